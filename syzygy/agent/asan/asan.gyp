@@ -52,6 +52,8 @@
         'heap.h',
         'heap_checker.cc',
         'heap_checker.h',
+        'heap_statistics.cc',
+        'heap_statistics.h',
         'heap_manager.h',
         'memory_interceptors.cc',
         'memory_interceptors.h',
@@ -89,6 +91,8 @@
         'memory_notifiers/null_memory_notifier.h',
         'memory_notifiers/shadow_memory_notifier.cc',
         'memory_notifiers/shadow_memory_notifier.h',
+        'quarantines/ring_sharded_quarantine.h',
+        'quarantines/ring_sharded_quarantine_impl.h',
         'quarantines/sharded_quarantine.h',
         'quarantines/sharded_quarantine_impl.h',
         'quarantines/size_limited_quarantine.h',
@@ -229,6 +233,7 @@
         'circular_queue_unittest.cc',
         'error_info_unittest.cc',
         'heap_checker_unittest.cc',
+        'heap_statistics_unittest.cc',
         'memory_interceptors_unittest.cc',
         'page_allocator_unittest.cc',
         'page_protection_helpers_unittest.cc',
@@ -247,6 +252,7 @@
         'heaps/zebra_block_heap_unittest.cc',
         'heap_managers/block_heap_manager_unittest.cc',
         'memory_notifiers/shadow_memory_notifier_unittest.cc',
+        'quarantines/ring_sharded_quarantine_unittest.cc',
         'quarantines/sharded_quarantine_unittest.cc',
         'quarantines/size_limited_quarantine_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
@@ -270,5 +276,29 @@
         },
       },
     },
+    {
+      # Micro-benchmarks of the runtime. These aren't part of the unittests,
+      # as their only output is the metrics they emit.
+      'target_name': 'syzyasan_rtl_benchmarks',
+      'type': 'executable',
+      'sources': [
+        'syzyasan_rtl_benchmarks.cc',
+        'unittest_util.cc',
+        'unittest_util.h',
+        '<(src)/base/test/run_all_unittests.cc',
+      ],
+      'dependencies': [
+        'syzyasan_rtl_lib',
+        'syzyasan_rtl',
+        '<(src)/base/base.gyp:base',
+        '<(src)/base/base.gyp:test_support_base',
+        '<(src)/syzygy/agent/common/common.gyp:agent_common_lib',
+        '<(src)/syzygy/core/core.gyp:core_unittest_utils',
+        '<(src)/syzygy/testing/testing.gyp:testing_lib',
+        '<(src)/syzygy/trace/agent_logger/agent_logger.gyp:agent_logger_lib',
+        '<(src)/testing/gmock.gyp:gmock',
+        '<(src)/testing/gtest.gyp:gtest',
+       ],
+    },
   ],
 }
@@ -54,7 +54,12 @@ void InitExecutionContext(const CONTEXT& rtl_context,
 
 }  // namespace
 
-AsanLogger::AsanLogger() : log_as_text_(true), minidump_on_failure_(false) {
+AsanLogger::AsanLogger()
+    : log_as_text_(true), minidump_on_failure_(false), pending_since_(0) {
+}
+
+AsanLogger::~AsanLogger() {
+  Flush();
 }
 
 void AsanLogger::Init() {
@@ -81,6 +86,7 @@ void AsanLogger::Init() {
 }
 
 void AsanLogger::Stop() {
+  Flush();
   if (rpc_binding_.Get() != NULL) {
     common::rpc::InvokeRpc(
         &LoggerClient_Stop,
@@ -89,19 +95,41 @@ void AsanLogger::Stop() {
 }
 
 void AsanLogger::Write(const std::string& message) {
-  // If we're bound to a logging endpoint, log the message there.
-  if (rpc_binding_.Get() != NULL) {
-    common::rpc::InvokeRpc(
-        &LoggerClient_Write,
-        rpc_binding_.Get(),
-        reinterpret_cast<const unsigned char*>(message.c_str()));
+  // If we're bound to a logging endpoint, log the message there. The logger
+  // ignores empty messages.
+  if (rpc_binding_.Get() == NULL || message.empty())
+    return;
+
+  base::AutoLock auto_lock(pending_lock_);
+  DWORD now = ::GetTickCount();
+  if (pending_.empty()) {
+    pending_.reserve(kMaxPendingSize);
+    pending_since_ = now;
+  }
+
+  // The logger terminates each message with a newline, which has to be done
+  // here for the messages to be sent together.
+  pending_.append(message);
+  if (message[message.size() - 1] != '\n')
+    pending_.push_back('\n');
+
+  if (pending_.size() >= kMaxPendingSize ||
+      now - pending_since_ >= kMaxPendingAgeMs) {
+    FlushUnlocked();
   }
 }
 
+void AsanLogger::Flush() {
+  base::AutoLock auto_lock(pending_lock_);
+  FlushUnlocked();
+}
+
 void AsanLogger::WriteWithContext(const std::string& message,
                                   const CONTEXT& context) {
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
+    base::AutoLock auto_lock(pending_lock_);
+    FlushUnlocked();
     ExecutionContext exec_context = {};
     InitExecutionContext(context, &exec_context);
     common::rpc::InvokeRpc(
@@ -117,6 +145,8 @@ void AsanLogger::WriteWithStackTrace(const std::string& message,
                                      size_t trace_length) {
   // If we're bound to a logging endpoint, log the message there.
   if (rpc_binding_.Get() != NULL) {
+    base::AutoLock auto_lock(pending_lock_);
+    FlushUnlocked();
     common::rpc::InvokeRpc(
         &LoggerClient_WriteWithTrace,
         rpc_binding_.Get(),
@@ -132,6 +162,7 @@ void AsanLogger::SaveMiniDump(CONTEXT* context, AsanErrorInfo* error_info) {
 
   if (rpc_binding_.Get() == NULL)
     return;
+  Flush();
 
   EXCEPTION_RECORD exception = {};
   exception.ExceptionCode = EXCEPTION_ARRAY_BOUNDS_EXCEEDED;
@@ -146,5 +177,47 @@ void AsanLogger::SaveMiniDump(CONTEXT* context, AsanErrorInfo* error_info) {
                          reinterpret_cast<unsigned long>(&pointers), 0);
 }
 
+void AsanLogger::SaveTargetedMiniDump(
+    CONTEXT* context,
+    AsanErrorInfo* error_info,
+    const trace::common::MiniDumpMemoryRanges& ranges) {
+  DCHECK(context != NULL);
+  DCHECK(error_info != NULL);
+
+  if (rpc_binding_.Get() == NULL)
+    return;
+  Flush();
+
+  // The logger expects the address of the memory ranges to be the last
+  // parameter of the exception record.
+  EXCEPTION_RECORD exception = {};
+  exception.ExceptionCode = EXCEPTION_ARRAY_BOUNDS_EXCEEDED;
+  exception.ExceptionAddress = reinterpret_cast<PVOID>(context->Eip);
+  exception.NumberParameters = 3;
+  exception.ExceptionInformation[0] = reinterpret_cast<ULONG_PTR>(context);
+  exception.ExceptionInformation[1] = reinterpret_cast<ULONG_PTR>(error_info);
+  exception.ExceptionInformation[2] = reinterpret_cast<ULONG_PTR>(&ranges);
+
+  const EXCEPTION_POINTERS pointers = { &exception, context };
+  common::rpc::InvokeRpc(&LoggerClient_SaveMiniDump, rpc_binding_.Get(),
+                         ::GetCurrentThreadId(),
+                         reinterpret_cast<unsigned long>(&pointers),
+                         trace::common::kSaveMiniDumpTargetedMemory);
+}
+
+void AsanLogger::FlushUnlocked() {
+  pending_lock_.AssertAcquired();
+
+  if (pending_.empty())
+    return;
+  if (rpc_binding_.Get() != NULL) {
+    common::rpc::InvokeRpc(
+        &LoggerClient_Write,
+        rpc_binding_.Get(),
+        reinterpret_cast<const unsigned char*>(pending_.c_str()));
+  }
+  pending_.clear();
+}
+
 }  // namespace asan
 }  // namespace agent
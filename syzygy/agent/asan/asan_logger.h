@@ -18,7 +18,9 @@
 #include <string>
 
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/trace/common/minidump_memory_ranges.h"
 
 namespace agent {
 namespace asan {
@@ -26,9 +28,23 @@ namespace asan {
 struct AsanErrorInfo;
 
 // A wrapper class to manage the singleton Asan RPC logger instance.
+//
+// The plain text messages are buffered and sent to the logger in batches, one
+// RPC per batch. The buffer is flushed once it's large enough or old enough,
+// and before any other request to the logger so that the log stays in order.
+// It's also flushed when an error is reported, and when the logger is stopped
+// or destroyed.
 class AsanLogger {
  public:
+  // The size of the buffered messages above which they're sent right away.
+  static const size_t kMaxPendingSize = 4096;
+
+  // The age of the oldest buffered message above which the buffer is flushed
+  // by the next write, in milliseconds.
+  static const DWORD kMaxPendingAgeMs = 500;
+
   AsanLogger();
+  ~AsanLogger();
 
   // Set the RPC instance ID to use. If an instance-id is to be used by the
   // logger, it must be set before calling Init().
@@ -52,9 +68,13 @@ class AsanLogger {
   // Stop the logger.
   void Stop();
 
-  // Write a @p message to the logger.
+  // Write a @p message to the logger. The message may be buffered, and a
+  // trailing newline is added if it doesn't have one.
   void Write(const std::string& message);
 
+  // Send the buffered messages to the logger.
+  void Flush();
+
   // Write a @p message to the logger, and have the logger include the most
   // detailed and accurate stack trace it can derive given the execution
   // @p context .
@@ -70,7 +90,18 @@ class AsanLogger {
   // @p context and @p error_info.
   void SaveMiniDump(CONTEXT* context, AsanErrorInfo* error_info);
 
+  // Ask the logger to capture a minidump of the process for the given
+  // @p context and @p error_info, which only includes the threads and modules
+  // of the process and the memory described by @p ranges.
+  void SaveTargetedMiniDump(CONTEXT* context,
+                            AsanErrorInfo* error_info,
+                            const trace::common::MiniDumpMemoryRanges& ranges);
+
  protected:
+  // Sends the buffered messages to the logger.
+  // @note This must be called under pending_lock_.
+  void FlushUnlocked();
+
   // The RPC binding.
   ::common::rpc::ScopedRpcBinding rpc_binding_;
 
@@ -85,6 +116,16 @@ class AsanLogger {
   // Default: false.
   bool minidump_on_failure_;
 
+  // The messages that haven't been sent yet, each terminated by a newline,
+  // and the time at which the oldest one was written.
+  // Under pending_lock_.
+  std::string pending_;
+  DWORD pending_since_;
+
+  // Serializes the writes, so that the buffered messages are sent in order
+  // with the other requests.
+  base::Lock pending_lock_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AsanLogger);
 };
@@ -44,6 +44,7 @@ using testing::Return;
 class TestAsanLogger : public AsanLogger {
  public:
   using AsanLogger::instance_id_;
+  using AsanLogger::pending_;
   using AsanLogger::rpc_binding_;
 };
 
@@ -97,6 +98,7 @@ TEST_F(AsanLoggerTest, EndToEnd) {
     AsanErrorInfo info = {};
     client_.SaveMiniDump(&ctx, &info);
     client_.Write(kMessage);
+    client_.Flush();
 
     // Shutdown the logging service.
     ASSERT_TRUE(server.Stop());
@@ -118,6 +120,97 @@ TEST_F(AsanLoggerTest, EndToEnd) {
   // TODO(rogerm): Inspect the contents of the minidump.
 }
 
+TEST_F(AsanLoggerTest, BufferedWrites) {
+  {
+    // Setup a log file destination.
+    base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
+
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_destination(destination.get());
+    ASSERT_TRUE(server.Start());
+
+    // Use the AsanLogger client.
+    client_.set_instance_id(instance_id_);
+    client_.Init();
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+
+    // The messages are buffered until they're flushed, and the missing
+    // newlines are added.
+    client_.Write("first\n");
+    client_.Write("");
+    client_.Write("second");
+    EXPECT_EQ("first\nsecond\n", client_.pending_);
+    client_.Flush();
+    EXPECT_TRUE(client_.pending_.empty());
+
+    // A write that fills the buffer is sent right away.
+    client_.Write(std::string(AsanLogger::kMaxPendingSize, 'x'));
+    EXPECT_TRUE(client_.pending_.empty());
+
+    // The buffered messages are sent before a stack trace.
+    client_.Write("third");
+    const void* trace[] = { &trace };
+    client_.WriteWithStackTrace("trace\n", trace, arraysize(trace));
+    EXPECT_TRUE(client_.pending_.empty());
+
+    // Shutdown the logging service.
+    ASSERT_TRUE(server.Stop());
+    ASSERT_TRUE(server.Join());
+  }
+
+  // Inspect the log file contents.
+  std::string content;
+  ASSERT_TRUE(base::ReadFileToString(temp_path_, &content));
+  std::string expected("first\nsecond\n");
+  expected.append(AsanLogger::kMaxPendingSize, 'x');
+  expected.append("\nthird\ntrace\n");
+  EXPECT_NE(std::string::npos, content.find(expected));
+}
+
+TEST_F(AsanLoggerTest, TargetedMiniDump) {
+  {
+    // Start up the logging service.
+    trace::agent_logger::AgentLogger server;
+    trace::agent_logger::RpcLoggerInstanceManager instance_manager(&server);
+    server.set_instance_id(instance_id_);
+    server.set_minidump_dir(temp_dir_.path());
+    ASSERT_TRUE(server.Start());
+
+    // Use the AsanLogger client.
+    client_.set_instance_id(instance_id_);
+    client_.set_minidump_on_failure(true);
+    client_.Init();
+    ASSERT_TRUE(client_.rpc_binding_.Get() != NULL);
+
+    // Generate a minidump that includes a buffer and an unreadable range,
+    // which is skipped.
+    static const char kBuffer[] = "This is the targeted memory";
+    trace::common::MiniDumpMemoryRange memory_ranges[] = {
+        { reinterpret_cast<uint32>(kBuffer), sizeof(kBuffer) },
+        { 0, 4096 } };
+    trace::common::MiniDumpMemoryRanges ranges = {
+        arraysize(memory_ranges), reinterpret_cast<uint32>(memory_ranges) };
+    CONTEXT ctx = {};
+    ::RtlCaptureContext(&ctx);
+    AsanErrorInfo info = {};
+    client_.SaveTargetedMiniDump(&ctx, &info, ranges);
+
+    // Shutdown the logging service.
+    ASSERT_TRUE(server.Stop());
+    ASSERT_TRUE(server.Join());
+  }
+
+  // We should have exactly one minidump in the temp directory.
+  using base::FileEnumerator;
+  FileEnumerator fe(temp_dir_.path(), false, FileEnumerator::FILES, L"*.dmp");
+  base::FilePath minidump(fe.Next());
+  EXPECT_FALSE(minidump.empty());
+  EXPECT_TRUE(fe.Next().empty());
+}
+
 TEST_F(AsanLoggerTest, Stop) {
   // Setup a log file destination.
   base::ScopedFILE destination(base::OpenFile(temp_path_, "wb"));
@@ -132,25 +132,21 @@ void ReportBadAccess(const uint8* location, AccessMode access_mode) {
                         asan_context);
 }
 
-void TestMemoryRange(const uint8* memory,
+bool TestMemoryRange(const uint8* memory,
                      size_t size,
                      AccessMode access_mode) {
   if (size == 0U)
-    return;
-  // TODO(sebmarchand): This approach is pretty limited because it only checks
-  //     if the first and the last elements are accessible. Once we have the
-  //     plumbing in place we should benchmark a check that looks at each
-  //     address to be touched (via the shadow memory, 8 bytes at a time).
-  if (!Shadow::IsAccessible(memory) ||
-      !Shadow::IsAccessible(memory + size - 1)) {
-    const uint8* location = NULL;
-    if (!Shadow::IsAccessible(memory)) {
-      location = memory;
-    } else {
-      location = memory + size - 1;
-    }
-    ReportBadAccess(location, access_mode);
-  }
+    return true;
+
+  // Check every byte of the range. This is done in bulk via the shadow memory
+  // so it remains cheap for large ranges.
+  const uint8* location = reinterpret_cast<const uint8*>(
+      Shadow::FindFirstPoisonedByte(memory, size));
+  if (location == NULL)
+    return true;
+
+  ReportBadAccess(location, access_mode);
+  return false;
 }
 
 }  // namespace asan
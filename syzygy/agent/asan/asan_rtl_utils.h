@@ -71,7 +71,9 @@ void ReportBadAccess(const uint8* location, AccessMode access_mode);
 //     to check.
 // @param size The size of the memory range that we want to check.
 // @param access_mode The access mode.
-void TestMemoryRange(const uint8* memory,
+// @returns true if the whole range is accessible, false if an error has been
+//     reported.
+bool TestMemoryRange(const uint8* memory,
                      size_t size,
                      AccessMode access_mode);
 
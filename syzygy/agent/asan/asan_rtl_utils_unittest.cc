@@ -118,7 +118,8 @@ TEST(AsanRtlUtilsTest, TestMemoryRange) {
   const size_t kTestBufferSize = 64;
   scoped_ptr<uint8> test_buffer(new uint8[kTestBufferSize]);
 
-  TestMemoryRange(test_buffer.get(), kTestBufferSize, access_mode);
+  EXPECT_TRUE(TestMemoryRange(test_buffer.get(), kTestBufferSize,
+                              access_mode));
   EXPECT_FALSE(memory_error_detected);
 
   // Poison the second half of the buffer.
@@ -127,15 +128,26 @@ TEST(AsanRtlUtilsTest, TestMemoryRange) {
                  kUserRedzoneMarker);
 
   // Test the first half of the buffer, no error should be detected.
-  TestMemoryRange(test_buffer.get(), kTestBufferSize / 2, access_mode);
+  EXPECT_TRUE(TestMemoryRange(test_buffer.get(), kTestBufferSize / 2,
+                              access_mode));
   EXPECT_FALSE(memory_error_detected);
 
-  // Test the second half of the buffer, we should get an invalid access on its
-  // last byte.
-  TestMemoryRange(test_buffer.get(), kTestBufferSize, access_mode);
+  // Test the whole buffer, we should get an invalid access on the first byte
+  // of its second half.
+  EXPECT_FALSE(TestMemoryRange(test_buffer.get(), kTestBufferSize,
+                               access_mode));
   EXPECT_TRUE(memory_error_detected);
-  EXPECT_EQ(test_buffer.get() + kTestBufferSize - 1, last_error_info.location);
+  EXPECT_EQ(test_buffer.get() + kTestBufferSize / 2, last_error_info.location);
   EXPECT_EQ(access_mode, last_error_info.access_mode);
+  memory_error_detected = false;
+
+  // Poison a range in the middle of the buffer only. Checking the end points
+  // isn't sufficient to detect this.
+  Shadow::Unpoison(test_buffer.get(), kTestBufferSize);
+  Shadow::Poison(test_buffer.get() + 16, 8, kUserRedzoneMarker);
+  TestMemoryRange(test_buffer.get(), kTestBufferSize, access_mode);
+  EXPECT_TRUE(memory_error_detected);
+  EXPECT_EQ(test_buffer.get() + 16, last_error_info.location);
 
   Shadow::Unpoison(test_buffer.get(), kTestBufferSize);
 }
@@ -28,12 +28,12 @@
 #include "base/win/wrapped_window_proc.h"
 #include "syzygy/agent/asan/asan_logger.h"
 #include "syzygy/agent/asan/block.h"
+#include "syzygy/agent/asan/error_info.h"
 #include "syzygy/agent/asan/heap_checker.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
 #include "syzygy/agent/asan/windows_heap_adapter.h"
-#include "syzygy/crashdata/crashdata.h"
 #include "syzygy/trace/client/client_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
@@ -47,6 +47,22 @@ using agent::asan::StackCaptureCache;
 using agent::asan::WindowsHeapAdapter;
 using base::win::WinProcExceptionFilter;
 
+// The maximum number of memory ranges of a targeted minidump. The ranges are
+// gathered on the stack while handling an error.
+const size_t kMaxTargetedMiniDumpRanges = 256;
+
+// The thread IDs below this value are recorded in the thread ID bitmap, with
+// one bit per multiple of 4. This makes for a 128KB bitmap, whose pages are
+// only backed by physical memory once they're touched.
+const uint32 kThreadIdBitmapMaxId = 1 << 22;
+const size_t kThreadIdBitmapSize = kThreadIdBitmapMaxId / 4 / 8;
+const size_t kBitsPerThreadIdBitmapWord = sizeof(LONG) * 8;
+
+// Determines if a thread ID is represented in the thread ID bitmap.
+bool ThreadIdIsInBitmap(uint32 thread_id) {
+  return thread_id < kThreadIdBitmapMaxId && (thread_id & 3) == 0;
+}
+
 // Signatures of the various Breakpad functions for setting custom crash
 // key-value pairs.
 // Post r194002.
@@ -244,14 +260,25 @@ void InitializeExceptionRecord(const AsanErrorInfo* error_info,
   pointers->ContextRecord = const_cast<CONTEXT*>(&error_info->context);
 }
 
-// Creates a serialized protobuf representing crash data.
-bool PopulateProtobuf(const AsanErrorInfo& error_info, std::string* protobuf) {
-  DCHECK_NE(static_cast<std::string*>(nullptr), protobuf);
-  crashdata::Value value;
-  PopulateErrorInfo(error_info, &value);
-  if (!value.SerializeToString(protobuf))
-    return false;
-  return true;
+// The maximum size of the crash data sent to Breakpad. Most of it goes to the
+// corrupt ranges, which are dropped least relevant first when they don't fit.
+const size_t kMaxCrashDataSize = 64 * 1024;
+
+// The buffer receiving the crash data. This is preallocated so that nothing
+// gets allocated from a heap that may well be corrupt while reporting a crash.
+// @note Under block_protect_lock.
+uint8 crash_data_buffer[kMaxCrashDataSize];
+
+// Serializes the crash data protobuf of an error to crash_data_buffer.
+// @param error_info The information about the error.
+// @returns the size of the crash data.
+// @note Under block_protect_lock.
+size_t SerializeCrashData(const AsanErrorInfo& error_info) {
+  size_t size = SerializeErrorInfo(
+      error_info, crash_data_buffer, sizeof(crash_data_buffer));
+  if (size == 0)
+    LOG(ERROR) << "The crash data doesn't fit in its buffer.";
+  return size;
 }
 
 // The breakpad error handler. It is expected that this will be bound in a
@@ -272,10 +299,9 @@ void BreakpadErrorHandler(const BreakpadFunctions& breakpad_functions,
   InitializeExceptionRecord(error_info, &exception, &pointers);
 
   if (breakpad_functions.report_crash_with_protobuf_ptr) {
-    std::string protobuf;
-    PopulateProtobuf(*error_info, &protobuf);
+    size_t size = SerializeCrashData(*error_info);
     breakpad_functions.report_crash_with_protobuf_ptr(
-        &pointers, protobuf.data(), protobuf.length());
+        &pointers, reinterpret_cast<const char*>(crash_data_buffer), size);
   } else {
     breakpad_functions.crash_for_exception_ptr(&pointers);
   }
@@ -426,9 +452,17 @@ AsanRuntime::AsanRuntime()
     : logger_(), stack_cache_(), asan_error_callback_(), heap_manager_() {
   ::common::SetDefaultAsanParameters(&params_);
   starting_ticks_ = ::GetTickCount();
+
+  // If this fails then all the thread IDs are simply kept in the set.
+  thread_id_bitmap_ = reinterpret_cast<volatile LONG*>(::VirtualAlloc(
+      NULL, kThreadIdBitmapSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
 }
 
 AsanRuntime::~AsanRuntime() {
+  if (thread_id_bitmap_ != NULL) {
+    ::VirtualFree(const_cast<LONG*>(thread_id_bitmap_), 0, MEM_RELEASE);
+    thread_id_bitmap_ = NULL;
+  }
 }
 
 void AsanRuntime::SetUp(const std::wstring& flags_command_line) {
@@ -495,6 +529,8 @@ void AsanRuntime::TearDown() {
   WindowsHeapAdapter::TearDown();
   TearDownHeapManager();
   TearDownStackCache();
+  if (params_.deduplicate_error_reports)
+    LogDuplicateErrorCounts();
   TearDownLogger();
   DCHECK(asan_error_callback_.is_null() == FALSE);
   asan_error_callback_.Reset();
@@ -511,11 +547,32 @@ void AsanRuntime::TearDown() {
 void AsanRuntime::OnErrorImpl(AsanErrorInfo* error_info) {
   DCHECK_NE(reinterpret_cast<AsanErrorInfo*>(NULL), error_info);
 
+  // Walking and formatting the stacks of an error and saving a minidump are
+  // costly, and a noisy bug can hit the same site over and over. Duplicates
+  // are only counted, and summarized when the runtime is torn down. There is
+  // nothing to do for exit_on_failure, as the first report already exited.
+  if (params_.deduplicate_error_reports && !RecordReportedError(*error_info))
+    return;
+
   LogAsanErrorInfo(error_info);
 
+  // Make sure that the error makes it to the log, whatever happens to the
+  // process next.
+  logger_->Flush();
+
   if (params_.minidump_on_failure) {
     DCHECK(logger_.get() != NULL);
-    logger_->SaveMiniDump(&error_info->context, error_info);
+    if (params_.targeted_minidump) {
+      trace::common::MiniDumpMemoryRange ranges[kMaxTargetedMiniDumpRanges];
+      trace::common::MiniDumpMemoryRanges targeted_ranges = {};
+      targeted_ranges.count = ErrorInfoGetMiniDumpMemoryRanges(
+          stack_cache_.get(), *error_info, ranges, arraysize(ranges));
+      targeted_ranges.ranges = reinterpret_cast<uint32>(ranges);
+      logger_->SaveTargetedMiniDump(&error_info->context, error_info,
+                                    targeted_ranges);
+    } else {
+      logger_->SaveMiniDump(&error_info->context, error_info);
+    }
   }
 
   if (params_.exit_on_failure) {
@@ -622,9 +679,9 @@ bool AsanRuntime::GetAsanFlagsEnvVar(std::wstring* env_var_wstr) {
 void AsanRuntime::PropagateParams() {
   // This function has to be kept in sync with the AsanParameters struct. These
   // checks will ensure that this is the case.
-  COMPILE_ASSERT(sizeof(::common::AsanParameters) == 56,
+  COMPILE_ASSERT(sizeof(::common::AsanParameters) == 60,
                  must_update_propagate_params);
-  COMPILE_ASSERT(::common::kAsanParametersVersion == 8,
+  COMPILE_ASSERT(::common::kAsanParametersVersion == 18,
                  must_update_parameters_version);
 
   // Push the configured parameter values to the appropriate endpoints.
@@ -633,11 +690,15 @@ void AsanRuntime::PropagateParams() {
       params_.reporting_period);
   common::StackCapture::set_bottom_frames_to_skip(
       params_.bottom_frames_to_skip);
+  common::StackCapture::set_fast_capture(params_.enable_fast_stack_capture);
+  BlockSetChecksumSampling(params_.enable_sampled_block_checksums);
   stack_cache_->set_max_num_frames(params_.max_num_frames);
   // ignored_stack_ids is used locally by AsanRuntime.
   logger_->set_log_as_text(params_.log_as_text);
   // exit_on_failure is used locally by AsanRuntime.
   logger_->set_minidump_on_failure(params_.minidump_on_failure);
+  if (params_.enable_lazy_shadow_commit)
+    Shadow::EnableLazyCommit();
 }
 
 size_t AsanRuntime::CalculateCorruptHeapInfoSize(
@@ -790,6 +851,70 @@ void AsanRuntime::LogAsanErrorInfo(AsanErrorInfo* error_info) {
   }
 }
 
+bool AsanRuntime::ReportedErrorKey::operator<(
+    const ReportedErrorKey& other) const {
+  if (error_type != other.error_type)
+    return error_type < other.error_type;
+  if (crash_stack_id != other.crash_stack_id)
+    return crash_stack_id < other.crash_stack_id;
+  return alloc_stack_id < other.alloc_stack_id;
+}
+
+void AsanRuntime::GetReportedErrorKey(const AsanErrorInfo& error_info,
+                                      ReportedErrorKey* key) {
+  DCHECK_NE(static_cast<ReportedErrorKey*>(nullptr), key);
+  key->error_type = error_info.error_type;
+  key->crash_stack_id = error_info.crash_stack_id;
+  key->alloc_stack_id = 0;
+  if (error_info.block_info.alloc_stack_size != 0) {
+    key->alloc_stack_id = common::ComputeStackTraceHash(
+        const_cast<void**>(error_info.block_info.alloc_stack),
+        error_info.block_info.alloc_stack_size);
+  }
+}
+
+bool AsanRuntime::RecordReportedError(const AsanErrorInfo& error_info) {
+  ReportedErrorKey key = {};
+  GetReportedErrorKey(error_info, &key);
+
+  base::AutoLock lock(reported_errors_lock_);
+  std::pair<ReportedErrorMap::iterator, bool> result =
+      reported_errors_.insert(std::make_pair(key, 0));
+  if (result.second)
+    return true;
+  ++result.first->second;
+  return false;
+}
+
+size_t AsanRuntime::GetDuplicateErrorCount(const AsanErrorInfo& error_info) {
+  ReportedErrorKey key = {};
+  GetReportedErrorKey(error_info, &key);
+
+  base::AutoLock lock(reported_errors_lock_);
+  ReportedErrorMap::const_iterator it = reported_errors_.find(key);
+  if (it == reported_errors_.end())
+    return 0;
+  return it->second;
+}
+
+void AsanRuntime::LogDuplicateErrorCounts() {
+  DCHECK(logger_.get() != NULL);
+  if (!logger_->log_as_text())
+    return;
+
+  base::AutoLock lock(reported_errors_lock_);
+  ReportedErrorMap::const_iterator it = reported_errors_.begin();
+  for (; it != reported_errors_.end(); ++it) {
+    if (it->second == 0)
+      continue;
+    logger_->Write(base::StringPrintf(
+        "SyzyASAN: %d duplicate reports of %s (stack_id=0x%08X, "
+        "alloc_stack_id=0x%08X) were omitted.\n",
+        it->second, ErrorInfoAccessTypeToStr(it->first.error_type),
+        it->first.crash_stack_id, it->first.alloc_stack_id));
+  }
+}
+
 void AsanRuntime::GetBadAccessInformation(AsanErrorInfo* error_info) {
   base::AutoLock lock(lock_);
 
@@ -817,11 +942,24 @@ void AsanRuntime::set_allocation_filter_flag(bool value) {
 
 void AsanRuntime::AddThreadId(uint32 thread_id) {
   DCHECK_NE(0u, thread_id);
+  if (thread_id_bitmap_ != NULL && ThreadIdIsInBitmap(thread_id)) {
+    size_t bit = thread_id / 4;
+    ::InterlockedOr(thread_id_bitmap_ + bit / kBitsPerThreadIdBitmapWord,
+                    1 << (bit % kBitsPerThreadIdBitmapWord));
+    return;
+  }
+
   base::AutoLock lock(thread_ids_lock_);
   thread_ids_.insert(thread_id);
 }
 
 bool AsanRuntime::ThreadIdIsValid(uint32 thread_id) {
+  if (thread_id_bitmap_ != NULL && ThreadIdIsInBitmap(thread_id)) {
+    size_t bit = thread_id / 4;
+    LONG word = thread_id_bitmap_[bit / kBitsPerThreadIdBitmapWord];
+    return (word & (1 << (bit % kBitsPerThreadIdBitmapWord))) != 0;
+  }
+
   base::AutoLock lock(thread_ids_lock_);
   return thread_ids_.count(thread_id) > 0;
 }
@@ -829,7 +967,7 @@ bool AsanRuntime::ThreadIdIsValid(uint32 thread_id) {
 bool AsanRuntime::HeapIdIsValid(HeapManagerInterface::HeapId heap_id) {
   // Consider dying heaps in this query, as they are still valid from the
   // point of view of an error report.
-  return heap_manager_->IsValidHeapIdUnlocked(heap_id, true);
+  return heap_manager_->IsValidHeapId(heap_id, true);
 }
 
 HeapType AsanRuntime::GetHeapType(HeapManagerInterface::HeapId heap_id) {
@@ -958,12 +1096,14 @@ LONG AsanRuntime::ExceptionFilterImpl(bool is_unhandled,
     record.ExceptionRecord = old_record;
   }
 
+  // The process may not survive what comes next.
+  runtime_->logger_->Flush();
+
   if (breakpad_functions.report_crash_with_protobuf_ptr) {
     // This method is expected to terminate the process.
-    std::string protobuf;
-    PopulateProtobuf(error_info, &protobuf);
+    size_t size = SerializeCrashData(error_info);
     breakpad_functions.report_crash_with_protobuf_ptr(
-        exception, protobuf.data(), protobuf.length());
+        exception, reinterpret_cast<const char*>(crash_data_buffer), size);
     return EXCEPTION_CONTINUE_SEARCH;
   }
 
@@ -17,6 +17,7 @@
 #ifndef SYZYGY_AGENT_ASAN_ASAN_RUNTIME_H_
 #define SYZYGY_AGENT_ASAN_ASAN_RUNTIME_H_
 
+#include <map>
 #include <set>
 #include <string>
 
@@ -104,8 +105,6 @@ class AsanRuntime {
   // Returns true if we should ignore the given @p stack_id, false
   // otherwise.
   bool ShouldIgnoreError(::common::AsanStackId stack_id) const {
-    // TODO(sebmarchand): Keep a list of the stack ids that have already been
-    //     reported so we can avoid reporting the same error multiple times.
     return params_.ignored_stack_ids_set.find(stack_id) !=
         params_.ignored_stack_ids_set.end();
   }
@@ -202,6 +201,20 @@ class AsanRuntime {
   // Logs information about an Asan error.
   void LogAsanErrorInfo(AsanErrorInfo* error_info);
 
+  // Records an error in the set of reported errors. Errors are identified by
+  // their type, their access stack and their allocation stack.
+  // @param error_info The information about the error.
+  // @returns true if this is the first report of the error, false if it is a
+  //     duplicate, in which case it is counted.
+  bool RecordReportedError(const AsanErrorInfo& error_info);
+
+  // @returns the number of duplicates of an error that were counted by
+  //     RecordReportedError.
+  size_t GetDuplicateErrorCount(const AsanErrorInfo& error_info);
+
+  // Logs the number of duplicates of each reported error that has some.
+  void LogDuplicateErrorCounts();
+
   // The heap manager.
   scoped_ptr<heap_managers::BlockHeapManager> heap_manager_;  // Under lock_.
 
@@ -224,6 +237,23 @@ class AsanRuntime {
   // Tear down the heap manager.
   void TearDownHeapManager();
 
+  // Identifies an error for the purpose of deduplicating error reports.
+  struct ReportedErrorKey {
+    BadAccessKind error_type;
+    common::StackCapture::StackId crash_stack_id;
+    // The hash of the allocation stack trace of the block, or 0 if there is
+    // none.
+    uint32 alloc_stack_id;
+
+    bool operator<(const ReportedErrorKey& other) const;
+  };
+  // Maps the reported errors to their number of duplicates.
+  typedef std::map<ReportedErrorKey, size_t> ReportedErrorMap;
+
+  // Gets the key of an error.
+  static void GetReportedErrorKey(const AsanErrorInfo& error_info,
+                                  ReportedErrorKey* key);
+
   // The unhandled exception filter registered by this runtime. This is used
   // to catch unhandled exceptions so we can augment them with information
   // about the corrupt heap.
@@ -264,11 +294,19 @@ class AsanRuntime {
   // bracketing valid alloc and free ticks values.
   uint32 starting_ticks_;
 
-  // The set of thread IDs that have been seen in the current process.
-  // This is used to validate thread IDs in a block trailer.
+  // The thread IDs that have been seen in the current process. This is used
+  // to validate thread IDs in a block trailer. The IDs that are small
+  // multiples of 4, which is the case of the vast majority of Windows thread
+  // IDs, are recorded in a bitmap that is only ever set, and that can thus
+  // be queried without a lock. The other IDs are kept in a set.
+  volatile LONG* thread_id_bitmap_;
   base::Lock thread_ids_lock_;
   std::hash_set<uint32> thread_ids_;  // Under thread_ids_lock_.
 
+  // The errors that were reported in full, when deduplicating error reports.
+  base::Lock reported_errors_lock_;
+  ReportedErrorMap reported_errors_;  // Under reported_errors_lock_.
+
   DISALLOW_COPY_AND_ASSIGN(AsanRuntime);
 };
 
@@ -34,6 +34,7 @@ using agent::asan::AsanErrorInfo;
 class TestAsanRuntime : public AsanRuntime {
  public:
   using AsanRuntime::PropagateParams;
+  using AsanRuntime::GetDuplicateErrorCount;
 };
 
 class AsanRuntimeTest : public testing::TestWithAsanLogger {
@@ -108,6 +109,28 @@ TEST_F(AsanRuntimeTest, ThreadIdCache) {
   ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
 }
 
+TEST_F(AsanRuntimeTest, ThreadIdCacheMultiplesOfFour) {
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+
+  // Typical thread IDs, and neighbours sharing the same bitmap words.
+  EXPECT_FALSE(asan_runtime_.ThreadIdIsValid(4096));
+  EXPECT_FALSE(asan_runtime_.ThreadIdIsValid(4100));
+  asan_runtime_.AddThreadId(4096);
+  EXPECT_TRUE(asan_runtime_.ThreadIdIsValid(4096));
+  EXPECT_FALSE(asan_runtime_.ThreadIdIsValid(4100));
+  EXPECT_FALSE(asan_runtime_.ThreadIdIsValid(4097));
+  asan_runtime_.AddThreadId(4100);
+  EXPECT_TRUE(asan_runtime_.ThreadIdIsValid(4100));
+
+  // A very large thread ID.
+  EXPECT_FALSE(asan_runtime_.ThreadIdIsValid(0x80000000));
+  asan_runtime_.AddThreadId(0x80000000);
+  EXPECT_TRUE(asan_runtime_.ThreadIdIsValid(0x80000000));
+
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+}
+
 TEST_F(AsanRuntimeTest, OnError) {
   ASSERT_NO_FATAL_FAILURE(
       asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
@@ -214,6 +237,42 @@ TEST_F(AsanRuntimeTest, IgnoredStackIds) {
   ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
 }
 
+TEST_F(AsanRuntimeTest, DeduplicateErrorReports) {
+  current_command_line_.AppendSwitch(::common::kParamDeduplicateErrorReports);
+  ASSERT_NO_FATAL_FAILURE(
+      asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
+  EXPECT_TRUE(asan_runtime_.params().deduplicate_error_reports);
+
+  asan_runtime_.params().check_heap_on_failure = false;
+  asan_runtime_.SetErrorCallBack(base::Bind(&TestCallback));
+
+  AsanErrorInfo bad_access_info = {};
+  RtlCaptureContext(&bad_access_info.context);
+  bad_access_info.error_type = USE_AFTER_FREE;
+  bad_access_info.crash_stack_id = 0xCAFEBABE;
+  bad_access_info.block_info.alloc_stack[0] =
+      reinterpret_cast<void*>(&TestCallback);
+  bad_access_info.block_info.alloc_stack_size = 1;
+
+  // The error callback is still invoked for the duplicates.
+  for (size_t i = 0; i < 3; ++i) {
+    callback_called = false;
+    asan_runtime_.OnError(&bad_access_info);
+    EXPECT_TRUE(callback_called);
+  }
+  EXPECT_EQ(2U, asan_runtime_.GetDuplicateErrorCount(bad_access_info));
+
+  // An error with another allocation stack is reported in full.
+  AsanErrorInfo other_access_info = bad_access_info;
+  other_access_info.block_info.alloc_stack_size = 0;
+  EXPECT_EQ(0U, asan_runtime_.GetDuplicateErrorCount(other_access_info));
+  asan_runtime_.OnError(&other_access_info);
+  EXPECT_EQ(0U, asan_runtime_.GetDuplicateErrorCount(other_access_info));
+  EXPECT_EQ(2U, asan_runtime_.GetDuplicateErrorCount(bad_access_info));
+
+  ASSERT_NO_FATAL_FAILURE(asan_runtime_.TearDown());
+}
+
 TEST_F(AsanRuntimeTest, HeapIdIsValid) {
   ASSERT_NO_FATAL_FAILURE(
       asan_runtime_.SetUp(current_command_line_.GetCommandLineString()));
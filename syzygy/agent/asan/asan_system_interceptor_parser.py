@@ -49,22 +49,27 @@ BOOL WINAPI asan_WriteFile(
     _Out_opt_ LPDWORD lpNumberOfBytesWritten,
     _Inout_opt_ LPOVERLAPPED lpOverlapped
     ) {
-  if (lpBuffer != NULL) {
-    TestMemoryRange(reinterpret_cast<const uint8*>(lpBuffer),
-                    nNumberOfBytesToWrite,
-                    agent::asan::ASAN_READ_ACCESS);
+  uint32 poison_epoch = Shadow::poison_epoch();
+  bool ranges_accessible = true;
+  if (lpBuffer != NULL &&
+      !TestMemoryRange(reinterpret_cast<const uint8*>(lpBuffer),
+                       nNumberOfBytesToWrite,
+                       agent::asan::ASAN_READ_ACCESS)) {
+    ranges_accessible = false;
   }
 
-  if (lpNumberOfBytesWritten != NULL) {
-    TestMemoryRange(reinterpret_cast<const uint8*>(lpNumberOfBytesWritten),
-                    sizeof(*lpNumberOfBytesWritten),
-                    agent::asan::ASAN_WRITE_ACCESS);
+  if (lpNumberOfBytesWritten != NULL &&
+      !TestMemoryRange(reinterpret_cast<const uint8*>(lpNumberOfBytesWritten),
+                       sizeof(*lpNumberOfBytesWritten),
+                       agent::asan::ASAN_WRITE_ACCESS)) {
+    ranges_accessible = false;
   }
 
-  if (lpOverlapped != NULL) {
-    TestMemoryRange(reinterpret_cast<const uint8*>(lpOverlapped),
-                    sizeof(*lpOverlapped),
-                    agent::asan::ASAN_READ_ACCESS);
+  if (lpOverlapped != NULL &&
+      !TestMemoryRange(reinterpret_cast<const uint8*>(lpOverlapped),
+                       sizeof(*lpOverlapped),
+                       agent::asan::ASAN_READ_ACCESS)) {
+    ranges_accessible = false;
   }
 
 
@@ -74,17 +79,22 @@ BOOL WINAPI asan_WriteFile(
   if (interceptor_tail_callback != NULL)
     (*interceptor_tail_callback)();
 
-
-  if (lpNumberOfBytesWritten != NULL) {
-    TestMemoryRange(reinterpret_cast<const uint8*>(lpNumberOfBytesWritten),
-                    sizeof(*lpNumberOfBytesWritten),
-                    agent::asan::ASAN_WRITE_ACCESS);
-  }
-
-  if (lpBuffer != NULL) {
-    TestMemoryRange(reinterpret_cast<const uint8*>(lpBuffer),
-                    nNumberOfBytesToWrite,
-                    agent::asan::ASAN_READ_ACCESS);
+  // The post-call checks are only done if something might have changed.
+  if (!ranges_accessible || Shadow::poison_epoch() != poison_epoch) {
+    if (lpNumberOfBytesWritten != NULL &&
+        !TestMemoryRange(
+            reinterpret_cast<const uint8*>(lpNumberOfBytesWritten),
+            sizeof(*lpNumberOfBytesWritten),
+            agent::asan::ASAN_WRITE_ACCESS)) {
+      ranges_accessible = false;
+    }
+
+    if (lpBuffer != NULL &&
+        !TestMemoryRange(reinterpret_cast<const uint8*>(lpBuffer),
+                         nNumberOfBytesToWrite,
+                         agent::asan::ASAN_READ_ACCESS)) {
+      ranges_accessible = false;
+    }
   }
 
   return ret;
@@ -225,9 +235,15 @@ instrumentation_filter_entry_template = Template("""
 #         the intercepted function.
 #     - param_checks_postcall: Optional parameter check done after the call to
 #         the intercepted function.
+#
+# The post-call checks are skipped if every range was accessible before the
+# call and no memory has been poisoned in the meantime, as they would then
+# necessarily succeed.
 interceptor_template = Template("""
 ${ret_type} ${calling_convention} \
 asan_${function_name}(${function_arguments}) {
+  uint32 poison_epoch = Shadow::poison_epoch();
+  bool ranges_accessible = true;
   ${buffer_check}
   ${param_checks_precall}
 
@@ -241,8 +257,10 @@ asan_${function_name}(${function_arguments}) {
   if (interceptor_tail_callback != NULL)
     (*interceptor_tail_callback)();
 
-  ${param_checks_postcall}
-  ${buffer_check}
+  if (!ranges_accessible || Shadow::poison_epoch() != poison_epoch) {
+    ${param_checks_postcall}
+    ${buffer_check}
+  }
 
   return ret;
 }
@@ -260,14 +278,17 @@ asan_${function_name}(${function_arguments}) {
 #
 # We need to do a double cast on the parameter to check to convert it to the
 # expected type (via a reinterpret_cast) and to lose the optional keyword
-# qualifier (via a const_cast).
+# qualifier (via a const_cast). The result of the check is accumulated in
+# ranges_accessible.
 param_checks_template = Template("""
-  if (${param_to_check} != NULL) {
-    TestMemoryRange(
-        const_cast<const uint8*>(
-            reinterpret_cast<const uint8 ${param_keyword}*>(${param_to_check})),
-        ${param_size},
-        agent::asan::ASAN_${access_type}_ACCESS);
+  if (${param_to_check} != NULL &&
+      !TestMemoryRange(
+          const_cast<const uint8*>(
+              reinterpret_cast<const uint8 ${param_keyword}*>(
+                  ${param_to_check})),
+          ${param_size},
+          agent::asan::ASAN_${access_type}_ACCESS)) {
+    ranges_accessible = false;
   }
 """)
 
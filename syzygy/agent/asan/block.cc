@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/asan/block.h"
 
+#include <intrin.h>
+#include <nmmintrin.h>
+
 #include <algorithm>
 
 #include "base/hash.h"
@@ -44,6 +47,68 @@ DECLARE_GET_MAX_BITFIELD_VALUE_FUNCTION(BlockHeader, body_size);
 
 const size_t kMaxBlockHeaderBodySize = GetMaxValueBlockHeader_body_size();
 
+// The number and the size of the chunks of the body that are checksummed
+// when the body of a block is sampled.
+const size_t kChecksumBodySampleCount = 16;
+const size_t kChecksumBodySampleSize = 64;
+
+// Indicates if the bodies of large blocks are sampled when calculating
+// checksums.
+bool checksum_sampling = false;
+
+// Determines if the CPU supports the SSE4.2 CRC32 instruction.
+bool CpuHasCrc32() {
+  int info[4] = {};
+  ::__cpuid(info, 1);
+  // SSE4.2 support is indicated by bit 20 of ECX.
+  return (info[2] & (1 << 20)) != 0;
+}
+
+// This is detected once, so that a given block is always checksummed with
+// the same function.
+const bool kUseCrc32 = CpuHasCrc32();
+
+// Calculates the CRC32C of a range of memory using the SSE4.2 instructions.
+uint32 Crc32cHash(const uint8* data, size_t size, uint32 crc) {
+  while (size >= sizeof(uint32)) {
+    crc = _mm_crc32_u32(crc, *reinterpret_cast<const uint32*>(data));
+    data += sizeof(uint32);
+    size -= sizeof(uint32);
+  }
+  while (size > 0) {
+    crc = _mm_crc32_u8(crc, *data);
+    ++data;
+    --size;
+  }
+  return crc;
+}
+
+// Accumulates the hash of a range of memory into @p hash. Uses CRC32C when it
+// is supported by the CPU, and SuperFastHash otherwise.
+void AccumulateHash(const uint8* data, size_t size, uint32* hash) {
+  DCHECK_NE(static_cast<uint32*>(nullptr), hash);
+  if (kUseCrc32) {
+    *hash = Crc32cHash(data, size, *hash);
+  } else {
+    *hash ^= base::SuperFastHash(reinterpret_cast<const char*>(data), size);
+  }
+}
+
+// Accumulates the hash of a sampled subset of the body of a block. The
+// first and the last chunks of the body are always included.
+void AccumulateSampledBodyHash(const BlockInfo& block_info, uint32* hash) {
+  DCHECK_LT(kChecksumBodySampleCount * kChecksumBodySampleSize,
+            block_info.body_size);
+  size_t stride = (block_info.body_size - kChecksumBodySampleSize) /
+      (kChecksumBodySampleCount - 1);
+  for (size_t i = 0; i < kChecksumBodySampleCount; ++i) {
+    size_t offset = i * stride;
+    if (i + 1 == kChecksumBodySampleCount)
+      offset = block_info.body_size - kChecksumBodySampleSize;
+    AccumulateHash(block_info.body + offset, kChecksumBodySampleSize, hash);
+  }
+}
+
 void InitializeBlockHeader(BlockInfo* block_info) {
   DCHECK_NE(static_cast<BlockInfo*>(NULL), block_info);
   DCHECK_NE(static_cast<BlockHeader*>(NULL), block_info->header);
@@ -216,6 +281,8 @@ BlockHeader* BlockGetHeaderFromBodyImpl(const void* const_body) {
 
 }  // namespace
 
+const size_t kBlockChecksumSampledBodySize = 4096;
+
 bool BlockPlanLayout(size_t chunk_size,
                      size_t alignment,
                      size_t size,
@@ -324,6 +391,37 @@ void BlockInitialize(const BlockLayout& layout,
   InitializeBlockTrailer(block_info);
 }
 
+bool BlockResizeBody(size_t body_size,
+                     size_t min_right_redzone_size,
+                     BlockInfo* block_info) {
+  DCHECK_NE(static_cast<BlockInfo*>(NULL), block_info);
+  DCHECK_EQ(ALLOCATED_BLOCK, block_info->header->state);
+
+  // The trailer stays at the end of the block, so the body can use everything
+  // up to it.
+  uint8* trailer = reinterpret_cast<uint8*>(block_info->trailer);
+  size_t max_body_size = trailer - block_info->body;
+  if (body_size > max_body_size || body_size > kMaxBlockHeaderBodySize)
+    return false;
+  size_t trailer_padding_size = max_body_size - body_size;
+  if (trailer_padding_size + sizeof(BlockTrailer) < min_right_redzone_size)
+    return false;
+
+  // As the end of the block is aligned the implicit trailer padding size
+  // derived from the body size is consistent with this one whenever it is
+  // small enough to be implicit.
+  block_info->body_size = body_size;
+  block_info->trailer_padding = block_info->body + body_size;
+  block_info->trailer_padding_size = trailer_padding_size;
+  block_info->header->body_size = body_size;
+  block_info->header->has_excess_trailer_padding =
+      trailer_padding_size > sizeof(uint32);
+  InitializeBlockTrailerPadding(block_info);
+  BlockIdentifyWholePages(block_info);
+
+  return true;
+}
+
 bool BlockInfoFromMemory(const void* raw_block, CompactBlockInfo* block_info) {
   DCHECK_NE(static_cast<void*>(NULL), raw_block);
   DCHECK_NE(static_cast<CompactBlockInfo*>(NULL), block_info);
@@ -414,13 +512,12 @@ void BlockSetChecksum(const BlockInfo& block_info) {
   switch (block_info.header->state) {
     case ALLOCATED_BLOCK: {
       // Only checksum the header and trailer regions.
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.block),
-          block_info.body - block_info.block);
-      checksum ^= base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.trailer_padding),
-          block_info.block + block_info.block_size -
-              block_info.trailer_padding);
+      AccumulateHash(block_info.block, block_info.body - block_info.block,
+                     &checksum);
+      AccumulateHash(block_info.trailer_padding,
+                     block_info.block + block_info.block_size -
+                         block_info.trailer_padding,
+                     &checksum);
       break;
     }
 
@@ -431,9 +528,18 @@ void BlockSetChecksum(const BlockInfo& block_info) {
     case QUARANTINED_BLOCK:
     case FREED_BLOCK:
     default: {
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.block),
-          block_info.block_size);
+      if (checksum_sampling &&
+          block_info.body_size > kBlockChecksumSampledBodySize) {
+        AccumulateHash(block_info.block, block_info.body - block_info.block,
+                       &checksum);
+        AccumulateSampledBodyHash(block_info, &checksum);
+        AccumulateHash(block_info.trailer_padding,
+                       block_info.block + block_info.block_size -
+                           block_info.trailer_padding,
+                       &checksum);
+      } else {
+        AccumulateHash(block_info.block, block_info.block_size, &checksum);
+      }
       break;
     }
   }
@@ -443,6 +549,14 @@ void BlockSetChecksum(const BlockInfo& block_info) {
   block_info.header->checksum = checksum;
 }
 
+void BlockSetChecksumSampling(bool sampling) {
+  checksum_sampling = sampling;
+}
+
+bool BlockChecksumSamplingIsEnabled() {
+  return checksum_sampling;
+}
+
 // Identifies whole pages in the given block_info.
 void BlockIdentifyWholePages(BlockInfo* block_info) {
   DCHECK_NE(static_cast<BlockInfo*>(NULL), block_info);
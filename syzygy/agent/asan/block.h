@@ -294,6 +294,24 @@ void BlockInitialize(const BlockLayout& layout,
                      bool is_nested,
                      BlockInfo* block_info);
 
+// Resizes the body of an allocated block in place. The block itself, its
+// header and its header padding are left untouched; the body grows into or
+// shrinks away from the trailer padding. Updates the header and the trailer
+// padding, and the whole page extents of @p block_info. Does not update the
+// shadow memory, the page protections or the checksum.
+// @param body_size The new size of the body of the block.
+// @param min_right_redzone_size The minimum size of the right redzone that
+//     must remain after the resize.
+// @param block_info The block to be resized. This must be in the
+//     ALLOCATED_BLOCK state.
+// @returns true on success, false if the block can't hold a body of this size
+//     while respecting @p min_right_redzone_size. The block is left unchanged
+//     on failure.
+// @note The pages containing the block must be writable and readable.
+bool BlockResizeBody(size_t body_size,
+                     size_t min_right_redzone_size,
+                     BlockInfo* block_info);
+
 // Converts between the two BlockInfo formats. This will work as long as the
 // input is valid; garbage in implies garbage out.
 // @param compact The populated compact block info.
@@ -342,6 +360,22 @@ bool BlockChecksumIsValid(const BlockInfo& block_info);
 // @param block_info The block to be checksummed.
 // @note The pages containing the block must be writable and readable.
 void BlockSetChecksum(const BlockInfo& block_info);
+
+// Enables or disables the sampling of the bodies of large blocks when
+// calculating checksums. When enabled, only the header, the trailer and a
+// fixed number of evenly spaced chunks of the body of quarantined and freed
+// blocks larger than kBlockChecksumSampledBodySize are checksummed. This
+// trades some detection of use-after-free writes for speed. This must not be
+// changed while there are checksummed blocks in existence.
+// @param sampling True to enable the sampling.
+void BlockSetChecksumSampling(bool sampling);
+
+// @returns true if the sampling of the bodies of large blocks is enabled.
+bool BlockChecksumSamplingIsEnabled();
+
+// The body size above which the bodies of blocks are sampled when calculating
+// checksums, if the sampling is enabled.
+extern const size_t kBlockChecksumSampledBodySize;
 // @}
 
 
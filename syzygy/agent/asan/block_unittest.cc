@@ -198,6 +198,41 @@ TEST(BlockTest, EndToEnd) {
   ASSERT_EQ(TRUE, ::VirtualFree(data, 0, MEM_RELEASE));
 }
 
+TEST(BlockTest, BlockResizeBody) {
+  BlockLayout layout = {};
+  BlockInfo block_info = {};
+
+  EXPECT_TRUE(BlockPlanLayout(8, 8, 64, 0, 32, &layout));
+  scoped_ptr<uint8> block_data(new uint8[layout.block_size]);
+  ::memset(block_data.get(), 0, layout.block_size);
+  BlockInitialize(layout, block_data.get(), false, &block_info);
+  BlockTrailer* trailer = block_info.trailer;
+
+  // Shrink the body so that the trailer padding becomes explicit.
+  EXPECT_TRUE(BlockResizeBody(13, 32, &block_info));
+  EXPECT_EQ(13u, block_info.body_size);
+  EXPECT_EQ(trailer, block_info.trailer);
+  EXPECT_TRUE(block_info.header->has_excess_trailer_padding);
+  EXPECT_NO_FATAL_FAILURE(IsValidInitializedBlock(block_info));
+
+  // Grow it so that the trailer padding is implicit.
+  size_t max_body_size =
+      reinterpret_cast<uint8*>(trailer) - block_info.body;
+  EXPECT_TRUE(BlockResizeBody(max_body_size - 2, 0, &block_info));
+  EXPECT_FALSE(block_info.header->has_excess_trailer_padding);
+  EXPECT_NO_FATAL_FAILURE(IsValidInitializedBlock(block_info));
+
+  BlockInfo block_info_from_memory = {};
+  EXPECT_TRUE(BlockInfoFromMemory(block_info.block, &block_info_from_memory));
+  EXPECT_EQ(block_info, block_info_from_memory);
+
+  // The right redzone can't be made smaller than requested, and the body
+  // can't overlap the trailer.
+  EXPECT_FALSE(BlockResizeBody(max_body_size, 32, &block_info));
+  EXPECT_FALSE(BlockResizeBody(max_body_size + 1, 0, &block_info));
+  EXPECT_EQ(max_body_size - 2, block_info.body_size);
+}
+
 TEST(BlockTest, GetHeaderFromBody) {
   // Plan two layouts, one with header padding and another without.
   BlockLayout layout1 = {};
@@ -679,5 +714,66 @@ TEST(BlockTest, ChecksumDetectsTampering) {
   ASSERT_NO_FATAL_FAILURE(runtime.TearDown());
 }
 
+namespace {
+
+// Determines if modifying the byte at @p address changes the checksum of a
+// block. The byte is restored before returning.
+bool ChecksumChangesWithByte(const BlockInfo& block_info, uint8* address) {
+  uint8 original_value = *address;
+  BlockSetChecksum(block_info);
+  uint32 checksum = block_info.header->checksum;
+
+  // The checksum can collide, so try a handful of values.
+  bool changed = false;
+  for (size_t i = 0; i < 4 && !changed; ++i) {
+    ++(*address);
+    BlockSetChecksum(block_info);
+    changed = block_info.header->checksum != checksum;
+  }
+
+  *address = original_value;
+  BlockSetChecksum(block_info);
+  return changed;
+}
+
+}  // namespace
+
+TEST(BlockTest, SampledChecksum) {
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio,
+                              4 * kBlockChecksumSampledBodySize, 0, 0,
+                              &layout));
+  scoped_ptr<uint8> data(new uint8[layout.block_size]);
+  ::memset(data.get(), 0, layout.block_size);
+  BlockInfo info = {};
+  BlockInitialize(layout, data.get(), false, &info);
+  info.header->state = QUARANTINED_BLOCK;
+
+  // A byte just past the first sampled chunk of the body.
+  uint8* unsampled_byte = info.body + 100;
+
+  EXPECT_FALSE(BlockChecksumSamplingIsEnabled());
+  EXPECT_TRUE(ChecksumChangesWithByte(info, unsampled_byte));
+
+  BlockSetChecksumSampling(true);
+  EXPECT_TRUE(BlockChecksumSamplingIsEnabled());
+
+  // The header, the trailer and the ends of the body are always checksummed.
+  EXPECT_TRUE(ChecksumChangesWithByte(info, info.block));
+  EXPECT_TRUE(ChecksumChangesWithByte(
+      info, reinterpret_cast<uint8*>(info.trailer)));
+  EXPECT_TRUE(ChecksumChangesWithByte(info, info.body));
+  EXPECT_TRUE(ChecksumChangesWithByte(info, info.body + info.body_size - 1));
+  EXPECT_FALSE(ChecksumChangesWithByte(info, unsampled_byte));
+
+  // The bodies of allocated blocks are never checksummed.
+  info.header->state = ALLOCATED_BLOCK;
+  EXPECT_TRUE(ChecksumChangesWithByte(info, info.block));
+  EXPECT_FALSE(ChecksumChangesWithByte(info, info.body));
+
+  BlockSetChecksumSampling(false);
+  EXPECT_FALSE(BlockChecksumSamplingIsEnabled());
+}
+
 }  // namespace asan
 }  // namespace agent
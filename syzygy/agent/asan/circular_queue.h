@@ -29,6 +29,10 @@
 //
 // INCORRECT USAGE (causes compilation error):
 // CircularQueue<int> q(capacity, &notifier);
+//
+// LockFreeCircularQueue is a variant that can be pushed to and popped from by
+// any number of threads at once, without locks. Its capacity is rounded up to
+// a power of two.
 
 #ifndef SYZYGY_AGENT_ASAN_CIRCULAR_QUEUE_H_
 #define SYZYGY_AGENT_ASAN_CIRCULAR_QUEUE_H_
@@ -36,6 +40,7 @@
 #include <memory>
 #include <vector>
 
+#include "base/atomicops.h"
 #include "syzygy/agent/asan/memory_notifier.h"
 
 namespace agent {
@@ -98,6 +103,87 @@ class CircularQueue {
   Container buffer_;
 };
 
+// A bounded circular queue that is safe for concurrent use by multiple
+// producers and consumers. Each slot carries a sequence number that tells
+// whether it's ready to be written or read for the current lap of the queue,
+// so threads only contend when they race for the same slot.
+// @tparam T the type of the elements. This must be default constructible and
+//     assignable.
+// @tparam Alloc the type of the allocator used by the underlying container.
+template<typename T, typename Alloc = std::allocator<T>>
+class LockFreeCircularQueue {
+ public:
+  // Constructor.
+  // @param max_capacity Minimum number of elements the queue can store. This
+  //     is rounded up to a power of two.
+  explicit LockFreeCircularQueue(size_t max_capacity);
+
+  // Constructor.
+  // @param max_capacity Minimum number of elements the queue can store. This
+  //     is rounded up to a power of two.
+  // @param alloc The allocator to use with this container.
+  LockFreeCircularQueue(size_t max_capacity, const Alloc& alloc);
+
+  // Inserts an element in the back/tail of the queue if possible.
+  // @param elem the element to be inserted.
+  // @returns true if the element was inserted, false if the queue is full.
+  bool push(const T& elem);
+
+  // Removes the element at the front/head of the queue if possible.
+  // @param elem receives the removed element.
+  // @returns true if an element was removed, false if the queue is empty.
+  bool pop(T* elem);
+
+  // Gives the current number of elements in the queue. This is only a
+  // snapshot when other threads are using the queue.
+  // @returns the number of elements currently stored in the queue.
+  size_t size() const;
+
+  // @returns true if the queue is empty, false otherwise.
+  bool empty() const;
+
+  // @returns the maximum number of elements the queue can handle.
+  size_t max_capacity() const;
+
+ private:
+  // A slot of the queue. Its sequence number is equal to the position of the
+  // next push that may use it, or to that position plus one once the element
+  // has been written and may be popped.
+  struct Cell {
+    volatile base::subtle::Atomic32 sequence;
+    T elem;
+  };
+  typedef typename Alloc::template rebind<Cell>::other CellAlloc;
+  typedef std::vector<Cell, CellAlloc> Container;
+
+  // The size of the padding used to keep the push and pop positions on
+  // separate cache lines.
+  static const size_t kCacheLineSize = 64;
+
+  // Initializes the slots of the queue.
+  void Initialize(size_t max_capacity);
+
+  // The slots of the queue. Its size is a power of two.
+  Container cells_;
+
+  // The mask giving the index of the slot for a position.
+  uint32 mask_;
+
+  char padding0_[kCacheLineSize];
+
+  // The position of the next push.
+  volatile base::subtle::Atomic32 push_position_;
+
+  char padding1_[kCacheLineSize];
+
+  // The position of the next pop.
+  volatile base::subtle::Atomic32 pop_position_;
+
+  char padding2_[kCacheLineSize];
+
+  DISALLOW_COPY_AND_ASSIGN(LockFreeCircularQueue);
+};
+
 }  // namespace asan
 }  // namespace agent
 
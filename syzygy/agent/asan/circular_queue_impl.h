@@ -18,6 +18,8 @@
 #ifndef SYZYGY_AGENT_ASAN_CIRCULAR_QUEUE_IMPL_H_
 #define SYZYGY_AGENT_ASAN_CIRCULAR_QUEUE_IMPL_H_
 
+#include <algorithm>
+
 #include "base/logging.h"
 #include "syzygy/agent/asan/memory_notifier.h"
 
@@ -86,6 +88,143 @@ size_t CircularQueue<T, Alloc>::max_capacity() const {
   return buffer_.size();
 }
 
+namespace detail {
+
+// The positions of the lock free queue wrap around. These helpers do the
+// position arithmetic on unsigned values, where overflow is well defined.
+inline base::subtle::Atomic32 NextQueuePosition(
+    base::subtle::Atomic32 position, uint32 increment) {
+  return static_cast<base::subtle::Atomic32>(
+      static_cast<uint32>(position) + increment);
+}
+
+inline int32 QueuePositionDistance(base::subtle::Atomic32 a,
+                                   base::subtle::Atomic32 b) {
+  return static_cast<int32>(static_cast<uint32>(a) - static_cast<uint32>(b));
+}
+
+}  // namespace detail
+
+template<typename T, typename Alloc>
+LockFreeCircularQueue<T, Alloc>::LockFreeCircularQueue(size_t max_capacity)
+    : mask_(0), push_position_(0), pop_position_(0) {
+  Initialize(max_capacity);
+}
+
+template<typename T, typename Alloc>
+LockFreeCircularQueue<T, Alloc>::LockFreeCircularQueue(
+    size_t max_capacity, const Alloc& alloc)
+    : cells_(CellAlloc(alloc)),
+      mask_(0),
+      push_position_(0),
+      pop_position_(0) {
+  Initialize(max_capacity);
+}
+
+template<typename T, typename Alloc>
+void LockFreeCircularQueue<T, Alloc>::Initialize(size_t max_capacity) {
+  // The sequence numbers can't tell a full queue from an empty one with a
+  // single slot.
+  size_t capacity = 2;
+  while (capacity < max_capacity)
+    capacity <<= 1;
+  DCHECK_GE(1u << 30, capacity);
+
+  cells_.resize(capacity);
+  for (size_t i = 0; i < capacity; ++i)
+    cells_[i].sequence = static_cast<base::subtle::Atomic32>(i);
+  mask_ = static_cast<uint32>(capacity - 1);
+}
+
+template<typename T, typename Alloc>
+bool LockFreeCircularQueue<T, Alloc>::push(const T& elem) {
+  base::subtle::Atomic32 position =
+      base::subtle::NoBarrier_Load(&push_position_);
+  while (true) {
+    Cell* cell = &cells_[static_cast<uint32>(position) & mask_];
+    base::subtle::Atomic32 sequence =
+        base::subtle::Acquire_Load(&cell->sequence);
+    int32 distance = detail::QueuePositionDistance(sequence, position);
+    if (distance == 0) {
+      // The slot is free for this lap, try to claim it.
+      base::subtle::Atomic32 previous =
+          base::subtle::NoBarrier_CompareAndSwap(
+              &push_position_, position,
+              detail::NextQueuePosition(position, 1));
+      if (previous == position) {
+        cell->elem = elem;
+        base::subtle::Release_Store(
+            &cell->sequence, detail::NextQueuePosition(position, 1));
+        return true;
+      }
+      position = previous;
+    } else if (distance < 0) {
+      // The slot still holds the element of the previous lap.
+      return false;
+    } else {
+      // Another thread claimed the slot, try again with the new position.
+      position = base::subtle::NoBarrier_Load(&push_position_);
+    }
+  }
+}
+
+template<typename T, typename Alloc>
+bool LockFreeCircularQueue<T, Alloc>::pop(T* elem) {
+  DCHECK_NE(static_cast<T*>(nullptr), elem);
+  base::subtle::Atomic32 position =
+      base::subtle::NoBarrier_Load(&pop_position_);
+  while (true) {
+    Cell* cell = &cells_[static_cast<uint32>(position) & mask_];
+    base::subtle::Atomic32 sequence =
+        base::subtle::Acquire_Load(&cell->sequence);
+    int32 distance = detail::QueuePositionDistance(
+        sequence, detail::NextQueuePosition(position, 1));
+    if (distance == 0) {
+      // The slot holds an element, try to claim it.
+      base::subtle::Atomic32 previous =
+          base::subtle::NoBarrier_CompareAndSwap(
+              &pop_position_, position,
+              detail::NextQueuePosition(position, 1));
+      if (previous == position) {
+        *elem = cell->elem;
+        // Make the slot available to the push of the next lap.
+        base::subtle::Release_Store(
+            &cell->sequence, detail::NextQueuePosition(position, mask_ + 1));
+        return true;
+      }
+      position = previous;
+    } else if (distance < 0) {
+      // The slot hasn't been written yet for this lap.
+      return false;
+    } else {
+      // Another thread claimed the slot, try again with the new position.
+      position = base::subtle::NoBarrier_Load(&pop_position_);
+    }
+  }
+}
+
+template<typename T, typename Alloc>
+size_t LockFreeCircularQueue<T, Alloc>::size() const {
+  base::subtle::Atomic32 pop_position =
+      base::subtle::Acquire_Load(&pop_position_);
+  base::subtle::Atomic32 push_position =
+      base::subtle::Acquire_Load(&push_position_);
+  int32 size = detail::QueuePositionDistance(push_position, pop_position);
+  if (size < 0)
+    return 0;
+  return std::min(static_cast<size_t>(size), cells_.size());
+}
+
+template<typename T, typename Alloc>
+bool LockFreeCircularQueue<T, Alloc>::empty() const {
+  return size() == 0;
+}
+
+template<typename T, typename Alloc>
+size_t LockFreeCircularQueue<T, Alloc>::max_capacity() const {
+  return cells_.size();
+}
+
 }  // namespace asan
 }  // namespace agent
 
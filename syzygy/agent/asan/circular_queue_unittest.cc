@@ -175,6 +175,51 @@ TEST(CircularQueue, MemoryNotifierIsCalled) {
       MemoryNotifierAllocator<int>(&mock_notifier));
 }
 
+TEST(LockFreeCircularQueue, MaxCapacityIsRoundedUp) {
+  LockFreeCircularQueue<int> q(100);
+  EXPECT_EQ(128u, q.max_capacity());
+  LockFreeCircularQueue<int> q2(128);
+  EXPECT_EQ(128u, q2.max_capacity());
+  LockFreeCircularQueue<int> q3(1);
+  EXPECT_EQ(2u, q3.max_capacity());
+}
+
+TEST(LockFreeCircularQueue, ComplyWithFIFO) {
+  LockFreeCircularQueue<int> q(128);
+  EXPECT_TRUE(q.empty());
+
+  int initial = 10;
+  for (int i = 0; i < initial; ++i)
+    EXPECT_TRUE(q.push(i));
+
+  // Go around the queue many times.
+  for (int i = initial; i < 1000 * 128; ++i) {
+    EXPECT_TRUE(q.push(i));
+    int elem = -1;
+    EXPECT_TRUE(q.pop(&elem));
+    EXPECT_EQ(i - initial, elem);
+    EXPECT_EQ(static_cast<size_t>(initial), q.size());
+  }
+}
+
+TEST(LockFreeCircularQueue, PushWhenFullAndPopWhenEmpty) {
+  LockFreeCircularQueue<int> q(128);
+  int elem = 0;
+  EXPECT_FALSE(q.pop(&elem));
+
+  for (int i = 0; i < 128; ++i)
+    EXPECT_TRUE(q.push(i));
+  EXPECT_EQ(128u, q.size());
+  EXPECT_FALSE(q.push(128));
+  EXPECT_EQ(128u, q.size());
+
+  for (int i = 0; i < 128; ++i) {
+    EXPECT_TRUE(q.pop(&elem));
+    EXPECT_EQ(i, elem);
+  }
+  EXPECT_FALSE(q.pop(&elem));
+  EXPECT_TRUE(q.empty());
+}
 
 }  // namespace asan
 }  // namespace agent
@@ -22,6 +22,7 @@ namespace asan {
 namespace {
 
 size_t page_size = 0;
+size_t allocation_granularity = 0;
 
 }  // namespace
 
@@ -35,5 +36,15 @@ size_t GetPageSize() {
   return page_size;
 }
 
+size_t GetAllocationGranularity() {
+  // Gets the allocation granularity from the OS.
+  if (allocation_granularity == 0) {
+    SYSTEM_INFO system_info = {};
+    ::GetSystemInfo(&system_info);
+    allocation_granularity = system_info.dwAllocationGranularity;
+  }
+  return allocation_granularity;
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -34,6 +34,9 @@ static const size_t kQuarantineDefaultShardingFactor = 128;
 //     fiasco.
 size_t GetPageSize();
 
+// @returns the granularity of the address space reservations on the OS.
+size_t GetAllocationGranularity();
+
 }  // namespace asan
 }  // namespace agent
 
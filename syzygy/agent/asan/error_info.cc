@@ -19,6 +19,7 @@
 #include "syzygy/agent/asan/block_utils.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
+#include "syzygy/crashdata/buffer_writer.h"
 #include "syzygy/crashdata/crashdata.h"
 
 namespace agent {
@@ -109,6 +110,88 @@ void GetAddressInformation(BlockHeader* header,
   DCHECK_LE(shadow_mem_bytes, arraysize(bad_access_info->shadow_memory) - 1);
 }
 
+// The size of the memory on each side of a bad access in which the blocks are
+// included in a targeted minidump.
+const size_t kMiniDumpNeighbourhoodSize = 4096;
+
+// The largest part of a block that is included in a targeted minidump. Only
+// the beginning and the end of larger blocks are included, which is where
+// their metadata and most of the overflows and underflows are.
+const size_t kMiniDumpMaxBlockSize = 16 * 1024;
+
+// Accumulates the memory ranges of a targeted minidump in a fixed size array.
+// This doesn't allocate, as it is used while handling an error.
+class MiniDumpMemoryRangeCollector {
+ public:
+  // @param stack_cache The stack cache that owns the alloc and free stack
+  //     traces of the blocks.
+  // @param ranges The array receiving the ranges.
+  // @param max_ranges The capacity of @p ranges. Further ranges are dropped.
+  MiniDumpMemoryRangeCollector(StackCaptureCache* stack_cache,
+                               trace::common::MiniDumpMemoryRange* ranges,
+                               size_t max_ranges)
+      : stack_cache_(stack_cache),
+        ranges_(ranges),
+        max_ranges_(max_ranges),
+        count_(0) {
+  }
+
+  // Adds a range of memory.
+  void Add(const void* address, size_t size) {
+    if (size == 0 || count_ == max_ranges_)
+      return;
+    ranges_[count_].address = reinterpret_cast<uint32>(address);
+    ranges_[count_].size = size;
+    ++count_;
+  }
+
+  // Adds a range of memory and its shadow.
+  void AddWithShadow(const void* address, size_t size) {
+    Add(address, size);
+    size_t begin = reinterpret_cast<size_t>(address) >> kShadowRatioLog;
+    size_t end = (reinterpret_cast<size_t>(address) + size +
+        kShadowRatio - 1) >> kShadowRatioLog;
+    Add(Shadow::shadow() + begin, end - begin);
+  }
+
+  // Adds a block, its shadow and its stack traces.
+  void AddBlock(const BlockInfo& block_info) {
+    if (block_info.block_size <= kMiniDumpMaxBlockSize) {
+      AddWithShadow(block_info.block, block_info.block_size);
+    } else {
+      const size_t kHalfSize = kMiniDumpMaxBlockSize / 2;
+      AddWithShadow(block_info.block, kHalfSize);
+      AddWithShadow(block_info.block + block_info.block_size - kHalfSize,
+                    kHalfSize);
+    }
+
+    // The header of a quarantined block may be protected, in which case its
+    // stack traces can't be found.
+    if (Shadow::PageIsProtected(block_info.header))
+      return;
+    AddStackCapture(block_info.header->alloc_stack);
+    if (block_info.header->state != ALLOCATED_BLOCK)
+      AddStackCapture(block_info.header->free_stack);
+  }
+
+  // @returns the number of ranges that were added.
+  size_t count() const { return count_; }
+
+ private:
+  // Adds a stack capture, if it belongs to the stack cache.
+  void AddStackCapture(const common::StackCapture* stack_capture) {
+    if (stack_cache_->StackCapturePointerIsValid(stack_capture))
+      Add(stack_capture, stack_capture->Size());
+  }
+
+  StackCaptureCache* stack_cache_;
+  trace::common::MiniDumpMemoryRange* ranges_;
+  size_t max_ranges_;
+  size_t count_;
+
+  DISALLOW_COPY_AND_ASSIGN(MiniDumpMemoryRangeCollector);
+};
+
 }  // namespace
 
 const char kHeapUseAfterFree[] = "heap-use-after-free";
@@ -246,26 +329,86 @@ void ErrorInfoGetAsanBlockInfo(const BlockInfo& block_info,
   }
 }
 
+size_t ErrorInfoGetMiniDumpMemoryRanges(
+    StackCaptureCache* stack_cache,
+    const AsanErrorInfo& error_info,
+    trace::common::MiniDumpMemoryRange* ranges,
+    size_t max_ranges) {
+  DCHECK_NE(static_cast<StackCaptureCache*>(nullptr), stack_cache);
+  DCHECK_NE(static_cast<trace::common::MiniDumpMemoryRange*>(nullptr), ranges);
+
+  MiniDumpMemoryRangeCollector collector(stack_cache, ranges, max_ranges);
+
+  // The block containing the bad access comes first, so that it makes it into
+  // the minidump even if there are too many ranges.
+  BlockInfo block_info = {};
+  const uint8* location = static_cast<const uint8*>(error_info.location);
+  size_t location_address = reinterpret_cast<size_t>(location);
+  bool has_block = false;
+  if (location_address >= Shadow::kAddressLowerBound &&
+      location_address < Shadow::kAddressUpperBound) {
+    has_block = Shadow::BlockInfoFromShadow(location, &block_info);
+  }
+  if (has_block)
+    collector.AddBlock(block_info);
+
+  // Then come its neighbours, along with the shadow of the whole
+  // neighbourhood, so that wild accesses are covered as well.
+  size_t lower_bound = Shadow::kAddressLowerBound;
+  if (location_address > lower_bound + kMiniDumpNeighbourhoodSize)
+    lower_bound = location_address - kMiniDumpNeighbourhoodSize;
+  size_t upper_bound = Shadow::kAddressUpperBound;
+  if (location_address < upper_bound - kMiniDumpNeighbourhoodSize)
+    upper_bound = location_address + kMiniDumpNeighbourhoodSize;
+  if (lower_bound < upper_bound) {
+    ShadowWalker walker(false,
+                        reinterpret_cast<const void*>(lower_bound),
+                        reinterpret_cast<const void*>(upper_bound));
+    BlockInfo neighbour = {};
+    while (walker.Next(&neighbour)) {
+      if (!has_block || neighbour.block != block_info.block)
+        collector.AddBlock(neighbour);
+    }
+    collector.AddWithShadow(reinterpret_cast<const void*>(lower_bound),
+                            upper_bound - lower_bound);
+  }
+
+  // Finally come the blocks reported in the corrupt ranges. The rest of the
+  // information about these ranges lives on the stack, which is always part
+  // of the minidump.
+  for (size_t i = 0; i < error_info.corrupt_ranges_reported; ++i) {
+    const AsanCorruptBlockRange& range = error_info.corrupt_ranges[i];
+    for (size_t j = 0; j < range.block_info_count; ++j) {
+      BlockInfo corrupt_block = {};
+      const void* header = range.block_info[j].header;
+      if (header != nullptr &&
+          Shadow::BlockInfoFromShadow(header, &corrupt_block)) {
+        collector.AddBlock(corrupt_block);
+      }
+    }
+  }
+
+  return collector.count();
+}
+
 namespace {
 
 // Converts an access mode to a string.
-void AccessModeToString(AccessMode access_mode, std::string* str) {
-  DCHECK_NE(static_cast<std::string*>(nullptr), str);
+const char* AccessModeToStr(AccessMode access_mode) {
   switch (access_mode) {
-    case ASAN_READ_ACCESS: *str = "read"; break;
-    case ASAN_WRITE_ACCESS: *str = "write"; break;
-    default: *str = "(unknown)"; break;
+    case ASAN_READ_ACCESS: return "read";
+    case ASAN_WRITE_ACCESS: return "write";
+    default: return "(unknown)";
   }
 }
 
 // Converts a block state to a string.
-void BlockStateToString(BlockState block_state, std::string* str) {
-  DCHECK_NE(static_cast<std::string*>(nullptr), str);
+const char* BlockStateToStr(BlockState block_state) {
   switch (block_state) {
-    case ALLOCATED_BLOCK: *str = "allocated"; break;
-    case QUARANTINED_BLOCK: *str = "quarantined"; break;
-    case FREED_BLOCK: *str = "freed"; break;
-    default: *str = "(unknown)"; break;
+    case ALLOCATED_BLOCK: return "allocated";
+    case QUARANTINED_BLOCK: return "quarantined";
+    case FREED_BLOCK: return "freed";
+    default: return "(unknown)";
   }
 }
 
@@ -283,31 +426,26 @@ void PopulateStackTrace(const void* const* frames,
     stack_trace->add_frames(CastAddress(frames[i]));
 }
 
-void DataStateToString(DataState data_state, std::string* str) {
-  DCHECK_NE(static_cast<std::string*>(nullptr), str);
+const char* DataStateToStr(DataState data_state) {
   switch (data_state) {
     default:
-    case kDataStateUnknown: *str = "(unknown)"; break;
-    case kDataIsClean: *str = "clean"; break;
-    case kDataIsCorrupt: *str = "corrupt"; break;
+    case kDataStateUnknown: return "(unknown)";
+    case kDataIsClean: return "clean";
+    case kDataIsCorrupt: return "corrupt";
   }
 }
 
 void PopulateBlockAnalysisResult(const BlockAnalysisResult& analysis,
                                  crashdata::Dictionary* dict) {
   DCHECK_NE(static_cast<crashdata::Dictionary*>(nullptr), dict);
-  DataStateToString(
-      analysis.block_state,
-      crashdata::LeafGetString(crashdata::DictAddLeaf("block", dict)));
-  DataStateToString(
-      analysis.header_state,
-      crashdata::LeafGetString(crashdata::DictAddLeaf("header", dict)));
-  DataStateToString(
-      analysis.body_state,
-      crashdata::LeafGetString(crashdata::DictAddLeaf("body", dict)));
-  DataStateToString(
-      analysis.trailer_state,
-      crashdata::LeafGetString(crashdata::DictAddLeaf("trailer", dict)));
+  crashdata::LeafGetString(crashdata::DictAddLeaf("block", dict))->assign(
+      DataStateToStr(analysis.block_state));
+  crashdata::LeafGetString(crashdata::DictAddLeaf("header", dict))->assign(
+      DataStateToStr(analysis.header_state));
+  crashdata::LeafGetString(crashdata::DictAddLeaf("body", dict))->assign(
+      DataStateToStr(analysis.body_state));
+  crashdata::LeafGetString(crashdata::DictAddLeaf("trailer", dict))->assign(
+      DataStateToStr(analysis.trailer_state));
 }
 
 }  // namespace
@@ -324,9 +462,8 @@ void PopulateBlockInfo(const AsanBlockInfo& block_info,
       ->set_address(CastAddress(block_info.header));
   crashdata::LeafSetUInt(block_info.user_size,
                          crashdata::DictAddLeaf("user-size", dict));
-  BlockStateToString(
-      static_cast<BlockState>(block_info.state),
-      crashdata::LeafGetString(crashdata::DictAddLeaf("state", dict)));
+  crashdata::LeafGetString(crashdata::DictAddLeaf("state", dict))->assign(
+      BlockStateToStr(static_cast<BlockState>(block_info.state)));
   crashdata::LeafGetString(crashdata::DictAddLeaf("heap-type", dict))
       ->assign(kHeapTypes[block_info.heap_type]);
 
@@ -385,57 +522,95 @@ void PopulateCorruptBlockRange(const AsanCorruptBlockRange& range,
 
 namespace {
 
-void PopulateShadowMemoryBlob(const AsanErrorInfo& error_info,
-                              crashdata::Dictionary* dict) {
-  DCHECK_NE(static_cast<crashdata::Dictionary*>(nullptr), dict);
-
-  // The shadow-info string can be reconstructed from information already in
-  // the crash (location, block-info, access-mode, access-size), so there's no
-  // need to send it. This is emitted as a blob.
-  uintptr_t index = reinterpret_cast<uintptr_t>(error_info.location);
-  index >>= kShadowRatioLog;
-  index = (index / Shadow::kShadowBytesPerLine) * Shadow::kShadowBytesPerLine;
-  uintptr_t index_min = index -
+// Gets the range of the shadow memory surrounding the address of an error.
+// The shadow-info string can be reconstructed from information already in
+// the crash (location, block-info, access-mode, access-size), so there's no
+// need to send it. The shadow memory is emitted as a blob instead.
+// @param error_info The error.
+// @param index Receives the index of the shadow byte of the address.
+// @param data Receives the start of the range.
+// @param length Receives the length of the range.
+void GetShadowMemoryRange(const AsanErrorInfo& error_info,
+                          uintptr_t* index,
+                          const uint8** data,
+                          uintptr_t* length) {
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), index);
+  DCHECK_NE(static_cast<const uint8**>(nullptr), data);
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), length);
+
+  *index = reinterpret_cast<uintptr_t>(error_info.location);
+  *index >>= kShadowRatioLog;
+  *index = (*index / Shadow::kShadowBytesPerLine) *
+      Shadow::kShadowBytesPerLine;
+  uintptr_t index_min = *index -
       Shadow::kShadowContextLines * Shadow::kShadowBytesPerLine;
-  if (index_min > index)
+  if (index_min > *index)
     index_min = 0;
-  uintptr_t index_max = index +
+  uintptr_t index_max = *index +
       Shadow::kShadowContextLines * Shadow::kShadowBytesPerLine;
-  if (index_max < index)
+  if (index_max < *index)
+    index_max = 0;
+  *data = Shadow::shadow() + index_min;
+  *length = index_max - index_min;
+}
+
+// Gets the range of the page protection bits surrounding the address of an
+// error.
+// @param error_info The error.
+// @param index Receives the index of the page bits byte of the address.
+// @param data Receives the start of the range.
+// @param length Receives the length of the range.
+void GetPageBitsRange(const AsanErrorInfo& error_info,
+                      uintptr_t* index,
+                      const uint8** data,
+                      uintptr_t* length) {
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), index);
+  DCHECK_NE(static_cast<const uint8**>(nullptr), data);
+  DCHECK_NE(static_cast<uintptr_t*>(nullptr), length);
+
+  // Emit information about page protections surround the address in question.
+  static const size_t kPageBitsContext = 2;
+  *index = reinterpret_cast<uintptr_t>(error_info.location);
+  *index /= GetPageSize();  // 1 bit per page.
+  *index /= 8;  // 8 bits per byte.
+  uintptr_t index_min = *index - kPageBitsContext;
+  if (index_min > *index)
+    index_min = 0;
+  uintptr_t index_max = *index + 1 + kPageBitsContext;
+  if (index_max < *index)
     index_max = 0;
-  uintptr_t length = index_max - index_min;
+  *data = Shadow::page_bits() + index_min;
+  *length = index_max - index_min;
+}
+
+void PopulateShadowMemoryBlob(const AsanErrorInfo& error_info,
+                              crashdata::Dictionary* dict) {
+  DCHECK_NE(static_cast<crashdata::Dictionary*>(nullptr), dict);
+
+  uintptr_t index = 0;
+  const uint8* data = nullptr;
+  uintptr_t length = 0;
+  GetShadowMemoryRange(error_info, &index, &data, &length);
   crashdata::LeafSetUInt(
       index, crashdata::DictAddLeaf("shadow-memory-index", dict));
   crashdata::Blob* blob = crashdata::LeafGetBlob(
       crashdata::DictAddLeaf("shadow-memory", dict));
-  blob->mutable_data()->assign(
-      reinterpret_cast<const char*>(Shadow::shadow() + index_min),
-      length);
+  blob->mutable_data()->assign(reinterpret_cast<const char*>(data), length);
 }
 
 void PopulatePageBitsBlob(const AsanErrorInfo& error_info,
                           crashdata::Dictionary* dict) {
   DCHECK_NE(static_cast<crashdata::Dictionary*>(nullptr), dict);
 
-  // Emit information about page protections surround the address in question.
-  static const size_t kPageBitsContext = 2;
-  uintptr_t index = reinterpret_cast<uintptr_t>(error_info.location);
-  index /= GetPageSize();  // 1 bit per page.
-  index /= 8;  // 8 bits per byte.
-  uintptr_t index_min = index - kPageBitsContext;
-  if (index_min > index)
-    index_min = 0;
-  uintptr_t index_max = index + 1 + kPageBitsContext;
-  if (index_max < index)
-    index_max = 0;
-  uintptr_t length = index_max - index_min;
+  uintptr_t index = 0;
+  const uint8* data = nullptr;
+  uintptr_t length = 0;
+  GetPageBitsRange(error_info, &index, &data, &length);
   crashdata::LeafSetUInt(
       index, crashdata::DictAddLeaf("page-bits-index", dict));
   crashdata::Blob* blob = crashdata::LeafGetBlob(
       crashdata::DictAddLeaf("page-bits", dict));
-  blob->mutable_data()->assign(
-      reinterpret_cast<const char*>(Shadow::page_bits() + index_min),
-      length);
+  blob->mutable_data()->assign(reinterpret_cast<const char*>(data), length);
 }
 
 }  // namespace
@@ -461,9 +636,8 @@ void PopulateErrorInfo(const AsanErrorInfo& error_info,
   }
   crashdata::LeafGetString(crashdata::DictAddLeaf("error-type", dict))
       ->assign(ErrorInfoAccessTypeToStr(error_info.error_type));
-  AccessModeToString(
-      error_info.access_mode,
-      crashdata::LeafGetString(crashdata::DictAddLeaf("access-mode", dict)));
+  crashdata::LeafGetString(crashdata::DictAddLeaf("access-mode", dict))
+      ->assign(AccessModeToStr(error_info.access_mode));
   crashdata::LeafSetUInt(error_info.access_size,
                          crashdata::DictAddLeaf("access-size", dict));
 
@@ -487,5 +661,211 @@ void PopulateErrorInfo(const AsanErrorInfo& error_info,
   }
 }
 
+namespace {
+
+void WriteStackTrace(const void* const* frames,
+                     size_t frame_count,
+                     crashdata::BufferWriter* writer) {
+  DCHECK_NE(static_cast<void*>(nullptr), frames);
+  DCHECK_LT(0u, frame_count);
+  DCHECK_NE(static_cast<crashdata::BufferWriter*>(nullptr), writer);
+  writer->BeginStackTrace();
+  for (size_t i = 0; i < frame_count; ++i)
+    writer->AddFrame(CastAddress(frames[i]));
+  writer->EndStackTrace();
+}
+
+// Writes the same value as PopulateBlockInfo.
+void WriteBlockInfo(const AsanBlockInfo& block_info,
+                    crashdata::BufferWriter* writer) {
+  DCHECK_NE(static_cast<crashdata::BufferWriter*>(nullptr), writer);
+
+  writer->BeginDict();
+  writer->AddKey("header");
+  writer->SetAddress(CastAddress(block_info.header));
+  writer->AddKey("user-size");
+  writer->SetUInt(block_info.user_size);
+  writer->AddKey("state");
+  writer->SetString(BlockStateToStr(static_cast<BlockState>(block_info.state)));
+  writer->AddKey("heap-type");
+  writer->SetString(kHeapTypes[block_info.heap_type]);
+
+  writer->AddKey("analysis");
+  writer->BeginDict();
+  writer->AddKey("block");
+  writer->SetString(DataStateToStr(block_info.analysis.block_state));
+  writer->AddKey("header");
+  writer->SetString(DataStateToStr(block_info.analysis.header_state));
+  writer->AddKey("body");
+  writer->SetString(DataStateToStr(block_info.analysis.body_state));
+  writer->AddKey("trailer");
+  writer->SetString(DataStateToStr(block_info.analysis.trailer_state));
+  writer->EndDict();
+
+  if (block_info.alloc_stack_size != 0) {
+    writer->AddKey("alloc-thread-id");
+    writer->SetUInt(block_info.alloc_tid);
+    writer->AddKey("alloc-stack");
+    WriteStackTrace(block_info.alloc_stack, block_info.alloc_stack_size,
+                    writer);
+  }
+
+  if (block_info.free_stack_size != 0) {
+    writer->AddKey("free-thread-id");
+    writer->SetUInt(block_info.free_tid);
+    writer->AddKey("free-stack");
+    WriteStackTrace(block_info.free_stack, block_info.free_stack_size,
+                    writer);
+    writer->AddKey("milliseconds-since-free");
+    writer->SetUInt(block_info.milliseconds_since_free);
+  }
+  writer->EndDict();
+}
+
+// Writes the same value as PopulateCorruptBlockRange.
+void WriteCorruptBlockRange(const AsanCorruptBlockRange& range,
+                            crashdata::BufferWriter* writer) {
+  DCHECK_NE(static_cast<crashdata::BufferWriter*>(nullptr), writer);
+
+  writer->BeginDict();
+  writer->AddKey("address");
+  writer->SetAddress(CastAddress(range.address));
+  writer->AddKey("length");
+  writer->SetUInt(range.length);
+  writer->AddKey("block-count");
+  writer->SetUInt(range.block_count);
+  if (range.block_info_count > 0) {
+    writer->AddKey("blocks");
+    writer->BeginList();
+    for (size_t i = 0; i < range.block_info_count; ++i) {
+      if (range.block_info[i].header != nullptr)
+        WriteBlockInfo(range.block_info[i], writer);
+    }
+    writer->EndList();
+  }
+  writer->EndDict();
+}
+
+// Indicates if a corrupt range should be reported before another one. The
+// range containing the bad access comes first, then the ranges with the most
+// blocks, then the lowest ones in memory, then the first ones in the array.
+// @param error_info The error whose corrupt ranges are compared.
+// @param index The index of a corrupt range.
+// @param other_index The index of the other corrupt range.
+// @returns true if the range at @p index comes first.
+bool ComesBefore(const AsanErrorInfo& error_info,
+                 size_t index,
+                 size_t other_index) {
+  const AsanCorruptBlockRange& range = error_info.corrupt_ranges[index];
+  const AsanCorruptBlockRange& other = error_info.corrupt_ranges[other_index];
+  const uint8* location = reinterpret_cast<const uint8*>(error_info.location);
+  const uint8* range_begin = reinterpret_cast<const uint8*>(range.address);
+  const uint8* other_begin = reinterpret_cast<const uint8*>(other.address);
+  bool range_contains = location >= range_begin &&
+      location < range_begin + range.length;
+  bool other_contains = location >= other_begin &&
+      location < other_begin + other.length;
+  if (range_contains != other_contains)
+    return range_contains;
+  if (range.block_count != other.block_count)
+    return range.block_count > other.block_count;
+  if (range_begin != other_begin)
+    return range_begin < other_begin;
+  return index < other_index;
+}
+
+// Writes the corrupt ranges of an error, most relevant first, until the
+// buffer is full. The ranges are picked by selection, as they can't be
+// sorted without allocating.
+void WriteCorruptRanges(const AsanErrorInfo& error_info,
+                        crashdata::BufferWriter* writer) {
+  DCHECK_NE(static_cast<crashdata::BufferWriter*>(nullptr), writer);
+
+  size_t range_count = error_info.corrupt_ranges_reported;
+  size_t previous = range_count;
+  for (size_t written = 0; written < range_count; ++written) {
+    // Find the first range that comes after the previous one.
+    size_t next = range_count;
+    for (size_t i = 0; i < range_count; ++i) {
+      if (previous != range_count && !ComesBefore(error_info, previous, i))
+        continue;
+      if (next == range_count || ComesBefore(error_info, i, next))
+        next = i;
+    }
+    DCHECK_GT(range_count, next);
+
+    // Drop this range and the less relevant ones if it doesn't fit.
+    crashdata::BufferWriter::Checkpoint checkpoint = {};
+    writer->GetCheckpoint(&checkpoint);
+    WriteCorruptBlockRange(error_info.corrupt_ranges[next], writer);
+    if (writer->overflowed()) {
+      writer->Rollback(checkpoint);
+      return;
+    }
+    previous = next;
+  }
+}
+
+}  // namespace
+
+size_t SerializeErrorInfo(const AsanErrorInfo& error_info,
+                          void* buffer,
+                          size_t buffer_size) {
+  DCHECK_NE(static_cast<void*>(nullptr), buffer);
+
+  crashdata::BufferWriter writer(buffer, buffer_size);
+  writer.BeginDict();
+  writer.AddKey("location");
+  writer.SetAddress(CastAddress(error_info.location));
+  writer.AddKey("crash-stack-id");
+  writer.SetUInt(error_info.crash_stack_id);
+  if (error_info.block_info.header != nullptr) {
+    writer.AddKey("block-info");
+    WriteBlockInfo(error_info.block_info, &writer);
+  }
+  writer.AddKey("error-type");
+  writer.SetString(ErrorInfoAccessTypeToStr(error_info.error_type));
+  writer.AddKey("access-mode");
+  writer.SetString(AccessModeToStr(error_info.access_mode));
+  writer.AddKey("access-size");
+  writer.SetUInt(error_info.access_size);
+
+  uintptr_t index = 0;
+  const uint8* data = nullptr;
+  uintptr_t length = 0;
+  GetShadowMemoryRange(error_info, &index, &data, &length);
+  writer.AddKey("shadow-memory-index");
+  writer.SetUInt(index);
+  writer.AddKey("shadow-memory");
+  writer.SetBlob(data, length);
+  GetPageBitsRange(error_info, &index, &data, &length);
+  writer.AddKey("page-bits-index");
+  writer.SetUInt(index);
+  writer.AddKey("page-bits");
+  writer.SetBlob(data, length);
+
+  writer.AddKey("heap-is-corrupt");
+  writer.SetUInt(error_info.heap_is_corrupt);
+  writer.AddKey("corrupt-range-count");
+  writer.SetUInt(error_info.corrupt_range_count);
+  writer.AddKey("corrupt-block-count");
+  writer.SetUInt(error_info.corrupt_block_count);
+
+  // The fields above are needed to make sense of the error, so there's no
+  // point in going on if they don't fit.
+  if (writer.overflowed())
+    return 0;
+
+  if (error_info.corrupt_ranges_reported > 0) {
+    writer.AddKey("corrupt-ranges");
+    writer.BeginList();
+    WriteCorruptRanges(error_info, &writer);
+    writer.EndList();
+  }
+  writer.EndDict();
+
+  return writer.Finish();
+}
+
 }  // namespace asan
 }  // namespace agent
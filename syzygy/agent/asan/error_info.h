@@ -22,6 +22,7 @@
 #include "syzygy/agent/asan/block.h"
 #include "syzygy/agent/asan/heap.h"
 #include "syzygy/agent/common/stack_capture.h"
+#include "syzygy/trace/common/minidump_memory_ranges.h"
 
 // Forward declaration.
 namespace crashdata {
@@ -200,6 +201,23 @@ void ErrorInfoGetAsanBlockInfo(const BlockInfo& block_info,
                                StackCaptureCache* stack_cache,
                                AsanBlockInfo* asan_block_info);
 
+// Gathers the memory that a targeted minidump of an error needs to include:
+// the block containing the bad access and its neighbours, the shadow of these
+// blocks, their alloc and free stack traces, and the blocks of the corrupt
+// ranges. This doesn't allocate any memory.
+// @param stack_cache The stack cache that owns the alloc and free stack traces
+//     of the blocks.
+// @param error_info The error, as filled in by
+//     ErrorInfoGetBadAccessInformation.
+// @param ranges Will receive the memory ranges, most important first.
+// @param max_ranges The capacity of @p ranges. Further ranges are dropped.
+// @returns the number of ranges written to @p ranges.
+size_t ErrorInfoGetMiniDumpMemoryRanges(
+    StackCaptureCache* stack_cache,
+    const AsanErrorInfo& error_info,
+    trace::common::MiniDumpMemoryRange* ranges,
+    size_t max_ranges);
+
 // Given a populated AsanBlockInfo struct, fills out a corresponding crashdata
 // protobuf.
 // @param block_info The block info information.
@@ -221,6 +239,20 @@ void PopulateCorruptBlockRange(const AsanCorruptBlockRange& range,
 void PopulateErrorInfo(const AsanErrorInfo& error_info,
                        crashdata::Value* value);
 
+// Serializes an AsanErrorInfo struct to a buffer, in the same format as the
+// crashdata protobuf filled out by PopulateErrorInfo. This doesn't allocate
+// any memory, so it's safe to use while handling a crash. If the corrupt
+// ranges don't all fit in the buffer, the most relevant ones are kept, and
+// they're ordered by relevance rather than by address.
+// @param error_info The filled in error information.
+// @param buffer The buffer receiving the serialized protobuf.
+// @param buffer_size The size of @p buffer.
+// @returns the size of the serialized protobuf, or 0 if the information
+//     about the error itself doesn't fit in @p buffer.
+size_t SerializeErrorInfo(const AsanErrorInfo& error_info,
+                          void* buffer,
+                          size_t buffer_size);
+
 }  // namespace asan
 }  // namespace agent
 
@@ -68,6 +68,45 @@ TEST_F(AsanErrorInfoTest, ErrorInfoGetBadAccessInformation) {
                                                 &error_info));
 }
 
+TEST_F(AsanErrorInfoTest, ErrorInfoGetMiniDumpMemoryRanges) {
+  testing::FakeAsanBlock fake_block(kShadowRatioLog, runtime_->stack_cache());
+  const size_t kAllocSize = 100;
+  EXPECT_TRUE(fake_block.InitializeBlock(kAllocSize));
+
+  AsanErrorInfo error_info = {};
+  error_info.location = fake_block.block_info.body + kAllocSize + 1;
+  EXPECT_TRUE(ErrorInfoGetBadAccessInformation(runtime_->stack_cache(),
+                                               &error_info));
+
+  trace::common::MiniDumpMemoryRange ranges[16] = {};
+  size_t count = ErrorInfoGetMiniDumpMemoryRanges(
+      runtime_->stack_cache(), error_info, ranges, arraysize(ranges));
+  ASSERT_LT(2u, count);
+
+  // The faulting block and its shadow come first.
+  const BlockInfo& block_info = fake_block.block_info;
+  EXPECT_EQ(reinterpret_cast<uint32>(block_info.block), ranges[0].address);
+  EXPECT_EQ(block_info.block_size, ranges[0].size);
+  EXPECT_EQ(reinterpret_cast<uint32>(Shadow::shadow()) +
+                (ranges[0].address >> kShadowRatioLog),
+            ranges[1].address);
+  EXPECT_EQ(block_info.block_size >> kShadowRatioLog, ranges[1].size);
+
+  // It is followed by its alloc stack trace.
+  const common::StackCapture* alloc_stack = block_info.header->alloc_stack;
+  EXPECT_EQ(reinterpret_cast<uint32>(alloc_stack), ranges[2].address);
+  EXPECT_EQ(alloc_stack->Size(), ranges[2].size);
+
+  // The ranges are truncated to the capacity of the array.
+  EXPECT_EQ(1u, ErrorInfoGetMiniDumpMemoryRanges(
+      runtime_->stack_cache(), error_info, ranges, 1));
+
+  // Accesses outside of the memory covered by the shadow have no ranges.
+  error_info.location = nullptr;
+  EXPECT_EQ(0u, ErrorInfoGetMiniDumpMemoryRanges(
+      runtime_->stack_cache(), error_info, ranges, arraysize(ranges)));
+}
+
 TEST_F(AsanErrorInfoTest, GetBadAccessInformationNestedBlock) {
   // Test a nested use after free. We allocate an outer block and an inner block
   // inside it, then we mark the outer block as quarantined and we test a bad
@@ -485,5 +524,94 @@ TEST_F(AsanErrorInfoTest, PopulateErrorInfo) {
   EXPECT_EQ(kExpected, json);
 }
 
+TEST_F(AsanErrorInfoTest, SerializeErrorInfo) {
+  AsanBlockInfo block_info = {};
+  InitAsanBlockInfo(&block_info);
+
+  AsanCorruptBlockRange range = {};
+  range.address = reinterpret_cast<void*>(0xBAADF00D);
+  range.length = 1024 * 1024;
+  range.block_count = 100;
+  range.block_info_count = 1;
+  range.block_info = &block_info;
+
+  AsanErrorInfo error_info = {};
+  error_info.location = reinterpret_cast<void*>(0x00001000);
+  error_info.crash_stack_id = 1234;
+  InitAsanBlockInfo(&error_info.block_info);
+  error_info.error_type = WILD_ACCESS;
+  error_info.access_mode = ASAN_READ_ACCESS;
+  error_info.access_size = 4;
+  error_info.heap_is_corrupt = true;
+  error_info.corrupt_range_count = 10;
+  error_info.corrupt_block_count = 200;
+  error_info.corrupt_ranges_reported = 1;
+  error_info.corrupt_ranges = &range;
+
+  crashdata::Value info;
+  PopulateErrorInfo(error_info, &info);
+  std::string expected;
+  EXPECT_TRUE(info.SerializeToString(&expected));
+
+  char buffer[4096] = {};
+  size_t size = SerializeErrorInfo(error_info, buffer, sizeof(buffer));
+  EXPECT_EQ(expected, std::string(buffer, size));
+
+  // Nothing is written if the error itself doesn't fit.
+  EXPECT_EQ(0u, SerializeErrorInfo(error_info, buffer, 64));
+}
+
+TEST_F(AsanErrorInfoTest, SerializeErrorInfoKeepsMostRelevantRanges) {
+  // The second range has the most blocks, and the third one contains the bad
+  // access.
+  AsanCorruptBlockRange ranges[3] = {};
+  ranges[0].address = reinterpret_cast<void*>(0x00010000);
+  ranges[0].length = 1024;
+  ranges[0].block_count = 1;
+  ranges[1].address = reinterpret_cast<void*>(0x00020000);
+  ranges[1].length = 1024;
+  ranges[1].block_count = 5;
+  ranges[2].address = reinterpret_cast<void*>(0x00030000);
+  ranges[2].length = 1024;
+  ranges[2].block_count = 1;
+
+  AsanErrorInfo error_info = {};
+  error_info.location = reinterpret_cast<void*>(0x00030010);
+  error_info.error_type = CORRUPT_BLOCK;
+  error_info.heap_is_corrupt = true;
+  error_info.corrupt_range_count = arraysize(ranges);
+  error_info.corrupt_block_count = 7;
+  error_info.corrupt_ranges_reported = arraysize(ranges);
+  error_info.corrupt_ranges = ranges;
+
+  char buffer[4096] = {};
+  size_t size = SerializeErrorInfo(error_info, buffer, sizeof(buffer));
+  ASSERT_NE(0u, size);
+
+  // The ranges are ordered by relevance, and the least relevant one is
+  // dropped when the buffer is a byte short.
+  for (size_t expected_count = 3; expected_count >= 2; --expected_count) {
+    crashdata::Value value;
+    ASSERT_TRUE(value.ParseFromArray(buffer, size));
+    const crashdata::Dictionary& dict = value.dictionary();
+    const crashdata::KeyValue& last = dict.values(dict.values_size() - 1);
+    EXPECT_EQ("corrupt-ranges", last.key());
+    const crashdata::List& list = last.value().list();
+    ASSERT_EQ(static_cast<int>(expected_count), list.values_size());
+    static const uint64 kExpectedAddresses[] = {
+        0x00030000, 0x00020000, 0x00010000 };
+    for (size_t i = 0; i < expected_count; ++i) {
+      const crashdata::KeyValue& key_value =
+          list.values(i).dictionary().values(0);
+      EXPECT_EQ("address", key_value.key());
+      EXPECT_EQ(kExpectedAddresses[i],
+                key_value.value().leaf().address().address());
+    }
+
+    size = SerializeErrorInfo(error_info, buffer, size - 1);
+    ASSERT_NE(0u, size);
+  }
+}
+
 }  // namespace asan
 }  // namespace agent
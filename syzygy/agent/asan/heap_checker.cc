@@ -21,6 +21,12 @@
 namespace agent {
 namespace asan {
 
+HeapChecker::HeapChecker()
+    : incremental_cursor_(
+          reinterpret_cast<const uint8*>(Shadow::kAddressLowerBound)),
+      incremental_in_corrupt_range_(false) {
+}
+
 bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
   DCHECK_NE(reinterpret_cast<CorruptRangesVector*>(NULL), corrupt_ranges);
 
@@ -34,26 +40,71 @@ bool HeapChecker::IsHeapCorrupt(CorruptRangesVector* corrupt_ranges) {
   // Walk over all of the addressable memory to find the corrupt blocks.
   // TODO(sebmarchand): Iterates over the heap slabs once we have switched to
   //     a new memory allocator.
+  bool in_corrupt_range = false;
   GetCorruptRangesInSlab(
       reinterpret_cast<const uint8*>(Shadow::kAddressLowerBound),
       Shadow::kAddressUpperBound - Shadow::kAddressLowerBound - 1,
+      &in_corrupt_range,
       corrupt_ranges);
 
   return !corrupt_ranges->empty();
 }
 
-void HeapChecker::GetCorruptRangesInSlab(const uint8* lower_bound,
-                                         size_t length,
+bool HeapChecker::CheckHeapIncrementally(size_t max_pages,
                                          CorruptRangesVector* corrupt_ranges) {
+  DCHECK_NE(0U, max_pages);
+  DCHECK_NE(reinterpret_cast<CorruptRangesVector*>(NULL), corrupt_ranges);
+
+  // Only the page protection lock is held, and only for the duration of this
+  // call. The heap may be modified between calls, so a block may be missed if
+  // it's allocated across the cursor in the meantime.
+  ::common::AutoRecursiveLock scoped_lock(block_protect_lock);
+
+  const uint8* upper_bound =
+      reinterpret_cast<const uint8*>(Shadow::kAddressUpperBound);
+  DCHECK_LT(incremental_cursor_, upper_bound);
+
+  size_t length = upper_bound - incremental_cursor_;
+  size_t max_length = max_pages * GetPageSize();
+  if (max_pages < length / GetPageSize())
+    length = max_length;
+
+  incremental_cursor_ = GetCorruptRangesInSlab(incremental_cursor_,
+                                               length,
+                                               &incremental_in_corrupt_range_,
+                                               corrupt_ranges);
+  if (incremental_cursor_ < upper_bound)
+    return false;
+
+  ResetIncrementalCheck();
+  return true;
+}
+
+void HeapChecker::ResetIncrementalCheck() {
+  incremental_cursor_ =
+      reinterpret_cast<const uint8*>(Shadow::kAddressLowerBound);
+  incremental_in_corrupt_range_ = false;
+}
+
+const uint8* HeapChecker::GetCorruptRangesInSlab(
+    const uint8* lower_bound,
+    size_t length,
+    bool* in_corrupt_range,
+    CorruptRangesVector* corrupt_ranges) {
   DCHECK_NE(reinterpret_cast<const uint8*>(NULL), lower_bound);
   DCHECK_NE(0U, length);
+  DCHECK_NE(reinterpret_cast<bool*>(NULL), in_corrupt_range);
   DCHECK_NE(reinterpret_cast<CorruptRangesVector*>(NULL), corrupt_ranges);
 
-  ShadowWalker shadow_walker(false, lower_bound, lower_bound + length);
+  const uint8* upper_bound = lower_bound + length;
+  ShadowWalker shadow_walker(false, lower_bound, upper_bound);
 
   AsanCorruptBlockRange* current_corrupt_range = NULL;
+  if (*in_corrupt_range && !corrupt_ranges->empty())
+    current_corrupt_range = &corrupt_ranges->back();
 
   // Iterates over the blocks.
+  const uint8* next_lower_bound = upper_bound;
   BlockInfo block_info = {};
   while (shadow_walker.Next(&block_info)) {
     // Remove the protections on this block so its checksum can be safely
@@ -78,17 +129,27 @@ void HeapChecker::GetCorruptRangesInSlab(const uint8* lower_bound,
       current_corrupt_range = NULL;
     }
 
+    const uint8* current_block_end = block_info.block + block_info.block_size;
     if (current_block_is_corrupt) {
       // If the current block is corrupt then we need to update the size of the
       // current range.
       DCHECK_NE(reinterpret_cast<AsanCorruptBlockRange*>(NULL),
                 current_corrupt_range);
       current_corrupt_range->block_count++;
-      const uint8* current_block_end = block_info.block + block_info.block_size;
       current_corrupt_range->length = current_block_end -
           reinterpret_cast<const uint8*>(current_corrupt_range->address);
     }
+
+    // The walker can't be advanced past a block that straddles the upper
+    // bound of the slab, so stop here and resume after it.
+    if (current_block_end >= upper_bound) {
+      next_lower_bound = current_block_end;
+      break;
+    }
   }
+
+  *in_corrupt_range = current_corrupt_range != NULL;
+  return next_lower_bound;
 }
 
 }  // namespace asan
@@ -35,7 +35,7 @@ class HeapChecker {
   typedef std::vector<AsanCorruptBlockRange> CorruptRangesVector;
 
   // Constructor.
-  HeapChecker() { }
+  HeapChecker();
 
   // Checks if the heap is corrupt and returns the information about the
   // corrupt ranges. This permanently removes all page protections as it
@@ -45,6 +45,30 @@ class HeapChecker {
   // @returns true if the heap is corrupt, false otherwise.
   bool IsHeapCorrupt(CorruptRangesVector* corrupt_ranges);
 
+  // Checks a bounded portion of the heap for corruption, resuming where the
+  // previous call left off. Repeated calls walk the entire addressable memory,
+  // after which the walk starts over from the beginning. This allows the
+  // cost of a heap check to be spread over time, rather than stalling the
+  // process for the duration of a complete walk. Like IsHeapCorrupt this
+  // permanently removes the page protections of the blocks that it walks.
+  // @param max_pages The maximum number of pages of memory to walk in this
+  //     call. This may be exceeded to finish walking a block that straddles
+  //     the end of the walked region.
+  // @param corrupt_ranges Will have information about the corrupt ranges
+  //     found by this call appended to it. A corrupt range that straddles two
+  //     calls will be extended, as long as the vector is preserved between
+  //     the calls.
+  // @returns true if this call completed a walk of the entire memory, false
+  //     otherwise.
+  bool CheckHeapIncrementally(size_t max_pages,
+                              CorruptRangesVector* corrupt_ranges);
+
+  // Restarts incremental checking from the beginning of the memory.
+  void ResetIncrementalCheck();
+
+  // @returns the address at which the next incremental check will start.
+  const uint8* incremental_cursor() const { return incremental_cursor_; }
+
   // TODO(sebmarchand): Add a testing seam that controls the range of memory
   //     that is walked by HeapChecker to keep unittest times to something
   //     reasonable.
@@ -53,11 +77,27 @@ class HeapChecker {
   // Get the information about the corrupt ranges in a heap slab.
   // @param lower_bound The lower bound for this slab.
   // @param length The length of this slab.
+  // @param in_corrupt_range Indicates if the last block walked before this
+  //     slab was corrupt, in which case the last range of @p corrupt_ranges
+  //     will be extended by any corrupt blocks at the start of the slab. Will
+  //     be updated to reflect the state of the last block in the slab.
   // @param corrupt_ranges Will receive the information about the corrupt ranges
   //     in this slab.
-  void GetCorruptRangesInSlab(const uint8* lower_bound,
-                              size_t length,
-                              CorruptRangesVector* corrupt_ranges);
+  // @returns the address at which a walk of the following memory should
+  //     start. This is past the end of the slab if its last block straddles
+  //     its upper bound.
+  const uint8* GetCorruptRangesInSlab(const uint8* lower_bound,
+                                      size_t length,
+                                      bool* in_corrupt_range,
+                                      CorruptRangesVector* corrupt_ranges);
+
+  // The address at which the next incremental check will start.
+  const uint8* incremental_cursor_;
+
+  // Indicates if the last block walked by the incremental check was corrupt.
+  bool incremental_in_corrupt_range_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeapChecker);
 };
 
 }  // namespace asan
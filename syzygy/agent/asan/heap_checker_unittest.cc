@@ -202,5 +202,68 @@ TEST_F(HeapCheckerTest, IsHeapCorrupt) {
   ::free(global_alloc);
 }
 
+TEST_F(HeapCheckerTest, CheckHeapIncrementally) {
+  const size_t kAllocSize = 100;
+
+  BlockLayout block_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, kAllocSize, 0, 0,
+                              &block_layout));
+
+  const size_t kNumberOfBlocks = 4;
+  size_t total_alloc_size = block_layout.block_size * kNumberOfBlocks;
+  uint8* global_alloc = reinterpret_cast<uint8*>(::malloc(total_alloc_size));
+
+  BlockHeader* block_headers[kNumberOfBlocks];
+  for (size_t i = 0; i < kNumberOfBlocks; ++i) {
+    BlockInfo block_info = {};
+    BlockInitialize(block_layout, global_alloc + i * block_layout.block_size,
+                    false, &block_info);
+    Shadow::PoisonAllocatedBlock(block_info);
+    BlockSetChecksum(block_info);
+    block_headers[i] = block_info.header;
+  }
+
+  // Corrupt the header of the first two blocks and of the last one.
+  block_headers[0]->magic++;
+  block_headers[1]->magic++;
+  block_headers[kNumberOfBlocks - 1]->magic++;
+
+  HeapChecker heap_checker;
+  HeapChecker::CorruptRangesVector expected_ranges;
+  EXPECT_TRUE(heap_checker.IsHeapCorrupt(&expected_ranges));
+  EXPECT_EQ(2, expected_ranges.size());
+
+  // Walk the heap a couple of pages at a time. This should find exactly the
+  // same corrupt ranges as the full walk.
+  const size_t kMaxPages = 2;
+  HeapChecker::CorruptRangesVector corrupt_ranges;
+  size_t call_count = 0;
+  const uint8* previous_cursor = heap_checker.incremental_cursor();
+  while (!heap_checker.CheckHeapIncrementally(kMaxPages, &corrupt_ranges)) {
+    // Each call should make some progress.
+    ASSERT_LT(previous_cursor, heap_checker.incremental_cursor());
+    previous_cursor = heap_checker.incremental_cursor();
+    ++call_count;
+  }
+  EXPECT_LT(1u, call_count);
+  EXPECT_EQ(reinterpret_cast<const uint8*>(Shadow::kAddressLowerBound),
+            heap_checker.incremental_cursor());
+
+  ASSERT_EQ(expected_ranges.size(), corrupt_ranges.size());
+  for (size_t i = 0; i < expected_ranges.size(); ++i) {
+    EXPECT_EQ(expected_ranges[i].address, corrupt_ranges[i].address);
+    EXPECT_EQ(expected_ranges[i].length, corrupt_ranges[i].length);
+    EXPECT_EQ(expected_ranges[i].block_count, corrupt_ranges[i].block_count);
+  }
+
+  // Restore the blocks.
+  block_headers[0]->magic--;
+  block_headers[1]->magic--;
+  block_headers[kNumberOfBlocks - 1]->magic--;
+
+  Shadow::Unpoison(global_alloc, total_alloc_size);
+  ::free(global_alloc);
+}
+
 }  // namespace asan
 }  // namespace agent
@@ -56,6 +56,15 @@ class HeapManagerInterface {
   // @returns true on failure, false otherwise.
   virtual bool Free(HeapId heap, void* alloc) = 0;
 
+  // Tries to resize a heap allocation without moving it.
+  // @param heap A hint on the heap that might contain this allocation.
+  // @param alloc The pointer to the allocation to be resized. This must be a
+  //     value that was previously returned by a call to 'Allocate'.
+  // @param bytes The new size of the allocation, in bytes.
+  // @returns true if the allocation has been resized in place, false if it
+  //     has been left untouched and must be moved to be resized.
+  virtual bool ResizeInPlace(HeapId heap, void* alloc, size_t bytes) = 0;
+
   // Returns the size of a heap allocation.
   // @param heap A hint on the heap that might contain this allocation.
   // @param alloc The pointer to the allocation whose size is to be calculated.
@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
 
+#include <intrin.h>
+
 #include <algorithm>
 #include <utility>
 
@@ -71,6 +73,7 @@ const size_t BlockHeapManager::kDefaultRateTargetedHeapsMaxBlockSize[] =
 
 BlockHeapManager::BlockHeapManager(StackCaptureCache* stack_cache)
     : stack_cache_(stack_cache),
+      heap_id_cookie_(static_cast<uintptr_t>(base::RandUint64())),
       initialized_(false),
       process_heap_(nullptr),
       process_heap_underlying_heap_(nullptr),
@@ -101,6 +104,15 @@ void BlockHeapManager::Init() {
     InitInternalHeap();
   }
 
+  // Expose the counters to external tools. They are kept in private memory
+  // if the section can't be created.
+  COMPILE_ASSERT(ShardedBlockQuarantine::kShardingFactor ==
+                     arraysize(statistics()->quarantine.shards),
+                 statistics_shard_count_mismatch);
+  statistics_section_.Init();
+  shared_quarantine_.set_shard_statistics(
+      statistics_section_.statistics()->quarantine.shards);
+
   // This takes care of its own locking, as its reentrant.
   PropagateParameters();
 
@@ -108,9 +120,12 @@ void BlockHeapManager::Init() {
     base::AutoLock lock(lock_);
     InitProcessHeap();
     initialized_ = true;
+    if (parameters_.enable_deferred_trimming)
+      StartDeferredTrimmingThreadUnlocked();
   }
 
   InitRateTargetedHeaps();
+  InitLifetimeSegregatedHeaps();
 }
 
 HeapId BlockHeapManager::CreateHeap() {
@@ -126,13 +141,12 @@ HeapId BlockHeapManager::CreateHeap() {
     underlying_heap = new heaps::WinHeap();
   }
   // Creates the heap.
-  BlockHeapInterface* heap = new heaps::SimpleBlockHeap(underlying_heap);
+  BlockHeapInterface* heap = new heaps::SimpleBlockHeap(
+      underlying_heap, parameters_.enable_block_cache);
 
   base::AutoLock lock(lock_);
   underlying_heaps_map_.insert(std::make_pair(heap, underlying_heap));
-  HeapMetadata metadata = { &shared_quarantine_, false };
-  auto result = heaps_.insert(std::make_pair(heap, metadata));
-  return GetHeapId(result);
+  return InsertHeapUnlocked(heap, &shared_quarantine_);
 }
 
 bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
@@ -149,6 +163,10 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
     iter->second.is_dying = true;
   }
 
+  // Prevent the deferred trimming thread from freeing blocks to this heap
+  // while it's being destroyed.
+  base::AutoLock trimming_lock(deferred_trimming_lock_);
+
   // Destroy the heap and flush its quarantine. This is done outside of the
   // lock to both reduce contention and to ensure that we can re-enter the
   // block heap manager if corruption is found during the heap tear down.
@@ -159,7 +177,9 @@ bool BlockHeapManager::DestroyHeap(HeapId heap_id) {
   {
     base::AutoLock lock(lock_);
     DestroyHeapResourcesUnlocked(heap, quarantine);
-    heaps_.erase(heaps_.find(heap));
+    auto iter = heaps_.find(heap);
+    iter->second.heap_id_tag = 0;
+    heaps_.erase(iter);
   }
 
   return true;
@@ -169,16 +189,12 @@ void* BlockHeapManager::Allocate(HeapId heap_id, size_t bytes) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
 
-  // Some allocations can pass through without instrumentation.
-  if (parameters_.allocation_guard_rate < 1.0 &&
+  // Some allocations can pass through without instrumentation. With allocation
+  // sampling this is decided per allocation site, once the stack is known.
+  if (!parameters_.enable_allocation_sampling &&
+      parameters_.allocation_guard_rate < 1.0 &&
       base::RandDouble() >= parameters_.allocation_guard_rate) {
-    BlockHeapInterface* heap = GetHeapFromId(heap_id);
-    void* alloc = heap->Allocate(bytes);
-    if ((heap->GetHeapFeatures() &
-       HeapInterface::kHeapReportsReservations) != 0) {
-      Shadow::Unpoison(alloc, bytes);
-    }
-    return alloc;
+    return AllocateUnguarded(heap_id, bytes);
   }
 
   // Capture the current stack. InitFromStack is inlined to preserve the
@@ -186,6 +202,11 @@ void* BlockHeapManager::Allocate(HeapId heap_id, size_t bytes) {
   common::StackCapture stack;
   stack.InitFromStack();
 
+  if (parameters_.enable_allocation_sampling &&
+      !ShouldGuardSampledAllocation(stack)) {
+    return AllocateUnguarded(heap_id, bytes);
+  }
+
   // Build the set of heaps that will be used to satisfy the allocation. This
   // is a stack of heaps, and they will be tried in the reverse order they are
   // inserted.
@@ -203,7 +224,15 @@ void* BlockHeapManager::Allocate(HeapId heap_id, size_t bytes) {
     heaps[heap_count++] = zebra_block_heap_id_;
   }
 
-  if (MayUseRateTargetedHeap(bytes)) {
+  // The lifetime segregated heaps take precedence over the rate targeted
+  // heaps, but only once the lifetime of the allocation site is known.
+  HeapId lifetime_heap_id = 0;
+  if (MayUseLifetimeSegregatedHeap(bytes))
+    lifetime_heap_id = ChooseLifetimeSegregatedHeap(stack);
+  if (lifetime_heap_id != 0) {
+    DCHECK_LT(heap_count, arraysize(heaps));
+    heaps[heap_count++] = lifetime_heap_id;
+  } else if (MayUseRateTargetedHeap(bytes)) {
     DCHECK_LT(heap_count, arraysize(heaps));
     heaps[heap_count++] = ChooseRateTargetedHeap(stack);
   }
@@ -225,8 +254,16 @@ void* BlockHeapManager::Allocate(HeapId heap_id, size_t bytes) {
   }
 
   // The allocation can fail if we're out of memory.
-  if (alloc == nullptr)
+  if (alloc == nullptr) {
+    ::InterlockedIncrement(
+        &GetHeapTypeStatistics(heaps[0])->failed_allocation_count);
     return nullptr;
+  }
+
+  HeapTypeStatistics* heap_statistics = GetHeapTypeStatistics(heap_id);
+  ::InterlockedIncrement(&heap_statistics->allocation_count);
+  ::InterlockedExchangeAdd(&heap_statistics->allocated_bytes,
+                           static_cast<LONG>(bytes));
 
   DCHECK_NE(static_cast<void*>(nullptr), alloc);
   DCHECK_EQ(0u, reinterpret_cast<size_t>(alloc) % kShadowRatio);
@@ -283,6 +320,11 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   heap_id = block_info.trailer->heap_id;
   BlockQuarantineInterface* quarantine = GetQuarantineFromId(heap_id);
 
+  HeapTypeStatistics* heap_statistics = GetHeapTypeStatistics(heap_id);
+  ::InterlockedIncrement(&heap_statistics->free_count);
+  ::InterlockedExchangeAdd(&heap_statistics->allocated_bytes,
+                           -static_cast<LONG>(block_info.body_size));
+
   // Poison the released alloc (marked as freed) and quarantine the block.
   // Note that the original data is left intact. This may make it easier
   // to debug a crash report/dump on access to a quarantined block.
@@ -299,6 +341,13 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   block_info.trailer->free_tid = ::GetCurrentThreadId();
   block_info.header->state = QUARANTINED_BLOCK;
 
+  if (parameters_.enable_lifetime_segregated_heaps &&
+      block_info.header->alloc_stack != nullptr) {
+    RecordAllocationLifetime(
+        block_info.header->alloc_stack->stack_id(),
+        block_info.trailer->free_ticks - block_info.trailer->alloc_ticks);
+  }
+
   BlockSetChecksum(block_info);
 
   CompactBlockInfo compact = {};
@@ -317,10 +366,67 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
     // not allocated) block.
     BlockProtectAll(block_info);
   }
+  UpdateQuarantineStatistics(quarantine);
+
+  if (CanDeferTrimming(quarantine)) {
+    // Only wake up the trimming thread if there's some work for it to do.
+    if (shared_quarantine_.size() > parameters_.quarantine_size)
+      ::SetEvent(deferred_trimming_event_.Get());
+    return true;
+  }
+
   TrimQuarantine(quarantine);
   return true;
 }
 
+bool BlockHeapManager::ResizeInPlace(HeapId heap_id,
+                                     void* alloc,
+                                     size_t bytes) {
+  DCHECK(initialized_);
+  DCHECK(IsValidHeapId(heap_id, false));
+  DCHECK_NE(static_cast<void*>(nullptr), alloc);
+
+  // Unguarded allocations are always moved.
+  BlockInfo block_info = {};
+  if (!Shadow::IsBeginningOfBlockBody(alloc) ||
+      !GetBlockInfo(alloc, &block_info)) {
+    return false;
+  }
+
+  // Let the caller take the regular path for nested and invalid blocks, it
+  // will report the errors if there are any.
+  if (block_info.is_nested)
+    return false;
+  BlockProtectNone(block_info);
+  if (!BlockChecksumIsValid(block_info) ||
+      block_info.header->state != ALLOCATED_BLOCK) {
+    BlockProtectRedzones(block_info);
+    return false;
+  }
+
+  // The body can grow into the trailer padding, as long as the right redzone
+  // stays as large as the one of a new allocation.
+  size_t old_body_size = block_info.body_size;
+  if (!BlockResizeBody(bytes,
+                       parameters_.trailer_padding_size + sizeof(BlockTrailer),
+                       &block_info)) {
+    BlockProtectRedzones(block_info);
+    return false;
+  }
+
+  HeapTypeStatistics* heap_statistics =
+      GetHeapTypeStatistics(block_info.trailer->heap_id);
+  ::InterlockedExchangeAdd(&heap_statistics->allocated_bytes,
+                           static_cast<LONG>(bytes) -
+                               static_cast<LONG>(old_body_size));
+
+  Shadow::PoisonAllocatedBlock(block_info);
+  BlockSetChecksum(block_info);
+  BlockProtectRedzones(block_info);
+
+  return true;
+}
+
 size_t BlockHeapManager::Size(HeapId heap_id, const void* alloc) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapId(heap_id, false));
@@ -406,6 +512,10 @@ void BlockHeapManager::set_parameters(
 }
 
 void BlockHeapManager::TearDownHeapManager() {
+  // The deferred trimming thread must be stopped before the heaps it frees
+  // blocks to are destroyed.
+  StopDeferredTrimmingThread();
+
   base::AutoLock lock(lock_);
 
   // This would indicate that we have outstanding heap locks being
@@ -419,6 +529,7 @@ void BlockHeapManager::TearDownHeapManager() {
   for (; iter_heaps != heaps_.end(); ++iter_heaps) {
     DCHECK(!iter_heaps->second.is_dying);
     iter_heaps->second.is_dying = true;
+    iter_heaps->second.heap_id_tag = 0;
     DestroyHeapContents(iter_heaps->first, iter_heaps->second.quarantine);
     DestroyHeapResourcesUnlocked(iter_heaps->first,
                                  iter_heaps->second.quarantine);
@@ -440,6 +551,13 @@ void BlockHeapManager::TearDownHeapManager() {
       rate_targeted_heaps_count_[i] = 0;
     }
   }
+  {
+    base::AutoLock lock(site_lifetimes_lock_);
+    for (size_t i = 0; i < kLifetimeClassCount; ++i) {
+      lifetime_segregated_heaps_[i] = 0;
+      lifetime_segregated_heaps_count_[i] = 0;
+    }
+  }
 
   // Free the allocation-filter flag (TLS).
   if (allocation_filter_flag_tls_ != TLS_OUT_OF_INDEXES) {
@@ -459,40 +577,32 @@ HeapId BlockHeapManager::GetHeapId(
   return GetHeapId(insert_result.first);
 }
 
-bool BlockHeapManager::IsValidHeapIdUnsafe(HeapId heap_id, bool allow_dying) {
-  DCHECK(initialized_);
-  HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
-  if (!IsValidHeapIdUnsafeUnlockedImpl1(hq))
-    return false;
-  base::AutoLock auto_lock(lock_);
-  if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
-    return false;
-  return true;
+uintptr_t BlockHeapManager::GetHeapIdTag(HeapId heap_id) const {
+  // Never return zero, as this is the tag of the heaps being removed.
+  return (heap_id ^ heap_id_cookie_) | 1;
 }
 
-bool BlockHeapManager::IsValidHeapIdUnsafeUnlocked(
-    HeapId heap_id, bool allow_dying) {
-  DCHECK(initialized_);
-  HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
-  if (!IsValidHeapIdUnsafeUnlockedImpl1(hq))
-    return false;
-  if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
-    return false;
-  return true;
+HeapId BlockHeapManager::InsertHeapUnlocked(
+    BlockHeapInterface* heap, BlockQuarantineInterface* quarantine) {
+  lock_.AssertAcquired();
+  HeapMetadata metadata = { quarantine, false, 0 };
+  auto result = heaps_.insert(std::make_pair(heap, metadata));
+  HeapId heap_id = GetHeapId(result);
+  result.first->second.heap_id_tag = GetHeapIdTag(heap_id);
+  return heap_id;
 }
 
-bool BlockHeapManager::IsValidHeapId(HeapId heap_id, bool allow_dying) {
+bool BlockHeapManager::IsValidHeapIdUnsafe(HeapId heap_id, bool allow_dying) {
   DCHECK(initialized_);
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
-  if (!IsValidHeapIdUnlockedImpl1(hq))
+  if (!IsValidHeapIdUnsafeUnlockedImpl1(hq))
     return false;
-  base::AutoLock auto_lock(lock_);
   if (!IsValidHeapIdUnlockedImpl2(hq, allow_dying))
     return false;
   return true;
 }
 
-bool BlockHeapManager::IsValidHeapIdUnlocked(HeapId heap_id, bool allow_dying) {
+bool BlockHeapManager::IsValidHeapId(HeapId heap_id, bool allow_dying) {
   DCHECK(initialized_);
   HeapQuarantinePair* hq = reinterpret_cast<HeapQuarantinePair*>(heap_id);
   if (!IsValidHeapIdUnlockedImpl1(hq))
@@ -528,15 +638,12 @@ bool BlockHeapManager::IsValidHeapIdUnlockedImpl1(
 
 bool BlockHeapManager::IsValidHeapIdUnlockedImpl2(HeapQuarantinePair* hq,
                                                   bool allow_dying) {
-  // Look in the list of live heaps first.
-  auto it = heaps_.find(hq->first);
-  if (it != heaps_.end()) {
-    HeapId heap_id = GetHeapId(it);
-    if (heap_id == reinterpret_cast<HeapId>(hq))
-      return !it->second.is_dying || allow_dying;
-  }
-
-  return false;
+  // The tag is only valid while the heap is in heaps_, so this doesn't need
+  // to look the heap up under lock_.
+  HeapId heap_id = reinterpret_cast<HeapId>(hq);
+  if (hq->second.heap_id_tag != GetHeapIdTag(heap_id))
+    return false;
+  return !hq->second.is_dying || allow_dying;
 }
 
 BlockHeapInterface* BlockHeapManager::GetHeapFromId(HeapId heap_id) {
@@ -567,6 +674,11 @@ void BlockHeapManager::PropagateParameters() {
   if (initialized_ && quarantine_size > parameters_.quarantine_size)
     TrimQuarantine(&shared_quarantine_);
 
+  if (initialized_ && parameters_.enable_deferred_trimming) {
+    base::AutoLock lock(lock_);
+    StartDeferredTrimmingThreadUnlocked();
+  }
+
   if (parameters_.enable_zebra_block_heap && zebra_block_heap_ == nullptr) {
     // Initialize the zebra heap only if it isn't already initialized.
     // The zebra heap cannot be resized once created.
@@ -575,10 +687,8 @@ void BlockHeapManager::PropagateParameters() {
                                            &shadow_memory_notifier_,
                                            internal_heap_.get());
     // The zebra block heap is its own quarantine.
-    HeapMetadata heap_metadata = { zebra_block_heap_, false };
-    auto result = heaps_.insert(std::make_pair(zebra_block_heap_,
-                                               heap_metadata));
-    zebra_block_heap_id_ = GetHeapId(result);
+    zebra_block_heap_id_ = InsertHeapUnlocked(zebra_block_heap_,
+                                              zebra_block_heap_);
   }
 
   if (zebra_block_heap_ != nullptr) {
@@ -592,9 +702,14 @@ void BlockHeapManager::PropagateParameters() {
   if (parameters_.enable_large_block_heap && large_block_heap_id_ == 0) {
     base::AutoLock lock(lock_);
     BlockHeapInterface* heap = new LargeBlockHeap(internal_heap_.get());
-    HeapMetadata metadata = { &shared_quarantine_, false };
-    auto result = heaps_.insert(std::make_pair(heap, metadata));
-    large_block_heap_id_ = GetHeapId(result);
+    large_block_heap_id_ = InsertHeapUnlocked(heap, &shared_quarantine_);
+  }
+
+  if (large_block_heap_id_ != 0) {
+    LargeBlockHeap* large_block_heap =
+        static_cast<LargeBlockHeap*>(GetHeapFromId(large_block_heap_id_));
+    large_block_heap->set_reservation_cache_size(
+        parameters_.large_block_heap_cache_size);
   }
 
   // TODO(chrisha|sebmarchand): Clean up existing blocks that exceed the
@@ -613,7 +728,7 @@ void BlockHeapManager::set_allocation_filter_flag(bool value) {
 
 HeapType BlockHeapManager::GetHeapTypeUnlocked(HeapId heap_id) {
   DCHECK(initialized_);
-  DCHECK(IsValidHeapIdUnlocked(heap_id, true));
+  DCHECK(IsValidHeapId(heap_id, true));
   BlockHeapInterface* heap = GetHeapFromId(heap_id);
   return heap->GetHeapType();
 }
@@ -637,13 +752,13 @@ bool BlockHeapManager::DestroyHeapContents(
   BlockQuarantineInterface::ObjectVector blocks_to_reinsert;
   quarantine->Empty(&blocks_vec);
 
+  // Remove protection to enable access to the block headers.
+  UnprotectBlockVector(blocks_vec);
+
   for (const auto& iter_block : blocks_vec) {
     BlockInfo expanded = {};
     ConvertBlockInfo(iter_block, &expanded);
 
-    // Remove protection to enable access to the block header.
-    BlockProtectNone(expanded);
-
     BlockHeapInterface* block_heap = GetHeapFromId(expanded.trailer->heap_id);
 
     if (block_heap == heap) {
@@ -677,17 +792,21 @@ bool BlockHeapManager::DestroyHeapContents(
 void BlockHeapManager::DestroyHeapResourcesUnlocked(
     BlockHeapInterface* heap,
     BlockQuarantineInterface* quarantine) {
-  // If the heap has an underlying heap then free it as well.
+  // If the heap has an underlying heap then free it as well. The heap itself
+  // must be destroyed first, as it may return cached blocks to its underlying
+  // heap.
+  HeapInterface* underlying_heap = nullptr;
   {
     auto iter = underlying_heaps_map_.find(heap);
     if (iter != underlying_heaps_map_.end()) {
       DCHECK_NE(static_cast<HeapInterface*>(nullptr), iter->second);
-      delete iter->second;
+      underlying_heap = iter->second;
       underlying_heaps_map_.erase(iter);
     }
   }
 
   delete heap;
+  delete underlying_heap;
 }
 
 void BlockHeapManager::TrimQuarantine(BlockQuarantineInterface* quarantine) {
@@ -695,6 +814,7 @@ void BlockHeapManager::TrimQuarantine(BlockQuarantineInterface* quarantine) {
   DCHECK_NE(static_cast<BlockQuarantineInterface*>(nullptr), quarantine);
 
   BlockQuarantineInterface::ObjectVector blocks_to_free;
+  uint64 start_cycles = ::__rdtsc();
 
   // Trim the quarantine to the new maximum size.
   if (parameters_.quarantine_size == 0) {
@@ -705,11 +825,144 @@ void BlockHeapManager::TrimQuarantine(BlockQuarantineInterface* quarantine) {
       blocks_to_free.push_back(compact);
   }
 
+  if (blocks_to_free.empty())
+    return;
+
   FreeBlockVector(blocks_to_free);
+  UpdateQuarantineStatistics(quarantine);
+  RecordTrimStatistics(::__rdtsc() - start_cycles);
+}
+
+bool BlockHeapManager::TrimQuarantineBatch(
+    BlockQuarantineInterface* quarantine, size_t max_blocks) {
+  DCHECK(initialized_);
+  DCHECK_NE(static_cast<BlockQuarantineInterface*>(nullptr), quarantine);
+
+  BlockQuarantineInterface::ObjectVector blocks_to_free;
+  blocks_to_free.reserve(max_blocks);
+  uint64 start_cycles = ::__rdtsc();
+
+  size_t popped = quarantine->PopBatch(max_blocks, &blocks_to_free);
+
+  FreeBlockVector(blocks_to_free);
+  if (popped != 0) {
+    UpdateQuarantineStatistics(quarantine);
+    RecordTrimStatistics(::__rdtsc() - start_cycles);
+  }
+  return popped == max_blocks;
+}
+
+bool BlockHeapManager::CanDeferTrimming(BlockQuarantineInterface* quarantine) {
+  DCHECK_NE(static_cast<BlockQuarantineInterface*>(nullptr), quarantine);
+
+  // Only the shared quarantine is trimmed by the deferred trimming thread.
+  if (!parameters_.enable_deferred_trimming ||
+      deferred_trimming_thread_.get() == nullptr ||
+      quarantine != &shared_quarantine_) {
+    return false;
+  }
+
+  // A quarantine size of 0 means that blocks must be freed immediately.
+  if (parameters_.quarantine_size == 0)
+    return false;
+
+  // Apply some backpressure if the trimming thread isn't keeping up.
+  size_t ceiling = parameters_.quarantine_size * kDeferredTrimmingCeilingRatio;
+  if (ceiling < parameters_.quarantine_size)
+    ceiling = parameters_.quarantine_size;
+  return shared_quarantine_.size() <= ceiling;
+}
+
+void BlockHeapManager::StartDeferredTrimmingThreadUnlocked() {
+  lock_.AssertAcquired();
+
+  if (deferred_trimming_thread_.get() != nullptr)
+    return;
+
+  deferred_trimming_event_.Set(::CreateEvent(nullptr, FALSE, FALSE, nullptr));
+  deferred_trimming_stop_event_.Set(
+      ::CreateEvent(nullptr, TRUE, FALSE, nullptr));
+  if (!deferred_trimming_event_.IsValid() ||
+      !deferred_trimming_stop_event_.IsValid()) {
+    LOG(ERROR) << "Unable to create the deferred trimming events.";
+    deferred_trimming_event_.Close();
+    deferred_trimming_stop_event_.Close();
+    return;
+  }
+
+  deferred_trimming_thread_.reset(new DeferredTrimmingThread(this));
+  deferred_trimming_thread_->Start();
+}
+
+void BlockHeapManager::StopDeferredTrimmingThread() {
+  if (deferred_trimming_thread_.get() == nullptr)
+    return;
+
+  ::SetEvent(deferred_trimming_stop_event_.Get());
+  deferred_trimming_thread_->Join();
+  deferred_trimming_thread_.reset();
+  deferred_trimming_event_.Close();
+  deferred_trimming_stop_event_.Close();
+}
+
+void BlockHeapManager::DeferredTrimmingLoop() {
+  HANDLE events[] = { deferred_trimming_stop_event_.Get(),
+                      deferred_trimming_event_.Get() };
+  while (true) {
+    DWORD ret = ::WaitForMultipleObjects(arraysize(events), events, FALSE,
+                                         INFINITE);
+    // Exit on a stop request, but also on failure rather than spinning.
+    // Any blocks left in the quarantine will be freed by the next
+    // synchronous trim, or when the heap manager is torn down.
+    if (ret != WAIT_OBJECT_0 + 1)
+      return;
+
+    while (true) {
+      {
+        base::AutoLock trimming_lock(deferred_trimming_lock_);
+        if (!TrimQuarantineBatch(&shared_quarantine_,
+                                 kDeferredTrimmingBatchSize)) {
+          break;
+        }
+      }
+      if (::WaitForSingleObject(deferred_trimming_stop_event_.Get(), 0) ==
+              WAIT_OBJECT_0) {
+        return;
+      }
+    }
+  }
+}
+
+BlockHeapManager::DeferredTrimmingThread::DeferredTrimmingThread(
+    BlockHeapManager* owner)
+    : base::SimpleThread("asan_deferred_trimming"), owner_(owner) {
+  DCHECK_NE(static_cast<BlockHeapManager*>(nullptr), owner);
+}
+
+void BlockHeapManager::DeferredTrimmingThread::Run() {
+  // Trimming is a background activity, it shouldn't compete with the
+  // application's threads.
+  ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+  owner_->DeferredTrimmingLoop();
+}
+
+void BlockHeapManager::UnprotectBlockVector(
+    const BlockQuarantineInterface::ObjectVector& vec) {
+  BlockProtectBatch batch;
+  for (const auto& iter_block : vec) {
+    BlockInfo expanded = {};
+    ConvertBlockInfo(iter_block, &expanded);
+    batch.ProtectNone(expanded);
+  }
 }
 
 void BlockHeapManager::FreeBlockVector(
     BlockQuarantineInterface::ObjectVector& vec) {
+  // Unprotecting all the blocks at once takes fewer system calls than doing
+  // it block by block, and makes the BlockProtectNone calls made while
+  // freeing the blocks no-ops.
+  UnprotectBlockVector(vec);
+
   for (const auto& iter_block : vec) {
     BlockInfo expanded = {};
     ConvertBlockInfo(iter_block, &expanded);
@@ -856,17 +1109,23 @@ void BlockHeapManager::InitInternalHeap() {
 void BlockHeapManager::InitProcessHeap() {
   DCHECK_EQ(static_cast<BlockHeapInterface*>(nullptr), process_heap_);
   if (parameters_.enable_ctmalloc) {
-    process_heap_underlying_heap_ =
-        new heaps::CtMallocHeap(&shadow_memory_notifier_);
+    // Spread the process heap over several CtMalloc partitions, so that
+    // threads don't all contend for the same lock. Its fragmentation is
+    // reported via the statistics section.
+    heaps::CtMallocHeap* ctmalloc_heap = new heaps::CtMallocHeap(
+        &shadow_memory_notifier_,
+        heaps::CtMallocHeap::kProcessHeapBucketCount);
+    ctmalloc_heap->set_statistics(
+        &statistics_section_.statistics()->process_heap_ctmalloc);
+    process_heap_underlying_heap_ = ctmalloc_heap;
   } else {
     process_heap_underlying_heap_ = new heaps::WinHeap(::GetProcessHeap());
   }
-  process_heap_ = new heaps::SimpleBlockHeap(process_heap_underlying_heap_);
+  process_heap_ = new heaps::SimpleBlockHeap(
+      process_heap_underlying_heap_, parameters_.enable_block_cache);
   underlying_heaps_map_.insert(std::make_pair(process_heap_,
                                               process_heap_underlying_heap_));
-  HeapMetadata heap_metadata = { &shared_quarantine_, false };
-  auto result = heaps_.insert(std::make_pair(process_heap_, heap_metadata));
-  process_heap_id_ = GetHeapId(result);
+  process_heap_id_ = InsertHeapUnlocked(process_heap_, &shared_quarantine_);
 }
 
 void BlockHeapManager::InitRateTargetedHeaps() {
@@ -887,6 +1146,21 @@ void BlockHeapManager::InitRateTargetedHeaps() {
   }
 }
 
+void BlockHeapManager::InitLifetimeSegregatedHeaps() {
+  if (!parameters_.enable_lifetime_segregated_heaps) {
+    ::memset(lifetime_segregated_heaps_, 0,
+             sizeof(lifetime_segregated_heaps_));
+    ::memset(lifetime_segregated_heaps_count_, 0,
+             sizeof(lifetime_segregated_heaps_count_));
+    return;
+  }
+
+  for (size_t i = 0; i < kLifetimeClassCount; ++i) {
+    lifetime_segregated_heaps_[i] = CreateHeap();
+    lifetime_segregated_heaps_count_[i] = 0;
+  }
+}
+
 bool BlockHeapManager::MayUseLargeBlockHeap(size_t bytes) const {
   DCHECK(initialized_);
   if (!parameters_.enable_large_block_heap)
@@ -982,6 +1256,137 @@ HeapId BlockHeapManager::ChooseRateTargetedHeap(
   return rate_targeted_heaps_[bucket];
 }
 
+bool BlockHeapManager::MayUseLifetimeSegregatedHeap(size_t bytes) const {
+  DCHECK(initialized_);
+  if (!parameters_.enable_lifetime_segregated_heaps)
+    return false;
+  // The heaps are only created if this was enabled at initialization time.
+  if (lifetime_segregated_heaps_[kShortLived] == 0)
+    return false;
+  // Leave the large allocations to the large block heap.
+  if (MayUseLargeBlockHeap(bytes))
+    return false;
+  return true;
+}
+
+HeapId BlockHeapManager::ChooseLifetimeSegregatedHeap(
+    const agent::common::StackCapture& stack) {
+  LifetimeClass lifetime_class = kShortLived;
+  {
+    base::AutoLock lock(site_lifetimes_lock_);
+    SiteLifetimeMap::const_iterator iter =
+        site_lifetimes_.find(stack.stack_id());
+
+    // Sites that haven't been seen freeing enough allocations yet are served
+    // as usual.
+    if (iter == site_lifetimes_.end() ||
+        iter->second.lifetime_count < kLifetimeSegregationMinLifetimeCount) {
+      return 0;
+    }
+
+    if (iter->second.average_lifetime > kShortLivedAllocationMaxTicks)
+      lifetime_class = kLongLived;
+  }
+
+  // This is racy, but only used for unittesting.
+  lifetime_segregated_heaps_count_[lifetime_class]++;
+  return lifetime_segregated_heaps_[lifetime_class];
+}
+
+void BlockHeapManager::RecordAllocationLifetime(StackId stack_id,
+                                                uint32 lifetime) {
+  base::AutoLock lock(site_lifetimes_lock_);
+  SiteLifetimeInfo& info = site_lifetimes_[stack_id];
+
+  // The first lifetime seeds the average. The following ones are blended in
+  // with a fixed weight, so that the average follows the sites whose behaviour
+  // changes over time.
+  if (info.lifetime_count == 0) {
+    info.average_lifetime = lifetime;
+  } else {
+    int64 delta = static_cast<int64>(lifetime) - info.average_lifetime;
+    info.average_lifetime = static_cast<uint32>(
+        info.average_lifetime + (delta >> kLifetimeAverageWeightShift));
+  }
+  if (info.lifetime_count < kLifetimeSegregationMinLifetimeCount)
+    ++info.lifetime_count;
+}
+
+bool BlockHeapManager::ShouldGuardSampledAllocation(
+    const agent::common::StackCapture& stack) {
+  DCHECK(parameters_.enable_allocation_sampling);
+
+  // The allocations explicitly selected by the allocation filter are always
+  // guarded.
+  if (parameters_.enable_allocation_filter && allocation_filter_flag())
+    return true;
+  if (parameters_.allocation_guard_rate >= 1.0)
+    return true;
+
+  size_t count = 0;
+  {
+    base::AutoLock lock(sampled_sites_lock_);
+    count = ++sampled_site_counts_[stack.stack_id()];
+  }
+
+  // Guard the first allocations from each site, then decay the guard rate of
+  // the site inversely to its allocation count, down to the global rate.
+  if (count <= kAllocationSamplingGuardedCount)
+    return true;
+  double rate = static_cast<double>(kAllocationSamplingGuardedCount) / count;
+  rate = std::max(rate, static_cast<double>(parameters_.allocation_guard_rate));
+  return base::RandDouble() < rate;
+}
+
+HeapTypeStatistics* BlockHeapManager::GetHeapTypeStatistics(HeapId heap_id) {
+  HeapType heap_type = GetHeapFromId(heap_id)->GetHeapType();
+  DCHECK_LT(static_cast<size_t>(heap_type), static_cast<size_t>(kHeapTypeMax));
+  return &statistics_section_.statistics()->heaps[heap_type];
+}
+
+void BlockHeapManager::UpdateQuarantineStatistics(
+    BlockQuarantineInterface* quarantine) {
+  DCHECK_NE(static_cast<BlockQuarantineInterface*>(nullptr), quarantine);
+  if (quarantine != &shared_quarantine_)
+    return;
+
+  // These are racy snapshots, which is fine for sampling.
+  QuarantineStatistics* statistics =
+      &statistics_section_.statistics()->quarantine;
+  statistics->size = static_cast<LONG>(shared_quarantine_.size());
+  statistics->count = static_cast<LONG>(shared_quarantine_.GetCount());
+}
+
+void BlockHeapManager::RecordTrimStatistics(uint64 cycles) {
+  QuarantineStatistics* statistics =
+      &statistics_section_.statistics()->quarantine;
+  ::InterlockedIncrement(&statistics->trim_count);
+  ::InterlockedExchangeAdd64(&statistics->trim_cycles,
+                             static_cast<LONGLONG>(cycles));
+
+  LONGLONG max_cycles = statistics->max_trim_cycles;
+  while (static_cast<uint64>(max_cycles) < cycles) {
+    LONGLONG previous = ::InterlockedCompareExchange64(
+        &statistics->max_trim_cycles, static_cast<LONGLONG>(cycles),
+        max_cycles);
+    if (previous == max_cycles)
+      break;
+    max_cycles = previous;
+  }
+}
+
+void* BlockHeapManager::AllocateUnguarded(HeapId heap_id, size_t bytes) {
+  ::InterlockedIncrement(
+      &statistics_section_.statistics()->unguarded_allocation_count);
+  BlockHeapInterface* heap = GetHeapFromId(heap_id);
+  void* alloc = heap->Allocate(bytes);
+  if ((heap->GetHeapFeatures() &
+     HeapInterface::kHeapReportsReservations) != 0) {
+    Shadow::Unpoison(alloc, bytes);
+  }
+  return alloc;
+}
+
 }  // namespace heap_managers
 }  // namespace asan
 }  // namespace agent
@@ -24,10 +24,13 @@
 
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/agent/asan/block_utils.h"
 #include "syzygy/agent/asan/error_info.h"
 #include "syzygy/agent/asan/heap.h"
 #include "syzygy/agent/asan/heap_manager.h"
+#include "syzygy/agent/asan/heap_statistics.h"
 #include "syzygy/agent/asan/quarantine.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
@@ -63,6 +66,25 @@ namespace heap_managers {
 // The zebra heap is created once, when enabled for the first time, with a
 // specified size. It can't be resized after creation. Disabling the zebra
 // heap only disables allocations on it, deallocations will continue to work.
+//
+// If the enable_deferred_trimming parameter is set then the shared quarantine
+// is trimmed by a low priority background thread, in batches, rather than by
+// the thread freeing a block. A thread freeing a block only trims the
+// quarantine itself if it has grown beyond a hard ceiling, which bounds the
+// amount of memory held in the quarantine if the background thread can't
+// keep up.
+//
+// If the enable_allocation_sampling parameter is set then the decision to
+// guard an allocation is made per allocation site, identified by the id of its
+// stack trace. The first allocations from each site are always guarded, and
+// the guard rate of a site then decays towards allocation_guard_rate. This
+// keeps the rarely seen sites, where bugs tend to hide, fully checked while
+// most of the allocations from the hot sites take the cheap unguarded path.
+//
+// The heap manager always maintains a set of counters describing the
+// allocations of each type of heap and the state of the shared quarantine.
+// They live in a named shared memory section, so that external tools can
+// sample them without stopping the process. See heap_statistics.h.
 class BlockHeapManager : public HeapManagerInterface {
  public:
   // Constructor.
@@ -82,6 +104,7 @@ class BlockHeapManager : public HeapManagerInterface {
   virtual bool DestroyHeap(HeapId heap_id);
   virtual void* Allocate(HeapId heap_id, size_t bytes);
   virtual bool Free(HeapId heap_id, void* alloc);
+  virtual bool ResizeInPlace(HeapId heap_id, void* alloc, size_t bytes);
   virtual size_t Size(HeapId heap_id, const void* alloc);
   virtual void Lock(HeapId heap_id);
   virtual void Unlock(HeapId heap_id);
@@ -109,6 +132,11 @@ class BlockHeapManager : public HeapManagerInterface {
   // Returns the process heap ID.
   HeapId process_heap() { return process_heap_id_; }
 
+  // @returns the counters maintained by this heap manager.
+  const HeapStatistics* statistics() const {
+    return statistics_section_.statistics();
+  }
+
   // Returns the allocation-filter flag value.
   // @returns the allocation-filter flag value.
   // @note The flag is stored per-thread using TLS. Multiple threads do not
@@ -149,6 +177,10 @@ class BlockHeapManager : public HeapManagerInterface {
   struct HeapMetadata {
     BlockQuarantineInterface* quarantine;
     bool is_dying;
+    // The tag of the ID of this heap, as returned by GetHeapIdTag. This is
+    // set once the heap is inserted in heaps_ and cleared before it's removed,
+    // which allows heap IDs to be validated without acquiring lock_.
+    uintptr_t heap_id_tag;
   };
   using HeapQuarantineMap =
       std::unordered_map<BlockHeapInterface*, HeapMetadata>;
@@ -172,6 +204,24 @@ class BlockHeapManager : public HeapManagerInterface {
     AllocationRateInfo() : allocation_site_count_max(0) { }
   };
 
+  // The lifetime statistics of an allocation site, used to choose the
+  // lifetime segregated heap serving its allocations.
+  struct SiteLifetimeInfo {
+    // An exponentially weighted moving average of the lifetimes of the
+    // allocations from this site, in ticks.
+    uint32 average_lifetime;
+    // The number of lifetimes that have been recorded for this site.
+    uint32 lifetime_count;
+  };
+  typedef std::unordered_map<StackId, SiteLifetimeInfo> SiteLifetimeMap;
+
+  // The indices of the lifetime segregated heaps.
+  enum LifetimeClass {
+    kShortLived,
+    kLongLived,
+    kLifetimeClassCount,
+  };
+
   // Causes the heap manager to tear itself down. If the heap manager
   // encounters corrupt blocks while tearing itself dow it will report an
   // error. This will in turn cause the asan runtime to call back into itself
@@ -189,8 +239,22 @@ class BlockHeapManager : public HeapManagerInterface {
   HeapId GetHeapId(
       const std::pair<HeapQuarantineMap::iterator, bool>& insert_result) const;
 
-  // @name Heap validation. There are multiple ways to do this because of the
-  //     need to do this during crash processing, when locks are already
+  // Returns the tag identifying a live heap ID. This mixes the ID with a
+  // random cookie so that stray values are unlikely to pass for valid tags.
+  // @param heap_id The ID of the heap.
+  // @returns the tag of @p heap_id.
+  uintptr_t GetHeapIdTag(HeapId heap_id) const;
+
+  // Inserts a heap in heaps_, and tags its ID as valid.
+  // @param heap The heap to insert.
+  // @param quarantine The quarantine used by @p heap.
+  // @returns the ID of the inserted heap.
+  // @note Must be called under lock_.
+  HeapId InsertHeapUnlocked(BlockHeapInterface* heap,
+                            BlockQuarantineInterface* quarantine);
+
+  // @name Heap validation. This doesn't acquire any lock, as it's done on
+  //     every heap call, and during crash processing when locks are already
   //     implicitly acquired. As such, the runtime has been made a friend of
   //     this class.
   // Determines if a heap ID is valid.
@@ -198,14 +262,12 @@ class BlockHeapManager : public HeapManagerInterface {
   // @param allow_dying If true then also consider heaps that are in the
   //     process of dying. Otherwise, only consider live heaps.
   // @returns true if the given heap id is valid.
-  // @note The unsafe variants can raise access violations.
+  // @note The unsafe variant can raise access violations.
   bool IsValidHeapIdUnsafe(HeapId heap_id, bool allow_dying);
-  bool IsValidHeapIdUnsafeUnlocked(HeapId heap_id, bool allow_dying);
   bool IsValidHeapId(HeapId heap_id, bool allow_dying);
-  bool IsValidHeapIdUnlocked(HeapId heap_id, bool allow_dying);
 
-  // Helpers for the above functions. This is split into two to keep the
-  // locking as narrow as possible.
+  // Helpers for the above functions. The first checks that the heap ID looks
+  // like it has the right shape, the second that it's tagged as valid.
   // @param hq The heap quarantine pair being queried.
   // @param allow_dying If true then also consider heaps that are in the
   //     process of dying. Otherwise, only consider live heaps.
@@ -257,6 +319,41 @@ class BlockHeapManager : public HeapManagerInterface {
   //    awkward since trimming with size 0 should flush the quarantine.
   void TrimQuarantine(BlockQuarantineInterface* quarantine);
 
+  // Trims at most @p max_blocks blocks from a quarantine that is over its
+  // maximum size.
+  // @param quarantine The quarantine to trim.
+  // @param max_blocks The maximum number of blocks to remove.
+  // @returns true if @p max_blocks blocks were removed, indicating that the
+  //     quarantine may still be over its maximum size.
+  bool TrimQuarantineBatch(BlockQuarantineInterface* quarantine,
+                           size_t max_blocks);
+
+  // Determines if the trimming of a quarantine can be left to the deferred
+  // trimming thread.
+  // @param quarantine The quarantine that a block was just pushed to.
+  // @returns true if the trimming may be deferred, false if it must be done
+  //     synchronously.
+  bool CanDeferTrimming(BlockQuarantineInterface* quarantine);
+
+  // @name Deferred trimming thread management.
+  // @{
+  // Starts the deferred trimming thread if it isn't already running.
+  // @note This must be called under lock_.
+  void StartDeferredTrimmingThreadUnlocked();
+  // Stops the deferred trimming thread if it is running, and waits for it to
+  // exit.
+  void StopDeferredTrimmingThread();
+  // The body of the deferred trimming thread. Waits for trimming requests and
+  // services them in batches until it is asked to stop.
+  void DeferredTrimmingLoop();
+  // @}
+
+  // Removes the page protections of a vector of blocks, using as few calls
+  // to VirtualProtect as possible.
+  // @param vec The vector of blocks to be unprotected.
+  void UnprotectBlockVector(
+      const BlockQuarantineInterface::ObjectVector& vec);
+
   // Free a vector of blocks.
   // @param vec The vector of blocks to be freed.
   void FreeBlockVector(BlockQuarantineInterface::ObjectVector& vec);
@@ -315,6 +412,9 @@ class BlockHeapManager : public HeapManagerInterface {
   // Initialize the rate targeted heaps.
   void InitRateTargetedHeaps();
 
+  // Initialize the lifetime segregated heaps.
+  void InitLifetimeSegregatedHeaps();
+
   // Determines if the large block heap should be used for an allocation of
   // the given size.
   // @param bytes The allocation size.
@@ -342,6 +442,96 @@ class BlockHeapManager : public HeapManagerInterface {
   // @returns The rate targeted heap that should serve this allocation.
   HeapId ChooseRateTargetedHeap(const agent::common::StackCapture& stack);
 
+  // Determines if we should use a lifetime segregated heap for an allocation
+  // of the given size.
+  // @param bytes The allocation size.
+  // @returns true if a lifetime segregated heap may be used for this
+  //     allocation, false otherwise.
+  bool MayUseLifetimeSegregatedHeap(size_t bytes) const;
+
+  // Given an allocation stack, choose the lifetime segregated heap that should
+  // be used to serve it.
+  // @param stack The allocation stack.
+  // @returns the lifetime segregated heap that should serve this allocation,
+  //     or 0 if the lifetime of the allocations from this site isn't known
+  //     yet.
+  HeapId ChooseLifetimeSegregatedHeap(
+      const agent::common::StackCapture& stack);
+
+  // Records the lifetime of a freed allocation into the statistics of its
+  // allocation site.
+  // @param stack_id The ID of the allocation stack.
+  // @param lifetime The lifetime of the allocation, in ticks.
+  void RecordAllocationLifetime(StackId stack_id, uint32 lifetime);
+
+  // Determines if an allocation should be guarded when allocation sampling is
+  // enabled.
+  // @param stack The allocation stack.
+  // @returns true if the allocation should be guarded, false otherwise.
+  bool ShouldGuardSampledAllocation(const agent::common::StackCapture& stack);
+
+  // @name Heap statistics helpers.
+  // @{
+  // @param heap_id The ID of a heap.
+  // @returns the counters of the type of the heap.
+  HeapTypeStatistics* GetHeapTypeStatistics(HeapId heap_id);
+  // Refreshes the size and count of the shared quarantine in the statistics.
+  // @param quarantine The quarantine that was just modified. Nothing is done
+  //     unless this is the shared quarantine.
+  void UpdateQuarantineStatistics(BlockQuarantineInterface* quarantine);
+  // Records the latency of a trim that freed some blocks.
+  // @param cycles The number of CPU cycles that the trim took.
+  void RecordTrimStatistics(uint64 cycles);
+  // @}
+
+  // Serves an allocation without guards from the given heap.
+  // @param heap_id The heap serving the allocation.
+  // @param bytes The allocation size.
+  // @returns the allocation, or nullptr on failure.
+  void* AllocateUnguarded(HeapId heap_id, size_t bytes);
+
+  // The number of lifetimes that must be recorded for an allocation site
+  // before its allocations are routed to a lifetime segregated heap.
+  static const size_t kLifetimeSegregationMinLifetimeCount = 8;
+
+  // The weight of the new lifetimes in the average lifetime of a site, as a
+  // power of two. A new lifetime counts for 1/8th of the average.
+  static const size_t kLifetimeAverageWeightShift = 3;
+
+  // The average lifetime, in ticks, below which the allocations from a site
+  // are considered short lived.
+  static const uint32 kShortLivedAllocationMaxTicks = 100;
+
+  // The number of allocations from each site that are always guarded when
+  // allocation sampling is enabled.
+  static const size_t kAllocationSamplingGuardedCount = 16;
+
+  // The maximum number of blocks that the deferred trimming thread frees
+  // between checks for a stop request.
+  static const size_t kDeferredTrimmingBatchSize = 64;
+
+  // The ratio of the quarantine size above which a thread freeing a block
+  // trims the shared quarantine itself, even if deferred trimming is enabled.
+  static const size_t kDeferredTrimmingCeilingRatio = 2;
+
+  // The thread used for deferred trimming.
+  class DeferredTrimmingThread : public base::SimpleThread {
+   public:
+    // Constructor.
+    // @param owner The heap manager whose quarantine is to be trimmed.
+    explicit DeferredTrimmingThread(BlockHeapManager* owner);
+
+    // @name base::SimpleThread implementation.
+    // @{
+    void Run() override;
+    // @}
+
+   private:
+    BlockHeapManager* owner_;
+
+    DISALLOW_COPY_AND_ASSIGN(DeferredTrimmingThread);
+  };
+
   // The number of rate targeted heaps.
   // TODO(sebmarchand): Make this value configurable.
   static const size_t kRateTargetedHeapCount = 4;
@@ -365,12 +555,35 @@ class BlockHeapManager : public HeapManagerInterface {
   // The information used by the rate targeted heaps.
   AllocationRateInfo targeted_heaps_info_;  // Under targeted_heaps_info_lock_.
 
+  // The lifetime segregated heaps, indexed by LifetimeClass.
+  HeapId lifetime_segregated_heaps_[kLifetimeClassCount];
+
+  // The number of blocks that have been served by each lifetime segregated
+  // heap, for unittesting.
+  size_t lifetime_segregated_heaps_count_[kLifetimeClassCount];
+
+  base::Lock site_lifetimes_lock_;
+
+  // Tracks the lifetimes of the allocations from each site when the lifetime
+  // segregated heaps are enabled.
+  SiteLifetimeMap site_lifetimes_;  // Under site_lifetimes_lock_.
+
+  base::Lock sampled_sites_lock_;
+
+  // Tracks how many times each allocation stack has been seen when allocation
+  // sampling is enabled.
+  // Under sampled_sites_lock_.
+  AllocationRateInfo::AllocationSiteCountMap sampled_site_counts_;
+
   // The stack cache used to store the stack traces.
   StackCaptureCache* stack_cache_;
 
   // Protects concurrent access to the heap manager internals.
   base::Lock lock_;
 
+  // The random cookie mixed in the heap ID tags.
+  uintptr_t heap_id_cookie_;
+
   // Indicates if 'Init' has been called.
   bool initialized_;  // Under lock_.
 
@@ -381,6 +594,9 @@ class BlockHeapManager : public HeapManagerInterface {
   // used by the LargeBlockHeap.
   ShardedBlockQuarantine shared_quarantine_;
 
+  // The section holding the counters of this heap manager.
+  HeapStatisticsSection statistics_section_;
+
   // Map the block heaps to their underlying heap.
   UnderlyingHeapMap underlying_heaps_map_;  // Under lock_.
 
@@ -429,6 +645,18 @@ class BlockHeapManager : public HeapManagerInterface {
   // Under lock_.
   HeapInterface** locked_heaps_;
 
+  // The deferred trimming thread, and the events used to communicate with it.
+  // The trim event is auto-reset and signaled when the shared quarantine goes
+  // over its maximum size, the stop event is manual-reset. These are created
+  // under lock_, and then remain valid until the heap manager is torn down.
+  scoped_ptr<DeferredTrimmingThread> deferred_trimming_thread_;
+  base::win::ScopedHandle deferred_trimming_event_;
+  base::win::ScopedHandle deferred_trimming_stop_event_;
+
+  // Held by the deferred trimming thread while it frees a batch of blocks,
+  // and by DestroyHeap while it tears down a heap.
+  base::Lock deferred_trimming_lock_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BlockHeapManager);
 };
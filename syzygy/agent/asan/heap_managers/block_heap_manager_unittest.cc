@@ -120,6 +120,7 @@ class TestBlockHeapManager : public BlockHeapManager {
  public:
   using BlockHeapManager::HeapQuarantinePair;
 
+  using BlockHeapManager::ChooseLifetimeSegregatedHeap;
   using BlockHeapManager::FreePotentiallyCorruptBlock;
   using BlockHeapManager::GetHeapId;
   using BlockHeapManager::GetHeapFromId;
@@ -127,22 +128,38 @@ class TestBlockHeapManager : public BlockHeapManager {
   using BlockHeapManager::GetQuarantineFromId;
   using BlockHeapManager::HeapMetadata;
   using BlockHeapManager::HeapQuarantineMap;
-  using BlockHeapManager::IsValidHeapIdUnlocked;
+  using BlockHeapManager::InitLifetimeSegregatedHeaps;
+  using BlockHeapManager::InsertHeapUnlocked;
+  using BlockHeapManager::IsValidHeapId;
+  using BlockHeapManager::RecordAllocationLifetime;
   using BlockHeapManager::SetHeapErrorCallback;
   using BlockHeapManager::ShardedBlockQuarantine;
   using BlockHeapManager::TrimQuarantine;
 
   using BlockHeapManager::allocation_filter_flag_tls_;
+  using BlockHeapManager::deferred_trimming_thread_;
   using BlockHeapManager::heaps_;
   using BlockHeapManager::large_block_heap_id_;
+  using BlockHeapManager::lifetime_segregated_heaps_;
+  using BlockHeapManager::lifetime_segregated_heaps_count_;
+  using BlockHeapManager::lock_;
   using BlockHeapManager::locked_heaps_;
   using BlockHeapManager::parameters_;
   using BlockHeapManager::rate_targeted_heaps_;
   using BlockHeapManager::rate_targeted_heaps_count_;
+  using BlockHeapManager::sampled_site_counts_;
+  using BlockHeapManager::shared_quarantine_;
+  using BlockHeapManager::site_lifetimes_;
   using BlockHeapManager::targeted_heaps_info_;
   using BlockHeapManager::zebra_block_heap_;
   using BlockHeapManager::zebra_block_heap_id_;
 
+  using BlockHeapManager::kAllocationSamplingGuardedCount;
+  using BlockHeapManager::kDeferredTrimmingCeilingRatio;
+  using BlockHeapManager::kLifetimeSegregationMinLifetimeCount;
+  using BlockHeapManager::kLongLived;
+  using BlockHeapManager::kShortLived;
+  using BlockHeapManager::kShortLivedAllocationMaxTicks;
   using BlockHeapManager::kRateTargetedHeapCount;
   using BlockHeapManager::kDefaultRateTargetedHeapsMinBlockSize;
 
@@ -199,11 +216,17 @@ class TestBlockHeapManager : public BlockHeapManager {
         rate_targeted_heaps_[i] = 0;
         rate_targeted_heaps_count_[i] = 0;
       }
+      for (size_t i = 0; i < kLifetimeClassCount; ++i) {
+        RemoveHeapById(lifetime_segregated_heaps_[i]);
+        lifetime_segregated_heaps_[i] = 0;
+        lifetime_segregated_heaps_count_[i] = 0;
+      }
 
       internal_heap_.reset();
       internal_win_heap_.reset();
       InitInternalHeap();
       InitRateTargetedHeaps();
+      InitLifetimeSegregatedHeaps();
     }
 
     PropagateParameters();
@@ -218,6 +241,7 @@ class TestBlockHeapManager : public BlockHeapManager {
         delete process_heap_underlying_heap_;
         process_heap_underlying_heap_ = nullptr;
       }
+      base::AutoLock lock(lock_);
       InitProcessHeap();
     }
   }
@@ -393,11 +417,11 @@ class BlockHeapManagerTest
     // Plug a mock ZebraBlockHeap by default disabled.
     test_zebra_block_heap_ = new TestZebraBlockHeap();
     heap_manager_->zebra_block_heap_ = test_zebra_block_heap_;
-    TestBlockHeapManager::HeapMetadata heap_metadata =
-      { test_zebra_block_heap_, false };
-    auto result = heap_manager_->heaps_.insert(std::make_pair(
-        test_zebra_block_heap_, heap_metadata));
-    heap_manager_->zebra_block_heap_id_ = heap_manager_->GetHeapId(result);
+    {
+      base::AutoLock lock(heap_manager_->lock_);
+      heap_manager_->zebra_block_heap_id_ = heap_manager_->InsertHeapUnlocked(
+          test_zebra_block_heap_, test_zebra_block_heap_);
+    }
 
     // Turn on the zebra_block_heap_enabled flag.
     ::common::AsanParameters params = heap_manager_->parameters();
@@ -696,6 +720,39 @@ TEST_P(BlockHeapManagerTest, Size) {
   }
 }
 
+TEST_P(BlockHeapManagerTest, ResizeInPlace) {
+  const size_t kAllocSize = 100;
+  const size_t kSmallSize = 10;
+  ScopedHeap heap(heap_manager_);
+  void* mem = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+
+  // Shrink the block, the tail of the old body becomes part of the redzone.
+  EXPECT_TRUE(heap_manager_->ResizeInPlace(heap.Id(), mem, kSmallSize));
+  EXPECT_EQ(kSmallSize, heap_manager_->Size(heap.Id(), mem));
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(mem, kSmallSize));
+
+  BlockInfo block_info = {};
+  ASSERT_TRUE(BlockInfoFromMemory(BlockGetHeaderFromBody(mem), &block_info));
+  EXPECT_EQ(kSmallSize, block_info.body_size);
+  EXPECT_TRUE(BlockChecksumIsValid(block_info));
+
+  // The block can grow back as long as the right redzone stays large enough.
+  size_t max_size = reinterpret_cast<uint8*>(block_info.trailer) -
+      block_info.body - heap_manager_->parameters().trailer_padding_size;
+  EXPECT_LE(kAllocSize, max_size);
+  EXPECT_TRUE(heap_manager_->ResizeInPlace(heap.Id(), mem, max_size));
+  EXPECT_EQ(max_size, heap_manager_->Size(heap.Id(), mem));
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(mem, max_size));
+
+  // Growing any further requires moving the allocation.
+  EXPECT_FALSE(heap_manager_->ResizeInPlace(heap.Id(), mem, max_size + 1));
+  EXPECT_EQ(max_size, heap_manager_->Size(heap.Id(), mem));
+
+  ASSERT_TRUE(heap.Free(mem));
+  EXPECT_FALSE(heap_manager_->ResizeInPlace(heap.Id(), mem, kSmallSize));
+}
+
 TEST_P(BlockHeapManagerTest, AllocsAccessibility) {
   const size_t kMaxAllocSize = 134584;
   ScopedHeap heap(heap_manager_);
@@ -1054,6 +1111,43 @@ TEST_P(BlockHeapManagerTest, SubsampledAllocationGuards) {
   EXPECT_GT(6 * kAllocationCount / 10, guarded_allocations);
 }
 
+TEST_P(BlockHeapManagerTest, SampledAllocationGuards) {
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.allocation_guard_rate = 0.0;
+  parameters.enable_allocation_sampling = true;
+  heap_manager_->set_parameters(parameters);
+  ScopedHeap heap(heap_manager_);
+
+  // Make all the allocations from a single site.
+  const size_t kAllocationCount = 1000;
+  size_t guarded_allocations = 0;
+  for (size_t i = 0; i < kAllocationCount; ++i) {
+    void* alloc = heap.Allocate(10);
+    EXPECT_NE(static_cast<void*>(nullptr), alloc);
+
+    BlockHeader* header = BlockGetHeaderFromBody(alloc);
+    if (header != nullptr) {
+      ++guarded_allocations;
+    } else {
+      // The first allocations from the site are always guarded.
+      EXPECT_LE(TestBlockHeapManager::kAllocationSamplingGuardedCount, i);
+    }
+    EXPECT_TRUE(heap.Free(alloc));
+  }
+  EXPECT_NO_FATAL_FAILURE(heap.FlushQuarantine());
+
+  EXPECT_EQ(1u, heap_manager_->sampled_site_counts_.size());
+  EXPECT_EQ(kAllocationCount,
+            heap_manager_->sampled_site_counts_.begin()->second);
+
+  // The expected number of guarded allocations is the guarded count times
+  // 1 + ln(kAllocationCount / guarded count), about 82, with a standard
+  // deviation below 9. The bounds are many deviations away from that.
+  EXPECT_LE(TestBlockHeapManager::kAllocationSamplingGuardedCount,
+            guarded_allocations);
+  EXPECT_GT(kAllocationCount / 4, guarded_allocations);
+}
+
 // Ensures that the ZebraBlockHeap overrides the provided heap.
 TEST_P(BlockHeapManagerTest, ZebraHeapIdInTrailerAfterAllocation) {
   EnableTestZebraBlockHeap();
@@ -1178,6 +1272,84 @@ TEST_P(BlockHeapManagerTest, AllocFromRateTargetedHeap) {
     heap.Free(alloc);
 }
 
+TEST_P(BlockHeapManagerTest, AllocFromLifetimeSegregatedHeaps) {
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.enable_lifetime_segregated_heaps = true;
+  heap_manager_->set_parameters(parameters);
+  heap_manager_->InitLifetimeSegregatedHeaps();
+  ScopedHeap heap(heap_manager_);
+
+  HeapId short_lived_heap = heap_manager_->lifetime_segregated_heaps_[
+      TestBlockHeapManager::kShortLived];
+  EXPECT_NE(0u, short_lived_heap);
+  EXPECT_NE(0u, heap_manager_->lifetime_segregated_heaps_[
+      TestBlockHeapManager::kLongLived]);
+
+  // Make all the allocations from a single site, and free them right away.
+  // The site is only routed to the short lived heap once enough lifetimes
+  // have been recorded.
+  const size_t kAllocationCount = 100;
+  for (size_t i = 0; i < kAllocationCount; ++i) {
+    void* alloc = heap.Allocate(10);
+    EXPECT_NE(static_cast<void*>(nullptr), alloc);
+
+    BlockInfo block_info = {};
+    EXPECT_TRUE(Shadow::BlockInfoFromShadow(alloc, &block_info));
+    if (i < TestBlockHeapManager::kLifetimeSegregationMinLifetimeCount)
+      EXPECT_NE(short_lived_heap, block_info.trailer->heap_id);
+    else
+      EXPECT_EQ(short_lived_heap, block_info.trailer->heap_id);
+    EXPECT_TRUE(heap.Free(alloc));
+  }
+  EXPECT_NO_FATAL_FAILURE(heap.FlushQuarantine());
+
+  EXPECT_EQ(1u, heap_manager_->site_lifetimes_.size());
+  EXPECT_EQ(kAllocationCount -
+                TestBlockHeapManager::kLifetimeSegregationMinLifetimeCount,
+            heap_manager_->lifetime_segregated_heaps_count_[
+                TestBlockHeapManager::kShortLived]);
+  EXPECT_EQ(0u, heap_manager_->lifetime_segregated_heaps_count_[
+      TestBlockHeapManager::kLongLived]);
+}
+
+TEST_P(BlockHeapManagerTest, ChooseLifetimeSegregatedHeap) {
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.enable_lifetime_segregated_heaps = true;
+  heap_manager_->set_parameters(parameters);
+  heap_manager_->InitLifetimeSegregatedHeaps();
+
+  const uint32 kMaxTicks = TestBlockHeapManager::kShortLivedAllocationMaxTicks;
+  agent::common::StackCapture short_lived_stack;
+  short_lived_stack.set_stack_id(1);
+  agent::common::StackCapture long_lived_stack;
+  long_lived_stack.set_stack_id(2);
+
+  // Unknown sites aren't routed to a lifetime segregated heap.
+  EXPECT_EQ(0u, heap_manager_->ChooseLifetimeSegregatedHeap(
+      short_lived_stack));
+
+  for (size_t i = 0;
+       i < TestBlockHeapManager::kLifetimeSegregationMinLifetimeCount; ++i) {
+    heap_manager_->RecordAllocationLifetime(1, 0);
+    heap_manager_->RecordAllocationLifetime(2, 10 * kMaxTicks);
+  }
+  HeapId short_lived_heap = heap_manager_->lifetime_segregated_heaps_[
+      TestBlockHeapManager::kShortLived];
+  HeapId long_lived_heap = heap_manager_->lifetime_segregated_heaps_[
+      TestBlockHeapManager::kLongLived];
+  EXPECT_EQ(short_lived_heap,
+            heap_manager_->ChooseLifetimeSegregatedHeap(short_lived_stack));
+  EXPECT_EQ(long_lived_heap,
+            heap_manager_->ChooseLifetimeSegregatedHeap(long_lived_stack));
+
+  // A site whose allocations start living longer eventually moves to the long
+  // lived heap.
+  for (size_t i = 0; i < 100; ++i)
+    heap_manager_->RecordAllocationLifetime(1, 10 * kMaxTicks);
+  EXPECT_EQ(long_lived_heap,
+            heap_manager_->ChooseLifetimeSegregatedHeap(short_lived_stack));
+}
+
 // The BlockHeapManager correctly quarantines the memory after free.
 TEST_P(BlockHeapManagerTest, QuarantinedAfterFree) {
   EnableTestZebraBlockHeap();
@@ -1372,6 +1544,149 @@ TEST_P(BlockHeapManagerTest, ZebraBlockHeapQuarantineRatioIsRespected) {
   }
 }
 
+// Ensures that blocks evicted from the quarantine are reused via the block
+// cache when it is enabled.
+TEST_P(BlockHeapManagerTest, BlockCacheReusesEvictedBlocks) {
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.quarantine_size = 0;
+  params.enable_rate_targeted_heaps = false;
+  params.enable_block_cache = true;
+  heap_manager_->SetParameters(params);
+
+  ScopedHeap heap(heap_manager_);
+
+  const size_t kAllocSize = 100;
+  void* alloc1 = heap.Allocate(kAllocSize);
+  EXPECT_NE(static_cast<void*>(nullptr), alloc1);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(alloc1, kAllocSize));
+  EXPECT_TRUE(heap.Free(alloc1));
+  EXPECT_FALSE(heap.InQuarantine(alloc1));
+
+  // The block should come straight back out of the cache, and be a perfectly
+  // valid block.
+  void* alloc2 = heap.Allocate(kAllocSize);
+  EXPECT_EQ(alloc1, alloc2);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(alloc2, kAllocSize));
+  BlockInfo block_info = {};
+  EXPECT_TRUE(Shadow::BlockInfoFromShadow(alloc2, &block_info));
+  {
+    ScopedBlockAccess block_access(block_info);
+    EXPECT_EQ(ALLOCATED_BLOCK, block_info.header->state);
+    EXPECT_EQ(heap.Id(), block_info.trailer->heap_id);
+  }
+  EXPECT_TRUE(heap.Free(alloc2));
+}
+
+TEST_P(BlockHeapManagerTest, DeferredTrimming) {
+  const size_t kAllocSize = 100;
+  const size_t kQuarantinedAllocs = 16;
+  size_t real_alloc_size = GetAllocSize(kAllocSize);
+  size_t quarantine_size = real_alloc_size * kQuarantinedAllocs;
+
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.quarantine_size = quarantine_size;
+  params.enable_rate_targeted_heaps = false;
+  params.enable_deferred_trimming = true;
+  heap_manager_->SetParameters(params);
+  EXPECT_TRUE(heap_manager_->deferred_trimming_thread_.get() != nullptr);
+
+  // The quarantine should never grow beyond the backpressure ceiling, no
+  // matter how far behind the trimming thread is.
+  size_t ceiling =
+      quarantine_size * TestBlockHeapManager::kDeferredTrimmingCeilingRatio;
+  ScopedHeap heap(heap_manager_);
+  for (size_t i = 0; i < 32 * kQuarantinedAllocs; ++i) {
+    void* mem = heap.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), mem);
+    ASSERT_TRUE(heap.Free(mem));
+    EXPECT_GE(ceiling, heap_manager_->shared_quarantine_.size());
+  }
+
+  // The trimming thread should eventually bring the quarantine back under
+  // its maximum size.
+  for (size_t i = 0; i < 1000; ++i) {
+    if (heap_manager_->shared_quarantine_.size() <= quarantine_size)
+      break;
+    ::Sleep(10);
+  }
+  EXPECT_GE(quarantine_size, heap_manager_->shared_quarantine_.size());
+
+  // A quarantine size of 0 still causes blocks to be freed immediately.
+  params.quarantine_size = 0;
+  heap_manager_->SetParameters(params);
+  void* mem = heap.Allocate(kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), mem);
+  ASSERT_TRUE(heap.Free(mem));
+  EXPECT_FALSE(heap.InQuarantine(mem));
+  EXPECT_EQ(0u, heap_manager_->shared_quarantine_.size());
+}
+
+TEST_P(BlockHeapManagerTest, HeapStatistics) {
+  const size_t kAllocSize = 100;
+  const size_t kQuarantinedAllocs = 16;
+  size_t real_alloc_size = GetAllocSize(kAllocSize);
+
+  ::common::AsanParameters params = heap_manager_->parameters();
+  params.quarantine_size = real_alloc_size * kQuarantinedAllocs;
+  heap_manager_->set_parameters(params);
+
+  const HeapStatistics* statistics = heap_manager_->statistics();
+  EXPECT_EQ(kHeapStatisticsVersion, statistics->version);
+  EXPECT_EQ(sizeof(HeapStatistics), statistics->size);
+  HeapStatistics before = *statistics;
+
+  ScopedHeap heap(heap_manager_);
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < 2 * kQuarantinedAllocs; ++i) {
+    void* mem = heap.Allocate(kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), mem);
+    blocks.push_back(mem);
+  }
+
+  // The allocations may be served by several types of heaps.
+  LONG allocation_count = 0;
+  LONG allocated_bytes = 0;
+  for (size_t i = 0; i < kHeapTypeMax; ++i) {
+    allocation_count += statistics->heaps[i].allocation_count -
+        before.heaps[i].allocation_count;
+    allocated_bytes += statistics->heaps[i].allocated_bytes -
+        before.heaps[i].allocated_bytes;
+  }
+  EXPECT_EQ(static_cast<LONG>(blocks.size()), allocation_count);
+  EXPECT_EQ(static_cast<LONG>(blocks.size() * kAllocSize), allocated_bytes);
+
+  // Freeing more blocks than the quarantine can hold trims it.
+  for (size_t i = 0; i < blocks.size(); ++i)
+    ASSERT_TRUE(heap.Free(blocks[i]));
+
+  LONG free_count = 0;
+  allocated_bytes = 0;
+  for (size_t i = 0; i < kHeapTypeMax; ++i) {
+    free_count += statistics->heaps[i].free_count - before.heaps[i].free_count;
+    allocated_bytes += statistics->heaps[i].allocated_bytes -
+        before.heaps[i].allocated_bytes;
+  }
+  EXPECT_EQ(static_cast<LONG>(blocks.size()), free_count);
+  EXPECT_EQ(0, allocated_bytes);
+
+  const QuarantineStatistics& quarantine = statistics->quarantine;
+  LONG trim_count = quarantine.trim_count;
+  LONGLONG trim_cycles = quarantine.trim_cycles;
+  LONGLONG max_trim_cycles = quarantine.max_trim_cycles;
+  EXPECT_LT(before.quarantine.trim_count, trim_count);
+  EXPECT_LT(0, max_trim_cycles);
+  EXPECT_LE(max_trim_cycles, trim_cycles);
+  EXPECT_EQ(heap_manager_->shared_quarantine_.size(),
+            static_cast<size_t>(quarantine.size));
+  EXPECT_EQ(heap_manager_->shared_quarantine_.GetCount(),
+            static_cast<size_t>(quarantine.count));
+
+  LONG shard_count = 0;
+  for (size_t i = 0; i < arraysize(quarantine.shards); ++i)
+    shard_count += quarantine.shards[i].count;
+  EXPECT_EQ(static_cast<LONG>(quarantine.count), shard_count);
+}
+
 // Ensures that the LargeBlockHeap overrides the provided heap if the allocation
 // size exceeds the threshold.
 TEST_P(BlockHeapManagerTest, LargeBlockHeapUsedForLargeAllocations) {
@@ -1541,17 +1856,41 @@ TEST_P(BlockHeapManagerTest, BestEffortLockAllOneHeapLockHeld) {
 // These functions are tested explicitly because the AsanRuntime reaches in
 // to use them.
 
-TEST_P(BlockHeapManagerTest, IsValidHeapIdUnlocked) {
+TEST_P(BlockHeapManagerTest, IsValidHeapId) {
   ASSERT_FALSE(heap_manager_->heaps_.empty());
-  EXPECT_FALSE(heap_manager_->IsValidHeapIdUnlocked(0xDEADBEEF, false));
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(0xDEADBEEF, false));
   for (auto& hq_pair : heap_manager_->heaps_) {
     TestBlockHeapManager::HeapQuarantinePair* hq = &hq_pair;
     TestBlockHeapManager::HeapId heap_id =
         reinterpret_cast<TestBlockHeapManager::HeapId>(hq);
-    EXPECT_TRUE(heap_manager_->IsValidHeapIdUnlocked(heap_id, false));
+    EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, false));
   }
 }
 
+TEST_P(BlockHeapManagerTest, IsValidHeapIdChecksTag) {
+  HeapId heap_id = heap_manager_->CreateHeap();
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, false));
+
+  TestBlockHeapManager::HeapQuarantinePair* hq =
+      reinterpret_cast<TestBlockHeapManager::HeapQuarantinePair*>(heap_id);
+
+  // Dying heaps are only valid if explicitly allowed.
+  hq->second.is_dying = true;
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(heap_id, false));
+  EXPECT_TRUE(heap_manager_->IsValidHeapId(heap_id, true));
+  hq->second.is_dying = false;
+
+  // A heap whose tag doesn't match its ID isn't valid.
+  uintptr_t tag = hq->second.heap_id_tag;
+  hq->second.heap_id_tag = 0;
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(heap_id, true));
+  hq->second.heap_id_tag = tag ^ 2;
+  EXPECT_FALSE(heap_manager_->IsValidHeapId(heap_id, true));
+  hq->second.heap_id_tag = tag;
+
+  EXPECT_TRUE(heap_manager_->DestroyHeap(heap_id));
+}
+
 TEST_P(BlockHeapManagerTest, GetHeapTypeUnlocked) {
   ASSERT_FALSE(heap_manager_->heaps_.empty());
   for (auto& hq_pair : heap_manager_->heaps_) {
@@ -0,0 +1,119 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_statistics.h"
+
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/common/com_utils.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// The format of the name of the statistics section, given the ID of the
+// process.
+const wchar_t kSectionNameFormat[] = L"Local\\SyzyAsanHeapStatistics-%u";
+
+void InitStatistics(HeapStatistics* statistics) {
+  DCHECK_NE(static_cast<HeapStatistics*>(nullptr), statistics);
+  ::memset(statistics, 0, sizeof(*statistics));
+  statistics->version = kHeapStatisticsVersion;
+  statistics->size = sizeof(*statistics);
+}
+
+}  // namespace
+
+HeapStatisticsSection::HeapStatisticsSection()
+    : statistics_(&local_statistics_) {
+  InitStatistics(&local_statistics_);
+}
+
+HeapStatisticsSection::~HeapStatisticsSection() {
+  if (statistics_ != &local_statistics_)
+    ::UnmapViewOfFile(statistics_);
+}
+
+bool HeapStatisticsSection::Init() {
+  DCHECK(!section_.IsValid());
+
+  std::wstring name = GetSectionName(::GetCurrentProcessId());
+  base::win::ScopedHandle section(::CreateFileMapping(
+      INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+      sizeof(HeapStatistics), name.c_str()));
+  if (!section.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create the heap statistics section: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  // Leave the section to the heap manager that created it.
+  if (::GetLastError() == ERROR_ALREADY_EXISTS)
+    return false;
+
+  void* view = ::MapViewOfFile(section.Get(), FILE_MAP_WRITE, 0, 0,
+                               sizeof(HeapStatistics));
+  if (view == nullptr) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map the heap statistics section: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  // Carry over the counters gathered so far.
+  statistics_ = reinterpret_cast<HeapStatistics*>(view);
+  ::memcpy(statistics_, &local_statistics_, sizeof(local_statistics_));
+  section_.Set(section.Take());
+
+  return true;
+}
+
+std::wstring HeapStatisticsSection::GetSectionName(DWORD process_id) {
+  return base::StringPrintf(kSectionNameFormat, process_id);
+}
+
+bool HeapStatisticsSection::ReadStatistics(DWORD process_id,
+                                           HeapStatistics* statistics) {
+  DCHECK_NE(static_cast<HeapStatistics*>(nullptr), statistics);
+
+  std::wstring name = GetSectionName(process_id);
+  base::win::ScopedHandle section(
+      ::OpenFileMapping(FILE_MAP_READ, FALSE, name.c_str()));
+  if (!section.IsValid())
+    return false;
+
+  void* view = ::MapViewOfFile(section.Get(), FILE_MAP_READ, 0, 0,
+                               sizeof(HeapStatistics));
+  if (view == nullptr) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map the heap statistics section: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  const HeapStatistics* shared_statistics =
+      reinterpret_cast<const HeapStatistics*>(view);
+  bool valid = shared_statistics->version == kHeapStatisticsVersion &&
+      shared_statistics->size == sizeof(HeapStatistics);
+  if (valid)
+    ::memcpy(statistics, shared_statistics, sizeof(*statistics));
+  ::UnmapViewOfFile(view);
+
+  return valid;
+}
+
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,146 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the counters maintained by the heap manager, and the named shared
+// memory section that exposes them to external tools. The counters are
+// updated without stopping the process, so a snapshot taken by another
+// process is only approximately consistent.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_STATISTICS_H_
+#define SYZYGY_AGENT_ASAN_HEAP_STATISTICS_H_
+
+#include <windows.h>
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/agent/asan/constants.h"
+#include "syzygy/agent/asan/heap.h"
+
+namespace agent {
+namespace asan {
+
+// The version of the HeapStatistics layout. This must be incremented
+// whenever the layout changes.
+static const uint32 kHeapStatisticsVersion = 2;
+
+// The counters of the heaps of a given type.
+struct HeapTypeStatistics {
+  // The number of guarded allocations served by these heaps.
+  volatile LONG allocation_count;
+  // The number of guarded allocations that these heaps failed to serve.
+  volatile LONG failed_allocation_count;
+  // The number of guarded allocations freed to these heaps.
+  volatile LONG free_count;
+  // The number of bytes currently allocated from these heaps, not counting
+  // the quarantined blocks.
+  volatile LONG allocated_bytes;
+};
+
+// The counters of a quarantine shard. They are updated under the lock of the
+// shard.
+struct QuarantineShardStatistics {
+  // The number of objects in the shard.
+  volatile LONG count;
+  // The number of times that the lock of the shard was found to be held by
+  // another thread.
+  volatile LONG lock_contention_count;
+};
+
+// The counters of the shared quarantine.
+struct QuarantineStatistics {
+  // The size of the quarantine, in bytes, and the number of blocks it holds.
+  // They are refreshed each time a block enters or leaves the quarantine.
+  volatile LONG size;
+  volatile LONG count;
+  // The number of trims that freed at least one block, and the total and
+  // maximum number of CPU cycles that they took.
+  volatile LONG trim_count;
+  volatile LONGLONG trim_cycles;
+  volatile LONGLONG max_trim_cycles;
+  QuarantineShardStatistics shards[kQuarantineDefaultShardingFactor];
+};
+
+// The counters of the CtMalloc heap underlying the process heap. Comparing
+// the two sizes gives the fragmentation of the heap. They are updated under
+// the locks of the buckets of the heap.
+struct CtMallocStatistics {
+  // The number of bytes of address space reserved by the heap.
+  volatile LONG reserved_bytes;
+  // The number of bytes of the slots in use. This includes the rounding up of
+  // the allocations to their size class.
+  volatile LONG allocated_bytes;
+};
+
+// The layout of the statistics section.
+struct HeapStatistics {
+  // The version of this layout, and its size in bytes. A reader must check
+  // both before looking at the counters.
+  uint32 version;
+  uint32 size;
+  // The number of allocations that were served without guards.
+  volatile LONG unguarded_allocation_count;
+  // The counters of each type of heap, indexed by HeapType.
+  HeapTypeStatistics heaps[kHeapTypeMax];
+  QuarantineStatistics quarantine;
+  CtMallocStatistics process_heap_ctmalloc;
+};
+
+// Owns the named shared memory section exposing the heap statistics of the
+// current process. If the section can't be created, for instance because
+// another heap manager of this process already owns it, the statistics are
+// kept in private memory instead, so that they can always be updated.
+class HeapStatisticsSection {
+ public:
+  HeapStatisticsSection();
+  ~HeapStatisticsSection();
+
+  // Creates the section. Until this is called, the statistics are kept in
+  // private memory.
+  // @returns true if the section was created, false otherwise.
+  bool Init();
+
+  // @returns the statistics. This is never null.
+  HeapStatistics* statistics() const { return statistics_; }
+
+  // @returns true if the statistics are exposed in the named section.
+  bool is_shared() const { return section_.IsValid(); }
+
+  // @param process_id The ID of a process.
+  // @returns the name of the statistics section of the process.
+  static std::wstring GetSectionName(DWORD process_id);
+
+  // Takes a snapshot of the heap statistics of a running process.
+  // @param process_id The ID of the process.
+  // @param statistics Receives the snapshot.
+  // @returns true on success, false if the process has no statistics section
+  //     or if its layout is of a different version.
+  static bool ReadStatistics(DWORD process_id, HeapStatistics* statistics);
+
+ private:
+  // The section, and its view.
+  base::win::ScopedHandle section_;
+  HeapStatistics* statistics_;
+
+  // The statistics used when the section doesn't exist.
+  HeapStatistics local_statistics_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeapStatisticsSection);
+};
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_STATISTICS_H_
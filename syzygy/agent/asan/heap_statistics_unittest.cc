@@ -0,0 +1,65 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_statistics.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+TEST(HeapStatisticsSectionTest, LocalStatistics) {
+  HeapStatisticsSection section;
+  HeapStatistics* statistics = section.statistics();
+  ASSERT_NE(static_cast<HeapStatistics*>(nullptr), statistics);
+  EXPECT_FALSE(section.is_shared());
+  EXPECT_EQ(kHeapStatisticsVersion, statistics->version);
+  EXPECT_EQ(sizeof(HeapStatistics), statistics->size);
+  EXPECT_EQ(0, static_cast<LONG>(statistics->unguarded_allocation_count));
+}
+
+TEST(HeapStatisticsSectionTest, SharedStatistics) {
+  HeapStatisticsSection section;
+  section.statistics()->unguarded_allocation_count = 42;
+
+  // The heap manager of a runtime living in this process may already own the
+  // section, in which case the statistics stay private.
+  bool shared = section.Init();
+  HeapStatistics* statistics = section.statistics();
+  if (!shared) {
+    EXPECT_FALSE(section.is_shared());
+    EXPECT_EQ(42, static_cast<LONG>(statistics->unguarded_allocation_count));
+    return;
+  }
+
+  // The counters gathered before the section was created are carried over.
+  EXPECT_TRUE(section.is_shared());
+  EXPECT_EQ(42, static_cast<LONG>(statistics->unguarded_allocation_count));
+
+  statistics->quarantine.trim_count = 7;
+  HeapStatistics snapshot = {};
+  ASSERT_TRUE(HeapStatisticsSection::ReadStatistics(::GetCurrentProcessId(),
+                                                    &snapshot));
+  EXPECT_EQ(kHeapStatisticsVersion, snapshot.version);
+  EXPECT_EQ(42, static_cast<LONG>(snapshot.unguarded_allocation_count));
+  EXPECT_EQ(7, static_cast<LONG>(snapshot.quarantine.trim_count));
+}
+
+TEST(HeapStatisticsSectionTest, GetSectionName) {
+  EXPECT_EQ(L"Local\\SyzyAsanHeapStatistics-1234",
+            HeapStatisticsSection::GetSectionName(1234));
+}
+
+}  // namespace asan
+}  // namespace agent
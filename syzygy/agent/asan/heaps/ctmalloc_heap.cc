@@ -44,29 +44,35 @@ void CtMallocMemoryReleasedCallback(
   memory_notifier->NotifyReturnedToOS(addr, length);
 }
 
+// Returns the size of the slot that holds an allocation.
+// @param alloc An allocation made from a CtMalloc partition.
+LONG GetSlotSize(void* alloc) {
+  WTF::PartitionPage* page = WTF::partitionPointerToPage(
+      WTF::partitionCookieFreePointerAdjust(alloc));
+  return static_cast<LONG>(page->bucket->slotSize);
+}
+
 }  // namespace
 
 CtMallocHeap::CtMallocHeap(MemoryNotifierInterface* memory_notifier)
-    : memory_notifier_(memory_notifier) {
-  DCHECK_NE(static_cast<MemoryNotifierInterface*>(NULL), memory_notifier);
-
-  ::memset(&allocator_, 0, sizeof(allocator_));
-
-  // Wire the memory notifier up to the underlying CtMalloc implementation via
-  // the callbacks we added.
-  allocator_.root()->callbacks.user_data = memory_notifier;
-  allocator_.root()->callbacks.reserved_callback =
-      &CtMallocMemoryReservedCallback;
-  allocator_.root()->callbacks.released_callback =
-      &CtMallocMemoryReleasedCallback;
+    : bucket_count_(1),
+      memory_notifier_(memory_notifier),
+      statistics_(&local_statistics_) {
+  Init();
+}
 
-  // Initialize the CtMalloc heap.
-  allocator_.init();
+CtMallocHeap::CtMallocHeap(MemoryNotifierInterface* memory_notifier,
+                           size_t bucket_count)
+    : bucket_count_(bucket_count),
+      memory_notifier_(memory_notifier),
+      statistics_(&local_statistics_) {
+  Init();
 }
 
 CtMallocHeap::~CtMallocHeap() {
-  // Shutdown the CtMalloc heap.
-  allocator_.shutdown();
+  // Shutdown the CtMalloc heaps.
+  for (size_t i = 0; i < bucket_count_; ++i)
+    buckets_[i].allocator.shutdown();
 }
 
 HeapType CtMallocHeap::GetHeapType() const {
@@ -79,22 +85,37 @@ uint32 CtMallocHeap::GetHeapFeatures() const {
 }
 
 void* CtMallocHeap::Allocate(size_t bytes) {
-  ::common::AutoRecursiveLock lock(lock_);
-  void* alloc = WTF::partitionAllocGeneric(allocator_.root(), bytes);
+  Bucket* bucket = GetThreadBucket();
+  ::common::AutoRecursiveLock lock(bucket->lock);
+  size_t reserved_bytes = bucket->allocator.root()->totalSizeOfSuperPages;
+  void* alloc = WTF::partitionAllocGeneric(bucket->allocator.root(), bytes);
+  if (alloc != NULL)
+    UpdateStatisticsUnlocked(bucket, GetSlotSize(alloc), reserved_bytes);
   return alloc;
 }
 
 bool CtMallocHeap::Free(void* alloc) {
-  ::common::AutoRecursiveLock lock(lock_);
-  WTF::partitionFreeGeneric(allocator_.root(), alloc);
+  if (alloc == NULL)
+    return true;
+
+  Bucket* bucket = GetOwningBucket(alloc);
+  DCHECK_NE(static_cast<Bucket*>(NULL), bucket);
+  ::common::AutoRecursiveLock lock(bucket->lock);
+  size_t reserved_bytes = bucket->allocator.root()->totalSizeOfSuperPages;
+  LONG slot_size = GetSlotSize(alloc);
+  WTF::partitionFreeGeneric(bucket->allocator.root(), alloc);
+  UpdateStatisticsUnlocked(bucket, -slot_size, reserved_bytes);
   return true;
 }
 
 bool CtMallocHeap::IsAllocated(const void* alloc) {
-  if (!WTF::partitionIsAllocatedGeneric(allocator_.root(),
-                                        const_cast<void*>(alloc), -1, NULL))
-    return false;
-  return true;
+  for (size_t i = 0; i < bucket_count_; ++i) {
+    if (WTF::partitionIsAllocatedGeneric(buckets_[i].allocator.root(),
+                                         const_cast<void*>(alloc), -1, NULL)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 size_t CtMallocHeap::GetAllocationSize(const void* alloc) {
@@ -102,24 +123,105 @@ size_t CtMallocHeap::GetAllocationSize(const void* alloc) {
     return kUnknownSize;
 
   size_t allocation_size = 0;
-  if (!WTF::partitionIsAllocatedGeneric(allocator_.root(),
-                                        const_cast<void*>(alloc), -1,
-                                        &allocation_size)) {
-    return kUnknownSize;
+  for (size_t i = 0; i < bucket_count_; ++i) {
+    if (WTF::partitionIsAllocatedGeneric(buckets_[i].allocator.root(),
+                                         const_cast<void*>(alloc), -1,
+                                         &allocation_size)) {
+      return allocation_size;
+    }
   }
-  return allocation_size;
+  return kUnknownSize;
 }
 
 void CtMallocHeap::Lock() {
-  lock_.Acquire();
+  for (size_t i = 0; i < bucket_count_; ++i)
+    buckets_[i].lock.Acquire();
 }
 
 void CtMallocHeap::Unlock() {
-  lock_.Release();
+  for (size_t i = bucket_count_; i > 0; --i)
+    buckets_[i - 1].lock.Release();
 }
 
 bool CtMallocHeap::TryLock() {
-  return lock_.Try();
+  for (size_t i = 0; i < bucket_count_; ++i) {
+    if (buckets_[i].lock.Try())
+      continue;
+
+    // Release the locks acquired so far.
+    for (; i > 0; --i)
+      buckets_[i - 1].lock.Release();
+    return false;
+  }
+  return true;
+}
+
+void CtMallocHeap::set_statistics(CtMallocStatistics* statistics) {
+  DCHECK_NE(static_cast<CtMallocStatistics*>(NULL), statistics);
+  *statistics = *statistics_;
+  statistics_ = statistics;
+}
+
+void CtMallocHeap::Init() {
+  DCHECK_NE(static_cast<MemoryNotifierInterface*>(NULL), memory_notifier_);
+  DCHECK_LT(0u, bucket_count_);
+
+  ::memset(&local_statistics_, 0, sizeof(local_statistics_));
+
+  buckets_.reset(new Bucket[bucket_count_]);
+  for (size_t i = 0; i < bucket_count_; ++i) {
+    PartitionAllocatorGeneric* allocator = &buckets_[i].allocator;
+    ::memset(allocator, 0, sizeof(*allocator));
+
+    // Wire the memory notifier up to the underlying CtMalloc implementation
+    // via the callbacks we added.
+    allocator->root()->callbacks.user_data = memory_notifier_;
+    allocator->root()->callbacks.reserved_callback =
+        &CtMallocMemoryReservedCallback;
+    allocator->root()->callbacks.released_callback =
+        &CtMallocMemoryReleasedCallback;
+
+    // Initialize the CtMalloc heap.
+    allocator->init();
+  }
+}
+
+CtMallocHeap::Bucket* CtMallocHeap::GetThreadBucket() {
+  if (bucket_count_ == 1)
+    return &buckets_[0];
+  // Thread IDs are multiples of 4, so discard the bottom bits.
+  size_t index = (::GetCurrentThreadId() >> 2) % bucket_count_;
+  return &buckets_[index];
+}
+
+CtMallocHeap::Bucket* CtMallocHeap::GetOwningBucket(void* alloc) {
+  DCHECK_NE(static_cast<void*>(NULL), alloc);
+  if (bucket_count_ == 1)
+    return &buckets_[0];
+
+  // Follow the page metadata of the allocation back to its partition.
+  WTF::PartitionRootBase* root = WTF::partitionPageToRoot(
+      WTF::partitionPointerToPage(
+          WTF::partitionCookieFreePointerAdjust(alloc)));
+  for (size_t i = 0; i < bucket_count_; ++i) {
+    if (buckets_[i].allocator.root() == root)
+      return &buckets_[i];
+  }
+  return NULL;
+}
+
+void CtMallocHeap::UpdateStatisticsUnlocked(Bucket* bucket,
+                                            LONG allocated_bytes_delta,
+                                            size_t reserved_bytes_before) {
+  DCHECK_NE(static_cast<Bucket*>(NULL), bucket);
+  size_t reserved_bytes = bucket->allocator.root()->totalSizeOfSuperPages;
+  if (reserved_bytes != reserved_bytes_before) {
+    ::InterlockedExchangeAdd(
+        &statistics_->reserved_bytes,
+        static_cast<LONG>(reserved_bytes - reserved_bytes_before));
+  }
+  ::InterlockedExchangeAdd(&statistics_->allocated_bytes,
+                           allocated_bytes_delta);
 }
 
 }  // namespace heaps
@@ -20,6 +20,7 @@
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
 #include "syzygy/agent/asan/heap.h"
+#include "syzygy/agent/asan/heap_statistics.h"
 #include "syzygy/agent/asan/memory_notifier.h"
 #include "syzygy/common/recursive_lock.h"
 #include "wtf/config.h"
@@ -29,12 +30,23 @@ namespace agent {
 namespace asan {
 namespace heaps {
 
+// CtMalloc already segregates the allocations by size class, but each
+// partition is gated by a single lock. This heap can spread the allocations
+// over several partitions, or buckets, each with its own lock. A thread
+// always allocates from the same bucket, while a free is routed back to the
+// bucket that owns the allocation.
 class CtMallocHeap : public HeapInterface {
  public:
-  // Constructor. Creates a heap that is owned uniquely by this object.
+  // The number of buckets used for the process heap.
+  static const size_t kProcessHeapBucketCount = 8;
+
+  // Constructors. Create a heap that is owned uniquely by this object.
   // @param memory_notifier The notifier that will be used to inform the
   //     runtime of this heaps internal memory use.
+  // @param bucket_count The number of buckets over which the allocations are
+  //     spread. Defaults to 1.
   explicit CtMallocHeap(MemoryNotifierInterface* memory_notifier);
+  CtMallocHeap(MemoryNotifierInterface* memory_notifier, size_t bucket_count);
 
   // Destructor.
   virtual ~CtMallocHeap();
@@ -52,16 +64,60 @@ class CtMallocHeap : public HeapInterface {
   virtual bool TryLock();
   // @}
 
+  // Moves the fragmentation counters of this heap to an external location,
+  // such as the heap statistics section. The counters gathered so far are
+  // carried over. This must be called before the heap is shared between
+  // threads.
+  // @param statistics The counters to use. Must outlive this heap.
+  void set_statistics(CtMallocStatistics* statistics);
+
+  // @returns the fragmentation counters of this heap.
+  const CtMallocStatistics* statistics() const { return statistics_; }
+
+  // @returns the number of buckets of this heap.
+  size_t bucket_count() const { return bucket_count_; }
+
  protected:
-  // The underlying heap. Under lock_.
-  PartitionAllocatorGeneric allocator_;
+  // A partition of the heap.
+  struct Bucket {
+    // The underlying heap. Under lock.
+    PartitionAllocatorGeneric allocator;
+    // The lock that gates access to this bucket.
+    ::common::RecursiveLock lock;
+  };
+
+  // Initializes the buckets.
+  void Init();
+
+  // @returns the bucket used by the current thread.
+  Bucket* GetThreadBucket();
+
+  // @param alloc An allocation made by this heap.
+  // @returns the bucket that owns @p alloc.
+  Bucket* GetOwningBucket(void* alloc);
+
+  // Updates the counters after an allocation or a free in @p bucket.
+  // @param bucket The bucket that served the operation. Its lock must be held.
+  // @param allocated_bytes_delta The change in the size of the slots in use.
+  // @param reserved_bytes_before The size reserved by the bucket prior to the
+  //     operation.
+  void UpdateStatisticsUnlocked(Bucket* bucket,
+                                LONG allocated_bytes_delta,
+                                size_t reserved_bytes_before);
+
+  // The buckets of this heap.
+  scoped_ptr<Bucket[]> buckets_;
+  size_t bucket_count_;
 
   // The interface that will be notified of internal memory use. Has its own
   // locking.
   MemoryNotifierInterface* memory_notifier_;
 
-  // The lock that gates access to this heap.
-  ::common::RecursiveLock lock_;
+  // The fragmentation counters. They are updated atomically, as the buckets
+  // have distinct locks. This points to local_statistics_ unless the counters
+  // have been moved elsewhere.
+  CtMallocStatistics* statistics_;
+  CtMallocStatistics local_statistics_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(CtMallocHeap);
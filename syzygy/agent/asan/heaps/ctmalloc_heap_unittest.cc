@@ -22,6 +22,25 @@ namespace agent {
 namespace asan {
 namespace heaps {
 
+namespace {
+
+// The parameters of AllocateOnThread.
+struct AllocateOnThreadParams {
+  CtMallocHeap* heap;
+  size_t size;
+  void* alloc;
+};
+
+// Makes an allocation on the thread that runs it.
+DWORD WINAPI AllocateOnThread(LPVOID param) {
+  AllocateOnThreadParams* params =
+      reinterpret_cast<AllocateOnThreadParams*>(param);
+  params->alloc = params->heap->Allocate(params->size);
+  return 0;
+}
+
+}  // namespace
+
 TEST(CtMallocHeapTest, GetHeapTypeIsValid) {
   testing::NullMemoryNotifier n;
   CtMallocHeap h(&n);
@@ -161,6 +180,69 @@ TEST(CtMallocHeapTest, Lock) {
   h.Unlock();
 }
 
+TEST(CtMallocHeapTest, Buckets) {
+  testing::NullMemoryNotifier n;
+  CtMallocHeap h(&n, 4);
+  EXPECT_EQ(4u, h.bucket_count());
+
+  // Make allocations from several threads. These are served by distinct
+  // buckets, but are all owned by the heap and can be freed from any thread.
+  const size_t kThreadCount = 8;
+  AllocateOnThreadParams params[kThreadCount] = {};
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    params[i].heap = &h;
+    params[i].size = 100 * (i + 1);
+    HANDLE thread = ::CreateThread(NULL, 0, &AllocateOnThread, &params[i], 0,
+                                   NULL);
+    ASSERT_NE(static_cast<HANDLE>(NULL), thread);
+    EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(thread, INFINITE));
+    ::CloseHandle(thread);
+  }
+
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    ASSERT_NE(static_cast<void*>(NULL), params[i].alloc);
+    EXPECT_TRUE(h.IsAllocated(params[i].alloc));
+    EXPECT_LE(params[i].size, h.GetAllocationSize(params[i].alloc));
+  }
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    EXPECT_TRUE(h.Free(params[i].alloc));
+    EXPECT_FALSE(h.IsAllocated(params[i].alloc));
+  }
+
+  // The heap lock gates all of the buckets.
+  h.Lock();
+  EXPECT_TRUE(h.TryLock());
+  h.Unlock();
+  h.Unlock();
+}
+
+TEST(CtMallocHeapTest, Statistics) {
+  testing::NullMemoryNotifier n;
+  CtMallocHeap h(&n, 2);
+
+  const size_t kAllocSize = 67;
+  void* alloc = h.Allocate(kAllocSize);
+  ASSERT_TRUE(alloc != NULL);
+  EXPECT_LE(static_cast<LONG>(kAllocSize), h.statistics()->allocated_bytes);
+  EXPECT_LE(h.statistics()->allocated_bytes, h.statistics()->reserved_bytes);
+
+  // Moving the counters carries them over.
+  CtMallocStatistics statistics = {};
+  h.set_statistics(&statistics);
+  EXPECT_EQ(&statistics, h.statistics());
+  EXPECT_LE(static_cast<LONG>(kAllocSize), statistics.allocated_bytes);
+
+  // Large allocations are accounted for too.
+  const size_t kLargeAllocSize = 64 * 1024 * 1024;
+  void* large_alloc = h.Allocate(kLargeAllocSize);
+  ASSERT_TRUE(large_alloc != NULL);
+  EXPECT_LE(static_cast<LONG>(kLargeAllocSize), statistics.reserved_bytes);
+
+  EXPECT_TRUE(h.Free(large_alloc));
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(0, statistics.allocated_bytes);
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
@@ -17,6 +17,7 @@
 #include <windows.h>
 
 #include <algorithm>
+#include <utility>
 
 #include "base/logging.h"
 #include "syzygy/common/align.h"
@@ -25,8 +26,29 @@ namespace agent {
 namespace asan {
 namespace heaps {
 
+namespace {
+
+// A cached reservation is only reused for allocations of at least
+// 1 / kReservationReuseRatio of its size, to avoid wasting address space.
+const size_t kReservationReuseRatio = 2;
+
+// Releases a set of reservations.
+void ReleaseReservations(const std::vector<void*>& reservations) {
+  for (size_t i = 0; i < reservations.size(); ++i)
+    ::VirtualFree(reservations[i], 0, MEM_RELEASE);
+}
+
+}  // namespace
+
 LargeBlockHeap::LargeBlockHeap(HeapInterface* internal_heap)
-    : allocs_(HeapAllocator<void*>(internal_heap)) {
+    : allocs_(HeapAllocator<void*>(internal_heap)),
+      reservation_cache_size_(0),
+      cached_reservation_size_(0),
+      reservations_(HeapAllocator<Reservation>(internal_heap)),
+      reservations_by_size_(
+          std::less<size_t>(),
+          HeapAllocator<std::pair<const size_t, ReservationList::iterator>>(
+              internal_heap)) {
 }
 
 LargeBlockHeap::~LargeBlockHeap() {
@@ -35,6 +57,10 @@ LargeBlockHeap::~LargeBlockHeap() {
   // If there are still allocations in the heap at destruction, then freeing
   // them here will not clear the associated shadow metadata.
   CHECK_EQ(0U, allocs_.size());
+
+  std::vector<void*> evicted;
+  EvictReservations(0, &evicted);
+  ReleaseReservations(evicted);
 }
 
 HeapType LargeBlockHeap::GetHeapType() const {
@@ -50,8 +76,26 @@ void* LargeBlockHeap::Allocate(size_t bytes) {
   // allocations get an actual distinct address each time.
   size_t size = std::max(bytes, 1u);
   size = ::common::AlignUp(size, GetPageSize());
-  void* alloc = ::VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
-  Allocation allocation = { alloc, bytes };
+
+  // Try to reuse a cached reservation first. Committing pages returns them
+  // zeroed, as with a fresh allocation.
+  size_t reserved_size = 0;
+  void* alloc = NULL;
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    alloc = TakeReservation(size, &reserved_size);
+  }
+  if (alloc != NULL &&
+      ::VirtualAlloc(alloc, size, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+    ::VirtualFree(alloc, 0, MEM_RELEASE);
+    alloc = NULL;
+  }
+
+  if (alloc == NULL) {
+    alloc = ::VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
+    reserved_size = size;
+  }
+  Allocation allocation = { alloc, bytes, reserved_size };
 
   if (alloc != NULL) {
     ::common::AutoRecursiveLock lock(lock_);
@@ -64,7 +108,9 @@ void* LargeBlockHeap::Allocate(size_t bytes) {
 }
 
 bool LargeBlockHeap::Free(void* alloc) {
-  Allocation allocation = { alloc, 0 };
+  Allocation allocation = { alloc, 0, 0 };
+  size_t reserved_size = 0;
+  bool cache_reservation = false;
 
   {
     // First lookup the allocation to ensure it was made by us.
@@ -72,15 +118,31 @@ bool LargeBlockHeap::Free(void* alloc) {
     AllocationSet::iterator it = allocs_.find(allocation);
     if (it == allocs_.end())
       return false;
+    reserved_size = it->reserved_size;
     allocs_.erase(it);
+    cache_reservation = reserved_size <= reservation_cache_size_;
   }
 
-  ::VirtualFree(alloc, 0, MEM_RELEASE);
+  if (!cache_reservation) {
+    ::VirtualFree(alloc, 0, MEM_RELEASE);
+    return true;
+  }
+
+  // The reservation must be decommitted before it's made available for
+  // reuse.
+  ::VirtualFree(alloc, reserved_size, MEM_DECOMMIT);
+  std::vector<void*> evicted;
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    CacheReservation(alloc, reserved_size);
+    EvictReservations(reservation_cache_size_, &evicted);
+  }
+  ReleaseReservations(evicted);
   return true;
 }
 
 bool LargeBlockHeap::IsAllocated(const void* alloc) {
-  Allocation allocation = { alloc, 0 };
+  Allocation allocation = { alloc, 0, 0 };
 
   {
     ::common::AutoRecursiveLock lock(lock_);
@@ -93,7 +155,7 @@ bool LargeBlockHeap::IsAllocated(const void* alloc) {
 }
 
 size_t LargeBlockHeap::GetAllocationSize(const void* alloc) {
-  Allocation allocation = { alloc, 0 };
+  Allocation allocation = { alloc, 0, 0 };
 
   {
     ::common::AutoRecursiveLock lock(lock_);
@@ -139,6 +201,69 @@ bool LargeBlockHeap::FreeBlock(const BlockInfo& block_info) {
   return Free(block_info.block);
 }
 
+void LargeBlockHeap::set_reservation_cache_size(
+    size_t reservation_cache_size) {
+  std::vector<void*> evicted;
+  {
+    ::common::AutoRecursiveLock lock(lock_);
+    reservation_cache_size_ = reservation_cache_size;
+    EvictReservations(reservation_cache_size_, &evicted);
+  }
+  ReleaseReservations(evicted);
+}
+
+void* LargeBlockHeap::TakeReservation(size_t size, size_t* reserved_size) {
+  DCHECK_NE(static_cast<size_t*>(NULL), reserved_size);
+
+  // Use the smallest reservation that fits.
+  ReservationSizeMap::iterator it = reservations_by_size_.lower_bound(size);
+  if (it == reservations_by_size_.end())
+    return NULL;
+  if (it->first / kReservationReuseRatio > size)
+    return NULL;
+
+  void* address = it->second->address;
+  *reserved_size = it->first;
+  cached_reservation_size_ -= it->first;
+  reservations_.erase(it->second);
+  reservations_by_size_.erase(it);
+  return address;
+}
+
+void LargeBlockHeap::CacheReservation(void* address, size_t size) {
+  DCHECK_NE(static_cast<void*>(NULL), address);
+
+  Reservation reservation = { address, size };
+  reservations_.push_front(reservation);
+  reservations_by_size_.insert(std::make_pair(size, reservations_.begin()));
+  cached_reservation_size_ += size;
+}
+
+void LargeBlockHeap::EvictReservations(size_t budget,
+                                       std::vector<void*>* evicted) {
+  DCHECK_NE(static_cast<std::vector<void*>*>(NULL), evicted);
+
+  while (cached_reservation_size_ > budget) {
+    DCHECK(!reservations_.empty());
+    ReservationList::iterator victim = reservations_.end();
+    --victim;
+
+    // Find the index entry of the victim among the reservations of the same
+    // size.
+    std::pair<ReservationSizeMap::iterator, ReservationSizeMap::iterator>
+        range = reservations_by_size_.equal_range(victim->size);
+    ReservationSizeMap::iterator it = range.first;
+    while (it != range.second && it->second != victim)
+      ++it;
+    DCHECK(it != range.second);
+    reservations_by_size_.erase(it);
+
+    evicted->push_back(victim->address);
+    cached_reservation_size_ -= victim->size;
+    reservations_.erase(victim);
+  }
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
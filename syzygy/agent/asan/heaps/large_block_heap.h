@@ -23,11 +23,20 @@
 // then allocations being fed into the large block heap should be at least
 // 32KB in size. Ideally the large allocation heap should not be leaned on too
 // heavily as it can cause significant memory fragmentation.
+//
+// Reserving and releasing address space for every allocation is costly for
+// workloads that repeatedly allocate and free buffers of similar sizes. The
+// heap can keep the address space of freed allocations reserved (but
+// decommitted), up to a configurable budget, and reuse it for later
+// allocations of a similar size.
 
 #ifndef SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 #define SYZYGY_AGENT_ASAN_HEAPS_LARGE_BLOCK_HEAP_H_
 
+#include <list>
+#include <map>
 #include <unordered_set>
+#include <vector>
 
 #include "syzygy/agent/asan/allocators.h"
 #include "syzygy/agent/asan/heap.h"
@@ -72,13 +81,72 @@ class LargeBlockHeap : public BlockHeapInterface {
   // @returns the number of active allocations in this heap.
   size_t size() const { return allocs_.size(); }
 
+  // @returns the maximum amount of address space, in bytes, kept reserved
+  //     for reuse.
+  size_t reservation_cache_size() const { return reservation_cache_size_; }
+
+  // Sets the maximum amount of address space, in bytes, kept reserved for
+  // reuse. Setting this to zero disables the reuse of freed allocations.
+  // Reservations exceeding the new budget are released.
+  // @param reservation_cache_size The new budget.
+  void set_reservation_cache_size(size_t reservation_cache_size);
+
+  // @returns the amount of address space, in bytes, currently kept reserved
+  //     for reuse.
+  size_t cached_reservation_size() const { return cached_reservation_size_; }
+
+  // @returns the number of reservations currently kept for reuse.
+  size_t cached_reservation_count() const { return reservations_.size(); }
+
  protected:
   // Information about an allocation made by this allocator.
   struct Allocation {
     const void* address;
     size_t size;
+    // The size of the address space reserved for this allocation. This can be
+    // bigger than the allocation if it reuses a cached reservation.
+    size_t reserved_size;
   };
 
+  // A decommitted reservation kept for reuse.
+  struct Reservation {
+    void* address;
+    size_t size;
+  };
+
+  // The cached reservations, with the most recently freed at the front.
+  typedef std::list<Reservation, HeapAllocator<Reservation>> ReservationList;
+
+  // Indexes the cached reservations by size.
+  typedef std::multimap<
+      size_t,
+      ReservationList::iterator,
+      std::less<size_t>,
+      HeapAllocator<std::pair<const size_t, ReservationList::iterator>>>
+          ReservationSizeMap;
+
+  // Takes a cached reservation that can hold @p size bytes, without being
+  // much bigger.
+  // @param size The page aligned size of the allocation.
+  // @param reserved_size Receives the size of the reservation.
+  // @returns the address of the reservation, or NULL if none was found.
+  // @note Under lock_.
+  void* TakeReservation(size_t size, size_t* reserved_size);
+
+  // Adds a decommitted reservation to the cache.
+  // @param address The address of the reservation.
+  // @param size The size of the reservation.
+  // @note Under lock_.
+  void CacheReservation(void* address, size_t size);
+
+  // Removes the least recently freed reservations from the cache until it
+  // fits in @p budget bytes.
+  // @param budget The maximum size of the cached reservations.
+  // @param evicted Receives the addresses of the evicted reservations, which
+  //     must be released outside of the lock.
+  // @note Under lock_.
+  void EvictReservations(size_t budget, std::vector<void*>* evicted);
+
   // Calculates a hash of an Allocation object by forwarding to the STL
   // hash for the allocation address.
   struct AllocationHash {
@@ -106,6 +174,12 @@ class LargeBlockHeap : public BlockHeapInterface {
       HeapAllocator<Allocation>> AllocationSet;
   AllocationSet allocs_;  // Under lock_.
 
+  // The reservation cache. Under lock_.
+  size_t reservation_cache_size_;
+  size_t cached_reservation_size_;
+  ReservationList reservations_;
+  ReservationSizeMap reservations_by_size_;
+
   // The global lock for this allocator.
   ::common::RecursiveLock lock_;
 
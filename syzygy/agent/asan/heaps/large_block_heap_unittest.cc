@@ -144,6 +144,90 @@ TEST(LargeBlockHeapTest, GetAllocationSize) {
   EXPECT_TRUE(h.Free(alloc));
 }
 
+TEST(LargeBlockHeapTest, ReservationsAreReused) {
+  TestLargeBlockHeap h;
+  const size_t kSize = 16 * GetPageSize();
+  h.set_reservation_cache_size(4 * kSize);
+
+  uint8* alloc = reinterpret_cast<uint8*>(h.Allocate(kSize));
+  ASSERT_TRUE(alloc != NULL);
+  ::memset(alloc, 0xCC, kSize);
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(1u, h.cached_reservation_count());
+  EXPECT_EQ(kSize, h.cached_reservation_size());
+
+  // The cached reservation is decommitted.
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  ASSERT_EQ(sizeof(memory_info),
+            ::VirtualQuery(alloc, &memory_info, sizeof(memory_info)));
+  EXPECT_EQ(static_cast<DWORD>(MEM_RESERVE), memory_info.State);
+
+  // A slightly smaller allocation reuses it, and gets zeroed memory.
+  const size_t kSmallerSize = kSize - GetPageSize() - 10;
+  uint8* alloc2 = reinterpret_cast<uint8*>(h.Allocate(kSmallerSize));
+  EXPECT_EQ(alloc, alloc2);
+  EXPECT_EQ(0u, h.cached_reservation_count());
+  EXPECT_EQ(0u, h.cached_reservation_size());
+  EXPECT_EQ(kSmallerSize, h.GetAllocationSize(alloc2));
+  for (size_t i = 0; i < kSmallerSize; ++i)
+    ASSERT_EQ(0u, alloc2[i]);
+
+  // Freeing it caches the whole reservation again.
+  EXPECT_TRUE(h.Free(alloc2));
+  EXPECT_EQ(kSize, h.cached_reservation_size());
+
+  // A much smaller or a bigger allocation doesn't use it.
+  void* alloc3 = h.Allocate(kSize / 4);
+  EXPECT_NE(reinterpret_cast<void*>(alloc), alloc3);
+  void* alloc4 = h.Allocate(kSize + 1);
+  EXPECT_NE(reinterpret_cast<void*>(alloc), alloc4);
+  EXPECT_EQ(1u, h.cached_reservation_count());
+  EXPECT_TRUE(h.Free(alloc3));
+  EXPECT_TRUE(h.Free(alloc4));
+}
+
+TEST(LargeBlockHeapTest, ReservationCacheBudget) {
+  TestLargeBlockHeap h;
+  const size_t kSize = 4 * GetPageSize();
+
+  // By default nothing is cached.
+  EXPECT_EQ(0u, h.reservation_cache_size());
+  void* alloc = h.Allocate(kSize);
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(0u, h.cached_reservation_count());
+
+  // Allocations bigger than the budget aren't cached either.
+  h.set_reservation_cache_size(2 * kSize);
+  alloc = h.Allocate(3 * kSize);
+  EXPECT_TRUE(h.Free(alloc));
+  EXPECT_EQ(0u, h.cached_reservation_count());
+
+  // The least recently freed reservations are evicted to fit in the budget.
+  void* allocs[3] = {};
+  for (size_t i = 0; i < arraysize(allocs); ++i)
+    allocs[i] = h.Allocate(kSize);
+  for (size_t i = 0; i < arraysize(allocs); ++i)
+    EXPECT_TRUE(h.Free(allocs[i]));
+  EXPECT_EQ(2u, h.cached_reservation_count());
+  EXPECT_EQ(2 * kSize, h.cached_reservation_size());
+
+  // The most recently freed reservations are still there.
+  void* reused[2] = {};
+  for (size_t i = 0; i < arraysize(reused); ++i)
+    reused[i] = h.Allocate(kSize);
+  EXPECT_TRUE(reused[0] == allocs[1] || reused[0] == allocs[2]);
+  EXPECT_TRUE(reused[1] == allocs[1] || reused[1] == allocs[2]);
+  for (size_t i = 0; i < arraysize(reused); ++i)
+    EXPECT_TRUE(h.Free(reused[i]));
+
+  // Shrinking the budget releases the reservations.
+  h.set_reservation_cache_size(kSize);
+  EXPECT_EQ(1u, h.cached_reservation_count());
+  h.set_reservation_cache_size(0);
+  EXPECT_EQ(0u, h.cached_reservation_count());
+  EXPECT_EQ(0u, h.cached_reservation_size());
+}
+
 TEST(LargeBlockHeapTest, Lock) {
   TestLargeBlockHeap h;
 
@@ -14,17 +14,43 @@
 
 #include "syzygy/agent/asan/heaps/simple_block_heap.h"
 
+#include <windows.h>
+
 #include "base/logging.h"
 
 namespace agent {
 namespace asan {
 namespace heaps {
 
+namespace {
+
+// Gives access to the first pointer of a free block as a linked list pointer.
+void** GetBlockLink(void* block) {
+  DCHECK_NE(static_cast<void*>(NULL), block);
+  return reinterpret_cast<void**>(block);
+}
+
+}  // namespace
+
 SimpleBlockHeap::SimpleBlockHeap(HeapInterface* heap) : heap_(heap) {
   DCHECK_NE(static_cast<HeapInterface*>(NULL), heap);
 }
 
+SimpleBlockHeap::SimpleBlockHeap(HeapInterface* heap, bool enable_block_cache)
+    : heap_(heap) {
+  DCHECK_NE(static_cast<HeapInterface*>(NULL), heap);
+  if (enable_block_cache) {
+    block_cache_.reset(new BlockCacheShard[kBlockCacheShardCount]);
+    for (size_t i = 0; i < kBlockCacheShardCount; ++i) {
+      ::memset(block_cache_[i].bins, 0, sizeof(block_cache_[i].bins));
+      ::memset(block_cache_[i].bin_sizes, 0,
+               sizeof(block_cache_[i].bin_sizes));
+    }
+  }
+}
+
 SimpleBlockHeap::~SimpleBlockHeap() {
+  FlushBlockCache();
 }
 
 HeapType SimpleBlockHeap::GetHeapType() const {
@@ -75,9 +101,24 @@ void* SimpleBlockHeap::AllocateBlock(size_t size,
     return nullptr;
   }
 
+  // Try to serve the allocation from the block cache first.
+  void* alloc = NULL;
+  if (block_cache_enabled() &&
+      layout->block_size <= kBlockCacheMaxBlockSize) {
+    size_t bin = layout->block_size / kShadowRatio;
+    BlockCacheShard* shard = GetBlockCacheShard();
+    base::AutoLock lock(shard->lock);
+    alloc = shard->bins[bin];
+    if (alloc != NULL) {
+      shard->bins[bin] = *GetBlockLink(alloc);
+      --shard->bin_sizes[bin];
+      return alloc;
+    }
+  }
+
   // Allocate space for the block. If the allocation fails heap_ will
   // return NULL and we'll simply pass it on.
-  void* alloc = heap_->Allocate(layout->block_size);
+  alloc = heap_->Allocate(layout->block_size);
   DCHECK_EQ(0u, reinterpret_cast<uintptr_t>(alloc) % kShadowRatio);
   return alloc;
 }
@@ -85,12 +126,89 @@ void* SimpleBlockHeap::AllocateBlock(size_t size,
 bool SimpleBlockHeap::FreeBlock(const BlockInfo& block_info) {
   DCHECK_NE(static_cast<uint8*>(NULL), block_info.block);
 
+  if (block_cache_enabled() &&
+      block_info.block_size <= kBlockCacheMaxBlockSize) {
+    DCHECK_EQ(0u, block_info.block_size % kShadowRatio);
+    size_t bin = block_info.block_size / kShadowRatio;
+    void* overflow = NULL;
+
+    {
+      BlockCacheShard* shard = GetBlockCacheShard();
+      base::AutoLock lock(shard->lock);
+
+      // If the bin is full then detach half of it, to be returned to the
+      // underlying heap once the shard lock has been released.
+      if (shard->bin_sizes[bin] == kBlockCacheMaxBlocksPerBin) {
+        overflow = shard->bins[bin];
+        void* last = overflow;
+        for (size_t i = 1; i < kBlockCacheMaxBlocksPerBin / 2; ++i)
+          last = *GetBlockLink(last);
+        shard->bins[bin] = *GetBlockLink(last);
+        *GetBlockLink(last) = NULL;
+        shard->bin_sizes[bin] -= kBlockCacheMaxBlocksPerBin / 2;
+      }
+
+      *GetBlockLink(block_info.block) = shard->bins[bin];
+      shard->bins[bin] = block_info.block;
+      ++shard->bin_sizes[bin];
+    }
+
+    return FreeBlockList(overflow);
+  }
+
   if (!heap_->Free(block_info.block))
     return false;
 
   return true;
 }
 
+bool SimpleBlockHeap::FlushBlockCache() {
+  if (!block_cache_enabled())
+    return true;
+
+  bool result = true;
+  for (size_t i = 0; i < kBlockCacheShardCount; ++i) {
+    BlockCacheShard* shard = &block_cache_[i];
+    for (size_t bin = 0; bin < kBlockCacheBinCount; ++bin) {
+      void* blocks = NULL;
+      {
+        base::AutoLock lock(shard->lock);
+        blocks = shard->bins[bin];
+        shard->bins[bin] = NULL;
+        shard->bin_sizes[bin] = 0;
+      }
+      if (!FreeBlockList(blocks))
+        result = false;
+    }
+  }
+
+  return result;
+}
+
+SimpleBlockHeap::BlockCacheShard* SimpleBlockHeap::GetBlockCacheShard() {
+  DCHECK(block_cache_enabled());
+  // Thread IDs are multiples of 4, so discard the bottom bits.
+  size_t index = (::GetCurrentThreadId() >> 2) % kBlockCacheShardCount;
+  return &block_cache_[index];
+}
+
+bool SimpleBlockHeap::FreeBlockList(void* blocks) {
+  if (blocks == NULL)
+    return true;
+
+  bool result = true;
+  heap_->Lock();
+  while (blocks != NULL) {
+    void* block = blocks;
+    blocks = *GetBlockLink(block);
+    if (!heap_->Free(block))
+      result = false;
+  }
+  heap_->Unlock();
+
+  return result;
+}
+
 }  // namespace heaps
 }  // namespace asan
 }  // namespace agent
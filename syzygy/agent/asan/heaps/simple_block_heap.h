@@ -19,6 +19,8 @@
 #ifndef SYZYGY_AGENT_ASAN_HEAPS_SIMPLE_BLOCK_HEAP_H_
 #define SYZYGY_AGENT_ASAN_HEAPS_SIMPLE_BLOCK_HEAP_H_
 
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/heap.h"
 
 namespace agent {
@@ -26,11 +28,31 @@ namespace asan {
 namespace heaps {
 
 // A block heap that wraps a raw heap.
+//
+// This heap can optionally maintain a cache of freed blocks. Small blocks that
+// are freed are kept in size-classed bins rather than being returned to the
+// underlying heap, and are used to satisfy subsequent allocations of the same
+// size. The cache is sharded by thread ID, so threads rarely contend with each
+// other and never take the lock of the underlying heap when they are served
+// by the cache. When a bin overflows half of its blocks are returned to the
+// underlying heap in a single batch, under a single acquisition of its lock.
+// Blocks only ever reach this heap once they have left the quarantine, so the
+// cache doesn't reduce the ability to detect use-after-free errors.
 class SimpleBlockHeap : public BlockHeapInterface {
  public:
-  // Constructor.
+  // The size of the largest block that will be cached, in bytes.
+  static const size_t kBlockCacheMaxBlockSize = 512;
+  // The number of blocks that may be cached per size class in each shard of
+  // the cache.
+  static const size_t kBlockCacheMaxBlocksPerBin = 32;
+  // The number of shards in the cache.
+  static const size_t kBlockCacheShardCount = 16;
+
+  // Constructors.
   // @param heap Is the underlying raw heap that will be used by this heap.
+  // @param enable_block_cache If true then freed blocks will be cached.
   explicit SimpleBlockHeap(HeapInterface* heap);
+  SimpleBlockHeap(HeapInterface* heap, bool enable_block_cache);
 
   // Virtual destructor.
   virtual ~SimpleBlockHeap();
@@ -57,10 +79,41 @@ class SimpleBlockHeap : public BlockHeapInterface {
   virtual bool FreeBlock(const BlockInfo& block_info);
   // @}
 
+  // @returns true if the block cache is enabled for this heap.
+  bool block_cache_enabled() const { return block_cache_.get() != NULL; }
+
+  // Returns all of the cached blocks to the underlying heap.
+  // @returns true on success, false otherwise.
+  bool FlushBlockCache();
+
  protected:
+  // The number of size classes in the cache. Block sizes are always a multiple
+  // of kShadowRatio.
+  static const size_t kBlockCacheBinCount =
+      kBlockCacheMaxBlockSize / kShadowRatio + 1;
+
+  // A shard of the block cache. Each bin is a singly linked list of free
+  // blocks, using the first pointer-sized word of each block as the link.
+  struct BlockCacheShard {
+    base::Lock lock;
+    void* bins[kBlockCacheBinCount];  // Under lock.
+    size_t bin_sizes[kBlockCacheBinCount];  // Under lock.
+  };
+
+  // @returns the cache shard to be used by the current thread.
+  BlockCacheShard* GetBlockCacheShard();
+
+  // Returns a linked list of blocks to the underlying heap.
+  // @param blocks The head of the linked list of blocks.
+  // @returns true on success, false otherwise.
+  bool FreeBlockList(void* blocks);
+
   // The underlying raw heap.
   HeapInterface* heap_;
 
+  // The block cache. This is NULL if the cache is disabled.
+  scoped_ptr<BlockCacheShard[]> block_cache_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SimpleBlockHeap);
 };
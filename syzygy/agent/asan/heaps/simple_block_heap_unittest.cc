@@ -87,6 +87,87 @@ TEST(SimpleBlockHeap, IsAllocated) {
   EXPECT_FALSE(h.IsAllocated(a));
 }
 
+TEST(SimpleBlockHeapTest, BlockCacheDisabledByDefault) {
+  WinHeap win_heap;
+  SimpleBlockHeap h(&win_heap);
+  EXPECT_FALSE(h.block_cache_enabled());
+  EXPECT_TRUE(h.FlushBlockCache());
+}
+
+TEST(SimpleBlockHeapTest, BlockCacheReusesBlocks) {
+  WinHeap win_heap;
+  SimpleBlockHeap h(&win_heap, true);
+  EXPECT_TRUE(h.block_cache_enabled());
+
+  BlockLayout layout = {};
+  BlockInfo block = {};
+
+  // A freed small block should be handed out again for an allocation of the
+  // same size.
+  void* alloc1 = h.AllocateBlock(32, 0, 0, &layout);
+  ASSERT_NE(static_cast<void*>(NULL), alloc1);
+  BlockInitialize(layout, alloc1, false, &block);
+  EXPECT_TRUE(h.FreeBlock(block));
+  void* alloc2 = h.AllocateBlock(32, 0, 0, &layout);
+  EXPECT_EQ(alloc1, alloc2);
+  BlockInfo block2 = {};
+  BlockInitialize(layout, alloc2, false, &block2);
+
+  // But not for one of a different size.
+  void* alloc3 = h.AllocateBlock(64, 0, 0, &layout);
+  ASSERT_NE(static_cast<void*>(NULL), alloc3);
+  EXPECT_NE(alloc2, alloc3);
+  BlockInitialize(layout, alloc3, false, &block);
+  EXPECT_TRUE(h.FreeBlock(block));
+  EXPECT_TRUE(h.FreeBlock(block2));
+
+  // Large blocks bypass the cache entirely.
+  void* alloc4 = h.AllocateBlock(
+      SimpleBlockHeap::kBlockCacheMaxBlockSize, 0, 0, &layout);
+  ASSERT_NE(static_cast<void*>(NULL), alloc4);
+  EXPECT_LT(SimpleBlockHeap::kBlockCacheMaxBlockSize, layout.block_size);
+  BlockInitialize(layout, alloc4, false, &block);
+  EXPECT_TRUE(h.FreeBlock(block));
+
+  EXPECT_TRUE(h.FlushBlockCache());
+}
+
+TEST(SimpleBlockHeapTest, BlockCacheOverflow) {
+  WinHeap win_heap;
+  SimpleBlockHeap h(&win_heap, true);
+
+  // Free more blocks of a given size than the cache can hold. The overflow
+  // should be returned to the underlying heap.
+  BlockInfoSet blocks;
+  for (size_t i = 0; i < 3 * SimpleBlockHeap::kBlockCacheMaxBlocksPerBin;
+       ++i) {
+    BlockLayout layout = {};
+    BlockInfo block = {};
+    void* alloc = h.AllocateBlock(16, 0, 0, &layout);
+    ASSERT_NE(static_cast<void*>(NULL), alloc);
+    BlockInitialize(layout, alloc, false, &block);
+    blocks.insert(block);
+  }
+  BlockInfoSet::const_iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it)
+    EXPECT_TRUE(h.FreeBlock(*it));
+
+  // At most a full bin worth of blocks should be handed back out before the
+  // underlying heap has to be used again.
+  std::set<void*> reused;
+  for (size_t i = 0; i < SimpleBlockHeap::kBlockCacheMaxBlocksPerBin; ++i) {
+    BlockLayout layout = {};
+    void* alloc = h.AllocateBlock(16, 0, 0, &layout);
+    ASSERT_NE(static_cast<void*>(NULL), alloc);
+    reused.insert(alloc);
+  }
+  EXPECT_EQ(SimpleBlockHeap::kBlockCacheMaxBlocksPerBin, reused.size());
+  for (std::set<void*>::const_iterator it = reused.begin();
+       it != reused.end(); ++it) {
+    EXPECT_TRUE(win_heap.Free(*it));
+  }
+}
+
 TEST(SimpleBlockHeapTest, Lock) {
   WinHeap win_heap;
   SimpleBlockHeap h(&win_heap);
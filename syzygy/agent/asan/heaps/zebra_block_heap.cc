@@ -30,6 +30,12 @@ const size_t ZebraBlockHeap::kMaximumAllocationSize = GetPageSize();
 const size_t ZebraBlockHeap::kMaximumBlockAllocationSize =
     GetPageSize() - sizeof(BlockHeader);
 
+ZebraBlockHeap::Shard::Shard(size_t slab_count, HeapInterface* internal_heap)
+    : slab_count(slab_count),
+      free_slabs(slab_count, HeapAllocator<size_t>(internal_heap)),
+      quarantine(slab_count, HeapAllocator<size_t>(internal_heap)) {
+}
+
 ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
                                MemoryNotifierInterface* memory_notifier,
                                HeapInterface* internal_heap)
@@ -38,12 +44,11 @@ ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
       // at the end of the reserved memory.
       heap_size_(::common::AlignUp(heap_size, kSlabSize)),
       slab_count_(heap_size_ / kSlabSize),
-      slab_info_(HeapAllocator<SlabInfo>(internal_heap)),
       quarantine_ratio_(::common::kDefaultZebraBlockHeapQuarantineRatio),
-      free_slabs_(slab_count_,
-                  HeapAllocator<size_t>(internal_heap)),
-      quarantine_(slab_count_,
-                  HeapAllocator<size_t>(internal_heap)),
+      slabs_per_shard_(0),
+      shard_count_(0),
+      shards_(HeapAllocator<Shard>(internal_heap)),
+      slab_info_(HeapAllocator<SlabInfo>(internal_heap)),
       memory_notifier_(memory_notifier) {
   DCHECK_NE(reinterpret_cast<MemoryNotifierInterface*>(NULL), memory_notifier);
 
@@ -57,12 +62,29 @@ ZebraBlockHeap::ZebraBlockHeap(size_t heap_size,
   DCHECK(::common::IsAligned(heap_address_, GetPageSize()));
   memory_notifier_->NotifyFutureHeapUse(heap_address_, heap_size_);
 
+  // Split the slabs into shards of contiguous slabs, so that the metadata of
+  // different shards doesn't share cache lines. There is always at least one
+  // shard, and none of them is empty.
+  size_t max_shard_count = kMaximumShardCount;
+  if (slab_count_ < max_shard_count)
+    max_shard_count = std::max<size_t>(1, slab_count_);
+  slabs_per_shard_ = std::max<size_t>(
+      1, (slab_count_ + max_shard_count - 1) / max_shard_count);
+  shard_count_ = std::max<size_t>(
+      1, (slab_count_ + slabs_per_shard_ - 1) / slabs_per_shard_);
+  shards_.reserve(shard_count_);
+  for (size_t i = 0; i < shard_count_; ++i) {
+    size_t shard_slab_count =
+        std::min(slabs_per_shard_, slab_count_ - i * slabs_per_shard_);
+    shards_.push_back(Shard(shard_slab_count, internal_heap));
+  }
+
   // Initialize the metadata describing the state of our heap.
   slab_info_.resize(slab_count_);
   for (size_t i = 0; i < slab_count_; ++i) {
     slab_info_[i].state = kFreeSlab;
     ::memset(&slab_info_[i].info, 0, sizeof(slab_info_[i].info));
-    free_slabs_.push(i);
+    shards_[GetShardIndex(i)].free_slabs.push(i);
   }
 }
 
@@ -92,10 +114,11 @@ void* ZebraBlockHeap::Allocate(size_t bytes) {
 bool ZebraBlockHeap::Free(void* alloc) {
   if (alloc == NULL)
     return true;
-  ::common::AutoRecursiveLock lock(lock_);
   size_t slab_index = GetSlabIndex(alloc);
   if (slab_index == kInvalidSlabIndex)
     return false;
+  size_t shard_index = GetShardIndex(slab_index);
+  ::common::AutoRecursiveLock lock(shard_locks_[shard_index]);
   if (slab_info_[slab_index].info.block != alloc)
     return false;
 
@@ -109,17 +132,17 @@ bool ZebraBlockHeap::Free(void* alloc) {
   slab_info_[slab_index].state = kFreeSlab;
   ::memset(&slab_info_[slab_index].info, 0,
            sizeof(slab_info_[slab_index].info));
-  free_slabs_.push(slab_index);
+  shards_[shard_index].free_slabs.push(slab_index);
   return true;
 }
 
 bool ZebraBlockHeap::IsAllocated(const void* alloc) {
   if (alloc == NULL)
     return false;
-  ::common::AutoRecursiveLock lock(lock_);
   size_t slab_index = GetSlabIndex(alloc);
   if (slab_index == kInvalidSlabIndex)
     return false;
+  ::common::AutoRecursiveLock lock(shard_locks_[GetShardIndex(slab_index)]);
   if (slab_info_[slab_index].state == kFreeSlab)
     return false;
   if (slab_info_[slab_index].info.block != alloc)
@@ -130,10 +153,10 @@ bool ZebraBlockHeap::IsAllocated(const void* alloc) {
 size_t ZebraBlockHeap::GetAllocationSize(const void* alloc) {
   if (alloc == NULL)
     return kUnknownSize;
-  ::common::AutoRecursiveLock lock(lock_);
   size_t slab_index = GetSlabIndex(alloc);
   if (slab_index == kInvalidSlabIndex)
     return kUnknownSize;
+  ::common::AutoRecursiveLock lock(shard_locks_[GetShardIndex(slab_index)]);
   if (slab_info_[slab_index].state == kFreeSlab)
     return kUnknownSize;
   if (slab_info_[slab_index].info.block != alloc)
@@ -142,15 +165,28 @@ size_t ZebraBlockHeap::GetAllocationSize(const void* alloc) {
 }
 
 void ZebraBlockHeap::Lock() {
-  lock_.Acquire();
+  // The shard locks are always acquired in the same order to avoid
+  // deadlocks.
+  for (size_t i = 0; i < shard_count_; ++i)
+    shard_locks_[i].Acquire();
 }
 
 void ZebraBlockHeap::Unlock() {
-  lock_.Release();
+  for (size_t i = shard_count_; i > 0; --i)
+    shard_locks_[i - 1].Release();
 }
 
 bool ZebraBlockHeap::TryLock() {
-  return lock_.Try();
+  for (size_t i = 0; i < shard_count_; ++i) {
+    if (shard_locks_[i].Try())
+      continue;
+
+    // Release the locks acquired so far.
+    for (size_t j = i; j > 0; --j)
+      shard_locks_[j - 1].Release();
+    return false;
+  }
+  return true;
 }
 
 void* ZebraBlockHeap::AllocateBlock(size_t size,
@@ -213,10 +249,11 @@ bool ZebraBlockHeap::FreeBlock(const BlockInfo& block_info) {
 }
 
 bool ZebraBlockHeap::Push(const CompactBlockInfo& info) {
-  ::common::AutoRecursiveLock lock(lock_);
   size_t slab_index = GetSlabIndex(info.block);
   if (slab_index == kInvalidSlabIndex)
     return false;
+  size_t shard_index = GetShardIndex(slab_index);
+  ::common::AutoRecursiveLock lock(shard_locks_[shard_index]);
   if (slab_info_[slab_index].state != kAllocatedSlab)
     return false;
   if (::memcmp(&slab_info_[slab_index].info, &info,
@@ -224,89 +261,153 @@ bool ZebraBlockHeap::Push(const CompactBlockInfo& info) {
     return false;
   }
 
-  quarantine_.push(slab_index);
+  shards_[shard_index].quarantine.push(slab_index);
   slab_info_[slab_index].state = kQuarantinedSlab;
   return true;
 }
 
 bool ZebraBlockHeap::Pop(CompactBlockInfo* info) {
-  ::common::AutoRecursiveLock lock(lock_);
-
-  if (QuarantineInvariantIsSatisfied())
-    return false;
+  // Pop from the first shard that doesn't satisfy the invariant, starting
+  // with the one of the calling thread as it's the most likely to have just
+  // received a block.
+  size_t first_shard_index = GetThreadShardIndex();
+  for (size_t i = 0; i < shard_count_; ++i) {
+    size_t shard_index = (first_shard_index + i) % shard_count_;
+    ::common::AutoRecursiveLock lock(shard_locks_[shard_index]);
+    if (ShardQuarantineInvariantIsSatisfied(shard_index))
+      continue;
+
+    Shard& shard = shards_[shard_index];
+    size_t slab_index = shard.quarantine.front();
+    DCHECK_NE(kInvalidSlabIndex, slab_index);
+    shard.quarantine.pop();
 
-  size_t slab_index = quarantine_.front();
-  DCHECK_NE(kInvalidSlabIndex, slab_index);
-  quarantine_.pop();
+    DCHECK_EQ(kQuarantinedSlab, slab_info_[slab_index].state);
+    slab_info_[slab_index].state = kAllocatedSlab;
+    *info = slab_info_[slab_index].info;
 
-  DCHECK_EQ(kQuarantinedSlab, slab_info_[slab_index].state);
-  slab_info_[slab_index].state = kAllocatedSlab;
-  *info = slab_info_[slab_index].info;
+    return true;
+  }
 
-  return true;
+  return false;
 }
 
 void ZebraBlockHeap::Empty(ObjectVector* infos) {
-  ::common::AutoRecursiveLock lock(lock_);
-  while (!quarantine_.empty()) {
-    size_t slab_index = quarantine_.front();
-    DCHECK_NE(kInvalidSlabIndex, slab_index);
-    quarantine_.pop();
-
-    // Do not free the slab, only release it from the quarantine.
-    slab_info_[slab_index].state = kAllocatedSlab;
-    infos->push_back(slab_info_[slab_index].info);
+  for (size_t i = 0; i < shard_count_; ++i) {
+    ::common::AutoRecursiveLock lock(shard_locks_[i]);
+    Shard& shard = shards_[i];
+    while (!shard.quarantine.empty()) {
+      size_t slab_index = shard.quarantine.front();
+      DCHECK_NE(kInvalidSlabIndex, slab_index);
+      shard.quarantine.pop();
+
+      // Do not free the slab, only release it from the quarantine.
+      slab_info_[slab_index].state = kAllocatedSlab;
+      infos->push_back(slab_info_[slab_index].info);
+    }
   }
 }
 
 size_t ZebraBlockHeap::GetCount() {
-  ::common::AutoRecursiveLock lock(lock_);
-  return quarantine_.size();
+  size_t count = 0;
+  for (size_t i = 0; i < shard_count_; ++i) {
+    ::common::AutoRecursiveLock lock(shard_locks_[i]);
+    count += shards_[i].quarantine.size();
+  }
+  return count;
+}
+
+size_t ZebraBlockHeap::GetLockId(const CompactBlockInfo& info) {
+  size_t slab_index = GetSlabIndex(info.block);
+  if (slab_index == kInvalidSlabIndex)
+    return 0;
+  return GetShardIndex(slab_index);
+}
+
+void ZebraBlockHeap::Lock(size_t id) {
+  DCHECK_LT(id, shard_count_);
+  shard_locks_[id].Acquire();
+}
+
+void ZebraBlockHeap::Unlock(size_t id) {
+  DCHECK_LT(id, shard_count_);
+  shard_locks_[id].Release();
 }
 
 void ZebraBlockHeap::set_quarantine_ratio(float quarantine_ratio) {
   DCHECK_LE(0, quarantine_ratio);
   DCHECK_GE(1, quarantine_ratio);
-  ::common::AutoRecursiveLock lock(lock_);
+  Lock();
   quarantine_ratio_ = quarantine_ratio;
+  Unlock();
 }
 
 ZebraBlockHeap::SlabInfo* ZebraBlockHeap::AllocateImpl(size_t bytes) {
   if (bytes == 0 || bytes > GetPageSize())
     return NULL;
-  ::common::AutoRecursiveLock lock(lock_);
 
-  if (free_slabs_.empty())
-    return NULL;
+  // Allocate from the shard of the calling thread, and only fall back to the
+  // other shards if it's full.
+  size_t first_shard_index = GetThreadShardIndex();
+  for (size_t i = 0; i < shard_count_; ++i) {
+    size_t shard_index = (first_shard_index + i) % shard_count_;
+    ::common::AutoRecursiveLock lock(shard_locks_[shard_index]);
+    Shard& shard = shards_[shard_index];
+    if (shard.free_slabs.empty())
+      continue;
+
+    size_t slab_index = shard.free_slabs.front();
+    DCHECK_NE(kInvalidSlabIndex, slab_index);
+    shard.free_slabs.pop();
+    uint8* slab_address = GetSlabAddress(slab_index);
+    DCHECK_NE(reinterpret_cast<uint8*>(NULL), slab_address);
+
+    // Push the allocation to the end of the even page.
+    uint8* alloc = slab_address + GetPageSize() - bytes;
+    alloc = ::common::AlignDown(alloc, kShadowRatio);
+
+    // Update the slab info.
+    SlabInfo* slab_info = &slab_info_[slab_index];
+    slab_info->state = kAllocatedSlab;
+    slab_info->info.block = alloc;
+    slab_info->info.block_size = bytes;
+    slab_info->info.header_size = 0;
+    slab_info->info.trailer_size = 0;
+    slab_info->info.is_nested = false;
 
-  size_t slab_index = free_slabs_.front();
-  DCHECK_NE(kInvalidSlabIndex, slab_index);
-  free_slabs_.pop();
-  uint8* slab_address = GetSlabAddress(slab_index);
-  DCHECK_NE(reinterpret_cast<uint8*>(NULL), slab_address);
-
-  // Push the allocation to the end of the even page.
-  uint8* alloc = slab_address + GetPageSize() - bytes;
-  alloc = ::common::AlignDown(alloc, kShadowRatio);
-
-  // Update the slab info.
-  SlabInfo* slab_info = &slab_info_[slab_index];
-  slab_info->state = kAllocatedSlab;
-  slab_info->info.block = alloc;
-  slab_info->info.block_size = bytes;
-  slab_info->info.header_size = 0;
-  slab_info->info.trailer_size = 0;
-  slab_info->info.is_nested = false;
-
-  return slab_info;
+    return slab_info;
+  }
+
+  return NULL;
 }
 
 bool ZebraBlockHeap::QuarantineInvariantIsSatisfied() {
-  return quarantine_.empty() ||
-         (quarantine_.size() / static_cast<float>(slab_count_) <=
+  for (size_t i = 0; i < shard_count_; ++i) {
+    ::common::AutoRecursiveLock lock(shard_locks_[i]);
+    if (!ShardQuarantineInvariantIsSatisfied(i))
+      return false;
+  }
+  return true;
+}
+
+bool ZebraBlockHeap::ShardQuarantineInvariantIsSatisfied(size_t shard_index) {
+  DCHECK_LT(shard_index, shard_count_);
+  const Shard& shard = shards_[shard_index];
+  return shard.quarantine.empty() ||
+         (shard.quarantine.size() / static_cast<float>(shard.slab_count) <=
              quarantine_ratio_);
 }
 
+size_t ZebraBlockHeap::GetThreadShardIndex() {
+  // Thread IDs are multiples of 4, so the low bits carry no information.
+  return (::GetCurrentThreadId() >> 2) % shard_count_;
+}
+
+size_t ZebraBlockHeap::GetShardIndex(size_t slab_index) {
+  DCHECK_LT(slab_index, slab_count_);
+  return slab_index / slabs_per_shard_;
+}
+
 uint8* ZebraBlockHeap::GetSlabAddress(size_t index) {
   if (index >= slab_count_)
     return NULL;
@@ -67,6 +67,13 @@ namespace heaps {
 // |-header-|                |-body-|                            |-trailer-|
 //
 // Calling Free on a quarantined address is an invalid operation.
+//
+// To avoid serializing the allocations of all the threads on a single lock,
+// the slabs are split into up to kMaximumShardCount shards of contiguous
+// slabs. Each shard has its own lock, free list and quarantine, and threads
+// allocate from the shard picked by their thread ID, falling back to the
+// other shards when theirs is full. The quarantine invariant is enforced
+// for each shard independently.
 class ZebraBlockHeap : public BlockHeapInterface,
                        public BlockQuarantineInterface {
  public:
@@ -81,6 +88,9 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // than this will always fail a call to 'AllocateBlock'.
   static const size_t kMaximumBlockAllocationSize;
 
+  // The maximum number of shards the slabs are split into.
+  static const size_t kMaximumShardCount = 16;
+
   // Constructor.
   // @param heap_size The amount of memory reserved by the heap in bytes.
   // @param memory_notifier The MemoryNotifierInterface used to report
@@ -121,11 +131,9 @@ class ZebraBlockHeap : public BlockHeapInterface,
   virtual bool Pop(CompactBlockInfo* info);
   virtual void Empty(std::vector<CompactBlockInfo>* infos);
   virtual size_t GetCount();
-  virtual size_t GetLockId(const CompactBlockInfo& info) {
-    return 0;
-  }
-  virtual void Lock(size_t id) { }
-  virtual void Unlock(size_t id) { }
+  virtual size_t GetLockId(const CompactBlockInfo& info);
+  virtual void Lock(size_t id);
+  virtual void Unlock(size_t id);
   // @}
 
   // Get the ratio of the memory used by the quarantine.
@@ -149,14 +157,45 @@ class ZebraBlockHeap : public BlockHeapInterface,
     CompactBlockInfo info;
   };
 
+  typedef CircularQueue<size_t, HeapAllocator<size_t>> SlabIndexQueue;
+
+  // A range of contiguous slabs with its own free list and quarantine. The
+  // queues of the i-th shard are under shard_locks_[i].
+  struct Shard {
+    Shard(size_t slab_count, HeapInterface* internal_heap);
+
+    // The number of slabs belonging to this shard.
+    size_t slab_count;
+
+    // Holds the indices of the free slabs of this shard.
+    SlabIndexQueue free_slabs;
+
+    // Holds the indices of the quarantined slabs of this shard.
+    SlabIndexQueue quarantine;
+  };
+
   // Performs an allocation, and returns a pointer to the SlabInfo where the
   // allocation was made.
   SlabInfo* AllocateImpl(size_t bytes);
 
-  // Checks if the quarantine invariant is satisfied.
+  // Checks if the quarantine invariant is satisfied by all the shards.
   // @returns true if the quarantine invariant is satisfied, false otherwise.
   bool QuarantineInvariantIsSatisfied();
 
+  // Checks if the quarantine invariant is satisfied by a shard. This must be
+  // called under the lock of the shard.
+  // @param shard_index The index of the shard.
+  // @returns true if the quarantine invariant is satisfied, false otherwise.
+  bool ShardQuarantineInvariantIsSatisfied(size_t shard_index);
+
+  // @returns the index of the shard the calling thread allocates from.
+  size_t GetThreadShardIndex();
+
+  // Gives the index of the shard owning a slab.
+  // @param slab_index 0-based index of a valid slab.
+  // @returns the index of the shard owning the slab.
+  size_t GetShardIndex(size_t slab_index);
+
   // Gives the 0-based index of the slab containing 'address'.
   // @param address address.
   // @returns The 0-based index of the slab containing 'address', or
@@ -180,29 +219,34 @@ class ZebraBlockHeap : public BlockHeapInterface,
   // The total number of slabs.
   size_t slab_count_;
 
-  // The ratio [0 .. 1] of the memory used by the quarantine. Under lock_.
+  // The ratio [0 .. 1] of the memory used by the quarantine. This is only
+  // modified under all the shard locks.
   float quarantine_ratio_;
 
-  typedef CircularQueue<size_t, HeapAllocator<size_t>> SlabIndexQueue;
+  // The number of slabs of each shard. The last shard may have fewer.
+  size_t slabs_per_shard_;
+
+  // The number of shards.
+  size_t shard_count_;
 
-  // Holds the indices of free slabs. Under lock_.
-  SlabIndexQueue free_slabs_;
+  typedef std::vector<Shard, HeapAllocator<Shard>> ShardVector;
 
-  // Holds the indices of the quarantined slabs. Under lock_.
-  SlabIndexQueue quarantine_;
+  // The shards.
+  ShardVector shards_;
 
   typedef std::vector<SlabInfo,
                       HeapAllocator<SlabInfo>> SlabInfoVector;
 
-  // Holds the information related to slabs. Under lock_.
+  // Holds the information related to slabs. Each entry is under the lock of
+  // the shard owning the slab.
   SlabInfoVector slab_info_;
 
   // The interface that will be notified of internal memory use. Has its own
   // locking.
   MemoryNotifierInterface* memory_notifier_;
 
-  // The global lock for this allocator.
-  ::common::RecursiveLock lock_;
+  // The locks of the shards. Locking the heap acquires all of them, in order.
+  ::common::RecursiveLock shard_locks_[kMaximumShardCount];
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ZebraBlockHeap);
@@ -19,6 +19,8 @@
 #include <utility>
 #include <vector>
 
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/unittest_util.h"
@@ -45,8 +47,13 @@ testing::DummyHeap dummy_heap;
 
 class TestZebraBlockHeap : public ZebraBlockHeap {
  public:
+  using ZebraBlockHeap::GetShardIndex;
+  using ZebraBlockHeap::GetSlabIndex;
   using ZebraBlockHeap::QuarantineInvariantIsSatisfied;
+  using ZebraBlockHeap::ShardQuarantineInvariantIsSatisfied;
   using ZebraBlockHeap::heap_address_;
+  using ZebraBlockHeap::shard_count_;
+  using ZebraBlockHeap::shards_;
   using ZebraBlockHeap::slab_count_;
 
   static const size_t kInitialHeapSize = 8 * (1 << 20);
@@ -66,11 +73,65 @@ class TestZebraBlockHeap : public ZebraBlockHeap {
   // @returns true if the heap is full (no more allocations allowed),
   // false otherwise.
   bool IsHeapFull() {
-    // No free slabs.
-    return free_slabs_.empty();
+    // No free slabs in any shard.
+    for (size_t i = 0; i < shard_count_; ++i) {
+      if (!shards_[i].free_slabs.empty())
+        return false;
+    }
+    return true;
   }
 };
 
+// Allocates, quarantines and frees blocks in a loop, checking that no other
+// thread touches them in the meantime.
+class AllocateAndFreeRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kNumIterations = 10000;
+
+  explicit AllocateAndFreeRunner(TestZebraBlockHeap* heap) : heap_(heap) {
+    DCHECK_NE(static_cast<TestZebraBlockHeap*>(NULL), heap);
+  }
+
+  virtual void Run() OVERRIDE {
+    static const size_t kNumLiveAllocations = 16;
+    static const size_t kAllocationSize = 64;
+    uint8* allocs[kNumLiveAllocations] = {};
+    uint8 pattern = static_cast<uint8>(::GetCurrentThreadId());
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      size_t j = i % kNumLiveAllocations;
+      if (allocs[j] != NULL) {
+        // Make sure nobody else wrote to the allocation while we owned it.
+        for (size_t k = 0; k < kAllocationSize; ++k)
+          ASSERT_EQ(static_cast<uint8>(pattern + j), allocs[j][k]);
+
+        // Go through the quarantine, which may evict any block of the shard.
+        CompactBlockInfo info = {};
+        info.block = allocs[j];
+        info.block_size = kAllocationSize;
+        {
+          TestZebraBlockHeap::AutoQuarantineLock lock(heap_, info);
+          ASSERT_TRUE(heap_->Push(info));
+        }
+        CompactBlockInfo popped = {};
+        while (heap_->Pop(&popped))
+          ASSERT_TRUE(heap_->Free(popped.block));
+      }
+
+      allocs[j] = reinterpret_cast<uint8*>(heap_->Allocate(kAllocationSize));
+      ASSERT_TRUE(allocs[j] != NULL);
+      ::memset(allocs[j], static_cast<uint8>(pattern + j), kAllocationSize);
+    }
+
+    for (size_t j = 0; j < kNumLiveAllocations; ++j)
+      ASSERT_TRUE(heap_->Free(allocs[j]));
+  }
+
+ private:
+  TestZebraBlockHeap* heap_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocateAndFreeRunner);
+};
+
 }  // namespace
 
 TEST(ZebraBlockHeapTest, GetHeapTypeIsValid) {
@@ -445,6 +506,101 @@ TEST(ZebraBlockHeapTest, PushPopInvariant) {
     EXPECT_TRUE(h.FreeBlock(blocks[i]));
 }
 
+TEST(ZebraBlockHeapTest, SlabsAreSharded) {
+  TestZebraBlockHeap h;
+  ASSERT_LT(1u, h.shard_count_);
+  EXPECT_GE(ZebraBlockHeap::kMaximumShardCount, h.shard_count_);
+
+  // The shards cover all the slabs.
+  size_t slab_count = 0;
+  for (size_t i = 0; i < h.shard_count_; ++i) {
+    EXPECT_LT(0u, h.shards_[i].slab_count);
+    EXPECT_EQ(h.shards_[i].slab_count, h.shards_[i].free_slabs.size());
+    slab_count += h.shards_[i].slab_count;
+  }
+  EXPECT_EQ(h.slab_count_, slab_count);
+
+  // Slabs are assigned to the shards in contiguous ranges.
+  EXPECT_EQ(0u, h.GetShardIndex(0));
+  EXPECT_EQ(h.shard_count_ - 1, h.GetShardIndex(h.slab_count_ - 1));
+  for (size_t i = 1; i < h.slab_count_; ++i) {
+    size_t shard_index = h.GetShardIndex(i);
+    size_t previous_shard_index = h.GetShardIndex(i - 1);
+    EXPECT_TRUE(shard_index == previous_shard_index ||
+                shard_index == previous_shard_index + 1);
+  }
+
+  // The lock ID of a block is the shard owning it.
+  void* alloc = h.Allocate(10);
+  ASSERT_NE(reinterpret_cast<void*>(NULL), alloc);
+  CompactBlockInfo info = {};
+  info.block = reinterpret_cast<uint8*>(alloc);
+  EXPECT_EQ(h.GetShardIndex(h.GetSlabIndex(alloc)), h.GetLockId(info));
+  EXPECT_TRUE(h.Free(alloc));
+}
+
+TEST(ZebraBlockHeapTest, QuarantineInvariantIsPerShard) {
+  TestZebraBlockHeap h;
+  ASSERT_LT(1u, h.shard_count_);
+
+  // Fill the heap, so that every shard is used.
+  std::vector<void*> allocs;
+  for (size_t i = 0; i < h.slab_count_; ++i) {
+    void* alloc = h.Allocate(0xFF);
+    ASSERT_NE(reinterpret_cast<void*>(NULL), alloc);
+    allocs.push_back(alloc);
+  }
+  EXPECT_TRUE(h.IsHeapFull());
+
+  // Quarantine all the blocks of the first shard only.
+  for (size_t i = 0; i < allocs.size(); ++i) {
+    if (h.GetShardIndex(h.GetSlabIndex(allocs[i])) != 0)
+      continue;
+    CompactBlockInfo info = {};
+    info.block = reinterpret_cast<uint8*>(allocs[i]);
+    info.block_size = 0xFF;
+    EXPECT_TRUE(h.Push(info));
+  }
+  EXPECT_EQ(h.shards_[0].slab_count, h.GetCount());
+  EXPECT_FALSE(h.ShardQuarantineInvariantIsSatisfied(0));
+  for (size_t i = 1; i < h.shard_count_; ++i)
+    EXPECT_TRUE(h.ShardQuarantineInvariantIsSatisfied(i));
+  EXPECT_FALSE(h.QuarantineInvariantIsSatisfied());
+
+  // Only the blocks of the first shard get popped, until its own invariant is
+  // satisfied.
+  CompactBlockInfo info = {};
+  while (h.Pop(&info))
+    EXPECT_EQ(0u, h.GetShardIndex(h.GetSlabIndex(info.block)));
+  EXPECT_TRUE(h.ShardQuarantineInvariantIsSatisfied(0));
+  EXPECT_TRUE(h.QuarantineInvariantIsSatisfied());
+  EXPECT_LT(0u, h.GetCount());
+
+  std::vector<CompactBlockInfo> objects;
+  h.Empty(&objects);
+  EXPECT_EQ(0u, h.GetCount());
+  for (size_t i = 0; i < allocs.size(); ++i)
+    EXPECT_TRUE(h.Free(allocs[i]));
+}
+
+TEST(ZebraBlockHeapTest, ConcurrentAllocsAndFrees) {
+  TestZebraBlockHeap h;
+  AllocateAndFreeRunner runner(&h);
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.push_back(
+        new base::DelegateSimpleThread(&runner, "AllocateAndFreeRunner"));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  std::vector<CompactBlockInfo> objects;
+  h.Empty(&objects);
+  for (size_t i = 0; i < objects.size(); ++i)
+    EXPECT_TRUE(h.Free(objects[i].block));
+}
+
 TEST(ZebraBlockHeapTest, MemoryNotifierIsCalled) {
   testing::MockMemoryNotifier mock_notifier;
 
@@ -36,6 +36,46 @@ void CheckMemoryAccess(void* location,
     ReportBadMemoryAccess(location, access_mode, access_size, context);
 }
 
+// Determines if all the memory accessed by a string instruction on one of its
+// operands is accessible. This checks the whole range in bulk via the shadow
+// memory.
+// @param location The initial value of the operand pointer.
+// @param access_mode The mode of the accesses.
+// @param length The number of memory accesses.
+// @param access_size The size of each the access in byte.
+// @param increment The increment to move the operand after each access.
+// @returns true if the whole range is accessible or if the operand isn't
+//     accessed, false if the range contains an invalid byte or can't be
+//     checked in bulk.
+bool StringAccessRangeIsAccessible(const uint8* location,
+                                   AccessMode access_mode,
+                                   uint32 length,
+                                   size_t access_size,
+                                   int32 increment) {
+  if (access_mode == agent::asan::ASAN_UNKNOWN_ACCESS)
+    return true;
+
+  // Leave the ranges that don't fit in the shadow memory to the per-access
+  // checks.
+  uintptr_t start = reinterpret_cast<uintptr_t>(location);
+  if (length > Shadow::kAddressUpperBound / access_size)
+    return false;
+  size_t span = (length - 1) * access_size;
+  if (increment < 0) {
+    if (span > start)
+      return false;
+    start -= span;
+  }
+  size_t size = span + access_size;
+  if (start >= Shadow::kAddressUpperBound ||
+      size > Shadow::kAddressUpperBound - start) {
+    return false;
+  }
+
+  return Shadow::IsRangeAccessible(reinterpret_cast<const void*>(start),
+                                   size);
+}
+
 // Check if the memory accesses done by a string instructions are valid.
 // @param dst The destination memory address of the access.
 // @param dst_access_mode The destination mode of the access.
@@ -51,6 +91,17 @@ void CheckStringsMemoryAccesses(
     uint8* src, AccessMode src_access_mode,
     uint32 length, size_t access_size, int32 increment, bool compare,
     const AsanContext& context) {
+  // Repeated instructions are first checked in bulk. The individual accesses
+  // only need to be inspected when this finds an invalid byte, in order to
+  // report the first bad access and to honour the early exit of repz cmps.
+  if (length > 1 &&
+      StringAccessRangeIsAccessible(src, src_access_mode, length, access_size,
+                                    increment) &&
+      StringAccessRangeIsAccessible(dst, dst_access_mode, length, access_size,
+                                    increment)) {
+    return;
+  }
+
   int32 offset = 0;
 
   for (uint32 i = 0; i < length; ++i) {
@@ -94,6 +145,23 @@ void CheckStringsMemoryAccesses(
   }
 }
 
+// Check if a range of memory is accessible and report an error on the first
+// bad byte.
+// @param location The first byte of the range.
+// @param access_mode The mode of the accesses in the range.
+// @param size The size of the range, in bytes.
+// @param context The registers context of the access.
+void CheckMemoryRangeAccess(const uint8* location,
+                            AccessMode access_mode,
+                            size_t size,
+                            const AsanContext& context) {
+  const void* bad_location = Shadow::FindFirstPoisonedByte(location, size);
+  if (bad_location != NULL) {
+    ReportBadMemoryAccess(const_cast<void*>(bad_location), access_mode, size,
+                          context);
+  }
+}
+
 }  // namespace asan
 }  // namespace agent
 
@@ -127,6 +195,7 @@ void CheckStringsMemoryAccesses(
 //     - Checks if the address we're trying to access is signed, if so this mean
 //         that this is an access to the upper region of the memory (over the
 //         2GB limit) and we should report this as an invalid wild access.
+//     - Adds the base address of the shadow memory to the shadow index.
 //     - Checks for zero shadow for this memory location. We use the cmp
 //         instruction so it'll set the sign flag if the upper bit of the shadow
 //         value of this memory location is set to 1.
@@ -136,7 +205,8 @@ void CheckStringsMemoryAccesses(
     __asm push edx  \
     __asm sar edx, 3  \
     __asm js report_failure  \
-    __asm movzx edx, BYTE PTR[edx + Shadow::shadow_]  \
+    __asm add edx, DWORD PTR[Shadow::shadow_]  \
+    __asm movzx edx, BYTE PTR[edx]  \
     __asm cmp dl, 0  \
     __asm jnz check_access_slow  \
     __asm add esp, 4
@@ -285,6 +355,84 @@ ASAN_MEM_INTERCEPT_FUNCTIONS(ASAN_CHECK_FUNCTION_NO_FLAGS)
 #undef ASAN_SLOW_PATH
 #undef ASAN_ERROR_PATH
 
+// Generates the asan check range functions. The name of the generated method
+// will be asan_check_range_(@p access_mode_str)().
+// The start of the range is expected in EDX, and the caller pushes the size of
+// the range and the original value of EDX on the stack.
+// @param access_mode_str The string representing the access mode (read_access
+//     or write_access).
+// @param access_mode_value The internal value representing this kind of access.
+// @note Calling this function doesn't alter any register.
+#define ASAN_CHECK_RANGE_FUNCTION(access_mode_str, access_mode_value)  \
+  extern "C" __declspec(naked)  \
+      void asan_check_range_ ## access_mode_str ## () {  \
+    __asm {  \
+      __asm pushfd  \
+      __asm push eax  \
+      __asm push ecx  \
+      /* Compute the address of the last byte of the range in EAX. */  \
+      __asm mov eax, edx  \
+      __asm add eax, DWORD PTR[esp + 20]  \
+      __asm dec eax  \
+      /* Let the slow path deal with the upper half of the address space. */  \
+      __asm mov ecx, edx  \
+      __asm or ecx, eax  \
+      __asm js check_range_slow  \
+      /* Check that the shadow bytes of the range are all zero. */  \
+      __asm mov ecx, edx  \
+      __asm shr ecx, 3  \
+      __asm shr eax, 3  \
+      __asm add ecx, DWORD PTR[Shadow::shadow_]  \
+      __asm add eax, DWORD PTR[Shadow::shadow_]  \
+    __asm check_range_loop:  \
+      __asm cmp BYTE PTR[ecx], 0  \
+      __asm jnz check_range_slow  \
+      __asm inc ecx  \
+      __asm cmp ecx, eax  \
+      __asm jbe check_range_loop  \
+      __asm pop ecx  \
+      __asm pop eax  \
+      __asm popfd  \
+      /* Restore original EDX. */  \
+      __asm mov edx, DWORD PTR[esp + 4]  \
+      __asm ret 8  \
+    __asm check_range_slow:  \
+      __asm pop ecx  \
+      __asm pop eax  \
+      __asm popfd  \
+      /* Restore original value of EDX, and put the range on stack. */  \
+      __asm xchg edx, DWORD PTR[esp + 4]  \
+      /* Create an Asan registers context on the stack. */  \
+      __asm pushfd  \
+      __asm pushad  \
+      /* Fix the original value of ESP in the Asan registers context. */  \
+      /* Removing 16 bytes (e.g. EFLAGS / EIP / range start / range size). */  \
+      __asm add DWORD PTR[esp + 12], 16  \
+      /* Push ARG4: the address of Asan context on stack. */  \
+      __asm push esp  \
+      /* Push ARG3: the size of the range. */  \
+      __asm push DWORD PTR[esp + 48]  \
+      /* Push ARG2: the access type. */  \
+      __asm push access_mode_value  \
+      /* Push ARG1: the start of the range. */  \
+      __asm push DWORD PTR[esp + 52]  \
+      __asm call agent::asan::CheckMemoryRangeAccess  \
+      /* Remove 4 x ARG on stack. */  \
+      __asm add esp, 16  \
+      /* Restore original registers. */  \
+      __asm popad  \
+      __asm popfd  \
+      /* Return and remove the range on stack. */  \
+      __asm ret 8  \
+    }  \
+  }
+
+// Generate the range check functions.
+ASAN_CHECK_RANGE_FUNCTION(read_access, AsanReadAccess)
+ASAN_CHECK_RANGE_FUNCTION(write_access, AsanWriteAccess)
+
+#undef ASAN_CHECK_RANGE_FUNCTION
+
 // Generates the asan check access functions for a string instruction.
 // The name of the generated method will be
 // asan_check_(@p prefix)(@p access_size)_byte_(@p inst)_access().
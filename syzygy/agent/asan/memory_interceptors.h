@@ -83,6 +83,11 @@ ASAN_STRING_INTERCEPT_FUNCTIONS(DECLARE_STRING_INTERCEPT_FUNCTIONS)
 
 #undef DECLARE_STRING_INTERCEPT_FUNCTIONS
 
+// Declare the range check functions. They expect the start of the range in EDX,
+// and the original value of EDX and the size of the range on the stack.
+void asan_check_range_read_access();
+void asan_check_range_write_access();
+
 }
 
 #endif  // SYZYGY_AGENT_ASAN_MEMORY_INTERCEPTORS_H_
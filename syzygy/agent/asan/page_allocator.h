@@ -26,6 +26,8 @@
 #ifndef SYZYGY_AGENT_ASAN_PAGE_ALLOCATOR_H_
 #define SYZYGY_AGENT_ASAN_PAGE_ALLOCATOR_H_
 
+#include <windows.h>
+
 #include "base/basictypes.h"
 #include "base/synchronization/lock.h"
 
@@ -36,6 +38,53 @@ namespace asan {
 struct PageAllocatorStatistics;
 template<bool kKeepStats> struct PageAllocatorStatisticsHelper;
 
+// A lock-free stack of groups of freed objects, linked through their first
+// pointer-sized bytes. The head of the stack pairs the top pointer with a tag
+// that is bumped on every update, so that a pop racing with a pop and a push of
+// the same group (the ABA problem) fails its compare-and-swap rather than
+// corrupting the stack. Popping may read the link of a group that has just
+// been handed out, which is fine as the memory of a PageAllocator is never
+// returned to the OS while it is alive.
+class PageAllocatorFreeList {
+ public:
+  PageAllocatorFreeList();
+
+  // Pushes a group of objects.
+  // @param object The group of objects to push.
+  void Push(uint8* object);
+
+  // Pushes a chain of groups, already linked together.
+  // @param first The first group of the chain.
+  // @param last The last group of the chain.
+  void PushChain(uint8* first, uint8* last);
+
+  // Pops a group of objects.
+  // @returns the popped group, or NULL if the stack is empty.
+  uint8* Pop();
+
+  // Atomically detaches the whole stack.
+  // @returns the chain of groups that were on the stack, or NULL.
+  uint8* Flush();
+
+  // @returns the group on top of the stack. This is racy, and is only meant
+  //     as a hint.
+  uint8* top() const { return head_.top; }
+
+ private:
+  union Head {
+    struct {
+      uint8* top;
+      uint32 tag;
+    };
+    volatile LONGLONG value;
+  };
+
+  // This needs 8-byte alignment to be updated atomically.
+  __declspec(align(8)) Head head_;
+
+  DISALLOW_COPY_AND_ASSIGN(PageAllocatorFreeList);
+};
+
 // An untyped PageAllocator. Thread safety is provided by this object.
 // @tparam kObjectSize The size of objects returned by the allocator,
 //     in bytes. Objects will be tightly packed so any alignment constraints
@@ -94,7 +143,9 @@ class PageAllocator {
   //     specified size class will be checked.
   // @returns true if the given object is the first object in a range that was
   //     freed by the allocator.
-  // @note Handles locking, so no locks must already be held.
+  // @note The inspected free lists are briefly detached while they are walked,
+  //     so concurrent allocations may miss the objects they hold and carve new
+  //     ones instead. This is only meant for debugging and testing.
   bool Freed(const void* object, size_t count);
 
   // Returns current statistics. If kKeepStats is false this is a noop and
@@ -106,7 +157,7 @@ class PageAllocator {
   // Pops the top item from the given free list.
   // @param count The size class.
   // @returns a pointer to the popped item, NULL if there was none.
-  // @note Handles locking, so no free_lock_ should be already held.
+  // @note This is lock-free.
   uint8* FreePop(size_t count);
 
   // Pushes the given object to the specified free list. Directives as to
@@ -116,13 +167,15 @@ class PageAllocator {
   // @param count The number of objects to free.
   // @param decr_alloc_groups If true then decrements allocated_groups.
   // @param decr_alloc_objects If true then decrements allocated_object.
-  // @note Handles locking, so no free_lock_ should be already held.
+  // @note This is lock-free.
   void FreePush(void* object, size_t count,
                 bool decr_alloc_groups, bool decr_alloc_objects);
 
   // Reserves a new page of objects, modifying current_page_ and
   // current_object_. Any remaining unallocated objects are stuffed into the
   // appropriate freed list. There may be no more than kMaxObjectCount of them.
+  // The page is taken from the current chunk, and a new chunk is allocated
+  // from the OS only when that one is exhausted.
   // @returns true if the allocation was successful, false otherwise.
   // @note Assumes the lock_ has already been acquired.
   bool AllocatePageLocked();
@@ -133,6 +186,15 @@ class PageAllocator {
   size_t page_size_;
   size_t objects_per_page_;
 
+  // The size of the chunks of pages allocated from the OS at once. This is a
+  // multiple of page_size_. Initialized in the constructor.
+  size_t chunk_size_;
+
+  // The next page to be handed out of the current chunk, and the end of that
+  // chunk. Under lock_.
+  uint8* next_chunk_page_;
+  uint8* end_chunk_;
+
   // The currently active page of objects. Under lock_.
   uint8* current_page_;
 
@@ -145,12 +207,8 @@ class PageAllocator {
   // pointer. Under lock_.
   uint8* end_object_;
 
-  // A singly linked list of freed objects, one per possible size category.
-  // These are under the corresponding free_lock_.
-  uint8* free_[kMaxObjectCount];
-
-  // Locks for the freed lists. This keeps contention down while freeing.
-  base::Lock free_lock_[kMaxObjectCount];
+  // A lock-free stack of freed objects, one per possible size category.
+  PageAllocatorFreeList free_[kMaxObjectCount];
 
   // The global lock for the allocator.
   base::Lock lock_;
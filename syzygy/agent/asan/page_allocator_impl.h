@@ -29,6 +29,71 @@
 namespace agent {
 namespace asan {
 
+inline PageAllocatorFreeList::PageAllocatorFreeList() {
+  COMPILE_ASSERT(sizeof(Head) == sizeof(LONGLONG), head_must_be_64_bits);
+  head_.top = NULL;
+  head_.tag = 0;
+}
+
+inline void PageAllocatorFreeList::Push(uint8* object) {
+  PushChain(object, object);
+}
+
+inline void PageAllocatorFreeList::PushChain(uint8* first, uint8* last) {
+  DCHECK_NE(static_cast<uint8*>(NULL), first);
+  DCHECK_NE(static_cast<uint8*>(NULL), last);
+
+  // A torn read of the head simply fails the compare-and-swap.
+  Head old_head;
+  old_head.value = head_.value;
+  while (true) {
+    *reinterpret_cast<uint8**>(last) = old_head.top;
+    Head new_head;
+    new_head.top = first;
+    new_head.tag = old_head.tag + 1;
+    LONGLONG value = ::InterlockedCompareExchange64(
+        &head_.value, new_head.value, old_head.value);
+    if (value == old_head.value)
+      return;
+    old_head.value = value;
+  }
+}
+
+inline uint8* PageAllocatorFreeList::Pop() {
+  Head old_head;
+  old_head.value = head_.value;
+  while (old_head.top != NULL) {
+    // The top group may be popped and handed out concurrently, in which case
+    // this reads garbage. The tag then guarantees that the compare-and-swap
+    // fails.
+    Head new_head;
+    new_head.top = *reinterpret_cast<uint8* volatile*>(old_head.top);
+    new_head.tag = old_head.tag + 1;
+    LONGLONG value = ::InterlockedCompareExchange64(
+        &head_.value, new_head.value, old_head.value);
+    if (value == old_head.value)
+      return old_head.top;
+    old_head.value = value;
+  }
+  return NULL;
+}
+
+inline uint8* PageAllocatorFreeList::Flush() {
+  Head old_head;
+  old_head.value = head_.value;
+  while (old_head.top != NULL) {
+    Head new_head;
+    new_head.top = NULL;
+    new_head.tag = old_head.tag + 1;
+    LONGLONG value = ::InterlockedCompareExchange64(
+        &head_.value, new_head.value, old_head.value);
+    if (value == old_head.value)
+      return old_head.top;
+    old_head.value = value;
+  }
+  return NULL;
+}
+
 // Empty statistics helper.
 template<> struct PageAllocatorStatisticsHelper<false> {
   void Lock() { }
@@ -76,7 +141,8 @@ template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
          bool kKeepStats>
 PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 PageAllocator()
-    : current_page_(NULL), current_object_(NULL), end_object_(NULL) {
+    : next_chunk_page_(NULL), end_chunk_(NULL), current_page_(NULL),
+      current_object_(NULL), end_object_(NULL) {
   COMPILE_ASSERT(kObjectSize >= sizeof(uintptr_t), object_size_too_small);
 
   // There needs to be at least one object per page, and extra bytes for a
@@ -88,20 +154,27 @@ PageAllocator()
 
   objects_per_page_ = (page_size_ - sizeof(void*)) / kObjectSize;
 
-  // Clear the freelists.
-  ::memset(free_, 0, sizeof(free_));
+  // Carve as many pages as fit in a reservation of the OS allocation
+  // granularity.
+  chunk_size_ = std::max(page_size_,
+      ::common::AlignDown(agent::asan::GetAllocationGranularity(), page_size_));
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
          bool kKeepStats>
 PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 ~PageAllocator() {
-  // Returns all pages to the OS.
+  // Returns all chunks to the OS. The pages are linked from the most recent
+  // to the oldest one, and a chunk starts with its oldest page, so a chunk is
+  // only released once all of its pages have been visited.
   uint8* page = current_page_;
   while (page) {
     uint8* prev = page + page_size_ - sizeof(void*);
     uint8* next_page = *reinterpret_cast<uint8**>(prev);
-    CHECK_EQ(TRUE, ::VirtualFree(page, 0, MEM_RELEASE));
+    MEMORY_BASIC_INFORMATION info = {};
+    CHECK_NE(0u, ::VirtualQuery(page, &info, sizeof(info)));
+    if (info.AllocationBase == page)
+      CHECK_EQ(TRUE, ::VirtualFree(page, 0, MEM_RELEASE));
     page = next_page;
   }
 }
@@ -142,9 +215,10 @@ Allocate(size_t count, size_t* received) {
   // first one that's big enough, and stuff the leftover objects into another
   // freed list.
   for (size_t n = count; n <= kMaxObjectCount; ++n) {
-    // This is racy and can end up lying to us. However, it's faster to first
-    // check this outside of the lock. We do this properly afterwards.
-    if (free_[n - 1] == NULL)
+    // This is racy and can end up lying to us. However, it's cheaper to first
+    // check this without touching the cache line of the list head
+    // exclusively. We do this properly afterwards.
+    if (free_[n - 1].top() == NULL)
       continue;
 
     // Unlink the objects from the free list of size n.
@@ -276,22 +350,28 @@ Freed(const void* object, size_t count) {
   }
 
   // Iterate over the applicable size classes.
-  for (size_t n = n_min; n <= n_max; ++n) {
-    base::AutoLock lock(free_lock_[n - 1]);
-
-    // Walk the list for this size class.
-    uint8* free = free_[n - 1];
-    while (free) {
-      if (object == free)
-        return true;
+  bool found = false;
+  for (size_t n = n_min; n <= n_max && !found; ++n) {
+    // Detach the list for this size class, so that it can be walked safely,
+    // and put it back afterwards.
+    uint8* first = free_[n - 1].Flush();
+    if (first == NULL)
+      continue;
 
-      // Jump to the next freed object in this size class.
-      free = *reinterpret_cast<uint8**>(free);
+    uint8* last = first;
+    while (true) {
+      if (object == last)
+        found = true;
+      uint8* next = *reinterpret_cast<uint8**>(last);
+      if (next == NULL)
+        break;
+      last = next;
     }
+
+    free_[n - 1].PushChain(first, last);
   }
 
-  // The freed objects have been exhausted and no match was found.
-  return false;
+  return found;
 }
 
 template<size_t kObjectSize, size_t kMaxObjectCount, size_t kPageSize,
@@ -312,13 +392,9 @@ uint8* PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
 
-  uint8* object = NULL;
-  {
-    base::AutoLock lock(free_lock_[count - 1]);
-    object = free_[count - 1];
-    if (object)
-      free_[count - 1] = *reinterpret_cast<uint8**>(object);
-  }
+  uint8* object = free_[count - 1].Pop();
+  if (object == NULL)
+    return NULL;
 
   // Update statistics.
   stats_.Lock();
@@ -338,11 +414,7 @@ void PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
   DCHECK_LT(0u, count);
   DCHECK_GE(kMaxObjectCount, count);
 
-  {
-    base::AutoLock lock(free_lock_[count - 1]);
-    *reinterpret_cast<uint8**>(object) = free_[count - 1];
-    free_[count - 1] = reinterpret_cast<uint8*>(object);
-  }
+  free_[count - 1].Push(reinterpret_cast<uint8*>(object));
 
   // Update statistics.
   stats_.Lock();
@@ -364,8 +436,6 @@ bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
 
   // If there are remaining objects stuff them into the appropriately sized
   // free list.
-  // NOTE: If this is a point of contention it could be moved to be outside
-  //     the scoped of lock_.
   if (current_object_ < end_object_) {
     size_t n = reinterpret_cast<uint8*>(end_object_) -
         reinterpret_cast<uint8*>(current_object_);
@@ -377,10 +447,18 @@ bool PageAllocator<kObjectSize, kMaxObjectCount, kPageSize, kKeepStats>::
       FreePush(current_object_, n, false, false);
   }
 
-  uint8* page = reinterpret_cast<uint8*>(
-      ::VirtualAlloc(NULL, page_size_, MEM_COMMIT, PAGE_READWRITE));
-  if (page == NULL)
-    return false;
+  // Start a new chunk if the current one is exhausted.
+  if (next_chunk_page_ == end_chunk_) {
+    uint8* chunk = reinterpret_cast<uint8*>(::VirtualAlloc(
+        NULL, chunk_size_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (chunk == NULL)
+      return false;
+    next_chunk_page_ = chunk;
+    end_chunk_ = chunk + chunk_size_;
+  }
+
+  uint8* page = next_chunk_page_;
+  next_chunk_page_ += page_size_;
 
   uint8* prev = page + page_size_ - sizeof(void*);
   end_object_ = ::common::AlignDown(prev, kObjectSize);
@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/page_allocator.h"
 
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 
 namespace agent {
@@ -48,7 +50,7 @@ class TestPageAllocator
 
     size_t free_objects = 0;
     for (size_t n = n_min; n <= n_max; ++n) {
-      uint8* free = free_[n - 1];
+      uint8* free = free_[n - 1].top();
       while (free) {
         free_objects += n;
         free = *reinterpret_cast<uint8**>(free);
@@ -71,6 +73,7 @@ class TestPageAllocator
   using Super::current_object_;
   using Super::end_object_;
   using Super::free_;
+  using Super::chunk_size_;
 };
 
 template<typename ObjectType,
@@ -87,6 +90,48 @@ class TestTypedPageAllocator
   }
 };
 
+// Allocates and frees objects of various sizes in a loop.
+template<typename PageAllocatorType>
+class AllocateAndFreeRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kNumIterations = 10000;
+
+  explicit AllocateAndFreeRunner(PageAllocatorType* page_allocator)
+      : page_allocator_(page_allocator) {
+    DCHECK(page_allocator != NULL);
+  }
+
+  virtual void Run() OVERRIDE {
+    static const size_t kNumLiveAllocations = 16;
+    uint8* allocs[kNumLiveAllocations] = {};
+    size_t counts[kNumLiveAllocations] = {};
+    uint8 pattern = static_cast<uint8>(::GetCurrentThreadId());
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      size_t j = i % kNumLiveAllocations;
+      if (allocs[j] != NULL) {
+        // Make sure nobody else wrote to the objects while we owned them.
+        for (size_t k = 0; k < counts[j] * 16; ++k)
+          ASSERT_EQ(static_cast<uint8>(pattern + j), allocs[j][k]);
+        page_allocator_->Free(allocs[j], counts[j]);
+      }
+
+      counts[j] = (i % 10) + 1;
+      allocs[j] = reinterpret_cast<uint8*>(
+          page_allocator_->Allocate(counts[j]));
+      ASSERT_TRUE(allocs[j] != NULL);
+      ::memset(allocs[j], static_cast<uint8>(pattern + j), counts[j] * 16);
+    }
+
+    for (size_t j = 0; j < kNumLiveAllocations; ++j)
+      page_allocator_->Free(allocs[j], counts[j]);
+  }
+
+ private:
+  PageAllocatorType* page_allocator_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocateAndFreeRunner);
+};
+
 // There are 256 16-byte objects in a 4KB page, so we should get 255 objects.
 typedef TestPageAllocator<16, 1, 4096> TestPageAllocator255;
 typedef TestPageAllocator<16, 10, 4096> TestPageAllocatorMulti255;
@@ -100,7 +145,7 @@ TEST(PageAllocatorTest, Constructor) {
   EXPECT_EQ(255, pa.objects_per_page_);
   EXPECT_TRUE(pa.current_page_ == NULL);
   EXPECT_TRUE(pa.current_object_ == NULL);
-  EXPECT_TRUE(pa.free_[0] == NULL);
+  EXPECT_TRUE(pa.free_[0].top() == NULL);
 
   TestPageAllocatorMulti255 mpa;
   EXPECT_EQ(4096, mpa.page_size_);
@@ -108,7 +153,7 @@ TEST(PageAllocatorTest, Constructor) {
   EXPECT_TRUE(mpa.current_page_ == NULL);
   EXPECT_TRUE(mpa.current_object_ == NULL);
   for (size_t i = 0; i < 10; ++i)
-    EXPECT_TRUE(mpa.free_[i] == NULL);
+    EXPECT_TRUE(mpa.free_[i].top() == NULL);
 }
 
 TEST(PageAllocatorTest, AllocatePage) {
@@ -157,6 +202,77 @@ TEST(PageAllocatorTest, SuccessiveSingleAllocations) {
   EXPECT_EQ(current_page, *reinterpret_cast<void**>(prev));
 }
 
+TEST(PageAllocatorTest, PagesAreCarvedFromChunks) {
+  TestPageAllocator255 pa;
+  EXPECT_EQ(0u, pa.chunk_size_ % pa.page_size_);
+  size_t pages_per_chunk = pa.chunk_size_ / pa.page_size_;
+
+  // Successive pages of the same chunk are contiguous.
+  pa.AllocatePage();
+  for (size_t i = 1; i < pages_per_chunk; ++i) {
+    uint8* previous_page = pa.current_page_;
+    pa.AllocatePage();
+    EXPECT_EQ(previous_page + pa.page_size_, pa.current_page_);
+  }
+
+  // The next page comes from a new chunk.
+  pa.AllocatePage();
+  EXPECT_EQ(pages_per_chunk + 1, pa.stats().page_count);
+}
+
+TEST(PageAllocatorTest, FreeList) {
+  uint8* objects[3] = {};
+  uint8 storage[3][sizeof(void*)] = {};
+  for (size_t i = 0; i < arraysize(objects); ++i)
+    objects[i] = storage[i];
+
+  PageAllocatorFreeList free_list;
+  EXPECT_TRUE(free_list.top() == NULL);
+  EXPECT_TRUE(free_list.Pop() == NULL);
+  EXPECT_TRUE(free_list.Flush() == NULL);
+
+  free_list.Push(objects[0]);
+  free_list.Push(objects[1]);
+  EXPECT_EQ(objects[1], free_list.top());
+  EXPECT_EQ(objects[1], free_list.Pop());
+  EXPECT_EQ(objects[0], free_list.Pop());
+  EXPECT_TRUE(free_list.Pop() == NULL);
+
+  // Flush the stack and put it back on top of another object.
+  free_list.Push(objects[0]);
+  free_list.Push(objects[1]);
+  uint8* first = free_list.Flush();
+  EXPECT_EQ(objects[1], first);
+  EXPECT_TRUE(free_list.top() == NULL);
+  free_list.Push(objects[2]);
+  free_list.PushChain(first, objects[0]);
+  EXPECT_EQ(objects[1], free_list.Pop());
+  EXPECT_EQ(objects[0], free_list.Pop());
+  EXPECT_EQ(objects[2], free_list.Pop());
+  EXPECT_TRUE(free_list.Pop() == NULL);
+}
+
+TEST(PageAllocatorTest, ConcurrentAllocsAndFrees) {
+  typedef TestPageAllocator<16, 10, 4096> TestPageAllocatorType;
+  TestPageAllocatorType pa;
+
+  static const size_t kNumThreads = 8;
+  AllocateAndFreeRunner<TestPageAllocatorType> runner(&pa);
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    threads.push_back(
+        new base::DelegateSimpleThread(&runner, "AllocateAndFreeRunner"));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < kNumThreads; ++i)
+    threads[i]->Join();
+
+  // Everything has been returned.
+  EXPECT_EQ(0u, pa.stats().allocated_groups);
+  EXPECT_EQ(0u, pa.stats().allocated_objects);
+  EXPECT_EQ(pa.FreeObjects(0), pa.stats().freed_objects);
+}
+
 TEST(PageAllocatorTest, SingleStatsTest) {
   TestPageAllocator255 pa;
 
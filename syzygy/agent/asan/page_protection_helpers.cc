@@ -14,9 +14,49 @@
 
 #include "syzygy/agent/asan/page_protection_helpers.h"
 
+#include <algorithm>
+
 namespace agent {
 namespace asan {
 
+namespace {
+
+// @returns true if any of the pages in the given range is marked as protected
+//     in the shadow memory.
+bool AnyPageIsProtected(const uint8* pages, size_t pages_size) {
+  for (size_t i = 0; i < pages_size; i += GetPageSize()) {
+    if (Shadow::PageIsProtected(pages + i))
+      return true;
+  }
+  return false;
+}
+
+// @returns true if all of the pages in the given range are marked as
+//     protected in the shadow memory.
+bool AllPagesAreProtected(const uint8* pages, size_t pages_size) {
+  for (size_t i = 0; i < pages_size; i += GetPageSize()) {
+    if (!Shadow::PageIsProtected(pages + i))
+      return false;
+  }
+  return true;
+}
+
+// Sets the protection of a range of pages, and updates the shadow memory to
+// reflect it.
+// @returns true on success, false otherwise.
+bool ProtectPages(uint8* pages, size_t pages_size, DWORD protection) {
+  DWORD old_protection = 0;
+  if (!::VirtualProtect(pages, pages_size, protection, &old_protection))
+    return false;
+  if (protection == PAGE_NOACCESS)
+    Shadow::MarkPagesProtected(pages, pages_size);
+  else
+    Shadow::MarkPagesUnprotected(pages, pages_size);
+  return true;
+}
+
+}  // namespace
+
 // TODO(chrisha): Move the page protections bits out of the shadow to an entire
 //     class that lives here. Or move all of this to shadow.
 
@@ -59,13 +99,15 @@ void BlockProtectNone(const BlockInfo& block_info) {
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
   DCHECK_NE(static_cast<uint8*>(NULL), block_info.block_pages);
-  DWORD old_protection = 0;
-  DWORD ret = ::VirtualProtect(block_info.block_pages,
-                               block_info.block_pages_size,
-                               PAGE_READWRITE, &old_protection);
-  CHECK_NE(0u, ret);
-  Shadow::MarkPagesUnprotected(block_info.block_pages,
-                               block_info.block_pages_size);
+
+  // The shadow memory reflects the protections of the block pages as long as
+  // they are only modified under block_protect_lock, which saves a system call
+  // when the block was unprotected by a BlockProtectBatch.
+  if (!AnyPageIsProtected(block_info.block_pages, block_info.block_pages_size))
+    return;
+
+  CHECK(ProtectPages(block_info.block_pages, block_info.block_pages_size,
+                     PAGE_READWRITE));
 }
 
 void BlockProtectRedzones(const BlockInfo& block_info) {
@@ -106,6 +148,11 @@ void BlockProtectAll(const BlockInfo& block_info) {
 
   ::common::AutoRecursiveLock lock(block_protect_lock);
   DCHECK_NE(static_cast<uint8*>(NULL), block_info.block_pages);
+  if (AllPagesAreProtected(block_info.block_pages,
+                           block_info.block_pages_size)) {
+    return;
+  }
+
   DWORD old_protection = 0;
   DWORD ret = ::VirtualProtect(block_info.block_pages,
                                block_info.block_pages_size,
@@ -149,5 +196,94 @@ void BlockProtectAuto(const BlockInfo& block_info) {
   }
 }
 
+void BlockProtectBatch::ProtectNone(const BlockInfo& block_info) {
+  if (block_info.block_pages_size == 0)
+    return;
+  DCHECK_NE(static_cast<uint8*>(NULL), block_info.block_pages);
+  Range range = { block_info.block_pages, block_info.block_pages_size,
+                  PAGE_READWRITE };
+  ranges_.push_back(range);
+}
+
+void BlockProtectBatch::ProtectAll(const BlockInfo& block_info) {
+  if (block_info.block_pages_size == 0)
+    return;
+  DCHECK_NE(static_cast<uint8*>(NULL), block_info.block_pages);
+  Range range = { block_info.block_pages, block_info.block_pages_size,
+                  PAGE_NOACCESS };
+  ranges_.push_back(range);
+}
+
+void BlockProtectBatch::Flush() {
+  if (ranges_.empty())
+    return;
+
+  ::common::AutoRecursiveLock lock(block_protect_lock);
+
+  // Drop the ranges that are already in the requested state.
+  size_t count = 0;
+  for (size_t i = 0; i < ranges_.size(); ++i) {
+    const Range& range = ranges_[i];
+    if (range.protection == PAGE_NOACCESS) {
+      if (AllPagesAreProtected(range.pages, range.pages_size))
+        continue;
+    } else {
+      if (!AnyPageIsProtected(range.pages, range.pages_size))
+        continue;
+    }
+    ranges_[count++] = range;
+  }
+  ranges_.resize(count);
+
+  // Apply the protections to runs of adjacent ranges.
+  std::sort(ranges_.begin(), ranges_.end(), &RangeAddressLess);
+  size_t run_start = 0;
+  for (size_t i = 1; i <= ranges_.size(); ++i) {
+    if (i < ranges_.size()) {
+      const Range& previous = ranges_[i - 1];
+      DCHECK_LE(previous.pages + previous.pages_size, ranges_[i].pages);
+      if (previous.pages + previous.pages_size == ranges_[i].pages &&
+          previous.protection == ranges_[i].protection) {
+        continue;
+      }
+    }
+
+    ProtectRanges(&ranges_[run_start], i - run_start,
+                  ranges_[run_start].protection);
+    run_start = i;
+  }
+
+  ranges_.clear();
+}
+
+bool BlockProtectBatch::RangeAddressLess(const Range& range1,
+                                         const Range& range2) {
+  return range1.pages < range2.pages;
+}
+
+void BlockProtectBatch::ProtectRanges(const Range* ranges,
+                                      size_t count,
+                                      DWORD protection) {
+  DCHECK_NE(static_cast<const Range*>(NULL), ranges);
+  DCHECK_LT(0u, count);
+
+  const Range& last = ranges[count - 1];
+  size_t run_size = last.pages + last.pages_size - ranges[0].pages;
+  if (ProtectPages(ranges[0].pages, run_size, protection))
+    return;
+
+  // VirtualProtect fails on ranges spanning several reservations, which
+  // happens when adjacent blocks come from different heaps. Fall back to
+  // protecting each block on its own.
+  for (size_t i = 0; i < count; ++i) {
+    bool ret = ProtectPages(ranges[i].pages, ranges[i].pages_size,
+                            protection);
+    if (protection == PAGE_READWRITE)
+      CHECK(ret);
+    else
+      DCHECK(ret);
+  }
+}
+
 }  // namespace asan
 }  // namespace agent
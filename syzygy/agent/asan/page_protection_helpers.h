@@ -18,6 +18,8 @@
 #ifndef SYZYGY_AGENT_ASAN_PAGE_PROTECTION_HELPERS_H_
 #define SYZYGY_AGENT_ASAN_PAGE_PROTECTION_HELPERS_H_
 
+#include <vector>
+
 #include "syzygy/agent/asan/block.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/common/recursive_lock.h"
@@ -44,7 +46,8 @@ bool GetBlockInfo(const void* raw_block, BlockInfo* block_info);
 
 // Unprotects all pages fully covered by the given block. All pages
 // intersecting but not fully covered by the block will be left in their
-// current state.
+// current state. This is a no-op if none of the pages are marked as protected
+// in the shadow memory.
 // @param block_info The block whose protections are to be modified.
 // @note Under block_protect_lock.
 void BlockProtectNone(const BlockInfo& block_info);
@@ -59,7 +62,8 @@ void BlockProtectRedzones(const BlockInfo& block_info);
 
 // Protects all pages completely spanned by the block. All pages
 // intersecting but not fully covered by the block will be left in their
-// current state.
+// current state. This is a no-op if all of the pages are marked as protected
+// in the shadow memory.
 // @param block_info The block whose protections are to be modified.
 // @note Under block_protect_lock.
 void BlockProtectAll(const BlockInfo& block_info);
@@ -71,6 +75,59 @@ void BlockProtectAll(const BlockInfo& block_info);
 // @note Under block_protect_lock.
 void BlockProtectAuto(const BlockInfo& block_info);
 
+// Accumulates page protection changes for many blocks and applies them with as
+// few calls to VirtualProtect as possible: the ranges are sorted, adjacent
+// ranges getting the same protection are coalesced, and ranges that are
+// already in the requested state are skipped. This is meant for operations
+// touching many blocks at once, like trimming a quarantine. The protections
+// of the queued blocks are left untouched until Flush is called, which happens
+// automatically on destruction.
+// @note A given page may only be queued once between two flushes.
+class BlockProtectBatch {
+ public:
+  BlockProtectBatch() { }
+
+  // Destructor. Flushes the pending changes.
+  ~BlockProtectBatch() { Flush(); }
+
+  // Queues the equivalent of a call to BlockProtectNone.
+  // @param block_info The block whose protections are to be modified.
+  void ProtectNone(const BlockInfo& block_info);
+
+  // Queues the equivalent of a call to BlockProtectAll.
+  // @param block_info The block whose protections are to be modified.
+  void ProtectAll(const BlockInfo& block_info);
+
+  // Applies the pending changes.
+  // @note Under block_protect_lock.
+  void Flush();
+
+  // @returns the number of pending changes.
+  size_t size() const { return ranges_.size(); }
+
+ protected:
+  // A pending protection change.
+  struct Range {
+    uint8* pages;
+    size_t pages_size;
+    DWORD protection;
+  };
+
+  // Sorts ranges by address.
+  static bool RangeAddressLess(const Range& range1, const Range& range2);
+
+  // Applies @p protection to the @p count ranges starting at @p ranges, which
+  // must be contiguous.
+  static void ProtectRanges(const Range* ranges,
+                            size_t count,
+                            DWORD protection);
+
+  std::vector<Range> ranges_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BlockProtectBatch);
+};
+
 // A scoped block access helper. Removes block protections when created via
 // BlockProtectNone, and restores them via BlockProtectAuto.
 // TODO(chrisha): Consider recording the fact the block protections on this
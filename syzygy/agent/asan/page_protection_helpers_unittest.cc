@@ -307,5 +307,94 @@ TEST(PageProtectionHelpersTest, ScopedBlockAccess) {
   ASSERT_EQ(TRUE, ::VirtualFree(alloc, 0, MEM_RELEASE));
 }
 
+TEST(PageProtectionHelpersTest, BlockProtectBatch) {
+  BlockLayout layout = {};
+  const size_t kPageSize = GetPageSize();
+  EXPECT_TRUE(BlockPlanLayout(kPageSize, kPageSize, kPageSize, kPageSize,
+                              kPageSize, &layout));
+
+  // Lay out adjacent blocks in a single reservation, so that their ranges can
+  // be coalesced.
+  const size_t kNumBlocks = 4;
+  uint8* alloc = reinterpret_cast<uint8*>(::VirtualAlloc(
+      NULL, kNumBlocks * layout.block_size, MEM_COMMIT, PAGE_READWRITE));
+  ASSERT_TRUE(alloc != NULL);
+  BlockInfo block_infos[kNumBlocks] = {};
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    BlockInitialize(layout, alloc + i * layout.block_size, false,
+                    &block_infos[i]);
+  }
+
+  {
+    BlockProtectBatch batch;
+    for (size_t i = 0; i < kNumBlocks; ++i)
+      batch.ProtectAll(block_infos[i]);
+    EXPECT_EQ(kNumBlocks, batch.size());
+
+    // Nothing changes until the batch is flushed.
+    for (size_t i = 0; i < kNumBlocks; ++i)
+      TestAccessUnderProtection(block_infos[i], kProtectNone);
+  }
+  for (size_t i = 0; i < kNumBlocks; ++i)
+    TestAccessUnderProtection(block_infos[i], kProtectAll);
+
+  // Mix protections in a single batch.
+  BlockProtectBatch batch;
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    if (i % 2 == 0)
+      batch.ProtectNone(block_infos[i]);
+    else
+      batch.ProtectAll(block_infos[i]);
+  }
+  batch.Flush();
+  EXPECT_EQ(0u, batch.size());
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    TestAccessUnderProtection(block_infos[i],
+                              i % 2 == 0 ? kProtectNone : kProtectAll);
+  }
+
+  // Blocks that are already unprotected are left alone.
+  for (size_t i = 0; i < kNumBlocks; ++i)
+    batch.ProtectNone(block_infos[i]);
+  batch.Flush();
+  for (size_t i = 0; i < kNumBlocks; ++i)
+    TestAccessUnderProtection(block_infos[i], kProtectNone);
+
+  ASSERT_EQ(TRUE, ::VirtualFree(alloc, 0, MEM_RELEASE));
+}
+
+TEST(PageProtectionHelpersTest, BlockProtectNoneSkipsUnprotectedPages) {
+  BlockLayout layout = {};
+  const size_t kPageSize = GetPageSize();
+  EXPECT_TRUE(BlockPlanLayout(kPageSize, kPageSize, kPageSize, kPageSize,
+                              kPageSize, &layout));
+  void* alloc = ::VirtualAlloc(NULL, layout.block_size, MEM_COMMIT,
+                               PAGE_READWRITE);
+  ASSERT_TRUE(alloc != NULL);
+
+  BlockInfo block_info = {};
+  BlockInitialize(layout, alloc, false, &block_info);
+
+  // Change the protection behind the back of the shadow memory. As the pages
+  // are not marked as protected, BlockProtectNone doesn't touch them.
+  DWORD old_protection = 0;
+  ASSERT_TRUE(::VirtualProtect(block_info.block_pages,
+                               block_info.block_pages_size,
+                               PAGE_READONLY, &old_protection));
+  BlockProtectNone(block_info);
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  ASSERT_EQ(sizeof(memory_info),
+            ::VirtualQuery(block_info.block_pages, &memory_info,
+                           sizeof(memory_info)));
+  EXPECT_EQ(static_cast<DWORD>(PAGE_READONLY), memory_info.Protect);
+
+  // Once protected they are properly unprotected.
+  BlockProtectAll(block_info);
+  BlockProtectNone(block_info);
+  TestAccessUnderProtection(block_info, kProtectNone);
+
+  ASSERT_EQ(TRUE, ::VirtualFree(alloc, 0, MEM_RELEASE));
+}
+
 }  // namespace asan
 }  // namespace agent
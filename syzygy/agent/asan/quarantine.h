@@ -62,6 +62,26 @@ class QuarantineInterface {
   //     false then the cache invariant is satisfied.
   virtual bool Pop(Object* object) = 0;
 
+  // Potentially removes several objects from the quarantine to maintain the
+  // invariant. This routine must be thread-safe, and implement its own
+  // locking. The default implementation repeatedly calls Pop, quarantines
+  // that can remove objects more cheaply in bulk should override it.
+  // @param max_count The maximum number of objects to remove.
+  // @param objects Receives copies of the removed objects, which are appended
+  //     to it.
+  // @returns the number of objects removed. If this is less than @p max_count
+  //     then the cache invariant is satisfied.
+  virtual size_t PopBatch(size_t max_count, ObjectVector* objects) {
+    DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+    size_t count = 0;
+    Object object;
+    while (count < max_count && Pop(&object)) {
+      objects->push_back(object);
+      ++count;
+    }
+    return count;
+  }
+
   // Removes all objects from the quarantine, placing them in the provided
   // vector. This routine must be thread-safe, and implement its own locking.
   virtual void Empty(ObjectVector* objects) = 0;
@@ -0,0 +1,173 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implements a sharded quarantine backed by lock free circular queues.
+
+#ifndef SYZYGY_AGENT_ASAN_QUARANTINES_RING_SHARDED_QUARANTINE_H_
+#define SYZYGY_AGENT_ASAN_QUARANTINES_RING_SHARDED_QUARANTINE_H_
+
+#include "base/atomicops.h"
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/agent/asan/circular_queue.h"
+#include "syzygy/agent/asan/quarantine.h"
+#include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+// A size-limited sharded quarantine where each shard is a bounded lock free
+// circular queue. Objects are distributed among the shards like in the
+// ShardedQuarantine, but pushing and popping objects never takes a lock, and
+// the size of the quarantine is maintained with atomic operations. Threads
+// only contend when they race for the same slot of a shard.
+//
+// As nothing is locked, an object may be popped by another thread as soon as
+// it has been pushed. Callers must be done with an object before pushing it,
+// and Lock/Unlock are no-ops.
+//
+// The shards have a fixed capacity. When the shard of an object is full the
+// object goes to the next shard that isn't, and it's refused if all of them
+// are full.
+//
+// @tparam ObjectType The type of object being stored in the cache. This must
+//     be default constructible and assignable.
+// @tparam SizeFunctorType A functor for extracting the size associated with
+//     an object.
+// @tparam HashFunctorType A functor for calculating a hash value associated
+//     with an object. This must be thread-safe, and implement the method:
+//     size_t operator()(const ObjectType& o) const;
+// @tparam ShardingFactor The sharding factor. Must be greater than 1.
+template<typename ObjectType,
+         typename SizeFunctorType,
+         typename HashFunctorType,
+         size_t ShardingFactor>
+class RingShardedQuarantine : public QuarantineInterface<ObjectType> {
+ public:
+  typedef QuarantineInterface<ObjectType> Super;
+  typedef typename Super::Object Object;
+  typedef typename Super::ObjectVector ObjectVector;
+  typedef SizeFunctorType SizeFunctor;
+  typedef HashFunctorType HashFunctor;
+
+  static const size_t kShardingFactor = ShardingFactor;
+  static const size_t kUnboundedSize = ~0;
+
+  // Constructor. The hash functor must have a default constructor. Initially
+  // the quarantine has unlimited capacity, up to the capacity of its shards.
+  // @param shard_capacity The minimum number of objects each shard can store.
+  explicit RingShardedQuarantine(size_t shard_capacity);
+
+  // Constructor with explicit hash functor. The hash functor must have a copy
+  // constructor.
+  // @param shard_capacity The minimum number of objects each shard can store.
+  // @param hash_functor The hash functor to be used.
+  RingShardedQuarantine(size_t shard_capacity,
+                        const HashFunctor& hash_functor);
+
+  // Virtual destructor.
+  virtual ~RingShardedQuarantine() { }
+
+  // Sets the maximum object size. This only gates the entry of future
+  // objects to 'Push'.
+  // @param max_object_size The maximum size of any single object in the
+  //     quarantine. Use kUnboundedSize for unlimited (no max).
+  void set_max_object_size(size_t max_object_size) {
+    max_object_size_ = max_object_size;
+  }
+
+  // Sets the maximum quarantine size. This may cause the quarantine
+  // invariant to be immediately invalidated, requiring calls to 'Pop'.
+  // @param max_quarantine_size The maximum size of the entire quarantine.
+  //     Use kUnboundedSize for unlimited (no max).
+  void set_max_quarantine_size(size_t max_quarantine_size) {
+    max_quarantine_size_ = max_quarantine_size;
+  }
+
+  // @returns the maximum object size.
+  size_t max_object_size() const { return max_object_size_; }
+
+  // @returns the maximum quarantine size.
+  size_t max_quarantine_size() const { return max_quarantine_size_; }
+
+  // @returns the current size of the quarantine.
+  size_t size() const {
+    return static_cast<size_t>(base::subtle::NoBarrier_Load(&size_));
+  }
+
+  // @name QuarantineInterface implementation.
+  // @{
+  bool Push(const Object& object) override;
+  bool Pop(Object* object) override;
+  size_t PopBatch(size_t max_count, ObjectVector* objects) override;
+  void Empty(ObjectVector* objects) override;
+  size_t GetCount() override;
+  // @}
+
+ protected:
+  // The type of the shards.
+  typedef LockFreeCircularQueue<Object> Shard;
+
+  // @name QuarantineInterface implementation.
+  // @{
+  size_t GetLockId(const Object& object) override;
+  void Lock(size_t id) override;
+  void Unlock(size_t id) override;
+  // @}
+
+  // Creates the shards.
+  // @param shard_capacity The minimum number of objects each shard can store.
+  void InitShards(size_t shard_capacity);
+
+  // @returns true if the quarantine is over its maximum size.
+  bool IsOverMaxSize() const;
+
+  // @returns the shard where the next search for an object to pop starts.
+  size_t GetPopShard();
+
+  // Pops the oldest object of a shard, and removes it from the size of the
+  // quarantine.
+  // @param shard The index of the shard.
+  // @param object Receives the popped object.
+  // @returns true if an object was popped, false if the shard is empty.
+  bool PopFromShard(size_t shard, Object* object);
+
+  // Parameters controlling the quarantine invariant.
+  size_t max_object_size_;
+  size_t max_quarantine_size_;
+
+  // The current size of the quarantine, and the number of objects in it.
+  volatile base::subtle::Atomic32 size_;
+  volatile base::subtle::Atomic32 count_;
+
+  // Used to spread the pops over the shards.
+  volatile base::subtle::Atomic32 pop_cursor_;
+
+  // The shards.
+  scoped_ptr<Shard> shards_[kShardingFactor];
+
+  // The hash functor that will be used to assign objects to shards.
+  HashFunctor hash_functor_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RingShardedQuarantine);
+};
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
+
+#include "syzygy/agent/asan/quarantines/ring_sharded_quarantine_impl.h"
+
+#endif  // SYZYGY_AGENT_ASAN_QUARANTINES_RING_SHARDED_QUARANTINE_H_
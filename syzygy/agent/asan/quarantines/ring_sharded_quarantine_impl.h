@@ -0,0 +1,194 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation of a ring sharded quarantine. This file is not
+// meant to be included directly.
+
+#ifndef SYZYGY_AGENT_ASAN_QUARANTINES_RING_SHARDED_QUARANTINE_IMPL_H_
+#define SYZYGY_AGENT_ASAN_QUARANTINES_RING_SHARDED_QUARANTINE_IMPL_H_
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+RingShardedQuarantine<OT, SFT, HFT, SF>::RingShardedQuarantine(
+    size_t shard_capacity)
+    : max_object_size_(kUnboundedSize),
+      max_quarantine_size_(kUnboundedSize),
+      size_(0),
+      count_(0),
+      pop_cursor_(0) {
+  InitShards(shard_capacity);
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+RingShardedQuarantine<OT, SFT, HFT, SF>::RingShardedQuarantine(
+    size_t shard_capacity, const HashFunctor& hash_functor)
+    : max_object_size_(kUnboundedSize),
+      max_quarantine_size_(kUnboundedSize),
+      size_(0),
+      count_(0),
+      pop_cursor_(0),
+      hash_functor_(hash_functor) {
+  InitShards(shard_capacity);
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void RingShardedQuarantine<OT, SFT, HFT, SF>::InitShards(
+    size_t shard_capacity) {
+  COMPILE_ASSERT(kShardingFactor > 1, invalid_sharding_factor);
+  for (size_t i = 0; i < kShardingFactor; ++i)
+    shards_[i].reset(new Shard(shard_capacity));
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool RingShardedQuarantine<OT, SFT, HFT, SF>::Push(const Object& object) {
+  SizeFunctor get_size;
+  size_t size = get_size(object);
+  if (max_object_size_ != kUnboundedSize && size > max_object_size_)
+    return false;
+  if (max_quarantine_size_ != kUnboundedSize && size > max_quarantine_size_)
+    return false;
+
+  // Account for the object before making it visible, so that a concurrent
+  // pop can't bring the size below zero.
+  base::subtle::Atomic32 delta = static_cast<base::subtle::Atomic32>(size);
+  base::subtle::NoBarrier_AtomicIncrement(&size_, delta);
+  base::subtle::NoBarrier_AtomicIncrement(&count_, 1);
+
+  size_t shard = GetLockId(object);
+  for (size_t i = 0; i < kShardingFactor; ++i) {
+    if (shards_[(shard + i) % kShardingFactor]->push(object))
+      return true;
+  }
+
+  // All the shards are full.
+  base::subtle::NoBarrier_AtomicIncrement(&size_, -delta);
+  base::subtle::NoBarrier_AtomicIncrement(&count_, -1);
+  return false;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool RingShardedQuarantine<OT, SFT, HFT, SF>::Pop(Object* object) {
+  DCHECK_NE(static_cast<Object*>(NULL), object);
+  if (!IsOverMaxSize())
+    return false;
+
+  // Scan the shards until finding a non-empty one. If there's none then
+  // another thread emptied them while we were in this function.
+  size_t shard = GetPopShard();
+  for (size_t i = 0; i < kShardingFactor; ++i) {
+    if (PopFromShard((shard + i) % kShardingFactor, object))
+      return true;
+  }
+  return false;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t RingShardedQuarantine<OT, SFT, HFT, SF>::PopBatch(
+    size_t max_count, ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+
+  // Take the objects from the shards in turn, so that they stay evenly
+  // loaded and the objects spend about the same time in the quarantine
+  // whatever their shard. Stop once a whole round of the shards comes up
+  // empty.
+  size_t count = 0;
+  size_t shard = GetPopShard();
+  size_t empty_shards = 0;
+  Object object;
+  while (count < max_count && empty_shards < kShardingFactor &&
+         IsOverMaxSize()) {
+    if (PopFromShard(shard, &object)) {
+      objects->push_back(object);
+      ++count;
+      empty_shards = 0;
+    } else {
+      ++empty_shards;
+    }
+    shard = (shard + 1) % kShardingFactor;
+  }
+  return count;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void RingShardedQuarantine<OT, SFT, HFT, SF>::Empty(ObjectVector* objects) {
+  DCHECK_NE(static_cast<ObjectVector*>(NULL), objects);
+
+  // The objects pushed concurrently may or may not make it into the vector,
+  // but the accounting stays consistent either way.
+  Object object;
+  for (size_t i = 0; i < kShardingFactor; ++i) {
+    while (PopFromShard(i, &object))
+      objects->push_back(object);
+  }
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t RingShardedQuarantine<OT, SFT, HFT, SF>::GetCount() {
+  return static_cast<size_t>(base::subtle::NoBarrier_Load(&count_));
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t RingShardedQuarantine<OT, SFT, HFT, SF>::GetLockId(
+    const Object& object) {
+  size_t hash = hash_functor_(object);
+  return detail::ShardedQuarantineHash<kShardingFactor>(hash);
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void RingShardedQuarantine<OT, SFT, HFT, SF>::Lock(size_t id) {
+  DCHECK_LT(id, kShardingFactor);
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void RingShardedQuarantine<OT, SFT, HFT, SF>::Unlock(size_t id) {
+  DCHECK_LT(id, kShardingFactor);
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool RingShardedQuarantine<OT, SFT, HFT, SF>::IsOverMaxSize() const {
+  return max_quarantine_size_ != kUnboundedSize &&
+      size() > max_quarantine_size_;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+size_t RingShardedQuarantine<OT, SFT, HFT, SF>::GetPopShard() {
+  base::subtle::Atomic32 cursor =
+      base::subtle::NoBarrier_AtomicIncrement(&pop_cursor_, 1);
+  return static_cast<uint32>(cursor) % kShardingFactor;
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+bool RingShardedQuarantine<OT, SFT, HFT, SF>::PopFromShard(
+    size_t shard, Object* object) {
+  DCHECK_LT(shard, kShardingFactor);
+  DCHECK_NE(static_cast<Object*>(NULL), object);
+  if (!shards_[shard]->pop(object))
+    return false;
+
+  SizeFunctor get_size;
+  base::subtle::Atomic32 delta =
+      static_cast<base::subtle::Atomic32>(get_size(*object));
+  base::subtle::NoBarrier_AtomicIncrement(&size_, -delta);
+  base::subtle::NoBarrier_AtomicIncrement(&count_, -1);
+  return true;
+}
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_QUARANTINES_RING_SHARDED_QUARANTINE_IMPL_H_
@@ -0,0 +1,237 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/quarantines/ring_sharded_quarantine.h"
+
+#include "base/memory/scoped_ptr.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace quarantines {
+
+namespace {
+
+struct DummyObject {
+  size_t size;
+  size_t hash;
+
+  DummyObject() : size(0), hash(0) { }
+  explicit DummyObject(size_t size) : size(size), hash(0) { }
+};
+
+struct DummyObjectSizeFunctor {
+  size_t operator()(const DummyObject& o) {
+    return o.size;
+  }
+};
+
+struct DummyObjectHashFunctor {
+  uint32 operator()(const DummyObject& o) {
+    return o.hash;
+  }
+};
+
+const size_t kShardCapacity = 1024;
+
+class TestRingShardedQuarantine
+    : public RingShardedQuarantine<DummyObject,
+                                   DummyObjectSizeFunctor,
+                                   DummyObjectHashFunctor,
+                                   8> {
+ public:
+  typedef RingShardedQuarantine<DummyObject,
+                                DummyObjectSizeFunctor,
+                                DummyObjectHashFunctor,
+                                8> Super;
+
+  TestRingShardedQuarantine() : Super(kShardCapacity) { }
+
+  size_t ShardCount(size_t shard) {
+    return shards_[shard]->size();
+  }
+};
+
+// Pushes objects into a quarantine and trims it, from a thread.
+class PushPopRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  PushPopRunner(TestRingShardedQuarantine* quarantine, size_t seed)
+      : quarantine_(quarantine), seed_(seed), pushed_(0), popped_(0) {
+  }
+
+  void Run() override {
+    DummyObject d(1);
+    d.hash = seed_;
+    TestRingShardedQuarantine::ObjectVector objects;
+    for (size_t i = 0; i < 100000; ++i) {
+      if (quarantine_->Push(d))
+        ++pushed_;
+      d.hash += 7;
+      objects.clear();
+      popped_ += quarantine_->PopBatch(4, &objects);
+    }
+  }
+
+  size_t pushed() const { return pushed_; }
+  size_t popped() const { return popped_; }
+
+ private:
+  TestRingShardedQuarantine* quarantine_;
+  size_t seed_;
+  size_t pushed_;
+  size_t popped_;
+
+  DISALLOW_COPY_AND_ASSIGN(PushPopRunner);
+};
+
+}  // namespace
+
+TEST(RingShardedQuarantineTest, EvenLoading) {
+  TestRingShardedQuarantine q;
+  DummyObject d(1);
+  DummyObject popped;
+
+  q.set_max_quarantine_size(4000);
+  EXPECT_EQ(0u, q.size());
+
+  // Stuff a bunch of things into the quarantine, but don't saturate it.
+  for (size_t i = 0; i < 3000; ++i) {
+    {
+      TestRingShardedQuarantine::AutoQuarantineLock lock(&q, d);
+      EXPECT_TRUE(q.Push(d));
+    }
+    d.hash++;
+    EXPECT_EQ(i + 1, q.size());
+    EXPECT_EQ(i + 1, q.GetCount());
+
+    EXPECT_FALSE(q.Pop(&popped));
+    EXPECT_EQ(i + 1, q.size());
+  }
+
+  // Saturate the quarantine, invalidating the invariant.
+  while (q.size() <= q.max_quarantine_size()) {
+    EXPECT_TRUE(q.Push(d));
+    d.hash++;
+  }
+
+  // Now expect one element to be popped off before the invariant is satisfied.
+  EXPECT_TRUE(q.Pop(&popped));
+  EXPECT_EQ(d.size, popped.size);
+  EXPECT_EQ(q.max_quarantine_size(), q.size());
+  EXPECT_FALSE(q.Pop(&popped));
+
+  // Expect there to be roughly even loading.
+  double expected_count = q.max_quarantine_size() / q.kShardingFactor;
+  for (size_t i = 0; i < q.kShardingFactor; ++i) {
+    size_t count = q.ShardCount(i);
+    EXPECT_LT(0.9 * expected_count, count);
+    EXPECT_GT(1.1 * expected_count, count);
+  }
+}
+
+TEST(RingShardedQuarantineTest, SizeLimits) {
+  TestRingShardedQuarantine q;
+  q.set_max_object_size(10);
+  q.set_max_quarantine_size(20);
+
+  EXPECT_FALSE(q.Push(DummyObject(11)));
+  EXPECT_TRUE(q.Push(DummyObject(10)));
+  EXPECT_EQ(10u, q.size());
+  EXPECT_EQ(1u, q.GetCount());
+}
+
+TEST(RingShardedQuarantineTest, FullShardsOverflow) {
+  TestRingShardedQuarantine q;
+
+  // All the objects hash to the same shard, which overflows into the others
+  // until they're all full.
+  DummyObject d(1);
+  for (size_t i = 0; i < q.kShardingFactor * kShardCapacity; ++i)
+    EXPECT_TRUE(q.Push(d));
+  EXPECT_FALSE(q.Push(d));
+  EXPECT_EQ(q.kShardingFactor * kShardCapacity, q.GetCount());
+  for (size_t i = 0; i < q.kShardingFactor; ++i)
+    EXPECT_EQ(kShardCapacity, q.ShardCount(i));
+
+  TestRingShardedQuarantine::ObjectVector os;
+  q.Empty(&os);
+  EXPECT_EQ(q.kShardingFactor * kShardCapacity, os.size());
+  EXPECT_EQ(0u, q.size());
+  EXPECT_EQ(0u, q.GetCount());
+  EXPECT_TRUE(q.Push(d));
+}
+
+TEST(RingShardedQuarantineTest, PopBatch) {
+  TestRingShardedQuarantine q;
+  q.set_max_quarantine_size(100);
+
+  DummyObject d(1);
+  for (size_t i = 0; i < 150; ++i) {
+    EXPECT_TRUE(q.Push(d));
+    d.hash++;
+  }
+
+  // The batch is capped by its maximum count.
+  TestRingShardedQuarantine::ObjectVector os;
+  EXPECT_EQ(20u, q.PopBatch(20, &os));
+  EXPECT_EQ(20u, os.size());
+  EXPECT_EQ(130u, q.size());
+
+  // And by the quarantine invariant.
+  EXPECT_EQ(30u, q.PopBatch(1000, &os));
+  EXPECT_EQ(50u, os.size());
+  EXPECT_EQ(100u, q.size());
+  EXPECT_EQ(0u, q.PopBatch(1000, &os));
+
+  // The batches are taken evenly from the shards.
+  for (size_t i = 0; i < q.kShardingFactor; ++i)
+    EXPECT_LT(0u, q.ShardCount(i));
+}
+
+TEST(RingShardedQuarantineTest, ConcurrentPushAndPop) {
+  TestRingShardedQuarantine q;
+  q.set_max_quarantine_size(1000);
+
+  const size_t kThreadCount = 4;
+  scoped_ptr<PushPopRunner> runners[kThreadCount];
+  scoped_ptr<base::DelegateSimpleThread> threads[kThreadCount];
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    runners[i].reset(new PushPopRunner(&q, i));
+    threads[i].reset(new base::DelegateSimpleThread(runners[i].get(),
+                                                    "PushPopRunner"));
+    threads[i]->Start();
+  }
+
+  size_t pushed = 0;
+  size_t popped = 0;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    threads[i]->Join();
+    pushed += runners[i]->pushed();
+    popped += runners[i]->popped();
+  }
+
+  // No object was lost or duplicated, and the accounting is consistent.
+  EXPECT_EQ(pushed - popped, q.GetCount());
+  EXPECT_EQ(pushed - popped, q.size());
+
+  TestRingShardedQuarantine::ObjectVector os;
+  q.Empty(&os);
+  EXPECT_EQ(pushed - popped, os.size());
+  EXPECT_EQ(0u, q.GetCount());
+}
+
+}  // namespace quarantines
+}  // namespace asan
+}  // namespace agent
@@ -18,6 +18,7 @@
 #define SYZYGY_AGENT_ASAN_QUARANTINES_SHARDED_QUARANTINE_H_
 
 #include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/heap_statistics.h"
 #include "syzygy/agent/asan/page_allocator.h"
 #include "syzygy/agent/asan/quarantines/size_limited_quarantine.h"
 
@@ -59,6 +60,18 @@ class ShardedQuarantine
   // Virtual destructor.
   virtual ~ShardedQuarantine() { }
 
+  // Moves the counters of the shards to an external array, such as one in the
+  // heap statistics section. The counters gathered so far are carried over.
+  // This must be called before the quarantine is shared between threads.
+  // @param shard_statistics An array of kShardingFactor counters, which must
+  //     outlive this quarantine.
+  void set_shard_statistics(QuarantineShardStatistics* shard_statistics);
+
+  // @returns the counters of the shards, an array of kShardingFactor entries.
+  const QuarantineShardStatistics* shard_statistics() const {
+    return shard_statistics_;
+  }
+
  protected:
   // @name SizeLimitedQuarantineImpl implementation.
   // @{
@@ -102,6 +115,12 @@ class ShardedQuarantine
   // The hash functor that will be used to assign objects to shards.
   HashFunctor hash_functor_;
 
+  // The counters of the shards. Each entry is under the corresponding locks_
+  // entry. This points to local_shard_statistics_ unless the counters have
+  // been moved elsewhere.
+  QuarantineShardStatistics* shard_statistics_;
+  QuarantineShardStatistics local_shard_statistics_[kShardingFactor];
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ShardedQuarantine);
 };
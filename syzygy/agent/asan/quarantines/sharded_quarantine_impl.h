@@ -46,19 +46,34 @@ size_t ShardedQuarantineHash(size_t a) {
 }  // namespace detail
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
-ShardedQuarantine<OT, SFT, HFT, SF>::ShardedQuarantine() {
+ShardedQuarantine<OT, SFT, HFT, SF>::ShardedQuarantine()
+    : shard_statistics_(local_shard_statistics_) {
   COMPILE_ASSERT(kShardingFactor >= 1, invalid_sharding_factor);
   ::memset(heads_, 0, sizeof(heads_));
   ::memset(tails_, 0, sizeof(tails_));
+  ::memset(local_shard_statistics_, 0, sizeof(local_shard_statistics_));
 }
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
 ShardedQuarantine<OT, SFT, HFT, SF>::ShardedQuarantine(
     const HashFunctor& hash_functor)
-    : hash_functor_(hash_functor) {
+    : hash_functor_(hash_functor),
+      shard_statistics_(local_shard_statistics_) {
   COMPILE_ASSERT(kShardingFactor > 1, invalid_sharding_factor);
   ::memset(heads_, 0, sizeof(heads_));
   ::memset(tails_, 0, sizeof(tails_));
+  ::memset(local_shard_statistics_, 0, sizeof(local_shard_statistics_));
+}
+
+template<typename OT, typename SFT, typename HFT, size_t SF>
+void ShardedQuarantine<OT, SFT, HFT, SF>::set_shard_statistics(
+    QuarantineShardStatistics* shard_statistics) {
+  DCHECK_NE(static_cast<QuarantineShardStatistics*>(NULL), shard_statistics);
+  if (shard_statistics == shard_statistics_)
+    return;
+  ::memcpy(shard_statistics, shard_statistics_,
+           kShardingFactor * sizeof(*shard_statistics));
+  shard_statistics_ = shard_statistics;
 }
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
@@ -84,6 +99,7 @@ bool ShardedQuarantine<OT, SFT, HFT, SF>::PushImpl(const Object& object) {
     heads_[shard] = node;
     tails_[shard] = node;
   }
+  ++shard_statistics_[shard].count;
 
   return true;
 }
@@ -114,6 +130,7 @@ bool ShardedQuarantine<OT, SFT, HFT, SF>::PopImpl(Object* object) {
     heads_[shard] = node->next;
     if (heads_[shard] == NULL)
       tails_[shard] = NULL;
+    --shard_statistics_[shard].count;
     break;
   }
   DCHECK_NE(static_cast<Node*>(NULL), node);
@@ -141,6 +158,7 @@ void ShardedQuarantine<OT, SFT, HFT, SF>::EmptyImpl(ObjectVector* objects) {
     }
     heads_[i] = NULL;
     tails_[i] = NULL;
+    shard_statistics_[i].count = 0;
   }
 
   return;
@@ -157,7 +175,10 @@ size_t ShardedQuarantine<OT, SFT, HFT, SF>::GetLockIdImpl(
 template<typename OT, typename SFT, typename HFT, size_t SF>
 void ShardedQuarantine<OT, SFT, HFT, SF>::LockImpl(size_t id) {
   DCHECK_LT(id, kShardingFactor);
-  locks_[id].Acquire();
+  if (!locks_[id].Try()) {
+    locks_[id].Acquire();
+    ++shard_statistics_[id].lock_contention_count;
+  }
 }
 
 template<typename OT, typename SFT, typename HFT, size_t SF>
@@ -207,6 +207,43 @@ TEST(ShardedQuarantineTest, LockUnlock) {
   EXPECT_TRUE(q.lock_set_.empty());
 }
 
+TEST(ShardedQuarantineTest, ShardStatistics) {
+  TestShardedQuarantine q;
+  DummyObject d(1);
+  q.set_max_object_size(TestShardedQuarantine::kUnboundedSize);
+  q.set_max_quarantine_size(10000);
+
+  for (size_t i = 0; i < 100; ++i) {
+    TestShardedQuarantine::AutoQuarantineLock lock(&q, d);
+    EXPECT_TRUE(q.Push(d));
+    d.hash++;
+  }
+
+  // The counters follow the contents of the shards, and are carried over
+  // when they are moved.
+  QuarantineShardStatistics shard_statistics[
+      TestShardedQuarantine::kShardingFactor] = {};
+  q.set_shard_statistics(shard_statistics);
+  EXPECT_EQ(shard_statistics, q.shard_statistics());
+  for (size_t i = 0; i < TestShardedQuarantine::kShardingFactor; ++i) {
+    EXPECT_EQ(q.ShardCount(i),
+              static_cast<size_t>(shard_statistics[i].count));
+    EXPECT_EQ(0, static_cast<LONG>(shard_statistics[i].lock_contention_count));
+  }
+
+  q.set_max_quarantine_size(50);
+  DummyObject popped;
+  while (q.Pop(&popped)) {}
+  for (size_t i = 0; i < TestShardedQuarantine::kShardingFactor; ++i)
+    EXPECT_EQ(q.ShardCount(i),
+              static_cast<size_t>(shard_statistics[i].count));
+
+  DummyObjectVector os;
+  q.Empty(&os);
+  for (size_t i = 0; i < TestShardedQuarantine::kShardingFactor; ++i)
+    EXPECT_EQ(0, static_cast<LONG>(shard_statistics[i].count));
+}
+
 }  // namespace quarantines
 }  // namespace asan
 }  // namespace agent
@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/asan/shadow.h"
 
+#include <windows.h>
+#include <emmintrin.h>
+
 #include <algorithm>
 
 #include "base/strings/stringprintf.h"
@@ -22,9 +25,69 @@
 namespace agent {
 namespace asan {
 
-uint8 Shadow::shadow_[kShadowSize] = {};
+namespace {
+
+// The log of the number of shadow bytes described by an entry of the block
+// index.
+const size_t kBlockIndexShadowBytesLog = 12 - kShadowRatioLog;
+
+// Reserves and commits the shadow memory. This is done when the runtime is
+// loaded so that the shadow memory is usable before Shadow::SetUp is called,
+// as was the case when it was statically allocated.
+uint8* AllocateShadowMemory() {
+  void* shadow = ::VirtualAlloc(NULL, Shadow::kShadowSize,
+                                MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  CHECK_NE(static_cast<void*>(NULL), shadow);
+  return reinterpret_cast<uint8*>(shadow);
+}
+
+// Determines if a chunk of shadow memory only contains zeros.
+bool ShadowChunkIsZero(const uint8* chunk) {
+  const uint32* cursor = reinterpret_cast<const uint32*>(chunk);
+  const uint32* end = reinterpret_cast<const uint32*>(
+      chunk + Shadow::kLazyCommitGranularity);
+  for (; cursor != end; ++cursor) {
+    if (*cursor != 0)
+      return false;
+  }
+  return true;
+}
+
+// Commits the chunks of shadow memory that are accessed while lazy commit is
+// enabled.
+LONG WINAPI LazyCommitHandler(EXCEPTION_POINTERS* exception_pointers) {
+  const EXCEPTION_RECORD* record = exception_pointers->ExceptionRecord;
+  if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION ||
+      record->NumberParameters < 2) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  // Only accesses to the shadow memory itself are handled.
+  uintptr_t address = record->ExceptionInformation[1];
+  uintptr_t shadow = reinterpret_cast<uintptr_t>(Shadow::shadow());
+  if (address < shadow || address >= shadow + Shadow::kShadowSize)
+    return EXCEPTION_CONTINUE_SEARCH;
+
+  // Another thread may have committed this chunk in the meantime, but
+  // committing it again is harmless and leaves its contents intact.
+  void* chunk = reinterpret_cast<void*>(
+      ::common::AlignDown(address, Shadow::kLazyCommitGranularity));
+  if (::VirtualAlloc(chunk, Shadow::kLazyCommitGranularity, MEM_COMMIT,
+                     PAGE_READWRITE) == NULL) {
+    return EXCEPTION_CONTINUE_SEARCH;
+  }
+
+  return EXCEPTION_CONTINUE_EXECUTION;
+}
+
+}  // namespace
+
+uint8* Shadow::shadow_ = AllocateShadowMemory();
+void* Shadow::lazy_commit_handler_ = NULL;
 uint8 Shadow::page_bits_[kPageBitsSize] = {};
 base::Lock Shadow::page_bits_lock_;
+volatile uint32 Shadow::poison_epoch_ = 0;
+Shadow::BlockIndexEntry Shadow::block_index_[Shadow::kBlockIndexSize];
 
 void Shadow::SetUp() {
   // Poison the shadow memory.
@@ -36,6 +99,7 @@ void Shadow::SetUp() {
 }
 
 void Shadow::TearDown() {
+  DisableLazyCommit();
   // Unpoison the shadow memory.
   Unpoison(shadow_, kShadowSize);
   // Unpoison the first 64k of the memory.
@@ -44,6 +108,42 @@ void Shadow::TearDown() {
   Unpoison(page_bits_, kPageBitsSize);
 }
 
+bool Shadow::EnableLazyCommit() {
+  if (lazy_commit_handler_ != NULL)
+    return true;
+
+  // The handler has to be in place before anything is decommitted, and must
+  // run before any other handler gets to see the access violations.
+  lazy_commit_handler_ = ::AddVectoredExceptionHandler(1, &LazyCommitHandler);
+  if (lazy_commit_handler_ == NULL) {
+    LOG(ERROR) << "Unable to install the shadow memory exception handler.";
+    return false;
+  }
+
+  for (size_t offset = 0; offset < kShadowSize;
+       offset += kLazyCommitGranularity) {
+    uint8* chunk = shadow_ + offset;
+    if (!ShadowChunkIsZero(chunk))
+      continue;
+    // This can only fail if the chunk isn't part of the reservation.
+    CHECK(::VirtualFree(chunk, kLazyCommitGranularity, MEM_DECOMMIT));
+  }
+
+  return true;
+}
+
+void Shadow::DisableLazyCommit() {
+  if (lazy_commit_handler_ == NULL)
+    return;
+
+  // Commit the entire shadow memory before removing the handler, so that no
+  // access can fault afterwards.
+  CHECK_NE(static_cast<void*>(NULL),
+           ::VirtualAlloc(shadow_, kShadowSize, MEM_COMMIT, PAGE_READWRITE));
+  ::RemoveVectoredExceptionHandler(lazy_commit_handler_);
+  lazy_commit_handler_ = NULL;
+}
+
 bool Shadow::IsClean() {
   static const size_t kInnacEnd = kAddressLowerBound >> kShadowRatioLog;
 
@@ -81,6 +181,7 @@ bool Shadow::IsClean() {
 void Shadow::Reset() {
   ::memset(shadow_, 0, kShadowSize);
   ::memset(page_bits_, 0, kPageBitsSize);
+  ::memset(block_index_, 0, sizeof(block_index_));
 }
 
 void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
@@ -89,12 +190,14 @@ void Shadow::Poison(const void* addr, size_t size, ShadowMarker shadow_val) {
   DCHECK_EQ(0U, (index + size) & (kShadowRatio - 1));
 
   index >>= kShadowRatioLog;
+  ClearBlockIndex(index, (start + size) >> kShadowRatioLog);
   if (start)
     shadow_[index++] = start;
 
   size >>= kShadowRatioLog;
   DCHECK_GT(arraysize(shadow_), index + size);
   ::memset(shadow_ + index, shadow_val, size);
+  ++poison_epoch_;
 }
 
 void Shadow::Unpoison(const void* addr, size_t size) {
@@ -105,6 +208,7 @@ void Shadow::Unpoison(const void* addr, size_t size) {
   index >>= kShadowRatioLog;
   size >>= kShadowRatioLog;
   DCHECK_GT(arraysize(shadow_), index + size);
+  ClearBlockIndex(index, size + (remainder != 0 ? 1 : 0));
   ::memset(shadow_ + index, kHeapAddressableMarker, size);
 
   if (remainder != 0)
@@ -194,6 +298,7 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
   // This isn't as simple as a memset because we need to preserve left and
   // right redzone padding bytes that may be found in the range.
   MarkAsFreedImpl64(cursor, cursor_end);
+  ++poison_epoch_;
 }
 
 bool Shadow::IsAccessible(const void* addr) {
@@ -213,6 +318,68 @@ bool Shadow::IsAccessible(const void* addr) {
   return start < shadow;
 }
 
+bool Shadow::IsRangeAccessible(const void* addr, size_t size) {
+  return FindFirstPoisonedByte(addr, size) == NULL;
+}
+
+const void* Shadow::FindFirstPoisonedByte(const void* addr, size_t size) {
+  if (size == 0)
+    return NULL;
+
+  const uint8* mem = reinterpret_cast<const uint8*>(addr);
+  const uint8* mem_end = mem + size;
+
+  // Check the bytes up to the first shadow-aligned address individually.
+  const uint8* mem_aligned = ::common::AlignUp(mem, kShadowRatio);
+  for (; mem < mem_end && mem < mem_aligned; ++mem) {
+    if (!IsAccessible(mem))
+      return mem;
+  }
+
+  // The range of shadow markers that entirely cover the remaining bytes of
+  // the range. Each of these must be fully accessible.
+  size_t index = reinterpret_cast<uintptr_t>(mem) >> kShadowRatioLog;
+  size_t index_end = reinterpret_cast<uintptr_t>(mem_end) >> kShadowRatioLog;
+  DCHECK_GE(arraysize(shadow_), index_end);
+
+  // Check individual markers until the cursor is aligned for SSE2 loads.
+  const uint8* cursor = shadow_ + index;
+  const uint8* cursor_end = shadow_ + index_end;
+  const uint8* cursor_aligned = ::common::AlignUp(cursor, sizeof(__m128i));
+  while (cursor < cursor_end && cursor < cursor_aligned && *cursor == 0)
+    ++cursor;
+
+  // Check 16 markers (128 bytes of memory) at a time.
+  if (cursor == cursor_aligned) {
+    const __m128i zero = _mm_setzero_si128();
+    while (static_cast<size_t>(cursor_end - cursor) >= sizeof(__m128i)) {
+      __m128i markers = _mm_load_si128(reinterpret_cast<const __m128i*>(
+          cursor));
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(markers, zero));
+      if (mask != 0xFFFF)
+        break;
+      cursor += sizeof(__m128i);
+    }
+  }
+
+  // Check the remaining fully covered markers individually.
+  while (cursor < cursor_end && *cursor == 0)
+    ++cursor;
+
+  // Finally, check the bytes covered by the first non-zero marker we came
+  // across, or by the last partially covered marker.
+  mem = reinterpret_cast<const uint8*>(
+      (cursor - shadow_) << kShadowRatioLog);
+  for (; mem < mem_end; ++mem) {
+    if (!IsAccessible(mem))
+      return mem;
+  }
+
+  // This can only be reached if the non-zero marker covers the end of the
+  // range.
+  return NULL;
+}
+
 bool Shadow::IsLeftRedzone(const void* address) {
   return ShadowMarkerHelper::IsActiveLeftRedzone(
       GetShadowMarkerForAddress(address));
@@ -312,6 +479,15 @@ void Shadow::PoisonAllocatedBlock(const BlockInfo& info) {
     cursor[-1] = body_size_mod;
   ::memset(cursor, kHeapRightPaddingMarker, right_redzone_bytes - 1);
   ::memset(cursor + right_redzone_bytes - 1, trailer_marker, 1);
+
+  // Large blocks are indexed, unless they are nested. A nested block hides
+  // the pages it overlaps from the index of its parent.
+  if (info.header->is_nested) {
+    ClearBlockIndex(index, block_bytes);
+  } else {
+    IndexBlock(index, block_bytes);
+  }
+  ++poison_epoch_;
 }
 
 bool Shadow::BlockIsNested(const BlockInfo& info) {
@@ -454,7 +630,9 @@ void Shadow::CloneShadowRange(const void* src_pointer,
 
   size_t size_shadow = size >> 3;
 
+  ClearBlockIndex(dst_index, size_shadow);
   memcpy(shadow_ + dst_index, shadow_ + src_index, size_shadow);
+  ++poison_epoch_;
 }
 
 void Shadow::AppendShadowByteText(const char *prefix,
@@ -695,6 +873,62 @@ bool Shadow::ScanRightForBracketingBlockEnd(
   return false;
 }
 
+void Shadow::IndexBlock(size_t index, size_t length) {
+  DCHECK_LT(0u, length);
+  DCHECK_GE(kShadowSize, index + length);
+
+  // Only the pages entirely covered by the block are indexed.
+  size_t entry = (index + (1 << kBlockIndexShadowBytesLog) - 1) >>
+      kBlockIndexShadowBytesLog;
+  size_t entry_end = (index + length) >> kBlockIndexShadowBytesLog;
+  for (; entry < entry_end; ++entry) {
+    block_index_[entry].start = static_cast<uint32>(index);
+    block_index_[entry].end = static_cast<uint32>(index + length - 1);
+  }
+}
+
+void Shadow::ClearBlockIndex(size_t index, size_t length) {
+  if (length == 0)
+    return;
+  DCHECK_GE(kShadowSize, index + length);
+
+  // Most pages aren't indexed, so avoid dirtying their entries.
+  size_t entry = index >> kBlockIndexShadowBytesLog;
+  size_t entry_end =
+      ((index + length - 1) >> kBlockIndexShadowBytesLog) + 1;
+  for (; entry < entry_end; ++entry) {
+    if (block_index_[entry].end != 0) {
+      block_index_[entry].start = 0;
+      block_index_[entry].end = 0;
+    }
+  }
+}
+
+bool Shadow::LookupBlockIndex(size_t cursor, size_t* left, size_t* right) {
+  DCHECK_NE(static_cast<size_t*>(NULL), left);
+  DCHECK_NE(static_cast<size_t*>(NULL), right);
+  DCHECK_GT(kShadowSize, cursor);
+
+  const BlockIndexEntry& entry =
+      block_index_[cursor >> kBlockIndexShadowBytesLog];
+  size_t start = entry.start;
+  size_t end = entry.end;
+  if (end == 0 || start > cursor || end < cursor)
+    return false;
+
+  // Make sure that the entry still describes a non-nested block.
+  if (!ShadowMarkerHelper::IsBlockStart(shadow_[start]) ||
+      ShadowMarkerHelper::IsNestedBlockStart(shadow_[start]) ||
+      !ShadowMarkerHelper::IsBlockEnd(shadow_[end]) ||
+      ShadowMarkerHelper::IsNestedBlockEnd(shadow_[end])) {
+    return false;
+  }
+
+  *left = start;
+  *right = end;
+  return true;
+}
+
 bool Shadow::BlockInfoFromShadowImpl(
     size_t initial_nesting_depth, const void* addr, CompactBlockInfo* info) {
   DCHECK_NE(static_cast<void*>(NULL), addr);
@@ -704,10 +938,14 @@ bool Shadow::BlockInfoFromShadowImpl(
   size_t left = reinterpret_cast<uintptr_t>(addr) / kShadowRatio;
   size_t right = left;
 
-  if (!ScanLeftForBracketingBlockStart(initial_nesting_depth, left, &left))
-    return false;
-  if (!ScanRightForBracketingBlockEnd(initial_nesting_depth, right, &right))
-    return false;
+  // Use the block index if possible, and scan for the block markers
+  // otherwise.
+  if (initial_nesting_depth != 0 || !LookupBlockIndex(left, &left, &right)) {
+    if (!ScanLeftForBracketingBlockStart(initial_nesting_depth, left, &left))
+      return false;
+    if (!ScanRightForBracketingBlockEnd(initial_nesting_depth, right, &right))
+      return false;
+  }
   ++right;
 
   info->block = reinterpret_cast<uint8*>(left * kShadowRatio);
@@ -819,3 +1057,11 @@ bool ShadowWalker::Next(BlockInfo* info) {
 
 }  // namespace asan
 }  // namespace agent
+
+extern "C" {
+
+// This is defined after Shadow::shadow_ in the same translation unit, so it is
+// initialized after the shadow memory is allocated.
+const uint8* asan_shadow_memory = agent::asan::Shadow::shadow();
+
+}  // extern "C"
@@ -93,9 +93,17 @@ class Shadow {
   // need 1 bit per page.
   static const size_t kPageBitsSize = 1 << (31 - 12 - 3);
 
+  // The block index has an entry per 4KB (2^12) page of the 2GB address
+  // space.
+  static const size_t kBlockIndexSize = 1 << (31 - 12);
+
   // The upper bound of the addressable memory.
   static const size_t kAddressUpperBound = kShadowSize << kShadowRatioLog;
 
+  // The granularity at which the shadow memory is committed when lazy
+  // commit is enabled. Each chunk describes 512KB of memory.
+  static const size_t kLazyCommitGranularity = 64 * 1024;
+
   // The number of shadow bytes to emit per line of a report.
   static const size_t kShadowBytesPerLine = 8;
 
@@ -110,9 +118,32 @@ class Shadow {
   // Set up the shadow memory.
   static void SetUp();
 
-  // Tear down the shadow memory.
+  // Tear down the shadow memory. This disables lazy commit if it was enabled.
   static void TearDown();
 
+  // Enables lazy commit of the shadow memory. This decommits the chunks of
+  // shadow memory that are entirely zero, which describe fully addressable
+  // memory, and installs a vectored exception handler that commits them
+  // again on first access. This bounds the commit charge of the shadow
+  // memory by the amount of memory that is actually poisoned or accessed,
+  // rather than by the size of the address space.
+  // @note Accesses to decommitted chunks raise first-chance access
+  //     violations, which will be visible to an attached debugger.
+  // @note A write to the shadow memory that races with this call may be
+  //     lost, so it must be done before other threads start using the
+  //     runtime.
+  // @returns true on success, false otherwise.
+  static bool EnableLazyCommit();
+
+  // Disables lazy commit of the shadow memory. This commits all of the shadow
+  // memory again and removes the exception handler.
+  static void DisableLazyCommit();
+
+  // @returns true if lazy commit of the shadow memory is enabled.
+  static bool lazy_commit_enabled() {
+    return lazy_commit_handler_ != NULL;
+  }
+
   // Poisons @p size bytes starting at @p addr with @p shadow_val value.
   // @pre addr + size mod 8 == 0.
   // @param address The starting address.
@@ -139,6 +170,22 @@ class Shadow {
   // @returns true if this address is accessible, false otherwise.
   static bool IsAccessible(const void* addr);
 
+  // Determines if an entire range of memory is accessible. This scans the
+  // shadow memory 16 markers at a time using SSE2, so it is suitable for
+  // checking large ranges.
+  // @param addr The starting address of the range.
+  // @param size The size of the range, in bytes.
+  // @returns true if each of the @p size bytes starting at @p addr is
+  //     accessible, false otherwise. An empty range is always accessible.
+  static bool IsRangeAccessible(const void* addr, size_t size);
+
+  // Finds the first byte of a range of memory that is not accessible.
+  // @param addr The starting address of the range.
+  // @param size The size of the range, in bytes.
+  // @returns a pointer to the first inaccessible byte in the range, or NULL if
+  //     the entire range is accessible.
+  static const void* FindFirstPoisonedByte(const void* addr, size_t size);
+
   // @param address The address that we want to check.
   // @returns true if the byte at @p address is an active left redzone.
   static bool IsLeftRedzone(const void* address);
@@ -277,6 +324,14 @@ class Shadow {
   // Read only accessor of page protection bits.
   static const uint8* page_bits() { return page_bits_; }
 
+  // Returns a counter that is bumped after each operation that may make some
+  // memory less accessible (poisoning, freeing, laying out a block, cloning a
+  // range). If the counter is unchanged across a call and the ranges it
+  // touches were accessible before the call then they still are, so their
+  // checks need not be repeated.
+  // @note Concurrent bumps may be lost, but the counter still changes.
+  static uint32 poison_epoch() { return poison_epoch_; }
+
   // Determines if the shadow memory is clean. That is, it reflects the
   // state of shadow memory immediately after construction and a call to
   // SetUp.
@@ -295,6 +350,36 @@ class Shadow {
                                    std::string* output,
                                    size_t bug_index);
 
+  // An entry of the block index. This describes the non-nested block that
+  // covers the whole page of the entry, as the shadow indices of its first
+  // and last bytes. Both are zero if the page isn't indexed.
+  struct BlockIndexEntry {
+    uint32 start;
+    uint32 end;
+  };
+
+  // Indexes a non-nested block, by pointing the entries of the pages it
+  // entirely covers at it.
+  // @param index The shadow index of the first byte of the block.
+  // @param length The size of the block in shadow bytes.
+  static void IndexBlock(size_t index, size_t length);
+
+  // Clears the entries of the block index overlapping a range of shadow
+  // memory. This must be done whenever block markers may be overwritten.
+  // @param index The shadow index of the first byte of the range.
+  // @param length The size of the range in shadow bytes.
+  static void ClearBlockIndex(size_t index, size_t length);
+
+  // Looks up the outermost block containing a cursor in the block index. As
+  // the index is updated without a lock, the entry is validated against the
+  // shadow memory before being used.
+  // @param cursor The position in shadow memory to look up.
+  // @param left Will be set to the location of the block start marker.
+  // @param right Will be set to the location of the block end marker.
+  // @returns true if a valid entry was found. If a page is indexed then no
+  //     nested block overlaps it, so this is also the innermost block.
+  static bool LookupBlockIndex(size_t cursor, size_t* left, size_t* right);
+
   // Scans to the left of the provided cursor, looking for the presence of a
   // block start marker that brackets the cursor.
   // @param initial_nesting_depth If zero then this will return the inner
@@ -327,8 +412,14 @@ class Shadow {
   static bool BlockInfoFromShadowImpl(
       size_t initial_nesting_depth, const void* addr, CompactBlockInfo* info);
 
-  // The shadow memory.
-  static uint8 shadow_[kShadowSize];
+  // The shadow memory. This is a contiguous reservation of kShadowSize bytes,
+  // allocated and committed when the runtime is loaded. The memory
+  // interceptors index directly into it.
+  static uint8* shadow_;
+
+  // The handle of the lazy commit exception handler, or NULL if lazy commit
+  // isn't enabled.
+  static void* lazy_commit_handler_;
 
   // A lock under which page protection bits are modified.
   static base::Lock page_bits_lock_;
@@ -336,6 +427,15 @@ class Shadow {
   // Data about which pages are protected. This changes relatively rarely, so
   // is reasonable to synchronize.
   static uint8 page_bits_[kPageBitsSize];  // Under page_bits_lock_.
+
+  // The block index. This speeds up finding the bounds of large blocks, which
+  // otherwise requires scanning the shadow memory of the whole block. It is
+  // maintained as blocks are laid out and their markers are overwritten.
+  static BlockIndexEntry block_index_[kBlockIndexSize];
+
+  // The counter returned by poison_epoch. This is bumped after the shadow
+  // memory has been modified.
+  static volatile uint32 poison_epoch_;
 };
 
 // A helper class to walk over the blocks contained in a given memory region.
@@ -391,4 +491,12 @@ class ShadowWalker {
 }  // namespace asan
 }  // namespace agent
 
+extern "C" {
+
+// The address of the shadow memory, exported so that instrumented code can
+// inline the fast path of the access checks.
+extern const uint8* asan_shadow_memory;
+
+}  // extern "C"
+
 #endif  // SYZYGY_AGENT_ASAN_SHADOW_H_
@@ -14,6 +14,8 @@
 
 #include "syzygy/agent/asan/shadow.h"
 
+#include <windows.h>
+
 #include "base/rand_util.h"
 #include "base/memory/scoped_ptr.h"
 #include "gtest/gtest.h"
@@ -28,9 +30,11 @@ namespace {
 // A derived class to expose protected members for unit-testing.
 class TestShadow : public Shadow {
  public:
+  using Shadow::LookupBlockIndex;
   using Shadow::Reset;
   using Shadow::ScanLeftForBracketingBlockStart;
   using Shadow::ScanRightForBracketingBlockEnd;
+  using Shadow::kLazyCommitGranularity;
   using Shadow::kShadowSize;
   using Shadow::shadow_;
 };
@@ -65,6 +69,69 @@ TEST(ShadowTest, PoisonUnpoisonAccess) {
   }
 }
 
+TEST(ShadowTest, IsRangeAccessible) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+  const uint8* addr = reinterpret_cast<const uint8*>(0x1000000);
+  const size_t kSize = 1024;
+
+  // Empty ranges are always accessible.
+  EXPECT_TRUE(Shadow::IsRangeAccessible(addr, 0));
+  EXPECT_EQ(NULL, Shadow::FindFirstPoisonedByte(addr, 0));
+
+  // Try ranges with all combinations of alignment of the start and end.
+  for (size_t start = 0; start < 2 * kShadowRatio; ++start) {
+    for (size_t end = kSize - 2 * kShadowRatio; end <= kSize; ++end) {
+      EXPECT_TRUE(Shadow::IsRangeAccessible(addr + start, end - start));
+      EXPECT_EQ(NULL,
+                Shadow::FindFirstPoisonedByte(addr + start, end - start));
+    }
+  }
+
+  // Poison a single granule at various positions in the range, including
+  // ones that fall in the SSE2 scanned portion.
+  for (size_t offset = 0; offset < kSize; offset += kShadowRatio) {
+    Shadow::Poison(addr + offset, kShadowRatio, kHeapLeftPaddingMarker);
+    EXPECT_FALSE(Shadow::IsRangeAccessible(addr, kSize));
+    EXPECT_EQ(addr + offset, Shadow::FindFirstPoisonedByte(addr, kSize));
+    if (offset > 0) {
+      EXPECT_EQ(addr + offset, Shadow::FindFirstPoisonedByte(addr + 1,
+                                                             kSize - 1));
+      EXPECT_TRUE(Shadow::IsRangeAccessible(addr, offset));
+      EXPECT_TRUE(Shadow::IsRangeAccessible(addr + 3, offset - 3));
+    }
+    Shadow::Unpoison(addr + offset, kShadowRatio);
+  }
+
+  // Partially addressable granules are handled byte by byte.
+  Shadow::Unpoison(addr, kSize - 3);
+  EXPECT_TRUE(Shadow::IsRangeAccessible(addr, kSize - 3));
+  EXPECT_EQ(addr + kSize - 3, Shadow::FindFirstPoisonedByte(addr, kSize));
+  Shadow::Unpoison(addr, kSize);
+
+  Shadow::Unpoison(addr + 512, 5);
+  Shadow::Poison(addr + 520, kShadowRatio, kHeapRightPaddingMarker);
+  EXPECT_EQ(addr + 517, Shadow::FindFirstPoisonedByte(addr, kSize));
+  EXPECT_TRUE(Shadow::IsRangeAccessible(addr + 16, 501));
+  EXPECT_FALSE(Shadow::IsRangeAccessible(addr + 16, 502));
+  Shadow::Unpoison(addr, kSize);
+}
+
+TEST(ShadowTest, IsRangeAccessiblePerfTest) {
+  std::vector<uint8> buf;
+  buf.resize(10 * 1024 * 1024, 0);
+  Shadow::Unpoison(buf.data(), buf.size());
+
+  uint64 tnet = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    uint64 t0 = ::__rdtsc();
+    EXPECT_TRUE(Shadow::IsRangeAccessible(buf.data(), buf.size()));
+    uint64 t1 = ::__rdtsc();
+    tnet += t1 - t0;
+  }
+  testing::EmitMetric("Syzygy.Asan.Shadow.IsRangeAccessible", tnet);
+}
+
 TEST(ShadowTest, SetUpAndTearDown) {
   // Reset the shadow memory.
   TestShadow::Reset();
@@ -94,6 +161,50 @@ TEST(ShadowTest, SetUpAndTearDown) {
     ASSERT_EQ(kHeapAddressableMarker, TestShadow::shadow_[i]);
 }
 
+TEST(ShadowTest, LazyCommit) {
+  // Reset the shadow memory.
+  TestShadow::Reset();
+  Shadow::SetUp();
+
+  // Choose some memory whose shadow lives in a chunk on its own.
+  const size_t kChunkCoverage =
+      TestShadow::kLazyCommitGranularity << kShadowRatioLog;
+  const uint8* addr = reinterpret_cast<const uint8*>(100 * kChunkCoverage);
+  const uint8* shadow = TestShadow::shadow_ +
+      (reinterpret_cast<uintptr_t>(addr) >> kShadowRatioLog);
+
+  EXPECT_FALSE(Shadow::lazy_commit_enabled());
+  ASSERT_TRUE(Shadow::EnableLazyCommit());
+  EXPECT_TRUE(Shadow::lazy_commit_enabled());
+
+  // The chunk should have been decommitted, as it's entirely zero.
+  MEMORY_BASIC_INFORMATION info = {};
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(shadow, &info, sizeof(info)));
+  EXPECT_EQ(MEM_RESERVE, info.State);
+
+  // Reading and writing the shadow should transparently commit it again.
+  EXPECT_TRUE(Shadow::IsAccessible(addr));
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(shadow, &info, sizeof(info)));
+  EXPECT_EQ(MEM_COMMIT, info.State);
+  Shadow::Poison(addr, kShadowRatio, kUserRedzoneMarker);
+  EXPECT_FALSE(Shadow::IsAccessible(addr));
+  Shadow::Unpoison(addr, kShadowRatio);
+  EXPECT_TRUE(Shadow::IsAccessible(addr));
+
+  // Chunks that contain poisoned markers are left alone.
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(TestShadow::shadow_, &info,
+                                         sizeof(info)));
+  EXPECT_EQ(MEM_COMMIT, info.State);
+
+  // Tearing down commits everything again.
+  Shadow::TearDown();
+  EXPECT_FALSE(Shadow::lazy_commit_enabled());
+  ASSERT_EQ(sizeof(info), ::VirtualQuery(TestShadow::shadow_, &info,
+                                         sizeof(info)));
+  EXPECT_EQ(MEM_COMMIT, info.State);
+  EXPECT_EQ(TestShadow::kShadowSize, info.RegionSize);
+}
+
 TEST(ShadowTest, GetNullTerminatedArraySize) {
   // Reset the shadow memory.
   TestShadow::Reset();
@@ -240,6 +351,37 @@ TEST(ShadowTest, PoisonAllocatedBlock) {
   delete [] data;
 }
 
+TEST(ShadowTest, PoisonEpoch) {
+  BlockLayout layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 16, 0, 0, &layout));
+  uint8* data = new uint8[2 * layout.block_size];
+  BlockInfo info = {};
+  BlockInitialize(layout, data, false, &info);
+
+  // Making memory accessible, or simply inspecting it, leaves the epoch
+  // untouched.
+  uint32 epoch = Shadow::poison_epoch();
+  Shadow::Unpoison(data, 2 * layout.block_size);
+  EXPECT_TRUE(Shadow::IsRangeAccessible(data, 2 * layout.block_size));
+  EXPECT_EQ(epoch, Shadow::poison_epoch());
+
+  // Each operation that may make memory inaccessible bumps it.
+  Shadow::PoisonAllocatedBlock(info);
+  EXPECT_NE(epoch, Shadow::poison_epoch());
+  epoch = Shadow::poison_epoch();
+  Shadow::MarkAsFreed(info.body, info.body_size);
+  EXPECT_NE(epoch, Shadow::poison_epoch());
+  epoch = Shadow::poison_epoch();
+  Shadow::CloneShadowRange(data, data + layout.block_size, layout.block_size);
+  EXPECT_NE(epoch, Shadow::poison_epoch());
+  epoch = Shadow::poison_epoch();
+  Shadow::Poison(data, kShadowRatio, kUserRedzoneMarker);
+  EXPECT_NE(epoch, Shadow::poison_epoch());
+
+  Shadow::Unpoison(data, 2 * layout.block_size);
+  delete [] data;
+}
+
 TEST(ShadowTest, ScanLeftAndRight) {
   size_t offset = Shadow::kShadowSize / 2;
   size_t l = 0;
@@ -449,6 +591,66 @@ TEST(ShadowTest, BlockInfoFromShadow) {
   EXPECT_NO_FATAL_FAILURE(TestBlockInfoFromShadow(layout2, layout0));
 }
 
+TEST(ShadowTest, BlockIndex) {
+  // Plan a block that covers several whole pages, and a small block to be
+  // nested inside of it.
+  const size_t kPageSize = 4096;
+  BlockLayout outer_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 4 * kPageSize, 0,
+                              0, &outer_layout));
+  BlockLayout nested_layout = {};
+  EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 16, 0, 0,
+                              &nested_layout));
+
+  uint8* data = new uint8[outer_layout.block_size];
+  BlockInfo outer = {};
+  BlockInitialize(outer_layout, data, false, &outer);
+  Shadow::PoisonAllocatedBlock(outer);
+
+  // The pages in the middle of the block are indexed.
+  size_t outer_start = reinterpret_cast<uintptr_t>(outer.block) / kShadowRatio;
+  size_t outer_end = outer_start + outer.block_size / kShadowRatio - 1;
+  uint8* middle = outer.body + outer.body_size / 2;
+  size_t cursor = reinterpret_cast<uintptr_t>(middle) / kShadowRatio;
+  size_t left = 0;
+  size_t right = 0;
+  EXPECT_TRUE(TestShadow::LookupBlockIndex(cursor, &left, &right));
+  EXPECT_EQ(outer_start, left);
+  EXPECT_EQ(outer_end, right);
+
+  BlockInfo info = {};
+  EXPECT_TRUE(Shadow::BlockInfoFromShadow(middle, &info));
+  EXPECT_EQ(outer.block, info.block);
+  EXPECT_EQ(outer.block_size, info.block_size);
+  EXPECT_EQ(outer.body_size, info.body_size);
+
+  // A nested block hides the pages that it overlaps, but not the others.
+  BlockInfo nested = {};
+  BlockInitialize(nested_layout, middle, true, &nested);
+  Shadow::PoisonAllocatedBlock(nested);
+  EXPECT_FALSE(TestShadow::LookupBlockIndex(cursor, &left, &right));
+  EXPECT_TRUE(Shadow::BlockInfoFromShadow(middle, &info));
+  EXPECT_EQ(nested.block, info.block);
+  EXPECT_TRUE(Shadow::ParentBlockInfoFromShadow(nested, &info));
+  EXPECT_EQ(outer.block, info.block);
+
+  uint8* first_page = ::common::AlignUp(outer.block, kPageSize);
+  cursor = reinterpret_cast<uintptr_t>(first_page) / kShadowRatio;
+  EXPECT_TRUE(TestShadow::LookupBlockIndex(cursor, &left, &right));
+  EXPECT_EQ(outer_start, left);
+
+  // Freeing the block preserves its markers, and thus its index.
+  Shadow::MarkAsFreed(outer.body, outer.body_size);
+  EXPECT_TRUE(TestShadow::LookupBlockIndex(cursor, &left, &right));
+
+  // Returning the block to the heap clears its index.
+  Shadow::Unpoison(data, outer_layout.block_size);
+  EXPECT_FALSE(TestShadow::LookupBlockIndex(cursor, &left, &right));
+  EXPECT_FALSE(Shadow::BlockInfoFromShadow(first_page, &info));
+
+  delete [] data;
+}
+
 TEST(ShadowTest, IsBeginningOfBlockBody) {
   BlockLayout l = {};
   EXPECT_TRUE(BlockPlanLayout(kShadowRatio, kShadowRatio, 7, 0, 0, &l));
@@ -83,26 +83,28 @@ bool StackCaptureCache::CachePage::ReturnStackCapture(
 StackCaptureCache::StackCaptureCache(AsanLogger* logger)
     : logger_(logger),
       max_num_frames_(common::StackCapture::kMaxNumFrames),
-      current_page_(new CachePage(NULL)) {
+      current_page_(new CachePage(NULL)),
+      requested_(0) {
   CHECK(current_page_ != NULL);
   DCHECK(logger_ != NULL);
-  ::memset(&statistics_, 0, sizeof(statistics_));
+  ::memset(statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
-  statistics_.size = sizeof(CachePage);
+  statistics_[0].size = sizeof(CachePage);
 }
 
 StackCaptureCache::StackCaptureCache(AsanLogger* logger, size_t max_num_frames)
     : logger_(logger),
       max_num_frames_(0),
-      current_page_(new CachePage(NULL)) {
+      current_page_(new CachePage(NULL)),
+      requested_(0) {
   CHECK(current_page_ != NULL);
   DCHECK(logger_ != NULL);
   DCHECK_LT(0u, max_num_frames);
   max_num_frames_ = static_cast<uint8>(
       std::min(max_num_frames, common::StackCapture::kMaxNumFrames));
-  ::memset(&statistics_, 0, sizeof(statistics_));
+  ::memset(statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
-  statistics_.size = sizeof(CachePage);
+  statistics_[0].size = sizeof(CachePage);
 }
 
 StackCaptureCache::~StackCaptureCache() {
@@ -125,15 +127,17 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
   DCHECK_NE(num_frames, 0U);
   DCHECK(current_page_ != NULL);
 
-  bool already_cached = false;
   common::StackCapture* stack_trace = NULL;
-  bool saturated = false;
+  bool must_log = false;
 
   {
     size_t known_stack_shard = stack_id % kKnownStacksSharding;
     // Get or insert the current stack trace while under the lock for this
-    // bucket.
+    // bucket. This same lock protects the statistics of this bucket, so that
+    // the common case of a previously seen stack doesn't touch any global
+    // lock.
     base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+    Statistics& statistics = statistics_[known_stack_shard];
 
     // Check if the stack capture is already in the cache map.
     common::StackCapture capture;
@@ -142,8 +146,9 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
 
     // If this capture has not already been cached then we have to initialize
     // the data.
+    bool already_cached = false;
     if (result == known_stacks_[known_stack_shard].end()) {
-      stack_trace = GetStackCapture(num_frames);
+      stack_trace = GetStackCapture(num_frames, &statistics);
       DCHECK(stack_trace != NULL);
       stack_trace->InitFromBuffer(stack_id, frames, num_frames);
       std::pair<StackSet::iterator, bool> it =
@@ -155,46 +160,43 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
       stack_trace = *result;
     }
     // Increment the reference count for this stack trace.
+    bool saturated = false;
     if (!stack_trace->RefCountIsSaturated()) {
       stack_trace->AddRef();
     } else {
       saturated = true;
     }
-  }
-  DCHECK(stack_trace != NULL);
 
-  bool must_log = false;
-  Statistics statistics = {};
-  // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    if (already_cached) {
-      // If the existing stack capture is previously unreferenced and becoming
-      // referenced again, then decrement the unreferenced counter.
-      if (stack_trace->HasNoRefs()) {
-        DCHECK_LT(0u, statistics_.unreferenced);
-        --statistics_.unreferenced;
+    // Update the statistics.
+    if (compression_reporting_period_ != 0) {
+      if (already_cached) {
+        // If the existing stack capture is previously unreferenced and
+        // becoming referenced again, then decrement the unreferenced counter.
+        if (stack_trace->HasNoRefs())
+          --statistics.unreferenced;
+      } else {
+        ++statistics.cached;
+        statistics.frames_alive += num_frames;
+        ++statistics.allocated;
       }
-    } else {
-      ++statistics_.cached;
-      statistics_.frames_alive += num_frames;
-      ++statistics_.allocated;
-    }
-    if (!saturated && stack_trace->RefCountIsSaturated()) {
-      saturated = true;
-      ++statistics_.saturated;
-    }
-    ++statistics_.requested;
-    ++statistics_.references;
-    statistics_.frames_stored += num_frames;
-    if (statistics_.requested % compression_reporting_period_ == 0) {
-      must_log = true;
-      GetStatisticsUnlocked(&statistics);
+      if (!saturated && stack_trace->RefCountIsSaturated())
+        ++statistics.saturated;
+      ++statistics.requested;
+      ++statistics.references;
+      statistics.frames_stored += num_frames;
+
+      uint32 requested = static_cast<uint32>(
+          base::subtle::NoBarrier_AtomicIncrement(&requested_, 1));
+      if (requested % compression_reporting_period_ == 0)
+        must_log = true;
     }
   }
+  DCHECK(stack_trace != NULL);
 
+  // The statistics are gathered from all of the shards, so this must be done
+  // outside of the lock.
   if (must_log)
-    LogStatisticsImpl(statistics);
+    LogStatistics();
 
   // Return the stack trace pointer that is now in the cache.
   return stack_trace;
@@ -212,39 +214,36 @@ void StackCaptureCache::ReleaseStackTrace(
   DCHECK(stack_capture != NULL);
 
   size_t known_stack_shard = stack_capture->stack_id() % kKnownStacksSharding;
-  bool add_to_reclaimed_list = false;
-  common::StackCapture* stack = NULL;
-  {
-    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+  base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+  Statistics& statistics = statistics_[known_stack_shard];
 
-    // We own the stack so its fine to remove the const. We double check this
-    // is the case in debug builds with the DCHECK.
-    stack = const_cast<common::StackCapture*>(stack_capture);
-    DCHECK(known_stacks_[known_stack_shard].find(stack) !=
-        known_stacks_[known_stack_shard].end());
+  // We own the stack so its fine to remove the const. We double check this
+  // is the case in debug builds with the DCHECK.
+  common::StackCapture* stack = const_cast<common::StackCapture*>(
+      stack_capture);
+  DCHECK(known_stacks_[known_stack_shard].find(stack) !=
+      known_stacks_[known_stack_shard].end());
 
-    stack->RemoveRef();
+  stack->RemoveRef();
 
-    if (stack->HasNoRefs()) {
-      add_to_reclaimed_list = true;
-      // Remove this from the known stacks as we're going to reclaim it and
-      // overwrite part of its data as we insert into the reclaimed_ list.
-      size_t num_erased = known_stacks_[known_stack_shard].erase(stack);
-      DCHECK_EQ(num_erased, 1u);
-    }
+  bool add_to_reclaimed_list = false;
+  if (stack->HasNoRefs()) {
+    add_to_reclaimed_list = true;
+    // Remove this from the known stacks as we're going to reclaim it and
+    // overwrite part of its data as we insert into the reclaimed_ list.
+    size_t num_erased = known_stacks_[known_stack_shard].erase(stack);
+    DCHECK_EQ(num_erased, 1u);
   }
 
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    DCHECK_LT(0u, statistics_.references);
-    --statistics_.references;
-    statistics_.frames_stored -= stack->num_frames();
+    --statistics.references;
+    statistics.frames_stored -= stack->num_frames();
     if (add_to_reclaimed_list) {
-      --statistics_.cached;
-      ++statistics_.unreferenced;
+      --statistics.cached;
+      ++statistics.unreferenced;
       // The frames in this stack capture are no longer alive.
-      statistics_.frames_alive -= stack->num_frames();
+      statistics.frames_alive -= stack->num_frames();
     }
   }
 
@@ -252,7 +251,7 @@ void StackCaptureCache::ReleaseStackTrace(
   // must come after the statistics updating, as we modify the |num_frames|
   // parameter in place.
   if (add_to_reclaimed_list)
-    AddStackCaptureToReclaimedList(stack);
+    AddStackCaptureToReclaimedList(stack, &statistics);
 }
 
 bool StackCaptureCache::StackCapturePointerIsValid(
@@ -289,22 +288,30 @@ bool StackCaptureCache::StackCapturePointerIsValid(
 
 void StackCaptureCache::LogStatistics()  {
   Statistics statistics = {};
-
-  {
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(&statistics);
-  }
-
+  GetStatistics(&statistics);
   LogStatisticsImpl(statistics);
 }
 
-void StackCaptureCache::GetStatisticsUnlocked(Statistics* statistics) const {
-#ifndef NDEBUG
-  stats_lock_.AssertAcquired();
-#endif
-
+void StackCaptureCache::GetStatistics(Statistics* statistics) const {
   DCHECK(statistics != NULL);
-  *statistics = statistics_;
+  ::memset(statistics, 0, sizeof(*statistics));
+
+  // Individual shards may have wrapped around, but the unsigned sums are
+  // always exact.
+  for (size_t i = 0; i < kKnownStacksSharding; ++i) {
+    base::AutoLock auto_lock(known_stacks_locks_[i]);
+    const Statistics& shard = statistics_[i];
+    statistics->cached += shard.cached;
+    statistics->size += shard.size;
+    statistics->saturated += shard.saturated;
+    statistics->unreferenced += shard.unreferenced;
+    statistics->requested += shard.requested;
+    statistics->allocated += shard.allocated;
+    statistics->references += shard.references;
+    statistics->frames_stored += shard.frames_stored;
+    statistics->frames_alive += shard.frames_alive;
+    statistics->frames_dead += shard.frames_dead;
+  }
 }
 
 void StackCaptureCache::LogStatisticsImpl(const Statistics& statistics) const {
@@ -341,7 +348,9 @@ void StackCaptureCache::LogStatisticsImpl(const Statistics& statistics) const {
       statistics.cached));
 }
 
-common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
+common::StackCapture* StackCaptureCache::GetStackCapture(
+    size_t num_frames, Statistics* statistics) {
+  DCHECK(statistics != NULL);
   common::StackCapture* stack_capture = NULL;
 
   // First look to the reclaimed stacks and try to use one of those. We'll use
@@ -360,10 +369,9 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
 
   if (stack_capture != NULL) {
     if (compression_reporting_period_ != 0) {
-      base::AutoLock stats_lock(stats_lock_);
       // These frames are no longer dead, but in limbo. If the stack capture
       // is used they'll be added to frames_alive and frames_stored.
-      statistics_.frames_dead -= stack_capture->max_num_frames();
+      statistics->frames_dead -= stack_capture->max_num_frames();
     }
     return stack_capture;
   }
@@ -397,20 +405,18 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
     // allocate a new stack capture.
     current_page_ = new CachePage(current_page_);
     CHECK(current_page_ != NULL);
-    statistics_.size += sizeof(CachePage);
+    statistics->size += sizeof(CachePage);
     stack_capture = current_page_->GetNextStackCapture(num_frames);
   }
 
   if (unused_stack_capture != NULL) {
     // We're creating an unreferenced stack capture.
-    AddStackCaptureToReclaimedList(unused_stack_capture);
+    AddStackCaptureToReclaimedList(unused_stack_capture, statistics);
   }
 
   // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    ++statistics_.unreferenced;
-  }
+  if (compression_reporting_period_ != 0)
+    ++statistics->unreferenced;
 
   DCHECK(stack_capture != NULL);
   return stack_capture;
@@ -428,8 +434,9 @@ class PrivateStackCapture : public common::StackCapture {
 }
 
 void StackCaptureCache::AddStackCaptureToReclaimedList(
-    common::StackCapture* stack_capture) {
+    common::StackCapture* stack_capture, Statistics* statistics) {
   DCHECK(stack_capture != NULL);
+  DCHECK(statistics != NULL);
 
   // Make the stack capture internally inconsistent so that it can't be
   // interpreted as being valid. This is rewritten upon reuse so not
@@ -446,10 +453,8 @@ void StackCaptureCache::AddStackCaptureToReclaimedList(
   }
 
   // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    statistics_.frames_dead += stack_capture->max_num_frames();
-  }
+  if (compression_reporting_period_ != 0)
+    statistics->frames_dead += stack_capture->max_num_frames();
 }
 
 }  // namespace asan
@@ -15,6 +15,7 @@
 #ifndef SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 #define SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 
+#include "base/atomicops.h"
 #include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/common/stack_capture.h"
@@ -166,24 +167,31 @@ class StackCaptureCache {
     // @}
   };
 
-  // Gets the current cache statistics. This must be called under lock_.
+  // Gets the current cache statistics. This acquires each of the
+  // known_stacks_locks_ in turn and aggregates the per-shard statistics.
   // @param statistics Will be populated with current cache statistics.
-  void GetStatisticsUnlocked(Statistics* statistics) const;
+  void GetStatistics(Statistics* statistics) const;
 
   // Implementation function for logging statistics.
   // @param report The statistics to be reported.
   void LogStatisticsImpl(const Statistics& statistics) const;
 
   // Grabs a temporary StackCapture from reclaimed_ or the current CachePage.
-  // Must be called under lock_. Takes care of updating frames_dead.
+  // Must be called under the known_stacks_locks_ entry that owns
+  // @p statistics. Takes care of updating frames_dead.
   // @param num_frames The minimum number of frames that are required.
-  common::StackCapture* GetStackCapture(size_t num_frames);
+  // @param statistics The per-shard statistics to be updated.
+  common::StackCapture* GetStackCapture(size_t num_frames,
+                                        Statistics* statistics);
 
   // Links a stack capture into the reclaimed_ list. Meant to be called by
-  // ReturnStackCapture only. Must be called under lock_. Takes care of
-  // updating frames_dead (on behalf of ReturnStackCapture).
+  // ReturnStackCapture only. Must be called under the known_stacks_locks_
+  // entry that owns @p statistics. Takes care of updating frames_dead (on
+  // behalf of ReturnStackCapture).
   // @param stack_capture The stack capture to be linked into reclaimed_.
-  void AddStackCaptureToReclaimedList(common::StackCapture* stack_capture);
+  // @param statistics The per-shard statistics to be updated.
+  void AddStackCaptureToReclaimedList(common::StackCapture* stack_capture,
+                                      Statistics* statistics);
 
   // The default number of known stacks sets that we keep.
   static const size_t kKnownStacksSharding = 16;
@@ -213,11 +221,18 @@ class StackCaptureCache {
   // Accessed under current_page_lock_.
   CachePage* current_page_;
 
-  // A lock protecting access to statistics_.
-  mutable base::Lock stats_lock_;
-
-  // Aggregate statistics about the cache. Accessed under stats_lock_.
-  Statistics statistics_;
+  // Statistics about the cache, sharded in the same manner as the known stacks
+  // sets so that they can be updated without taking a global lock on every
+  // allocation. Each entry is accessed under the corresponding
+  // known_stacks_locks_ entry; they are only aggregated by GetStatistics. As
+  // stack captures migrate between shards via the reclaimed_ lists the
+  // individual counters of a shard may wrap around, but their sum is always
+  // exact.
+  Statistics statistics_[kKnownStacksSharding];
+
+  // The total number of stack traces requested, used to determine when to
+  // report the compression ratio. Only ever modified via atomic operations.
+  volatile base::subtle::Atomic32 requested_;
 
   // Locks to protect each reclaimed list from concurrent access.
   base::Lock reclaimed_locks_[common::StackCapture::kMaxNumFrames + 1];
@@ -15,6 +15,8 @@
 #include "syzygy/agent/asan/stack_capture_cache.h"
 
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/asan_logger.h"
 
@@ -35,12 +37,7 @@ class TestStackCaptureCache : public StackCaptureCache {
   }
 
   using StackCaptureCache::Statistics;
-
-  void GetStatistics(Statistics* s) {
-    DCHECK(s != NULL);
-    base::AutoLock auto_lock(stats_lock_);
-    GetStatisticsUnlocked(s);
-  }
+  using StackCaptureCache::GetStatistics;
 
   CachePage* current_page() { return current_page_; }
 
@@ -48,6 +45,36 @@ class TestStackCaptureCache : public StackCaptureCache {
   using StackCaptureCache::current_page_;
 };
 
+// Repeatedly saves and releases a small set of synthetic stack traces.
+class SaveStackTraceRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kNumStacks = 64;
+  static const size_t kNumIterations = 1000;
+
+  explicit SaveStackTraceRunner(StackCaptureCache* cache) : cache_(cache) {
+    DCHECK(cache != NULL);
+  }
+
+  virtual void Run() {
+    void* frames[10] = {};
+    for (size_t i = 0; i < kNumIterations; ++i) {
+      StackCapture::StackId stack_id = i % kNumStacks;
+      for (size_t j = 0; j < arraysize(frames); ++j)
+        frames[j] = reinterpret_cast<void*>(stack_id + j + 1);
+      const StackCapture* stack = cache_->SaveStackTrace(
+          stack_id, frames, arraysize(frames));
+      ASSERT_TRUE(stack != NULL);
+      EXPECT_EQ(stack_id, stack->stack_id());
+      cache_->ReleaseStackTrace(stack);
+    }
+  }
+
+ private:
+  StackCaptureCache* cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(SaveStackTraceRunner);
+};
+
 class StackCaptureCacheTest : public testing::Test {
  public:
   void SetUp() OVERRIDE {
@@ -325,6 +352,41 @@ TEST_F(StackCaptureCacheTest, Statistics) {
   EXPECT_EQ(s1_frames, s.frames_dead);
 }
 
+TEST_F(StackCaptureCacheTest, ConcurrentStatistics) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  // Use a period that is never reached so that nothing gets logged.
+  cache.set_compression_reporting_period(0xFFFFFFFF);
+
+  static const size_t kNumThreads = 8;
+  SaveStackTraceRunner runner(&cache);
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    threads.push_back(
+        new base::DelegateSimpleThread(&runner, "SaveStackTraceRunner"));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < kNumThreads; ++i)
+    threads[i]->Join();
+
+  // The statistics are aggregated across all of the shards, and should be
+  // consistent once all of the references have been released.
+  TestStackCaptureCache::Statistics s = {};
+  cache.GetStatistics(&s);
+  EXPECT_EQ(0u, s.cached);
+  EXPECT_EQ(0u, s.references);
+  EXPECT_EQ(0u, s.frames_stored);
+  EXPECT_EQ(0u, s.frames_alive);
+  EXPECT_EQ(kNumThreads * SaveStackTraceRunner::kNumIterations, s.requested);
+  EXPECT_GE(s.allocated, SaveStackTraceRunner::kNumStacks);
+  EXPECT_LT(0u, s.unreferenced);
+  EXPECT_LT(0u, s.frames_dead);
+  EXPECT_EQ(sizeof(TestStackCaptureCache::CachePage), s.size);
+
+  cache.set_compression_reporting_period(
+      StackCaptureCache::GetDefaultCompressionReportingPeriod());
+}
+
 TEST_F(StackCaptureCacheTest, CachePagesArePoisoned) {
   scoped_ptr<TestStackCaptureCache::CachePage> page(
       new TestStackCaptureCache::CachePage(NULL));
@@ -0,0 +1,322 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Micro-benchmarks of the hot paths of the SyzyASan runtime. Each benchmark
+// emits the average number of CPU cycles per operation as a metric named
+// "Syzygy.Asan.Benchmark.<operation>", which ends up on the dashboard when
+// SYZYGY_UNITTEST_METRICS is set. The benchmarks only check that the runtime
+// doesn't report any error, and are meant to be compared from one build to the
+// next on a quiet machine.
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/asan_crt_interceptors.h"
+#include "syzygy/agent/asan/asan_runtime.h"
+#include "syzygy/agent/asan/memory_interceptors.h"
+#include "syzygy/agent/asan/stack_capture_cache.h"
+#include "syzygy/agent/asan/unittest_util.h"
+#include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
+#include "syzygy/testing/metrics.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+using agent::common::StackCapture;
+using heap_managers::BlockHeapManager;
+
+typedef BlockHeapManager::HeapId HeapId;
+
+// The allocation sizes and thread counts of the heap manager benchmarks.
+const size_t kAllocationSizes[] = { 16, 256, 4096, 64 * 1024 };
+const size_t kThreadCounts[] = { 1, 2, 4, 8 };
+
+// The number of allocations made by each thread of the heap manager
+// benchmarks.
+const size_t kAllocationsPerThread = 10000;
+
+// The number of allocations kept alive by each thread of the heap manager
+// benchmarks, so that frees don't always hit the block that was just
+// allocated.
+const size_t kLiveAllocationsPerThread = 64;
+
+// The number of calls made by the probe and interceptor benchmarks.
+const size_t kCallCount = 100000;
+
+// The probes, along with their names.
+struct Probe {
+  const char* name;
+  FARPROC function;
+};
+const Probe kProbes[] = {
+#define DEFINE_PROBE_TABLE(access_size, access_mode_str, access_mode) \
+  { "asan_check_" #access_size "_byte_" #access_mode_str, \
+    asan_check_ ## access_size ## _byte_ ## access_mode_str },
+
+ASAN_MEM_INTERCEPT_FUNCTIONS(DEFINE_PROBE_TABLE)
+
+#undef DEFINE_PROBE_TABLE
+};
+
+// Calls a probe on an address. The probes take the address in EDX, and
+// preserve all of the registers and flags.
+// @param probe The probe.
+// @param address The checked address.
+void __declspec(naked) CallProbe(FARPROC probe, const void* address) {
+  __asm {
+    push edx
+    mov edx, DWORD PTR[esp + 12]  // address
+    call DWORD PTR[esp + 8]  // probe
+    pop edx
+    ret
+  }
+}
+
+// Emits the average number of cycles of an operation.
+// @param name The name of the operation.
+// @param cycles The number of cycles spent in all of the operations.
+// @param operation_count The number of operations.
+void EmitCyclesPerOperation(const std::string& name,
+                            uint64 cycles,
+                            size_t operation_count) {
+  DCHECK_LT(0u, operation_count);
+  testing::EmitMetric("Syzygy.Asan.Benchmark." + name,
+                      static_cast<double>(cycles) / operation_count);
+}
+
+// A derived class to expose the heap manager of the runtime.
+class TestAsanRuntime : public AsanRuntime {
+ public:
+  using AsanRuntime::heap_manager_;
+};
+
+// Allocates and frees blocks of a given size in a heap, keeping a window of
+// live blocks.
+class AllocFreeRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  AllocFreeRunner(BlockHeapManager* heap_manager,
+                  HeapId heap_id,
+                  size_t size)
+      : heap_manager_(heap_manager), heap_id_(heap_id), size_(size) {
+  }
+
+  virtual void Run() override {
+    void* blocks[kLiveAllocationsPerThread] = {};
+    for (size_t i = 0; i < kAllocationsPerThread; ++i) {
+      void*& block = blocks[i % kLiveAllocationsPerThread];
+      if (block != nullptr)
+        EXPECT_TRUE(heap_manager_->Free(heap_id_, block));
+      block = heap_manager_->Allocate(heap_id_, size_);
+      EXPECT_NE(static_cast<void*>(nullptr), block);
+    }
+    for (size_t i = 0; i < kLiveAllocationsPerThread; ++i) {
+      if (blocks[i] != nullptr)
+        EXPECT_TRUE(heap_manager_->Free(heap_id_, blocks[i]));
+    }
+  }
+
+ private:
+  BlockHeapManager* heap_manager_;
+  HeapId heap_id_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocFreeRunner);
+};
+
+class SyzyAsanRtlBenchmark : public testing::TestWithAsanRuntime {
+ public:
+  typedef testing::TestWithAsanRuntime Super;
+
+  SyzyAsanRtlBenchmark() : Super(&test_runtime_), heap_id_(0) {}
+
+  virtual void SetUp() override {
+    Super::SetUp();
+    runtime_->params().check_heap_on_failure = false;
+    runtime_->SetErrorCallBack(
+        base::Bind(&SyzyAsanRtlBenchmark::OnError, base::Unretained(this)));
+    heap_id_ = heap_manager()->CreateHeap();
+    ASSERT_NE(0u, heap_id_);
+  }
+
+  virtual void TearDown() override {
+    if (heap_id_ != 0)
+      EXPECT_TRUE(heap_manager()->DestroyHeap(heap_id_));
+    Super::TearDown();
+  }
+
+  void OnError(AsanErrorInfo* error_info) {
+    ADD_FAILURE() << "Unexpected Asan error.";
+  }
+
+  BlockHeapManager* heap_manager() {
+    return test_runtime_.heap_manager_.get();
+  }
+
+  // Allocates a block in the heap of the benchmark.
+  void* Allocate(size_t size) {
+    void* block = heap_manager()->Allocate(heap_id_, size);
+    EXPECT_NE(static_cast<void*>(nullptr), block);
+    return block;
+  }
+
+  // Frees a block of the heap of the benchmark.
+  void Free(void* block) {
+    EXPECT_TRUE(heap_manager()->Free(heap_id_, block));
+  }
+
+ protected:
+  TestAsanRuntime test_runtime_;
+  HeapId heap_id_;
+};
+
+}  // namespace
+
+TEST_F(SyzyAsanRtlBenchmark, BlockHeapManagerAllocFree) {
+  for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+    for (size_t j = 0; j < arraysize(kAllocationSizes); ++j) {
+      size_t thread_count = kThreadCounts[i];
+      size_t size = kAllocationSizes[j];
+
+      ScopedVector<AllocFreeRunner> runners;
+      ScopedVector<base::DelegateSimpleThread> threads;
+      for (size_t k = 0; k < thread_count; ++k) {
+        runners.push_back(new AllocFreeRunner(heap_manager(), heap_id_, size));
+        threads.push_back(new base::DelegateSimpleThread(
+            runners.back(), "SyzyAsanRtlBenchmark"));
+      }
+
+      uint64 t0 = ::__rdtsc();
+      for (size_t k = 0; k < thread_count; ++k)
+        threads[k]->Start();
+      for (size_t k = 0; k < thread_count; ++k)
+        threads[k]->Join();
+      uint64 t1 = ::__rdtsc();
+
+      // This is the wall time per allocation, so that scaling issues show up
+      // as the thread count grows.
+      EmitCyclesPerOperation(
+          base::StringPrintf("BlockHeapManager.AllocFree.%dThreads.%dBytes",
+                             thread_count, size),
+          t1 - t0, thread_count * kAllocationsPerThread);
+    }
+  }
+}
+
+TEST_F(SyzyAsanRtlBenchmark, BlockHeapManagerQuarantineTrimming) {
+  static const size_t kBlockSize = 256;
+  static const size_t kBlockCount = 10000;
+
+  // Use a quarantine that only holds a small fraction of the blocks, so that
+  // each free has to trim it.
+  ::common::AsanParameters params = heap_manager()->parameters();
+  params.quarantine_size = 64 * kBlockSize;
+  heap_manager()->set_parameters(params);
+
+  std::vector<void*> blocks(kBlockCount);
+  for (size_t i = 0; i < kBlockCount; ++i)
+    blocks[i] = Allocate(kBlockSize);
+
+  uint64 t0 = ::__rdtsc();
+  for (size_t i = 0; i < kBlockCount; ++i)
+    Free(blocks[i]);
+  uint64 t1 = ::__rdtsc();
+  EmitCyclesPerOperation("BlockHeapManager.FreeWithQuarantineTrimming",
+                         t1 - t0, kBlockCount);
+}
+
+TEST_F(SyzyAsanRtlBenchmark, StackCaptureCacheSaveStackTrace) {
+  static const size_t kStackCount = 256;
+  static const size_t kFrameCount = 20;
+  StackCaptureCache* stack_cache = runtime_->stack_cache();
+
+  // The first round saves new stack traces, and the following ones find them
+  // in the cache.
+  void* frames[kFrameCount] = {};
+  uint64 t0 = ::__rdtsc();
+  for (size_t i = 0; i < kCallCount; ++i) {
+    StackCapture::StackId stack_id = i % kStackCount;
+    for (size_t j = 0; j < kFrameCount; ++j)
+      frames[j] = reinterpret_cast<void*>(stack_id * kFrameCount + j + 1);
+    const StackCapture* stack =
+        stack_cache->SaveStackTrace(stack_id, frames, kFrameCount);
+    stack_cache->ReleaseStackTrace(stack);
+  }
+  uint64 t1 = ::__rdtsc();
+  EmitCyclesPerOperation("StackCaptureCache.SaveStackTrace", t1 - t0,
+                         kCallCount);
+}
+
+TEST_F(SyzyAsanRtlBenchmark, Probes) {
+  uint8* block = reinterpret_cast<uint8*>(Allocate(64));
+
+  for (size_t i = 0; i < arraysize(kProbes); ++i) {
+    uint64 t0 = ::__rdtsc();
+    for (size_t j = 0; j < kCallCount; ++j)
+      CallProbe(kProbes[i].function, block);
+    uint64 t1 = ::__rdtsc();
+    EmitCyclesPerOperation(
+        base::StringPrintf("Probes.%s", kProbes[i].name), t1 - t0,
+        kCallCount);
+  }
+
+  Free(block);
+}
+
+TEST_F(SyzyAsanRtlBenchmark, CrtInterceptors) {
+  static const size_t kBufferSize = 4096;
+  static const size_t kStringLength = 255;
+  uint8* source = reinterpret_cast<uint8*>(Allocate(kBufferSize));
+  uint8* destination = reinterpret_cast<uint8*>(Allocate(kBufferSize));
+  ::memset(source, 'a', kStringLength);
+  source[kStringLength] = 0;
+
+  uint64 t0 = ::__rdtsc();
+  for (size_t i = 0; i < kCallCount; ++i)
+    asan_memcpy(destination, source, kBufferSize);
+  uint64 t1 = ::__rdtsc();
+  EmitCyclesPerOperation("CrtInterceptors.memcpy.4096Bytes", t1 - t0,
+                         kCallCount);
+
+  t0 = ::__rdtsc();
+  for (size_t i = 0; i < kCallCount; ++i)
+    asan_memset(destination, static_cast<int>(i), kBufferSize);
+  t1 = ::__rdtsc();
+  EmitCyclesPerOperation("CrtInterceptors.memset.4096Bytes", t1 - t0,
+                         kCallCount);
+
+  const char* string = reinterpret_cast<const char*>(source);
+  size_t total_length = 0;
+  t0 = ::__rdtsc();
+  for (size_t i = 0; i < kCallCount; ++i)
+    total_length += asan_strlen(string);
+  t1 = ::__rdtsc();
+  EXPECT_EQ(kCallCount * kStringLength, total_length);
+  EmitCyclesPerOperation("CrtInterceptors.strlen.255Bytes", t1 - t0,
+                         kCallCount);
+
+  Free(destination);
+  Free(source);
+}
+
+}  // namespace asan
+}  // namespace agent
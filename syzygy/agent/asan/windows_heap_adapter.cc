@@ -82,7 +82,23 @@ LPVOID WINAPI WindowsHeapAdapter::HeapReAlloc(HANDLE heap,
                                               LPVOID mem,
                                               SIZE_T bytes) {
   DCHECK_NE(reinterpret_cast<HeapManagerInterface*>(NULL), heap_manager_);
-  // Always fail in-place reallocation requests.
+
+  // Try to resize the allocation in place first. This saves the copy, and
+  // keeps the old block out of the quarantine.
+  if (mem != NULL) {
+    size_t old_size = 0;
+    if ((flags & HEAP_ZERO_MEMORY) != 0)
+      old_size = HeapSize(heap, 0, mem);
+    if (heap_manager_->ResizeInPlace(HandleToHeapId(heap), mem, bytes)) {
+      if ((flags & HEAP_ZERO_MEMORY) != 0 && bytes > old_size) {
+        ::memset(reinterpret_cast<uint8*>(mem) + old_size, 0,
+                 bytes - old_size);
+      }
+      return mem;
+    }
+  }
+
+  // Fail the in-place reallocation requests that can't be satisfied.
   if ((flags & HEAP_REALLOC_IN_PLACE_ONLY) != 0)
     return NULL;
 
@@ -37,6 +37,7 @@ class LenientMockHeapManager : public HeapManagerInterface {
   MOCK_METHOD2(Size, size_t(HeapId, const void*));
   MOCK_METHOD2(Allocate, void*(HeapId, size_t));
   MOCK_METHOD2(Free, bool(HeapId, void*));
+  MOCK_METHOD3(ResizeInPlace, bool(HeapId, void*, size_t));
   MOCK_METHOD1(Lock, void(HeapId));
   MOCK_METHOD1(Unlock, void(HeapId));
   MOCK_METHOD0(BestEffortLockAll, void());
@@ -113,10 +114,13 @@ TEST_F(WindowsHeapAdapterTest, HeapAllocWithZeroMemoryFlag) {
 TEST_F(WindowsHeapAdapterTest, HeapReAlloc) {
   void* kFakeAlloc = reinterpret_cast<void*>(0x12345678);
   void* kFakeReAlloc = reinterpret_cast<void*>(0x87654321);
-  // A successful call to WindowsHeapAdapter::HeapReAlloc should end up calling
-  // HeapManagerInterface::Allocate, HeapManagerInterface::Size and
-  // HeapManagerInterface::Free.
+  // A successful call to WindowsHeapAdapter::HeapReAlloc that can't be done
+  // in place should end up calling HeapManagerInterface::Allocate,
+  // HeapManagerInterface::Size and HeapManagerInterface::Free.
   const size_t kReAllocSize = 200;
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, kFakeAlloc, kReAllocSize)).WillOnce(
+      Return(false));
   EXPECT_CALL(mock_heap_manager_, Allocate(kFakeHeapId, kReAllocSize)).WillOnce(
       Return(kFakeReAlloc));
   EXPECT_CALL(mock_heap_manager_, Free(kFakeHeapId, kFakeAlloc)).WillOnce(
@@ -153,6 +157,48 @@ TEST_F(WindowsHeapAdapterTest, HeapReAllocFailForInPlaceReallocations) {
                                       kReAllocSize));
 }
 
+TEST_F(WindowsHeapAdapterTest, HeapReAllocInPlace) {
+  void* kFakeAlloc = reinterpret_cast<void*>(0x12345678);
+  const size_t kReAllocSize = 10;
+  // No new allocation should be made when the heap manager is able to resize
+  // the allocation in place.
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, kFakeAlloc, kReAllocSize)).WillOnce(
+      Return(true));
+  EXPECT_CALL(mock_heap_manager_, Allocate(_, _)).Times(0);
+  EXPECT_CALL(mock_heap_manager_, Free(_, _)).Times(0);
+  EXPECT_EQ(kFakeAlloc,
+      WindowsHeapAdapter::HeapReAlloc(reinterpret_cast<HANDLE>(kFakeHeapId),
+                                      HEAP_REALLOC_IN_PLACE_ONLY,
+                                      kFakeAlloc,
+                                      kReAllocSize));
+}
+
+TEST_F(WindowsHeapAdapterTest, HeapReAllocInPlaceWithZeroMemoryFlag) {
+  const size_t kAllocSize = 10;
+  const size_t kReAllocSize = kAllocSize * 2;
+  uint8 kDummyBuffer[kReAllocSize];
+  ::memset(kDummyBuffer, 0xFF, kReAllocSize);
+  void* alloc = reinterpret_cast<void*>(kDummyBuffer);
+
+  EXPECT_CALL(mock_heap_manager_, Size(kFakeHeapId, alloc)).WillOnce(
+      Return(kAllocSize));
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, alloc, kReAllocSize)).WillOnce(
+      Return(true));
+  EXPECT_EQ(alloc,
+      WindowsHeapAdapter::HeapReAlloc(reinterpret_cast<HANDLE>(kFakeHeapId),
+                                      HEAP_ZERO_MEMORY,
+                                      alloc,
+                                      kReAllocSize));
+
+  // Only the bytes past the old size should have been cleared.
+  for (size_t i = 0; i < kAllocSize; ++i)
+    EXPECT_EQ(0xFF, kDummyBuffer[i]);
+  for (size_t i = kAllocSize; i < kReAllocSize; ++i)
+    EXPECT_EQ(0, kDummyBuffer[i]);
+}
+
 TEST_F(WindowsHeapAdapterTest, HeapReAllocFailOnOOM) {
   const size_t kReAllocSize = 10;
   // Return NULL in the internal call that allocates the new buffer.
@@ -180,6 +226,9 @@ TEST_F(WindowsHeapAdapterTest, HeapReallocCopyData) {
   EXPECT_EQ(reinterpret_cast<void*>(kDummyBuffer1), alloc);
   base::RandBytes(alloc, kAllocSize);
 
+  EXPECT_CALL(mock_heap_manager_,
+              ResizeInPlace(kFakeHeapId, alloc, kReAllocSize)).WillOnce(
+      Return(false));
   EXPECT_CALL(mock_heap_manager_, Allocate(kFakeHeapId, kReAllocSize)).WillOnce(
       Return(reinterpret_cast<void*>(kDummyBuffer2)));
   EXPECT_CALL(mock_heap_manager_, Free(kFakeHeapId, alloc)).WillOnce(
@@ -61,9 +61,20 @@
 //      process-wide segment shared by all threads. In this mode, no events can
 //      be lost.
 //    - Buffered mode: A per-thread buffer is used to collect execution
-//      information. A batch commit is done when the buffer is full. In this
-//      mode, under a non-standard execution (crash, force exit, ...) pending
-//      events may be lost.
+//      information. A batch commit is done when the buffer is full. The
+//      buffer is filled and the branch predictor is simulated without any
+//      lock, and the lock of the module is only held to commit the counters.
+//      For basic block entry counting, the per-thread buffer is an array of
+//      counters that is merged into the segment when the thread detaches, so
+//      that the threads don't bounce the cache lines of the hot counters.
+//      In this mode, under a non-standard execution (crash, force exit, ...)
+//      pending events may be lost.
+//
+//    The basic block entry counters may be 1, 2 or 4 bytes wide. They
+//    saturate rather than wrap around.
+//
+//    The counters of each module are protected by a lock of their own, so
+//    that threads tracing different modules don't contend.
 //
 //    The agent keeps a ThreadState for each running thread. The thread state
 //    is accessible through a TLS mechanism and contains information needed by
@@ -81,6 +92,8 @@
 
 #include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 
+#include <limits>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/environment.h"
@@ -167,6 +180,9 @@ BBPROBE_REDIRECT_CALL(_branch_exit, BranchExitHook, 8)
 BBPROBE_REDIRECT_CALL(_increment_indexed_freq_data,
                       IncrementIndexedFreqDataHook,
                       8)
+BBPROBE_REDIRECT_CALL(_increment_indexed_freq_data_buffered,
+                      IncrementIndexedFreqDataBufferedHook,
+                      8)
 
 // This is expected to be called via instrumentation that looks like:
 //    push module_data
@@ -283,6 +299,9 @@ struct BranchFrequency {
 struct BranchBufferEntry {
   uint32 basic_block_id;
   uint32 last_basic_block_id;
+  // Set by the branch predictor simulation when the branch from
+  // last_basic_block_id was mispredicted.
+  bool mispredicted;
 };
 
 // All tracing runs through this object.
@@ -296,6 +315,21 @@ inline uint32 IncrementAndSaturate(uint32 value) {
   return value;
 }
 
+// Add @p count to the counter at @p index of the array of @p T counters
+// @p counters, saturating at the maximal value of @p T.
+template <typename T>
+inline void AddAndSaturate(void* counters, uint32 index, uint32 count) {
+  T* counter = static_cast<T*>(counters) + index;
+  const uint32 kMaxValue = std::numeric_limits<T>::max();
+  uint32 value = *counter;
+  if (count >= kMaxValue - value) {
+    value = kMaxValue;
+  } else {
+    value += count;
+  }
+  *counter = static_cast<T>(value);
+}
+
 // Get the address of the module containing @p addr. We do this by querying
 // for the allocation that contains @p addr. This must lie within the
 // instrumented module, and be part of the single allocation in which the
@@ -343,11 +377,22 @@ bool DatatypeVersionIsValid(uint32 data_type,
   } else if (data_type == IndexedFrequencyData::BASIC_BLOCK_ENTRY) {
     if (agent_id != ::common::kBasicBlockEntryAgentId ||
         version != ::common::kBasicBlockFrequencyDataVersion ||
-        frequency_size != kIntSize ||
+        (frequency_size != 1U && frequency_size != 2U &&
+         frequency_size != kIntSize) ||
         num_columns != 1U) {
       LOG(ERROR) << "Unexpected values in the basic block data structures.";
       return false;
     }
+  } else if (data_type == IndexedFrequencyData::JUMP_TABLE) {
+    // The jump table counters are incremented in place by the instrumentation,
+    // we only need to commit them to the trace file.
+    if (agent_id != ::common::kJumpTableCountAgentId ||
+        version != ::common::kJumpTableFrequencyDataVersion ||
+        frequency_size != kIntSize ||
+        num_columns != 1U) {
+      LOG(ERROR) << "Unexpected values in the jump table data structures.";
+      return false;
+    }
   } else {
     LOG(ERROR) << "Unexpected entry kind.";
     return false;
@@ -410,15 +455,40 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // Saturation increment the frequency record for @p index. Note that in
   // Release mode, no range checking is performed on index.
   // @param basic_block_id the basic block index.
+  // @note The trace lock must be held.
   void Increment(uint32 basic_block_id);
 
+  // Saturation increment the thread-local counter for @p index. The local
+  // counters are merged into the frequency records by Flush.
+  // @param basic_block_id the basic block index.
+  void IncrementLocal(uint32 basic_block_id);
+
   // Update state and frequency when a jump enters the basic block @p index
   // coming from the basic block @last.
   // @param basic_block_id the basic block index.
   // @param last_basic_block_id the originating basic block index from which we
   //     enter @p basic_block_id.
+  // @note The trace lock must be held.
   void Enter(uint32 basic_block_id, uint32 last_basic_block_id);
 
+  // Update the simulated branch predictor when a jump enters the basic block
+  // @p basic_block_id coming from the basic block @p last_basic_block_id. This
+  // only touches the state of this thread, and doesn't need the trace lock.
+  // @param basic_block_id the basic block index.
+  // @param last_basic_block_id the originating basic block index.
+  // @returns true iff the branch was mispredicted.
+  bool Predict(uint32 basic_block_id, uint32 last_basic_block_id);
+
+  // Update the frequencies when a jump enters the basic block
+  // @p basic_block_id coming from the basic block @p last_basic_block_id.
+  // @param basic_block_id the basic block index.
+  // @param last_basic_block_id the originating basic block index.
+  // @param mispredicted true iff the branch was mispredicted.
+  // @note The trace lock must be held.
+  void Commit(uint32 basic_block_id,
+              uint32 last_basic_block_id,
+              bool mispredicted);
+
   // Update state and frequency when a jump leaves the basic block @p index.
   // @param basic_block_id the basic block index.
   void Leave(uint32 basic_block_id);
@@ -429,7 +499,8 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   //     entry, false otherwise.
   bool Push(uint32 basic_block_id);
 
-  // Flush pending values in the basic block ids buffer.
+  // Flush pending values in the basic block ids buffer and the thread-local
+  // counters. This acquires the trace lock.
   void Flush();
 
   // Return the id of the most recent basic block executed.
@@ -459,6 +530,18 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   }
 
  protected:
+  // Saturation add @p count to the frequency record for @p index, whatever
+  // the size of the counters is.
+  // @param basic_block_id the basic block index.
+  // @param count the value to add.
+  // @note The trace lock must be held.
+  void AddToFrequency(uint32 basic_block_id, uint32 count);
+
+  // Merge the thread-local counters into the frequency records, and reset
+  // them.
+  // @note The trace lock must be held.
+  void CommitLocalFrequencies();
+
   // As a shortcut, this points to the beginning of the array of basic-block
   // entry frequency values. With tracing enabled, this is equivalent to:
   //     reinterpret_cast<uint32*>(this->trace_data->frequency_data)
@@ -481,6 +564,10 @@ class BasicBlockEntry::ThreadState : public agent::common::ThreadStateBase {
   // The branch predictor state (2-bit saturating counter).
   std::vector<uint8> predictor_data_;
 
+  // The thread-local basic block entry counters, allocated on first use by
+  // IncrementLocal. These are always 32-bit wide.
+  std::vector<uint32> local_frequencies_;
+
   // The last basic block id executed.
   uint32 last_basic_block_id_;
 
@@ -499,7 +586,7 @@ BasicBlockEntry::ThreadState::ThreadState(IndexedFrequencyData* module_data,
 }
 
 BasicBlockEntry::ThreadState::~ThreadState() {
-  if (!basic_block_id_buffer_.empty())
+  if (!basic_block_id_buffer_.empty() || !local_frequencies_.empty())
     Flush();
 
   uint32 slot = GetBasicBlockData()->fs_slot;
@@ -511,7 +598,7 @@ BasicBlockEntry::ThreadState::~ThreadState() {
 
 void BasicBlockEntry::ThreadState::AllocateBasicBlockIdBuffer() {
   DCHECK(basic_block_id_buffer_.empty());
-  basic_block_id_buffer_.resize(kBufferSize * sizeof(BranchBufferEntry));
+  basic_block_id_buffer_.resize(kBufferSize);
 }
 
 void BasicBlockEntry::ThreadState::AllocatePredictorCache() {
@@ -546,13 +633,90 @@ inline void BasicBlockEntry::ThreadState::Increment(uint32 basic_block_id) {
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
 
-  // Retrieve information for the basic block.
-  BBEntryFrequency& entry = GetBBEntryFrequency(basic_block_id);
-  entry.frequency = IncrementAndSaturate(entry.frequency);
+  AddToFrequency(basic_block_id, 1);
+}
+
+inline void BasicBlockEntry::ThreadState::IncrementLocal(
+    uint32 basic_block_id) {
+  DCHECK(module_data_ != NULL);
+  DCHECK_LT(basic_block_id, module_data_->num_entries);
+
+  if (local_frequencies_.empty())
+    local_frequencies_.resize(module_data_->num_entries, 0U);
+
+  uint32& frequency = local_frequencies_[basic_block_id];
+  frequency = IncrementAndSaturate(frequency);
+}
+
+void BasicBlockEntry::ThreadState::AddToFrequency(uint32 basic_block_id,
+                                                  uint32 count) {
+  DCHECK(frequency_data_ != NULL);
+  DCHECK(module_data_ != NULL);
+  DCHECK_EQ(1U, module_data_->num_columns);
+
+  switch (module_data_->frequency_size) {
+    case 1:
+      AddAndSaturate<uint8>(frequency_data_, basic_block_id, count);
+      break;
+    case 2:
+      AddAndSaturate<uint16>(frequency_data_, basic_block_id, count);
+      break;
+    case 4:
+      AddAndSaturate<uint32>(frequency_data_, basic_block_id, count);
+      break;
+    default:
+      NOTREACHED();
+      break;
+  }
+}
+
+void BasicBlockEntry::ThreadState::CommitLocalFrequencies() {
+  for (size_t i = 0; i < local_frequencies_.size(); ++i) {
+    if (local_frequencies_[i] == 0)
+      continue;
+    AddToFrequency(i, local_frequencies_[i]);
+    local_frequencies_[i] = 0;
+  }
 }
 
 void BasicBlockEntry::ThreadState::Enter(
     uint32 basic_block_id, uint32 last_basic_block_id) {
+  bool mispredicted = Predict(basic_block_id, last_basic_block_id);
+  Commit(basic_block_id, last_basic_block_id, mispredicted);
+}
+
+bool BasicBlockEntry::ThreadState::Predict(
+    uint32 basic_block_id, uint32 last_basic_block_id) {
+  // Simulate the branch predictor.
+  // see: http://en.wikipedia.org/wiki/Branch_predictor
+  // states:
+  //    0: Strongly not taken
+  //    1: Weakly not taken
+  //    2: Weakly taken
+  //    3: Strongly taken
+  if (predictor_data_.empty() || last_basic_block_id == kInvalidBasicBlockId)
+    return false;
+  DCHECK(predictor_data_.size() == kPredictorCacheSize);
+
+  bool taken = (basic_block_id != last_basic_block_id + 1);
+  bool mispredicted = false;
+  size_t offset = last_basic_block_id % kPredictorCacheSize;
+  uint8& state = predictor_data_[offset];
+  if (taken) {
+    mispredicted = (state < 2);
+    if (state < 3)
+      ++state;
+  } else {
+    mispredicted = (state > 1);
+    if (state != 0)
+      --state;
+  }
+  return mispredicted;
+}
+
+void BasicBlockEntry::ThreadState::Commit(uint32 basic_block_id,
+                                          uint32 last_basic_block_id,
+                                          bool mispredicted) {
   DCHECK(frequency_data_ != NULL);
   DCHECK(module_data_ != NULL);
   DCHECK_LT(basic_block_id, module_data_->num_entries);
@@ -578,31 +742,8 @@ void BasicBlockEntry::ThreadState::Enter(
       previous.branch_taken = IncrementAndSaturate(previous.branch_taken);
   }
 
-  // Simulate the branch predictor.
-  // see: http://en.wikipedia.org/wiki/Branch_predictor
-  // states:
-  //    0: Strongly not taken
-  //    1: Weakly not taken
-  //    2: Weakly taken
-  //    3: Strongly taken
-  if (predictor_data_.empty())
-    return;
-  DCHECK(predictor_data_.size() == kPredictorCacheSize);
-  if (last_basic_block_id != kInvalidBasicBlockId) {
-    size_t offset = last_basic_block_id % kPredictorCacheSize;
-    uint8& state = predictor_data_[offset];
-    if (taken) {
-      if (state < 2)
-        previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
-      if (state < 3)
-        ++state;
-    } else {
-      if (state > 1)
-        previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
-      if (state != 0)
-        --state;
-    }
-  }
+  if (mispredicted)
+    previous.mispredicted = IncrementAndSaturate(previous.mispredicted);
 }
 
 inline void BasicBlockEntry::ThreadState::Leave(uint32 basic_block_id) {
@@ -622,6 +763,7 @@ bool BasicBlockEntry::ThreadState::Push(uint32 basic_block_id) {
   BranchBufferEntry* entry = &basic_block_id_buffer_[last_offset];
   entry->basic_block_id = basic_block_id;
   entry->last_basic_block_id = last_basic_block_id_;
+  entry->mispredicted = false;
 
   ++basic_block_id_buffer_offset_;
 
@@ -630,10 +772,26 @@ bool BasicBlockEntry::ThreadState::Push(uint32 basic_block_id) {
 
 void BasicBlockEntry::ThreadState::Flush() {
   uint32 last_offset = basic_block_id_buffer_offset_;
+  if (last_offset == 0 && local_frequencies_.empty())
+    return;
 
+  // The branch predictor is private to this thread, so it's simulated before
+  // acquiring the lock.
   for (size_t offset = 0; offset < last_offset; ++offset) {
     BranchBufferEntry* entry = &basic_block_id_buffer_[offset];
-    Enter(entry->basic_block_id, entry->last_basic_block_id);
+    entry->mispredicted = Predict(entry->basic_block_id,
+                                  entry->last_basic_block_id);
+  }
+
+  // Commit the whole buffer to the frequency data at once.
+  {
+    base::AutoLock scoped_lock(*trace_lock_);
+    for (size_t offset = 0; offset < last_offset; ++offset) {
+      const BranchBufferEntry* entry = &basic_block_id_buffer_[offset];
+      Commit(entry->basic_block_id, entry->last_basic_block_id,
+             entry->mispredicted);
+    }
+    CommitLocalFrequencies();
   }
 
   // Reset buffer.
@@ -728,8 +886,9 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
 
   // Create the thread-local state for this thread. By default, just point the
   // counter array to the statically allocated fall-back area.
-  ThreadState* state =
-    new ThreadState(module_data, &lock_, module_data->frequency_data);
+  ThreadState* state = new ThreadState(module_data,
+                                       GetModuleLock(module_data),
+                                       module_data->frequency_data);
   CHECK(state != NULL);
 
   // Register the thread state with the thread state manager.
@@ -769,6 +928,21 @@ BasicBlockEntry::ThreadState* BasicBlockEntry::CreateThreadState(
   return state;
 }
 
+base::Lock* BasicBlockEntry::GetModuleLock(
+    const IndexedFrequencyData* module_data) {
+  DCHECK(module_data != NULL);
+
+  base::AutoLock scoped_lock(lock_);
+  ModuleLockMap::iterator it = module_locks_.find(module_data);
+  if (it != module_locks_.end())
+    return it->second;
+
+  base::Lock* module_lock = new base::Lock();
+  module_lock_storage_.push_back(module_lock);
+  module_locks_.insert(std::make_pair(module_data, module_lock));
+  return module_lock;
+}
+
 inline BasicBlockEntry::ThreadState* BasicBlockEntry::GetThreadState(
     IndexedFrequencyData* module_data) {
   DCHECK(module_data != NULL);
@@ -808,6 +982,24 @@ void WINAPI BasicBlockEntry::IncrementIndexedFreqDataHook(
   state->Increment(entry_frame->index);
 }
 
+void WINAPI BasicBlockEntry::IncrementIndexedFreqDataBufferedHook(
+    IncrementIndexedFreqDataFrame* entry_frame) {
+  DCHECK(entry_frame != NULL);
+  DCHECK(entry_frame->module_data != NULL);
+  DCHECK_GT(entry_frame->module_data->num_entries,
+            entry_frame->index);
+
+  ThreadState* state = GetThreadState(entry_frame->module_data);
+  if (state == NULL) {
+    ScopedLastErrorKeeper scoped_last_error_keeper;
+    state = Instance()->CreateThreadState(entry_frame->module_data);
+  }
+
+  // The counters of this thread are only merged when it detaches, so no lock
+  // is needed here.
+  state->IncrementLocal(entry_frame->index);
+}
+
 void WINAPI BasicBlockEntry::BranchEnterHook(
     IncrementIndexedFreqDataFrame* entry_frame) {
   DCHECK(entry_frame != NULL);
@@ -838,10 +1030,8 @@ void WINAPI BasicBlockEntry::BranchEnterBufferedHook(
     state = Instance()->CreateThreadState(entry_frame->module_data);
   }
 
-  if (state->Push(entry_frame->index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
+  if (state->Push(entry_frame->index))
     state->Flush();
-  }
   state->reset_last_basic_block_id();
 }
 
@@ -881,10 +1071,8 @@ void __fastcall BasicBlockEntry::BranchEnterBufferedHookSlot(uint32 index) {
   if (state == NULL)
     return;
 
-  if (state->Push(index)) {
-    base::AutoLock scoped_lock(*state->trace_lock());
+  if (state->Push(index))
     state->Flush();
-  }
   state->reset_last_basic_block_id();
 }
 
@@ -991,7 +1179,8 @@ void BasicBlockEntry::OnProcessAttach(IndexedFrequencyData* module_data) {
       reinterpret_cast<BasicBlockIndexedFrequencyData*>(module_data);
 
   // Exit if the magic number does not match.
-  CHECK_EQ(::common::kBasicBlockEntryAgentId, module_data->agent_id);
+  CHECK(module_data->agent_id == ::common::kBasicBlockEntryAgentId ||
+        module_data->agent_id == ::common::kJumpTableCountAgentId);
 
   // Exit if the version does not match.
   CHECK(DatatypeVersionIsValid(module_data->data_type,
@@ -26,9 +26,11 @@
 
 #include <windows.h>
 #include <winnt.h>
+#include <map>
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/memory/scoped_vector.h"
 #include "base/win/pe_image.h"
 #include "syzygy/agent/common/thread_state.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -78,6 +80,10 @@ class BasicBlockEntry {
   static void WINAPI IncrementIndexedFreqDataHook(
       IncrementIndexedFreqDataFrame* entry_frame);
 
+  // Called from _increment_indexed_freq_data_buffered().
+  static void WINAPI IncrementIndexedFreqDataBufferedHook(
+      IncrementIndexedFreqDataFrame* entry_frame);
+
   // Called from _branch_enter.
   static void WINAPI BranchEnterHook(
       IncrementIndexedFreqDataFrame* entry_frame);
@@ -155,6 +161,12 @@ class BasicBlockEntry {
   // is unavailable, this function returns NULL.
   static ThreadState* GetThreadState(IndexedFrequencyData* module_data);
 
+  // Returns the lock that protects the frequency data of a module, creating it
+  // if necessary.
+  // @param module_data the module information.
+  // @returns the lock associated with @p module_data.
+  base::Lock* GetModuleLock(const IndexedFrequencyData* module_data);
+
   // Returns the local thread state for the current thread (when instrumented
   // with fast-path).
   template<int S>
@@ -175,8 +187,14 @@ class BasicBlockEntry {
   // of, but rather that we let live until the client gets torn down.
   trace::client::TraceFileSegment segment_;  // Under lock_.
 
-  // Global lock to avoid concurrent segment_ update.
+  // Global lock to avoid concurrent segment_ and module_locks_ update.
   base::Lock lock_;
+
+  // The locks protecting the frequency data of each module. The threads
+  // tracing different modules don't contend with each other.
+  typedef std::map<const IndexedFrequencyData*, base::Lock*> ModuleLockMap;
+  ModuleLockMap module_locks_;  // Under lock_.
+  ScopedVector<base::Lock> module_lock_storage_;  // Under lock_.
 };
 
 // This structure contains the BasicBlockEntry IndexedFrequencyData specifics
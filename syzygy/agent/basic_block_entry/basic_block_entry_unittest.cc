@@ -87,6 +87,7 @@ class BasicBlockEntryTest : public testing::Test {
  public:
   enum InstrumentationMode {
     kBasicBlockEntryInstrumentation,
+    kBufferedBasicBlockEntryInstrumentation,
     kBranchInstrumentation,
     kBufferedBranchInstrumentation,
     kBranchWithSlotInstrumentation,
@@ -130,9 +131,24 @@ class BasicBlockEntryTest : public testing::Test {
     ::memset(&default_branch_data_, 0, sizeof(default_branch_data_));
   }
 
+  void ConfigureJumpTableAgent() {
+    common_data_->agent_id = ::common::kJumpTableCountAgentId;
+    common_data_->data_type = ::common::IndexedFrequencyData::JUMP_TABLE;
+    common_data_->version = ::common::kJumpTableFrequencyDataVersion;
+    module_data_.tls_index = TLS_OUT_OF_INDEXES;
+    module_data_.fs_slot = 0;
+    common_data_->initialization_attempted = 0U;
+    common_data_->num_entries = kNumBasicBlocks;
+    common_data_->num_columns = kNumColumns;
+    common_data_->frequency_size = sizeof(default_frequency_data_[0]);
+    common_data_->frequency_data = default_frequency_data_;
+    ::memset(&default_frequency_data_, 0, sizeof(default_frequency_data_));
+  }
+
   void ConfigureAgent(InstrumentationMode mode) {
     switch (mode) {
       case kBasicBlockEntryInstrumentation:
+      case kBufferedBasicBlockEntryInstrumentation:
         ConfigureBasicBlockAgent();
         break;
       case kBranchInstrumentation:
@@ -266,6 +282,10 @@ class BasicBlockEntryTest : public testing::Test {
         ::GetProcAddress(agent_module_, "_increment_indexed_freq_data");
     ASSERT_TRUE(basic_block_increment_stub_ != NULL);
 
+    basic_block_increment_buffered_stub_ = ::GetProcAddress(
+        agent_module_, "_increment_indexed_freq_data_buffered");
+    ASSERT_TRUE(basic_block_increment_buffered_stub_ != NULL);
+
     indirect_penter_dllmain_stub_ =
         ::GetProcAddress(agent_module_, "_indirect_penter_dllmain");
     ASSERT_TRUE(indirect_penter_dllmain_stub_ != NULL);
@@ -287,6 +307,7 @@ class BasicBlockEntryTest : public testing::Test {
       basic_block_exit_s1_stub_ = NULL;
       basic_block_function_enter_s1_stub_ = NULL;
       basic_block_increment_stub_ = NULL;
+      basic_block_increment_buffered_stub_ = NULL;
       indirect_penter_dllmain_stub_ = NULL;
       indirect_penter_exemain_stub_ = NULL;
     }
@@ -312,6 +333,14 @@ class BasicBlockEntryTest : public testing::Test {
     }
   }
 
+  void SimulateBasicBlockEntryBuffered(uint32 basic_block_id) {
+    __asm {
+      push basic_block_id
+      push offset module_data_
+      call basic_block_increment_buffered_stub_
+    }
+  }
+
   void SimulateBranchEnter(uint32 basic_block_id) {
     __asm {
       push basic_block_id
@@ -378,6 +407,9 @@ class BasicBlockEntryTest : public testing::Test {
       case kBasicBlockEntryInstrumentation:
         SimulateBasicBlockEntry(basic_block_id);
         break;
+      case kBufferedBasicBlockEntryInstrumentation:
+        SimulateBasicBlockEntryBuffered(basic_block_id);
+        break;
       case kBranchInstrumentation:
         SimulateBranchEnter(basic_block_id);
         SimulateBranchExit(basic_block_id);
@@ -556,6 +588,9 @@ class BasicBlockEntryTest : public testing::Test {
   // The basic-block increment hook.
   static FARPROC basic_block_increment_stub_;
 
+  // The basic-block increment hook (with buffering).
+  static FARPROC basic_block_increment_buffered_stub_;
+
   // The DllMain entry stub.
   static FARPROC indirect_penter_dllmain_stub_;
 
@@ -602,6 +637,7 @@ FARPROC BasicBlockEntryTest::basic_block_exit_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_exit_s1_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_function_enter_s1_stub_ = NULL;
 FARPROC BasicBlockEntryTest::basic_block_increment_stub_ = NULL;
+FARPROC BasicBlockEntryTest::basic_block_increment_buffered_stub_ = NULL;
 FARPROC BasicBlockEntryTest::indirect_penter_dllmain_stub_ = NULL;
 FARPROC BasicBlockEntryTest::indirect_penter_exemain_stub_ = NULL;
 
@@ -661,6 +697,32 @@ TEST_F(BasicBlockEntryTest, NoServerNoCrash) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(0));
 }
 
+TEST_F(BasicBlockEntryTest, JumpTableNoServerNoCrash) {
+  // Configure for jump table mode.
+  ConfigureJumpTableAgent();
+
+  // Load the agent dll.
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event. The jump table data should be accepted
+  // and left pointing to the default array as there is no service running.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+  ASSERT_EQ(::common::kJumpTableCountAgentId, common_data_->agent_id);
+  ASSERT_EQ(IndexedFrequencyData::JUMP_TABLE, common_data_->data_type);
+  ASSERT_NE(TLS_OUT_OF_INDEXES, module_data_.tls_index);
+  ASSERT_NE(0U, common_data_->initialization_attempted);
+  ASSERT_EQ(default_frequency_data_, common_data_->frequency_data);
+
+  // Simulate the process detach event.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+
+  // Unload the DLL.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  // Replay the log. There should be none as we didn't start the service.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(0));
+}
+
 TEST_F(BasicBlockEntryTest, SingleThreadedDllBasicBlockEvents) {
   // Configure for BasicBlock mode.
   ConfigureBasicBlockAgent();
@@ -783,6 +845,42 @@ TEST_F(BasicBlockEntryTest, SingleThreadedExeBasicBlockEvents) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(BasicBlockEntryTest, BufferedCompactBasicBlockEvents) {
+  // Configure for BasicBlock mode, with 1-byte counters.
+  ConfigureBasicBlockAgent();
+  common_data_->frequency_size = sizeof(uint8);
+
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  // Simulate the process attach event.
+  SimulateModuleEvent(DLL_PROCESS_ATTACH);
+
+  // The frequency_data must be allocated and frequency_data must point to it.
+  ASSERT_NE(default_frequency_data_, common_data_->frequency_data);
+  const uint8* frequency_data =
+      reinterpret_cast<uint8*>(common_data_->frequency_data);
+
+  // Enter the first basic block often enough to saturate its counter.
+  for (size_t i = 0; i < 300; ++i)
+    SimulateBasicBlockEntryBuffered(0);
+  SimulateBasicBlockEntryBuffered(1);
+  SimulateBasicBlockEntryBuffered(1);
+
+  // The counters of this thread must not have been committed yet.
+  EXPECT_EQ(0U, frequency_data[0]);
+  EXPECT_EQ(0U, frequency_data[1]);
+
+  // Simulate the process detach event, which merges the counters.
+  SimulateModuleEvent(DLL_PROCESS_DETACH);
+  EXPECT_EQ(0xFFU, frequency_data[0]);
+  EXPECT_EQ(2U, frequency_data[1]);
+
+  // Unload the DLL and stop the service.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_NO_FATAL_FAILURE(StopService());
+}
+
 TEST_F(BasicBlockEntryTest, SingleThreadedExeBranchEvents) {
   // Configure for Branch mode.
   ConfigureBranchAgent();
@@ -915,6 +1013,11 @@ TEST_F(BasicBlockEntryTest, BranchWithBufferingEvents) {
   ASSERT_NO_FATAL_FAILURE(StopService());
 }
 
+TEST_F(BasicBlockEntryTest, SingleDllBufferedBasicBlockEvents) {
+  ASSERT_NO_FATAL_FAILURE(
+    CheckExecution(kDllMain, kBufferedBasicBlockEntryInstrumentation));
+}
+
 TEST_F(BasicBlockEntryTest, SingleExeBranchEvents) {
   ASSERT_NO_FATAL_FAILURE(
     CheckExecution(kExeMain, kBranchInstrumentation));
@@ -965,6 +1068,11 @@ TEST_F(BasicBlockEntryTest, MultiThreadedExeBasicBlockEvents) {
       CheckThreadExecution(kExeMain, kBasicBlockEntryInstrumentation));
 }
 
+TEST_F(BasicBlockEntryTest, MultiThreadedDllBufferedBasicBlockEvents) {
+  ASSERT_NO_FATAL_FAILURE(
+      CheckThreadExecution(kDllMain, kBufferedBasicBlockEntryInstrumentation));
+}
+
 TEST_F(BasicBlockEntryTest, MultiThreadedDllBranchEvents) {
   ASSERT_NO_FATAL_FAILURE(
       CheckThreadExecution(kDllMain, kBranchInstrumentation));
@@ -28,9 +28,15 @@
         'dll_notifications.cc',
         'dll_notifications.h',
         'entry_frame.h',
+        'hot_patcher.cc',
+        'hot_patcher.h',
+        'lock_contention.cc',
+        'lock_contention.h',
         'process_utils.cc',
         'process_utils.h',
         'scoped_last_error_keeper.h',
+        'shared_frequency_data.cc',
+        'shared_frequency_data.h',
         'stack_capture.cc',
         'stack_capture.h',
         'thread_state.cc',
@@ -49,7 +55,10 @@
       'sources': [
         'dlist_unittest.cc',
         'dll_notifications_unittest.cc',
+        'hot_patcher_unittest.cc',
+        'lock_contention_unittest.cc',
         'process_utils_unittest.cc',
+        'shared_frequency_data_unittest.cc',
         'stack_capture_unittest.cc',
         'thread_state_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
@@ -0,0 +1,233 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/hot_patcher.h"
+
+#include "base/logging.h"
+#include "base/win/pe_image.h"
+#include "syzygy/block_graph/hot_patching_metadata.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/common/defs.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+using block_graph::HotPatchingBlockMetadata;
+using block_graph::HotPatchingMetadataHeader;
+
+// "mov edi, edi", as a little-endian word.
+const uint16 kMovEdiEdi = 0xFF8B;
+
+// "jmp $-5", a short jump to the five bytes preceding the block, as a
+// little-endian word.
+const uint16 kShortJumpBack = 0xF9EB;
+
+// The opcode of a near jump, and the size of the instruction.
+const uint8 kNearJumpOpcode = 0xE9;
+const size_t kNearJumpSize = 5;
+
+// Makes @p size bytes at @p address writable for the lifetime of the object.
+class ScopedWritableCode {
+ public:
+  ScopedWritableCode(void* address, size_t size)
+      : address_(address), size_(size), old_protection_(0), writable_(false) {
+    writable_ = ::VirtualProtect(address_, size_, PAGE_EXECUTE_READWRITE,
+                                 &old_protection_) == TRUE;
+    if (!writable_) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "VirtualProtect failed: " << ::common::LogWe(error) << ".";
+    }
+  }
+
+  ~ScopedWritableCode() {
+    if (!writable_)
+      return;
+    DWORD dummy = 0;
+    if (!::VirtualProtect(address_, size_, old_protection_, &dummy)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "VirtualProtect failed: " << ::common::LogWe(error) << ".";
+    }
+    ::FlushInstructionCache(::GetCurrentProcess(), address_, size_);
+  }
+
+  bool writable() const { return writable_; }
+
+ private:
+  void* address_;
+  size_t size_;
+  DWORD old_protection_;
+  bool writable_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedWritableCode);
+};
+
+}  // namespace
+
+HotPatcher::HotPatcher() : image_base_(NULL) {
+}
+
+HotPatcher::~HotPatcher() {
+}
+
+bool HotPatcher::Init(HMODULE module) {
+  DCHECK(module != NULL);
+
+  base::win::PEImage image(module);
+  const IMAGE_SECTION_HEADER* section = image.GetImageSectionHeaderByName(
+      ::common::kHotPatchingMetadataSectionName);
+  if (section == NULL) {
+    LOG(ERROR) << "The module has no hot patching metadata.";
+    return false;
+  }
+
+  uint8* image_base = reinterpret_cast<uint8*>(module);
+  return InitFromMetadata(image_base,
+                          image_base + section->VirtualAddress,
+                          section->Misc.VirtualSize);
+}
+
+bool HotPatcher::InitFromMetadata(uint8* image_base,
+                                  const uint8* metadata,
+                                  size_t metadata_size) {
+  DCHECK(image_base != NULL);
+  DCHECK(metadata != NULL);
+  DCHECK(image_base_ == NULL);
+
+  if (metadata_size < sizeof(HotPatchingMetadataHeader)) {
+    LOG(ERROR) << "The hot patching metadata is truncated.";
+    return false;
+  }
+  const HotPatchingMetadataHeader* header =
+      reinterpret_cast<const HotPatchingMetadataHeader*>(metadata);
+  if (header->version != block_graph::kHotPatchingMetadataVersion) {
+    LOG(ERROR) << "Unsupported hot patching metadata version "
+               << header->version << ".";
+    return false;
+  }
+  size_t max_blocks = (metadata_size - sizeof(*header)) /
+      sizeof(HotPatchingBlockMetadata);
+  if (header->number_of_blocks > max_blocks) {
+    LOG(ERROR) << "The hot patching metadata is truncated.";
+    return false;
+  }
+
+  const HotPatchingBlockMetadata* blocks =
+      reinterpret_cast<const HotPatchingBlockMetadata*>(header + 1);
+  BlockMap prepared_blocks;
+  for (size_t i = 0; i < header->number_of_blocks; ++i) {
+    uint32 relative_address = blocks[i].relative_address;
+    const uint8* block = image_base + relative_address;
+    if (relative_address < kNearJumpSize || (relative_address & 1) != 0 ||
+        blocks[i].data_size < sizeof(kMovEdiEdi) ||
+        *reinterpret_cast<const uint16*>(block) != kMovEdiEdi) {
+      LOG(ERROR) << "The block at RVA 0x" << std::hex << relative_address
+                 << std::dec << " is not hot patchable.";
+      return false;
+    }
+    prepared_blocks.insert(std::make_pair(relative_address, false));
+  }
+
+  base::AutoLock auto_lock(lock_);
+  image_base_ = image_base;
+  blocks_.swap(prepared_blocks);
+  return true;
+}
+
+bool HotPatcher::EnableBlock(uint32 relative_address, const void* target) {
+  DCHECK(target != NULL);
+
+  base::AutoLock auto_lock(lock_);
+  BlockMap::iterator it = blocks_.find(relative_address);
+  if (it == blocks_.end()) {
+    LOG(ERROR) << "No hot patchable block at RVA 0x" << std::hex
+               << relative_address << std::dec << ".";
+    return false;
+  }
+  if (it->second) {
+    LOG(ERROR) << "The block at RVA 0x" << std::hex << relative_address
+               << std::dec << " is already enabled.";
+    return false;
+  }
+
+  // The jump in the padding is unreachable until the block start is patched.
+  uint8* block = image_base_ + relative_address;
+  if (!WriteJumpBeforeBlock(block, target) ||
+      !WriteBlockStart(block, kShortJumpBack)) {
+    return false;
+  }
+
+  it->second = true;
+  return true;
+}
+
+bool HotPatcher::DisableBlock(uint32 relative_address) {
+  base::AutoLock auto_lock(lock_);
+  BlockMap::iterator it = blocks_.find(relative_address);
+  if (it == blocks_.end()) {
+    LOG(ERROR) << "No hot patchable block at RVA 0x" << std::hex
+               << relative_address << std::dec << ".";
+    return false;
+  }
+  if (!it->second)
+    return true;
+
+  // The jump in the padding is left in place, as a thread may still be
+  // running through it.
+  if (!WriteBlockStart(image_base_ + relative_address, kMovEdiEdi))
+    return false;
+
+  it->second = false;
+  return true;
+}
+
+bool HotPatcher::IsBlockEnabled(uint32 relative_address) const {
+  base::AutoLock auto_lock(lock_);
+  BlockMap::const_iterator it = blocks_.find(relative_address);
+  return it != blocks_.end() && it->second;
+}
+
+bool HotPatcher::WriteBlockStart(uint8* block, uint16 instruction) {
+  DCHECK(block != NULL);
+
+  ScopedWritableCode writable_code(block, sizeof(instruction));
+  if (!writable_code.writable())
+    return false;
+
+  // The block start is word aligned, so this is seen atomically by the
+  // threads running through it.
+  ::InterlockedExchange16(reinterpret_cast<volatile SHORT*>(block),
+                          static_cast<SHORT>(instruction));
+  return true;
+}
+
+bool HotPatcher::WriteJumpBeforeBlock(uint8* block, const void* target) {
+  DCHECK(block != NULL);
+  DCHECK(target != NULL);
+
+  uint8* jump = block - kNearJumpSize;
+  ScopedWritableCode writable_code(jump, kNearJumpSize);
+  if (!writable_code.writable())
+    return false;
+
+  // The displacement is relative to the end of the jump, which is the block.
+  jump[0] = kNearJumpOpcode;
+  *reinterpret_cast<int32*>(jump + 1) =
+      reinterpret_cast<const uint8*>(target) - block;
+  return true;
+}
+
+}  // namespace common
+}  // namespace agent
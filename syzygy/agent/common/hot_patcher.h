@@ -0,0 +1,103 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a utility class that redirects the hot patchable blocks of a
+// module at runtime. This allows an agent to turn on instrumentation of
+// individual functions while the rest of the module runs at native speed.
+//
+// A hot patchable block is prepared the same way as a function compiled with
+// /hotpatch: it starts with a two byte "mov edi, edi" instruction, and is
+// preceded by at least five bytes of padding. Enabling a block writes a near
+// jump to the instrumented code in the padding, then atomically replaces the
+// "mov edi, edi" with a short jump back to it. Disabling a block restores the
+// "mov edi, edi", so threads running through it always see a whole
+// instruction.
+
+#ifndef SYZYGY_AGENT_COMMON_HOT_PATCHER_H_
+#define SYZYGY_AGENT_COMMON_HOT_PATCHER_H_
+
+#include <windows.h>
+#include <map>
+
+#include "base/basictypes.h"
+#include "base/synchronization/lock.h"
+
+namespace agent {
+namespace common {
+
+class HotPatcher {
+ public:
+  HotPatcher();
+  ~HotPatcher();
+
+  // Reads the hot patchable blocks of @p module from its hot patching
+  // metadata section.
+  // @param module the module to patch.
+  // @returns true on success, false if the module has no valid metadata.
+  bool Init(HMODULE module);
+
+  // Reads the hot patchable blocks of an image from its hot patching metadata.
+  // This is exposed for unittesting.
+  // @param image_base the base address of the image.
+  // @param metadata the hot patching metadata of the image.
+  // @param metadata_size the size of @p metadata.
+  // @returns true on success, false if the metadata is invalid.
+  bool InitFromMetadata(uint8* image_base,
+                        const uint8* metadata,
+                        size_t metadata_size);
+
+  // Redirects the block at @p relative_address to @p target. Enabling a
+  // block that is already enabled changes its target.
+  // @param relative_address the RVA of a hot patchable block.
+  // @param target the instrumented code to run instead of the block.
+  // @returns true on success, false otherwise.
+  bool EnableBlock(uint32 relative_address, const void* target);
+
+  // Restores the block at @p relative_address to its original code.
+  // @param relative_address the RVA of a hot patchable block.
+  // @returns true on success, false otherwise.
+  bool DisableBlock(uint32 relative_address);
+
+  // @returns true if the block at @p relative_address is currently
+  //     redirected.
+  bool IsBlockEnabled(uint32 relative_address) const;
+
+  // @returns the number of hot patchable blocks.
+  size_t block_count() const { return blocks_.size(); }
+
+ private:
+  // The state of each hot patchable block, by RVA.
+  typedef std::map<uint32, bool> BlockMap;
+
+  // Writes @p instruction over the first two bytes of the block at @p block,
+  // and flushes the instruction cache.
+  static bool WriteBlockStart(uint8* block, uint16 instruction);
+
+  // Writes a near jump to @p target over the five bytes preceding @p block.
+  static bool WriteJumpBeforeBlock(uint8* block, const void* target);
+
+  // The base address of the patched image.
+  uint8* image_base_;
+
+  // Serializes the patching of the blocks, and protects blocks_.
+  mutable base::Lock lock_;
+  BlockMap blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(HotPatcher);
+};
+
+}  // namespace common
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_COMMON_HOT_PATCHER_H_
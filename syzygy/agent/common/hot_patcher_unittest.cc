@@ -0,0 +1,147 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/hot_patcher.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/hot_patching_metadata.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+using block_graph::HotPatchingBlockMetadata;
+using block_graph::HotPatchingMetadataHeader;
+
+// The RVAs of the hot patchable block and of its instrumented version in the
+// test image.
+const uint32 kBlockRva = 0x10;
+const uint32 kTargetRva = 0x20;
+
+// A hot patchable block preceded by its padding, returning 1.
+const uint8 kPaddedBlock[] = {
+    0xCC, 0xCC, 0xCC, 0xCC, 0xCC,  // Padding.
+    0x8B, 0xFF,  // mov edi, edi
+    0xB8, 0x01, 0x00, 0x00, 0x00,  // mov eax, 1
+    0xC3,  // ret
+};
+
+// The instrumented version of the block, returning 2.
+const uint8 kTarget[] = {
+    0xB8, 0x02, 0x00, 0x00, 0x00,  // mov eax, 2
+    0xC3,  // ret
+};
+
+typedef int (*TestFunction)();
+
+class HotPatcherTest : public testing::Test {
+ public:
+  HotPatcherTest() : image_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    image_ = reinterpret_cast<uint8*>(::VirtualAlloc(
+        NULL, 0x1000, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+    ASSERT_TRUE(image_ != NULL);
+    ::memset(image_, 0xCC, 0x1000);
+    ::memcpy(image_ + kBlockRva - 5, kPaddedBlock, sizeof(kPaddedBlock));
+    ::memcpy(image_ + kTargetRva, kTarget, sizeof(kTarget));
+  }
+
+  virtual void TearDown() OVERRIDE {
+    if (image_ != NULL)
+      ::VirtualFree(image_, 0, MEM_RELEASE);
+  }
+
+  // Builds the hot patching metadata of the test image.
+  void BuildMetadata(uint32 version, uint32 relative_address) {
+    HotPatchingMetadataHeader header = { version, 1 };
+    HotPatchingBlockMetadata block = { relative_address, 8 };
+    const uint8* header_bytes = reinterpret_cast<const uint8*>(&header);
+    const uint8* block_bytes = reinterpret_cast<const uint8*>(&block);
+    metadata_.assign(header_bytes, header_bytes + sizeof(header));
+    metadata_.insert(metadata_.end(), block_bytes, block_bytes + sizeof(block));
+  }
+
+  int CallBlock() {
+    return reinterpret_cast<TestFunction>(image_ + kBlockRva)();
+  }
+
+ protected:
+  uint8* image_;
+  std::vector<uint8> metadata_;
+};
+
+}  // namespace
+
+TEST_F(HotPatcherTest, EnableAndDisableBlock) {
+  BuildMetadata(block_graph::kHotPatchingMetadataVersion, kBlockRva);
+  HotPatcher patcher;
+  ASSERT_TRUE(patcher.InitFromMetadata(image_, &metadata_[0],
+                                       metadata_.size()));
+  EXPECT_EQ(1U, patcher.block_count());
+  EXPECT_FALSE(patcher.IsBlockEnabled(kBlockRva));
+  EXPECT_EQ(1, CallBlock());
+
+  EXPECT_TRUE(patcher.EnableBlock(kBlockRva, image_ + kTargetRva));
+  EXPECT_TRUE(patcher.IsBlockEnabled(kBlockRva));
+  EXPECT_EQ(2, CallBlock());
+
+  // A block must be disabled before being redirected again.
+  EXPECT_FALSE(patcher.EnableBlock(kBlockRva, image_ + kTargetRva));
+
+  EXPECT_TRUE(patcher.DisableBlock(kBlockRva));
+  EXPECT_FALSE(patcher.IsBlockEnabled(kBlockRva));
+  EXPECT_EQ(1, CallBlock());
+  EXPECT_TRUE(patcher.DisableBlock(kBlockRva));
+
+  EXPECT_TRUE(patcher.EnableBlock(kBlockRva, image_ + kTargetRva));
+  EXPECT_EQ(2, CallBlock());
+}
+
+TEST_F(HotPatcherTest, FailsWithUnknownBlock) {
+  BuildMetadata(block_graph::kHotPatchingMetadataVersion, kBlockRva);
+  HotPatcher patcher;
+  ASSERT_TRUE(patcher.InitFromMetadata(image_, &metadata_[0],
+                                       metadata_.size()));
+  EXPECT_FALSE(patcher.EnableBlock(kTargetRva, image_ + kTargetRva));
+  EXPECT_FALSE(patcher.DisableBlock(kTargetRva));
+  EXPECT_FALSE(patcher.IsBlockEnabled(kTargetRva));
+}
+
+TEST_F(HotPatcherTest, InitFailsWithInvalidMetadata) {
+  // Wrong version.
+  BuildMetadata(block_graph::kHotPatchingMetadataVersion + 1, kBlockRva);
+  HotPatcher patcher1;
+  EXPECT_FALSE(patcher1.InitFromMetadata(image_, &metadata_[0],
+                                         metadata_.size()));
+
+  // Truncated.
+  BuildMetadata(block_graph::kHotPatchingMetadataVersion, kBlockRva);
+  HotPatcher patcher2;
+  EXPECT_FALSE(patcher2.InitFromMetadata(image_, &metadata_[0],
+                                         metadata_.size() - 1));
+
+  // The block doesn't start with "mov edi, edi".
+  BuildMetadata(block_graph::kHotPatchingMetadataVersion, kTargetRva);
+  HotPatcher patcher3;
+  EXPECT_FALSE(patcher3.InitFromMetadata(image_, &metadata_[0],
+                                         metadata_.size()));
+}
+
+}  // namespace common
+}  // namespace agent
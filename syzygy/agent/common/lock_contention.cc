@@ -0,0 +1,119 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/lock_contention.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/lazy_instance.h"
+#include "base/strings/stringprintf.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+typedef LockContentionTable::EntryMap EntryMap;
+
+base::LazyInstance<LockContentionTable>::Leaky static_table_instance =
+    LAZY_INSTANCE_INITIALIZER;
+
+// Orders the records by decreasing wait time, and then by decreasing count.
+bool IsMoreContended(const EntryMap::value_type* entry1,
+                     const EntryMap::value_type* entry2) {
+  if (entry1->second.wait_cycles != entry2->second.wait_cycles)
+    return entry1->second.wait_cycles > entry2->second.wait_cycles;
+  return entry1->second.count > entry2->second.count;
+}
+
+}  // namespace
+
+bool LockContentionTable::Key::operator<(const Key& other) const {
+  if (lock_name != other.lock_name)
+    return lock_name < other.lock_name;
+  if (stack_id != other.stack_id)
+    return stack_id < other.stack_id;
+  return role < other.role;
+}
+
+LockContentionTable* LockContentionTable::Instance() {
+  return static_table_instance.Pointer();
+}
+
+void LockContentionTable::RecordWaitingSite(const char* lock_name,
+                                            StackId stack_id,
+                                            uint64 wait_cycles) {
+  DCHECK(lock_name != NULL);
+  Key key = { lock_name, stack_id, kWaitingSite };
+
+  base::AutoLock lock(lock_);
+  Entry& entry = entries_[key];
+  ++entry.count;
+  entry.wait_cycles += wait_cycles;
+  entry.max_wait_cycles = std::max(entry.max_wait_cycles, wait_cycles);
+}
+
+void LockContentionTable::RecordOwningSite(const char* lock_name,
+                                           StackId stack_id) {
+  DCHECK(lock_name != NULL);
+  Key key = { lock_name, stack_id, kOwningSite };
+
+  base::AutoLock lock(lock_);
+  ++entries_[key].count;
+}
+
+void LockContentionTable::GetEntries(EntryMap* entries) const {
+  DCHECK(entries != NULL);
+  base::AutoLock lock(lock_);
+  *entries = entries_;
+}
+
+void LockContentionTable::Dump() const {
+  EntryMap entries;
+  GetEntries(&entries);
+  if (entries.empty())
+    return;
+
+  std::vector<const EntryMap::value_type*> sorted_entries;
+  sorted_entries.reserve(entries.size());
+  EntryMap::const_iterator it = entries.begin();
+  for (; it != entries.end(); ++it)
+    sorted_entries.push_back(&(*it));
+  std::sort(sorted_entries.begin(), sorted_entries.end(), IsMoreContended);
+
+  LOG(INFO) << "Lock contention by call site:";
+  for (size_t i = 0; i < sorted_entries.size(); ++i) {
+    const Key& key = sorted_entries[i]->first;
+    const Entry& entry = sorted_entries[i]->second;
+    if (key.role == kWaitingSite) {
+      LOG(INFO) << base::StringPrintf(
+          "  %s: waiting site 0x%08X, %u waits, %llu cycles "
+          "(max %llu).", key.lock_name, key.stack_id, entry.count,
+          entry.wait_cycles, entry.max_wait_cycles);
+    } else {
+      LOG(INFO) << base::StringPrintf(
+          "  %s: owning site 0x%08X, held during %u waits.",
+          key.lock_name, key.stack_id, entry.count);
+    }
+  }
+}
+
+void LockContentionTable::Clear() {
+  base::AutoLock lock(lock_);
+  entries_.clear();
+}
+
+}  // namespace common
+}  // namespace agent
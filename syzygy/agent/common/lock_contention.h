@@ -0,0 +1,198 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a lock wrapper that records where and for how long the lock is
+// contended. It can wrap any lock with the Acquire/Release/Try interface of
+// base::Lock, such as common::RecursiveLock:
+//
+//   ContentionTrackingLock<base::Lock> lock_("Profiler::lock_");
+//   ...
+//   AutoContentionTrackingLock<base::Lock> lock(lock_);
+//
+// The uncontended path costs a single Try. When a thread has to wait, it
+// records its call site and the time it waited, and asks the owner of the
+// lock to record its own call site when releasing it. The call sites are
+// identified by the relative IDs of their stack traces, which are stable
+// across runs. The records are accumulated in the LockContentionTable, which
+// an agent dumps to its log when it is torn down.
+
+#ifndef SYZYGY_AGENT_COMMON_LOCK_CONTENTION_H_
+#define SYZYGY_AGENT_COMMON_LOCK_CONTENTION_H_
+
+#include <windows.h>
+#include <intrin.h>
+
+#include <map>
+
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/common/stack_capture.h"
+
+namespace agent {
+namespace common {
+
+// Accumulates the contention records of the ContentionTrackingLocks of the
+// process.
+class LockContentionTable {
+ public:
+  typedef StackCapture::StackId StackId;
+
+  // The role of a call site in a contention.
+  enum SiteRole {
+    // The site waited for the lock.
+    kWaitingSite,
+    // The site held the lock while another thread waited for it.
+    kOwningSite,
+  };
+
+  // Identifies a call site of a lock.
+  struct Key {
+    bool operator<(const Key& other) const;
+
+    // The name of the lock. This is a static string.
+    const char* lock_name;
+    StackId stack_id;
+    SiteRole role;
+  };
+
+  // The contention records of a call site.
+  struct Entry {
+    // The number of contentions in which the site took part.
+    size_t count;
+    // The total and maximum number of CPU cycles spent waiting at the site.
+    // These are only counted for waiting sites.
+    uint64 wait_cycles;
+    uint64 max_wait_cycles;
+  };
+
+  typedef std::map<Key, Entry> EntryMap;
+
+  LockContentionTable() { }
+
+  // @returns the table of the process.
+  static LockContentionTable* Instance();
+
+  // Records a site that waited for a lock.
+  // @param lock_name The name of the lock.
+  // @param stack_id The relative ID of the stack trace of the site.
+  // @param wait_cycles The number of CPU cycles spent waiting.
+  void RecordWaitingSite(const char* lock_name,
+                         StackId stack_id,
+                         uint64 wait_cycles);
+
+  // Records a site that held a lock while another thread waited for it.
+  // @param lock_name The name of the lock.
+  // @param stack_id The relative ID of the stack trace of the site.
+  void RecordOwningSite(const char* lock_name, StackId stack_id);
+
+  // Gets a copy of the records.
+  // @param entries Receives the records.
+  void GetEntries(EntryMap* entries) const;
+
+  // Writes the records to the log, most contended sites first.
+  void Dump() const;
+
+  // Discards all the records.
+  void Clear();
+
+ private:
+  // Protects entries_. This lock isn't tracked, so that recording doesn't
+  // recurse.
+  mutable base::Lock lock_;
+  EntryMap entries_;  // Under lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(LockContentionTable);
+};
+
+// A lock that records its contention in the LockContentionTable.
+// @tparam LockType The type of the wrapped lock.
+template <typename LockType>
+class ContentionTrackingLock {
+ public:
+  // @param name The name of the lock, as it will appear in the records. This
+  //     must be a static string.
+  explicit ContentionTrackingLock(const char* name)
+      : name_(name), contended_(0) {
+    DCHECK(name != NULL);
+  }
+
+  // @name The interface of the wrapped lock.
+  // @{
+  bool Try() { return lock_.Try(); }
+  void AssertAcquired() { lock_.AssertAcquired(); }
+
+  // This mustn't be inlined, so that the recorded stack trace starts at the
+  // caller.
+  __declspec(noinline) void Acquire() {
+    if (lock_.Try())
+      return;
+
+    StackCapture stack;
+    stack.InitFromStack();
+    ::InterlockedExchange(&contended_, 1);
+    uint64 start_cycles = ::__rdtsc();
+    lock_.Acquire();
+    uint64 wait_cycles = ::__rdtsc() - start_cycles;
+    LockContentionTable::Instance()->RecordWaitingSite(
+        name_, stack.ComputeRelativeStackId(), wait_cycles);
+  }
+
+  __declspec(noinline) void Release() {
+    if (contended_ != 0 && ::InterlockedExchange(&contended_, 0) != 0) {
+      StackCapture stack;
+      stack.InitFromStack();
+      LockContentionTable::Instance()->RecordOwningSite(
+          name_, stack.ComputeRelativeStackId());
+    }
+    lock_.Release();
+  }
+  // @}
+
+  // @returns the name of the lock.
+  const char* name() const { return name_; }
+
+ private:
+  LockType lock_;
+  const char* name_;
+
+  // Set by a thread that has to wait for the lock, so that the owner records
+  // its call site when it releases the lock.
+  volatile LONG contended_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContentionTrackingLock);
+};
+
+// A scoped lock helper for contention tracking locks.
+template <typename LockType>
+class AutoContentionTrackingLock {
+ public:
+  explicit AutoContentionTrackingLock(ContentionTrackingLock<LockType>& lock)
+      : lock_(lock) {
+    lock_.Acquire();
+  }
+
+  ~AutoContentionTrackingLock() {
+    lock_.Release();
+  }
+
+ private:
+  ContentionTrackingLock<LockType>& lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(AutoContentionTrackingLock);
+};
+
+}  // namespace common
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_COMMON_LOCK_CONTENTION_H_
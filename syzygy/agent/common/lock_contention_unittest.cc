@@ -0,0 +1,166 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/lock_contention.h"
+
+#include "base/bind.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/thread.h"
+#include "gtest/gtest.h"
+#include "syzygy/common/recursive_lock.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+typedef LockContentionTable::EntryMap EntryMap;
+
+const char kTestLockName[] = "TestLock";
+
+class LockContentionTest : public testing::Test {
+ public:
+  LockContentionTest() : worker_thread_("test") {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    StackCapture::Init();
+    LockContentionTable::Instance()->Clear();
+    ASSERT_TRUE(worker_thread_.Start());
+  }
+
+  virtual void TearDown() OVERRIDE {
+    worker_thread_.Stop();
+    LockContentionTable::Instance()->Clear();
+  }
+
+  // Acquires and releases a lock, after signaling an event.
+  template <typename LockType>
+  static void AcquireAndRelease(ContentionTrackingLock<LockType>* lock,
+                                base::WaitableEvent* event) {
+    event->Signal();
+    AutoContentionTrackingLock<LockType> auto_lock(*lock);
+  }
+
+  // Makes the worker thread wait for a lock held by the current thread.
+  template <typename LockType>
+  void ContendLock(ContentionTrackingLock<LockType>* lock) {
+    base::WaitableEvent event(false, false);
+    lock->Acquire();
+    worker_thread_.message_loop()->PostTask(
+        FROM_HERE,
+        base::Bind(&LockContentionTest::AcquireAndRelease<LockType>,
+                   lock,
+                   &event));
+    event.Wait();
+    // Give the worker thread the time to block on the lock.
+    base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(50));
+    lock->Release();
+    worker_thread_.Stop();
+  }
+
+  // Counts the records of a given role.
+  static size_t CountRecords(const EntryMap& entries,
+                             LockContentionTable::SiteRole role,
+                             uint64* wait_cycles) {
+    size_t count = 0;
+    *wait_cycles = 0;
+    EntryMap::const_iterator it = entries.begin();
+    for (; it != entries.end(); ++it) {
+      EXPECT_EQ(kTestLockName, it->first.lock_name);
+      if (it->first.role != role)
+        continue;
+      count += it->second.count;
+      *wait_cycles += it->second.wait_cycles;
+    }
+    return count;
+  }
+
+ protected:
+  base::Thread worker_thread_;
+};
+
+}  // namespace
+
+TEST_F(LockContentionTest, RecordSites) {
+  LockContentionTable* table = LockContentionTable::Instance();
+  table->RecordWaitingSite(kTestLockName, 1, 10);
+  table->RecordWaitingSite(kTestLockName, 1, 30);
+  table->RecordWaitingSite(kTestLockName, 2, 5);
+  table->RecordOwningSite(kTestLockName, 1);
+
+  EntryMap entries;
+  table->GetEntries(&entries);
+  ASSERT_EQ(3U, entries.size());
+
+  LockContentionTable::Key key = {
+      kTestLockName, 1, LockContentionTable::kWaitingSite };
+  ASSERT_EQ(1U, entries.count(key));
+  EXPECT_EQ(2U, entries[key].count);
+  EXPECT_EQ(40U, entries[key].wait_cycles);
+  EXPECT_EQ(30U, entries[key].max_wait_cycles);
+
+  key.role = LockContentionTable::kOwningSite;
+  ASSERT_EQ(1U, entries.count(key));
+  EXPECT_EQ(1U, entries[key].count);
+  EXPECT_EQ(0U, entries[key].wait_cycles);
+
+  table->Dump();
+  table->Clear();
+  table->GetEntries(&entries);
+  EXPECT_TRUE(entries.empty());
+}
+
+TEST_F(LockContentionTest, UncontendedLockRecordsNothing) {
+  ContentionTrackingLock<base::Lock> lock(kTestLockName);
+  for (size_t i = 0; i < 10; ++i) {
+    AutoContentionTrackingLock<base::Lock> auto_lock(lock);
+    lock.AssertAcquired();
+  }
+
+  EntryMap entries;
+  LockContentionTable::Instance()->GetEntries(&entries);
+  EXPECT_TRUE(entries.empty());
+}
+
+TEST_F(LockContentionTest, ContendedLock) {
+  ContentionTrackingLock<base::Lock> lock(kTestLockName);
+  ContendLock(&lock);
+
+  EntryMap entries;
+  LockContentionTable::Instance()->GetEntries(&entries);
+  uint64 wait_cycles = 0;
+  EXPECT_EQ(1U, CountRecords(
+      entries, LockContentionTable::kWaitingSite, &wait_cycles));
+  EXPECT_LT(0U, wait_cycles);
+  EXPECT_EQ(1U, CountRecords(
+      entries, LockContentionTable::kOwningSite, &wait_cycles));
+}
+
+TEST_F(LockContentionTest, ContendedRecursiveLock) {
+  ContentionTrackingLock< ::common::RecursiveLock> lock(kTestLockName);
+  ContendLock(&lock);
+
+  EntryMap entries;
+  LockContentionTable::Instance()->GetEntries(&entries);
+  uint64 wait_cycles = 0;
+  EXPECT_EQ(1U, CountRecords(
+      entries, LockContentionTable::kWaitingSite, &wait_cycles));
+  EXPECT_EQ(1U, CountRecords(
+      entries, LockContentionTable::kOwningSite, &wait_cycles));
+}
+
+}  // namespace common
+}  // namespace agent
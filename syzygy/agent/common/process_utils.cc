@@ -16,7 +16,9 @@
 
 #include <psapi.h>
 
+#include "base/lazy_instance.h"
 #include "base/logging.h"
+#include "base/synchronization/lock.h"
 #include "base/win/pe_image.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/path_util.h"
@@ -27,6 +29,17 @@ namespace common {
 
 namespace {
 
+// The device path converter shared by all the calls to LogModule. Caching the
+// device names of the drives makes logging all the modules of a process much
+// cheaper, as each conversion otherwise queries every logical drive.
+struct SharedDevicePathConverter {
+  base::Lock lock;
+  ::common::DevicePathConverter converter;  // Under lock.
+};
+
+base::LazyInstance<SharedDevicePathConverter>::Leaky shared_converter =
+    LAZY_INSTANCE_INITIALIZER;
+
 // Accessing a module acquired from process iteration calls is inherently racy,
 // as we don't hold any kind of reference to the module, and so the module
 // could be unloaded while we're accessing it.
@@ -130,9 +143,13 @@ bool LogModule(HMODULE module,
   }
   base::FilePath device_path(module_name);
   base::FilePath drive_path;
-  if (!::common::ConvertDevicePathToDrivePath(device_path, &drive_path)) {
-    LOG(ERROR) << "ConvertDevicePathToDrivePath failed.";
-    return false;
+  {
+    SharedDevicePathConverter* shared = shared_converter.Pointer();
+    base::AutoLock lock(shared->lock);
+    if (!shared->converter.Convert(device_path, &drive_path)) {
+      LOG(ERROR) << "Failed to convert device path to drive path.";
+      return false;
+    }
   }
   ::wcsncpy(module_event->module_name, drive_path.value().c_str(),
             arraysize(module_event->module_name));
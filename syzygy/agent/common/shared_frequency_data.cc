@@ -0,0 +1,144 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/shared_frequency_data.h"
+
+#include "base/logging.h"
+#include "syzygy/common/com_utils.h"
+
+namespace agent {
+namespace common {
+
+// A new file mapping is zero-filled, so a size of zero identifies a shared
+// array that hasn't been initialized yet.
+struct SharedFrequencyData::Header {
+  // The size of the shared array, in bytes.
+  uint32 size;
+  // The number of processes attached to the shared array.
+  uint32 attached_processes;
+};
+
+SharedFrequencyData::SharedFrequencyData()
+    : header_(NULL), data_(NULL), size_(0) {
+}
+
+SharedFrequencyData::~SharedFrequencyData() {
+  if (attached())
+    Detach(NULL);
+}
+
+bool SharedFrequencyData::Attach(const base::StringPiece16& name,
+                                 size_t size) {
+  DCHECK(!attached());
+  DCHECK_LT(0U, size);
+
+  std::wstring mapping_name(name.as_string());
+  std::wstring mutex_name(mapping_name + L"-lock");
+  mutex_.Set(::CreateMutex(NULL, FALSE, mutex_name.c_str()));
+  if (!mutex_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create mutex \"" << mutex_name << "\": "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  if (!Lock()) {
+    Close();
+    return false;
+  }
+
+  bool attached = false;
+  size_t mapping_size = sizeof(Header) + size;
+  mapping_.Set(::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   0, mapping_size, mapping_name.c_str()));
+  if (!mapping_.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to create shared frequency data \""
+               << mapping_name << "\": " << ::common::LogWe(error) << ".";
+  } else {
+    header_ = reinterpret_cast<Header*>(::MapViewOfFile(
+        mapping_.Get(), FILE_MAP_ALL_ACCESS, 0, 0, mapping_size));
+    if (header_ == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to map shared frequency data \"" << mapping_name
+                 << "\": " << ::common::LogWe(error) << ".";
+    } else if (header_->size != 0 && header_->size != size) {
+      LOG(ERROR) << "The shared frequency data \"" << mapping_name
+                 << "\" has size " << header_->size << ", expected " << size
+                 << ".";
+    } else {
+      header_->size = size;
+      ++header_->attached_processes;
+      data_ = reinterpret_cast<uint8*>(header_ + 1);
+      size_ = size;
+      attached = true;
+    }
+  }
+
+  Unlock();
+  if (!attached)
+    Close();
+  return attached;
+}
+
+bool SharedFrequencyData::Detach(std::vector<uint8>* merged_data) {
+  DCHECK(attached());
+
+  bool merged = false;
+  if (Lock()) {
+    DCHECK_LT(0U, header_->attached_processes);
+    if (--header_->attached_processes == 0) {
+      if (merged_data != NULL) {
+        merged_data->assign(data_, data_ + size_);
+        merged = true;
+      }
+      ::memset(data_, 0, size_);
+    }
+    Unlock();
+  }
+
+  Close();
+  return merged;
+}
+
+bool SharedFrequencyData::Lock() {
+  // An abandoned mutex is still acquired. The header it protects is only
+  // ever updated by simple increments and decrements.
+  DWORD result = ::WaitForSingleObject(mutex_.Get(), INFINITE);
+  if (result != WAIT_OBJECT_0 && result != WAIT_ABANDONED) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to acquire shared frequency data mutex: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  return true;
+}
+
+void SharedFrequencyData::Unlock() {
+  ::ReleaseMutex(mutex_.Get());
+}
+
+void SharedFrequencyData::Close() {
+  if (header_ != NULL) {
+    ::UnmapViewOfFile(header_);
+    header_ = NULL;
+  }
+  data_ = NULL;
+  size_ = 0;
+  mapping_.Close();
+  mutex_.Close();
+}
+
+}  // namespace common
+}  // namespace agent
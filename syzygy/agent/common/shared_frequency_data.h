@@ -0,0 +1,92 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a frequency array that is shared by all the processes of an
+// instrumented module, through a named file mapping. The processes record
+// their visits directly in the shared array, and the last process to detach
+// from it gets the merged data, so that a single record is written for all of
+// them.
+
+#ifndef SYZYGY_AGENT_COMMON_SHARED_FREQUENCY_DATA_H_
+#define SYZYGY_AGENT_COMMON_SHARED_FREQUENCY_DATA_H_
+
+#include <windows.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+#include "base/win/scoped_handle.h"
+
+namespace agent {
+namespace common {
+
+class SharedFrequencyData {
+ public:
+  SharedFrequencyData();
+
+  // Detaches from the shared array, discarding the merged data if this is the
+  // last process attached to it.
+  ~SharedFrequencyData();
+
+  // Attaches to the shared array called @p name, creating it if this is the
+  // first process to attach to it.
+  // @param name the name of the shared array. This should identify the
+  //     instrumented module and the trace session.
+  // @param size the size of the shared array, in bytes. This must be the same
+  //     in all the processes.
+  // @returns true on success, false otherwise.
+  bool Attach(const base::StringPiece16& name, size_t size);
+
+  // Detaches from the shared array. If this was the last process attached to
+  // it, returns the merged data and clears the array, so that processes that
+  // attach to it later start afresh.
+  // @param merged_data receives the merged data if this was the last process
+  //     attached to the shared array. May be NULL to discard it.
+  // @returns true if @p merged_data was filled in, false otherwise.
+  bool Detach(std::vector<uint8>* merged_data);
+
+  // @returns true if attached to a shared array.
+  bool attached() const { return data_ != NULL; }
+
+  // @returns the shared array, or NULL if not attached.
+  uint8* data() const { return data_; }
+
+  // @returns the size of the shared array.
+  size_t size() const { return size_; }
+
+ private:
+  // The header at the start of the file mapping, followed by the array.
+  struct Header;
+
+  // Acquires and releases the mutex that protects the header.
+  // @returns true on success, false otherwise.
+  bool Lock();
+  void Unlock();
+
+  // Unmaps the shared array and closes the handles to it.
+  void Close();
+
+  base::win::ScopedHandle mutex_;
+  base::win::ScopedHandle mapping_;
+  Header* header_;
+  uint8* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedFrequencyData);
+};
+
+}  // namespace common
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_COMMON_SHARED_FREQUENCY_DATA_H_
@@ -0,0 +1,80 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/common/shared_frequency_data.h"
+
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace common {
+
+namespace {
+
+const size_t kSize = 4;
+
+class SharedFrequencyDataTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    // Use a name of our own, so that concurrent test runs don't interfere.
+    name_ = base::StringPrintf(L"syzygy-shared-frequency-data-test-%d",
+                               ::GetCurrentProcessId());
+  }
+
+ protected:
+  std::wstring name_;
+};
+
+}  // namespace
+
+TEST_F(SharedFrequencyDataTest, LastDetachGetsMergedData) {
+  // Two instances in the same process behave as two processes would.
+  SharedFrequencyData first;
+  SharedFrequencyData second;
+  ASSERT_TRUE(first.Attach(name_, kSize));
+  ASSERT_TRUE(second.Attach(name_, kSize));
+  EXPECT_TRUE(first.attached());
+  EXPECT_EQ(kSize, first.size());
+  ASSERT_TRUE(first.data() != NULL);
+  ASSERT_TRUE(second.data() != NULL);
+
+  first.data()[0] = 1;
+  second.data()[2] = 1;
+  EXPECT_EQ(1, second.data()[0]);
+  EXPECT_EQ(1, first.data()[2]);
+
+  std::vector<uint8> merged;
+  EXPECT_FALSE(first.Detach(&merged));
+  EXPECT_FALSE(first.attached());
+  EXPECT_TRUE(merged.empty());
+
+  // The shared array survives the first process.
+  second.data()[3] = 1;
+
+  ASSERT_TRUE(second.Detach(&merged));
+  const uint8 kExpected[kSize] = { 1, 0, 1, 1 };
+  ASSERT_EQ(kSize, merged.size());
+  EXPECT_EQ(0, ::memcmp(kExpected, &merged[0], kSize));
+}
+
+TEST_F(SharedFrequencyDataTest, AttachFailsWithDifferentSize) {
+  SharedFrequencyData first;
+  SharedFrequencyData second;
+  ASSERT_TRUE(first.Attach(name_, kSize));
+  EXPECT_FALSE(second.Attach(name_, kSize / 2));
+  EXPECT_FALSE(second.attached());
+}
+
+}  // namespace common
+}  // namespace agent
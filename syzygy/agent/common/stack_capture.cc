@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/common/stack_capture.h"
 
+#include <intrin.h>
 #include <algorithm>
 
 #include "base/logging.h"
@@ -37,6 +38,9 @@ uint32 ComputeStackTraceHash(void** stack_trace, uint8 stack_depth) {
 size_t StackCapture::bottom_frames_to_skip_ =
     ::common::kDefaultBottomFramesToSkip;
 
+// Whether stack traces are captured by walking the frame pointers.
+bool StackCapture::fast_capture_ = ::common::kDefaultEnableFastStackCapture;
+
 size_t StackCapture::GetSize(size_t max_num_frames) {
   DCHECK_LT(0u, max_num_frames);
   max_num_frames = std::min(max_num_frames, kMaxNumFrames);
@@ -67,6 +71,7 @@ void StackCapture::RemoveRef() {
 
 void StackCapture::Init() {
   bottom_frames_to_skip_ = ::common::kDefaultBottomFramesToSkip;
+  fast_capture_ = ::common::kDefaultEnableFastStackCapture;
 }
 
 void StackCapture::InitFromBuffer(StackId stack_id,
@@ -79,6 +84,58 @@ void StackCapture::InitFromBuffer(StackId stack_id,
   ::memcpy(frames_, frames, num_frames_ * sizeof(void*));
 }
 
+// The walk needs the frame of this function, so it must keep its frame
+// pointer even in optimized builds.
+#pragma optimize("y", off)
+void StackCapture::InitFromFramePointers() {
+  // Frame pointers that point outside of the stack of the current thread end
+  // the walk.
+  const NT_TIB* tib = reinterpret_cast<const NT_TIB*>(::NtCurrentTeb());
+  void** stack_low = reinterpret_cast<void**>(tib->StackLimit);
+  void** stack_high = reinterpret_cast<void**>(tib->StackBase);
+
+  // Each frame starts with the frame pointer of its caller, followed by the
+  // return address into it. The return address of this function is the first
+  // frame, as InitFromStack is inlined into its caller.
+  void** frame = reinterpret_cast<void**>(::_AddressOfReturnAddress()) - 1;
+  size_t num_frames = 0;
+  uint32 hash_value = 0;
+  while (num_frames < max_num_frames_) {
+    if (frame < stack_low || frame + 2 > stack_high ||
+        (reinterpret_cast<uintptr_t>(frame) & (sizeof(void*) - 1)) != 0) {
+      break;
+    }
+    void* return_address = frame[1];
+    if (return_address == NULL)
+      break;
+    frames_[num_frames++] = return_address;
+    hash_value += reinterpret_cast<uint32>(return_address);
+
+    // The frames of the callers are further up the stack. Anything else means
+    // that the chain is broken, by code that doesn't maintain frame pointers.
+    void** next_frame = reinterpret_cast<void**>(frame[0]);
+    if (next_frame <= frame)
+      break;
+    frame = next_frame;
+  }
+  DCHECK_LT(0u, num_frames);
+
+  // Drop the bottom frames, and take them out of the hash. This matches
+  // ComputeStackTraceHash over the remaining frames.
+  if (num_frames > bottom_frames_to_skip_) {
+    for (size_t i = num_frames - bottom_frames_to_skip_; i < num_frames; ++i)
+      hash_value -= reinterpret_cast<uint32>(frames_[i]);
+    num_frames -= bottom_frames_to_skip_;
+  } else {
+    hash_value = reinterpret_cast<uint32>(frames_[0]);
+    num_frames = 1;
+  }
+
+  num_frames_ = static_cast<uint8>(num_frames);
+  stack_id_ = hash_value;
+}
+#pragma optimize("", on)
+
 StackCapture::StackId StackCapture::ComputeRelativeStackId() {
   // We want to ignore the frames relative to our module to be able to get the
   // same trace id even if we update our runtime.
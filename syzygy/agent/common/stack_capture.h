@@ -133,6 +133,19 @@ class StackCapture {
   // Get the number of bottom frames to skip per stack trace.
   static size_t bottom_frames_to_skip() { return bottom_frames_to_skip_; }
 
+  // Enables or disables the fast stack capture. When enabled, InitFromStack
+  // walks the chain of frame pointers itself and computes the stack ID during
+  // the walk, rather than calling ::CaptureStackBackTrace and hashing the
+  // frames in a second pass. This requires the code on the stack to maintain
+  // frame pointers; the walk stops at the first frame that doesn't.
+  // @param fast_capture True to enable the fast stack capture.
+  static void set_fast_capture(bool fast_capture) {
+    fast_capture_ = fast_capture;
+  }
+
+  // @returns true if the fast stack capture is enabled.
+  static bool fast_capture() { return fast_capture_; }
+
   // Initializes a stack trace from an array of frame pointers, a count and
   // a StackId (such as returned by ::CaptureStackBackTrace).
   // @param stack_id The ID of the stack back trace.
@@ -148,6 +161,10 @@ class StackCapture {
   // that it doesn't further pollute the stack trace, but rather makes it
   // reflect the actual point of the call.
   __forceinline void InitFromStack() {
+    if (fast_capture_) {
+      InitFromFramePointers();
+      return;
+    }
     num_frames_ = ::CaptureStackBackTrace(
         0, max_num_frames_, frames_, NULL);
     if (num_frames_ > bottom_frames_to_skip_)
@@ -174,9 +191,19 @@ class StackCapture {
   StackId ComputeRelativeStackId();
 
  protected:
+  // Initializes a stack trace by walking the chain of frame pointers, starting
+  // with the frame of the caller of InitFromStack. This produces the same
+  // frames and stack ID as ::CaptureStackBackTrace does on code that
+  // maintains frame pointers. This mustn't be inlined, as the walk starts
+  // from its own frame.
+  __declspec(noinline) void InitFromFramePointers();
+
   // The number of bottom frames to skip on the stack traces.
   static size_t bottom_frames_to_skip_;
 
+  // Indicates if InitFromStack uses InitFromFramePointers.
+  static bool fast_capture_;
+
   // The unique ID of this hash. This is used for storing the hash in the set.
   StackId stack_id_;
 
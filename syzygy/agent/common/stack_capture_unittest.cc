@@ -97,5 +97,44 @@ TEST_F(StackCaptureTest, RestrictedFrameCount) {
   EXPECT_EQ(5u, capture.max_num_frames());
 }
 
+TEST_F(StackCaptureTest, FastCapture) {
+  StackCapture::set_bottom_frames_to_skip(0);
+  StackCapture capture;
+  StackCapture fast_capture;
+
+  // Both captures are made from this function, so they only differ by their
+  // first frame.
+  capture.InitFromStack();
+  StackCapture::set_fast_capture(true);
+  fast_capture.InitFromStack();
+  StackCapture::set_fast_capture(false);
+
+  EXPECT_TRUE(fast_capture.IsValid());
+  ASSERT_LT(1u, fast_capture.num_frames());
+  ASSERT_LT(1u, capture.num_frames());
+  EXPECT_EQ(capture.frames()[1], fast_capture.frames()[1]);
+
+  // The stack ID is computed during the walk, and matches the usual hash.
+  void* frames[StackCapture::kMaxNumFrames] = {};
+  ::memcpy(frames, fast_capture.frames(),
+           fast_capture.num_frames() * sizeof(void*));
+  EXPECT_EQ(ComputeStackTraceHash(
+                frames, static_cast<uint8>(fast_capture.num_frames())),
+            fast_capture.stack_id());
+
+  // Skipping the bottom frames takes them out of the hash.
+  StackCapture::set_bottom_frames_to_skip(1);
+  StackCapture::set_fast_capture(true);
+  StackCapture skipped_capture;
+  skipped_capture.InitFromStack();
+  StackCapture::set_fast_capture(false);
+  EXPECT_EQ(fast_capture.num_frames() - 1, skipped_capture.num_frames());
+  EXPECT_EQ(ComputeStackTraceHash(
+                frames, static_cast<uint8>(skipped_capture.num_frames())) -
+                reinterpret_cast<uint32>(frames[0]) +
+                reinterpret_cast<uint32>(skipped_capture.frames()[0]),
+            skipped_capture.stack_id());
+}
+
 }  // namespace common
 }  // namespace agent
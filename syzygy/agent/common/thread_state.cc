@@ -21,16 +21,20 @@ namespace common {
 
 ThreadStateBase::ThreadStateBase()
     : thread_handle_(
-        ::OpenThread(SYNCHRONIZE, FALSE, ::GetCurrentThreadId())) {
+        ::OpenThread(SYNCHRONIZE, FALSE, ::GetCurrentThreadId())),
+      wait_handle_(NULL),
+      manager_(NULL),
+      next_dead_item_(NULL) {
   DCHECK(thread_handle_.IsValid());
   InitializeListHead(&entry_);
 }
 
 ThreadStateBase::~ThreadStateBase() {
   DCHECK(IsListEmpty(&entry_));
+  DCHECK(wait_handle_ == NULL);
 }
 
-ThreadStateManager::ThreadStateManager() {
+ThreadStateManager::ThreadStateManager() : dead_items_(NULL) {
   InitializeListHead(&active_items_);
   InitializeListHead(&death_row_items_);
 }
@@ -40,6 +44,15 @@ ThreadStateManager::~ThreadStateManager() {
   // racy as hell if other threads are active, but it's the caller's
   // responsibility to ensure that's not the case.
 
+  // Cancel the pending thread termination notifications, so that none of
+  // them fires once the manager is gone. The items whose threads are dead are
+  // then found by polling.
+  LIST_ENTRY* entry = death_row_items_.Flink;
+  for (; entry != &death_row_items_; entry = entry->Flink) {
+    ThreadStateBase* item = CONTAINING_RECORD(entry, ThreadStateBase, entry_);
+    UnregisterWait(item, true);
+  }
+
   // Attempt an orderly deletion of items of the death row.
   Scavenge();
 
@@ -77,9 +90,27 @@ void ThreadStateManager::Register(ThreadStateBase* item) {
 
 void ThreadStateManager::Unregister(ThreadStateBase* item) {
   DCHECK(item != NULL);
-  base::AutoLock auto_lock(lock_);
-  RemoveEntryList(&item->entry_);
-  InitializeListHead(&item->entry_);
+
+  LIST_ENTRY dead_items;
+  InitializeListHead(&dead_items);
+
+  {
+    base::AutoLock auto_lock(lock_);
+
+    // Make sure that no notification is pending or running for this item. The
+    // notification doesn't acquire lock_, so this can safely block on it.
+    UnregisterWait(item, true);
+
+    RemoveEntryList(&item->entry_);
+    InitializeListHead(&item->entry_);
+
+    // The item may already have been pushed on the dead items stack. Gathering
+    // the dead items takes it off the stack, and leaves it alone as it's no
+    // longer on death row.
+    GatherDeadItemsUnlocked(&dead_items);
+  }
+
+  DeleteItems(&dead_items);
 }
 
 void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
@@ -92,6 +123,11 @@ void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
     DCHECK(IsNodeOnList(&active_items_, &item->entry_) ||
            IsNodeOnList(&death_row_items_, &item->entry_));
 
+    // An item that is already waiting for its thread to terminate stays on
+    // death row.
+    if (item->wait_handle_ != NULL)
+      return;
+
     // Pull it out of the list it's on, this'll preserve it over the scavenge
     // below, in the unlikely case that the item is being marked from another
     // thread than it's own.
@@ -106,6 +142,20 @@ void ThreadStateManager::MarkForDeath(ThreadStateBase* item) {
     base::AutoLock auto_lock(lock_);
 
     InsertHeadList(&death_row_items_, &item->entry_);
+
+    // Ask to be notified once the thread has terminated. This is done under
+    // the lock so that the item can't be gathered before it's on death row.
+    // If this fails then the item is simply polled when scavenging.
+    item->manager_ = this;
+    if (!::RegisterWaitForSingleObject(&item->wait_handle_,
+                                       item->thread_handle_.Get(),
+                                       &ThreadStateManager::OnThreadTerminated,
+                                       item,
+                                       INFINITE,
+                                       WT_EXECUTEONLYONCE |
+                                           WT_EXECUTEINWAITTHREAD)) {
+      item->wait_handle_ = NULL;
+    }
   }
 }
 
@@ -141,11 +191,35 @@ void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
   DCHECK(IsListEmpty(dead_items));
   lock_.AssertAcquired();
 
+  // Take the items whose threads were notified as terminated. The stack is
+  // only ever emptied as a whole, so this is safe from concurrent pushes.
+  ThreadStateBase* dead_item = reinterpret_cast<ThreadStateBase*>(
+      ::InterlockedExchangePointer(
+          reinterpret_cast<void* volatile*>(&dead_items_), NULL));
+  while (dead_item != NULL) {
+    ThreadStateBase* next_dead_item = dead_item->next_dead_item_;
+    dead_item->next_dead_item_ = NULL;
+
+    // The wait has fired, but must still be unregistered to release it.
+    UnregisterWait(dead_item, false);
+
+    // The item may have been unregistered in the meantime, in which case it's
+    // no longer on death row.
+    if (!IsListEmpty(&dead_item->entry_)) {
+      RemoveEntryList(&dead_item->entry_);
+      InsertTailList(dead_items, &dead_item->entry_);
+    }
+
+    dead_item = next_dead_item;
+  }
+
   // Return if the death row items list is empty.
   if (IsListEmpty(&death_row_items_))
     return;
 
   // Walk the death row items list, looking for items owned by dead threads.
+  // The items with a pending wait will be notified once their thread has
+  // terminated, so they don't need to be polled.
   ThreadStateBase* item =
       CONTAINING_RECORD(death_row_items_.Flink, ThreadStateBase, entry_);
   while (item != NULL) {
@@ -156,7 +230,7 @@ void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
     }
 
     // Move the item to the dead_items list if the associated thread is dead.
-    if (IsThreadDead(item)) {
+    if (item->wait_handle_ == NULL && IsThreadDead(item)) {
       RemoveEntryList(&item->entry_);
       InsertTailList(dead_items, &item->entry_);
     }
@@ -165,6 +239,38 @@ void ThreadStateManager::GatherDeadItemsUnlocked(LIST_ENTRY* dead_items) {
   }
 }
 
+void ThreadStateManager::UnregisterWait(ThreadStateBase* item,
+                                        bool wait_for_callback) {
+  DCHECK(item != NULL);
+  if (item->wait_handle_ == NULL)
+    return;
+
+  // This can fail with ERROR_IO_PENDING if the callback is running and we're
+  // not waiting for it, in which case the wait is released once it returns.
+  ::UnregisterWaitEx(item->wait_handle_,
+                     wait_for_callback ? INVALID_HANDLE_VALUE : NULL);
+  item->wait_handle_ = NULL;
+}
+
+void CALLBACK ThreadStateManager::OnThreadTerminated(void* context,
+                                                     BOOLEAN timed_out) {
+  DCHECK(context != NULL);
+  ThreadStateBase* item = reinterpret_cast<ThreadStateBase*>(context);
+  ThreadStateManager* manager = item->manager_;
+  DCHECK(manager != NULL);
+
+  // Push the item on the dead items stack. The item may be deleted as soon as
+  // it has been pushed, so it mustn't be touched after that.
+  while (true) {
+    ThreadStateBase* head = manager->dead_items_;
+    item->next_dead_item_ = head;
+    void* previous = ::InterlockedCompareExchangePointer(
+        reinterpret_cast<void* volatile*>(&manager->dead_items_), item, head);
+    if (previous == head)
+      break;
+  }
+}
+
 bool ThreadStateManager::IsThreadDead(ThreadStateBase* item) {
   DCHECK(item != NULL);
   return ::WaitForSingleObject(item->thread_handle_, 0)  == WAIT_OBJECT_0;
@@ -48,6 +48,16 @@ class ThreadStateBase {
   // The entry linking us into the manager's active_items_ or death_row_ lists.
   LIST_ENTRY entry_;
 
+  // The wait registered on thread_handle_ once we're marked for death, or NULL
+  // if there is none. Accessed under the manager's lock_.
+  HANDLE wait_handle_;
+
+  // The manager to notify once our thread has terminated.
+  ThreadStateManager* manager_;
+
+  // The link in the manager's dead items stack.
+  ThreadStateBase* next_dead_item_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateBase);
 };
@@ -70,7 +80,9 @@ class ThreadStateManager {
 
   // Transfer @p item from the list of active items to the death row list. This
   // does not delete @p item immediately if it's called on @p items' own
-  // thread.
+  // thread. Instead, a wait is registered on the owning thread, and @p item
+  // is pushed on the dead items stack once that thread has terminated. This
+  // allows items to be scavenged without polling every thread on death row.
   void MarkForDeath(ThreadStateBase* item);
 
  protected:
@@ -81,9 +93,21 @@ class ThreadStateManager {
 
   // Gathers all items which have been marked for death whose owning threads
   // have terminated into @p dead_items. These items can subsequently be
-  // deleted using the Delete() method.
+  // deleted using the Delete() method. The items that were notified as dead
+  // are taken from the dead items stack. Only the items for which no wait
+  // could be registered are polled with IsThreadDead.
   void GatherDeadItemsUnlocked(LIST_ENTRY* dead_items);
 
+  // Cancels the wait registered for @p item, if any. If @p wait_for_callback
+  // is true then this blocks until a running notification has completed.
+  static void UnregisterWait(ThreadStateBase* item, bool wait_for_callback);
+
+  // The callback invoked by the thread pool once the thread owning an item
+  // has terminated. Pushes the item on the dead items stack of its manager.
+  // @param context The item whose thread has terminated.
+  // @param timed_out Unused, as the wait has no timeout.
+  static void CALLBACK OnThreadTerminated(void* context, BOOLEAN timed_out);
+
   // Deletes (using the delete operator) each item in @p items.
   static void DeleteItems(LIST_ENTRY* items);
 
@@ -101,6 +125,12 @@ class ThreadStateManager {
   // death. Accessed under lock_.
   LIST_ENTRY death_row_items_;
 
+  // A stack of the death row items whose threads are known to have
+  // terminated, linked through ThreadStateBase::next_dead_item_. Items are
+  // pushed onto it by the thread pool without acquiring lock_, and it's only
+  // ever emptied as a whole, under lock_.
+  ThreadStateBase* volatile dead_items_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadStateManager);
 };
@@ -29,6 +29,7 @@ class TestThreadState : public ThreadStateBase {
  public:
   // Expose protected members for unit-testing.
   using ThreadStateBase::entry_;
+  using ThreadStateBase::wait_handle_;
 
   explicit TestThreadState(base::AtomicRefCount* ref) : ref_(ref) {
     base::AtomicRefCountInc(ref_);
@@ -74,6 +75,25 @@ class TestThreadStateManager : public ThreadStateManager {
     return ListContains(&death_row_items_, item);
   }
 
+  // Returns true iff a thread termination notification is pending for
+  // @p item.
+  bool HasPendingWait(const TestThreadState* item) {
+    base::AutoLock auto_lock(lock_);
+    return item->wait_handle_ != NULL;
+  }
+
+  // Scavenges until no items are left, or until a timeout. The termination
+  // of the threads is notified asynchronously, so this may take a few tries.
+  // @returns true iff there are still items being managed.
+  bool ScavengeUntilEmpty() {
+    for (size_t i = 0; i < 500; ++i) {
+      if (!Scavenge())
+        return false;
+      ::Sleep(10);
+    }
+    return true;
+  }
+
  protected:
   // A helper function to check if a item is in the given list.
   static bool ListContains(const LIST_ENTRY* list,
@@ -208,6 +228,7 @@ TEST_F(ThreadStateTest, LifeCycle) {
   EXPECT_FALSE(manager_->HasActiveItems());
   EXPECT_TRUE(manager_->HasDeathRowItems());
   EXPECT_TRUE(manager_->IsOnDeathRow(thread_state));
+  EXPECT_TRUE(manager_->HasPendingWait(thread_state));
 
   // A list to which we'll scavenge thread state items.
   bool has_items = false;
@@ -229,13 +250,50 @@ TEST_F(ThreadStateTest, LifeCycle) {
   worker_thread_.Stop();
   EXPECT_TRUE(manager_->IsThreadDead(thread_state));
   EXPECT_TRUE(base::AtomicRefCountIsOne(&thread_states_));
-  has_items = manager_->Scavenge();
+  has_items = manager_->ScavengeUntilEmpty();
   EXPECT_FALSE(has_items);
   EXPECT_FALSE(manager_->HasActiveItems());
   EXPECT_FALSE(manager_->HasDeathRowItems());
   EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
 }
 
+TEST_F(ThreadStateTest, UnregisterItemMarkedForDeath) {
+  TestThreadState* thread_state = NULL;
+  ASSERT_NO_FATAL_FAILURE(CreateThreadState(&thread_state));
+  ASSERT_NO_FATAL_FAILURE(RegisterThreadState(thread_state));
+  ASSERT_NO_FATAL_FAILURE(MarkThreadStateForDeath(thread_state));
+  EXPECT_TRUE(manager_->HasPendingWait(thread_state));
+
+  // Unregistering the item cancels the notification of its thread's
+  // termination, so the item can safely be deleted by the caller.
+  ASSERT_NO_FATAL_FAILURE(UnregisterThreadState(thread_state));
+  EXPECT_FALSE(manager_->HasPendingWait(thread_state));
+  EXPECT_FALSE(manager_->HasDeathRowItems());
+
+  worker_thread_.Stop();
+  EXPECT_FALSE(manager_->ScavengeUntilEmpty());
+  EXPECT_TRUE(base::AtomicRefCountIsOne(&thread_states_));
+  delete thread_state;
+  EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
+}
+
+TEST_F(ThreadStateTest, ScavengesManyDeadThreads) {
+  static const size_t kThreadCount = 16;
+  for (size_t i = 0; i < kThreadCount; ++i) {
+    TestThreadState* thread_state = NULL;
+    ASSERT_NO_FATAL_FAILURE(CreateThreadState(&thread_state));
+    ASSERT_NO_FATAL_FAILURE(RegisterThreadState(thread_state));
+    ASSERT_NO_FATAL_FAILURE(MarkThreadStateForDeath(thread_state));
+
+    // Start a new worker thread for the next item.
+    worker_thread_.Stop();
+    ASSERT_TRUE(worker_thread_.Start());
+  }
+
+  EXPECT_FALSE(manager_->ScavengeUntilEmpty());
+  EXPECT_TRUE(base::AtomicRefCountIsZero(&thread_states_));
+}
+
 TEST_F(ThreadStateTest, DeletesAllThreadStatesOnDestruction) {
   TestThreadState* thread_state = NULL;
   ASSERT_NO_FATAL_FAILURE(CreateThreadState(&thread_state));
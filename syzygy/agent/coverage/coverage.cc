@@ -20,6 +20,7 @@
 #include "base/environment.h"
 #include "base/lazy_instance.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/agent/common/process_utils.h"
@@ -69,6 +70,36 @@ extern "C" void __declspec(naked) _indirect_penter_dllmain() {
   }
 }
 
+extern "C" void __declspec(naked) _coverage_hit() {
+  __asm {
+    // Stack: ..., basic_block_id, coverage_data, ret_addr.
+
+    // Stash volatile registers.
+    push eax
+    push ecx
+    push edx
+    pushfd
+
+    // Stack: ..., basic_block_id, coverage_data, ret_addr, eax, ecx, edx, fd.
+
+    // Push the address of the return address, which is where the hit frame
+    // starts.
+    lea eax, DWORD PTR[esp + 0x10]
+    push eax
+
+    call agent::coverage::Coverage::HitHook
+
+    // Restore volatile registers.
+    popfd
+    pop edx
+    pop ecx
+    pop eax
+
+    // Return to the end of the probe, popping the two probe arguments.
+    ret 8
+  }
+}
+
 BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
   using agent::coverage::Coverage;
 
@@ -118,17 +149,29 @@ using ::common::kBasicBlockFrequencyDataVersion;
 base::LazyInstance<agent::coverage::Coverage> static_coverage_instance =
     LAZY_INSTANCE_INITIALIZER;
 
+// The opcodes of the self-patching probes.
+const uint8 kPushImm32Opcode = 0x68;
+const uint8 kJmpRel8Opcode = 0xEB;
+
+// The size of a cache line. A write to the first two bytes of a probe is only
+// atomic with respect to the other threads if it doesn't span two lines.
+const uintptr_t kCacheLineSize = 64;
+
 }  // namespace
 
 Coverage* Coverage::Instance() {
   return static_coverage_instance.Pointer();
 }
 
-Coverage::Coverage() {
+Coverage::Coverage()
+    : share_coverage_data_(
+          trace::client::IsSharedFrequencyDataEnabledForThisModule()) {
   trace::client::InitializeRpcSession(&session_, &segment_);
 }
 
 Coverage::~Coverage() {
+  for (size_t i = 0; i < shared_coverage_data_.size(); ++i)
+    WriteSharedCoverageData(shared_coverage_data_[i]);
 }
 
 void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
@@ -192,6 +235,66 @@ void WINAPI Coverage::EntryHook(EntryHookFrame* entry_frame) {
   LOG(INFO) << "Coverage client initialized.";
 }
 
+void WINAPI Coverage::HitHook(HitHookFrame* hit_frame) {
+  DCHECK(hit_frame != NULL);
+  DCHECK(hit_frame->coverage_data != NULL);
+  DCHECK_GT(hit_frame->coverage_data->num_entries, hit_frame->basic_block_id);
+
+  ScopedLastErrorKeeper scoped_last_error_keeper;
+
+  IndexedFrequencyData* coverage_data = hit_frame->coverage_data;
+  static_cast<uint8*>(coverage_data->frequency_data)[
+      hit_frame->basic_block_id] = 1;
+
+  // Until the module has been initialized the visit is recorded in the
+  // static array, and would be lost when the frequency data is redirected to
+  // the trace segment. Leave the probe active in that case so that the block
+  // is recorded again.
+  if (coverage_data->initialization_attempted == 0)
+    return;
+
+  // Patching is best effort: on failure, the probe simply stays active.
+  PatchProbe(hit_frame->ret_addr - kSelfPatchingProbeSize);
+}
+
+bool Coverage::PatchProbe(uint8* probe) {
+  DCHECK(probe != NULL);
+
+  // The probe may already have been patched by another thread.
+  if (probe[0] == kJmpRel8Opcode)
+    return true;
+  DCHECK_EQ(kPushImm32Opcode, probe[0]);
+
+  // Other threads may be executing the probe while it's patched, so the two
+  // bytes of the jump must be written at once.
+  uintptr_t address = reinterpret_cast<uintptr_t>(probe);
+  if ((address % kCacheLineSize) == kCacheLineSize - 1)
+    return false;
+
+  DWORD old_protection = 0;
+  if (!::VirtualProtect(probe, sizeof(uint16), PAGE_EXECUTE_READWRITE,
+                        &old_protection)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "VirtualProtect failed: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  // Write 'jmp short $+kSelfPatchingProbeSize'.
+  uint16 jump = static_cast<uint16>(
+      kJmpRel8Opcode | ((kSelfPatchingProbeSize - sizeof(uint16)) << 8));
+  *reinterpret_cast<volatile uint16*>(probe) = jump;
+
+  DWORD dummy_protection = 0;
+  if (!::VirtualProtect(probe, sizeof(uint16), old_protection,
+                        &dummy_protection)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "VirtualProtect failed: " << ::common::LogWe(error) << ".";
+  }
+  ::FlushInstructionCache(::GetCurrentProcess(), probe, sizeof(uint16));
+
+  return true;
+}
+
 bool Coverage::InitializeCoverageData(void* module_base,
                                       IndexedFrequencyData* coverage_data) {
   DCHECK(coverage_data != NULL);
@@ -235,6 +338,27 @@ bool Coverage::InitializeCoverageData(void* module_base,
     return false;
   }
 
+  // Initialize the header of the coverage data struct.
+  TraceIndexedFrequencyData record = {};
+  base::win::PEImage image(module_base);
+  record.data_type = coverage_data->data_type;
+  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
+  record.module_base_addr = reinterpret_cast<ModuleAddr>(image.module());
+  record.module_base_size = nt_headers->OptionalHeader.SizeOfImage;
+  record.module_checksum = nt_headers->OptionalHeader.CheckSum;
+  record.module_time_date_stamp = nt_headers->FileHeader.TimeDateStamp;
+  record.frequency_size = 1;
+  record.num_columns = 1;
+  record.num_entries = coverage_data->num_entries;
+
+  // The coverage record of a shared module is only allocated when the process
+  // exits, if it's the last one to do so. If the coverage data can't be
+  // shared, it's recorded for this process only.
+  if (share_coverage_data_ &&
+      InitializeSharedCoverageData(record, coverage_segment, coverage_data)) {
+    return true;
+  }
+
   // Allocate the basic-block frequency data. We will leave this allocated and
   // let it get flushed during tear-down of the call-trace client.
   TraceIndexedFrequencyData* trace_coverage_data =
@@ -243,21 +367,7 @@ bool Coverage::InitializeCoverageData(void* module_base,
               TRACE_INDEXED_FREQUENCY,
               bb_freq_size));
   DCHECK(trace_coverage_data != NULL);
-
-  // Initialize the coverage data struct.
-  base::win::PEImage image(module_base);
-  trace_coverage_data->data_type = coverage_data->data_type;
-  const IMAGE_NT_HEADERS* nt_headers = image.GetNTHeaders();
-  trace_coverage_data->module_base_addr =
-      reinterpret_cast<ModuleAddr>(image.module());
-  trace_coverage_data->module_base_size =
-      nt_headers->OptionalHeader.SizeOfImage;
-  trace_coverage_data->module_checksum = nt_headers->OptionalHeader.CheckSum;
-  trace_coverage_data->module_time_date_stamp =
-      nt_headers->FileHeader.TimeDateStamp;
-  trace_coverage_data->frequency_size = 1;
-  trace_coverage_data->num_columns = 1;
-  trace_coverage_data->num_entries = coverage_data->num_entries;
+  *trace_coverage_data = record;
 
   // Hook up the newly allocated buffer to the call-trace instrumentation.
   coverage_data->frequency_data =
@@ -266,5 +376,61 @@ bool Coverage::InitializeCoverageData(void* module_base,
   return true;
 }
 
+bool Coverage::InitializeSharedCoverageData(
+    const TraceIndexedFrequencyData& record,
+    const trace::client::TraceFileSegment& segment,
+    IndexedFrequencyData* coverage_data) {
+  DCHECK(coverage_data != NULL);
+
+  // The shared frequency array is specific to the trace session and to the
+  // version of the module.
+  std::wstring name = base::StringPrintf(
+      L"syzygy-coverage-%ls-%08X-%08X-%08X",
+      base::UTF8ToWide(trace::client::GetInstanceIdForThisModule()).c_str(),
+      record.module_checksum,
+      record.module_time_date_stamp,
+      record.module_base_size);
+
+  scoped_ptr<SharedCoverageData> shared_coverage_data(
+      new SharedCoverageData());
+  if (!shared_coverage_data->shared_data.Attach(name, record.num_entries)) {
+    LOG(WARNING) << "Unable to share coverage data, recording it for this "
+                 << "process only.";
+    return false;
+  }
+  shared_coverage_data->record = record;
+  shared_coverage_data->segment = segment;
+
+  // Hook up the shared frequency array to the call-trace instrumentation.
+  coverage_data->frequency_data = shared_coverage_data->shared_data.data();
+  shared_coverage_data_.push_back(shared_coverage_data.release());
+
+  return true;
+}
+
+void Coverage::WriteSharedCoverageData(
+    SharedCoverageData* shared_coverage_data) {
+  DCHECK(shared_coverage_data != NULL);
+
+  // The merged coverage is written by the last process to exit.
+  std::vector<uint8> merged_data;
+  if (!shared_coverage_data->shared_data.Detach(&merged_data))
+    return;
+
+  // The segment was allocated to fit the record, so this doesn't involve the
+  // call-trace service.
+  size_t bb_freq_size =
+      sizeof(TraceIndexedFrequencyData) + merged_data.size() - 1;
+  TraceIndexedFrequencyData* trace_coverage_data =
+      reinterpret_cast<TraceIndexedFrequencyData*>(
+          shared_coverage_data->segment.AllocateTraceRecordImpl(
+              TRACE_INDEXED_FREQUENCY,
+              bb_freq_size));
+  DCHECK(trace_coverage_data != NULL);
+  *trace_coverage_data = shared_coverage_data->record;
+  ::memcpy(trace_coverage_data->frequency_data, &merged_data[0],
+           merged_data.size());
+}
+
 }  // namespace coverage
 }  // namespace agent
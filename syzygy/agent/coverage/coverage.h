@@ -17,6 +17,11 @@
 // instrumentation will dump its code coverage results. The instrumentation
 // injects a run-time dependency on this library and adds appropriate
 // initialization hooks.
+//
+// When the SYZYGY_SHARED_FREQUENCY_DATA environment variable selects the
+// agent, all the processes of an instrumented module record their coverage
+// in a shared frequency array, and only the last of them to exit writes a
+// coverage record, holding the merged coverage of all of them.
 
 #ifndef SYZYGY_AGENT_COVERAGE_COVERAGE_H_
 #define SYZYGY_AGENT_COVERAGE_COVERAGE_H_
@@ -26,14 +31,19 @@
 #include <vector>
 
 #include "base/lazy_instance.h"
+#include "base/memory/scoped_vector.h"
 #include "base/win/pe_image.h"
 #include "syzygy/agent/common/entry_frame.h"
+#include "syzygy/agent/common/shared_frequency_data.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/trace/client/rpc_session.h"
 
 // Instrumentation stubs to handle the loading of the library.
 extern "C" void _cdecl _indirect_penter_dllmain();
 
+// Instrumentation stub called by the self-patching probes.
+extern "C" void _cdecl _coverage_hit();
+
 namespace agent {
 namespace coverage {
 
@@ -44,13 +54,32 @@ class Coverage {
   // syzygy/agent/coverage/coverage.cc for details.
   struct EntryHookFrame {
     void* func_addr;
-    common::IndexedFrequencyData* coverage_data;
+    ::common::IndexedFrequencyData* coverage_data;
   };
 
+  // This is overlaid on the stack frame built by _coverage_hit. See
+  // syzygy/agent/coverage/coverage.cc for details.
+  struct HitHookFrame {
+    uint8* ret_addr;
+    ::common::IndexedFrequencyData* coverage_data;
+    uint32 basic_block_id;
+  };
+
+  // The size in bytes of a self-patching probe, which looks like:
+  //     push basic_block_id   (5 bytes)
+  //     push coverage_data    (5 bytes)
+  //     call [_coverage_hit]  (6 bytes)
+  // On its first execution the probe records the visit, and is patched into a
+  // short jump over itself.
+  static const size_t kSelfPatchingProbeSize = 16;
+
   // The thunks _indirect_penter_dllmain and _indirect_exe_entry are redirected
   // here.
   static void WINAPI EntryHook(EntryHookFrame* entry_frame);
 
+  // The self-patching probes are redirected here through _coverage_hit.
+  static void WINAPI HitHook(HitHookFrame* hit_frame);
+
   // Retrieves the coverage singleton instance.
   static Coverage* Instance();
 
@@ -61,10 +90,41 @@ class Coverage {
   Coverage();
   ~Coverage();
 
+  // Patches the self-patching probe starting at @p probe into a short jump
+  // over itself.
+  // @param probe the address of the probe.
+  // @returns true on success, false otherwise.
+  static bool PatchProbe(uint8* probe);
+
+  // The coverage data of a module whose processes merge their coverage in a
+  // shared frequency array.
+  struct SharedCoverageData {
+    // The header of the merged coverage record.
+    TraceIndexedFrequencyData record;
+    // The segment that receives the merged coverage record, if this is the
+    // last process to exit.
+    trace::client::TraceFileSegment segment;
+    common::SharedFrequencyData shared_data;
+  };
+
   // Initializes the given coverage data element.
   bool InitializeCoverageData(void* module_base,
                               ::common::IndexedFrequencyData* coverage_data);
 
+  // Redirects the given coverage data element to a shared frequency array.
+  // @param record the header of the coverage record of the module.
+  // @param segment the segment that will receive the merged coverage record.
+  // @param coverage_data the coverage data element to redirect.
+  // @returns true on success, false otherwise.
+  bool InitializeSharedCoverageData(
+      const TraceIndexedFrequencyData& record,
+      const trace::client::TraceFileSegment& segment,
+      ::common::IndexedFrequencyData* coverage_data);
+
+  // Detaches from the shared frequency array of @p shared_coverage_data, and
+  // writes the merged coverage record if this is the last process to exit.
+  void WriteSharedCoverageData(SharedCoverageData* shared_coverage_data);
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
@@ -72,6 +132,12 @@ class Coverage {
   // goes to specially allocated segments that we don't explicitly keep track
   // of, but rather that we let live until the client gets torn down.
   trace::client::TraceFileSegment segment_;
+
+  // Whether the processes of the instrumented modules merge their coverage.
+  bool share_coverage_data_;
+
+  // The modules whose coverage is merged with that of the other processes.
+  ScopedVector<SharedCoverageData> shared_coverage_data_;
 };
 
 }  // namespace coverage
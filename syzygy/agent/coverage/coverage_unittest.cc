@@ -16,9 +16,11 @@
 
 #include "syzygy/agent/coverage/coverage.h"
 
+#include "base/environment.h"
 #include "base/file_util.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -141,6 +143,9 @@ class CoverageClientTest : public testing::Test {
     _indirect_penter_dllmain_ =
         ::GetProcAddress(module_, "_indirect_penter_dllmain");
     ASSERT_TRUE(_indirect_penter_dllmain_ != NULL);
+
+    _coverage_hit_ = ::GetProcAddress(module_, "_coverage_hit");
+    ASSERT_TRUE(_coverage_hit_ != NULL);
   }
 
   void UnloadDll() {
@@ -148,6 +153,7 @@ class CoverageClientTest : public testing::Test {
       ASSERT_TRUE(::FreeLibrary(module_));
       module_ = NULL;
       _indirect_penter_dllmain_ = NULL;
+      _coverage_hit_ = NULL;
     }
   }
 
@@ -171,9 +177,13 @@ class CoverageClientTest : public testing::Test {
  private:
   HMODULE module_;
   static FARPROC _indirect_penter_dllmain_;
+
+ protected:
+  static FARPROC _coverage_hit_;
 };
 
 FARPROC CoverageClientTest::_indirect_penter_dllmain_ = NULL;
+FARPROC CoverageClientTest::_coverage_hit_ = NULL;
 
 BOOL WINAPI CoverageClientTest::IndirectDllMain(HMODULE module,
                                                 DWORD reason,
@@ -190,6 +200,24 @@ BOOL __declspec(naked) WINAPI CoverageClientTest::DllMainThunk(
   }
 }
 
+// Writes into @p buffer a function made of a self-patching probe for the
+// basic block @p i, followed by a return.
+void WriteProbedFunction(size_t i, FARPROC* coverage_hit, uint8* buffer) {
+  uint8* cursor = buffer;
+  *cursor++ = 0x68;  // push imm32
+  *reinterpret_cast<uint32*>(cursor) = i;
+  cursor += sizeof(uint32);
+  *cursor++ = 0x68;  // push imm32
+  *reinterpret_cast<IndexedFrequencyData**>(cursor) = &coverage_data;
+  cursor += sizeof(uint32);
+  *cursor++ = 0xFF;  // call [disp32]
+  *cursor++ = 0x15;
+  *reinterpret_cast<FARPROC**>(cursor) = coverage_hit;
+  cursor += sizeof(uint32);
+  ASSERT_EQ(Coverage::kSelfPatchingProbeSize, cursor - buffer);
+  *cursor++ = 0xC3;  // ret
+}
+
 void VisitBlock(size_t i) {
   EXPECT_GT(coverage_data.num_entries, i);
   static_cast<uint8*>(coverage_data.frequency_data)[i] = 1;
@@ -261,5 +289,81 @@ TEST_F(CoverageClientTest, VisitOneBB) {
   ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
 }
 
+TEST_F(CoverageClientTest, SelfPatchingProbe) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  EXPECT_TRUE(DllMainThunk(::GetModuleHandle(NULL), DLL_PROCESS_ATTACH, NULL));
+  uint8* data = static_cast<uint8*>(coverage_data.frequency_data);
+
+  // Build a function probed for the second basic block.
+  uint8* function = static_cast<uint8*>(::VirtualAlloc(
+      NULL, 64, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+  ASSERT_TRUE(function != NULL);
+  ASSERT_NO_FATAL_FAILURE(WriteProbedFunction(1, &_coverage_hit_, function));
+  void (*probed_function)() = reinterpret_cast<void (*)()>(function);
+
+  // The first execution records the visit and patches the probe.
+  probed_function();
+  EXPECT_EQ(0U, data[0]);
+  EXPECT_EQ(1U, data[1]);
+  EXPECT_EQ(0xEB, function[0]);
+  EXPECT_EQ(Coverage::kSelfPatchingProbeSize - 2, function[1]);
+
+  // The next executions skip the probe.
+  data[1] = 0;
+  probed_function();
+  EXPECT_EQ(0U, data[1]);
+
+  EXPECT_TRUE(::VirtualFree(function, 0, MEM_RELEASE));
+
+  // Unload the DLL and stop the service.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_NO_FATAL_FAILURE(StopService());
+}
+
+TEST_F(CoverageClientTest, SharedCoverageData) {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env->SetVar(::kSyzygySharedFrequencyDataEnvVar, "1"));
+
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+
+  HMODULE self = ::GetModuleHandle(NULL);
+  DWORD process_id = ::GetCurrentProcessId();
+  DWORD thread_id = ::GetCurrentThreadId();
+
+  void* data = coverage_data.frequency_data;
+  EXPECT_TRUE(DllMainThunk(self, DLL_PROCESS_ATTACH, NULL));
+
+  // The coverage data should have been redirected to the shared array.
+  ASSERT_NE(data, coverage_data.frequency_data);
+
+  VisitBlock(1);
+
+  // Unloading the DLL writes the merged coverage, as this is the only process
+  // sharing it.
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  env->UnSetVar(::kSyzygySharedFrequencyDataEnvVar);
+
+  const uint8 kExpectedCoverageData[kBasicBlockCount] = { 0, 1 };
+
+  // Set up expectations for what should be in the trace.
+  EXPECT_CALL(handler_, OnProcessStarted(_, process_id, _));
+  EXPECT_CALL(handler_, OnProcessAttach(_,
+                                        process_id,
+                                        thread_id,
+                                        ModuleAtAddress(self)));
+  EXPECT_CALL(handler_, OnIndexedFrequency(
+      _,
+      process_id,
+      _,
+      CoverageDataMatches(self, kBasicBlockCount, kExpectedCoverageData)));
+  EXPECT_CALL(handler_, OnProcessEnded(_, process_id));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs(1));
+}
+
 }  // namespace coverage
 }  // namespace agent
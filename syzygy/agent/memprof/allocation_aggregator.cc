@@ -0,0 +1,113 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/allocation_aggregator.h"
+
+#include <utility>
+
+#include "base/logging.h"
+
+namespace agent {
+namespace memprof {
+
+AllocationAggregator::AllocationAggregator() {
+}
+
+void AllocationAggregator::OnAllocation(const void* address,
+                                        size_t size,
+                                        uint32 stack_trace_id) {
+  if (address == nullptr)
+    return;
+
+  base::AutoLock lock(lock_);
+  OnAllocationImpl(address, size, stack_trace_id);
+}
+
+void AllocationAggregator::OnFree(const void* address) {
+  if (address == nullptr)
+    return;
+
+  base::AutoLock lock(lock_);
+  OnFreeImpl(address);
+}
+
+void AllocationAggregator::OnReallocation(const void* old_address,
+                                          const void* new_address,
+                                          size_t size,
+                                          uint32 stack_trace_id) {
+  if (new_address == nullptr)
+    return;
+
+  base::AutoLock lock(lock_);
+  if (old_address != nullptr)
+    OnFreeImpl(old_address);
+  OnAllocationImpl(new_address, size, stack_trace_id);
+}
+
+void AllocationAggregator::GetSiteStatistics(SiteStatisticsMap* sites) const {
+  DCHECK_NE(static_cast<SiteStatisticsMap*>(nullptr), sites);
+
+  base::AutoLock lock(lock_);
+  *sites = sites_;
+}
+
+size_t AllocationAggregator::live_allocation_count() const {
+  base::AutoLock lock(lock_);
+  return live_allocations_.size();
+}
+
+void AllocationAggregator::OnAllocationImpl(const void* address,
+                                            size_t size,
+                                            uint32 stack_trace_id) {
+  DCHECK_NE(static_cast<const void*>(nullptr), address);
+  lock_.AssertAcquired();
+
+  // An allocation whose free was missed, for instance because it was freed
+  // by another module, is accounted for as freed once its address is reused.
+  std::pair<LiveAllocationMap::iterator, bool> result =
+      live_allocations_.insert(std::make_pair(address, LiveAllocation()));
+  LiveAllocation& allocation = result.first->second;
+  if (!result.second) {
+    SiteStatistics& previous_site = sites_[allocation.stack_trace_id];
+    --previous_site.live_count;
+    previous_site.live_bytes -= allocation.size;
+  }
+  allocation.stack_trace_id = stack_trace_id;
+  allocation.size = size;
+
+  SiteStatistics& site = sites_[stack_trace_id];
+  ++site.live_count;
+  site.live_bytes += size;
+  ++site.total_count;
+  site.total_bytes += size;
+}
+
+void AllocationAggregator::OnFreeImpl(const void* address) {
+  DCHECK_NE(static_cast<const void*>(nullptr), address);
+  lock_.AssertAcquired();
+
+  LiveAllocationMap::iterator it = live_allocations_.find(address);
+  if (it == live_allocations_.end())
+    return;
+
+  SiteStatistics& site = sites_[it->second.stack_trace_id];
+  DCHECK_LT(0u, site.live_count);
+  DCHECK_LE(it->second.size, site.live_bytes);
+  --site.live_count;
+  site.live_bytes -= it->second.size;
+  live_allocations_.erase(it);
+}
+
+}  // namespace memprof
+}  // namespace agent
@@ -0,0 +1,114 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the AllocationAggregator class, which aggregates heap allocations
+// by allocation site in the memory profiler agent. This is much cheaper than
+// logging every heap function call, and is enough for finding leaks and
+// allocation churn.
+
+#ifndef SYZYGY_AGENT_MEMPROF_ALLOCATION_AGGREGATOR_H_
+#define SYZYGY_AGENT_MEMPROF_ALLOCATION_AGGREGATOR_H_
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "base/synchronization/lock.h"
+
+namespace agent {
+namespace memprof {
+
+// Maintains the live and total allocation counts and sizes of each allocation
+// site, identified by the ID of the stack trace of the allocations. This is
+// thread-safe.
+class AllocationAggregator {
+ public:
+  // The statistics of an allocation site.
+  struct SiteStatistics {
+    // The number and size of the allocations made by the site that are still
+    // live.
+    size_t live_count;
+    uint64 live_bytes;
+    // The number and size of all the allocations made by the site.
+    size_t total_count;
+    uint64 total_bytes;
+  };
+  typedef base::hash_map<uint32, SiteStatistics> SiteStatisticsMap;
+
+  AllocationAggregator();
+
+  // Records an allocation.
+  // @param address The address of the allocation. Failed allocations, with
+  //     a null address, are ignored.
+  // @param size The size of the allocation.
+  // @param stack_trace_id The ID of the stack trace of the allocation.
+  void OnAllocation(const void* address, size_t size, uint32 stack_trace_id);
+
+  // Records a free. This must be called before the memory is actually freed,
+  // so that the address can't be reused by another allocation in between.
+  // @param address The address of the allocation being freed. Addresses that
+  //     weren't recorded, such as those of allocations made before the
+  //     aggregator was created, are ignored.
+  void OnFree(const void* address);
+
+  // Records a reallocation, as a free of the old allocation followed by a new
+  // allocation.
+  // @param old_address The address of the reallocated allocation.
+  // @param new_address The address of the new allocation. If this is null
+  //     then the reallocation failed, and the old allocation is still live.
+  // @param size The size of the new allocation.
+  // @param stack_trace_id The ID of the stack trace of the reallocation.
+  void OnReallocation(const void* old_address,
+                      const void* new_address,
+                      size_t size,
+                      uint32 stack_trace_id);
+
+  // Takes a snapshot of the statistics of the allocation sites.
+  // @param sites Receives the statistics of all the sites that made an
+  //     allocation so far.
+  void GetSiteStatistics(SiteStatisticsMap* sites) const;
+
+  // @returns the number of live allocations.
+  size_t live_allocation_count() const;
+
+ protected:
+  // The site and size of a live allocation.
+  struct LiveAllocation {
+    uint32 stack_trace_id;
+    size_t size;
+  };
+  typedef base::hash_map<const void*, LiveAllocation> LiveAllocationMap;
+
+  // Implementations of OnAllocation and OnFree. These must be called under
+  // lock_.
+  void OnAllocationImpl(const void* address,
+                        size_t size,
+                        uint32 stack_trace_id);
+  void OnFreeImpl(const void* address);
+
+  // Protects the members below.
+  mutable base::Lock lock_;
+
+  // The live allocations, by address.
+  LiveAllocationMap live_allocations_;  // Under lock_.
+
+  // The statistics of each allocation site.
+  SiteStatisticsMap sites_;  // Under lock_.
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AllocationAggregator);
+};
+
+}  // namespace memprof
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_MEMPROF_ALLOCATION_AGGREGATOR_H_
@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/allocation_aggregator.h"
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace memprof {
+
+namespace {
+
+typedef AllocationAggregator::SiteStatistics SiteStatistics;
+typedef AllocationAggregator::SiteStatisticsMap SiteStatisticsMap;
+
+const uint32 kSite1 = 0x1234;
+const uint32 kSite2 = 0x5678;
+
+const void* Address(size_t address) {
+  return reinterpret_cast<const void*>(address);
+}
+
+void ExpectSiteStatistics(const SiteStatisticsMap& sites,
+                          uint32 site,
+                          size_t live_count,
+                          uint64 live_bytes,
+                          size_t total_count,
+                          uint64 total_bytes) {
+  SiteStatisticsMap::const_iterator it = sites.find(site);
+  ASSERT_TRUE(it != sites.end());
+  EXPECT_EQ(live_count, it->second.live_count);
+  EXPECT_EQ(live_bytes, it->second.live_bytes);
+  EXPECT_EQ(total_count, it->second.total_count);
+  EXPECT_EQ(total_bytes, it->second.total_bytes);
+}
+
+}  // namespace
+
+TEST(AllocationAggregatorTest, AllocationsAreAggregatedBySite) {
+  AllocationAggregator aggregator;
+  aggregator.OnAllocation(Address(0x1000), 16, kSite1);
+  aggregator.OnAllocation(Address(0x2000), 32, kSite1);
+  aggregator.OnAllocation(Address(0x3000), 64, kSite2);
+  EXPECT_EQ(3u, aggregator.live_allocation_count());
+
+  // Failed allocations are ignored.
+  aggregator.OnAllocation(nullptr, 128, kSite2);
+  EXPECT_EQ(3u, aggregator.live_allocation_count());
+
+  SiteStatisticsMap sites;
+  aggregator.GetSiteStatistics(&sites);
+  EXPECT_EQ(2u, sites.size());
+  ExpectSiteStatistics(sites, kSite1, 2, 48, 2, 48);
+  ExpectSiteStatistics(sites, kSite2, 1, 64, 1, 64);
+
+  // Frees only affect the live statistics of the site of the allocation.
+  aggregator.OnFree(Address(0x2000));
+  aggregator.OnFree(Address(0x3000));
+  EXPECT_EQ(1u, aggregator.live_allocation_count());
+  aggregator.GetSiteStatistics(&sites);
+  ExpectSiteStatistics(sites, kSite1, 1, 16, 2, 48);
+  ExpectSiteStatistics(sites, kSite2, 0, 0, 1, 64);
+
+  // Unknown addresses are ignored.
+  aggregator.OnFree(Address(0x4000));
+  aggregator.OnFree(nullptr);
+  EXPECT_EQ(1u, aggregator.live_allocation_count());
+}
+
+TEST(AllocationAggregatorTest, Reallocations) {
+  AllocationAggregator aggregator;
+  aggregator.OnAllocation(Address(0x1000), 16, kSite1);
+
+  // A failed reallocation leaves the allocation live.
+  aggregator.OnReallocation(Address(0x1000), nullptr, 32, kSite2);
+  SiteStatisticsMap sites;
+  aggregator.GetSiteStatistics(&sites);
+  EXPECT_EQ(1u, sites.size());
+  ExpectSiteStatistics(sites, kSite1, 1, 16, 1, 16);
+
+  aggregator.OnReallocation(Address(0x1000), Address(0x2000), 32, kSite2);
+  EXPECT_EQ(1u, aggregator.live_allocation_count());
+  aggregator.GetSiteStatistics(&sites);
+  ExpectSiteStatistics(sites, kSite1, 0, 0, 1, 16);
+  ExpectSiteStatistics(sites, kSite2, 1, 32, 1, 32);
+
+  // Reallocating null is an allocation.
+  aggregator.OnReallocation(nullptr, Address(0x3000), 8, kSite2);
+  EXPECT_EQ(2u, aggregator.live_allocation_count());
+  aggregator.GetSiteStatistics(&sites);
+  ExpectSiteStatistics(sites, kSite2, 2, 40, 2, 40);
+}
+
+TEST(AllocationAggregatorTest, ReusedAddressesReleaseMissedFrees) {
+  AllocationAggregator aggregator;
+  aggregator.OnAllocation(Address(0x1000), 16, kSite1);
+  aggregator.OnAllocation(Address(0x1000), 32, kSite2);
+  EXPECT_EQ(1u, aggregator.live_allocation_count());
+
+  SiteStatisticsMap sites;
+  aggregator.GetSiteStatistics(&sites);
+  ExpectSiteStatistics(sites, kSite1, 0, 0, 1, 16);
+  ExpectSiteStatistics(sites, kSite2, 1, 32, 1, 32);
+}
+
+}  // namespace memprof
+}  // namespace agent
@@ -0,0 +1,182 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/content_hash.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace agent {
+namespace memprof {
+
+namespace {
+
+// The primes of xxHash32, whose rounds are used for each lane.
+const uint32 kPrime1 = 2654435761U;
+const uint32 kPrime2 = 2246822519U;
+const uint32 kPrime3 = 3266489917U;
+const uint32 kPrime4 = 668265263U;
+const uint32 kPrime5 = 374761393U;
+
+// The number of 32-bit lanes in a chunk, and of SSE2 vectors.
+const size_t kLaneCount = kContentHashChunkSize / sizeof(uint32);
+const size_t kVectorCount = kContentHashChunkSize / sizeof(__m128i);
+COMPILE_ASSERT(kVectorCount == 4, content_hasher_expects_4_vectors_per_chunk);
+
+uint32 RotateLeft(uint32 value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+// Multiplies the 32-bit lanes of two vectors, keeping the low 32 bits of the
+// products. SSE2 only has a widening multiply of the even lanes.
+__m128i MultiplyLanes(__m128i a, __m128i b) {
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Accumulates a hash over whole chunks, then finishes it with a tail of less
+// than a chunk.
+class ContentHasher {
+ public:
+  ContentHasher() {
+    for (size_t i = 0; i < kVectorCount; ++i) {
+      uint32 seed = kPrime1 * (4 * i + 1);
+      lanes_[i] = _mm_set_epi32(seed + 3 * kPrime1, seed + 2 * kPrime1,
+                                seed + kPrime1, seed);
+    }
+  }
+
+  // Hashes @p chunk_count chunks starting at @p data. Each lane goes through
+  // an xxHash32 round per chunk, and the lanes are independent so that the
+  // rounds of a chunk can all be in flight at once.
+  void UpdateChunks(const uint8* data, size_t chunk_count) {
+    const __m128i prime1 = _mm_set1_epi32(kPrime1);
+    const __m128i prime2 = _mm_set1_epi32(kPrime2);
+    __m128i lane0 = lanes_[0];
+    __m128i lane1 = lanes_[1];
+    __m128i lane2 = lanes_[2];
+    __m128i lane3 = lanes_[3];
+    const __m128i* cursor = reinterpret_cast<const __m128i*>(data);
+    for (size_t i = 0; i < chunk_count; ++i, cursor += kVectorCount) {
+      lane0 = Round(lane0, _mm_loadu_si128(cursor), prime1, prime2);
+      lane1 = Round(lane1, _mm_loadu_si128(cursor + 1), prime1, prime2);
+      lane2 = Round(lane2, _mm_loadu_si128(cursor + 2), prime1, prime2);
+      lane3 = Round(lane3, _mm_loadu_si128(cursor + 3), prime1, prime2);
+    }
+    lanes_[0] = lane0;
+    lanes_[1] = lane1;
+    lanes_[2] = lane2;
+    lanes_[3] = lane3;
+  }
+
+  // Merges the lanes and hashes the remaining bytes.
+  // @param tail The bytes past the last whole chunk.
+  // @param tail_size The number of bytes at @p tail, less than a chunk.
+  // @param size The total size of the hashed data.
+  // @returns the final hash.
+  uint32 Finish(const uint8* tail, size_t tail_size, size_t size) {
+    DCHECK_GT(kContentHashChunkSize, tail_size);
+
+    uint32 lanes[kLaneCount];
+    for (size_t i = 0; i < kVectorCount; ++i) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes) + i, lanes_[i]);
+    }
+
+    uint32 hash = static_cast<uint32>(size) + kPrime5;
+    for (size_t i = 0; i < kLaneCount; ++i)
+      hash = RotateLeft(hash + lanes[i] * kPrime3, 17) * kPrime4;
+
+    for (; tail_size >= sizeof(uint32);
+         tail += sizeof(uint32), tail_size -= sizeof(uint32)) {
+      uint32 word = 0;
+      ::memcpy(&word, tail, sizeof(word));
+      hash = RotateLeft(hash + word * kPrime3, 17) * kPrime4;
+    }
+    for (; tail_size > 0; ++tail, --tail_size)
+      hash = RotateLeft(hash + *tail * kPrime5, 11) * kPrime1;
+
+    hash ^= hash >> 15;
+    hash *= kPrime2;
+    hash ^= hash >> 13;
+    hash *= kPrime3;
+    hash ^= hash >> 16;
+    return hash;
+  }
+
+ private:
+  static __m128i Round(__m128i lane, __m128i input, __m128i prime1,
+                       __m128i prime2) {
+    lane = _mm_add_epi32(lane, MultiplyLanes(input, prime2));
+    lane = _mm_or_si128(_mm_slli_epi32(lane, 13), _mm_srli_epi32(lane, 19));
+    return MultiplyLanes(lane, prime1);
+  }
+
+  __m128i lanes_[kVectorCount];
+
+  DISALLOW_COPY_AND_ASSIGN(ContentHasher);
+};
+
+}  // namespace
+
+uint32 HashContents(const void* data, size_t size) {
+  DCHECK(data != NULL || size == 0);
+
+  const uint8* bytes = reinterpret_cast<const uint8*>(data);
+  size_t chunk_count = size / kContentHashChunkSize;
+  ContentHasher hasher;
+  hasher.UpdateChunks(bytes, chunk_count);
+  size_t hashed = chunk_count * kContentHashChunkSize;
+  return hasher.Finish(bytes + hashed, size - hashed, size);
+}
+
+uint32 HashContentsSampled(const void* data, size_t size, size_t sample_size) {
+  DCHECK(data != NULL || size == 0);
+
+  if (sample_size == 0)
+    return HashContents(data, size);
+  sample_size = std::max(sample_size, kMinContentHashSampleSize);
+  if (size <= sample_size)
+    return HashContents(data, size);
+
+  // Hash a prefix of the range, which is where headers and most small writes
+  // end up.
+  const uint8* bytes = reinterpret_cast<const uint8*>(data);
+  size_t sample_chunks = sample_size / kContentHashChunkSize;
+  size_t prefix_chunks = sample_chunks / 2;
+  ContentHasher hasher;
+  hasher.UpdateChunks(bytes, prefix_chunks);
+
+  // Spread the remaining chunks evenly over the rest of the range. The last
+  // one ends the range, so that writes to the end of a block are noticed.
+  size_t strided_chunks = sample_chunks - prefix_chunks;
+  size_t rest_offset = prefix_chunks * kContentHashChunkSize;
+  size_t last_offset = size - kContentHashChunkSize;
+  DCHECK_LE(rest_offset + (strided_chunks - 1) * kContentHashChunkSize,
+            last_offset);
+  size_t stride = 0;
+  if (strided_chunks > 1)
+    stride = (last_offset - rest_offset) / (strided_chunks - 1);
+  for (size_t i = 0; i + 1 < strided_chunks; ++i)
+    hasher.UpdateChunks(bytes + rest_offset + i * stride, 1);
+  hasher.UpdateChunks(bytes + last_offset, 1);
+
+  return hasher.Finish(NULL, 0, size);
+}
+
+}  // namespace memprof
+}  // namespace agent
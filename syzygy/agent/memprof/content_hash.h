@@ -0,0 +1,58 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the functions used by the memory profiler for hashing the contents
+// of heap blocks when they are freed. These need to be fast, as they touch
+// every byte of every freed block.
+
+#ifndef SYZYGY_AGENT_MEMPROF_CONTENT_HASH_H_
+#define SYZYGY_AGENT_MEMPROF_CONTENT_HASH_H_
+
+#include "base/basictypes.h"
+
+namespace agent {
+namespace memprof {
+
+// The size of the chunks that are hashed in parallel lanes. Hashed data is
+// consumed a chunk at a time, and the bytes of a chunk are spread over 16
+// independent 32-bit lanes, which are updated with SSE2.
+const size_t kContentHashChunkSize = 64;
+
+// The smallest sample size for which HashContentsSampled actually samples.
+const size_t kMinContentHashSampleSize = 2 * kContentHashChunkSize;
+
+// Computes a 32-bit hash of a memory range. The hash doesn't depend on the
+// alignment of the range.
+// @param data The start of the range.
+// @param size The size of the range.
+// @returns the hash of the range.
+uint32 HashContents(const void* data, size_t size);
+
+// Computes a 32-bit hash of a sample of a memory range. Ranges of at most
+// @p sample_size bytes are hashed as with HashContents. For larger ranges,
+// the first half of the sample is a prefix of the range, and the second half
+// is made of chunks evenly spread over the rest of the range, the last of
+// which ends the range. The size of the range is always part of the hash.
+// @param data The start of the range.
+// @param size The size of the range.
+// @param sample_size The maximum number of bytes to hash, or 0 to hash the
+//     whole range. This is rounded down to a multiple of
+//     kContentHashChunkSize, and up to kMinContentHashSampleSize.
+// @returns the hash of the sample.
+uint32 HashContentsSampled(const void* data, size_t size, size_t sample_size);
+
+}  // namespace memprof
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_MEMPROF_CONTENT_HASH_H_
@@ -0,0 +1,109 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/memprof/content_hash.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace memprof {
+
+namespace {
+
+void FillBuffer(std::vector<uint8>* buffer) {
+  for (size_t i = 0; i < buffer->size(); ++i)
+    (*buffer)[i] = static_cast<uint8>(i * 7 + 3);
+}
+
+}  // namespace
+
+TEST(ContentHashTest, HashDependsOnEveryByte) {
+  // Cover a few whole chunks and a tail.
+  std::vector<uint8> buffer(3 * kContentHashChunkSize + 7);
+  FillBuffer(&buffer);
+  uint32 hash = HashContents(&buffer[0], buffer.size());
+  EXPECT_EQ(hash, HashContents(&buffer[0], buffer.size()));
+
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] ^= 1;
+    EXPECT_NE(hash, HashContents(&buffer[0], buffer.size()));
+    buffer[i] ^= 1;
+  }
+}
+
+TEST(ContentHashTest, HashDependsOnSize) {
+  std::vector<uint8> buffer(2 * kContentHashChunkSize, 0);
+  uint32 hash = HashContents(&buffer[0], buffer.size());
+  EXPECT_NE(hash, HashContents(&buffer[0], buffer.size() - 1));
+  EXPECT_NE(hash, HashContents(&buffer[0], kContentHashChunkSize));
+  EXPECT_NE(HashContents(&buffer[0], 0), HashContents(&buffer[0], 1));
+}
+
+TEST(ContentHashTest, HashDoesNotDependOnAlignment) {
+  const size_t kSize = 5 * kContentHashChunkSize + 13;
+  std::vector<uint8> buffer(kSize + 16);
+  std::vector<uint8> contents(kSize);
+  FillBuffer(&contents);
+  uint32 hash = HashContents(&contents[0], kSize);
+
+  for (size_t offset = 0; offset < 16; ++offset) {
+    ::memcpy(&buffer[offset], &contents[0], kSize);
+    EXPECT_EQ(hash, HashContents(&buffer[offset], kSize));
+  }
+}
+
+TEST(ContentHashTest, SmallRangesAreNotSampled) {
+  std::vector<uint8> buffer(4 * kContentHashChunkSize);
+  FillBuffer(&buffer);
+  uint32 hash = HashContents(&buffer[0], buffer.size());
+  EXPECT_EQ(hash, HashContentsSampled(&buffer[0], buffer.size(), 0));
+  EXPECT_EQ(hash, HashContentsSampled(&buffer[0], buffer.size(),
+                                      buffer.size()));
+
+  // Sample sizes are rounded up to the minimum sample size.
+  EXPECT_EQ(HashContents(&buffer[0], kMinContentHashSampleSize),
+            HashContentsSampled(&buffer[0], kMinContentHashSampleSize, 1));
+}
+
+TEST(ContentHashTest, LargeRangesAreSampled) {
+  const size_t kSampleSize = 4 * kContentHashChunkSize;
+  std::vector<uint8> buffer(100 * kContentHashChunkSize);
+  FillBuffer(&buffer);
+  uint32 hash = HashContentsSampled(&buffer[0], buffer.size(), kSampleSize);
+  EXPECT_NE(HashContents(&buffer[0], buffer.size()), hash);
+
+  // The prefix is hashed.
+  buffer[0] ^= 1;
+  EXPECT_NE(hash, HashContentsSampled(&buffer[0], buffer.size(), kSampleSize));
+  buffer[0] ^= 1;
+
+  // So is the end of the range.
+  buffer.back() ^= 1;
+  EXPECT_NE(hash, HashContentsSampled(&buffer[0], buffer.size(), kSampleSize));
+  buffer.back() ^= 1;
+
+  // Bytes between the sampled chunks aren't.
+  buffer[3 * kContentHashChunkSize] ^= 1;
+  EXPECT_EQ(hash, HashContentsSampled(&buffer[0], buffer.size(), kSampleSize));
+  buffer[3 * kContentHashChunkSize] ^= 1;
+
+  // The size is always hashed.
+  EXPECT_NE(hash, HashContentsSampled(&buffer[0], buffer.size() - 1,
+                                      kSampleSize));
+}
+
+}  // namespace memprof
+}  // namespace agent
@@ -19,11 +19,22 @@
 namespace agent {
 namespace memprof {
 
+namespace {
+
+// The maximum size of the fixed part of an encoded compact function call:
+// the timestamp delta, function ID, stack trace index and argument count
+// varints, and a new stack trace ID.
+const size_t kMaxCompactCallHeaderSize =
+    4 * kMaxTraceVarintSize + sizeof(uint32);
+
+}  // namespace
+
 FunctionCallLogger::FunctionCallLogger(
     trace::client::RpcSession* session)
     : session_(session),
       stack_trace_tracking_(kTrackingNone),
       serialize_timestamps_(false),
+      compact_function_calls_(false),
       call_counter_(0),
       serial_(0) {
   DCHECK_NE(static_cast<trace::client::RpcSession*>(nullptr), session);
@@ -108,8 +119,169 @@ uint32 FunctionCallLogger::GetStackTraceId(TraceFileSegment* segment) {
 
 bool FunctionCallLogger::FlushSegment(TraceFileSegment* segment) {
   DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+
+  // The open batch of compact calls, if any, leaves with the segment.
+  CompactCallBatch* batch = compact_call_batch_.Get();
+  if (batch != nullptr && batch->segment == segment)
+    batch->record = nullptr;
+
   return session_->ExchangeBuffer(segment);
 }
 
+uint64 FunctionCallLogger::GetTimestamp() {
+  if (!serialize_timestamps_)
+    return ::trace::common::GetTsc();
+
+  base::AutoLock lock(lock_);
+  return call_counter_++;
+}
+
+void FunctionCallLogger::EmitCompactFunctionCall(
+    TraceFileSegment* segment,
+    uint64 timestamp,
+    uint32 function_id,
+    uint32 stack_trace_id,
+    const size_t* argument_sizes,
+    size_t argument_slots,
+    const uint8* argument_data) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+  DCHECK_NE(static_cast<const size_t*>(nullptr), argument_sizes);
+  DCHECK_NE(static_cast<const uint8*>(nullptr), argument_data);
+
+  // Bound the size of the encoded call. A delta encoded argument may take
+  // a byte more than its raw contents.
+  size_t max_size = kMaxCompactCallHeaderSize;
+  size_t argument_count = 0;
+  for (size_t i = 0; i < argument_slots; ++i) {
+    if (argument_sizes[i] == 0)
+      continue;
+    ++argument_count;
+    max_size += 2 * kMaxTraceVarintSize + argument_sizes[i];
+  }
+
+  CompactCallBatch* batch = GetCompactCallBatch();
+  if (!CompactCallBatchIsOpen(batch, segment) ||
+      !segment->CanAllocateRaw(max_size)) {
+    if (!OpenCompactCallBatch(segment, timestamp, max_size, batch))
+      return;
+  }
+  DCHECK(CompactCallBatchIsOpen(batch, segment));
+  DCHECK(segment->CanAllocateRaw(max_size));
+
+  // Encode the call in place, at the end of the batch.
+  uint8* call = segment->write_ptr;
+  uint8* cursor = call;
+  cursor += WriteTraceVarint(timestamp - batch->last_timestamp, cursor);
+  cursor += WriteTraceVarint(function_id, cursor);
+
+  size_t stack_trace_index = 0;
+  while (stack_trace_index < batch->stack_trace_id_count &&
+         batch->stack_trace_ids[stack_trace_index] != stack_trace_id) {
+    ++stack_trace_index;
+  }
+  cursor += WriteTraceVarint(stack_trace_index, cursor);
+  if (stack_trace_index == batch->stack_trace_id_count) {
+    ::memcpy(cursor, &stack_trace_id, sizeof(stack_trace_id));
+    cursor += sizeof(stack_trace_id);
+    if (batch->stack_trace_id_count <
+            TraceCompactFunctionCalls::kMaxStackTraceIds) {
+      batch->stack_trace_ids[batch->stack_trace_id_count] = stack_trace_id;
+      ++batch->stack_trace_id_count;
+    }
+  }
+
+  cursor += WriteTraceVarint(argument_count, cursor);
+  size_t argument_index = 0;
+  for (size_t i = 0; i < argument_slots; ++i) {
+    size_t argument_size = argument_sizes[i];
+    if (argument_size == 0)
+      continue;
+
+    cursor += WriteTraceVarint(argument_size, cursor);
+    if (argument_size == sizeof(uint32) &&
+        argument_index < TraceCompactFunctionCalls::kMaxDeltaArguments) {
+      uint32 value = 0;
+      ::memcpy(&value, argument_data, sizeof(value));
+      uint32& last_value = batch->last_arguments[argument_index];
+      cursor += WriteTraceVarint(ZigZagEncodeTraceDelta(value - last_value),
+                                 cursor);
+      last_value = value;
+    } else {
+      ::memcpy(cursor, argument_data, argument_size);
+      cursor += argument_size;
+    }
+    argument_data += argument_size;
+    ++argument_index;
+  }
+
+  // Commit the call by growing the segment, then the record.
+  size_t call_size = cursor - call;
+  DCHECK_LE(call_size, max_size);
+  segment->write_ptr += call_size;
+  segment->header->segment_length += call_size;
+  ::trace::client::GetRecordPrefix(batch->record)->size += call_size;
+  batch->record->data_size += call_size;
+  ++batch->record->call_count;
+  batch->last_timestamp = timestamp;
+}
+
+FunctionCallLogger::CompactCallBatch*
+FunctionCallLogger::GetCompactCallBatch() {
+  CompactCallBatch* batch = compact_call_batch_.Get();
+  if (batch != nullptr)
+    return batch;
+
+  batch = new CompactCallBatch();
+  {
+    base::AutoLock lock(lock_);
+    compact_call_batches_.push_back(batch);
+  }
+  compact_call_batch_.Set(batch);
+  return batch;
+}
+
+bool FunctionCallLogger::CompactCallBatchIsOpen(
+    const CompactCallBatch* batch, const TraceFileSegment* segment) {
+  DCHECK_NE(static_cast<const CompactCallBatch*>(nullptr), batch);
+  DCHECK_NE(static_cast<const TraceFileSegment*>(nullptr), segment);
+
+  if (batch->record == nullptr || batch->segment != segment)
+    return false;
+
+  // Other records may have been written to the segment since the last call,
+  // or it may have been flushed by its owner.
+  const RecordPrefix* prefix = ::trace::client::GetRecordPrefix(batch->record);
+  return prefix->type == TraceCompactFunctionCalls::kTypeId &&
+      segment->write_ptr == batch->record->data + batch->record->data_size;
+}
+
+bool FunctionCallLogger::OpenCompactCallBatch(TraceFileSegment* segment,
+                                              uint64 timestamp,
+                                              size_t min_data_size,
+                                              CompactCallBatch* batch) {
+  DCHECK_NE(static_cast<TraceFileSegment*>(nullptr), segment);
+  DCHECK_NE(static_cast<CompactCallBatch*>(nullptr), batch);
+
+  size_t record_size = FIELD_OFFSET(TraceCompactFunctionCalls, data);
+  if (!segment->CanAllocate(record_size + min_data_size) &&
+      !FlushSegment(segment)) {
+    return false;
+  }
+  DCHECK(segment->CanAllocate(record_size + min_data_size));
+
+  TraceCompactFunctionCalls* record =
+      reinterpret_cast<TraceCompactFunctionCalls*>(
+          segment->AllocateTraceRecordImpl(
+              TraceCompactFunctionCalls::kTypeId, record_size));
+  DCHECK_NE(static_cast<TraceCompactFunctionCalls*>(nullptr), record);
+  record->base_timestamp = timestamp;
+
+  ::memset(batch, 0, sizeof(*batch));
+  batch->segment = segment;
+  batch->record = record;
+  batch->last_timestamp = timestamp;
+  return true;
+}
+
 }  // namespace memprof
 }  // namespace agent
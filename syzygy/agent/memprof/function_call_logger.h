@@ -20,6 +20,8 @@
 
 #include <set>
 
+#include "base/memory/scoped_vector.h"
+#include "base/threading/thread_local.h"
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/trace/client/rpc_session.h"
 
@@ -90,6 +92,12 @@ class FunctionCallLogger {
   void set_serialize_timestamps(bool serialize_timestamps) {
     serialize_timestamps_ = serialize_timestamps;
   }
+  bool compact_function_calls() const {
+    return compact_function_calls_;
+  }
+  void set_compact_function_calls(bool compact_function_calls) {
+    compact_function_calls_ = compact_function_calls;
+  }
   // @}
 
   // @returns a unique serial number for this function call logger.
@@ -97,15 +105,73 @@ class FunctionCallLogger {
   uint32 serial() const { return serial_; }
 
  protected:
+  // The state of the batch of compact function calls that a thread is
+  // appending to. The batch is the last record of the segment of the thread,
+  // and grows in place until something else is written to the segment.
+  struct CompactCallBatch {
+    // The segment and the record of the batch. |record| is null if there is
+    // no open batch.
+    TraceFileSegment* segment;
+    TraceCompactFunctionCalls* record;
+    // The timestamp of the last call of the batch.
+    uint64 last_timestamp;
+    // The dictionary of stack trace IDs of the batch.
+    size_t stack_trace_id_count;
+    uint32 stack_trace_ids[TraceCompactFunctionCalls::kMaxStackTraceIds];
+    // The last value of each delta encoded argument.
+    uint32 last_arguments[TraceCompactFunctionCalls::kMaxDeltaArguments];
+  };
+
   // Flushes the provided segment, and gets a new one.
   bool FlushSegment(TraceFileSegment* segment);
 
+  // @returns the timestamp of a function call being logged.
+  uint64 GetTimestamp();
+
+  // Appends a function call to the batch of compact function calls of the
+  // calling thread, starting a new batch if need be.
+  // @param segment The segment to write to.
+  // @param timestamp The timestamp of the call.
+  // @param function_id The ID of the function that was called.
+  // @param stack_trace_id The ID of the stack trace of the call.
+  // @param argument_sizes The sizes of the arguments. Null arguments, of size
+  //     zero, are skipped.
+  // @param argument_slots The number of entries in @p argument_sizes.
+  // @param argument_data The contents of the arguments, back to back.
+  void EmitCompactFunctionCall(TraceFileSegment* segment,
+                               uint64 timestamp,
+                               uint32 function_id,
+                               uint32 stack_trace_id,
+                               const size_t* argument_sizes,
+                               size_t argument_slots,
+                               const uint8* argument_data);
+
+  // @returns the compact call batch of the calling thread, allocating it if
+  //     need be.
+  CompactCallBatch* GetCompactCallBatch();
+
+  // @returns true if @p batch can be appended to in @p segment.
+  static bool CompactCallBatchIsOpen(const CompactCallBatch* batch,
+                                     const TraceFileSegment* segment);
+
+  // Starts a new batch of compact function calls in @p segment, flushing it
+  // if there isn't room for @p min_data_size bytes of encoded calls.
+  // @returns true on success, false if the segment couldn't be flushed.
+  bool OpenCompactCallBatch(TraceFileSegment* segment,
+                            uint64 timestamp,
+                            size_t min_data_size,
+                            CompactCallBatch* batch);
+
   // The stack-trace tracking mode. Default to kTrackingNone.
   StackTraceTracking stack_trace_tracking_;
 
   // Whether or not timestamps are being serialized.
   bool serialize_timestamps_;
 
+  // Whether or not detailed function calls are emitted as batches of compact
+  // function calls.
+  bool compact_function_calls_;
+
   // The RPC session events are being written to.
   trace::client::RpcSession* session_;
 
@@ -126,6 +192,11 @@ class FunctionCallLogger {
   typedef std::set<uint32> StackIdSet;
   StackIdSet emitted_stack_ids_;  // Under lock_.
 
+  // The compact call batch of each thread, and their storage. These are only
+  // used if |compact_function_calls_| is true.
+  base::ThreadLocalPointer<CompactCallBatch> compact_call_batch_;
+  ScopedVector<CompactCallBatch> compact_call_batches_;  // Under lock_.
+
   // A unique serial number generated at construction time. For unittesting.
   uint32 serial_;
 
@@ -161,8 +232,9 @@ template<> struct FunctionCallLogger::ArgumentSerializer<
 
 // Implementation off the detailed function call logger. Populates a
 // TraceDetailedFunctionCall buffer with variable length encodings of
-// the arguments. Arguments are serialized using the ArgumentSerializer
-// helper.
+// the arguments, or appends the call to a TraceCompactFunctionCalls batch if
+// compact function calls are enabled. Arguments are serialized using the
+// ArgumentSerializer helper.
 template<typename ArgType0,
          typename ArgType1,
          typename ArgType2,
@@ -206,6 +278,31 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   args_count += arg_size5 > 0 ? 1 : 0;
   args_size += arg_size5;
 
+  if (compact_function_calls_) {
+    // Serialize the arguments back to back, and encode them from there.
+    uint8 arg_data[sizeof(ArgType0) + sizeof(ArgType1) + sizeof(ArgType2) +
+                   sizeof(ArgType3) + sizeof(ArgType4) + sizeof(ArgType5)];
+    uint8* arg_cursor = arg_data;
+    ArgumentSerializer<ArgType0>().serialize(arg0, arg_cursor);
+    arg_cursor += arg_size0;
+    ArgumentSerializer<ArgType1>().serialize(arg1, arg_cursor);
+    arg_cursor += arg_size1;
+    ArgumentSerializer<ArgType2>().serialize(arg2, arg_cursor);
+    arg_cursor += arg_size2;
+    ArgumentSerializer<ArgType3>().serialize(arg3, arg_cursor);
+    arg_cursor += arg_size3;
+    ArgumentSerializer<ArgType4>().serialize(arg4, arg_cursor);
+    arg_cursor += arg_size4;
+    ArgumentSerializer<ArgType5>().serialize(arg5, arg_cursor);
+
+    const size_t arg_sizes[] = {
+        arg_size0, arg_size1, arg_size2, arg_size3, arg_size4, arg_size5 };
+    EmitCompactFunctionCall(segment, GetTimestamp(), function_id,
+                            stack_trace_id, arg_sizes, arraysize(arg_sizes),
+                            arg_data);
+    return;
+  }
+
   if (args_size > 0)
     args_size += (args_count + 1) * sizeof(uint32);
   size_t data_size = FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) +
@@ -221,13 +318,7 @@ void FunctionCallLogger::EmitDetailedFunctionCall(TraceFileSegment* segment,
   data->stack_trace_id = stack_trace_id;
   data->argument_data_size = args_size;
 
-  if (serialize_timestamps_) {
-    base::AutoLock lock(lock_);
-    data->timestamp = call_counter_;
-    ++call_counter_;
-  } else {
-    data->timestamp = ::trace::common::GetTsc();
-  }
+  data->timestamp = GetTimestamp();
 
   if (args_size == 0)
     return;
@@ -307,5 +307,66 @@ TEST(FunctionCallLoggerTest, TraceDetailedFunctionCallSerializeTimestamps) {
   }
 }
 
+TEST(FunctionCallLoggerTest, CompactFunctionCalls) {
+  TestFunctionCallLogger fcl;
+  fcl.set_serialize_timestamps(true);
+  fcl.set_compact_function_calls(true);
+
+  const uint32 kStackTraceId = 0x11223344;
+  const uint32 kArgument = 0x1000;
+  const uint8 kCharArgument = 'A';
+  fcl.EmitDetailedFunctionCall(&fcl.test_segment_, 3, kStackTraceId,
+                               kArgument, kCharArgument);
+  fcl.EmitDetailedFunctionCall(&fcl.test_segment_, 3, kStackTraceId,
+                               kArgument + 4);
+  fcl.EmitDetailedFunctionCall(&fcl.test_segment_, 4, kStackTraceId);
+
+  // All of the calls were appended to a single record, at the end of the
+  // segment.
+  ASSERT_EQ(1u, fcl.allocation_infos.size());
+  const auto& info0 = fcl.allocation_infos[0];
+  EXPECT_EQ(TraceCompactFunctionCalls::kTypeId, info0.record_type);
+  TraceCompactFunctionCalls* data0 =
+      reinterpret_cast<TraceCompactFunctionCalls*>(info0.record);
+  EXPECT_EQ(0u, data0->base_timestamp);
+  EXPECT_EQ(3u, data0->call_count);
+  EXPECT_EQ(fcl.test_segment_.write_ptr, data0->data + data0->data_size);
+
+  const uint8 kExpectedData0[] = {
+      // Timestamp delta, function ID, new stack trace ID.
+      0x00, 0x03, 0x00, 0x44, 0x33, 0x22, 0x11,
+      // 2 arguments: 0x1000 as a delta from 0, and 'A'.
+      0x02, 0x04, 0x80, 0x40, 0x01, 'A',
+      // Timestamp delta, function ID, stack trace ID 0 of the dictionary.
+      0x01, 0x03, 0x00,
+      // 1 argument, 4 more than the previous one.
+      0x01, 0x04, 0x08,
+      // Timestamp delta, function ID, stack trace ID 0, no arguments.
+      0x01, 0x04, 0x00, 0x00,
+      };
+  ASSERT_EQ(arraysize(kExpectedData0), data0->data_size);
+  EXPECT_EQ(0, ::memcmp(kExpectedData0, data0->data, data0->data_size));
+
+  // Writing another record to the segment closes the batch.
+  fcl.GetFunctionId(&fcl.test_segment_, "foo");
+  fcl.EmitDetailedFunctionCall(&fcl.test_segment_, 3, kStackTraceId,
+                               kArgument);
+  ASSERT_EQ(3u, fcl.allocation_infos.size());
+  const auto& info2 = fcl.allocation_infos[2];
+  EXPECT_EQ(TraceCompactFunctionCalls::kTypeId, info2.record_type);
+  TraceCompactFunctionCalls* data2 =
+      reinterpret_cast<TraceCompactFunctionCalls*>(info2.record);
+  EXPECT_EQ(3u, data2->base_timestamp);
+  EXPECT_EQ(1u, data2->call_count);
+  EXPECT_EQ(3u, data0->call_count);
+
+  // The new batch has its own dictionary and argument deltas.
+  const uint8 kExpectedData2[] = {
+      0x00, 0x03, 0x00, 0x44, 0x33, 0x22, 0x11, 0x01, 0x04, 0x80, 0x40,
+      };
+  ASSERT_EQ(arraysize(kExpectedData2), data2->data_size);
+  EXPECT_EQ(0, ::memcmp(kExpectedData2, data2->data, data2->data_size));
+}
+
 }  // namespace memprof
 }  // namespace agent
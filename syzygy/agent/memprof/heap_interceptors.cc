@@ -18,19 +18,31 @@
 
 #include <windows.h>
 
-#include "base/hash.h"
+#include "syzygy/agent/memprof/content_hash.h"
 #include "syzygy/agent/memprof/memprof.h"
 
 // A wrapper to EMIT_DETAILED_FUNCTION_CALL that provides the MemoryProfiler
-// FunctionCallLogger instance.
+// FunctionCallLogger instance. Heap function calls aren't logged when
+// allocations are aggregated.
 #define EMIT_DETAILED_HEAP_FUNCTION_CALL(...)  \
     DCHECK_NE(static_cast<agent::memprof::MemoryProfiler*>(nullptr),  \
               agent::memprof::memory_profiler.get());  \
-    EMIT_DETAILED_FUNCTION_CALL(  \
-        &agent::memprof::memory_profiler->function_call_logger(),  \
-        agent::memprof::memory_profiler->GetOrAllocateThreadState()->  \
-            segment(),  \
-        __VA_ARGS__);
+    if (!AggregateAllocations()) {  \
+      EMIT_DETAILED_FUNCTION_CALL(  \
+          &agent::memprof::memory_profiler->function_call_logger(),  \
+          agent::memprof::memory_profiler->GetOrAllocateThreadState()->  \
+              segment(),  \
+          __VA_ARGS__);  \
+    }
+
+namespace {
+
+// @returns true if allocations are aggregated rather than logged.
+bool AggregateAllocations() {
+  return agent::memprof::memory_profiler->parameters().aggregate_allocations;
+}
+
+}  // namespace
 
 extern "C" {
 
@@ -58,6 +70,8 @@ LPVOID WINAPI asan_HeapAlloc(HANDLE heap,
                              DWORD flags,
                              SIZE_T bytes) {
   LPVOID ret = ::HeapAlloc(heap, flags, bytes);
+  if (AggregateAllocations())
+    agent::memprof::memory_profiler->OnHeapAllocation(ret, bytes);
   EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, bytes, ret);
   return ret;
 }
@@ -67,6 +81,8 @@ LPVOID WINAPI asan_HeapReAlloc(HANDLE heap,
                                LPVOID mem,
                                SIZE_T bytes) {
   LPVOID ret = ::HeapReAlloc(heap, flags, mem, bytes);
+  if (AggregateAllocations())
+    agent::memprof::memory_profiler->OnHeapReallocation(mem, ret, bytes);
   EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, bytes, ret);
   return ret;
 }
@@ -74,14 +90,23 @@ LPVOID WINAPI asan_HeapReAlloc(HANDLE heap,
 BOOL WINAPI asan_HeapFree(HANDLE heap,
                           DWORD flags,
                           LPVOID mem) {
-  // Calculate a hash value of the contents if necessary.
+  // Calculate a hash value of the contents if necessary. This is only logged
+  // with the call, so it isn't needed when allocations are aggregated.
   uint32 hash = 0;
-  if (mem != nullptr &&
-      agent::memprof::memory_profiler->parameters().hash_contents_at_free) {
+  const agent::memprof::Parameters& parameters =
+      agent::memprof::memory_profiler->parameters();
+  if (mem != nullptr && !AggregateAllocations() &&
+      parameters.hash_contents_at_free) {
     size_t size = ::HeapSize(heap, 0, mem);
-    hash = base::SuperFastHash(reinterpret_cast<const char*>(mem), size);
+    hash = agent::memprof::HashContentsSampled(mem, size,
+                                               parameters.hash_sample_size);
   }
 
+  // The free is recorded first, as the address may be reused as soon as it
+  // is freed.
+  if (AggregateAllocations())
+    agent::memprof::memory_profiler->OnHeapFree(mem);
+
   BOOL ret = ::HeapFree(heap, flags, mem);
   EMIT_DETAILED_HEAP_FUNCTION_CALL(heap, flags, mem, ret, hash);
   return ret;
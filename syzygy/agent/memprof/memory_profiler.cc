@@ -20,16 +20,29 @@
 namespace agent {
 namespace memprof {
 
+const char kAllocationSnapshotFunctionName[] =
+    "agent::memprof::AllocationSnapshot";
+const char kAllocationSiteStatisticsFunctionName[] =
+    "agent::memprof::AllocationSiteStatistics";
+
 MemoryProfiler::MemoryProfiler()
-    : function_call_logger_(&session_) {
+    : function_call_logger_(&session_),
+      last_allocation_snapshot_(0) {
   SetDefaultParameters(&parameters_);
 }
 
+MemoryProfiler::~MemoryProfiler() {
+  // Log the final state of the allocation sites, which includes the leaks.
+  if (parameters_.aggregate_allocations && session_.IsTracing())
+    LogAllocationSnapshot();
+}
+
 bool MemoryProfiler::Init() {
   // We don't care if parameter parsing fails at runtime; such parameters will
   // simply be ignored.
   ParseParametersFromEnv(&parameters_);
   PropagateParameters();
+  last_allocation_snapshot_ = ::GetTickCount();
   ThreadState* state = GetOrAllocateThreadState();
   if (!trace::client::InitializeRpcSession(
           &session_, state->segment())) {
@@ -66,6 +79,82 @@ void MemoryProfiler::PropagateParameters() {
       parameters_.stack_trace_tracking);
   function_call_logger_.set_serialize_timestamps(
       parameters_.serialize_timestamps);
+  function_call_logger_.set_compact_function_calls(
+      parameters_.compact_function_calls);
+
+  // Allocation sites are identified by their stack trace IDs, so these must
+  // at least be tracked when allocations are aggregated.
+  if (parameters_.aggregate_allocations &&
+      parameters_.stack_trace_tracking == kTrackingNone) {
+    function_call_logger_.set_stack_trace_tracking(kTrackingTrack);
+  }
+}
+
+void MemoryProfiler::OnHeapAllocation(const void* address, size_t size) {
+  uint32 stack_trace_id = function_call_logger_.GetStackTraceId(
+      GetOrAllocateThreadState()->segment());
+  allocation_aggregator_.OnAllocation(address, size, stack_trace_id);
+  MaybeLogAllocationSnapshot();
+}
+
+void MemoryProfiler::OnHeapFree(const void* address) {
+  allocation_aggregator_.OnFree(address);
+  MaybeLogAllocationSnapshot();
+}
+
+void MemoryProfiler::OnHeapReallocation(const void* old_address,
+                                        const void* new_address,
+                                        size_t size) {
+  uint32 stack_trace_id = function_call_logger_.GetStackTraceId(
+      GetOrAllocateThreadState()->segment());
+  allocation_aggregator_.OnReallocation(old_address, new_address, size,
+                                        stack_trace_id);
+  MaybeLogAllocationSnapshot();
+}
+
+void MemoryProfiler::LogAllocationSnapshot() {
+  AllocationAggregator::SiteStatisticsMap sites;
+  allocation_aggregator_.GetSiteStatistics(&sites);
+  size_t live_allocation_count = allocation_aggregator_.live_allocation_count();
+
+  trace::client::TraceFileSegment* segment =
+      GetOrAllocateThreadState()->segment();
+  if (segment->write_ptr == nullptr)
+    return;
+
+  uint32 snapshot_function_id = function_call_logger_.GetFunctionId(
+      segment, kAllocationSnapshotFunctionName);
+  uint32 site_function_id = function_call_logger_.GetFunctionId(
+      segment, kAllocationSiteStatisticsFunctionName);
+  function_call_logger_.EmitDetailedFunctionCall(
+      segment, snapshot_function_id, 0, sites.size(), live_allocation_count);
+
+  AllocationAggregator::SiteStatisticsMap::const_iterator it = sites.begin();
+  for (; it != sites.end(); ++it) {
+    const AllocationAggregator::SiteStatistics& site = it->second;
+    function_call_logger_.EmitDetailedFunctionCall(
+        segment, site_function_id, it->first, site.live_count,
+        site.live_bytes, site.total_count, site.total_bytes);
+  }
+}
+
+void MemoryProfiler::MaybeLogAllocationSnapshot() {
+  DWORD now = ::GetTickCount();
+
+  // This first check is racy, but it avoids taking the lock on every heap
+  // function call.
+  if (now - last_allocation_snapshot_ < parameters_.allocation_snapshot_period)
+    return;
+  {
+    base::AutoLock lock(lock_);
+    if (now - last_allocation_snapshot_ <
+            parameters_.allocation_snapshot_period) {
+      return;
+    }
+    last_allocation_snapshot_ = now;
+  }
+
+  LogAllocationSnapshot();
 }
 
 MemoryProfiler::ThreadState* MemoryProfiler::GetOrAllocateThreadStateImpl() {
@@ -24,6 +24,7 @@
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/agent/common/dll_notifications.h"
 #include "syzygy/agent/common/thread_state.h"
+#include "syzygy/agent/memprof/allocation_aggregator.h"
 #include "syzygy/agent/memprof/function_call_logger.h"
 #include "syzygy/agent/memprof/parameters.h"
 #include "syzygy/common/logging.h"
@@ -32,9 +33,20 @@
 namespace agent {
 namespace memprof {
 
+// The names of the functions that allocation snapshots are logged as, when
+// allocations are aggregated. A snapshot is logged as a call to
+// AllocationSnapshot, with the number of allocation sites and of live
+// allocations as arguments, followed by a call to AllocationSiteStatistics
+// for each site. These have the ID of the stack trace of the site, and the
+// live count, live bytes, total count and total bytes of the site as
+// arguments.
+extern const char kAllocationSnapshotFunctionName[];
+extern const char kAllocationSiteStatisticsFunctionName[];
+
 class MemoryProfiler {
  public:
   MemoryProfiler();
+  ~MemoryProfiler();
 
   // Initializes this memory profiler.
   // @returns true for success, false otherwise.
@@ -60,6 +72,21 @@ class MemoryProfiler {
   // @returns the current parameters.
   const Parameters& parameters() const { return parameters_; }
 
+  // @name Allocation aggregation. These record heap allocations made by the
+  // current thread, and periodically log snapshots of the allocation sites.
+  // They are only used if the aggregate_allocations parameter is enabled.
+  // @{
+  void OnHeapAllocation(const void* address, size_t size);
+  // This must be called before the memory is freed.
+  void OnHeapFree(const void* address);
+  void OnHeapReallocation(const void* old_address,
+                          const void* new_address,
+                          size_t size);
+  // Logs a snapshot of the allocation sites, using the current thread's
+  // segment.
+  void LogAllocationSnapshot();
+  // @}
+
  protected:
   friend class ThreadState;
 
@@ -77,6 +104,10 @@ class MemoryProfiler {
   // Logs @p module, using the current thread's segment.
   void LogModule(HMODULE module);
 
+  // Logs a snapshot of the allocation sites if the snapshot period has
+  // elapsed since the last one.
+  void MaybeLogAllocationSnapshot();
+
   // Sink for DLL load/unload event notifications.
   void OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
                   HMODULE module,
@@ -100,6 +131,13 @@ class MemoryProfiler {
   // The parameters that we use. These are parsed from the environment.
   Parameters parameters_;
 
+  // Aggregates the heap allocations, if the aggregate_allocations parameter
+  // is enabled.
+  AllocationAggregator allocation_aggregator_;
+
+  // The tick count of the last allocation snapshot.
+  DWORD last_allocation_snapshot_;  // Written under lock_.
+
   // To keep track of modules added after initialization.
   agent::common::DllNotificationWatcher dll_watcher_;
 
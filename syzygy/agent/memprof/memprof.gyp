@@ -36,7 +36,11 @@
       'target_name': 'memprof_lib',
       'type': 'static_library',
       'sources': [
+        'allocation_aggregator.cc',
+        'allocation_aggregator.h',
         'asan_compatibility.cc',
+        'content_hash.cc',
+        'content_hash.h',
         'crt_interceptors.cc',
         'heap_interceptors.cc',
         'function_call_logger.cc',
@@ -63,6 +67,8 @@
       'target_name': 'memprof_unittests',
       'type': 'executable',
       'sources': [
+        'allocation_aggregator_unittest.cc',
+        'content_hash_unittest.cc',
         'function_call_logger_unittest.cc',
         'memprof_unittest.cc',
         'parameters_unittest.cc',
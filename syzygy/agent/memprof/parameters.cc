@@ -17,6 +17,7 @@
 #include "base/command_line.h"
 #include "base/environment.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace agent {
@@ -36,17 +37,29 @@ const char kParametersEnvVar[] = "SYZYGY_MEMPROF_OPTIONS";
 StackTraceTracking kDefaultStackTraceTracking = kTrackingNone;
 bool kDefaultSerializeTimestamps = false;
 bool kDefaultHashContentsAtFree = false;
+uint32 kDefaultHashSampleSize = 0;
+bool kDefaultCompactFunctionCalls = false;
+bool kDefaultAggregateAllocations = false;
+uint32 kDefaultAllocationSnapshotPeriod = 10000;
 
 // Parameter names for parsing.
 const char kParamStackTraceTracking[] = "stack-trace-tracking";
 const char kParamSerializeTimestamps[] = "serialize-timestamps";
 const char kParamHashContentsAtFree[] = "hash-contents-at-free";
+const char kParamHashSampleSize[] = "hash-sample-size";
+const char kParamCompactFunctionCalls[] = "compact-function-calls";
+const char kParamAggregateAllocations[] = "aggregate-allocations";
+const char kParamAllocationSnapshotPeriod[] = "allocation-snapshot-period";
 
 void SetDefaultParameters(Parameters* parameters) {
   DCHECK_NE(static_cast<Parameters*>(nullptr), parameters);
   parameters->stack_trace_tracking = kDefaultStackTraceTracking;
   parameters->serialize_timestamps = false;
   parameters->hash_contents_at_free = false;
+  parameters->hash_sample_size = kDefaultHashSampleSize;
+  parameters->compact_function_calls = kDefaultCompactFunctionCalls;
+  parameters->aggregate_allocations = kDefaultAggregateAllocations;
+  parameters->allocation_snapshot_period = kDefaultAllocationSnapshotPeriod;
 }
 
 bool ParseParameters(const base::StringPiece& param_string,
@@ -86,6 +99,36 @@ bool ParseParameters(const base::StringPiece& param_string,
   if (cmd_line.HasSwitch(kParamHashContentsAtFree))
     parameters->hash_contents_at_free = true;
 
+  value = cmd_line.GetSwitchValueASCII(kParamHashSampleSize);
+  if (!value.empty()) {
+    unsigned sample_size = 0;
+    if (base::StringToUint(value, &sample_size)) {
+      parameters->hash_sample_size = sample_size;
+    } else {
+      LOG(ERROR) << "Invalid value for --" << kParamHashSampleSize << ": "
+                 << value;
+      success = false;
+    }
+  }
+
+  if (cmd_line.HasSwitch(kParamCompactFunctionCalls))
+    parameters->compact_function_calls = true;
+
+  if (cmd_line.HasSwitch(kParamAggregateAllocations))
+    parameters->aggregate_allocations = true;
+
+  value = cmd_line.GetSwitchValueASCII(kParamAllocationSnapshotPeriod);
+  if (!value.empty()) {
+    unsigned period = 0;
+    if (base::StringToUint(value, &period) && period > 0) {
+      parameters->allocation_snapshot_period = period;
+    } else {
+      LOG(ERROR) << "Invalid value for --" << kParamAllocationSnapshotPeriod
+                 << ": " << value;
+      success = false;
+    }
+  }
+
   return success;
 }
 
@@ -50,6 +50,21 @@ struct Parameters {
   // the hash value stored as an additional parameter to the heap free
   // function.
   bool hash_contents_at_free;
+  // The maximum number of bytes of a block that are hashed when it is freed.
+  // Larger blocks only have a sample of their contents hashed. If this is 0
+  // then blocks are hashed entirely.
+  uint32 hash_sample_size;
+  // If this is enabled then detailed function calls are batched in
+  // TraceCompactFunctionCalls records, which encode the calls of a thread
+  // relative to one another rather than in full.
+  bool compact_function_calls;
+  // If this is enabled then heap allocations are aggregated by allocation
+  // site in the agent, and only snapshots of the per-site statistics are
+  // logged, instead of every heap function call.
+  bool aggregate_allocations;
+  // The minimum time between two snapshots of the per-site statistics, in
+  // milliseconds. Only used if |aggregate_allocations| is enabled.
+  uint32 allocation_snapshot_period;
 };
 
 // The environment variable that is used for extracting parameters.
@@ -62,11 +77,19 @@ extern const char* kStackTraceTrackingValues[];
 extern StackTraceTracking kDefaultStackTraceTracking;
 extern bool kDefaultSerializeTimestamps;
 extern bool kDefaultHashContentsAtFree;
+extern uint32 kDefaultHashSampleSize;
+extern bool kDefaultCompactFunctionCalls;
+extern bool kDefaultAggregateAllocations;
+extern uint32 kDefaultAllocationSnapshotPeriod;
 
 // Parameter names for parsing.
 extern const char kParamStackTraceTracking[];
 extern const char kParamSerializeTimestamps[];
 extern const char kParamHashContentsAtFree[];
+extern const char kParamHashSampleSize[];
+extern const char kParamCompactFunctionCalls[];
+extern const char kParamAggregateAllocations[];
+extern const char kParamAllocationSnapshotPeriod[];
 
 // Initializes a Parameters struct with default values.
 // @param parameters The Parameters struct to be initialized.
@@ -26,6 +26,10 @@ TEST(ParametersTest, SetDefaults) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultHashSampleSize, p.hash_sample_size);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultAggregateAllocations, p.aggregate_allocations);
+  EXPECT_EQ(kDefaultAllocationSnapshotPeriod, p.allocation_snapshot_period);
 }
 
 TEST(ParametersTest, ParseInvalidStackTraceTracking) {
@@ -43,6 +47,10 @@ TEST(ParametersTest, ParseMinimalCommandLine) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultHashSampleSize, p.hash_sample_size);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultAggregateAllocations, p.aggregate_allocations);
+  EXPECT_EQ(kDefaultAllocationSnapshotPeriod, p.allocation_snapshot_period);
 }
 
 TEST(ParametersTest, ParseMaximalCommandLine) {
@@ -50,11 +58,34 @@ TEST(ParametersTest, ParseMaximalCommandLine) {
   SetDefaultParameters(&p);
   std::string str("--stack-trace-tracking=emit "
                   "--serialize-timestamps "
-                  "--hash-contents-at-free");
+                  "--hash-contents-at-free "
+                  "--hash-sample-size=4096 "
+                  "--compact-function-calls "
+                  "--aggregate-allocations "
+                  "--allocation-snapshot-period=500");
   EXPECT_TRUE(ParseParameters(str, &p));
   EXPECT_EQ(kTrackingEmit, p.stack_trace_tracking);
   EXPECT_TRUE(p.serialize_timestamps);
   EXPECT_TRUE(p.hash_contents_at_free);
+  EXPECT_EQ(4096u, p.hash_sample_size);
+  EXPECT_TRUE(p.compact_function_calls);
+  EXPECT_TRUE(p.aggregate_allocations);
+  EXPECT_EQ(500u, p.allocation_snapshot_period);
+}
+
+TEST(ParametersTest, ParseInvalidHashSampleSize) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParameters("--hash-sample-size=foo", &p));
+  EXPECT_EQ(kDefaultHashSampleSize, p.hash_sample_size);
+}
+
+TEST(ParametersTest, ParseInvalidAllocationSnapshotPeriod) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParameters("--allocation-snapshot-period=foo", &p));
+  EXPECT_FALSE(ParseParameters("--allocation-snapshot-period=0", &p));
+  EXPECT_EQ(kDefaultAllocationSnapshotPeriod, p.allocation_snapshot_period);
 }
 
 TEST(ParametersTest, ParseNoEnvironment) {
@@ -68,6 +99,10 @@ TEST(ParametersTest, ParseNoEnvironment) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultHashSampleSize, p.hash_sample_size);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultAggregateAllocations, p.aggregate_allocations);
+  EXPECT_EQ(kDefaultAllocationSnapshotPeriod, p.allocation_snapshot_period);
 }
 
 TEST(ParametersTest, ParseEmptyEnvironment) {
@@ -81,6 +116,10 @@ TEST(ParametersTest, ParseEmptyEnvironment) {
   EXPECT_EQ(kDefaultStackTraceTracking, p.stack_trace_tracking);
   EXPECT_EQ(kDefaultSerializeTimestamps, p.serialize_timestamps);
   EXPECT_EQ(kDefaultHashContentsAtFree, p.hash_contents_at_free);
+  EXPECT_EQ(kDefaultHashSampleSize, p.hash_sample_size);
+  EXPECT_EQ(kDefaultCompactFunctionCalls, p.compact_function_calls);
+  EXPECT_EQ(kDefaultAggregateAllocations, p.aggregate_allocations);
+  EXPECT_EQ(kDefaultAllocationSnapshotPeriod, p.allocation_snapshot_period);
 }
 
 TEST(ParametersTest, ParseInvalidEnvironment) {
@@ -0,0 +1,140 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/invocation_table.h"
+
+#include "base/logging.h"
+
+namespace agent {
+namespace profiler {
+
+InvocationValue::InvocationValue()
+    : caller_move_count(0), function_move_count(0), info(NULL) {
+}
+
+InvocationTable::InvocationTable()
+    : entries_(kInitialCapacity), size_(0), last_entry_(NULL) {
+  COMPILE_ASSERT((kInitialCapacity & (kInitialCapacity - 1)) == 0,
+                 initial_capacity_must_be_a_power_of_two);
+}
+
+InvocationValue* InvocationTable::Find(RetAddr caller, FuncAddr function) {
+  if (last_entry_ != NULL && last_entry_->caller == caller &&
+      last_entry_->function == function) {
+    return &last_entry_->value;
+  }
+
+  Entry& entry = entries_[FindSlot(caller, function)];
+  if (entry.function == NULL)
+    return NULL;
+
+  last_entry_ = &entry;
+  return &entry.value;
+}
+
+InvocationValue* InvocationTable::Insert(RetAddr caller, FuncAddr function) {
+  DCHECK(function != NULL);
+
+  // Keep the load factor at or below one half, so that probe sequences stay
+  // short.
+  if ((size_ + 1) * 2 > entries_.size())
+    Grow();
+
+  Entry& entry = entries_[FindSlot(caller, function)];
+  DCHECK(entry.function == NULL);
+  entry.caller = caller;
+  entry.function = function;
+  ++size_;
+
+  last_entry_ = &entry;
+  return &entry.value;
+}
+
+void InvocationTable::Erase(RetAddr caller, FuncAddr function) {
+  size_t mask = entries_.size() - 1;
+  size_t hole = FindSlot(caller, function);
+  if (entries_[hole].function == NULL)
+    return;
+
+  last_entry_ = NULL;
+  entries_[hole] = Entry();
+  --size_;
+
+  // Shift back the entries that follow the hole in the same cluster, so that
+  // lookups never stop short at the freed slot. An entry can fill the hole
+  // only if its home slot doesn't lie cyclically between the hole and itself.
+  for (size_t slot = (hole + 1) & mask;
+       entries_[slot].function != NULL;
+       slot = (slot + 1) & mask) {
+    size_t home = HomeSlot(entries_[slot].caller, entries_[slot].function);
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      entries_[hole] = entries_[slot];
+      entries_[slot] = Entry();
+      hole = slot;
+    }
+  }
+}
+
+void InvocationTable::Clear() {
+  last_entry_ = NULL;
+  if (size_ == 0)
+    return;
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].function != NULL)
+      entries_[i] = Entry();
+  }
+  size_ = 0;
+}
+
+size_t InvocationTable::HomeSlot(RetAddr caller, FuncAddr function) const {
+  // Code addresses share their high bits and are often aligned, so mix the
+  // bits of both halves of the key before masking.
+  uint32 hash = reinterpret_cast<uint32>(caller) * 0x9E3779B1U;
+  hash ^= reinterpret_cast<uint32>(function) * 0x85EBCA6BU;
+  hash ^= hash >> 15;
+  return hash & (entries_.size() - 1);
+}
+
+size_t InvocationTable::FindSlot(RetAddr caller, FuncAddr function) const {
+  size_t mask = entries_.size() - 1;
+  size_t slot = HomeSlot(caller, function);
+  while (true) {
+    const Entry& entry = entries_[slot];
+    if (entry.function == NULL ||
+        (entry.caller == caller && entry.function == function)) {
+      return slot;
+    }
+    slot = (slot + 1) & mask;
+  }
+}
+
+void InvocationTable::Grow() {
+  std::vector<Entry> old_entries(entries_.size() * 2);
+  old_entries.swap(entries_);
+  last_entry_ = NULL;
+
+  for (size_t i = 0; i < old_entries.size(); ++i) {
+    Entry& old_entry = old_entries[i];
+    if (old_entry.function == NULL)
+      continue;
+
+    Entry& entry = entries_[FindSlot(old_entry.caller, old_entry.function)];
+    DCHECK(entry.function == NULL);
+    entry = old_entry;
+  }
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -0,0 +1,128 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the per-thread table the profiler uses to find the trace buffer
+// entry for a caller/function pair on every function exit.
+
+#ifndef SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
+#define SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/agent/profiler/symbol_map.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace agent {
+namespace profiler {
+
+struct InvocationValue {
+  InvocationValue();
+
+  // This invocation entry's caller's dynamic symbol, if any.
+  scoped_refptr<SymbolMap::Symbol> caller_symbol;
+  // The last observed move count for caller_symbol.
+  int32 caller_move_count;
+
+  // This invocation entry's callee's dynamic symbol, if any.
+  scoped_refptr<SymbolMap::Symbol> function_symbol;
+  // The last observed move count for function_symbol.
+  int32 function_move_count;
+
+  // Points to the trace buffer entry for the respective function.
+  InvocationInfo* info;
+};
+
+// An open-addressed hash table from caller/function pair to invocation value.
+// Keys and values are stored inline in a power-of-two sized array and
+// collisions are resolved by linear probing, so that a lookup usually touches
+// a single cache line. The most recently found or inserted entry is memoized,
+// which makes the lookup trivial for calls in a tight loop.
+// @note This is not thread safe, each thread has its own table.
+class InvocationTable {
+ public:
+  InvocationTable();
+
+  // Finds the value for a caller/function pair.
+  // @param caller the caller.
+  // @param function the function.
+  // @returns the value for the pair, or NULL if it's not in the table. The
+  //     value is valid until the next call to Insert, Erase or Clear.
+  InvocationValue* Find(RetAddr caller, FuncAddr function);
+
+  // Inserts a new caller/function pair in the table.
+  // @param caller the caller.
+  // @param function the function, must not be NULL.
+  // @returns the default-initialized value for the pair. The value is valid
+  //     until the next call to Insert, Erase or Clear.
+  // @pre The pair must not already be in the table.
+  InvocationValue* Insert(RetAddr caller, FuncAddr function);
+
+  // Erases a caller/function pair from the table, if present.
+  // @param caller the caller.
+  // @param function the function.
+  void Erase(RetAddr caller, FuncAddr function);
+
+  // Erases all the entries, but keeps the storage for reuse.
+  void Clear();
+
+  // @returns the number of entries in the table.
+  size_t size() const { return size_; }
+
+  // @returns the number of slots in the table.
+  size_t capacity() const { return entries_.size(); }
+
+  // The initial number of slots in the table, must be a power of two.
+  static const size_t kInitialCapacity = 256;
+
+ protected:
+  struct Entry {
+    Entry() : caller(NULL), function(NULL) {
+    }
+
+    // The key. An entry with a NULL function is free.
+    RetAddr caller;
+    FuncAddr function;
+
+    InvocationValue value;
+  };
+
+  // @returns the slot at which the probe sequence for a key starts.
+  size_t HomeSlot(RetAddr caller, FuncAddr function) const;
+
+  // @returns the slot that holds the key, or the free slot that ends its
+  //     probe sequence.
+  size_t FindSlot(RetAddr caller, FuncAddr function) const;
+
+  // Doubles the number of slots and rehashes the entries.
+  void Grow();
+
+  // The slots, their number is always a power of two.
+  std::vector<Entry> entries_;
+
+  // The number of slots in use.
+  size_t size_;
+
+  // The most recently found or inserted entry, if any.
+  Entry* last_entry_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(InvocationTable);
+};
+
+}  // namespace profiler
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_PROFILER_INVOCATION_TABLE_H_
@@ -0,0 +1,124 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/invocation_table.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+namespace {
+
+class TestInvocationTable : public InvocationTable {
+ public:
+  using InvocationTable::HomeSlot;
+};
+
+const void* ToPtr(intptr_t number) {
+  return reinterpret_cast<const void*>(number);
+}
+
+InvocationInfo* ToInfo(intptr_t number) {
+  return reinterpret_cast<InvocationInfo*>(number);
+}
+
+}  // namespace
+
+TEST(InvocationTableTest, InsertFindErase) {
+  InvocationTable table;
+  EXPECT_EQ(0u, table.size());
+  EXPECT_EQ(InvocationTable::kInitialCapacity, table.capacity());
+  EXPECT_EQ(NULL, table.Find(ToPtr(1), ToPtr(2)));
+
+  InvocationValue* value = table.Insert(ToPtr(1), ToPtr(2));
+  ASSERT_TRUE(value != NULL);
+  EXPECT_EQ(NULL, value->info);
+  EXPECT_EQ(0, value->caller_move_count);
+  EXPECT_EQ(0, value->function_move_count);
+  value->info = ToInfo(12);
+  EXPECT_EQ(1u, table.size());
+
+  table.Insert(ToPtr(2), ToPtr(1))->info = ToInfo(21);
+  EXPECT_EQ(2u, table.size());
+
+  ASSERT_TRUE(table.Find(ToPtr(1), ToPtr(2)) != NULL);
+  EXPECT_EQ(ToInfo(12), table.Find(ToPtr(1), ToPtr(2))->info);
+  ASSERT_TRUE(table.Find(ToPtr(2), ToPtr(1)) != NULL);
+  EXPECT_EQ(ToInfo(21), table.Find(ToPtr(2), ToPtr(1))->info);
+  EXPECT_EQ(NULL, table.Find(ToPtr(1), ToPtr(1)));
+
+  table.Erase(ToPtr(1), ToPtr(2));
+  EXPECT_EQ(1u, table.size());
+  EXPECT_EQ(NULL, table.Find(ToPtr(1), ToPtr(2)));
+  EXPECT_EQ(ToInfo(21), table.Find(ToPtr(2), ToPtr(1))->info);
+
+  // Erasing a missing key is a no-op.
+  table.Erase(ToPtr(1), ToPtr(2));
+  EXPECT_EQ(1u, table.size());
+
+  table.Clear();
+  EXPECT_EQ(0u, table.size());
+  EXPECT_EQ(InvocationTable::kInitialCapacity, table.capacity());
+  EXPECT_EQ(NULL, table.Find(ToPtr(2), ToPtr(1)));
+}
+
+TEST(InvocationTableTest, Grows) {
+  InvocationTable table;
+  const size_t kNumEntries = 4 * InvocationTable::kInitialCapacity;
+  for (size_t i = 0; i < kNumEntries; ++i)
+    table.Insert(ToPtr(i), ToPtr(i + 0x1000))->info = ToInfo(i + 1);
+  EXPECT_EQ(kNumEntries, table.size());
+  EXPECT_LE(2 * kNumEntries, table.capacity());
+
+  for (size_t i = 0; i < kNumEntries; ++i) {
+    InvocationValue* value = table.Find(ToPtr(i), ToPtr(i + 0x1000));
+    ASSERT_TRUE(value != NULL);
+    EXPECT_EQ(ToInfo(i + 1), value->info);
+  }
+}
+
+TEST(InvocationTableTest, EraseKeepsCollidingEntriesReachable) {
+  TestInvocationTable table;
+
+  // Find a set of keys that share the same home slot, so that they form a
+  // single cluster.
+  const void* kFunction = ToPtr(0x1000);
+  const size_t kHome = table.HomeSlot(ToPtr(0), kFunction);
+  std::vector<intptr_t> callers;
+  for (intptr_t caller = 0; callers.size() < 4; ++caller) {
+    if (table.HomeSlot(ToPtr(caller), kFunction) == kHome)
+      callers.push_back(caller);
+  }
+  for (size_t i = 0; i < callers.size(); ++i)
+    table.Insert(ToPtr(callers[i]), kFunction)->info = ToInfo(i + 1);
+
+  // Erase from the head of the cluster, the remaining entries must stay
+  // reachable.
+  for (size_t i = 0; i < callers.size(); ++i) {
+    table.Erase(ToPtr(callers[i]), kFunction);
+    EXPECT_EQ(NULL, table.Find(ToPtr(callers[i]), kFunction));
+    for (size_t j = i + 1; j < callers.size(); ++j) {
+      InvocationValue* value = table.Find(ToPtr(callers[j]), kFunction);
+      ASSERT_TRUE(value != NULL);
+      EXPECT_EQ(ToInfo(j + 1), value->info);
+    }
+  }
+  EXPECT_EQ(0u, table.size());
+}
+
+}  // namespace profiler
+}  // namespace agent
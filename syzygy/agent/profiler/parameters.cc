@@ -0,0 +1,90 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/parameters.h"
+
+#include "base/command_line.h"
+#include "base/environment.h"
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+
+namespace agent {
+namespace profiler {
+
+// The environment variable that is used for extracting parameters.
+const char kParametersEnvVar[] = "SYZYGY_PROFILER_OPTIONS";
+
+// Default parameter values.
+const uint32 kDefaultSamplingInterval = 1;
+
+// The largest accepted sampling interval.
+const uint32 kMaxSamplingInterval = 1 << 20;
+
+// Parameter names for parsing.
+const char kParamSamplingInterval[] = "sampling-interval";
+
+void SetDefaultParameters(Parameters* parameters) {
+  DCHECK(parameters != NULL);
+  parameters->sampling_interval = kDefaultSamplingInterval;
+}
+
+bool ParseParameters(const base::StringPiece& param_string,
+                     Parameters* parameters) {
+  DCHECK(parameters != NULL);
+
+  // Prepends the flags with a dummy executable name to keep the CommandLine
+  // parser happy.
+  std::wstring str = base::UTF8ToWide(param_string);
+  str.insert(0, L" ");
+  str.insert(0, L"dummy.exe");
+  CommandLine cmd_line = CommandLine::FromString(str);
+
+  bool success = true;
+
+  std::string value = cmd_line.GetSwitchValueASCII(kParamSamplingInterval);
+  if (!value.empty()) {
+    unsigned interval = 0;
+    if (!base::StringToUint(value, &interval) || interval == 0 ||
+        interval > kMaxSamplingInterval) {
+      LOG(ERROR) << "Invalid value for --" << kParamSamplingInterval
+                 << ": " << value;
+      success = false;
+    } else {
+      parameters->sampling_interval = interval;
+    }
+  }
+
+  return success;
+}
+
+bool ParseParametersFromEnv(Parameters* parameters) {
+  DCHECK(parameters != NULL);
+
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  DCHECK(env.get() != NULL);
+
+  std::string value;
+  if (!env->GetVar(kParametersEnvVar, &value))
+    return true;
+
+  if (!ParseParameters(value, parameters))
+    return false;
+
+  return true;
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -0,0 +1,65 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares structures and parsing routines for Profiler runtime parameters.
+
+#ifndef SYZYGY_AGENT_PROFILER_PARAMETERS_H_
+#define SYZYGY_AGENT_PROFILER_PARAMETERS_H_
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+namespace agent {
+namespace profiler {
+
+// A structure housing runtime parameters for the profiler agent.
+struct Parameters {
+  // The mean number of function entries per thread between two recorded
+  // invocations. The recorded call counts and cycle sums are scaled by this
+  // value. A value of 1 records every invocation.
+  uint32 sampling_interval;
+};
+
+// The environment variable that is used for extracting parameters.
+extern const char kParametersEnvVar[];
+
+// Default parameter values.
+extern const uint32 kDefaultSamplingInterval;
+
+// The largest accepted sampling interval.
+extern const uint32 kMaxSamplingInterval;
+
+// Parameter names for parsing.
+extern const char kParamSamplingInterval[];
+
+// Initializes a Parameters struct with default values.
+// @param parameters The Parameters struct to be initialized.
+void SetDefaultParameters(Parameters* parameters);
+
+// Parses parameters from a string and updates the provided structure.
+// @param param_string the string of parameters to be parsed.
+// @param parameters The Parameters struct to be updated.
+// @returns true on success, false otherwise. Logs verbosely on failure.
+bool ParseParameters(const base::StringPiece& param_string,
+                     Parameters* parameters);
+
+// Parses parameters from the environment and updates the provided structure.
+// @param parameters The Parameters struct to be updated.
+// @returns true on success, false otherwise. Logs verbosely on failure.
+bool ParseParametersFromEnv(Parameters* parameters);
+
+}  // namespace profiler
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_PROFILER_PARAMETERS_H_
@@ -0,0 +1,89 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/profiler/parameters.h"
+
+#include "base/environment.h"
+#include "base/memory/scoped_ptr.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace profiler {
+
+TEST(ParametersTest, SetDefaults) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
+}
+
+TEST(ParametersTest, ParseInvalidSamplingInterval) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParameters("--sampling-interval=foo", &p));
+  EXPECT_FALSE(ParseParameters("--sampling-interval=0", &p));
+  EXPECT_FALSE(ParseParameters("--sampling-interval=-3", &p));
+  EXPECT_FALSE(ParseParameters("--sampling-interval=1000000000", &p));
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
+}
+
+TEST(ParametersTest, ParseMinimalCommandLine) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParameters("", &p));
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
+}
+
+TEST(ParametersTest, ParseMaximalCommandLine) {
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParameters("--sampling-interval=16", &p));
+  EXPECT_EQ(16u, p.sampling_interval);
+}
+
+TEST(ParametersTest, ParseNoEnvironment) {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  env->UnSetVar(kParametersEnvVar);
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParametersFromEnv(&p));
+  EXPECT_EQ(kDefaultSamplingInterval, p.sampling_interval);
+}
+
+TEST(ParametersTest, ParseInvalidEnvironment) {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  env->SetVar(kParametersEnvVar, "--sampling-interval=0");
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_FALSE(ParseParametersFromEnv(&p));
+  env->UnSetVar(kParametersEnvVar);
+}
+
+TEST(ParametersTest, ParseValidEnvironment) {
+  scoped_ptr<base::Environment> env(base::Environment::Create());
+  ASSERT_TRUE(env.get() != NULL);
+  env->SetVar(kParametersEnvVar, "--sampling-interval=8");
+
+  Parameters p = {};
+  SetDefaultParameters(&p);
+  EXPECT_TRUE(ParseParametersFromEnv(&p));
+  EXPECT_EQ(8u, p.sampling_interval);
+  env->UnSetVar(kParametersEnvVar);
+}
+
+}  // namespace profiler
+}  // namespace agent
@@ -32,6 +32,7 @@
 #include "syzygy/agent/common/dlist.h"
 #include "syzygy/agent/common/process_utils.h"
 #include "syzygy/agent/common/scoped_last_error_keeper.h"
+#include "syzygy/agent/profiler/invocation_table.h"
 #include "syzygy/agent/profiler/return_thunk_factory.h"
 #include "syzygy/common/logging.h"
 #include "syzygy/trace/client/client_utils.h"
@@ -40,44 +41,12 @@
 namespace {
 
 using agent::common::ScopedLastErrorKeeper;
-
-typedef std::pair<RetAddr, FuncAddr> InvocationKey;
-
-class HashInvocationKey {
- public:
-  static const size_t bucket_size = 4;
-  static const size_t min_buckets = 8;
-
-  size_t operator()(const InvocationKey& key) const {
-    return reinterpret_cast<size_t>(key.first) ^
-        reinterpret_cast<size_t>(key.second);
-  }
-
-  bool operator()(const InvocationKey& a, const InvocationKey& b) const {
-    return a < b;
-  }
-};
-
+using agent::profiler::InvocationTable;
+using agent::profiler::InvocationValue;
 using agent::profiler::SymbolMap;
 
-struct InvocationValue {
-  // This invocation entry's caller's dynamic symbol, if any.
-  scoped_refptr<SymbolMap::Symbol> caller_symbol;
-  // The last observed move count for caller_symbol.
-  int32 caller_move_count;
-
-  // This invocation entry's callee's dynamic symbol, if any.
-  scoped_refptr<SymbolMap::Symbol> function_symbol;
-  // The last observed move count for function_symbol.
-  int32 function_move_count;
-
-  // Points to the trace buffer entry for the respective function.
-  InvocationInfo* info;
-};
-
-typedef base::hash_map<
-    InvocationKey, InvocationValue, HashInvocationKey> InvocationMap;
-
+// The number of times the hooks are timed when calibrating their overhead.
+const size_t kCalibrationRounds = 1000;
 
 // The information on how to set the thread name comes from
 // a MSDN article: http://msdn2.microsoft.com/en-us/library/xcb2z8hs.aspx
@@ -231,6 +200,23 @@ extern "C" __declspec(naked) void __cdecl OnDynamicFunctionEntry(
   }
 }
 
+// An empty function, which the profiler invokes through its hooks to
+// calibrate their overhead.
+extern "C" void __declspec(naked) CalibrationFunction() {
+  __asm {
+    ret
+  }
+}
+
+// An entry thunk for CalibrationFunction, like those the instrumenter
+// generates.
+extern "C" void __declspec(naked) CalibrationThunk() {
+  __asm {
+    push CalibrationFunction
+    jmp _indirect_penter
+  }
+}
+
 BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
   using agent::profiler::Profiler;
 
@@ -306,6 +292,11 @@ class Profiler::ThreadState
   // Logs @p symbol into the trace.
   void LogSymbol(SymbolMap::Symbol* symbol);
 
+  // Calibrates the overhead of the hooks on the current processor, unless
+  // another thread already did, and logs it. This is done once per thread,
+  // as soon as the thread has a trace segment.
+  void Calibrate();
+
   // Processes a single function entry.
   void OnFunctionEntry(EntryFrame* entry_frame,
                        FuncAddr function,
@@ -334,6 +325,18 @@ class Profiler::ThreadState
                         FuncAddr function,
                         uint64 cycles);
 
+  // @returns true iff the current function entry should be recorded.
+  bool ShouldSample();
+  // @returns the number of function entries until the next sample.
+  uint32 NextSamplingCountdown();
+
+  // Times empty invocations through the hooks.
+  // @param calibration receives the overhead of the hooks.
+  void MeasureOverhead(TraceProfilerCalibration* calibration);
+
+  // Logs @p calibration into the trace.
+  void LogCalibration(const TraceProfilerCalibration& calibration);
+
   void UpdateOverhead(uint64 entry_cycles);
   InvocationInfo* AllocateInvocationInfo();
   void ClearCache();
@@ -348,8 +351,18 @@ class Profiler::ThreadState
   // measures time exclusive of profiling overhead.
   uint64 cycles_overhead_;
 
+  // In sampling mode only one function entry in sampling_interval_, on
+  // average, is recorded. The recorded call counts and cycle sums are scaled
+  // up accordingly. The interval between samples is randomized to avoid
+  // aliasing with periodic call patterns.
+  uint32 sampling_interval_;
+  // The number of function entries left until the next sample.
+  uint32 calls_until_sample_;
+  // The state of the random generator used to pick the next sample.
+  uint32 sampling_seed_;
+
   // The invocations we've recorded in our buffer.
-  InvocationMap invocations_;
+  InvocationTable invocations_;
 
   // The trace file segment we're recording to.
   trace::client::TraceFileSegment segment_;
@@ -359,16 +372,35 @@ class Profiler::ThreadState
 
   // The set of modules we've logged.
   ModuleSet logged_modules_;
+
+  // True once this thread's hooks are calibrated.
+  bool calibrated_;
+
+  // True while calibrating. The invocations of the calibration function are
+  // then timed into calibration_cycles_, rather than recorded.
+  bool calibrating_;
+  uint64 calibration_cycles_;
 };
 
 Profiler::ThreadState::ThreadState(Profiler* profiler)
     : profiler_(profiler),
       cycles_overhead_(0LL),
-      batch_(NULL) {
+      sampling_interval_(profiler->parameters_.sampling_interval),
+      calls_until_sample_(1),
+      sampling_seed_(::GetCurrentThreadId() | 1),
+      batch_(NULL),
+      calibrated_(false),
+      calibrating_(false),
+      calibration_cycles_(0) {
+  DCHECK_LT(0u, sampling_interval_);
   Initialize();
 }
 
 Profiler::ThreadState::~ThreadState() {
+  VLOG(1) << "Thread used at most "
+          << max_num_pages_in_use() << " of " << num_pages()
+          << " return thunk pages.";
+
   ClearCache();
 
   // If we have an outstanding buffer, let's deallocate it now.
@@ -456,12 +488,35 @@ void Profiler::ThreadState::LogSymbol(SymbolMap::Symbol* symbol) {
                 symbol->name().data(), symbol->name().size() + 1);
 }
 
+void Profiler::ThreadState::Calibrate() {
+  if (calibrated_ || segment_.write_ptr == NULL ||
+      profiler_->session_.IsDisabled()) {
+    return;
+  }
+  calibrated_ = true;
+
+  TraceProfilerCalibration calibration = {};
+  calibration.processor_number = ::GetCurrentProcessorNumber();
+  if (!profiler_->GetCalibration(calibration.processor_number,
+                                 &calibration)) {
+    MeasureOverhead(&calibration);
+    profiler_->AddCalibration(calibration);
+  }
+
+  LogCalibration(calibration);
+}
+
 void Profiler::ThreadState::OnFunctionEntry(EntryFrame* entry_frame,
                                             FuncAddr function,
                                             uint64 cycles) {
   if (profiler_->session_.IsDisabled())
     return;
 
+  if (!ShouldSample()) {
+    UpdateOverhead(cycles);
+    return;
+  }
+
   // Record the details of the entry.
   // Note that on tail-recursion and tail-call elimination, the caller recorded
   // here will be a thunk. We cater for this case on exit as best we can.
@@ -482,6 +537,11 @@ void Profiler::ThreadState::OnV8FunctionEntry(FuncAddr function,
   if (profiler_->session_.IsDisabled())
     return;
 
+  if (!ShouldSample()) {
+    UpdateOverhead(cycles);
+    return;
+  }
+
   // Record the details of the entry.
 
   // TODO(siggi): Note that we want to do different exit processing here,
@@ -506,6 +566,12 @@ void Profiler::ThreadState::OnFunctionExit(const ThunkData* data,
   // Calculate the number of cycles in the invocation, exclusive our overhead.
   uint64 cycles_executed = cycles_exit - cycles_overhead_ - data->cycles_entry;
 
+  if (calibrating_) {
+    calibration_cycles_ = cycles_executed;
+    UpdateOverhead(cycles_exit);
+    return;
+  }
+
   // See if the return address resolves to a thunk, which indicates
   // tail recursion or tail call elimination. In that case we record the
   // calling function as caller, which isn't totally accurate as that'll
@@ -524,6 +590,76 @@ void Profiler::ThreadState::OnFunctionExit(const ThunkData* data,
   UpdateOverhead(cycles_exit);
 }
 
+void Profiler::ThreadState::MeasureOverhead(
+    TraceProfilerCalibration* calibration) {
+  DCHECK(calibration != NULL);
+  DCHECK(!calibrating_);
+
+  // Every calibration invocation must go through the hooks, and none of them
+  // may count against the overhead of the function we may be called from.
+  uint32 sampling_interval = sampling_interval_;
+  uint64 cycles_overhead = cycles_overhead_;
+  sampling_interval_ = 1;
+  calibrating_ = true;
+
+  // The cost of an empty call without the hooks.
+  uint64 min_call_cycles = kuint64max;
+  for (size_t i = 0; i < kCalibrationRounds; ++i) {
+    uint64 start = __rdtsc();
+    CalibrationFunction();
+    min_call_cycles = std::min(min_call_cycles, __rdtsc() - start);
+  }
+
+  // The cost of the same call through the hooks, less what the hooks account
+  // for themselves. The minima are the least disturbed by interrupts.
+  uint64 min_invocation_cycles = kuint64max;
+  uint64 min_hooked_call_cycles = kuint64max;
+  for (size_t i = 0; i < kCalibrationRounds; ++i) {
+    uint64 overhead_before = cycles_overhead_;
+    uint64 start = __rdtsc();
+    CalibrationThunk();
+    uint64 elapsed = __rdtsc() - start;
+    uint64 accounted = cycles_overhead_ - overhead_before;
+
+    min_invocation_cycles = std::min(min_invocation_cycles,
+                                     calibration_cycles_);
+    if (elapsed > accounted)
+      min_hooked_call_cycles = std::min(min_hooked_call_cycles,
+                                        elapsed - accounted);
+  }
+
+  sampling_interval_ = sampling_interval;
+  cycles_overhead_ = cycles_overhead;
+  calibrating_ = false;
+
+  calibration->invocation_overhead_cycles = min_invocation_cycles;
+  calibration->call_overhead_cycles = 0;
+  if (min_hooked_call_cycles != kuint64max &&
+      min_hooked_call_cycles > min_call_cycles) {
+    calibration->call_overhead_cycles =
+        min_hooked_call_cycles - min_call_cycles;
+  }
+  calibration->call_overhead_cycles = std::max(
+      calibration->call_overhead_cycles,
+      calibration->invocation_overhead_cycles);
+}
+
+void Profiler::ThreadState::LogCalibration(
+    const TraceProfilerCalibration& calibration) {
+  if (!segment_.CanAllocate(sizeof(calibration)) && !FlushSegment()) {
+    // Failed to allocate a new segment.
+    return;
+  }
+
+  DCHECK(segment_.CanAllocate(sizeof(calibration)));
+  batch_ = NULL;
+
+  TraceProfilerCalibration* calibration_event =
+      segment_.AllocateTraceRecord<TraceProfilerCalibration>();
+  DCHECK(calibration_event != NULL);
+  *calibration_event = calibration;
+}
+
 void Profiler::ThreadState::OnPageAdded(const void* page) {
   profiler_->OnPageAdded(page);
 }
@@ -536,19 +672,18 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
                                              FuncAddr function,
                                              uint64 duration_cycles) {
   // See whether we've already recorded an entry for this function.
-  InvocationKey key(caller, function);
-  InvocationMap::iterator it = invocations_.find(key);
-  if (it != invocations_.end()) {
+  InvocationValue* existing = invocations_.Find(caller, function);
+  if (existing != NULL) {
     // Yup, we already have an entry, validate it.
-    InvocationValue& value = it->second;
+    InvocationValue& value = *existing;
 
     if ((value.caller_symbol == NULL ||
          value.caller_symbol->move_count() == value.caller_move_count) &&
         (value.function_symbol == NULL ||
          value.function_symbol->move_count() == value.function_move_count)) {
       // The entry is still good, tally the new data.
-      ++(value.info->num_calls);
-      value.info->cycles_sum += duration_cycles;
+      value.info->num_calls += sampling_interval_;
+      value.info->cycles_sum += duration_cycles * sampling_interval_;
       if (duration_cycles < value.info->cycles_min) {
         value.info->cycles_min = duration_cycles;
       } else if (duration_cycles > value.info->cycles_max) {
@@ -561,10 +696,10 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
       // The entry is not valid any more, discard it.
       DCHECK(value.caller_symbol != NULL || value.function_symbol != NULL);
 
-      invocations_.erase(it);
+      invocations_.Erase(caller, function);
     }
   }
-  DCHECK(invocations_.find(key) == invocations_.end());
+  DCHECK(invocations_.Find(caller, function) == NULL);
 
   // We don't have an entry, allocate a new one for this invocation.
   // The code below may touch last error.
@@ -594,7 +729,7 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
 
   InvocationInfo* info = AllocateInvocationInfo();
   if (info != NULL) {
-    InvocationValue& value = invocations_[key];
+    InvocationValue& value = *invocations_.Insert(caller, function);
     value.info = info;
     value.caller_symbol = caller_symbol;
     if (caller_symbol != NULL)
@@ -634,14 +769,40 @@ void Profiler::ThreadState::RecordInvocation(RetAddr caller,
           reinterpret_cast<const uint8*>(caller_symbol->address());
     }
 
-    info->num_calls = 1;
-    info->cycles_min = info->cycles_max = info->cycles_sum = duration_cycles;
+    info->num_calls = sampling_interval_;
+    info->cycles_min = info->cycles_max = duration_cycles;
+    info->cycles_sum = duration_cycles * sampling_interval_;
   }
 }
 
+bool Profiler::ThreadState::ShouldSample() {
+  if (sampling_interval_ == 1)
+    return true;
+
+  DCHECK_LT(0u, calls_until_sample_);
+  if (--calls_until_sample_ != 0)
+    return false;
+
+  calls_until_sample_ = NextSamplingCountdown();
+  return true;
+}
+
+uint32 Profiler::ThreadState::NextSamplingCountdown() {
+  // A xorshift generator is plenty for spreading the samples, and cheap
+  // enough to run on the function entry path.
+  sampling_seed_ ^= sampling_seed_ << 13;
+  sampling_seed_ ^= sampling_seed_ >> 17;
+  sampling_seed_ ^= sampling_seed_ << 5;
+
+  // Pick a countdown in [1, 2 * sampling_interval_ - 1], which averages to
+  // sampling_interval_.
+  return 1 + sampling_seed_ % (2 * sampling_interval_ - 1);
+}
+
 void Profiler::ThreadState::UpdateOverhead(uint64 entry_cycles) {
-  // TODO(siggi): Measure the fixed overhead on setup,
-  //     then add it on every update.
+  // This misses the parts of the hooks that run around the cycle counter
+  // reads. Those are calibrated by MeasureOverhead, and compensated for by
+  // the grinder.
   cycles_overhead_ += (__rdtsc() - entry_cycles);
 }
 
@@ -687,7 +848,7 @@ bool Profiler::ThreadState::FlushSegment() {
 
 void Profiler::ThreadState::ClearCache() {
   batch_ = NULL;
-  invocations_.clear();
+  invocations_.Clear();
 }
 
 void Profiler::OnThreadDetach() {
@@ -697,7 +858,7 @@ void Profiler::OnThreadDetach() {
 }
 
 RetAddr* Profiler::ResolveReturnAddressLocation(RetAddr* pc_location) {
-  base::AutoLock lock(lock_);
+  agent::common::AutoContentionTrackingLock<base::Lock> lock(lock_);
 
   // In case of tail-call and tail recursion elimination, we can get chained
   // thunks, so we loop around here until we resolve to a non-thunk.
@@ -751,7 +912,7 @@ void Profiler::OnModuleEntry(EntryFrame* entry_frame,
   // Make sure we only log each module once per process.
   bool is_new_module = false;
   if (should_log_module) {
-    base::AutoLock lock(lock_);
+    agent::common::AutoContentionTrackingLock<base::Lock> lock(lock_);
 
     is_new_module = logged_modules_.insert(module).second;
   }
@@ -771,7 +932,7 @@ void Profiler::OnModuleEntry(EntryFrame* entry_frame,
 }
 
 void Profiler::OnPageAdded(const void* page) {
-  base::AutoLock lock(lock_);
+  agent::common::AutoContentionTrackingLock<base::Lock> lock(lock_);
 
   PageVector::iterator it =
       std::lower_bound(pages_.begin(), pages_.end(), page);
@@ -780,7 +941,7 @@ void Profiler::OnPageAdded(const void* page) {
 }
 
 void Profiler::OnPageRemoved(const void* page) {
-  base::AutoLock lock(lock_);
+  agent::common::AutoContentionTrackingLock<base::Lock> lock(lock_);
 
   PageVector::iterator it =
       std::lower_bound(pages_.begin(), pages_.end(), page);
@@ -790,6 +951,24 @@ void Profiler::OnPageRemoved(const void* page) {
   pages_.erase(it);
 }
 
+bool Profiler::GetCalibration(uint32 processor_number,
+                              TraceProfilerCalibration* calibration) {
+  DCHECK(calibration != NULL);
+  agent::common::AutoContentionTrackingLock<base::Lock> lock(lock_);
+
+  CalibrationMap::const_iterator it = calibrations_.find(processor_number);
+  if (it == calibrations_.end())
+    return false;
+  *calibration = it->second;
+  return true;
+}
+
+void Profiler::AddCalibration(const TraceProfilerCalibration& calibration) {
+  agent::common::AutoContentionTrackingLock<base::Lock> lock(lock_);
+  calibrations_.insert(
+      std::make_pair(calibration.processor_number, calibration));
+}
+
 void Profiler::OnThreadName(const base::StringPiece& thread_name) {
   ThreadState* state = GetOrAllocateThreadState();
   if (state != NULL)
@@ -832,7 +1011,20 @@ void Profiler::OnDllEvent(agent::common::DllNotificationWatcher::EventType type,
   }
 }
 
-Profiler::Profiler() : handler_registration_(NULL) {
+Profiler::Profiler()
+    : lock_("Profiler::lock_"), handler_registration_(NULL) {
+  // The lock contention records are keyed on stack traces.
+  agent::common::StackCapture::Init();
+
+  // Pick up our parameters before any thread state is created, as the thread
+  // states cache them.
+  SetDefaultParameters(&parameters_);
+  if (!ParseParametersFromEnv(&parameters_)) {
+    LOG(ERROR) << "Failed to parse " << kParametersEnvVar
+               << ", using the defaults.";
+    SetDefaultParameters(&parameters_);
+  }
+
   // Create our RPC session and allocate our initial trace segment on creation,
   // aka at load time.
   ThreadState* data = CreateFirstThreadStateAndSession();
@@ -841,6 +1033,10 @@ Profiler::Profiler() : handler_registration_(NULL) {
   handler_registration_ = ::AddVectoredExceptionHandler(TRUE, ExceptionHandler);
 
   dll_watcher_.Init(base::Bind(&Profiler::OnDllEvent, base::Unretained(this)));
+
+  // The first thread state got its segment with the session, so it
+  // calibrates here rather than on its first segment allocation.
+  data->Calibrate();
 }
 
 Profiler::~Profiler() {
@@ -859,6 +1055,8 @@ Profiler::~Profiler() {
     ::RemoveVectoredExceptionHandler(handler_registration_);
     handler_registration_ = NULL;
   }
+
+  agent::common::LockContentionTable::Instance()->Dump();
 }
 
 Profiler::ThreadState* Profiler::CreateFirstThreadStateAndSession() {
@@ -874,6 +1072,7 @@ Profiler::ThreadState* Profiler::GetOrAllocateThreadState() {
   Profiler::ThreadState* data = GetOrAllocateThreadStateImpl();
   if (!data->segment()->write_ptr && session_.IsTracing()) {
     session_.AllocateBuffer(data->segment());
+    data->Calibrate();
   }
   return data;
 }
@@ -26,15 +26,19 @@
 
 #include <windows.h>
 #include <winnt.h>
+#include <map>
 #include <vector>
 
 #include "base/synchronization/lock.h"
 #include "base/threading/thread_local.h"
 #include "syzygy/agent/common/dll_notifications.h"
 #include "syzygy/agent/common/entry_frame.h"
+#include "syzygy/agent/common/lock_contention.h"
 #include "syzygy/agent/common/thread_state.h"
+#include "syzygy/agent/profiler/parameters.h"
 #include "syzygy/agent/profiler/symbol_map.h"
 #include "syzygy/trace/client/rpc_session.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
 
 // Assembly instrumentation stubs to handle function entry and exit.
 extern "C" void _cdecl _indirect_penter();
@@ -118,6 +122,17 @@ class Profiler {
   void OnPageAdded(const void* page);
   void OnPageRemoved(const void* page);
 
+  // Gets the calibration of the hooks on a processor.
+  // @param processor_number the processor.
+  // @param calibration receives the calibration.
+  // @returns true if the hooks were already calibrated on @p processor_number.
+  bool GetCalibration(uint32 processor_number,
+                      TraceProfilerCalibration* calibration);
+
+  // Remembers the calibration of the hooks on a processor, for the threads
+  // that start on it later.
+  void AddCalibration(const TraceProfilerCalibration& calibration);
+
   // Called on a first chance exception declaring thread name.
   void OnThreadName(const base::StringPiece& thread_name);
 
@@ -140,11 +155,15 @@ class Profiler {
   ThreadState* GetThreadState() const;
   void FreeThreadState();
 
+  // The runtime parameters, parsed from the environment at load time.
+  Parameters parameters_;
+
   // The RPC session we're logging to/through.
   trace::client::RpcSession session_;
 
-  // Protects pages_ and logged_modules_.
-  base::Lock lock_;
+  // Protects pages_, logged_modules_ and calibrations_. Its contention is
+  // dumped to the log when the profiler is torn down.
+  agent::common::ContentionTrackingLock<base::Lock> lock_;
 
   // The dynamic symbol map.
   SymbolMap symbol_map_;
@@ -157,6 +176,10 @@ class Profiler {
   typedef base::hash_set<HMODULE> ModuleSet;
   ModuleSet logged_modules_;  // Under lock_.
 
+  // The calibrations of the hooks, by processor number.
+  typedef std::map<uint32, TraceProfilerCalibration> CalibrationMap;
+  CalibrationMap calibrations_;  // Under lock_.
+
   // A helper to manage the life-cycle of the ThreadState instances allocated
   // by this agent.
   agent::common::ThreadStateManager thread_state_manager_;
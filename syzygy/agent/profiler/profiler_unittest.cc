@@ -80,6 +80,7 @@ using agent::common::GetProcessModules;
 using agent::common::ModuleVector;
 using testing::_;
 using testing::AllOf;
+using testing::AnyNumber;
 using testing::Return;
 using testing::StrictMockParseEventHandler;
 using trace::service::RpcServiceInstanceManager;
@@ -121,6 +122,10 @@ MATCHER_P(ModuleAtAddress, module, "") {
   return arg->module_base_addr == module;
 }
 
+MATCHER(CalibrationIsConsistent, "") {
+  return arg->invocation_overhead_cycles <= arg->call_overhead_cycles;
+}
+
 MATCHER_P2(InvocationInfoHasCallerSymbol, symbol_id, symbol_len, "") {
   for (size_t i = 0; i < 1; ++i) {
     const InvocationInfo& invocation = arg->invocations[i];
@@ -183,6 +188,10 @@ class ProfilerTest : public testing::Test {
     ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
 
     service_.SetEnvironment();
+
+    // Every thread that traces logs the calibration of the hooks.
+    EXPECT_CALL(handler_, OnProfilerCalibration(_, _, _, _))
+        .Times(AnyNumber());
   }
 
   virtual void TearDown() OVERRIDE {
@@ -446,6 +455,26 @@ TEST_F(ProfilerTest, ResolveReturnAddressLocation) {
   ASSERT_NO_FATAL_FAILURE(TestResolutionFuncNestedThunk(resolution_func_));
 }
 
+TEST_F(ProfilerTest, RecordsCalibration) {
+  // Spin up the RPC service.
+  ASSERT_NO_FATAL_FAILURE(StartService());
+
+  // The profiler calibrates its hooks when it's loaded, without recording
+  // any invocation.
+  ASSERT_NO_FATAL_FAILURE(LoadDll());
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+  EXPECT_CALL(handler_, OnProcessStarted(_, ::GetCurrentProcessId(), _));
+  EXPECT_CALL(handler_, OnProfilerCalibration(_,
+                                              ::GetCurrentProcessId(),
+                                              ::GetCurrentThreadId(),
+                                              CalibrationIsConsistent()));
+  EXPECT_CALL(handler_, OnProcessEnded(_, ::GetCurrentProcessId()));
+
+  // Replay the log.
+  ASSERT_NO_FATAL_FAILURE(ReplayLogs());
+}
+
 TEST_F(ProfilerTest, RecordsAllModulesAndFunctions) {
   // Spin up the RPC service.
   ASSERT_NO_FATAL_FAILURE(StartService());
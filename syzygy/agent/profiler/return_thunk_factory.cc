@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/profiler/return_thunk_factory.h"
 
+#include <algorithm>
+#include <xmmintrin.h>
+
 #include "base/logging.h"
 #include "syzygy/assm/assembler.h"
 
@@ -43,7 +46,11 @@ namespace profiler {
 
 ReturnThunkFactoryBase::ReturnThunkFactoryBase(ThunkMainFunc main_func)
     : main_func_(main_func),
-      first_free_thunk_(NULL) {
+      first_free_thunk_(NULL),
+      next_chunk_page_(NULL),
+      chunk_end_(NULL),
+      num_pages_(0),
+      max_num_pages_in_use_(0) {
   DCHECK(main_func_ != NULL);
 }
 
@@ -55,6 +62,7 @@ ReturnThunkFactoryBase::~ReturnThunkFactoryBase() {
 void ReturnThunkFactoryBase::Initialize() {
   DCHECK(first_free_thunk_ == NULL);
   AddPage();
+  max_num_pages_in_use_ = std::max(max_num_pages_in_use_, num_pages_in_use());
 }
 
 void ReturnThunkFactoryBase::Uninitialize() {
@@ -76,10 +84,23 @@ void ReturnThunkFactoryBase::Uninitialize() {
 
     ThunkData* data = DataFromThunk(&page_to_free->thunks[0]);
     delete [] data;
-    ::VirtualFree(page_to_free, 0, MEM_RELEASE);
+
+    // Release the reservation once we're done with its last page. Pages are
+    // handed out in order, so the reservation starts at the page whose
+    // index is a multiple of kNumPagesPerChunk.
+    if (current_page == NULL ||
+        current_page->index % kNumPagesPerChunk == 0) {
+      size_t chunk_offset = page_to_free->index % kNumPagesPerChunk;
+      uint8* chunk = reinterpret_cast<uint8*>(page_to_free) -
+          chunk_offset * kPageSize;
+      ::VirtualFree(chunk, 0, MEM_RELEASE);
+    }
   }
 
   first_free_thunk_ = NULL;
+  next_chunk_page_ = NULL;
+  chunk_end_ = NULL;
+  num_pages_ = 0;
 }
 
 ReturnThunkFactoryBase::ThunkData* ReturnThunkFactoryBase::MakeThunk(
@@ -91,15 +112,33 @@ ReturnThunkFactoryBase::ThunkData* ReturnThunkFactoryBase::MakeThunk(
   Page* current_page = PageFromThunk(first_free_thunk_);
   if (first_free_thunk_ != LastThunk(current_page)) {
     first_free_thunk_++;
-  } else if (current_page->next_page) {
-    first_free_thunk_ = &current_page->next_page->thunks[0];
   } else {
-    AddPage();
+    if (current_page->next_page) {
+      first_free_thunk_ = &current_page->next_page->thunks[0];
+    } else {
+      AddPage();
+    }
+
+    // The stack of thunks grows by a page, update the high-water mark.
+    max_num_pages_in_use_ = std::max(max_num_pages_in_use_,
+                                     num_pages_in_use());
   }
 
+  // The next thunk is likely to be needed soon, as call stacks tend to grow
+  // and shrink repeatedly around their current depth. Get its data on the
+  // way into the cache.
+  _mm_prefetch(reinterpret_cast<const char*>(DataFromThunk(first_free_thunk_)),
+               _MM_HINT_T0);
+
   return data;
 }
 
+size_t ReturnThunkFactoryBase::num_pages_in_use() const {
+  if (first_free_thunk_ == NULL)
+    return 0;
+  return PageFromThunk(first_free_thunk_)->index + 1;
+}
+
 ReturnThunkFactoryBase::Thunk* ReturnThunkFactoryBase::CastToThunk(
     RetAddr ret) {
   Thunk* thunk = const_cast<Thunk*>(reinterpret_cast<const Thunk*>(ret));
@@ -124,12 +163,21 @@ void ReturnThunkFactoryBase::AddPage() {
   Page* previous_page = PageFromThunk(first_free_thunk_);
   DCHECK(previous_page == NULL || previous_page->next_page == NULL);
 
-  // TODO(joi): This may be consuming 64K of memory, in which case it would
-  // be more efficient to reserve a larger block at a time if we think we
-  // normally need more than 4K of thunks.
+  // Reserve a new chunk of address space when the current one is used up.
+  // Reserving whole chunks avoids wasting the rest of the allocation
+  // granularity on each page, and keeps neighbouring pages adjacent.
+  if (next_chunk_page_ == chunk_end_) {
+    next_chunk_page_ = reinterpret_cast<uint8*>(::VirtualAlloc(
+        NULL, kNumPagesPerChunk * kPageSize, MEM_RESERVE,
+        PAGE_EXECUTE_READWRITE));
+    CHECK(next_chunk_page_ != NULL);
+    chunk_end_ = next_chunk_page_ + kNumPagesPerChunk * kPageSize;
+  }
+
   Page* new_page = reinterpret_cast<Page*>(::VirtualAlloc(
-      NULL, kPageSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+      next_chunk_page_, kPageSize, MEM_COMMIT, PAGE_EXECUTE_READWRITE));
   CHECK(new_page != NULL);
+  next_chunk_page_ += kPageSize;
 
   // Allocate the data associated with each thunk.
   ThunkData* data = new ThunkData[kNumThunksPerPage];
@@ -139,6 +187,9 @@ void ReturnThunkFactoryBase::AddPage() {
   new_page->previous_page = previous_page;
   new_page->next_page = NULL;
   new_page->factory = this;
+  new_page->index = num_pages_++;
+  DCHECK(previous_page == NULL ||
+         previous_page->index + 1 == new_page->index);
 
   if (previous_page)
     previous_page->next_page = new_page;
@@ -28,6 +28,10 @@ namespace profiler {
 // in between times, on the assumption that the call stack will grow
 // as deep again as it has before.
 //
+// Pages are carved out of larger contiguous reservations, so that a deep
+// stack of thunks maps to neighbouring pages rather than to a scattering of
+// separate allocations.
+//
 // This class is currently somewhat specific to profiling, as it
 // calls rdtsc in the return hook and stores data needed for profiling,
 // but it could be generalized if needed.
@@ -52,6 +56,16 @@ class ReturnThunkFactoryBase {
   // Returns the thunk data corresponding to a thunk.
   static ThunkData* DataFromThunk(Thunk* thunk);
 
+  // @name Statistics.
+  // @{
+  // @returns the number of pages of thunks allocated.
+  size_t num_pages() const { return num_pages_; }
+  // @returns the number of pages spanned by the thunks currently in use.
+  size_t num_pages_in_use() const;
+  // @returns the largest number of pages ever spanned by the thunks in use.
+  size_t max_num_pages_in_use() const { return max_num_pages_in_use_; }
+  // @}
+
   // The thunk itself is opaque, but must be declared here
   // for the size calculations below.
   struct Thunk {
@@ -114,6 +128,8 @@ class ReturnThunkFactoryBase {
     Page* previous_page;
     Page* next_page;
     ReturnThunkFactoryBase* factory;
+    // The position of this page in the page list, starting from zero.
+    size_t index;
     Thunk thunks[1];  // In fact, as many as fit.
   };
 
@@ -122,6 +138,10 @@ class ReturnThunkFactoryBase {
   static const size_t kNumThunksPerPage =
       (kPageSize - offsetof(Page, thunks)) / sizeof(Thunk);
 
+  // The number of pages reserved at a time. This makes for a reservation the
+  // size of the allocation granularity.
+  static const size_t kNumPagesPerChunk = 16;
+
   void AddPage();
   static Page* PageFromThunk(Thunk* thunk);
   static Thunk* LastThunk(Page* page);
@@ -141,6 +161,14 @@ class ReturnThunkFactoryBase {
   // and pages are linked together, so this is all we need to store.
   Thunk* first_free_thunk_;
 
+  // The next page to commit and the end of the current reservation.
+  uint8* next_chunk_page_;
+  uint8* chunk_end_;
+
+  // Statistics.
+  size_t num_pages_;
+  size_t max_num_pages_in_use_;
+
   DISALLOW_COPY_AND_ASSIGN(ReturnThunkFactoryBase);
 };
 
@@ -44,6 +44,8 @@ class TestFactory : public ReturnThunkFactoryImpl<TestFactory> {
   using ReturnThunkFactoryImpl<TestFactory>::Initialize;
   using ReturnThunkFactoryImpl<TestFactory>::ThunkMain;
   using ReturnThunkFactoryImpl<TestFactory>::kNumThunksPerPage;
+  using ReturnThunkFactoryImpl<TestFactory>::kNumPagesPerChunk;
+  using ReturnThunkFactoryImpl<TestFactory>::kPageSize;
 };
 
 class ReturnThunkTest : public testing::Test {
@@ -224,6 +226,51 @@ TEST_F(ReturnThunkTest, ReusePages) {
   ASSERT_EQ(last_thunk->thunk, new_last_thunk->thunk);
 }
 
+TEST_F(ReturnThunkTest, PageStatistics) {
+  EXPECT_EQ(1u, factory_->num_pages());
+  EXPECT_EQ(1u, factory_->num_pages_in_use());
+  EXPECT_EQ(1u, factory_->max_num_pages_in_use());
+
+  // Grow the stack of thunks to span three pages.
+  const size_t kNumPages = 3;
+  EXPECT_CALL(*factory_, OnPageAdded(_)).Times(kNumPages - 1);
+  ReturnThunkFactoryBase::ThunkData* first_thunk = factory_->MakeThunk(NULL);
+  for (size_t i = 1; i < (kNumPages - 1) * TestFactory::kNumThunksPerPage;
+       ++i) {
+    factory_->MakeThunk(NULL);
+  }
+  EXPECT_EQ(kNumPages, factory_->num_pages());
+  EXPECT_EQ(kNumPages, factory_->num_pages_in_use());
+  EXPECT_EQ(kNumPages, factory_->max_num_pages_in_use());
+
+  // Unwind the whole stack, the pages stay allocated but are no longer in use.
+  EXPECT_CALL(*factory_, OnFunctionExit(_, _));
+  TestFactory::ThunkMain(first_thunk, 0LL);
+  EXPECT_EQ(kNumPages, factory_->num_pages());
+  EXPECT_EQ(1u, factory_->num_pages_in_use());
+  EXPECT_EQ(kNumPages, factory_->max_num_pages_in_use());
+}
+
+TEST_F(ReturnThunkTest, PagesAreContiguousWithinAChunk) {
+  EXPECT_CALL(*factory_, OnPageAdded(_))
+      .Times(TestFactory::kNumPagesPerChunk);
+
+  // Allocate the rest of the first chunk, plus a page in the next one.
+  const uint8* previous_page = NULL;
+  for (size_t i = 0;
+       i < TestFactory::kNumPagesPerChunk * TestFactory::kNumThunksPerPage;
+       ++i) {
+    ReturnThunkFactoryBase::ThunkData* data = factory_->MakeThunk(NULL);
+    const uint8* page =
+        reinterpret_cast<const uint8*>(TestFactory::PageFromThunk(data->thunk));
+    if (previous_page != NULL && page != previous_page) {
+      EXPECT_EQ(previous_page + TestFactory::kPageSize, page);
+    }
+    previous_page = page;
+  }
+  EXPECT_EQ(TestFactory::kNumPagesPerChunk + 1, factory_->num_pages());
+}
+
 TEST_F(ReturnThunkTest, CastToThunk) {
   // Allocate a bunch of thunks.
   ReturnThunkFactoryBase::ThunkData* first_thunk = factory_->MakeThunk(NULL);
@@ -14,12 +14,16 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include "base/threading/platform_thread.h"
+
 namespace agent {
 namespace profiler {
 
 base::subtle::Atomic32 SymbolMap::Symbol::next_symbol_id_ = 0;
 
-SymbolMap::SymbolMap() {
+SymbolMap::SymbolMap() : active_index_(0) {
+  num_readers_[0] = 0;
+  num_readers_[1] = 0;
 }
 
 SymbolMap::~SymbolMap() {
@@ -36,65 +40,153 @@ void SymbolMap::AddSymbol(const void* start_addr,
     return;
 
   Range range(reinterpret_cast<const uint8*>(start_addr), length);
-  RetireRangeUnlocked(range);
 
-  bool inserted = addr_space_.Insert(
-      Range(reinterpret_cast<const uint8*>(start_addr), length), symbol);
-  DCHECK(inserted);
+  size_t index = BeginUpdateUnlocked();
+  AddSymbolUnlocked(&addr_spaces_[index], range, symbol, false);
+  index = PublishUpdateUnlocked(index);
+  AddSymbolUnlocked(&addr_spaces_[index], range, symbol, true);
 }
 
 void SymbolMap::MoveSymbol(const void* old_addr, const void* new_addr) {
   base::AutoLock hold(lock_);
 
+  size_t index = BeginUpdateUnlocked();
+  if (!MoveSymbolUnlocked(&addr_spaces_[index], old_addr, new_addr, false))
+    return;
+  index = PublishUpdateUnlocked(index);
+  bool moved = MoveSymbolUnlocked(&addr_spaces_[index],
+                                  old_addr,
+                                  new_addr,
+                                  true);
+  DCHECK(moved);
+}
+
+scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbol(const void* addr) {
+  size_t index = AcquireReadIndex();
+  const SymbolAddressSpace& addr_space = addr_spaces_[index];
+
+  scoped_refptr<Symbol> symbol;
+  SymbolAddressSpace::RangeMapConstIter found =
+      addr_space.FindFirstIntersection(
+          Range(reinterpret_cast<const uint8*>(addr), 1));
+  if (found != addr_space.end())
+    symbol = found->second;
+
+  ReleaseReadIndex(index);
+  return symbol;
+}
+
+void SymbolMap::AddSymbolUnlocked(SymbolAddressSpace* addr_space,
+                                  const Range& range,
+                                  Symbol* symbol,
+                                  bool update_symbols) {
+  DCHECK(addr_space != NULL);
+  DCHECK(symbol != NULL);
+
+  RetireRangeUnlocked(addr_space, range, update_symbols);
+
+  bool inserted = addr_space->Insert(range, symbol);
+  DCHECK(inserted);
+}
+
+bool SymbolMap::MoveSymbolUnlocked(SymbolAddressSpace* addr_space,
+                                   const void* old_addr,
+                                   const void* new_addr,
+                                   bool update_symbols) {
+  DCHECK(addr_space != NULL);
+
   SymbolAddressSpace::RangeMapIter found =
-      addr_space_.FindFirstIntersection(
+      addr_space->FindFirstIntersection(
           Range(reinterpret_cast<const uint8*>(old_addr), 1));
 
   // If we don't have a record of the original symbol, then we can't move it.
   // This may occur if a symbol provider starts pushing events only after its
   // address space has been stocked.
-  if (found == addr_space_.end() || found->first.start() != old_addr)
-    return;
+  if (found == addr_space->end() || found->first.start() != old_addr)
+    return false;
 
   scoped_refptr<Symbol> symbol = found->second;
 
   // Note the fact that it's been moved.
-  symbol->Move(new_addr);
+  if (update_symbols)
+    symbol->Move(new_addr);
 
   size_t length = found->first.size();
-  addr_space_.Remove(found);
+  addr_space->Remove(found);
 
-  RetireRangeUnlocked(
-      Range(reinterpret_cast<const uint8*>(new_addr), length));
+  Range range(reinterpret_cast<const uint8*>(new_addr), length);
+  RetireRangeUnlocked(addr_space, range, update_symbols);
 
-  bool inserted = addr_space_.Insert(
-      Range(reinterpret_cast<const uint8*>(new_addr), length), symbol);
+  bool inserted = addr_space->Insert(range, symbol);
   DCHECK(inserted);
+
+  return true;
 }
 
-scoped_refptr<SymbolMap::Symbol> SymbolMap::FindSymbol(const void* addr) {
-  base::AutoLock hold(lock_);
+void SymbolMap::RetireRangeUnlocked(SymbolAddressSpace* addr_space,
+                                    const Range& range,
+                                    bool update_symbols) {
+  DCHECK(addr_space != NULL);
+  lock_.AssertAcquired();
 
-  SymbolAddressSpace::RangeMapIter found =
-      addr_space_.FindFirstIntersection(
-          Range(reinterpret_cast<const uint8*>(addr), 1));
+  SymbolAddressSpace::RangeMapIterPair found =
+      addr_space->FindIntersecting(range);
+  if (update_symbols) {
+    SymbolAddressSpace::iterator it = found.first;
+    for (; it != found.second; ++it)
+      it->second->Invalidate();
+  }
+
+  addr_space->Remove(found);
+}
+
+size_t SymbolMap::AcquireReadIndex() {
+  while (true) {
+    base::subtle::Atomic32 index = base::subtle::Acquire_Load(&active_index_);
+    base::subtle::Barrier_AtomicIncrement(&num_readers_[index], 1);
 
-  if (found == addr_space_.end())
-    return NULL;
+    // A writer may have made the other copy active before it saw our count,
+    // in which case it may be about to modify this copy. Back off and retry.
+    if (base::subtle::Acquire_Load(&active_index_) == index)
+      return index;
+
+    base::subtle::Barrier_AtomicIncrement(&num_readers_[index], -1);
+  }
+}
 
-  return found->second;
+void SymbolMap::ReleaseReadIndex(size_t index) {
+  DCHECK_GT(2u, index);
+  base::subtle::Barrier_AtomicIncrement(&num_readers_[index], -1);
 }
 
-void SymbolMap::RetireRangeUnlocked(const Range& range) {
+void SymbolMap::WaitForReadersUnlocked(size_t index) {
+  DCHECK_GT(2u, index);
   lock_.AssertAcquired();
 
-  SymbolAddressSpace::RangeMapIterPair found =
-      addr_space_.FindIntersecting(range);
-  SymbolAddressSpace::iterator it = found.first;
-  for (; it != found.second; ++it)
-    found.first->second->Invalidate();
+  while (base::subtle::Acquire_Load(&num_readers_[index]) != 0)
+    base::PlatformThread::YieldCurrentThread();
+}
+
+size_t SymbolMap::BeginUpdateUnlocked() {
+  lock_.AssertAcquired();
+
+  // Readers that raced the previous update may still be backing out of the
+  // inactive copy.
+  size_t index = 1 - base::subtle::NoBarrier_Load(&active_index_);
+  WaitForReadersUnlocked(index);
+  return index;
+}
+
+size_t SymbolMap::PublishUpdateUnlocked(size_t index) {
+  DCHECK_GT(2u, index);
+  lock_.AssertAcquired();
+
+  base::subtle::Release_Store(&active_index_, index);
+  base::subtle::MemoryBarrier();
 
-  addr_space_.Remove(found);
+  index = 1 - index;
+  WaitForReadersUnlocked(index);
+  return index;
 }
 
 SymbolMap::Symbol::Symbol(const base::StringPiece& name, const void* address)
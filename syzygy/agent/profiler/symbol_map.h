@@ -29,6 +29,11 @@ namespace profiler {
 // resolving addresses of dynamically generated, garbage collected code, to
 // names in a profiler. This is geared to allow entry/exit processing in a
 // profiler to execute as quickly as possible.
+//
+// Lookups never block. The map keeps two copies of its address space: readers
+// use the active copy while a writer updates the other one, makes it active,
+// waits for the readers of the previous copy to drain and then brings that
+// copy up to date. Writers are serialized by a lock.
 class SymbolMap {
  public:
   class Symbol;
@@ -59,11 +64,59 @@ class SymbolMap {
       SymbolAddressSpace;
   typedef SymbolAddressSpace::Range Range;
 
+  // @name Updates of a single copy of the address space.
+  // @param addr_space the copy to update.
+  // @param update_symbols true iff the symbols themselves should be moved or
+  //     invalidated. Each update does this for exactly one of the copies.
+  // @{
+  void AddSymbolUnlocked(SymbolAddressSpace* addr_space,
+                         const Range& range,
+                         Symbol* symbol,
+                         bool update_symbols);
+  // @returns false if there's no symbol starting at @p old_addr.
+  bool MoveSymbolUnlocked(SymbolAddressSpace* addr_space,
+                          const void* old_addr,
+                          const void* new_addr,
+                          bool update_symbols);
   // Retire any symbols overlapping @p range.
-  void RetireRangeUnlocked(const Range& range);
+  void RetireRangeUnlocked(SymbolAddressSpace* addr_space,
+                           const Range& range,
+                           bool update_symbols);
+  // @}
+
+  // @name Reader bookkeeping.
+  // @{
+  // @returns the index of the copy the caller may now read from.
+  size_t AcquireReadIndex();
+  // Signals that the caller is done reading from copy @p index.
+  void ReleaseReadIndex(size_t index);
+  // @}
 
+  // @name Writer bookkeeping, must be called under lock_.
+  // @{
+  // Waits until there are no readers of copy @p index.
+  void WaitForReadersUnlocked(size_t index);
+  // Waits until the inactive copy can be updated.
+  // @returns the index of the inactive copy.
+  size_t BeginUpdateUnlocked();
+  // Makes copy @p index active, then waits until the other copy can be
+  // updated.
+  // @returns the index of the other copy.
+  size_t PublishUpdateUnlocked(size_t index);
+  // @}
+
+  // Serializes the writers.
   base::Lock lock_;
-  SymbolAddressSpace addr_space_;  // Under lock_.
+
+  // The two copies of the address space. Readers may only access the copy
+  // they acquired, writers only modify a copy that has no readers.
+  SymbolAddressSpace addr_spaces_[2];
+
+  // The index of the copy that new readers should use.
+  base::subtle::Atomic32 active_index_;
+
+  // The number of readers of each copy.
+  base::subtle::Atomic32 num_readers_[2];
 
  private:
   DISALLOW_COPY_AND_ASSIGN(SymbolMap);
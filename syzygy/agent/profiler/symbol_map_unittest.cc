@@ -14,6 +14,9 @@
 
 #include "syzygy/agent/profiler/symbol_map.h"
 
+#include <algorithm>
+
+#include "base/threading/simple_thread.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -24,9 +27,43 @@ namespace {
 
 class TestingSymbolMap : public SymbolMap {
  public:
-  // Expose the address space for testing.
-  using SymbolMap::addr_space_;
   typedef SymbolMap::SymbolAddressSpace SymbolAddressSpace;
+
+  // Expose the address spaces for testing.
+  using SymbolMap::active_index_;
+  using SymbolMap::addr_spaces_;
+  using SymbolMap::num_readers_;
+
+  SymbolAddressSpace& addr_space() { return addr_spaces_[active_index_]; }
+
+  // @returns true iff both copies of the address space are identical.
+  bool AddressSpacesMatch() const {
+    const SymbolAddressSpace& a = addr_spaces_[0];
+    const SymbolAddressSpace& b = addr_spaces_[1];
+    if (a.size() != b.size())
+      return false;
+    return std::equal(a.begin(), a.end(), b.begin());
+  }
+};
+
+// Looks up a symbol repeatedly and checks that it's always sane.
+class FindSymbolDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  FindSymbolDelegate(SymbolMap* symbol_map, const void* addr)
+      : symbol_map_(symbol_map), addr_(addr) {
+  }
+
+  virtual void Run() OVERRIDE {
+    for (size_t i = 0; i < 10000; ++i) {
+      scoped_refptr<SymbolMap::Symbol> symbol = symbol_map_->FindSymbol(addr_);
+      if (symbol != NULL)
+        EXPECT_EQ("foo", symbol->name());
+    }
+  }
+
+ private:
+  SymbolMap* symbol_map_;
+  const void* addr_;
 };
 
 const uint8* ToPtr(intptr_t number) {
@@ -46,10 +83,10 @@ TEST_F(SymbolMapTest, AddSymbol) {
   symbol_map_.AddSymbol(kStart, 0x22, "foo");
 
   // Reach into the privates of the symbol map and test it's as we expect.
-  ASSERT_EQ(1, symbol_map_.addr_space_.size());
+  ASSERT_EQ(1, symbol_map_.addr_space().size());
   TestingSymbolMap::SymbolAddressSpace::iterator it =
-      symbol_map_.addr_space_.begin();
-  ASSERT_TRUE(it != symbol_map_.addr_space_.end());
+      symbol_map_.addr_space().begin();
+  ASSERT_TRUE(it != symbol_map_.addr_space().end());
 
   EXPECT_EQ(it->first.start(), kStart);
   EXPECT_EQ(it->first.size(), 0x22);
@@ -95,10 +132,10 @@ TEST_F(SymbolMapTest, AddMoveSymbol) {
   symbol_map_.MoveSymbol(kSrcAddr, kDstAddr);
 
   // Reach into the privates of the symbol map and test it's as we expect.
-  ASSERT_EQ(1, symbol_map_.addr_space_.size());
+  ASSERT_EQ(1, symbol_map_.addr_space().size());
   TestingSymbolMap::SymbolAddressSpace::iterator it =
-      symbol_map_.addr_space_.begin();
-  ASSERT_TRUE(it != symbol_map_.addr_space_.end());
+      symbol_map_.addr_space().begin();
+  ASSERT_TRUE(it != symbol_map_.addr_space().end());
 
   EXPECT_EQ(it->first.start(), kDstAddr);
   EXPECT_EQ(it->first.size(), 0x22);
@@ -113,6 +150,12 @@ TEST_F(SymbolMapTest, AddMoveSymbol) {
 
   // It should have accrued one move.
   EXPECT_EQ(1, symbol->move_count());
+
+  // Both copies of the address space should agree, and there should be no
+  // readers left.
+  EXPECT_TRUE(symbol_map_.AddressSpacesMatch());
+  EXPECT_EQ(0, symbol_map_.num_readers_[0]);
+  EXPECT_EQ(0, symbol_map_.num_readers_[1]);
 }
 
 TEST_F(SymbolMapTest, FindSymbol) {
@@ -173,6 +216,40 @@ TEST_F(SymbolMapTest, SymbolLifeCycle) {
   // Note that invalidating a symbol updates the move count.
   EXPECT_EQ(2, symbol->move_count());
   EXPECT_EQ(ToPtr(NULL), symbol->address());
+  EXPECT_TRUE(symbol_map_.AddressSpacesMatch());
+}
+
+TEST_F(SymbolMapTest, ConcurrentFindAndMove) {
+  const uint8* const kAddr1 = ToPtr(0x1000);
+  const uint8* const kAddr2 = ToPtr(0x2000);
+  symbol_map_.AddSymbol(kAddr1, 0x20, "foo");
+  scoped_refptr<SymbolMap::Symbol> symbol = symbol_map_.FindSymbol(kAddr1);
+  ASSERT_TRUE(symbol != NULL);
+
+  FindSymbolDelegate delegate1(&symbol_map_, kAddr1 + 0x10);
+  FindSymbolDelegate delegate2(&symbol_map_, kAddr2 + 0x10);
+  base::DelegateSimpleThread thread1(&delegate1, "find1");
+  base::DelegateSimpleThread thread2(&delegate2, "find2");
+  thread1.Start();
+  thread2.Start();
+
+  // Bounce the symbol back and forth while the lookups are going on.
+  const int32 kNumMoves = 1000;
+  for (int32 i = 0; i < kNumMoves; ++i) {
+    if (i % 2 == 0)
+      symbol_map_.MoveSymbol(kAddr1, kAddr2);
+    else
+      symbol_map_.MoveSymbol(kAddr2, kAddr1);
+  }
+
+  thread1.Join();
+  thread2.Join();
+
+  EXPECT_EQ(kNumMoves, symbol->move_count());
+  EXPECT_EQ(symbol, symbol_map_.FindSymbol(kAddr1));
+  EXPECT_TRUE(symbol_map_.AddressSpacesMatch());
+  EXPECT_EQ(0, symbol_map_.num_readers_[0]);
+  EXPECT_EQ(0, symbol_map_.num_readers_[1]);
 }
 
 }  // namespace profiler
@@ -17,9 +17,12 @@
 
 #include "syzygy/application/application.h"
 
+#include <algorithm>
+
 #include "base/file_util.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
+#include "base/threading/simple_thread.h"
 
 namespace application {
 
@@ -79,4 +82,112 @@ bool AppImplBase::AppendMatchingPaths(const base::FilePath& pattern,
   return found_a_match;
 }
 
+bool AppImplBase::ParseJobs(const CommandLine* command_line, size_t* jobs) {
+  DCHECK(command_line != NULL);
+  DCHECK(jobs != NULL);
+
+  if (!command_line->HasSwitch("jobs"))
+    return true;
+
+  std::string jobs_str = command_line->GetSwitchValueASCII("jobs");
+  unsigned value = 0;
+  if (!base::StringToUint(jobs_str, &value) || value == 0) {
+    LOG(ERROR) << "Invalid value for --jobs: \"" << jobs_str << "\".";
+    return false;
+  }
+
+  *jobs = value;
+  return true;
+}
+
+size_t AppImplBase::GetProcessorCount() {
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  return std::max<size_t>(system_info.dwNumberOfProcessors, 1);
+}
+
+// Runs the jobs of a pool on a worker thread.
+class JobPool::Worker : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit Worker(JobPool* pool) : pool_(pool) {
+    DCHECK(pool != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    pool_->RunJobs();
+  }
+  // @}
+
+ private:
+  JobPool* pool_;
+
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+JobPool::JobPool(const base::StringPiece& name, size_t jobs)
+    : jobs_(jobs), next_entry_(0), failed_(0) {
+  DCHECK_LT(0U, jobs);
+  name_.assign(name.begin(), name.end());
+}
+
+JobPool::~JobPool() {
+}
+
+void JobPool::AddJob(const Job& job) {
+  DCHECK(!job.is_null());
+  Entry entry;
+  entry.job = job;
+  entries_.push_back(entry);
+}
+
+bool JobPool::Run() {
+  base::subtle::NoBarrier_Store(&next_entry_, 0);
+  base::subtle::NoBarrier_Store(&failed_, 0);
+
+  // There's no point in having more workers than jobs, and no need to spin up
+  // a thread for a single worker.
+  size_t num_workers = std::min(jobs_, entries_.size());
+  if (num_workers <= 1) {
+    RunJobs();
+  } else {
+    Worker worker(this);
+    base::DelegateSimpleThreadPool pool(name_, num_workers);
+    pool.Start();
+    pool.AddWork(&worker, num_workers);
+    pool.JoinAll();
+  }
+
+  if (VLOG_IS_ON(1)) {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      VLOG(1) << name_ << " job " << i << " took "
+              << entries_[i].time.InSecondsF() << " seconds.";
+    }
+  }
+
+  return base::subtle::NoBarrier_Load(&failed_) == 0;
+}
+
+base::TimeDelta JobPool::job_time(size_t index) const {
+  DCHECK_LT(index, entries_.size());
+  return entries_[index].time;
+}
+
+void JobPool::RunJobs() {
+  while (true) {
+    size_t index = static_cast<size_t>(
+        base::subtle::NoBarrier_AtomicIncrement(&next_entry_, 1));
+    if (index > entries_.size())
+      return;
+
+    // Each entry is only ever touched by the worker that took it.
+    Entry& entry = entries_[index - 1];
+    base::Time start = base::Time::Now();
+    if (!entry.job.Run())
+      base::subtle::NoBarrier_Store(&failed_, 1);
+    entry.time = base::Time::Now() - start;
+  }
+}
+
 }  // namespace application
@@ -64,6 +64,9 @@
 //       ASSERT_EQ(0, test_app.Run());
 //     }
 //
+// Applications that can do work on several threads take the number of jobs
+// from the --jobs switch, with AppImplBase::ParseJobs, and run their work on
+// a JobPool.
 
 #ifndef SYZYGY_APPLICATION_APPLICATION_H_
 #define SYZYGY_APPLICATION_APPLICATION_H_
@@ -72,10 +75,13 @@
 #include <vector>
 
 #include "base/at_exit.h"
+#include "base/atomicops.h"
+#include "base/callback.h"
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
+#include "base/time/time.h"
 #include "syzygy/common/com_utils.h"
 
 namespace application {
@@ -143,6 +149,19 @@ class AppImplBase {
   static bool AppendMatchingPaths(const base::FilePath& pattern,
                                   std::vector<base::FilePath>* matches);
 
+  // A helper function to parse the --jobs switch, which is shared by all the
+  // applications that can do work on several threads. The value must be a
+  // positive integer.
+  // @param command_line the command line to parse.
+  // @param jobs receives the number of jobs. This is left unchanged if the
+  //     switch isn't present.
+  // @returns true on success, false if the value of the switch is invalid.
+  static bool ParseJobs(const CommandLine* command_line, size_t* jobs);
+
+  // @returns the number of processors of the machine, which is the default
+  //     number of jobs of the applications whose output doesn't depend on it.
+  static size_t GetProcessorCount();
+
   // A helper function to get a command line parameter that has both a current
   // and a deprecated name.
   template <typename ValueType>
@@ -276,6 +295,78 @@ class ScopedTimeLogger {
   const base::Time start_;
 };
 
+// Runs a set of independent jobs on up to a given number of worker threads.
+// The jobs are handed out in the order in which they were added, each one to
+// the first worker to become idle, so that a long job doesn't hold back the
+// others. The time taken by each job is kept, and logged at the verbose
+// level.
+//
+// Use is as follows:
+//
+//   JobPool pool("MyApp", jobs);
+//   for (size_t i = 0; i < files.size(); ++i)
+//     pool.AddJob(base::Bind(&ProcessFile, files[i]));
+//   if (!pool.Run())
+//     return false;
+class JobPool {
+ public:
+  // A job returns true on success, false otherwise.
+  typedef base::Callback<bool(void)> Job;
+
+  // @param name the name of the pool, used to name its threads.
+  // @param jobs the maximum number of jobs to run at once. This must be
+  //     positive. No thread is created if this is one.
+  JobPool(const base::StringPiece& name, size_t jobs);
+  ~JobPool();
+
+  // Adds a job to the pool. This can't be called while the pool runs.
+  // @param job the job to add.
+  void AddJob(const Job& job);
+
+  // Runs all the jobs that have been added to the pool, and waits for them
+  // to complete. The jobs keep running when one of them fails.
+  // @returns true if all of the jobs succeeded, false otherwise.
+  bool Run();
+
+  // @name Accessors.
+  // @{
+  size_t jobs() const { return jobs_; }
+  size_t job_count() const { return entries_.size(); }
+  // @}
+
+  // @param index the index of a job, in the order in which it was added.
+  // @returns the time taken by the job during the last call to Run.
+  base::TimeDelta job_time(size_t index) const;
+
+ private:
+  class Worker;
+
+  // Runs the jobs that haven't been taken by another worker yet, until there
+  // are none left. This is called on each worker thread.
+  void RunJobs();
+
+  struct Entry {
+    Job job;
+    base::TimeDelta time;
+  };
+
+  // The name of the pool.
+  std::string name_;
+
+  // The maximum number of jobs to run at once.
+  size_t jobs_;
+
+  // The jobs to run.
+  std::vector<Entry> entries_;
+
+  // One past the index of the next entry of entries_ to run, and whether a
+  // job failed. These are shared by the workers.
+  base::subtle::Atomic32 next_entry_;
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobPool);
+};
+
 }  // namespace application
 
 #include "syzygy/application/application_impl.h"
@@ -16,6 +16,7 @@
 
 #include <shellapi.h>
 
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -105,6 +106,12 @@ bool CreateEmptyFile(const base::FilePath& path) {
   return true;
 }
 
+// A job that counts its runs, and returns @p result.
+bool CountingJob(bool result, base::subtle::Atomic32* runs) {
+  base::subtle::NoBarrier_AtomicIncrement(runs, 1);
+  return result;
+}
+
 }  // namespace
 
 TEST_F(ApplicationTest, AppImplBaseDefault) {
@@ -243,4 +250,71 @@ TEST_F(ApplicationTest, GetDeprecatedSwitch) {
   EXPECT_EQ(kBarPath, path);
 }
 
+TEST_F(ApplicationTest, ParseJobs) {
+  size_t jobs = 3;
+  EXPECT_TRUE(TestAppImpl::ParseJobs(&cmd_line_, &jobs));
+  EXPECT_EQ(3U, jobs);
+
+  cmd_line_.AppendSwitchASCII("jobs", "4");
+  EXPECT_TRUE(TestAppImpl::ParseJobs(&cmd_line_, &jobs));
+  EXPECT_EQ(4U, jobs);
+
+  CommandLine zero_jobs(base::FilePath(L"test.exe"));
+  zero_jobs.AppendSwitchASCII("jobs", "0");
+  EXPECT_FALSE(TestAppImpl::ParseJobs(&zero_jobs, &jobs));
+
+  CommandLine invalid_jobs(base::FilePath(L"test.exe"));
+  invalid_jobs.AppendSwitchASCII("jobs", "many");
+  EXPECT_FALSE(TestAppImpl::ParseJobs(&invalid_jobs, &jobs));
+  EXPECT_EQ(4U, jobs);
+
+  EXPECT_LT(0U, TestAppImpl::GetProcessorCount());
+}
+
+TEST_F(ApplicationTest, JobPoolRunsAllJobs) {
+  const size_t kJobCount = 20;
+  base::subtle::Atomic32 runs = 0;
+
+  JobPool pool("Test", 4);
+  EXPECT_EQ(4U, pool.jobs());
+  for (size_t i = 0; i < kJobCount; ++i)
+    pool.AddJob(base::Bind(&CountingJob, true, &runs));
+  EXPECT_EQ(kJobCount, pool.job_count());
+
+  EXPECT_TRUE(pool.Run());
+  EXPECT_EQ(kJobCount, static_cast<size_t>(runs));
+  for (size_t i = 0; i < kJobCount; ++i)
+    EXPECT_LE(0, pool.job_time(i).InMicroseconds());
+
+  // The jobs can be run again.
+  EXPECT_TRUE(pool.Run());
+  EXPECT_EQ(2 * kJobCount, static_cast<size_t>(runs));
+}
+
+TEST_F(ApplicationTest, JobPoolReportsFailure) {
+  base::subtle::Atomic32 runs = 0;
+
+  JobPool pool("Test", 2);
+  pool.AddJob(base::Bind(&CountingJob, true, &runs));
+  pool.AddJob(base::Bind(&CountingJob, false, &runs));
+  pool.AddJob(base::Bind(&CountingJob, true, &runs));
+
+  // The other jobs still run when one of them fails.
+  EXPECT_FALSE(pool.Run());
+  EXPECT_EQ(3, runs);
+}
+
+TEST_F(ApplicationTest, JobPoolWithOneJob) {
+  base::subtle::Atomic32 runs = 0;
+
+  JobPool empty_pool("Test", 1);
+  EXPECT_TRUE(empty_pool.Run());
+
+  JobPool pool("Test", 1);
+  pool.AddJob(base::Bind(&CountingJob, true, &runs));
+  pool.AddJob(base::Bind(&CountingJob, true, &runs));
+  EXPECT_TRUE(pool.Run());
+  EXPECT_EQ(2, runs);
+}
+
 }  // namespace application
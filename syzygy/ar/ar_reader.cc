@@ -93,17 +93,6 @@ bool ParseArFileHeader(const ArFileHeader& header,
   return true;
 }
 
-template<typename Object>
-bool ReadObject(FILE* file, Object* object) {
-  DCHECK_NE(reinterpret_cast<FILE*>(NULL), file);
-  DCHECK_NE(reinterpret_cast<Object*>(NULL), object);
-  if (::fread(object, sizeof(Object), 1, file) != 1) {
-    LOG(ERROR) << "Failed to read from archive.";
-    return false;
-  }
-  return true;
-}
-
 bool ParseSecondarySymbolTable(
     size_t file_size,
     const uint8* data,
@@ -205,27 +194,39 @@ bool ParseSecondarySymbolTable(
 }  // namespace
 
 ArReader::ArReader()
-    : length_(0), offset_(0), index_(0), start_of_object_files_(0) {
+    : memory_mapped_(false), length_(0), offset_(0), index_(0),
+      start_of_object_files_(0) {
 }
 
 bool ArReader::Init(const base::FilePath& ar_path) {
   DCHECK(path_.empty());
 
   path_ = ar_path;
-  file_.reset(base::OpenFile(path_, "rb"));
-  if (file_.get() == NULL) {
-    LOG(ERROR) << "Failed to open file for reading: " << path_.value();
-    return false;
+  if (memory_mapped_) {
+    if (mapped_file_.Initialize(path_)) {
+      length_ = mapped_file_.length();
+    } else {
+      LOG(WARNING) << "Unable to map \"" << path_.value() << "\", reading "
+                   << "it instead.";
+    }
   }
 
-  if (!base::GetFileSize(path_, reinterpret_cast<int64*>(&length_))) {
-    LOG(ERROR) << "Unable to get the archive file size.";
-    return false;
+  if (!IsMapped()) {
+    file_.reset(base::OpenFile(path_, "rb"));
+    if (file_.get() == NULL) {
+      LOG(ERROR) << "Failed to open file for reading: " << path_.value();
+      return false;
+    }
+
+    if (!base::GetFileSize(path_, reinterpret_cast<int64*>(&length_))) {
+      LOG(ERROR) << "Unable to get the archive file size.";
+      return false;
+    }
   }
 
   // Parse the global header.
   ArGlobalHeader global_header = {};
-  if (!ReadObject(file_.get(), &global_header))
+  if (!ReadBytes(&global_header, sizeof(global_header)))
     return false;
   if (::memcmp(global_header.magic,
                kArGlobalMagic,
@@ -325,7 +326,7 @@ bool ArReader::SeekIndex(size_t index) {
   if (offset_ == offset)
     return true;
 
-  if (::fseek(file_.get(), offset, SEEK_SET) != 0) {
+  if (!SeekTo(offset)) {
     LOG(ERROR) << "Failed to seek to archive file " << index
                << " at offset " << offset << ".";
     return false;
@@ -347,6 +348,46 @@ bool ArReader::ExtractNext(ParsedArFileHeader* header,
   DCHECK_LT(index_, offsets_.size());
   DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
 
+  if (!SeekNext())
+    return false;
+
+  if (!ReadNextFile(header, data))
+    return false;
+  ++index_;
+
+  if (!TranslateHeaderFilename(header))
+    return false;
+
+  return true;
+}
+
+bool ArReader::ExtractNextView(ParsedArFileHeader* header,
+                               const uint8** data) {
+  DCHECK_LT(index_, offsets_.size());
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK_NE(reinterpret_cast<const uint8**>(NULL), data);
+
+  if (!IsMapped()) {
+    LOG(ERROR) << "Unable to view the files of an archive that isn't mapped.";
+    return false;
+  }
+
+  if (!SeekNext())
+    return false;
+
+  if (!ReadNextFileView(header, data))
+    return false;
+  ++index_;
+
+  if (!TranslateHeaderFilename(header))
+    return false;
+
+  return true;
+}
+
+bool ArReader::SeekNext() {
+  DCHECK_LT(index_, offsets_.size());
+
   // If all has gone well then the cursor should have been left at the
   // beginning of a valid archive file, or the end of the file.
   if (offset_ < length_) {
@@ -359,7 +400,7 @@ bool ArReader::ExtractNext(ParsedArFileHeader* header,
 
   // Seek to the beginning of the next archive file if we're not already there.
   if (offset_ != offsets_[index_]) {
-    if (::fseek(file_.get(), offsets_[index_], SEEK_SET) != 0) {
+    if (!SeekTo(offsets_[index_])) {
       LOG(ERROR) << "Failed to seek to file " << index_ << ".";
       return false;
     }
@@ -367,9 +408,11 @@ bool ArReader::ExtractNext(ParsedArFileHeader* header,
   }
   DCHECK_LT(offset_, length_);
 
-  if (!ReadNextFile(header, data))
-    return false;
-  ++index_;
+  return true;
+}
+
+bool ArReader::TranslateHeaderFilename(ParsedArFileHeader* header) {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
 
   // Store the actual filename in the header.
   std::string filename;
@@ -389,7 +432,7 @@ bool ArReader::Extract(size_t index,
     return false;
 
   // Seek to the file in question.
-  if (::fseek(file_.get(), offsets_[index], SEEK_SET) != 0) {
+  if (!SeekTo(offsets_[index])) {
     LOG(ERROR) << "Failed to seek to file " << index << ".";
     return false;
   }
@@ -408,7 +451,7 @@ bool ArReader::ReadNextFile(ParsedArFileHeader* header,
 
   // Read and parse the file header.
   ArFileHeader raw_header = {};
-  if (!ReadObject(file_.get(), &raw_header))
+  if (!ReadBytes(&raw_header, sizeof(raw_header)))
     return false;
   if (!ParseArFileHeader(raw_header, header))
     return false;
@@ -422,8 +465,7 @@ bool ArReader::ReadNextFile(ParsedArFileHeader* header,
   if (data != NULL) {
     seek_size = aligned_size - header->size;
     data->resize(header->size);
-    if (::fread(data->data(), 1, header->size, file_.get()) !=
-            header->size) {
+    if (!ReadBytes(data->data(), header->size)) {
       LOG(ERROR) << "Failed to read file \"" << header->name
                  << "\" at offset " << offset_ << " of archive \""
                  << path_.value() << "\".";
@@ -433,7 +475,7 @@ bool ArReader::ReadNextFile(ParsedArFileHeader* header,
   }
 
   // Seek to the beginning of the next file.
-  if (seek_size > 0 && ::fseek(file_.get(), seek_size, SEEK_CUR) != 0) {
+  if (seek_size > 0 && !Skip(seek_size)) {
     LOG(ERROR) << "Failed to seek to next file at offset " << offset_
                << " of archive \"" << path_.value() << "\".";
     return false;
@@ -443,6 +485,66 @@ bool ArReader::ReadNextFile(ParsedArFileHeader* header,
   return true;
 }
 
+bool ArReader::ReadNextFileView(ParsedArFileHeader* header,
+                                const uint8** data) {
+  DCHECK_NE(reinterpret_cast<ParsedArFileHeader*>(NULL), header);
+  DCHECK(data == NULL || IsMapped());
+
+  if (!ReadNextFile(header, NULL))
+    return false;
+
+  // The file contents lie between the header and the cursor, which has been
+  // moved past them and their padding.
+  if (data != NULL) {
+    uint64 aligned_size = common::AlignUp64(header->size, kArFileAlignment);
+    uint64 start = offset_ - aligned_size;
+    if (start > length_ || header->size > length_ - start) {
+      LOG(ERROR) << "File \"" << header->name << "\" at offset " << start
+                 << " of archive \"" << path_.value() << "\" is truncated.";
+      return false;
+    }
+    *data = mapped_file_.data() + start;
+  }
+
+  return true;
+}
+
+bool ArReader::ReadBytes(void* buffer, size_t length) {
+  DCHECK_NE(reinterpret_cast<void*>(NULL), buffer);
+
+  if (IsMapped()) {
+    if (offset_ > length_ || length > length_ - offset_) {
+      LOG(ERROR) << "Failed to read past the end of archive \""
+                 << path_.value() << "\".";
+      return false;
+    }
+    ::memcpy(buffer, mapped_file_.data() + offset_, length);
+    return true;
+  }
+
+  if (::fread(buffer, 1, length, file_.get()) != length) {
+    LOG(ERROR) << "Failed to read from archive.";
+    return false;
+  }
+  return true;
+}
+
+// Like fseek, seeking past the end of a mapped archive succeeds, and the
+// subsequent reads fail.
+bool ArReader::SeekTo(uint64 offset) {
+  if (IsMapped())
+    return true;
+
+  return ::_fseeki64(file_.get(), offset, SEEK_SET) == 0;
+}
+
+bool ArReader::Skip(uint64 length) {
+  if (IsMapped())
+    return true;
+
+  return ::_fseeki64(file_.get(), length, SEEK_CUR) == 0;
+}
+
 bool ArReader::TranslateFilename(const std::string& internal_name,
                                  std::string* full_name) {
   DCHECK_NE(reinterpret_cast<std::string*>(NULL), full_name);
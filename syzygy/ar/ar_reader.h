@@ -84,12 +84,17 @@
 
 #include "base/file_util.h"
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
 
 // Class for extracting files from archive files. This currently does not
 // expose the parsed symbol information in any meaningful way.
+//
+// The archive can optionally be mapped into memory rather than read through a
+// FILE. The contents of its files can then be viewed in place, and are only
+// paged in as they are accessed.
 class ArReader {
  public:
   // Stores the offsets of each file object, by their index.
@@ -104,6 +109,22 @@ class ArReader {
 
   ArReader();
 
+  // Sets whether the archive is mapped into memory, rather than read through a
+  // FILE. If the mapping fails then Init falls back to reading the archive.
+  // This must be called before Init.
+  // @param memory_mapped true to map the archive into memory.
+  void set_memory_mapped(bool memory_mapped) {
+    DCHECK(path_.empty());
+    memory_mapped_ = memory_mapped;
+  }
+
+  // @returns true if the archive is to be mapped into memory by Init.
+  bool memory_mapped() const { return memory_mapped_; }
+
+  // @returns true if the archive has actually been mapped into memory. This
+  //     is only valid after a successful call to Init.
+  bool IsMapped() const { return mapped_file_.IsValid(); }
+
   // Opens the provided file, validating that it is indeed an archive file,
   // parsing its headers and populating symbol and filename information. Logs
   // verbosely on failure.
@@ -155,6 +176,16 @@ class ArReader {
   // @returns true on success, false otherwise.
   bool ExtractNext(ParsedArFileHeader* header, DataBuffer* data);
 
+  // Extracts the next file without copying its contents, and advances the
+  // cursor to the following file in the archive. This is only available when
+  // the archive is mapped into memory.
+  // @param header The header to be populated.
+  // @param data Receives a pointer to the contents of the file, which are
+  //     header->size bytes long. They remain valid for the lifetime of the
+  //     reader.
+  // @returns true on success, false otherwise.
+  bool ExtractNextView(ParsedArFileHeader* header, const uint8** data);
+
   // Extracts the specified file to a buffer. Leaves the cursor pointing
   // at the next file in the archive.
   // @param index The index of the file to be extracted.
@@ -171,13 +202,47 @@ class ArReader {
   // external filename. Doesn't update 'index_'.
   bool ReadNextFile(ParsedArFileHeader* header, DataBuffer* data);
 
+  // Reads the header of the next file from the archive, and gets a view of its
+  // contents if they are requested. Advances the cursor like ReadNextFile.
+  // @param header The header to be populated.
+  // @param data If not NULL, receives a pointer to the contents of the file.
+  //     May only be non-NULL if the archive is mapped.
+  // @returns true on success, false otherwise.
+  bool ReadNextFileView(ParsedArFileHeader* header, const uint8** data);
+
+  // Prepares the cursor for extracting the file at index_, checking that it
+  // lies at a valid file offset.
+  // @returns true on success, false otherwise.
+  bool SeekNext();
+
+  // Translates the internal file name in @p header to its full name.
+  // @param header The header whose name is translated in place.
+  // @returns true on success, false otherwise.
+  bool TranslateHeaderFilename(ParsedArFileHeader* header);
+
+  // @name Low-level access to the archive. These read from the mapping if the
+  //     archive is mapped, and from the FILE otherwise. They don't update
+  //     offset_, which is the responsibility of the caller.
+  // @{
+  // Reads @p length bytes at the cursor into @p buffer.
+  bool ReadBytes(void* buffer, size_t length);
+  // Moves the cursor to the absolute position @p offset.
+  bool SeekTo(uint64 offset);
+  // Moves the cursor forward by @p length bytes.
+  bool Skip(uint64 length);
+  // @}
+
   // Translates an archive internal filename to the full extended filename.
   bool TranslateFilename(const std::string& internal_name,
                          std::string* full_name);
 
-  // The file that is being read.
+  // The file that is being read. Only one of file_ and mapped_file_ is used.
   base::FilePath path_;
   base::ScopedFILE file_;
+  base::MemoryMappedFile mapped_file_;
+
+  // Indicates whether the archive is to be mapped into memory.
+  bool memory_mapped_;
 
   // Data regarding the archive.
   uint64 length_;
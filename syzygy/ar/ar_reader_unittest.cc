@@ -135,6 +135,50 @@ TEST_F(ArReaderTest, InitAndBuildFileIndex) {
   EXPECT_TRUE(reader.HasNext());
 }
 
+TEST_F(ArReaderTest, MemoryMapped) {
+  ArReader file_reader;
+  EXPECT_FALSE(file_reader.memory_mapped());
+  EXPECT_TRUE(file_reader.Init(lib_path_));
+  EXPECT_FALSE(file_reader.IsMapped());
+
+  ArReader mapped_reader;
+  mapped_reader.set_memory_mapped(true);
+  EXPECT_TRUE(mapped_reader.memory_mapped());
+  EXPECT_TRUE(mapped_reader.Init(lib_path_));
+  EXPECT_TRUE(mapped_reader.IsMapped());
+
+  EXPECT_EQ(file_reader.symbols(), mapped_reader.symbols());
+  EXPECT_EQ(file_reader.offsets(), mapped_reader.offsets());
+
+  // Viewing files in place requires a mapping.
+  ParsedArFileHeader file_header;
+  const uint8* view = NULL;
+  EXPECT_FALSE(file_reader.ExtractNextView(&file_header, &view));
+  EXPECT_TRUE(file_reader.SeekIndex(0));
+
+  // Both readers see the same files, whether they are copied or viewed.
+  DataBuffer file_data;
+  ParsedArFileHeader mapped_header;
+  DataBuffer mapped_data;
+  for (size_t i = 0; i < file_reader.offsets().size(); ++i) {
+    EXPECT_TRUE(file_reader.ExtractNext(&file_header, &file_data));
+
+    ASSERT_TRUE(mapped_reader.SeekIndex(i));
+    EXPECT_TRUE(mapped_reader.ExtractNext(&mapped_header, &mapped_data));
+    EXPECT_EQ(file_header.name, mapped_header.name);
+    EXPECT_EQ(file_header.size, mapped_header.size);
+    EXPECT_EQ(file_data, mapped_data);
+
+    ASSERT_TRUE(mapped_reader.SeekIndex(i));
+    EXPECT_TRUE(mapped_reader.ExtractNextView(&mapped_header, &view));
+    EXPECT_EQ(file_header.name, mapped_header.name);
+    ASSERT_EQ(file_data.size(), mapped_header.size);
+    EXPECT_EQ(0, ::memcmp(file_data.data(), view, file_data.size()));
+  }
+  EXPECT_FALSE(file_reader.HasNext());
+  EXPECT_FALSE(mapped_reader.HasNext());
+}
+
 TEST_F(ArReaderTest, NoFilenameTable) {
   base::FilePath lib = testing::GetSrcRelativePath(
       testing::kWeakSymbolArchiveFile);
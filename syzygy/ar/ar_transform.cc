@@ -14,11 +14,15 @@
 
 #include "syzygy/ar/ar_transform.h"
 
+#include <algorithm>
+
+#include "base/atomicops.h"
 #include "base/bind.h"
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/memory/scoped_vector.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/ar/ar_reader.h"
 #include "syzygy/ar/ar_writer.h"
 
@@ -41,12 +45,69 @@ struct FileDeleter {
 
 }  // namespace
 
+struct ArTransform::PendingFile {
+  PendingFile() : remove(false) {
+  }
+
+  ParsedArFileHeader header;
+  scoped_ptr<DataBuffer> contents;
+  bool remove;
+};
+
+// Transforms a batch of files in parallel. Each worker thread takes the next
+// file that hasn't been transformed yet, until they're all done or one of them
+// fails.
+class ArTransform::FileTransformer
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  FileTransformer(const TransformFileCallback& callback,
+                  const std::vector<PendingFile*>& files)
+      : callback_(callback), files_(files), next_file_(0), failed_(0) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    while (base::subtle::NoBarrier_Load(&failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_file_, 1));
+      if (index > files_.size())
+        return;
+
+      PendingFile* file = files_[index - 1];
+      if (!callback_.Run(&file->header, file->contents.get(), &file->remove))
+        base::subtle::NoBarrier_Store(&failed_, 1);
+    }
+  }
+  // @}
+
+  // @returns true iff all the files were transformed successfully.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+ private:
+  const TransformFileCallback& callback_;
+  const std::vector<PendingFile*>& files_;
+
+  // One past the index of the next entry of files_ to transform.
+  base::subtle::Atomic32 next_file_;
+
+  // Set to 1 as soon as a file fails to be transformed.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileTransformer);
+};
+
 bool ArTransform::Transform() {
   DCHECK(!input_archive_.empty());
   DCHECK(!output_archive_.empty());
   DCHECK(!callback_.is_null());
 
+  // The archive is mapped so that its files are copied straight from the
+  // page cache as they are extracted.
   ArReader reader;
+  reader.set_memory_mapped(true);
   if (!reader.Init(input_archive_))
     return false;
   LOG(INFO) << "Read " << reader.symbols().size() << " symbols.";
@@ -54,34 +115,49 @@ bool ArTransform::Transform() {
   // This collection of buffers must outlive the ArWriter below.
   ScopedVector<DataBuffer> buffers;
 
+  // When transforming in parallel the files are extracted a batch at a time,
+  // so that the workers are kept busy without reading the whole archive.
+  size_t file_count = reader.offsets().size();
+  size_t batch_size = 1;
+  if (max_concurrency_ > 1)
+    batch_size = max_concurrency_ * kFilesPerWorker;
+
   // Iterate over the files in the archive.
   ArWriter writer;
-  for (size_t i = 0; i < reader.offsets().size(); ++i) {
-    // Extract the next file.
-    ParsedArFileHeader header;
-    scoped_ptr<DataBuffer> buffer(new DataBuffer());
-    if (!reader.ExtractNext(&header, buffer.get()))
-      return false;
+  for (size_t first = 0; first < file_count; first += batch_size) {
+    // Extract the next batch of files.
+    ScopedVector<PendingFile> files;
+    size_t end = std::min(first + batch_size, file_count);
+    for (size_t i = first; i < end; ++i) {
+      files.push_back(new PendingFile());
+      PendingFile* file = files.back();
+      file->contents.reset(new DataBuffer());
+      if (!reader.ExtractNext(&file->header, file->contents.get()))
+        return false;
 
-    LOG(INFO) << "Processing file " << (i + 1) << " of "
-              << reader.offsets().size() << ": " << header.name;
+      LOG(INFO) << "Processing file " << (i + 1) << " of " << file_count
+                << ": " << file->header.name;
+    }
 
-    // Apply the transform to this file.
-    bool remove = false;
-    if (!callback_.Run(&header, buffer.get(), &remove))
+    // Apply the transform to these files.
+    if (!TransformFiles(files.get()))
       return false;
 
-    if (remove)
-      continue;
+    // Add the transformed files to the output archive, in their original
+    // order.
+    for (size_t i = 0; i < files.size(); ++i) {
+      PendingFile* file = files[i];
+      if (file->remove)
+        continue;
 
-    // Add the transformed file to the output archive.
-    if (!writer.AddFile(header.name, header.timestamp, header.mode,
-                        buffer.get())) {
-      return false;
-    }
+      if (!writer.AddFile(file->header.name, file->header.timestamp,
+                          file->header.mode, file->contents.get())) {
+        return false;
+      }
 
-    // Save the buffer so we keep it around until the writer has finished.
-    buffers.push_back(buffer.release());
+      // Save the buffer so we keep it around until the writer has finished.
+      buffers.push_back(file->contents.release());
+    }
   }
 
   if (!writer.Write(output_archive_))
@@ -91,6 +167,26 @@ bool ArTransform::Transform() {
   return true;
 }
 
+bool ArTransform::TransformFiles(const std::vector<PendingFile*>& files) {
+  size_t num_threads = std::min(max_concurrency_, files.size());
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < files.size(); ++i) {
+      PendingFile* file = files[i];
+      if (!callback_.Run(&file->header, file->contents.get(), &file->remove))
+        return false;
+    }
+    return true;
+  }
+
+  FileTransformer transformer(callback_, files);
+  base::DelegateSimpleThreadPool pool("ArTransform", num_threads);
+  pool.Start();
+  pool.AddWork(&transformer, num_threads);
+  pool.JoinAll();
+
+  return transformer.succeeded();
+}
+
 OnDiskArTransformAdapter::OnDiskArTransformAdapter(
     TransformFileOnDiskCallback inner_callback)
     : inner_callback_(inner_callback),
@@ -109,20 +205,26 @@ OnDiskArTransformAdapter::~OnDiskArTransformAdapter() {
 bool OnDiskArTransformAdapter::Transform(ParsedArFileHeader* header,
                                          DataBuffer* contents,
                                          bool* remove) {
-  if (temp_dir_.empty()) {
-    if (!base::CreateNewTempDirectory(L"OnDiskArTransformAdapter",
-                                           &temp_dir_)) {
-      LOG(ERROR) << "Unable to create temporary directory.";
-      return false;
+  // Create input and output file names. Each invocation gets its own index,
+  // so that concurrent transforms don't clobber each other's files.
+  base::FilePath input_path;
+  base::FilePath output_path;
+  {
+    base::AutoLock auto_lock(lock_);
+    if (temp_dir_.empty()) {
+      if (!base::CreateNewTempDirectory(L"OnDiskArTransformAdapter",
+                                        &temp_dir_)) {
+        LOG(ERROR) << "Unable to create temporary directory.";
+        return false;
+      }
     }
-  }
 
-  // Create input and output file names.
-  base::FilePath input_path = temp_dir_.Append(
-      base::StringPrintf(L"input-%04d.obj", index_));
-  base::FilePath output_path = temp_dir_.Append(
-      base::StringPrintf(L"output-%04d.obj", index_));
-  ++index_;
+    input_path = temp_dir_.Append(
+        base::StringPrintf(L"input-%04d.obj", index_));
+    output_path = temp_dir_.Append(
+        base::StringPrintf(L"output-%04d.obj", index_));
+    ++index_;
+  }
 
   // Set up deleters for these files.
   FileDeleter input_deleter(input_path);
@@ -19,21 +19,30 @@
 #ifndef SYZYGY_AR_AR_TRANSFORM_H_
 #define SYZYGY_AR_AR_TRANSFORM_H_
 
+#include <vector>
+
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/ar/ar_common.h"
 
 namespace ar {
 
 // A class for transforming all of the object files contained in an
-// archive, and repackaging them into an archive.
+// archive, and repackaging them into an archive. The files can be transformed
+// by several threads at once, in which case they are extracted a batch at a
+// time so that only a bounded number of them are held in memory before being
+// transformed. Either way they end up in the output archive in their original
+// order.
 class ArTransform {
  public:
   // The type of callback that will be invoked for each object file
   // in the archive. If this returns true then the transform will
   // continue. If it returns false then the transform will terminate
-  // with an error. Transforms modify the values in place.
+  // with an error. Transforms modify the values in place. If the maximum
+  // concurrency is greater than one the callback is invoked concurrently for
+  // different files, and must be thread safe.
   // |header| The header of the file.
   // |contents| The contents of the file.
   // |remove| If set to true then indicates that the file should be
@@ -44,7 +53,7 @@ class ArTransform {
       TransformFileCallback;
 
   // Constructor.
-  ArTransform() { }
+  ArTransform() : max_concurrency_(1) { }
 
   // Applies the transform. The transform must already have been configured.
   // @returns true on success, false otherwise.
@@ -72,6 +81,16 @@ class ArTransform {
     DCHECK(!callback.is_null());
     callback_ = callback;
   }
+
+  // Sets the maximum number of files that are transformed at once. Defaults to
+  // one, in which case the files are transformed one after the other on the
+  // calling thread.
+  // @param max_concurrency The maximum number of worker threads to use. Must
+  //     be at least one.
+  void set_max_concurrency(size_t max_concurrency) {
+    DCHECK_LT(0u, max_concurrency);
+    max_concurrency_ = max_concurrency;
+  }
   // @}
 
   // @name Accessors.
@@ -84,18 +103,38 @@ class ArTransform {
 
   // @returns the callback.
   TransformFileCallback callback() const { return callback_; }
+
+  // @returns the maximum number of files that are transformed at once.
+  size_t max_concurrency() const { return max_concurrency_; }
   // @}
 
+  // The number of files that are extracted per worker thread when
+  // transforming in parallel.
+  static const size_t kFilesPerWorker = 4;
+
  private:
+  // A file that has been extracted and is waiting to be transformed.
+  struct PendingFile;
+  // The thread pool delegate that transforms a batch of pending files.
+  class FileTransformer;
+
+  // Applies the callback to a batch of files, using up to max_concurrency_
+  // threads.
+  // @param files The files to transform.
+  // @returns true on success, false if the callback failed for any file.
+  bool TransformFiles(const std::vector<PendingFile*>& files);
+
   base::FilePath input_archive_;
   base::FilePath output_archive_;
   TransformFileCallback callback_;
+  size_t max_concurrency_;
 
   DISALLOW_COPY_AND_ASSIGN(ArTransform);
 };
 
 // A callback adapter that allows transforms to modify the files
-// on disk rather than in memory. This is not thread safe.
+// on disk rather than in memory. The outer callback is thread safe as long as
+// the inner callback is, so it may be used with concurrent transforms.
 class OnDiskArTransformAdapter {
  public:
   typedef ArTransform::TransformFileCallback TransformFileCallback;
@@ -146,6 +185,9 @@ class OnDiskArTransformAdapter {
   // Temporary directory where files are produced.
   base::FilePath temp_dir_;
   size_t index_;
+
+  // Protects temp_dir_ and index_.
+  base::Lock lock_;
 };
 
 }  // namespace ar
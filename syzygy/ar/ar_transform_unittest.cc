@@ -15,6 +15,7 @@
 #include "syzygy/ar/ar_transform.h"
 
 #include "base/bind.h"
+#include "base/synchronization/lock.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/ar/ar_reader.h"
@@ -39,7 +40,8 @@ class LenientArTransformTest : public testing::Test {
         on_disk_callback_(base::Bind(
             &LenientArTransformTest::OnDiskCallback,
             base::Unretained(this))),
-        on_disk_adapter_(on_disk_callback_) {
+        on_disk_adapter_(on_disk_callback_),
+        counting_callback_count_(0) {
   }
 
   virtual void SetUp() OVERRIDE {
@@ -77,6 +79,27 @@ class LenientArTransformTest : public testing::Test {
     return true;
   }
 
+  // A thread safe identity transform that counts the files it sees.
+  bool CountingCallback(ParsedArFileHeader* header,
+                        DataBuffer* contents,
+                        bool* remove) {
+    base::AutoLock auto_lock(counting_callback_lock_);
+    ++counting_callback_count_;
+    return true;
+  }
+
+  // Reads all of the files in an archive, in order.
+  void ReadArchive(const base::FilePath& path,
+                   std::vector<ParsedArFileHeader>* headers,
+                   std::vector<DataBuffer>* contents) {
+    ArReader reader;
+    ASSERT_TRUE(reader.Init(path));
+    headers->resize(reader.offsets().size());
+    contents->resize(reader.offsets().size());
+    for (size_t i = 0; i < reader.offsets().size(); ++i)
+      ASSERT_TRUE(reader.ExtractNext(&headers->at(i), &contents->at(i)));
+  }
+
   bool OnDiskCallbackCopyFile(const base::FilePath& input_path,
                               const base::FilePath& output_path,
                               ParsedArFileHeader* header,
@@ -93,6 +116,9 @@ class LenientArTransformTest : public testing::Test {
   ArTransform::TransformFileCallback in_memory_callback_;
   OnDiskArTransformAdapter::TransformFileOnDiskCallback on_disk_callback_;
   OnDiskArTransformAdapter on_disk_adapter_;
+
+  base::Lock counting_callback_lock_;
+  size_t counting_callback_count_;
 };
 typedef testing::StrictMock<LenientArTransformTest> ArTransformTest;
 
@@ -137,6 +163,37 @@ TEST_F(ArTransformTest, TransformIdentityInMemory) {
   EXPECT_EQ(testing::kArchiveFileCount, reader.offsets().size());
 }
 
+TEST_F(ArTransformTest, TransformIdentityInMemoryInParallel) {
+  ArTransform tx;
+  EXPECT_EQ(1u, tx.max_concurrency());
+  tx.set_input_archive(input_archive_);
+  tx.set_output_archive(output_archive_);
+  tx.set_callback(base::Bind(&ArTransformTest::CountingCallback,
+                             base::Unretained(this)));
+  tx.set_max_concurrency(3);
+  EXPECT_EQ(3u, tx.max_concurrency());
+
+  EXPECT_TRUE(tx.Transform());
+  EXPECT_EQ(testing::kArchiveFileCount, counting_callback_count_);
+
+  // The files must come out in their original order, untouched.
+  std::vector<ParsedArFileHeader> input_headers;
+  std::vector<DataBuffer> input_contents;
+  ASSERT_NO_FATAL_FAILURE(
+      ReadArchive(input_archive_, &input_headers, &input_contents));
+  std::vector<ParsedArFileHeader> output_headers;
+  std::vector<DataBuffer> output_contents;
+  ASSERT_NO_FATAL_FAILURE(
+      ReadArchive(output_archive_, &output_headers, &output_contents));
+
+  ASSERT_EQ(testing::kArchiveFileCount, output_headers.size());
+  ASSERT_EQ(input_headers.size(), output_headers.size());
+  for (size_t i = 0; i < input_headers.size(); ++i) {
+    EXPECT_EQ(input_headers[i].name, output_headers[i].name);
+    EXPECT_EQ(input_contents[i], output_contents[i]);
+  }
+}
+
 TEST_F(ArTransformTest, TransformFailsOnDiskCallbackFails) {
     ArTransform tx;
   tx.set_input_archive(input_archive_);
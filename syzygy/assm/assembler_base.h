@@ -72,6 +72,16 @@ class AssemblerBase {
   void set_location(uint32 location) { location_ = location; }
   // @}
 
+  // @name x64 mode.
+  // When set, instructions are assembled for 64-bit mode: memory operands
+  // use 64-bit registers, and displacement-only operands are encoded as
+  // absolute addresses. Use Operand::RipRelative for RIP-relative addressing.
+  // Defaults to false.
+  // @{
+  bool x64() const { return x64_; }
+  void set_x64(bool x64) { x64_ = x64; }
+  // @}
+
   // Emits one or more NOP instructions, their total length being @p size
   // bytes.
   // @param size The number of bytes of NOPs to generate.
@@ -218,6 +228,28 @@ class AssemblerBase {
   //     on @p src during execution.
   void xchg(const Register32& dst, const Operand& src);
 
+  // @name Quad-word instructions.
+  // These are only valid in x64 mode.
+  // @{
+  void mov(const Register64& dst, const Register64& src);
+  void mov(const Register64& dst, const Operand& src);
+  void mov(const Operand& dst, const Register64& src);
+  // Moves a sign-extended 32-bit immediate.
+  void mov(const Register64& dst, const Immediate& src);
+
+  void lea(const Register64& dst, const Operand& src);
+
+  void push(const Register64& src);
+  void pop(const Register64& dst);
+
+  void cmp(const Register64& dst, const Register64& src);
+  void cmp(const Register64& dst, const Immediate& src);
+  void add(const Register64& dst, const Register64& src);
+  void add(const Register64& dst, const Immediate& src);
+  void sub(const Register64& dst, const Register64& src);
+  void sub(const Register64& dst, const Immediate& src);
+  // @}
+
   // @name Aliases
   // @{
   void loop(const Immediate& dst) { l(kLoopOnCounter, dst); }
@@ -256,6 +288,9 @@ class AssemblerBase {
 
   // The delegate we push instructions at.
   InstructionSerializer* serializer_;
+
+  // True when assembling x64 code.
+  bool x64_;
 };
 
 }  // namespace assm
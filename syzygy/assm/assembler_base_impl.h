@@ -48,6 +48,16 @@ class AssemblerBase<ReferenceType>::InstructionBuffer {
   // Emits operand size prefix (0x66) bytes.
   // @param count The number of operand size prefix bytes to emit.
   void EmitOperandSizePrefix(size_t count);
+  // Emits the FS segment prefix.
+  void EmitFsSegmentPrefix();
+  // Emits a REX prefix, if any of its bits are needed. This must directly
+  // precede the opcode. The REX.X and REX.B bits needed by memory operands
+  // are added by EmitOperand.
+  // @param wide true to select a 64-bit operand size.
+  // @param reg the register in the ModR/M reg field, or kRegisterNone.
+  // @param rm the register in the ModR/M r/m field or in the opcode, or
+  //     kRegisterNone.
+  void EmitRexPrefix(bool wide, RegisterId reg, RegisterId rm);
   // Emit an opcode byte.
   void EmitOpCodeByte(uint8 opcode);
   // Emit a ModR/M byte with an opcode extension.
@@ -69,6 +79,11 @@ class AssemblerBase<ReferenceType>::InstructionBuffer {
   // Emit a 32-bit displacement with optional reference info.
   void Emit32BitDisplacement(const Displacement& disp);
 
+  // Emit a 32-bit RIP-relative displacement with optional reference info.
+  // The value is made relative to the end of the instruction once it's
+  // complete.
+  void EmitRipRelativeDisplacement(const Displacement& disp);
+
   // Emit a 32-bit immediate with optional reference info.
   void Emit32BitImmediate(const Immediate& disp);
 
@@ -91,6 +106,9 @@ class AssemblerBase<ReferenceType>::InstructionBuffer {
   void EmitArithmeticInstructionToRegister32(uint8 op_eax, uint8 op_8,
       uint8 op_32, uint8 sub_op, const Register32& dst,
       const Immediate& src);
+  void EmitArithmeticInstructionToRegister64(uint8 op_rax, uint8 op_8,
+      uint8 op_32, uint8 sub_op, const Register64& dst,
+      const Immediate& src);
   void EmitArithmeticInstructionToRegister8(uint8 op_eax, uint8 op_8,
       uint8 sub_op, const Register8& dst, const Immediate& src);
   void EmitArithmeticInstructionToOperand(uint8 op_8, uint8 op_32,
@@ -107,11 +125,24 @@ class AssemblerBase<ReferenceType>::InstructionBuffer {
  protected:
   void EmitByte(uint8 byte);
 
+  // Used for the offsets below when there's nothing at that offset.
+  static const size_t kNoOffset = static_cast<size_t>(-1);
+
   AssemblerBase* asm_;
   size_t num_reference_infos_;
   ReferenceInfo reference_infos_[2];
   size_t len_;
   uint8 buf_[kMaxInstructionLength];
+
+  // The offset of the opcode, and of the REX prefix, if any.
+  size_t opcode_offset_;
+  size_t rex_offset_;
+
+  // The offset and the absolute target of a RIP-relative displacement, if
+  // any, and whether it carries a reference.
+  size_t rip_offset_;
+  uint32 rip_target_;
+  bool rip_reference_;
 };
 
 namespace details {
@@ -134,12 +165,16 @@ template <class ReferenceType>
 bool IsDisplacementOnly(const OperandBase<ReferenceType>& operand) {
   return operand.displacement().size() != kSizeNone &&
       operand.base() == kRegisterNone &&
-      operand.index() == kRegisterNone;
+      operand.index() == kRegisterNone &&
+      !operand.rip_relative();
 }
 
 template <class ReferenceType>
 AssemblerBase<ReferenceType>::InstructionBuffer::InstructionBuffer(
-    AssemblerBase* assm) : asm_(assm), len_(0), num_reference_infos_(0) {
+    AssemblerBase* assm)
+        : asm_(assm), len_(0), num_reference_infos_(0),
+          opcode_offset_(kNoOffset), rex_offset_(kNoOffset),
+          rip_offset_(kNoOffset), rip_target_(0), rip_reference_(false) {
   DCHECK(assm != NULL);
 #ifndef NDEBUG
   // Initialize the buffer in debug mode for easier debugging.
@@ -149,6 +184,13 @@ AssemblerBase<ReferenceType>::InstructionBuffer::InstructionBuffer(
 
 template <class ReferenceType>
 AssemblerBase<ReferenceType>::InstructionBuffer::~InstructionBuffer() {
+  if (rip_offset_ != kNoOffset) {
+    // A referenced RIP-relative displacement must end the instruction, as
+    // PC-relative references are relative to their own end.
+    DCHECK(!rip_reference_ || rip_offset_ + sizeof(uint32) == len_);
+    uint32 relative_value = rip_target_ - (asm_->location() + len_);
+    ::memcpy(buf_ + rip_offset_, &relative_value, sizeof(relative_value));
+  }
   asm_->Output(*this);
 }
 
@@ -159,9 +201,38 @@ void AssemblerBase<ReferenceType>::InstructionBuffer::EmitOperandSizePrefix(
     EmitByte(kOperandSizePrefix);
 }
 
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::InstructionBuffer::EmitFsSegmentPrefix() {
+  DCHECK_EQ(kNoOffset, opcode_offset_);
+  EmitByte(kFsSegmentPrefix);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::InstructionBuffer::EmitRexPrefix(
+    bool wide, RegisterId reg, RegisterId rm) {
+  DCHECK(asm_->x64());
+  DCHECK_EQ(kNoOffset, opcode_offset_);
+  DCHECK_EQ(kNoOffset, rex_offset_);
+
+  uint8 rex = 0;
+  if (wide)
+    rex |= kRexW;
+  if (reg != kRegisterNone && Register::IsExtended(reg))
+    rex |= kRexR;
+  if (rm != kRegisterNone && Register::IsExtended(rm))
+    rex |= kRexB;
+  if (rex == 0)
+    return;
+
+  rex_offset_ = len_;
+  EmitByte(kRexPrefix | rex);
+}
+
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::InstructionBuffer::EmitOpCodeByte(
     uint8 opcode) {
+  if (opcode_offset_ == kNoOffset)
+    opcode_offset_ = len_;
   EmitByte(opcode);
 }
 
@@ -194,6 +265,43 @@ template <class ReferenceType>
 void AssemblerBase<ReferenceType>::InstructionBuffer::EmitOperand(
     uint8 reg_op, const Operand& op) {
   DCHECK_GE(8, reg_op);
+  DCHECK_NE(kNoOffset, opcode_offset_);
+
+  // In x64 mode the operand registers are 64-bit, and may need extension
+  // bits in a REX prefix. That is inserted before the opcode if the
+  // instruction didn't already emit one.
+  uint8 rex = 0;
+  if (op.base() != kRegisterNone) {
+    DCHECK_EQ(asm_->x64(), op.base() >= kRegister64Min);
+    if (Register::IsExtended(op.base()))
+      rex |= kRexB;
+  }
+  if (op.index() != kRegisterNone) {
+    DCHECK_EQ(asm_->x64(), op.index() >= kRegister64Min);
+    if (Register::IsExtended(op.index()))
+      rex |= kRexX;
+  }
+  if (rex != 0) {
+    if (rex_offset_ == kNoOffset) {
+      DCHECK_GT(sizeof(buf_), len_);
+      DCHECK_EQ(0U, num_reference_infos_);
+      ::memmove(buf_ + opcode_offset_ + 1, buf_ + opcode_offset_,
+                len_ - opcode_offset_);
+      buf_[opcode_offset_] = kRexPrefix;
+      rex_offset_ = opcode_offset_;
+      ++opcode_offset_;
+      ++len_;
+    }
+    buf_[rex_offset_] |= rex;
+  }
+
+  if (op.rip_relative()) {
+    // The [rip+disp32] mode is encoded as [disp32] is in 32-bit mode.
+    DCHECK(asm_->x64());
+    EmitModRMByte(kReg1Ind, reg_op, kRegisterEbp);
+    EmitRipRelativeDisplacement(op.displacement());
+    return;
+  }
 
   // The op operand can encode any one of the following things:
   // An indirect register access [EAX].
@@ -210,8 +318,12 @@ void AssemblerBase<ReferenceType>::InstructionBuffer::EmitOperand(
   // See e.g. http://ref.x86asm.net/geek32-abc.html#modrm_byte_32 for a nice
   // overview table of the ModR/M byte encoding.
 
-  // ESP can never be used as an index register on X86.
-  DCHECK_NE(kRegisterEsp, op.index());
+  // ESP can never be used as an index register on X86. Note that the
+  // special cases below compare register codes, as RSP and R12 share the
+  // code of ESP, and RBP and R13 share the code of EBP.
+  DCHECK(op.index() == kRegisterNone ||
+         Register::Code(op.index()) != kRegisterCode100 ||
+         Register::IsExtended(op.index()));
 
   // Is there an index register?
   if (op.index() == kRegisterNone) {
@@ -223,12 +335,19 @@ void AssemblerBase<ReferenceType>::InstructionBuffer::EmitOperand(
       DCHECK_NE(kSizeNone, op.displacement().size());
       DCHECK_EQ(kTimes1, op.scale());
 
-      // The [disp32] mode is encoded by overloading [EBP].
-      EmitModRMByte(kReg1Ind, reg_op, kRegisterEbp);
+      if (asm_->x64()) {
+        // In x64 mode [EBP] is overloaded for [rip+disp32], and [disp32] is
+        // encoded with a SIB byte having neither index nor base.
+        EmitModRMByte(kReg1Ind, reg_op, kRegisterEsp);
+        EmitScaleIndexBaseByte(kTimes1, kRegisterEsp, kRegisterEbp);
+      } else {
+        // The [disp32] mode is encoded by overloading [EBP].
+        EmitModRMByte(kReg1Ind, reg_op, kRegisterEbp);
+      }
       Emit32BitDisplacement(op.displacement());
     } else {
       // Base register only, is it ESP?
-      if (op.base() == kRegisterEsp) {
+      if (Register::Code(op.base()) == kRegisterCode100) {
         // The [ESP] and [ESP+disp] cases cannot be encoded without a SIB byte.
         if (op.displacement().size() == kSizeNone) {
           EmitModRMByte(kReg1Ind, reg_op, kRegisterEsp);
@@ -244,7 +363,7 @@ void AssemblerBase<ReferenceType>::InstructionBuffer::EmitOperand(
           Emit32BitDisplacement(op.displacement());
         }
       } else if (op.displacement().size() == kSizeNone) {
-        if (op.base() == kRegisterEbp) {
+        if (Register::Code(op.base()) == kRegisterCode101) {
           // The [EBP] case cannot be encoded canonically, there always must
           // be a (zero) displacement.
           EmitModRMByte(kReg1ByteDisp, reg_op, op.base());
@@ -327,6 +446,25 @@ void AssemblerBase<ReferenceType>::InstructionBuffer::Emit32BitDisplacement(
   EmitByte(value >> 24);
 }
 
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::InstructionBuffer::
+EmitRipRelativeDisplacement(const Displacement& disp) {
+  DCHECK_EQ(kSize32Bit, disp.size());
+  DCHECK_EQ(kNoOffset, rip_offset_);
+
+  rip_reference_ = details::IsValidReference(disp.reference());
+  AddReference(disp.reference(), kSize32Bit, true);
+
+  // The value is written by the destructor, once the length of the
+  // instruction is known.
+  rip_offset_ = len_;
+  rip_target_ = disp.value();
+  EmitByte(0);
+  EmitByte(0);
+  EmitByte(0);
+  EmitByte(0);
+}
+
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::InstructionBuffer::Emit32BitImmediate(
     const Immediate& imm) {
@@ -422,6 +560,27 @@ EmitArithmeticInstructionToRegister32(
   }
 }
 
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::InstructionBuffer::
+EmitArithmeticInstructionToRegister64(
+    uint8 op_rax, uint8 op_8, uint8 op_32, uint8 sub_op,
+    const Register64& dst, const Immediate& src) {
+  // The immediates are sign-extended to 64 bits.
+  if (dst.id() == kRegisterRax && src.size() == kSize32Bit) {
+    // Special encoding for RAX.
+    EmitOpCodeByte(op_rax);
+    Emit32BitImmediate(src);
+  } else if (src.size() == kSize8Bit) {
+    EmitOpCodeByte(op_8);
+    EmitModRMByte(kReg1, sub_op, dst.id());
+    Emit8BitImmediate(src);
+  } else {
+    EmitOpCodeByte(op_32);
+    EmitModRMByte(kReg1, sub_op, dst.id());
+    Emit32BitImmediate(src);
+  }
+}
+
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::InstructionBuffer::
 EmitArithmeticInstructionToRegister8(
@@ -507,7 +666,7 @@ void AssemblerBase<ReferenceType>::InstructionBuffer::EmitByte(uint8 byte) {
 template <class ReferenceType>
 AssemblerBase<ReferenceType>::AssemblerBase(
     uint32 location, InstructionSerializer* serializer) :
-        location_(location), serializer_(serializer) {
+        location_(location), serializer_(serializer), x64_(false) {
   DCHECK(serializer != NULL);
 }
 
@@ -790,8 +949,9 @@ void AssemblerBase<ReferenceType>::mov(const Register32& dst,
                                        const Operand& src) {
   InstructionBuffer instr(this);
 
-  if (dst.id() == kRegisterEax && IsDisplacementOnly(src)) {
-    // Special encoding for indirect displacement only to EAX.
+  if (dst.id() == kRegisterEax && IsDisplacementOnly(src) && !x64_) {
+    // Special encoding for indirect displacement only to EAX. In x64 mode
+    // this takes a 64-bit displacement, so it isn't used.
     instr.EmitOpCodeByte(0xA1);
     instr.Emit32BitDisplacement(src.displacement());
   } else {
@@ -805,8 +965,9 @@ void AssemblerBase<ReferenceType>::mov(const Operand& dst,
                                        const Register32& src) {
   InstructionBuffer instr(this);
 
-  if (src.id() == kRegisterEax && IsDisplacementOnly(dst)) {
-    // Special encoding for indirect displacement only from EAX.
+  if (src.id() == kRegisterEax && IsDisplacementOnly(dst) && !x64_) {
+    // Special encoding for indirect displacement only from EAX. In x64 mode
+    // this takes a 64-bit displacement, so it isn't used.
     instr.EmitOpCodeByte(0xA3);
     instr.Emit32BitDisplacement(dst.displacement());
   } else {
@@ -839,10 +1000,11 @@ template <class ReferenceType>
 void AssemblerBase<ReferenceType>::mov_fs(const Register32& dst,
                                           const Operand& src) {
   InstructionBuffer instr(this);
-  instr.EmitOpCodeByte(kFsSegmentPrefix);
+  instr.EmitFsSegmentPrefix();
 
-  if (dst.id() == kRegisterEax && IsDisplacementOnly(src)) {
-    // Special encoding for indirect displacement only to EAX.
+  if (dst.id() == kRegisterEax && IsDisplacementOnly(src) && !x64_) {
+    // Special encoding for indirect displacement only to EAX. In x64 mode
+    // this takes a 64-bit displacement, so it isn't used.
     instr.EmitOpCodeByte(0xA1);
     instr.Emit32BitDisplacement(src.displacement());
   } else {
@@ -855,10 +1017,11 @@ template <class ReferenceType>
 void AssemblerBase<ReferenceType>::mov_fs(const Operand& dst,
                                           const Register32& src) {
   InstructionBuffer instr(this);
-  instr.EmitOpCodeByte(kFsSegmentPrefix);
+  instr.EmitFsSegmentPrefix();
 
-  if (src.id() == kRegisterEax && IsDisplacementOnly(dst)) {
-    // Special encoding for indirect displacement only from EAX.
+  if (src.id() == kRegisterEax && IsDisplacementOnly(dst) && !x64_) {
+    // Special encoding for indirect displacement only from EAX. In x64 mode
+    // this takes a 64-bit displacement, so it isn't used.
     instr.EmitOpCodeByte(0xA3);
     instr.Emit32BitDisplacement(dst.displacement());
   } else {
@@ -878,6 +1041,7 @@ void AssemblerBase<ReferenceType>::lea(const Register32& dst,
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::push(const Register32& src) {
+  DCHECK(!x64_);
   InstructionBuffer instr(this);
 
   instr.EmitOpCodeByte(0x50 | src.code());
@@ -902,6 +1066,7 @@ void AssemblerBase<ReferenceType>::push(const Operand& dst) {
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::pushad() {
+  DCHECK(!x64_);
   InstructionBuffer instr(this);
 
   instr.EmitOpCodeByte(0x60);
@@ -909,6 +1074,7 @@ void AssemblerBase<ReferenceType>::pushad() {
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::pop(const Register32& src) {
+  DCHECK(!x64_);
   InstructionBuffer instr(this);
 
   instr.EmitOpCodeByte(0x58 | src.code());
@@ -924,6 +1090,7 @@ void AssemblerBase<ReferenceType>::pop(const Operand& dst) {
 
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::popad() {
+  DCHECK(!x64_);
   InstructionBuffer instr(this);
 
   instr.EmitOpCodeByte(0x61);
@@ -1216,6 +1383,137 @@ void AssemblerBase<ReferenceType>::xchg(const Register32& dst,
   instr.EmitOperand(dst.code(), src);
 }
 
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::mov(const Register64& dst,
+                                       const Register64& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+
+  instr.EmitRexPrefix(true, dst.id(), src.id());
+  instr.EmitOpCodeByte(0x8B);
+  instr.EmitModRMByte(kReg1, dst.id(), src.id());
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::mov(const Register64& dst,
+                                       const Operand& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+
+  instr.EmitRexPrefix(true, dst.id(), kRegisterNone);
+  instr.EmitOpCodeByte(0x8B);
+  instr.EmitOperand(dst.code(), src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::mov(const Operand& dst,
+                                       const Register64& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+
+  instr.EmitRexPrefix(true, src.id(), kRegisterNone);
+  instr.EmitOpCodeByte(0x89);
+  instr.EmitOperand(src.code(), dst);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::mov(const Register64& dst,
+                                       const Immediate& src) {
+  DCHECK(x64_);
+  DCHECK_EQ(kSize32Bit, src.size());
+  InstructionBuffer instr(this);
+
+  instr.EmitRexPrefix(true, kRegisterNone, dst.id());
+  instr.EmitOpCodeByte(0xC7);
+  instr.EmitModRMByte(kReg1, 0, dst.id());
+  instr.Emit32BitImmediate(src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::lea(const Register64& dst,
+                                       const Operand& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+
+  instr.EmitRexPrefix(true, dst.id(), kRegisterNone);
+  instr.EmitOpCodeByte(0x8D);
+  instr.EmitOperand(dst.code(), src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::push(const Register64& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+
+  // The operand size defaults to 64 bits, there's no need for REX.W.
+  instr.EmitRexPrefix(false, kRegisterNone, src.id());
+  instr.EmitOpCodeByte(0x50 | src.code());
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::pop(const Register64& dst) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+
+  // The operand size defaults to 64 bits, there's no need for REX.W.
+  instr.EmitRexPrefix(false, kRegisterNone, dst.id());
+  instr.EmitOpCodeByte(0x58 | dst.code());
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::cmp(const Register64& dst,
+                                       const Register64& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+  instr.EmitRexPrefix(true, dst.id(), src.id());
+  instr.EmitArithmeticInstruction(0x3B, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::cmp(const Register64& dst,
+                                       const Immediate& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+  instr.EmitRexPrefix(true, kRegisterNone, dst.id());
+  instr.EmitArithmeticInstructionToRegister64(0x3D, 0x83, 0x81, 7, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::add(const Register64& dst,
+                                       const Register64& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+  instr.EmitRexPrefix(true, dst.id(), src.id());
+  instr.EmitArithmeticInstruction(0x03, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::add(const Register64& dst,
+                                       const Immediate& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+  instr.EmitRexPrefix(true, kRegisterNone, dst.id());
+  instr.EmitArithmeticInstructionToRegister64(0x05, 0x83, 0x81, 0, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sub(const Register64& dst,
+                                       const Register64& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+  instr.EmitRexPrefix(true, dst.id(), src.id());
+  instr.EmitArithmeticInstruction(0x2B, dst, src);
+}
+
+template <class ReferenceType>
+void AssemblerBase<ReferenceType>::sub(const Register64& dst,
+                                       const Immediate& src) {
+  DCHECK(x64_);
+  InstructionBuffer instr(this);
+  instr.EmitRexPrefix(true, kRegisterNone, dst.id());
+  instr.EmitArithmeticInstructionToRegister64(0x2D, 0x83, 0x81, 5, dst, src);
+}
+
 template <class ReferenceType>
 void AssemblerBase<ReferenceType>::nop1(size_t prefix_count) {
   InstructionBuffer instr(this);
@@ -1535,4 +1535,96 @@ TEST_F(AssemblerTest, References) {
   EXPECT_EQ(&ref4, serializer_.references[3].ref);
 }
 
+TEST_F(AssemblerTest, X64MovRegisterToRegister) {
+  asm_.set_x64(true);
+
+  asm_.mov(rax, rcx);
+  EXPECT_BYTES(0x48, 0x8B, 0xC1);
+  asm_.mov(r8, rax);
+  EXPECT_BYTES(0x4C, 0x8B, 0xC0);
+  asm_.mov(rdx, r15);
+  EXPECT_BYTES(0x49, 0x8B, 0xD7);
+  asm_.mov(r9, r10);
+  EXPECT_BYTES(0x4D, 0x8B, 0xCA);
+}
+
+TEST_F(AssemblerTest, X64MovOperand) {
+  asm_.set_x64(true);
+
+  asm_.mov(rax, Operand(rbx));
+  EXPECT_BYTES(0x48, 0x8B, 0x03);
+  // R13 has the code of RBP, and needs a zero displacement.
+  asm_.mov(rax, Operand(r13));
+  EXPECT_BYTES(0x49, 0x8B, 0x45, 0x00);
+  // R12 has the code of RSP, and needs a SIB byte.
+  asm_.mov(rcx, Operand(r12, Displacement(0x10, kSize8Bit)));
+  EXPECT_BYTES(0x49, 0x8B, 0x4C, 0x24, 0x10);
+  asm_.mov(Operand(rsp, Displacement(0x08, kSize8Bit)), rdx);
+  EXPECT_BYTES(0x48, 0x89, 0x54, 0x24, 0x08);
+  asm_.mov(rax, Operand(rbx, r12, kTimes4));
+  EXPECT_BYTES(0x4A, 0x8B, 0x04, 0xA3);
+  asm_.mov(Operand(r8, rcx, kTimes8, Displacement(0x100, kSize32Bit)), r11);
+  EXPECT_BYTES(0x4D, 0x89, 0x9C, 0xC8, 0x00, 0x01, 0x00, 0x00);
+
+  // Displacement-only operands need a SIB byte, as [disp32] is RIP-relative.
+  asm_.mov(rax, Operand(Displacement(0xCAFEBABE, kSize32Bit)));
+  EXPECT_BYTES(0x48, 0x8B, 0x04, 0x25, 0xBE, 0xBA, 0xFE, 0xCA);
+}
+
+TEST_F(AssemblerTest, X64MovImmediate) {
+  asm_.set_x64(true);
+
+  asm_.mov(rcx, Immediate(0x12345678, kSize32Bit));
+  EXPECT_BYTES(0x48, 0xC7, 0xC1, 0x78, 0x56, 0x34, 0x12);
+  asm_.mov(r14, Immediate(0x12345678, kSize32Bit));
+  EXPECT_BYTES(0x49, 0xC7, 0xC6, 0x78, 0x56, 0x34, 0x12);
+}
+
+TEST_F(AssemblerTest, X64PushPop) {
+  asm_.set_x64(true);
+
+  asm_.push(rax);
+  EXPECT_BYTES(0x50);
+  asm_.push(r12);
+  EXPECT_BYTES(0x41, 0x54);
+  asm_.pop(rbp);
+  EXPECT_BYTES(0x5D);
+  asm_.pop(r15);
+  EXPECT_BYTES(0x41, 0x5F);
+}
+
+TEST_F(AssemblerTest, X64Arithmetic) {
+  asm_.set_x64(true);
+
+  asm_.add(rsp, Immediate(0x08, kSize8Bit));
+  EXPECT_BYTES(0x48, 0x83, 0xC4, 0x08);
+  asm_.sub(rax, Immediate(0x100, kSize32Bit));
+  EXPECT_BYTES(0x48, 0x2D, 0x00, 0x01, 0x00, 0x00);
+  asm_.sub(r10, Immediate(0x100, kSize32Bit));
+  EXPECT_BYTES(0x49, 0x81, 0xEA, 0x00, 0x01, 0x00, 0x00);
+  asm_.cmp(r9, r10);
+  EXPECT_BYTES(0x4D, 0x3B, 0xCA);
+  asm_.add(rax, rbx);
+  EXPECT_BYTES(0x48, 0x03, 0xC3);
+}
+
+TEST_F(AssemblerTest, X64RipRelative) {
+  asm_.set_x64(true);
+  asm_.set_location(0x1000);
+
+  // The displacement is relative to the end of the 7-byte instruction.
+  static const int ref = 1;
+  asm_.lea(rax, Operand::RipRelative(
+      Displacement(0x2000, kSize32Bit, &ref)));
+  EXPECT_BYTES(0x48, 0x8D, 0x05, 0xF9, 0x0F, 0x00, 0x00);
+
+  ASSERT_EQ(1U, serializer_.references.size());
+  EXPECT_EQ(3U, serializer_.references[0].location);
+  EXPECT_EQ(&ref, serializer_.references[0].ref);
+
+  // Extended registers are encoded in a REX prefix.
+  asm_.mov(r8, Operand::RipRelative(Displacement(0x1000, kSize32Bit)));
+  EXPECT_BYTES(0x4C, 0x8B, 0x05, 0xF2, 0xFF, 0xFF, 0xFF);
+}
+
 }  // namespace assm
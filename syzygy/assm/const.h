@@ -33,6 +33,14 @@ const uint8 kTwoByteOpCodePrefix = 0x0F;
 const uint8 kFsSegmentPrefix = 0x64;
 // Prefix group 3 (operand size override).
 const uint8 kOperandSizePrefix = 0x66;
+// The REX prefix of x64 instructions, and its bits. REX.W selects a 64-bit
+// operand size, and REX.R, REX.X and REX.B extend the ModR/M reg field, the
+// SIB index field and the ModR/M r/m or SIB base field respectively.
+const uint8 kRexPrefix = 0x40;
+const uint8 kRexW = 0x08;
+const uint8 kRexR = 0x04;
+const uint8 kRexX = 0x02;
+const uint8 kRexB = 0x01;
 
 // Some opcodes that are used repeatedly.
 const uint8 kNopOpCode = 0x1F;
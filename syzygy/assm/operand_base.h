@@ -67,6 +67,30 @@ class OperandBase {
               ScaleFactor scale,
               const DisplacementBase& displ);
 
+  // @name 64-bit addressing modes.
+  // These are the same as the above, and are only valid when assembling x64
+  // code.
+  // @{
+  explicit OperandBase(const Register64& base);
+  OperandBase(const Register64& base, const DisplacementBase& displ);
+  OperandBase(const Register64& base,
+              const Register64& index,
+              ScaleFactor scale,
+              const DisplacementBase& displ);
+  OperandBase(const Register64& base,
+              const Register64& index,
+              ScaleFactor scale);
+  OperandBase(const Register64& index,
+              ScaleFactor scale,
+              const DisplacementBase& displ);
+  // @}
+
+  // The [rip + disp32] mode. This is only valid when assembling x64 code.
+  // @param displ the 32-bit displacement. Its value is the absolute target
+  //     location, which is made relative to the end of the instruction when
+  //     it is assembled. Its reference, if any, is PC-relative.
+  static OperandBase RipRelative(const DisplacementBase& displ);
+
   // Low-level constructor, none of the parameters are checked.
   OperandBase(RegisterId base,
               RegisterId index,
@@ -79,6 +103,7 @@ class OperandBase {
   RegisterId index() const { return index_; }
   ScaleFactor scale() const { return scale_; }
   const DisplacementBase& displacement() const { return displacement_; }
+  bool rip_relative() const { return rip_relative_; }
   // @}
 
  private:
@@ -90,13 +115,16 @@ class OperandBase {
   ScaleFactor scale_;
   // The displacement, if any.
   DisplacementBase displacement_;
+  // True for the [rip + disp32] mode.
+  bool rip_relative_;
 };
 
 template <class ReferenceType>
 OperandBase<ReferenceType>::OperandBase(const Register32& base)
     : base_(base.id()),
       index_(kRegisterNone),
-      scale_(kTimes1) {
+      scale_(kTimes1),
+      rip_relative_(false) {
 }
 
 template <class ReferenceType>
@@ -105,7 +133,8 @@ OperandBase<ReferenceType>::OperandBase(
         base_(base.id()),
         index_(kRegisterNone),
         scale_(kTimes1),
-        displacement_(displacement) {
+        displacement_(displacement),
+        rip_relative_(false) {
   // There must be a base register.
   DCHECK_NE(kRegisterNone, base_);
 }
@@ -115,7 +144,8 @@ OperandBase<ReferenceType>::OperandBase(const DisplacementBase& displacement) :
     base_(kRegisterNone),
     index_(kRegisterNone),
     scale_(kTimes1),
-    displacement_(displacement) {
+    displacement_(displacement),
+    rip_relative_(false) {
   DCHECK_NE(kSizeNone, displacement.size());
 }
 
@@ -126,7 +156,8 @@ OperandBase<ReferenceType>::OperandBase(
         base_(base.id()),
         index_(index.id()),
         scale_(scale),
-        displacement_(displacement) {
+        displacement_(displacement),
+        rip_relative_(false) {
   // ESP cannot be used as an index register.
   DCHECK_NE(kRegisterEsp, index.id());
   DCHECK_NE(kSizeNone, displacement.size());
@@ -135,7 +166,8 @@ OperandBase<ReferenceType>::OperandBase(
 template <class ReferenceType>
 OperandBase<ReferenceType>::OperandBase(
     const Register32& base, const Register32& index, ScaleFactor scale) :
-        base_(base.id()), index_(index.id()), scale_(scale) {
+        base_(base.id()), index_(index.id()), scale_(scale),
+        rip_relative_(false) {
   // ESP cannot be used as an index register.
   DCHECK_NE(kRegisterEsp, index.id());
   DCHECK_EQ(kSizeNone, displacement_.size());
@@ -146,7 +178,7 @@ OperandBase<ReferenceType>::OperandBase(
     const Register32& index, ScaleFactor scale,
     const DisplacementBase& displacement) :
         base_(kRegisterNone), index_(index.id()), scale_(scale),
-        displacement_(displacement) {
+        displacement_(displacement), rip_relative_(false) {
   // ESP cannot be used as an index register.
   DCHECK_NE(kRegisterEsp, index.id());
   DCHECK_NE(kSizeNone, displacement.size());
@@ -157,7 +189,69 @@ OperandBase<ReferenceType>::OperandBase(
     RegisterId base, RegisterId index, ScaleFactor scale,
     const DisplacementBase& displacement) :
         base_(base), index_(index), scale_(scale),
-        displacement_(displacement) {
+        displacement_(displacement), rip_relative_(false) {
+}
+
+template <class ReferenceType>
+OperandBase<ReferenceType>::OperandBase(const Register64& base)
+    : base_(base.id()),
+      index_(kRegisterNone),
+      scale_(kTimes1),
+      rip_relative_(false) {
+}
+
+template <class ReferenceType>
+OperandBase<ReferenceType>::OperandBase(
+    const Register64& base, const DisplacementBase& displacement) :
+        base_(base.id()),
+        index_(kRegisterNone),
+        scale_(kTimes1),
+        displacement_(displacement),
+        rip_relative_(false) {
+}
+
+template <class ReferenceType>
+OperandBase<ReferenceType>::OperandBase(
+    const Register64& base, const Register64& index,
+    ScaleFactor scale, const DisplacementBase& displacement) :
+        base_(base.id()),
+        index_(index.id()),
+        scale_(scale),
+        displacement_(displacement),
+        rip_relative_(false) {
+  // RSP cannot be used as an index register.
+  DCHECK_NE(kRegisterRsp, index.id());
+  DCHECK_NE(kSizeNone, displacement.size());
+}
+
+template <class ReferenceType>
+OperandBase<ReferenceType>::OperandBase(
+    const Register64& base, const Register64& index, ScaleFactor scale) :
+        base_(base.id()), index_(index.id()), scale_(scale),
+        rip_relative_(false) {
+  // RSP cannot be used as an index register.
+  DCHECK_NE(kRegisterRsp, index.id());
+  DCHECK_EQ(kSizeNone, displacement_.size());
+}
+
+template <class ReferenceType>
+OperandBase<ReferenceType>::OperandBase(
+    const Register64& index, ScaleFactor scale,
+    const DisplacementBase& displacement) :
+        base_(kRegisterNone), index_(index.id()), scale_(scale),
+        displacement_(displacement), rip_relative_(false) {
+  // RSP cannot be used as an index register.
+  DCHECK_NE(kRegisterRsp, index.id());
+  DCHECK_NE(kSizeNone, displacement.size());
+}
+
+template <class ReferenceType>
+OperandBase<ReferenceType> OperandBase<ReferenceType>::RipRelative(
+    const DisplacementBase& displacement) {
+  DCHECK_EQ(kSize32Bit, displacement.size());
+  OperandBase operand(kRegisterNone, kRegisterNone, kTimes1, displacement);
+  operand.rip_relative_ = true;
+  return operand;
 }
 
 }  // namespace assm
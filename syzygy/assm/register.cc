@@ -22,6 +22,7 @@ class RegisterBuilder {
   static const Register8 Create8(RegisterId id) { return Register8(id); }
   static const Register16 Create16(RegisterId id) { return Register16(id); }
   static const Register32 Create32(RegisterId id) { return Register32(id); }
+  static const Register64 Create64(RegisterId id) { return Register64(id); }
 };
 
 // An array of all registers.
@@ -57,6 +58,26 @@ const Register kRegisters[kRegisterCount] = {
     RegisterBuilder::Create32(kRegisterEdi)
 };
 
+// An array of the 64-bit registers.
+const Register64 kRegisters64[kRegister64Count] = {
+    RegisterBuilder::Create64(kRegisterRax),
+    RegisterBuilder::Create64(kRegisterRcx),
+    RegisterBuilder::Create64(kRegisterRdx),
+    RegisterBuilder::Create64(kRegisterRbx),
+    RegisterBuilder::Create64(kRegisterRsp),
+    RegisterBuilder::Create64(kRegisterRbp),
+    RegisterBuilder::Create64(kRegisterRsi),
+    RegisterBuilder::Create64(kRegisterRdi),
+    RegisterBuilder::Create64(kRegisterR8),
+    RegisterBuilder::Create64(kRegisterR9),
+    RegisterBuilder::Create64(kRegisterR10),
+    RegisterBuilder::Create64(kRegisterR11),
+    RegisterBuilder::Create64(kRegisterR12),
+    RegisterBuilder::Create64(kRegisterR13),
+    RegisterBuilder::Create64(kRegisterR14),
+    RegisterBuilder::Create64(kRegisterR15)
+};
+
 // Slices into the array of all registers, by register size.
 typedef const Register8 (&Register8Array)[kRegister8Count];
 Register8Array kRegisters8 =
@@ -98,7 +119,28 @@ const Register32& ebp = kRegisters32[5];
 const Register32& esi = kRegisters32[6];
 const Register32& edi = kRegisters32[7];
 
+const Register64& rax = kRegisters64[0];
+const Register64& rcx = kRegisters64[1];
+const Register64& rdx = kRegisters64[2];
+const Register64& rbx = kRegisters64[3];
+const Register64& rsp = kRegisters64[4];
+const Register64& rbp = kRegisters64[5];
+const Register64& rsi = kRegisters64[6];
+const Register64& rdi = kRegisters64[7];
+const Register64& r8 = kRegisters64[8];
+const Register64& r9 = kRegisters64[9];
+const Register64& r10 = kRegisters64[10];
+const Register64& r11 = kRegisters64[11];
+const Register64& r12 = kRegisters64[12];
+const Register64& r13 = kRegisters64[13];
+const Register64& r14 = kRegisters64[14];
+const Register64& r15 = kRegisters64[15];
+
 const Register& Register::Get(RegisterId id) {
+  if (id >= kRegister64Min) {
+    DCHECK_GT(kRegister64Max, id);
+    return kRegisters64[id - kRegister64Min];
+  }
   DCHECK_LE(kRegisterMin, id);
   DCHECK_GT(kRegisterMax, id);
   return kRegisters[id];
@@ -119,4 +161,9 @@ const Register32& CastAsRegister32(const Register& reg) {
   return reinterpret_cast<const Register32&>(reg);
 }
 
+const Register64& CastAsRegister64(const Register& reg) {
+  DCHECK_EQ(kSize64Bit, reg.size());
+  return reinterpret_cast<const Register64&>(reg);
+}
+
 }  // namespace assm
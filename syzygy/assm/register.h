@@ -29,6 +29,7 @@ static const size_t kRegister8Count = kRegister8Max - kRegister8Min;
 static const size_t kRegister16Count = kRegister16Max - kRegister16Min;
 static const size_t kRegister32Count = kRegister32Max - kRegister32Min;
 static const size_t kRegisterCount = kRegisterMax - kRegisterMin;
+static const size_t kRegister64Count = kRegister64Max - kRegister64Min;
 
 // An array of all registers, sorted by their RegisterId.
 extern const Register kRegisters[kRegisterCount];
@@ -39,6 +40,10 @@ extern const Register8 (&kRegisters8)[kRegister8Count];
 extern const Register16 (&kRegisters16)[kRegister16Count];
 extern const Register32 (&kRegisters32)[kRegister32Count];
 
+// An array of the 64-bit registers, sorted by their RegisterId. These are
+// only valid when assembling x64 code.
+extern const Register64 kRegisters64[kRegister64Count];
+
 // Convenience constants for the 8-bit x86 registers.
 extern const Register8& al;
 extern const Register8& cl;
@@ -69,12 +74,31 @@ extern const Register32& ebp;
 extern const Register32& esi;
 extern const Register32& edi;
 
+// Convenience constants for the 64-bit x64 registers.
+extern const Register64& rax;
+extern const Register64& rcx;
+extern const Register64& rdx;
+extern const Register64& rbx;
+extern const Register64& rsp;
+extern const Register64& rbp;
+extern const Register64& rsi;
+extern const Register64& rdi;
+extern const Register64& r8;
+extern const Register64& r9;
+extern const Register64& r10;
+extern const Register64& r11;
+extern const Register64& r12;
+extern const Register64& r13;
+extern const Register64& r14;
+extern const Register64& r15;
+
 // Utility functions for casting between registers at differing precisions. This
 // is only safe to call if the object is of the requested derived type.
 // @returns true if the conversion is possible, false otherwise.
 const Register8& CastAsRegister8(const Register& reg);
 const Register16& CastAsRegister16(const Register& reg);
 const Register32& CastAsRegister32(const Register& reg);
+const Register64& CastAsRegister64(const Register& reg);
 
 }  // namespace assm
 
@@ -17,8 +17,9 @@
 // with the X86 assembly utilities declared in assembler.h, and are of no real
 // use on their own.
 //
-// The design of the register class has been crafted to allow easy extension
-// for X86-64 registers if the time comes.
+// The 64-bit registers are only valid when assembling x64 code. They are kept
+// out of the [kRegisterMin, kRegisterMax) range, which the analyses iterate
+// over.
 //
 // For converting between Syzygy registers and Distorm RegisterType refer to the
 // utilities in disassembler_util.
@@ -38,6 +39,8 @@ namespace assm {
 //
 // This enum has been constructed such that the lower 3-bits represents the
 // code associated with the register, which is used in ModR/M and SIB bytes.
+// The registers R8 through R15 additionally need an extension bit in a REX
+// prefix.
 enum RegisterId {
   kRegisterNone = -1,
 
@@ -71,6 +74,24 @@ enum RegisterId {
   kRegisterEsi = 22,
   kRegisterEdi = 23,
 
+  // 64-bit registers.
+  kRegisterRax = 24,
+  kRegisterRcx = 25,
+  kRegisterRdx = 26,
+  kRegisterRbx = 27,
+  kRegisterRsp = 28,
+  kRegisterRbp = 29,
+  kRegisterRsi = 30,
+  kRegisterRdi = 31,
+  kRegisterR8 = 32,
+  kRegisterR9 = 33,
+  kRegisterR10 = 34,
+  kRegisterR11 = 35,
+  kRegisterR12 = 36,
+  kRegisterR13 = 37,
+  kRegisterR14 = 38,
+  kRegisterR15 = 39,
+
   // Ranges for various register types. These come at the end so that
   // preferentially the debugger will show proper register IDs for overloaded
   // enum values.
@@ -81,7 +102,9 @@ enum RegisterId {
   kRegister16Max = 16,
   kRegister32Min = 16,
   kRegister32Max = 24,
-  kRegisterMax = 24
+  kRegisterMax = 24,
+  kRegister64Min = 24,
+  kRegister64Max = 40
 };
 
 // We use another enum for register code simply for type safety. This makes it
@@ -103,6 +126,7 @@ enum RegisterSize {
   kSize8Bit = 8,
   kSize16Bit = 16,
   kSize32Bit = 32,
+  kSize64Bit = 64,
 };
 
 // The base class of all registers.
@@ -125,6 +149,15 @@ class Register {
     return RegisterCode(id & 0x7);
   }
 
+  // @returns true if this register needs an extension bit in a REX prefix.
+  bool IsExtended() const { return IsExtended(id_); }
+
+  // Utility function for determining whether the register with the given ID
+  // needs an extension bit in a REX prefix.
+  static bool IsExtended(RegisterId id) {
+    return id >= kRegisterR8 && id < kRegister64Max;
+  }
+
   // Utility function for getting the register with the given ID.
   static const Register& Get(RegisterId id);
 
@@ -173,6 +206,7 @@ class RegisterImpl : public Register {
 typedef RegisterImpl<kSize8Bit> Register8;
 typedef RegisterImpl<kSize16Bit> Register16;
 typedef RegisterImpl<kSize32Bit> Register32;
+typedef RegisterImpl<kSize64Bit> Register64;
 
 }  // namespace assm
 
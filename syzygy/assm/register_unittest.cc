@@ -43,6 +43,17 @@ TEST(RegisterTest, Accessors) {
   EXPECT_EQ(kRegisterEax, eax.id());
   EXPECT_EQ(kSize32Bit, eax.size());
   EXPECT_EQ(0, eax.code());
+  EXPECT_FALSE(eax.IsExtended());
+
+  EXPECT_EQ(kRegisterRdi, rdi.id());
+  EXPECT_EQ(kSize64Bit, rdi.size());
+  EXPECT_EQ(7, rdi.code());
+  EXPECT_FALSE(rdi.IsExtended());
+
+  EXPECT_EQ(kRegisterR9, r9.id());
+  EXPECT_EQ(kSize64Bit, r9.size());
+  EXPECT_EQ(1, r9.code());
+  EXPECT_TRUE(r9.IsExtended());
 }
 
 TEST(RegisterTest, Get) {
@@ -52,6 +63,11 @@ TEST(RegisterTest, Get) {
             &Register::Get(kRegisterBx));
   EXPECT_EQ(reinterpret_cast<const Register*>(&eax),
             &Register::Get(kRegisterEax));
+  EXPECT_EQ(reinterpret_cast<const Register*>(&rsp),
+            &Register::Get(kRegisterRsp));
+  EXPECT_EQ(reinterpret_cast<const Register*>(&r12),
+            &Register::Get(kRegisterR12));
+  EXPECT_EQ(&r15, &CastAsRegister64(Register::Get(kRegisterR15)));
 }
 
 TEST(RegisterTest, Comparison) {
@@ -62,6 +78,7 @@ TEST(RegisterTest, Comparison) {
   EXPECT_FALSE(al == ax);
   EXPECT_FALSE(al == eax);
   EXPECT_FALSE(ax == eax);
+  EXPECT_FALSE(eax == rax);
 
   EXPECT_TRUE(al != ax);
   EXPECT_TRUE(al != eax);
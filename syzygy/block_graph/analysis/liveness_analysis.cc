@@ -14,6 +14,7 @@
 
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 
+#include <deque>
 #include <set>
 #include <stack>
 #include <vector>
@@ -172,29 +173,128 @@ void LivenessAnalysis::Analyze(const BasicBlockSubGraph* subgraph) {
   for (; fw_iter != order.end(); ++fw_iter)
     StateHelper::Clear(&live_in_[*fw_iter]);
 
+  ComputePredecessors(subgraph);
+  Solve(order);
+}
+
+void LivenessAnalysis::Reanalyze(const BasicBlockSubGraph* subgraph,
+                                 const BasicBlockSet& changed_blocks) {
+  DCHECK(subgraph != NULL);
+
+  ComputePredecessors(subgraph);
+
+  const BBCollection& basic_blocks = subgraph->basic_blocks();
+  std::vector<const BasicCodeBlock*> order;
+  ControlFlowAnalysis::FlattenBasicBlocksInPostOrder(basic_blocks, &order);
+
+  // Forget about the basic blocks that are no longer part of the subgraph.
+  BasicBlockSet present(order.begin(), order.end());
+  LiveMap::iterator live_iter = live_in_.begin();
+  while (live_iter != live_in_.end()) {
+    if (present.find(live_iter->first) == present.end())
+      live_in_.erase(live_iter++);
+    else
+      ++live_iter;
+  }
+
+  // The liveness at entry of a basic block only depends on the basic blocks
+  // it may reach. Thus, only the modified basic blocks and their ancestors
+  // need to be recomputed.
+  BasicBlockSet affected;
+  std::stack<const BasicCodeBlock*> pending;
+  BasicBlockOrdering::const_iterator fw_iter = order.begin();
+  for (; fw_iter != order.end(); ++fw_iter) {
+    const BasicCodeBlock* bb = *fw_iter;
+    if (changed_blocks.find(bb) != changed_blocks.end() ||
+        live_in_.find(bb) == live_in_.end()) {
+      if (affected.insert(bb).second)
+        pending.push(bb);
+    }
+  }
+  while (!pending.empty()) {
+    const BasicCodeBlock* bb = pending.top();
+    pending.pop();
+
+    PredecessorMap::const_iterator look = predecessors_.find(bb);
+    if (look == predecessors_.end())
+      continue;
+    BasicCodeBlockVector::const_iterator pred_iter = look->second.begin();
+    for (; pred_iter != look->second.end(); ++pred_iter) {
+      if (affected.insert(*pred_iter).second)
+        pending.push(*pred_iter);
+    }
+  }
+
+  // Restart the affected basic blocks from an empty set, keeping them in
+  // post-order so that the propagation converges quickly.
+  BasicCodeBlockVector worklist;
+  for (fw_iter = order.begin(); fw_iter != order.end(); ++fw_iter) {
+    if (affected.find(*fw_iter) == affected.end())
+      continue;
+    StateHelper::Clear(&live_in_[*fw_iter]);
+    worklist.push_back(*fw_iter);
+  }
+
+  Solve(worklist);
+}
+
+void LivenessAnalysis::ComputePredecessors(
+    const BasicBlockSubGraph* subgraph) {
+  DCHECK(subgraph != NULL);
+
+  predecessors_.clear();
+
+  const BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::const_iterator bb_iter = basic_blocks.begin();
+  for (; bb_iter != basic_blocks.end(); ++bb_iter) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+    if (bb == NULL)
+      continue;
+
+    const Successors& successors = bb->successors();
+    Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      const BasicBlock* successor = succ->reference().basic_block();
+      if (successor != NULL)
+        predecessors_[successor].push_back(bb);
+    }
+  }
+}
+
+void LivenessAnalysis::Solve(const BasicCodeBlockVector& worklist) {
   // Propagate liveness information until stable (fix-point). Each set may only
-  // grow, thus we have a halting condition.
-  bool changed = true;
-  while (changed) {
-    changed = false;
-
-    BasicBlockOrdering::const_iterator  bb_iter = order.begin();
-    for (; bb_iter != order.end(); ++bb_iter) {
-      const BasicCodeBlock* bb = *bb_iter;
-
-      // Merge current liveness information with every successor information.
-      State state;
-      GetStateAtExitOf(bb, &state);
-
-      // Propagate liveness information backward until the basic block entry.
-      const Instructions& instructions = bb->instructions();
-      Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
-      for (; instr_iter != instructions.rend(); ++instr_iter)
-        PropagateBackward(*instr_iter, &state);
-
-      // Commit liveness information to the global state.
-      if (StateHelper::Union(state, &live_in_[bb]))
-        changed = true;
+  // grow, thus we have a halting condition. A basic block is only revisited
+  // when the liveness information at entry of one of its successors grows.
+  std::deque<const BasicCodeBlock*> pending(worklist.begin(), worklist.end());
+  BasicBlockSet queued(worklist.begin(), worklist.end());
+
+  while (!pending.empty()) {
+    const BasicCodeBlock* bb = pending.front();
+    pending.pop_front();
+    queued.erase(bb);
+
+    // Merge current liveness information with every successor information.
+    State state;
+    GetStateAtExitOf(bb, &state);
+
+    // Propagate liveness information backward until the basic block entry.
+    const Instructions& instructions = bb->instructions();
+    Instructions::const_reverse_iterator instr_iter = instructions.rbegin();
+    for (; instr_iter != instructions.rend(); ++instr_iter)
+      PropagateBackward(*instr_iter, &state);
+
+    // Commit liveness information to the global state.
+    if (!StateHelper::Union(state, &live_in_[bb]))
+      continue;
+
+    // The predecessors must merge the updated information.
+    PredecessorMap::const_iterator look = predecessors_.find(bb);
+    if (look == predecessors_.end())
+      continue;
+    BasicCodeBlockVector::const_iterator pred_iter = look->second.begin();
+    for (; pred_iter != look->second.end(); ++pred_iter) {
+      if (queued.insert(*pred_iter).second)
+        pending.push_back(*pred_iter);
     }
   }
 }
@@ -28,6 +28,8 @@
 #define SYZYGY_BLOCK_GRAPH_ANALYSIS_LIVENESS_ANALYSIS_H_
 
 #include <map>
+#include <set>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -96,7 +98,9 @@ namespace analysis {
 //
 // Local modifications inside a basic block do not invalidate the global
 // analysis except if a new live range escapes the scope of the basic block. In
-// that case, the whole analysis is invalid and must be recomputed.
+// that case, the analysis must be updated with 'Reanalyze', which only
+// recomputes the modified basic blocks and the basic blocks that may reach
+// them.
 //
 // Example:
 //
@@ -118,6 +122,7 @@ namespace analysis {
 class LivenessAnalysis {
  public:
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef std::set<const BasicBlock*> BasicBlockSet;
 
   class State;
   class StateHelper;
@@ -148,11 +153,39 @@ class LivenessAnalysis {
   // @param subgraph Subgraph to apply the analysis.
   void Analyze(const BasicBlockSubGraph* subgraph);
 
+  // Update a global analysis after some basic blocks of @p subgraph have been
+  // modified. Only the modified basic blocks and the basic blocks that may
+  // reach them are recomputed, the information of the other basic blocks is
+  // kept as is. Basic blocks added to the subgraph since the last analysis
+  // are considered modified, and those removed from it are forgotten.
+  // @param subgraph Subgraph previously passed to Analyze.
+  // @param changed_blocks The basic blocks that have been modified.
+  // @pre Analyze has been called on @p subgraph.
+  void Reanalyze(const BasicBlockSubGraph* subgraph,
+                 const BasicBlockSet& changed_blocks);
+
  private:
+  typedef std::vector<const BasicCodeBlock*> BasicCodeBlockVector;
+
+  // Maps each basic block to the code blocks that have it as a successor.
+  typedef std::map<const BasicBlock*, BasicCodeBlockVector> PredecessorMap;
+
+  // Rebuild the predecessors of each basic block of @p subgraph.
+  // @param subgraph Subgraph to apply the analysis.
+  void ComputePredecessors(const BasicBlockSubGraph* subgraph);
+
+  // Propagate liveness information until stable (fix-point), starting with
+  // the basic blocks in @p worklist.
+  // @param worklist The basic blocks to process first, in post-order.
+  void Solve(const BasicCodeBlockVector& worklist);
+
   // Contains the registers alive at entry of each basic block.
   typedef std::map<const BasicBlock*, State> LiveMap;
   LiveMap live_in_;
 
+  // Contains the predecessors of each basic block of the analyzed subgraph.
+  PredecessorMap predecessors_;
+
   DISALLOW_COPY_AND_ASSIGN(LivenessAnalysis);
 };
 
@@ -1781,6 +1781,87 @@ TEST_F(LivenessAnalysisTest, AnalyzeWithData) {
   EXPECT_TRUE(is_live(assm::esi));
 }
 
+TEST_F(LivenessAnalysisTest, ReanalyzeModifiedBlocks) {
+  BasicBlockSubGraph subgraph;
+
+  // Build and analyze this flow graph:
+  //      [first]              [other]
+  //      mov eax, ebx         mov esi, ebx
+  //         |
+  //      [second]
+  //      mov ecx, edx
+  BasicCodeBlock* first = subgraph.AddBasicCodeBlock("first");
+  BasicCodeBlock* second = subgraph.AddBasicCodeBlock("second");
+  BasicCodeBlock* other = subgraph.AddBasicCodeBlock("other");
+  ASSERT_TRUE(first != NULL);
+  ASSERT_TRUE(second != NULL);
+  ASSERT_TRUE(other != NULL);
+
+  AddSuccessorBetween(Successor::kConditionTrue, first, second);
+
+  BasicBlockAssembler asm_first(first->instructions().end(),
+                                &first->instructions());
+  asm_first.mov(assm::eax, assm::ebx);
+
+  BasicBlockAssembler asm_second(second->instructions().end(),
+                                 &second->instructions());
+  asm_second.mov(assm::ecx, assm::edx);
+
+  BasicBlockAssembler asm_other(other->instructions().end(),
+                                &other->instructions());
+  asm_other.mov(assm::esi, assm::ebx);
+
+  liveness_.Analyze(&subgraph);
+
+  liveness_.GetStateAtEntryOf(first, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_TRUE(is_live(assm::edi));
+
+  // Kill edi at the start of the second basic block.
+  BasicBlockAssembler asm_update(second->instructions().begin(),
+                                 &second->instructions());
+  asm_update.mov(assm::edi, Immediate(1));
+
+  // Until the analysis is updated, the old information is kept.
+  liveness_.GetStateAtEntryOf(first, &state_);
+  EXPECT_TRUE(is_live(assm::edi));
+
+  LivenessAnalysis::BasicBlockSet changed_blocks;
+  changed_blocks.insert(second);
+  liveness_.Reanalyze(&subgraph, changed_blocks);
+
+  // The modified basic block and its predecessor are updated.
+  liveness_.GetStateAtEntryOf(second, &state_);
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::edi));
+  liveness_.GetStateAtEntryOf(first, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_FALSE(is_live(assm::ecx));
+  EXPECT_FALSE(is_live(assm::edi));
+
+  // The unrelated basic block is untouched.
+  liveness_.GetStateAtEntryOf(other, &state_);
+  EXPECT_FALSE(is_live(assm::esi));
+  EXPECT_TRUE(is_live(assm::edi));
+
+  // A new basic block is analyzed even if it's not reported as modified.
+  BasicCodeBlock* entry = subgraph.AddBasicCodeBlock("entry");
+  ASSERT_TRUE(entry != NULL);
+  AddSuccessorBetween(Successor::kConditionTrue, entry, first);
+  BasicBlockAssembler asm_entry(entry->instructions().end(),
+                                &entry->instructions());
+  asm_entry.mov(assm::edx, Immediate(2));
+
+  liveness_.Reanalyze(&subgraph, LivenessAnalysis::BasicBlockSet());
+
+  liveness_.GetStateAtEntryOf(entry, &state_);
+  EXPECT_FALSE(is_live(assm::eax));
+  EXPECT_TRUE(is_live(assm::ebx));
+  EXPECT_FALSE(is_live(assm::edx));
+  EXPECT_FALSE(is_live(assm::edi));
+}
+
 }  // namespace
 
 }  // namespace analysis
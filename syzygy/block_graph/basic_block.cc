@@ -97,6 +97,41 @@ bool IsConditionalBranch(const Instruction& inst) {
   return META_GET_FC(inst.representation().meta) == FC_CND_BRANCH;
 }
 
+// Returns the location of the data of @p operand_index in the encoding of
+// @p repr. We walk backwards through the operands, and back up the operand
+// location by the size of each operand, until we're at ours.
+BasicBlock::Offset GetOperandLocation(const _DInst& repr,
+                                      size_t operand_index) {
+  DCHECK_GT(arraysize(repr.ops), operand_index);
+
+  BasicBlock::Offset operand_location = repr.size;
+  size_t i = 0;
+  for (i = arraysize(repr.ops); i != operand_index; --i) {
+    switch (repr.ops[i - 1].type) {
+      case O_NONE:
+      case O_REG:
+        break;
+
+      case O_IMM:
+      case O_IMM1:
+      case O_IMM2:
+      case O_PTR:
+      case O_PC:
+        operand_location -= repr.ops[i - 1].size / 8;
+        break;
+
+      case O_SMEM:
+      case O_MEM:
+      case O_DISP:
+        operand_location -= repr.dispSize / 8;
+        break;
+    }
+  }
+  DCHECK_EQ(i, operand_index);
+
+  return operand_location;
+}
+
 bool UpdateBasicBlockReferenceMap(BasicBlock::Size object_size,
                                   BasicBlock::BasicBlockReferenceMap* ref_map,
                                   BasicBlock::Offset offset,
@@ -254,12 +289,38 @@ Instruction::Instruction(const Instruction& other)
 }
 
 bool Instruction::FromBuffer(const uint8* buf, size_t len, Instruction* inst) {
+  return FromBuffer(buf, len, NULL, inst);
+}
+
+bool Instruction::FromBuffer(const uint8* buf,
+                             size_t len,
+                             core::DecodedInstructionCache* cache,
+                             Instruction* inst) {
+  DCHECK(buf != NULL);
+  DCHECK_LT(0U, len);
+  DCHECK(inst != NULL);
+
+  _DInst repr = {};
+  if (cache != NULL) {
+    if (!cache->DecodeOneInstruction(buf, len, &repr))
+      return false;
+  } else if (!core::DecodeOneInstruction(buf, len, &repr)) {
+    return false;
+  }
+
+  *inst = Instruction(repr, buf);
+  return true;
+}
+
+bool Instruction::FromBuffer64(const uint8* buf,
+                               size_t len,
+                               Instruction* inst) {
   DCHECK(buf != NULL);
   DCHECK_LT(0U, len);
   DCHECK(inst != NULL);
 
   _DInst repr = {};
-  if (!core::DecodeOneInstruction(buf, len, &repr))
+  if (!core::DecodeOneInstruction64(buf, len, &repr))
     return false;
 
   *inst = Instruction(repr, buf);
@@ -317,35 +378,8 @@ bool Instruction::FindOperandReference(size_t operand_index,
                                        BasicBlockReference* reference) const {
   DCHECK(reference != NULL);
 
-  // We walk backwards through the operands, and back up the operand
-  // location by the size of each operand, until we're at ours.
-  size_t operand_location = representation_.size;
-  size_t i = 0;
-  for (i = arraysize(representation_.ops); i != operand_index; --i) {
-    switch (representation_.ops[i - 1].type) {
-      case O_NONE:
-      case O_REG:
-        break;
-
-      case O_IMM:
-      case O_IMM1:
-      case O_IMM2:
-      case O_PTR:
-      case O_PC:
-        operand_location -= representation_.ops[i - 1].size / 8;
-        break;
-
-      case O_SMEM:
-      case O_MEM:
-      case O_DISP:
-        operand_location -= representation_.dispSize / 8;
-        break;
-    }
-  }
-  DCHECK_EQ(i, operand_index);
-
-  Instruction::BasicBlockReferenceMap::const_iterator
-      it(references_.find(operand_location));
+  Instruction::BasicBlockReferenceMap::const_iterator it(
+      references_.find(GetOperandLocation(representation_, operand_index)));
 
   if (it != references_.end()) {
     *reference = it->second;
@@ -355,6 +389,51 @@ bool Instruction::FindOperandReference(size_t operand_index,
   return false;
 }
 
+bool Instruction::SetOperandReference(size_t operand_index,
+                                      const BasicBlockReference& reference) {
+  DCHECK(reference.IsValid());
+
+  Instruction::BasicBlockReferenceMap::iterator it(
+      references_.find(GetOperandLocation(representation_, operand_index)));
+  if (it == references_.end())
+    return false;
+
+  DCHECK_EQ(it->second.reference_type(), reference.reference_type());
+  DCHECK_EQ(it->second.size(), reference.size());
+  it->second = reference;
+  return true;
+}
+
+bool Instruction::SetOperandValue(size_t operand_index, uint32 value) {
+  DCHECK_GT(arraysize(representation_.ops), operand_index);
+
+  const _Operand& operand = representation_.ops[operand_index];
+  switch (operand.type) {
+    case O_IMM:
+      if (operand.size != 32)
+        return false;
+      representation_.imm.dword = value;
+      break;
+
+    case O_SMEM:
+    case O_MEM:
+    case O_DISP:
+      if (representation_.dispSize != 32)
+        return false;
+      // The decoder sign-extends displacements.
+      representation_.disp = static_cast<int32>(value);
+      break;
+
+    default:
+      return false;
+  }
+
+  Offset location = GetOperandLocation(representation_, operand_index);
+  DCHECK_LE(location + sizeof(value), representation_.size);
+  ::memcpy(data_ + location, &value, sizeof(value));
+  return true;
+}
+
 bool Instruction::InvertConditionalBranchOpcode(uint16* opcode) {
   DCHECK(opcode != NULL);
 
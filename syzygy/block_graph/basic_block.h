@@ -29,6 +29,7 @@
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/tags.h"
 #include "syzygy/common/align.h"
+#include "syzygy/core/decoded_instruction_cache.h"
 #include "syzygy/core/disassembler_util.h"
 
 #include "distorm.h"  // NOLINT
@@ -260,6 +261,24 @@ class Instruction {
   // @returns true on success, false otherwise.
   static bool FromBuffer(const uint8* buf, size_t len, Instruction* inst);
 
+  // Factory to construct an initialized Instruction instance from a buffer
+  // containing x64 code.
+  // @param buf the data comprising the instruction.
+  // @param len the maximum length (in bytes) of @p buf to consume
+  // @returns true on success, false otherwise.
+  static bool FromBuffer64(const uint8* buf, size_t len, Instruction* inst);
+
+  // Factory to construct an initialized Instruction instance from a buffer,
+  // going through a decoded instruction cache.
+  // @param buf the data comprising the instruction.
+  // @param len the maximum length (in bytes) of @p buf to consume
+  // @param cache the cache to decode through. May be NULL.
+  // @returns true on success, false otherwise.
+  static bool FromBuffer(const uint8* buf,
+                         size_t len,
+                         core::DecodedInstructionCache* cache,
+                         Instruction* inst);
+
   // Accessors.
   // @{
   const Representation& representation() const { return representation_; }
@@ -335,6 +354,23 @@ class Instruction {
   bool FindOperandReference(size_t operand_index,
                             BasicBlockReference* reference) const;
 
+  // Replaces the reference, if any, for @p operand_index of this instruction.
+  // @param operand_index the desired operand, in the range 0-3.
+  // @param reference the new reference. It must have the same type and size
+  //     as the reference it replaces.
+  // @returns true iff @p operand_index exists and has a reference.
+  bool SetOperandReference(size_t operand_index,
+                           const BasicBlockReference& reference);
+
+  // Sets the value of a 32-bit immediate or displacement operand of this
+  // instruction. Both the encoded data and the representation are updated,
+  // which is much cheaper than decoding a new instruction.
+  // @param operand_index the desired operand, in the range 0-3.
+  // @param value the new value of the operand.
+  // @returns true iff @p operand_index exists and has a 32-bit immediate or
+  //     displacement.
+  bool SetOperandValue(size_t operand_index, uint32 value);
+
   // Helper function to invert a conditional branching opcode.
   static bool InvertConditionalBranchOpcode(uint16* opcode);
 
@@ -14,6 +14,8 @@
 //
 #include "syzygy/block_graph/basic_block_assembler.h"
 
+#include <iterator>
+
 namespace block_graph {
 
 namespace {
@@ -171,9 +173,36 @@ BasicBlockAssembler::Operand Operand(
   return BasicBlockAssembler::Operand(index, scale, displ);
 }
 
+BasicBlockAssembler::Operand Operand(const assm::Register64& base) {
+  return BasicBlockAssembler::Operand(base);
+}
+
+BasicBlockAssembler::Operand Operand(
+    const assm::Register64& base,
+    const BasicBlockAssembler::Displacement& displ) {
+  return BasicBlockAssembler::Operand(base, displ);
+}
+
+BasicBlockAssembler::Operand Operand(
+    const assm::Register64& base, const assm::Register64& index,
+    assm::ScaleFactor scale, const BasicBlockAssembler::Displacement& displ) {
+  return BasicBlockAssembler::Operand(base, index, scale, displ);
+}
+
+BasicBlockAssembler::Operand Operand(const assm::Register64& base,
+                                     const assm::Register64& index,
+                                     assm::ScaleFactor scale) {
+  return BasicBlockAssembler::Operand(base, index, scale);
+}
+
+BasicBlockAssembler::Operand RipRelativeOperand(
+    const BasicBlockAssembler::Displacement& displ) {
+  return BasicBlockAssembler::Operand::RipRelative(displ);
+}
+
 BasicBlockAssembler::BasicBlockSerializer::BasicBlockSerializer(
     const Instructions::iterator& where, Instructions* list)
-        : where_(where), list_(list) {
+        : where_(where), list_(list), x64_(false) {
   DCHECK(list != NULL);
 }
 
@@ -181,7 +210,10 @@ void BasicBlockAssembler::BasicBlockSerializer::AppendInstruction(
     uint32 location, const uint8* bytes, size_t num_bytes,
     const ReferenceInfo* refs, size_t num_refs) {
   Instruction instruction;
-  CHECK(Instruction::FromBuffer(bytes, num_bytes, &instruction));
+  if (x64_)
+    CHECK(Instruction::FromBuffer64(bytes, num_bytes, &instruction));
+  else
+    CHECK(Instruction::FromBuffer(bytes, num_bytes, &instruction));
   instruction.set_source_range(source_range_);
 
   Instructions::iterator it = list_->insert(where_, instruction);
@@ -240,4 +272,78 @@ void BasicBlockAssembler::j(ConditionCode code, const Immediate& dst) {
   Super::j(code, dst);
 }
 
+InstructionTemplate::InstructionTemplate()
+    : assembler_(instructions_.end(), &instructions_) {
+}
+
+bool InstructionTemplate::AddValueSlot(size_t instruction, size_t operand) {
+  Instruction* inst = GetInstruction(instruction);
+  if (inst == NULL)
+    return false;
+
+  // Check on a copy that the operand can be patched.
+  Instruction copy(*inst);
+  if (operand >= arraysize(copy.representation().ops) ||
+      !copy.SetOperandValue(operand, 0)) {
+    return false;
+  }
+
+  Slot slot = { instruction, operand };
+  value_slots_.push_back(slot);
+  return true;
+}
+
+bool InstructionTemplate::AddReferenceSlot(size_t instruction,
+                                           size_t operand) {
+  Instruction* inst = GetInstruction(instruction);
+  if (inst == NULL)
+    return false;
+
+  BasicBlockReference ref;
+  if (operand >= arraysize(inst->representation().ops) ||
+      !inst->FindOperandReference(operand, &ref)) {
+    return false;
+  }
+
+  Slot slot = { instruction, operand };
+  reference_slots_.push_back(slot);
+  return true;
+}
+
+void InstructionTemplate::Emit(const Instructions::iterator& where,
+                               Instructions* list,
+                               const uint32* values,
+                               size_t num_values,
+                               const BasicBlockReference* refs,
+                               size_t num_refs) const {
+  DCHECK(list != NULL);
+  DCHECK_EQ(value_slots_.size(), num_values);
+  DCHECK_EQ(reference_slots_.size(), num_refs);
+
+  // Copy the instructions, keeping track of the copies to patch.
+  std::vector<Instructions::iterator> copies;
+  copies.reserve(instructions_.size());
+  Instructions::const_iterator it = instructions_.begin();
+  for (; it != instructions_.end(); ++it)
+    copies.push_back(list->insert(where, *it));
+
+  for (size_t i = 0; i < value_slots_.size(); ++i) {
+    const Slot& slot = value_slots_[i];
+    CHECK(copies[slot.instruction]->SetOperandValue(slot.operand, values[i]));
+  }
+  for (size_t i = 0; i < reference_slots_.size(); ++i) {
+    const Slot& slot = reference_slots_[i];
+    CHECK(copies[slot.instruction]->SetOperandReference(slot.operand,
+                                                        refs[i]));
+  }
+}
+
+Instruction* InstructionTemplate::GetInstruction(size_t index) {
+  if (index >= instructions_.size())
+    return NULL;
+  Instructions::iterator it = instructions_.begin();
+  std::advance(it, index);
+  return &(*it);
+}
+
 }  // namespace block_graph
@@ -17,6 +17,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
 #define SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
 
+#include <vector>
+
 #include "syzygy/assm/assembler_base.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -127,6 +129,7 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
   typedef assm::Register8 Register8;
   typedef assm::Register16 Register16;
   typedef assm::Register32 Register32;
+  typedef assm::Register64 Register64;
   typedef assm::ConditionCode ConditionCode;
 
   // Constructs a basic block assembler that inserts new instructions
@@ -151,6 +154,14 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
     serializer_.set_source_range(source_range);
   }
 
+  // Selects x64 mode. This hides the base class accessor, as the created
+  // instructions must also be decoded as x64 code.
+  // @param x64 true to assemble and decode x64 instructions.
+  void set_x64(bool x64) {
+    Super::set_x64(x64);
+    serializer_.set_x64(x64);
+  }
+
   // @name Call instructions.
   // @{
   void call(const Immediate& dst);
@@ -191,6 +202,8 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
       source_range_ = source_range;
     }
 
+    void set_x64(bool x64) { x64_ = x64; }
+
     // Pushes back a reference type to be associated with a untyped reference.
     // @param type The type of the reference.
     // @param size The size of the reference, as a ValueSize.
@@ -202,11 +215,93 @@ class BasicBlockAssembler : public assm::AssemblerBase<UntypedReference> {
 
     // Source range set to instructions appended by this serializer.
     SourceRange source_range_;
+
+    // True when the appended instructions are x64 code.
+    bool x64_;
   };
 
   BasicBlockSerializer serializer_;
 };
 
+// A precompiled sequence of instructions, which can be emitted repeatedly
+// without assembling and decoding each instruction every time. The operands
+// that vary from one use to the next are assembled with placeholders, and
+// declared as slots that are patched in the emitted copies.
+//
+// For example, to emit "push <id>; call [hook]" with a varying id:
+//
+//   InstructionTemplate entry_hook;
+//   entry_hook.assembler()->push(Immediate(0, assm::kSize32Bit));
+//   entry_hook.assembler()->call(Operand(Displacement(hook, 0)));
+//   CHECK(entry_hook.AddValueSlot(0, 0));
+//   ...
+//   uint32 id = ...;
+//   entry_hook.Emit(bb->instructions().begin(), &bb->instructions(),
+//                   &id, 1, NULL, 0);
+class InstructionTemplate {
+ public:
+  typedef BasicBlock::Instructions Instructions;
+
+  InstructionTemplate();
+
+  // @returns the assembler appending instructions to this template.
+  BasicBlockAssembler* assembler() { return &assembler_; }
+
+  // @returns the instructions of this template.
+  const Instructions& instructions() const { return instructions_; }
+
+  // @name Slot declaration.
+  // Slots are numbered in the order they are added, separately for values and
+  // for references.
+  // @{
+  // Declares a 32-bit immediate or displacement operand as a value slot.
+  // The placeholder must have been assembled with a 32-bit size.
+  // @param instruction the index of the instruction in this template.
+  // @param operand the index of the operand, in the range 0-3.
+  // @returns true on success, false if the operand has no 32-bit value.
+  bool AddValueSlot(size_t instruction, size_t operand);
+  // Declares the reference of an operand as a reference slot.
+  // @param instruction the index of the instruction in this template.
+  // @param operand the index of the operand, in the range 0-3.
+  // @returns true on success, false if the operand has no reference.
+  bool AddReferenceSlot(size_t instruction, size_t operand);
+  // @}
+
+  // Emits a copy of the instructions of this template.
+  // @param where the position at which the instructions are inserted.
+  // @param list the list receiving the instructions.
+  // @param values the values of the value slots, in order.
+  // @param num_values the number of values. This must be the number of value
+  //     slots.
+  // @param refs the references of the reference slots, in order. Each must
+  //     have the type and size of the placeholder it replaces.
+  // @param num_refs the number of references. This must be the number of
+  //     reference slots.
+  void Emit(const Instructions::iterator& where,
+            Instructions* list,
+            const uint32* values,
+            size_t num_values,
+            const BasicBlockReference* refs,
+            size_t num_refs) const;
+
+ private:
+  // An operand patched by Emit.
+  struct Slot {
+    size_t instruction;
+    size_t operand;
+  };
+
+  // Returns the instruction at @p index in this template.
+  Instruction* GetInstruction(size_t index);
+
+  Instructions instructions_;
+  BasicBlockAssembler assembler_;
+  std::vector<Slot> value_slots_;
+  std::vector<Slot> reference_slots_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstructionTemplate);
+};
+
 // @name Immediate factory functions.
 // @{
 
@@ -354,6 +449,39 @@ BasicBlockAssembler::Operand Operand(
 
 // @}
 
+// @name x64 operand factory functions.
+// These are only valid with an assembler in x64 mode.
+// @{
+
+// A register-indirect mode.
+BasicBlockAssembler::Operand Operand(const assm::Register64& base);
+
+// A register-indirect with displacement mode.
+BasicBlockAssembler::Operand Operand(
+    const assm::Register64& base,
+    const BasicBlockAssembler::Displacement& displ);
+
+// The full [base + index * scale + displ32] mode.
+// @note rsp cannot be used as an index register.
+BasicBlockAssembler::Operand Operand(
+    const assm::Register64& base, const assm::Register64& index,
+    assm::ScaleFactor scale, const BasicBlockAssembler::Displacement& displ);
+
+// The full [base + index * scale] mode.
+// @note rsp cannot be used as an index register.
+BasicBlockAssembler::Operand Operand(const assm::Register64& base,
+                                     const assm::Register64& index,
+                                     assm::ScaleFactor scale);
+
+// The [rip + displ32] mode.
+// @param displ The 32-bit displacement. When it carries a reference, the
+//     reference is made PC-relative and must be the last thing encoded in
+//     the instruction, so this can't be combined with an immediate.
+BasicBlockAssembler::Operand RipRelativeOperand(
+    const BasicBlockAssembler::Displacement& displ);
+
+// @}
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_BASIC_BLOCK_ASSEMBLER_H_
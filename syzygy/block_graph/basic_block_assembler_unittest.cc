@@ -784,6 +784,29 @@ TEST_F(BasicBlockAssemblerTest, xchg) {
   ASSERT_NO_REFS();
 }
 
+TEST_F(BasicBlockAssemblerTest, X64) {
+  asm_.set_x64(true);
+
+  asm_.push(assm::r12);
+  ASSERT_EQ(1, instructions_.size());
+  EXPECT_EQ(2U, instructions_.front().size());
+  ASSERT_NO_REFS();
+
+  asm_.mov(assm::rax, Operand(assm::r13, Displacement(test_block_, 4)));
+  ASSERT_EQ(1, instructions_.size());
+  EXPECT_EQ(7U, instructions_.front().size());
+  ASSERT_REFS(3, BasicBlockReference::REFERRED_TYPE_BLOCK, test_block_);
+
+  asm_.lea(assm::rcx, RipRelativeOperand(Displacement(test_bb_)));
+  ASSERT_EQ(1, instructions_.size());
+  EXPECT_EQ(7U, instructions_.front().size());
+  BasicBlock::BasicBlockReferenceMap::const_iterator it =
+      instructions_.front().references().find(3);
+  ASSERT_NE(instructions_.front().references().end(), it);
+  EXPECT_EQ(BlockGraph::PC_RELATIVE_REF, it->second.reference_type());
+  ASSERT_REFS(3, BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK, test_bb_);
+}
+
 TEST_F(BasicBlockAssemblerTest, UndefinedSourceRange) {
   ASSERT_EQ(asm_.source_range(), SourceRange());
   asm_.call(Immediate(test_block_, 0));
@@ -813,4 +836,60 @@ TEST_F(BasicBlockAssemblerTest, SetMultipleSourceRange) {
   ASSERT_EQ(instructions_.back().source_range(), range2);
 }
 
+TEST_F(BasicBlockAssemblerTest, InstructionTemplate) {
+  BlockGraph::Block* other_block =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 10, "other block");
+
+  // push <value>; mov eax, [ecx + <value>]; call [<reference>].
+  InstructionTemplate instr_template;
+  BasicBlockAssembler* template_asm = instr_template.assembler();
+  template_asm->push(Immediate(0, assm::kSize32Bit));
+  template_asm->mov(assm::eax,
+                    Operand(assm::ecx, Displacement(0, assm::kSize32Bit)));
+  template_asm->call(Operand(Displacement(test_block_, 0)));
+  ASSERT_EQ(3U, instr_template.instructions().size());
+
+  EXPECT_TRUE(instr_template.AddValueSlot(0, 0));
+  EXPECT_TRUE(instr_template.AddValueSlot(1, 1));
+  EXPECT_TRUE(instr_template.AddReferenceSlot(2, 0));
+
+  // Operands without a 32-bit value or a reference can't be slots.
+  EXPECT_FALSE(instr_template.AddValueSlot(1, 0));
+  EXPECT_FALSE(instr_template.AddReferenceSlot(0, 0));
+  EXPECT_FALSE(instr_template.AddValueSlot(3, 0));
+
+  // Emit the template, and assemble the same sequence directly.
+  const uint32 kValues[] = { 0x12345678, 0xFFFFFFF0 };
+  BasicBlockReference refs[] = {
+      BasicBlockReference(BlockGraph::ABSOLUTE_REF, 4, other_block, 4, 4) };
+  instr_template.Emit(instructions_.end(), &instructions_,
+                      kValues, arraysize(kValues), refs, arraysize(refs));
+  ASSERT_EQ(3U, instructions_.size());
+
+  BasicBlock::Instructions expected;
+  BasicBlockAssembler expected_asm(expected.end(), &expected);
+  expected_asm.push(Immediate(kValues[0], assm::kSize32Bit));
+  expected_asm.mov(assm::eax, Operand(assm::ecx,
+                                      Displacement(kValues[1],
+                                                   assm::kSize32Bit)));
+  expected_asm.call(Operand(Displacement(other_block, 4)));
+  ASSERT_EQ(3U, expected.size());
+
+  BasicBlock::Instructions::const_iterator it = instructions_.begin();
+  BasicBlock::Instructions::const_iterator expected_it = expected.begin();
+  for (; it != instructions_.end(); ++it, ++expected_it) {
+    ASSERT_EQ(expected_it->size(), it->size());
+    EXPECT_EQ(0, ::memcmp(expected_it->data(), it->data(), it->size()));
+    EXPECT_EQ(expected_it->representation().imm.dword,
+              it->representation().imm.dword);
+    EXPECT_EQ(expected_it->representation().disp,
+              it->representation().disp);
+    EXPECT_EQ(expected_it->references(), it->references());
+  }
+
+  // The template itself is left untouched.
+  const Instruction& first = instr_template.instructions().front();
+  EXPECT_EQ(0U, first.representation().imm.dword);
+}
+
 }  // namespace block_graph
@@ -133,7 +133,8 @@ BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
       subgraph_(subgraph),
       current_block_start_(0),
       check_decomposition_results_(true),
-      contains_unsupported_instructions_(false) {
+      contains_unsupported_instructions_(false),
+      instruction_cache_(NULL) {
   // TODO(rogerm): Once we're certain this is stable for all input binaries
   //     turn on check_decomposition_results_ by default only ifndef NDEBUG.
   DCHECK(block != NULL);
@@ -208,7 +209,8 @@ bool BasicBlockDecomposer::DecodeInstruction(Offset offset,
   // Decode the instruction.
   const uint8* buffer = block_->data() + offset;
   size_t max_length = code_end_offset - offset;
-  if (!Instruction::FromBuffer(buffer, max_length, instruction)) {
+  if (!Instruction::FromBuffer(buffer, max_length, instruction_cache_,
+                               instruction)) {
     VLOG(1) << "Failed to decode instruction at offset " << offset
             << " of block '" << block_->name() << "'.";
 
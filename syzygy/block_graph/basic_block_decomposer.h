@@ -102,6 +102,13 @@ class BasicBlockDecomposer {
     return contains_unsupported_instructions_;
   }
 
+  // Sets the cache to decode instructions through. The cache must outlive
+  // the decomposition. Defaults to NULL, in which case every instruction is
+  // decoded afresh.
+  void set_instruction_cache(core::DecodedInstructionCache* cache) {
+    instruction_cache_ = cache;
+  }
+
  protected:
   typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
   typedef core::AddressSpace<Offset, size_t, BasicBlock*> BBAddressSpace;
@@ -267,6 +274,9 @@ class BasicBlockDecomposer {
 
   // Decomposition failure flags.
   bool contains_unsupported_instructions_;
+
+  // The cache to decode instructions through, if any.
+  core::DecodedInstructionCache* instruction_cache_;
 };
 
 }  // namespace block_graph
@@ -120,6 +120,34 @@ bool EndBlocksAreWellPlaced(BasicBlockSubGraph* subgraph) {
   return true;
 }
 
+// Makes a newly merged block share the data of the original block when the
+// layout reproduced it byte for byte, so that unchanged blocks don't keep a
+// duplicate of their data. Bytes past the original data are implicitly zero.
+void ShareUnchangedData(const BlockGraph::Block* original_block,
+                        const BlockVector& new_blocks) {
+  if (original_block == NULL || new_blocks.size() != 1)
+    return;
+
+  BlockGraph::Block* new_block = new_blocks.front();
+  if (new_block->size() != original_block->size() ||
+      new_block->data_size() < original_block->data_size() ||
+      original_block->data_size() == 0) {
+    return;
+  }
+
+  const uint8* new_data = new_block->data();
+  const uint8* original_data = original_block->data();
+  size_t original_size = original_block->data_size();
+  if (::memcmp(new_data, original_data, original_size) != 0)
+    return;
+  for (size_t i = original_size; i < new_block->data_size(); ++i) {
+    if (new_data[i] != 0)
+      return;
+  }
+
+  new_block->ShareData(*original_block);
+}
+
 // Adds a new label to a block, or merges a label with an existing one. This is
 // used because labels may collide when creating a new block, as BasicEndBlocks
 // have zero size.
@@ -1222,6 +1250,7 @@ bool BlockBuilder::Merge(BasicBlockSubGraph* subgraph) {
     return false;
 
   context.TransferReferrers(subgraph);
+  ShareUnchangedData(subgraph->original_block(), context.new_blocks());
   context.RemoveOriginalBlock(subgraph);
 
   // Track the newly created blocks.
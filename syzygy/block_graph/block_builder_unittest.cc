@@ -605,6 +605,22 @@ TEST_F(BlockBuilderTest, MergeAssemblesSourceRangesCorrectly) {
   ASSERT_EQ(expected_source_ranges, new_block->source_ranges());
 }
 
+TEST_F(BlockBuilderTest, MergeSharesUnchangedData) {
+  ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraphWithLabelPastEnd());
+  const uint8* original_data = func2_->data();
+  ASSERT_TRUE(func2_->owns_data());
+
+  BlockBuilder builder(&block_graph_);
+  ASSERT_TRUE(builder.Merge(&subgraph_));
+  ASSERT_EQ(1u, builder.new_blocks().size());
+
+  // The block was laid out identically, so it took over the original data
+  // rather than keeping a copy of it.
+  BlockGraph::Block* new_block = builder.new_blocks()[0];
+  EXPECT_EQ(original_data, new_block->data());
+  EXPECT_TRUE(new_block->owns_data());
+}
+
 TEST_F(BlockBuilderTest, LabelsPastEndAreNotDropped) {
   ASSERT_NO_FATAL_FAILURE(InitBasicBlockSubGraphWithLabelPastEnd());
 
@@ -17,7 +17,9 @@
 #include <limits>
 
 #include "base/logging.h"
+#include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/core/decoded_instruction_cache.h"
 
 // Pretty prints a BlockInfo to an ostream. This has to be outside of any
 // namespaces so that operator<< is found properly.
@@ -205,6 +207,14 @@ const char* BlockAttributeToString(BlockGraph::BlockAttributeEnum attr) {
   }
 }
 
+// Allocates a zero-initialized buffer of @p size bytes for block data.
+scoped_refptr<base::RefCountedBytes> CreateDataBuffer(size_t size) {
+  DCHECK_LT(0u, size);
+  scoped_refptr<base::RefCountedBytes> buffer(new base::RefCountedBytes());
+  buffer->data().resize(size);
+  return buffer;
+}
+
 }  // namespace
 
 const char* BlockGraph::ImageFormatToString(ImageFormat format) {
@@ -255,6 +265,7 @@ const BlockGraph::SectionId BlockGraph::kInvalidSectionId = -1;
 
 BlockGraph::BlockGraph()
     : next_section_id_(0),
+      blocks_(std::less<BlockId>(), BlockAllocator(&arena_)),
       next_block_id_(0),
       image_format_(UNKNOWN_IMAGE_FORMAT) {
 }
@@ -262,6 +273,12 @@ BlockGraph::BlockGraph()
 BlockGraph::~BlockGraph() {
 }
 
+core::DecodedInstructionCache* BlockGraph::instruction_cache() {
+  if (instruction_cache_.get() == NULL)
+    instruction_cache_.reset(new core::DecodedInstructionCache());
+  return instruction_cache_.get();
+}
+
 BlockGraph::Section* BlockGraph::AddSection(const base::StringPiece& name,
                                             uint32 characteristics) {
   Section new_section(next_section_id_++, name, characteristics);
@@ -745,12 +762,65 @@ bool BlockGraph::Section::Load(core::InArchive* in_archive) {
       in_archive->Load(&characteristics_);
 }
 
+BlockGraph::Label::Label(const base::StringPiece& name,
+                         LabelAttributes attributes)
+    : name_(NULL), owns_name_(false), attributes_(attributes) {
+  if (!name.empty()) {
+    name_ = new std::string(name.begin(), name.end());
+    owns_name_ = true;
+  }
+}
+
+BlockGraph::Label::Label(const Label& other)
+    : name_(NULL), owns_name_(false), attributes_(other.attributes_) {
+  CopyNameFrom(other);
+}
+
+BlockGraph::Label::~Label() {
+  if (owns_name_)
+    delete name_;
+}
+
+BlockGraph::Label& BlockGraph::Label::operator=(const Label& other) {
+  if (this == &other)
+    return *this;
+
+  if (owns_name_)
+    delete name_;
+  name_ = NULL;
+  owns_name_ = false;
+
+  CopyNameFrom(other);
+  attributes_ = other.attributes_;
+  return *this;
+}
+
+const std::string& BlockGraph::Label::name() const {
+  if (name_ == NULL)
+    return base::EmptyString();
+  return *name_;
+}
+
 std::string BlockGraph::Label::ToString() const {
   return base::StringPrintf("%s (%s)",
-                            name_.c_str(),
+                            name().c_str(),
                             LabelAttributesToString(attributes_).c_str());
 }
 
+void BlockGraph::Label::CopyNameFrom(const Label& other) {
+  DCHECK(name_ == NULL);
+  DCHECK(!owns_name_);
+
+  if (!other.owns_name_) {
+    name_ = other.name_;
+    return;
+  }
+
+  DCHECK(other.name_ != NULL);
+  name_ = new std::string(*other.name_);
+  owns_name_ = true;
+}
+
 bool BlockGraph::Label::IsValid() const {
   return AreValidAttributes(attributes_);
 }
@@ -828,7 +898,12 @@ BlockGraph::Block::Block(BlockGraph* block_graph)
       block_graph_(block_graph),
       section_(kInvalidSectionId),
       attributes_(0U),
-      owns_data_(false),
+      references_(std::less<Offset>(),
+                  ReferenceMap::allocator_type(&block_graph->arena_)),
+      referrers_(std::less<Referrer>(),
+                 ReferrerSet::allocator_type(&block_graph->arena_)),
+      labels_(std::less<Offset>(),
+              LabelMap::allocator_type(&block_graph->arena_)),
       data_(NULL),
       data_size_(0U) {
   DCHECK(block_graph != NULL);
@@ -850,7 +925,12 @@ BlockGraph::Block::Block(BlockId id,
       block_graph_(block_graph),
       section_(kInvalidSectionId),
       attributes_(0U),
-      owns_data_(false),
+      references_(std::less<Offset>(),
+                  ReferenceMap::allocator_type(&block_graph->arena_)),
+      referrers_(std::less<Referrer>(),
+                 ReferrerSet::allocator_type(&block_graph->arena_)),
+      labels_(std::less<Offset>(),
+              LabelMap::allocator_type(&block_graph->arena_)),
       data_(NULL),
       data_size_(0U) {
   DCHECK(block_graph != NULL);
@@ -859,8 +939,6 @@ BlockGraph::Block::Block(BlockId id,
 
 BlockGraph::Block::~Block() {
   DCHECK(block_graph_ != NULL);
-  if (owns_data_)
-    delete [] data_;
 }
 
 void BlockGraph::Block::set_name(const base::StringPiece& name) {
@@ -888,20 +966,11 @@ uint8* BlockGraph::Block::AllocateRawData(size_t data_size) {
   DCHECK_GT(data_size, 0u);
   DCHECK_LE(data_size, size_);
 
-  uint8* new_data = new uint8[data_size];
-  if (!new_data)
-    return NULL;
-
-  if (owns_data()) {
-    DCHECK(data_ != NULL);
-    delete [] data_;
-  }
-
-  data_ = new_data;
+  data_buffer_ = CreateDataBuffer(data_size);
+  data_ = &data_buffer_->data()[0];
   data_size_ = data_size;
-  owns_data_ = true;
 
-  return new_data;
+  return &data_buffer_->data()[0];
 }
 
 void BlockGraph::Block::InsertData(Offset offset,
@@ -1034,21 +1103,14 @@ void BlockGraph::Block::SetData(const uint8* data, size_t data_size) {
          (data_size != 0 && data != NULL));
   DCHECK(data_size <= size_);
 
-  if (owns_data_)
-    delete [] data_;
-
-  owns_data_ = false;
+  data_buffer_ = NULL;
   data_ = data;
   data_size_ = data_size;
 }
 
 uint8* BlockGraph::Block::AllocateData(size_t size) {
-  uint8* new_data = AllocateRawData(size);
-  if (new_data == NULL)
-    return NULL;
-
-  ::memset(new_data, 0, size);
-  return new_data;
+  // Data buffers are always allocated zero-initialized.
+  return AllocateRawData(size);
 }
 
 uint8* BlockGraph::Block::CopyData(size_t size, const void* data) {
@@ -1069,25 +1131,23 @@ const uint8* BlockGraph::Block::ResizeData(size_t new_size) {
     data_size_ = new_size;
   } else {
     // Either our own data, or it's growing (or both).
-    uint8* new_data = NULL;
+    scoped_refptr<base::RefCountedBytes> new_buffer;
+    const uint8* new_data = NULL;
 
-    // If the new size is non-zero we need to reallocate.
+    // If the new size is non-zero we need to reallocate. The tail of the new
+    // buffer is already zeroed.
     if (new_size > 0) {
-      new_data = new uint8[new_size];
-      CHECK(new_data);
+      new_buffer = CreateDataBuffer(new_size);
+      new_data = &new_buffer->data()[0];
 
       // Copy the (head of the) old data.
-      memcpy(new_data, data_, std::min(data_size_, new_size));
-      if (new_size > data_size_) {
-        // Zero the tail.
-        memset(new_data + data_size_, 0, new_size - data_size_);
+      if (data_size_ > 0) {
+        memcpy(&new_buffer->data()[0], data_,
+               std::min(data_size_, new_size));
       }
     }
 
-    if (owns_data())
-      delete [] data_;
-
-    owns_data_ = true;
+    data_buffer_ = new_buffer;
     data_ = new_data;
     data_size_ = new_size;
   }
@@ -1099,20 +1159,29 @@ uint8* BlockGraph::Block::GetMutableData() {
   DCHECK_NE(0U, data_size_);
   DCHECK(data_ != NULL);
 
-  // Make a copy if we don't already own the data.
-  if (!owns_data()) {
-    uint8* new_data = new uint8[data_size_];
-    if (new_data == NULL)
-      return NULL;
-    memcpy(new_data, data_, data_size_);
-    data_ = new_data;
-    owns_data_ = true;
+  // Make a copy if we don't already own the data, or if we share it with
+  // other blocks.
+  if (!owns_data() || !data_buffer_->HasOneRef()) {
+    scoped_refptr<base::RefCountedBytes> new_buffer =
+        CreateDataBuffer(data_size_);
+    memcpy(&new_buffer->data()[0], data_, data_size_);
+    data_buffer_ = new_buffer;
+    data_ = &data_buffer_->data()[0];
   }
-  DCHECK(owns_data_);
+  DCHECK(owns_data());
+  DCHECK(data_buffer_->HasOneRef());
 
   return const_cast<uint8*>(data_);
 }
 
+void BlockGraph::Block::ShareData(const Block& other) {
+  DCHECK_LE(other.data_size_, size_);
+
+  data_buffer_ = other.data_buffer_;
+  data_ = other.data_;
+  data_size_ = other.data_size_;
+}
+
 bool BlockGraph::Block::HasExternalReferrers() const {
   ReferrerSet::const_iterator it = referrers().begin();
   for (; it != referrers().end(); ++it) {
@@ -1249,9 +1318,20 @@ bool BlockGraph::Block::SetLabel(Offset offset, const Label& label) {
           << LabelAttributesToString(label.attributes()) << " label '"
           << label.name() << "' at offset " << offset << ".";
 
+  // Store the label with an interned name, which is shared by all the labels
+  // of the block-graph that have the same name.
+  Label interned_label;
+  if (label.name().empty()) {
+    interned_label = label;
+  } else {
+    interned_label = Label(
+        &block_graph_->string_table().InternString(label.name()),
+        label.attributes());
+  }
+
   // Try inserting the label into the label map.
   std::pair<LabelMap::iterator, bool> result(
-      labels_.insert(std::make_pair(offset, label)));
+      labels_.insert(std::make_pair(offset, interned_label)));
 
   // If it was freshly inserted then we're done.
   if (result.second)
@@ -37,6 +37,8 @@
         'block_graph_serializer.h',
         'block_hash.cc',
         'block_hash.h',
+        'block_hash_index.cc',
+        'block_hash_index.h',
         'block_util.cc',
         'block_util.h',
         'filter_util.cc',
@@ -94,6 +96,7 @@
         'block_graph_serializer_unittest.cc',
         'block_builder_unittest.cc',
         'block_graph_unittest.cc',
+        'block_hash_index_unittest.cc',
         'block_hash_unittest.cc',
         'block_util_unittest.cc',
         'filter_util_unittest.cc',
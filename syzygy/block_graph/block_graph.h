@@ -32,12 +32,23 @@
 
 #include "base/basictypes.h"
 #include "base/file_util.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/arena.h"
 #include "syzygy/core/string_table.h"
 
+namespace core {
+
+// Forward declaration.
+class DecodedInstructionCache;
+
+}  // namespace core
+
 namespace block_graph {
 
 // Forward declaration.
@@ -238,8 +249,13 @@ class BlockGraph {
   class Label;
   class Reference;
 
-  // The block map contains all blocks, indexed by id.
-  typedef std::map<BlockId, Block> BlockMap;
+  // The block map contains all blocks, indexed by id. The blocks of a
+  // BlockGraph, and the references, referrers and labels they hold, are
+  // allocated from an arena that's freed wholesale with the BlockGraph.
+  typedef core::ArenaAllocator<std::pair<const BlockId, Block> >
+      BlockAllocator;
+  typedef std::map<BlockId, Block, std::less<BlockId>, BlockAllocator>
+      BlockMap;
 
   BlockGraph();
   ~BlockGraph();
@@ -341,6 +357,12 @@ class BlockGraph {
   // @returns the image format.
   ImageFormat image_format() const { return image_format_; }
 
+  // Gets the cache of decoded instructions shared by all of the passes that
+  // decode the code of this block graph. It's created on first use, which
+  // isn't thread safe, but using it is.
+  // @returns the decoded instruction cache of this BlockGraph.
+  core::DecodedInstructionCache* instruction_cache();
+
  private:
   // Give BlockGraphSerializer access to our innards for serialization.
   friend BlockGraphSerializer;
@@ -348,6 +370,10 @@ class BlockGraph {
   // Removes a block by the iterator to it. The iterator must be valid.
   bool RemoveBlockByIterator(BlockMap::iterator it);
 
+  // The arena our blocks and their containers are allocated from. This is
+  // declared first so that it outlives them.
+  core::Arena arena_;
+
   // All sections we contain.
   SectionMap sections_;
 
@@ -367,6 +393,9 @@ class BlockGraph {
   // UNKNOWN_IMAGE_FORMAT. Usually initialized by the appropriate decomposer.
   ImageFormat image_format_;
 
+  // The decoded instruction cache, created on first use.
+  scoped_ptr<core::DecodedInstructionCache> instruction_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockGraph);
 };
 
@@ -464,25 +493,41 @@ struct BlockGraph::Section {
 // block. In particular, a code label represents an instruction boundary
 // at which disassembly can begin and a data label represents the beginning
 // of embedded data.
+//
+// A label either owns a copy of its name, or refers to a name interned in the
+// string table of a block-graph. Labels stored in a block always do the
+// latter, so that the name of a given label is only stored once per
+// block-graph, and copying such a label is cheap.
 class BlockGraph::Label {
  public:
   // Default constructor.
-  Label() : attributes_(0) {
+  Label() : name_(NULL), owns_name_(false), attributes_(0) {
   }
 
   // Full constructor.
-  Label(const base::StringPiece& name, LabelAttributes attributes)
-      : name_(name.begin(), name.end()), attributes_(attributes) {
+  Label(const base::StringPiece& name, LabelAttributes attributes);
+
+  // Constructs a label that refers to an interned name.
+  // @param interned_name the name of the label. It must outlive the label and
+  //     all of its copies, e.g. by being interned in the string table of the
+  //     block-graph the label belongs to.
+  // @param attributes the attributes of the label.
+  Label(const std::string* interned_name, LabelAttributes attributes)
+      : name_(interned_name), owns_name_(false), attributes_(attributes) {
+    DCHECK(interned_name != NULL);
   }
 
   // Copy construction.
-  Label(const Label& other)
-      : name_(other.name_), attributes_(other.attributes_) {
-  }
+  Label(const Label& other);
+
+  ~Label();
+
+  // Assignment.
+  Label& operator=(const Label& other);
 
   // @name Accessors.
   // @{
-  const std::string& name() const { return name_; }
+  const std::string& name() const;
   // @}
 
   // A helper function for logging and debugging.
@@ -490,7 +535,7 @@ class BlockGraph::Label {
 
   // Equality comparator for unittesting.
   bool operator==(const Label& other) const {
-    return name_ == other.name_ && attributes_ == other.attributes_;
+    return name() == other.name() && attributes_ == other.attributes_;
   }
 
   // The label attributes are a bitmask. You can set them wholesale,
@@ -519,8 +564,15 @@ class BlockGraph::Label {
   static bool AreValidAttributes(LabelAttributes attributes);
 
  private:
-  // The name by which this label is known.
-  std::string name_;
+  // Makes this label share or copy the name of @p other, depending on whether
+  // @p other owns its name.
+  void CopyNameFrom(const Label& other);
+
+  // The name by which this label is known. This is NULL for an empty name.
+  const std::string* name_;
+
+  // True iff name_ is owned by this label.
+  bool owns_name_;
 
   // The disposition of the bytes found at this label.
   LabelAttributes attributes_;
@@ -546,10 +598,13 @@ class BlockGraph::Block {
   // to allow one to easily locate and remove the backreferences on change or
   // deletion.
   typedef std::pair<Block*, Offset> Referrer;
-  typedef std::set<Referrer> ReferrerSet;
+  typedef std::set<Referrer, std::less<Referrer>,
+                   core::ArenaAllocator<Referrer> > ReferrerSet;
 
   // Map of references that this block makes to other blocks.
-  typedef std::map<Offset, Reference> ReferenceMap;
+  typedef std::map<Offset, Reference, std::less<Offset>,
+                   core::ArenaAllocator<std::pair<const Offset, Reference> > >
+      ReferenceMap;
 
   // Represents a range of data in this block.
   typedef core::AddressRange<Offset, Size> DataRange;
@@ -572,7 +627,9 @@ class BlockGraph::Block {
   // within the block. Note that, while possible, it is NOT guaranteed that
   // all basic blocks are marked with a label. Basic block decomposition should
   // disassemble from the code labels to discover all basic blocks.
-  typedef std::map<Offset, Label> LabelMap;
+  typedef std::map<Offset, Label, std::less<Offset>,
+                   core::ArenaAllocator<std::pair<const Offset, Label> > >
+      LabelMap;
 
   ~Block();
 
@@ -639,10 +696,10 @@ class BlockGraph::Block {
     attributes_ &= ~attribute;
   }
 
-  // This is true iff data_ is in the ownership of the block.
-  // Iff true, the block will delete [] data_ on destruction or when
-  // data is overwritten.
-  bool owns_data() const { return owns_data_; }
+  // This is true iff data_ is in the ownership of the block. Owned data is
+  // reference counted, and may be shared with other blocks of the block-graph
+  // (see ShareData) until one of them modifies it.
+  bool owns_data() const { return data_buffer_.get() != NULL; }
 
   // Makes room for the given amount of data at the given offset. This is
   // special in that it will patch up any labels, source ranges and referrers
@@ -708,8 +765,17 @@ class BlockGraph::Block {
   // @pre new_size <= size().
   const uint8* ResizeData(size_t new_size);
 
+  // Makes this block refer to the same data as @p other, without copying it.
+  // If @p other owns its data, the two blocks share ownership of it and the
+  // first one to modify it makes itself a private copy. Otherwise, the
+  // underlying data must outlive this block, as with SetData.
+  // @param other the block whose data is to be shared.
+  // @pre other.data_size() <= size().
+  void ShareData(const Block& other);
+
   // Returns a mutable copy of the block's data. If the block doesn't own
-  // the data on entry, it'll be copied and the copy returned to the caller.
+  // the data on entry, or shares it with other blocks, it'll be copied and the
+  // copy returned to the caller.
   uint8* GetMutableData();
 
   // The data bytes the block refers to.
@@ -844,9 +910,10 @@ class BlockGraph::Block {
   SourceRanges source_ranges_;
   LabelMap labels_;
 
-  // True iff data_ is ours to deallocate with delete [].
-  // If this is false, data_ must be guaranteed to outlive the block.
-  bool owns_data_;
+  // The buffer holding data_ if it's in our ownership, possibly shared with
+  // other blocks. If this is NULL, data_ must be guaranteed to outlive the
+  // block.
+  scoped_refptr<base::RefCountedBytes> data_buffer_;
   // A pointer to the code or data we represent.
   const uint8* data_;
   // Size of the above.
@@ -30,48 +30,13 @@ using core::OutArchive;
 //     representation.
 // Version 3: Added image_format_ block-graph property.
 // Version 4: Deprecated old decomposer attributes.
-static const uint32 kSerializedBlockGraphVersion = 4;
+// Version 5: Each distinct string is saved once, and referred to by id.
+static const uint32 kSerializedBlockGraphVersion = 5;
 
 // Some constants for use in dealing with backwards compatibility.
 static const uint32 kMinSupportedSerializedBlockGraphVersion = 2;
 static const uint32 kImageFormatPropertyBlockGraphVersion = 3;
-
-// Potentially saves a string, depending on whether or not OMIT_STRINGS is
-// enabled.
-bool MaybeSaveString(const BlockGraphSerializer& bgs,
-                     const std::string& value,
-                     OutArchive* out_archive) {
-  DCHECK(out_archive != NULL);
-
-  if (bgs.has_attributes(BlockGraphSerializer::OMIT_STRINGS))
-    return true;
-
-  if (!out_archive->Save(value)) {
-    LOG(ERROR) << "Unable to save string \"" << value << "\".";
-    return false;
-  }
-
-  return true;
-}
-
-// Potentially loads a string, depending on whether or not OMIT_STRINGS is
-// enabled.
-bool MaybeLoadString(const BlockGraphSerializer& bgs,
-                     std::string* value,
-                     InArchive* in_archive) {
-  DCHECK(value != NULL);
-  DCHECK(in_archive != NULL);
-
-  if (bgs.has_attributes(BlockGraphSerializer::OMIT_STRINGS))
-    return true;
-
-  if (!in_archive->Load(value)) {
-    LOG(ERROR) << "Unable to load string.";
-    return false;
-  }
-
-  return true;
-}
+static const uint32 kIndexedStringsBlockGraphVersion = 5;
 
 bool ValidAttributes(uint32 attributes, uint32 attributes_max) {
   return (attributes & ~(attributes_max - 1)) == 0;
@@ -92,14 +57,14 @@ bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
     return false;
   }
 
-  // TODO(etienneb): We should serialize the string table in the block graph,
-  //    and encode string ids instead of the raw strings.
-
   // This function takes care of outputting a meaningful log message on
   // failure.
   if (!SaveBlockGraphProperties(block_graph, out_archive))
     return false;
 
+  // The ids of the strings are only meaningful within this serialization.
+  saved_string_ids_.clear();
+
   // Save the blocks, except for their references. We do that in a second pass
   // so that when loading the referenced blocks will exist.
   if (!SaveBlocks(block_graph, out_archive)) {
@@ -107,6 +72,8 @@ bool BlockGraphSerializer::Save(const BlockGraph& block_graph,
     return false;
   }
 
+  saved_string_ids_.clear();
+
   // Save all of the references. The referrers are implicitly saved by this.
   if (!SaveBlockGraphReferences(block_graph, out_archive)) {
     LOG(ERROR) << "Unable to save block graph references.";
@@ -156,7 +123,11 @@ bool BlockGraphSerializer::Load(BlockGraph* block_graph,
     return false;
 
   // Load the blocks, except for their references.
-  if (!LoadBlocks(block_graph, in_archive)) {
+  load_indexed_strings_ = version >= kIndexedStringsBlockGraphVersion;
+  loaded_strings_.clear();
+  bool blocks_loaded = LoadBlocks(block_graph, in_archive);
+  loaded_strings_.clear();
+  if (!blocks_loaded) {
     LOG(ERROR) << "Unable to load blocks.";
     return false;
   }
@@ -340,8 +311,8 @@ bool BlockGraphSerializer::SaveBlockProperties(const BlockGraph::Block& block,
       !out_archive->Save(block.addr()) ||
       !SaveInt32(static_cast<uint32>(block.section()), out_archive) ||
       !out_archive->Save(block.attributes()) ||
-      !MaybeSaveString(*this, block.name(), out_archive) ||
-      !MaybeSaveString(*this, block.compiland_name(), out_archive)) {
+      !MaybeSaveString(block.name(), out_archive) ||
+      !MaybeSaveString(block.compiland_name(), out_archive)) {
     LOG(ERROR) << "Unable to save properties for block with id "
                << block.id() << ".";
     return false;
@@ -378,8 +349,8 @@ bool BlockGraphSerializer::LoadBlockProperties(BlockGraph::Block* block,
       !in_archive->Load(&block->addr_) ||
       !LoadInt32(reinterpret_cast<int32*>(&section), in_archive) ||
       !in_archive->Load(&attributes) ||
-      !MaybeLoadString(*this, &name, in_archive) ||
-      !MaybeLoadString(*this, &compiland_name, in_archive)) {
+      !MaybeLoadString(&name, in_archive) ||
+      !MaybeLoadString(&compiland_name, in_archive)) {
     LOG(ERROR) << "Unable to load properties for block with id "
                << block->id() << ".";
     return false;
@@ -428,7 +399,7 @@ bool BlockGraphSerializer::SaveBlockLabels(const BlockGraph::Block& block,
     uint16 attributes = static_cast<uint16>(label.attributes());
 
     if (!SaveInt32(offset, out_archive) || !out_archive->Save(attributes) ||
-        !MaybeSaveString(*this, label.name(), out_archive)) {
+        !MaybeSaveString(label.name(), out_archive)) {
       LOG(ERROR) << "Unable to save label at offset "
                  << label_iter->first << " of block with id "
                  << block.id() << ".";
@@ -462,7 +433,7 @@ bool BlockGraphSerializer::LoadBlockLabels(BlockGraph::Block* block,
     std::string name;
 
     if (!LoadInt32(&offset, in_archive) || !(in_archive->Load(&attributes)) ||
-        !MaybeLoadString(*this, &name, in_archive)) {
+        !MaybeLoadString(&name, in_archive)) {
       LOG(ERROR) << "Unable to load label " << i << " of " << label_count
                  << " for block with id " << block->id() << ".";
       return false;
@@ -605,14 +576,24 @@ bool BlockGraphSerializer::LoadBlockData(BlockGraph::Block* block,
   if (data_in_stream) {
     DCHECK_LT(0u, data_size);
 
-    // Read the data from the stream.
-    block->AllocateData(data_size);
-    DCHECK_EQ(data_size, block->data_size());
-    DCHECK(block->data() != NULL);
-    if (!in_archive->in_stream()->Read(data_size, block->GetMutableData())) {
-      LOG(ERROR) << "Unable to read data for block with id "
-                 << block->id() << ".";
-      return false;
+    // Leave the data in the stream's buffer if we can.
+    const uint8* data = NULL;
+    if (load_data_in_place_)
+      data = in_archive->in_stream()->ReadInPlace(data_size);
+
+    if (data != NULL) {
+      block->SetData(data, data_size);
+    } else {
+      // Read the data from the stream.
+      block->AllocateData(data_size);
+      DCHECK_EQ(data_size, block->data_size());
+      DCHECK(block->data() != NULL);
+      if (!in_archive->in_stream()->Read(data_size,
+                                         block->GetMutableData())) {
+        LOG(ERROR) << "Unable to read data for block with id "
+                   << block->id() << ".";
+        return false;
+      }
     }
   }
 
@@ -784,6 +765,67 @@ bool BlockGraphSerializer::LoadReference(BlockGraph* block_graph,
 // Saves an unsigned 32 bit value. This uses a variable length encoding where
 // the first three bits are reserved to indicate the number of bytes required to
 // store the value.
+bool BlockGraphSerializer::MaybeSaveString(const std::string& value,
+                                           OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  if (has_attributes(BlockGraphSerializer::OMIT_STRINGS))
+    return true;
+
+  // Strings that have already been saved are referred to by id. Otherwise the
+  // next unused id is saved, followed by the string itself.
+  std::pair<StringIdMap::iterator, bool> result = saved_string_ids_.insert(
+      std::make_pair(value, saved_string_ids_.size()));
+  if (!SaveUint32(result.first->second, out_archive) ||
+      (result.second && !out_archive->Save(value))) {
+    LOG(ERROR) << "Unable to save string \"" << value << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockGraphSerializer::MaybeLoadString(std::string* value,
+                                           InArchive* in_archive) const {
+  DCHECK(value != NULL);
+  DCHECK(in_archive != NULL);
+
+  if (has_attributes(BlockGraphSerializer::OMIT_STRINGS))
+    return true;
+
+  if (!load_indexed_strings_) {
+    if (!in_archive->Load(value)) {
+      LOG(ERROR) << "Unable to load string.";
+      return false;
+    }
+    return true;
+  }
+
+  uint32 id = 0;
+  if (!LoadUint32(&id, in_archive)) {
+    LOG(ERROR) << "Unable to load string id.";
+    return false;
+  }
+
+  if (id < loaded_strings_.size()) {
+    *value = loaded_strings_[id];
+    return true;
+  }
+
+  if (id != loaded_strings_.size()) {
+    LOG(ERROR) << "Invalid string id " << id << ".";
+    return false;
+  }
+
+  if (!in_archive->Load(value)) {
+    LOG(ERROR) << "Unable to load string.";
+    return false;
+  }
+  loaded_strings_.push_back(*value);
+
+  return true;
+}
+
 bool BlockGraphSerializer::SaveUint32(uint32 value,
                                       OutArchive* out_archive) const {
   DCHECK(out_archive != NULL);
@@ -17,6 +17,10 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_SERIALIZER_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_SERIALIZER_H_
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "base/callback.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -132,7 +136,8 @@ class BlockGraphSerializer {
 
   // Default constructor.
   BlockGraphSerializer()
-      : data_mode_(DEFAULT_DATA_MODE), attributes_(DEFAULT_ATTRIBUTES) { }
+      : data_mode_(DEFAULT_DATA_MODE), attributes_(DEFAULT_ATTRIBUTES),
+        load_data_in_place_(false), load_indexed_strings_(true) { }
 
   // @name For setting and accessing the data mode.
   // @{
@@ -194,6 +199,20 @@ class BlockGraphSerializer {
         new LoadBlockDataCallback(load_block_data_callback));
   }
 
+  // @name For setting and accessing in place loading of block data.
+  // When enabled, and if the input stream supports InStream::ReadInPlace
+  // (e.g. a core::MemoryInStream over a memory-mapped serialization), Load
+  // points the blocks at their data in the stream's buffer instead of copying
+  // it. Such blocks don't own their data, and only make a private copy of it
+  // when it's first modified. The buffer must then outlive the block-graph.
+  // This only affects loading, and is disabled by default.
+  // @{
+  bool load_data_in_place() const { return load_data_in_place_; }
+  void set_load_data_in_place(bool load_data_in_place) {
+    load_data_in_place_ = load_data_in_place;
+  }
+  // @}
+
   // Loads a block-graph from the provided input archive. The data-mode and
   // attributes used in the serialization will also be updated. If an external
   // data source is required SetBlockDataCallback must be called prior to Load.
@@ -246,6 +265,15 @@ class BlockGraphSerializer {
                      InArchive* in_archive) const;
   // @}
 
+  // @{
+  // Potentially saves or loads a string, depending on whether or not
+  // OMIT_STRINGS is enabled. Each distinct string is only saved once, and then
+  // referred to by an id.
+  bool MaybeSaveString(const std::string& value,
+                       OutArchive* out_archive) const;
+  bool MaybeLoadString(std::string* value, InArchive* in_archive) const;
+  // @}
+
   // @{
   // Utility functions for loading and saving integer values with a simple
   // variable-length encoding.
@@ -259,6 +287,19 @@ class BlockGraphSerializer {
   DataMode data_mode_;
   // Controls the specifics of how the serialization is performed.
   Attributes attributes_;
+  // Indicates whether block data may be referenced in the input stream.
+  bool load_data_in_place_;
+
+  // @{
+  // The strings seen in the current serialization, by id. These are only
+  // used during a call to Save or Load respectively.
+  typedef std::map<std::string, uint32> StringIdMap;
+  mutable StringIdMap saved_string_ids_;
+  mutable std::vector<std::string> loaded_strings_;
+  // @}
+  // Indicates whether the stream being loaded refers to strings by id, which
+  // older versions of the serialization do not.
+  bool load_indexed_strings_;
 
   // Optional callbacks.
   scoped_ptr<SaveBlockDataCallback> save_block_data_callback_;
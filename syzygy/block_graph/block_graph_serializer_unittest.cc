@@ -521,6 +521,69 @@ TEST_F(BlockGraphSerializerTest, RoundTripAllData) {
       eNoBlockDataCallbacks, 0));
 }
 
+TEST_F(BlockGraphSerializerTest, RoundTripAllDataInPlace) {
+  InitBlockGraph();
+  InitOutArchive();
+
+  s_.set_data_mode(BlockGraphSerializer::OUTPUT_ALL_DATA);
+  ASSERT_TRUE(s_.Save(bg_, oa_.get()));
+  ASSERT_LT(0u, v_.size());
+
+  core::MemoryInStream in_stream(&v_[0], v_.size());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  BlockGraph bg;
+  s_.set_load_data_in_place(true);
+  ASSERT_TRUE(s_.Load(&bg, &in_archive));
+  ASSERT_TRUE(testing::BlockGraphsEqual(bg_, bg, s_));
+
+  // The block data should have been left in the serialized buffer.
+  const uint8* buffer_begin = &v_[0];
+  const uint8* buffer_end = buffer_begin + v_.size();
+  BlockGraph::BlockMap::iterator it = bg.blocks_mutable().begin();
+  for (; it != bg.blocks_mutable().end(); ++it) {
+    BlockGraph::Block& block = it->second;
+    if (block.data_size() == 0)
+      continue;
+    EXPECT_FALSE(block.owns_data());
+    EXPECT_LE(buffer_begin, block.data());
+    EXPECT_GE(buffer_end, block.data() + block.data_size());
+
+    // Modifying a block makes a private copy of its data, leaving the buffer
+    // untouched.
+    const uint8* in_place_data = block.data();
+    uint8 in_place_byte = in_place_data[0];
+    block.GetMutableData()[0] ^= 0xFF;
+    EXPECT_TRUE(block.owns_data());
+    EXPECT_NE(in_place_data, block.data());
+    EXPECT_EQ(in_place_byte, in_place_data[0]);
+  }
+}
+
+TEST_F(BlockGraphSerializerTest, RepeatedStringsAreSavedOnce) {
+  static const char kName[] = "a_rather_long_repeated_name";
+  for (size_t i = 0; i < 4; ++i) {
+    BlockGraph::Block* block =
+        bg_.AddBlock(BlockGraph::CODE_BLOCK, 16, kName);
+    block->set_compiland_name(kName);
+    ASSERT_TRUE(block->SetLabel(0, kName, BlockGraph::CODE_LABEL));
+  }
+
+  InitOutArchive();
+  ASSERT_TRUE(s_.Save(bg_, oa_.get()));
+
+  // The name should appear exactly once in the serialized stream.
+  std::string stream(v_.begin(), v_.end());
+  size_t first = stream.find(kName);
+  ASSERT_NE(std::string::npos, first);
+  EXPECT_EQ(std::string::npos, stream.find(kName, first + 1));
+
+  InitInArchive();
+  BlockGraph bg;
+  ASSERT_TRUE(s_.Load(&bg, ia_.get()));
+  ASSERT_TRUE(testing::BlockGraphsEqual(bg_, bg, s_));
+}
+
 // TODO(chrisha): Do a heck of a lot more testing of protected member functions.
 
 }  // namespace block_graph
@@ -121,6 +121,27 @@ TEST(LabelTest, InitializationFullConstructor) {
   ASSERT_EQ(BlockGraph::CODE_LABEL, label.attributes());
 }
 
+TEST(LabelTest, CopyAndAssignment) {
+  BlockGraph::Label label("foo", BlockGraph::CODE_LABEL);
+
+  // A copy of a label that owns its name is independent of the original.
+  scoped_ptr<BlockGraph::Label> copy(new BlockGraph::Label(label));
+  BlockGraph::Label assigned;
+  assigned = *copy;
+  copy.reset();
+  ASSERT_EQ(label, assigned);
+  ASSERT_NE(&label.name(), &assigned.name());
+
+  // Copies of a label with an interned name share it.
+  std::string interned_name("bar");
+  BlockGraph::Label interned(&interned_name, BlockGraph::DATA_LABEL);
+  BlockGraph::Label interned_copy(interned);
+  ASSERT_EQ(&interned_name, &interned_copy.name());
+  assigned = interned;
+  ASSERT_EQ(&interned_name, &assigned.name());
+  ASSERT_EQ(BlockGraph::DATA_LABEL, assigned.attributes());
+}
+
 TEST(LabelTest, Attributes) {
   BlockGraph::Label label;
   ASSERT_EQ(0u, label.attributes());
@@ -318,6 +339,37 @@ TEST_F(BlockTest, GetMutableData) {
   ASSERT_EQ(data, block_->GetMutableData());
 }
 
+TEST_F(BlockTest, ShareData) {
+  BlockGraph::Block* other =
+      image_.AddBlock(kBlockType, kBlockSize, "other");
+  ASSERT_TRUE(other != NULL);
+
+  // Sharing data that isn't owned simply refers to it.
+  block_->SetData(kTestData, sizeof(kTestData));
+  other->ShareData(*block_);
+  ASSERT_EQ(kTestData, other->data());
+  ASSERT_EQ(sizeof(kTestData), other->data_size());
+  ASSERT_FALSE(other->owns_data());
+
+  // Owned data is shared without being copied.
+  const uint8* data = block_->CopyData(sizeof(kTestData), kTestData);
+  other->ShareData(*block_);
+  ASSERT_EQ(data, other->data());
+  ASSERT_TRUE(block_->owns_data());
+  ASSERT_TRUE(other->owns_data());
+
+  // Modifying either block gives it a private copy, leaving the other one
+  // untouched.
+  uint8* other_data = other->GetMutableData();
+  ASSERT_NE(data, other_data);
+  other_data[0] = ~kTestData[0];
+  ASSERT_EQ(data, block_->data());
+  ASSERT_EQ(0, memcmp(kTestData, block_->data(), sizeof(kTestData)));
+
+  // A block that is the last one holding its data modifies it in place.
+  ASSERT_EQ(data, block_->GetMutableData());
+}
+
 TEST_F(BlockTest, InsertData) {
   // Create a block with a labelled array of pointers. Explicitly initialize
   // the last one with some data and let the block be longer than its
@@ -911,6 +963,36 @@ TEST(BlockGraphTest, RemoveSection) {
   ASSERT_EQ(0u, image.sections().size());
 }
 
+TEST(BlockGraphTest, BlocksShareTheGraphArena) {
+  BlockGraph image;
+  BlockGraph::Block* b1 = image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "b1");
+  BlockGraph::Block* b2 = image.AddBlock(BlockGraph::DATA_BLOCK, 0x20, "b2");
+  ASSERT_TRUE(b1 != NULL);
+  ASSERT_TRUE(b2 != NULL);
+
+  BlockGraph::Reference ref(BlockGraph::ABSOLUTE_REF, 4, b2, 0, 0);
+  ASSERT_TRUE(b1->SetReference(0, ref));
+  ASSERT_TRUE(b1->SetLabel(0, "label", BlockGraph::CODE_LABEL));
+
+  // All of the block containers draw from the same arena as the block map.
+  core::Arena* arena = image.blocks().get_allocator().arena();
+  EXPECT_TRUE(arena != NULL);
+  EXPECT_EQ(arena, b1->references().get_allocator().arena());
+  EXPECT_EQ(arena, b1->labels().get_allocator().arena());
+  EXPECT_EQ(arena, b2->referrers().get_allocator().arena());
+
+  // Blocks of other graphs use their own arena.
+  BlockGraph other_image;
+  BlockGraph::Block* other_block =
+      other_image.AddBlock(BlockGraph::CODE_BLOCK, 0x20, "other_block");
+  EXPECT_NE(arena, other_block->references().get_allocator().arena());
+
+  // Removing the reference recycles its memory within the arena.
+  EXPECT_TRUE(b1->RemoveReference(0));
+  EXPECT_TRUE(b1->references().empty());
+  EXPECT_TRUE(b2->referrers().empty());
+}
+
 TEST(BlockGraphTest, RemoveBlock) {
   BlockGraph image;
 
@@ -1067,6 +1149,33 @@ TEST(BlockGraphTest, References) {
   EXPECT_THAT(b2->referrers(), BlockGraph::Block::ReferrerSet());
 }
 
+TEST(BlockGraphTest, LabelNamesAreInterned) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "block1");
+  BlockGraph::Block* block2 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 0x10, "block2");
+
+  ASSERT_TRUE(block1->SetLabel(0, "label", BlockGraph::CODE_LABEL));
+  ASSERT_TRUE(block1->SetLabel(4, "label", BlockGraph::DATA_LABEL));
+  ASSERT_TRUE(block2->SetLabel(8, "label", BlockGraph::CODE_LABEL));
+
+  BlockGraph::Label label1;
+  BlockGraph::Label label2;
+  BlockGraph::Label label3;
+  ASSERT_TRUE(block1->GetLabel(0, &label1));
+  ASSERT_TRUE(block1->GetLabel(4, &label2));
+  ASSERT_TRUE(block2->GetLabel(8, &label3));
+
+  // All of the labels refer to the same instance of their name, which lives
+  // in the string table of the block-graph.
+  EXPECT_EQ("label", label1.name());
+  EXPECT_EQ(&label1.name(), &label2.name());
+  EXPECT_EQ(&label1.name(), &label3.name());
+  EXPECT_EQ(&block_graph.string_table().InternString("label"),
+            &label1.name());
+}
+
 TEST(BlockGraphTest, Labels) {
   BlockGraph image;
 
@@ -0,0 +1,225 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/block_graph/block_hash_index.h"
+
+#include <algorithm>
+
+namespace block_graph {
+
+namespace {
+
+typedef BlockHashIndex::Entries Entries;
+typedef BlockHashIndex::Entry Entry;
+
+// This needs to be incremented any time a non-backwards compatible change is
+// made to the serialization format.
+const uint32 kBlockHashIndexVersion = 1;
+
+// Orders entries by hash, then by name. The block ID disambiguates the
+// remaining ties so that the order is deterministic.
+struct EntryLess {
+  bool operator()(const Entry& entry1, const Entry& entry2) const {
+    int compare = entry1.hash.Compare(entry2.hash);
+    if (compare != 0)
+      return compare < 0;
+    if (entry1.name != entry2.name)
+      return entry1.name < entry2.name;
+    return entry1.block_id < entry2.block_id;
+  }
+};
+
+// Compares an entry's hash to a hash, for the binary searches.
+struct EntryHashLess {
+  bool operator()(const Entry& entry, const BlockHash& hash) const {
+    return entry.hash.Compare(hash) < 0;
+  }
+  bool operator()(const BlockHash& hash, const Entry& entry) const {
+    return hash.Compare(entry.hash) < 0;
+  }
+};
+
+// @returns the end of the run of entries that share the hash of @p begin.
+Entries::const_iterator EndOfHash(Entries::const_iterator begin,
+                                  Entries::const_iterator end) {
+  DCHECK(begin != end);
+  Entries::const_iterator it = begin + 1;
+  while (it != end && it->hash == begin->hash)
+    ++it;
+  return it;
+}
+
+// @returns the end of the run of entries that share the name of @p begin.
+Entries::const_iterator EndOfName(Entries::const_iterator begin,
+                                  Entries::const_iterator end) {
+  DCHECK(begin != end);
+  Entries::const_iterator it = begin + 1;
+  while (it != end && it->name == begin->name)
+    ++it;
+  return it;
+}
+
+// Matches the entries of two runs of entries that share the same hash, by
+// name. Both runs are sorted by name.
+void MatchByName(Entries::const_iterator begin1,
+                 Entries::const_iterator end1,
+                 Entries::const_iterator begin2,
+                 Entries::const_iterator end2,
+                 BlockHashIndex::BlockIdMap* matches) {
+  DCHECK(matches != NULL);
+
+  while (begin1 != end1 && begin2 != end2) {
+    if (begin1->name < begin2->name) {
+      begin1 = EndOfName(begin1, end1);
+    } else if (begin2->name < begin1->name) {
+      begin2 = EndOfName(begin2, end2);
+    } else {
+      Entries::const_iterator name_end1 = EndOfName(begin1, end1);
+      Entries::const_iterator name_end2 = EndOfName(begin2, end2);
+      if (name_end1 - begin1 == 1 && name_end2 - begin2 == 1)
+        matches->insert(std::make_pair(begin1->block_id, begin2->block_id));
+      begin1 = name_end1;
+      begin2 = name_end2;
+    }
+  }
+}
+
+}  // namespace
+
+void BlockHashIndex::Init(const BlockGraph& block_graph) {
+  entries_.clear();
+  entries_.reserve(block_graph.blocks().size());
+
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    entries_.push_back(Entry());
+    Entry& entry = entries_.back();
+    entry.hash.Hash(&block);
+    entry.block_id = block.id();
+    entry.name = block.name();
+    entry.address = block.addr();
+  }
+
+  std::sort(entries_.begin(), entries_.end(), EntryLess());
+}
+
+std::pair<Entries::const_iterator, Entries::const_iterator>
+BlockHashIndex::Find(const BlockHash& hash) const {
+  return std::equal_range(entries_.begin(), entries_.end(), hash,
+                          EntryHashLess());
+}
+
+size_t BlockHashIndex::Match(const BlockHashIndex& other,
+                             BlockIdMap* matches) const {
+  DCHECK(matches != NULL);
+
+  matches->clear();
+
+  // Both indices are sorted by hash, so a single merge-like pass finds all
+  // the common hashes.
+  Entries::const_iterator it1 = entries_.begin();
+  Entries::const_iterator it2 = other.entries_.begin();
+  while (it1 != entries_.end() && it2 != other.entries_.end()) {
+    int compare = it1->hash.Compare(it2->hash);
+    if (compare < 0) {
+      ++it1;
+      continue;
+    }
+    if (compare > 0) {
+      ++it2;
+      continue;
+    }
+
+    Entries::const_iterator hash_end1 = EndOfHash(it1, entries_.end());
+    Entries::const_iterator hash_end2 = EndOfHash(it2, other.entries_.end());
+    if (hash_end1 - it1 == 1 && hash_end2 - it2 == 1)
+      matches->insert(std::make_pair(it1->block_id, it2->block_id));
+    else
+      MatchByName(it1, hash_end1, it2, hash_end2, matches);
+
+    it1 = hash_end1;
+    it2 = hash_end2;
+  }
+
+  return matches->size();
+}
+
+bool BlockHashIndex::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  if (!out_archive->Save(kBlockHashIndexVersion) ||
+      !out_archive->Save(entries_.size())) {
+    LOG(ERROR) << "Unable to save block hash index header.";
+    return false;
+  }
+
+  Entries::const_iterator it = entries_.begin();
+  for (; it != entries_.end(); ++it) {
+    const base::MD5Digest& digest = it->hash.md5_digest;
+    if (!out_archive->out_stream()->Write(sizeof(digest.a), digest.a) ||
+        !out_archive->Save(it->block_id) ||
+        !out_archive->Save(it->name) ||
+        !out_archive->Save(it->address)) {
+      LOG(ERROR) << "Unable to save block hash index entry for block with id "
+                 << it->block_id << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BlockHashIndex::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+
+  uint32 version = 0;
+  size_t count = 0;
+  if (!in_archive->Load(&version)) {
+    LOG(ERROR) << "Unable to load block hash index version.";
+    return false;
+  }
+  if (version != kBlockHashIndexVersion) {
+    LOG(ERROR) << "Unable to load block hash index with version " << version
+               << ".";
+    return false;
+  }
+  if (!in_archive->Load(&count)) {
+    LOG(ERROR) << "Unable to load block hash index entry count.";
+    return false;
+  }
+
+  Entries entries(count);
+  for (size_t i = 0; i < count; ++i) {
+    Entry& entry = entries[i];
+    base::MD5Digest& digest = entry.hash.md5_digest;
+    if (!in_archive->in_stream()->Read(sizeof(digest.a), digest.a) ||
+        !in_archive->Load(&entry.block_id) ||
+        !in_archive->Load(&entry.name) ||
+        !in_archive->Load(&entry.address)) {
+      LOG(ERROR) << "Unable to load block hash index entry " << i << " of "
+                 << count << ".";
+      return false;
+    }
+  }
+
+  // Don't rely on the serialized order, the matching depends on it.
+  std::sort(entries.begin(), entries.end(), EntryLess());
+  entries_.swap(entries);
+
+  return true;
+}
+
+}  // namespace block_graph
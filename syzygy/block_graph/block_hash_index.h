@@ -0,0 +1,99 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Declares BlockHashIndex, a content-addressed index of the blocks of a
+// block-graph. It can be generated once per build and persisted, and then used
+// to carry information keyed on blocks (profile data, orders, filters) from
+// one build over to the next: blocks whose content didn't change are matched
+// by their hash without running a full comparison of the block-graphs.
+
+#ifndef SYZYGY_BLOCK_GRAPH_BLOCK_HASH_INDEX_H_
+#define SYZYGY_BLOCK_GRAPH_BLOCK_HASH_INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/block_hash.h"
+#include "syzygy/core/address.h"
+#include "syzygy/core/serialization.h"
+
+namespace block_graph {
+
+class BlockHashIndex {
+ public:
+  // Describes an indexed block.
+  struct Entry {
+    Entry() : block_id(0) { }
+
+    // The hash of the content of the block.
+    BlockHash hash;
+    // The ID of the block in its block-graph.
+    BlockGraph::BlockId block_id;
+    // The name of the block.
+    std::string name;
+    // The address of the block in its original image, if any.
+    core::RelativeAddress address;
+  };
+  typedef std::vector<Entry> Entries;
+
+  // Maps the IDs of the blocks of an index to the IDs of their matching blocks
+  // in another index.
+  typedef std::map<BlockGraph::BlockId, BlockGraph::BlockId> BlockIdMap;
+
+  BlockHashIndex() { }
+
+  // Indexes all the blocks of @p block_graph, replacing any existing entries.
+  // @param block_graph the block-graph to index.
+  void Init(const BlockGraph& block_graph);
+
+  // @returns the entries of the index, sorted by hash then name.
+  const Entries& entries() const { return entries_; }
+
+  // Looks up the blocks with a given hash.
+  // @param hash the hash to look up.
+  // @returns the range of entries with the hash @p hash. It is empty if there
+  //     are none.
+  std::pair<Entries::const_iterator, Entries::const_iterator> Find(
+      const BlockHash& hash) const;
+
+  // Matches the blocks of this index to those of @p other. Blocks are matched
+  // when their hash is unique in both indices. When several blocks share a
+  // hash, they are matched by name, provided that the name is unique amongst
+  // them in both indices. Other blocks are left unmatched. This runs in time
+  // linear in the size of both indices.
+  // @param other the index to match against.
+  // @param matches receives the ID of the matching block in @p other for each
+  //     matched block of this index. It is cleared first.
+  // @returns the number of matched blocks.
+  size_t Match(const BlockHashIndex& other, BlockIdMap* matches) const;
+
+  // @name Serialization functions.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+
+ private:
+  // The indexed blocks, sorted by hash then name.
+  Entries entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockHashIndex);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_BLOCK_HASH_INDEX_H_
@@ -0,0 +1,135 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/block_graph/block_hash_index.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/serialization.h"
+
+namespace block_graph {
+
+namespace {
+
+const uint8 kData1[] = { 0x55, 0x8B, 0xEC, 0x5D, 0xC3 };
+const uint8 kData2[] = { 0x33, 0xC0, 0xC3 };
+
+// Adds a code block holding a copy of @p data to @p block_graph.
+template<size_t N>
+BlockGraph::Block* AddCodeBlock(const char* name,
+                                const uint8 (&data)[N],
+                                BlockGraph* block_graph) {
+  BlockGraph::Block* block =
+      block_graph->AddBlock(BlockGraph::CODE_BLOCK, N, name);
+  block->CopyData(N, data);
+  return block;
+}
+
+}  // namespace
+
+TEST(BlockHashIndexTest, InitAndFind) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block1 = AddCodeBlock("block1", kData1, &block_graph);
+  AddCodeBlock("block2", kData2, &block_graph);
+  block1->set_addr(core::RelativeAddress(0x1000));
+
+  BlockHashIndex index;
+  index.Init(block_graph);
+  EXPECT_EQ(2u, index.entries().size());
+
+  std::pair<BlockHashIndex::Entries::const_iterator,
+            BlockHashIndex::Entries::const_iterator> range =
+      index.Find(BlockHash(block1));
+  ASSERT_EQ(1, range.second - range.first);
+  EXPECT_EQ(block1->id(), range.first->block_id);
+  EXPECT_EQ("block1", range.first->name);
+  EXPECT_EQ(core::RelativeAddress(0x1000), range.first->address);
+
+  BlockGraph other_graph;
+  BlockGraph::Block* other = other_graph.AddBlock(BlockGraph::DATA_BLOCK,
+                                                  sizeof(kData1), "other");
+  other->CopyData(sizeof(kData1), kData1);
+  range = index.Find(BlockHash(other));
+  EXPECT_EQ(range.first, range.second);
+}
+
+TEST(BlockHashIndexTest, Match) {
+  BlockGraph old_graph;
+  BlockGraph::Block* old_unique = AddCodeBlock("unique", kData1, &old_graph);
+  BlockGraph::Block* old_dup1 = AddCodeBlock("dup1", kData2, &old_graph);
+  AddCodeBlock("dup2", kData2, &old_graph);
+  AddCodeBlock("dup", kData2, &old_graph);
+  AddCodeBlock("dup", kData2, &old_graph);
+
+  // The new build has an extra block ahead of the others, so the IDs are all
+  // different.
+  BlockGraph new_graph;
+  new_graph.AddBlock(BlockGraph::DATA_BLOCK, 4, "new");
+  BlockGraph::Block* new_unique =
+      AddCodeBlock("renamed", kData1, &new_graph);
+  AddCodeBlock("dup2_renamed", kData2, &new_graph);
+  BlockGraph::Block* new_dup1 = AddCodeBlock("dup1", kData2, &new_graph);
+  AddCodeBlock("dup", kData2, &new_graph);
+  AddCodeBlock("dup", kData2, &new_graph);
+
+  BlockHashIndex old_index;
+  old_index.Init(old_graph);
+  BlockHashIndex new_index;
+  new_index.Init(new_graph);
+
+  // The unique hash is matched despite the rename. Amongst the duplicated
+  // hashes only the uniquely named block can be matched.
+  BlockHashIndex::BlockIdMap matches;
+  EXPECT_EQ(2u, old_index.Match(new_index, &matches));
+  EXPECT_EQ(new_unique->id(), matches[old_unique->id()]);
+  EXPECT_EQ(new_dup1->id(), matches[old_dup1->id()]);
+}
+
+TEST(BlockHashIndexTest, RoundTrip) {
+  BlockGraph block_graph;
+  AddCodeBlock("block1", kData1, &block_graph)->set_addr(
+      core::RelativeAddress(0x1000));
+  AddCodeBlock("block2", kData2, &block_graph)->set_addr(
+      core::RelativeAddress(0x2000));
+
+  BlockHashIndex index;
+  index.Init(block_graph);
+
+  core::ByteVector bytes;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(bytes)));
+  core::NativeBinaryOutArchive out_archive(out_stream.get());
+  ASSERT_TRUE(index.Save(&out_archive));
+
+  core::MemoryInStream in_stream(&bytes[0], bytes.size());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  BlockHashIndex loaded;
+  ASSERT_TRUE(loaded.Load(&in_archive));
+
+  ASSERT_EQ(index.entries().size(), loaded.entries().size());
+  for (size_t i = 0; i < index.entries().size(); ++i) {
+    const BlockHashIndex::Entry& entry = index.entries()[i];
+    const BlockHashIndex::Entry& loaded_entry = loaded.entries()[i];
+    EXPECT_EQ(entry.hash, loaded_entry.hash);
+    EXPECT_EQ(entry.block_id, loaded_entry.block_id);
+    EXPECT_EQ(entry.name, loaded_entry.name);
+    EXPECT_EQ(entry.address, loaded_entry.address);
+  }
+
+  // A loaded index matches the original one completely.
+  BlockHashIndex::BlockIdMap matches;
+  EXPECT_EQ(2u, loaded.Match(index, &matches));
+}
+
+}  // namespace block_graph
@@ -189,4 +189,45 @@ bool GetJumpTableSize(const BlockGraph::Block* block,
   return true;
 }
 
+void MarkReachableBlocks(const BlockGraph& block_graph,
+                         const ConstBlockVector& roots,
+                         std::vector<bool>* reachable) {
+  DCHECK(reachable != NULL);
+
+  reachable->clear();
+  const BlockGraph::BlockMap& blocks = block_graph.blocks();
+  if (blocks.empty())
+    return;
+  reachable->resize(blocks.rbegin()->first + 1, false);
+
+  // Mark the roots as reachable.
+  ConstBlockVector working;
+  working.reserve(roots.size());
+  for (size_t i = 0; i < roots.size(); ++i) {
+    DCHECK(roots[i] != NULL);
+    DCHECK_LT(roots[i]->id(), reachable->size());
+    if ((*reachable)[roots[i]->id()])
+      continue;
+    (*reachable)[roots[i]->id()] = true;
+    working.push_back(roots[i]);
+  }
+
+  // Follow the reachable graph.
+  while (!working.empty()) {
+    const BlockGraph::Block* block = working.back();
+    working.pop_back();
+
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        block->references().begin();
+    for (; ref_it != block->references().end(); ++ref_it) {
+      const BlockGraph::Block* referenced = ref_it->second.referenced();
+      DCHECK_LT(referenced->id(), reachable->size());
+      if ((*reachable)[referenced->id()])
+        continue;
+      (*reachable)[referenced->id()] = true;
+      working.push_back(referenced);
+    }
+  }
+}
+
 }  // namespace block_graph
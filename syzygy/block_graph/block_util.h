@@ -17,6 +17,8 @@
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_UTIL_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_UTIL_H_
 
+#include <vector>
+
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -67,6 +69,25 @@ bool GetJumpTableSize(const block_graph::BlockGraph::Block* block,
     block_graph::BlockGraph::Block::LabelMap::const_iterator jump_table_label,
     size_t* table_size);
 
+// Marks the blocks that are reachable from a set of roots by following their
+// references. The visited blocks are tracked with a flat bit vector indexed by
+// block ID, so the walk is linear in the number of references.
+// @param block_graph The block graph containing the blocks.
+// @param roots The blocks from which the walk starts. These are reachable.
+// @param reachable Receives a bit per block ID, set iff the block with this
+//     ID is reachable.
+void MarkReachableBlocks(const BlockGraph& block_graph,
+                         const ConstBlockVector& roots,
+                         std::vector<bool>* reachable);
+
+// @returns true iff @p block is marked in @p reachable, as computed by
+//     MarkReachableBlocks.
+inline bool IsReachableBlock(const std::vector<bool>& reachable,
+                             const BlockGraph::Block* block) {
+  DCHECK(block != NULL);
+  return block->id() < reachable.size() && reachable[block->id()];
+}
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_BLOCK_UTIL_H_
@@ -221,6 +221,39 @@ TEST_F(BlockUtilTest, CheckInvalidRegisterUnexpectedStackFrameManipulation) {
   EXPECT_TRUE(HasUnexpectedStackFrameManipulation(&subgraph_));
 }
 
+TEST_F(BlockUtilTest, MarkReachableBlocks) {
+  std::vector<bool> reachable;
+  MarkReachableBlocks(image_, ConstBlockVector(), &reachable);
+  EXPECT_TRUE(reachable.empty());
+
+  // Build a chain b1 -> b2 -> b3, a cycle b4 <-> b5 and a lone block b6.
+  BlockGraph::Block* blocks[6] = {};
+  for (size_t i = 0; i < arraysize(blocks); ++i) {
+    blocks[i] = image_.AddBlock(BlockGraph::DATA_BLOCK, 4, "b");
+    ASSERT_TRUE(blocks[i] != NULL);
+  }
+  ASSERT_TRUE(blocks[0]->SetReference(0, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, blocks[1], 0, 0)));
+  ASSERT_TRUE(blocks[1]->SetReference(0, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, blocks[2], 0, 0)));
+  ASSERT_TRUE(blocks[3]->SetReference(0, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, blocks[4], 0, 0)));
+  ASSERT_TRUE(blocks[4]->SetReference(0, BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, blocks[3], 0, 0)));
+
+  ConstBlockVector roots;
+  roots.push_back(blocks[1]);
+  roots.push_back(blocks[4]);
+  MarkReachableBlocks(image_, roots, &reachable);
+
+  EXPECT_FALSE(IsReachableBlock(reachable, blocks[0]));
+  EXPECT_TRUE(IsReachableBlock(reachable, blocks[1]));
+  EXPECT_TRUE(IsReachableBlock(reachable, blocks[2]));
+  EXPECT_TRUE(IsReachableBlock(reachable, blocks[3]));
+  EXPECT_TRUE(IsReachableBlock(reachable, blocks[4]));
+  EXPECT_FALSE(IsReachableBlock(reachable, blocks[5]));
+}
+
 namespace {
 
 // A utility class for using the test data built around the function in
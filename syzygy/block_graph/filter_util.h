@@ -19,14 +19,19 @@
 #ifndef SYZYGY_BLOCK_GRAPH_FILTER_UTIL_H_
 #define SYZYGY_BLOCK_GRAPH_FILTER_UTIL_H_
 
+#include <vector>
+
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_filter.h"
+#include "syzygy/core/address_filter_bitmap.h"
 
 namespace block_graph {
 
 typedef core::AddressFilter<core::RelativeAddress, size_t>
     RelativeAddressFilter;
+typedef core::AddressFilterBitmap<core::RelativeAddress, size_t>
+    RelativeAddressFilterBitmap;
 
 // Determines if the given @p block is filtered. A block is filtered if any of
 // it's source data is marked in the filter.
@@ -56,6 +61,56 @@ bool IsFiltered(const RelativeAddressFilter& filter,
 bool IsFiltered(const RelativeAddressFilter& filter,
                 const block_graph::Instruction& instruction);
 
+// Versions of the above that consult an indexed filter. These give the same
+// results as querying the filter the bitmap was built from, but each source
+// range is checked in constant time.
+bool IsFiltered(const RelativeAddressFilterBitmap& filter,
+                const block_graph::BlockGraph::Block* block);
+bool IsFiltered(const RelativeAddressFilterBitmap& filter,
+                const block_graph::BasicBlock* basic_block);
+bool IsFiltered(const RelativeAddressFilterBitmap& filter,
+                const block_graph::BasicCodeBlock* basic_block);
+bool IsFiltered(const RelativeAddressFilterBitmap& filter,
+                const block_graph::BasicDataBlock* basic_block);
+bool IsFiltered(const RelativeAddressFilterBitmap& filter,
+                const block_graph::Instruction& instruction);
+
+// The outcome of checking every block of a block graph against a filter,
+// indexed by block ID. This is built once, and is never modified afterwards so
+// it may be shared by any number of transforms and queried concurrently.
+// Blocks added to the block graph after it was built are not covered by it.
+class FilteredBlockSet {
+ public:
+  // Checks all the blocks of @p block_graph against @p filter.
+  FilteredBlockSet(const RelativeAddressFilter& filter,
+                   const BlockGraph& block_graph);
+  FilteredBlockSet(const RelativeAddressFilterBitmap& filter,
+                   const BlockGraph& block_graph);
+
+  // @param block The block to be checked.
+  // @returns true if @p block existed when this set was built.
+  bool Covers(const BlockGraph::Block* block) const {
+    DCHECK(block != NULL);
+    return block->id() < filtered_.size();
+  }
+
+  // @param block The block to be checked. It must be covered by this set.
+  // @returns true if @p block is filtered.
+  bool IsFiltered(const BlockGraph::Block* block) const {
+    DCHECK(Covers(block));
+    return filtered_[block->id()];
+  }
+
+ private:
+  template<typename FilterType>
+  void Init(const FilterType& filter, const BlockGraph& block_graph);
+
+  // One bit per block ID, set for the filtered blocks.
+  std::vector<bool> filtered_;
+
+  DISALLOW_COPY_AND_ASSIGN(FilteredBlockSet);
+};
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_FILTER_UTIL_H_
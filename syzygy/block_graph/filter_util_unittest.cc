@@ -69,6 +69,15 @@ TEST(FilterUtilTest, IsFiltered) {
   EXPECT_FALSE(IsFiltered(f, data_bb_ptr));
   EXPECT_FALSE(IsFiltered(f, inst));
 
+  // An index of the filter should agree.
+  RelativeAddressFilterBitmap b(f);
+  EXPECT_FALSE(IsFiltered(b, block));
+  EXPECT_FALSE(IsFiltered(b, code_bb));
+  EXPECT_FALSE(IsFiltered(b, data_bb));
+  EXPECT_FALSE(IsFiltered(b, code_bb_ptr));
+  EXPECT_FALSE(IsFiltered(b, data_bb_ptr));
+  EXPECT_FALSE(IsFiltered(b, inst));
+
   // Now mark a conflicting range in the filter.
   f.Mark(Range(RelativeAddress(30), 10));
 
@@ -79,6 +88,61 @@ TEST(FilterUtilTest, IsFiltered) {
   EXPECT_TRUE(IsFiltered(f, code_bb_ptr));
   EXPECT_TRUE(IsFiltered(f, data_bb_ptr));
   EXPECT_TRUE(IsFiltered(f, inst));
+
+  b = RelativeAddressFilterBitmap(f);
+  EXPECT_TRUE(IsFiltered(b, block));
+  EXPECT_TRUE(IsFiltered(b, code_bb));
+  EXPECT_TRUE(IsFiltered(b, data_bb));
+  EXPECT_TRUE(IsFiltered(b, code_bb_ptr));
+  EXPECT_TRUE(IsFiltered(b, data_bb_ptr));
+  EXPECT_TRUE(IsFiltered(b, inst));
+}
+
+TEST(FilterUtilTest, FilteredBlockSet) {
+  BlockGraph block_graph;
+  BlockGraph::Block* block1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10, "block1");
+  BlockGraph::Block* block2 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10, "block2");
+  BlockGraph::Block* block3 =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 10, "block3");
+  EXPECT_TRUE(block1->source_ranges().Push(
+        BlockGraph::Block::SourceRanges::SourceRange(0, 10),
+        BlockGraph::Block::SourceRanges::DestinationRange(
+            RelativeAddress(0), 10)));
+  EXPECT_TRUE(block2->source_ranges().Push(
+        BlockGraph::Block::SourceRanges::SourceRange(0, 10),
+        BlockGraph::Block::SourceRanges::DestinationRange(
+            RelativeAddress(10), 10)));
+  EXPECT_TRUE(block3->source_ranges().Push(
+        BlockGraph::Block::SourceRanges::SourceRange(0, 10),
+        BlockGraph::Block::SourceRanges::DestinationRange(
+            RelativeAddress(20), 10)));
+
+  // Remove a block so that there is a gap in the IDs.
+  EXPECT_TRUE(block_graph.RemoveBlock(block2));
+
+  RelativeAddressFilter f(Range(RelativeAddress(0), 100));
+  f.Mark(Range(RelativeAddress(25), 10));
+
+  FilteredBlockSet filtered(f, block_graph);
+  EXPECT_TRUE(filtered.Covers(block1));
+  EXPECT_TRUE(filtered.Covers(block3));
+  EXPECT_EQ(IsFiltered(f, block1), filtered.IsFiltered(block1));
+  EXPECT_EQ(IsFiltered(f, block3), filtered.IsFiltered(block3));
+  EXPECT_FALSE(filtered.IsFiltered(block1));
+  EXPECT_TRUE(filtered.IsFiltered(block3));
+
+  // An index of the filter gives the same result.
+  RelativeAddressFilterBitmap b(f);
+  FilteredBlockSet filtered_from_bitmap(b, block_graph);
+  EXPECT_FALSE(filtered_from_bitmap.IsFiltered(block1));
+  EXPECT_TRUE(filtered_from_bitmap.IsFiltered(block3));
+
+  // Blocks added later aren't covered.
+  BlockGraph::Block* block4 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10, "block4");
+  EXPECT_FALSE(filtered.Covers(block4));
 }
 
 }  // namespace block_graph
@@ -18,6 +18,10 @@ namespace block_graph {
 
 bool Filterable::IsFiltered(const block_graph::BlockGraph::Block* block) const {
   DCHECK(block != NULL);
+  if (filtered_blocks_ != NULL && filtered_blocks_->Covers(block))
+    return filtered_blocks_->IsFiltered(block);
+  if (filter_bitmap_ != NULL)
+    return block_graph::IsFiltered(*filter_bitmap_, block);
   if (filter_ == NULL)
     return false;
   return block_graph::IsFiltered(*filter_, block);
@@ -25,6 +29,8 @@ bool Filterable::IsFiltered(const block_graph::BlockGraph::Block* block) const {
 
 bool Filterable::IsFiltered(const block_graph::BasicBlock* basic_block) const {
   DCHECK(basic_block != NULL);
+  if (filter_bitmap_ != NULL)
+    return block_graph::IsFiltered(*filter_bitmap_, basic_block);
   if (filter_ == NULL)
     return false;
   return block_graph::IsFiltered(*filter_, basic_block);
@@ -33,6 +39,8 @@ bool Filterable::IsFiltered(const block_graph::BasicBlock* basic_block) const {
 bool Filterable::IsFiltered(
     const block_graph::BasicCodeBlock* basic_block) const {
   DCHECK(basic_block != NULL);
+  if (filter_bitmap_ != NULL)
+    return block_graph::IsFiltered(*filter_bitmap_, basic_block);
   if (filter_ == NULL)
     return false;
   return block_graph::IsFiltered(*filter_, basic_block);
@@ -41,12 +49,16 @@ bool Filterable::IsFiltered(
 bool Filterable::IsFiltered(
     const block_graph::BasicDataBlock* basic_block) const {
   DCHECK(basic_block != NULL);
+  if (filter_bitmap_ != NULL)
+    return block_graph::IsFiltered(*filter_bitmap_, basic_block);
   if (filter_ == NULL)
     return false;
   return block_graph::IsFiltered(*filter_, basic_block);
 }
 
 bool Filterable::IsFiltered(const block_graph::Instruction& instruction) const {
+  if (filter_bitmap_ != NULL)
+    return block_graph::IsFiltered(*filter_bitmap_, instruction);
   if (filter_ == NULL)
     return false;
   return block_graph::IsFiltered(*filter_, instruction);
@@ -24,18 +24,54 @@ namespace block_graph {
 
 class Filterable {
  public:
-  Filterable() : filter_(NULL) { }
-  explicit Filterable(const RelativeAddressFilter* filter) : filter_(filter) { }
+  Filterable()
+      : filter_(NULL), filter_bitmap_(NULL), filtered_blocks_(NULL) {
+  }
+  explicit Filterable(const RelativeAddressFilter* filter)
+      : filter_(filter), filter_bitmap_(NULL), filtered_blocks_(NULL) {
+  }
 
-  // Sets the filter to be used by this object.
+  // Sets the filter to be used by this object. This clears any index of the
+  // filter that was previously set.
   // @param filter The filter to use. May be NULL.
   void set_filter(const RelativeAddressFilter* filter) {
     filter_ = filter;
+    filter_bitmap_ = NULL;
+    filtered_blocks_ = NULL;
   }
 
   // Returns the filter currently used by this object.
   const RelativeAddressFilter* filter() const { return filter_; }
 
+  // Sets an index of the filter to be consulted in its place. This is worth
+  // doing when a lot of objects are checked against an unchanging filter.
+  // @param filter_bitmap The index to use. This must have been built from the
+  //     current filter, which must not be modified while the index is in use.
+  //     May be NULL.
+  void set_filter_bitmap(const RelativeAddressFilterBitmap* filter_bitmap) {
+    DCHECK(filter_bitmap == NULL || filter_ != NULL);
+    filter_bitmap_ = filter_bitmap;
+  }
+
+  // Returns the index of the filter currently used by this object.
+  const RelativeAddressFilterBitmap* filter_bitmap() const {
+    return filter_bitmap_;
+  }
+
+  // Sets the precomputed outcome of checking the blocks against the filter.
+  // Blocks covered by it are not checked against the filter again, the others
+  // are.
+  // @param filtered_blocks The set to use. This must have been built from the
+  //     current filter, which must not be modified while the set is in use.
+  //     May be NULL.
+  void set_filtered_blocks(const FilteredBlockSet* filtered_blocks) {
+    DCHECK(filtered_blocks == NULL || filter_ != NULL);
+    filtered_blocks_ = filtered_blocks;
+  }
+
+  // Returns the precomputed filtered blocks used by this object.
+  const FilteredBlockSet* filtered_blocks() const { return filtered_blocks_; }
+
   // Determines if the given object is filtered.
   // @param basic_block The basic block to be checked.
   // @returns true if the object filtered, false otherwise.
@@ -48,6 +84,8 @@ class Filterable {
 
  private:
   const RelativeAddressFilter* filter_;
+  const RelativeAddressFilterBitmap* filter_bitmap_;
+  const FilteredBlockSet* filtered_blocks_;
 
   DISALLOW_COPY_AND_ASSIGN(Filterable);
 };
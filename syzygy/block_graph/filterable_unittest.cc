@@ -44,8 +44,20 @@ TEST(FilterableTest, Accessors)  {
   f.set_filter(&raf);
   EXPECT_EQ(&raf, f.filter());
 
+  RelativeAddressFilterBitmap bitmap(raf);
+  f.set_filter_bitmap(&bitmap);
+  EXPECT_EQ(&bitmap, f.filter_bitmap());
+
+  BlockGraph block_graph;
+  FilteredBlockSet filtered_blocks(raf, block_graph);
+  f.set_filtered_blocks(&filtered_blocks);
+  EXPECT_EQ(&filtered_blocks, f.filtered_blocks());
+
+  // Changing the filter drops the indexes.
   f.set_filter(NULL);
   EXPECT_TRUE(f.filter() == NULL);
+  EXPECT_TRUE(f.filter_bitmap() == NULL);
+  EXPECT_TRUE(f.filtered_blocks() == NULL);
 }
 
 TEST(FilterableTest, IsFiltered) {
@@ -113,6 +125,23 @@ TEST(FilterableTest, IsFiltered) {
   EXPECT_TRUE(f.IsFiltered(code_bb_ptr));
   EXPECT_TRUE(f.IsFiltered(data_bb_ptr));
   EXPECT_TRUE(f.IsFiltered(inst));
+
+  // An index of the filter is consulted in its place.
+  RelativeAddressFilterBitmap bitmap(raf);
+  f.set_filter_bitmap(&bitmap);
+  EXPECT_TRUE(f.IsFiltered(block));
+  EXPECT_TRUE(f.IsFiltered(code_bb));
+  EXPECT_TRUE(f.IsFiltered(data_bb));
+  EXPECT_TRUE(f.IsFiltered(code_bb_ptr));
+  EXPECT_TRUE(f.IsFiltered(data_bb_ptr));
+  EXPECT_TRUE(f.IsFiltered(inst));
+
+  // Precomputed results are used for the blocks they cover.
+  RelativeAddressFilter empty_raf(Range(RelativeAddress(0), 100));
+  FilteredBlockSet unfiltered_blocks(empty_raf, block_graph);
+  f.set_filtered_blocks(&unfiltered_blocks);
+  EXPECT_FALSE(f.IsFiltered(block));
+  EXPECT_TRUE(f.IsFiltered(code_bb));
 }
 
 }  // namespace block_graph
@@ -36,19 +36,6 @@ struct OrderedBlockGraph::CompareSectionInfo {
   }
 };
 
-// This is used for sorting and searching through the block index.
-struct OrderedBlockGraph::CompareBlockInfo {
-  bool operator()(const BlockInfo& b1, const BlockInfo& b2) const {
-    return *b1.it < *b2.it;
-  }
-  bool operator()(const BlockInfo& b1, const Block* b2) const {
-    return *b1.it < b2;
-  }
-  bool operator()(const Block* b1, const BlockInfo& b2) const {
-    return b1 < *b2.it;
-  }
-};
-
 OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
     : block_graph_(block_graph) {
   DCHECK(block_graph != NULL);
@@ -85,13 +72,16 @@ OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
 
   // Iterate through the blocks and place them into the appropriate BlockLists.
   // Each sections BlockList will contain the blocks in the order of their
-  // block graph ID.
-  block_infos_.resize(block_graph_->blocks().size());
+  // block graph ID. The block infos are indexed by block ID, so that
+  // GetBlockInfo is a constant time operation.
   BlockGraph::BlockMap::iterator block_it =
       block_graph_->blocks_mutable().begin();
   BlockGraph::BlockMap::iterator block_end =
       block_graph_->blocks_mutable().end();
-  for (size_t i = 0; block_it != block_end; ++block_it, ++i) {
+  if (block_it != block_end)
+    block_infos_.resize(block_graph_->blocks().rbegin()->first + 1);
+  for (; block_it != block_end; ++block_it) {
+    size_t i = block_it->first;
     DCHECK_LT(i, block_infos_.size());
     // Get the SectionInfo for the section containing the block.
     BlockGraph::SectionId section_id = block_it->second.section();
@@ -106,9 +96,6 @@ OrderedBlockGraph::OrderedBlockGraph(BlockGraph* block_graph)
     block_infos_[i].it = ordered_section->ordered_blocks_.insert(
         ordered_section->ordered_blocks_.end(), block);
   }
-
-  // Sort the BlockInfos so that we can use GetBlockInfo.
-  std::sort(block_infos_.begin(), block_infos_.end(), CompareBlockInfo());
 }
 
 const OrderedBlockGraph::OrderedSection& OrderedBlockGraph::ordered_section(
@@ -324,6 +311,40 @@ void OrderedBlockGraph::PlaceAfter(const BlockGraph::Block* anchored_block,
   DCHECK_EQ(*(moved->it), moved_block);
 }
 
+void OrderedBlockGraph::ApplyOrder(const Section* section,
+                                   const std::vector<Block*>& blocks) {
+  SectionInfo* section_info = GetSectionInfo(section);
+  DCHECK(section_info != NULL);
+
+  OrderedSection* ordered_section = &section_info->ordered_section;
+  BlockList& section_blocks(ordered_section->ordered_blocks_);
+
+  // The blocks are moved one by one right before this cursor, which follows
+  // the last placed block.
+  BlockList::iterator cursor = section_blocks.begin();
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    Block* block = blocks[i];
+    DCHECK(block != NULL);
+
+    BlockInfo* block_info = GetBlockInfo(block);
+    DCHECK(block_info != NULL);
+
+    // Already there? Move on to the next position.
+    if (block_info->it == cursor) {
+      ++cursor;
+      continue;
+    }
+
+    section_blocks.splice(cursor,
+                          block_info->ordered_section->ordered_blocks_,
+                          block_info->it);
+    --(block_info->it = cursor);
+    block_info->ordered_section = ordered_section;
+    block->set_section(section_info->id());
+    DCHECK_EQ(*(block_info->it), block);
+  }
+}
+
 const OrderedBlockGraph::SectionInfo* OrderedBlockGraph::GetSectionInfo(
     const Section* section) const {
   // Special case: the catch all section, which actually does not correspond
@@ -352,14 +373,12 @@ OrderedBlockGraph::SectionInfo* OrderedBlockGraph::GetSectionInfo(
 
 const OrderedBlockGraph::BlockInfo* OrderedBlockGraph::GetBlockInfo(
     const Block* block) const {
-  std::vector<BlockInfo>::const_iterator it =
-      std::lower_bound(block_infos_.begin(),
-                       block_infos_.end(),
-                       block,
-                       CompareBlockInfo());
-  DCHECK(it != block_infos_.end());
-  DCHECK_EQ(block, *(it->it));
-  return &(*it);
+  DCHECK(block != NULL);
+  DCHECK_LT(block->id(), block_infos_.size());
+  const BlockInfo* block_info = &block_infos_[block->id()];
+  DCHECK(block_info->ordered_section != NULL);
+  DCHECK_EQ(block, *(block_info->it));
+  return block_info;
 }
 
 OrderedBlockGraph::BlockInfo* OrderedBlockGraph::GetBlockInfo(
@@ -211,12 +211,24 @@ class OrderedBlockGraph {
   template<typename BlockCompareFunctor>
   void Sort(const Section* section, BlockCompareFunctor block_compare_functor);
 
+  // Moves the given blocks to the head of the given section, in the given
+  // order. The blocks that are not listed are left after them, in their
+  // current relative order. Blocks that do not belong to that section will
+  // have their section_id updated. Without duplicates this is equivalent to
+  // calling PlaceAtHead for each of the blocks in reverse order, but it is
+  // cheaper for large orders.
+  //
+  // @param section the section into which the blocks should be placed. May be
+  //     NULL, indicating that the blocks lie outside of all known sections.
+  // @param blocks the blocks to be moved, in order. A block listed more than
+  //     once ends up at the position of its last occurrence.
+  void ApplyOrder(const Section* section, const std::vector<Block*>& blocks);
+
  protected:
   // Forward declarations.
   struct SectionInfo;
   struct BlockInfo;
   struct CompareSectionInfo;
-  struct CompareBlockInfo;
 
   // @{
   // @returns the SectionInfo representing the given Section*.
@@ -244,9 +256,10 @@ class OrderedBlockGraph {
   std::vector<SectionInfo> section_infos_;
   // Stores a full set of iterators pointing to all of the blocks in the various
   // OrderedSection BlockLists. This is allocated once and reused. The entries
-  // are sorted based on the block pointers referred to by the iterators. In
-  // this way we can do a fast lookup from Block* to the BlockList containing
-  // it, as well as the iterator to it.
+  // are indexed by the IDs of the blocks referred to by the iterators. In this
+  // way we can do a constant time lookup from Block* to the BlockList
+  // containing it, as well as the iterator to it. The entries of the IDs that
+  // don't correspond to any block have a NULL ordered section.
   std::vector<BlockInfo> block_infos_;
 
   DISALLOW_COPY_AND_ASSIGN(OrderedBlockGraph);
@@ -36,6 +36,8 @@ struct OrderedBlockGraph::SectionInfo {
 };
 
 struct OrderedBlockGraph::BlockInfo {
+  BlockInfo() : ordered_section(NULL) { }
+
   // The iterator pointing to the list node storing a block.
   BlockList::iterator it;
   // The ordered section owning the list to which the iterator belongs.
@@ -121,44 +123,19 @@ void OrderedBlockGraph::Sort(const Section* section,
   SectionInfo* section_info = GetSectionInfo(section);
   DCHECK(section_info != NULL);
 
-  // Build an index which can be used to find the BlockInfo index from a
-  // Block*.
-  typedef std::vector<std::pair<Block*, size_t>> ReverseIndex;
-  ReverseIndex rindex;
   BlockList& blocks(section_info->ordered_section.ordered_blocks_);
-  rindex.reserve(blocks.size());
-  BlockList::iterator it = blocks.begin();
-  for (; it != blocks.end(); ++it) {
-    Block* block = *it;
-    DCHECK(block != NULL);
-
-    BlockInfo* block_info = GetBlockInfo(block);
-    DCHECK(block_info != NULL);
-
-    size_t index = block_info - &block_infos_[0];
-    rindex.push_back(std::make_pair(block, index));
-  }
-  // Sort this based on Block*, which std::pair does for us by default.
-  std::sort(rindex.begin(), rindex.end());
-
   typedef internal::BlockListSortAdapter<BlockCompareFunctor> Adapter;
   internal::SortList(Adapter(block_compare_functor),
-                     rindex.size(),
+                     blocks.size(),
                      &blocks);
 
-  // Rebuild the block index using the index to find the affected BlockInfo
-  // entries.
-  for (it = blocks.begin(); it != blocks.end(); ++it) {
+  // Rebuild the block index for the affected blocks.
+  BlockList::iterator it = blocks.begin();
+  for (; it != blocks.end(); ++it) {
     Block* block = *it;
     DCHECK(block != NULL);
-
-    ReverseIndex::const_iterator rindex_it = std::lower_bound(
-        rindex.begin(), rindex.end(),
-        std::make_pair(block, static_cast<size_t>(0)));
-    DCHECK(rindex_it != rindex.end());
-    DCHECK_EQ(rindex_it->first, block);
-
-    block_infos_[rindex_it->second].it = it;
+    DCHECK_LT(block->id(), block_infos_.size());
+    block_infos_[block->id()].it = it;
   }
 }
 
@@ -403,6 +403,46 @@ TEST_F(OrderedBlockGraphTest, BlockChangeToAnotherSectionAndBack) {
   ordered.PlaceAtHead(section0, block1);
 }
 
+TEST_F(OrderedBlockGraphTest, BlockApplyOrder) {
+  InitBlockGraph(2, 3, 0);
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 1, 2, 3);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 5, 6);
+
+  BlockGraph::Section* section0 = block_graph_.GetSectionById(0);
+  BlockVector blocks;
+  blocks.push_back(block_graph_.GetBlockById(5));
+  blocks.push_back(block_graph_.GetBlockById(3));
+  blocks.push_back(block_graph_.GetBlockById(1));
+  ordered.ApplyOrder(section0, blocks);
+  EXPECT_EQ(0, blocks[0]->section());
+  EXPECT_SECTION_CONTAINS(ordered, 0, 5, 3, 1, 2);
+  EXPECT_SECTION_CONTAINS(ordered, 1, 4, 6);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+
+  // Applying a prefix of the current order should be a noop.
+  blocks.pop_back();
+  ordered.ApplyOrder(section0, blocks);
+  EXPECT_SECTION_CONTAINS(ordered, 0, 5, 3, 1, 2);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+
+  // An empty order should be a noop too.
+  ordered.ApplyOrder(section0, BlockVector());
+  EXPECT_SECTION_CONTAINS(ordered, 0, 5, 3, 1, 2);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
+TEST_F(OrderedBlockGraphTest, BlockIndexWithMissingIds) {
+  InitBlockGraph(0, 0, 4);
+  ASSERT_TRUE(block_graph_.RemoveBlockById(2));
+  TestOrderedBlockGraph ordered(&block_graph_);
+  EXPECT_SECTION_CONTAINS(ordered, NULL, 1, 3, 4);
+
+  ordered.PlaceAtHead(NULL, block_graph_.GetBlockById(4));
+  EXPECT_SECTION_CONTAINS(ordered, NULL, 4, 1, 3);
+  EXPECT_TRUE(ordered.IndicesAreValid());
+}
+
 TEST_F(OrderedBlockGraphTest, BlockEmpty) {
   InitBlockGraph(0, 0, 0);
   TestOrderedBlockGraph ordered(&block_graph_);
@@ -14,12 +14,116 @@
 
 #include "syzygy/block_graph/transform.h"
 
+#include <set>
+
+#include "base/atomicops.h"
+#include "base/stl_util.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 
 namespace block_graph {
 
+namespace {
+
+// The number of blocks decomposed per worker thread in each batch.
+const size_t kBlocksPerThreadPerBatch = 32;
+
+// The outcome of decomposing and transforming a single block.
+struct BlockTransformResult {
+  BlockTransformResult()
+      : block(NULL), succeeded(false), unsupported_instructions(false) {
+  }
+
+  BlockGraph::Block* block;
+  BasicBlockSubGraph subgraph;
+  bool succeeded;
+  bool unsupported_instructions;
+};
+
+// Decomposes and transforms the block of @p result, filling in the rest of
+// @p result. This only reads the block graph.
+void DecomposeAndTransformBlock(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockTransformResult* result) {
+  DCHECK(result != NULL);
+  DCHECK(result->block != NULL);
+
+  BasicBlockDecomposer bb_decomposer(result->block, &result->subgraph);
+  bb_decomposer.set_instruction_cache(block_graph->instruction_cache());
+  if (!bb_decomposer.Decompose()) {
+    result->unsupported_instructions =
+        bb_decomposer.contains_unsupported_instructions();
+    return;
+  }
+
+  result->succeeded = transform->TransformBasicBlockSubGraph(
+      policy, block_graph, &result->subgraph);
+}
+
+// Shares out a batch of blocks among the worker threads.
+class BatchTransformer : public base::DelegateSimpleThread::Delegate {
+ public:
+  BatchTransformer(BasicBlockSubGraphTransformInterface* transform,
+                   const TransformPolicyInterface* policy,
+                   BlockGraph* block_graph,
+                   std::vector<BlockTransformResult*>* results)
+      : transform_(transform), policy_(policy), block_graph_(block_graph),
+        results_(results), next_result_(0) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    while (true) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_result_, 1));
+      if (index > results_->size())
+        return;
+      DecomposeAndTransformBlock(transform_, policy_, block_graph_,
+                                 (*results_)[index - 1]);
+    }
+  }
+  // @}
+
+ private:
+  BasicBlockSubGraphTransformInterface* transform_;
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+  std::vector<BlockTransformResult*>* results_;
+
+  // One past the index of the next result to fill in.
+  base::subtle::Atomic32 next_result_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchTransformer);
+};
+
+// @returns true if @p block references or is referred to by a block in
+//     @p batch_blocks.
+bool IsConnectedToBatch(const BlockGraph::Block* block,
+                        const std::set<const BlockGraph::Block*>& batch_blocks) {
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      block->references().begin();
+  for (; ref_it != block->references().end(); ++ref_it) {
+    if (batch_blocks.count(ref_it->second.referenced()) != 0)
+      return true;
+  }
+
+  BlockGraph::Block::ReferrerSet::const_iterator referrer_it =
+      block->referrers().begin();
+  for (; referrer_it != block->referrers().end(); ++referrer_it) {
+    if (batch_blocks.count(referrer_it->first) != 0)
+      return true;
+  }
+
+  return false;
+}
+
+}  // namespace
+
 bool ApplyBlockGraphTransform(BlockGraphTransformInterface* transform,
                               const TransformPolicyInterface* policy,
                               BlockGraph* block_graph,
@@ -91,6 +195,7 @@ bool ApplyBasicBlockSubGraphTransform(
   // Decompose block to basic blocks.
   BasicBlockSubGraph subgraph;
   BasicBlockDecomposer bb_decomposer(block, &subgraph);
+  bb_decomposer.set_instruction_cache(block_graph->instruction_cache());
   if (!bb_decomposer.Decompose()) {
     // If the failure is due to unsupported instructions then simply mark the
     // block as undecomposable so it won't be processed again.
@@ -136,6 +241,7 @@ bool ApplyBasicBlockSubGraphTransforms(
   // Decompose block to basic blocks.
   BasicBlockSubGraph subgraph;
   BasicBlockDecomposer bb_decomposer(block, &subgraph);
+  bb_decomposer.set_instruction_cache(block_graph->instruction_cache());
   if (!bb_decomposer.Decompose())
     return false;
 
@@ -162,4 +268,85 @@ bool ApplyBasicBlockSubGraphTransforms(
   return true;
 }
 
+bool ApplyBasicBlockSubGraphTransformInParallel(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    const BlockVector& blocks,
+    size_t num_threads) {
+  DCHECK(transform != NULL);
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK_LT(0U, num_threads);
+
+  // The workers share the decoded instruction cache, create it ahead of them.
+  block_graph->instruction_cache();
+
+  const size_t max_batch_size = num_threads * kBlocksPerThreadPerBatch;
+  size_t next_block = 0;
+  while (next_block < blocks.size()) {
+    // Gather a batch of consecutive blocks that aren't connected to one
+    // another. The batch ends at the first block connected to it, which starts
+    // the next batch once the blocks it's connected to have been merged. Since
+    // the blocks are merged in the order they're given, the new blocks get the
+    // same IDs as when the blocks are transformed one at a time.
+    std::set<const BlockGraph::Block*> batch_blocks;
+    std::vector<BlockTransformResult*> results;
+    for (; next_block < blocks.size(); ++next_block) {
+      BlockGraph::Block* block = blocks[next_block];
+      DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
+      DCHECK(policy->BlockIsSafeToBasicBlockDecompose(block));
+      if (results.size() == max_batch_size ||
+          IsConnectedToBatch(block, batch_blocks)) {
+        break;
+      }
+      batch_blocks.insert(block);
+      results.push_back(new BlockTransformResult());
+      results.back()->block = block;
+    }
+    DCHECK(!results.empty());
+
+    // Decompose and transform the batch. The block graph is only read until
+    // all of the workers are done.
+    BatchTransformer batch_transformer(transform, policy, block_graph,
+                                       &results);
+    if (num_threads == 1) {
+      batch_transformer.Run();
+    } else {
+      base::DelegateSimpleThreadPool pool("BasicBlockTransform", num_threads);
+      pool.Start();
+      pool.AddWork(&batch_transformer, num_threads);
+      pool.JoinAll();
+    }
+
+    // Merge the batch back into the block graph, in order.
+    bool succeeded = true;
+    for (size_t i = 0; i < results.size() && succeeded; ++i) {
+      BlockTransformResult* result = results[i];
+      if (!result->succeeded) {
+        // Blocks with unsupported instructions are marked as undecomposable so
+        // they won't be processed again, as ApplyBasicBlockSubGraphTransform
+        // does.
+        if (result->unsupported_instructions) {
+          VLOG(1) << "Block contains unsupported instruction(s): "
+                  << BlockInfo(result->block);
+          result->block->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
+          continue;
+        }
+        succeeded = false;
+        break;
+      }
+
+      BlockBuilder builder(block_graph);
+      succeeded = builder.Merge(&result->subgraph);
+    }
+
+    STLDeleteElements(&results);
+    if (!succeeded)
+      return false;
+  }
+
+  return true;
+}
+
 }  // namespace block_graph
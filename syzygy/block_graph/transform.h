@@ -138,6 +138,33 @@ bool ApplyBasicBlockSubGraphTransforms(
     BlockGraph::Block* block,
     BlockVector* new_blocks);
 
+// Applies the provided BasicBlockSubGraphTransform to a set of blocks, with the
+// same results as applying it to each block in turn. The blocks are basic-block
+// decomposed and transformed in batches on a pool of worker threads, and each
+// batch is then merged back into the block graph, one block at a time, on the
+// calling thread. Blocks that reference one another are never in the same
+// batch, so that each block is decomposed against an up to date graph. The
+// blocks are merged in the order they are given, so the resulting block graph,
+// down to the IDs of the new blocks, doesn't depend on the number of threads.
+//
+// @param transform the transform to apply. Its TransformBasicBlockSubGraph
+//     function must be safe to call concurrently for distinct subgraphs, and
+//     must not modify the block graph.
+// @param policy The policy object restricting how the transform is applied.
+// @param block_graph the block graph containing the blocks to be transformed.
+// @param blocks the blocks to be transformed.
+// @param num_threads the number of worker threads to use. If this is one the
+//     blocks are transformed on the calling thread.
+// @pre each block must be a code block that is safe to decompose.
+// @returns true on success, false otherwise. On failure the blocks merged
+//     before the failing one remain transformed.
+bool ApplyBasicBlockSubGraphTransformInParallel(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    const BlockVector& blocks,
+    size_t num_threads);
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
@@ -16,6 +16,7 @@
 
 #include "syzygy/block_graph/transform.h"
 
+#include "base/atomicops.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/unittest_util.h"
@@ -153,6 +154,33 @@ class MockBasicBlockSubGraphTransform :
                     BasicBlockSubGraph*));
 };
 
+// A transform that counts its invocations, and that can be called from several
+// threads at once. gmock mocks can't be.
+class CountingBasicBlockSubGraphTransform :
+    public BasicBlockSubGraphTransformInterface {
+ public:
+  explicit CountingBasicBlockSubGraphTransform(bool result)
+      : result_(result), count_(0) {
+  }
+
+  virtual const char* name() const {
+    return "CountingBasicBlockSubGraphTransform";
+  }
+
+  virtual bool TransformBasicBlockSubGraph(const TransformPolicyInterface*,
+                                           BlockGraph*,
+                                           BasicBlockSubGraph*) {
+    base::subtle::NoBarrier_AtomicIncrement(&count_, 1);
+    return result_;
+  }
+
+  size_t count() const { return static_cast<size_t>(count_); }
+
+ private:
+  bool result_;
+  base::subtle::Atomic32 count_;
+};
+
 }  // namespace
 
 TEST_F(ApplyBlockGraphTransformTest, NormalTransformSucceeds) {
@@ -276,6 +304,27 @@ TEST_F(ApplyBasicBlockSubGraphTransformTest, EmptyTransformSucceeds) {
   EXPECT_EQ(new_block, ref.referenced());
 }
 
+TEST_F(ApplyBasicBlockSubGraphTransformTest, DecodedInstructionsAreCached) {
+  core::DecodedInstructionCache* cache = block_graph_.instruction_cache();
+  ASSERT_TRUE(cache != NULL);
+  EXPECT_EQ(0U, cache->hits());
+
+  CountingBasicBlockSubGraphTransform transform(true);
+  BlockVector new_blocks;
+  ASSERT_TRUE(ApplyBasicBlockSubGraphTransform(
+      &transform, &policy_, &block_graph_, code_block_, &new_blocks));
+  size_t misses = cache->misses();
+  EXPECT_LT(0U, misses);
+  ASSERT_EQ(1U, new_blocks.size());
+
+  // Transforming the rebuilt block decodes the same bytes, from a new home.
+  code_block_ = new_blocks[0];
+  ASSERT_TRUE(ApplyBasicBlockSubGraphTransform(
+      &transform, &policy_, &block_graph_, code_block_, NULL));
+  EXPECT_EQ(misses, cache->misses());
+  EXPECT_LT(0U, cache->hits());
+}
+
 TEST_F(ApplyBasicBlockSubGraphTransformTest, VectorTransformSucceeds) {
   // Validate applying a vector of transforms.
   MockBasicBlockSubGraphTransform transform1;
@@ -296,4 +345,64 @@ TEST_F(ApplyBasicBlockSubGraphTransformTest, VectorTransformSucceeds) {
                                                 &new_blocks));
 }
 
+TEST_F(ApplyBasicBlockSubGraphTransformTest, ParallelTransformSucceeds) {
+  // Add more code blocks like the first one. They all refer to the data block
+  // but not to one another, so they can be transformed concurrently.
+  const size_t kNumCodeBlocks = 20;
+  BlockVector code_blocks(1, code_block_);
+  std::set<BlockGraph::BlockId> code_block_ids;
+  code_block_ids.insert(code_block_->id());
+  for (size_t i = 1; i < kNumCodeBlocks; ++i) {
+    BlockGraph::Block* code_block = block_graph_.AddBlock(
+        BlockGraph::CODE_BLOCK, sizeof(kCodeBytes), "Code");
+    ASSERT_TRUE(code_block != NULL);
+    ASSERT_TRUE(code_block->SetLabel(
+        kOffsetOfCode,
+        BlockGraph::Label("Code", BlockGraph::CODE_LABEL)));
+    code_block->SetData(kCodeBytes, sizeof(kCodeBytes));
+    ASSERT_TRUE(
+        code_block->SetReference(kOffsetOfReferenceToData,
+                                 MakeReference(data_block_, kOffsetOfData)));
+    code_blocks.push_back(code_block);
+    code_block_ids.insert(code_block->id());
+  }
+
+  CountingBasicBlockSubGraphTransform transform(true);
+  EXPECT_TRUE(ApplyBasicBlockSubGraphTransformInParallel(
+      &transform, &policy_, &block_graph_, code_blocks, 4));
+  EXPECT_EQ(kNumCodeBlocks, transform.count());
+
+  // Each code block has been replaced with an equivalent one.
+  EXPECT_EQ(kNumCodeBlocks + 1, block_graph_.blocks().size());
+  std::set<BlockGraph::BlockId>::const_iterator id_it = code_block_ids.begin();
+  for (; id_it != code_block_ids.end(); ++id_it)
+    EXPECT_EQ(NULL, block_graph_.GetBlockById(*id_it));
+  code_block_ = NULL;
+  EXPECT_EQ(kNumCodeBlocks, data_block_->referrers().size());
+
+  BlockGraph::BlockMap::const_iterator block_it =
+      block_graph_.blocks().begin();
+  for (; block_it != block_graph_.blocks().end(); ++block_it) {
+    const BlockGraph::Block& block = block_it->second;
+    if (block.type() != BlockGraph::CODE_BLOCK)
+      continue;
+    BlockGraph::Reference ref;
+    EXPECT_TRUE(block.GetReference(kOffsetOfReferenceToData, &ref));
+    EXPECT_EQ(data_block_, ref.referenced());
+  }
+}
+
+TEST_F(ApplyBasicBlockSubGraphTransformTest, ParallelTransformFails) {
+  BlockGraph::BlockId code_block_id = code_block_->id();
+
+  CountingBasicBlockSubGraphTransform transform(false);
+  EXPECT_FALSE(ApplyBasicBlockSubGraphTransformInParallel(
+      &transform, &policy_, &block_graph_, BlockVector(1, code_block_), 2));
+  EXPECT_EQ(1U, transform.count());
+
+  // The original block graph should be unchanged.
+  EXPECT_EQ(2U, block_graph_.blocks().size());
+  EXPECT_EQ(code_block_, block_graph_.GetBlockById(code_block_id));
+}
+
 }  // namespace block_graph
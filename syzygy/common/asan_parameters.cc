@@ -163,6 +163,15 @@ const bool kDefaultEnableCtMalloc = true;
 const bool kDefaultEnableRateTargetedHeaps = true;
 const bool kDefaultEnableZebraBlockHeap = false;
 const bool kDefaultEnableAllocationFilter = false;
+const bool kDefaultEnableBlockCache = false;
+const bool kDefaultEnableDeferredTrimming = false;
+const bool kDefaultEnableLazyShadowCommit = false;
+const bool kDefaultEnableAllocationSampling = false;
+const bool kDefaultEnableLifetimeSegregatedHeaps = false;
+const bool kDefaultEnableFastStackCapture = false;
+const bool kDefaultTargetedMinidump = false;
+const bool kDefaultDeduplicateErrorReports = false;
+const bool kDefaultEnableSampledBlockChecksums = false;
 
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap = true;
@@ -170,6 +179,7 @@ extern const bool kDefaultEnableLargeBlockHeap = true;
 // our historic average for Chrome. Overhead in this heap is 2 pages, so want
 // 2 / 0.45 = 4.44 < 5 page minimum.
 extern const size_t kDefaultLargeAllocationThreshold = 5 * 4096;
+extern const size_t kDefaultLargeBlockHeapCacheSize = 0;
 
 const char kSyzyAsanOptionsEnvVar[] = "SYZYGY_ASAN_OPTIONS";
 
@@ -206,10 +216,22 @@ const char kParamDisableCtMalloc[] = "disable_ctmalloc";
 const char kParamDisableRateTargetedHeaps[] = "disable_rate_targeted_heaps";
 const char kParamEnableZebraBlockHeap[] = "enable_zebra_block_heap";
 const char kParamEnableAllocationFilter[] = "enable_allocation_filter";
+const char kParamEnableBlockCache[] = "enable_block_cache";
+const char kParamEnableDeferredTrimming[] = "enable_deferred_trimming";
+const char kParamEnableLazyShadowCommit[] = "enable_lazy_shadow_commit";
+const char kParamEnableAllocationSampling[] = "enable_allocation_sampling";
+const char kParamEnableLifetimeSegregatedHeaps[] =
+    "enable_lifetime_segregated_heaps";
+const char kParamEnableFastStackCapture[] = "enable_fast_stack_capture";
+const char kParamTargetedMinidump[] = "targeted_minidump";
+const char kParamDeduplicateErrorReports[] = "deduplicate_error_reports";
+const char kParamEnableSampledBlockChecksums[] =
+    "enable_sampled_block_checksums";
 
 // String names of LargeBlockHeap parameters.
 const char kParamDisableLargeBlockHeap[] = "disable_large_block_heap";
 const char kParamLargeAllocationThreshold[] = "large_allocation_threshold";
+const char kParamLargeBlockHeapCacheSize[] = "large_block_heap_cache_size";
 
 InflatedAsanParameters::InflatedAsanParameters() {
   // Clear the AsanParameters portion of ourselves.
@@ -284,15 +306,30 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->enable_zebra_block_heap = kDefaultEnableZebraBlockHeap;
   asan_parameters->enable_large_block_heap = kDefaultEnableLargeBlockHeap;
   asan_parameters->enable_allocation_filter = kDefaultEnableAllocationFilter;
+  asan_parameters->enable_block_cache = kDefaultEnableBlockCache;
+  asan_parameters->enable_deferred_trimming = kDefaultEnableDeferredTrimming;
+  asan_parameters->enable_lazy_shadow_commit = kDefaultEnableLazyShadowCommit;
+  asan_parameters->enable_allocation_sampling =
+      kDefaultEnableAllocationSampling;
+  asan_parameters->enable_lifetime_segregated_heaps =
+      kDefaultEnableLifetimeSegregatedHeaps;
+  asan_parameters->enable_fast_stack_capture = kDefaultEnableFastStackCapture;
+  asan_parameters->targeted_minidump = kDefaultTargetedMinidump;
+  asan_parameters->deduplicate_error_reports = kDefaultDeduplicateErrorReports;
+  asan_parameters->enable_sampled_block_checksums =
+      kDefaultEnableSampledBlockChecksums;
   asan_parameters->large_allocation_threshold =
       kDefaultLargeAllocationThreshold;
+  asan_parameters->large_block_heap_cache_size =
+      kDefaultLargeBlockHeapCacheSize;
 }
 
 bool InflateAsanParameters(const AsanParameters* pod_params,
                            InflatedAsanParameters* inflated_params) {
   // This must be kept up to date with AsanParameters as it evolves.
   static const size_t kSizeOfAsanParametersByVersion[] =
-      { 40, 44, 48, 52, 52, 52, 56, 56, 56 };
+      { 40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 56, 56, 56, 60, 60, 60, 60,
+        60, 60 };
   COMPILE_ASSERT(arraysize(kSizeOfAsanParametersByVersion) ==
                      kAsanParametersVersion + 1,
                  kSizeOfAsanParametersByVersion_out_of_date);
@@ -424,6 +461,13 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the large block heap reservation cache size.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamLargeBlockHeapCacheSize,
+          &asan_parameters->large_block_heap_cache_size) == kFlagError) {
+    return false;
+  }
+
   // Parse the other (boolean) flags.
   if (cmd_line.HasSwitch(kParamMiniDumpOnFailure))
     asan_parameters->minidump_on_failure = true;
@@ -445,6 +489,24 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     asan_parameters->enable_rate_targeted_heaps = false;
   if (cmd_line.HasSwitch(kParamEnableAllocationFilter))
     asan_parameters->enable_allocation_filter = true;
+  if (cmd_line.HasSwitch(kParamEnableBlockCache))
+    asan_parameters->enable_block_cache = true;
+  if (cmd_line.HasSwitch(kParamEnableDeferredTrimming))
+    asan_parameters->enable_deferred_trimming = true;
+  if (cmd_line.HasSwitch(kParamEnableLazyShadowCommit))
+    asan_parameters->enable_lazy_shadow_commit = true;
+  if (cmd_line.HasSwitch(kParamEnableAllocationSampling))
+    asan_parameters->enable_allocation_sampling = true;
+  if (cmd_line.HasSwitch(kParamEnableLifetimeSegregatedHeaps))
+    asan_parameters->enable_lifetime_segregated_heaps = true;
+  if (cmd_line.HasSwitch(kParamEnableFastStackCapture))
+    asan_parameters->enable_fast_stack_capture = true;
+  if (cmd_line.HasSwitch(kParamTargetedMinidump))
+    asan_parameters->targeted_minidump = true;
+  if (cmd_line.HasSwitch(kParamDeduplicateErrorReports))
+    asan_parameters->deduplicate_error_reports = true;
+  if (cmd_line.HasSwitch(kParamEnableSampledBlockChecksums))
+    asan_parameters->enable_sampled_block_checksums = true;
 
   return true;
 }
@@ -37,7 +37,7 @@ namespace common {
 // the StackCaptureCache.
 typedef uint32 AsanStackId;
 
-static const size_t kAsanParametersReserved1Bits = 22;
+static const size_t kAsanParametersReserved1Bits = 13;
 
 // This data structure is injected into an instrumented image in a read-only
 // section. It is initialized by the instrumenter, and will be looked up at
@@ -113,6 +113,44 @@ struct AsanParameters {
       // BlockHeapManager: Indicates if we want to use the rate targeted heaps
       // to reduce the aliasing of the low frequency allocation sites.
       unsigned enable_rate_targeted_heaps : 1;
+      // SimpleBlockHeap: If true then small freed blocks are cached per thread
+      // and reused for allocations of the same size. This only applies to
+      // heaps created after this is set.
+      unsigned enable_block_cache : 1;
+      // BlockHeapManager: If true then the trimming of the shared quarantine
+      // is deferred to a low priority background thread, rather than being
+      // done synchronously by the thread that frees a block.
+      unsigned enable_deferred_trimming : 1;
+      // Shadow: If true then the chunks of shadow memory describing fully
+      // addressable memory are decommitted, and committed again on demand.
+      unsigned enable_lazy_shadow_commit : 1;
+      // BlockHeapManager: If true then allocation_guard_rate is applied per
+      // allocation site rather than per allocation. The first allocations from
+      // each site are always guarded, and the guard rate of a site then decays
+      // towards allocation_guard_rate as it keeps allocating.
+      unsigned enable_allocation_sampling : 1;
+      // BlockHeapManager: If true then the lifetimes of the allocations from
+      // each allocation site are tracked, and the allocations from sites that
+      // are known to be short or long lived are served by separate heaps.
+      unsigned enable_lifetime_segregated_heaps : 1;
+      // StackCapture: If true then stack traces are captured by walking the
+      // chain of frame pointers directly, and hashed during the walk, rather
+      // than by calling ::CaptureStackBackTrace.
+      unsigned enable_fast_stack_capture : 1;
+      // Logger: If true then the minidumps saved on failure only contain the
+      // memory that is relevant to the error, such as the faulting block and
+      // its neighbours, their shadow and their stack traces, rather than the
+      // fixed set of memory that is otherwise captured.
+      unsigned targeted_minidump : 1;
+      // Runtime: If true then an error is only reported in full the first
+      // time that its type, access stack and allocation stack are seen. The
+      // duplicates are only counted, and a summary of the counts is logged
+      // when the runtime is torn down.
+      unsigned deduplicate_error_reports : 1;
+      // Block: If true then only the header, the trailer and a sampled subset
+      // of the body of large quarantined and freed blocks are checksummed,
+      // rather than their entire contents.
+      unsigned enable_sampled_block_checksums : 1;
 
       // Add new flags here!
 
@@ -135,23 +173,28 @@ struct AsanParameters {
   // the large block heap.
   uint32 large_allocation_threshold;
 
+  // LargeBlockHeap: The maximum amount of address space, in bytes, that is
+  // kept reserved for reuse after large allocations are freed. A value of zero
+  // means that freed allocations are always returned to the OS.
+  uint32 large_block_heap_cache_size;
+
   // Add new parameters here!
 
   // When laid out in memory the ignored_stack_ids are present here as a NULL
   // terminated vector.
 };
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 56);
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 60);
 
 // The current version of the Asan parameters structure. This must be updated
 // if any changes are made to the above structure! This is defined in the header
 // file to allow compile time assertions against this version number.
-const uint32 kAsanParametersVersion = 8u;
+const uint32 kAsanParametersVersion = 18u;
 
 // If the number of free bits in the parameters struct changes, then the
 // version has to change as well. This is simply here to make sure that
 // everything changes in lockstep.
-COMPILE_ASSERT(kAsanParametersReserved1Bits == 22 &&
-                   kAsanParametersVersion == 8,
+COMPILE_ASSERT(kAsanParametersReserved1Bits == 13 &&
+                   kAsanParametersVersion == 18,
                version_must_change_if_reserved_bits_changes);
 
 // The name of the section that will be injected into an instrumented image,
@@ -231,9 +274,19 @@ extern const float kDefaultZebraBlockHeapQuarantineRatio;
 extern const bool kDefaultEnableCtMalloc;
 extern const bool kDefaultEnableZebraBlockHeap;
 extern const bool kDefaultEnableAllocationFilter;
+extern const bool kDefaultEnableBlockCache;
+extern const bool kDefaultEnableDeferredTrimming;
+extern const bool kDefaultEnableLazyShadowCommit;
+extern const bool kDefaultEnableAllocationSampling;
+extern const bool kDefaultEnableLifetimeSegregatedHeaps;
+extern const bool kDefaultEnableFastStackCapture;
+extern const bool kDefaultTargetedMinidump;
+extern const bool kDefaultDeduplicateErrorReports;
+extern const bool kDefaultEnableSampledBlockChecksums;
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap;
 extern const size_t kDefaultLargeAllocationThreshold;
+extern const size_t kDefaultLargeBlockHeapCacheSize;
 extern const bool kDefaultEnableRateTargetedHeaps;
 
 // The name of the environment variable containing the SyzyAsan command-line.
@@ -264,9 +317,19 @@ extern const char kParamDisableCtMalloc[];
 extern const char kParamDisableSizeTargetedHeaps[];
 extern const char kParamEnableZebraBlockHeap[];
 extern const char kParamEnableAllocationFilter[];
+extern const char kParamEnableBlockCache[];
+extern const char kParamEnableDeferredTrimming[];
+extern const char kParamEnableLazyShadowCommit[];
+extern const char kParamEnableAllocationSampling[];
+extern const char kParamEnableLifetimeSegregatedHeaps[];
+extern const char kParamEnableFastStackCapture[];
+extern const char kParamTargetedMinidump[];
+extern const char kParamDeduplicateErrorReports[];
+extern const char kParamEnableSampledBlockChecksums[];
 // String names of LargeBlockHeap parameters.
 extern const char kParamDisableLargeBlockHeap[];
 extern const char kParamLargeAllocationThreshold[];
+extern const char kParamLargeBlockHeapCacheSize[];
 
 // Initializes an AsanParameters struct with default values.
 // @param asan_parameters The AsanParameters struct to be initialized.
@@ -88,8 +88,28 @@ TEST(AsanParametersTest, SetDefaultAsanParameters) {
             static_cast<bool>(aparams.enable_allocation_filter));
   EXPECT_EQ(kDefaultEnableRateTargetedHeaps,
             static_cast<bool>(aparams.enable_rate_targeted_heaps));
+  EXPECT_EQ(kDefaultEnableBlockCache,
+            static_cast<bool>(aparams.enable_block_cache));
+  EXPECT_EQ(kDefaultEnableDeferredTrimming,
+            static_cast<bool>(aparams.enable_deferred_trimming));
+  EXPECT_EQ(kDefaultEnableLazyShadowCommit,
+            static_cast<bool>(aparams.enable_lazy_shadow_commit));
+  EXPECT_EQ(kDefaultEnableAllocationSampling,
+            static_cast<bool>(aparams.enable_allocation_sampling));
+  EXPECT_EQ(kDefaultEnableLifetimeSegregatedHeaps,
+            static_cast<bool>(aparams.enable_lifetime_segregated_heaps));
+  EXPECT_EQ(kDefaultEnableFastStackCapture,
+            static_cast<bool>(aparams.enable_fast_stack_capture));
+  EXPECT_EQ(kDefaultTargetedMinidump,
+            static_cast<bool>(aparams.targeted_minidump));
+  EXPECT_EQ(kDefaultDeduplicateErrorReports,
+            static_cast<bool>(aparams.deduplicate_error_reports));
+  EXPECT_EQ(kDefaultEnableSampledBlockChecksums,
+            static_cast<bool>(aparams.enable_sampled_block_checksums));
   EXPECT_EQ(kDefaultLargeAllocationThreshold,
             aparams.large_allocation_threshold);
+  EXPECT_EQ(kDefaultLargeBlockHeapCacheSize,
+            aparams.large_block_heap_cache_size);
 }
 
 TEST(AsanParametersTest, InflateAsanParametersStackIdsPastEnd) {
@@ -238,8 +258,28 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             static_cast<bool>(iparams.enable_allocation_filter));
   EXPECT_EQ(kDefaultEnableRateTargetedHeaps,
             static_cast<bool>(iparams.enable_rate_targeted_heaps));
+  EXPECT_EQ(kDefaultEnableBlockCache,
+            static_cast<bool>(iparams.enable_block_cache));
+  EXPECT_EQ(kDefaultEnableDeferredTrimming,
+            static_cast<bool>(iparams.enable_deferred_trimming));
+  EXPECT_EQ(kDefaultEnableLazyShadowCommit,
+            static_cast<bool>(iparams.enable_lazy_shadow_commit));
+  EXPECT_EQ(kDefaultEnableAllocationSampling,
+            static_cast<bool>(iparams.enable_allocation_sampling));
+  EXPECT_EQ(kDefaultEnableLifetimeSegregatedHeaps,
+            static_cast<bool>(iparams.enable_lifetime_segregated_heaps));
+  EXPECT_EQ(kDefaultEnableFastStackCapture,
+            static_cast<bool>(iparams.enable_fast_stack_capture));
+  EXPECT_EQ(kDefaultTargetedMinidump,
+            static_cast<bool>(iparams.targeted_minidump));
+  EXPECT_EQ(kDefaultDeduplicateErrorReports,
+            static_cast<bool>(iparams.deduplicate_error_reports));
+  EXPECT_EQ(kDefaultEnableSampledBlockChecksums,
+            static_cast<bool>(iparams.enable_sampled_block_checksums));
   EXPECT_EQ(kDefaultLargeAllocationThreshold,
             iparams.large_allocation_threshold);
+  EXPECT_EQ(kDefaultLargeBlockHeapCacheSize,
+            iparams.large_block_heap_cache_size);
 }
 
 TEST(AsanParametersTest, ParseAsanParametersMaximal) {
@@ -265,7 +305,17 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
       L"--disable_large_block_heap "
       L"--disable_rate_targeted_heaps "
       L"--enable_allocation_filter "
-      L"--large_allocation_threshold=4096";
+      L"--enable_block_cache "
+      L"--enable_deferred_trimming "
+      L"--enable_lazy_shadow_commit "
+      L"--enable_allocation_sampling "
+      L"--enable_lifetime_segregated_heaps "
+      L"--enable_fast_stack_capture "
+      L"--targeted_minidump "
+      L"--deduplicate_error_reports "
+      L"--enable_sampled_block_checksums "
+      L"--large_allocation_threshold=4096 "
+      L"--large_block_heap_cache_size=1048576";
 
   InflatedAsanParameters iparams;
   SetDefaultAsanParameters(&iparams);
@@ -295,7 +345,17 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_FALSE(static_cast<bool>(iparams.enable_large_block_heap));
   EXPECT_TRUE(static_cast<bool>(iparams.enable_allocation_filter));
   EXPECT_FALSE(static_cast<bool>(iparams.enable_rate_targeted_heaps));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_block_cache));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_deferred_trimming));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_lazy_shadow_commit));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_allocation_sampling));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_lifetime_segregated_heaps));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_fast_stack_capture));
+  EXPECT_TRUE(static_cast<bool>(iparams.targeted_minidump));
+  EXPECT_TRUE(static_cast<bool>(iparams.deduplicate_error_reports));
+  EXPECT_TRUE(static_cast<bool>(iparams.enable_sampled_block_checksums));
   EXPECT_EQ(4096, iparams.large_allocation_threshold);
+  EXPECT_EQ(1048576, iparams.large_block_heap_cache_size);
 }
 
 }  // namespace common
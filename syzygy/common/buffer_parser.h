@@ -18,9 +18,47 @@
 #define SYZYGY_COMMON_BUFFER_PARSER_H_
 
 #include "base/basictypes.h"
+#include "base/logging.h"
 
 namespace common {
 
+// A non-owning view of a contiguous array of @p DataType elements, typically
+// pointing into a buffer being parsed. This allows handing out arrays read
+// from a buffer without copying them. The view is only valid for as long as
+// the underlying buffer is.
+template <class DataType>
+class BufferView {
+ public:
+  typedef const DataType* const_iterator;
+
+  BufferView() : data_(NULL), size_(0) {
+  }
+
+  BufferView(const DataType* data, size_t size) : data_(data), size_(size) {
+    DCHECK(data != NULL || size == 0);
+  }
+
+  // Accessors.
+  const DataType* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // @name STL-like iteration.
+  // @{
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  // @}
+
+  const DataType& operator[](size_t index) const {
+    DCHECK_LT(index, size_);
+    return data_[index];
+  }
+
+ private:
+  const DataType* data_;
+  size_t size_;
+};
+
 // A binary buffer parser
 class BinaryBufferParser {
  public:
@@ -127,6 +165,34 @@ class BinaryBufferReader {
     return Read(sizeof(**data_ptr), data_ptr);
   }
 
+  // Retrieve a view of @p count elements of @p DataType from our buffer,
+  // without moving the read position.
+  // @param count the number of elements in the view.
+  // @param view on success receives a view pointing into our buffer.
+  // @returns true iff the @p count elements are in our buffer.
+  template <class DataType>
+  bool PeekView(size_t count, BufferView<DataType>* view) {
+    DCHECK(view != NULL);
+    if (count > RemainingBytes() / sizeof(DataType))
+      return false;
+    const DataType* data = NULL;
+    if (!Peek(count * sizeof(DataType), &data))
+      return false;
+    *view = BufferView<DataType>(data, count);
+    return true;
+  }
+
+  // Retrieve a view of @p count elements of @p DataType from our buffer,
+  // and advance the read position past them.
+  template <class DataType>
+  bool ReadView(size_t count, BufferView<DataType>* view) {
+    if (!PeekView(count, view))
+      return false;
+    bool consumed = Consume(count * sizeof(DataType));
+    DCHECK(consumed);
+    return true;
+  }
+
   // Retrieve a zero-terminated string from our buffer without
   // advancing the read position.
   bool PeekString(const char** str, size_t* str_len);
@@ -193,6 +193,33 @@ TEST(BinaryBufferReader, Read) {
   EXPECT_FALSE(reader.Read(kDataBufferSize, &ptr));
 }
 
+TEST(BinaryBufferReader, ReadView) {
+  BinaryBufferReader reader(kDataBuffer, kDataBufferSize);
+
+  BufferView<uint16> view;
+  EXPECT_TRUE(view.empty());
+  EXPECT_TRUE(reader.PeekView(2, &view));
+  EXPECT_EQ(0, reader.pos());
+  EXPECT_EQ(2U, view.size());
+  EXPECT_EQ(reinterpret_cast<const uint16*>(kDataBuffer), view.data());
+
+  EXPECT_TRUE(reader.ReadView(3, &view));
+  EXPECT_EQ(6, reader.pos());
+  EXPECT_EQ(3U, view.size());
+  EXPECT_EQ(0x0504, view[2]);
+  EXPECT_EQ(view.data() + 3, view.end());
+
+  // The view must be entirely contained in the buffer.
+  EXPECT_FALSE(reader.ReadView(kDataBufferSize, &view));
+  EXPECT_FALSE(reader.ReadView(static_cast<size_t>(-1), &view));
+  EXPECT_EQ(6, reader.pos());
+
+  BufferView<uint8> bytes;
+  EXPECT_TRUE(reader.ReadView(kDataBufferSize - 6, &bytes));
+  EXPECT_EQ(0U, reader.RemainingBytes());
+  EXPECT_EQ(17, bytes[bytes.size() - 1]);
+}
+
 TEST(BinaryBufferReader, ReadCharString) {
   static const char kBuf[] = {
     L'a', L'b', L'c', L'd', L'\0', L'e', L'f', L'g', L'\0', L'h', L'i'
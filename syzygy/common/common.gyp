@@ -51,6 +51,16 @@
         # This is required for ATL to use XP-safe versions of its functions.
         '_USING_V110_SDK71_',
       ],
+      'all_dependent_settings': {
+        'msvs_settings': {
+          'VCLinkerTool': {
+            # Required by the on-demand module loading in dbghelp_util.cc.
+            'AdditionalDependencies': [
+              'psapi.lib',
+            ],
+          },
+        },
+      },
     },
     {
       'target_name': 'common_unittest_utils',
@@ -74,6 +84,7 @@
         'buffer_writer_unittest.cc',
         'com_utils_unittest.cc',
         'comparable_unittest.cc',
+        'dbghelp_util_unittest.cc',
         'path_util_unittest.cc',
         'recursive_lock_unittest.cc',
         'unittest_util_unittest.cc',
@@ -15,12 +15,32 @@
 #include "syzygy/common/dbghelp_util.h"
 
 #include <dbghelp.h>
+#include <psapi.h>
 
+#include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "syzygy/common/com_utils.h"
 
 namespace common {
 
+namespace {
+
+// The state of the process-wide symbol session.
+struct SharedSymbolSession {
+  SharedSymbolSession() : initialized(false), failed(false) {
+  }
+
+  bool initialized;
+  bool failed;
+};
+
+base::LazyInstance<RecursiveLock>::Leaky dbghelp_lock =
+    LAZY_INSTANCE_INITIALIZER;
+base::LazyInstance<SharedSymbolSession>::Leaky shared_session =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
 // A wrapper for SymInitialize. It looks like it has an internal race condition
 // that can ocassionaly fail, so we wrap it and retry a finite number of times.
 // Ugly, but necessary.
@@ -46,4 +66,70 @@ bool SymInitialize(HANDLE process,
   return false;
 }
 
+RecursiveLock* GetDbgHelpLock() {
+  return dbghelp_lock.Pointer();
+}
+
+ScopedSharedSymbolSession::ScopedSharedSymbolSession()
+    : auto_lock_(*GetDbgHelpLock()), session_(NULL) {
+  SharedSymbolSession* state = shared_session.Pointer();
+
+  // The session is identified by an arbitrary value that doesn't correspond
+  // to a real process, so that it doesn't collide with a session initialized
+  // for the current process by other code.
+  HANDLE handle = reinterpret_cast<HANDLE>(state);
+
+  if (!state->initialized && !state->failed) {
+    ::SymSetOptions(::SymGetOptions() | SYMOPT_DEFERRED_LOADS);
+    if (SymInitialize(handle, NULL, false))
+      state->initialized = true;
+    else
+      state->failed = true;
+  }
+
+  if (state->initialized)
+    session_ = handle;
+}
+
+DWORD64 CALLBACK GetModuleBaseLoadingModules(HANDLE process, DWORD64 address) {
+  GetDbgHelpLock()->AssertAcquired();
+
+  DWORD64 base = ::SymGetModuleBase64(process, address);
+  if (base != 0)
+    return base;
+
+  // The module isn't loaded yet in the session. Find out if the address
+  // belongs to an image mapped in the process.
+  MEMORY_BASIC_INFORMATION info = {};
+  const void* ptr = reinterpret_cast<const void*>(
+      static_cast<uintptr_t>(address));
+  if (::VirtualQueryEx(process, ptr, &info, sizeof(info)) != sizeof(info) ||
+      info.Type != MEM_IMAGE) {
+    return 0;
+  }
+
+  HMODULE module = reinterpret_cast<HMODULE>(info.AllocationBase);
+  wchar_t module_path[MAX_PATH];
+  MODULEINFO module_info = {};
+  if (::GetModuleFileNameExW(process, module, module_path,
+                             arraysize(module_path)) == 0 ||
+      !::GetModuleInformation(process, module, &module_info,
+                              sizeof(module_info))) {
+    return 0;
+  }
+
+  base = reinterpret_cast<DWORD64>(module_info.lpBaseOfDll);
+  if (::SymLoadModuleExW(process, NULL, module_path, NULL, base,
+                         module_info.SizeOfImage, NULL, 0) == 0) {
+    DWORD error = ::GetLastError();
+    // ERROR_SUCCESS means the module was already loaded.
+    if (error != ERROR_SUCCESS) {
+      LOG(ERROR) << "SymLoadModuleEx failed: " << LogWe(error);
+      return 0;
+    }
+  }
+
+  return base;
+}
+
 }  // namespace common
@@ -19,6 +19,9 @@
 
 #include <windows.h>
 
+#include "base/basictypes.h"
+#include "syzygy/common/recursive_lock.h"
+
 namespace common {
 
 // A wrapper for SymInitialize. It looks like it has an internal race condition
@@ -36,6 +39,45 @@ bool SymInitialize(HANDLE process,
                    const char* user_search_path,
                    bool invade_process);
 
+// Returns the process-wide lock that serializes access to dbghelp. None of the
+// dbghelp functions are thread-safe, so every caller in a multithreaded
+// process must hold this lock while using them. The lock is recursive so that
+// it may be taken by code that is itself called with it held.
+RecursiveLock* GetDbgHelpLock();
+
+// Provides access to a dbghelp symbol session that is shared by the whole
+// process. The session is initialized on first use, with deferred symbol
+// loads and without invading the current process, and is never cleaned up.
+// This avoids paying for a SymInitialize/SymCleanup pair on every call of
+// utilities that only need a session for things like SymFindFileInPath. The
+// dbghelp lock is held for the lifetime of this object.
+class ScopedSharedSymbolSession {
+ public:
+  ScopedSharedSymbolSession();
+
+  // @returns the handle of the shared session, or NULL if it failed to
+  //     initialize.
+  HANDLE session() const { return session_; }
+
+ private:
+  AutoRecursiveLock auto_lock_;
+  HANDLE session_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedSharedSymbolSession);
+};
+
+// A GetModuleBase callback for StackWalk64 that loads the module containing
+// @p address into the symbol session of @p process on demand. This allows
+// sessions to be initialized without invading the process, so that only the
+// modules actually touched by a stack walk are loaded. Must be called with the
+// dbghelp lock held.
+// @param process The handle of the process whose stack is being walked. This
+//     is also the handle of its symbol session.
+// @param address The address whose module base is requested.
+// @returns the base address of the module containing @p address, or 0 if it
+//     doesn't belong to a module.
+DWORD64 CALLBACK GetModuleBaseLoadingModules(HANDLE process, DWORD64 address);
+
 }  // namespace common
 
 #endif  // SYZYGY_COMMON_DBGHELP_UTIL_H_
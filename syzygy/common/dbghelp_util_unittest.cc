@@ -0,0 +1,64 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/common/dbghelp_util.h"
+
+#include <dbghelp.h>
+
+#include "gtest/gtest.h"
+
+namespace common {
+
+namespace {
+
+void DummyFunction() {
+}
+
+}  // namespace
+
+TEST(DbgHelpUtilTest, SharedSymbolSessionIsReused) {
+  HANDLE session = NULL;
+  {
+    ScopedSharedSymbolSession symbol_session;
+    session = symbol_session.session();
+    ASSERT_TRUE(session != NULL);
+    GetDbgHelpLock()->AssertAcquired();
+  }
+
+  ScopedSharedSymbolSession symbol_session;
+  EXPECT_EQ(session, symbol_session.session());
+}
+
+TEST(DbgHelpUtilTest, GetModuleBaseLoadingModules) {
+  HANDLE process = ::GetCurrentProcess();
+  AutoRecursiveLock auto_lock(*GetDbgHelpLock());
+  ASSERT_TRUE(SymInitialize(process, NULL, false));
+
+  // The module containing this function is loaded on demand.
+  DWORD64 address = reinterpret_cast<DWORD64>(&DummyFunction);
+  DWORD64 expected_base = reinterpret_cast<DWORD64>(
+      ::GetModuleHandle(NULL));
+  EXPECT_EQ(0U, ::SymGetModuleBase64(process, address));
+  EXPECT_EQ(expected_base, GetModuleBaseLoadingModules(process, address));
+  EXPECT_EQ(expected_base, ::SymGetModuleBase64(process, address));
+
+  // Stack memory doesn't belong to any module.
+  int value = 0;
+  EXPECT_EQ(0U, GetModuleBaseLoadingModules(
+      process, reinterpret_cast<DWORD64>(&value)));
+
+  EXPECT_TRUE(::SymCleanup(process));
+}
+
+}  // namespace common
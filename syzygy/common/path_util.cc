@@ -24,13 +24,57 @@ namespace common {
 bool ConvertDevicePathToDrivePath(const base::FilePath& device_path,
                                   base::FilePath* drive_path) {
   DCHECK(drive_path != NULL);
+  DevicePathConverter converter;
+  return converter.Convert(device_path, drive_path);
+}
+
+DevicePathConverter::DevicePathConverter() : drive_bits_(0) {
+}
+
+bool DevicePathConverter::Convert(const base::FilePath& device_path,
+                                  base::FilePath* drive_path) {
+  DCHECK(drive_path != NULL);
   static const wchar_t kPathSeparator = L'\\';
 
-  // Get the set of logical drives that exist as a bitmask.
+  // Get the set of logical drives that exist as a bitmask, and refresh their
+  // device names if it has changed.
   DWORD drive_bits = ::GetLogicalDrives();
+  if (drive_bits != drive_bits_ || drives_.empty())
+    Refresh(drive_bits);
+
+  // Look for a device that matches the prefix of device_path.
+  for (size_t i = 0; i < drives_.size(); ++i) {
+    const std::wstring& device = drives_[i].device;
+    size_t device_length = device.size();
 
-  // For each logical drive get the device name, looking for one that
-  // matches the prefix of device_path.
+    // Is this the device we're looking for?
+    if (_wcsnicmp(device.c_str(), device_path.value().c_str(),
+                  device_length) == 0) {
+      // The device path must consist only of the device name, or must be
+      // immediately followed by a path separator. This prevents matching
+      // "\Device\HarddiskVolume10" with "\Device\HarddiskVolume1".
+      if (device_path.value().size() == device_length ||
+          device_path.value()[device_length] == kPathSeparator) {
+        // Replace the device name with the drive letter and return the
+        // translated path.
+        wchar_t drive[] = { drives_[i].letter, L':', 0 };
+        *drive_path = base::FilePath(drive).Append(
+            device_path.value().substr(device_length));
+        return true;
+      }
+    }
+  }
+
+  // We didn't find a matching device.
+  *drive_path = device_path;
+  return true;
+}
+
+void DevicePathConverter::Refresh(DWORD drive_bits) {
+  drive_bits_ = drive_bits;
+  drives_.clear();
+
+  // For each logical drive get the device name.
   DWORD drive_bit = 1;
   wchar_t drive_letter = L'A';
   wchar_t drive[] = { 'A', ':', 0 };
@@ -43,39 +87,24 @@ bool ConvertDevicePathToDrivePath(const base::FilePath& device_path,
     drive[0] = drive_letter;
 
     // The call to QueryDosDevice is racy, as the system state may have changed
-    // since we called GetLogicalDriveStrings. So on failure we simply log a
-    // warning and continue on our merry way.
+    // since we called GetLogicalDrives. So on failure we simply log a warning
+    // and continue on our merry way.
     wchar_t device[1024] = { 0 };
     DWORD device_length = ::QueryDosDevice(drive, device, arraysize(device));
     if (device_length == 0) {
       DWORD error = ::GetLastError();
       LOG(WARNING) << "QueryDosDevice failed: " << common::LogWe(error);
-    } else {
-      // The string that QueryDosDevice writes is terminated with 2 nulls.
-      DCHECK_GT(device_length, 2u);
-      device_length -= 2;
-      DCHECK_EQ(device_length, ::wcslen(device));
-
-      // Is this the device we're looking for?
-      if (_wcsnicmp(device, device_path.value().c_str(), device_length) == 0) {
-        // The device path must consist only of the device name, or must be
-        // immediately followed by a path separator. This prevents matching
-        // "\Device\HarddiskVolume10" with "\Device\HarddiskVolume1".
-        if (device_path.value().size() == device_length ||
-            device_path.value()[device_length] == kPathSeparator) {
-          // Replace the device name with the drive letter and return the
-          // translated path.
-          *drive_path = base::FilePath(drive).Append(
-              device_path.value().substr(device_length));
-          return true;
-        }
-      }
+      continue;
     }
-  }
 
-  // We didn't find a matching device.
-  *drive_path = device_path;
-  return true;
+    // The string that QueryDosDevice writes is terminated with 2 nulls.
+    DCHECK_GT(device_length, 2u);
+    device_length -= 2;
+    DCHECK_EQ(device_length, ::wcslen(device));
+
+    Drive entry = { drive_letter, std::wstring(device, device_length) };
+    drives_.push_back(entry);
+  }
 }
 
 }  // namespace common
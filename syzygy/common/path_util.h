@@ -17,6 +17,12 @@
 #ifndef SYZYGY_COMMON_PATH_UTIL_H_
 #define SYZYGY_COMMON_PATH_UTIL_H_
 
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
 #include "base/files/file_path.h"
 
 namespace common {
@@ -32,6 +38,37 @@ namespace common {
 bool ConvertDevicePathToDrivePath(const base::FilePath& device_path,
                                   base::FilePath* drive_path);
 
+// Converts device paths to drive paths like ConvertDevicePathToDrivePath, but
+// caches the device names of the logical drives. This avoids querying every
+// drive for each path when converting many of them. The cache is refreshed
+// whenever the set of logical drives changes. This class isn't thread-safe.
+class DevicePathConverter {
+ public:
+  DevicePathConverter();
+
+  // Converts @p device_path. See ConvertDevicePathToDrivePath for details.
+  // @param device_path The path to be converted.
+  // @param drive_path The path to be populated with the converted path.
+  // @returns true on success, false otherwise.
+  bool Convert(const base::FilePath& device_path, base::FilePath* drive_path);
+
+ private:
+  // Reads the device names of the logical drives in @p drive_bits.
+  void Refresh(DWORD drive_bits);
+
+  // A logical drive and the name of its device.
+  struct Drive {
+    wchar_t letter;
+    std::wstring device;
+  };
+
+  // The set of logical drives that drives_ describes.
+  DWORD drive_bits_;
+  std::vector<Drive> drives_;
+
+  DISALLOW_COPY_AND_ASSIGN(DevicePathConverter);
+};
+
 }  // namespace common
 
 #endif  // SYZYGY_COMMON_PATH_UTIL_H_
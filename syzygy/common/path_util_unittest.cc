@@ -112,4 +112,28 @@ TEST_F(PathUtilTest, ConvertDevicePathToDrivePathWithDeviceWithPrefix) {
   ASSERT_EQ(device.value(), drive.value());
 }
 
+TEST_F(PathUtilTest, DevicePathConverter) {
+  DevicePathConverter converter;
+
+  // Convert a few paths with the same converter, so that the later ones use
+  // the cached device names.
+  for (size_t i = 0; i < 3; ++i) {
+    base::FilePath device(cur_device_);
+    device = device.Append(L"foo.txt");
+    base::FilePath drive;
+    ASSERT_TRUE(converter.Convert(device, &drive));
+    base::FilePath expected_drive(
+        std::wstring(cur_drive_).append(L"\\foo.txt"));
+    ASSERT_THAT(expected_drive.value(), ::testing::StrCaseEq(drive.value()));
+
+    device = base::FilePath(std::wstring(cur_device_).append(L"1234567"));
+    ASSERT_TRUE(converter.Convert(device, &drive));
+    ASSERT_EQ(device.value(), drive.value());
+
+    device = base::FilePath(L"\\Device\\ThisDeviceDoesNotExist\\foo.txt");
+    ASSERT_TRUE(converter.Convert(device, &drive));
+    ASSERT_EQ(device.value(), drive.value());
+  }
+}
+
 }  // namespace common
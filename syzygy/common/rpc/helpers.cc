@@ -19,6 +19,7 @@
 
 #include <windows.h>
 
+#include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/win/windows_version.h"
 #include "syzygy/common/com_utils.h"
@@ -26,6 +27,13 @@
 namespace common {
 namespace rpc {
 
+namespace {
+
+base::LazyInstance<RpcBindingPool>::Leaky static_binding_pool =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
 bool CreateRpcBinding(const base::StringPiece16& protocol,
                       const base::StringPiece16& endpoint,
                       handle_t* out_handle) {
@@ -127,6 +135,126 @@ bool ScopedRpcBinding::Close() {
   return true;
 }
 
+RpcBindingPool::RpcBindingPool() {
+}
+
+RpcBindingPool::~RpcBindingPool() {
+  Clear();
+}
+
+RpcBindingPool* RpcBindingPool::Instance() {
+  return static_binding_pool.Pointer();
+}
+
+bool RpcBindingPool::Get(const base::StringPiece16& protocol,
+                         const base::StringPiece16& endpoint,
+                         handle_t* out_handle) {
+  DCHECK(out_handle != NULL);
+
+  BindingKey key(std::wstring(protocol.begin(), protocol.end()),
+                 std::wstring(endpoint.begin(), endpoint.end()));
+
+  base::AutoLock auto_lock(lock_);
+  BindingMap::const_iterator it = bindings_.find(key);
+  if (it != bindings_.end()) {
+    *out_handle = it->second;
+    return true;
+  }
+
+  // Creating a binding doesn't involve the server, so it's cheap enough to
+  // do under the lock.
+  handle_t binding = NULL;
+  if (!CreateRpcBinding(protocol, endpoint, &binding))
+    return false;
+
+  bindings_.insert(std::make_pair(key, binding));
+  *out_handle = binding;
+  return true;
+}
+
+void RpcBindingPool::Clear() {
+  base::AutoLock auto_lock(lock_);
+  BindingMap::iterator it = bindings_.begin();
+  for (; it != bindings_.end(); ++it) {
+    RPC_STATUS status = ::RpcBindingFree(&it->second);
+    if (status != RPC_S_OK) {
+      LOG(WARNING) << "Failed to free RPC binding: "
+                   << ::common::LogWe(status) << ".";
+    }
+  }
+  bindings_.clear();
+}
+
+size_t RpcBindingPool::size() const {
+  base::AutoLock auto_lock(lock_);
+  return bindings_.size();
+}
+
+AsyncRpcQueue::AsyncRpcQueue()
+    : worker_scheduled_(false),
+      idle_event_(::CreateEvent(NULL, TRUE, TRUE, NULL)) {
+  DCHECK(idle_event_.IsValid());
+}
+
+AsyncRpcQueue::~AsyncRpcQueue() {
+  WaitForIdle();
+}
+
+bool AsyncRpcQueue::Post(const base::Closure& rpc_call) {
+  DCHECK(!rpc_call.is_null());
+
+  base::AutoLock auto_lock(lock_);
+  pending_calls_.push_back(rpc_call);
+  if (worker_scheduled_)
+    return true;
+
+  worker_scheduled_ = true;
+  ::ResetEvent(idle_event_.Get());
+  if (!::QueueUserWorkItem(&WorkerCallback, this, WT_EXECUTEDEFAULT)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to queue RPC worker: " << ::common::LogWe(error)
+               << ".";
+    pending_calls_.pop_back();
+    worker_scheduled_ = false;
+    ::SetEvent(idle_event_.Get());
+    return false;
+  }
+
+  return true;
+}
+
+void AsyncRpcQueue::WaitForIdle() {
+  DWORD result = ::WaitForSingleObject(idle_event_.Get(), INFINITE);
+  DCHECK_EQ(WAIT_OBJECT_0, result);
+}
+
+// static
+DWORD WINAPI AsyncRpcQueue::WorkerCallback(void* param) {
+  DCHECK(param != NULL);
+  static_cast<AsyncRpcQueue*>(param)->RunWorker();
+  return 0;
+}
+
+void AsyncRpcQueue::RunWorker() {
+  while (true) {
+    base::Closure rpc_call;
+    {
+      base::AutoLock auto_lock(lock_);
+      if (pending_calls_.empty()) {
+        worker_scheduled_ = false;
+        ::SetEvent(idle_event_.Get());
+        return;
+      }
+      rpc_call = pending_calls_.front();
+      pending_calls_.pop_front();
+    }
+
+    // The calls are run outside of the lock, so that more can be posted
+    // meanwhile.
+    rpc_call.Run();
+  }
+}
+
 ScopedRpcInterfaceRegistration::ScopedRpcInterfaceRegistration(
     RPC_IF_HANDLE if_spec)
     : if_spec_(if_spec), status_(::RpcServerRegisterIf(if_spec_, NULL, NULL)) {
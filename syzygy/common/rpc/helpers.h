@@ -20,9 +20,17 @@
 #include <rpc.h>
 #include <wtypes.h>
 
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "base/callback.h"
 #include "base/macros.h"
 #include "base/process/process_handle.h"
 #include "base/strings/string_piece.h"
+#include "base/synchronization/lock.h"
+#include "base/win/scoped_handle.h"
 
 // TODO(rogerm): Is there directly usable stuff in base/callback.h that
 //     might make this simpler/cleaner?
@@ -229,6 +237,81 @@ class ScopedRpcBinding {
   DISALLOW_COPY_AND_ASSIGN(ScopedRpcBinding);
 };
 
+// A thread-safe cache of RPC bindings, keyed by protocol and endpoint. An RPC
+// binding handle can be used by several threads at once, so a single binding
+// per endpoint is shared by all of the users of the pool. This saves clients
+// that talk to the same endpoint repeatedly, or from several places, the cost
+// of creating a binding each time. The bindings are freed with the pool.
+class RpcBindingPool {
+ public:
+  RpcBindingPool();
+  ~RpcBindingPool();
+
+  // @returns the process-wide pool. It is leaked at process exit.
+  static RpcBindingPool* Instance();
+
+  // Gets the binding to @p endpoint using @p protocol, creating it on first
+  // use. The binding remains owned by the pool.
+  // @param protocol The RPC protocol to bind.
+  // @param endpoint The endpoint/address to bind.
+  // @param out_handle Receives the pooled binding.
+  // @returns true on success.
+  bool Get(const base::StringPiece16& protocol,
+           const base::StringPiece16& endpoint,
+           handle_t* out_handle);
+
+  // Frees all of the pooled bindings. This must only be called once no
+  // handle obtained from the pool is in use anymore.
+  void Clear();
+
+  // @returns the number of pooled bindings.
+  size_t size() const;
+
+ private:
+  typedef std::pair<std::wstring, std::wstring> BindingKey;
+  typedef std::map<BindingKey, handle_t> BindingMap;
+
+  mutable base::Lock lock_;
+  BindingMap bindings_;  // Under lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(RpcBindingPool);
+};
+
+// Runs RPC calls asynchronously, in the order they are posted, on a thread
+// pool worker. This lets callers fire and forget non-critical calls instead
+// of blocking on their round trip. The calls are closures that typically wrap
+// InvokeRpc. They must own, or otherwise keep alive, everything they pass to
+// the RPC function, as they run after Post returns.
+class AsyncRpcQueue {
+ public:
+  AsyncRpcQueue();
+
+  // Waits for the posted calls to complete.
+  ~AsyncRpcQueue();
+
+  // Posts @p rpc_call to be run asynchronously.
+  // @returns true on success, false if the worker couldn't be scheduled, in
+  //     which case @p rpc_call is dropped.
+  bool Post(const base::Closure& rpc_call);
+
+  // Waits until all of the posted calls have completed.
+  void WaitForIdle();
+
+ private:
+  // The worker, run on the Windows thread pool.
+  static DWORD WINAPI WorkerCallback(void* param);
+  void RunWorker();
+
+  base::Lock lock_;
+  std::deque<base::Closure> pending_calls_;  // Under lock_.
+  bool worker_scheduled_;  // Under lock_.
+
+  // Signaled when no worker is scheduled.
+  base::win::ScopedHandle idle_event_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsyncRpcQueue);
+};
+
 // A helper to manage an RPC interface registration.
 class ScopedRpcInterfaceRegistration {
  public:
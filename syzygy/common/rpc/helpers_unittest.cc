@@ -16,12 +16,23 @@
 
 #include "syzygy/common/rpc/helpers.h"
 
+#include <vector>
+
+#include "base/bind.h"
 #include "base/strings/string16.h"
 #include "gtest/gtest.h"
 
 namespace common {
 namespace rpc {
 
+namespace {
+
+void AppendValue(std::vector<int>* values, int value) {
+  values->push_back(value);
+}
+
+}  // namespace
+
 TEST(RpcHelpersTest, AsRpcWstr) {
   base::char16 a_string[] = L"Hello world.";
   // As this helper only amounts to a reinterpret cast, the real test is that it
@@ -29,5 +40,46 @@ TEST(RpcHelpersTest, AsRpcWstr) {
   RPC_WSTR an_rpc_wstr = AsRpcWstr(a_string);
 }
 
+TEST(RpcHelpersTest, RpcBindingPool) {
+  RpcBindingPool pool;
+  EXPECT_EQ(0U, pool.size());
+
+  // Creating a binding doesn't require a server.
+  handle_t binding1 = NULL;
+  ASSERT_TRUE(pool.Get(L"ncalrpc", L"endpoint1", &binding1));
+  EXPECT_TRUE(binding1 != NULL);
+  EXPECT_EQ(1U, pool.size());
+
+  // The binding is reused for the same endpoint.
+  handle_t binding2 = NULL;
+  ASSERT_TRUE(pool.Get(L"ncalrpc", L"endpoint1", &binding2));
+  EXPECT_EQ(binding1, binding2);
+  EXPECT_EQ(1U, pool.size());
+
+  ASSERT_TRUE(pool.Get(L"ncalrpc", L"endpoint2", &binding2));
+  EXPECT_NE(binding1, binding2);
+  EXPECT_EQ(2U, pool.size());
+
+  pool.Clear();
+  EXPECT_EQ(0U, pool.size());
+}
+
+TEST(RpcHelpersTest, AsyncRpcQueue) {
+  std::vector<int> values;
+  AsyncRpcQueue queue;
+
+  // An idle queue doesn't block.
+  queue.WaitForIdle();
+
+  // The calls run in order.
+  for (int i = 0; i < 100; ++i)
+    ASSERT_TRUE(queue.Post(base::Bind(&AppendValue, &values, i)));
+  queue.WaitForIdle();
+
+  ASSERT_EQ(100U, values.size());
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(i, values[i]);
+}
+
 }  // namespace rpc
 }  // namespace common
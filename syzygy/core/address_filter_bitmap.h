@@ -0,0 +1,159 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Declares AddressFilterBitmap, an immutable index of an AddressFilter that
+// answers membership queries in constant time. It keeps one bit per
+// granule of the filter's extent recording whether the granule holds any
+// marked byte, and another recording whether the granule is entirely marked.
+// Queries that fall in granules only partly covered by marked ranges are
+// resolved exactly against a sorted copy of the filter's ranges.
+//
+// This is intended for consumers that query a filter many times without
+// modifying it, like the transforms that check every instruction of an image
+// against a filter.
+
+#ifndef SYZYGY_CORE_ADDRESS_FILTER_BITMAP_H_
+#define SYZYGY_CORE_ADDRESS_FILTER_BITMAP_H_
+
+#include <vector>
+
+#include "syzygy/core/address_filter.h"
+
+namespace core {
+
+template<typename AddressType, typename SizeType>
+class AddressFilterBitmap {
+ public:
+  typedef AddressType Address;
+  typedef SizeType Size;
+  typedef AddressFilter<AddressType, SizeType> Filter;
+  typedef typename Filter::Range Range;
+  typedef typename Filter::RangeLessThan RangeLessThan;
+  typedef std::vector<Range> RangeVector;
+
+  // The default granularity of the bitmap, expressed as a power of two. One
+  // bit per 16 bytes keeps the bitmaps to 1/64th of the size of the image
+  // while leaving most instructions within one or two granules.
+  static const size_t kDefaultGranularityLog2 = 4;
+
+  // Default constructor. Builds an empty bitmap over an empty extent.
+  AddressFilterBitmap();
+
+  // Constructor. Indexes the given filter.
+  // @param filter The filter to index.
+  // @param granularity_log2 The log2 of the number of bytes covered by each
+  //     bit of the bitmaps.
+  explicit AddressFilterBitmap(
+      const Filter& filter,
+      size_t granularity_log2 = kDefaultGranularityLog2);
+
+  // Determines if the given address range is marked in its entirety. This
+  // has the same semantics as AddressFilter::IsMarked.
+  // @param range The address range to check.
+  // @returns false if any locations in the range are not marked, or true if
+  //     they all are.
+  bool IsMarked(const Range& range) const;
+
+  // Determines if the given address range is not marked at all. This has the
+  // same semantics as AddressFilter::IsUnmarked.
+  // @param range The address range to check.
+  // @returns false if any locations in the range are marked, or true if
+  //     they are all unmarked.
+  bool IsUnmarked(const Range& range) const;
+
+  // @name Set operations. Both bitmaps must have the same extent and
+  //     granularity. The bitmaps are combined a word at a time, and the exact
+  //     ranges are merged in a single linear pass.
+  // @{
+  // Calculates the intersection of this bitmap and another.
+  // @param other The bitmap to intersect with.
+  // @param bitmap The bitmap to populate with the intersection. This may be
+  //     |this|.
+  void Intersect(const AddressFilterBitmap& other,
+                 AddressFilterBitmap* bitmap) const;
+
+  // Calculates the union of this bitmap and another.
+  // @param other The bitmap with which to calculate the union.
+  // @param bitmap The bitmap to populate with the union. This may be |this|.
+  void Union(const AddressFilterBitmap& other,
+             AddressFilterBitmap* bitmap) const;
+  // @}
+
+  // Converts this bitmap back to an AddressFilter.
+  // @param filter The filter to populate.
+  void ToFilter(Filter* filter) const;
+
+  // @name Accessors.
+  // @{
+  const Range& extent() const { return extent_; }
+  size_t granularity_log2() const { return granularity_log2_; }
+  const RangeVector& marked_ranges() const { return marked_ranges_; }
+  size_t granule_count() const { return granule_count_; }
+  bool empty() const { return marked_ranges_.empty(); }
+  // @}
+
+ protected:
+  typedef std::vector<uint32> Bitmap;
+
+  // Clips @p range to the extent and returns the first and last granules it
+  // touches.
+  // @returns false if the clipped range is empty.
+  bool GetGranules(const Range& range,
+                   Range* clipped,
+                   size_t* first,
+                   size_t* last) const;
+
+  // Resolves a query exactly using the sorted ranges.
+  // @{
+  bool IsMarkedExact(const Range& range) const;
+  bool IsUnmarkedExact(const Range& range) const;
+  // @}
+
+  // Sets the bits [@p begin, @p end) of @p bitmap.
+  static void SetBits(size_t begin, size_t end, Bitmap* bitmap);
+
+  // @returns true if any bit in [@p first, @p last] of @p bitmap is set.
+  static bool AnyBitSet(const Bitmap& bitmap, size_t first, size_t last);
+
+  // @returns true if all bits in [@p first, @p last] of @p bitmap are set.
+  static bool AllBitsSet(const Bitmap& bitmap, size_t first, size_t last);
+
+  // The extent of the indexed filter.
+  Range extent_;
+
+  // The log2 of the number of bytes covered by a bit.
+  size_t granularity_log2_;
+
+  // The number of granules in the extent.
+  size_t granule_count_;
+
+  // One bit per granule. A bit of |any_marked_| is clear only if its granule
+  // holds no marked byte. A bit of |all_marked_| is set only if its granule
+  // is entirely marked. The bits are allowed to be conservative (a union may
+  // produce a fully marked granule with a clear |all_marked_| bit); such
+  // granules are resolved from |marked_ranges_|.
+  Bitmap any_marked_;
+  Bitmap all_marked_;
+
+  // The sorted, disjoint and non-contiguous marked ranges.
+  RangeVector marked_ranges_;
+};
+
+}  // namespace core
+
+// Bring in the implementation.
+#include "syzygy/core/address_filter_bitmap_impl.h"
+
+#endif  // SYZYGY_CORE_ADDRESS_FILTER_BITMAP_H_
@@ -0,0 +1,317 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Implementation details of core::AddressFilterBitmap. This is only meant to
+// be included directly from syzygy/core/address_filter_bitmap.h.
+
+#ifndef SYZYGY_CORE_ADDRESS_FILTER_BITMAP_IMPL_H_
+#define SYZYGY_CORE_ADDRESS_FILTER_BITMAP_IMPL_H_
+
+#include <algorithm>
+
+namespace core {
+
+namespace internal {
+
+const size_t kBitmapWordBits = 32;
+
+}  // namespace internal
+
+template<typename AddressType, typename SizeType>
+AddressFilterBitmap<AddressType, SizeType>::AddressFilterBitmap()
+    : granularity_log2_(kDefaultGranularityLog2), granule_count_(0) {
+}
+
+template<typename AddressType, typename SizeType>
+AddressFilterBitmap<AddressType, SizeType>::AddressFilterBitmap(
+    const Filter& filter, size_t granularity_log2)
+    : extent_(filter.extent()),
+      granularity_log2_(granularity_log2),
+      granule_count_(0) {
+  DCHECK_GT(internal::kBitmapWordBits, granularity_log2);
+
+  size_t extent_size = extent_.size();
+  size_t granule_size = 1 << granularity_log2_;
+  granule_count_ = (extent_size + granule_size - 1) >> granularity_log2_;
+  size_t word_count = (granule_count_ + internal::kBitmapWordBits - 1) /
+      internal::kBitmapWordBits;
+  any_marked_.resize(word_count, 0);
+  all_marked_.resize(word_count, 0);
+  marked_ranges_.reserve(filter.size());
+
+  typename Filter::RangeSet::const_iterator it =
+      filter.marked_ranges().begin();
+  for (; it != filter.marked_ranges().end(); ++it) {
+    DCHECK(extent_.Contains(*it));
+    size_t begin = static_cast<size_t>(it->start() - extent_.start());
+    size_t end = begin + it->size();
+
+    SetBits(begin >> granularity_log2_,
+            ((end - 1) >> granularity_log2_) + 1,
+            &any_marked_);
+
+    // A trailing partial granule counts as entirely marked if the range runs
+    // to the end of the extent, as queries never look past the extent.
+    size_t full_begin = (begin + granule_size - 1) >> granularity_log2_;
+    size_t full_end = end >> granularity_log2_;
+    if (end == extent_size)
+      full_end = granule_count_;
+    if (full_begin < full_end)
+      SetBits(full_begin, full_end, &all_marked_);
+
+    marked_ranges_.push_back(*it);
+  }
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::IsMarked(
+    const Range& range) const {
+  // Anything that falls outside of the extent is by definition not marked.
+  Range r;
+  size_t first = 0;
+  size_t last = 0;
+  if (!GetGranules(range, &r, &first, &last))
+    return false;
+
+  if (AllBitsSet(all_marked_, first, last))
+    return true;
+  if (!AllBitsSet(any_marked_, first, last))
+    return false;
+
+  return IsMarkedExact(r);
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::IsUnmarked(
+    const Range& range) const {
+  // Anything that falls outside of the extent is by definition not marked.
+  Range r;
+  size_t first = 0;
+  size_t last = 0;
+  if (!GetGranules(range, &r, &first, &last))
+    return true;
+
+  if (!AnyBitSet(any_marked_, first, last))
+    return true;
+  if (AnyBitSet(all_marked_, first, last))
+    return false;
+
+  return IsUnmarkedExact(r);
+}
+
+template<typename AddressType, typename SizeType>
+void AddressFilterBitmap<AddressType, SizeType>::Intersect(
+    const AddressFilterBitmap& other, AddressFilterBitmap* bitmap) const {
+  DCHECK(bitmap != NULL);
+  DCHECK(extent_ == other.extent_);
+  DCHECK_EQ(granularity_log2_, other.granularity_log2_);
+
+  // A granule is entirely marked in the intersection iff it is in both
+  // operands, so |all_marked_| stays exact. |any_marked_| may be left set for
+  // granules whose marked bytes don't overlap, which is allowed.
+  Bitmap any_marked(any_marked_);
+  Bitmap all_marked(all_marked_);
+  for (size_t i = 0; i < any_marked.size(); ++i) {
+    any_marked[i] &= other.any_marked_[i];
+    all_marked[i] &= other.all_marked_[i];
+  }
+
+  RangeVector ranges;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < marked_ranges_.size() && j < other.marked_ranges_.size()) {
+    const Range& r1 = marked_ranges_[i];
+    const Range& r2 = other.marked_ranges_[j];
+    Range r;
+    if (internal::Intersect(r1, r2, &r))
+      ranges.push_back(r);
+    if (r1.end() < r2.end()) {
+      ++i;
+    } else {
+      ++j;
+    }
+  }
+
+  bitmap->extent_ = extent_;
+  bitmap->granularity_log2_ = granularity_log2_;
+  bitmap->granule_count_ = granule_count_;
+  bitmap->any_marked_.swap(any_marked);
+  bitmap->all_marked_.swap(all_marked);
+  bitmap->marked_ranges_.swap(ranges);
+}
+
+template<typename AddressType, typename SizeType>
+void AddressFilterBitmap<AddressType, SizeType>::Union(
+    const AddressFilterBitmap& other, AddressFilterBitmap* bitmap) const {
+  DCHECK(bitmap != NULL);
+  DCHECK(extent_ == other.extent_);
+  DCHECK_EQ(granularity_log2_, other.granularity_log2_);
+
+  // A granule holds a marked byte in the union iff it does in either operand,
+  // so |any_marked_| stays exact. A granule may be entirely covered by the
+  // union of two partial granules and still have a clear |all_marked_| bit,
+  // which is allowed.
+  Bitmap any_marked(any_marked_);
+  Bitmap all_marked(all_marked_);
+  for (size_t i = 0; i < any_marked.size(); ++i) {
+    any_marked[i] |= other.any_marked_[i];
+    all_marked[i] |= other.all_marked_[i];
+  }
+
+  // Merge the ranges by start address, coalescing overlapping and contiguous
+  // ranges as we go.
+  RangeVector ranges;
+  ranges.reserve(marked_ranges_.size() + other.marked_ranges_.size());
+  size_t i = 0;
+  size_t j = 0;
+  while (i < marked_ranges_.size() || j < other.marked_ranges_.size()) {
+    const Range* next = NULL;
+    if (j == other.marked_ranges_.size() ||
+        (i < marked_ranges_.size() &&
+         marked_ranges_[i].start() < other.marked_ranges_[j].start())) {
+      next = &marked_ranges_[i++];
+    } else {
+      next = &other.marked_ranges_[j++];
+    }
+
+    if (ranges.empty() || ranges.back().end() < next->start()) {
+      ranges.push_back(*next);
+      continue;
+    }
+
+    if (next->end() > ranges.back().end()) {
+      Range& last = ranges.back();
+      last = Range(last.start(), next->end() - last.start());
+    }
+  }
+
+  bitmap->extent_ = extent_;
+  bitmap->granularity_log2_ = granularity_log2_;
+  bitmap->granule_count_ = granule_count_;
+  bitmap->any_marked_.swap(any_marked);
+  bitmap->all_marked_.swap(all_marked);
+  bitmap->marked_ranges_.swap(ranges);
+}
+
+template<typename AddressType, typename SizeType>
+void AddressFilterBitmap<AddressType, SizeType>::ToFilter(
+    Filter* filter) const {
+  DCHECK(filter != NULL);
+  *filter = Filter(extent_);
+  for (size_t i = 0; i < marked_ranges_.size(); ++i)
+    filter->Mark(marked_ranges_[i]);
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::GetGranules(
+    const Range& range, Range* clipped, size_t* first, size_t* last) const {
+  DCHECK(clipped != NULL);
+  DCHECK(first != NULL);
+  DCHECK(last != NULL);
+
+  if (!internal::Intersect(extent_, range, clipped))
+    return false;
+
+  size_t begin = static_cast<size_t>(clipped->start() - extent_.start());
+  *first = begin >> granularity_log2_;
+  *last = (begin + clipped->size() - 1) >> granularity_log2_;
+  DCHECK_LT(*last, granule_count_);
+  return true;
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::IsMarkedExact(
+    const Range& range) const {
+  // Find the first range that ends past the start of the query range. As
+  // contiguous ranges are merged it must contain the query range entirely.
+  typename RangeVector::const_iterator it = std::lower_bound(
+      marked_ranges_.begin(), marked_ranges_.end(),
+      Range(range.start(), 1), RangeLessThan());
+  return it != marked_ranges_.end() && it->Contains(range);
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::IsUnmarkedExact(
+    const Range& range) const {
+  typename RangeVector::const_iterator it = std::lower_bound(
+      marked_ranges_.begin(), marked_ranges_.end(),
+      Range(range.start(), 1), RangeLessThan());
+  return it == marked_ranges_.end() || !it->Intersects(range);
+}
+
+template<typename AddressType, typename SizeType>
+void AddressFilterBitmap<AddressType, SizeType>::SetBits(
+    size_t begin, size_t end, Bitmap* bitmap) {
+  DCHECK(bitmap != NULL);
+  DCHECK_LE(begin, end);
+
+  const size_t kBits = internal::kBitmapWordBits;
+  for (; begin < end && begin % kBits != 0; ++begin)
+    (*bitmap)[begin / kBits] |= 1U << (begin % kBits);
+  for (; begin + kBits <= end; begin += kBits)
+    (*bitmap)[begin / kBits] = ~0U;
+  for (; begin < end; ++begin)
+    (*bitmap)[begin / kBits] |= 1U << (begin % kBits);
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::AnyBitSet(
+    const Bitmap& bitmap, size_t first, size_t last) {
+  DCHECK_LE(first, last);
+
+  const size_t kBits = internal::kBitmapWordBits;
+  size_t first_word = first / kBits;
+  size_t last_word = last / kBits;
+  uint32 first_mask = ~0U << (first % kBits);
+  uint32 last_mask = ~0U >> (kBits - 1 - last % kBits);
+
+  if (first_word == last_word)
+    return (bitmap[first_word] & first_mask & last_mask) != 0;
+  if ((bitmap[first_word] & first_mask) != 0)
+    return true;
+  for (size_t i = first_word + 1; i < last_word; ++i) {
+    if (bitmap[i] != 0)
+      return true;
+  }
+  return (bitmap[last_word] & last_mask) != 0;
+}
+
+template<typename AddressType, typename SizeType>
+bool AddressFilterBitmap<AddressType, SizeType>::AllBitsSet(
+    const Bitmap& bitmap, size_t first, size_t last) {
+  DCHECK_LE(first, last);
+
+  const size_t kBits = internal::kBitmapWordBits;
+  size_t first_word = first / kBits;
+  size_t last_word = last / kBits;
+  uint32 first_mask = ~0U << (first % kBits);
+  uint32 last_mask = ~0U >> (kBits - 1 - last % kBits);
+
+  if (first_word == last_word) {
+    uint32 mask = first_mask & last_mask;
+    return (bitmap[first_word] & mask) == mask;
+  }
+  if ((bitmap[first_word] & first_mask) != first_mask)
+    return false;
+  for (size_t i = first_word + 1; i < last_word; ++i) {
+    if (bitmap[i] != ~0U)
+      return false;
+  }
+  return (bitmap[last_word] & last_mask) == last_mask;
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_ADDRESS_FILTER_BITMAP_IMPL_H_
@@ -0,0 +1,163 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/core/address_filter_bitmap.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/address.h"
+
+namespace core {
+
+namespace {
+
+typedef AddressFilter<AbsoluteAddress, size_t> TestAddressFilter;
+typedef AddressFilterBitmap<AbsoluteAddress, size_t> TestAddressFilterBitmap;
+typedef TestAddressFilter::Range Range;
+
+Range MakeRange(size_t address, size_t size) {
+  return Range(AbsoluteAddress(address), size);
+}
+
+// Builds a filter over [0, 1000) with a mix of granule aligned, unaligned
+// and single byte ranges.
+void BuildFilter(TestAddressFilter* filter) {
+  *filter = TestAddressFilter(MakeRange(0, 1000));
+  filter->Mark(MakeRange(0, 32));
+  filter->Mark(MakeRange(40, 3));
+  filter->Mark(MakeRange(100, 150));
+  filter->Mark(MakeRange(511, 1));
+  filter->Mark(MakeRange(990, 10));
+}
+
+// Checks that the bitmap agrees with the filter for every range of up to
+// |max_size| bytes, including ranges straddling the extent.
+void ExpectSameQueries(const TestAddressFilter& filter,
+                       const TestAddressFilterBitmap& bitmap,
+                       size_t max_size) {
+  for (size_t start = 0; start < 1010; ++start) {
+    for (size_t size = 1; size <= max_size; ++size) {
+      Range range(MakeRange(start, size));
+      ASSERT_EQ(filter.IsMarked(range), bitmap.IsMarked(range))
+          << "IsMarked(" << start << ", " << size << ")";
+      ASSERT_EQ(filter.IsUnmarked(range), bitmap.IsUnmarked(range))
+          << "IsUnmarked(" << start << ", " << size << ")";
+    }
+  }
+}
+
+}  // namespace
+
+TEST(AddressFilterBitmapTest, DefaultConstructor) {
+  TestAddressFilterBitmap bitmap;
+  EXPECT_EQ(Range(), bitmap.extent());
+  EXPECT_EQ(0u, bitmap.granule_count());
+  EXPECT_TRUE(bitmap.empty());
+  EXPECT_FALSE(bitmap.IsMarked(MakeRange(0, 10)));
+  EXPECT_TRUE(bitmap.IsUnmarked(MakeRange(0, 10)));
+}
+
+TEST(AddressFilterBitmapTest, Construct) {
+  TestAddressFilter filter;
+  BuildFilter(&filter);
+
+  TestAddressFilterBitmap bitmap(filter, 4);
+  EXPECT_EQ(filter.extent(), bitmap.extent());
+  EXPECT_EQ(4u, bitmap.granularity_log2());
+  EXPECT_EQ(63u, bitmap.granule_count());
+  EXPECT_EQ(filter.size(), bitmap.marked_ranges().size());
+
+  TestAddressFilter round_trip;
+  bitmap.ToFilter(&round_trip);
+  EXPECT_EQ(filter, round_trip);
+}
+
+TEST(AddressFilterBitmapTest, QueriesMatchFilter) {
+  TestAddressFilter filter;
+  BuildFilter(&filter);
+
+  for (size_t granularity_log2 = 0; granularity_log2 < 8; ++granularity_log2) {
+    TestAddressFilterBitmap bitmap(filter, granularity_log2);
+    ASSERT_NO_FATAL_FAILURE(ExpectSameQueries(filter, bitmap, 80));
+  }
+}
+
+TEST(AddressFilterBitmapTest, QueriesOfEmptyAndFullFilters) {
+  TestAddressFilter filter(MakeRange(0, 1000));
+  TestAddressFilterBitmap empty(filter);
+  EXPECT_TRUE(empty.empty());
+  ASSERT_NO_FATAL_FAILURE(ExpectSameQueries(filter, empty, 40));
+
+  filter.Mark(filter.extent());
+  TestAddressFilterBitmap full(filter);
+  ASSERT_NO_FATAL_FAILURE(ExpectSameQueries(filter, full, 40));
+}
+
+TEST(AddressFilterBitmapTest, Intersect) {
+  TestAddressFilter f1;
+  BuildFilter(&f1);
+  TestAddressFilter f2(MakeRange(0, 1000));
+  f2.Mark(MakeRange(16, 30));
+  f2.Mark(MakeRange(200, 700));
+
+  TestAddressFilter expected;
+  f1.Intersect(f2, &expected);
+
+  TestAddressFilterBitmap b1(f1);
+  TestAddressFilterBitmap b2(f2);
+  TestAddressFilterBitmap intersection;
+  b1.Intersect(b2, &intersection);
+
+  TestAddressFilter actual;
+  intersection.ToFilter(&actual);
+  EXPECT_EQ(expected, actual);
+  ASSERT_NO_FATAL_FAILURE(ExpectSameQueries(expected, intersection, 40));
+
+  // In place.
+  b1.Intersect(b2, &b1);
+  b1.ToFilter(&actual);
+  EXPECT_EQ(expected, actual);
+}
+
+TEST(AddressFilterBitmapTest, Union) {
+  TestAddressFilter f1;
+  BuildFilter(&f1);
+  TestAddressFilter f2(MakeRange(0, 1000));
+  f2.Mark(MakeRange(32, 8));
+  f2.Mark(MakeRange(43, 57));
+  f2.Mark(MakeRange(600, 10));
+
+  TestAddressFilter expected;
+  f1.Union(f2, &expected);
+
+  TestAddressFilterBitmap b1(f1);
+  TestAddressFilterBitmap b2(f2);
+  TestAddressFilterBitmap union_bitmap;
+  b1.Union(b2, &union_bitmap);
+
+  // The contiguous ranges should have been coalesced.
+  TestAddressFilter actual;
+  union_bitmap.ToFilter(&actual);
+  EXPECT_EQ(expected, actual);
+  EXPECT_EQ(expected.size(), union_bitmap.marked_ranges().size());
+  EXPECT_TRUE(union_bitmap.IsMarked(MakeRange(0, 250)));
+  ASSERT_NO_FATAL_FAILURE(ExpectSameQueries(expected, union_bitmap, 40));
+
+  // In place.
+  b2.Union(b1, &b2);
+  b2.ToFilter(&actual);
+  EXPECT_EQ(expected, actual);
+}
+
+}  // namespace core
@@ -945,4 +945,47 @@ TEST(AddressFilterTest, Difference) {
   }
 }
 
+TEST(AddressFilterTest, UnionClipsToExtent) {
+  TestAddressFilter f1(MakeRange(20, 60));
+  f1.Mark(MakeRange(40, 10));
+
+  // The ranges of f2 straddling the extent of f1 are clipped to it.
+  TestAddressFilter f2(MakeRange(0, 100));
+  f2.Mark(MakeRange(10, 20));
+  f2.Mark(MakeRange(50, 5));
+  f2.Mark(MakeRange(70, 20));
+
+  f1.Union(f2, &f1);
+  EXPECT_EQ(MakeRange(20, 60), f1.extent());
+
+  RangeSet expected;
+  expected.insert(MakeRange(20, 10));
+  expected.insert(MakeRange(40, 15));
+  expected.insert(MakeRange(70, 10));
+  EXPECT_THAT(expected, ContainerEq(f1.marked_ranges()));
+}
+
+TEST(AddressFilterTest, DifferenceSpanningSeveralRanges) {
+  TestAddressFilter f1(MakeRange(0, 100));
+  f1.Mark(MakeRange(10, 10));
+  f1.Mark(MakeRange(30, 10));
+  f1.Mark(MakeRange(50, 10));
+  f1.Mark(MakeRange(70, 10));
+
+  // A single range of f2 covers the end of one range of f1, all of another
+  // and the start of a third.
+  TestAddressFilter f2(MakeRange(0, 100));
+  f2.Mark(MakeRange(15, 40));
+  f2.Mark(MakeRange(72, 2));
+
+  f1.Subtract(f2, &f1);
+
+  RangeSet expected;
+  expected.insert(MakeRange(10, 5));
+  expected.insert(MakeRange(55, 5));
+  expected.insert(MakeRange(70, 2));
+  expected.insert(MakeRange(74, 6));
+  EXPECT_THAT(expected, ContainerEq(f1.marked_ranges()));
+}
+
 }  // namespace core
@@ -40,14 +40,22 @@ template <typename AddressType, typename SizeType> class AddressRange;
 
 // An address space is a mapping from a set of non-overlapping address ranges
 // (AddressSpace::Range), each of non-zero size, to an ItemType.
-template <typename AddressType, typename SizeType, typename ItemType>
+//
+// The ranges are stored in a RangeMapType, which must provide the subset of
+// the std::map interface used here. This defaults to a std::map, but may be
+// a SortedVectorMap for address spaces that are queried much more often than
+// they're modified, and that don't hold on to iterators across
+// modifications. The AddressSpace semantics are identical with either.
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType =
+              std::map<AddressRange<AddressType, SizeType>, ItemType> >
 class AddressSpace {
  public:
   // Typedef we use for convenience throughout.
   typedef AddressRange<AddressType, SizeType> Range;
-  typedef std::map<Range, ItemType> RangeMap;
-  typedef typename std::map<Range, ItemType>::iterator RangeMapIter;
-  typedef typename std::map<Range, ItemType>::const_iterator RangeMapConstIter;
+  typedef RangeMapType RangeMap;
+  typedef typename RangeMap::iterator RangeMapIter;
+  typedef typename RangeMap::const_iterator RangeMapConstIter;
   typedef std::pair<RangeMapConstIter, RangeMapConstIter> RangeMapConstIterPair;
   typedef std::pair<RangeMapIter, RangeMapIter> RangeMapIterPair;
 
@@ -485,12 +493,14 @@ class AddressRangeMap {
   RangePairs range_pairs_;
 };
 
-template <typename AddressType, typename SizeType, typename ItemType>
-AddressSpace<AddressType, SizeType, ItemType>::AddressSpace() {
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::AddressSpace() {
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Insert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -512,8 +522,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindOrInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -539,8 +550,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::SubsumeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -595,8 +607,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+void AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::MergeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -640,8 +653,10 @@ void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
   return;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType,
+                  RangeMapType>::Remove(const Range& range) {
   // We can't remove empty ranges.
   if (range.IsEmpty())
     return false;
@@ -654,16 +669,22 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::const_iterator
+AddressSpace<AddressType, SizeType, ItemType,
+             RangeMapType>::FindFirstIntersection(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindFirstIntersection(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::iterator
+AddressSpace<AddressType, SizeType, ItemType,
+             RangeMapType>::FindFirstIntersection(
     const Range& range) {
   // Empty items do not exist in the address-space.
   if (range.IsEmpty())
@@ -693,16 +714,20 @@ AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapConstIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapConstIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindIntersecting(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMapIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) {
   // Empty ranges find nothing.
   if (range.IsEmpty())
@@ -730,15 +755,18 @@ AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
   return std::make_pair(begin, end);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Intersects(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Intersects(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   return (its.first != its.second);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType,
+                  RangeMapType>::ContainsExactly(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -746,8 +774,9 @@ bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
   return its.first->first == range;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Contains(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -755,9 +784,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
   return its.first->first.Contains(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::const_iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) const {
   // If there is a containing range, it must be the first intersection.
   RangeMap::const_iterator it(FindFirstIntersection(range));
@@ -767,9 +798,11 @@ AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType, typename SizeType, typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType,
+                      RangeMapType>::RangeMap::iterator
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) {
   // If there is a containing range, it must be the first intersection.
   RangeMap::iterator it(FindFirstIntersection(range));
@@ -17,6 +17,8 @@
 #include <limits>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "syzygy/core/random_number_generator.h"
+#include "syzygy/core/sorted_vector_map.h"
 #include "syzygy/core/unittest_util.h"
 
 namespace core {
@@ -493,6 +495,80 @@ TEST(AddressSpaceTest, FindIntersecting) {
   EXPECT_TRUE(it_pair.first == address_space.ranges().end());
 }
 
+typedef AddressSpace<size_t, size_t, size_t> ValueAddressSpace;
+typedef AddressSpace<size_t, size_t, size_t,
+                     SortedVectorMap<IntegerRange, size_t> >
+    SortedVectorAddressSpace;
+
+TEST(AddressSpaceTest, SortedVectorBackendMatchesMapBackend) {
+  ValueAddressSpace map_space;
+  SortedVectorAddressSpace vector_space;
+  RandomNumberGenerator random(0xC0FFEE);
+
+  for (size_t i = 0; i < 5000; ++i) {
+    IntegerRange range(random(1000), random(20));
+    size_t item = random(4);
+
+    switch (random(6)) {
+      case 0: {
+        ValueAddressSpace::RangeMapIter map_it;
+        SortedVectorAddressSpace::RangeMapIter vector_it;
+        bool map_result = map_space.Insert(range, item, &map_it);
+        ASSERT_EQ(map_result, vector_space.Insert(range, item, &vector_it));
+        if (map_result)
+          ASSERT_EQ(map_it->first, vector_it->first);
+        break;
+      }
+      case 1: {
+        ASSERT_EQ(map_space.FindOrInsert(range, item),
+                  vector_space.FindOrInsert(range, item));
+        break;
+      }
+      case 2: {
+        ASSERT_EQ(map_space.SubsumeInsert(range, item),
+                  vector_space.SubsumeInsert(range, item));
+        break;
+      }
+      case 3: {
+        if (random(4) == 0) {
+          map_space.MergeInsert(range, item);
+          vector_space.MergeInsert(range, item);
+        }
+        break;
+      }
+      case 4: {
+        ASSERT_EQ(map_space.Remove(range), vector_space.Remove(range));
+        break;
+      }
+      default: {
+        ValueAddressSpace::RangeMapConstIter map_it =
+            map_space.FindFirstIntersection(range);
+        SortedVectorAddressSpace::RangeMapConstIter vector_it =
+            vector_space.FindFirstIntersection(range);
+        ASSERT_EQ(map_it == map_space.end(), vector_it == vector_space.end());
+        if (map_it != map_space.end())
+          ASSERT_EQ(map_it->first, vector_it->first);
+
+        ASSERT_EQ(map_space.Contains(range), vector_space.Contains(range));
+        ASSERT_EQ(map_space.ContainsExactly(range),
+                  vector_space.ContainsExactly(range));
+        ASSERT_EQ(map_space.Intersects(range), vector_space.Intersects(range));
+        break;
+      }
+    }
+
+    // Both address spaces hold the same ranges and items.
+    ASSERT_EQ(map_space.size(), vector_space.size());
+    ValueAddressSpace::RangeMapConstIter map_it = map_space.begin();
+    SortedVectorAddressSpace::RangeMapConstIter vector_it =
+        vector_space.begin();
+    for (; map_it != map_space.end(); ++map_it, ++vector_it) {
+      ASSERT_EQ(map_it->first, vector_it->first);
+      ASSERT_EQ(map_it->second, vector_it->second);
+    }
+  }
+}
+
 TEST(AddressRangeMapTest, IsSimple) {
   IntegerRangeMap map;
   EXPECT_FALSE(map.IsSimple());
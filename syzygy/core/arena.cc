@@ -0,0 +1,75 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/arena.h"
+
+namespace core {
+
+Arena::Arena() : cursor_(NULL), end_(NULL) {
+  COMPILE_ASSERT(kMaxArenaAllocationSize % kGranularity == 0,
+                 max_allocation_size_must_be_a_multiple_of_granularity);
+  COMPILE_ASSERT(sizeof(FreeEntry) <= kGranularity,
+                 free_entries_must_fit_the_smallest_allocation);
+  ::memset(free_lists_, 0, sizeof(free_lists_));
+}
+
+Arena::~Arena() {
+  for (size_t i = 0; i < slabs_.size(); ++i)
+    ::operator delete(slabs_[i]);
+}
+
+void* Arena::Allocate(size_t size) {
+  if (size == 0)
+    size = 1;
+  if (size > kMaxArenaAllocationSize)
+    return ::operator new(size);
+
+  size_t size_class = GetSizeClass(size);
+  FreeEntry* entry = free_lists_[size_class];
+  if (entry != NULL) {
+    free_lists_[size_class] = entry->next;
+    return entry;
+  }
+
+  size_t rounded_size = (size_class + 1) * kGranularity;
+  if (static_cast<size_t>(end_ - cursor_) < rounded_size) {
+    // The tail of the previous slab is abandoned. As allocations are at most
+    // kMaxArenaAllocationSize, this wastes very little.
+    cursor_ = static_cast<uint8*>(::operator new(kSlabSize));
+    end_ = cursor_ + kSlabSize;
+    slabs_.push_back(cursor_);
+  }
+
+  void* ptr = cursor_;
+  cursor_ += rounded_size;
+  return ptr;
+}
+
+void Arena::Free(void* ptr, size_t size) {
+  if (ptr == NULL)
+    return;
+  if (size == 0)
+    size = 1;
+  if (size > kMaxArenaAllocationSize) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  size_t size_class = GetSizeClass(size);
+  FreeEntry* entry = static_cast<FreeEntry*>(ptr);
+  entry->next = free_lists_[size_class];
+  free_lists_[size_class] = entry;
+}
+
+}  // namespace core
@@ -0,0 +1,178 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An Arena carves small allocations out of large slabs, which are only
+// returned to the heap when the arena is destroyed. An ArenaAllocator is an
+// STL allocator drawing from an arena, so that node-based containers holding
+// many small elements don't make one heap allocation per element.
+//
+// Example use is as follows:
+//
+// Arena arena;
+// typedef ArenaAllocator<std::pair<const int, int> > Allocator;
+// std::map<int, int, std::less<int>, Allocator> map(std::less<int>(),
+//                                                   Allocator(&arena));
+//
+// The arena must outlive all of the containers drawing from it.
+
+#ifndef SYZYGY_CORE_ARENA_H_
+#define SYZYGY_CORE_ARENA_H_
+
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/logging.h"
+
+namespace core {
+
+// A bump allocator with free lists for small sizes. Freed allocations are
+// recycled for later allocations of the same size class, but the memory only
+// goes back to the heap when the arena is destroyed. Allocations that are too
+// large for a size class go straight to the heap.
+// @note This is not thread safe.
+class Arena {
+ public:
+  // The granularity and alignment of arena allocations.
+  static const size_t kGranularity = 8;
+  // The largest allocation served from the slabs.
+  static const size_t kMaxArenaAllocationSize = 256;
+  // The size of the slabs the arena carves allocations from.
+  static const size_t kSlabSize = 64 * 1024;
+
+  Arena();
+  ~Arena();
+
+  // Allocates @p size bytes.
+  // @param size the number of bytes to allocate.
+  // @returns a pointer to the allocation, aligned to kGranularity.
+  void* Allocate(size_t size);
+
+  // Frees an allocation.
+  // @param ptr the allocation to free, which must come from this arena.
+  // @param size the size that @p ptr was allocated with.
+  void Free(void* ptr, size_t size);
+
+  // @returns the number of bytes reserved for slabs.
+  size_t slab_bytes() const { return slabs_.size() * kSlabSize; }
+
+ protected:
+  // A freed allocation, chained in the free list of its size class.
+  struct FreeEntry {
+    FreeEntry* next;
+  };
+
+  // The number of size classes.
+  static const size_t kNumSizeClasses = kMaxArenaAllocationSize / kGranularity;
+
+  // @returns the size class of an allocation of @p size bytes.
+  static size_t GetSizeClass(size_t size) {
+    DCHECK_LT(0U, size);
+    DCHECK_GE(kMaxArenaAllocationSize, size);
+    return (size - 1) / kGranularity;
+  }
+
+  // The slabs, and the unused part of the last one.
+  std::vector<uint8*> slabs_;
+  uint8* cursor_;
+  uint8* end_;
+
+  // The free lists, indexed by size class.
+  FreeEntry* free_lists_[kNumSizeClasses];
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+// An STL allocator drawing from an arena. A default-constructed allocator
+// uses the heap, so that containers using this allocator can still be
+// created without an arena.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+    typedef ArenaAllocator<U> other;
+  };
+
+  ArenaAllocator() : arena_(NULL) {
+  }
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {
+  }
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other)  // NOLINT
+      : arena_(other.arena()) {
+  }
+
+  pointer allocate(size_type count, const void* /* hint */ = NULL) {
+    size_t size = count * sizeof(T);
+    if (arena_ == NULL)
+      return static_cast<pointer>(::operator new(size));
+    return static_cast<pointer>(arena_->Allocate(size));
+  }
+
+  void deallocate(pointer ptr, size_type count) {
+    if (arena_ == NULL) {
+      ::operator delete(ptr);
+      return;
+    }
+    arena_->Free(ptr, count * sizeof(T));
+  }
+
+  void construct(pointer ptr, const T& value) {
+    new(ptr) T(value);
+  }
+
+  void destroy(pointer ptr) {
+    ptr->~T();
+  }
+
+  pointer address(reference value) const { return &value; }
+  const_pointer address(const_reference value) const { return &value; }
+
+  size_type max_size() const {
+    return std::numeric_limits<size_type>::max() / sizeof(T);
+  }
+
+  // @returns the arena this allocator draws from, NULL for the heap.
+  Arena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena();
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.arena();
+  }
+
+ private:
+  Arena* arena_;
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_ARENA_H_
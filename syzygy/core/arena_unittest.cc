@@ -0,0 +1,92 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/arena.h"
+
+#include <map>
+#include <set>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+TEST(ArenaTest, AllocationsAreAlignedAndDistinct) {
+  Arena arena;
+  EXPECT_EQ(0U, arena.slab_bytes());
+
+  std::set<void*> allocations;
+  for (size_t size = 1; size <= Arena::kMaxArenaAllocationSize; ++size) {
+    void* ptr = arena.Allocate(size);
+    ASSERT_TRUE(ptr != NULL);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(ptr) % Arena::kGranularity);
+    EXPECT_TRUE(allocations.insert(ptr).second);
+    ::memset(ptr, 0xCC, size);
+  }
+  EXPECT_LT(0U, arena.slab_bytes());
+}
+
+TEST(ArenaTest, FreedAllocationsAreRecycled) {
+  Arena arena;
+  void* ptr1 = arena.Allocate(24);
+  void* ptr2 = arena.Allocate(24);
+  EXPECT_NE(ptr1, ptr2);
+
+  arena.Free(ptr1, 24);
+  // Allocations of the same size class reuse the freed memory.
+  EXPECT_EQ(ptr1, arena.Allocate(20));
+
+  // Other size classes don't.
+  arena.Free(ptr2, 24);
+  EXPECT_NE(ptr2, arena.Allocate(32));
+  EXPECT_EQ(ptr2, arena.Allocate(24));
+}
+
+TEST(ArenaTest, LargeAllocationsUseTheHeap) {
+  Arena arena;
+  const size_t kLargeSize = Arena::kSlabSize * 2;
+  void* ptr = arena.Allocate(kLargeSize);
+  ASSERT_TRUE(ptr != NULL);
+  ::memset(ptr, 0xCC, kLargeSize);
+  EXPECT_EQ(0U, arena.slab_bytes());
+  arena.Free(ptr, kLargeSize);
+}
+
+TEST(ArenaAllocatorTest, ContainersDrawFromTheArena) {
+  typedef ArenaAllocator<std::pair<const int, int> > Allocator;
+  typedef std::map<int, int, std::less<int>, Allocator> ArenaMap;
+
+  Arena arena;
+  {
+    ArenaMap map(std::less<int>(), Allocator(&arena));
+    for (int i = 0; i < 1000; ++i)
+      map.insert(std::make_pair(i, i));
+    EXPECT_LT(0U, arena.slab_bytes());
+
+    // Copies keep drawing from the same arena.
+    ArenaMap copy(map);
+    EXPECT_TRUE(copy.get_allocator() == map.get_allocator());
+    EXPECT_TRUE(copy == map);
+
+    map.erase(map.begin(), map.find(500));
+    EXPECT_EQ(500U, map.size());
+  }
+
+  // Without an arena, the allocator uses the heap.
+  ArenaMap heap_map;
+  EXPECT_TRUE(heap_map.get_allocator().arena() == NULL);
+  heap_map.insert(std::make_pair(1, 1));
+  EXPECT_EQ(1U, heap_map.size());
+}
+
+}  // namespace core
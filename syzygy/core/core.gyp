@@ -24,16 +24,24 @@
         'address.cc',
         'address.h',
         'address_filter.h',
+        'address_filter_bitmap.h',
+        'address_filter_bitmap_impl.h',
         'address_filter_impl.h',
         'address_space.cc',
         'address_space.h',
         'address_space_internal.h',
+        'arena.cc',
+        'arena.h',
+        'decoded_instruction_cache.cc',
+        'decoded_instruction_cache.h',
         'disassembler.cc',
         'disassembler.h',
         'disassembler_util.cc',
         'disassembler_util.h',
         'file_util.cc',
         'file_util.h',
+        'json_file_reader.cc',
+        'json_file_reader.h',
         'json_file_writer.cc',
         'json_file_writer.h',
         'random_number_generator.cc',
@@ -43,6 +51,7 @@
         'serialization.cc',
         'serialization.h',
         'serialization_impl.h',
+        'sorted_vector_map.h',
         'string_table.cc',
         'string_table.h',
         'zstream.cc',
@@ -75,15 +84,20 @@
       'includes': ['../build/masm.gypi'],
       'sources': [
         'address_unittest.cc',
+        'address_filter_bitmap_unittest.cc',
         'address_filter_unittest.cc',
         'address_space_unittest.cc',
+        'arena_unittest.cc',
+        'decoded_instruction_cache_unittest.cc',
         'disassembler_test_code.asm',
         'disassembler_unittest.cc',
         'disassembler_util_unittest.cc',
         'file_util_unittest.cc',
+        'json_file_reader_unittest.cc',
         'json_file_writer_unittest.cc',
         'section_offset_address_unittest.cc',
         'serialization_unittest.cc',
+        'sorted_vector_map_unittest.cc',
         'string_table_unittest.cc',
         'unittest_util_unittest.cc',
         'zstream_unittest.cc',
@@ -0,0 +1,85 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/decoded_instruction_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "base/logging.h"
+
+namespace core {
+
+DecodedInstructionCache::DecodedInstructionCache()
+    : max_entries_per_shard_(kDefaultMaxEntries / kNumShards) {
+}
+
+DecodedInstructionCache::DecodedInstructionCache(size_t max_entries)
+    : max_entries_per_shard_(std::max(max_entries / kNumShards,
+                                      static_cast<size_t>(1))) {
+}
+
+bool DecodedInstructionCache::DecodeOneInstruction(const uint8* buffer,
+                                                   size_t length,
+                                                   _DInst* instruction) {
+  DCHECK(buffer != NULL);
+  DCHECK(instruction != NULL);
+
+  // Only the bytes that the decoder may look at are part of the key.
+  std::string key(reinterpret_cast<const char*>(buffer),
+                  std::min(length, assm::kMaxInstructionLength));
+  Shard& shard = shards_[std::hash<std::string>()(key) % kNumShards];
+
+  {
+    base::AutoLock lock(shard.lock);
+    InstructionMap::const_iterator it = shard.instructions.find(key);
+    if (it != shard.instructions.end()) {
+      ++shard.hits;
+      *instruction = it->second;
+      return true;
+    }
+    ++shard.misses;
+  }
+
+  // Decode outside of the lock. Failures aren't cached, they're rare and
+  // usually abort whatever is decoding.
+  if (!core::DecodeOneInstruction(buffer, length, instruction))
+    return false;
+
+  base::AutoLock lock(shard.lock);
+  if (shard.instructions.size() >= max_entries_per_shard_)
+    shard.instructions.clear();
+  shard.instructions.insert(std::make_pair(key, *instruction));
+  return true;
+}
+
+size_t DecodedInstructionCache::hits() const {
+  size_t hits = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    base::AutoLock lock(shards_[i].lock);
+    hits += shards_[i].hits;
+  }
+  return hits;
+}
+
+size_t DecodedInstructionCache::misses() const {
+  size_t misses = 0;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    base::AutoLock lock(shards_[i].lock);
+    misses += shards_[i].misses;
+  }
+  return misses;
+}
+
+}  // namespace core
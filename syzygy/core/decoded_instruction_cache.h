@@ -0,0 +1,94 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares DecodedInstructionCache, which memoizes the decoding of single
+// instructions so that passes decoding the same code don't each pay for
+// running distorm over it.
+
+#ifndef SYZYGY_CORE_DECODED_INSTRUCTION_CACHE_H_
+#define SYZYGY_CORE_DECODED_INSTRUCTION_CACHE_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/assm/const.h"
+#include "syzygy/core/disassembler_util.h"
+
+namespace core {
+
+// A cache of decoded instructions, keyed on the bytes they are decoded from.
+// A single decode never reads more than kMaxInstructionLength bytes, so those
+// bytes fully determine the result, wherever they are found. The cache hits
+// on code that has moved, such as a block rebuilt by an earlier transform, and
+// never returns stale results for memory that has been reused.
+// @note This is thread safe.
+class DecodedInstructionCache {
+ public:
+  // The default maximum number of instructions to keep.
+  static const size_t kDefaultMaxEntries = 1 << 20;
+
+  DecodedInstructionCache();
+  explicit DecodedInstructionCache(size_t max_entries);
+
+  // Decodes exactly one instruction from the given buffer. This has the same
+  // semantics as core::DecodeOneInstruction without an address.
+  // @param buffer the buffer containing the data to decode.
+  // @param length the length of the buffer.
+  // @param instruction receives the decoded instruction.
+  // @returns true if an instruction was decoded, false otherwise.
+  bool DecodeOneInstruction(const uint8* buffer,
+                            size_t length,
+                            _DInst* instruction);
+
+  // @name Statistics.
+  // @{
+  size_t hits() const;
+  size_t misses() const;
+  // @}
+
+ protected:
+  // The cache is split into independently locked shards, to reduce
+  // contention between threads.
+  static const size_t kNumShards = 16;
+
+  // The decoded instructions, keyed on the bytes they were decoded from. Keys
+  // are no longer than std::string's inline storage, so they don't need an
+  // allocation of their own.
+  typedef base::hash_map<std::string, _DInst> InstructionMap;
+
+  struct Shard {
+    Shard() : hits(0), misses(0) {
+    }
+
+    mutable base::Lock lock;
+    InstructionMap instructions;  // Under lock.
+    size_t hits;  // Under lock.
+    size_t misses;  // Under lock.
+  };
+
+  // The maximum number of instructions kept by each shard. A full shard is
+  // emptied.
+  size_t max_entries_per_shard_;
+
+  Shard shards_[kNumShards];
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DecodedInstructionCache);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_DECODED_INSTRUCTION_CACHE_H_
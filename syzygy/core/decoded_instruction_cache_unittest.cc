@@ -0,0 +1,99 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/decoded_instruction_cache.h"
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+const uint8 kCode[] = {
+  0x8B, 0x44, 0x24, 0x04,              // mov eax,dword ptr [esp+4]
+  0x01, 0x05, 0x00, 0x00, 0x00, 0x00,  // add dword ptr [_y],eax
+  0xC3                                 // ret
+};
+
+void ExpectSameInstruction(const _DInst& expected, const _DInst& actual) {
+  EXPECT_EQ(0, ::memcmp(&expected, &actual, sizeof(expected)));
+}
+
+}  // namespace
+
+TEST(DecodedInstructionCacheTest, MatchesDecodeOneInstruction) {
+  DecodedInstructionCache cache;
+
+  for (size_t offset = 0; offset < sizeof(kCode); ) {
+    _DInst expected = {};
+    ASSERT_TRUE(DecodeOneInstruction(kCode + offset, sizeof(kCode) - offset,
+                                     &expected));
+
+    _DInst actual = {};
+    ASSERT_TRUE(cache.DecodeOneInstruction(kCode + offset,
+                                           sizeof(kCode) - offset, &actual));
+    ExpectSameInstruction(expected, actual);
+
+    // The second decode hits the cache.
+    ASSERT_TRUE(cache.DecodeOneInstruction(kCode + offset,
+                                           sizeof(kCode) - offset, &actual));
+    ExpectSameInstruction(expected, actual);
+
+    offset += expected.size;
+  }
+
+  EXPECT_EQ(3U, cache.hits());
+  EXPECT_EQ(3U, cache.misses());
+}
+
+TEST(DecodedInstructionCacheTest, HitsOnMovedCode) {
+  DecodedInstructionCache cache;
+  uint8 copy[sizeof(kCode)] = {};
+  ::memcpy(copy, kCode, sizeof(kCode));
+
+  _DInst original = {};
+  ASSERT_TRUE(cache.DecodeOneInstruction(kCode, sizeof(kCode), &original));
+  _DInst moved = {};
+  ASSERT_TRUE(cache.DecodeOneInstruction(copy, sizeof(copy), &moved));
+  ExpectSameInstruction(original, moved);
+  EXPECT_EQ(1U, cache.hits());
+
+  // Changing the bytes changes the result.
+  copy[0] = 0xC3;
+  _DInst changed = {};
+  ASSERT_TRUE(cache.DecodeOneInstruction(copy, sizeof(copy), &changed));
+  EXPECT_EQ(1U, changed.size);
+  EXPECT_EQ(1U, cache.hits());
+}
+
+TEST(DecodedInstructionCacheTest, TruncatedBuffersFail) {
+  DecodedInstructionCache cache;
+  _DInst instruction = {};
+  EXPECT_FALSE(cache.DecodeOneInstruction(kCode, 2, &instruction));
+  EXPECT_FALSE(cache.DecodeOneInstruction(kCode, 2, &instruction));
+  EXPECT_EQ(0U, cache.hits());
+}
+
+TEST(DecodedInstructionCacheTest, FullCacheKeepsWorking) {
+  DecodedInstructionCache cache(1);
+  for (size_t i = 0; i < 100; ++i) {
+    // mov eax, i
+    uint8 code[] = { 0xB8, static_cast<uint8>(i), 0x00, 0x00, 0x00 };
+    _DInst instruction = {};
+    ASSERT_TRUE(cache.DecodeOneInstruction(code, sizeof(code), &instruction));
+    EXPECT_EQ(sizeof(code), instruction.size);
+  }
+}
+
+}  // namespace core
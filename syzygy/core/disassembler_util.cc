@@ -146,13 +146,18 @@ _DecodeResult DistormDecompose(_CodeInfo* ci,
   return ret;
 }
 
-bool DecodeOneInstruction(
-    uint32 address, const uint8* buffer, size_t length, _DInst* instruction) {
+namespace {
+
+bool DecodeOneInstructionImpl(_DecodeType decode_type,
+                              uint32 address,
+                              const uint8* buffer,
+                              size_t length,
+                              _DInst* instruction) {
   DCHECK(buffer != NULL);
   DCHECK(instruction != NULL);
 
   _CodeInfo code = {};
-  code.dt = Decode32Bits;
+  code.dt = decode_type;
   code.features = DF_NONE;
   code.codeOffset = address;
   code.codeLen = length;
@@ -178,6 +183,14 @@ bool DecodeOneInstruction(
   return true;
 }
 
+}  // namespace
+
+bool DecodeOneInstruction(
+    uint32 address, const uint8* buffer, size_t length, _DInst* instruction) {
+  return DecodeOneInstructionImpl(Decode32Bits, address, buffer, length,
+                                  instruction);
+}
+
 bool DecodeOneInstruction(
     const uint8* buffer, size_t length, _DInst* instruction) {
   DCHECK(buffer != NULL);
@@ -187,6 +200,12 @@ bool DecodeOneInstruction(
   return true;
 }
 
+bool DecodeOneInstruction64(
+    const uint8* buffer, size_t length, _DInst* instruction) {
+  return DecodeOneInstructionImpl(Decode64Bits, 0x10000000, buffer, length,
+                                  instruction);
+}
+
 bool InstructionToString(
     const _DInst& instruction,
     const uint8_t* data,
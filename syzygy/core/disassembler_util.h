@@ -59,6 +59,13 @@ bool DecodeOneInstruction(
 bool DecodeOneInstruction(
     const uint8* buffer, size_t length, _DInst* instruction);
 
+// Decodes exactly one x64 instruction from the given buffer.
+// @param buffer the buffer containing the data to decode.
+// @param length the length of the buffer.
+// @returns true if an instruction was decoded, false otherwise.
+bool DecodeOneInstruction64(
+    const uint8* buffer, size_t length, _DInst* instruction);
+
 // Dump text representation of exactly one instruction to a std::string.
 // @param instruction the instruction to dump.
 // @param data points to the raw byte sequences.
@@ -150,6 +150,21 @@ TEST(DisassemblerUtilTest, DistormWrapperVxorpsPasses) {
   EXPECT_TRUE(DecodeOneInstruction(kVxorps, sizeof(kVxorps), &inst));
 }
 
+TEST(DisassemblerUtilTest, DecodeOneInstruction64) {
+  // mov rax, qword ptr [r13]
+  static const uint8 kMovRaxR13[] = { 0x49, 0x8B, 0x45, 0x00 };
+  _DInst inst = {};
+  EXPECT_TRUE(DecodeOneInstruction64(kMovRaxR13, sizeof(kMovRaxR13), &inst));
+  EXPECT_EQ(sizeof(kMovRaxR13), inst.size);
+  EXPECT_EQ(I_MOV, inst.opcode);
+  EXPECT_EQ(R_RAX, inst.ops[0].index);
+  EXPECT_EQ(R_R13, inst.ops[1].index);
+
+  // The same bytes are two instructions in 32-bit mode.
+  EXPECT_TRUE(DecodeOneInstruction(kMovRaxR13, sizeof(kMovRaxR13), &inst));
+  EXPECT_EQ(1U, inst.size);
+}
+
 TEST(DisassemblerUtilTest, InstructionToString) {
   _DInst inst = {};
   inst = DecodeBuffer(kNop1, sizeof(kNop1));
@@ -0,0 +1,485 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include "syzygy/core/json_file_reader.h"
+
+#include "base/logging.h"
+#include "base/values.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversion_utils.h"
+
+namespace core {
+
+namespace {
+
+// The size of the read buffer.
+const size_t kBufferSize = 64 * 1024;
+
+bool IsWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool IsNumberChar(char c) {
+  return IsDigit(c) || c == '.' || c == 'e' || c == 'E' || c == '+' ||
+      c == '-';
+}
+
+bool HexDigitValue(char c, uint32* value) {
+  DCHECK(value != NULL);
+  if (c >= '0' && c <= '9') {
+    *value = c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    *value = c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    *value = c - 'A' + 10;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+JSONFileReader::JSONFileReader(FILE* file)
+    : file_(file),
+      buffer_(kBufferSize),
+      buffer_pos_(0),
+      buffer_len_(0),
+      eof_(false),
+      error_(false),
+      finished_(false),
+      token_(kNoToken),
+      integer_value_(0),
+      double_value_(0.0),
+      boolean_value_(false) {
+  DCHECK(file != NULL);
+}
+
+JSONFileReader::~JSONFileReader() {
+}
+
+bool JSONFileReader::Next() {
+  if (error_)
+    return false;
+  if (token_ == kEndOfInput)
+    return true;
+
+  char c = 0;
+  if (!SkipWhitespace())
+    return false;
+  if (!GetChar(&c)) {
+    if (error_)
+      return Fail("Error reading JSON input.");
+    if (!finished_)
+      return Fail("Unexpected end of JSON input.");
+    token_ = kEndOfInput;
+    return true;
+  }
+
+  if (finished_)
+    return Fail("Unexpected data after JSON value.");
+
+  // Consume the separator that precedes the token, if any.
+  if (!stack_.empty()) {
+    StructureState& state = stack_.back();
+    if (state == kListValue || state == kDictValue) {
+      char closing = state == kListValue ? ']' : '}';
+      if (c == ',') {
+        state = state == kListValue ? kListComma : kDictComma;
+        if (!SkipWhitespace() || !GetChar(&c))
+          return Fail("Unexpected end of JSON input.");
+      } else if (c != closing) {
+        return Fail("Expected a comma in JSON input.");
+      }
+    } else if (state == kDictKey) {
+      if (c != ':')
+        return Fail("Expected a colon in JSON input.");
+      if (!SkipWhitespace() || !GetChar(&c))
+        return Fail("Unexpected end of JSON input.");
+    }
+  }
+
+  // Handle the end of structures.
+  if (c == '}' || c == ']') {
+    StructureState start = c == '}' ? kDictStart : kListStart;
+    StructureState value = c == '}' ? kDictValue : kListValue;
+    if (stack_.empty() || (stack_.back() != start && stack_.back() != value))
+      return Fail("Unexpected closing of a structure in JSON input.");
+    stack_.pop_back();
+    token_ = c == '}' ? kCloseDict : kCloseList;
+    EndValue();
+    return true;
+  }
+
+  // Handle dictionary keys.
+  if (!stack_.empty() &&
+      (stack_.back() == kDictStart || stack_.back() == kDictComma)) {
+    if (c != '"')
+      return Fail("Expected a dictionary key in JSON input.");
+    if (!ReadString())
+      return false;
+    stack_.back() = kDictKey;
+    token_ = kKey;
+    return true;
+  }
+
+  // Anything else is a value.
+  switch (c) {
+    case '{':
+      stack_.push_back(kDictStart);
+      token_ = kOpenDict;
+      return true;
+
+    case '[':
+      stack_.push_back(kListStart);
+      token_ = kOpenList;
+      return true;
+
+    case '"':
+      if (!ReadString())
+        return false;
+      token_ = kString;
+      break;
+
+    case 't':
+    case 'f':
+      if (!ReadLiteral(c == 't' ? "rue" : "alse"))
+        return false;
+      token_ = kBoolean;
+      boolean_value_ = c == 't';
+      break;
+
+    case 'n':
+      if (!ReadLiteral("ull"))
+        return false;
+      token_ = kNull;
+      break;
+
+    default:
+      if (c != '-' && !IsDigit(c))
+        return Fail("Unexpected character in JSON input.");
+      if (!ReadNumber(c))
+        return false;
+      break;
+  }
+
+  EndValue();
+  return true;
+}
+
+bool JSONFileReader::AtValue() const {
+  switch (token_) {
+    case kOpenDict:
+    case kOpenList:
+    case kString:
+    case kInteger:
+    case kDouble:
+    case kBoolean:
+    case kNull:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+bool JSONFileReader::ReadValue(scoped_ptr<base::Value>* value) {
+  DCHECK(value != NULL);
+  if (!AtValue())
+    return Fail("Expected a value in JSON input.");
+  return ReadValueImpl(value);
+}
+
+bool JSONFileReader::SkipValue() {
+  if (!AtValue())
+    return Fail("Expected a value in JSON input.");
+
+  // Simple values are a single token, structures end when the stack gets back
+  // to its current depth.
+  if (token_ != kOpenDict && token_ != kOpenList)
+    return true;
+  size_t depth = stack_.size();
+  while (stack_.size() >= depth) {
+    if (!Next())
+      return false;
+  }
+  return true;
+}
+
+bool JSONFileReader::Fail(const char* message) {
+  DCHECK(message != NULL);
+  LOG(ERROR) << message;
+  error_ = true;
+  token_ = kNoToken;
+  return false;
+}
+
+bool JSONFileReader::PeekChar(char* c) {
+  DCHECK(c != NULL);
+
+  if (buffer_pos_ == buffer_len_) {
+    if (eof_)
+      return false;
+
+    buffer_pos_ = 0;
+    buffer_len_ = ::fread(&buffer_[0], 1, buffer_.size(), file_);
+    if (::ferror(file_)) {
+      eof_ = true;
+      error_ = true;
+    } else if (::feof(file_)) {
+      eof_ = true;
+    }
+    if (buffer_len_ == 0)
+      return false;
+  }
+
+  *c = buffer_[buffer_pos_];
+  return true;
+}
+
+bool JSONFileReader::GetChar(char* c) {
+  if (!PeekChar(c))
+    return false;
+  ++buffer_pos_;
+  return true;
+}
+
+bool JSONFileReader::SkipWhitespace() {
+  char c = 0;
+  while (PeekChar(&c)) {
+    if (IsWhitespace(c)) {
+      ++buffer_pos_;
+      continue;
+    }
+    if (c != '/')
+      return true;
+
+    // Skip a comment.
+    ++buffer_pos_;
+    if (!GetChar(&c) || (c != '/' && c != '*'))
+      return Fail("Unexpected character in JSON input.");
+    if (c == '/') {
+      while (GetChar(&c) && c != '\n') {
+      }
+    } else {
+      char previous = 0;
+      while (true) {
+        if (!GetChar(&c))
+          return Fail("Unterminated comment in JSON input.");
+        if (previous == '*' && c == '/')
+          break;
+        previous = c;
+      }
+    }
+  }
+
+  if (error_)
+    return Fail("Error reading JSON input.");
+  return true;
+}
+
+bool JSONFileReader::ReadLiteral(const char* literal) {
+  DCHECK(literal != NULL);
+  for (; *literal != 0; ++literal) {
+    char c = 0;
+    if (!GetChar(&c) || c != *literal)
+      return Fail("Invalid literal in JSON input.");
+  }
+  return true;
+}
+
+bool JSONFileReader::ReadString() {
+  string_value_.clear();
+  while (true) {
+    char c = 0;
+    if (!GetChar(&c))
+      return Fail("Unterminated string in JSON input.");
+    if (c == '"')
+      return true;
+    if (c != '\\') {
+      string_value_.push_back(c);
+      continue;
+    }
+
+    if (!GetChar(&c))
+      return Fail("Unterminated string in JSON input.");
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        string_value_.push_back(c);
+        break;
+      case 'b':
+        string_value_.push_back('\b');
+        break;
+      case 'f':
+        string_value_.push_back('\f');
+        break;
+      case 'n':
+        string_value_.push_back('\n');
+        break;
+      case 'r':
+        string_value_.push_back('\r');
+        break;
+      case 't':
+        string_value_.push_back('\t');
+        break;
+
+      case 'u': {
+        uint32 code_point = 0;
+        if (!ReadUnicodeEscape(&code_point))
+          return false;
+
+        // Characters outside of the BMP are encoded as surrogate pairs.
+        if (code_point >= 0xDC00 && code_point <= 0xDFFF)
+          return Fail("Invalid surrogate pair in JSON input.");
+        if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+          uint32 low = 0;
+          if (!GetChar(&c) || c != '\\' || !GetChar(&c) || c != 'u' ||
+              !ReadUnicodeEscape(&low) || low < 0xDC00 || low > 0xDFFF) {
+            return Fail("Invalid surrogate pair in JSON input.");
+          }
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+              (low - 0xDC00);
+        }
+        base::WriteUnicodeCharacter(code_point, &string_value_);
+        break;
+      }
+
+      default:
+        return Fail("Invalid escape sequence in JSON input.");
+    }
+  }
+}
+
+bool JSONFileReader::ReadUnicodeEscape(uint32* code_point) {
+  DCHECK(code_point != NULL);
+  *code_point = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    char c = 0;
+    uint32 digit = 0;
+    if (!GetChar(&c) || !HexDigitValue(c, &digit))
+      return Fail("Invalid unicode escape in JSON input.");
+    *code_point = (*code_point << 4) | digit;
+  }
+  return true;
+}
+
+bool JSONFileReader::ReadNumber(char first) {
+  number_.assign(1, first);
+  bool is_integer = true;
+  char c = 0;
+  while (PeekChar(&c) && IsNumberChar(c)) {
+    if (c == '.' || c == 'e' || c == 'E')
+      is_integer = false;
+    number_.push_back(c);
+    ++buffer_pos_;
+  }
+
+  // Like base::JSONReader, integers that don't fit in an int are read as
+  // doubles.
+  if (is_integer && base::StringToInt(number_, &integer_value_)) {
+    token_ = kInteger;
+    double_value_ = integer_value_;
+    return true;
+  }
+  if (!base::StringToDouble(number_, &double_value_))
+    return Fail("Invalid number in JSON input.");
+  token_ = kDouble;
+  return true;
+}
+
+void JSONFileReader::EndValue() {
+  if (stack_.empty()) {
+    finished_ = true;
+    return;
+  }
+
+  StructureState& state = stack_.back();
+  if (state == kListStart || state == kListComma) {
+    state = kListValue;
+  } else {
+    DCHECK_EQ(kDictKey, state);
+    state = kDictValue;
+  }
+}
+
+bool JSONFileReader::ReadValueImpl(scoped_ptr<base::Value>* value) {
+  DCHECK(value != NULL);
+
+  switch (token_) {
+    case kOpenDict: {
+      scoped_ptr<base::DictionaryValue> dict(new base::DictionaryValue());
+      while (true) {
+        if (!Next())
+          return false;
+        if (token_ == kCloseDict)
+          break;
+        DCHECK_EQ(kKey, token_);
+        std::string key(string_value_);
+        scoped_ptr<base::Value> child;
+        if (!Next() || !ReadValueImpl(&child))
+          return false;
+        dict->SetWithoutPathExpansion(key, child.release());
+      }
+      value->reset(dict.release());
+      return true;
+    }
+
+    case kOpenList: {
+      scoped_ptr<base::ListValue> list(new base::ListValue());
+      while (true) {
+        if (!Next())
+          return false;
+        if (token_ == kCloseList)
+          break;
+        scoped_ptr<base::Value> child;
+        if (!ReadValueImpl(&child))
+          return false;
+        list->Append(child.release());
+      }
+      value->reset(list.release());
+      return true;
+    }
+
+    case kString:
+      value->reset(new base::StringValue(string_value_));
+      return true;
+
+    case kInteger:
+      value->reset(new base::FundamentalValue(integer_value_));
+      return true;
+
+    case kDouble:
+      value->reset(new base::FundamentalValue(double_value_));
+      return true;
+
+    case kBoolean:
+      value->reset(new base::FundamentalValue(boolean_value_));
+      return true;
+
+    case kNull:
+      value->reset(base::Value::CreateNullValue());
+      return true;
+
+    default:
+      return Fail("Expected a value in JSON input.");
+  }
+}
+
+}  // namespace core
@@ -0,0 +1,195 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// JSONFileReader is a lightweight streaming reader for JSON data, and the
+// counterpart of JSONFileWriter. Rather than parsing a whole document into a
+// base::Value, it reads the file through a fixed size buffer and lets the
+// caller walk the document token by token, only materializing the values it
+// asks for. This keeps the memory use of loading large files bounded by the
+// size of their largest materialized value.
+#ifndef SYZYGY_CORE_JSON_FILE_READER_H_
+#define SYZYGY_CORE_JSON_FILE_READER_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_piece.h"
+
+// Forward declaration.
+namespace base {
+class Value;
+}
+
+namespace core {
+
+// Reads JSON data as a stream of tokens. Comments, as written by
+// JSONFileWriter when pretty printing, are skipped.
+//
+// Typical use, to read a dictionary:
+//
+//   JSONFileReader reader(file);
+//   if (!reader.Next() || reader.token() != JSONFileReader::kOpenDict)
+//     return false;
+//   while (reader.Next() && reader.token() == JSONFileReader::kKey) {
+//     std::string key = reader.string_value();
+//     // Move to the value and read or skip it.
+//     if (!reader.Next() || !reader.SkipValue())
+//       return false;
+//   }
+//   if (reader.token() != JSONFileReader::kCloseDict)
+//     return false;
+class JSONFileReader {
+ public:
+  // The types of tokens.
+  enum TokenType {
+    // No token has been read yet, or an error occurred.
+    kNoToken,
+    // The end of the input was reached after a complete value.
+    kEndOfInput,
+    kOpenDict,
+    kCloseDict,
+    kOpenList,
+    kCloseList,
+    // A dictionary key. Its value is in string_value().
+    kKey,
+    // Simple values. Their value is in the corresponding accessor.
+    kString,
+    kInteger,
+    kDouble,
+    kBoolean,
+    kNull,
+  };
+
+  // @param file the file to read from. The reader doesn't take ownership of
+  //     it.
+  explicit JSONFileReader(FILE* file);
+
+  ~JSONFileReader();
+
+  // Moves to the next token.
+  // @returns true on success, false if the data is not valid JSON or can't
+  //     be read. Errors are logged.
+  bool Next();
+
+  // @name Accessors for the current token.
+  // @{
+  TokenType token() const { return token_; }
+  // Valid for kKey and kString tokens.
+  const std::string& string_value() const { return string_value_; }
+  // Valid for kInteger tokens.
+  int integer_value() const { return integer_value_; }
+  // Valid for kInteger and kDouble tokens.
+  double double_value() const { return double_value_; }
+  // Valid for kBoolean tokens.
+  bool boolean_value() const { return boolean_value_; }
+  // @}
+
+  // @returns true if the current token starts a value.
+  bool AtValue() const;
+
+  // Reads the value starting at the current token, including any nested
+  // structure. The reader is left on the last token of the value.
+  // @param value receives the value.
+  // @returns true on success, false on error.
+  bool ReadValue(scoped_ptr<base::Value>* value);
+
+  // Skips the value starting at the current token, including any nested
+  // structure. The reader is left on the last token of the value.
+  // @returns true on success, false on error.
+  bool SkipValue();
+
+ protected:
+  // Everything here is protected for unittesting purposes.
+
+  // The states of the structures being parsed.
+  enum StructureState {
+    // In a list, awaiting a value or the closing bracket.
+    kListStart,
+    // In a list after a comma, awaiting a value.
+    kListComma,
+    // In a list after a value, awaiting a comma or the closing bracket.
+    kListValue,
+    // In a dictionary, awaiting a key or the closing brace.
+    kDictStart,
+    // In a dictionary after a comma, awaiting a key.
+    kDictComma,
+    // In a dictionary after a key, awaiting a colon and a value.
+    kDictKey,
+    // In a dictionary after a value, awaiting a comma or the closing brace.
+    kDictValue,
+  };
+
+  // Logs @p message, and puts the reader in the error state.
+  // @returns false.
+  bool Fail(const char* message);
+
+  // Low level character access, through the buffer.
+  // @returns false at the end of the input, or on a read error.
+  bool PeekChar(char* c);
+  bool GetChar(char* c);
+
+  // Skips whitespace and comments.
+  bool SkipWhitespace();
+
+  // Reads a literal (true, false or null) whose first character has been
+  // consumed.
+  bool ReadLiteral(const char* literal);
+  // Reads a string whose opening quote has been consumed into
+  // string_value_.
+  bool ReadString();
+  // Reads a \uXXXX escape sequence whose \u has been consumed.
+  bool ReadUnicodeEscape(uint32* code_point);
+  // Reads a number starting with @p first.
+  bool ReadNumber(char first);
+
+  // Updates the structure state after a complete value.
+  void EndValue();
+
+  // Helper for ReadValue, which reads a nested value.
+  bool ReadValueImpl(scoped_ptr<base::Value>* value);
+
+  // The file that is being read from.
+  FILE* file_;
+  // The read buffer, and the current position and amount of data in it.
+  std::vector<char> buffer_;
+  size_t buffer_pos_;
+  size_t buffer_len_;
+  // Set when the end of the file has been reached, or on a read error.
+  bool eof_;
+  // Set when a read error occurred.
+  bool error_;
+
+  // The stack of structures currently being parsed.
+  std::vector<StructureState> stack_;
+  // Set once the top level value has been read.
+  bool finished_;
+
+  // The current token and its value.
+  TokenType token_;
+  std::string string_value_;
+  int integer_value_;
+  double double_value_;
+  bool boolean_value_;
+
+  // Scratch space for parsing numbers, kept to avoid reallocating it.
+  std::string number_;
+
+  DISALLOW_COPY_AND_ASSIGN(JSONFileReader);
+};
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_JSON_FILE_READER_H_
@@ -0,0 +1,239 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/core/json_file_reader.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/json_file_writer.h"
+
+namespace core {
+
+namespace {
+
+class JSONFileReaderTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+
+  // Replaces the contents of the test file with @p contents, and rewinds it.
+  void SetContents(const std::string& contents) {
+    base::FilePath path;
+    file_.reset(base::CreateAndOpenTemporaryFileInDir(temp_dir_.path(),
+                                                      &path));
+    ASSERT_TRUE(file_.get() != NULL);
+    ASSERT_EQ(contents.size(),
+              ::fwrite(contents.data(), 1, contents.size(), file_.get()));
+    ASSERT_EQ(0, ::fseek(file_.get(), 0, SEEK_SET));
+  }
+
+  // Reads the test file as a single value, and ensures that nothing follows
+  // it.
+  bool ReadDocument(scoped_ptr<base::Value>* value) {
+    JSONFileReader reader(file_.get());
+    return reader.Next() && reader.ReadValue(value) && reader.Next() &&
+        reader.token() == JSONFileReader::kEndOfInput;
+  }
+
+  // Checks that @p contents is read to the same value as base::JSONReader
+  // reads it.
+  void ExpectReadsLikeJSONReader(const char* contents) {
+    scoped_ptr<base::Value> expected(base::JSONReader::Read(contents));
+    ASSERT_TRUE(expected.get() != NULL);
+
+    ASSERT_NO_FATAL_FAILURE(SetContents(contents));
+    scoped_ptr<base::Value> value;
+    ASSERT_TRUE(ReadDocument(&value));
+    EXPECT_TRUE(expected->Equals(value.get()));
+  }
+
+  void ExpectInvalid(const char* contents) {
+    ASSERT_NO_FATAL_FAILURE(SetContents(contents));
+    scoped_ptr<base::Value> value;
+    EXPECT_FALSE(ReadDocument(&value));
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::ScopedFILE file_;
+};
+
+}  // namespace
+
+TEST_F(JSONFileReaderTest, Tokens) {
+  ASSERT_NO_FATAL_FAILURE(SetContents(
+      "{\"a\": [1, -2.5, \"s\", true, null], \"b\": {}}"));
+  JSONFileReader reader(file_.get());
+  EXPECT_EQ(JSONFileReader::kNoToken, reader.token());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kOpenDict, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kKey, reader.token());
+  EXPECT_EQ("a", reader.string_value());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kOpenList, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kInteger, reader.token());
+  EXPECT_EQ(1, reader.integer_value());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kDouble, reader.token());
+  EXPECT_EQ(-2.5, reader.double_value());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kString, reader.token());
+  EXPECT_EQ("s", reader.string_value());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kBoolean, reader.token());
+  EXPECT_TRUE(reader.boolean_value());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kNull, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kCloseList, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kKey, reader.token());
+  EXPECT_EQ("b", reader.string_value());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kOpenDict, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kCloseDict, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kCloseDict, reader.token());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kEndOfInput, reader.token());
+}
+
+TEST_F(JSONFileReaderTest, ReadValue) {
+  ExpectReadsLikeJSONReader("42");
+  ExpectReadsLikeJSONReader("\"string\"");
+  ExpectReadsLikeJSONReader("[]");
+  ExpectReadsLikeJSONReader("{}");
+  ExpectReadsLikeJSONReader("[1, 2.5, 1e3, -7, 99999999999, false, null]");
+  ExpectReadsLikeJSONReader("{\"a\": {\"b\": [{\"c\": \"d\"}]}, \"e\": []}");
+}
+
+TEST_F(JSONFileReaderTest, ReadsEscapes) {
+  ExpectReadsLikeJSONReader("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"");
+  ExpectReadsLikeJSONReader("\"\\u0041\\u00e9\\u20AC\"");
+  ExpectReadsLikeJSONReader("\"\\ud83d\\ude00\"");
+}
+
+TEST_F(JSONFileReaderTest, SkipsComments) {
+  ASSERT_NO_FATAL_FAILURE(SetContents(
+      "// Leading comment.\n"
+      "{\n"
+      "  \"a\": 1,  // Trailing comment.\n"
+      "  /* Block\n"
+      "     comment. */\n"
+      "  \"b\": 2\n"
+      "}\n"
+      "// Final comment.\n"));
+  scoped_ptr<base::Value> value;
+  ASSERT_TRUE(ReadDocument(&value));
+
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+  int i = 0;
+  EXPECT_TRUE(dict->GetInteger("a", &i));
+  EXPECT_EQ(1, i);
+  EXPECT_TRUE(dict->GetInteger("b", &i));
+  EXPECT_EQ(2, i);
+}
+
+TEST_F(JSONFileReaderTest, SkipValue) {
+  ASSERT_NO_FATAL_FAILURE(SetContents(
+      "{\"skipped\": {\"a\": [1, [2, {}]], \"b\": null}, \"kept\": 3}"));
+  JSONFileReader reader(file_.get());
+  ASSERT_TRUE(reader.Next());
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ("skipped", reader.string_value());
+  ASSERT_TRUE(reader.Next());
+  ASSERT_TRUE(reader.SkipValue());
+  EXPECT_EQ(JSONFileReader::kCloseDict, reader.token());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kKey, reader.token());
+  EXPECT_EQ("kept", reader.string_value());
+  ASSERT_TRUE(reader.Next());
+  ASSERT_TRUE(reader.SkipValue());
+  EXPECT_EQ(JSONFileReader::kInteger, reader.token());
+  EXPECT_EQ(3, reader.integer_value());
+
+  ASSERT_TRUE(reader.Next());
+  EXPECT_EQ(JSONFileReader::kCloseDict, reader.token());
+
+  // Only values can be skipped.
+  EXPECT_FALSE(reader.SkipValue());
+}
+
+TEST_F(JSONFileReaderTest, InvalidInput) {
+  ExpectInvalid("");
+  ExpectInvalid("[1,]");
+  ExpectInvalid("[1 2]");
+  ExpectInvalid("{\"a\":1,}");
+  ExpectInvalid("{\"a\" 1}");
+  ExpectInvalid("{1: 1}");
+  ExpectInvalid("[1}");
+  ExpectInvalid("[1] 2");
+  ExpectInvalid("[\"unterminated");
+  ExpectInvalid("\"\\q\"");
+  ExpectInvalid("\"\\ude00\"");
+  ExpectInvalid("tru");
+  ExpectInvalid("/* unterminated");
+}
+
+TEST_F(JSONFileReaderTest, ReadsJSONFileWriterOutput) {
+  ASSERT_NO_FATAL_FAILURE(SetContents(""));
+  {
+    JSONFileWriter writer(file_.get(), true);
+    ASSERT_TRUE(writer.OutputComment("A comment."));
+    ASSERT_TRUE(writer.OpenDict());
+    ASSERT_TRUE(writer.OutputKey("list"));
+    ASSERT_TRUE(writer.OpenList());
+    for (int i = 0; i < 10000; ++i)
+      ASSERT_TRUE(writer.OutputInteger(i));
+    ASSERT_TRUE(writer.CloseList());
+    ASSERT_TRUE(writer.OutputKey("hex"));
+    ASSERT_TRUE(writer.OutputHexString(0x1234, true));
+    ASSERT_TRUE(writer.OutputKey("string"));
+    ASSERT_TRUE(writer.OutputString("<\"escaped\">"));
+    ASSERT_TRUE(writer.CloseDict());
+    ASSERT_TRUE(writer.Flush());
+  }
+  ASSERT_EQ(0, ::fseek(file_.get(), 0, SEEK_SET));
+
+  scoped_ptr<base::Value> value;
+  ASSERT_TRUE(ReadDocument(&value));
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+
+  base::ListValue* list = NULL;
+  ASSERT_TRUE(dict->GetList("list", &list));
+  ASSERT_EQ(10000u, list->GetSize());
+  int i = 0;
+  EXPECT_TRUE(list->GetInteger(9999, &i));
+  EXPECT_EQ(9999, i);
+
+  std::string s;
+  EXPECT_TRUE(dict->GetString("hex", &s));
+  EXPECT_EQ("0x00001234", s);
+  EXPECT_TRUE(dict->GetString("string", &s));
+  EXPECT_EQ("<\"escaped\">", s);
+}
+
+}  // namespace core
@@ -25,6 +25,7 @@
 #include "base/json/json_writer.h"
 #include "base/json/string_escape.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 
 namespace core {
@@ -43,6 +44,44 @@ static const char kCommentPrefix[] = "//";
 static const char* kStructureOpenings[] = { "[", "{", NULL };
 static const char* kStructureClosings[] = { "]", "}", NULL };
 
+// The size of the output buffer. Output is written to the file whenever it
+// fills up, and when a complete value has been written.
+static const size_t kBufferSize = 64 * 1024;
+
+// Returns true if |value| can be output as a JSON string by simply quoting
+// it. This is the case for printable ASCII characters, except for those that
+// base::GetQuotedJSONString escapes.
+bool NeedsEscaping(const base::StringPiece& value) {
+  for (size_t i = 0; i < value.size(); ++i) {
+    char c = value[i];
+    if (c < 0x20 || c > 0x7E || c == '"' || c == '\\' || c == '<')
+      return true;
+  }
+  return false;
+}
+
+// Formats |value| in decimal at the end of |buffer|, whose size is
+// |buffer_size|. Returns a pointer to the first character.
+char* FormatInteger(int value, char* buffer, size_t buffer_size) {
+  DCHECK(buffer != NULL);
+  DCHECK_LE(12u, buffer_size);
+
+  // Work with the magnitude as an unsigned value, so that INT_MIN works.
+  uint32 magnitude = static_cast<uint32>(value);
+  if (value < 0)
+    magnitude = 0 - magnitude;
+
+  char* p = buffer + buffer_size;
+  do {
+    *(--p) = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    *(--p) = '-';
+
+  return p;
+}
+
 }  // namespace
 
 struct JSONFileWriter::Helper {
@@ -56,9 +95,10 @@ struct JSONFileWriter::Helper {
     if (!json_file_writer->AlignForValueOrKey())
       return false;
 
-    std::string formatted_key = base::GetQuotedJSONString(key.as_string());
-    if (!json_file_writer->Printf("%s:", formatted_key.c_str()))
+    if (!json_file_writer->PrintString(key) ||
+        !json_file_writer->PutChar(':')) {
       return false;
+    }
 
     // If we're pretty printing, then also output a space between the key and
     // the value.
@@ -83,8 +123,7 @@ struct JSONFileWriter::Helper {
       return false;
     if (!(json_file_writer->*print_function)(value))
       return false;
-    json_file_writer->FlushValue(true);
-    return true;
+    return json_file_writer->FlushValue(true);
   }
 };
 
@@ -93,7 +132,9 @@ JSONFileWriter::JSONFileWriter(FILE* file, bool pretty_print)
       pretty_print_(pretty_print),
       finished_(false),
       at_col_zero_(true),
-      indent_depth_(0) {
+      indent_depth_(0),
+      buffer_(kBufferSize),
+      buffer_len_(0) {
   DCHECK(file != NULL);
 }
 
@@ -113,13 +154,13 @@ bool JSONFileWriter::OutputComment(const base::StringPiece& comment) {
 
   // Trailing comments can be written directly.
   if (finished_) {
-    if (!OutputNewline() || !Printf("%s", kCommentPrefix))
+    if (!OutputNewline() || !Write(kCommentPrefix))
       return false;
     if (comment.length() > 0 &&
-        !Printf(" %.*s", comment.length(), comment.data())) {
+        (!PutChar(' ') || !Write(comment.data(), comment.length()))) {
       return false;
     }
-    return true;
+    return FlushBuffer();
   }
 
   // Store the comment for output before the next value.
@@ -166,7 +207,8 @@ bool JSONFileWriter::OutputTrailingComment(const base::StringPiece& comment) {
   // Are we finished? Immediately write the comment, but leave
   // trailing_comment_ populated so that repeated calls will fail.
   if (finished_ &&
-      !Printf("  %s %s", kCommentPrefix, trailing_comment_.c_str())) {
+      (!Printf("  %s %s", kCommentPrefix, trailing_comment_.c_str()) ||
+       !FlushBuffer())) {
     return false;
   }
 
@@ -181,11 +223,35 @@ bool JSONFileWriter::OutputTrailingComment(const base::StringPiece16& comment) {
 }
 
 bool JSONFileWriter::PrintBoolean(bool value) {
-  return Printf("%s", value ? kTrue : kFalse);
+  return Write(value ? kTrue : kFalse);
 }
 
 bool JSONFileWriter::PrintInteger(int value) {
-  return Printf("%d", value);
+  char buffer[12];
+  char* begin = FormatInteger(value, buffer, sizeof(buffer));
+  return Write(begin, buffer + sizeof(buffer) - begin);
+}
+
+bool JSONFileWriter::PrintHexString(uint32 value, bool padded) {
+  static const char kHexDigits[] = "0123456789ABCDEF";
+
+  // Room for the quotes, the prefix and 8 digits.
+  char buffer[12];
+  char* p = buffer + sizeof(buffer);
+  *(--p) = '"';
+  size_t digits = 0;
+  do {
+    *(--p) = kHexDigits[value & 0xF];
+    value >>= 4;
+    ++digits;
+  } while (value != 0 || (padded && digits < 8));
+  if (padded) {
+    *(--p) = 'x';
+    *(--p) = '0';
+  }
+  *(--p) = '"';
+
+  return Write(p, buffer + sizeof(buffer) - p);
 }
 
 bool JSONFileWriter::PrintDouble(double value) {
@@ -194,11 +260,22 @@ bool JSONFileWriter::PrintDouble(double value) {
 }
 
 bool JSONFileWriter::PrintString(const base::StringPiece& value) {
-  return Printf("%s", base::GetQuotedJSONString(value.as_string()).c_str());
+  // Most strings don't need escaping, and are written without building a
+  // quoted copy.
+  if (NeedsEscaping(value))
+    return Write(base::GetQuotedJSONString(value.as_string()));
+  return PutChar('"') && Write(value.data(), value.size()) && PutChar('"');
+}
+
+bool JSONFileWriter::PrintString(const base::StringPiece16& value) {
+  std::string utf8;
+  if (!base::WideToUTF8(value.data(), value.length(), &utf8))
+    return false;
+  return PrintString(utf8);
 }
 
 bool JSONFileWriter::PrintNull(int value_unused) {
-  return Printf("%s", kNull);
+  return Write(kNull);
 }
 
 bool JSONFileWriter::PrintValue(const Value* value) {
@@ -221,7 +298,7 @@ bool JSONFileWriter::PrintValue(const Value* value) {
     case Value::TYPE_BINARY: {
       std::string str;
       base::JSONWriter::Write(value, &str);
-      return Printf("%s", str.c_str());
+      return Write(str);
     }
 
     default: {
@@ -232,22 +309,59 @@ bool JSONFileWriter::PrintValue(const Value* value) {
 }
 
 bool JSONFileWriter::Printf(const char* format, ...) {
+  std::string str;
   va_list args;
   va_start(args, format);
-  int chars_written = vfprintf(file_, format, args);
+  base::StringAppendV(&str, format, args);
   va_end(args);
-  if (chars_written > 0)
-    at_col_zero_ = false;
-  return chars_written >= 0;
+  return Write(str);
 }
 
 bool JSONFileWriter::PutChar(char c) {
-  if (fputc(c, file_) != c)
+  if (buffer_len_ == buffer_.size() && !FlushBuffer())
     return false;
+  buffer_[buffer_len_++] = c;
   at_col_zero_ = false;
   return true;
 }
 
+bool JSONFileWriter::Write(const char* data, size_t length) {
+  DCHECK(data != NULL);
+  if (length == 0)
+    return true;
+
+  at_col_zero_ = false;
+  if (buffer_len_ + length > buffer_.size()) {
+    if (!FlushBuffer())
+      return false;
+
+    // Data that doesn't fit in the buffer is written directly.
+    if (length > buffer_.size())
+      return ::fwrite(data, 1, length, file_) == length;
+  }
+
+  ::memcpy(&buffer_[buffer_len_], data, length);
+  buffer_len_ += length;
+  return true;
+}
+
+bool JSONFileWriter::Write(const char* str) {
+  DCHECK(str != NULL);
+  return Write(str, ::strlen(str));
+}
+
+bool JSONFileWriter::Write(const std::string& str) {
+  return Write(str.data(), str.size());
+}
+
+bool JSONFileWriter::FlushBuffer() {
+  if (buffer_len_ == 0)
+    return true;
+  size_t length = buffer_len_;
+  buffer_len_ = 0;
+  return ::fwrite(&buffer_[0], 1, length, file_) == length;
+}
+
 bool JSONFileWriter::OpenList() {
   return OpenStructure(kList);
 }
@@ -273,9 +387,9 @@ bool JSONFileWriter::OutputKey(const base::StringPiece16& key) {
 }
 
 bool JSONFileWriter::Flush() {
-  // Already finished? This is a no-op.
+  // Already finished? Only buffered output needs to be written.
   if (finished_)
-    return true;
+    return FlushBuffer();
 
   // Are we waiting on a required value?
   if (RequireKeyValue())
@@ -287,7 +401,7 @@ bool JSONFileWriter::Flush() {
       return false;
   }
 
-  return true;
+  return FlushBuffer();
 }
 
 bool JSONFileWriter::OutputBoolean(bool value) {
@@ -300,6 +414,14 @@ bool JSONFileWriter::OutputInteger(int value) {
       value, &JSONFileWriter::PrintInteger, this);
 }
 
+bool JSONFileWriter::OutputHexString(uint32 value, bool padded) {
+  if (!ReadyForValue() || !AlignForValueOrKey() ||
+      !PrintHexString(value, padded)) {
+    return false;
+  }
+  return FlushValue(true);
+}
+
 bool JSONFileWriter::OutputDouble(double value) {
   return Helper::OutputValue(
       value, &JSONFileWriter::PrintDouble, this);
@@ -332,11 +454,8 @@ bool JSONFileWriter::OutputIndent() {
   if (!pretty_print_)
     return true;
 
-  // We bypass Printf and manually update at_col_zero_ here for efficiency.
-  if (indent_depth_ > 0)
-    at_col_zero_ = false;
   for (size_t i = 0; i < indent_depth_; ++i) {
-    if (fprintf(file_, "%s", kIndent) < 0)
+    if (!Write(kIndent, arraysize(kIndent) - 1))
       return false;
   }
   return true;
@@ -346,8 +465,7 @@ bool JSONFileWriter::OutputNewline() {
   if (!pretty_print_ || at_col_zero_)
     return true;
 
-  // Bypass Printf and manually at_col_zero_ for efficiency.
-  if (fprintf(file_, "%s", kNewline) < 0)
+  if (!Write(kNewline, arraysize(kNewline) - 1))
     return false;
   at_col_zero_ = true;
 
@@ -369,13 +487,14 @@ bool JSONFileWriter::OutputComments() {
       return false;
 
     // Output the comment prefix.
-    if (!Printf("%s", kCommentPrefix))
+    if (!Write(kCommentPrefix))
       return false;
 
     // Output the comment if there's any content.
     if (!comments_[i].empty() &&
-        !Printf(" %s", comments_[i].c_str()))
+        (!PutChar(' ') || !Write(comments_[i]))) {
       return false;
+    }
 
     if (!OutputNewline())
       return false;
@@ -473,13 +592,14 @@ bool JSONFileWriter::OpenStructure(StructureType type) {
 
   if (!ReadyForValue() ||
       !AlignForValueOrKey() ||
-      !Printf("%s", kStructureOpenings[type])) {
+      !Write(kStructureOpenings[type])) {
     return false;
   }
 
   // Opening a new structure is like writing a new value, but the value has
   // not been *finished*.
-  FlushValue(false);
+  bool flushed = FlushValue(false);
+  DCHECK(flushed);
 
   stack_.push_back(StackElement(type));
   ++indent_depth_;
@@ -503,18 +623,20 @@ bool JSONFileWriter::CloseStructure(StructureType type) {
   if (pretty_print_ && !OutputIndent())
     return false;
 
-  if (!Printf("%s", kStructureClosings[type])) {
+  if (!Write(kStructureClosings[type])) {
     return false;
   }
 
   // If this closed the last open structure, then the JSON file is finished.
-  if (stack_.empty())
+  if (stack_.empty()) {
     finished_ = true;
+    return FlushBuffer();
+  }
 
   return true;
 }
 
-void JSONFileWriter::FlushValue(bool value_completed) {
+bool JSONFileWriter::FlushValue(bool value_completed) {
   // The value was successfully written, so if we were in a dictionary waiting
   // for a value, pop the kDictKey entry off the stack.
   if (RequireKeyValue())
@@ -529,8 +651,11 @@ void JSONFileWriter::FlushValue(bool value_completed) {
       // If the stack is empty then having a written a single value means the
       // JSON file is finished.
       finished_ = true;
+      return FlushBuffer();
     }
   }
+
+  return true;
 }
 
 void JSONFileWriter::CompileAsserts() {
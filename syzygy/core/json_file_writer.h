@@ -14,10 +14,13 @@
 //
 // JSONFileWriter is a lightweight class for writing JSON formatted output
 // directly to file rather than via a base::Value intermediate and then
-// std::string intermediate representation.
+// std::string intermediate representation. Output goes through a fixed size
+// buffer, which is written to the file when it fills up, when a complete
+// value has been written, and on Flush.
 #ifndef SYZYGY_CORE_JSON_FILE_WRITER_H_
 #define SYZYGY_CORE_JSON_FILE_WRITER_H_
 
+#include <string>
 #include <vector>
 #include "base/basictypes.h"
 #include "base/strings/string_piece.h"
@@ -70,7 +73,8 @@ class JSONFileWriter {
   bool OutputKey(const base::StringPiece& key);
   bool OutputKey(const base::StringPiece16& key);
 
-  // Closes off the JSON stream, terminating any open data structures.
+  // Closes off the JSON stream, terminating any open data structures, and
+  // writes any buffered output to the file.
   // Returns true on success, false on failure.
   bool Flush();
 
@@ -78,6 +82,11 @@ class JSONFileWriter {
   bool OutputBoolean(bool value);
   bool OutputInteger(int value);
   bool OutputDouble(double value);
+  // Outputs @p value as a string of uppercase hex digits. If @p padded is
+  // true it is zero-padded to 8 digits and prefixed with "0x", as in
+  // "0x0000CAFE". Otherwise it is written with the minimal number of digits,
+  // as in "CAFE".
+  bool OutputHexString(uint32 value, bool padded);
   bool OutputString(const base::StringPiece& value);
   bool OutputString(const base::StringPiece16& value);
   bool OutputNull();
@@ -119,16 +128,24 @@ class JSONFileWriter {
   // implementation of the various Output* functions.
   bool PrintBoolean(bool value);
   bool PrintInteger(int value);
+  bool PrintHexString(uint32 value, bool padded);
   bool PrintDouble(double value);
   bool PrintString(const base::StringPiece& value);
+  bool PrintString(const base::StringPiece16& value);
   bool PrintNull(int value_unused);
   bool PrintValue(const base::Value* value);
 
-  // The following group of functions act as pass-through for fprintf and fputc,
-  // but update internal state. No newline characters should be written using
-  // this mechanism. All newlines should be written using OutputNewline.
+  // The following group of functions write to the output buffer, and update
+  // internal state. No newline characters should be written using this
+  // mechanism. All newlines should be written using OutputNewline.
   bool Printf(const char* format, ...);
   bool PutChar(char c);
+  bool Write(const char* data, size_t length);
+  bool Write(const char* str);
+  bool Write(const std::string& str);
+
+  // Writes the buffered output to the file.
+  bool FlushBuffer();
 
   // Some state determination functions.
   bool FirstEntry() const;
@@ -141,8 +158,9 @@ class JSONFileWriter {
   bool OpenStructure(StructureType type);
   // Outputs the end of a data structure.
   bool CloseStructure(StructureType type);
-  // Performs any state changes necessary after outputting a value.
-  void FlushValue(bool value_completed);
+  // Performs any state changes necessary after outputting a value. Returns
+  // false if this completed the stream, and the output couldn't be written.
+  bool FlushValue(bool value_completed);
 
   static void CompileAsserts();
 
@@ -164,6 +182,9 @@ class JSONFileWriter {
   // a trailing comma or not.
   std::string trailing_comment_;
   std::vector<std::string> comments_;
+  // The output buffer, and the amount of data in it.
+  std::vector<char> buffer_;
+  size_t buffer_len_;
 
   DISALLOW_COPY_AND_ASSIGN(JSONFileWriter);
 };
@@ -346,6 +346,19 @@ TEST_F(JSONFileWriterTest, OutputInteger) {
   ASSERT_EQ("11", s);
 }
 
+TEST_F(JSONFileWriterTest, OutputHexString) {
+  TestJSONFileWriter json_file(file(), false);
+  EXPECT_TRUE(json_file.OpenList());
+  EXPECT_TRUE(json_file.OutputHexString(0xBEEF, true));
+  EXPECT_TRUE(json_file.OutputHexString(0xBEEF, false));
+  EXPECT_TRUE(json_file.CloseList());
+  ASSERT_TRUE(json_file.Finished());
+
+  std::string s;
+  ASSERT_TRUE(FileContents(&s));
+  ASSERT_EQ("[\"0x0000BEEF\",\"BEEF\"]", s);
+}
+
 TEST_F(JSONFileWriterTest, OutputDouble) {
   TestJSONFileWriter json_file(file(), false);
   ASSERT_TRUE(json_file.FirstEntry());
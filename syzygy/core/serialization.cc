@@ -25,17 +25,41 @@ namespace core {
 
 FileOutStream::FileOutStream(FILE* file) : file_(file) {
   DCHECK(file != NULL);
+  buffer_.reserve(kBufferSize);
+}
+
+FileOutStream::~FileOutStream() {
+  // Data that was never flushed still ends up in the file.
+  WriteBuffer();
 }
 
 bool FileOutStream::Write(size_t length, const Byte* bytes) {
-  return fwrite(bytes, sizeof(Byte), length, file_) == length;
+  if (buffer_.size() + length > kBufferSize) {
+    if (!WriteBuffer())
+      return false;
+    if (length >= kBufferSize)
+      return ::fwrite(bytes, sizeof(Byte), length, file_) == length;
+  }
+  buffer_.insert(buffer_.end(), bytes, bytes + length);
+  return true;
 }
 
 bool FileOutStream::Flush() {
+  if (!WriteBuffer())
+    return false;
   ::fflush(file_);
   return true;
 }
 
+bool FileOutStream::WriteBuffer() {
+  if (buffer_.empty())
+    return true;
+  bool success = ::fwrite(&buffer_[0], sizeof(Byte), buffer_.size(), file_) ==
+      buffer_.size();
+  buffer_.clear();
+  return success;
+}
+
 FileInStream::FileInStream(FILE* file) : file_(file) {
   DCHECK(file != NULL);
 }
@@ -56,6 +80,31 @@ bool FileInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
   return true;
 }
 
+MemoryInStream::MemoryInStream(const Byte* data, size_t length)
+    : position_(data), end_(data + length) {
+  DCHECK(data != NULL || length == 0);
+}
+
+const Byte* MemoryInStream::ReadInPlace(size_t length) {
+  if (length > remaining())
+    return NULL;
+
+  const Byte* bytes = position_;
+  position_ += length;
+  return bytes;
+}
+
+bool MemoryInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
+  DCHECK(bytes != NULL);
+  DCHECK(bytes_read != NULL);
+
+  *bytes_read = std::min(length, remaining());
+  ::memcpy(bytes, position_, *bytes_read);
+  position_ += *bytes_read;
+
+  return true;
+}
+
 // Serialization of base::Time.
 // We serialize to 'number of seconds since epoch' (represented as a double)
 // as this is consistent regardless of the underlying representation used in
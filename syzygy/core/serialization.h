@@ -81,6 +81,18 @@
 //   template<class InArchive> bool Load(ClassName* data,
 //                                       InArchive* in_archive);
 //
+// *** BULK SERIALIZATION
+//
+// Vectors, strings and C-arrays of primitive types are saved and loaded with
+// a single write or read of their contents, rather than one per element. The
+// same can be enabled for a struct whose Save function writes exactly its
+// in-memory representation (fields in declaration order, no padding), by
+// declaring it at global scope:
+//
+//   CORE_SERIALIZE_AS_POD(ClassName)
+//
+// The serialized form of the containers doesn't change.
+//
 // *** UNDER THE HOOD
 //
 // We trace the calltree for the serialization of a Foo object foo:
@@ -123,6 +135,7 @@ namespace internal {
 // Forward declares of some utilities we need. These are defined in
 // serialization_impl.h.
 template<typename T> struct IsByteLike;
+template<typename T> struct IsBulkSerializable;
 template<typename IteratorTag> struct IteratorsAreEqualFunctor;
 
 }  // namespace internal
@@ -188,6 +201,15 @@ class InStream {
     return true;
   }
 
+  // Consumes the next @p length bytes of the stream without copying them.
+  // This is only supported by streams backed by memory that outlives them,
+  // and lets callers keep pointers into the underlying buffer.
+  // @param length the number of bytes to consume.
+  // @returns a pointer to the consumed bytes, or NULL if the stream doesn't
+  //     support this or holds fewer than @p length bytes. Nothing is consumed
+  //     on failure.
+  virtual const Byte* ReadInPlace(size_t length) { return NULL; }
+
  protected:
   // Needs to be implemented by derived classes. See description of Read above.
   // @param length the number of bytes to read.
@@ -201,16 +223,28 @@ class InStream {
 typedef scoped_ptr<OutStream> ScopedOutStreamPtr;
 typedef scoped_ptr<InStream> ScopedInStreamPtr;
 
-// A simple OutStream wrapper for FILE pointers.
+// An OutStream wrapper for FILE pointers. Small writes are buffered, as
+// archives write one primitive value at a time; the buffer is written out on
+// Flush, or at the latest when the stream is destroyed.
 class FileOutStream : public OutStream {
  public:
+  // The size of the write buffer. Writes at least this large bypass it.
+  static const size_t kBufferSize = 64 * 1024;
+
   explicit FileOutStream(FILE* file);
-  virtual ~FileOutStream() { }
+  virtual ~FileOutStream();
   virtual bool Write(size_t length, const Byte* bytes);
   virtual bool Flush();
 
  private:
+  // Writes the contents of the buffer to the file, and empties it.
+  // @returns true on success, false otherwise.
+  bool WriteBuffer();
+
   FILE* file_;
+  std::vector<Byte> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileOutStream);
 };
 
 // A simple InStream wrapper for FILE pointers.
@@ -226,6 +260,32 @@ class FileInStream : public InStream {
   FILE* file_;
 };
 
+// An InStream over a contiguous buffer of bytes, such as the view of a
+// memory-mapped file. Reads are plain copies, and ReadInPlace is supported: the
+// pointers it returns are valid for as long as the buffer is.
+class MemoryInStream : public InStream {
+ public:
+  // @param data the buffer to read from. It must outlive this stream, and any
+  //     pointer returned by ReadInPlace.
+  // @param length the length of the buffer.
+  MemoryInStream(const Byte* data, size_t length);
+  virtual ~MemoryInStream() { }
+
+  virtual const Byte* ReadInPlace(size_t length);
+
+  // @returns the number of bytes left in the stream.
+  size_t remaining() const { return end_ - position_; }
+
+ protected:
+  virtual bool ReadImpl(size_t length, Byte* bytes, size_t* bytes_read);
+
+ private:
+  const Byte* position_;
+  const Byte* end_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryInStream);
+};
+
 // A simple OutStream wrapper for containers of bytes. Uses an output iterator
 // to push data to some container, or a pair of non-const iterators to write
 // data to a preallocated container. The underlying container should store
@@ -344,6 +404,13 @@ class NativeBinaryOutArchive {
   NATIVE_BINARY_OUT_ARCHIVE_SAVE(unsigned long);
 #undef NATIVE_BINARY_OUT_ARCHIVE_SAVE
 
+  // Saves a block of raw bytes. This is how arrays of bulk serializable
+  // values are saved in a single write.
+  bool SaveBytes(size_t length, const Byte* bytes) {
+    DCHECK(out_stream_ != NULL);
+    return out_stream_->Write(length, bytes);
+  }
+
   bool Flush() { return out_stream_->Flush(); }
 
   OutStream* out_stream() { return out_stream_; }
@@ -393,6 +460,12 @@ class NativeBinaryInArchive {
   NATIVE_BINARY_IN_ARCHIVE_LOAD(unsigned long);
 #undef NATIVE_BINARY_IN_ARCHIVE_LOAD
 
+  // Loads a block of raw bytes saved with NativeBinaryOutArchive::SaveBytes.
+  bool LoadBytes(size_t length, Byte* bytes) {
+    DCHECK(in_stream_ != NULL);
+    return in_stream_->Read(length, bytes);
+  }
+
   InStream* in_stream() { return in_stream_; }
 
  private:
@@ -405,6 +478,17 @@ typedef NativeBinaryInArchive InArchive;
 
 }  // namespace core
 
+// Marks @p Type as bulk serializable. See BULK SERIALIZATION above. This must
+// be used at global scope.
+#define CORE_SERIALIZE_AS_POD(Type) \
+    namespace core { \
+    namespace internal { \
+    template<> struct IsBulkSerializable<Type> { \
+      enum { Value = 1 }; \
+    }; \
+    }  /* namespace internal */ \
+    }  /* namespace core */
+
 // Bring in the implementation of the various templated functions.
 #include "syzygy/core/serialization_impl.h"
 
@@ -50,6 +50,35 @@ template<typename T> struct IsByteLike {
   };
 };
 
+// Identifies the types whose serialized form is their in-memory
+// representation, so that arrays of them can be saved and loaded in bulk. This
+// holds for the primitive types, and is enabled for other types with
+// CORE_SERIALIZE_AS_POD.
+template<typename T> struct IsBulkSerializable {
+  enum { Value = 0 };
+};
+#define CORE_BULK_SERIALIZABLE_PRIMITIVE(Type) \
+  template<> struct IsBulkSerializable<Type> { \
+    enum { Value = 1 }; \
+  }
+CORE_BULK_SERIALIZABLE_PRIMITIVE(bool);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(char);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(wchar_t);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(float);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(double);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(int8);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(int16);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(int32);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(int64);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(uint8);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(uint16);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(uint32);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(uint64);
+CORE_BULK_SERIALIZABLE_PRIMITIVE(unsigned long);
+// OMAP is saved field by field, which is the same as its in-memory layout.
+CORE_BULK_SERIALIZABLE_PRIMITIVE(OMAP);
+#undef CORE_BULK_SERIALIZABLE_PRIMITIVE
+
 // This compares two iterators. It only does so if the iterator type is
 // not an output iterator.
 template<typename IteratorTag> struct IteratorsAreEqualFunctor {
@@ -149,6 +178,104 @@ bool LoadContainer(Container* container,
   return true;
 }
 
+// Serialization of arrays of values, either one value at a time or, for bulk
+// serializable types, as a single block of bytes.
+template<bool kBulk> struct ArraySerializer {
+  template<typename Type, class OutArchive>
+  static bool Save(const Type* data, size_t count, OutArchive* out_archive) {
+    DCHECK(out_archive != NULL);
+    for (size_t i = 0; i < count; ++i) {
+      if (!out_archive->Save(data[i]))
+        return false;
+    }
+    return true;
+  }
+
+  template<typename Type, class InArchive>
+  static bool Load(Type* data, size_t count, InArchive* in_archive) {
+    DCHECK(in_archive != NULL);
+    for (size_t i = 0; i < count; ++i) {
+      if (!in_archive->Load(&data[i]))
+        return false;
+    }
+    return true;
+  }
+};
+template<> struct ArraySerializer<true> {
+  template<typename Type, class OutArchive>
+  static bool Save(const Type* data, size_t count, OutArchive* out_archive) {
+    DCHECK(out_archive != NULL);
+    if (count == 0)
+      return true;
+    return out_archive->SaveBytes(count * sizeof(Type),
+                                  reinterpret_cast<const Byte*>(data));
+  }
+
+  template<typename Type, class InArchive>
+  static bool Load(Type* data, size_t count, InArchive* in_archive) {
+    DCHECK(in_archive != NULL);
+    if (count == 0)
+      return true;
+    return in_archive->LoadBytes(count * sizeof(Type),
+                                 reinterpret_cast<Byte*>(data));
+  }
+};
+
+// Serialization of containers with contiguous storage (std::vector and
+// std::basic_string). The serialized form is the same as for SaveContainer,
+// but for bulk serializable values the contents are saved and loaded with a
+// single write or read. std::vector<bool> is not contiguous, so it is never
+// serialized in bulk.
+template<bool kBulk> struct ContiguousContainerSerializer {
+  template<class Container, class OutArchive>
+  static bool Save(const Container& container, OutArchive* out_archive) {
+    return SaveContainer(container, out_archive);
+  }
+
+  template<class Container, class InArchive>
+  static bool Load(Container* container, InArchive* in_archive) {
+    DCHECK(container != NULL);
+    container->clear();
+    return LoadContainer(container, std::back_inserter(*container),
+                         in_archive);
+  }
+};
+template<> struct ContiguousContainerSerializer<true> {
+  template<class Container, class OutArchive>
+  static bool Save(const Container& container, OutArchive* out_archive) {
+    DCHECK(out_archive != NULL);
+    if (!out_archive->Save(container.size()))
+      return false;
+    if (container.empty())
+      return true;
+    return ArraySerializer<true>::Save(&container[0], container.size(),
+                                       out_archive);
+  }
+
+  template<class Container, class InArchive>
+  static bool Load(Container* container, InArchive* in_archive) {
+    DCHECK(container != NULL);
+    DCHECK(in_archive != NULL);
+
+    typename Container::size_type size = 0;
+    if (!in_archive->Load(&size))
+      return false;
+
+    container->clear();
+    container->resize(size);
+    if (size == 0)
+      return true;
+    return ArraySerializer<true>::Load(&(*container)[0], size, in_archive);
+  }
+};
+
+// Selects the serializer of a contiguous container of @p Type.
+template<typename Type> struct ContiguousContainerSerializerFor {
+  typedef ContiguousContainerSerializer<
+      IsBulkSerializable<Type>::Value &&
+      !TypesAreEqual<Type, bool>::Value> Serializer;
+};
+
 }  // namespace internal
 
 template<typename OutputIterator> bool ByteOutStream<OutputIterator>::Write(
@@ -204,7 +331,9 @@ template<typename Char, typename Traits, typename Alloc, class OutArchive>
 bool Save(const std::basic_string<Char, Traits, Alloc>& string,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(string, out_archive);
+  typedef typename internal::ContiguousContainerSerializerFor<Char>::Serializer
+      Serializer;
+  return Serializer::Save(string, out_archive);
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -233,7 +362,9 @@ template<typename Type, typename Alloc, class OutArchive>
 bool Save(const std::vector<Type, Alloc>& vector,
           OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  return internal::SaveContainer(vector, out_archive);
+  typedef typename internal::ContiguousContainerSerializerFor<Type>::Serializer
+      Serializer;
+  return Serializer::Save(vector, out_archive);
 }
 
 // Implementation of STL Load specializations.
@@ -243,10 +374,9 @@ bool Load(std::basic_string<Char, Traits, Alloc>* string,
           InArchive* in_archive) {
   DCHECK(string != NULL);
   DCHECK(in_archive != NULL);
-  string->clear();
-  return internal::LoadContainer(string,
-                                 std::back_inserter(*string),
-                                 in_archive);
+  typedef typename internal::ContiguousContainerSerializerFor<Char>::Serializer
+      Serializer;
+  return Serializer::Load(string, in_archive);
 }
 
 template<typename Key, typename Data, typename Compare, typename Alloc,
@@ -285,9 +415,9 @@ bool Load(std::vector<Type, Alloc>* vector,
           InArchive* in_archive) {
   DCHECK(vector != NULL);
   DCHECK(in_archive != NULL);
-  return internal::LoadContainer(vector,
-                                 std::back_inserter(*vector),
-                                 in_archive);
+  typedef typename internal::ContiguousContainerSerializerFor<Type>::Serializer
+      Serializer;
+  return Serializer::Load(vector, in_archive);
 }
 
 // Implementation of serialization for C-style arrays.
@@ -295,22 +425,16 @@ bool Load(std::vector<Type, Alloc>* vector,
 template<typename Type, size_t Length, class OutArchive>
 bool Save(const Type (&data)[Length], OutArchive* out_archive) {
   DCHECK(out_archive != NULL);
-  for (size_t i = 0; i < Length; ++i) {
-    if (!out_archive->Save(data[i]))
-      return false;
-  }
-  return true;
+  return internal::ArraySerializer<internal::IsBulkSerializable<Type>::Value>::
+      Save(data, Length, out_archive);
 }
 
 template<typename Type, size_t Length, class InArchive>
 bool Load(Type (*data)[Length], InArchive* in_archive) {
   DCHECK(data != NULL);
   DCHECK(in_archive != NULL);
-  for (size_t i = 0; i < Length; ++i) {
-    if (!in_archive->Load(&((*data)[i])))
-      return false;
-  }
-  return true;
+  return internal::ArraySerializer<internal::IsBulkSerializable<Type>::Value>::
+      Load(*data, Length, in_archive);
 }
 
 // Declaration of serialization for base::Time.
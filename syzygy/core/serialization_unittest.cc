@@ -47,8 +47,39 @@ struct Foo {
   }
 };
 
+// A POD struct whose serialized form is its in-memory representation.
+struct Bar {
+  uint32 a;
+  uint32 b;
+
+  bool operator==(const Bar& bar) const {
+    return a == bar.a && b == bar.b;
+  }
+
+  template<class OutArchive> bool Save(OutArchive* out_archive) const {
+    return out_archive->Save(a) && out_archive->Save(b);
+  }
+  template<class InArchive> bool Load(InArchive* in_archive) {
+    return in_archive->Load(&a) && in_archive->Load(&b);
+  }
+};
+
+// Saves @p data to @p bytes.
+template<typename Data> bool SaveToBytes(const Data& data, ByteVector* bytes) {
+  ScopedOutStreamPtr out_stream(
+      CreateByteOutStream(std::back_inserter(*bytes)));
+  NativeBinaryOutArchive out_archive(out_stream.get());
+  return out_archive.Save(data) && out_archive.Flush();
+}
+
 }  // namespace
 
+}  // namespace core
+
+CORE_SERIALIZE_AS_POD(core::Bar)
+
+namespace core {
+
 class SerializationTest : public testing::Test {
  public:
   virtual void SetUp() {
@@ -109,6 +140,37 @@ TEST_F(SerializationTest, IteratorInStream) {
   EXPECT_FALSE(in_stream->Read(sizeof(kTestData), buffer));
 }
 
+TEST_F(SerializationTest, MemoryInStream) {
+  MemoryInStream in_stream(kTestData, sizeof(kTestData));
+  EXPECT_EQ(sizeof(kTestData), in_stream.remaining());
+
+  // Reading data should work, and should match the source data.
+  Byte buffer[sizeof(kTestData)];
+  EXPECT_TRUE(in_stream.Read(2, buffer));
+  EXPECT_EQ(0, memcmp(buffer, kTestData, 2));
+
+  // Reading in place should point directly into the source data.
+  EXPECT_EQ(kTestData + 2, in_stream.ReadInPlace(2));
+  EXPECT_EQ(sizeof(kTestData) - 4, in_stream.remaining());
+
+  // Reading in place past the end should fail without consuming anything.
+  EXPECT_EQ(NULL, in_stream.ReadInPlace(sizeof(kTestData)));
+  EXPECT_EQ(sizeof(kTestData) - 4, in_stream.remaining());
+
+  EXPECT_TRUE(in_stream.Read(sizeof(kTestData) - 4, buffer + 4));
+  EXPECT_EQ(0, memcmp(buffer + 4, kTestData + 4, sizeof(kTestData) - 4));
+
+  // We should not be able to read past the end of an exhausted buffer.
+  EXPECT_FALSE(in_stream.Read(sizeof(kTestData), buffer));
+}
+
+TEST_F(SerializationTest, IteratorInStreamDoesNotReadInPlace) {
+  ByteVector bytes(kTestData, kTestData + sizeof(kTestData));
+  ScopedInStreamPtr in_stream;
+  in_stream.reset(CreateByteInStream(bytes.begin(), bytes.end()));
+  EXPECT_EQ(NULL, in_stream->ReadInPlace(2));
+}
+
 TEST_F(SerializationTest, FileOutStream) {
   base::FilePath path;
   base::ScopedFILE file;
@@ -121,6 +183,7 @@ TEST_F(SerializationTest, FileOutStream) {
   // Write some test data to a file.
   EXPECT_TRUE(out_stream.Write(2, kTestData));
   EXPECT_TRUE(out_stream.Write(sizeof(kTestData) - 2, kTestData + 2));
+  EXPECT_TRUE(out_stream.Flush());
 
   // Load the data from the file and ensure it matches the original data.
   file.reset();
@@ -131,6 +194,37 @@ TEST_F(SerializationTest, FileOutStream) {
   EXPECT_EQ(0, memcmp(buffer, kTestData, sizeof(kTestData)));
 }
 
+TEST_F(SerializationTest, FileOutStreamBuffersWrites) {
+  base::FilePath path;
+  base::ScopedFILE file;
+  file.reset(base::CreateAndOpenTemporaryFileInDir(temp_dir(), &path));
+  ASSERT_TRUE(file.get() != NULL);
+
+  // Mix writes smaller and larger than the buffer.
+  ByteVector large_data(FileOutStream::kBufferSize + 1, 0x42);
+  ByteVector expected_data;
+  {
+    FileOutStream out_stream(file.get());
+    EXPECT_TRUE(out_stream.Write(sizeof(kTestData), kTestData));
+    EXPECT_TRUE(out_stream.Write(large_data.size(), &large_data[0]));
+    EXPECT_TRUE(out_stream.Write(sizeof(kTestData), kTestData));
+
+    // Nothing is lost when the stream isn't flushed explicitly.
+  }
+  expected_data.insert(expected_data.end(), kTestData,
+                       kTestData + sizeof(kTestData));
+  expected_data.insert(expected_data.end(), large_data.begin(),
+                       large_data.end());
+  expected_data.insert(expected_data.end(), kTestData,
+                       kTestData + sizeof(kTestData));
+
+  file.reset();
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  ASSERT_EQ(expected_data.size(), contents.size());
+  EXPECT_EQ(0, memcmp(&expected_data[0], contents.data(), contents.size()));
+}
+
 TEST_F(SerializationTest, FileInStream) {
   base::FilePath path;
   base::ScopedFILE file;
@@ -209,4 +303,49 @@ TEST_F(SerializationTest, CustomTypeRoundTrip) {
   EXPECT_TRUE(TestRoundTrip(foo));
 }
 
+TEST_F(SerializationTest, BulkTypesRoundTrip) {
+  std::vector<uint32> empty_vector;
+  EXPECT_TRUE(TestRoundTrip(empty_vector));
+
+  std::vector<bool> bool_vector;
+  bool_vector.push_back(true);
+  bool_vector.push_back(false);
+  bool_vector.push_back(true);
+  EXPECT_TRUE(TestRoundTrip(bool_vector));
+
+  std::vector<Bar> bar_vector;
+  for (uint32 i = 0; i < 100; ++i) {
+    Bar bar = { i, i * i };
+    bar_vector.push_back(bar);
+  }
+  EXPECT_TRUE(TestRoundTrip(bar_vector));
+
+  std::wstring empty_wstring;
+  EXPECT_TRUE(TestRoundTrip(empty_wstring));
+}
+
+TEST_F(SerializationTest, BulkSerializationMatchesElementWise) {
+  std::vector<uint32> vector;
+  vector.push_back(1);
+  vector.push_back(3);
+  vector.push_back(5);
+  Bar bars[2] = { { 1, 2 }, { 3, 4 } };
+
+  // Save the same data one element at a time.
+  ByteVector expected;
+  ScopedOutStreamPtr out_stream(
+      CreateByteOutStream(std::back_inserter(expected)));
+  NativeBinaryOutArchive out_archive(out_stream.get());
+  EXPECT_TRUE(out_archive.Save(vector.size()));
+  for (size_t i = 0; i < vector.size(); ++i)
+    EXPECT_TRUE(out_archive.Save(vector[i]));
+  for (size_t i = 0; i < arraysize(bars); ++i)
+    EXPECT_TRUE(bars[i].Save(&out_archive));
+
+  ByteVector bytes;
+  EXPECT_TRUE(SaveToBytes(vector, &bytes));
+  EXPECT_TRUE(SaveToBytes(bars, &bytes));
+  EXPECT_EQ(expected, bytes);
+}
+
 }  // namespace core
@@ -0,0 +1,203 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares SortedVectorMap, an associative container with the subset of the
+// std::map interface used by AddressSpace, that keeps its elements in a
+// sorted vector.
+
+#ifndef SYZYGY_CORE_SORTED_VECTOR_MAP_H_
+#define SYZYGY_CORE_SORTED_VECTOR_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace core {
+
+// A map that stores its elements contiguously, in key order. Lookups are a
+// binary search over a flat array, which is much friendlier to the cache than
+// walking the nodes of a std::map, and there is no per-element allocation.
+// Inserting in increasing key order appends in amortized constant time, while
+// inserting or erasing elsewhere moves the elements that follow.
+//
+// @note Unlike std::map, inserting or erasing an element invalidates the
+//     iterators to the elements that follow it, and possibly all iterators
+//     if the storage is reallocated.
+// @note The keys are not const in value_type, as the elements need to be
+//     assignable. It is up to the user not to modify them through an
+//     iterator.
+template <typename KeyType, typename ValueType,
+          typename CompareType = std::less<KeyType> >
+class SortedVectorMap {
+ public:
+  typedef KeyType key_type;
+  typedef ValueType mapped_type;
+  typedef CompareType key_compare;
+  typedef std::pair<KeyType, ValueType> value_type;
+  typedef std::vector<value_type> ValueVector;
+  typedef typename ValueVector::iterator iterator;
+  typedef typename ValueVector::const_iterator const_iterator;
+  typedef typename ValueVector::size_type size_type;
+
+  SortedVectorMap() { }
+
+  // @name Iteration, in key order.
+  // @{
+  iterator begin() { return values_.begin(); }
+  const_iterator begin() const { return values_.begin(); }
+  iterator end() { return values_.end(); }
+  const_iterator end() const { return values_.end(); }
+  // @}
+
+  bool empty() const { return values_.empty(); }
+  size_type size() const { return values_.size(); }
+  void clear() { values_.clear(); }
+
+  // Reserves storage for @p size elements, so that a batch of insertions
+  // doesn't reallocate.
+  // @param size the number of elements to make room for.
+  void reserve(size_type size) { values_.reserve(size); }
+
+  // Inserts @p value unless an element with an equivalent key exists.
+  // @param value the element to insert.
+  // @returns an iterator to the inserted or existing element, and true iff
+  //     @p value was inserted.
+  std::pair<iterator, bool> insert(const value_type& value);
+
+  // Erases the element at @p it.
+  // @param it an iterator to the element to erase.
+  void erase(iterator it) { values_.erase(it); }
+
+  // Erases the elements in [@p first, @p last).
+  // @param first an iterator to the first element to erase.
+  // @param last an iterator past the last element to erase.
+  void erase(iterator first, iterator last) { values_.erase(first, last); }
+
+  // Erases the element with a key equivalent to @p key, if any.
+  // @param key the key to erase.
+  // @returns the number of elements erased.
+  size_type erase(const KeyType& key);
+
+  // @name Lookups, with the same semantics as their std::map namesakes.
+  // @{
+  iterator find(const KeyType& key);
+  const_iterator find(const KeyType& key) const;
+  iterator lower_bound(const KeyType& key);
+  const_iterator lower_bound(const KeyType& key) const;
+  iterator upper_bound(const KeyType& key);
+  const_iterator upper_bound(const KeyType& key) const;
+  // @}
+
+  bool operator==(const SortedVectorMap& other) const {
+    return values_ == other.values_;
+  }
+  bool operator!=(const SortedVectorMap& other) const {
+    return values_ != other.values_;
+  }
+
+ private:
+  // Compares elements to keys for the binary searches.
+  struct ValueKeyLess {
+    bool operator()(const value_type& value, const KeyType& key) const {
+      return CompareType()(value.first, key);
+    }
+    bool operator()(const KeyType& key, const value_type& value) const {
+      return CompareType()(key, value.first);
+    }
+  };
+
+  // The elements, sorted by key.
+  ValueVector values_;
+};
+
+template <typename KeyType, typename ValueType, typename CompareType>
+std::pair<typename SortedVectorMap<KeyType, ValueType, CompareType>::iterator,
+          bool>
+SortedVectorMap<KeyType, ValueType, CompareType>::insert(
+    const value_type& value) {
+  // Elements that arrive in key order are appended without a search.
+  if (values_.empty() || CompareType()(values_.back().first, value.first)) {
+    values_.push_back(value);
+    return std::make_pair(values_.end() - 1, true);
+  }
+
+  iterator it = lower_bound(value.first);
+  if (it != values_.end() && !CompareType()(value.first, it->first))
+    return std::make_pair(it, false);
+
+  it = values_.insert(it, value);
+  return std::make_pair(it, true);
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::size_type
+SortedVectorMap<KeyType, ValueType, CompareType>::erase(const KeyType& key) {
+  iterator it = find(key);
+  if (it == values_.end())
+    return 0;
+
+  values_.erase(it);
+  return 1;
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::iterator
+SortedVectorMap<KeyType, ValueType, CompareType>::find(const KeyType& key) {
+  iterator it = lower_bound(key);
+  if (it != values_.end() && !CompareType()(key, it->first))
+    return it;
+  return values_.end();
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::const_iterator
+SortedVectorMap<KeyType, ValueType, CompareType>::find(
+    const KeyType& key) const {
+  return const_cast<SortedVectorMap*>(this)->find(key);
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::iterator
+SortedVectorMap<KeyType, ValueType, CompareType>::lower_bound(
+    const KeyType& key) {
+  return std::lower_bound(values_.begin(), values_.end(), key, ValueKeyLess());
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::const_iterator
+SortedVectorMap<KeyType, ValueType, CompareType>::lower_bound(
+    const KeyType& key) const {
+  return const_cast<SortedVectorMap*>(this)->lower_bound(key);
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::iterator
+SortedVectorMap<KeyType, ValueType, CompareType>::upper_bound(
+    const KeyType& key) {
+  return std::upper_bound(values_.begin(), values_.end(), key, ValueKeyLess());
+}
+
+template <typename KeyType, typename ValueType, typename CompareType>
+typename SortedVectorMap<KeyType, ValueType, CompareType>::const_iterator
+SortedVectorMap<KeyType, ValueType, CompareType>::upper_bound(
+    const KeyType& key) const {
+  return const_cast<SortedVectorMap*>(this)->upper_bound(key);
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_SORTED_VECTOR_MAP_H_
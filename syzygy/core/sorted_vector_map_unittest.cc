@@ -0,0 +1,114 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/sorted_vector_map.h"
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef SortedVectorMap<int, int> IntMap;
+
+}  // namespace
+
+TEST(SortedVectorMapTest, InsertKeepsKeysSorted) {
+  IntMap map;
+  EXPECT_TRUE(map.empty());
+
+  EXPECT_TRUE(map.insert(std::make_pair(20, 2)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(30, 3)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(10, 1)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(25, 4)).second);
+  EXPECT_EQ(4u, map.size());
+
+  int expected_keys[] = { 10, 20, 25, 30 };
+  IntMap::const_iterator it = map.begin();
+  for (size_t i = 0; i < arraysize(expected_keys); ++i, ++it) {
+    ASSERT_TRUE(it != map.end());
+    EXPECT_EQ(expected_keys[i], it->first);
+  }
+  EXPECT_TRUE(it == map.end());
+}
+
+TEST(SortedVectorMapTest, InsertDoesNotReplace) {
+  IntMap map;
+  std::pair<IntMap::iterator, bool> inserted =
+      map.insert(std::make_pair(10, 1));
+  EXPECT_TRUE(inserted.second);
+
+  std::pair<IntMap::iterator, bool> existing =
+      map.insert(std::make_pair(10, 2));
+  EXPECT_FALSE(existing.second);
+  EXPECT_TRUE(existing.first == map.begin());
+  EXPECT_EQ(1, existing.first->second);
+  EXPECT_EQ(1u, map.size());
+}
+
+TEST(SortedVectorMapTest, Lookups) {
+  IntMap map;
+  map.reserve(3);
+  map.insert(std::make_pair(10, 1));
+  map.insert(std::make_pair(20, 2));
+  map.insert(std::make_pair(30, 3));
+
+  EXPECT_EQ(2, map.find(20)->second);
+  EXPECT_TRUE(map.find(15) == map.end());
+
+  EXPECT_EQ(20, map.lower_bound(20)->first);
+  EXPECT_EQ(20, map.lower_bound(15)->first);
+  EXPECT_TRUE(map.lower_bound(35) == map.end());
+
+  EXPECT_EQ(30, map.upper_bound(20)->first);
+  EXPECT_TRUE(map.upper_bound(30) == map.end());
+
+  const IntMap& const_map = map;
+  EXPECT_EQ(3, const_map.find(30)->second);
+  EXPECT_TRUE(const_map.lower_bound(5) == const_map.begin());
+}
+
+TEST(SortedVectorMapTest, Erase) {
+  IntMap map;
+  for (int i = 0; i < 5; ++i)
+    map.insert(std::make_pair(i, i));
+
+  EXPECT_EQ(1u, map.erase(2));
+  EXPECT_EQ(0u, map.erase(2));
+  EXPECT_TRUE(map.find(2) == map.end());
+
+  map.erase(map.begin());
+  EXPECT_EQ(1, map.begin()->first);
+
+  map.erase(map.begin(), map.lower_bound(4));
+  EXPECT_EQ(1u, map.size());
+  EXPECT_EQ(4, map.begin()->first);
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(SortedVectorMapTest, Comparison) {
+  IntMap map1;
+  IntMap map2;
+  EXPECT_TRUE(map1 == map2);
+
+  map1.insert(std::make_pair(1, 1));
+  EXPECT_TRUE(map1 != map2);
+
+  map2.insert(std::make_pair(1, 1));
+  EXPECT_TRUE(map1 == map2);
+}
+
+}  // namespace core
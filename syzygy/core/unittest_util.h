@@ -89,7 +89,8 @@ template<class Data> bool TestSerialization(const Data& data, FILE* file) {
     return false;
 
   // Flush the output and rewind the file.
-  fflush(file);
+  if (!out_archive.Flush())
+    return false;
   fseek(file, 0, SEEK_SET);
 
   core::FileInStream in_stream(file);
@@ -14,6 +14,12 @@
 
 #include "syzygy/core/zstream.h"
 
+#include <algorithm>
+
+#include "base/stl_util.h"
+#include "base/sys_info.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/core/serialization.h"
 #include "third_party/zlib/zlib.h"
 
@@ -27,8 +33,113 @@ namespace {
 // grow dynamically so we simply use a page of memory.
 static const size_t kZStreamBufferSize = 4096;
 
+// The structures of the ParallelZOutStream format.
+struct ParallelZHeader {
+  uint32 magic;
+  uint32 version;
+  uint32 chunk_size;
+};
+
+struct ParallelZChunkHeader {
+  uint32 uncompressed_size;
+  uint32 compressed_size;
+};
+
+struct ParallelZIndexEntry {
+  // The offset of the chunk header, from the start of the stream.
+  uint64 compressed_offset;
+  // The offset of the chunk data in the decompressed data.
+  uint64 uncompressed_offset;
+};
+
+const uint32 kParallelZMagic = 0x5A505A53;  // 'SZPZ'.
+const uint32 kParallelZVersion = 1;
+
+// The size of the index trailer, which repeats the chunk count and is
+// followed by the magic.
+const size_t kParallelZTrailerSize = 2 * sizeof(uint32);
+
+// Decompresses a chunk.
+// @param compressed the compressed data.
+// @param compressed_size the size of the compressed data.
+// @param uncompressed_size the expected size of the decompressed data.
+// @param output receives the decompressed data.
+// @returns true on success, false otherwise.
+bool DecompressChunk(const Byte* compressed,
+                     size_t compressed_size,
+                     size_t uncompressed_size,
+                     std::vector<Byte>* output) {
+  DCHECK(output != NULL);
+
+  output->resize(uncompressed_size);
+  uLongf output_size = uncompressed_size;
+  int ret = uncompress(reinterpret_cast<Bytef*>(&output->at(0)),
+                       &output_size,
+                       reinterpret_cast<const Bytef*>(compressed),
+                       compressed_size);
+  if (ret != Z_OK || output_size != uncompressed_size) {
+    LOG(ERROR) << "zlib uncompress returned " << ret << ".";
+    return false;
+  }
+  return true;
+}
+
+// Orders an offset and the index entries by decompressed offset.
+bool UncompressedOffsetLess(uint64 offset,
+                            const std::pair<uint64, uint64>& entry) {
+  return offset < entry.second;
+}
+
 }  // namespace
 
+class ParallelZOutStream::Chunk : public base::DelegateSimpleThread::Delegate {
+ public:
+  Chunk(int level, size_t chunk_size)
+      : level_(level), done_(true, false), success_(false) {
+    input_.reserve(chunk_size);
+  }
+
+  // Compresses the input. This runs on a worker thread, or on the calling
+  // thread when there are no workers.
+  virtual void Run() OVERRIDE {
+    DCHECK(!input_.empty());
+
+    uLongf output_size = compressBound(input_.size());
+    output_.resize(output_size);
+    int ret = compress2(reinterpret_cast<Bytef*>(&output_[0]),
+                        &output_size,
+                        reinterpret_cast<const Bytef*>(&input_[0]),
+                        input_.size(),
+                        level_);
+    if (ret == Z_OK) {
+      output_.resize(output_size);
+      success_ = true;
+    } else {
+      LOG(ERROR) << "zlib compress2 returned " << ret << ".";
+    }
+    done_.Signal();
+  }
+
+  // Waits for the chunk to be compressed.
+  // @returns true if it was compressed successfully.
+  bool Wait() {
+    done_.Wait();
+    return success_;
+  }
+
+  std::vector<Byte>& input() { return input_; }
+  const std::vector<Byte>& output() const { return output_; }
+
+ private:
+  int level_;
+  std::vector<Byte> input_;
+  std::vector<Byte> output_;
+  base::WaitableEvent done_;
+  bool success_;
+
+  DISALLOW_COPY_AND_ASSIGN(Chunk);
+};
+
 void ZOutStream::z_stream_s_close::operator()(z_stream_s* zstream) const {
   if (zstream != NULL) {
     deflateEnd(zstream);
@@ -241,4 +352,418 @@ bool ZInStream::ReadImpl(size_t length, Byte* bytes, size_t* bytes_read) {
   return true;
 }
 
+ParallelZOutStream::ParallelZOutStream(OutStream* out_stream)
+    : out_stream_(out_stream),
+      level_(Z_DEFAULT_COMPRESSION),
+      chunk_size_(kDefaultChunkSize),
+      max_pending_chunks_(0),
+      initialized_(false),
+      compressed_offset_(0),
+      uncompressed_offset_(0) {
+  DCHECK(out_stream != NULL);
+}
+
+ParallelZOutStream::~ParallelZOutStream() {
+  // The workers may still refer to pending chunks.
+  if (pool_.get() != NULL)
+    pool_->JoinAll();
+  STLDeleteElements(&pending_chunks_);
+}
+
+bool ParallelZOutStream::Init(int level) {
+  return Init(level, base::SysInfo::NumberOfProcessors(), kDefaultChunkSize);
+}
+
+bool ParallelZOutStream::Init(int level,
+                              size_t num_threads,
+                              size_t chunk_size) {
+  DCHECK(level == Z_DEFAULT_COMPRESSION || (level >= 0 && level <= 9));
+  DCHECK_LT(0u, num_threads);
+  DCHECK_LT(0u, chunk_size);
+
+  if (initialized_)
+    return true;
+
+  ParallelZHeader header = { kParallelZMagic, kParallelZVersion, chunk_size };
+  if (!WriteOut(sizeof(header), reinterpret_cast<const Byte*>(&header))) {
+    LOG(ERROR) << "Unable to write compressed stream header.";
+    return false;
+  }
+
+  level_ = level;
+  chunk_size_ = chunk_size;
+
+  // Keep enough chunks in flight for the workers to stay busy while the
+  // oldest chunk is being written out.
+  max_pending_chunks_ = 2 * num_threads;
+  if (num_threads > 1) {
+    pool_.reset(new base::DelegateSimpleThreadPool("ParallelZOutStream",
+                                                   num_threads));
+    pool_->Start();
+  }
+
+  current_chunk_.reset(new Chunk(level_, chunk_size_));
+  initialized_ = true;
+
+  return true;
+}
+
+bool ParallelZOutStream::Write(size_t length, const Byte* bytes) {
+  DCHECK(initialized_);
+
+  while (length > 0) {
+    DCHECK(bytes != NULL);
+    std::vector<Byte>& input = current_chunk_->input();
+    size_t bytes_to_copy = std::min(length, chunk_size_ - input.size());
+    input.insert(input.end(), bytes, bytes + bytes_to_copy);
+    bytes += bytes_to_copy;
+    length -= bytes_to_copy;
+
+    if (input.size() == chunk_size_ && !QueueChunk())
+      return false;
+  }
+
+  return true;
+}
+
+bool ParallelZOutStream::Flush() {
+  DCHECK(initialized_);
+
+  if (!QueueChunk())
+    return false;
+  while (!pending_chunks_.empty()) {
+    if (!WriteOldestChunk())
+      return false;
+  }
+
+  if (pool_.get() != NULL) {
+    pool_->JoinAll();
+    pool_.reset();
+  }
+  current_chunk_.reset();
+  initialized_ = false;
+
+  // Terminate the chunks, and write the index.
+  ParallelZChunkHeader end = {};
+  uint32 chunk_count = index_.size();
+  if (!WriteOut(sizeof(end), reinterpret_cast<const Byte*>(&end)) ||
+      !WriteOut(sizeof(chunk_count),
+                reinterpret_cast<const Byte*>(&chunk_count))) {
+    LOG(ERROR) << "Unable to write compressed stream index.";
+    return false;
+  }
+  for (size_t i = 0; i < index_.size(); ++i) {
+    ParallelZIndexEntry entry = { index_[i].first, index_[i].second };
+    if (!WriteOut(sizeof(entry), reinterpret_cast<const Byte*>(&entry))) {
+      LOG(ERROR) << "Unable to write compressed stream index.";
+      return false;
+    }
+  }
+  uint32 trailer[] = { chunk_count, kParallelZMagic };
+  if (!WriteOut(sizeof(trailer), reinterpret_cast<const Byte*>(trailer))) {
+    LOG(ERROR) << "Unable to write compressed stream index.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ParallelZOutStream::QueueChunk() {
+  DCHECK(current_chunk_.get() != NULL);
+
+  if (current_chunk_->input().empty())
+    return true;
+
+  Chunk* chunk = current_chunk_.release();
+  pending_chunks_.push_back(chunk);
+  if (pool_.get() != NULL) {
+    pool_->AddWork(chunk);
+  } else {
+    chunk->Run();
+  }
+  current_chunk_.reset(new Chunk(level_, chunk_size_));
+
+  while (pending_chunks_.size() > max_pending_chunks_) {
+    if (!WriteOldestChunk())
+      return false;
+  }
+
+  return true;
+}
+
+bool ParallelZOutStream::WriteOldestChunk() {
+  DCHECK(!pending_chunks_.empty());
+
+  scoped_ptr<Chunk> chunk(pending_chunks_.front());
+  pending_chunks_.pop_front();
+  if (!chunk->Wait())
+    return false;
+
+  ParallelZChunkHeader header = { chunk->input().size(),
+                                  chunk->output().size() };
+  index_.push_back(std::make_pair(compressed_offset_, uncompressed_offset_));
+  if (!WriteOut(sizeof(header), reinterpret_cast<const Byte*>(&header)) ||
+      !WriteOut(chunk->output().size(), &chunk->output()[0])) {
+    LOG(ERROR) << "Unable to write compressed stream.";
+    return false;
+  }
+  uncompressed_offset_ += chunk->input().size();
+
+  return true;
+}
+
+bool ParallelZOutStream::WriteOut(size_t length, const Byte* bytes) {
+  if (!out_stream_->Write(length, bytes))
+    return false;
+  compressed_offset_ += length;
+  return true;
+}
+
+ParallelZInStream::ParallelZInStream(InStream* in_stream)
+    : in_stream_(in_stream),
+      chunk_size_(0),
+      initialized_(false),
+      at_end_(false),
+      chunk_position_(0) {
+  DCHECK(in_stream != NULL);
+}
+
+ParallelZInStream::~ParallelZInStream() { }
+
+bool ParallelZInStream::Init() {
+  if (initialized_)
+    return true;
+
+  ParallelZHeader header = {};
+  if (!in_stream_->Read(sizeof(header), reinterpret_cast<Byte*>(&header))) {
+    LOG(ERROR) << "Unable to read compressed stream header.";
+    return false;
+  }
+  if (header.magic != kParallelZMagic || header.version != kParallelZVersion) {
+    LOG(ERROR) << "Unsupported compressed stream format.";
+    return false;
+  }
+
+  chunk_size_ = header.chunk_size;
+  initialized_ = true;
+
+  return true;
+}
+
+bool ParallelZInStream::ReadImpl(size_t length,
+                                 Byte* bytes,
+                                 size_t* bytes_read) {
+  DCHECK(initialized_);
+  DCHECK(bytes_read != NULL);
+
+  *bytes_read = 0;
+  while (length > 0) {
+    DCHECK(bytes != NULL);
+
+    // Move on to the next chunk once this one is consumed. Reaching the end
+    // of the stream is not an error.
+    if (chunk_position_ == chunk_.size()) {
+      if (at_end_)
+        break;
+      if (!ReadChunk())
+        return false;
+      continue;
+    }
+
+    size_t bytes_to_copy = std::min(length, chunk_.size() - chunk_position_);
+    ::memcpy(bytes, &chunk_[chunk_position_], bytes_to_copy);
+    chunk_position_ += bytes_to_copy;
+    bytes += bytes_to_copy;
+    length -= bytes_to_copy;
+    *bytes_read += bytes_to_copy;
+  }
+
+  return true;
+}
+
+bool ParallelZInStream::ReadChunk() {
+  chunk_.clear();
+  chunk_position_ = 0;
+
+  ParallelZChunkHeader header = {};
+  if (!in_stream_->Read(sizeof(header), reinterpret_cast<Byte*>(&header))) {
+    LOG(ERROR) << "Unable to read compressed chunk header.";
+    return false;
+  }
+
+  // The end of the chunks. Consume the index so that the chained stream is
+  // left positioned past the compressed data.
+  if (header.uncompressed_size == 0) {
+    uint32 chunk_count = 0;
+    if (!in_stream_->Read(sizeof(chunk_count),
+                          reinterpret_cast<Byte*>(&chunk_count))) {
+      LOG(ERROR) << "Unable to read compressed stream index.";
+      return false;
+    }
+    for (uint32 i = 0; i < chunk_count; ++i) {
+      ParallelZIndexEntry entry = {};
+      if (!in_stream_->Read(sizeof(entry), reinterpret_cast<Byte*>(&entry))) {
+        LOG(ERROR) << "Unable to read compressed stream index.";
+        return false;
+      }
+    }
+    uint32 trailer[2] = {};
+    if (!in_stream_->Read(sizeof(trailer), reinterpret_cast<Byte*>(trailer)) ||
+        trailer[0] != chunk_count || trailer[1] != kParallelZMagic) {
+      LOG(ERROR) << "Invalid compressed stream index.";
+      return false;
+    }
+    at_end_ = true;
+    return true;
+  }
+
+  if (header.uncompressed_size > chunk_size_) {
+    LOG(ERROR) << "Invalid compressed chunk size.";
+    return false;
+  }
+
+  compressed_.resize(header.compressed_size);
+  if (header.compressed_size == 0 ||
+      !in_stream_->Read(compressed_.size(), &compressed_[0])) {
+    LOG(ERROR) << "Unable to read compressed chunk.";
+    return false;
+  }
+
+  return DecompressChunk(&compressed_[0], compressed_.size(),
+                         header.uncompressed_size, &chunk_);
+}
+
+ParallelZReader::ParallelZReader()
+    : data_(NULL),
+      length_(0),
+      size_(0),
+      cached_chunk_(static_cast<size_t>(-1)) {
+}
+
+bool ParallelZReader::Init(const Byte* data, size_t length) {
+  DCHECK(data != NULL);
+
+  ParallelZHeader header = {};
+  if (length < sizeof(header) + sizeof(ParallelZChunkHeader) +
+          sizeof(uint32) + kParallelZTrailerSize) {
+    LOG(ERROR) << "Compressed data is too short.";
+    return false;
+  }
+  ::memcpy(&header, data, sizeof(header));
+  if (header.magic != kParallelZMagic || header.version != kParallelZVersion) {
+    LOG(ERROR) << "Unsupported compressed stream format.";
+    return false;
+  }
+
+  // Find the index from the trailer.
+  uint32 trailer[2] = {};
+  ::memcpy(trailer, data + length - kParallelZTrailerSize, sizeof(trailer));
+  uint32 chunk_count = trailer[0];
+  if (trailer[1] != kParallelZMagic) {
+    LOG(ERROR) << "Invalid compressed stream index.";
+    return false;
+  }
+  size_t index_size = chunk_count * sizeof(ParallelZIndexEntry);
+  size_t max_index_size = length - sizeof(header) -
+      sizeof(ParallelZChunkHeader) - sizeof(uint32) - kParallelZTrailerSize;
+  if (chunk_count > max_index_size / sizeof(ParallelZIndexEntry)) {
+    LOG(ERROR) << "Invalid compressed stream index.";
+    return false;
+  }
+  const Byte* entries = data + length - kParallelZTrailerSize - index_size;
+  uint32 leading_chunk_count = 0;
+  ::memcpy(&leading_chunk_count, entries - sizeof(uint32), sizeof(uint32));
+  if (leading_chunk_count != chunk_count) {
+    LOG(ERROR) << "Invalid compressed stream index.";
+    return false;
+  }
+
+  index_.clear();
+  index_.reserve(chunk_count);
+  for (uint32 i = 0; i < chunk_count; ++i) {
+    ParallelZIndexEntry entry = {};
+    ::memcpy(&entry, entries + i * sizeof(entry), sizeof(entry));
+    if (entry.compressed_offset + sizeof(ParallelZChunkHeader) > length ||
+        (i > 0 && entry.uncompressed_offset <= index_.back().second)) {
+      LOG(ERROR) << "Invalid compressed stream index entry.";
+      return false;
+    }
+    index_.push_back(std::make_pair(entry.compressed_offset,
+                                    entry.uncompressed_offset));
+  }
+
+  data_ = data;
+  length_ = length;
+  cached_chunk_ = static_cast<size_t>(-1);
+  cache_.clear();
+
+  // The size of the data is the end of the last chunk.
+  size_ = 0;
+  if (!index_.empty()) {
+    ParallelZChunkHeader last = {};
+    ::memcpy(&last, data + index_.back().first, sizeof(last));
+    size_ = index_.back().second + last.uncompressed_size;
+  }
+
+  return true;
+}
+
+bool ParallelZReader::Read(uint64 offset, size_t length, Byte* bytes) {
+  DCHECK(data_ != NULL);
+
+  if (offset > size_ || length > size_ - offset)
+    return false;
+
+  while (length > 0) {
+    DCHECK(bytes != NULL);
+
+    // Find the chunk containing the offset.
+    std::vector<std::pair<uint64, uint64> >::const_iterator it =
+        std::upper_bound(index_.begin(), index_.end(), offset,
+                         UncompressedOffsetLess);
+    DCHECK(it != index_.begin());
+    --it;
+    size_t chunk = it - index_.begin();
+    if (chunk != cached_chunk_ && !LoadChunk(chunk))
+      return false;
+
+    size_t chunk_offset = static_cast<size_t>(offset - it->second);
+    if (chunk_offset >= cache_.size()) {
+      LOG(ERROR) << "Compressed stream index doesn't match its chunks.";
+      return false;
+    }
+    size_t bytes_to_copy = std::min(length, cache_.size() - chunk_offset);
+    ::memcpy(bytes, &cache_[chunk_offset], bytes_to_copy);
+    offset += bytes_to_copy;
+    bytes += bytes_to_copy;
+    length -= bytes_to_copy;
+  }
+
+  return true;
+}
+
+bool ParallelZReader::LoadChunk(size_t index) {
+  DCHECK_LT(index, index_.size());
+
+  cached_chunk_ = static_cast<size_t>(-1);
+
+  uint64 offset = index_[index].first;
+  ParallelZChunkHeader header = {};
+  ::memcpy(&header, data_ + offset, sizeof(header));
+  offset += sizeof(header);
+  if (header.uncompressed_size == 0 ||
+      header.compressed_size > length_ - offset) {
+    LOG(ERROR) << "Invalid compressed chunk.";
+    return false;
+  }
+
+  if (!DecompressChunk(data_ + offset, header.compressed_size,
+                       header.uncompressed_size, &cache_)) {
+    return false;
+  }
+
+  cached_chunk_ = index;
+  return true;
+}
+
 }  // namespace core
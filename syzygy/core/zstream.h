@@ -17,11 +17,17 @@
 #ifndef SYZYGY_CORE_ZSTREAM_H_
 #define SYZYGY_CORE_ZSTREAM_H_
 
+#include <deque>
+#include <vector>
+
 #include "base/memory/scoped_ptr.h"
 #include "syzygy/core/serialization.h"
 
-// Forward declaration.
+// Forward declarations.
 struct z_stream_s;
+namespace base {
+class DelegateSimpleThreadPool;
+}  // namespace base
 
 namespace core {
 
@@ -117,6 +123,167 @@ class ZInStream : public InStream {
   std::vector<uint8> buffer_;
 };
 
+// A block-parallel zlib compressing out-stream. The input is cut into chunks
+// of a fixed size, which are compressed independently on a pool of worker
+// threads and written out in order. This compresses slightly less well than
+// ZOutStream, but scales with the number of processors. The output is not
+// compatible with ZInStream; it must be read with ParallelZInStream or
+// ParallelZReader.
+//
+// The format of the output is:
+//   ParallelZHeader
+//   For each chunk: ParallelZChunkHeader, followed by the compressed data.
+//   A ParallelZChunkHeader with zero sizes, marking the end of the chunks.
+//   The index: uint32 chunk count, a ParallelZIndexEntry per chunk, and
+//   the uint32 chunk count and magic again, so that the index can be found
+//   from the end of the data.
+class ParallelZOutStream : public OutStream {
+ public:
+  // The default size of the chunks.
+  static const size_t kDefaultChunkSize = 1024 * 1024;
+
+  // Constructor.
+  // @param out_stream the output stream to receive the compressed data.
+  explicit ParallelZOutStream(OutStream* out_stream);
+
+  // Destructor.
+  virtual ~ParallelZOutStream();
+
+  // @{
+  // Initializes this compressor. Must be called prior to calling Write.
+  // @param level the level of compression, as for ZOutStream::Init.
+  // @param num_threads the number of worker threads to use. If not provided
+  //     defaults to the number of processors.
+  // @param chunk_size the size of the chunks the input is cut into. If not
+  //     provided defaults to kDefaultChunkSize.
+  // @returns true on success, false otherwise.
+  bool Init(int level);
+  bool Init(int level, size_t num_threads, size_t chunk_size);
+  // @}
+
+  // @name OutStream implementation.
+  // @{
+  virtual bool Write(size_t length, const Byte* bytes) OVERRIDE;
+  // Compresses and writes the remaining input, and the index. The stream is
+  // closed afterwards. This does not recursively call flush on the child
+  // stream.
+  virtual bool Flush() OVERRIDE;
+  // @}
+
+ private:
+  // A chunk of input, compressed by a worker thread.
+  class Chunk;
+
+  // Hands the chunk being filled to the workers.
+  bool QueueChunk();
+  // Waits for the oldest pending chunk to be compressed, and writes it out.
+  bool WriteOldestChunk();
+  // Writes @p length bytes to out_stream_, keeping track of the offset.
+  bool WriteOut(size_t length, const Byte* bytes);
+
+  OutStream* out_stream_;
+  int level_;
+  size_t chunk_size_;
+  size_t max_pending_chunks_;
+  bool initialized_;
+
+  // The workers. This is NULL when compressing on the calling thread.
+  scoped_ptr<base::DelegateSimpleThreadPool> pool_;
+
+  // The chunk being filled, and the chunks being compressed, in order. The
+  // chunks are owned by this stream.
+  scoped_ptr<Chunk> current_chunk_;
+  std::deque<Chunk*> pending_chunks_;
+
+  // The offsets of the chunks written so far, for the index.
+  std::vector<std::pair<uint64, uint64> > index_;
+  uint64 compressed_offset_;
+  uint64 uncompressed_offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelZOutStream);
+};
+
+// A decompressing in-stream for the output of ParallelZOutStream, reading the
+// chained input stream sequentially.
+class ParallelZInStream : public InStream {
+ public:
+  // Constructor.
+  // @param in_stream the input stream from which we read compressed data.
+  explicit ParallelZInStream(InStream* in_stream);
+
+  // Destructor.
+  virtual ~ParallelZInStream();
+
+  // Reads the header of the stream. Must be called prior to calling any read
+  // functions.
+  // @returns true on success, false otherwise.
+  bool Init();
+
+ protected:
+  // InStream implementation.
+  virtual bool ReadImpl(
+      size_t length, Byte* bytes, size_t* bytes_read) OVERRIDE;
+
+ private:
+  // Reads and decompresses the next chunk, or reads the index if there are
+  // no more chunks.
+  bool ReadChunk();
+
+  InStream* in_stream_;
+  size_t chunk_size_;
+  bool initialized_;
+  bool at_end_;
+
+  // The current chunk, and the position of the next byte to return from it.
+  std::vector<Byte> chunk_;
+  size_t chunk_position_;
+  std::vector<Byte> compressed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelZInStream);
+};
+
+// Provides random access to the output of ParallelZOutStream held in memory.
+// Only the chunks covering the data that is read are decompressed, and the
+// most recently decompressed chunk is cached.
+class ParallelZReader {
+ public:
+  ParallelZReader();
+
+  // Reads the header and the index of the compressed data.
+  // @param data the compressed data. It must outlive this reader.
+  // @param length the length of the compressed data.
+  // @returns true on success, false otherwise.
+  bool Init(const Byte* data, size_t length);
+
+  // @returns the size of the decompressed data.
+  uint64 size() const { return size_; }
+
+  // Reads decompressed data.
+  // @param offset the offset in the decompressed data to read from.
+  // @param length the number of bytes to read.
+  // @param bytes the buffer receiving the data.
+  // @returns true on success, false on error or if the range is not entirely
+  //     contained in the decompressed data.
+  bool Read(uint64 offset, size_t length, Byte* bytes);
+
+ private:
+  // Decompresses chunk @p index into the cache.
+  bool LoadChunk(size_t index);
+
+  const Byte* data_;
+  size_t length_;
+  uint64 size_;
+
+  // The compressed offset and the decompressed offset of each chunk.
+  std::vector<std::pair<uint64, uint64> > index_;
+
+  // The most recently decompressed chunk.
+  size_t cached_chunk_;
+  std::vector<Byte> cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelZReader);
+};
+
 }  // namespace core
 
 #endif  // SYZYGY_CORE_ZSTREAM_H_
@@ -14,6 +14,8 @@
 
 #include "syzygy/core/zstream.h"
 
+#include <algorithm>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/serialization.h"
@@ -57,6 +59,58 @@ class ZInStreamTest : public ::testing::Test {
   uint8 buffer[2 * sizeof(kSampleData)];
 };
 
+// A chunk size small enough for the generated data to span many chunks.
+const size_t kSmallChunkSize = 4096;
+
+// Generates compressible data spanning many small chunks, with a partial
+// chunk at the end.
+void GenerateData(std::vector<uint8>* data) {
+  data->resize(37 * kSmallChunkSize + 123);
+  for (size_t i = 0; i < data->size(); ++i)
+    (*data)[i] = kSampleData[(i * 7 + i / 1000) % (sizeof(kSampleData) - 1)];
+}
+
+// Compresses @p data with a ParallelZOutStream.
+void ParallelCompress(const std::vector<uint8>& data,
+                      size_t num_threads,
+                      std::vector<uint8>* compressed) {
+  ScopedOutStreamPtr out_stream(
+      CreateByteOutStream(std::back_inserter(*compressed)));
+  ParallelZOutStream zip_stream(out_stream.get());
+  ASSERT_TRUE(zip_stream.Init(9, num_threads, kSmallChunkSize));
+
+  // Write in pieces that don't line up with the chunks.
+  size_t offset = 0;
+  while (offset < data.size()) {
+    size_t length = std::min<size_t>(1000, data.size() - offset);
+    ASSERT_TRUE(zip_stream.Write(length, &data[offset]));
+    offset += length;
+  }
+  ASSERT_TRUE(zip_stream.Flush());
+  ASSERT_LT(0u, compressed->size());
+  ASSERT_GT(data.size(), compressed->size());
+}
+
+// Decompresses @p compressed with a ParallelZInStream, and checks that it is
+// entirely consumed.
+void ParallelDecompress(const std::vector<uint8>& compressed,
+                        std::vector<uint8>* data) {
+  ScopedInStreamPtr in_stream(
+      CreateByteInStream(compressed.begin(), compressed.end()));
+  ParallelZInStream unzip_stream(in_stream.get());
+  ASSERT_TRUE(unzip_stream.Init());
+
+  uint8 buffer[1000] = {};
+  size_t bytes_read = 0;
+  do {
+    ASSERT_TRUE(unzip_stream.Read(sizeof(buffer), buffer, &bytes_read));
+    data->insert(data->end(), buffer, buffer + bytes_read);
+  } while (bytes_read == sizeof(buffer));
+
+  EXPECT_TRUE(in_stream->Read(sizeof(buffer), buffer, &bytes_read));
+  EXPECT_EQ(0u, bytes_read);
+}
+
 }  // namespace
 
 TEST_F(ZOutStreamTest, DoingNothingProducesNoData) {
@@ -133,4 +187,91 @@ TEST(ZStreamTest, RoundTrip) {
   EXPECT_THAT(decompressed, testing::ElementsAreArray(kSampleData));
 }
 
+TEST(ParallelZStreamTest, RoundTrip) {
+  std::vector<uint8> data;
+  GenerateData(&data);
+
+  std::vector<uint8> compressed;
+  ASSERT_NO_FATAL_FAILURE(ParallelCompress(data, 4, &compressed));
+
+  std::vector<uint8> decompressed;
+  ASSERT_NO_FATAL_FAILURE(ParallelDecompress(compressed, &decompressed));
+  EXPECT_EQ(data, decompressed);
+}
+
+TEST(ParallelZStreamTest, SingleThreadedOutputIsIdentical) {
+  std::vector<uint8> data;
+  GenerateData(&data);
+
+  std::vector<uint8> compressed1;
+  std::vector<uint8> compressed4;
+  ASSERT_NO_FATAL_FAILURE(ParallelCompress(data, 1, &compressed1));
+  ASSERT_NO_FATAL_FAILURE(ParallelCompress(data, 4, &compressed4));
+  EXPECT_EQ(compressed1, compressed4);
+}
+
+TEST(ParallelZStreamTest, EmptyRoundTrip) {
+  std::vector<uint8> compressed;
+  ScopedOutStreamPtr out_stream(
+      CreateByteOutStream(std::back_inserter(compressed)));
+  ParallelZOutStream zip_stream(out_stream.get());
+  ASSERT_TRUE(zip_stream.Init(9, 2, kSmallChunkSize));
+  ASSERT_TRUE(zip_stream.Flush());
+
+  std::vector<uint8> decompressed;
+  ASSERT_NO_FATAL_FAILURE(ParallelDecompress(compressed, &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+
+  ParallelZReader reader;
+  ASSERT_TRUE(reader.Init(&compressed[0], compressed.size()));
+  EXPECT_EQ(0u, reader.size());
+}
+
+TEST(ParallelZStreamTest, ReadingTruncatedDataFails) {
+  std::vector<uint8> data;
+  GenerateData(&data);
+  std::vector<uint8> compressed;
+  ASSERT_NO_FATAL_FAILURE(ParallelCompress(data, 4, &compressed));
+  compressed.resize(compressed.size() / 2);
+
+  ScopedInStreamPtr in_stream(
+      CreateByteInStream(compressed.begin(), compressed.end()));
+  ParallelZInStream unzip_stream(in_stream.get());
+  ASSERT_TRUE(unzip_stream.Init());
+  std::vector<uint8> decompressed(data.size());
+  EXPECT_FALSE(unzip_stream.Read(decompressed.size(), &decompressed[0]));
+
+  ParallelZReader reader;
+  EXPECT_FALSE(reader.Init(&compressed[0], compressed.size()));
+}
+
+TEST(ParallelZStreamTest, RandomAccess) {
+  std::vector<uint8> data;
+  GenerateData(&data);
+  std::vector<uint8> compressed;
+  ASSERT_NO_FATAL_FAILURE(ParallelCompress(data, 4, &compressed));
+
+  ParallelZReader reader;
+  ASSERT_TRUE(reader.Init(&compressed[0], compressed.size()));
+  EXPECT_EQ(data.size(), reader.size());
+
+  // Read ranges within a chunk, spanning chunks, and at the end, out of
+  // order.
+  const size_t kRanges[][2] = {
+      { 10 * kSmallChunkSize + 5, 100 },
+      { 3 * kSmallChunkSize - 50, 2 * kSmallChunkSize + 100 },
+      { 0, 1 },
+      { data.size() - 200, 200 } };
+  for (size_t i = 0; i < arraysize(kRanges); ++i) {
+    std::vector<uint8> buffer(kRanges[i][1]);
+    ASSERT_TRUE(reader.Read(kRanges[i][0], buffer.size(), &buffer[0]));
+    EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(),
+                           data.begin() + kRanges[i][0]));
+  }
+
+  // Reading past the end fails.
+  uint8 buffer[2] = {};
+  EXPECT_FALSE(reader.Read(data.size() - 1, sizeof(buffer), buffer));
+}
+
 }  // namespace core
@@ -0,0 +1,346 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/crashdata/buffer_writer.h"
+
+// This uses 'assert' and not base DCHECKs so that it is portable.
+#include <assert.h>
+#include <string.h>
+
+namespace crashdata {
+
+namespace {
+
+using google::protobuf::uint8;
+using google::protobuf::uint32;
+using google::protobuf::uint64;
+
+// The wire types of the protobuf encoding.
+const int kVarintWireType = 0;
+const int kFixed64WireType = 1;
+const int kLengthDelimitedWireType = 2;
+
+// The field numbers of the crash data messages.
+const int kValueTypeField = 1;
+const int kValueLeafField = 3;
+const int kValueListField = 4;
+const int kValueDictionaryField = 5;
+const int kLeafTypeField = 1;
+const int kLeafIntegerField = 2;
+const int kLeafUnsignedIntegerField = 3;
+const int kLeafRealField = 4;
+const int kLeafStringField = 5;
+const int kLeafAddressField = 6;
+const int kLeafStackTraceField = 7;
+const int kLeafBlobField = 8;
+const int kAddressAddressField = 1;
+const int kStackTraceFramesField = 1;
+const int kBlobDataField = 3;
+const int kListValuesField = 1;
+const int kKeyValueKeyField = 1;
+const int kKeyValueValueField = 2;
+const int kDictionaryValuesField = 1;
+
+// The room reserved for the length of a nested message, which is enough for
+// any 32-bit length.
+const size_t kMaxLengthSize = 5;
+
+// The maximum size of a varint.
+const size_t kMaxVarintSize = 10;
+
+// Encodes a varint.
+// @param value The value to encode.
+// @param output Receives the encoded value. This must have room for
+//     kMaxVarintSize bytes.
+// @returns the size of the encoded value.
+size_t EncodeVarint(uint64 value, uint8* output) {
+  assert(output != nullptr);
+  size_t size = 0;
+  while (value >= 0x80) {
+    output[size++] = static_cast<uint8>(value | 0x80);
+    value >>= 7;
+  }
+  output[size++] = static_cast<uint8>(value);
+  return size;
+}
+
+}  // namespace
+
+BufferWriter::BufferWriter(void* buffer, size_t buffer_size)
+    : buffer_(reinterpret_cast<uint8*>(buffer)), buffer_size_(buffer_size) {
+  assert(buffer != nullptr || buffer_size == 0);
+  ::memset(&state_, 0, sizeof(state_));
+  state_.depth = 1;
+  state_.frames[0].kind = kRootValueFrame;
+}
+
+void BufferWriter::BeginDict() {
+  if (BeginValue(Value_Type_DICTIONARY))
+    OpenField(kValueDictionaryField, kDictFrame);
+}
+
+void BufferWriter::EndDict() {
+  if (state_.overflowed)
+    return;
+  CloseField(kDictFrame);
+  EndValue();
+}
+
+void BufferWriter::BeginList() {
+  if (BeginValue(Value_Type_LIST))
+    OpenField(kValueListField, kListFrame);
+}
+
+void BufferWriter::EndList() {
+  if (state_.overflowed)
+    return;
+  CloseField(kListFrame);
+  EndValue();
+}
+
+void BufferWriter::SetInt(google::protobuf::int64 value) {
+  if (BeginLeaf(Leaf_Type_INTEGER) &&
+      WriteVarintField(kLeafIntegerField, static_cast<uint64>(value))) {
+    EndLeaf();
+  }
+}
+
+void BufferWriter::SetUInt(uint64 value) {
+  if (BeginLeaf(Leaf_Type_UNSIGNED_INTEGER) &&
+      WriteVarintField(kLeafUnsignedIntegerField, value)) {
+    EndLeaf();
+  }
+}
+
+void BufferWriter::SetReal(double value) {
+  // Fixed size values are little endian, as is the memory of the machines
+  // this runs on.
+  if (BeginLeaf(Leaf_Type_REAL) &&
+      WriteTag(kLeafRealField, kFixed64WireType) &&
+      WriteBytes(&value, sizeof(value))) {
+    EndLeaf();
+  }
+}
+
+void BufferWriter::SetString(const char* value) {
+  assert(value != nullptr);
+  SetString(value, ::strlen(value));
+}
+
+void BufferWriter::SetString(const char* data, size_t size) {
+  assert(data != nullptr || size == 0);
+  if (BeginLeaf(Leaf_Type_STRING) &&
+      WriteBytesField(kLeafStringField, data, size)) {
+    EndLeaf();
+  }
+}
+
+void BufferWriter::SetAddress(uint64 address) {
+  if (BeginLeaf(Leaf_Type_ADDRESS) &&
+      OpenField(kLeafAddressField, kMessageFrame) &&
+      WriteVarintField(kAddressAddressField, address)) {
+    CloseField(kMessageFrame);
+    EndLeaf();
+  }
+}
+
+void BufferWriter::SetBlob(const void* data, size_t size) {
+  assert(data != nullptr || size == 0);
+  if (BeginLeaf(Leaf_Type_BLOB) &&
+      OpenField(kLeafBlobField, kMessageFrame) &&
+      WriteBytesField(kBlobDataField, data, size)) {
+    CloseField(kMessageFrame);
+    EndLeaf();
+  }
+}
+
+void BufferWriter::BeginStackTrace() {
+  // The frames are a packed repeated field, which is itself length delimited.
+  if (BeginLeaf(Leaf_Type_STACK_TRACE) &&
+      OpenField(kLeafStackTraceField, kStackTraceFrame)) {
+    OpenField(kStackTraceFramesField, kFramesFrame);
+  }
+}
+
+void BufferWriter::AddFrame(uint64 frame) {
+  if (state_.overflowed)
+    return;
+  assert(state_.frames[state_.depth - 1].kind == kFramesFrame);
+  WriteVarint(frame);
+}
+
+void BufferWriter::EndStackTrace() {
+  if (state_.overflowed)
+    return;
+
+  // An empty packed field isn't written at all.
+  const Frame& frames = state_.frames[state_.depth - 1];
+  assert(frames.kind == kFramesFrame);
+  if (state_.size == frames.contents_offset) {
+    state_.size = frames.tag_offset;
+    --state_.depth;
+  } else {
+    CloseField(kFramesFrame);
+  }
+  CloseField(kStackTraceFrame);
+  EndLeaf();
+}
+
+void BufferWriter::AddKey(const char* key) {
+  assert(key != nullptr);
+  if (state_.overflowed)
+    return;
+  assert(state_.frames[state_.depth - 1].kind == kDictFrame);
+  if (OpenField(kDictionaryValuesField, kKeyValueFrame) &&
+      WriteBytesField(kKeyValueKeyField, key, ::strlen(key))) {
+    OpenField(kKeyValueValueField, kValueFrame);
+  }
+}
+
+void BufferWriter::GetCheckpoint(Checkpoint* checkpoint) const {
+  assert(checkpoint != nullptr);
+  *checkpoint = state_;
+}
+
+void BufferWriter::Rollback(const Checkpoint& checkpoint) {
+  assert(checkpoint.size <= buffer_size_);
+  state_ = checkpoint;
+}
+
+size_t BufferWriter::Finish() const {
+  if (state_.overflowed || state_.depth != 0)
+    return 0;
+  return state_.size;
+}
+
+bool BufferWriter::BeginValue(Value_Type type) {
+  if (state_.overflowed)
+    return false;
+
+  // The elements of a list are written one after the other, while other
+  // values have already been opened by their container.
+  FrameKind kind = state_.frames[state_.depth - 1].kind;
+  if (kind == kListFrame) {
+    if (!OpenField(kListValuesField, kValueFrame))
+      return false;
+  } else {
+    assert(kind == kValueFrame || kind == kRootValueFrame);
+  }
+
+  return WriteVarintField(kValueTypeField, type);
+}
+
+void BufferWriter::EndValue() {
+  assert(!state_.overflowed);
+  FrameKind kind = state_.frames[state_.depth - 1].kind;
+  if (kind == kRootValueFrame) {
+    --state_.depth;
+    return;
+  }
+
+  CloseField(kValueFrame);
+  if (state_.frames[state_.depth - 1].kind == kKeyValueFrame)
+    CloseField(kKeyValueFrame);
+}
+
+bool BufferWriter::BeginLeaf(Leaf_Type type) {
+  return BeginValue(Value_Type_LEAF) &&
+      OpenField(kValueLeafField, kLeafFrame) &&
+      WriteVarintField(kLeafTypeField, type);
+}
+
+void BufferWriter::EndLeaf() {
+  assert(!state_.overflowed);
+  CloseField(kLeafFrame);
+  EndValue();
+}
+
+bool BufferWriter::WriteBytes(const void* data, size_t size) {
+  if (state_.overflowed)
+    return false;
+  if (buffer_size_ - state_.size < size) {
+    state_.overflowed = true;
+    return false;
+  }
+  if (size != 0)
+    ::memcpy(buffer_ + state_.size, data, size);
+  state_.size += size;
+  return true;
+}
+
+bool BufferWriter::WriteVarint(uint64 value) {
+  uint8 encoded[kMaxVarintSize];
+  return WriteBytes(encoded, EncodeVarint(value, encoded));
+}
+
+bool BufferWriter::WriteTag(int field_number, int wire_type) {
+  return WriteVarint((static_cast<uint32>(field_number) << 3) | wire_type);
+}
+
+bool BufferWriter::WriteVarintField(int field_number, uint64 value) {
+  return WriteTag(field_number, kVarintWireType) && WriteVarint(value);
+}
+
+bool BufferWriter::WriteBytesField(int field_number,
+                                   const void* data,
+                                   size_t size) {
+  return WriteTag(field_number, kLengthDelimitedWireType) &&
+      WriteVarint(size) && WriteBytes(data, size);
+}
+
+bool BufferWriter::OpenField(int field_number, FrameKind kind) {
+  if (state_.overflowed)
+    return false;
+  if (state_.depth == kMaxDepth) {
+    state_.overflowed = true;
+    return false;
+  }
+
+  size_t tag_offset = state_.size;
+  if (!WriteTag(field_number, kLengthDelimitedWireType))
+    return false;
+  if (buffer_size_ - state_.size < kMaxLengthSize) {
+    state_.overflowed = true;
+    return false;
+  }
+  state_.size += kMaxLengthSize;
+
+  Frame& frame = state_.frames[state_.depth++];
+  frame.kind = kind;
+  frame.tag_offset = tag_offset;
+  frame.contents_offset = state_.size;
+  return true;
+}
+
+void BufferWriter::CloseField(FrameKind kind) {
+  assert(!state_.overflowed);
+  assert(state_.depth > 0);
+  const Frame& frame = state_.frames[state_.depth - 1];
+  assert(frame.kind == kind);
+
+  // Write the length of the contents and move them right after it.
+  size_t length = state_.size - frame.contents_offset;
+  size_t length_offset = frame.contents_offset - kMaxLengthSize;
+  uint8 encoded[kMaxVarintSize];
+  size_t length_size = EncodeVarint(length, encoded);
+  assert(length_size <= kMaxLengthSize);
+  ::memcpy(buffer_ + length_offset, encoded, length_size);
+  ::memmove(buffer_ + length_offset + length_size,
+            buffer_ + frame.contents_offset,
+            length);
+  state_.size = length_offset + length_size + length;
+  --state_.depth;
+}
+
+}  // namespace crashdata
@@ -0,0 +1,173 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares BufferWriter, which serializes a crash data Value directly to its
+// protobuf wire format in a fixed size buffer. Unlike building a Value and
+// serializing it, this doesn't allocate any memory, so it can be used from a
+// crash handler. The output is identical to what Value::SerializeToString
+// produces for the same value.
+//
+// A value is written depth first, in the same order as it would be built
+// with the helper functions of crashdata.h:
+//
+//   BufferWriter writer(buffer, sizeof(buffer));
+//   writer.BeginDict();
+//   writer.AddKey("location");
+//   writer.SetAddress(0xBAADF00D);
+//   writer.AddKey("frames");
+//   writer.BeginList();
+//   writer.SetUInt(42);
+//   writer.SetString("foo");
+//   writer.EndList();
+//   writer.EndDict();
+//   size_t size = writer.Finish();
+
+#ifndef SYZYGY_CRASHDATA_BUFFER_WRITER_H_
+#define SYZYGY_CRASHDATA_BUFFER_WRITER_H_
+
+#include "syzygy/crashdata/crashdata.h"
+
+namespace crashdata {
+
+// Writes a Value in the protobuf wire format to a fixed size buffer. Nested
+// messages are written with room for the largest length prefix, and moved
+// back over the unused part of it once they are complete.
+class BufferWriter {
+ public:
+  // The maximum nesting depth of the written value. Each dictionary entry
+  // uses 3 levels, and each list element 2.
+  static const size_t kMaxDepth = 32;
+
+  // The kinds of nested messages.
+  enum FrameKind {
+    kRootValueFrame,
+    kValueFrame,
+    kKeyValueFrame,
+    kDictFrame,
+    kListFrame,
+    kLeafFrame,
+    kStackTraceFrame,
+    kFramesFrame,
+    // An Address or a Blob, which are written at once.
+    kMessageFrame,
+  };
+
+  // A nested message being written.
+  struct Frame {
+    FrameKind kind;
+    // The offset of the tag of the message.
+    size_t tag_offset;
+    // The offset of the contents of the message, after the space reserved
+    // for its length.
+    size_t contents_offset;
+  };
+
+  // The state of the writer, to which it can be rolled back.
+  struct Checkpoint {
+    // The number of bytes written.
+    size_t size;
+    // The nested messages being written.
+    size_t depth;
+    Frame frames[kMaxDepth];
+    // Indicates if the buffer is full.
+    bool overflowed;
+  };
+
+  // @param buffer The buffer receiving the serialized value.
+  // @param buffer_size The size of @p buffer.
+  BufferWriter(void* buffer, size_t buffer_size);
+
+  // @name Functions for writing a value. The value being written is the root
+  //     value, the value of the last key added to a dictionary, or a new
+  //     element when a list is being written.
+  // @{
+  void BeginDict();
+  void EndDict();
+  void BeginList();
+  void EndList();
+  void SetInt(google::protobuf::int64 value);
+  void SetUInt(google::protobuf::uint64 value);
+  void SetReal(double value);
+  void SetString(const char* value);
+  void SetString(const char* data, size_t size);
+  void SetAddress(google::protobuf::uint64 address);
+  // Writes a blob with explicit contents, not tied to an address.
+  void SetBlob(const void* data, size_t size);
+  // Writes a stack trace, whose frames are added with AddFrame.
+  void BeginStackTrace();
+  void AddFrame(google::protobuf::uint64 frame);
+  void EndStackTrace();
+  // @}
+
+  // Adds a key to the dictionary being written. This must be followed by the
+  // value of the key.
+  // @param key The key.
+  void AddKey(const char* key);
+
+  // @name Functions for bounding the output.
+  // Once the buffer is full, the writer stops writing and overflowed returns
+  // true. It can then be rolled back to a previous checkpoint, to drop the
+  // part of the value that didn't fit.
+  // @{
+  void GetCheckpoint(Checkpoint* checkpoint) const;
+  void Rollback(const Checkpoint& checkpoint);
+  bool overflowed() const { return state_.overflowed; }
+  // @}
+
+  // Finishes writing.
+  // @returns the size of the serialized value, or 0 if it didn't fit or if
+  //     it isn't complete.
+  size_t Finish() const;
+
+ private:
+  // Writes the type of the value being written, opening a new list element
+  // if need be.
+  // @param type The type of the value.
+  // @returns true on success, false if the writer overflowed.
+  bool BeginValue(Value_Type type);
+
+  // Closes the value that was just written, and the dictionary entry that
+  // contains it if any.
+  void EndValue();
+
+  // Writes the leaf value being written, up to its type.
+  // @param type The type of the leaf.
+  // @returns true on success, false if the writer overflowed.
+  bool BeginLeaf(Leaf_Type type);
+
+  // Closes the leaf that was just written, and its value.
+  void EndLeaf();
+
+  // @name Low level writing functions. They return true on success, and false
+  //     if the writer overflowed.
+  // @{
+  bool WriteBytes(const void* data, size_t size);
+  bool WriteVarint(google::protobuf::uint64 value);
+  bool WriteTag(int field_number, int wire_type);
+  bool WriteVarintField(int field_number, google::protobuf::uint64 value);
+  bool WriteBytesField(int field_number, const void* data, size_t size);
+  // Opens a length delimited field.
+  bool OpenField(int field_number, FrameKind kind);
+  // Closes the innermost length delimited field.
+  void CloseField(FrameKind kind);
+  // @}
+
+  google::protobuf::uint8* buffer_;
+  size_t buffer_size_;
+  Checkpoint state_;
+};
+
+}  // namespace crashdata
+
+#endif  // SYZYGY_CRASHDATA_BUFFER_WRITER_H_
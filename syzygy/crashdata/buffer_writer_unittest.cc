@@ -0,0 +1,175 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/crashdata/buffer_writer.h"
+
+#include "gtest/gtest.h"
+
+namespace crashdata {
+
+namespace {
+
+// Serializes a value with protobuf.
+std::string Serialize(const Value& value) {
+  std::string serialized;
+  EXPECT_TRUE(value.SerializeToString(&serialized));
+  return serialized;
+}
+
+// Gets the output of a writer.
+std::string GetOutput(const BufferWriter& writer, const char* buffer) {
+  return std::string(buffer, writer.Finish());
+}
+
+}  // namespace
+
+TEST(BufferWriterTest, Leaves) {
+  char buffer[1024] = {};
+  static const char kBlob[] = { 1, 2, 0, 3 };
+
+  Value value;
+  Dictionary* dict = ValueGetDict(&value);
+  LeafSetInt(-42, DictAddLeaf("int", dict));
+  LeafSetUInt(0xFFFFFFFFFFull, DictAddLeaf("uint", dict));
+  LeafSetReal(3.5, DictAddLeaf("real", dict));
+  LeafGetString(DictAddLeaf("string", dict))->assign("foo");
+  LeafGetString(DictAddLeaf("empty-string", dict));
+  LeafGetAddress(DictAddLeaf("address", dict))->set_address(0xBAADF00D);
+  LeafGetBlob(DictAddLeaf("blob", dict))->mutable_data()->assign(
+      kBlob, sizeof(kBlob));
+  StackTrace* stack_trace = LeafGetStackTrace(DictAddLeaf("stack", dict));
+  stack_trace->add_frames(0xCAFEBABE);
+  stack_trace->add_frames(0x1234);
+  LeafGetStackTrace(DictAddLeaf("empty-stack", dict));
+
+  BufferWriter writer(buffer, sizeof(buffer));
+  writer.BeginDict();
+  writer.AddKey("int");
+  writer.SetInt(-42);
+  writer.AddKey("uint");
+  writer.SetUInt(0xFFFFFFFFFFull);
+  writer.AddKey("real");
+  writer.SetReal(3.5);
+  writer.AddKey("string");
+  writer.SetString("foo");
+  writer.AddKey("empty-string");
+  writer.SetString("");
+  writer.AddKey("address");
+  writer.SetAddress(0xBAADF00D);
+  writer.AddKey("blob");
+  writer.SetBlob(kBlob, sizeof(kBlob));
+  writer.AddKey("stack");
+  writer.BeginStackTrace();
+  writer.AddFrame(0xCAFEBABE);
+  writer.AddFrame(0x1234);
+  writer.EndStackTrace();
+  writer.AddKey("empty-stack");
+  writer.BeginStackTrace();
+  writer.EndStackTrace();
+  writer.EndDict();
+
+  EXPECT_FALSE(writer.overflowed());
+  EXPECT_EQ(Serialize(value), GetOutput(writer, buffer));
+}
+
+TEST(BufferWriterTest, NestedContainers) {
+  char buffer[4096] = {};
+
+  // The large string makes the lengths of the containers take more than one
+  // byte.
+  std::string large_string(300, 'x');
+
+  Value value;
+  List* list = ValueGetList(&value);
+  LeafSetUInt(1, ValueGetLeaf(list->add_values()));
+  Dictionary* dict = ValueGetDict(list->add_values());
+  LeafGetString(DictAddLeaf("large", dict))->assign(large_string);
+  List* inner_list = ValueGetList(DictAddValue("list", dict));
+  ValueGetDict(inner_list->add_values());
+  ValueGetList(inner_list->add_values());
+  ValueGetDict(DictAddValue("empty-dict", dict));
+
+  BufferWriter writer(buffer, sizeof(buffer));
+  writer.BeginList();
+  writer.SetUInt(1);
+  writer.BeginDict();
+  writer.AddKey("large");
+  writer.SetString(large_string.data(), large_string.size());
+  writer.AddKey("list");
+  writer.BeginList();
+  writer.BeginDict();
+  writer.EndDict();
+  writer.BeginList();
+  writer.EndList();
+  writer.EndList();
+  writer.AddKey("empty-dict");
+  writer.BeginDict();
+  writer.EndDict();
+  writer.EndDict();
+  writer.EndList();
+
+  EXPECT_FALSE(writer.overflowed());
+  EXPECT_EQ(Serialize(value), GetOutput(writer, buffer));
+
+  Value parsed;
+  EXPECT_TRUE(parsed.ParseFromArray(buffer, writer.Finish()));
+  EXPECT_EQ(Serialize(value), Serialize(parsed));
+}
+
+TEST(BufferWriterTest, IncompleteValue) {
+  char buffer[64] = {};
+  BufferWriter writer(buffer, sizeof(buffer));
+  writer.BeginDict();
+  writer.AddKey("key");
+  writer.SetUInt(1);
+  EXPECT_EQ(0u, writer.Finish());
+  writer.EndDict();
+  EXPECT_NE(0u, writer.Finish());
+}
+
+TEST(BufferWriterTest, OverflowAndRollback) {
+  char buffer[64] = {};
+
+  Value value;
+  List* list = ValueGetList(&value);
+  LeafGetString(ValueGetLeaf(list->add_values()))->assign("short");
+
+  BufferWriter writer(buffer, sizeof(buffer));
+  writer.BeginList();
+  writer.SetString("short");
+
+  // An element that doesn't fit is rolled back.
+  BufferWriter::Checkpoint checkpoint = {};
+  writer.GetCheckpoint(&checkpoint);
+  writer.BeginDict();
+  writer.AddKey("long");
+  writer.SetString(std::string(100, 'x').c_str());
+  writer.EndDict();
+  EXPECT_TRUE(writer.overflowed());
+  EXPECT_EQ(0u, writer.Finish());
+
+  writer.Rollback(checkpoint);
+  EXPECT_FALSE(writer.overflowed());
+  writer.EndList();
+  EXPECT_EQ(Serialize(value), GetOutput(writer, buffer));
+}
+
+TEST(BufferWriterTest, EmptyBuffer) {
+  BufferWriter writer(nullptr, 0);
+  writer.SetUInt(1);
+  EXPECT_TRUE(writer.overflowed());
+  EXPECT_EQ(0u, writer.Finish());
+}
+
+}  // namespace crashdata
@@ -59,6 +59,8 @@
       'target_name': 'crashdata_lib',
       'type': 'static_library',
       'sources': [
+        'buffer_writer.cc',
+        'buffer_writer.h',
         'crashdata.cc',
         'crashdata.h',
         'json.cc',
@@ -79,6 +81,7 @@
       'type': 'executable',
       'sources': [
         '<(src)/base/test/run_all_unittests.cc',
+        'buffer_writer_unittest.cc',
         'crashdata_unittest.cc',
         'json_unittest.cc',
       ],
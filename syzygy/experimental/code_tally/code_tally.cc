@@ -19,6 +19,7 @@
 
 #include "syzygy/experimental/code_tally/code_tally.h"
 
+#include <algorithm>
 #include <cstdio>
 
 #include "base/bind.h"
@@ -31,8 +32,14 @@
 #include "syzygy/common/com_utils.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/core/json_file_writer.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_symbol_record.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
+#include "third_party/cci/Files/CvInfo.h"
 
 namespace {
 
@@ -77,6 +84,7 @@ bool WriteExecutableDict(const pe::PEFile::Signature& image_signature,
 bool GetImageSignature(const base::FilePath& image_name,
                        pe::PEFile::Signature* image_signature) {
   pe::PEFile image_file;
+  image_file.set_memory_mapped(true);
   if (!image_file.Init(image_name)) {
     LOG(ERROR) << "Unable to read image file '" << image_name.value() << "'.";
 
@@ -87,39 +95,283 @@ bool GetImageSignature(const base::FilePath& image_name,
   return true;
 }
 
-}  // namespace
 
-CodeTally::CodeTally(const base::FilePath& image_file)
-    : image_file_(image_file) {
+// The bytes contributed to each kind of section by an object file.
+struct ObjectSizes {
+  ObjectSizes() : code(0), data(0), bss(0) {
+  }
+
+  size_t code;
+  size_t data;
+  size_t bss;
+};
+
+// Reads a function symbol, and optionally its name.
+bool ReadProcSymbol(pdb::PdbStream* stream,
+                    cci::ProcSym32* proc,
+                    std::string* name) {
+  DCHECK(stream != NULL);
+  DCHECK(proc != NULL);
+
+  size_t to_read = offsetof(cci::ProcSym32, name);
+  size_t bytes_read = 0;
+  if (!stream->ReadBytes(proc, to_read, &bytes_read) ||
+      bytes_read != to_read ||
+      (name != NULL && !pdb::ReadString(stream, name))) {
+    LOG(ERROR) << "Unable to read function symbol.";
+    return false;
+  }
+
+  return true;
 }
 
-bool CodeTally::TallyLines(const base::FilePath& pdb_file) {
-  base::FilePath found_pdb = pdb_file;
+bool IsProcSymbol(uint16 symbol_type) {
+  return symbol_type == cci::S_GPROC32 || symbol_type == cci::S_LPROC32 ||
+      symbol_type == cci::S_GPROC32_VS2013 ||
+      symbol_type == cci::S_LPROC32_VS2013;
+}
 
-  // Start by locating the PDB file, if one was not provided.
-  if (found_pdb.empty() && !pe::FindPdbForModule(image_file_, &found_pdb)) {
-    LOG(ERROR) << "Unable to find PDB file for image '"
-               << image_file_.value() << "'.";
-    return false;
+// Produces the coarse tally of CodeTally::StreamTally. The section
+// contributions are accrued into a counter per object file up front, as they
+// are all in the DBI stream anyway. Then the symbol stream of each object file
+// is read and its tally is written out, one object file at a time. Only the
+// start addresses of the functions are kept across object files, in a sorted
+// vector, to apportion the size of folded functions.
+class PdbStreamTally {
+ public:
+  PdbStreamTally() { }
+
+  // Reads the PDB file, its DBI stream and its section headers, and makes a
+  // first pass over the function symbols.
+  // @param pdb_path The path of the PDB file to read.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& pdb_path) {
+    pdb::PdbReader pdb_reader;
+    pdb_reader.set_memory_mapped(true);
+    if (!pdb_reader.Read(pdb_path, &pdb_file_)) {
+      LOG(ERROR) << "Unable to read PDB file '" << pdb_path.value() << "'.";
+      return false;
+    }
+
+    pdb::PdbStream* dbi_stream = pdb_file_.GetStream(pdb::kDbiStream);
+    if (dbi_stream == NULL || !dbi_.Read(dbi_stream)) {
+      LOG(ERROR) << "Unable to read the DBI stream of PDB file '"
+                 << pdb_path.value() << "'.";
+      return false;
+    }
+
+    // The section contributions and symbols of an image with OMAP refer to
+    // the original image, which would need translating.
+    if (dbi_.dbg_header().omap_from_src != -1) {
+      LOG(ERROR) << "PDB file '" << pdb_path.value() << "' has OMAP "
+                 << "information, which isn't supported when streaming.";
+      return false;
+    }
+
+    pdb::PdbStream* section_stream = GetStream(
+        dbi_.dbg_header().section_header);
+    if (section_stream == NULL ||
+        !section_stream->Seek(0) ||
+        !section_stream->Read(
+            &sections_,
+            section_stream->length() / sizeof(IMAGE_SECTION_HEADER))) {
+      LOG(ERROR) << "Unable to read the section headers of PDB file '"
+                 << pdb_path.value() << "'.";
+      return false;
+    }
+
+    AccrueSectionContributions();
+
+    // Collect the function addresses, without their names.
+    pdb::VisitSymbolsCallback callback = base::Bind(
+        &PdbStreamTally::OnFunctionAddress, base::Unretained(this));
+    for (size_t i = 0; i < dbi_.modules().size(); ++i) {
+      if (!VisitModuleSymbols(i, callback))
+        return false;
+    }
+    std::sort(function_addresses_.begin(), function_addresses_.end());
+
+    return true;
   }
 
-  // Make sure the PDB file, whether found or provided, matches the image file.
-  if (!pe::PeAndPdbAreMatched(image_file_, found_pdb)) {
-    LOG(ERROR) << "PDB file '" << found_pdb.value() << "' does not match "
-               << " image file '" << image_file_.value() << "'.";
-    return false;
+  // Writes the "objects" list.
+  // @param writer The writer that receives the tally.
+  // @returns true on success, false otherwise.
+  bool WriteObjects(core::JSONFileWriter* writer) {
+    DCHECK(writer != NULL);
+
+    if (!writer->OutputKey("objects") || !writer->OpenList())
+      return false;
+
+    pdb::VisitSymbolsCallback callback = base::Bind(
+        &PdbStreamTally::OnFunction, base::Unretained(this),
+        base::Unretained(writer));
+
+    const pdb::DbiStream::DbiModuleVector& modules = dbi_.modules();
+    for (size_t i = 0; i < modules.size(); ++i) {
+      const ObjectSizes& sizes = object_sizes_[i];
+      if (!writer->OpenDict() ||
+          !writer->OutputKey("name") ||
+          !writer->OutputString(modules[i].module_name()) ||
+          !writer->OutputKey("library") ||
+          !writer->OutputString(modules[i].object_name()) ||
+          !writer->OutputKey("code_size") ||
+          !writer->OutputInteger(sizes.code) ||
+          !writer->OutputKey("data_size") ||
+          !writer->OutputInteger(sizes.data) ||
+          !writer->OutputKey("bss_size") ||
+          !writer->OutputInteger(sizes.bss)) {
+        return false;
+      }
+
+      if (!writer->OutputKey("functions") || !writer->OpenDict())
+        return false;
+      if (!VisitModuleSymbols(i, callback))
+        return false;
+      if (!writer->CloseDict() || !writer->CloseDict())
+        return false;
+    }
+
+    if (!writer->CloseList())
+      return false;
+
+    return true;
   }
 
-  // Retrieve the version info for the image file.
-  image_file_version_.reset(
-      FileVersionInfo::CreateFileVersionInfo(image_file_));
-  if (image_file_version_.get() == NULL) {
-    LOG(ERROR) << "Unable to get file version for image file '"
-               << image_file_.value() << "'.";
-    return false;
+ private:
+  // Returns the stream with the given index, or NULL if there is none.
+  pdb::PdbStream* GetStream(int16 index) {
+    if (index < 0 || static_cast<size_t>(index) >= pdb_file_.StreamCount())
+      return NULL;
+    return pdb_file_.GetStream(index);
   }
 
-  if (!GetImageSignature(image_file_, &image_signature_))
+  // Translates a section and offset to a relative address. Returns false for
+  // symbols that don't live in a section.
+  bool Translate(uint16 section, uint32 offset, uint32* rva) const {
+    DCHECK(rva != NULL);
+
+    // Sections are numbered from 1.
+    if (section == 0 || section > sections_.size())
+      return false;
+
+    *rva = sections_[section - 1].VirtualAddress + offset;
+    return true;
+  }
+
+  void AccrueSectionContributions() {
+    object_sizes_.resize(dbi_.modules().size());
+
+    const pdb::DbiStream::DbiSectionContribVector& contribs =
+        dbi_.section_contribs();
+    for (size_t i = 0; i < contribs.size(); ++i) {
+      const pdb::DbiSectionContrib& contrib = contribs[i];
+      if (contrib.module < 0 ||
+          static_cast<size_t>(contrib.module) >= object_sizes_.size() ||
+          contrib.size <= 0) {
+        continue;
+      }
+
+      ObjectSizes& sizes = object_sizes_[contrib.module];
+      if ((contrib.flags & IMAGE_SCN_CNT_CODE) != 0)
+        sizes.code += contrib.size;
+      else if ((contrib.flags & IMAGE_SCN_CNT_INITIALIZED_DATA) != 0)
+        sizes.data += contrib.size;
+      else if ((contrib.flags & IMAGE_SCN_CNT_UNINITIALIZED_DATA) != 0)
+        sizes.bss += contrib.size;
+    }
+  }
+
+  bool VisitModuleSymbols(size_t module_index,
+                          const pdb::VisitSymbolsCallback& callback) {
+    const pdb::DbiModuleInfo& module = dbi_.modules()[module_index];
+    const pdb::DbiModuleInfoBase& info = module.module_info_base();
+    pdb::PdbStream* stream = GetStream(info.stream);
+    if (stream == NULL || info.symbol_bytes == 0)
+      return true;
+
+    if (!stream->Seek(0) ||
+        !pdb::VisitSymbols(callback, info.symbol_bytes, true, stream)) {
+      LOG(ERROR) << "Unable to read the symbols of object file '"
+                 << module.module_name() << "'.";
+      return false;
+    }
+
+    return true;
+  }
+
+  bool OnFunctionAddress(uint16 symbol_length,
+                         uint16 symbol_type,
+                         pdb::PdbStream* stream) {
+    if (!IsProcSymbol(symbol_type))
+      return true;
+
+    cci::ProcSym32 proc = {};
+    if (!ReadProcSymbol(stream, &proc, NULL))
+      return false;
+
+    uint32 rva = 0;
+    if (Translate(proc.seg, proc.off, &rva))
+      function_addresses_.push_back(rva);
+    return true;
+  }
+
+  bool OnFunction(core::JSONFileWriter* writer,
+                  uint16 symbol_length,
+                  uint16 symbol_type,
+                  pdb::PdbStream* stream) {
+    DCHECK(writer != NULL);
+
+    if (!IsProcSymbol(symbol_type))
+      return true;
+
+    cci::ProcSym32 proc = {};
+    std::string name;
+    if (!ReadProcSymbol(stream, &proc, &name))
+      return false;
+
+    uint32 rva = 0;
+    if (!Translate(proc.seg, proc.off, &rva))
+      return true;
+
+    // Functions folded to the same address share its size.
+    std::pair<std::vector<uint32>::const_iterator,
+              std::vector<uint32>::const_iterator> range =
+        std::equal_range(function_addresses_.begin(),
+                         function_addresses_.end(),
+                         rva);
+    size_t fold_count = std::max<size_t>(1, range.second - range.first);
+
+    if (!writer->OutputKey(name) ||
+        !writer->OutputDouble(static_cast<double>(proc.len) / fold_count)) {
+      return false;
+    }
+
+    return true;
+  }
+
+  pdb::PdbFile pdb_file_;
+  pdb::DbiStream dbi_;
+  std::vector<IMAGE_SECTION_HEADER> sections_;
+
+  // The sizes contributed by each object file, indexed like dbi_.modules().
+  std::vector<ObjectSizes> object_sizes_;
+
+  // The sorted start addresses of all of the functions.
+  std::vector<uint32> function_addresses_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbStreamTally);
+};
+
+}  // namespace
+
+CodeTally::CodeTally(const base::FilePath& image_file)
+    : image_file_(image_file) {
+}
+
+bool CodeTally::TallyLines(const base::FilePath& pdb_file) {
+  base::FilePath found_pdb;
+  if (!ReadImageInfo(pdb_file, &found_pdb))
     return false;
 
   base::win::ScopedComPtr<IDiaDataSource> data_source;
@@ -293,6 +545,68 @@ bool CodeTally::GenerateJsonOutput(core::JSONFileWriter* writer) {
   return true;
 }
 
+bool CodeTally::StreamTally(const base::FilePath& pdb_file,
+                            core::JSONFileWriter* writer) {
+  DCHECK(writer != NULL);
+
+  base::FilePath found_pdb;
+  if (!ReadImageInfo(pdb_file, &found_pdb))
+    return false;
+
+  PdbStreamTally tally;
+  if (!tally.Init(found_pdb))
+    return false;
+
+  if (!writer->OpenDict())
+    return false;
+
+  if (!WriteExecutableDict(image_signature_, image_file_version_.get(), writer))
+    return false;
+
+  if (!tally.WriteObjects(writer))
+    return false;
+
+  if (!writer->CloseDict())
+    return false;
+
+  return true;
+}
+
+bool CodeTally::ReadImageInfo(const base::FilePath& pdb_file,
+                              base::FilePath* found_pdb) {
+  DCHECK(found_pdb != NULL);
+
+  *found_pdb = pdb_file;
+
+  // Start by locating the PDB file, if one was not provided.
+  if (found_pdb->empty() && !pe::FindPdbForModule(image_file_, found_pdb)) {
+    LOG(ERROR) << "Unable to find PDB file for image '"
+               << image_file_.value() << "'.";
+    return false;
+  }
+
+  // Make sure the PDB file, whether found or provided, matches the image file.
+  if (!pe::PeAndPdbAreMatched(image_file_, *found_pdb)) {
+    LOG(ERROR) << "PDB file '" << found_pdb->value() << "' does not match "
+               << " image file '" << image_file_.value() << "'.";
+    return false;
+  }
+
+  // Retrieve the version info for the image file.
+  image_file_version_.reset(
+      FileVersionInfo::CreateFileVersionInfo(image_file_));
+  if (image_file_version_.get() == NULL) {
+    LOG(ERROR) << "Unable to get file version for image file '"
+               << image_file_.value() << "'.";
+    return false;
+  }
+
+  if (!GetImageSignature(image_file_, &image_signature_))
+    return false;
+
+  return true;
+}
+
 CodeTally::SourceFileInfo* CodeTally::FindOrCreateSourceFileInfo(
     const wchar_t* source_file) {
   DCHECK(source_file != NULL);
@@ -113,6 +113,41 @@ class JSONFileWriter;
 //   source line contribution.
 // - On the second pass we know how often each code byte is shared, and so
 //   we can accrue the correct tally.
+//
+// For size tracking, where the line-level detail isn't needed, StreamTally
+// produces a coarser tally much faster. It reads the DBI stream and the
+// symbol stream of each object file straight from the PDB, rather than going
+// through DIA, and writes the output for each object file as soon as it has
+// been read, rather than building the whole tally in memory. Its output looks
+// like this:
+//
+// --- output ---
+//
+// {
+//   "executable": {
+//     ...  // As above.
+//   },
+//   "objects": [
+//     {
+//       // The object file's name, and the library it was linked from, if
+//       // any. An object file name may appear more than once.
+//       "name": "foo.obj",
+//       "library": "foo.lib",
+//       // The bytes contributed to code, initialized data and uninitialized
+//       // data sections, as recorded by the section contributions.
+//       "code_size": 31,
+//       "data_size": 8,
+//       "bss_size": 0,
+//       // The size of each function. Functions folded by the linker share
+//       // their size equally.
+//       "functions": {
+//         "function": 17.0,
+//         "inline_function": 14.0,
+//       },
+//     },
+//   ]
+// }
+// --- output ---
 class CodeTally {
  public:
   // Creates a code tally instance for the given image file.
@@ -125,6 +160,15 @@ class CodeTally {
   // Generates a JSON file from the internal state.
   bool GenerateJsonOutput(core::JSONFileWriter* writer);
 
+  // Reads the PDB file's streams and writes the coarse, per object file
+  // tally to @p writer as it goes. This doesn't use or update the state of
+  // TallyLines.
+  // @param pdb_file The PDB file of the image. If empty, it is searched for.
+  // @param writer The writer that receives the tally.
+  // @returns true on success, false otherwise.
+  bool StreamTally(const base::FilePath& pdb_file,
+                   core::JSONFileWriter* writer);
+
  private:
   struct LineInfo;
   struct FunctionInfo;
@@ -138,6 +182,14 @@ class CodeTally {
       FunctionInfoAddressSpace;
   typedef FunctionInfoAddressSpace::Range FunctionRange;
 
+  // Locates and validates the PDB file, and reads the image's version and
+  // signature.
+  // @param pdb_file The PDB file of the image. If empty, it is searched for.
+  // @param found_pdb Receives the path of the PDB file.
+  // @returns true on success, false otherwise.
+  bool ReadImageInfo(const base::FilePath& pdb_file,
+                     base::FilePath* found_pdb);
+
   SourceFileInfo* FindOrCreateSourceFileInfo(const wchar_t* source_file);
   ObjectFileInfo* FindOrCreateObjectFileInfo(const wchar_t* object_file);
 
@@ -45,7 +45,12 @@ const char kUsageFormatStr[] =
     "      Optionally provide the name or path to the output file. If not\n"
     "      provided, output will be to standard out.\n"
     "  --pretty-print\n"
-    "      If provided, the JSON output will be pretty printed.\n";
+    "      If provided, the JSON output will be pretty printed.\n"
+    "  --streaming\n"
+    "      If provided, the tally is read straight from the PDB streams and\n"
+    "      written out one object file at a time. This is much faster, but\n"
+    "      only tallies the section contributions and function sizes of each\n"
+    "      object file, without the source line breakdown.\n";
 
 }  // namespace
 
@@ -82,6 +87,9 @@ bool CodeTallyApp::ParseCommandLine(const CommandLine* cmd_line) {
   // Check the pretty print flag.
   pretty_print_ = cmd_line->HasSwitch("pretty-print");
 
+  // Check the streaming flag.
+  streaming_ = cmd_line->HasSwitch("streaming");
+
   return true;
 }
 
@@ -106,13 +114,21 @@ int CodeTallyApp::Run() {
     output_file = scoped_file.get();
   }
 
-  // Do the tally.
   CodeTally tally(input_image_);
+  core::JSONFileWriter writer(output_file, pretty_print_);
+
+  // The streaming tally writes its output as it goes.
+  if (streaming_) {
+    if (!tally.StreamTally(input_pdb_, &writer))
+      return 1;
+    return 0;
+  }
+
+  // Do the tally.
   if (!tally.TallyLines(input_pdb_))
     return 1;
 
   // And write the output file.
-  core::JSONFileWriter writer(output_file, pretty_print_);
   if (!tally.GenerateJsonOutput(&writer))
     return 1;
 
@@ -67,13 +67,24 @@
 // made the cut. In this case, a match will be made based on identical code
 // content. This situation is handled regardless of the feature that is
 // given priority.
+//
+// Building the feature indices dominates the running time on large images, so
+// it is done in two passes. The blocks are first bucketed on a cheap key (the
+// block hash or the block name) and only blocks that share a key are then
+// compared in full, to split apart any hash collisions. The hashing and the
+// per-bucket comparisons are independent of each other, and are spread across
+// a pool of worker threads.
 
 #include "syzygy/experimental/compare/compare.h"
 
 #include <algorithm>
 
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/containers/hash_tables.h"
 #include "base/logging.h"
 #include "base/md5.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/block_hash.h"
 #include "syzygy/common/comparable.h"
 #include "syzygy/experimental/compare/block_compare.h"
@@ -107,7 +118,7 @@ enum BlockFeatures {
 // Every index needs to store some metadata that is tied to each block. We
 // use a single metadata store to reduce overhead.
 struct BlockMetadata {
-  BlockMetadata() : block(NULL) {
+  BlockMetadata() : block(NULL), block_graph_index(0) {
     for (size_t i = 0; i < kFeatureCount; ++i) {
       feature_index[i] = kInvalidIndex;
     }
@@ -115,6 +126,9 @@ struct BlockMetadata {
 
   const BlockGraph::Block* block;
 
+  // The block graph that the block belongs to (0 or 1).
+  size_t block_graph_index;
+
   // Each FeatureIndex needs to be able to map from a block to that blocks index
   // in the blocks sorted by that feature.
   size_t feature_index[kFeatureCount];
@@ -129,6 +143,71 @@ struct BlockMetadata {
   std::string block_name;
 };
 
+// There is a single instance of block metadata shared across all FeatureIndex
+// objects. The values are never moved once inserted, so the index entries can
+// hold on to pointers to them.
+typedef base::hash_map<const BlockGraph::Block*, BlockMetadata>
+    BlockMetadataMap;
+
+// Runs a task over the indices [0, count) on a pool of worker threads. Each
+// worker takes the next index that hasn't been processed yet, until they're
+// all done or one of them fails.
+class ParallelTaskRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  typedef base::Callback<bool(size_t)> Task;
+
+  ParallelTaskRunner(const Task& task, size_t count)
+      : task_(task), count_(count), next_index_(0), failed_(0) {
+  }
+
+  // Runs @p task over all the indices, using at most @p jobs threads.
+  // @returns true iff the task succeeded for all of them.
+  static bool RunTask(const Task& task, size_t count, size_t jobs) {
+    ParallelTaskRunner runner(task, count);
+    size_t num_threads = std::min(jobs, count);
+    if (num_threads <= 1) {
+      runner.Run();
+    } else {
+      base::DelegateSimpleThreadPool pool("ParallelTaskRunner", num_threads);
+      pool.Start();
+      pool.AddWork(&runner, num_threads);
+      pool.JoinAll();
+    }
+    return runner.succeeded();
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    while (base::subtle::NoBarrier_Load(&failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_index_, 1));
+      if (index > count_)
+        return;
+      if (!task_.Run(index - 1))
+        base::subtle::NoBarrier_Store(&failed_, 1);
+    }
+  }
+  // @}
+
+  // @returns true iff the task succeeded for all the indices.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+ private:
+  Task task_;
+  size_t count_;
+
+  // One past the next index to process.
+  base::subtle::Atomic32 next_index_;
+
+  // Set to 1 as soon as the task fails for an index.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelTaskRunner);
+};
+
 // The virtual base-class for a block feature.
 class BlockFeature {
  public:
@@ -137,12 +216,26 @@ class BlockFeature {
     DCHECK_GT(static_cast<size_t>(kFeatureCount), id);
   }
 
-  // Initializes the metadata for this feature and the given @p block.
+  // Initializes the metadata for this feature and the given @p block. This
+  // may be called concurrently for distinct blocks, so it must only touch
+  // the metadata that is particular to this feature.
   virtual bool InitMetadata(BlockMetadata* metadata) const = 0;
 
-  // Compares two blocks, returning their relative sort order (-1, 0, 1).
+  // Compares the cheap keys of two blocks, returning their relative sort
+  // order (-1, 0, 1). Blocks are first bucketed on this.
+  virtual int CompareKeys(const BlockMetadata& metadata0,
+                          const BlockMetadata& metadata1) const = 0;
+
+  // Compares two blocks, returning their relative sort order (-1, 0, 1). This
+  // must refine CompareKeys, and defaults to it.
   virtual int Compare(const BlockMetadata& metadata0,
-                      const BlockMetadata& metadata1) const = 0;
+                      const BlockMetadata& metadata1) const {
+    return CompareKeys(metadata0, metadata1);
+  }
+
+  // Returns true if Compare is finer than CompareKeys, in which case blocks
+  // that share a key need to be compared further.
+  virtual bool HasRefinement() const { return false; }
 
   // Returns the id associated with this feature.
   size_t id() const { return id_; }
@@ -163,10 +256,17 @@ class FeatureIndex {
   static const BlockGraph::BlockAttributes kIgnoredAttributes =
     BlockGraph::PADDING_BLOCK;
 
-  // Initializes this feature index over the provided block graphs.
+  // Initializes this feature index over the blocks in @p block_metadata,
+  // using up to @p jobs threads.
   FeatureIndex(const BlockFeature& block_feature,
-               const BlockGraph& block_graph0,
-               const BlockGraph& block_graph1);
+               size_t jobs,
+               BlockMetadataMap* block_metadata);
+
+  // Populates @p block_metadata with the blocks from the given block graphs
+  // that take part in the mapping.
+  static void AddBlocks(const BlockGraph& block_graph0,
+                        const BlockGraph& block_graph1,
+                        BlockMetadataMap* block_metadata);
 
   // This returns the number of unique features in the graph. (The number of
   // unique buckets the blocks were able to be split up into.)
@@ -274,16 +374,10 @@ class FeatureIndex {
     }
   }
 
-  // Returns the metadata associated with a given block. This is used for
-  // debugging purposes.
-  static const BlockMetadata* GetBlockMetadata(const BlockGraph::Block* block) {
-    BlockMetadataMap::const_iterator it = block_metadata_.find(block);
-    if (it == block_metadata_.end())
-      return NULL;
-    return &it->second;
-  }
-
  private:
+  typedef std::pair<size_t, size_t> BlockInfoRange;
+  typedef std::vector<BlockInfoRange> BlockInfoRanges;
+
   // Returns the index of the given block in this feature.
   size_t GetBlockIndex(const BlockGraph::Block* block) const {
     BlockMetadataMap::const_iterator it = block_metadata_.find(block);
@@ -293,41 +387,26 @@ class FeatureIndex {
     return index;
   }
 
-  // Populates block_infos_ and block_metadata_ with the blocks from the
-  // given BlockGraph.
-  bool AddBlocks(const BlockFeature& block_feature,
-                 size_t block_graph_index,
-                 const BlockGraph& block_graph) {
-    DCHECK(block_graph_index == 0 || block_graph_index == 1);
-
-    BlockGraph::BlockMap::const_iterator block_it =
-        block_graph.blocks().begin();
-    for (; block_it != block_graph.blocks().end(); ++block_it) {
-      const BlockGraph::Block* block = &block_it->second;
-
-      if (block->attributes() & kIgnoredAttributes)
-        continue;
-
-      // Ensure that an entry exists in block_metadata_.
-      BlockMetadataMap::iterator metadata_it = block_metadata_.find(block);
-      if (metadata_it == block_metadata_.end()) {
-        BlockMetadata metadata;
-        metadata.block = block;
-        metadata_it = block_metadata_.insert(
-            std::make_pair(block, metadata)).first;
-      }
-
-      // Initialize any metadata for this feature.
-      if (!block_feature.InitMetadata(&metadata_it->second))
-        return false;
-
-      // Add this block to block_infos_.
-      BlockInfo block_info(&metadata_it->second,
-                           block_graph_index,
-                           block_feature.id());
-      block_infos_.push_back(block_info);
-    }
+  // Initializes the metadata of the block at @p index in block_infos_. This
+  // is run on the worker threads.
+  bool InitBlockMetadata(const BlockFeature* block_feature, size_t index) {
+    DCHECK(block_feature != NULL);
+    DCHECK_GT(block_infos_.size(), index);
+    return block_feature->InitMetadata(block_infos_[index].metadata);
+  }
 
+  // Fully sorts the range of block_infos_ at @p index in @p ranges, the
+  // blocks of which all share a key. This is run on the worker threads.
+  bool SortBlockInfoRange(const BlockFeature* block_feature,
+                          const BlockInfoRanges* ranges,
+                          size_t index) {
+    DCHECK(block_feature != NULL);
+    DCHECK(ranges != NULL);
+    DCHECK_GT(ranges->size(), index);
+    const BlockInfoRange& range = (*ranges)[index];
+    std::sort(block_infos_.begin() + range.first,
+              block_infos_.begin() + range.second,
+              BlockInfoSortFunctor(*block_feature, true));
     return true;
   }
 
@@ -386,20 +465,26 @@ class FeatureIndex {
   };
   std::vector<BlockInfo> block_infos_;
 
-  // This is used as a sort functor for BlockInfos.
+  // This is used as a sort functor for BlockInfos. It either compares the
+  // feature keys only, or the feature in full.
   class BlockInfoSortFunctor {
    public:
-    explicit BlockInfoSortFunctor(const BlockFeature& block_feature)
-        : block_feature(block_feature) {
+    BlockInfoSortFunctor(const BlockFeature& block_feature, bool full)
+        : block_feature(block_feature), full(full) {
     }
 
     bool operator()(const BlockInfo& block_info0,
                     const BlockInfo& block_info1) {
-      return block_feature.Compare(*block_info0.metadata,
-                                   *block_info1.metadata) < 0;
+      if (full) {
+        return block_feature.Compare(*block_info0.metadata,
+                                     *block_info1.metadata) < 0;
+      }
+      return block_feature.CompareKeys(*block_info0.metadata,
+                                       *block_info1.metadata) < 0;
     }
    private:
     const BlockFeature& block_feature;
+    bool full;
   };
 
   // This stores information regarding the per unique feature in the index.
@@ -420,10 +505,8 @@ class FeatureIndex {
   };
   std::vector<FeatureInfo> feature_infos_;
 
-  // There is a sinlge instance of block metadata shared across all
-  // FeatureIndex objects.
-  typedef std::map<const BlockGraph::Block*, BlockMetadata> BlockMetadataMap;
-  static BlockMetadataMap block_metadata_;
+  // The metadata shared with the other FeatureIndex objects.
+  const BlockMetadataMap& block_metadata_;
 
   // This is copied from the BlockFeature provided in the constructor.
   size_t feature_id_;
@@ -431,29 +514,90 @@ class FeatureIndex {
   DISALLOW_COPY_AND_ASSIGN(FeatureIndex);
 };
 
-FeatureIndex::BlockMetadataMap FeatureIndex::block_metadata_;
+void FeatureIndex::AddBlocks(const BlockGraph& block_graph0,
+                             const BlockGraph& block_graph1,
+                             BlockMetadataMap* block_metadata) {
+  DCHECK(block_metadata != NULL);
+
+  const BlockGraph* block_graphs[] = { &block_graph0, &block_graph1 };
+  for (size_t i = 0; i < arraysize(block_graphs); ++i) {
+    BlockGraph::BlockMap::const_iterator block_it =
+        block_graphs[i]->blocks().begin();
+    for (; block_it != block_graphs[i]->blocks().end(); ++block_it) {
+      const BlockGraph::Block* block = &block_it->second;
+      if (block->attributes() & kIgnoredAttributes)
+        continue;
+
+      BlockMetadata& metadata = (*block_metadata)[block];
+      metadata.block = block;
+      metadata.block_graph_index = i;
+    }
+  }
+}
 
 FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
-                           const BlockGraph& block_graph0,
-                           const BlockGraph& block_graph1)
-    : feature_id_(block_feature.id()) {
+                           size_t jobs,
+                           BlockMetadataMap* block_metadata)
+    : block_metadata_(*block_metadata),
+      feature_id_(block_feature.id()) {
+  DCHECK(block_metadata != NULL);
+
   // Nothing to do if the block graphs are both empty!
-  if (block_graph0.blocks().empty() && block_graph1.blocks().empty())
+  if (block_metadata->empty())
     return;
 
-  // Add the blocks to block_infos_, and initialize metadata.
-  block_infos_.reserve(block_graph0.blocks().size() +
-      block_graph1.blocks().size());
-  if (!AddBlocks(block_feature, 0, block_graph0))
-    return;
-  if (!AddBlocks(block_feature, 1, block_graph1))
+  // Add the blocks to block_infos_.
+  block_infos_.reserve(block_metadata->size());
+  BlockMetadataMap::iterator metadata_it = block_metadata->begin();
+  for (; metadata_it != block_metadata->end(); ++metadata_it) {
+    BlockInfo block_info(&metadata_it->second,
+                         metadata_it->second.block_graph_index,
+                         block_feature.id());
+    block_infos_.push_back(block_info);
+  }
+
+  // Initialize the metadata for this feature.
+  if (!ParallelTaskRunner::RunTask(
+          base::Bind(&FeatureIndex::InitBlockMetadata,
+                     base::Unretained(this),
+                     &block_feature),
+          block_infos_.size(),
+          jobs)) {
+    LOG(ERROR) << "Failed to initialize metadata for feature " << feature_id_
+               << ".";
+    block_infos_.clear();
     return;
+  }
 
-  // Sort block_infos_.
-  BlockInfoSortFunctor block_info_sort(block_feature);
+  // Bucket block_infos_ on the feature keys.
   std::sort(block_infos_.begin(),
             block_infos_.end(),
-            block_info_sort);
+            BlockInfoSortFunctor(block_feature, false));
+
+  // Finish sorting the blocks that share a key. These buckets are
+  // independent, so they are sorted in parallel.
+  if (block_feature.HasRefinement()) {
+    BlockInfoRanges ranges;
+    size_t start = 0;
+    for (size_t i = 1; i <= block_infos_.size(); ++i) {
+      if (i < block_infos_.size() &&
+          block_feature.CompareKeys(*block_infos_[start].metadata,
+                                    *block_infos_[i].metadata) == 0) {
+        continue;
+      }
+      if (i - start > 1)
+        ranges.push_back(std::make_pair(start, i));
+      start = i;
+    }
+
+    ParallelTaskRunner::RunTask(
+        base::Bind(&FeatureIndex::SortBlockInfoRange,
+                   base::Unretained(this),
+                   &block_feature,
+                   &ranges),
+        ranges.size(),
+        jobs);
+  }
 
   // Assign unique feature IDs, and build out the FeatureInfo array.
   // Simultaneously, fill out BlockMetadata::feature_index.
@@ -461,6 +605,7 @@ FeatureIndex::FeatureIndex(const BlockFeature& block_feature,
   block_infos_[0].feature_bucket = feature_bucket;
   block_infos_[0].metadata->feature_index[feature_id_] = 0;
   feature_infos_.resize(1);
+  feature_infos_.back().block_count[block_infos_[0].block_graph_index]++;
   size_t i = 1;
   for (; i < block_infos_.size(); ++i) {
     int c = block_feature.Compare(*block_infos_[i - 1].metadata,
@@ -512,14 +657,22 @@ class BlockHashFeature : public BlockFeature {
     return true;
   }
 
+  virtual int CompareKeys(const BlockMetadata& metadata0,
+                          const BlockMetadata& metadata1) const {
+    return metadata0.block_hash.Compare(metadata1.block_hash);
+  }
+
+  // Blocks with the same hash are compared in full to detect collisions.
   virtual int Compare(const BlockMetadata& metadata0,
                       const BlockMetadata& metadata1) const {
-    int c = metadata0.block_hash.Compare(metadata1.block_hash);
+    int c = CompareKeys(metadata0, metadata1);
     if (c != 0)
       return c;
 
     return BlockCompare(metadata0.block, metadata1.block);
   }
+
+  virtual bool HasRefinement() const { return true; }
 };
 
 class BlockNameFeature : public BlockFeature {
@@ -535,7 +688,7 @@ class BlockNameFeature : public BlockFeature {
 
   // Compare block names, but using the name in the metadata struct if there
   // is one.
-  virtual int Compare(const BlockMetadata& metadata0,
+  virtual int CompareKeys(const BlockMetadata& metadata0,
                       const BlockMetadata& metadata1) const {
     base::StringPiece s0 = metadata0.block->name();
     if (!metadata0.block_name.empty())
@@ -587,13 +740,27 @@ class BlockGraphMapper {
  public:
   // Builds the mapping between the two given block graphs, and if provided,
   // populates the vector of unmapped blocks left in each block graph.
+  // The feature indices are built using up to @p jobs threads.
   bool BuildMapping(const BlockGraph& bg0,
                     const BlockGraph& bg1,
+                    size_t jobs,
                     BlockGraphMapping* mapping,
                     ConstBlockVector* unmapped0,
                     ConstBlockVector* unmapped1);
 
  private:
+  // Returns the metadata associated with a given block. This is used for
+  // debugging purposes.
+  const BlockMetadata* GetBlockMetadata(const BlockGraph::Block* block) const {
+    BlockMetadataMap::const_iterator it = block_metadata_.find(block);
+    if (it == block_metadata_.end())
+      return NULL;
+    return &it->second;
+  }
+
+  // The metadata of the blocks being mapped, shared by the feature indices.
+  BlockMetadataMap block_metadata_;
+
   // Internally, most of the work is done by the FeatureIndex objects.
   scoped_ptr<FeatureIndex> feature_indices_[kFeatureCount];
 
@@ -637,6 +804,7 @@ class BlockGraphMapper {
 
 bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
                                     const BlockGraph& bg1,
+                                    size_t jobs,
                                     BlockGraphMapping* mapping,
                                     ConstBlockVector* unmapped0,
                                     ConstBlockVector* unmapped1) {
@@ -645,14 +813,13 @@ bool BlockGraphMapper::BuildMapping(const BlockGraph& bg0,
   mapping_->clear();
 
   // Build the feature indices.
+  FeatureIndex::AddBlocks(bg0, bg1, &block_metadata_);
   BlockHashFeature hash_feature;
   feature_indices_[kHashFeature].reset(
-      new FeatureIndex(hash_feature, bg0, bg1));
-#ifdef USE_BLOCK_NAME_FEATURE
+      new FeatureIndex(hash_feature, jobs, &block_metadata_));
   BlockNameFeature name_feature;
   feature_indices_[kNameFeature].reset(
-      new FeatureIndex(name_feature, bg0, bg1));
-#endif
+      new FeatureIndex(name_feature, jobs, &block_metadata_));
 
   // Iterate through each index.
   for (size_t i = 0; i < kFeatureCount; ++i) {
@@ -712,9 +879,9 @@ bool BlockGraphMapper::ScheduleMapping(const BlockGraph::Block* block0,
       // In this case, block0 was already mapped to another block, block2.
       // block2 is in the same blockgraph as block1.
       const BlockGraph::Block* block2 = it->second;
-      const BlockMetadata* meta0 = FeatureIndex::GetBlockMetadata(block0);
-      const BlockMetadata* meta1 = FeatureIndex::GetBlockMetadata(block1);
-      const BlockMetadata* meta2 = FeatureIndex::GetBlockMetadata(block2);
+      const BlockMetadata* meta0 = GetBlockMetadata(block0);
+      const BlockMetadata* meta1 = GetBlockMetadata(block1);
+      const BlockMetadata* meta2 = GetBlockMetadata(block2);
     }
 #endif
 
@@ -731,9 +898,9 @@ bool BlockGraphMapper::ScheduleMapping(const BlockGraph::Block* block0,
       // In this case, block1 was already mapped to another block, block2.
       // block2 is in the same blockgraph as block0.
       const BlockGraph::Block* block2 = it->second;
-      const BlockMetadata* meta0 = FeatureIndex::GetBlockMetadata(block0);
-      const BlockMetadata* meta1 = FeatureIndex::GetBlockMetadata(block1);
-      const BlockMetadata* meta2 = FeatureIndex::GetBlockMetadata(block2);
+      const BlockMetadata* meta0 = GetBlockMetadata(block0);
+      const BlockMetadata* meta1 = GetBlockMetadata(block1);
+      const BlockMetadata* meta2 = GetBlockMetadata(block2);
     }
 #endif
 
@@ -898,11 +1065,21 @@ bool BuildBlockGraphMapping(const BlockGraph& bg1,
                             BlockGraphMapping* mapping,
                             ConstBlockVector* unmapped1,
                             ConstBlockVector* unmapped2) {
+  return BuildBlockGraphMapping(bg1, bg2, 1, mapping, unmapped1, unmapped2);
+}
+
+bool BuildBlockGraphMapping(const BlockGraph& bg1,
+                            const BlockGraph& bg2,
+                            size_t jobs,
+                            BlockGraphMapping* mapping,
+                            ConstBlockVector* unmapped1,
+                            ConstBlockVector* unmapped2) {
+  DCHECK_LT(0u, jobs);
   DCHECK(mapping != NULL);
 
   // Pass the real work off to the BlockGraphMapper defined above.
   BlockGraphMapper mapper;
-  return mapper.BuildMapping(bg1, bg2, mapping, unmapped1, unmapped2);
+  return mapper.BuildMapping(bg1, bg2, jobs, mapping, unmapped1, unmapped2);
 }
 
 bool ReverseBlockGraphMapping(const BlockGraphMapping& mapping,
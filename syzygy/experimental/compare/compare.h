@@ -40,6 +40,15 @@ bool BuildBlockGraphMapping(const block_graph::BlockGraph& bg1,
                             block_graph::ConstBlockVector* unmapped1,
                             block_graph::ConstBlockVector* unmapped2);
 
+// As above, but spreads the hashing and the comparison of the blocks across
+// up to @p jobs threads.
+bool BuildBlockGraphMapping(const block_graph::BlockGraph& bg1,
+                            const block_graph::BlockGraph& bg2,
+                            size_t jobs,
+                            BlockGraphMapping* mapping,
+                            block_graph::ConstBlockVector* unmapped1,
+                            block_graph::ConstBlockVector* unmapped2);
+
 // Reverses a block mapping. This can not be done in-place, so
 // @p reverse_mapping and @p mapping must not be the same object.
 bool ReverseBlockGraphMapping(const BlockGraphMapping& mapping,
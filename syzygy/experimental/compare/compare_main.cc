@@ -21,18 +21,23 @@
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
+#include "base/sys_info.h"
 #include "base/time/time.h"
 #include "syzygy/core/serialization.h"
+#include "syzygy/experimental/compare/block_compare.h"
 #include "syzygy/experimental/compare/compare.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/serialization.h"
+#include "syzygy/reorder/reorderer.h"
 #include "syzygy/version/syzygy_version.h"
 
 using block_graph::BlockGraph;
 using block_graph::ConstBlockVector;
 using experimental::BlockGraphMapping;
+using reorder::Reorderer;
 
 namespace {
 
@@ -48,7 +53,15 @@ int Usage(char** argv, const char* message) {
       "\n"
       "Required parameters\n"
       "  --from=<bg file>\n"
-      "  --to=<bg file>\n";
+      "  --to=<bg file>\n"
+      "Optional parameters\n"
+      "  --jobs=<count>\n"
+      "      The number of threads to use when matching blocks. Defaults to\n"
+      "      the number of processors.\n"
+      "  --input-order=<order file>\n"
+      "  --output-order=<order file>\n"
+      "      Carries an order generated for the 'from' image over to the\n"
+      "      'to' image. Blocks that can't be matched are dropped.\n";
 
   return 1;
 }
@@ -164,6 +177,47 @@ void GetMappingStats(const BlockGraphMapping& mapping,
   }
 }
 
+// Carries @p order, which is given over the blocks of the 'from' image, over
+// to the matching blocks of the 'to' image. Blocks that aren't in @p mapping
+// are dropped from the order. The basic-block offsets are only kept for
+// blocks that are identical across the images, as they are meaningless
+// otherwise; such blocks are placed in their entirety.
+void TranslateOrder(const BlockGraphMapping& mapping,
+                    Reorderer::Order* order) {
+  DCHECK(order != NULL);
+
+  size_t dropped_blocks = 0;
+  size_t dropped_offsets = 0;
+  for (size_t i = 0; i < order->sections.size(); ++i) {
+    Reorderer::Order::BlockSpecVector& blocks = order->sections[i].blocks;
+    Reorderer::Order::BlockSpecVector translated_blocks;
+    translated_blocks.reserve(blocks.size());
+    for (size_t j = 0; j < blocks.size(); ++j) {
+      BlockGraphMapping::const_iterator it = mapping.find(blocks[j].block);
+      if (it == mapping.end()) {
+        ++dropped_blocks;
+        continue;
+      }
+
+      translated_blocks.push_back(Reorderer::Order::BlockSpec(it->second));
+      if (!blocks[j].basic_block_offsets.empty()) {
+        if (experimental::BlockCompare(it->first, it->second) == 0) {
+          translated_blocks.back().basic_block_offsets.swap(
+              blocks[j].basic_block_offsets);
+        } else {
+          ++dropped_offsets;
+        }
+      }
+    }
+    blocks.swap(translated_blocks);
+  }
+
+  LOG(INFO) << "Dropped " << dropped_blocks << " unmapped blocks from the "
+            << "order.";
+  LOG(INFO) << "Dropped the basic-block offsets of " << dropped_offsets
+            << " modified blocks.";
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -185,6 +239,22 @@ int main(int argc, char** argv) {
   if (path_from.empty() || path_to.empty())
     return Usage(argv, "Must specify '--from' and '--to' parameters!");
 
+  size_t jobs = base::SysInfo::NumberOfProcessors();
+  if (cmd_line->HasSwitch("jobs")) {
+    std::string jobs_str = cmd_line->GetSwitchValueASCII("jobs");
+    unsigned parsed_jobs = 0;
+    if (!base::StringToUint(jobs_str, &parsed_jobs) || parsed_jobs == 0)
+      return Usage(argv, "Invalid value for '--jobs'!");
+    jobs = parsed_jobs;
+  }
+
+  base::FilePath input_order = cmd_line->GetSwitchValuePath("input-order");
+  base::FilePath output_order = cmd_line->GetSwitchValuePath("output-order");
+  if (input_order.empty() != output_order.empty()) {
+    return Usage(argv,
+        "Must specify both '--input-order' and '--output-order' or neither!");
+  }
+
   LOG(INFO) << "Toolchain version: "
             << version::kSyzygyVersion.GetVersionString() << ".";
 
@@ -214,6 +284,7 @@ int main(int argc, char** argv) {
   ConstBlockVector unmapped1, unmapped2;
   if (!experimental::BuildBlockGraphMapping(block_graph_from,
                                             block_graph_to,
+                                            jobs,
                                             &mapping,
                                             &unmapped1,
                                             &unmapped2)) {
@@ -241,5 +312,24 @@ int main(int argc, char** argv) {
   printf("\nMAPPING AS PORTION OF TO\n");
   stats_mapping.Dump(stats_to);
 
+  if (!input_order.empty()) {
+    LOG(INFO) << "Carrying \"" << input_order.value() << "\" over to \""
+              << output_order.value() << "\".";
+    Reorderer::Order order;
+    if (!order.LoadFromJSON(pe_file_from, image_layout_from, input_order)) {
+      LOG(ERROR) << "Failed to load order file \"" << input_order.value()
+                 << "\".";
+      return 1;
+    }
+
+    TranslateOrder(mapping, &order);
+
+    if (!order.SerializeToJSON(pe_file_to, output_order, false)) {
+      LOG(ERROR) << "Failed to write order file \"" << output_order.value()
+                 << "\".";
+      return 1;
+    }
+  }
+
   return 0;
 }
@@ -26,6 +26,8 @@
         '<(src)/syzygy/experimental/pdb_dumper/pdb_dumper.gyp:*',
         '<(src)/syzygy/experimental/pdb_writer/pdb_writer.gyp:*',
         '<(src)/syzygy/experimental/timed_decomposer/timed_decomposer.gyp:*',
+        '<(src)/syzygy/experimental/timed_relinker/timed_relinker.gyp:*',
+        '<(src)/syzygy/experimental/trace_stress/trace_stress.gyp:*',
       ],
     },
   ]
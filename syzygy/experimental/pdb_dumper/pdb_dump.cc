@@ -24,12 +24,14 @@
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/files/file_path.h"
 #include "syzygy/experimental/pdb_dumper/pdb_dump_util.h"
 #include "syzygy/experimental/pdb_dumper/pdb_module_info_stream_dumper.h"
+#include "syzygy/experimental/pdb_dumper/pdb_query.h"
 #include "syzygy/experimental/pdb_dumper/pdb_symbol_record_dumper.h"
 #include "syzygy/experimental/pdb_dumper/pdb_type_info_stream_dumper.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
@@ -201,7 +203,33 @@ const char kUsage[] =
     "       that this can take a long time as there may be many of these\n"
     "       streams.\n"
     "    --explode-streams if provided, each PDB file's streams will be\n"
-    "       exploded into a directory named '<PDB file>.streams'\n";
+    "       exploded into a directory named '<PDB file>.streams'\n"
+    "\n"
+    "  Query Options:\n"
+    "    When any of these is provided only the matching items are dumped,\n"
+    "    using the indices of the PDB file to read as little of it as\n"
+    "    possible. This makes it practical to inspect large PDB files.\n"
+    "    --module=NAME dumps the module info streams of the modules with the\n"
+    "       given name or base name.\n"
+    "    --symbol=NAME dumps the global and public symbol records with the\n"
+    "       given name.\n"
+    "    --type=ID dumps the type info record with the given ID. Hexadecimal\n"
+    "       IDs are prefixed with '0x'.\n";
+
+// Parses a type ID, which is either decimal or '0x'-prefixed hexadecimal.
+bool ParseTypeId(const std::string& value, uint32* type_id) {
+  DCHECK(type_id != NULL);
+  int parsed = 0;
+  bool success = false;
+  if (StartsWithASCII(value, "0x", false))
+    success = base::HexStringToInt(value.substr(2), &parsed);
+  else
+    success = base::StringToInt(value, &parsed);
+  if (!success)
+    return false;
+  *type_id = static_cast<uint32>(parsed);
+  return true;
+}
 
 }  // namespace
 
@@ -210,7 +238,9 @@ PdbDumpApp::PdbDumpApp()
       explode_streams_(false),
       dump_symbol_record_(false),
       dump_type_info_(false),
-      dump_modules_(false) {
+      dump_modules_(false),
+      has_type_query_(false),
+      type_query_(0) {
 }
 
 bool PdbDumpApp::ParseCommandLine(const CommandLine* command_line) {
@@ -221,6 +251,14 @@ bool PdbDumpApp::ParseCommandLine(const CommandLine* command_line) {
   dump_type_info_ = command_line->HasSwitch("dump-type-info");
   dump_modules_ = command_line->HasSwitch("dump-modules");
 
+  module_query_ = command_line->GetSwitchValueASCII("module");
+  symbol_query_ = command_line->GetSwitchValueASCII("symbol");
+  if (command_line->HasSwitch("type")) {
+    if (!ParseTypeId(command_line->GetSwitchValueASCII("type"), &type_query_))
+      return Usage("Invalid type ID.");
+    has_type_query_ = true;
+  }
+
   CommandLine::StringVector args = command_line->GetArgs();
   if (args.empty())
     return Usage("You must provide at least one input file.");
@@ -238,6 +276,7 @@ int PdbDumpApp::Run() {
     VLOG(1) << "File \"" << input_pdb_path.value() << "\"";
 
     pdb::PdbReader reader;
+    reader.set_memory_mapped(true);
     pdb::PdbFile pdb_file;
     if (!reader.Read(input_pdb_path, &pdb_file)) {
       LOG(ERROR) << "Failed to read PDB file " << input_pdb_path.value() << ".";
@@ -247,7 +286,17 @@ int PdbDumpApp::Run() {
     pdb::PdbInfoHeader70 info = {};
     NameStreamMap name_streams;
     pdb::PdbStream* stream = pdb_file.GetStream(pdb::kPdbHeaderInfoStream);
-    if (stream != NULL && ReadHeaderInfoStream(stream, &info, &name_streams)) {
+    bool has_info_stream = stream != NULL &&
+        ReadHeaderInfoStream(stream, &info, &name_streams);
+
+    // In query mode nothing else is dumped.
+    if (HasQuery()) {
+      if (!DumpQueries(pdb_file, name_streams))
+        return 1;
+      continue;
+    }
+
+    if (has_info_stream) {
       DumpInfoStream(info, name_streams);
     } else {
       LOG(ERROR) << "No header info stream.";
@@ -436,4 +485,151 @@ void PdbDumpApp::DumpDbiStream(const DbiStream& dbi_stream) {
   DumpDbiHeaders(dbi_stream);
 }
 
+bool PdbDumpApp::HasQuery() const {
+  return !module_query_.empty() || !symbol_query_.empty() || has_type_query_;
+}
+
+bool PdbDumpApp::DumpQueries(const PdbFile& pdb_file,
+                             const NameStreamMap& name_streams) {
+  // The symbol and the module queries both need the dbi stream, which is
+  // small compared to the streams it refers to.
+  DbiStream dbi_stream;
+  if (!module_query_.empty() || !symbol_query_.empty()) {
+    PdbStream* stream = pdb_file.GetStream(pdb::kDbiStream);
+    if (stream == NULL || !dbi_stream.Read(stream)) {
+      LOG(ERROR) << "No Dbi stream.";
+      return false;
+    }
+  }
+
+  if (!module_query_.empty() &&
+      !DumpModuleQuery(pdb_file, name_streams, dbi_stream)) {
+    return false;
+  }
+  if (!symbol_query_.empty() && !DumpSymbolQuery(pdb_file, dbi_stream))
+    return false;
+  if (has_type_query_ && !DumpTypeQuery(pdb_file))
+    return false;
+
+  return true;
+}
+
+bool PdbDumpApp::DumpModuleQuery(const PdbFile& pdb_file,
+                                 const NameStreamMap& name_streams,
+                                 const DbiStream& dbi_stream) {
+  // The module info streams refer to their source files by their offset in
+  // the name table.
+  NameStreamMap::const_iterator it(name_streams.find("/names"));
+  OffsetStringMap index_names;
+  if (it == name_streams.end() ||
+      !ReadNameStream(pdb_file.GetStream(it->second), &index_names)) {
+    LOG(ERROR) << "Unable to read the name table.";
+    return false;
+  }
+
+  size_t modules_matched = 0;
+  DbiStream::DbiModuleVector::const_iterator iter_modules =
+      dbi_stream.modules().begin();
+  for (; iter_modules != dbi_stream.modules().end(); ++iter_modules) {
+    const std::string& module_name = iter_modules->module_name();
+    std::string base_name = base::WideToUTF8(
+        base::FilePath(base::UTF8ToWide(module_name)).BaseName().value());
+    if (base::strcasecmp(module_name.c_str(), module_query_.c_str()) != 0 &&
+        base::strcasecmp(base_name.c_str(), module_query_.c_str()) != 0) {
+      continue;
+    }
+
+    ++modules_matched;
+    if (iter_modules->module_info_base().stream == -1)
+      continue;
+    PdbStream* module_stream =
+        pdb_file.GetStream(iter_modules->module_info_base().stream);
+    if (module_stream == NULL) {
+      LOG(ERROR) << "Unable to read a module info stream.";
+      return false;
+    }
+    DumpModuleInfoStream(*iter_modules, index_names, out(), module_stream);
+  }
+
+  if (modules_matched == 0) {
+    LOG(ERROR) << "No module named \"" << module_query_ << "\".";
+    return false;
+  }
+  return true;
+}
+
+bool PdbDumpApp::DumpSymbolQuery(const PdbFile& pdb_file,
+                                 const DbiStream& dbi_stream) {
+  PdbStream* sym_record_stream =
+      pdb_file.GetStream(dbi_stream.header().symbol_record_stream);
+  if (dbi_stream.header().symbol_record_stream == -1 ||
+      sym_record_stream == NULL) {
+    LOG(ERROR) << "No symbol record stream.";
+    return false;
+  }
+
+  // Look the name up in the hash tables of both the global and the public
+  // symbols.
+  SymbolRecordVector symbol_vector;
+  PdbStream* globals_stream =
+      pdb_file.GetStream(dbi_stream.header().global_symbol_info_stream);
+  if (globals_stream != NULL &&
+      !FindSymbolRecordsByName(globals_stream, 0, sym_record_stream,
+                               symbol_query_, &symbol_vector)) {
+    LOG(ERROR) << "Unable to search the global symbols.";
+    return false;
+  }
+  PdbStream* publics_stream =
+      pdb_file.GetStream(dbi_stream.header().public_symbol_info_stream);
+  if (publics_stream != NULL &&
+      !FindSymbolRecordsByName(publics_stream, kPublicSymbolHashOffset,
+                               sym_record_stream, symbol_query_,
+                               &symbol_vector)) {
+    LOG(ERROR) << "Unable to search the public symbols.";
+    return false;
+  }
+
+  if (symbol_vector.empty()) {
+    LOG(ERROR) << "No symbol named \"" << symbol_query_ << "\".";
+    return false;
+  }
+
+  DumpIndentedText(out(), 0, "%d symbol records named %s:\n",
+                   symbol_vector.size(), symbol_query_.c_str());
+  DumpSymbolRecords(out(), sym_record_stream, symbol_vector, 1);
+  return true;
+}
+
+bool PdbDumpApp::DumpTypeQuery(const PdbFile& pdb_file) {
+  PdbStream* stream = pdb_file.GetStream(pdb::kTpiStream);
+  TypeInfoHeader type_info_header = {};
+  if (stream == NULL || !stream->Seek(0) ||
+      !stream->Read(&type_info_header, 1)) {
+    LOG(ERROR) << "No type info stream.";
+    return false;
+  }
+
+  PdbStream* hash_stream = pdb_file.GetStream(
+      type_info_header.type_info_hash.stream_number);
+  TypeInfoRecord type_info_record = {};
+  if (!FindTypeInfoRecord(stream, type_info_header, hash_stream, type_query_,
+                          &type_info_record)) {
+    return false;
+  }
+
+  // Type records only refer to types with lower IDs. Those are known to exist
+  // without having to be read, so they get placeholder entries.
+  TypeInfoRecordMap type_info_record_map;
+  TypeInfoRecord placeholder = {};
+  for (uint32 type_id = type_info_header.type_min; type_id < type_query_;
+       ++type_id) {
+    type_info_record_map.insert(type_info_record_map.end(),
+                                std::make_pair(type_id, placeholder));
+  }
+  type_info_record_map[type_query_] = type_info_record;
+
+  return DumpTypeInfoRecord(out(), stream, type_info_record_map, type_query_,
+                            type_info_record, 0);
+}
+
 }  // namespace pdb
@@ -15,6 +15,7 @@
 #ifndef SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_DUMP_H_
 #define SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_DUMP_H_
 
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -26,6 +27,7 @@ namespace pdb {
 
 // Forward declarations.
 class DbiStream;
+class PdbFile;
 
 // The PdbDump application dumps data for one or more PDB files to stdout,
 // and can optionally explode the streams from each PDB file to a set of files
@@ -58,6 +60,25 @@ class PdbDumpApp : public application::AppImplBase {
   // Dumps @p dbi_stream to out().
   void DumpDbiStream(const DbiStream& dbi_stream);
 
+  // @returns true iff a module, symbol or type query was specified.
+  bool HasQuery() const;
+
+  // Dumps the modules, symbols and types matching the queries to out(). Only
+  // the streams and the parts of them that the queries require are read.
+  // @param pdb_file the PDB file to query.
+  // @param name_streams the named streams of @p pdb_file.
+  // @returns true on success, false on error.
+  bool DumpQueries(const PdbFile& pdb_file, const NameStreamMap& name_streams);
+
+  // @name Query mode helpers, used by DumpQueries.
+  // @{
+  bool DumpModuleQuery(const PdbFile& pdb_file,
+                       const NameStreamMap& name_streams,
+                       const DbiStream& dbi_stream);
+  bool DumpSymbolQuery(const PdbFile& pdb_file, const DbiStream& dbi_stream);
+  bool DumpTypeQuery(const PdbFile& pdb_file);
+  // @}
+
   // The PDB files to dump.
   std::vector<base::FilePath> pdb_files_;
 
@@ -73,6 +94,19 @@ class PdbDumpApp : public application::AppImplBase {
 
   // Iff true, the module streams will be dumped. Default to false.
   bool dump_modules_;
+
+  // @name Queries. When any of these is specified only the matching items are
+  //     dumped, instead of the whole PDB.
+  // @{
+  // The name of the modules to dump. Matches either the full module name or
+  // its base name, case insensitively.
+  std::string module_query_;
+  // The name of the global and public symbols to dump.
+  std::string symbol_query_;
+  // The ID of the type to dump, iff has_type_query_ is true.
+  bool has_type_query_;
+  uint32 type_query_;
+  // @}
 };
 
 }  // namespace pdb
@@ -29,6 +29,8 @@
         'pdb_leaf.h',
         'pdb_module_info_stream_dumper.cc',
         'pdb_module_info_stream_dumper.h',
+        'pdb_query.cc',
+        'pdb_query.h',
         'pdb_symbol_record_dumper.cc',
         'pdb_symbol_record_dumper.h',
         'pdb_type_info_stream_dumper.cc',
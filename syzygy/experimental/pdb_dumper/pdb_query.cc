@@ -0,0 +1,328 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/experimental/pdb_dumper/pdb_query.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "syzygy/common/assertions.h"
+#include "syzygy/experimental/pdb_dumper/pdb_leaf.h"
+#include "syzygy/pdb/pdb_stream.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
+
+namespace pdb {
+
+namespace {
+
+namespace cci = Microsoft_Cci_Pdb;
+
+// The header of the symbol hash table of the global and public symbol info
+// streams.
+struct SymbolHashHeader {
+  uint32 signature;
+  uint32 version;
+  uint32 hash_records_size;
+  uint32 buckets_size;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(SymbolHashHeader, 16);
+
+// A hash record, referring to a symbol in the symbol record stream.
+struct SymbolHashRecord {
+  // The offset of the symbol in the symbol record stream, plus one.
+  uint32 offset;
+  uint32 ref_count;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(SymbolHashRecord, 8);
+
+// An entry of the type index offset table of the type info hash stream.
+struct TypeIndexOffset {
+  uint32 type_id;
+  // The offset of the type record relative to the end of the stream header.
+  uint32 offset;
+};
+COMPILE_ASSERT_IS_POD_OF_SIZE(TypeIndexOffset, 8);
+
+const uint32 kSymbolHashSignature = 0xFFFFFFFF;
+const uint32 kSymbolHashVersion = 0xEFFE0000 + 19990810;
+
+// The number of buckets of the symbol hash table. The table has one more
+// bucket than this, which is never used for names.
+const size_t kSymbolHashBucketCount = 4096;
+const size_t kSymbolHashBitmapSize = (kSymbolHashBucketCount + 1 + 31) / 32;
+
+// The bucket offsets are stored in units of the size of a hash record in
+// memory, which is larger than on disk.
+const size_t kSymbolHashRecordMemorySize = 12;
+
+// Computes the hash of a symbol name, as used by the symbol hash tables. This
+// is case insensitive for ASCII letters.
+uint32 HashSymbolName(const std::string& name) {
+  const uint8* data = reinterpret_cast<const uint8*>(name.data());
+  size_t size = name.size();
+  uint32 hash = 0;
+
+  for (; size >= sizeof(uint32); size -= sizeof(uint32)) {
+    hash ^= *reinterpret_cast<const uint32*>(data);
+    data += sizeof(uint32);
+  }
+  if (size >= sizeof(uint16)) {
+    hash ^= *reinterpret_cast<const uint16*>(data);
+    data += sizeof(uint16);
+    size -= sizeof(uint16);
+  }
+  if (size != 0)
+    hash ^= *data;
+
+  hash |= 0x20202020;
+  hash ^= hash >> 11;
+  return hash ^ (hash >> 16);
+}
+
+// Reads the record at @p position in @p sym_record_stream, and its name if it
+// is of a kind found in the symbol hash tables.
+// @returns true on success, false on error. @p name is left empty for records
+//     of other kinds.
+bool ReadSymbolRecordAndName(PdbStream* sym_record_stream,
+                             size_t position,
+                             SymbolRecord* record,
+                             std::string* name) {
+  DCHECK(sym_record_stream != NULL);
+  DCHECK(record != NULL);
+  DCHECK(name != NULL);
+
+  uint16 len = 0;
+  if (!sym_record_stream->Seek(position) ||
+      !sym_record_stream->Read(&len, 1) ||
+      !sym_record_stream->Read(&record->type, 1)) {
+    LOG(ERROR) << "Unable to read the symbol record at " << position << ".";
+    return false;
+  }
+  record->start_position = sym_record_stream->pos();
+  record->len = len - sizeof(record->type);
+
+  // Skip the fields that precede the name.
+  size_t name_offset = 0;
+  switch (record->type) {
+    case cci::S_PUB32:
+      name_offset = offsetof(cci::PubSym32, name);
+      break;
+    case cci::S_GDATA32:
+    case cci::S_LDATA32:
+      name_offset = offsetof(cci::DatasSym32, name);
+      break;
+    case cci::S_GTHREAD32:
+    case cci::S_LTHREAD32:
+      name_offset = offsetof(cci::ThreadSym32, name);
+      break;
+    case cci::S_PROCREF:
+    case cci::S_LPROCREF:
+    case cci::S_DATAREF:
+      name_offset = offsetof(cci::RefSym2, name);
+      break;
+    case cci::S_UDT:
+      name_offset = offsetof(cci::UdtSym, name);
+      break;
+    case cci::S_CONSTANT: {
+      // The value is a numeric leaf, which may be followed by its data.
+      uint16 value = 0;
+      size_t value_offset = offsetof(cci::ConstSym, value);
+      if (!sym_record_stream->Seek(record->start_position + value_offset) ||
+          !sym_record_stream->Read(&value, 1)) {
+        LOG(ERROR) << "Unable to read the value of a constant symbol.";
+        return false;
+      }
+      size_t value_size = 0;
+      GetNumericLeafNameAndSize(value, &value_size);
+      name_offset = offsetof(cci::ConstSym, name) + value_size;
+      break;
+    }
+    default:
+      name->clear();
+      return true;
+  }
+
+  if (!sym_record_stream->Seek(record->start_position + name_offset) ||
+      !ReadString(sym_record_stream, name)) {
+    LOG(ERROR) << "Unable to read the name of the symbol record at "
+               << position << ".";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+const size_t kPublicSymbolHashOffset = 28;
+
+bool FindSymbolRecordsByName(PdbStream* hash_stream,
+                             size_t hash_offset,
+                             PdbStream* sym_record_stream,
+                             const std::string& name,
+                             SymbolRecordVector* records) {
+  DCHECK(hash_stream != NULL);
+  DCHECK(sym_record_stream != NULL);
+  DCHECK(records != NULL);
+
+  SymbolHashHeader header = {};
+  if (!hash_stream->Seek(hash_offset) || !hash_stream->Read(&header, 1)) {
+    LOG(ERROR) << "Unable to read the symbol hash header.";
+    return false;
+  }
+  if (header.signature != kSymbolHashSignature ||
+      header.version != kSymbolHashVersion) {
+    LOG(ERROR) << "Unsupported symbol hash table version.";
+    return false;
+  }
+
+  size_t records_offset = hash_stream->pos();
+  size_t record_count = header.hash_records_size / sizeof(SymbolHashRecord);
+  size_t bitmap_offset = records_offset + header.hash_records_size;
+
+  // Only the non-empty buckets have an entry in the bucket array, in bucket
+  // order. They are marked in a bitmap that precedes the array.
+  std::vector<uint32> bitmap;
+  if (!hash_stream->Seek(bitmap_offset) ||
+      !hash_stream->Read(&bitmap, kSymbolHashBitmapSize)) {
+    LOG(ERROR) << "Unable to read the symbol hash bitmap.";
+    return false;
+  }
+
+  size_t bucket = HashSymbolName(name) % kSymbolHashBucketCount;
+  if ((bitmap[bucket / 32] & (1U << (bucket % 32))) == 0)
+    return true;
+
+  size_t bucket_index = 0;
+  for (size_t i = 0; i < bucket; ++i) {
+    if ((bitmap[i / 32] & (1U << (i % 32))) != 0)
+      ++bucket_index;
+  }
+  size_t bucket_count = header.buckets_size / sizeof(uint32) -
+      kSymbolHashBitmapSize;
+  if (bucket_index >= bucket_count) {
+    LOG(ERROR) << "The symbol hash bitmap is inconsistent.";
+    return false;
+  }
+
+  // The chain of a bucket ends where the chain of the next non-empty bucket
+  // begins.
+  uint32 chain[2] = {
+      0, static_cast<uint32>(record_count * kSymbolHashRecordMemorySize) };
+  size_t to_read = bucket_index + 1 < bucket_count ? 2 : 1;
+  size_t bucket_offset = bitmap_offset +
+      (kSymbolHashBitmapSize + bucket_index) * sizeof(uint32);
+  if (!hash_stream->Seek(bucket_offset) ||
+      !hash_stream->Read(chain, to_read)) {
+    LOG(ERROR) << "Unable to read the symbol hash buckets.";
+    return false;
+  }
+  size_t chain_begin = chain[0] / kSymbolHashRecordMemorySize;
+  size_t chain_end = chain[1] / kSymbolHashRecordMemorySize;
+  if (chain_begin > chain_end || chain_end > record_count) {
+    LOG(ERROR) << "Invalid symbol hash chain.";
+    return false;
+  }
+
+  std::vector<SymbolHashRecord> hash_records;
+  if (!hash_stream->Seek(records_offset +
+                         chain_begin * sizeof(SymbolHashRecord)) ||
+      !hash_stream->Read(&hash_records, chain_end - chain_begin)) {
+    LOG(ERROR) << "Unable to read the symbol hash records.";
+    return false;
+  }
+
+  // Different names share a bucket, so the name of each record is checked.
+  for (size_t i = 0; i < hash_records.size(); ++i) {
+    if (hash_records[i].offset == 0)
+      continue;
+    SymbolRecord record = {};
+    std::string record_name;
+    if (!ReadSymbolRecordAndName(sym_record_stream,
+                                 hash_records[i].offset - 1,
+                                 &record,
+                                 &record_name)) {
+      return false;
+    }
+    if (record_name == name)
+      records->push_back(record);
+  }
+
+  return true;
+}
+
+bool FindTypeInfoRecord(PdbStream* type_info_stream,
+                        const TypeInfoHeader& type_info_header,
+                        PdbStream* hash_stream,
+                        uint32 type_id,
+                        TypeInfoRecord* type_record) {
+  DCHECK(type_info_stream != NULL);
+  DCHECK(type_record != NULL);
+
+  if (type_id < type_info_header.type_min ||
+      type_id >= type_info_header.type_max) {
+    LOG(ERROR) << "Type " << type_id << " is not in the type info stream.";
+    return false;
+  }
+
+  // Start from the closest preceding type in the offset table, or from the
+  // first type if there is no usable table.
+  uint32 current_type_id = type_info_header.type_min;
+  size_t position = type_info_header.len;
+  const OffsetCb& offsets =
+      type_info_header.type_info_hash.offset_cb_type_info_offset;
+  if (hash_stream != NULL && offsets.cb != 0) {
+    std::vector<TypeIndexOffset> table;
+    if (!hash_stream->Seek(offsets.offset) ||
+        !hash_stream->Read(&table, offsets.cb / sizeof(TypeIndexOffset))) {
+      LOG(ERROR) << "Unable to read the type index offset table.";
+      return false;
+    }
+    for (size_t i = 0; i < table.size() && table[i].type_id <= type_id; ++i) {
+      current_type_id = table[i].type_id;
+      position = type_info_header.len + table[i].offset;
+    }
+  }
+
+  // Walk the record headers up to the type.
+  size_t type_info_data_end =
+      type_info_header.len + type_info_header.type_info_data_size;
+  while (position < type_info_data_end) {
+    uint16 len = 0;
+    if (!type_info_stream->Seek(position) ||
+        !type_info_stream->Read(&len, 1)) {
+      LOG(ERROR) << "Unable to read a type info record length.";
+      return false;
+    }
+    if (current_type_id == type_id) {
+      if (!type_info_stream->Read(&type_record->type, 1)) {
+        LOG(ERROR) << "Unable to read a type info record type.";
+        return false;
+      }
+      type_record->start_position = type_info_stream->pos();
+      type_record->len = len - sizeof(type_record->type);
+      return true;
+    }
+    position += sizeof(len) + len;
+    ++current_type_id;
+  }
+
+  LOG(ERROR) << "Type " << type_id << " is past the end of the type info "
+             << "stream.";
+  return false;
+}
+
+}  // namespace pdb
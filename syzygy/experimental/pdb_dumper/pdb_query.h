@@ -0,0 +1,71 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// This file provides random access to individual records of a PDB, using the
+// indices that the PDB already contains, so that a single symbol or type can
+// be dumped without reading the whole stream it lives in.
+
+#ifndef SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_QUERY_H_
+#define SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_QUERY_H_
+
+#include <string>
+
+#include "base/basictypes.h"
+#include "syzygy/pdb/pdb_data.h"
+#include "syzygy/pdb/pdb_data_types.h"
+
+namespace pdb {
+
+// Forward declarations.
+class PdbStream;
+
+// The offset of the symbol hash table in the public symbol info stream. The
+// global symbol info stream starts directly with the hash table.
+extern const size_t kPublicSymbolHashOffset;
+
+// Finds the symbol records named @p name using the hash table of a global or
+// public symbol info stream. Only the hash table and the records in the
+// matching bucket are read.
+// @param hash_stream the global or public symbol info stream.
+// @param hash_offset the offset of the hash table in @p hash_stream.
+// @param sym_record_stream the symbol record stream.
+// @param name the name of the symbols to find.
+// @param records receives the matching records. Records are appended, so
+//     several hash streams may be queried in turn.
+// @returns true on success, false on error.
+bool FindSymbolRecordsByName(PdbStream* hash_stream,
+                             size_t hash_offset,
+                             PdbStream* sym_record_stream,
+                             const std::string& name,
+                             SymbolRecordVector* records);
+
+// Finds the record of a type using the type index offset table of the type
+// info hash stream. Only the record headers between the closest preceding
+// table entry and the type are read.
+// @param type_info_stream the type info stream.
+// @param type_info_header the header of @p type_info_stream.
+// @param hash_stream the type info hash stream.
+// @param type_id the ID of the type to find.
+// @param type_record receives the record of the type.
+// @returns true on success, false if the type can't be found.
+bool FindTypeInfoRecord(PdbStream* type_info_stream,
+                        const TypeInfoHeader& type_info_header,
+                        PdbStream* hash_stream,
+                        uint32 type_id,
+                        TypeInfoRecord* type_record);
+
+}  // namespace pdb
+
+#endif  // SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_QUERY_H_
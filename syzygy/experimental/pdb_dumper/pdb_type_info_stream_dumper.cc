@@ -67,46 +67,65 @@ void DumpTypeInfoStream(FILE* out,
   uint8 indent_level = 1;
   // Dump each symbol contained in the vector.
   for (; type_info_iter != type_info_record_map.end(); ++type_info_iter) {
-    if (!stream->Seek(type_info_iter->second.start_position)) {
-      LOG(ERROR) << "Unable to seek to type info record at position "
-                 << base::StringPrintf("0x%08X.",
-                                       type_info_iter->second.start_position);
+    if (!DumpTypeInfoRecord(out,
+                            stream,
+                            type_info_record_map,
+                            type_info_iter->first,
+                            type_info_iter->second,
+                            indent_level)) {
       return;
     }
-    // The location in the map is the start of the leaf, which points
-    // past the size/type pair.
-    DumpIndentedText(out, indent_level, "Type info 0x%04X (at 0x%04X):\n",
-        type_info_iter->first,
-        type_info_iter->second.start_position - sizeof(cci::SYMTYPE));
-    bool success = DumpLeaf(type_info_record_map,
-                            type_info_iter->second.type,
-                            out,
-                            stream,
-                            type_info_iter->second.len,
-                            indent_level + 1);
+  }
+}
 
-    if (!success) {
-      // In case of failure we just dump the hex data of this type info.
-      if (!stream->Seek(type_info_iter->second.start_position)) {
-        LOG(ERROR) << "Unable to seek to type info record at position "
-                   << base::StringPrintf("0x%08X.",
-                                         type_info_iter->second.start_position);
-        return;
-      }
-      DumpUnknownLeaf(type_info_record_map,
-                      out,
-                      stream,
-                      type_info_iter->second.len,
-                      indent_level + 1);
-    }
-    stream->Seek(common::AlignUp(stream->pos(), 4));
-    size_t expected_position = type_info_iter->second.start_position
-        + type_info_iter->second.len;
-    if (stream->pos() != expected_position) {
-      LOG(ERROR) << "Type info stream is not valid.";
-      return;
+bool DumpTypeInfoRecord(FILE* out,
+                        PdbStream* stream,
+                        const TypeInfoRecordMap& type_info_record_map,
+                        uint32 type_id,
+                        const TypeInfoRecord& type_info_record,
+                        uint8 indent_level) {
+  DCHECK(stream != NULL);
+
+  if (!stream->Seek(type_info_record.start_position)) {
+    LOG(ERROR) << "Unable to seek to type info record at position "
+               << base::StringPrintf("0x%08X.",
+                                     type_info_record.start_position);
+    return false;
+  }
+  // The location in the map is the start of the leaf, which points
+  // past the size/type pair.
+  DumpIndentedText(out, indent_level, "Type info 0x%04X (at 0x%04X):\n",
+      type_id,
+      type_info_record.start_position - sizeof(cci::SYMTYPE));
+  bool success = DumpLeaf(type_info_record_map,
+                          type_info_record.type,
+                          out,
+                          stream,
+                          type_info_record.len,
+                          indent_level + 1);
+
+  if (!success) {
+    // In case of failure we just dump the hex data of this type info.
+    if (!stream->Seek(type_info_record.start_position)) {
+      LOG(ERROR) << "Unable to seek to type info record at position "
+                 << base::StringPrintf("0x%08X.",
+                                       type_info_record.start_position);
+      return false;
     }
+    DumpUnknownLeaf(type_info_record_map,
+                    out,
+                    stream,
+                    type_info_record.len,
+                    indent_level + 1);
+  }
+  stream->Seek(common::AlignUp(stream->pos(), 4));
+  size_t expected_position = type_info_record.start_position
+      + type_info_record.len;
+  if (stream->pos() != expected_position) {
+    LOG(ERROR) << "Type info stream is not valid.";
+    return false;
   }
+  return true;
 }
 
 }  // namespace pdb
@@ -35,6 +35,22 @@ void DumpTypeInfoStream(FILE* out,
                         const TypeInfoHeader& type_info_header,
                         const TypeInfoRecordMap& type_info_record_map);
 
+// Dumps the record of a single type from @p stream to @p out.
+// @param out the output where the record should be dumped.
+// @param stream the type info stream.
+// @param type_info_record_map the type info records which the record may
+//     refer to.
+// @param type_id the ID of the type.
+// @param type_info_record the record of the type.
+// @param indent_level the level of indentation to use.
+// @returns true on success, false if the stream is not valid.
+bool DumpTypeInfoRecord(FILE* out,
+                        PdbStream* stream,
+                        const TypeInfoRecordMap& type_info_record_map,
+                        uint32 type_id,
+                        const TypeInfoRecord& type_info_record,
+                        uint8 indent_level);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_EXPERIMENTAL_PDB_DUMPER_PDB_TYPE_INFO_STREAM_DUMPER_H_
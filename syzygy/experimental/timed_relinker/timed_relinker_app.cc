@@ -0,0 +1,435 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Relinks images multiple times while capturing timing and memory information
+// for each phase of the toolchain. The phases are run in the same order and
+// with the same utilities as in the PERelinker, but one at a time so that
+// they can be measured individually.
+
+#include "syzygy/experimental/timed_relinker/timed_relinker_app.h"
+
+#include <windows.h>  // NOLINT
+#include <crtdbg.h>
+#include <objbase.h>
+#include <psapi.h>
+
+#include <algorithm>
+#include <map>
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/ordered_block_graph.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/instrument/transforms/asan_transform.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/find.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/pe/pe_file_writer.h"
+#include "syzygy/pe/pe_relinker_util.h"
+#include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/testing/metrics.h"
+
+namespace experimental {
+
+namespace {
+
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BlockGraph;
+using block_graph::OrderedBlockGraph;
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options] IMAGE_FILE [IMAGE_FILE ...]\n"
+    "\n"
+    "  A tool that relinks each of the given images multiple times, and\n"
+    "  reports the wall time, the peak working set and the number of heap\n"
+    "  allocations of each phase of the toolchain. The results are averaged\n"
+    "  over the iterations and emitted as metrics named\n"
+    "  Syzygy.Toolchain.<image>.<phase>.<measurement>.\n"
+    "\n"
+    "Required parameters:\n"
+    "  --iterations=NUM     The number of times to relink each image.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --asan               Apply the Asan transform, which is otherwise\n"
+    "                       skipped.\n"
+    "  --csv=PATH           The path to which CSV output should be written.\n"
+    "  --output-dir=DIR     The directory where the relinked images are\n"
+    "                       written. Defaults to a temporary directory.\n"
+    "\n"
+    "Allocations are only counted by builds that use the debug CRT.\n";
+
+#if defined(_DEBUG)
+// The number of heap allocations made so far.
+volatile LONG allocation_count = 0;
+
+// Counts the heap allocations made through the CRT.
+int AllocationCountingHook(int alloc_type,
+                           void* /* user_data */,
+                           size_t /* size */,
+                           int /* block_type */,
+                           long /* request_number */,
+                           const unsigned char* /* filename */,
+                           int /* line_number */) {
+  if (alloc_type == _HOOK_ALLOC || alloc_type == _HOOK_REALLOC)
+    ::InterlockedIncrement(&allocation_count);
+  return TRUE;
+}
+#endif
+
+// @returns the number of heap allocations made so far, or -1 if they aren't
+//     counted.
+int64 GetAllocationCount() {
+#if defined(_DEBUG)
+  return allocation_count;
+#else
+  return -1;
+#endif
+}
+
+// @returns the peak working set of the process.
+size_t GetPeakWorkingSet() {
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+}
+
+// Measures a phase for as long as it is in scope.
+class ScopedPhase {
+ public:
+  // @param phase The name of the phase.
+  // @param samples The vector that receives the measurements of the phase.
+  ScopedPhase(const char* phase, TimedRelinkerApp::PhaseSamples* samples)
+      : phase_(phase),
+        samples_(samples),
+        start_(base::Time::NowFromSystemTime()),
+        start_allocation_count_(GetAllocationCount()) {
+    DCHECK(samples != NULL);
+  }
+
+  ~ScopedPhase() {
+    TimedRelinkerApp::PhaseSample sample = {};
+    sample.phase = phase_;
+    sample.seconds = (base::Time::NowFromSystemTime() - start_).InSecondsF();
+    sample.peak_working_set = GetPeakWorkingSet();
+    sample.allocation_count = -1;
+    if (start_allocation_count_ >= 0)
+      sample.allocation_count = GetAllocationCount() - start_allocation_count_;
+    LOG(INFO) << "Phase " << phase_ << " took " << sample.seconds
+              << " seconds.";
+    samples_->push_back(sample);
+  }
+
+ private:
+  const char* phase_;
+  TimedRelinkerApp::PhaseSamples* samples_;
+  base::Time start_;
+  int64 start_allocation_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhase);
+};
+
+// Basic-block decomposes all of the code blocks that are safe to decompose,
+// which is what the basic-block transforms start with.
+// @param policy The policy deciding which blocks are safe to decompose.
+// @param block_graph The block-graph to decompose.
+void BasicBlockDecomposeAll(const pe::PETransformPolicy& policy,
+                            const BlockGraph& block_graph) {
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    if (!policy.BlockIsSafeToBasicBlockDecompose(&block))
+      continue;
+    BasicBlockSubGraph subgraph;
+    BasicBlockDecomposer decomposer(&block, &subgraph);
+    if (!decomposer.Decompose()) {
+      LOG(WARNING) << "Failed to basic-block decompose \"" << block.name()
+                   << "\".";
+    }
+  }
+}
+
+bool WriteCsvFile(const base::FilePath& path,
+                  const std::vector<std::string>& rows) {
+  LOG(INFO) << "Writing samples information to '" << path.value() << "'.";
+  base::ScopedFILE out_file(base::OpenFile(path, "wb"));
+  if (out_file.get() == NULL) {
+    LOG(ERROR) << "Failed to open " << path.value() << " for writing.";
+    return false;
+  }
+  fprintf(out_file.get(),
+          "image, iteration, phase, seconds, peak_working_set, "
+          "allocation_count\n");
+  for (size_t i = 0; i < rows.size(); ++i)
+    fprintf(out_file.get(), "%s\n", rows[i].c_str());
+  return true;
+}
+
+// Accumulates the measurements of a phase over the iterations.
+struct PhaseTotals {
+  PhaseTotals() : seconds(0.0), peak_working_set(0), allocation_count(0) {}
+
+  double seconds;
+  size_t peak_working_set;
+  int64 allocation_count;
+};
+
+}  // namespace
+
+TimedRelinkerApp::TimedRelinkerApp()
+    : application::AppImplBase("Timed Image Relinker"),
+      num_iterations_(0),
+      asan_(false) {
+}
+
+void TimedRelinkerApp::PrintUsage(const base::FilePath& program,
+                                  const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool TimedRelinkerApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(cmd_line->GetProgram(), "");
+    return false;
+  }
+
+  const CommandLine::StringVector& args = cmd_line->GetArgs();
+  if (args.empty()) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify at least one image!");
+    return false;
+  }
+  for (size_t i = 0; i < args.size(); ++i)
+    image_paths_.push_back(base::FilePath(args[i]));
+
+  if (!base::StringToInt(
+          cmd_line->GetSwitchValueNative("iterations"), &num_iterations_) ||
+      num_iterations_ <= 0) {
+    PrintUsage(cmd_line->GetProgram(), "Must specify '--iterations' >= 1!");
+    return false;
+  }
+
+  asan_ = cmd_line->HasSwitch("asan");
+  csv_path_ = cmd_line->GetSwitchValuePath("csv");
+  output_dir_ = cmd_line->GetSwitchValuePath("output-dir");
+
+  return true;
+}
+
+int TimedRelinkerApp::Run() {
+  DCHECK(!image_paths_.empty());
+  DCHECK_LT(0, num_iterations_);
+
+#if defined(_DEBUG)
+  _CrtSetAllocHook(&AllocationCountingHook);
+#endif
+
+  base::ScopedTempDir temp_dir;
+  base::FilePath output_dir = output_dir_;
+  if (output_dir.empty()) {
+    if (!temp_dir.CreateUniqueTempDir()) {
+      LOG(ERROR) << "Failed to create a temporary directory.";
+      return 1;
+    }
+    output_dir = temp_dir.path();
+  } else if (!base::CreateDirectory(output_dir)) {
+    LOG(ERROR) << "Failed to create " << output_dir.value() << ".";
+    return 1;
+  }
+
+  std::vector<std::string> csv_rows;
+  for (size_t i = 0; i < image_paths_.size(); ++i) {
+    const base::FilePath& image_path = image_paths_[i];
+    LOG(INFO) << "Processing \"" << image_path.value() << "\".";
+    std::string image_name =
+        base::WideToUTF8(image_path.BaseName().RemoveExtension().value());
+
+    // The phases are kept in the order in which they first ran.
+    std::vector<std::string> phases;
+    std::map<std::string, PhaseTotals> totals;
+    for (int j = 0; j < num_iterations_; ++j) {
+      LOG(INFO) << "Starting iteration " << (j + 1) << ".";
+      PhaseSamples samples;
+      if (!RelinkImage(image_path, output_dir, &samples))
+        return 1;
+
+      for (size_t k = 0; k < samples.size(); ++k) {
+        const PhaseSample& sample = samples[k];
+        if (totals.find(sample.phase) == totals.end())
+          phases.push_back(sample.phase);
+        PhaseTotals& phase_totals = totals[sample.phase];
+        phase_totals.seconds += sample.seconds;
+        phase_totals.peak_working_set = std::max(
+            phase_totals.peak_working_set, sample.peak_working_set);
+        phase_totals.allocation_count += sample.allocation_count;
+        csv_rows.push_back(base::StringPrintf(
+            "%s, %d, %s, %f, %u, %lld", image_name.c_str(), j,
+            sample.phase.c_str(), sample.seconds, sample.peak_working_set,
+            sample.allocation_count));
+      }
+    }
+
+    for (size_t j = 0; j < phases.size(); ++j) {
+      const PhaseTotals& phase_totals = totals[phases[j]];
+      std::string prefix = base::StringPrintf(
+          "Syzygy.Toolchain.%s.%s.", image_name.c_str(), phases[j].c_str());
+      testing::EmitMetric(prefix + "Seconds",
+                          phase_totals.seconds / num_iterations_);
+      testing::EmitMetric(prefix + "PeakWorkingSet",
+                          static_cast<uint64>(phase_totals.peak_working_set));
+      if (GetAllocationCount() >= 0) {
+        testing::EmitMetric(prefix + "AllocationCount",
+                            phase_totals.allocation_count / num_iterations_);
+      }
+    }
+  }
+
+  if (!csv_path_.empty() && !WriteCsvFile(csv_path_, csv_rows))
+    return 1;
+
+  return 0;
+}
+
+bool TimedRelinkerApp::RelinkImage(const base::FilePath& image_path,
+                                   const base::FilePath& output_dir,
+                                   PhaseSamples* samples) {
+  DCHECK(samples != NULL);
+
+  base::FilePath output_path = output_dir.Append(image_path.BaseName());
+  base::FilePath input_pdb_path;
+  base::FilePath output_pdb_path;
+  if (!pe::ValidateAndInferPaths(image_path, output_path, true,
+                                 &input_pdb_path, &output_pdb_path)) {
+    return false;
+  }
+  GUID output_guid = GUID_NULL;
+  if (FAILED(::CoCreateGuid(&output_guid))) {
+    LOG(ERROR) << "Failed to create new PDB GUID.";
+    return false;
+  }
+
+  pe::PETransformPolicy policy;
+  pe::PEFile pe_file;
+  BlockGraph block_graph;
+  pe::ImageLayout input_image_layout(&block_graph);
+  BlockGraph::Block* headers_block = NULL;
+  {
+    ScopedPhase phase("Decompose", samples);
+    if (!pe_file.Init(image_path))
+      return false;
+    pe::ImageLayout orig_image_layout(&block_graph);
+    pe::Decomposer decomposer(pe_file);
+    decomposer.set_pdb_path(input_pdb_path);
+    if (!decomposer.Decompose(&orig_image_layout))
+      return false;
+    if (!pe::CopyImageLayoutWithoutPadding(orig_image_layout,
+                                           &input_image_layout)) {
+      return false;
+    }
+    headers_block = input_image_layout.blocks.GetBlockByAddress(
+        BlockGraph::RelativeAddress(0));
+    if (headers_block == NULL) {
+      LOG(ERROR) << "Unable to find the DOS header block.";
+      return false;
+    }
+  }
+
+  {
+    ScopedPhase phase("BasicBlockDecompose", samples);
+    BasicBlockDecomposeAll(policy, block_graph);
+  }
+
+  if (asan_) {
+    ScopedPhase phase("AsanTransform", samples);
+    instrument::transforms::AsanTransform asan_transform;
+    if (!block_graph::ApplyBlockGraphTransform(&asan_transform, &policy,
+                                               &block_graph, headers_block)) {
+      return false;
+    }
+  }
+
+  {
+    ScopedPhase phase("FinalizeTransforms", samples);
+    if (!pe::FinalizeBlockGraph(image_path, output_pdb_path, output_guid,
+                                true, &policy, &block_graph, headers_block)) {
+      return false;
+    }
+  }
+
+  OrderedBlockGraph ordered_block_graph(&block_graph);
+  {
+    ScopedPhase phase("Order", samples);
+    if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph, headers_block))
+      return false;
+  }
+
+  pe::ImageLayout output_image_layout(&block_graph);
+  {
+    ScopedPhase phase("Layout", samples);
+    if (!pe::BuildImageLayout(0, 1, ordered_block_graph, headers_block,
+                              &output_image_layout)) {
+      return false;
+    }
+  }
+
+  {
+    ScopedPhase phase("WritePe", samples);
+    pe::PEFileWriter writer(output_image_layout);
+    if (!writer.WriteImage(output_path)) {
+      LOG(ERROR) << "Failed to write image \"" << output_path.value() << "\".";
+      return false;
+    }
+  }
+
+  {
+    ScopedPhase phase("WritePdb", samples);
+    pdb::PdbReader pdb_reader;
+    pdb::PdbFile pdb_file;
+    if (!pdb_reader.Read(input_pdb_path, &pdb_file)) {
+      LOG(ERROR) << "Unable to read PDB file: " << input_pdb_path.value();
+      return false;
+    }
+    pe::RelativeAddressRange input_range;
+    pe::GetOmapRange(input_image_layout.sections, &input_range);
+    if (!pe::FinalizePdbFile(image_path, output_path, input_range,
+                             output_image_layout, output_guid, false, false,
+                             false, &pdb_file) ||
+        !pe::WritePdbFile(output_path, output_image_layout, true, false, false,
+                          output_pdb_path, &pdb_file)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace experimental
@@ -0,0 +1,89 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A command line application to relink images multiple times and generate
+// timing and memory information for each phase of the toolchain.
+
+#ifndef SYZYGY_EXPERIMENTAL_TIMED_RELINKER_TIMED_RELINKER_APP_H_
+#define SYZYGY_EXPERIMENTAL_TIMED_RELINKER_TIMED_RELINKER_APP_H_
+
+#include <string>
+#include <vector>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "syzygy/application/application.h"
+
+namespace experimental {
+
+// This class implements the timed_relinker command-line utility.
+//
+// See the description given in TimedRelinkerApp:::PrintUsage() for
+// information about running this utility.
+class TimedRelinkerApp : public application::AppImplBase {
+ public:
+  // The measurements of a phase of the toolchain.
+  struct PhaseSample {
+    // The name of the phase.
+    std::string phase;
+    // The wall time of the phase, in seconds.
+    double seconds;
+    // The peak working set of the process at the end of the phase, in bytes.
+    // The peak can't be reset, so this is the peak of the whole run so far.
+    size_t peak_working_set;
+    // The number of heap allocations made by the phase, or -1 if they aren't
+    // counted. They are only counted with the debug CRT.
+    int64 allocation_count;
+  };
+  typedef std::vector<PhaseSample> PhaseSamples;
+
+  TimedRelinkerApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Runs each phase of the toolchain on an image, and measures it.
+  // @param image_path The image to relink.
+  // @param output_dir The directory where the relinked image is written.
+  // @param samples Receives the measurements of each phase.
+  // @returns true on success, false otherwise.
+  bool RelinkImage(const base::FilePath& image_path,
+                   const base::FilePath& output_dir,
+                   PhaseSamples* samples);
+
+  // @name Command-line options.
+  // @{
+  std::vector<base::FilePath> image_paths_;
+  base::FilePath output_dir_;
+  base::FilePath csv_path_;
+  int num_iterations_;
+  bool asan_;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TimedRelinkerApp);
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_TIMED_RELINKER_TIMED_RELINKER_APP_H_
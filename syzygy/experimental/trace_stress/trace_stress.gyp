@@ -0,0 +1,47 @@
+# Copyright 2014 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+{
+  'variables': {
+    'chromium_code': 1,
+  },
+  'targets': [
+    {
+      'target_name': 'trace_stress_lib',
+      'type': 'static_library',
+      'sources': [
+        'trace_stress_app.cc',
+        'trace_stress_app.h',
+      ],
+      'dependencies': [
+        '<(src)/syzygy/application/application.gyp:application_lib',
+        '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
+        '<(src)/syzygy/testing/testing.gyp:testing_lib',
+        '<(src)/syzygy/trace/client/client.gyp:rpc_client_lib',
+        '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
+        '<(src)/syzygy/version/version.gyp:syzygy_version',
+      ],
+    },
+    {
+      'target_name': 'trace_stress',
+      'type': 'executable',
+      'sources': [
+        'trace_stress_main.cc',
+      ],
+      'dependencies': [
+        'trace_stress_lib',
+      ],
+    },
+  ],
+}
@@ -0,0 +1,576 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/experimental/trace_stress/trace_stress_app.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_vector.h"
+#include "base/process/kill.h"
+#include "base/process/launch.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+#include "syzygy/common/rpc/helpers.h"
+#include "syzygy/testing/metrics.h"
+#include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/client/rpc_session.h"
+#include "syzygy/trace/rpc/call_trace_rpc.h"
+
+namespace experimental {
+
+namespace {
+
+using ::common::rpc::InvokeRpc;
+using ::common::rpc::ScopedRpcBinding;
+using trace::client::RpcSession;
+using trace::client::TraceFileSegment;
+
+typedef TraceStressApp::ClientResults ClientResults;
+
+const char kUsageFormatStr[] =
+    "Usage: %ls [options]\n"
+    "\n"
+    "  A tool that load-tests a running call trace service. It spawns client\n"
+    "  processes whose threads write synthetic records to the service at a\n"
+    "  controlled rate, and reports the achieved throughput, the time the\n"
+    "  clients were stalled exchanging buffers, the buffers that were\n"
+    "  dropped, and the buffers that the service wrote late.\n"
+    "\n"
+    "Optional parameters:\n"
+    "  --instance-id=ID     The instance ID of the call trace service.\n"
+    "  --processes=NUM      The number of client processes. Defaults to 1.\n"
+    "  --threads=NUM        The number of tracing threads per process.\n"
+    "                       Defaults to 1.\n"
+    "  --rate=NUM           The number of records each thread writes per\n"
+    "                       second, 0 for as many as possible. Defaults to 0.\n"
+    "  --record-size=NUM    The size of the records, in bytes. Defaults to\n"
+    "                       64.\n"
+    "  --duration=NUM       How long the threads trace for, in seconds.\n"
+    "                       Defaults to 10.\n"
+    "  --late-ms=NUM        The write latency, in milliseconds, from which a\n"
+    "                       buffer is counted as late. Defaults to 100.\n"
+    "  --drain-timeout=NUM  How long to wait for the service to write the\n"
+    "                       buffers of the run, in seconds. Defaults to 30.\n"
+    "\n"
+    "The service counts the statistics of all of its sessions, so it should\n"
+    "not be tracing anything else during the run.\n";
+
+// The switch that runs the tool as a client process, and names the file that
+// receives its results.
+const char kResultsFileSwitch[] = "results-file";
+
+// The number of records a thread writes between checks of the clock when its
+// rate isn't limited.
+const uint64 kRecordsPerBatch = 1024;
+
+// Reads an optional integer switch.
+// @param cmd_line The command line.
+// @param name The name of the switch.
+// @param min_value The minimum value of the switch.
+// @param value Holds the default value, and receives the value of the switch.
+// @returns true on success, false if the switch is malformed or too small.
+bool GetIntSwitch(const CommandLine* cmd_line,
+                  const char* name,
+                  int min_value,
+                  int* value) {
+  DCHECK(cmd_line != NULL);
+  DCHECK(name != NULL);
+  DCHECK(value != NULL);
+
+  if (!cmd_line->HasSwitch(name))
+    return true;
+  return base::StringToInt(cmd_line->GetSwitchValueASCII(name), value) &&
+      *value >= min_value;
+}
+
+// Gets the statistics of the call trace service.
+// @param instance_id The instance ID of the service.
+// @param statistics Receives the statistics.
+// @returns true on success, false otherwise.
+bool QueryServiceStatistics(const std::wstring& instance_id,
+                            TraceSessionStatistics* statistics) {
+  DCHECK(statistics != NULL);
+
+  std::wstring protocol;
+  std::wstring endpoint;
+  ::GetSyzygyCallTraceRpcProtocol(&protocol);
+  ::GetSyzygyCallTraceRpcEndpoint(instance_id, &endpoint);
+
+  ScopedRpcBinding binding;
+  if (!binding.Open(protocol, endpoint)) {
+    LOG(ERROR) << "Failed to connect to the call trace service.";
+    return false;
+  }
+
+  ::memset(statistics, 0, sizeof(*statistics));
+  if (!InvokeRpc(CallTraceClient_QueryStatistics, binding.Get(),
+                 sizeof(*statistics),
+                 reinterpret_cast<byte*>(statistics)).succeeded()) {
+    LOG(ERROR) << "Failed to query the call trace service.";
+    return false;
+  }
+
+  return true;
+}
+
+// Subtracts the counts of a set of statistics from another.
+// @param statistics The statistics to subtract.
+// @param total The statistics to subtract from.
+void SubtractTraceSessionStatistics(const TraceSessionStatistics& statistics,
+                                    TraceSessionStatistics* total) {
+  DCHECK(total != NULL);
+
+  total->num_sessions -= statistics.num_sessions;
+  total->num_buffers_committed -= statistics.num_buffers_committed;
+  total->num_bytes_committed -= statistics.num_bytes_committed;
+  total->num_recycle_stalls -= statistics.num_recycle_stalls;
+  for (size_t i = 0; i < TraceLatencyHistogram::kNumBuckets; ++i) {
+    total->wait_time.counts[i] -= statistics.wait_time.counts[i];
+    total->write_latency.counts[i] -= statistics.write_latency.counts[i];
+  }
+}
+
+// A thread of a client process that writes synthetic records.
+class TracingThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param session The session of the process.
+  // @param records_per_second The rate at which records are written, or 0
+  //     for as fast as possible.
+  // @param record_size The size of the records.
+  // @param duration How long to write records for.
+  TracingThread(RpcSession* session,
+                int records_per_second,
+                size_t record_size,
+                base::TimeDelta duration)
+      : session_(session),
+        records_per_second_(records_per_second),
+        record_size_(record_size),
+        duration_(duration) {
+    DCHECK(session != NULL);
+    DCHECK_LE(sizeof(TraceComment), record_size);
+    ::memset(&results_, 0, sizeof(results_));
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    base::TimeTicks start = base::TimeTicks::Now();
+    if (!session_->AllocateBuffer(&segment_)) {
+      LOG(ERROR) << "Failed to allocate a trace buffer.";
+      ++results_.num_failed_exchanges;
+      return;
+    }
+
+    if (WriteRecords(start)) {
+      ++results_.num_exchanges;
+      if (!session_->ReturnBuffer(&segment_))
+        ++results_.num_failed_exchanges;
+    }
+    results_.thread_microseconds =
+        (base::TimeTicks::Now() - start).InMicroseconds();
+  }
+  // @}
+
+  // @returns the results of the thread. They are only complete once the
+  //     thread has been joined.
+  const ClientResults& results() const { return results_; }
+
+ private:
+  // Writes records at the requested rate until the duration has elapsed.
+  // @param start The time at which the thread started.
+  // @returns true on success, false if a buffer couldn't be exchanged.
+  bool WriteRecords(base::TimeTicks start) {
+    while (true) {
+      base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+      if (elapsed >= duration_)
+        return true;
+
+      uint64 batch_end = results_.num_records + kRecordsPerBatch;
+      if (records_per_second_ > 0) {
+        uint64 due_records =
+            elapsed.InMicroseconds() * records_per_second_ / 1000000;
+        if (due_records <= results_.num_records) {
+          base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(1));
+          continue;
+        }
+        batch_end = std::min(batch_end, due_records);
+      }
+
+      while (results_.num_records < batch_end) {
+        if (!WriteRecord())
+          return false;
+      }
+    }
+  }
+
+  // Writes a record, exchanging the buffer if it's full.
+  // @returns true on success, false if the buffer couldn't be exchanged.
+  bool WriteRecord() {
+    if (!segment_.CanAllocate(record_size_)) {
+      ++results_.num_exchanges;
+      base::TimeTicks start = base::TimeTicks::Now();
+      bool exchanged = session_->ExchangeBuffer(&segment_);
+      int64 stall = (base::TimeTicks::Now() - start).InMicroseconds();
+      results_.stall_microseconds += stall;
+      results_.max_stall_microseconds =
+          std::max(results_.max_stall_microseconds, stall);
+      if (!exchanged) {
+        LOG(ERROR) << "Failed to exchange a trace buffer.";
+        ++results_.num_failed_exchanges;
+        return false;
+      }
+      if (!segment_.CanAllocate(record_size_)) {
+        LOG(ERROR) << "The records don't fit in a trace buffer.";
+        return false;
+      }
+    }
+
+    TraceComment* comment = reinterpret_cast<TraceComment*>(
+        segment_.AllocateTraceRecordImpl(TRACE_COMMENT, record_size_));
+    DCHECK(comment != NULL);
+    comment->comment_size =
+        record_size_ - FIELD_OFFSET(TraceComment, comment);
+    ::memset(comment->comment, 'x', comment->comment_size);
+
+    ++results_.num_records;
+    results_.num_record_bytes += record_size_;
+    return true;
+  }
+
+  RpcSession* session_;
+  int records_per_second_;
+  size_t record_size_;
+  base::TimeDelta duration_;
+
+  TraceFileSegment segment_;
+  ClientResults results_;
+
+  DISALLOW_COPY_AND_ASSIGN(TracingThread);
+};
+
+}  // namespace
+
+TraceStressApp::TraceStressApp()
+    : application::AppImplBase("Trace Stress"),
+      num_processes_(1),
+      num_threads_(1),
+      records_per_second_(0),
+      record_size_(64),
+      duration_seconds_(10),
+      late_milliseconds_(100),
+      drain_timeout_seconds_(30) {
+  ::memset(&initial_statistics_, 0, sizeof(initial_statistics_));
+}
+
+void TraceStressApp::AddClientResults(const ClientResults& results,
+                                      ClientResults* total) {
+  DCHECK(total != NULL);
+
+  total->num_records += results.num_records;
+  total->num_record_bytes += results.num_record_bytes;
+  total->num_exchanges += results.num_exchanges;
+  total->num_failed_exchanges += results.num_failed_exchanges;
+  total->num_bytes_committed += results.num_bytes_committed;
+  total->stall_microseconds += results.stall_microseconds;
+  total->max_stall_microseconds = std::max(total->max_stall_microseconds,
+                                           results.max_stall_microseconds);
+  total->thread_microseconds += results.thread_microseconds;
+}
+
+uint32 TraceStressApp::CountLateBuffers(const TraceLatencyHistogram& histogram,
+                                        int64 threshold_microseconds) {
+  // Bucket 0 counts durations below 1us, and bucket i > 0 those from
+  // 2^(i-1)us.
+  uint32 num_late_buffers = 0;
+  for (size_t i = 0; i < TraceLatencyHistogram::kNumBuckets; ++i) {
+    int64 lower_bound = i == 0 ? 0 : 1LL << (i - 1);
+    if (lower_bound >= threshold_microseconds)
+      num_late_buffers += histogram.counts[i];
+  }
+  return num_late_buffers;
+}
+
+void TraceStressApp::PrintUsage(const base::FilePath& program,
+                                const base::StringPiece& message) {
+  if (!message.empty()) {
+    ::fwrite(message.data(), 1, message.length(), out());
+    ::fprintf(out(), "\n\n");
+  }
+
+  ::fprintf(out(), kUsageFormatStr, program.BaseName().value().c_str());
+}
+
+bool TraceStressApp::ParseCommandLine(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  program_ = cmd_line->GetProgram();
+  if (cmd_line->HasSwitch("help")) {
+    PrintUsage(program_, "");
+    return false;
+  }
+
+  instance_id_ = cmd_line->GetSwitchValueNative("instance-id");
+  results_path_ = cmd_line->GetSwitchValuePath(kResultsFileSwitch);
+
+  if (!GetIntSwitch(cmd_line, "processes", 1, &num_processes_)) {
+    PrintUsage(program_, "Must specify '--processes' >= 1!");
+    return false;
+  }
+  if (!GetIntSwitch(cmd_line, "threads", 1, &num_threads_)) {
+    PrintUsage(program_, "Must specify '--threads' >= 1!");
+    return false;
+  }
+  if (!GetIntSwitch(cmd_line, "rate", 0, &records_per_second_)) {
+    PrintUsage(program_, "Must specify '--rate' >= 0!");
+    return false;
+  }
+  const int kMinRecordSize = sizeof(TraceComment);
+  if (!GetIntSwitch(cmd_line, "record-size", kMinRecordSize, &record_size_)) {
+    PrintUsage(program_, base::StringPrintf(
+        "Must specify '--record-size' >= %d!", kMinRecordSize));
+    return false;
+  }
+  if (!GetIntSwitch(cmd_line, "duration", 1, &duration_seconds_)) {
+    PrintUsage(program_, "Must specify '--duration' >= 1!");
+    return false;
+  }
+  if (!GetIntSwitch(cmd_line, "late-ms", 0, &late_milliseconds_)) {
+    PrintUsage(program_, "Must specify '--late-ms' >= 0!");
+    return false;
+  }
+  if (!GetIntSwitch(cmd_line, "drain-timeout", 0, &drain_timeout_seconds_)) {
+    PrintUsage(program_, "Must specify '--drain-timeout' >= 0!");
+    return false;
+  }
+
+  return true;
+}
+
+int TraceStressApp::Run() {
+  if (!results_path_.empty())
+    return RunClient() ? 0 : 1;
+
+  if (!QueryServiceStatistics(instance_id_, &initial_statistics_))
+    return 1;
+
+  LOG(INFO) << "Running " << num_processes_ << " client processes of "
+            << num_threads_ << " threads for " << duration_seconds_
+            << " seconds.";
+  base::Time start = base::Time::NowFromSystemTime();
+  ClientResults client_results = {};
+  if (!RunClientProcesses(&client_results))
+    return 1;
+  double seconds = (base::Time::NowFromSystemTime() - start).InSecondsF();
+
+  TraceSessionStatistics service_statistics = {};
+  if (!WaitForServiceToDrain(client_results.num_bytes_committed,
+                             &service_statistics)) {
+    return 1;
+  }
+
+  PrintReport(client_results, service_statistics, seconds);
+  return 0;
+}
+
+bool TraceStressApp::RunClientProcesses(ClientResults* results) {
+  DCHECK(results != NULL);
+
+  base::ScopedTempDir temp_dir;
+  if (!temp_dir.CreateUniqueTempDir()) {
+    LOG(ERROR) << "Failed to create a temporary directory.";
+    return false;
+  }
+
+  // Start all of the clients before waiting for any of them.
+  std::vector<base::FilePath> results_paths;
+  std::vector<base::ProcessHandle> handles;
+  for (int i = 0; i < num_processes_; ++i) {
+    results_paths.push_back(
+        temp_dir.path().Append(base::StringPrintf(L"client-%d.bin", i)));
+
+    CommandLine cmd_line(program_);
+    if (!instance_id_.empty())
+      cmd_line.AppendSwitchNative("instance-id", instance_id_);
+    cmd_line.AppendSwitchASCII("threads", base::IntToString(num_threads_));
+    cmd_line.AppendSwitchASCII("rate", base::IntToString(records_per_second_));
+    cmd_line.AppendSwitchASCII("record-size", base::IntToString(record_size_));
+    cmd_line.AppendSwitchASCII("duration",
+                               base::IntToString(duration_seconds_));
+    cmd_line.AppendSwitchPath(kResultsFileSwitch, results_paths.back());
+
+    base::ProcessHandle handle = base::kNullProcessHandle;
+    if (!base::LaunchProcess(cmd_line, base::LaunchOptions(), &handle)) {
+      LOG(ERROR) << "Failed to launch client process " << i << ".";
+      break;
+    }
+    handles.push_back(handle);
+  }
+
+  bool success = handles.size() == results_paths.size();
+  ::memset(results, 0, sizeof(*results));
+  for (size_t i = 0; i < handles.size(); ++i) {
+    int exit_code = 0;
+    if (!base::WaitForExitCode(handles[i], &exit_code) || exit_code != 0) {
+      LOG(ERROR) << "Client process " << i << " failed.";
+      success = false;
+      continue;
+    }
+
+    std::string contents;
+    if (!base::ReadFileToString(results_paths[i], &contents) ||
+        contents.size() != sizeof(ClientResults)) {
+      LOG(ERROR) << "Failed to read the results of client process " << i
+                 << ".";
+      success = false;
+      continue;
+    }
+    AddClientResults(*reinterpret_cast<const ClientResults*>(contents.data()),
+                     results);
+  }
+
+  return success;
+}
+
+bool TraceStressApp::RunClient() {
+  DCHECK(!results_path_.empty());
+
+  RpcSession session;
+  session.set_instance_id(instance_id_);
+  TraceFileSegment segment;
+  if (!session.CreateSession(&segment)) {
+    LOG(ERROR) << "Failed to create a session with the call trace service.";
+    return false;
+  }
+  // The threads allocate their own buffers.
+  if (!session.ReturnBuffer(&segment)) {
+    LOG(ERROR) << "Failed to return the initial trace buffer.";
+    return false;
+  }
+
+  ScopedVector<TracingThread> tracing_threads;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (int i = 0; i < num_threads_; ++i) {
+    tracing_threads.push_back(new TracingThread(
+        &session, records_per_second_, record_size_,
+        base::TimeDelta::FromSeconds(duration_seconds_)));
+    threads.push_back(new base::DelegateSimpleThread(
+        tracing_threads.back(), "TraceStress"));
+    threads.back()->Start();
+  }
+
+  ClientResults results = {};
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    AddClientResults(tracing_threads[i]->results(), &results);
+  }
+
+  // Closing the session commits anything that's still in flight.
+  if (!session.CloseSession()) {
+    LOG(ERROR) << "Failed to close the session with the call trace service.";
+    return false;
+  }
+  TraceSessionStatistics statistics = {};
+  session.GetStatistics(&statistics);
+  results.num_bytes_committed = statistics.num_bytes_committed;
+
+  if (base::WriteFile(results_path_, reinterpret_cast<const char*>(&results),
+                      sizeof(results)) != sizeof(results)) {
+    LOG(ERROR) << "Failed to write \"" << results_path_.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool TraceStressApp::WaitForServiceToDrain(
+    uint64 num_bytes, TraceSessionStatistics* statistics) {
+  DCHECK(statistics != NULL);
+
+  // The service only counts the bytes of a buffer once it has written it.
+  base::Time deadline = base::Time::NowFromSystemTime() +
+      base::TimeDelta::FromSeconds(drain_timeout_seconds_);
+  while (true) {
+    if (!QueryServiceStatistics(instance_id_, statistics))
+      return false;
+    SubtractTraceSessionStatistics(initial_statistics_, statistics);
+    if (statistics->num_bytes_committed >= num_bytes)
+      return true;
+    if (base::Time::NowFromSystemTime() >= deadline) {
+      LOG(WARNING) << "The service hasn't written all of the buffers yet.";
+      return true;
+    }
+    base::PlatformThread::Sleep(base::TimeDelta::FromMilliseconds(100));
+  }
+}
+
+void TraceStressApp::PrintReport(
+    const ClientResults& client_results,
+    const TraceSessionStatistics& service_statistics,
+    double seconds) {
+  DCHECK_LT(0.0, seconds);
+
+  double records_per_second = client_results.num_records / seconds;
+  double bytes_per_second = service_statistics.num_bytes_committed / seconds;
+  double stall_fraction = 0.0;
+  if (client_results.thread_microseconds > 0) {
+    stall_fraction = static_cast<double>(client_results.stall_microseconds) /
+        client_results.thread_microseconds;
+  }
+  uint32 num_late_buffers = CountLateBuffers(
+      service_statistics.write_latency, late_milliseconds_ * 1000LL);
+
+  ::fprintf(out(), "Clients: %d processes of %d threads, %.2f s.\n",
+            num_processes_, num_threads_, seconds);
+  ::fprintf(out(), "Records written: %llu (%.0f/s, %llu bytes).\n",
+            client_results.num_records, records_per_second,
+            client_results.num_record_bytes);
+  ::fprintf(out(), "Buffers exchanged: %u, dropped: %u.\n",
+            client_results.num_exchanges,
+            client_results.num_failed_exchanges);
+  ::fprintf(out(), "Client stall time: %.3f s (%.2f%% of tracing time, "
+            "longest %.3f ms).\n",
+            client_results.stall_microseconds / 1e6, 100.0 * stall_fraction,
+            client_results.max_stall_microseconds / 1e3);
+  ::fprintf(out(), "Service buffers committed: %u, bytes written: %llu "
+            "(%.2f MB/s).\n",
+            service_statistics.num_buffers_committed,
+            service_statistics.num_bytes_committed,
+            bytes_per_second / (1024 * 1024));
+  ::fprintf(out(), "Service recycle stalls: %u.\n",
+            service_statistics.num_recycle_stalls);
+  ::fprintf(out(), "Buffers written late (>= %d ms): %u.\n",
+            late_milliseconds_, num_late_buffers);
+
+  testing::EmitMetric("Syzygy.TraceStress.RecordsPerSecond",
+                      records_per_second);
+  testing::EmitMetric("Syzygy.TraceStress.BytesPerSecond", bytes_per_second);
+  testing::EmitMetric("Syzygy.TraceStress.StallFraction", stall_fraction);
+  testing::EmitMetric("Syzygy.TraceStress.MaxStallMicroseconds",
+                      client_results.max_stall_microseconds);
+  testing::EmitMetric("Syzygy.TraceStress.DroppedBuffers",
+                      static_cast<uint64>(client_results.num_failed_exchanges));
+  testing::EmitMetric("Syzygy.TraceStress.RecycleStalls",
+                      static_cast<uint64>(
+                          service_statistics.num_recycle_stalls));
+  testing::EmitMetric("Syzygy.TraceStress.LateBuffers",
+                      static_cast<uint64>(num_late_buffers));
+}
+
+}  // namespace experimental
@@ -0,0 +1,141 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A command line application to load-test a running call trace service with
+// synthetic trace records, and to report the throughput it sustains.
+
+#ifndef SYZYGY_EXPERIMENTAL_TRACE_STRESS_TRACE_STRESS_APP_H_
+#define SYZYGY_EXPERIMENTAL_TRACE_STRESS_TRACE_STRESS_APP_H_
+
+#include <string>
+
+#include "base/command_line.h"
+#include "base/files/file_path.h"
+#include "syzygy/application/application.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace experimental {
+
+// This class implements the trace_stress command-line utility.
+//
+// The utility spawns copies of itself as client processes. Each of them opens
+// a session with the service and runs tracing threads that write synthetic
+// records at a controlled rate. The client processes report their
+// measurements through a results file, and the utility compares them with the
+// statistics of the service.
+//
+// See the description given in TraceStressApp:::PrintUsage() for
+// information about running this utility.
+class TraceStressApp : public application::AppImplBase {
+ public:
+  // The measurements of a client process. These are written as is to the
+  // results file of the process.
+  struct ClientResults {
+    // The number of records written, and their total size in bytes.
+    uint64 num_records;
+    uint64 num_record_bytes;
+    // The number of buffers handed to the service, and the number of
+    // exchanges that failed. The records of a failed exchange are dropped.
+    uint32 num_exchanges;
+    uint32 num_failed_exchanges;
+    // The number of bytes committed to the service, as counted by the
+    // session.
+    uint64 num_bytes_committed;
+    // The total time the tracing threads were blocked exchanging buffers, and
+    // the longest such stall.
+    int64 stall_microseconds;
+    int64 max_stall_microseconds;
+    // The time the tracing threads ran for, summed over the threads.
+    int64 thread_microseconds;
+  };
+
+  TraceStressApp();
+
+  // @name Implementation of the AppImplBase interface.
+  // @{
+  bool ParseCommandLine(const CommandLine* command_line);
+
+  int Run();
+  // @}
+
+  // Adds the measurements of a client to a total.
+  // @param results The measurements to add.
+  // @param total The total to add them to.
+  static void AddClientResults(const ClientResults& results,
+                               ClientResults* total);
+
+  // Counts the buffers of a write latency histogram that took at least a
+  // given time to be written. As the histogram has power of two buckets, the
+  // threshold is rounded up to the next bucket boundary.
+  // @param histogram The write latency histogram.
+  // @param threshold_microseconds The threshold.
+  // @returns the number of buffers that were written late.
+  static uint32 CountLateBuffers(const TraceLatencyHistogram& histogram,
+                                 int64 threshold_microseconds);
+
+ protected:
+  // Print the app's usage information.
+  void PrintUsage(const base::FilePath& program,
+                  const base::StringPiece& message);
+
+  // Runs the client processes, waits for them and aggregates their results.
+  // @param results Receives the aggregated results.
+  // @returns true on success, false otherwise.
+  bool RunClientProcesses(ClientResults* results);
+
+  // Runs the tracing threads of a client process and writes their results
+  // to results_path_.
+  // @returns true on success, false otherwise.
+  bool RunClient();
+
+  // Waits for the service to have written at least a given number of bytes
+  // since the start of the run, or for the drain timeout to expire.
+  // @param num_bytes The number of bytes.
+  // @param statistics Receives the statistics of the service.
+  // @returns true on success, false if the service couldn't be queried.
+  bool WaitForServiceToDrain(uint64 num_bytes,
+                             TraceSessionStatistics* statistics);
+
+  // Writes the report of the run to out().
+  void PrintReport(const ClientResults& client_results,
+                   const TraceSessionStatistics& service_statistics,
+                   double seconds);
+
+  // The program, used to spawn the client processes.
+  base::FilePath program_;
+
+  // @name Command-line options.
+  // @{
+  std::wstring instance_id_;
+  int num_processes_;
+  int num_threads_;
+  int records_per_second_;
+  int record_size_;
+  int duration_seconds_;
+  int late_milliseconds_;
+  int drain_timeout_seconds_;
+  // Only set in the client processes.
+  base::FilePath results_path_;
+  // @}
+
+  // The statistics of the service at the start of the run.
+  TraceSessionStatistics initial_statistics_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TraceStressApp);
+};
+
+}  // namespace experimental
+
+#endif  // SYZYGY_EXPERIMENTAL_TRACE_STRESS_TRACE_STRESS_APP_H_
@@ -16,6 +16,8 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/file_util.h"
 #include "base/strings/string_util.h"
@@ -24,13 +26,24 @@
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_com_initializer.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_symbol_record.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
 #include "syzygy/pe/dia_util.h"
 #include "syzygy/pe/find.h"
+#include "third_party/cci/Files/CvInfo.h"
 
 namespace genfilter {
 
 namespace {
 
+namespace cci = Microsoft_Cci_Pdb;
+
+typedef core::RelativeAddress RelativeAddress;
+typedef FilterCompiler::Range Range;
+
 const char kFunction[] = "function";
 const char kPublicSymbol[] = "public_symbol";
 
@@ -70,6 +83,279 @@ void TrimComment(std::string* s) {
   s->resize(comment_index);
 }
 
+// Reads a symbol of type T, followed by its zero-terminated name.
+template<typename T>
+bool ReadSymbolAndName(pdb::PdbStream* stream, T* symbol, std::string* name) {
+  DCHECK(stream != NULL);
+  DCHECK(symbol != NULL);
+  DCHECK(name != NULL);
+
+  size_t to_read = offsetof(T, name);
+  size_t bytes_read = 0;
+  if (!stream->ReadBytes(symbol, to_read, &bytes_read) ||
+      bytes_read != to_read || !pdb::ReadString(stream, name)) {
+    LOG(ERROR) << "Unable to read symbol record.";
+    return false;
+  }
+
+  return true;
+}
+
+// Reads function and public symbols straight from the streams of a PDB file.
+class PdbSymbolReader {
+ public:
+  // A symbol, and the range of the image it occupies.
+  struct Symbol {
+    std::string name;
+    Range range;
+  };
+  typedef std::vector<Symbol> Symbols;
+
+  PdbSymbolReader() { }
+
+  // Reads the PDB file, its DBI stream and its section headers.
+  // @param pdb_path The path of the PDB file to read.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& pdb_path) {
+    pdb::PdbReader pdb_reader;
+    pdb_reader.set_memory_mapped(true);
+    if (!pdb_reader.Read(pdb_path, &pdb_file_)) {
+      LOG(ERROR) << "Unable to read PDB file: " << pdb_path.value();
+      return false;
+    }
+
+    pdb::PdbStream* dbi_stream = pdb_file_.GetStream(pdb::kDbiStream);
+    if (dbi_stream == NULL || !dbi_.Read(dbi_stream)) {
+      LOG(ERROR) << "Unable to read the DBI stream of PDB file: "
+                 << pdb_path.value();
+      return false;
+    }
+
+    pdb::PdbStream* section_stream = GetStream(
+        dbi_.dbg_header().section_header);
+    if (section_stream == NULL ||
+        !section_stream->Seek(0) ||
+        !section_stream->Read(
+            &sections_,
+            section_stream->length() / sizeof(IMAGE_SECTION_HEADER))) {
+      LOG(ERROR) << "Unable to read the section headers of PDB file: "
+                 << pdb_path.value();
+      return false;
+    }
+
+    return true;
+  }
+
+  // @returns true if the PDB file has OMAP information. The addresses of the
+  //     symbols then need to be translated.
+  bool HasOmap() const {
+    return dbi_.dbg_header().omap_from_src != -1;
+  }
+
+  // Reads the functions of all of the compilands.
+  // @param functions Will receive the functions.
+  // @returns true on success, false otherwise.
+  bool ReadFunctions(Symbols* functions) {
+    DCHECK(functions != NULL);
+
+    // The compilands are read in parallel, each into its own vector, and
+    // their functions are then appended in compiland order.
+    pdb::SymbolStreamVector streams;
+    const pdb::DbiStream::DbiModuleVector& modules = dbi_.modules();
+    for (size_t i = 0; i < modules.size(); ++i) {
+      const pdb::DbiModuleInfoBase& module = modules[i].module_info_base();
+      pdb::PdbStream* stream = GetStream(module.stream);
+      if (stream == NULL || module.symbol_bytes == 0)
+        continue;
+
+      pdb::SymbolStream symbol_stream = { stream, module.symbol_bytes, true };
+      streams.push_back(symbol_stream);
+    }
+
+    std::vector<Symbols> module_functions(streams.size());
+    pdb::VisitStreamSymbolsCallback callback = base::Bind(
+        &PdbSymbolReader::OnModuleFunctionSymbol, base::Unretained(this),
+        base::Unretained(&module_functions));
+    SYSTEM_INFO system_info = {};
+    ::GetSystemInfo(&system_info);
+    if (!pdb::VisitSymbolStreams(callback, streams,
+                                 system_info.dwNumberOfProcessors)) {
+      LOG(ERROR) << "Unable to read the symbols of the compilands.";
+      return false;
+    }
+
+    for (size_t i = 0; i < module_functions.size(); ++i) {
+      functions->insert(functions->end(), module_functions[i].begin(),
+                        module_functions[i].end());
+    }
+
+    return true;
+  }
+
+  // Reads the public symbols. As these don't carry a length, public symbols
+  // sharing the address of a function are given the length of that function.
+  // Otherwise they're taken to extend up to the next public symbol in the same
+  // section, or to the end of the section.
+  // @param functions The functions, as read by ReadFunctions.
+  // @param public_symbols Will receive the public symbols.
+  // @returns true on success, false otherwise.
+  bool ReadPublicSymbols(const Symbols& functions, Symbols* public_symbols) {
+    DCHECK(public_symbols != NULL);
+
+    pdb::PdbStream* stream = GetStream(dbi_.header().symbol_record_stream);
+    if (stream == NULL) {
+      LOG(ERROR) << "Unable to find the symbol record stream.";
+      return false;
+    }
+
+    pdb::VisitSymbolsCallback callback = base::Bind(
+        &PdbSymbolReader::OnPublicSymbol, base::Unretained(this),
+        base::Unretained(public_symbols));
+    if (!stream->Seek(0) ||
+        !pdb::VisitSymbols(callback, stream->length(), false, stream)) {
+      LOG(ERROR) << "Unable to read the symbol record stream.";
+      return false;
+    }
+
+    std::map<RelativeAddress, size_t> function_lengths;
+    for (size_t i = 0; i < functions.size(); ++i) {
+      function_lengths.insert(std::make_pair(functions[i].range.start(),
+                                             functions[i].range.size()));
+    }
+
+    // The public symbols are read with an empty range ending at the end of
+    // their section. Sort them by address to fill in their lengths.
+    std::stable_sort(public_symbols->begin(), public_symbols->end(),
+                     &SymbolStartsBefore);
+    for (size_t i = 0; i < public_symbols->size(); ++i) {
+      Symbol& symbol = (*public_symbols)[i];
+      RelativeAddress start = symbol.range.start();
+      RelativeAddress end = symbol.range.end();
+
+      std::map<RelativeAddress, size_t>::const_iterator function_it =
+          function_lengths.find(start);
+      if (function_it != function_lengths.end()) {
+        end = start + function_it->second;
+      } else {
+        for (size_t j = i + 1; j < public_symbols->size(); ++j) {
+          RelativeAddress next = (*public_symbols)[j].range.start();
+          if (next > start) {
+            end = std::min(end, next);
+            break;
+          }
+        }
+      }
+
+      symbol.range = Range(start, end - start);
+    }
+
+    return true;
+  }
+
+ private:
+  // Returns the stream with the given index, or NULL if there is none.
+  pdb::PdbStream* GetStream(int16 index) {
+    if (index < 0 || static_cast<size_t>(index) >= pdb_file_.StreamCount())
+      return NULL;
+    return pdb_file_.GetStream(index);
+  }
+
+  // Translates a section and offset to a relative address. Also returns the
+  // end of the section. Returns false for symbols that don't live in a
+  // section.
+  bool Translate(uint16 section, uint32 offset,
+                 RelativeAddress* addr, RelativeAddress* section_end) const {
+    DCHECK(addr != NULL);
+    DCHECK(section_end != NULL);
+
+    // Sections are numbered from 1.
+    if (section == 0 || section > sections_.size())
+      return false;
+
+    const IMAGE_SECTION_HEADER& header = sections_[section - 1];
+    *addr = RelativeAddress(header.VirtualAddress + offset);
+    *section_end = RelativeAddress(header.VirtualAddress +
+                                   header.Misc.VirtualSize);
+    return true;
+  }
+
+  bool OnFunctionSymbol(Symbols* functions,
+                        uint16 symbol_length,
+                        uint16 symbol_type,
+                        pdb::PdbStream* stream) {
+    DCHECK(functions != NULL);
+
+    if (symbol_type != cci::S_GPROC32 && symbol_type != cci::S_LPROC32 &&
+        symbol_type != cci::S_GPROC32_VS2013 &&
+        symbol_type != cci::S_LPROC32_VS2013) {
+      return true;
+    }
+
+    cci::ProcSym32 proc = {};
+    Symbol symbol;
+    if (!ReadSymbolAndName(stream, &proc, &symbol.name))
+      return false;
+
+    RelativeAddress addr;
+    RelativeAddress section_end;
+    if (!Translate(proc.seg, proc.off, &addr, &section_end))
+      return true;
+
+    symbol.range = Range(addr, proc.len);
+    functions->push_back(symbol);
+    return true;
+  }
+
+  bool OnModuleFunctionSymbol(std::vector<Symbols>* module_functions,
+                              size_t module_index,
+                              uint16 symbol_length,
+                              uint16 symbol_type,
+                              pdb::PdbStream* stream) {
+    DCHECK(module_functions != NULL);
+    DCHECK_GT(module_functions->size(), module_index);
+
+    return OnFunctionSymbol(&(*module_functions)[module_index], symbol_length,
+                            symbol_type, stream);
+  }
+
+  bool OnPublicSymbol(Symbols* public_symbols,
+                      uint16 symbol_length,
+                      uint16 symbol_type,
+                      pdb::PdbStream* stream) {
+    DCHECK(public_symbols != NULL);
+
+    if (symbol_type != cci::S_PUB32)
+      return true;
+
+    cci::PubSym32 pub = {};
+    Symbol symbol;
+    if (!ReadSymbolAndName(stream, &pub, &symbol.name))
+      return false;
+
+    RelativeAddress addr;
+    RelativeAddress section_end;
+    if (!Translate(pub.seg, pub.off, &addr, &section_end) ||
+        addr >= section_end) {
+      return true;
+    }
+
+    symbol.range = Range(addr, section_end - addr);
+    public_symbols->push_back(symbol);
+    return true;
+  }
+
+  static bool SymbolStartsBefore(const Symbol& symbol1,
+                                 const Symbol& symbol2) {
+    return symbol1.range.start() < symbol2.range.start();
+  }
+
+  pdb::PdbFile pdb_file_;
+  pdb::DbiStream dbi_;
+  std::vector<IMAGE_SECTION_HEADER> sections_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbSymbolReader);
+};
+
 }  // namespace
 
 bool FilterCompiler::Init(const base::FilePath& image_path) {
@@ -239,7 +525,9 @@ bool FilterCompiler::AddRule(ModificationType modification_type,
       rule_map_.insert(std::make_pair(index, rule)).first;
   Rule* rule_ptr = &rule_it->second;
 
-  // Update the vectors of rules by type.
+  // Update the vectors of rules by type, and the matching prefilter.
+  prefilters_[rule_type].AddRegex(rules_by_type_[rule_type].size(),
+                                  description);
   rules_by_type_[rule_type].push_back(rule_ptr);
 
   return true;
@@ -250,6 +538,50 @@ bool FilterCompiler::CrawlSymbols() {
   if (rule_map_.empty())
     return true;
 
+  bool crawled = false;
+  if (!CrawlPdbSymbols(&crawled))
+    return false;
+  if (crawled)
+    return true;
+
+  LOG(INFO) << "PDB file has OMAP information, crawling symbols via DIA.";
+  return CrawlDiaSymbols();
+}
+
+bool FilterCompiler::CrawlPdbSymbols(bool* crawled) {
+  DCHECK(crawled != NULL);
+
+  *crawled = false;
+  PdbSymbolReader reader;
+  if (!reader.Init(pdb_path_))
+    return false;
+  if (reader.HasOmap())
+    return true;
+
+  // The functions are also needed to get the lengths of the public symbols.
+  PdbSymbolReader::Symbols functions;
+  if (!reader.ReadFunctions(&functions))
+    return false;
+  for (size_t i = 0; i < functions.size(); ++i) {
+    MatchRulesBySymbolName(kFunctionRule, functions[i].name,
+                           functions[i].range);
+  }
+
+  if (!rules_by_type_[kPublicSymbolRule].empty()) {
+    PdbSymbolReader::Symbols public_symbols;
+    if (!reader.ReadPublicSymbols(functions, &public_symbols))
+      return false;
+    for (size_t i = 0; i < public_symbols.size(); ++i) {
+      MatchRulesBySymbolName(kPublicSymbolRule, public_symbols[i].name,
+                             public_symbols[i].range);
+    }
+  }
+
+  *crawled = true;
+  return true;
+}
+
+bool FilterCompiler::CrawlDiaSymbols() {
   base::win::ScopedComPtr<IDiaDataSource> data_source;
   if (!pe::CreateDiaSource(data_source.Receive()))
     return false;
@@ -335,20 +667,20 @@ bool FilterCompiler::OnCompiland(IDiaSymbol* compiland) {
 
 bool FilterCompiler::OnFunction(IDiaSymbol* function) {
   DCHECK(function != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kFunctionRule], function))
+  if (!MatchRulesByDiaSymbolName(kFunctionRule, function))
     return false;
   return true;
 }
 
 bool FilterCompiler::OnPublicSymbol(IDiaSymbol* public_symbol) {
   DCHECK(public_symbol != NULL);
-  if (!MatchRulesBySymbolName(rules_by_type_[kPublicSymbolRule], public_symbol))
+  if (!MatchRulesByDiaSymbolName(kPublicSymbolRule, public_symbol))
     return false;
   return true;
 }
 
-bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
-                                            IDiaSymbol* symbol) {
+bool FilterCompiler::MatchRulesByDiaSymbolName(RuleType rule_type,
+                                               IDiaSymbol* symbol) {
   DCHECK(symbol != NULL);
 
   // Get the symbol properties.
@@ -372,15 +704,30 @@ bool FilterCompiler::MatchRulesBySymbolName(const RulePointers& rules,
     return false;
   }
 
-  // Look for any matching rules and update the associated image ranges.
-  RulePointers::const_iterator it = rules.begin();
-  for (; it != rules.end(); ++it) {
-    Rule* rule = *it;
-    if (rule->regex.FullMatch(name))
-      rule->ranges.Mark(Range(RelativeAddress(rva), length));
-  }
+  MatchRulesBySymbolName(rule_type, name,
+                         Range(RelativeAddress(rva), length));
 
   return true;
 }
 
+void FilterCompiler::MatchRulesBySymbolName(RuleType rule_type,
+                                            const std::string& name,
+                                            const Range& range) {
+  DCHECK_LE(0, rule_type);
+  DCHECK_GT(kRuleTypeCount, rule_type);
+
+  const RulePointers& rules = rules_by_type_[rule_type];
+  if (rules.empty())
+    return;
+
+  // Look for any matching rules and update the associated image ranges. Only
+  // the rules that can possibly match need to be inspected.
+  prefilters_[rule_type].GetCandidates(name, &candidate_rules_);
+  for (size_t i = 0; i < candidate_rules_.size(); ++i) {
+    Rule* rule = rules[candidate_rules_[i]];
+    if (rule->regex.FullMatch(name))
+      rule->ranges.Mark(range);
+  }
+}
+
 }  // namespace genfilter
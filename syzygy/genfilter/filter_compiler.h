@@ -34,6 +34,11 @@
 //                  name.
 //
 // Comments may be specified using the '#' character.
+//
+// The symbols are read straight from the streams of the PDB file, falling
+// back to DIA for PDB files with OMAP information. To keep this fast with many
+// rules, each symbol name is only run against the rules whose regex can
+// possibly match it, as determined by a RegexPrefilter.
 
 #ifndef SYZYGY_GENFILTER_FILTER_COMPILER_H_
 #define SYZYGY_GENFILTER_FILTER_COMPILER_H_
@@ -42,6 +47,7 @@
 #include <map>
 
 #include "pcrecpp.h"  // NOLINT
+#include "syzygy/genfilter/regex_prefilter.h"
 #include "syzygy/pe/image_filter.h"
 
 namespace genfilter {
@@ -134,11 +140,24 @@ class FilterCompiler {
                const base::StringPiece& description,
                const base::StringPiece& source_info);
 
-  // Crawls the symbols matching rules. Delegates to the various symbol
-  // visitors.
+  // Crawls the symbols matching rules. Reads them from the PDB streams if
+  // possible, from DIA otherwise.
   // @returns true on success, false otherwise.
   bool CrawlSymbols();
 
+  // Crawls the symbols matching rules straight from the PDB streams. This
+  // can't translate addresses via OMAP, so it bails on PDB files that have
+  // OMAP information.
+  // @param crawled Will be set to true if the symbols were crawled, false if
+  //     the PDB file has OMAP information.
+  // @returns true on success, false otherwise.
+  bool CrawlPdbSymbols(bool* crawled);
+
+  // Crawls the symbols matching rules via DIA. Delegates to the various
+  // symbol visitors.
+  // @returns true on success, false otherwise.
+  bool CrawlDiaSymbols();
+
   // Fills in the filter using cached symbol match data in the rules.
   // @param filter The filter to be filled in.
   bool FillFilter(ImageFilter* filter);
@@ -150,11 +169,20 @@ class FilterCompiler {
   bool OnPublicSymbol(IDiaSymbol* public_symbol);
   // @}
 
-  // Matches a symbol by name against rules in the given vector. Called by
-  // OnPublicSymbol and OnFunction.
-  // @param rules The vector of rules to be inspected for a symbol match.
+  // Matches a DIA symbol by name against the rules of the given type. Called
+  // by OnPublicSymbol and OnFunction.
+  // @param rule_type The type of rules to be inspected for a symbol match.
   // @param symbol The symbol to inspect.
-  bool MatchRulesBySymbolName(const RulePointers& rules, IDiaSymbol* symbol);
+  bool MatchRulesByDiaSymbolName(RuleType rule_type, IDiaSymbol* symbol);
+
+  // Matches a symbol by name against the rules of the given type, marking its
+  // range in those that match.
+  // @param rule_type The type of rules to be inspected for a symbol match.
+  // @param name The name of the symbol.
+  // @param range The range of the image occupied by the symbol.
+  void MatchRulesBySymbolName(RuleType rule_type,
+                              const std::string& name,
+                              const Range& range);
 
   base::FilePath image_path_;
   base::FilePath pdb_path_;
@@ -168,6 +196,13 @@ class FilterCompiler {
   // symbols
   RulePointers rules_by_type_[kRuleTypeCount];
 
+  // Prefilters for the rules of each type. The IDs of the regexes are their
+  // indices in rules_by_type_.
+  RegexPrefilter prefilters_[kRuleTypeCount];
+
+  // Used as scratch space by MatchRulesBySymbolName.
+  std::vector<size_t> candidate_rules_;
+
   DISALLOW_COPY_AND_ASSIGN(FilterCompiler);
 };
 
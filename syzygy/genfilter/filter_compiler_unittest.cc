@@ -30,6 +30,8 @@ class TestFilterCompiler : public FilterCompiler {
   using FilterCompiler::RuleMap;
   using FilterCompiler::RulePointers;
 
+  using FilterCompiler::CrawlDiaSymbols;
+  using FilterCompiler::CrawlPdbSymbols;
   using FilterCompiler::rule_map_;
   using FilterCompiler::rules_by_type_;
 
@@ -252,4 +254,51 @@ TEST_F(FilterCompilerTest, Compile) {
   EXPECT_LT(0u, filter.filter.size());
 }
 
+TEST_F(FilterCompilerTest, PdbAndDiaCrawlsMatch) {
+  static const char* kFunctionRules[] = {
+      "DllMain", ".*function.*", "ThisFunctionDoesNotExist" };
+
+  TestFilterCompiler pdb_fc;
+  TestFilterCompiler dia_fc;
+  ASSERT_TRUE(pdb_fc.Init(test_dll_, test_dll_pdb_));
+  ASSERT_TRUE(dia_fc.Init(test_dll_, test_dll_pdb_));
+  for (size_t i = 0; i < arraysize(kFunctionRules); ++i) {
+    ASSERT_TRUE(pdb_fc.AddRule(FilterCompiler::kAddToFilter,
+                               FilterCompiler::kFunctionRule,
+                               kFunctionRules[i]));
+    ASSERT_TRUE(dia_fc.AddRule(FilterCompiler::kAddToFilter,
+                               FilterCompiler::kFunctionRule,
+                               kFunctionRules[i]));
+  }
+  ASSERT_TRUE(pdb_fc.AddRule(FilterCompiler::kSubtractFromFilter,
+                             FilterCompiler::kPublicSymbolRule,
+                             "\\?function1.*"));
+  ASSERT_TRUE(dia_fc.AddRule(FilterCompiler::kSubtractFromFilter,
+                             FilterCompiler::kPublicSymbolRule,
+                             "\\?function1.*"));
+
+  bool crawled = false;
+  ASSERT_TRUE(pdb_fc.CrawlPdbSymbols(&crawled));
+  ASSERT_TRUE(crawled);
+  ASSERT_TRUE(dia_fc.CrawlDiaSymbols());
+
+  // The functions should be found at the same places.
+  for (size_t i = 0; i < arraysize(kFunctionRules); ++i)
+    EXPECT_EQ(dia_fc.rule(i).ranges, pdb_fc.rule(i).ranges);
+  EXPECT_LT(0u, pdb_fc.rule(0).ranges.size());
+  EXPECT_LT(0u, pdb_fc.rule(1).ranges.size());
+  EXPECT_EQ(0u, pdb_fc.rule(2).ranges.size());
+
+  // Public symbols carry no length in the PDB, so only their addresses are
+  // expected to match.
+  const FilterCompiler::RelativeAddressFilter& pdb_ranges =
+      pdb_fc.rule(3).ranges;
+  const FilterCompiler::RelativeAddressFilter& dia_ranges =
+      dia_fc.rule(3).ranges;
+  ASSERT_LT(0u, dia_ranges.size());
+  ASSERT_LT(0u, pdb_ranges.size());
+  EXPECT_EQ(dia_ranges.marked_ranges().begin()->start(),
+            pdb_ranges.marked_ranges().begin()->start());
+}
+
 }  // namespace genfilter
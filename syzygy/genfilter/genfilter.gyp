@@ -25,10 +25,13 @@
         'filter_compiler.h',
         'genfilter_app.cc',
         'genfilter_app.h',
+        'regex_prefilter.cc',
+        'regex_prefilter.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/application/application.gyp:application_lib',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
       ],
     },
@@ -49,6 +52,7 @@
       'sources': [
         'filter_compiler_unittest.cc',
         'genfilter_app_unittest.cc',
+        'regex_prefilter_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
       'dependencies': [
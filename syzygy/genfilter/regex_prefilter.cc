@@ -0,0 +1,187 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/genfilter/regex_prefilter.h"
+
+#include <ctype.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace genfilter {
+
+namespace {
+
+// Returns true if @p c has a special meaning when not escaped.
+bool IsMetaCharacter(char c) {
+  switch (c) {
+    case '.':
+    case '[':
+    case ']':
+    case '(':
+    case ')':
+    case '^':
+    case '$':
+    case '|':
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case '}':
+    case '\\':
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Returns true if the regex contains an alternation at the top level, ie: one
+// that isn't nested in a group.
+bool HasTopLevelAlternation(const base::StringPiece& regex) {
+  size_t depth = 0;
+  bool in_class = false;
+  for (size_t i = 0; i < regex.size(); ++i) {
+    char c = regex[i];
+    if (c == '\\') {
+      // Skip the escaped character.
+      ++i;
+      continue;
+    }
+
+    if (in_class) {
+      if (c == ']')
+        in_class = false;
+      continue;
+    }
+
+    switch (c) {
+      case '[':
+        in_class = true;
+        // A leading ']' is part of the class.
+        if (i + 1 < regex.size() && regex[i + 1] == ']')
+          ++i;
+        break;
+
+      case '(':
+        ++depth;
+        break;
+
+      case ')':
+        if (depth > 0)
+          --depth;
+        break;
+
+      case '|':
+        if (depth == 0)
+          return true;
+        break;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace
+
+RegexPrefilter::RegexPrefilter() : nodes_(1) {
+}
+
+void RegexPrefilter::AddRegex(size_t id, const base::StringPiece& regex) {
+  std::string prefix = GetLiteralPrefix(regex);
+
+  size_t node = 0;
+  for (size_t i = 0; i < prefix.size(); ++i) {
+    std::map<char, size_t>::const_iterator it =
+        nodes_[node].children.find(prefix[i]);
+    if (it != nodes_[node].children.end()) {
+      node = it->second;
+      continue;
+    }
+
+    // Add a new child. This may reallocate the nodes, so nothing refers to
+    // them across this.
+    size_t child = nodes_.size();
+    nodes_.push_back(Node());
+    nodes_[node].children[prefix[i]] = child;
+    node = child;
+  }
+
+  nodes_[node].ids.push_back(id);
+}
+
+void RegexPrefilter::GetCandidates(const base::StringPiece& str,
+                                   std::vector<size_t>* ids) const {
+  DCHECK(ids != NULL);
+
+  ids->clear();
+  size_t node = 0;
+  size_t i = 0;
+  while (true) {
+    ids->insert(ids->end(), nodes_[node].ids.begin(), nodes_[node].ids.end());
+    if (i == str.size())
+      break;
+
+    std::map<char, size_t>::const_iterator it =
+        nodes_[node].children.find(str[i]);
+    if (it == nodes_[node].children.end())
+      break;
+    node = it->second;
+    ++i;
+  }
+
+  std::sort(ids->begin(), ids->end());
+}
+
+std::string RegexPrefilter::GetLiteralPrefix(const base::StringPiece& regex) {
+  std::string prefix;
+  if (HasTopLevelAlternation(regex))
+    return prefix;
+
+  size_t i = 0;
+  while (i < regex.size()) {
+    char c = regex[i];
+    size_t next = i + 1;
+    if (c == '\\') {
+      // An escaped alphanumeric character is a character class, a back
+      // reference, etc. Anything else stands for itself.
+      if (next == regex.size() || ::isalnum(static_cast<uint8>(regex[next])))
+        break;
+      c = regex[next];
+      ++next;
+    } else if (IsMetaCharacter(c)) {
+      break;
+    }
+
+    // A quantifier that allows zero occurrences makes this character optional.
+    // Any other quantifier ends the literal prefix after it.
+    if (next < regex.size()) {
+      char quantifier = regex[next];
+      if (quantifier == '*' || quantifier == '?' || quantifier == '{')
+        break;
+      if (quantifier == '+') {
+        prefix.push_back(c);
+        break;
+      }
+    }
+
+    prefix.push_back(c);
+    i = next;
+  }
+
+  return prefix;
+}
+
+}  // namespace genfilter
@@ -0,0 +1,75 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares RegexPrefilter, which quickly narrows down the set of regexes that
+// can possibly fully match a given string.
+//
+// Each regex is reduced to the literal prefix that any string it fully matches
+// must start with, and the prefixes are stored in a trie. The candidates for a
+// string are then found with a single walk down the trie, and only those need
+// to be run. Regexes that have no literal prefix (ie: they start with a
+// wildcard, a character class, a group, etc) are candidates for every string.
+
+#ifndef SYZYGY_GENFILTER_REGEX_PREFILTER_H_
+#define SYZYGY_GENFILTER_REGEX_PREFILTER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/string_piece.h"
+
+namespace genfilter {
+
+class RegexPrefilter {
+ public:
+  RegexPrefilter();
+
+  // Adds a regex to the prefilter.
+  // @param id The ID of the regex. This is what is returned for candidate
+  //     matches.
+  // @param regex The regex pattern.
+  void AddRegex(size_t id, const base::StringPiece& regex);
+
+  // Gets the IDs of the regexes that may fully match the given string. These
+  // are returned in increasing order.
+  // @param str The string to be matched.
+  // @param ids Will receive the IDs of the candidate regexes.
+  void GetCandidates(const base::StringPiece& str,
+                     std::vector<size_t>* ids) const;
+
+  // Returns the literal prefix of the strings matched by a regex. This errs
+  // on the side of caution, returning an empty string whenever it's not sure.
+  // @param regex The regex pattern.
+  // @returns the literal prefix of the strings matched by @p regex.
+  static std::string GetLiteralPrefix(const base::StringPiece& regex);
+
+ private:
+  // A node of the trie. The root node is at index 0.
+  struct Node {
+    // The children of this node, by character.
+    std::map<char, size_t> children;
+    // The IDs of the regexes whose literal prefix ends at this node.
+    std::vector<size_t> ids;
+  };
+
+  std::vector<Node> nodes_;
+
+  DISALLOW_COPY_AND_ASSIGN(RegexPrefilter);
+};
+
+}  // namespace genfilter
+
+#endif  // SYZYGY_GENFILTER_REGEX_PREFILTER_H_
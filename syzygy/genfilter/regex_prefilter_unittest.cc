@@ -0,0 +1,67 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/genfilter/regex_prefilter.h"
+
+#include "gtest/gtest.h"
+
+namespace genfilter {
+
+TEST(RegexPrefilterTest, GetLiteralPrefix) {
+  EXPECT_EQ("", RegexPrefilter::GetLiteralPrefix(""));
+  EXPECT_EQ("DllMain", RegexPrefilter::GetLiteralPrefix("DllMain"));
+  EXPECT_EQ("foo::", RegexPrefilter::GetLiteralPrefix("foo::.*"));
+  EXPECT_EQ("?function1",
+            RegexPrefilter::GetLiteralPrefix("\\?function1.*"));
+  EXPECT_EQ("fo", RegexPrefilter::GetLiteralPrefix("foo?bar"));
+  EXPECT_EQ("fo", RegexPrefilter::GetLiteralPrefix("foo*bar"));
+  EXPECT_EQ("fo", RegexPrefilter::GetLiteralPrefix("foo{0,2}bar"));
+  EXPECT_EQ("foo", RegexPrefilter::GetLiteralPrefix("foo+bar"));
+  EXPECT_EQ("foo", RegexPrefilter::GetLiteralPrefix("foo(bar|baz)"));
+  EXPECT_EQ("foo", RegexPrefilter::GetLiteralPrefix("foo[|]"));
+  EXPECT_EQ("foo", RegexPrefilter::GetLiteralPrefix("foo\\d+"));
+  EXPECT_EQ("", RegexPrefilter::GetLiteralPrefix("foo|bar"));
+  EXPECT_EQ("", RegexPrefilter::GetLiteralPrefix(".*foo"));
+  EXPECT_EQ("", RegexPrefilter::GetLiteralPrefix("(?i)foo"));
+  EXPECT_EQ("", RegexPrefilter::GetLiteralPrefix("^foo"));
+  EXPECT_EQ("", RegexPrefilter::GetLiteralPrefix("[fF]oo"));
+}
+
+TEST(RegexPrefilterTest, GetCandidates) {
+  RegexPrefilter prefilter;
+  prefilter.AddRegex(0, "foo::.*");
+  prefilter.AddRegex(1, ".*bar");
+  prefilter.AddRegex(2, "foo::bar");
+  prefilter.AddRegex(3, "baz");
+  prefilter.AddRegex(4, "fo+");
+
+  std::vector<size_t> ids;
+  prefilter.GetCandidates("foo::bar", &ids);
+  ASSERT_EQ(4u, ids.size());
+  EXPECT_EQ(0u, ids[0]);
+  EXPECT_EQ(1u, ids[1]);
+  EXPECT_EQ(2u, ids[2]);
+  EXPECT_EQ(4u, ids[3]);
+
+  prefilter.GetCandidates("baz", &ids);
+  ASSERT_EQ(2u, ids.size());
+  EXPECT_EQ(1u, ids[0]);
+  EXPECT_EQ(3u, ids[1]);
+
+  prefilter.GetCandidates("", &ids);
+  ASSERT_EQ(1u, ids.size());
+  EXPECT_EQ(1u, ids[0]);
+}
+
+}  // namespace genfilter
@@ -17,8 +17,10 @@
 
 #include "syzygy/grinder/basic_block_util.h"
 
+#include <emmintrin.h>
 #include <algorithm>
 #include <functional>
+#include <limits>
 
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
@@ -29,6 +31,77 @@
 namespace grinder {
 namespace basic_block_util {
 
+namespace {
+
+const uint32 kMaxCount = std::numeric_limits<EntryCountType>::max();
+
+// Clamps each of the 32-bit lanes of @p value to kMaxCount. Lanes with the
+// top bit set are greater than kMaxCount: the arithmetic shift turns them
+// into all ones, which the mask then brings down to kMaxCount.
+inline __m128i ClampCounts(__m128i value, __m128i max_count) {
+  return _mm_and_si128(_mm_or_si128(value, _mm_srai_epi32(value, 31)),
+                       max_count);
+}
+
+// Adds 4 values, which are already clamped, to the 4 counts at @p counts.
+// Two clamped values can't overflow 32 bits, so a plain addition followed by
+// a clamp saturates the sum.
+inline void AddCounts(__m128i values, __m128i max_count, uint32* counts) {
+  __m128i* p = reinterpret_cast<__m128i*>(counts);
+  __m128i sum = _mm_add_epi32(_mm_loadu_si128(p), values);
+  _mm_storeu_si128(p, ClampCounts(sum, max_count));
+}
+
+inline void AddCount(uint32 value, uint32* count) {
+  value = std::min(value, kMaxCount);
+  *count += std::min(value, kMaxCount - *count);
+}
+
+void AccumulateUint8(const uint8* values, size_t length, uint32* counts) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max_count = _mm_set1_epi32(kMaxCount);
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    // Widen 16 values to 4 vectors of 32-bit values, which can't exceed
+    // kMaxCount.
+    __m128i v8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    __m128i lo16 = _mm_unpacklo_epi8(v8, zero);
+    __m128i hi16 = _mm_unpackhi_epi8(v8, zero);
+    AddCounts(_mm_unpacklo_epi16(lo16, zero), max_count, counts + i);
+    AddCounts(_mm_unpackhi_epi16(lo16, zero), max_count, counts + i + 4);
+    AddCounts(_mm_unpacklo_epi16(hi16, zero), max_count, counts + i + 8);
+    AddCounts(_mm_unpackhi_epi16(hi16, zero), max_count, counts + i + 12);
+  }
+  for (; i < length; ++i)
+    AddCount(values[i], counts + i);
+}
+
+void AccumulateUint16(const uint16* values, size_t length, uint32* counts) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max_count = _mm_set1_epi32(kMaxCount);
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m128i v16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    AddCounts(_mm_unpacklo_epi16(v16, zero), max_count, counts + i);
+    AddCounts(_mm_unpackhi_epi16(v16, zero), max_count, counts + i + 4);
+  }
+  for (; i < length; ++i)
+    AddCount(values[i], counts + i);
+}
+
+void AccumulateUint32(const uint32* values, size_t length, uint32* counts) {
+  const __m128i max_count = _mm_set1_epi32(kMaxCount);
+  size_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m128i v32 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+    AddCounts(ClampCounts(v32, max_count), max_count, counts + i);
+  }
+  for (; i < length; ++i)
+    AddCount(values[i], counts + i);
+}
+
+}  // namespace
+
 bool ModuleIdentityComparator::operator()(
     const ModuleInformation& lhs, const ModuleInformation& rhs) {
   if (lhs.module_size < rhs.module_size)
@@ -235,7 +308,8 @@ uint32 GetFrequency(const TraceIndexedFrequencyData* data,
 
   DCHECK(data->data_type == common::IndexedFrequencyData::BASIC_BLOCK_ENTRY ||
          data->data_type == common::IndexedFrequencyData::BRANCH ||
-         data->data_type == common::IndexedFrequencyData::COVERAGE);
+         data->data_type == common::IndexedFrequencyData::COVERAGE ||
+         data->data_type == common::IndexedFrequencyData::JUMP_TABLE);
 
   size_t offset = bb_id * data->num_columns + column;
   switch (data->frequency_size) {
@@ -251,5 +325,36 @@ uint32 GetFrequency(const TraceIndexedFrequencyData* data,
   return 0;
 }
 
+void AccumulateFrequencies(const TraceIndexedFrequencyData* data,
+                           std::vector<uint32>* counts) {
+  DCHECK(data != NULL);
+  DCHECK(counts != NULL);
+  DCHECK(IsValidFrequencySize(data->frequency_size));
+
+  // The values of all columns are contiguous, so they're summed as a single
+  // flat array whatever the number of columns.
+  size_t length = data->num_entries * data->num_columns;
+  DCHECK_EQ(length, counts->size());
+  if (length == 0)
+    return;
+
+  uint32* count_data = &counts->at(0);
+  switch (data->frequency_size) {
+    case 1:
+      AccumulateUint8(data->frequency_data, length, count_data);
+      return;
+    case 2:
+      AccumulateUint16(reinterpret_cast<const uint16*>(data->frequency_data),
+                       length, count_data);
+      return;
+    case 4:
+      AccumulateUint32(reinterpret_cast<const uint32*>(data->frequency_data),
+                       length, count_data);
+      return;
+  }
+
+  NOTREACHED();
+}
+
 }  // namespace basic_block_util
 }  // namespace grinder
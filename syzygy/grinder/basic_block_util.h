@@ -135,6 +135,16 @@ uint32 GetFrequency(const TraceIndexedFrequencyData* data,
                     size_t bb_id,
                     size_t column);
 
+// Adds all of the frequency values contained in @p data to @p counts, using
+// saturation arithmetic. Counts saturate at the maximum EntryCountType, as do
+// the values that don't fit in one. The common frequency sizes are handled
+// with SIMD kernels rather than one GetFrequency call per value.
+// @param data the frequency data to accumulate.
+// @param counts the counters to update. They are laid out like the values in
+//     @p data, so there are num_entries * num_columns of them.
+void AccumulateFrequencies(const TraceIndexedFrequencyData* data,
+                           std::vector<uint32>* counts);
+
 }  // namespace basic_block_util
 }  // namespace grinder
 
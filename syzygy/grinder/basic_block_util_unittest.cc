@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/basic_block_util.h"
 
+#include <limits>
+
 #include "base/files/scoped_temp_dir.h"
 #include "base/win/scoped_com_initializer.h"
 #include "gmock/gmock.h"
@@ -47,6 +49,7 @@ class TestGrinder : public GrinderInterface {
     ASSERT_TRUE(parser != NULL);
     parser_ = parser;
   }
+  virtual bool Merge(GrinderInterface*) OVERRIDE { return true; }
   virtual bool Grind() OVERRIDE { return true; }
   virtual bool OutputData(FILE*) OVERRIDE { return true; }
   // @}
@@ -352,5 +355,44 @@ TEST(GrinderBasicBlockUtilTest, GetFrequencyWithColumns) {
   EXPECT_EQ(0x77665544, GetFrequency(data, 0x0, 1));
 }
 
+TEST(GrinderBasicBlockUtilTest, AccumulateFrequencies) {
+  // Enough counter data for each frequency size to go through the vectorized
+  // loops as well as the scalar tail. The high bytes make some of the 4-byte
+  // values too large for an EntryCountType.
+  static const size_t kDataSize = 40;
+  uint8 buffer[sizeof(TraceIndexedFrequencyData) + kDataSize - 1] = {};
+  TraceIndexedFrequencyData* data =
+      reinterpret_cast<TraceIndexedFrequencyData*>(buffer);
+  for (size_t i = 0; i < kDataSize; ++i)
+    data->frequency_data[i] = static_cast<uint8>(i * 37 + 0x80);
+  data->num_columns = 2;
+  data->data_type = common::IndexedFrequencyData::BRANCH;
+
+  const uint32 kMaxCount = std::numeric_limits<EntryCountType>::max();
+  static const size_t kFrequencySizes[] = { 1, 2, 4 };
+  for (size_t i = 0; i < arraysize(kFrequencySizes); ++i) {
+    data->frequency_size = kFrequencySizes[i];
+    data->num_entries = kDataSize / data->frequency_size / data->num_columns;
+
+    // Start with counts of which some are about to saturate.
+    std::vector<uint32> counts(data->num_entries * data->num_columns);
+    for (size_t j = 0; j < counts.size(); ++j)
+      counts[j] = j % 3 == 0 ? kMaxCount - j : j;
+
+    // Compute the expected results one value at a time.
+    std::vector<uint32> expected(counts);
+    for (size_t bb_id = 0; bb_id < data->num_entries; ++bb_id) {
+      for (size_t column = 0; column < data->num_columns; ++column) {
+        uint32 value = std::min(GetFrequency(data, bb_id, column), kMaxCount);
+        uint32& count = expected[bb_id * data->num_columns + column];
+        count += std::min(value, kMaxCount - count);
+      }
+    }
+
+    AccumulateFrequencies(data, &counts);
+    EXPECT_THAT(counts, testing::ContainerEq(expected));
+  }
+}
+
 }  // namespace basic_block_util
 }  // namespace grinder
@@ -0,0 +1,305 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/binary_coverage.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "base/file_util.h"
+
+namespace grinder {
+
+namespace {
+
+typedef BinaryCoverage::SourceFileCoverage SourceFileCoverage;
+
+// Identifies binary coverage files. This reads 'SZCV' in a hex dump.
+const uint32 kBinaryCoverageSignature = 0x56435A53;
+
+// The version of the serialized binary coverage. This must be incremented
+// whenever the format changes.
+const uint32 kBinaryCoverageVersion = 1;
+
+// Adds two execution counts using saturation arithmetic.
+uint32 AddExecutionCounts(uint32 count1, uint32 count2) {
+  return std::min(count1, std::numeric_limits<uint32>::max() - count2) +
+      count2;
+}
+
+// @returns the size of the bitmap of @p line_count lines.
+size_t GetBitmapSize(size_t line_count) {
+  return (line_count + 7) / 8;
+}
+
+// Sets the range of lines covered by @p coverage. Any lines it held are lost.
+void SetLineRange(size_t first_line,
+                  size_t line_count,
+                  SourceFileCoverage* coverage) {
+  DCHECK(coverage != NULL);
+  coverage->first_line = first_line;
+  coverage->execution_counts.assign(line_count, 0);
+  coverage->instrumented_lines.assign(GetBitmapSize(line_count), 0);
+}
+
+// Adds the lines of @p from to @p to, whose range must enclose the range of
+// @p from.
+void AddLines(const SourceFileCoverage& from, SourceFileCoverage* to) {
+  DCHECK(to != NULL);
+  DCHECK_LE(to->first_line, from.first_line);
+  DCHECK_LE(from.first_line + from.line_count(),
+            to->first_line + to->line_count());
+
+  size_t offset = from.first_line - to->first_line;
+  for (size_t i = 0; i < from.line_count(); ++i) {
+    to->execution_counts[offset + i] = AddExecutionCounts(
+        to->execution_counts[offset + i], from.execution_counts[i]);
+  }
+
+  // The bitmaps can be combined bytewise when they are aligned, which is
+  // always the case when merging the coverage of the same build.
+  if (offset % 8 == 0) {
+    for (size_t i = 0; i < from.instrumented_lines.size(); ++i)
+      to->instrumented_lines[offset / 8 + i] |= from.instrumented_lines[i];
+    return;
+  }
+
+  for (size_t i = 0; i < from.line_count(); ++i) {
+    if (from.IsInstrumented(i))
+      to->SetInstrumented(offset + i);
+  }
+}
+
+}  // namespace
+
+void BinaryCoverage::Init(const CoverageData& coverage_data) {
+  typedef CoverageData::SourceFileCoverageDataMap SourceFileCoverageDataMap;
+  typedef CoverageData::LineExecutionCountMap LineExecutionCountMap;
+
+  source_files_.clear();
+
+  // The map is sorted by file name, and so is the result.
+  const SourceFileCoverageDataMap& source_file_map =
+      coverage_data.source_file_coverage_data_map();
+  source_files_.reserve(source_file_map.size());
+  SourceFileCoverageDataMap::const_iterator file_it = source_file_map.begin();
+  for (; file_it != source_file_map.end(); ++file_it) {
+    const LineExecutionCountMap& lines =
+        file_it->second.line_execution_count_map;
+    if (lines.empty())
+      continue;
+
+    source_files_.push_back(SourceFileCoverage());
+    SourceFileCoverage& coverage = source_files_.back();
+    coverage.file_name = file_it->first;
+    size_t first_line = lines.begin()->first;
+    SetLineRange(first_line, lines.rbegin()->first - first_line + 1,
+                 &coverage);
+
+    LineExecutionCountMap::const_iterator line_it = lines.begin();
+    for (; line_it != lines.end(); ++line_it) {
+      size_t index = line_it->first - first_line;
+      coverage.execution_counts[index] = line_it->second;
+      coverage.SetInstrumented(index);
+    }
+  }
+}
+
+void BinaryCoverage::Merge(const BinaryCoverage& other) {
+  if (other.source_files_.empty())
+    return;
+
+  // Both lists of source files are sorted by name, so they are merged in a
+  // single pass.
+  SourceFiles merged;
+  merged.reserve(source_files_.size() + other.source_files_.size());
+  SourceFiles::const_iterator it = source_files_.begin();
+  SourceFiles::const_iterator other_it = other.source_files_.begin();
+  while (it != source_files_.end() || other_it != other.source_files_.end()) {
+    if (other_it == other.source_files_.end() ||
+        (it != source_files_.end() && it->file_name < other_it->file_name)) {
+      merged.push_back(*it);
+      ++it;
+    } else if (it == source_files_.end() ||
+               other_it->file_name < it->file_name) {
+      merged.push_back(*other_it);
+      ++other_it;
+    } else {
+      merged.push_back(*it);
+      MergeSourceFile(*other_it, &merged.back());
+      ++it;
+      ++other_it;
+    }
+  }
+
+  source_files_.swap(merged);
+}
+
+void BinaryCoverage::ToCoverageData(CoverageData* coverage_data) const {
+  DCHECK(coverage_data != NULL);
+
+  for (size_t i = 0; i < source_files_.size(); ++i) {
+    const SourceFileCoverage& coverage = source_files_[i];
+    for (size_t j = 0; j < coverage.line_count(); ++j) {
+      if (coverage.IsInstrumented(j)) {
+        coverage_data->AddLine(coverage.file_name,
+                               coverage.first_line + j,
+                               coverage.execution_counts[j]);
+      }
+    }
+  }
+}
+
+bool BinaryCoverage::SaveToFile(const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  if (!SaveToFile(file.get())) {
+    LOG(ERROR) << "Unable to write coverage to \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool BinaryCoverage::SaveToFile(FILE* file) const {
+  DCHECK(file != NULL);
+
+  core::FileOutStream out_stream(file);
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  return Save(&out_archive) && out_archive.Flush();
+}
+
+bool BinaryCoverage::LoadFromFile(const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for reading.";
+    return false;
+  }
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  if (!Load(&in_archive)) {
+    LOG(ERROR) << "Unable to read coverage from \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool BinaryCoverage::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+
+  std::vector<std::string> file_names(source_files_.size());
+  for (size_t i = 0; i < source_files_.size(); ++i)
+    file_names[i] = source_files_[i].file_name;
+
+  if (!out_archive->Save(kBinaryCoverageSignature) ||
+      !out_archive->Save(kBinaryCoverageVersion) ||
+      !out_archive->Save(file_names)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < source_files_.size(); ++i) {
+    const SourceFileCoverage& coverage = source_files_[i];
+    if (!out_archive->Save(static_cast<uint32>(coverage.first_line)) ||
+        !out_archive->Save(coverage.execution_counts) ||
+        !out_archive->Save(coverage.instrumented_lines)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BinaryCoverage::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+
+  uint32 signature = 0;
+  uint32 version = 0;
+  if (!in_archive->Load(&signature) || !in_archive->Load(&version))
+    return false;
+  if (signature != kBinaryCoverageSignature) {
+    LOG(ERROR) << "Not a binary coverage file.";
+    return false;
+  }
+  if (version != kBinaryCoverageVersion) {
+    LOG(ERROR) << "Unsupported binary coverage version " << version << ".";
+    return false;
+  }
+
+  std::vector<std::string> file_names;
+  if (!in_archive->Load(&file_names))
+    return false;
+
+  SourceFiles source_files(file_names.size());
+  for (size_t i = 0; i < source_files.size(); ++i) {
+    // Merging relies on the source files being sorted.
+    if (i > 0 && !(file_names[i - 1] < file_names[i])) {
+      LOG(ERROR) << "Binary coverage source files are not sorted.";
+      return false;
+    }
+
+    SourceFileCoverage& coverage = source_files[i];
+    coverage.file_name = file_names[i];
+    uint32 first_line = 0;
+    if (!in_archive->Load(&first_line) ||
+        !in_archive->Load(&coverage.execution_counts) ||
+        !in_archive->Load(&coverage.instrumented_lines)) {
+      return false;
+    }
+    coverage.first_line = first_line;
+
+    if (coverage.instrumented_lines.size() !=
+            GetBitmapSize(coverage.line_count())) {
+      LOG(ERROR) << "Inconsistent binary coverage for \""
+                 << coverage.file_name << "\".";
+      return false;
+    }
+  }
+
+  source_files_.swap(source_files);
+  return true;
+}
+
+void BinaryCoverage::MergeSourceFile(const SourceFileCoverage& other,
+                                     SourceFileCoverage* coverage) {
+  DCHECK(coverage != NULL);
+  DCHECK_EQ(other.file_name, coverage->file_name);
+
+  // Most often, both ranges are the same.
+  if (other.first_line >= coverage->first_line &&
+      other.first_line + other.line_count() <=
+          coverage->first_line + coverage->line_count()) {
+    AddLines(other, coverage);
+    return;
+  }
+
+  // Otherwise, the lines are moved over to a range enclosing both ranges.
+  size_t first_line = std::min(coverage->first_line, other.first_line);
+  size_t end_line = std::max(coverage->first_line + coverage->line_count(),
+                             other.first_line + other.line_count());
+  SourceFileCoverage merged;
+  merged.file_name = coverage->file_name;
+  SetLineRange(first_line, end_line - first_line, &merged);
+  AddLines(*coverage, &merged);
+  AddLines(other, &merged);
+
+  std::swap(*coverage, merged);
+}
+
+}  // namespace grinder
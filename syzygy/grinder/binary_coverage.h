@@ -0,0 +1,121 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares BinaryCoverage, a compact representation of line coverage that is
+// cheap to store and to merge.
+//
+// The coverage of each source file is stored as a dense array of execution
+// counts, covering the range of lines from the first to the last instrumented
+// one, along with a bitmap of the instrumented lines in that range. The source
+// files are sorted by name. Merging the coverage of two runs of the same build
+// thus boils down to adding the count arrays and OR-ing the bitmaps of each
+// source file, rather than parsing and aggregating text files.
+//
+// The serialized form starts with a signature and a version, followed by a
+// string table of the source file names and the coverage of each source file,
+// in the same order.
+
+#ifndef SYZYGY_GRINDER_BINARY_COVERAGE_H_
+#define SYZYGY_GRINDER_BINARY_COVERAGE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/grinder/coverage_data.h"
+
+namespace grinder {
+
+class BinaryCoverage {
+ public:
+  struct SourceFileCoverage;  // Forward declaration.
+  typedef std::vector<SourceFileCoverage> SourceFiles;
+
+  // Initializes this object with the coverage in @p coverage_data.
+  void Init(const CoverageData& coverage_data);
+
+  // Merges the coverage in @p other into this object. The execution counts
+  // are added using saturation arithmetic.
+  // @param other the coverage to be merged.
+  void Merge(const BinaryCoverage& other);
+
+  // Adds this coverage to a CoverageData object, for output to other formats.
+  // @param coverage_data the object to be populated.
+  void ToCoverageData(CoverageData* coverage_data) const;
+
+  // @name Accessors.
+  // @{
+  const SourceFiles& source_files() const { return source_files_; }
+  // @}
+
+  // @name Files.
+  // @{
+  // Saves this coverage to the file at @p path, or to @p file.
+  // @returns true on success, false otherwise.
+  bool SaveToFile(const base::FilePath& path) const;
+  bool SaveToFile(FILE* file) const;
+  // Loads this coverage from the file at @p path.
+  // @returns true on success, false otherwise.
+  bool LoadFromFile(const base::FilePath& path);
+  // @}
+
+  // @name Serialization.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+
+ protected:
+  // Merges the coverage of a source file into @p coverage.
+  static void MergeSourceFile(const SourceFileCoverage& other,
+                              SourceFileCoverage* coverage);
+
+  // The coverage of the source files, sorted by name.
+  SourceFiles source_files_;
+};
+
+// The coverage of a single source file.
+struct BinaryCoverage::SourceFileCoverage {
+  SourceFileCoverage() : first_line(0) {
+  }
+
+  // @returns the number of lines in the range covered by this object.
+  size_t line_count() const { return execution_counts.size(); }
+
+  // @returns true iff the line at @p index in the range is instrumented.
+  bool IsInstrumented(size_t index) const {
+    DCHECK_LT(index, line_count());
+    return (instrumented_lines[index / 8] & (1 << (index % 8))) != 0;
+  }
+
+  // Sets the line at @p index in the range as being instrumented.
+  void SetInstrumented(size_t index) {
+    DCHECK_LT(index, line_count());
+    instrumented_lines[index / 8] |= 1 << (index % 8);
+  }
+
+  std::string file_name;
+  // The first line of the range covered by this object.
+  size_t first_line;
+  // The execution counts of the lines of the range.
+  std::vector<uint32> execution_counts;
+  // The bitmap of the instrumented lines of the range.
+  std::vector<uint8> instrumented_lines;
+};
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_BINARY_COVERAGE_H_
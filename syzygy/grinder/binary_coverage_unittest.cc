@@ -0,0 +1,142 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/binary_coverage.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace grinder {
+
+namespace {
+
+typedef CoverageData::LineExecutionCountMap LineExecutionCountMap;
+typedef CoverageData::SourceFileCoverageDataMap SourceFileCoverageDataMap;
+
+// Returns the execution counts of @p file_name in @p coverage_data.
+LineExecutionCountMap GetLines(const CoverageData& coverage_data,
+                               const std::string& file_name) {
+  const SourceFileCoverageDataMap& source_file_map =
+      coverage_data.source_file_coverage_data_map();
+  SourceFileCoverageDataMap::const_iterator it =
+      source_file_map.find(file_name);
+  if (it == source_file_map.end())
+    return LineExecutionCountMap();
+  return it->second.line_execution_count_map;
+}
+
+}  // namespace
+
+TEST(BinaryCoverageTest, InitAndConvert) {
+  CoverageData coverage_data;
+  coverage_data.AddLine("foo.cc", 10, 1);
+  coverage_data.AddLine("foo.cc", 12, 0);
+  coverage_data.AddLine("foo.cc", 30, 7);
+  coverage_data.AddLine("bar.cc", 1, 2);
+
+  BinaryCoverage coverage;
+  coverage.Init(coverage_data);
+
+  // The source files are sorted, and cover the range of their lines.
+  const BinaryCoverage::SourceFiles& source_files = coverage.source_files();
+  ASSERT_EQ(2u, source_files.size());
+  EXPECT_EQ("bar.cc", source_files[0].file_name);
+  EXPECT_EQ(1u, source_files[0].first_line);
+  EXPECT_EQ(1u, source_files[0].line_count());
+  EXPECT_EQ("foo.cc", source_files[1].file_name);
+  EXPECT_EQ(10u, source_files[1].first_line);
+  EXPECT_EQ(21u, source_files[1].line_count());
+  EXPECT_TRUE(source_files[1].IsInstrumented(0));
+  EXPECT_FALSE(source_files[1].IsInstrumented(1));
+  EXPECT_TRUE(source_files[1].IsInstrumented(2));
+
+  // Only the instrumented lines come back.
+  CoverageData converted;
+  coverage.ToCoverageData(&converted);
+  EXPECT_EQ(GetLines(coverage_data, "foo.cc"), GetLines(converted, "foo.cc"));
+  EXPECT_EQ(GetLines(coverage_data, "bar.cc"), GetLines(converted, "bar.cc"));
+}
+
+TEST(BinaryCoverageTest, Merge) {
+  CoverageData coverage_data1;
+  coverage_data1.AddLine("foo.cc", 10, 1);
+  coverage_data1.AddLine("foo.cc", 11, 0);
+  coverage_data1.AddLine("bar.cc", 5, 3);
+  BinaryCoverage coverage1;
+  coverage1.Init(coverage_data1);
+
+  CoverageData coverage_data2;
+  coverage_data2.AddLine("foo.cc", 10, 2);
+  coverage_data2.AddLine("foo.cc", 11, 0xFFFFFFFF);
+  coverage_data2.AddLine("foo.cc", 3, 4);
+  coverage_data2.AddLine("baz.cc", 1, 1);
+  BinaryCoverage coverage2;
+  coverage2.Init(coverage_data2);
+
+  coverage1.Merge(coverage2);
+  ASSERT_EQ(3u, coverage1.source_files().size());
+
+  CoverageData merged;
+  coverage1.ToCoverageData(&merged);
+
+  // The ranges of foo.cc are combined, and the counts saturate.
+  LineExecutionCountMap expected_foo;
+  expected_foo[3] = 4;
+  expected_foo[10] = 3;
+  expected_foo[11] = 0xFFFFFFFF;
+  EXPECT_EQ(expected_foo, GetLines(merged, "foo.cc"));
+  EXPECT_EQ(GetLines(coverage_data1, "bar.cc"), GetLines(merged, "bar.cc"));
+  EXPECT_EQ(GetLines(coverage_data2, "baz.cc"), GetLines(merged, "baz.cc"));
+}
+
+TEST(BinaryCoverageTest, SaveAndLoad) {
+  CoverageData coverage_data;
+  for (size_t i = 0; i < 20; i += 3)
+    coverage_data.AddLine("foo.cc", 100 + i, i);
+  coverage_data.AddLine("bar.cc", 1, 2);
+  BinaryCoverage coverage;
+  coverage.Init(coverage_data);
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().Append(L"coverage.bin");
+  ASSERT_TRUE(coverage.SaveToFile(path));
+
+  BinaryCoverage loaded_coverage;
+  ASSERT_TRUE(loaded_coverage.LoadFromFile(path));
+
+  CoverageData loaded_coverage_data;
+  loaded_coverage.ToCoverageData(&loaded_coverage_data);
+  EXPECT_EQ(GetLines(coverage_data, "foo.cc"),
+            GetLines(loaded_coverage_data, "foo.cc"));
+  EXPECT_EQ(GetLines(coverage_data, "bar.cc"),
+            GetLines(loaded_coverage_data, "bar.cc"));
+}
+
+TEST(BinaryCoverageTest, LoadInvalidFileFails) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  BinaryCoverage coverage;
+  EXPECT_FALSE(coverage.LoadFromFile(temp_dir.path().Append(L"missing")));
+
+  base::FilePath path = temp_dir.path().Append(L"invalid.bin");
+  static const char kData[] = "not a coverage file";
+  ASSERT_EQ(static_cast<int>(sizeof(kData)),
+            base::WriteFile(path, kData, sizeof(kData)));
+  EXPECT_FALSE(coverage.LoadFromFile(path));
+}
+
+}  // namespace grinder
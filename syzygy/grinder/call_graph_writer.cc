@@ -0,0 +1,295 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/call_graph_writer.h"
+
+#include "base/logging.h"
+
+namespace grinder {
+
+namespace {
+
+// Identifies binary call graph files. This reads 'SZCG' in a hex dump.
+const uint32 kBinaryCallGraphSignature = 0x47435A53;
+
+// The version of the binary call graph format. This must be incremented
+// whenever the format changes.
+const uint32 kBinaryCallGraphVersion = 1;
+
+bool SaveMetrics(const CallGraphMetrics& metrics,
+                 core::OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(metrics.num_calls) &&
+      out_archive->Save(metrics.cycles_sum) &&
+      out_archive->Save(metrics.cycles_min) &&
+      out_archive->Save(metrics.cycles_max);
+}
+
+bool LoadMetrics(core::InArchive* in_archive, CallGraphMetrics* metrics) {
+  DCHECK(in_archive != NULL);
+  DCHECK(metrics != NULL);
+  return in_archive->Load(&metrics->num_calls) &&
+      in_archive->Load(&metrics->cycles_sum) &&
+      in_archive->Load(&metrics->cycles_min) &&
+      in_archive->Load(&metrics->cycles_max);
+}
+
+// Loads a name reference, and the name itself if it's the first reference to
+// it.
+// @param in_archive the archive to read from.
+// @param names the names read so far, to which a new name is appended.
+// @param name receives the name.
+// @returns true on success, false otherwise.
+bool LoadName(core::InArchive* in_archive,
+              std::vector<std::string>* names,
+              std::string* name) {
+  DCHECK(in_archive != NULL);
+  DCHECK(names != NULL);
+  DCHECK(name != NULL);
+
+  uint32 index = 0;
+  if (!in_archive->Load(&index))
+    return false;
+  if (index == names->size()) {
+    names->push_back(std::string());
+    if (!in_archive->Load(&names->back()))
+      return false;
+  } else if (index > names->size()) {
+    LOG(ERROR) << "Invalid name reference in binary call graph.";
+    return false;
+  }
+
+  *name = (*names)[index];
+  return true;
+}
+
+}  // namespace
+
+CacheGrindCallGraphWriter::CacheGrindCallGraphWriter(FILE* file)
+    : file_(file), next_function_(0) {
+  DCHECK(file != NULL);
+}
+
+bool CacheGrindCallGraphWriter::BeginCallGraph(size_t part_count) {
+  return true;
+}
+
+bool CacheGrindCallGraphWriter::BeginPart(uint32 process_id,
+                                          uint32 thread_id,
+                                          const std::string& thread_name,
+                                          size_t function_count,
+                                          size_t call_count) {
+  functions_.clear();
+  functions_.reserve(function_count);
+  next_function_ = 0;
+
+  // TODO(siggi): Output command line here.
+  if (::fprintf(file_, "pid: %d\n", process_id) < 0)
+    return false;
+  if (thread_id != 0 && ::fprintf(file_, "thread: %d\n", thread_id) < 0)
+    return false;
+  if (::fprintf(file_, "events: Calls Cycles Cycles-Min Cycles-Max\n") < 0)
+    return false;
+  if (!thread_name.empty() &&
+      ::fprintf(file_, "desc: Trigger: %s\n", thread_name.c_str()) < 0) {
+    return false;
+  }
+
+  return true;
+}
+
+bool CacheGrindCallGraphWriter::WriteFunction(
+    const CallGraphFunction& function) {
+  DCHECK_EQ(0U, next_function_);
+  functions_.push_back(function);
+  return true;
+}
+
+bool CacheGrindCallGraphWriter::WriteCall(const CallGraphCall& call) {
+  if (call.caller >= functions_.size() || call.callee >= functions_.size() ||
+      call.caller + 1 < next_function_) {
+    LOG(ERROR) << "Calls must refer to the function table, and be grouped "
+               << "by caller.";
+    return false;
+  }
+
+  if (!WriteFunctionsUpTo(call.caller))
+    return false;
+
+  const CallGraphFunction& callee = functions_[call.callee];
+  const CallGraphMetrics& metrics = call.metrics;
+  if (::fprintf(file_, "cfl=%s\n", callee.file_name.c_str()) < 0 ||
+      ::fprintf(file_, "cfn=%s\n", callee.name.c_str()) < 0 ||
+      ::fprintf(file_, "calls=%I64d %d\n", metrics.num_calls,
+                callee.line) < 0 ||
+      ::fprintf(file_, "%d %I64d %I64d %I64d %I64d\n", call.line,
+                metrics.num_calls, metrics.cycles_sum, metrics.cycles_min,
+                metrics.cycles_max) < 0) {
+    return false;
+  }
+
+  return true;
+}
+
+bool CacheGrindCallGraphWriter::EndPart() {
+  if (!functions_.empty() && !WriteFunctionsUpTo(functions_.size() - 1))
+    return false;
+  functions_.clear();
+  next_function_ = 0;
+  return true;
+}
+
+bool CacheGrindCallGraphWriter::WriteFunctionsUpTo(size_t index) {
+  DCHECK_LT(index, functions_.size());
+
+  for (; next_function_ <= index; ++next_function_) {
+    const CallGraphFunction& function = functions_[next_function_];
+    const CallGraphMetrics& metrics = function.metrics;
+    if (::fprintf(file_, "fl=%s\n", function.file_name.c_str()) < 0 ||
+        ::fprintf(file_, "fn=%s\n", function.name.c_str()) < 0 ||
+        ::fprintf(file_, "%d %I64d %I64d %I64d %I64d\n", function.line,
+                  metrics.num_calls, metrics.cycles_sum, metrics.cycles_min,
+                  metrics.cycles_max) < 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+BinaryCallGraphWriter::BinaryCallGraphWriter(FILE* file)
+    : out_stream_(file), out_archive_(&out_stream_) {
+}
+
+bool BinaryCallGraphWriter::BeginCallGraph(size_t part_count) {
+  return out_archive_.Save(kBinaryCallGraphSignature) &&
+      out_archive_.Save(kBinaryCallGraphVersion) &&
+      out_archive_.Save(static_cast<uint32>(part_count));
+}
+
+bool BinaryCallGraphWriter::BeginPart(uint32 process_id,
+                                      uint32 thread_id,
+                                      const std::string& thread_name,
+                                      size_t function_count,
+                                      size_t call_count) {
+  return out_archive_.Save(process_id) &&
+      out_archive_.Save(thread_id) &&
+      out_archive_.Save(thread_name) &&
+      out_archive_.Save(static_cast<uint32>(function_count)) &&
+      out_archive_.Save(static_cast<uint32>(call_count));
+}
+
+bool BinaryCallGraphWriter::WriteFunction(const CallGraphFunction& function) {
+  return WriteName(function.name) &&
+      WriteName(function.file_name) &&
+      out_archive_.Save(function.line) &&
+      SaveMetrics(function.metrics, &out_archive_);
+}
+
+bool BinaryCallGraphWriter::WriteCall(const CallGraphCall& call) {
+  return out_archive_.Save(call.caller) &&
+      out_archive_.Save(call.callee) &&
+      out_archive_.Save(call.line) &&
+      SaveMetrics(call.metrics, &out_archive_);
+}
+
+bool BinaryCallGraphWriter::EndPart() {
+  return out_archive_.Flush();
+}
+
+bool BinaryCallGraphWriter::WriteName(const std::string& name) {
+  std::pair<NameMap::iterator, bool> inserted =
+      names_.insert(std::make_pair(name, static_cast<uint32>(names_.size())));
+  if (!out_archive_.Save(inserted.first->second))
+    return false;
+  if (inserted.second && !out_archive_.Save(name))
+    return false;
+  return true;
+}
+
+bool ReadBinaryCallGraph(FILE* file, CallGraphWriter* writer) {
+  DCHECK(file != NULL);
+  DCHECK(writer != NULL);
+
+  core::FileInStream in_stream(file);
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
+  uint32 signature = 0;
+  uint32 version = 0;
+  uint32 part_count = 0;
+  if (!in_archive.Load(&signature) || !in_archive.Load(&version) ||
+      !in_archive.Load(&part_count)) {
+    return false;
+  }
+  if (signature != kBinaryCallGraphSignature) {
+    LOG(ERROR) << "Not a binary call graph file.";
+    return false;
+  }
+  if (version != kBinaryCallGraphVersion) {
+    LOG(ERROR) << "Unsupported binary call graph version " << version << ".";
+    return false;
+  }
+
+  if (!writer->BeginCallGraph(part_count))
+    return false;
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < part_count; ++i) {
+    uint32 process_id = 0;
+    uint32 thread_id = 0;
+    std::string thread_name;
+    uint32 function_count = 0;
+    uint32 call_count = 0;
+    if (!in_archive.Load(&process_id) || !in_archive.Load(&thread_id) ||
+        !in_archive.Load(&thread_name) || !in_archive.Load(&function_count) ||
+        !in_archive.Load(&call_count) ||
+        !writer->BeginPart(process_id, thread_id, thread_name, function_count,
+                           call_count)) {
+      return false;
+    }
+
+    for (size_t j = 0; j < function_count; ++j) {
+      CallGraphFunction function;
+      if (!LoadName(&in_archive, &names, &function.name) ||
+          !LoadName(&in_archive, &names, &function.file_name) ||
+          !in_archive.Load(&function.line) ||
+          !LoadMetrics(&in_archive, &function.metrics) ||
+          !writer->WriteFunction(function)) {
+        return false;
+      }
+    }
+
+    for (size_t j = 0; j < call_count; ++j) {
+      CallGraphCall call;
+      if (!in_archive.Load(&call.caller) || !in_archive.Load(&call.callee) ||
+          !in_archive.Load(&call.line) ||
+          !LoadMetrics(&in_archive, &call.metrics)) {
+        return false;
+      }
+      if (call.caller >= function_count || call.callee >= function_count) {
+        LOG(ERROR) << "Invalid call in binary call graph.";
+        return false;
+      }
+      if (!writer->WriteCall(call))
+        return false;
+    }
+
+    if (!writer->EndPart())
+      return false;
+  }
+
+  return true;
+}
+
+}  // namespace grinder
@@ -0,0 +1,195 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares writers of profiler call graphs, in the KCacheGrind text format and
+// in a compact binary format, and a reader of the binary format.
+//
+// A call graph is written a part at a time. Each part holds a table of
+// functions, with their exclusive metrics, followed by the calls between them,
+// with their inclusive metrics. The calls refer to their caller and callee by
+// index in the function table, and are grouped by caller, in the order of the
+// function table. This allows the calls to be streamed out.
+//
+// The binary format starts with a signature, a version and the number of
+// parts. Each part starts with its header, followed by its functions and its
+// calls. The function and file names are written once, the first time they
+// are used, and referred to by index afterwards.
+//
+// For information on the KCacheGrind file format, see:
+// http://kcachegrind.sourceforge.net/cgi-bin/show.cgi/KcacheGrindCalltreeFormat
+
+#ifndef SYZYGY_GRINDER_CALL_GRAPH_WRITER_H_
+#define SYZYGY_GRINDER_CALL_GRAPH_WRITER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "syzygy/core/serialization.h"
+
+namespace grinder {
+
+// The metrics of a function or of a call.
+struct CallGraphMetrics {
+  CallGraphMetrics()
+      : num_calls(0), cycles_sum(0), cycles_min(0), cycles_max(0) {
+  }
+
+  uint64 num_calls;
+  uint64 cycles_sum;
+  uint64 cycles_min;
+  uint64 cycles_max;
+};
+
+// A function of a call graph part.
+struct CallGraphFunction {
+  CallGraphFunction() : line(0) {
+  }
+
+  std::string name;
+  // The source file of the function, with forward slashes.
+  std::string file_name;
+  uint32 line;
+  // The metrics of the function, exclusive of its calls.
+  CallGraphMetrics metrics;
+};
+
+// A call of a call graph part.
+struct CallGraphCall {
+  CallGraphCall() : caller(0), callee(0), line(0) {
+  }
+
+  // The indexes of the calling and called functions in the function table.
+  uint32 caller;
+  uint32 callee;
+  // The line of the call site, in the caller.
+  uint32 line;
+  // The metrics of the call, inclusive of the callee's own calls.
+  CallGraphMetrics metrics;
+};
+
+// The interface of the call graph writers. The methods must be called in the
+// order described at the top of this file.
+class CallGraphWriter {
+ public:
+  virtual ~CallGraphWriter() {}
+
+  // Begins a call graph of @p part_count parts.
+  virtual bool BeginCallGraph(size_t part_count) = 0;
+
+  // Begins a part.
+  // @param process_id the process of the part.
+  // @param thread_id the thread of the part, or 0 if the part aggregates all
+  //     the threads.
+  // @param thread_name the name of the thread, if any.
+  // @param function_count the number of functions of the part.
+  // @param call_count the number of calls of the part.
+  virtual bool BeginPart(uint32 process_id,
+                         uint32 thread_id,
+                         const std::string& thread_name,
+                         size_t function_count,
+                         size_t call_count) = 0;
+
+  // Writes the next function of the current part.
+  virtual bool WriteFunction(const CallGraphFunction& function) = 0;
+
+  // Writes the next call of the current part. All of its functions must have
+  // been written first.
+  virtual bool WriteCall(const CallGraphCall& call) = 0;
+
+  // Ends the current part.
+  virtual bool EndPart() = 0;
+};
+
+// Writes a call graph in the KCacheGrind text format. The function table of
+// the current part is held in memory, but the calls are streamed out.
+class CacheGrindCallGraphWriter : public CallGraphWriter {
+ public:
+  // @param file the file to write to.
+  explicit CacheGrindCallGraphWriter(FILE* file);
+
+  // @name CallGraphWriter implementation.
+  // @{
+  virtual bool BeginCallGraph(size_t part_count) OVERRIDE;
+  virtual bool BeginPart(uint32 process_id,
+                         uint32 thread_id,
+                         const std::string& thread_name,
+                         size_t function_count,
+                         size_t call_count) OVERRIDE;
+  virtual bool WriteFunction(const CallGraphFunction& function) OVERRIDE;
+  virtual bool WriteCall(const CallGraphCall& call) OVERRIDE;
+  virtual bool EndPart() OVERRIDE;
+  // @}
+
+ private:
+  // Writes the functions of the function table up to and including the one
+  // at @p index, which haven't been written yet.
+  bool WriteFunctionsUpTo(size_t index);
+
+  FILE* file_;
+
+  // The function table of the current part, and the index of the next
+  // function to be written out.
+  std::vector<CallGraphFunction> functions_;
+  size_t next_function_;
+
+  DISALLOW_COPY_AND_ASSIGN(CacheGrindCallGraphWriter);
+};
+
+// Writes a call graph in the binary format, as it is given. Only the names
+// seen so far are held in memory.
+class BinaryCallGraphWriter : public CallGraphWriter {
+ public:
+  // @param file the file to write to, which must be opened in binary mode.
+  explicit BinaryCallGraphWriter(FILE* file);
+
+  // @name CallGraphWriter implementation.
+  // @{
+  virtual bool BeginCallGraph(size_t part_count) OVERRIDE;
+  virtual bool BeginPart(uint32 process_id,
+                         uint32 thread_id,
+                         const std::string& thread_name,
+                         size_t function_count,
+                         size_t call_count) OVERRIDE;
+  virtual bool WriteFunction(const CallGraphFunction& function) OVERRIDE;
+  virtual bool WriteCall(const CallGraphCall& call) OVERRIDE;
+  virtual bool EndPart() OVERRIDE;
+  // @}
+
+ private:
+  // Writes a reference to @p name, preceded by its definition if it's the
+  // first reference to it.
+  bool WriteName(const std::string& name);
+
+  core::FileOutStream out_stream_;
+  core::NativeBinaryOutArchive out_archive_;
+
+  // The index of each name written so far.
+  typedef std::map<std::string, uint32> NameMap;
+  NameMap names_;
+
+  DISALLOW_COPY_AND_ASSIGN(BinaryCallGraphWriter);
+};
+
+// Reads a call graph in the binary format, and hands it to @p writer. This
+// converts a binary call graph to another format.
+// @param file the file to read from, which must be opened in binary mode.
+// @param writer the writer to hand the call graph to.
+// @returns true on success, false otherwise.
+bool ReadBinaryCallGraph(FILE* file, CallGraphWriter* writer);
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_CALL_GRAPH_WRITER_H_
@@ -0,0 +1,180 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/call_graph_writer.h"
+
+#include "base/file_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+
+namespace grinder {
+
+namespace {
+
+const char kExpectedText[] =
+    "pid: 1\n"
+    "thread: 2\n"
+    "events: Calls Cycles Cycles-Min Cycles-Max\n"
+    "desc: Trigger: Main\n"
+    "fl=foo.cc\n"
+    "fn=Foo\n"
+    "10 1 100 100 100\n"
+    "cfl=bar.cc\n"
+    "cfn=Bar\n"
+    "calls=2 20\n"
+    "12 2 60 20 40\n"
+    "fl=bar.cc\n"
+    "fn=Bar\n"
+    "20 2 60 20 40\n"
+    "fl=foo.cc\n"
+    "fn=Baz\n"
+    "30 0 0 0 0\n"
+    "cfl=foo.cc\n"
+    "cfn=Foo\n"
+    "calls=1 10\n"
+    "31 1 200 200 200\n"
+    "pid: 1\n"
+    "events: Calls Cycles Cycles-Min Cycles-Max\n";
+
+CallGraphMetrics Metrics(uint64 num_calls, uint64 cycles_sum,
+                         uint64 cycles_min, uint64 cycles_max) {
+  CallGraphMetrics metrics;
+  metrics.num_calls = num_calls;
+  metrics.cycles_sum = cycles_sum;
+  metrics.cycles_min = cycles_min;
+  metrics.cycles_max = cycles_max;
+  return metrics;
+}
+
+CallGraphFunction Function(const std::string& name,
+                           const std::string& file_name,
+                           uint32 line,
+                           const CallGraphMetrics& metrics) {
+  CallGraphFunction function;
+  function.name = name;
+  function.file_name = file_name;
+  function.line = line;
+  function.metrics = metrics;
+  return function;
+}
+
+CallGraphCall Call(uint32 caller, uint32 callee, uint32 line,
+                   const CallGraphMetrics& metrics) {
+  CallGraphCall call;
+  call.caller = caller;
+  call.callee = callee;
+  call.line = line;
+  call.metrics = metrics;
+  return call;
+}
+
+// Writes a call graph of two parts to @p writer. The second part is empty.
+void WriteCallGraph(CallGraphWriter* writer) {
+  ASSERT_TRUE(writer->BeginCallGraph(2));
+
+  ASSERT_TRUE(writer->BeginPart(1, 2, "Main", 3, 2));
+  ASSERT_TRUE(writer->WriteFunction(
+      Function("Foo", "foo.cc", 10, Metrics(1, 100, 100, 100))));
+  ASSERT_TRUE(writer->WriteFunction(
+      Function("Bar", "bar.cc", 20, Metrics(2, 60, 20, 40))));
+  ASSERT_TRUE(writer->WriteFunction(
+      Function("Baz", "foo.cc", 30, Metrics(0, 0, 0, 0))));
+  ASSERT_TRUE(writer->WriteCall(Call(0, 1, 12, Metrics(2, 60, 20, 40))));
+  ASSERT_TRUE(writer->WriteCall(Call(2, 0, 31, Metrics(1, 200, 200, 200))));
+  ASSERT_TRUE(writer->EndPart());
+
+  ASSERT_TRUE(writer->BeginPart(1, 0, "", 0, 0));
+  ASSERT_TRUE(writer->EndPart());
+}
+
+}  // namespace
+
+TEST(CallGraphWriterTest, WriteCacheGrind) {
+  testing::ScopedTempFile temp;
+  {
+    base::ScopedFILE file(base::OpenFile(temp.path(), "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    CacheGrindCallGraphWriter writer(file.get());
+    ASSERT_NO_FATAL_FAILURE(WriteCallGraph(&writer));
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(temp.path(), &contents));
+  EXPECT_EQ(kExpectedText, contents);
+}
+
+TEST(CallGraphWriterTest, CacheGrindFailsWithUngroupedCalls) {
+  testing::ScopedTempFile temp;
+  base::ScopedFILE file(base::OpenFile(temp.path(), "wb"));
+  ASSERT_TRUE(file.get() != NULL);
+  CacheGrindCallGraphWriter writer(file.get());
+
+  ASSERT_TRUE(writer.BeginCallGraph(1));
+  ASSERT_TRUE(writer.BeginPart(1, 2, "", 3, 2));
+  for (size_t i = 0; i < 3; ++i)
+    ASSERT_TRUE(writer.WriteFunction(CallGraphFunction()));
+  EXPECT_TRUE(writer.WriteCall(Call(2, 0, 0, CallGraphMetrics())));
+  EXPECT_FALSE(writer.WriteCall(Call(0, 1, 0, CallGraphMetrics())));
+  EXPECT_FALSE(writer.WriteCall(Call(2, 3, 0, CallGraphMetrics())));
+}
+
+TEST(CallGraphWriterTest, ConvertBinaryToCacheGrind) {
+  testing::ScopedTempFile binary_temp;
+  {
+    base::ScopedFILE file(base::OpenFile(binary_temp.path(), "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    BinaryCallGraphWriter writer(file.get());
+    ASSERT_NO_FATAL_FAILURE(WriteCallGraph(&writer));
+  }
+
+  testing::ScopedTempFile text_temp;
+  {
+    base::ScopedFILE in_file(base::OpenFile(binary_temp.path(), "rb"));
+    ASSERT_TRUE(in_file.get() != NULL);
+    base::ScopedFILE out_file(base::OpenFile(text_temp.path(), "wb"));
+    ASSERT_TRUE(out_file.get() != NULL);
+    CacheGrindCallGraphWriter writer(out_file.get());
+    ASSERT_TRUE(ReadBinaryCallGraph(in_file.get(), &writer));
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(text_temp.path(), &contents));
+  EXPECT_EQ(kExpectedText, contents);
+}
+
+TEST(CallGraphWriterTest, ReadBinaryFailsWithTruncatedFile) {
+  testing::ScopedTempFile temp;
+  {
+    base::ScopedFILE file(base::OpenFile(temp.path(), "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    BinaryCallGraphWriter writer(file.get());
+    ASSERT_NO_FATAL_FAILURE(WriteCallGraph(&writer));
+  }
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(temp.path(), &contents));
+  contents.resize(contents.size() / 2);
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            base::WriteFile(temp.path(), contents.data(), contents.size()));
+
+  base::ScopedFILE file(base::OpenFile(temp.path(), "rb"));
+  ASSERT_TRUE(file.get() != NULL);
+  testing::ScopedTempFile text_temp;
+  base::ScopedFILE out_file(base::OpenFile(text_temp.path(), "wb"));
+  ASSERT_TRUE(out_file.get() != NULL);
+  CacheGrindCallGraphWriter writer(out_file.get());
+  EXPECT_FALSE(ReadBinaryCallGraph(file.get(), &writer));
+}
+
+}  // namespace grinder
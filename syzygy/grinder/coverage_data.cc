@@ -14,6 +14,9 @@
 
 #include "syzygy/grinder/coverage_data.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace grinder {
 
 bool CoverageData::Add(const LineInfo& line_info) {
@@ -54,4 +57,13 @@ bool CoverageData::Add(const LineInfo& line_info) {
   return true;
 }
 
+void CoverageData::AddLine(const std::string& source_file_name,
+                           size_t line_number,
+                           uint32 execution_count) {
+  uint32& count = source_file_coverage_data_map_[source_file_name].
+      line_execution_count_map[line_number];
+  count = std::min(count, std::numeric_limits<uint32>::max() -
+                   execution_count) + execution_count;
+}
+
 }  // namespace grinder
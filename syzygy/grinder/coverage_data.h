@@ -43,6 +43,15 @@ class CoverageData {
   // @returns true on success, false otherwise.
   bool Add(const LineInfo& line_info);
 
+  // Adds the execution count of a single instrumented line.
+  // @param source_file_name the name of the source file of the line.
+  // @param line_number the number of the line.
+  // @param execution_count the number of times the line was executed. This is
+  //     added using saturation arithmetic.
+  void AddLine(const std::string& source_file_name,
+               size_t line_number,
+               uint32 execution_count);
+
   const SourceFileCoverageDataMap& source_file_coverage_data_map() const {
     return source_file_coverage_data_map_;
   }
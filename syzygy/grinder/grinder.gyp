@@ -23,8 +23,12 @@
       'sources': [
         'basic_block_util.cc',
         'basic_block_util.h',
+        'binary_coverage.cc',
+        'binary_coverage.h',
         'cache_grind_writer.cc',
         'cache_grind_writer.h',
+        'call_graph_writer.cc',
+        'call_graph_writer.h',
         'coverage_data.cc',
         'coverage_data.h',
         'find.cc',
@@ -40,10 +44,14 @@
         'lcov_writer.h',
         'line_info.cc',
         'line_info.h',
+        'symbol_table.cc',
+        'symbol_table.h',
         'grinders/coverage_grinder.cc',
         'grinders/coverage_grinder.h',
         'grinders/indexed_frequency_data_grinder.cc',
         'grinders/indexed_frequency_data_grinder.h',
+        'grinders/page_fault_grinder.cc',
+        'grinders/page_fault_grinder.h',
         'grinders/profile_grinder.cc',
         'grinders/profile_grinder.h',
         'grinders/sample_grinder.cc',
@@ -53,6 +61,7 @@
         '<(src)/syzygy/application/application.gyp:application_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/pe/pe.gyp:dia_sdk',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
       ],
@@ -62,7 +71,9 @@
       'type': 'executable',
       'sources': [
         'basic_block_util_unittest.cc',
+        'binary_coverage_unittest.cc',
         'cache_grind_writer_unittest.cc',
+        'call_graph_writer_unittest.cc',
         'coverage_data_unittest.cc',
         'find_unittest.cc',
         'grinder_app_unittest.cc',
@@ -70,7 +81,9 @@
         'indexed_frequency_data_serializer_unittest.cc',
         'lcov_writer_unittest.cc',
         'line_info_unittest.cc',
+        'symbol_table_unittest.cc',
         'grinders/coverage_grinder_unittest.cc',
+        'grinders/page_fault_grinder_unittest.cc',
         'grinders/profile_grinder_unittest.cc',
         'grinders/sample_grinder_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
@@ -87,10 +100,31 @@
         '<(src)/syzygy/test_data/test_data.gyp:basic_block_entry_traces',
         '<(src)/syzygy/test_data/test_data.gyp:coverage_traces',
         '<(src)/syzygy/test_data/test_data.gyp:profile_traces',
+        '<(src)/syzygy/test_data/test_data.gyp:randomized_test_dll',
         '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
         '<(src)/syzygy/version/version.gyp:version_lib',
       ],
     },
+    {
+      # Throughput benchmarks of the parser and of the grinders. These aren't
+      # part of the unittests, as their only output is the metrics they emit.
+      'target_name': 'grinder_benchmarks',
+      'type': 'executable',
+      'sources': [
+        'grinder_benchmarks.cc',
+        '<(src)/base/test/run_all_unittests.cc',
+      ],
+      'dependencies': [
+        'grinder_lib',
+        '<(src)/base/base.gyp:test_support_base',
+        '<(src)/testing/gmock.gyp:gmock',
+        '<(src)/testing/gtest.gyp:gtest',
+        '<(src)/syzygy/core/core.gyp:core_unittest_utils',
+        '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
+        '<(src)/syzygy/testing/testing.gyp:testing_lib',
+        '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
+      ],
+    },
     {
       'target_name': 'grinder',
       'type': 'executable',
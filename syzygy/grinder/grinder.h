@@ -43,6 +43,16 @@ class GrinderInterface : public trace::parser::ParseEventHandlerImpl {
   //     handler.
   virtual void SetParser(Parser* parser) = 0;
 
+  // Merges the parse event state of another grinder into this one. This
+  // allows trace files to be parsed concurrently, each worker feeding its own
+  // grinder. This will only be called prior to Grind, with a grinder of the
+  // same type that was given the same command-line.
+  // @param partial the grinder whose state is to be merged. It is left in an
+  //     unspecified state.
+  // @returns true on success, false otherwise.
+  // @note The implementation should log on failure.
+  virtual bool Merge(GrinderInterface* partial) = 0;
+
   // Performs any computation/aggregation/summarization that needs to be done
   // after having parsed trace files. This will only be called after a
   // successful call to ParseCommandLine and after all parse events have been
@@ -14,12 +14,21 @@
 
 #include "syzygy/grinder/grinder_app.h"
 
+#include <algorithm>
+
+#include "base/atomicops.h"
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
+#include "syzygy/grinder/binary_coverage.h"
+#include "syzygy/grinder/call_graph_writer.h"
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 #include "syzygy/grinder/grinders/indexed_frequency_data_grinder.h"
+#include "syzygy/grinder/grinders/page_fault_grinder.h"
 #include "syzygy/grinder/grinders/profile_grinder.h"
 #include "syzygy/grinder/grinders/sample_grinder.h"
 
@@ -42,22 +51,47 @@ const char kUsageFormatStr[] =
     "  In 'sample' mode it processes sampling profiler data and outputs heat\n"
     "  per basic-block/function/compiland in CSV format.\n"
     "\n"
+    "  In 'page-faults' mode it processes the page faults of kernel ETW\n"
+    "  traces, as captured by call_trace_control, and outputs the faulting\n"
+    "  blocks of an image in the order in which they first faulted, in CSV\n"
+    "  format.\n"
+    "\n"
+    "  In 'merge-coverage' mode it merges binary coverage files, as output\n"
+    "  in 'coverage' mode, rather than trace files. The output is as in\n"
+    "  'coverage' mode.\n"
+    "\n"
+    "  In 'convert-profile' mode it converts binary call graph files, as\n"
+    "  output in 'profile' mode, to KCacheGrind-compatible output files.\n"
+    "\n"
     "Required parameters\n"
     "  --mode=<mode>\n"
-    "    The processing mode. Must be one of 'bbentry', 'branch', 'coverage',\n"
+    "    The processing mode. Must be one of 'bbentry', 'branch',\n"
+    "    'convert-profile', 'coverage', 'merge-coverage', 'page-faults',\n"
     "    'profile' or 'sample'.\n"
     "\n"
     "Optional parameters\n"
     "  --output-file=<output file>\n"
     "    The location of output file. If not specified, output is to stdout.\n"
-    "coverage mode optional parameters\n"
+    "  --jobs=<count>\n"
+    "    The number of trace files to parse concurrently. Each worker thread\n"
+    "    aggregates its trace files separately, and the results are merged\n"
+    "    before the final processing. Defaults to 1.\n"
+    "coverage and merge-coverage mode optional parameters\n"
     "  --output-format=<output format>\n"
-    "    Output format must be one of 'lcov' or 'cachegrind'. Defaults to\n"
-    "    'lcov' if not explicitly specified.\n"
+    "    Output format must be one of 'lcov', 'cachegrind' or 'binary'.\n"
+    "    Defaults to 'lcov' if not explicitly specified. Binary coverage\n"
+    "    files are compact, and fast to merge.\n"
     "profile mode optional parameters\n"
     "  --thread-parts\n"
     "    Aggregate and output separate parts for each thread seen in the\n"
     "    trace files.\n"
+    "  --symbol-cache-dir=<directory>\n"
+    "    A directory where the symbols extracted from the PDBs are cached,\n"
+    "    which makes grinding profiles of the same build again faster.\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'cachegrind' or 'binary'. Defaults to\n"
+    "    'cachegrind'. Binary call graphs are much smaller, and can be\n"
+    "    converted in 'convert-profile' mode.\n"
     "sample mode optional parameters\n"
     "  --aggregation-level=<level>\n"
     "    The level of aggregation. Must be one of 'basic-block', 'function',\n"
@@ -70,12 +104,95 @@ const char kUsageFormatStr[] =
     "    will be reported for all modules encountered in the trace files.\n"
     "    This must be specified for 'basic-block' aggregation modes, as\n"
     "    only one module may be processed at a time in this mode.\n"
+    "  --streaming\n"
+    "    Fold the samples into per-function heat as they are parsed, rather\n"
+    "    than accumulating them for the whole run. This keeps the memory use\n"
+    "    bounded when processing long sampling sessions. Only supported for\n"
+    "    'function' and 'compiland' aggregation.\n"
+    "page-faults mode parameters\n"
+    "  --image=<path>\n"
+    "    The path to the image whose page faults are to be processed. This\n"
+    "    is required.\n"
+    "  --original-image=<path>\n"
+    "    The path to the original image, if --image was relinked. The faults\n"
+    "    are then attributed to the blocks of the original image.\n"
     "\n";
 
+// Parses trace files on a worker thread. Each worker thread takes the next
+// trace file that hasn't been parsed yet, until they're all done, and feeds it
+// to its own grinder.
+class TraceFileParser : public base::DelegateSimpleThread::Delegate {
+ public:
+  TraceFileParser(const std::vector<base::FilePath>& trace_files,
+                  base::subtle::Atomic32* next_file,
+                  base::subtle::Atomic32* failed,
+                  GrinderInterface* grinder)
+      : trace_files_(trace_files), next_file_(next_file), failed_(failed),
+        grinder_(grinder) {
+    DCHECK(next_file != NULL);
+    DCHECK(failed != NULL);
+    DCHECK(grinder != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    // The grinders may use DIA while handling parse events.
+    base::win::ScopedCOMInitializer com_initializer;
+
+    while (base::subtle::NoBarrier_Load(failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(next_file_, 1));
+      if (index > trace_files_.size())
+        return;
+
+      if (!ParseTraceFile(trace_files_[index - 1]))
+        base::subtle::NoBarrier_Store(failed_, 1);
+    }
+  }
+  // @}
+
+ private:
+  bool ParseTraceFile(const base::FilePath& trace_file) {
+    trace::parser::Parser parser;
+    grinder_->SetParser(&parser);
+    if (!parser.Init(grinder_))
+      return false;
+
+    if (!parser.OpenTraceFile(trace_file)) {
+      LOG(ERROR) << "Unable to open trace file \'"
+                 << trace_file.value() << "'";
+      return false;
+    }
+
+    if (!parser.Consume()) {
+      LOG(ERROR) << "Error parsing trace file \'"
+                 << trace_file.value() << "'";
+      return false;
+    }
+
+    return true;
+  }
+
+  const std::vector<base::FilePath>& trace_files_;
+
+  // One past the index of the next entry of trace_files_ to parse. This is
+  // shared by all the workers.
+  base::subtle::Atomic32* next_file_;
+
+  // Set to 1 as soon as a trace file fails to be parsed. This is shared by
+  // all the workers.
+  base::subtle::Atomic32* failed_;
+
+  GrinderInterface* grinder_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileParser);
+};
+
 }  // namespace
 
 GrinderApp::GrinderApp()
-    : application::AppImplBase("Grinder"), mode_(kProfile) {
+    : application::AppImplBase("Grinder"), mode_(kProfile), num_jobs_(1) {
 }
 
 void GrinderApp::PrintUsage(const base::FilePath& program,
@@ -116,24 +233,26 @@ bool GrinderApp::ParseCommandLine(const CommandLine* command_line) {
   std::string mode = command_line->GetSwitchValueASCII("mode");
   if (LowerCaseEqualsASCII(mode, "profile")) {
     mode_ = kProfile;
-    grinder_.reset(new grinders::ProfileGrinder());
   } else if (LowerCaseEqualsASCII(mode, "coverage")) {
     mode_ = kCoverage;
-    grinder_.reset(new grinders::CoverageGrinder());
   } else if (LowerCaseEqualsASCII(mode, "bbentry")) {
     mode_ = kBasicBlockEntry;
-    grinder_.reset(new grinders::IndexedFrequencyDataGrinder());
   } else if (LowerCaseEqualsASCII(mode, "branch")) {
     mode_ = kIndexedFrequencyData;
-    grinder_.reset(new grinders::IndexedFrequencyDataGrinder());
   } else if (LowerCaseEqualsASCII(mode, "sample")) {
     mode_ = kSample;
-    grinder_.reset(new grinders::SampleGrinder());
+  } else if (LowerCaseEqualsASCII(mode, "page-faults")) {
+    mode_ = kPageFault;
+  } else if (LowerCaseEqualsASCII(mode, "merge-coverage")) {
+    mode_ = kMergeCoverage;
+  } else if (LowerCaseEqualsASCII(mode, "convert-profile")) {
+    mode_ = kConvertProfile;
   } else {
     PrintUsage(command_line->GetProgram(),
                base::StringPrintf("Unknown mode: %s.", mode.c_str()));
     return false;
   }
+  grinder_.reset(CreateGrinder(mode_));
   DCHECK(grinder_.get() != NULL);
 
   // Parse the command-line for the grinder.
@@ -144,6 +263,24 @@ bool GrinderApp::ParseCommandLine(const CommandLine* command_line) {
     return false;
   }
 
+  // Parse the number of jobs.
+  if (!ParseJobs(command_line, &num_jobs_)) {
+    PrintUsage(command_line->GetProgram(), "Invalid number of jobs.");
+    return false;
+  }
+
+  // Each worker thread feeds its own grinder. There's no point in having more
+  // workers than trace files.
+  size_t num_workers = std::min(num_jobs_, trace_files_.size());
+  if (num_workers > 1 && mode_ != kMergeCoverage &&
+      mode_ != kConvertProfile) {
+    for (size_t i = 0; i < num_workers; ++i) {
+      partial_grinders_.push_back(CreateGrinder(mode_));
+      if (!partial_grinders_.back()->ParseCommandLine(command_line))
+        return false;
+    }
+  }
+
   output_file_ = command_line->GetSwitchValuePath("output-file");
 
   return true;
@@ -153,16 +290,19 @@ int GrinderApp::Run() {
   DCHECK(grinder_.get() != NULL);
 
   trace::parser::Parser parser;
-  grinder_->SetParser(&parser);
-  if (!parser.Init(grinder_.get()))
-    return 1;
-
-  // Open the input files.
-  for (size_t i = 0; i < trace_files_.size(); ++i) {
-    if (!parser.OpenTraceFile(trace_files_[i])) {
-      LOG(ERROR) << "Unable to open trace file \'"
-                 << trace_files_[i].value() << "'";
+  if (mode_ != kMergeCoverage && mode_ != kConvertProfile &&
+      partial_grinders_.empty()) {
+    grinder_->SetParser(&parser);
+    if (!parser.Init(grinder_.get()))
       return 1;
+
+    // Open the input files.
+    for (size_t i = 0; i < trace_files_.size(); ++i) {
+      if (!parser.OpenTraceFile(trace_files_[i])) {
+        LOG(ERROR) << "Unable to open trace file \'"
+                   << trace_files_[i].value() << "'";
+        return 1;
+      }
     }
   }
 
@@ -181,10 +321,28 @@ int GrinderApp::Run() {
     auto_close.reset(output);
   }
 
-  LOG(INFO) << "Parsing trace files.";
-  if (!parser.Consume()) {
-    LOG(ERROR) << "Error parsing trace files.";
-    return 1;
+  if (mode_ == kMergeCoverage) {
+    LOG(INFO) << "Merging coverage files.";
+    if (!MergeCoverageFiles())
+      return 1;
+  } else if (mode_ == kConvertProfile) {
+    // There is nothing to grind.
+    LOG(INFO) << "Converting call graph files.";
+    DCHECK(output != NULL);
+    return ConvertCallGraphFiles(output) ? 0 : 1;
+  } else if (partial_grinders_.empty()) {
+    LOG(INFO) << "Parsing trace files.";
+    if (!parser.Consume()) {
+      LOG(ERROR) << "Error parsing trace files.";
+      return 1;
+    }
+  } else {
+    LOG(INFO) << "Parsing trace files using " << partial_grinders_.size()
+              << " threads.";
+    if (!ParseTraceFilesInParallel()) {
+      LOG(ERROR) << "Error parsing trace files.";
+      return 1;
+    }
   }
 
   LOG(INFO) << "Aggregating data.";
@@ -207,8 +365,103 @@ int GrinderApp::Run() {
 }
 
 void GrinderApp::TearDown() {
-  // Release the grinder so it has a chance to clean up before COM goes away.
+  // Release the grinders so they have a chance to clean up before COM goes
+  // away.
+  partial_grinders_.clear();
   grinder_.reset();
 }
 
+GrinderInterface* GrinderApp::CreateGrinder(Mode mode) {
+  switch (mode) {
+    case kProfile:
+    case kConvertProfile:
+      return new grinders::ProfileGrinder();
+    case kCoverage:
+    case kMergeCoverage:
+      return new grinders::CoverageGrinder();
+    case kBasicBlockEntry:
+    case kIndexedFrequencyData:
+      return new grinders::IndexedFrequencyDataGrinder();
+    case kSample:
+      return new grinders::SampleGrinder();
+    case kPageFault:
+      return new grinders::PageFaultGrinder();
+  }
+
+  NOTREACHED() << "Unknown mode.";
+  return NULL;
+}
+
+bool GrinderApp::MergeCoverageFiles() {
+  DCHECK_EQ(kMergeCoverage, mode_);
+
+  BinaryCoverage merged;
+  for (size_t i = 0; i < trace_files_.size(); ++i) {
+    // This logs verbosely for us.
+    BinaryCoverage coverage;
+    if (!coverage.LoadFromFile(trace_files_[i]))
+      return false;
+    merged.Merge(coverage);
+  }
+
+  static_cast<grinders::CoverageGrinder*>(grinder_.get())->AddBinaryCoverage(
+      merged);
+  return true;
+}
+
+bool GrinderApp::ConvertCallGraphFiles(FILE* output) {
+  DCHECK_EQ(kConvertProfile, mode_);
+  DCHECK(output != NULL);
+
+  for (size_t i = 0; i < trace_files_.size(); ++i) {
+    base::ScopedFILE input(base::OpenFile(trace_files_[i], "rb"));
+    if (input.get() == NULL) {
+      LOG(ERROR) << "Unable to open \"" << trace_files_[i].value()
+                 << "\" for reading.";
+      return false;
+    }
+
+    CacheGrindCallGraphWriter writer(output);
+    if (!ReadBinaryCallGraph(input.get(), &writer)) {
+      LOG(ERROR) << "Unable to convert call graph \""
+                 << trace_files_[i].value() << "\".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool GrinderApp::ParseTraceFilesInParallel() {
+  DCHECK_LT(1U, partial_grinders_.size());
+
+  base::subtle::Atomic32 next_file = 0;
+  base::subtle::Atomic32 failed = 0;
+  ScopedVector<TraceFileParser> workers;
+  for (size_t i = 0; i < partial_grinders_.size(); ++i) {
+    workers.push_back(new TraceFileParser(trace_files_, &next_file, &failed,
+                                          partial_grinders_[i]));
+  }
+
+  base::DelegateSimpleThreadPool pool("GrinderApp", workers.size());
+  pool.Start();
+  for (size_t i = 0; i < workers.size(); ++i)
+    pool.AddWork(workers[i], 1);
+  pool.JoinAll();
+
+  if (base::subtle::NoBarrier_Load(&failed) != 0)
+    return false;
+
+  // Merge the partial results in a fixed order.
+  for (size_t i = 0; i < partial_grinders_.size(); ++i) {
+    if (!grinder_->Merge(partial_grinders_[i])) {
+      LOG(ERROR) << "Failed to merge the partial results.";
+      return false;
+    }
+  }
+  partial_grinders_.clear();
+
+  return true;
+}
+
 }  // namespace grinder
@@ -15,6 +15,7 @@
 #define SYZYGY_GRINDER_GRINDER_APP_H_
 
 #include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
 #include "syzygy/application/application.h"
 #include "syzygy/grinder/grinder.h"
 
@@ -33,6 +34,9 @@ class GrinderApp : public application::AppImplBase {
     kBasicBlockEntry,
     kIndexedFrequencyData,
     kSample,
+    kPageFault,
+    kMergeCoverage,
+    kConvertProfile,
   };
 
   // @name Implementation of the AppImplbase interface.
@@ -49,10 +53,35 @@ class GrinderApp : public application::AppImplBase {
   // @}
 
  protected:
+  // Creates a grinder for the processing mode @p mode.
+  static GrinderInterface* CreateGrinder(Mode mode);
+
+  // Merges the binary coverage files given as input, and hands the result to
+  // the coverage grinder.
+  // @returns true on success, false otherwise.
+  bool MergeCoverageFiles();
+
+  // Converts the binary call graph files given as input to the KCacheGrind
+  // format, and writes them to @p output.
+  // @returns true on success, false otherwise.
+  bool ConvertCallGraphFiles(FILE* output);
+
+  // Parses the trace files concurrently, each of the partial grinders being
+  // fed by its own worker thread, and merges the results into grinder_.
+  // @returns true on success, false otherwise.
+  bool ParseTraceFilesInParallel();
+
   std::vector<base::FilePath> trace_files_;
   base::FilePath output_file_;
   Mode mode_;
   scoped_ptr<GrinderInterface> grinder_;
+
+  // The number of trace files to parse concurrently.
+  size_t num_jobs_;
+
+  // The grinders fed by the worker threads when parsing in parallel. These
+  // are merged into grinder_ once all the trace files have been parsed.
+  ScopedVector<GrinderInterface> partial_grinders_;
 };
 
 }  // namespace grinder
@@ -19,6 +19,8 @@
 #include "gtest/gtest.h"
 #include "syzygy/application/application.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/grinder/binary_coverage.h"
+#include "syzygy/grinder/call_graph_writer.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/sampler/unittest_util.h"
 
@@ -122,6 +124,15 @@ TEST_F(GrinderAppTest, ParseCommandLineOutputFile) {
   ASSERT_EQ(L"output.txt", impl_.output_file_.value());
 }
 
+TEST_F(GrinderAppTest, ParseCommandLineInvalidJobsFails) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("jobs", "0");
+  cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+      testing::kProfileTraceFiles[0]));
+
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(GrinderAppTest, BasicBlockEntryEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "bbentry");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -158,6 +169,27 @@ TEST_F(GrinderAppTest, ProfileEndToEnd) {
   EXPECT_TRUE(base::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, ProfileEndToEndInParallel) {
+  cmd_line_.AppendSwitchASCII("mode", "profile");
+  cmd_line_.AppendSwitchASCII("jobs", "2");
+  for (size_t i = 0; i < arraysize(testing::kProfileTraceFiles); ++i) {
+    cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
+        testing::kProfileTraceFiles[i]));
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  ASSERT_TRUE(!base::PathExists(output_file));
+
+  EXPECT_EQ(0, app_.Run());
+
+  // Verify that the output file was created.
+  EXPECT_TRUE(base::PathExists(output_file));
+}
+
 TEST_F(GrinderAppTest, CoverageEndToEnd) {
   cmd_line_.AppendSwitchASCII("mode", "coverage");
   cmd_line_.AppendArgPath(testing::GetExeTestDataRelativePath(
@@ -177,6 +209,72 @@ TEST_F(GrinderAppTest, CoverageEndToEnd) {
   EXPECT_TRUE(base::PathExists(output_file));
 }
 
+TEST_F(GrinderAppTest, MergeCoverageEndToEnd) {
+  cmd_line_.AppendSwitchASCII("mode", "merge-coverage");
+
+  // Write a couple of binary coverage files to be merged.
+  for (size_t i = 0; i < 2; ++i) {
+    CoverageData coverage_data;
+    coverage_data.AddLine("foo.cc", 10 + i, 1);
+    BinaryCoverage coverage;
+    coverage.Init(coverage_data);
+
+    base::FilePath coverage_file;
+    ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &coverage_file));
+    ASSERT_TRUE(coverage.SaveToFile(coverage_file));
+    cmd_line_.AppendArgPath(coverage_file);
+  }
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+  cmd_line_.AppendSwitchASCII("output-format", "binary");
+
+  EXPECT_EQ(0, app_.Run());
+
+  // The output holds the lines of both files.
+  BinaryCoverage merged;
+  ASSERT_TRUE(merged.LoadFromFile(output_file));
+  CoverageData merged_data;
+  merged.ToCoverageData(&merged_data);
+  ASSERT_EQ(1u, merged_data.source_file_coverage_data_map().size());
+  EXPECT_EQ(2u, merged_data.source_file_coverage_data_map().begin()->
+      second.line_execution_count_map.size());
+}
+
+TEST_F(GrinderAppTest, ConvertProfileEndToEnd) {
+  cmd_line_.AppendSwitchASCII("mode", "convert-profile");
+
+  // Write a binary call graph with a single function.
+  base::FilePath call_graph_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &call_graph_file));
+  {
+    base::ScopedFILE file(base::OpenFile(call_graph_file, "wb"));
+    ASSERT_TRUE(file.get() != NULL);
+    BinaryCallGraphWriter writer(file.get());
+    CallGraphFunction function;
+    function.name = "Foo";
+    function.file_name = "foo.cc";
+    ASSERT_TRUE(writer.BeginCallGraph(1));
+    ASSERT_TRUE(writer.BeginPart(1, 0, "", 1, 0));
+    ASSERT_TRUE(writer.WriteFunction(function));
+    ASSERT_TRUE(writer.EndPart());
+  }
+  cmd_line_.AppendArgPath(call_graph_file);
+
+  base::FilePath output_file;
+  ASSERT_TRUE(base::CreateTemporaryFileInDir(temp_dir_, &output_file));
+  ASSERT_TRUE(base::DeleteFile(output_file, false));
+  cmd_line_.AppendSwitchPath("output-file", output_file);
+
+  EXPECT_EQ(0, app_.Run());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(output_file, &contents));
+  EXPECT_NE(std::string::npos, contents.find("fn=Foo\n"));
+}
+
 TEST_F(GrinderAppTest, SampleEndToEnd) {
   base::FilePath trace_file = temp_dir_.Append(L"sampler.bin");
   ASSERT_NO_FATAL_FAILURE(testing::WriteDummySamplerTraceFile(trace_file));
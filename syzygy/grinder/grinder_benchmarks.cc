@@ -0,0 +1,479 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Throughput benchmarks of the trace parser and of the grinders. Each
+// benchmark writes a large synthetic trace file of a given kind of record,
+// then measures the rate at which Parser::Consume dispatches it to an event
+// handler. The rates are emitted as metrics named
+// Syzygy.Grinder.Benchmark.<handler>.<records>.{EventsPerSecond,
+// MegabytesPerSecond}.
+
+#include <algorithm>
+#include <vector>
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "gtest/gtest.h"
+#include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/grinder/grinders/profile_grinder.h"
+#include "syzygy/grinder/grinders/sample_grinder.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/pe/unittest_util.h"
+#include "syzygy/testing/metrics.h"
+#include "syzygy/trace/common/clock.h"
+#include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+#include "syzygy/trace/service/process_info.h"
+#include "syzygy/trace/service/trace_file_writer.h"
+
+namespace grinder {
+
+namespace {
+
+using trace::parser::Parser;
+using trace::parser::ParseEventHandlerImpl;
+
+// The address at which the synthetic traces load test_dll.
+const uint32 kModuleAddress = 0x07000000;
+
+// The size of the segments of the synthetic traces.
+const size_t kSegmentSize = 1024 * 1024;
+
+// The shape of the synthetic traces. Each of them is a few tens of
+// megabytes.
+const size_t kNumInvocationBatches = 2048;
+const size_t kNumInvocationsPerBatch = 512;
+const size_t kNumFunctions = 1024;
+const size_t kNumCallers = 4096;
+const size_t kNumFrequencyRecords = 2048;
+const size_t kNumFrequencyEntries = 4096;
+const size_t kNumSampleRecords = 2048;
+const size_t kMaxNumSampleBuckets = 4096;
+const size_t kNumDetailedFunctionCalls = 512 * 1024;
+const size_t kArgumentDataSize = 32;
+
+// A simple linear congruential generator, so that the traces are
+// deterministic.
+uint32 NextRandom(uint32* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+// Writes a trace file, packing its records in segments of kSegmentSize bytes.
+class SyntheticTraceWriter {
+ public:
+  SyntheticTraceWriter() : timestamp_(0) {
+  }
+
+  // Opens the trace file and writes its header.
+  void Open(const base::FilePath& path) {
+    trace::common::ClockInfo clock_info = {};
+    trace::common::GetClockInfo(&clock_info);
+    timestamp_ = clock_info.tsc_reference;
+
+    ASSERT_TRUE(writer_.Open(path));
+    trace::service::ProcessInfo process_info;
+    ASSERT_TRUE(process_info.Initialize(::GetCurrentProcessId()));
+    ASSERT_TRUE(writer_.WriteHeader(process_info));
+  }
+
+  // Appends a record to the current segment, flushing the segment first if
+  // the record doesn't fit.
+  void AppendRecord(uint16 type, const void* data, size_t length) {
+    ASSERT_LE(sizeof(RecordPrefix) + length + kSegmentOverhead, kSegmentSize);
+    if (segment_.size() + sizeof(RecordPrefix) + length > kSegmentSize)
+      ASSERT_NO_FATAL_FAILURE(FlushSegment());
+    if (segment_.empty())
+      StartSegment();
+
+    RecordPrefix prefix = {};
+    prefix.timestamp = timestamp_;
+    prefix.type = type;
+    prefix.size = length;
+    prefix.version.hi = TRACE_VERSION_HI;
+    prefix.version.lo = TRACE_VERSION_LO;
+    Append(&prefix, sizeof(prefix));
+    Append(data, length);
+
+    GetSegmentHeader()->segment_length += sizeof(prefix) + length;
+  }
+
+  // Flushes the last segment and closes the trace file.
+  void Close() {
+    ASSERT_NO_FATAL_FAILURE(FlushSegment());
+    ASSERT_TRUE(writer_.Close());
+  }
+
+ private:
+  // The size of the segment prefix and header.
+  static const size_t kSegmentOverhead =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+
+  void StartSegment() {
+    DCHECK(segment_.empty());
+
+    RecordPrefix prefix = {};
+    prefix.timestamp = timestamp_;
+    prefix.type = TraceFileSegmentHeader::kTypeId;
+    prefix.size = sizeof(TraceFileSegmentHeader);
+    prefix.version.hi = TRACE_VERSION_HI;
+    prefix.version.lo = TRACE_VERSION_LO;
+    Append(&prefix, sizeof(prefix));
+
+    TraceFileSegmentHeader header = {};
+    header.thread_id = ::GetCurrentThreadId();
+    Append(&header, sizeof(header));
+  }
+
+  void FlushSegment() {
+    if (segment_.empty())
+      return;
+    segment_.resize(::common::AlignUp(segment_.size(), writer_.block_size()));
+    ASSERT_TRUE(writer_.WriteRecord(&segment_[0], segment_.size()));
+    segment_.clear();
+  }
+
+  void Append(const void* data, size_t length) {
+    const uint8* bytes = reinterpret_cast<const uint8*>(data);
+    segment_.insert(segment_.end(), bytes, bytes + length);
+  }
+
+  TraceFileSegmentHeader* GetSegmentHeader() {
+    DCHECK_LE(kSegmentOverhead, segment_.size());
+    return reinterpret_cast<TraceFileSegmentHeader*>(
+        &segment_[sizeof(RecordPrefix)]);
+  }
+
+  trace::service::TraceFileWriter writer_;
+  std::vector<uint8> segment_;
+  uint64 timestamp_;
+};
+
+// An event handler that only counts the events it receives. This measures
+// the parser on its own.
+class CountingEventHandler : public ParseEventHandlerImpl {
+ public:
+  CountingEventHandler() : num_events_(0) {
+  }
+
+  virtual void OnInvocationBatch(base::Time time,
+                                 DWORD process_id,
+                                 DWORD thread_id,
+                                 size_t num_invocations,
+                                 const TraceBatchInvocationInfo* data)
+      OVERRIDE {
+    num_events_ += num_invocations;
+  }
+  virtual void OnIndexedFrequency(base::Time time,
+                                  DWORD process_id,
+                                  DWORD thread_id,
+                                  const TraceIndexedFrequencyData* data)
+      OVERRIDE {
+    ++num_events_;
+  }
+  virtual void OnSampleData(base::Time time,
+                            DWORD process_id,
+                            const TraceSampleData* data) OVERRIDE {
+    ++num_events_;
+  }
+  virtual void OnDetailedFunctionCall(base::Time time,
+                                      DWORD process_id,
+                                      DWORD thread_id,
+                                      const TraceDetailedFunctionCall* data)
+      OVERRIDE {
+    ++num_events_;
+  }
+
+  uint64 num_events() const { return num_events_; }
+
+ private:
+  uint64 num_events_;
+};
+
+class GrinderBenchmark : public testing::Test {
+ public:
+  GrinderBenchmark()
+      : num_events_(0),
+        cmd_line_(base::FilePath(L"grinder.exe")),
+        text_header_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    trace_path_ = temp_dir_.path().Append(L"benchmark.bin");
+
+    test_dll_path_ = testing::GetOutputRelativePath(testing::kTestDllName);
+    ASSERT_TRUE(test_dll_.Init(test_dll_path_));
+    test_dll_.GetSignature(&test_dll_signature_);
+    text_header_ = test_dll_.GetSectionHeader(".text");
+    ASSERT_TRUE(text_header_ != NULL);
+  }
+
+  // Starts a synthetic trace with a load event of test_dll.
+  void BeginTrace() {
+    ASSERT_NO_FATAL_FAILURE(writer_.Open(trace_path_));
+
+    TraceModuleData module_data = {};
+    module_data.module_base_addr =
+        reinterpret_cast<ModuleAddr>(kModuleAddress);
+    module_data.module_base_size = test_dll_signature_.module_size;
+    module_data.module_checksum = test_dll_signature_.module_checksum;
+    module_data.module_time_date_stamp =
+        test_dll_signature_.module_time_date_stamp;
+    ::wcsncpy(module_data.module_name, test_dll_path_.value().c_str(),
+              arraysize(module_data.module_name));
+    ASSERT_NO_FATAL_FAILURE(writer_.AppendRecord(
+        TRACE_PROCESS_ATTACH_EVENT, &module_data, sizeof(module_data)));
+  }
+
+  // @returns a pseudo-random address in the text section of test_dll.
+  ModuleAddr GetTextAddress(size_t index) {
+    uint32 offset = (index * 16) % text_header_->Misc.VirtualSize;
+    return reinterpret_cast<ModuleAddr>(
+        kModuleAddress + text_header_->VirtualAddress + offset);
+  }
+
+  // Writes a trace of profiler invocation batches.
+  void WriteInvocationTrace() {
+    ASSERT_NO_FATAL_FAILURE(BeginTrace());
+
+    std::vector<InvocationInfo> batch(kNumInvocationsPerBatch);
+    uint32 seed = 42;
+    for (size_t i = 0; i < kNumInvocationBatches; ++i) {
+      for (size_t j = 0; j < batch.size(); ++j) {
+        InvocationInfo& info = batch[j];
+        ::memset(&info, 0, sizeof(info));
+        info.function = reinterpret_cast<FuncAddr>(
+            GetTextAddress(NextRandom(&seed) % kNumFunctions));
+        info.caller = reinterpret_cast<RetAddr>(
+            GetTextAddress(NextRandom(&seed) % kNumCallers));
+        info.num_calls = 1 + NextRandom(&seed) % 16;
+        info.cycles_min = 100 + NextRandom(&seed) % 1000;
+        info.cycles_max = info.cycles_min * 2;
+        info.cycles_sum = info.cycles_min * info.num_calls;
+      }
+      ASSERT_NO_FATAL_FAILURE(writer_.AppendRecord(
+          TRACE_BATCH_INVOCATION, &batch[0],
+          batch.size() * sizeof(batch[0])));
+    }
+
+    ASSERT_NO_FATAL_FAILURE(writer_.Close());
+    num_events_ = kNumInvocationBatches * kNumInvocationsPerBatch;
+  }
+
+  // Writes a trace of basic-block frequency records.
+  void WriteIndexedFrequencyTrace() {
+    ASSERT_NO_FATAL_FAILURE(BeginTrace());
+
+    std::vector<uint8> buffer(
+        FIELD_OFFSET(TraceIndexedFrequencyData, frequency_data) +
+            kNumFrequencyEntries * sizeof(uint32));
+    TraceIndexedFrequencyData* data =
+        reinterpret_cast<TraceIndexedFrequencyData*>(&buffer[0]);
+    data->module_base_addr = reinterpret_cast<ModuleAddr>(kModuleAddress);
+    data->module_base_size = test_dll_signature_.module_size;
+    data->module_checksum = test_dll_signature_.module_checksum;
+    data->module_time_date_stamp = test_dll_signature_.module_time_date_stamp;
+    data->num_entries = kNumFrequencyEntries;
+    data->num_columns = 1;
+    data->data_type = ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+    data->frequency_size = sizeof(uint32);
+
+    uint32* frequencies = reinterpret_cast<uint32*>(data->frequency_data);
+    uint32 seed = 42;
+    for (size_t i = 0; i < kNumFrequencyRecords; ++i) {
+      for (size_t j = 0; j < kNumFrequencyEntries; ++j)
+        frequencies[j] = NextRandom(&seed) % 1000;
+      ASSERT_NO_FATAL_FAILURE(writer_.AppendRecord(
+          TRACE_INDEXED_FREQUENCY, &buffer[0], buffer.size()));
+    }
+
+    ASSERT_NO_FATAL_FAILURE(writer_.Close());
+    num_events_ = kNumFrequencyRecords;
+  }
+
+  // Writes a trace of sampling profiler records.
+  void WriteSampleTrace() {
+    ASSERT_NO_FATAL_FAILURE(BeginTrace());
+
+    const uint32 kBucketSize = 4;
+    size_t num_buckets = std::min<size_t>(
+        kMaxNumSampleBuckets, text_header_->Misc.VirtualSize / kBucketSize);
+    std::vector<uint8> buffer(
+        FIELD_OFFSET(TraceSampleData, buckets) +
+            num_buckets * sizeof(uint32));
+    TraceSampleData* data = reinterpret_cast<TraceSampleData*>(&buffer[0]);
+    data->module_base_addr = reinterpret_cast<ModuleAddr>(kModuleAddress);
+    data->module_size = test_dll_signature_.module_size;
+    data->module_checksum = test_dll_signature_.module_checksum;
+    data->module_time_date_stamp = test_dll_signature_.module_time_date_stamp;
+    data->bucket_size = kBucketSize;
+    data->bucket_start = GetTextAddress(0);
+    data->bucket_count = num_buckets;
+    data->sampling_start_time = 0;
+    data->sampling_end_time = 1000000;
+    data->sampling_interval = 1000;
+
+    uint32 seed = 42;
+    for (size_t i = 0; i < kNumSampleRecords; ++i) {
+      for (size_t j = 0; j < num_buckets; ++j)
+        data->buckets[j] = NextRandom(&seed) % 16;
+      ASSERT_NO_FATAL_FAILURE(writer_.AppendRecord(
+          TRACE_SAMPLE_DATA, &buffer[0], buffer.size()));
+    }
+
+    ASSERT_NO_FATAL_FAILURE(writer_.Close());
+    num_events_ = kNumSampleRecords;
+  }
+
+  // Writes a trace of detailed function call records.
+  void WriteDetailedFunctionCallTrace() {
+    ASSERT_NO_FATAL_FAILURE(BeginTrace());
+
+    std::vector<uint8> buffer(
+        FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) +
+            kArgumentDataSize);
+    TraceDetailedFunctionCall* data =
+        reinterpret_cast<TraceDetailedFunctionCall*>(&buffer[0]);
+    data->argument_data_size = kArgumentDataSize;
+
+    // A single argument, filling the argument data.
+    uint32* argument_header = reinterpret_cast<uint32*>(data->argument_data);
+    argument_header[0] = 1;
+    argument_header[1] = kArgumentDataSize - 2 * sizeof(uint32);
+
+    uint32 seed = 42;
+    for (size_t i = 0; i < kNumDetailedFunctionCalls; ++i) {
+      data->timestamp = i;
+      data->function_id = NextRandom(&seed) % kNumFunctions;
+      data->stack_trace_id = NextRandom(&seed);
+      ASSERT_NO_FATAL_FAILURE(writer_.AppendRecord(
+          TRACE_DETAILED_FUNCTION_CALL, &buffer[0], buffer.size()));
+    }
+
+    ASSERT_NO_FATAL_FAILURE(writer_.Close());
+    num_events_ = kNumDetailedFunctionCalls;
+  }
+
+  // Parses the synthetic trace, dispatching it to @p handler, and emits the
+  // throughput of the parse.
+  // @param handler_name The name of the handler, for the metrics.
+  // @param records_name The name of the records of the trace, for the
+  //     metrics.
+  // @param handler The handler.
+  // @param grinder The grinder, if @p handler is one.
+  void ConsumeTrace(const char* handler_name,
+                    const char* records_name,
+                    ParseEventHandlerImpl* handler,
+                    GrinderInterface* grinder) {
+    int64 file_size = 0;
+    ASSERT_TRUE(base::GetFileSize(trace_path_, &file_size));
+
+    Parser parser;
+    ASSERT_TRUE(parser.Init(handler));
+    if (grinder != NULL)
+      grinder->SetParser(&parser);
+    ASSERT_TRUE(parser.OpenTraceFile(trace_path_));
+
+    base::Time start = base::Time::NowFromSystemTime();
+    ASSERT_TRUE(parser.Consume());
+    double seconds = (base::Time::NowFromSystemTime() - start).InSecondsF();
+    ASSERT_FALSE(parser.error_occurred());
+    ASSERT_LT(0.0, seconds);
+
+    std::string prefix = base::StringPrintf(
+        "Syzygy.Grinder.Benchmark.%s.%s", handler_name, records_name);
+    testing::EmitMetric(prefix + ".EventsPerSecond", num_events_ / seconds);
+    testing::EmitMetric(prefix + ".MegabytesPerSecond",
+                        file_size / seconds / (1024 * 1024));
+  }
+
+  // Parses the synthetic trace with a CountingEventHandler, and checks that
+  // every event was dispatched.
+  void ConsumeTraceWithParserOnly(const char* records_name) {
+    CountingEventHandler handler;
+    ASSERT_NO_FATAL_FAILURE(
+        ConsumeTrace("Parser", records_name, &handler, NULL));
+    EXPECT_EQ(num_events_, handler.num_events());
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath trace_path_;
+  SyntheticTraceWriter writer_;
+
+  // The number of events written to the synthetic trace.
+  uint64 num_events_;
+
+  // A command line with no switches, to initialize the grinders.
+  CommandLine cmd_line_;
+
+  // The module that the synthetic traces refer to.
+  base::FilePath test_dll_path_;
+  pe::PEFile test_dll_;
+  pe::PEFile::Signature test_dll_signature_;
+  const IMAGE_SECTION_HEADER* text_header_;
+};
+
+}  // namespace
+
+TEST_F(GrinderBenchmark, ParserInvocationBatches) {
+  ASSERT_NO_FATAL_FAILURE(WriteInvocationTrace());
+  ASSERT_NO_FATAL_FAILURE(ConsumeTraceWithParserOnly("InvocationBatches"));
+}
+
+TEST_F(GrinderBenchmark, ParserIndexedFrequencies) {
+  ASSERT_NO_FATAL_FAILURE(WriteIndexedFrequencyTrace());
+  ASSERT_NO_FATAL_FAILURE(ConsumeTraceWithParserOnly("IndexedFrequencies"));
+}
+
+TEST_F(GrinderBenchmark, ParserSamples) {
+  ASSERT_NO_FATAL_FAILURE(WriteSampleTrace());
+  ASSERT_NO_FATAL_FAILURE(ConsumeTraceWithParserOnly("Samples"));
+}
+
+TEST_F(GrinderBenchmark, ParserDetailedFunctionCalls) {
+  ASSERT_NO_FATAL_FAILURE(WriteDetailedFunctionCallTrace());
+  ASSERT_NO_FATAL_FAILURE(
+      ConsumeTraceWithParserOnly("DetailedFunctionCalls"));
+}
+
+TEST_F(GrinderBenchmark, ProfileGrinderInvocationBatches) {
+  ASSERT_NO_FATAL_FAILURE(WriteInvocationTrace());
+
+  grinders::ProfileGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(ConsumeTrace(
+      "ProfileGrinder", "InvocationBatches", &grinder, &grinder));
+
+  base::Time start = base::Time::NowFromSystemTime();
+  ASSERT_TRUE(grinder.Grind());
+  testing::EmitMetric(
+      "Syzygy.Grinder.Benchmark.ProfileGrinder.InvocationBatches.GrindSeconds",
+      (base::Time::NowFromSystemTime() - start).InSecondsF());
+}
+
+TEST_F(GrinderBenchmark, SampleGrinderSamples) {
+  ASSERT_NO_FATAL_FAILURE(WriteSampleTrace());
+
+  grinders::SampleGrinder grinder;
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(ConsumeTrace(
+      "SampleGrinder", "Samples", &grinder, &grinder));
+}
+
+}  // namespace grinder
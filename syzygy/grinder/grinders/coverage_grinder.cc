@@ -14,6 +14,9 @@
 
 #include "syzygy/grinder/grinders/coverage_grinder.h"
 
+#include <fcntl.h>
+#include <io.h>
+
 #include "base/files/file_path.h"
 #include "base/strings/string_util.h"
 #include "syzygy/common/indexed_frequency_data.h"
@@ -61,6 +64,8 @@ bool CoverageGrinder::ParseCommandLine(const CommandLine* command_line) {
     output_format_ = kLcovFormat;
   } else if (LowerCaseEqualsASCII(format, "cachegrind")) {
     output_format_ = kCacheGrindFormat;
+  } else if (LowerCaseEqualsASCII(format, "binary")) {
+    output_format_ = kBinaryFormat;
   } else {
     LOG(ERROR) << "Unknown output format: " << format << ".";
     return false;
@@ -73,13 +78,35 @@ void CoverageGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool CoverageGrinder::Merge(GrinderInterface* partial) {
+  DCHECK(partial != NULL);
+  CoverageGrinder* other = static_cast<CoverageGrinder*>(partial);
+
+  if (other->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  // The LineInfo objects of the other grinder refer to its own source file
+  // names, so they are aggregated right away rather than moved over.
+  PdbInfoMap::const_iterator it = other->pdb_info_cache_.begin();
+  for (; it != other->pdb_info_cache_.end(); ++it) {
+    if (!coverage_data_.Add(it->second.line_info)) {
+      LOG(ERROR) << "Failed to aggregate line information from PDB: "
+                 << it->first.path;
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool CoverageGrinder::Grind() {
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all basic block frequency data events, "
                  << "coverage results will be partial.";
   }
 
-  if (pdb_info_cache_.empty()) {
+  if (pdb_info_cache_.empty() &&
+      coverage_data_.source_file_coverage_data_map().empty()) {
     LOG(ERROR) << "No coverage data was encountered.";
     return false;
   }
@@ -115,12 +142,29 @@ bool CoverageGrinder::OutputData(FILE* file) {
       break;
     }
 
+    case kBinaryFormat: {
+      // The output may have been opened in text mode, which would mangle the
+      // binary data.
+      ::_setmode(::_fileno(file), _O_BINARY);
+      BinaryCoverage coverage;
+      coverage.Init(coverage_data_);
+      if (!coverage.SaveToFile(file)) {
+        LOG(ERROR) << "Failed to write binary coverage.";
+        return false;
+      }
+      break;
+    }
+
     default: NOTREACHED() << "Unknown OutputFormat.";
   }
 
   return true;
 }
 
+void CoverageGrinder::AddBinaryCoverage(const BinaryCoverage& coverage) {
+  coverage.ToCoverageData(&coverage_data_);
+}
+
 void CoverageGrinder::OnIndexedFrequency(
     base::Time time,
     DWORD process_id,
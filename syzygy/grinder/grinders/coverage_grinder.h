@@ -18,6 +18,7 @@
 #define SYZYGY_GRINDER_GRINDERS_COVERAGE_GRINDER_H_
 
 #include "syzygy/grinder/basic_block_util.h"
+#include "syzygy/grinder/binary_coverage.h"
 #include "syzygy/grinder/coverage_data.h"
 #include "syzygy/grinder/grinder.h"
 
@@ -35,6 +36,7 @@ class CoverageGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* partial) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -54,10 +56,16 @@ class CoverageGrinder : public GrinderInterface {
   enum OutputFormat {
     kLcovFormat,
     kCacheGrindFormat,
+    kBinaryFormat,
   };
 
   OutputFormat output_format() const { return output_format_; }
 
+  // Adds previously ground coverage to the coverage of this grinder. This
+  // allows binary coverage files to be converted to the other formats.
+  // @param coverage the coverage to be added.
+  void AddBinaryCoverage(const BinaryCoverage& coverage);
+
   const CoverageData& coverage_data() { return coverage_data_; }
 
  protected:
@@ -65,9 +73,10 @@ class CoverageGrinder : public GrinderInterface {
   // OnIndexedFrequency.
   basic_block_util::PdbInfoMap pdb_info_cache_;
 
-  // Stores the final coverage data, populated by Grind. Contains an aggregate
-  // of all LineInfo objects stored in the pdb_info_map_, in a reverse map
-  // (where efficient lookup is by file name and line number).
+  // Stores the final coverage data, populated by Merge and Grind. Contains an
+  // aggregate of all LineInfo objects stored in the pdb_info_map_ of this
+  // grinder and of the merged ones, in a reverse map (where efficient lookup
+  // is by file name and line number).
   CoverageData coverage_data_;
 
   // Points to the parser that is feeding us events. Used to get module
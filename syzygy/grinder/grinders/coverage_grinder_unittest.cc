@@ -118,6 +118,36 @@ TEST_F(CoverageGrinderTest, GrindFailsOnNoCoverageEvents) {
   EXPECT_FALSE(grinder.Grind());
 }
 
+TEST_F(CoverageGrinderTest, MergeSucceeds) {
+  TestCoverageGrinder partial;
+  partial.ParseCommandLine(&cmd_line_);
+  ASSERT_NO_FATAL_FAILURE(InitParser(&partial));
+  partial.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+
+  // A grinder that only merged the partial results has the same coverage as
+  // the grinder that handled the events.
+  TestCoverageGrinder grinder;
+  grinder.ParseCommandLine(&cmd_line_);
+  ASSERT_TRUE(grinder.Merge(&partial));
+  ASSERT_TRUE(grinder.Grind());
+  ASSERT_TRUE(partial.Grind());
+
+  typedef CoverageData::SourceFileCoverageDataMap SourceFileCoverageDataMap;
+  const SourceFileCoverageDataMap& expected =
+      partial.coverage_data().source_file_coverage_data_map();
+  const SourceFileCoverageDataMap& merged =
+      grinder.coverage_data().source_file_coverage_data_map();
+  ASSERT_EQ(expected.size(), merged.size());
+  SourceFileCoverageDataMap::const_iterator expected_it = expected.begin();
+  SourceFileCoverageDataMap::const_iterator merged_it = merged.begin();
+  for (; expected_it != expected.end(); ++expected_it, ++merged_it) {
+    EXPECT_EQ(expected_it->first, merged_it->first);
+    EXPECT_EQ(expected_it->second.line_execution_count_map,
+              merged_it->second.line_execution_count_map);
+  }
+}
+
 TEST_F(CoverageGrinderTest, GrindAndOutputLcovDataSucceeds) {
   cmd_line_.AppendSwitchASCII("output-format", "lcov");
   ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds(CoverageGrinder::kLcovFormat));
@@ -131,5 +161,11 @@ TEST_F(CoverageGrinderTest, GrindAndOutputCacheGrindDataSucceeds) {
   // TODO(chrisha): Validate the output is a valid CacheGrind file.
 }
 
+TEST_F(CoverageGrinderTest, GrindAndOutputBinaryDataSucceeds) {
+  cmd_line_.AppendSwitchASCII("output-format", "binary");
+  ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds(
+      CoverageGrinder::kBinaryFormat));
+}
+
 }  // namespace grinders
 }  // namespace grinder
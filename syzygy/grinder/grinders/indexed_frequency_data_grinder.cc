@@ -46,7 +46,58 @@ void IndexedFrequencyDataGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool IndexedFrequencyDataGrinder::Merge(GrinderInterface* partial) {
+  using basic_block_util::EntryCountType;
+  using basic_block_util::IndexedFrequencyInformation;
+  using basic_block_util::IndexedFrequencyMap;
+
+  DCHECK(partial != NULL);
+  IndexedFrequencyDataGrinder* other =
+      static_cast<IndexedFrequencyDataGrinder*>(partial);
+
+  if (other->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  FlushPendingFrequencies();
+  other->FlushPendingFrequencies();
+
+  ModuleIndexedFrequencyMap::const_iterator module_it =
+      other->frequency_data_map_.begin();
+  for (; module_it != other->frequency_data_map_.end(); ++module_it) {
+    std::pair<ModuleIndexedFrequencyMap::iterator, bool> result =
+        frequency_data_map_.insert(*module_it);
+    if (result.second)
+      continue;
+
+    // Validate fields are compatible to be grinded together.
+    IndexedFrequencyInformation& info = result.first->second;
+    const IndexedFrequencyInformation& other_info = module_it->second;
+    if (info.num_entries != other_info.num_entries ||
+        info.num_columns != other_info.num_columns ||
+        info.frequency_size != other_info.frequency_size ||
+        info.data_type != other_info.data_type) {
+      LOG(ERROR) << "Incompatible frequency data for module "
+                 << module_it->first.path;
+      event_handler_errored_ = true;
+      continue;
+    }
+
+    // Sum the frequencies using saturation arithmetic.
+    IndexedFrequencyMap::const_iterator entry_it =
+        other_info.frequency_map.begin();
+    for (; entry_it != other_info.frequency_map.end(); ++entry_it) {
+      EntryCountType& value = info.frequency_map[entry_it->first];
+      value += std::min(
+          entry_it->second,
+          std::numeric_limits<EntryCountType>::max() - value);
+    }
+  }
+
+  return true;
+}
+
 bool IndexedFrequencyDataGrinder::Grind() {
+  FlushPendingFrequencies();
   if (frequency_data_map_.empty()) {
     LOG(ERROR) << "No basic-block frequency data was encountered.";
     return false;
@@ -57,6 +108,7 @@ bool IndexedFrequencyDataGrinder::Grind() {
 
 bool IndexedFrequencyDataGrinder::OutputData(FILE* file) {
   DCHECK(file != NULL);
+  FlushPendingFrequencies();
   if (!serializer_.SaveAsJson(frequency_data_map_, file))
     return false;
   return true;
@@ -116,12 +168,7 @@ void IndexedFrequencyDataGrinder::OnIndexedFrequency(
 void IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData(
     const InstrumentedModuleInformation& instrumented_module,
     const TraceIndexedFrequencyData* data) {
-  using basic_block_util::BasicBlockOffset;
-  using basic_block_util::EntryCountType;
-  using basic_block_util::GetFrequency;
   using basic_block_util::IndexedFrequencyInformation;
-  using basic_block_util::IndexedFrequencyMap;
-  using basic_block_util::RelativeAddress;
 
   DCHECK(data != NULL);
   DCHECK_NE(0U, data->num_entries);
@@ -154,29 +201,55 @@ void IndexedFrequencyDataGrinder::UpdateBasicBlockFrequencyData(
     return;
   }
 
-  // Run over the BB frequency data and increment values for each basic block
-  // using saturation arithmetic.
-  IndexedFrequencyMap& bb_entries = info.frequency_map;
-  for (size_t bb_id = 0; bb_id < data->num_entries; ++bb_id) {
-    for (size_t column = 0; column < data->num_columns; ++column) {
-      EntryCountType amount = GetFrequency(data, bb_id, column);
-      if (amount != 0) {
-        BasicBlockOffset offs =
-            instrumented_module.block_ranges[bb_id].start().value();
+  // Add the BB frequency data to the dense counters of this module, using
+  // saturation arithmetic. As the JSON file outputs int32 and the basic block
+  // agent uses uint32 counters, the counts saturate at the maximum int32.
+  std::vector<uint32>& counts = pending_frequencies_[&instrumented_module];
+  if (counts.empty())
+    counts.resize(data->num_entries * data->num_columns, 0);
+  basic_block_util::AccumulateFrequencies(data, &counts);
+}
 
+void IndexedFrequencyDataGrinder::FlushPendingFrequencies() const {
+  using basic_block_util::BasicBlockOffset;
+  using basic_block_util::EntryCountType;
+  using basic_block_util::IndexedFrequencyInformation;
+  using basic_block_util::IndexedFrequencyMap;
+  using basic_block_util::RelativeAddress;
+
+  PendingFrequencyMap::const_iterator it = pending_frequencies_.begin();
+  for (; it != pending_frequencies_.end(); ++it) {
+    const InstrumentedModuleInformation* instrumented_module = it->first;
+    const std::vector<uint32>& counts = it->second;
+
+    ModuleIndexedFrequencyMap::iterator look =
+        frequency_data_map_.find(instrumented_module->original_module);
+    DCHECK(look != frequency_data_map_.end());
+    IndexedFrequencyInformation& info = look->second;
+    DCHECK_EQ(info.num_entries * info.num_columns, counts.size());
+
+    // Increment the values of each basic block with a non-zero count, using
+    // saturation arithmetic. The dense counts are already saturated at the
+    // maximum EntryCountType.
+    IndexedFrequencyMap& bb_entries = info.frequency_map;
+    for (size_t bb_id = 0; bb_id < info.num_entries; ++bb_id) {
+      for (size_t column = 0; column < info.num_columns; ++column) {
+        EntryCountType amount = counts[bb_id * info.num_columns + column];
+        DCHECK_LE(0, amount);
+        if (amount == 0)
+          continue;
+
+        BasicBlockOffset offs =
+            instrumented_module->block_ranges[bb_id].start().value();
         EntryCountType& value = bb_entries[
             std::make_pair(RelativeAddress(offs), column)];
-        if (amount < 0) {
-          // We need to detect uint32 to int32 overflow because JSON file output
-          // int32 and basic block agent use an uint32 counter.
-          value = std::numeric_limits<EntryCountType>::max();
-        } else {
-          value += std::min(
-              amount, std::numeric_limits<EntryCountType>::max() - value);
-        }
+        value += std::min(
+            amount, std::numeric_limits<EntryCountType>::max() - value);
       }
     }
   }
+
+  pending_frequencies_.clear();
 }
 
 const IndexedFrequencyDataGrinder::InstrumentedModuleInformation*
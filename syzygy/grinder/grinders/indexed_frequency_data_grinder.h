@@ -47,6 +47,7 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* partial) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -65,6 +66,7 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
 
   // @returns a map from ModuleInformation records to basic block frequencies.
   const ModuleIndexedFrequencyMap& frequency_data_map() const {
+    FlushPendingFrequencies();
     return frequency_data_map_;
   }
 
@@ -89,11 +91,17 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
                    InstrumentedModuleInformation,
                    ModuleIdentityComparator> InstrumentedModuleMap;
 
+  // Frequencies are first summed in dense counters per instrumented module,
+  // laid out like the values of the frequency data records. They are only
+  // folded into the sparse frequency maps when those are needed.
+  typedef std::map<const InstrumentedModuleInformation*,
+                   std::vector<uint32> > PendingFrequencyMap;
+
   // This method does the actual updating of the frequencies on receipt
   // of basic-block frequency data. It is implemented separately from the
   // main hook for unit-testing purposes.
   // @param module_info the module whose basic-block frequencies are being
-  //     counted.
+  //     counted. It must outlive the next call to FlushPendingFrequencies.
   // @param data the basic-block frequencies being reported. The data type of
   //     this record is expected to be a basic-blocks data frequencies.
   void UpdateBasicBlockFrequencyData(
@@ -107,8 +115,15 @@ class IndexedFrequencyDataGrinder : public GrinderInterface {
   const InstrumentedModuleInformation* FindOrCreateInstrumentedModule(
       const ModuleInformation* module_info);
 
+  // Folds the pending dense counters into frequency_data_map_.
+  void FlushPendingFrequencies() const;
+
   // Stores the summarized basic-block frequencies for each module encountered.
-  ModuleIndexedFrequencyMap frequency_data_map_;
+  // These are brought up to date lazily, hence mutable.
+  mutable ModuleIndexedFrequencyMap frequency_data_map_;
+
+  // The frequencies that haven't been folded into frequency_data_map_ yet.
+  mutable PendingFrequencyMap pending_frequencies_;
 
   // Stores the basic block ID maps for each module encountered.
   InstrumentedModuleMap instrumented_modules_;
@@ -291,6 +291,35 @@ TEST_F(IndexedFrequencyDataGrinderTest, UpdateBasicBlockFrequencyData) {
               testing::ContainerEq(expected_counts));
 }
 
+TEST_F(IndexedFrequencyDataGrinderTest, Merge) {
+  InstrumentedModuleInformation module_info;
+  ASSERT_NO_FATAL_FAILURE(InitModuleInfo(&module_info));
+
+  ScopedFrequencyData data;
+  ASSERT_NO_FATAL_FAILURE(
+      GetFrequencyData(module_info.original_module, 4, &data));
+
+  TestIndexedFrequencyDataGrinder grinder;
+  TestIndexedFrequencyDataGrinder partial1;
+  TestIndexedFrequencyDataGrinder partial2;
+  partial1.UpdateBasicBlockFrequencyData(module_info, data.get());
+  partial2.UpdateBasicBlockFrequencyData(module_info, data.get());
+
+  // The first merge copies the module data, the second sums the frequencies.
+  IndexedFrequencyMap expected_counts;
+  ASSERT_TRUE(grinder.Merge(&partial1));
+  ASSERT_EQ(1U, grinder.frequency_data_map().size());
+  CreateExpectedCounts(1, &expected_counts);
+  EXPECT_THAT(grinder.frequency_data_map().begin()->second.frequency_map,
+              testing::ContainerEq(expected_counts));
+
+  ASSERT_TRUE(grinder.Merge(&partial2));
+  ASSERT_EQ(1U, grinder.frequency_data_map().size());
+  CreateExpectedCounts(2, &expected_counts);
+  EXPECT_THAT(grinder.frequency_data_map().begin()->second.frequency_map,
+              testing::ContainerEq(expected_counts));
+}
+
 TEST_F(IndexedFrequencyDataGrinderTest, GrindBranchEntryDataSucceeds) {
   ModuleIndexedFrequencyMap entry_counts;
   ASSERT_NO_FATAL_FAILURE(
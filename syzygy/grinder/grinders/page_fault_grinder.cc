@@ -0,0 +1,245 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/grinders/page_fault_grinder.h"
+
+#include <algorithm>
+
+#include "syzygy/pdb/omap.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/find.h"
+
+namespace grinder {
+namespace grinders {
+
+namespace {
+
+using trace::parser::AbsoluteAddress64;
+using trace::parser::ModuleInformation;
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef PageFaultGrinder::BlockFaultData BlockFaultData;
+typedef PageFaultGrinder::FaultData FaultData;
+
+// Orders blocks by their first fault, then by address.
+bool BlockFaultedFirst(const BlockFaultData& bfd1,
+                       const BlockFaultData& bfd2) {
+  if (bfd1.faults.first_fault != bfd2.faults.first_fault)
+    return bfd1.faults.first_fault < bfd2.faults.first_fault;
+  return bfd1.address < bfd2.address;
+}
+
+}  // namespace
+
+const char PageFaultGrinder::kImage[] = "image";
+const char PageFaultGrinder::kOriginalImage[] = "original-image";
+
+void PageFaultGrinder::FaultData::Merge(const FaultData& other) {
+  if (other.soft_faults + other.hard_faults == 0)
+    return;
+  if (soft_faults + hard_faults == 0 || other.first_fault < first_fault)
+    first_fault = other.first_fault;
+  soft_faults += other.soft_faults;
+  hard_faults += other.hard_faults;
+}
+
+PageFaultGrinder::PageFaultGrinder()
+    : parser_(NULL), image_layout_(&block_graph_), orphaned_faults_(0) {
+}
+
+PageFaultGrinder::~PageFaultGrinder() {
+}
+
+bool PageFaultGrinder::ParseCommandLine(const CommandLine* command_line) {
+  DCHECK(command_line != NULL);
+
+  image_path_ = command_line->GetSwitchValuePath(kImage);
+  if (image_path_.empty()) {
+    LOG(ERROR) << "Must specify --" << kImage << ".";
+    return false;
+  }
+
+  pe::PEFile image;
+  if (!image.Init(image_path_)) {
+    LOG(ERROR) << "Failed to parse image \"" << image_path_.value() << "\".";
+    return false;
+  }
+  image.GetSignature(&image_signature_);
+
+  original_image_path_ = command_line->GetSwitchValuePath(kOriginalImage);
+
+  return true;
+}
+
+void PageFaultGrinder::SetParser(Parser* parser) {
+  DCHECK(parser != NULL);
+  parser_ = parser;
+}
+
+bool PageFaultGrinder::Merge(GrinderInterface* partial) {
+  DCHECK(partial != NULL);
+  PageFaultGrinder* other = static_cast<PageFaultGrinder*>(partial);
+
+  FaultMap::const_iterator it = other->faults_.begin();
+  for (; it != other->faults_.end(); ++it)
+    faults_[it->first].Merge(it->second);
+
+  return true;
+}
+
+bool PageFaultGrinder::Grind() {
+  if (faults_.empty()) {
+    LOG(ERROR) << "No page faults were found for module \""
+               << image_path_.value() << "\".";
+    return false;
+  }
+
+  // A relinked image has its faults mapped back to the original image via
+  // the OMAP of its PDB.
+  base::FilePath layout_path(image_path_);
+  std::vector<OMAP> omap_from;
+  if (!original_image_path_.empty()) {
+    layout_path = original_image_path_;
+
+    base::FilePath pdb_path;
+    if (!pe::FindPdbForModule(image_path_, &pdb_path) || pdb_path.empty()) {
+      LOG(ERROR) << "Failed to find PDB for image \"" << image_path_.value()
+                 << "\".";
+      return false;
+    }
+    if (!pdb::ReadOmapsFromPdbFile(pdb_path, NULL, &omap_from)) {
+      LOG(ERROR) << "Failed to read OMAP from PDB \"" << pdb_path.value()
+                 << "\".";
+      return false;
+    }
+    if (omap_from.empty()) {
+      LOG(ERROR) << "Image \"" << image_path_.value() << "\" is not relinked.";
+      return false;
+    }
+  }
+
+  pe::PEFile image;
+  if (!image.Init(layout_path)) {
+    LOG(ERROR) << "Failed to read PE file \"" << layout_path.value() << "\".";
+    return false;
+  }
+
+  pe::Decomposer decomposer(image);
+  LOG(INFO) << "Decomposing module \"" << layout_path.value() << "\".";
+  if (!decomposer.Decompose(&image_layout_)) {
+    LOG(ERROR) << "Failed to decompose module \"" << layout_path.value()
+               << "\".";
+    return false;
+  }
+
+  // Attribute the faults to the blocks.
+  typedef std::map<const BlockGraph::Block*, FaultData> BlockFaultMap;
+  BlockFaultMap block_fault_map;
+  FaultMap::const_iterator it = faults_.begin();
+  for (; it != faults_.end(); ++it) {
+    core::RelativeAddress address(it->first);
+    if (!omap_from.empty())
+      address = pdb::TranslateAddressViaOmap(omap_from, address);
+
+    const BlockGraph::Block* block =
+        image_layout_.blocks.GetBlockByAddress(address);
+    if (block == NULL) {
+      orphaned_faults_ += it->second.soft_faults + it->second.hard_faults;
+      continue;
+    }
+    block_fault_map[block].Merge(it->second);
+  }
+
+  if (orphaned_faults_ != 0) {
+    LOG(WARNING) << orphaned_faults_ << " page faults could not be "
+                 << "attributed to a block.";
+  }
+
+  block_faults_.reserve(block_fault_map.size());
+  BlockFaultMap::const_iterator block_it = block_fault_map.begin();
+  for (; block_it != block_fault_map.end(); ++block_it) {
+    BlockFaultData data = { block_it->first, core::RelativeAddress(),
+                            block_it->second };
+    if (!image_layout_.blocks.GetAddressOf(block_it->first, &data.address)) {
+      LOG(ERROR) << "Block \"" << block_it->first->name() << "\" is not in "
+                 << "the image layout.";
+      return false;
+    }
+    block_faults_.push_back(data);
+  }
+  std::sort(block_faults_.begin(), block_faults_.end(), BlockFaultedFirst);
+
+  return true;
+}
+
+bool PageFaultGrinder::OutputData(FILE* file) {
+  DCHECK(file != NULL);
+
+  if (::fprintf(file, "RVA, Size, Compiland, Block, SoftFaults, "
+                      "HardFaults\n") <= 0) {
+    return false;
+  }
+
+  for (size_t i = 0; i < block_faults_.size(); ++i) {
+    const BlockFaultData& data = block_faults_[i];
+    if (::fprintf(file,
+                  "0x%08X, %d, %s, %s, %d, %d\n",
+                  data.address.value(),
+                  data.block->size(),
+                  data.block->compiland_name().c_str(),
+                  data.block->name().c_str(),
+                  data.faults.soft_faults,
+                  data.faults.hard_faults) <= 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void PageFaultGrinder::OnPageFault(base::Time time,
+                                   DWORD process_id,
+                                   DWORD thread_id,
+                                   AbsoluteAddress64 address,
+                                   bool is_hard_fault) {
+  DCHECK(parser_ != NULL);
+
+  // Most faults are taken outside of any module, on the heap or the stacks.
+  const ModuleInformation* module_info =
+      parser_->GetModuleInformation(process_id, address);
+  if (module_info == NULL)
+    return;
+
+  // Only keep the faults taken in the image of interest.
+  if (image_signature_.module_size != module_info->module_size ||
+      image_signature_.module_checksum != module_info->module_checksum ||
+      image_signature_.module_time_date_stamp !=
+          module_info->module_time_date_stamp) {
+    return;
+  }
+
+  FaultData fault;
+  fault.first_fault = time;
+  if (is_hard_fault)
+    fault.hard_faults = 1;
+  else
+    fault.soft_faults = 1;
+
+  core::RelativeAddress rva(
+      static_cast<uint32>(address - module_info->base_address.value()));
+  faults_[rva].Merge(fault);
+}
+
+}  // namespace grinders
+}  // namespace grinder
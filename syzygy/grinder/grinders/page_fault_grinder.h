@@ -0,0 +1,127 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the page fault grinder, which processes the page faults recorded
+// in kernel ETW traces. The faults taken in an image are attributed to the
+// blocks of that image or, for a relinked image, to the blocks of the
+// original image via the OMAP of the relinked image's PDB. The blocks are
+// output in the order in which they first faulted, which allows the actual
+// page faults of an ordering to be compared to simulated ones.
+
+#ifndef SYZYGY_GRINDER_GRINDERS_PAGE_FAULT_GRINDER_H_
+#define SYZYGY_GRINDER_GRINDERS_PAGE_FAULT_GRINDER_H_
+
+#include <map>
+#include <vector>
+
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/core/address.h"
+#include "syzygy/grinder/grinder.h"
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/pe_file.h"
+
+namespace grinder {
+namespace grinders {
+
+// This class processes kernel traces and attributes the page faults taken in
+// an image to its blocks.
+class PageFaultGrinder : public GrinderInterface {
+ public:
+  PageFaultGrinder();
+  ~PageFaultGrinder();
+
+  // @name GrinderInterface implementation.
+  // @{
+  virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
+  virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* partial) OVERRIDE;
+  virtual bool Grind() OVERRIDE;
+  virtual bool OutputData(FILE* file) OVERRIDE;
+  // @}
+
+  // @name ParseEventHandler implementation.
+  // @{
+  virtual void OnPageFault(base::Time time,
+                           DWORD process_id,
+                           DWORD thread_id,
+                           trace::parser::AbsoluteAddress64 address,
+                           bool is_hard_fault) OVERRIDE;
+  // @}
+
+  // @name Parameter names.
+  // @{
+  static const char kImage[];
+  static const char kOriginalImage[];
+  // @}
+
+  // The page faults taken at an address or in a block.
+  struct FaultData {
+    FaultData() : soft_faults(0), hard_faults(0) { }
+
+    // Adds the faults of @p other to these ones.
+    void Merge(const FaultData& other);
+
+    size_t soft_faults;
+    size_t hard_faults;
+    base::Time first_fault;
+  };
+
+  // The page faults taken in a block of the image.
+  struct BlockFaultData {
+    const block_graph::BlockGraph::Block* block;
+    core::RelativeAddress address;
+    FaultData faults;
+  };
+
+  // The faults, by address in the traced image.
+  typedef std::map<core::RelativeAddress, FaultData> FaultMap;
+
+  // @name Accessors, for unit testing.
+  // @{
+  const FaultMap& faults() const { return faults_; }
+  const std::vector<BlockFaultData>& block_faults() const {
+    return block_faults_;
+  }
+  size_t orphaned_faults() const { return orphaned_faults_; }
+  // @}
+
+ protected:
+  // The traced image, and the original image if it was relinked.
+  base::FilePath image_path_;
+  base::FilePath original_image_path_;
+  pe::PEFile::Signature image_signature_;
+
+  // The parser feeding this grinder.
+  Parser* parser_;
+
+  // The faults taken in the traced image.
+  FaultMap faults_;
+
+  // The faults attributed to the blocks of the original image, in the order
+  // in which the blocks first faulted. Populated by Grind.
+  block_graph::BlockGraph block_graph_;
+  pe::ImageLayout image_layout_;
+  std::vector<BlockFaultData> block_faults_;
+
+  // The number of faults that didn't land in any block.
+  size_t orphaned_faults_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PageFaultGrinder);
+};
+
+}  // namespace grinders
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_GRINDERS_PAGE_FAULT_GRINDER_H_
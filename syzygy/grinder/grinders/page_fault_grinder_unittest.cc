@@ -0,0 +1,206 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/grinders/page_fault_grinder.h"
+
+#include "base/file_util.h"
+#include "base/win/scoped_com_initializer.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+#include "syzygy/trace/parse/parse_engine.h"
+
+namespace grinder {
+namespace grinders {
+
+namespace {
+
+using trace::parser::ModuleInformation;
+
+const DWORD kProcessId = 0x1234;
+const DWORD kThreadId = 0x5678;
+const uint32 kModuleBase = 0x10000000;
+
+// A parse engine that only tracks the modules it is given.
+class TestParseEngine : public trace::parser::ParseEngine {
+ public:
+  TestParseEngine() : ParseEngine("Test", true) {
+  }
+
+  virtual bool IsRecognizedTraceFile(
+      const base::FilePath& trace_file_path) OVERRIDE {
+    return true;
+  }
+  virtual bool OpenTraceFile(const base::FilePath& trace_file_path) OVERRIDE {
+    return true;
+  }
+  virtual bool ConsumeAllEvents() OVERRIDE { return true; }
+  virtual bool CloseAllTraceFiles() OVERRIDE { return true; }
+
+  using ParseEngine::AddModuleInformation;
+};
+
+class PageFaultGrinderTest : public testing::PELibUnitTest {
+ public:
+  PageFaultGrinderTest()
+      : cmd_line_(base::FilePath(L"page_fault_grinder.exe")),
+        engine_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    testing::PELibUnitTest::SetUp();
+    test_dll_path_ = testing::GetOutputRelativePath(testing::kTestDllName);
+  }
+
+  // Loads @p image_path in the test process, as seen by the parser.
+  void InitParser(PageFaultGrinder* grinder,
+                  const base::FilePath& image_path) {
+    ASSERT_TRUE(grinder != NULL);
+
+    pe::PEFile image;
+    ASSERT_TRUE(image.Init(image_path));
+    ModuleInformation module_info;
+    image.GetSignature(&module_info);
+    module_info.base_address.set_value(kModuleBase);
+
+    engine_ = new TestParseEngine();
+    parser_.AddParseEngine(engine_);
+    ASSERT_TRUE(parser_.Init(grinder));
+    ASSERT_TRUE(parser_.OpenTraceFile(base::FilePath(L"kernel.etl")));
+    ASSERT_TRUE(engine_->AddModuleInformation(kProcessId, module_info));
+    grinder->SetParser(&parser_);
+  }
+
+  // Faults at @p rva in the test image.
+  void Fault(PageFaultGrinder* grinder, uint32 rva, int64 time,
+             bool is_hard_fault) {
+    grinder->OnPageFault(base::Time::FromInternalValue(time), kProcessId,
+                         kThreadId, kModuleBase + rva, is_hard_fault);
+  }
+
+ protected:
+  CommandLine cmd_line_;
+  base::FilePath test_dll_path_;
+  trace::parser::Parser parser_;
+  TestParseEngine* engine_;
+  base::win::ScopedCOMInitializer com_initializer_;
+};
+
+}  // namespace
+
+TEST_F(PageFaultGrinderTest, ParseCommandLine) {
+  PageFaultGrinder grinder;
+  EXPECT_FALSE(grinder.ParseCommandLine(&cmd_line_));
+
+  cmd_line_.AppendSwitchPath(PageFaultGrinder::kImage, test_dll_path_);
+  EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(PageFaultGrinderTest, GrindFailsWithoutFaults) {
+  PageFaultGrinder grinder;
+  cmd_line_.AppendSwitchPath(PageFaultGrinder::kImage, test_dll_path_);
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  EXPECT_FALSE(grinder.Grind());
+}
+
+TEST_F(PageFaultGrinderTest, GrindAttributesFaultsToBlocks) {
+  PageFaultGrinder grinder;
+  cmd_line_.AppendSwitchPath(PageFaultGrinder::kImage, test_dll_path_);
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder, test_dll_path_));
+
+  // Find two code blocks of the image.
+  pe::PEFile image;
+  ASSERT_TRUE(image.Init(test_dll_path_));
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll(&image, &image_layout));
+  std::vector<core::RelativeAddress> code_blocks;
+  block_graph::BlockGraph::AddressSpace::RangeMapConstIter it =
+      image_layout.blocks.begin();
+  for (; it != image_layout.blocks.end() && code_blocks.size() < 2; ++it) {
+    if (it->second->type() == block_graph::BlockGraph::CODE_BLOCK &&
+        it->first.size() > 1) {
+      code_blocks.push_back(it->first.start());
+    }
+  }
+  ASSERT_EQ(2u, code_blocks.size());
+
+  // The second block faults first. Faults outside of the module are ignored.
+  Fault(&grinder, code_blocks[1].value(), 10, true);
+  Fault(&grinder, code_blocks[0].value(), 20, false);
+  Fault(&grinder, code_blocks[0].value() + 1, 30, true);
+  Fault(&grinder, code_blocks[1].value(), 40, false);
+  grinder.OnPageFault(base::Time::FromInternalValue(50), kProcessId,
+                      kThreadId, kModuleBase - 1, true);
+  EXPECT_EQ(3u, grinder.faults().size());
+
+  ASSERT_TRUE(grinder.Grind());
+  ASSERT_EQ(2u, grinder.block_faults().size());
+  EXPECT_EQ(0u, grinder.orphaned_faults());
+
+  const PageFaultGrinder::BlockFaultData& first = grinder.block_faults()[0];
+  EXPECT_EQ(code_blocks[1], first.address);
+  EXPECT_EQ(1u, first.faults.soft_faults);
+  EXPECT_EQ(1u, first.faults.hard_faults);
+  EXPECT_EQ(10, first.faults.first_fault.ToInternalValue());
+
+  const PageFaultGrinder::BlockFaultData& second = grinder.block_faults()[1];
+  EXPECT_EQ(code_blocks[0], second.address);
+  EXPECT_EQ(1u, second.faults.soft_faults);
+  EXPECT_EQ(1u, second.faults.hard_faults);
+  EXPECT_EQ(20, second.faults.first_fault.ToInternalValue());
+
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath output_path = temp_dir.Append(L"faults.csv");
+  base::ScopedFILE output(base::OpenFile(output_path, "wb"));
+  ASSERT_TRUE(output.get() != NULL);
+  EXPECT_TRUE(grinder.OutputData(output.get()));
+}
+
+TEST_F(PageFaultGrinderTest, GrindMapsRelinkedImageViaOmap) {
+  base::FilePath relinked_path =
+      testing::GetExeTestDataRelativePath(testing::kRandomizedTestDllName);
+
+  PageFaultGrinder grinder;
+  cmd_line_.AppendSwitchPath(PageFaultGrinder::kImage, relinked_path);
+  cmd_line_.AppendSwitchPath(PageFaultGrinder::kOriginalImage,
+                             test_dll_path_);
+  ASSERT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder, relinked_path));
+
+  // Fault at the entry point of the relinked image, which maps back to the
+  // entry point of the original image.
+  pe::PEFile relinked_image;
+  ASSERT_TRUE(relinked_image.Init(relinked_path));
+  Fault(&grinder,
+        relinked_image.nt_headers()->OptionalHeader.AddressOfEntryPoint,
+        10, true);
+
+  ASSERT_TRUE(grinder.Grind());
+  ASSERT_EQ(1u, grinder.block_faults().size());
+  EXPECT_EQ(0u, grinder.orphaned_faults());
+
+  pe::PEFile image;
+  ASSERT_TRUE(image.Init(test_dll_path_));
+  core::RelativeAddress entry_point(
+      image.nt_headers()->OptionalHeader.AddressOfEntryPoint);
+  const PageFaultGrinder::BlockFaultData& data = grinder.block_faults()[0];
+  EXPECT_LE(data.address, entry_point);
+  EXPECT_GT(data.address + data.block->size(), entry_point);
+}
+
+}  // namespace grinders
+}  // namespace grinder
@@ -14,19 +14,23 @@
 
 #include "syzygy/grinder/grinders/profile_grinder.h"
 
+#include <fcntl.h>
+#include <io.h>
+
 #include "base/at_exit.h"
 #include "base/command_line.h"
+#include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
-#include "base/win/scoped_bstr.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/pe/find.h"
+#include "syzygy/pe/pdb_info.h"
 
 namespace grinder {
 namespace grinders {
 
-using base::win::ScopedBstr;
 using base::win::ScopedComPtr;
 using trace::parser::AbsoluteAddress64;
 using trace::parser::ParseEventHandler;
@@ -57,6 +61,23 @@ bool ModuleInformationKeyLess(const ModuleInformation& a,
   return a.path < b.path;
 }
 
+// Subtracts @p cycles from @p value, without going below zero.
+uint64 SubtractCycles(uint64 value, uint64 cycles) {
+  return value > cycles ? value - cycles : 0;
+}
+
+// Removes the overhead of the profiler's hooks from an invocation info.
+void CompensateInvocation(const TraceProfilerCalibration& calibration,
+                          InvocationInfo* info) {
+  DCHECK(info != NULL);
+
+  uint64 overhead = calibration.invocation_overhead_cycles;
+  info->cycles_min = SubtractCycles(info->cycles_min, overhead);
+  info->cycles_max = SubtractCycles(info->cycles_max, overhead);
+  info->cycles_sum = SubtractCycles(info->cycles_sum,
+                                    overhead * info->num_calls);
+}
+
 }  // namespace
 
 ProfileGrinder::CodeLocation::CodeLocation()
@@ -134,7 +155,8 @@ ProfileGrinder::PartData::PartData()
 ProfileGrinder::ProfileGrinder()
     : parser_(NULL),
       modules_(ModuleInformationKeyLess),
-      thread_parts_(true) {
+      thread_parts_(true),
+      output_format_(kCacheGrindFormat) {
 }
 
 ProfileGrinder::~ProfileGrinder() {
@@ -142,6 +164,21 @@ ProfileGrinder::~ProfileGrinder() {
 
 bool ProfileGrinder::ParseCommandLine(const CommandLine* command_line) {
   thread_parts_ = command_line->HasSwitch("thread-parts");
+  symbol_cache_dir_ = command_line->GetSwitchValuePath("symbol-cache-dir");
+
+  const char kOutputFormat[] = "output-format";
+  if (!command_line->HasSwitch(kOutputFormat))
+    return true;
+
+  std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+  if (LowerCaseEqualsASCII(format, "cachegrind")) {
+    output_format_ = kCacheGrindFormat;
+  } else if (LowerCaseEqualsASCII(format, "binary")) {
+    output_format_ = kBinaryFormat;
+  } else {
+    LOG(ERROR) << "Unknown output format: " << format << ".";
+    return false;
+  }
   return true;
 }
 
@@ -150,6 +187,62 @@ void ProfileGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool ProfileGrinder::Merge(GrinderInterface* partial) {
+  DCHECK(partial != NULL);
+  ProfileGrinder* other = static_cast<ProfileGrinder*>(partial);
+  DCHECK_EQ(thread_parts_, other->thread_parts_);
+
+  dynamic_symbols_.insert(other->dynamic_symbols_.begin(),
+                          other->dynamic_symbols_.end());
+
+  PartDataMap::const_iterator part_it = other->parts_.begin();
+  for (; part_it != other->parts_.end(); ++part_it) {
+    const PartData& other_part = part_it->second;
+    PartData* part = FindOrCreatePart(other_part.process_id_,
+                                      other_part.thread_id_);
+    if (part->thread_name_.empty())
+      part->thread_name_ = other_part.thread_name_;
+
+    // The callers have yet to be resolved, so only the locations and the
+    // metrics need to be merged.
+    InvocationNodeMap::const_iterator node_it = other_part.nodes_.begin();
+    for (; node_it != other_part.nodes_.end(); ++node_it) {
+      FunctionLocation function = node_it->first;
+      CanonicalizeLocation(&function);
+
+      std::pair<InvocationNodeMap::iterator, bool> result =
+          part->nodes_.insert(std::make_pair(function, InvocationNode()));
+      InvocationNode& node = result.first->second;
+      if (result.second) {
+        node.function = function;
+        node.metrics = node_it->second.metrics;
+      } else {
+        AggregateMetrics(node_it->second.metrics, &node.metrics);
+      }
+    }
+
+    InvocationEdgeMap::const_iterator edge_it = other_part.edges_.begin();
+    for (; edge_it != other_part.edges_.end(); ++edge_it) {
+      InvocationEdgeKey key(edge_it->first);
+      CanonicalizeLocation(&key.first);
+      CanonicalizeLocation(&key.second);
+
+      std::pair<InvocationEdgeMap::iterator, bool> result =
+          part->edges_.insert(std::make_pair(key, InvocationEdge()));
+      InvocationEdge& edge = result.first->second;
+      if (result.second) {
+        edge.function = key.first;
+        edge.caller = key.second;
+        edge.metrics = edge_it->second.metrics;
+      } else {
+        AggregateMetrics(edge_it->second.metrics, &edge.metrics);
+      }
+    }
+  }
+
+  return true;
+}
+
 bool ProfileGrinder::Grind() {
   if (!ResolveCallers()) {
     LOG(ERROR) << "Error resolving callers.";
@@ -262,31 +355,55 @@ ProfileGrinder::PartData* ProfileGrinder::FindOrCreatePart(DWORD process_id,
   return &it->second;
 }
 
-bool ProfileGrinder::GetFunctionSymbolByRVA(IDiaSession* session,
-                                            RVA address,
-                                            IDiaSymbol** symbol) {
-  DCHECK(session != NULL);
-  DCHECK(symbol != NULL && *symbol == NULL);
-
-  ScopedComPtr<IDiaSymbol> function;
-  HRESULT hr = session->findSymbolByRVA(address,
-                                        SymTagFunction,
-                                        function.Receive());
-  if (FAILED(hr) || function.get() == NULL) {
-    // No private function, let's try for a public symbol.
-    hr = session->findSymbolByRVA(address,
-                                  SymTagPublicSymbol,
-                                  function.Receive());
-    if (FAILED(hr))
-      return false;
+bool ProfileGrinder::GetSymbolTableForModule(const ModuleInformation* module,
+                                             const SymbolTable** table) {
+  DCHECK(module != NULL);
+  DCHECK(table != NULL);
+
+  std::pair<ModuleSymbolTableMap::iterator, bool> result =
+      module_symbol_tables_.insert(std::make_pair(module, SymbolTable()));
+  SymbolTable* symbol_table = &result.first->second;
+
+  if (result.second) {
+    // The symbol cache is keyed on the signature of the module's PDB, which
+    // is read from the module itself. This avoids loading the PDB at all when
+    // the symbols are cached.
+    base::FilePath cache_path;
+    if (!symbol_cache_dir_.empty()) {
+      base::FilePath module_path;
+      pe::PdbInfo pdb_info;
+      if (pe::FindModuleBySignature(*module, &module_path) &&
+          !module_path.empty() && pdb_info.Init(module_path)) {
+        cache_path = SymbolTable::GetCachePath(symbol_cache_dir_,
+                                               pdb_info.signature(),
+                                               pdb_info.pdb_age());
+      }
+    }
+
+    if (cache_path.empty() || !symbol_table->LoadFromFile(cache_path)) {
+      ScopedComPtr<IDiaSession> session;
+      if (!GetSessionForModule(module, session.Receive()) ||
+          !symbol_table->Init(session.get())) {
+        // Leave an empty table behind, to remember the failure.
+        *symbol_table = SymbolTable();
+        return false;
+      }
+
+      if (!cache_path.empty() &&
+          (!base::CreateDirectory(symbol_cache_dir_) ||
+           !symbol_table->SaveToFile(cache_path))) {
+        LOG(WARNING) << "Unable to cache the symbols of module '"
+                     << module->path << "'.";
+      }
+    }
   }
-  if (function.get() == NULL) {
-    LOG(ERROR) << "NULL function returned from findSymbolByRVA.";
+
+  if (symbol_table->functions().empty() &&
+      symbol_table->public_symbols().empty()) {
     return false;
   }
 
-  *symbol = function.Detach();
-
+  *table = symbol_table;
   return true;
 }
 
@@ -314,66 +431,28 @@ bool ProfileGrinder::GetFunctionForCaller(const CallerLocation& caller,
     return true;
   }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetSessionForModule(caller.module(), session.Receive()))
+  const SymbolTable* table = NULL;
+  if (!GetSymbolTableForModule(caller.module(), &table))
     return false;
 
-  ScopedComPtr<IDiaSymbol> function_sym;
-  if (!GetFunctionSymbolByRVA(session.get(),
-                              caller.rva(),
-                              function_sym.Receive())) {
+  const SymbolTable::Function* function_symbol =
+      table->FindFunction(core::RelativeAddress(caller.rva()));
+  if (function_symbol == NULL) {
     LOG(ERROR) << "No symbol info available for function in module '"
                << caller.module()->path << "'";
-  }
-
-  // Get the RVA of the function.
-  DWORD rva = 0;
-  HRESULT hr = function_sym->get_relativeVirtualAddress(&rva);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_relativeVirtualAddress: "
-               << common::LogHr(hr) << ".";
     return false;
   }
 
   // Return the module/rva we found.
-  function->Set(caller.module(), rva);
-
-  ULONGLONG length = 0;
-  hr = function_sym->get_length(&length);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_length: " << common::LogHr(hr) << ".";
-    return false;
-  }
-
-  DWORD line_number = 0;
-  if (length != 0) {
-    ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
-
-    hr = session->findLinesByRVA(caller.rva(), length, enum_lines.Receive());
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    ScopedComPtr<IDiaLineNumber> line;
-    ULONG fetched = 0;
-    hr = enum_lines->Next(1, line.Receive(), &fetched);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in IDiaLineNumber::Next: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    if (fetched == 1) {
-      hr = line->get_lineNumber(&line_number);
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_lineNumber: " << common::LogHr(hr) << ".";
-        return false;
-      }
-    } else if (fetched != 0) {
-      NOTREACHED() << "IDiaLineNumber::Next unexpectedly returned "
-                   << fetched << " elements.";
-    }
+  function->Set(caller.module(), function_symbol->address.value());
+
+  size_t line_number = 0;
+  if (function_symbol->size != 0) {
+    const SymbolTable::Line* caller_line =
+        table->FindLine(core::RelativeAddress(caller.rva()),
+                        function_symbol->size);
+    if (caller_line != NULL)
+      line_number = caller_line->line_number;
   }
 
   *line = line_number;
@@ -417,77 +496,33 @@ bool ProfileGrinder::GetInfoForFunction(const FunctionLocation& function,
     return true;
   }
 
-  ScopedComPtr<IDiaSession> session;
-  if (!GetSessionForModule(function.module(), session.Receive()))
+  const SymbolTable* table = NULL;
+  if (!GetSymbolTableForModule(function.module(), &table))
     return false;
 
-  ScopedComPtr<IDiaSymbol> function_sym;
-  if (!GetFunctionSymbolByRVA(session.get(),
-                              function.rva(),
-                              function_sym.Receive())) {
+  const SymbolTable::Function* function_symbol =
+      table->FindFunction(core::RelativeAddress(function.rva()));
+  if (function_symbol == NULL) {
     LOG(ERROR) << "No symbol info available for function in module '"
                << function.module()->path << "'";
     return false;
   }
 
-  ScopedBstr function_name_bstr;
-  HRESULT hr = function_sym->get_name(function_name_bstr.Receive());
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_name: " << common::LogHr(hr) << ".";
-    return false;
-  }
-
-  *function_name = common::ToString(function_name_bstr);
-
-  ULONGLONG length = 0;
-  hr = function_sym->get_length(&length);
-  if (FAILED(hr)) {
-    LOG(ERROR) << "Failure in get_length: " << common::LogHr(hr) << ".";
-    return false;
-  }
-
-  ScopedBstr file_name_bstr;
-  DWORD line_number = 0;
-  if (length != 0) {
-    ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
-
-    hr = session->findLinesByRVA(function.rva(),
-                                 length,
-                                 enum_lines.Receive());
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
-      return false;
-    }
-
-    ScopedComPtr<IDiaLineNumber> line;
-    ULONG fetched = 0;
-    hr = enum_lines->Next(1, line.Receive(), &fetched);
-    if (FAILED(hr)) {
-      LOG(ERROR) << "Failure in IDialineNumber::Next: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-    if (fetched == 1) {
-      hr = line->get_lineNumber(&line_number);
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_lineNumber: " << common::LogHr(hr) << ".";
-        return false;
-      }
-      ScopedComPtr<IDiaSourceFile> source_file;
-      hr = line->get_sourceFile(source_file.Receive());
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_sourceFile: " << common::LogHr(hr) << ".";
-        return false;
-      }
-      hr = source_file->get_fileName(file_name_bstr.Receive());
-      if (FAILED(hr)) {
-        LOG(ERROR) << "Failure in get_fileName: " << common::LogHr(hr) << ".";
-        return false;
-      }
+  *function_name = function_symbol->name;
+
+  file_name->clear();
+  size_t line_number = 0;
+  if (function_symbol->size != 0) {
+    const SymbolTable::Line* function_line =
+        table->FindLine(core::RelativeAddress(function.rva()),
+                        function_symbol->size);
+    if (function_line != NULL) {
+      line_number = function_line->line_number;
+      if (function_line->file_index != SymbolTable::kNoFile)
+        *file_name = table->file_names()[function_line->file_index];
     }
   }
 
-  *file_name = common::ToString(file_name_bstr);
   *line = line_number;
   return true;
 }
@@ -534,9 +569,12 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
       // Make the function's cycle count exclusive, by subtracting all
       // the outbound (inclusive) cycle counts from the total. We make
       // special allowance for the "fringe" nodes mentioned above, by
-      // noting they have no recorded calls.
+      // noting they have no recorded calls. The overhead of the hooks of
+      // the outbound calls is also removed.
       if (node.metrics.num_calls != 0) {
         node.metrics.cycles_sum -= edge.metrics.cycles_sum;
+        node.metrics.cycles_sum = SubtractCycles(
+            node.metrics.cycles_sum, edge.metrics.cycles_overhead);
       }
     } else {
       // TODO(siggi): The profile instrumentation currently doesn't record
@@ -551,12 +589,25 @@ bool ProfileGrinder::ResolveCallersForPart(PartData* part) {
 }
 
 bool ProfileGrinder::OutputData(FILE* file) {
-  // Output the file header.
+  DCHECK(file != NULL);
+
+  scoped_ptr<CallGraphWriter> writer;
+  if (output_format_ == kBinaryFormat) {
+    // The output may have been opened in text mode, which would mangle the
+    // binary data.
+    ::_setmode(::_fileno(file), _O_BINARY);
+    writer.reset(new BinaryCallGraphWriter(file));
+  } else {
+    writer.reset(new CacheGrindCallGraphWriter(file));
+  }
+
+  if (!writer->BeginCallGraph(parts_.size()))
+    return false;
 
   bool succeeded = true;
   PartDataMap::iterator it = parts_.begin();
   for (; it != parts_.end(); ++it) {
-    if (!OutputDataForPart(it->second, file)) {
+    if (!OutputDataForPart(it->second, writer.get())) {
       // Keep going despite problems in output
       succeeded = false;
     }
@@ -565,60 +616,87 @@ bool ProfileGrinder::OutputData(FILE* file) {
   return succeeded;
 }
 
-bool ProfileGrinder::OutputDataForPart(const PartData& part, FILE* file) {
-  // TODO(siggi): Output command line here.
-  ::fprintf(file, "pid: %d\n", part.process_id_);
-  if (part.thread_id_ != 0)
-    ::fprintf(file, "thread: %d\n", part.thread_id_);
-  ::fprintf(file, "events: Calls Cycles Cycles-Min Cycles-Max\n");
-
-  if (!part.thread_name_.empty())
-    ::fprintf(file, "desc: Trigger: %s\n", part.thread_name_.c_str());
-
-  // Walk the nodes and output the data.
+bool ProfileGrinder::OutputDataForPart(const PartData& part,
+                                       CallGraphWriter* writer) {
+  DCHECK(writer != NULL);
+
+  // Resolve the functions, and the calls between them, before writing
+  // anything. A part with an unresolved function is written out empty, so
+  // that the output stays well formed.
+  std::vector<CallGraphFunction> functions(part.nodes_.size());
+  std::vector<CallGraphCall> calls;
+  typedef std::map<const InvocationNode*, uint32> NodeIndexMap;
+  NodeIndexMap node_indexes;
+  bool resolved = true;
   InvocationNodeMap::const_iterator node_it(part.nodes_.begin());
-  for (; node_it != part.nodes_.end(); ++node_it) {
+  for (uint32 i = 0; node_it != part.nodes_.end(); ++node_it, ++i) {
     const InvocationNode& node = node_it->second;
     std::wstring function_name;
     std::wstring file_name;
     size_t line = 0;
-    if (GetInfoForFunction(node.function, &function_name, &file_name, &line)) {
-      // Rewrite file path to use forward slashes instead of back slashes.
-      base::ReplaceChars(file_name, L"\\", L"/", &file_name);
-
-      // Output the function information.
-      ::fprintf(file, "fl=%ws\n", file_name.c_str());
-      ::fprintf(file, "fn=%ws\n", function_name.c_str());
-      ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", line,
-                node.metrics.num_calls, node.metrics.cycles_sum,
-                node.metrics.cycles_min, node.metrics.cycles_max);
-
-      // Output the call information from this function.
-      const InvocationEdge* call = node.first_call;
-      for (; call != NULL; call = call->next_call) {
-        if (GetInfoForFunction(call->function,
-                               &function_name,
-                               &file_name,
-                               &line)) {
-
-          // Rewrite file path to use forward slashes instead of back slashes.
-          base::ReplaceChars(file_name, L"\\", L"/", &file_name);
-
-          ::fprintf(file, "cfl=%ws\n", file_name.c_str());
-          ::fprintf(file, "cfn=%ws\n", function_name.c_str());
-          ::fprintf(file, "calls=%d %d\n", call->metrics.num_calls, line);
-          ::fprintf(file, "%d %I64d %I64d %I64d %I64d\n", call->line,
-                    call->metrics.num_calls, call->metrics.cycles_sum,
-                    call->metrics.cycles_min, call->metrics.cycles_max);
-        }
-      }
-    } else {
+    if (!GetInfoForFunction(node.function, &function_name, &file_name,
+                            &line)) {
       LOG(ERROR) << "Unable to resolve function.";
-      return false;
+      resolved = false;
+      break;
     }
+
+    // Rewrite file path to use forward slashes instead of back slashes.
+    base::ReplaceChars(file_name, L"\\", L"/", &file_name);
+
+    CallGraphFunction& function = functions[i];
+    function.name = base::WideToUTF8(function_name);
+    function.file_name = base::WideToUTF8(file_name);
+    function.line = line;
+    function.metrics.num_calls = node.metrics.num_calls;
+    function.metrics.cycles_sum = node.metrics.cycles_sum;
+    function.metrics.cycles_min = node.metrics.cycles_min;
+    function.metrics.cycles_max = node.metrics.cycles_max;
+    node_indexes[&node] = i;
   }
 
-  return true;
+  if (resolved) {
+    for (node_it = part.nodes_.begin(); node_it != part.nodes_.end();
+         ++node_it) {
+      const InvocationNode& node = node_it->second;
+      const InvocationEdge* edge = node.first_call;
+      for (; edge != NULL; edge = edge->next_call) {
+        InvocationNodeMap::const_iterator callee_it =
+            part.nodes_.find(edge->function);
+        if (callee_it == part.nodes_.end())
+          continue;
+
+        CallGraphCall call;
+        call.caller = node_indexes[&node];
+        call.callee = node_indexes[&callee_it->second];
+        call.line = edge->line;
+        call.metrics.num_calls = edge->metrics.num_calls;
+        call.metrics.cycles_sum = edge->metrics.cycles_sum;
+        call.metrics.cycles_min = edge->metrics.cycles_min;
+        call.metrics.cycles_max = edge->metrics.cycles_max;
+        calls.push_back(call);
+      }
+    }
+  } else {
+    functions.clear();
+  }
+
+  if (!writer->BeginPart(part.process_id_, part.thread_id_, part.thread_name_,
+                         functions.size(), calls.size())) {
+    return false;
+  }
+  for (size_t i = 0; i < functions.size(); ++i) {
+    if (!writer->WriteFunction(functions[i]))
+      return false;
+  }
+  for (size_t i = 0; i < calls.size(); ++i) {
+    if (!writer->WriteCall(calls[i]))
+      return false;
+  }
+  if (!writer->EndPart())
+    return false;
+
+  return resolved;
 }
 
 void ProfileGrinder::OnInvocationBatch(base::Time time,
@@ -629,6 +707,19 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
   PartData* part = FindOrCreatePart(process_id, thread_id);
   DCHECK(data != NULL);
 
+  // Traces from older profilers carry no calibration, and are aggregated as
+  // is.
+  const TraceProfilerCalibration* calibration = NULL;
+  CalibrationMap::const_iterator calibration_it =
+      calibrations_.find(std::make_pair(process_id, thread_id));
+  if (calibration_it != calibrations_.end())
+    calibration = &calibration_it->second;
+
+  // Functions and callers are cached separately, as a function and its
+  // caller often live in different modules.
+  ModuleLookupCache function_cache;
+  ModuleLookupCache caller_cache;
+
   // Process and aggregate the individual invocation entries.
   for (size_t i = 0; i < num_invocations; ++i) {
     const InvocationInfo& info = data->invocations[i];
@@ -648,7 +739,8 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
       AbsoluteAddress64 function_addr =
           reinterpret_cast<AbsoluteAddress64>(info.function);
 
-      ConvertToModuleRVA(process_id, function_addr, &function);
+      ConvertToModuleRVA(process_id, function_addr, &function_cache,
+                         &function);
     }
 
     CallerLocation caller;
@@ -659,10 +751,18 @@ void ProfileGrinder::OnInvocationBatch(base::Time time,
       // The caller is a native function.
       AbsoluteAddress64 caller_addr =
           reinterpret_cast<AbsoluteAddress64>(info.caller);
-      ConvertToModuleRVA(process_id, caller_addr, &caller);
+      ConvertToModuleRVA(process_id, caller_addr, &caller_cache, &caller);
     }
 
-    AggregateEntryToPart(function, caller, info, part);
+    if (calibration == NULL) {
+      AggregateEntryToPart(function, caller, info, 0, part);
+    } else {
+      InvocationInfo compensated_info = info;
+      CompensateInvocation(*calibration, &compensated_info);
+      AggregateEntryToPart(function, caller, compensated_info,
+                           calibration->call_overhead_cycles * info.num_calls,
+                           part);
+    }
   }
 }
 
@@ -685,9 +785,19 @@ void ProfileGrinder::OnDynamicSymbol(DWORD process_id,
   dynamic_symbols_[key].assign(symbol_name.begin(), symbol_name.end());
 }
 
+void ProfileGrinder::OnProfilerCalibration(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceProfilerCalibration* data) {
+  DCHECK(data != NULL);
+  calibrations_[std::make_pair(process_id, thread_id)] = *data;
+}
+
 void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
                                           const CallerLocation& caller,
                                           const InvocationInfo& info,
+                                          uint64 cycles_overhead,
                                           PartData* part) {
   // Have we recorded this node before?
   InvocationNodeMap::iterator node_it(part->nodes_.find(function));
@@ -725,6 +835,7 @@ void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
     found.metrics.cycles_max = std::max(found.metrics.cycles_max,
                                         info.cycles_max);
     found.metrics.cycles_sum += info.cycles_sum;
+    found.metrics.cycles_overhead += cycles_overhead;
   } else {
     // Nopes, we haven't seen this edge before, insert it.
     InvocationEdge& edge = part->edges_[key];
@@ -734,16 +845,49 @@ void ProfileGrinder::AggregateEntryToPart(const FunctionLocation& function,
     edge.metrics.cycles_min = info.cycles_min;
     edge.metrics.cycles_max = info.cycles_max;
     edge.metrics.cycles_sum = info.cycles_sum;
+    edge.metrics.cycles_overhead = cycles_overhead;
   }
 }
 
+void ProfileGrinder::CanonicalizeLocation(CodeLocation* location) {
+  DCHECK(location != NULL);
+
+  if (location->is_symbol() || location->module() == NULL)
+    return;
+
+  ModuleInformationSet::iterator it(modules_.insert(*location->module()).first);
+  location->Set(&(*it), location->rva());
+}
+
+void ProfileGrinder::AggregateMetrics(const Metrics& from, Metrics* to) {
+  DCHECK(to != NULL);
+
+  to->num_calls += from.num_calls;
+  to->cycles_min = std::min(to->cycles_min, from.cycles_min);
+  to->cycles_max = std::max(to->cycles_max, from.cycles_max);
+  to->cycles_sum += from.cycles_sum;
+  to->cycles_overhead += from.cycles_overhead;
+}
+
 void ProfileGrinder::ConvertToModuleRVA(uint32 process_id,
                                         AbsoluteAddress64 addr,
+                                        ModuleLookupCache* cache,
                                         CodeLocation* rva) {
+  DCHECK(cache != NULL);
   DCHECK(rva != NULL);
 
-  const ModuleInformation* module =
-      parser_->GetModuleInformation(process_id, addr);
+  // Try the most recently found module first.
+  const ModuleInformation* module = cache->module;
+  if (module != NULL) {
+    AbsoluteAddress64 module_base = module->base_address.value();
+    if (addr >= module_base && addr - module_base < module->module_size) {
+      rva->Set(cache->canonical_module,
+               static_cast<RVA>(addr - module_base));
+      return;
+    }
+  }
+
+  module = parser_->GetModuleInformation(process_id, addr);
 
   if (module == NULL) {
     // We have no module information for this address.
@@ -759,6 +903,9 @@ void ProfileGrinder::ConvertToModuleRVA(uint32 process_id,
   }
   DCHECK(it != modules_.end());
 
+  cache->module = module;
+  cache->canonical_module = &(*it);
+
   rva->Set(&(*it), static_cast<RVA>(addr - module->base_address.value()));
 }
 
@@ -20,7 +20,9 @@
 
 #include "base/files/file_path.h"
 #include "base/win/scoped_comptr.h"
+#include "syzygy/grinder/call_graph_writer.h"
 #include "syzygy/grinder/grinder.h"
+#include "syzygy/grinder/symbol_table.h"
 
 namespace grinder {
 namespace grinders {
@@ -56,6 +58,19 @@ typedef uint32 RVA;
 // summing up the cost of the incoming edges, and subtracting the cost of the
 // outgoing edges.
 //
+// The symbols of each module are extracted once from its PDB into a symbol
+// table, which all the address lookups then use. If a symbol cache directory is
+// provided, the symbol tables are also cached there across runs.
+//
+// The profiler calibrates the overhead of its hooks that it can't account for
+// itself, and records it per thread. The invocations of each thread are
+// compensated for that overhead as they are aggregated, both in their own
+// cycles and in the exclusive cycles of their callers.
+//
+// The call graph is output in the KCacheGrind format, or in a compact binary
+// format that can be converted to it later. See call_graph_writer.h. Either
+// way, the calls are streamed out rather than formatted in memory.
+//
 // For information on the KCacheGrind file format, see:
 // http://kcachegrind.sourceforge.net/cgi-bin/show.cgi/KcacheGrindCalltreeFormat
 class ProfileGrinder : public GrinderInterface {
@@ -63,18 +78,35 @@ class ProfileGrinder : public GrinderInterface {
   ProfileGrinder();
   ~ProfileGrinder();
 
+  // The output formats.
+  enum OutputFormat {
+    kCacheGrindFormat,
+    kBinaryFormat,
+  };
+
   // @name Accessors and mutators.
   // @{
   // If thread_parts is true, the grinder will aggregate and output
   // separate parts for each thread seen in the trace file(s).
   bool thread_parts() const { return thread_parts_; }
   void set_thread_parts(bool thread_parts) { thread_parts_ = thread_parts; }
+  // The directory where the symbol tables are cached. If empty, the symbol
+  // tables aren't cached.
+  const base::FilePath& symbol_cache_dir() const { return symbol_cache_dir_; }
+  void set_symbol_cache_dir(const base::FilePath& symbol_cache_dir) {
+    symbol_cache_dir_ = symbol_cache_dir;
+  }
+  OutputFormat output_format() const { return output_format_; }
+  void set_output_format(OutputFormat output_format) {
+    output_format_ = output_format;
+  }
   // @}
 
   // @name GrinderInterface implementation.
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* partial) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -94,6 +126,11 @@ class ProfileGrinder : public GrinderInterface {
   virtual void OnDynamicSymbol(DWORD process_id,
                                uint32 symbol_id,
                                const base::StringPiece& symbol_name) OVERRIDE;
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerCalibration* data) OVERRIDE;
   // @}
 
  protected:
@@ -126,6 +163,7 @@ class ProfileGrinder : public GrinderInterface {
 
   typedef base::win::ScopedComPtr<IDiaSession> SessionPtr;
   typedef std::map<const ModuleInformation*, SessionPtr> ModuleSessionMap;
+  typedef std::map<const ModuleInformation*, SymbolTable> ModuleSymbolTableMap;
 
   bool GetSessionForModule(const ModuleInformation* module,
                            IDiaSession** session_out);
@@ -133,13 +171,13 @@ class ProfileGrinder : public GrinderInterface {
   // Finds or creates the part data for the given @p thread_id.
   PartData* FindOrCreatePart(DWORD process_id, DWORD thread_id);
 
-  // Retrieves the function containing @p address.
-  // @param symbol on success returns the function's private symbol, or
-  //     public symbol if no private symbol is available.
+  // Retrieves the symbol table of @p module, loading it from the symbol cache
+  // or extracting it from the module's PDB the first time it's needed.
+  // @param module the module whose symbols are requested.
+  // @param table on success returns the symbol table of @p module.
   // @returns true on success.
-  bool GetFunctionSymbolByRVA(IDiaSession* session,
-                              RVA address,
-                              IDiaSymbol** symbol);
+  bool GetSymbolTableForModule(const ModuleInformation* module,
+                               const SymbolTable** table);
 
   // Resolves the function and line number a particular caller belongs to.
   // @param caller the location of the caller.
@@ -154,17 +192,51 @@ class ProfileGrinder : public GrinderInterface {
                           std::wstring* file_name,
                           size_t* line);
 
+  // Remembers the module most recently found by ConvertToModuleRVA. Runs of
+  // addresses in an invocation batch tend to fall in the same module, and
+  // this allows them to skip looking the module up. As the parser's module
+  // information may change between events, a cache must not outlive the
+  // event being processed.
+  struct ModuleLookupCache {
+    ModuleLookupCache() : module(NULL), canonical_module(NULL) {
+    }
+
+    // The module as known to the parser.
+    const ModuleInformation* module;
+    // The corresponding entry in modules_.
+    const ModuleInformation* canonical_module;
+  };
+
   // Converts an absolute address to an RVA.
+  // @param process_id the process in which @p addr lives.
+  // @param addr the address to convert.
+  // @param cache the module lookup cache to use and update.
+  // @param rva on return contains the module and RVA of @p addr.
   void ConvertToModuleRVA(uint32 process_id,
                           trace::parser::AbsoluteAddress64 addr,
+                          ModuleLookupCache* cache,
                           CodeLocation* rva);
 
   // Aggregates a single invocation info and/or creates a new node and edge.
+  // @param function the function of @p info.
+  // @param caller the caller of @p info.
+  // @param info the invocation info, compensated for the hooks' overhead.
+  // @param cycles_overhead the overhead of the hooks that the invocations of
+  //     @p info add to the cycles of their caller.
+  // @param part the part to aggregate to.
   void AggregateEntryToPart(const FunctionLocation& function,
                             const CallerLocation& caller,
                             const InvocationInfo& info,
+                            uint64 cycles_overhead,
                             PartData* part);
 
+  // Makes @p location refer to the canonical information of its module in
+  // modules_. This is used to import locations from another grinder.
+  void CanonicalizeLocation(CodeLocation* location);
+
+  // Aggregates the metrics @p from into the metrics @p to.
+  static void AggregateMetrics(const Metrics& from, Metrics* to);
+
   // This functions adds all caller edges to each function node's linked list of
   // callers. In so doing, it also computes each function node's inclusive cost.
   // @returns true on success, false on failure.
@@ -173,8 +245,8 @@ class ProfileGrinder : public GrinderInterface {
   // Resolves callers for @p part.
   bool ResolveCallersForPart(PartData* part);
 
-  // Outputs data for @p part to @p file.
-  bool OutputDataForPart(const PartData& part, FILE* file);
+  // Outputs data for @p part to @p writer.
+  bool OutputDataForPart(const PartData& part, CallGraphWriter* writer);
 
   // Keeps track of the dynamic symbols seen.
   DynamicSymbolMap dynamic_symbols_;
@@ -185,14 +257,28 @@ class ProfileGrinder : public GrinderInterface {
   // Stores the DIA session objects we have going for each module.
   ModuleSessionMap module_sessions_;
 
+  // Stores the symbol tables of the modules. A module whose symbols couldn't
+  // be loaded has an empty table, so that it's attempted only once.
+  ModuleSymbolTableMap module_symbol_tables_;
+
+  // The directory where the symbol tables are cached, if any.
+  base::FilePath symbol_cache_dir_;
+
   // The parts we store. If thread_parts_ is false, we store only a single
   // part with id 0. The parts are keyed on process id/thread id.
   typedef std::pair<uint32, uint32> PartKey;
   typedef std::map<PartKey, PartData> PartDataMap;
   PartDataMap parts_;
 
+  // The calibrations of the profiler's hooks, keyed on process id/thread id.
+  typedef std::map<PartKey, TraceProfilerCalibration> CalibrationMap;
+  CalibrationMap calibrations_;
+
   // If true, data is aggregated and output per-thread.
   bool thread_parts_;
+
+  // The format of the output.
+  OutputFormat output_format_;
 };
 
 // The data we store for each part.
@@ -294,13 +380,22 @@ struct ProfileGrinder::CallerLocation : public ProfileGrinder::CodeLocation {
 
 // The metrics we capture per function and per caller.
 struct ProfileGrinder::Metrics {
-  Metrics() : num_calls(0), cycles_min(0), cycles_max(0), cycles_sum(0) {
+  Metrics()
+      : num_calls(0),
+        cycles_min(0),
+        cycles_max(0),
+        cycles_sum(0),
+        cycles_overhead(0) {
   }
 
   uint64 num_calls;
   uint64 cycles_min;
   uint64 cycles_max;
   uint64 cycles_sum;
+
+  // The overhead of the profiler's hooks that the calls add to the cycles of
+  // their caller. This is only tallied for edges.
+  uint64 cycles_overhead;
 };
 
 // An invocation node represents a function.
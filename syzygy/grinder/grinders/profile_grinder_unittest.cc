@@ -14,6 +14,8 @@
 
 #include "syzygy/grinder/grinders/profile_grinder.h"
 
+#include "base/files/file_enumerator.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -206,6 +208,74 @@ TEST_F(ProfileGrinderTest, GrindSymbolTestData) {
   EXPECT_EQ(kCallerSymbolId, it->first.symbol_id());
 }
 
+TEST_F(ProfileGrinderTest, MergeSymbolTestData) {
+  // Issue the same events against two partial grinders.
+  TestProfileGrinder partial1;
+  IssueSetupEvents(&partial1);
+  IssueSymbolInvocationEvent(&partial1);
+  TestProfileGrinder partial2;
+  IssueSetupEvents(&partial2);
+  IssueSymbolInvocationEvent(&partial2);
+
+  // Merge them, and grind the data.
+  TestProfileGrinder grinder;
+  ASSERT_TRUE(grinder.Merge(&partial1));
+  ASSERT_TRUE(grinder.Merge(&partial2));
+  ASSERT_TRUE(grinder.Grind());
+
+  ASSERT_EQ(1, grinder.parts_.size());
+  TestProfileGrinder::PartData* part =
+      grinder.FindOrCreatePart(::GetCurrentProcessId(),
+                               ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+  ASSERT_EQ("TestThread", part->thread_name_);
+
+  // The metrics of the function are aggregated across the partial grinders.
+  ASSERT_EQ(2, part->nodes_.size());
+  TestProfileGrinder::InvocationNodeMap::iterator it = part->nodes_.begin();
+  EXPECT_TRUE(it->first.is_symbol());
+  EXPECT_EQ(kFunctionSymbolId, it->first.symbol_id());
+  EXPECT_EQ(2000, it->second.metrics.num_calls);
+  EXPECT_EQ(10, it->second.metrics.cycles_min);
+  EXPECT_EQ(1000, it->second.metrics.cycles_max);
+  EXPECT_EQ(2 * 1000 * 100, it->second.metrics.cycles_sum);
+}
+
+TEST_F(ProfileGrinderTest, CompensatesCalibratedOverhead) {
+  TestProfileGrinder grinder;
+  IssueSetupEvents(&grinder);
+
+  TraceProfilerCalibration calibration = {};
+  calibration.invocation_overhead_cycles = 4;
+  calibration.call_overhead_cycles = 10;
+  grinder.OnProfilerCalibration(base::Time::Now(),
+                                ::GetCurrentProcessId(),
+                                ::GetCurrentThreadId(),
+                                &calibration);
+  IssueSymbolInvocationEvent(&grinder);
+  ASSERT_TRUE(grinder.Grind());
+
+  TestProfileGrinder::PartData* part =
+      grinder.FindOrCreatePart(::GetCurrentProcessId(),
+                               ::GetCurrentThreadId());
+  ASSERT_TRUE(part != NULL);
+
+  // The invocations of the function are compensated for their own overhead.
+  ASSERT_EQ(2, part->nodes_.size());
+  TestProfileGrinder::InvocationNodeMap::iterator it = part->nodes_.begin();
+  EXPECT_EQ(kFunctionSymbolId, it->first.symbol_id());
+  EXPECT_EQ(1000, it->second.metrics.num_calls);
+  EXPECT_EQ(6, it->second.metrics.cycles_min);
+  EXPECT_EQ(996, it->second.metrics.cycles_max);
+  EXPECT_EQ(1000 * (100 - 4), it->second.metrics.cycles_sum);
+
+  // The edge carries the overhead the calls add to the caller.
+  ASSERT_EQ(1, part->edges_.size());
+  EXPECT_EQ(1000 * (100 - 4), part->edges_.begin()->second.metrics.cycles_sum);
+  EXPECT_EQ(1000 * 10,
+            part->edges_.begin()->second.metrics.cycles_overhead);
+}
+
 TEST_F(ProfileGrinderTest, ParseEmptyCommandLineSucceeds) {
   TestProfileGrinder grinder;
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
@@ -218,6 +288,28 @@ TEST_F(ProfileGrinderTest, ParseThreadPartsSwitchOnCommandLine) {
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(ProfileGrinderTest, ParseSymbolCacheDirOnCommandLine) {
+  TestProfileGrinder grinder;
+  base::FilePath cache_dir(L"C:\\symbol_cache");
+  cmd_line_.AppendSwitchPath("symbol-cache-dir", cache_dir);
+  EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(cache_dir, grinder.symbol_cache_dir());
+}
+
+TEST_F(ProfileGrinderTest, ParseOutputFormatOnCommandLine) {
+  TestProfileGrinder grinder;
+  EXPECT_EQ(ProfileGrinder::kCacheGrindFormat, grinder.output_format());
+  cmd_line_.AppendSwitchASCII("output-format", "binary");
+  EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(ProfileGrinder::kBinaryFormat, grinder.output_format());
+}
+
+TEST_F(ProfileGrinderTest, ParseInvalidOutputFormatOnCommandLineFails) {
+  TestProfileGrinder grinder;
+  cmd_line_.AppendSwitchASCII("output-format", "foo");
+  EXPECT_FALSE(grinder.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(ProfileGrinderTest, SetParserSucceeds) {
   TestProfileGrinder grinder;
   grinder.ParseCommandLine(&cmd_line_);
@@ -233,5 +325,63 @@ TEST_F(ProfileGrinderTest, GrindAndOutputCacheGrindDataSucceeds) {
   // TODO(etienneb): Validate the output is a valid CacheGrind file.
 }
 
+TEST_F(ProfileGrinderTest, OutputBinaryConvertsToCacheGrind) {
+  TestProfileGrinder grinder;
+  grinder.ParseCommandLine(&cmd_line_);
+  ASSERT_NO_FATAL_FAILURE(InitParser(&grinder));
+  grinder.SetParser(&parser_);
+  ASSERT_TRUE(parser_.Consume());
+  ASSERT_TRUE(grinder.Grind());
+
+  testing::ScopedTempFile text_path;
+  base::ScopedFILE text_file(base::OpenFile(text_path.path(), "wb"));
+  ASSERT_TRUE(text_file.get() != NULL);
+  ASSERT_TRUE(grinder.OutputData(text_file.get()));
+  text_file.reset();
+
+  testing::ScopedTempFile binary_path;
+  base::ScopedFILE binary_file(base::OpenFile(binary_path.path(), "wb"));
+  ASSERT_TRUE(binary_file.get() != NULL);
+  grinder.set_output_format(ProfileGrinder::kBinaryFormat);
+  ASSERT_TRUE(grinder.OutputData(binary_file.get()));
+  binary_file.reset();
+
+  // Converting the binary output gives the text output.
+  testing::ScopedTempFile converted_path;
+  binary_file.reset(base::OpenFile(binary_path.path(), "rb"));
+  ASSERT_TRUE(binary_file.get() != NULL);
+  base::ScopedFILE converted_file(
+      base::OpenFile(converted_path.path(), "wb"));
+  ASSERT_TRUE(converted_file.get() != NULL);
+  CacheGrindCallGraphWriter writer(converted_file.get());
+  ASSERT_TRUE(ReadBinaryCallGraph(binary_file.get(), &writer));
+  converted_file.reset();
+
+  std::string text;
+  ASSERT_TRUE(base::ReadFileToString(text_path.path(), &text));
+  std::string converted;
+  ASSERT_TRUE(base::ReadFileToString(converted_path.path(), &converted));
+  EXPECT_FALSE(text.empty());
+  EXPECT_EQ(text, converted);
+}
+
+TEST_F(ProfileGrinderTest, GrindAndOutputWithSymbolCacheSucceeds) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath cache_dir = temp_dir.path().Append(L"symbols");
+  cmd_line_.AppendSwitchPath("symbol-cache-dir", cache_dir);
+
+  // The first run populates the cache.
+  ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds());
+  base::FileEnumerator enumerator(cache_dir,
+                                  false,
+                                  base::FileEnumerator::FILES,
+                                  L"*.symbols");
+  EXPECT_FALSE(enumerator.Next().empty());
+
+  // The second run uses it.
+  ASSERT_NO_FATAL_FAILURE(GrindAndOutputSucceeds());
+}
+
 }  // namespace grinders
 }  // namespace grinder
@@ -44,6 +44,37 @@ core::RelativeAddress GetBucketStart(const TraceSampleData* sample_data) {
           reinterpret_cast<uint32>(sample_data->module_base_addr));
 }
 
+// Upsamples the buckets of @p module_data to the finer @p bucket_size.
+void UpsampleBuckets(uint32 bucket_size,
+                     SampleGrinder::ModuleData* module_data) {
+  DCHECK(module_data != NULL);
+  DCHECK_LT(0U, bucket_size);
+  DCHECK_LE(bucket_size, module_data->bucket_size);
+
+  // If we're already as fine then there's nothing to do.
+  if (module_data->bucket_size == bucket_size)
+    return;
+
+  // Grow the buckets in place, and then fill in the scaled values tail first.
+  std::vector<double>& buckets = module_data->buckets;
+  size_t old_size = buckets.size();
+  size_t factor = module_data->bucket_size / bucket_size;
+  size_t new_size = old_size * factor;
+  buckets.resize(new_size);
+  for (size_t i = old_size, j = new_size; i > 0; ) {
+    --i;
+    double new_value = buckets[i] / factor;
+
+    for (size_t k = 0; k < factor; ++k) {
+      --j;
+      buckets[j] = new_value;
+    }
+  }
+
+  // Update the bucket size.
+  module_data->bucket_size = bucket_size;
+}
+
 // Returns the size of an intersection between a given address range and a
 // sample bucket.
 size_t IntersectionSize(const Range& range,
@@ -140,10 +171,12 @@ bool BuildHeatMapForCodeBlock(const pe::PETransformPolicy& policy,
   return true;
 }
 
-// Builds an empty heat map for the given module. One range is created per
-// basic-block. Non-decomposable code blocks are represented by a single range.
-bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
-                       const SampleGrinder::ModuleData& module_data,
+// Builds an empty heat map for the given module. If @p basic_blocks is true,
+// one range is created per basic-block and non-decomposable code blocks are
+// represented by a single range. Otherwise, one range is created per code
+// block, which is enough to aggregate heat to functions or compilands.
+bool BuildEmptyHeatMap(const SampleGrinder::ModuleData& module_data,
+                       bool basic_blocks,
                        core::StringTable* string_table,
                        HeatMap* heat_map) {
   DCHECK(string_table != NULL);
@@ -184,6 +217,18 @@ bool BuildEmptyHeatMap(const SampleGrinder::ModuleKey& module_key,
     if (block->attributes() & BlockGraph::GAP_BLOCK)
       continue;
 
+    if (!basic_blocks) {
+      SampleGrinder::BasicBlockData data = {
+          &string_table->InternString(block->compiland_name()),
+          &string_table->InternString(block->name()),
+          0.0 };
+      if (!heat_map->Insert(block_it->first, data)) {
+        LOG(ERROR) << "Failed to insert code block into heat map.";
+        return false;
+      }
+      continue;
+    }
+
     if (!BuildHeatMapForCodeBlock(policy, block_it->first, block, string_table,
                                   heat_map)) {
       return false;
@@ -224,6 +269,31 @@ bool BuildEmptyHeatMap(const base::FilePath& image_path,
   return true;
 }
 
+// Adds the heat of the ranges of @p from to the same ranges of @p to. Ranges
+// that are missing from @p to are inserted, with their names interned in
+// @p string_table.
+void AddHeat(const HeatMap& from,
+             core::StringTable* string_table,
+             HeatMap* to) {
+  DCHECK(string_table != NULL);
+  DCHECK(to != NULL);
+
+  HeatMap::const_iterator from_it = from.begin();
+  for (; from_it != from.end(); ++from_it) {
+    HeatMap::iterator to_it = to->FindFirstIntersection(from_it->first);
+    if (to_it != to->end() && to_it->first == from_it->first) {
+      to_it->second.heat += from_it->second.heat;
+      continue;
+    }
+
+    SampleGrinder::BasicBlockData data = {
+        &string_table->InternString(*from_it->second.compiland),
+        &string_table->InternString(*from_it->second.function),
+        from_it->second.heat };
+    to->Insert(from_it->first, data);
+  }
+}
+
 bool RollUpToLines(const HeatMap& heat_map, LineInfo* line_info) {
   DCHECK(line_info != NULL);
 
@@ -343,9 +413,11 @@ COMPILE_ASSERT(arraysize(SampleGrinder::kAggregationLevelNames) ==
 
 const char SampleGrinder::kAggregationLevel[] = "aggregation-level";
 const char SampleGrinder::kImage[] = "image";
+const char SampleGrinder::kStreaming[] = "streaming";
 
 SampleGrinder::SampleGrinder()
     : aggregation_level_(kBasicBlock),
+      streaming_(false),
       parser_(NULL),
       event_handler_errored_(false),
       clock_rate_(0.0) {
@@ -374,6 +446,16 @@ bool SampleGrinder::ParseCommandLine(const CommandLine* command_line) {
     }
   }
 
+  streaming_ = command_line->HasSwitch(kStreaming);
+  if (streaming_ && aggregation_level_ != kFunction &&
+      aggregation_level_ != kCompiland) {
+    LOG(ERROR) << "--" << kStreaming << " is only supported at the \""
+               << kAggregationLevelNames[kFunction] << "\" and \""
+               << kAggregationLevelNames[kCompiland]
+               << "\" aggregation levels.";
+    return false;
+  }
+
   // Parse the image parameter, and initialize information about the image of
   // interest.
   image_path_ = command_line->GetSwitchValuePath(kImage);
@@ -398,6 +480,64 @@ void SampleGrinder::SetParser(Parser* parser) {
   parser_ = parser;
 }
 
+bool SampleGrinder::Merge(GrinderInterface* partial) {
+  DCHECK(partial != NULL);
+  SampleGrinder* other = static_cast<SampleGrinder*>(partial);
+
+  if (other->event_handler_errored_)
+    event_handler_errored_ = true;
+
+  ModuleDataMap::iterator other_it = other->module_data_.begin();
+  for (; other_it != other->module_data_.end(); ++other_it) {
+    ModuleData& other_data = other_it->second;
+
+    // In streaming mode the samples have already been folded into heat maps
+    // of the same code blocks, which simply need to be summed. The names they
+    // refer to belong to the string table of the partial grinder.
+    if (streaming_) {
+      if (!other_data.heat_map_built)
+        continue;
+      ModuleData& module_data = module_data_[other_it->first];
+      module_data.module_path = other_data.module_path;
+      module_data.heat_map_built = true;
+      AddHeat(other_data.heat_map, &string_table_, &module_data.heat_map);
+      module_data.total_heat += other_data.total_heat;
+      module_data.orphaned_heat += other_data.orphaned_heat;
+      continue;
+    }
+
+    if (other_data.bucket_size == 0)
+      continue;
+
+    std::pair<ModuleDataMap::iterator, bool> result =
+        module_data_.insert(*other_it);
+    if (result.second)
+      continue;
+
+    // The bucket starts need to be consistent.
+    ModuleData& module_data = result.first->second;
+    if (module_data.bucket_start != other_data.bucket_start) {
+      LOG(ERROR) << "Sample data for module \""
+                 << module_data.module_path.value()
+                 << "\" has an inconsistent bucket start.";
+      event_handler_errored_ = true;
+      continue;
+    }
+
+    // Bring both tallies to the finest bucket size, then sum them.
+    uint32 bucket_size = std::min(module_data.bucket_size,
+                                  other_data.bucket_size);
+    UpsampleBuckets(bucket_size, &module_data);
+    UpsampleBuckets(bucket_size, &other_data);
+    if (module_data.buckets.size() < other_data.buckets.size())
+      module_data.buckets.resize(other_data.buckets.size());
+    for (size_t i = 0; i < other_data.buckets.size(); ++i)
+      module_data.buckets[i] += other_data.buckets[i];
+  }
+
+  return true;
+}
+
 bool SampleGrinder::Grind() {
   if (event_handler_errored_) {
     LOG(WARNING) << "Failed to handle all TraceSampleData records, results "
@@ -416,6 +556,30 @@ bool SampleGrinder::Grind() {
     }
   }
 
+  // In streaming mode the heat has already been poured into the heat maps of
+  // the modules as the samples were parsed, and only needs to be rolled up.
+  if (streaming_) {
+    ModuleDataMap::iterator mod_it = module_data_.begin();
+    for (; mod_it != module_data_.end(); ++mod_it) {
+      ModuleData& module_data = mod_it->second;
+      if (module_data.orphaned_heat > 0) {
+        LOG(WARNING) << base::StringPrintf("%.2f%% (%.4f s) ",
+                                           module_data.orphaned_heat /
+                                               module_data.total_heat,
+                                           module_data.orphaned_heat)
+                     << "samples were orphaned for module \""
+                     << module_data.module_path.value() << "\".";
+      }
+
+      LOG(INFO) << "Rolling up heat of module \""
+                << module_data.module_path.value() << "\" to \""
+                << kAggregationLevelNames[aggregation_level_] << "\" level.";
+      RollUpByName(aggregation_level_, module_data.heat_map, &name_heat_map_);
+      module_data.heat_map.Clear();
+    }
+    return true;
+  }
+
   // Process each module.
   ModuleDataMap::const_iterator mod_it = module_data_.begin();
   for (; mod_it != module_data_.end(); ++mod_it) {
@@ -434,7 +598,7 @@ bool SampleGrinder::Grind() {
       // the image to get compilands, functions and basic blocks.
       // TODO(chrisha): We shouldn't need full decomposition for this.
       empty_heat_map_built = BuildEmptyHeatMap(
-          mod_it->first, mod_it->second, &string_table_, &heat_map_);
+          mod_it->second, true, &string_table_, &heat_map_);
     }
 
     if (!empty_heat_map_built) {
@@ -553,6 +717,12 @@ void SampleGrinder::OnSampleData(base::Time Time,
   LOG(INFO) << "Aggregating sample info for module \""
             << module_data->module_path.value() << "\".";
 
+  if (streaming_) {
+    if (!FoldSampleData(data, module_data))
+      event_handler_errored_ = true;
+    return;
+  }
+
   // Make sure that we have a high enough bucket resolution to be able to
   // represent the data that we're processing. This may involve 'upsampling'
   // previously collected data.
@@ -587,6 +757,42 @@ SampleGrinder::ModuleData* SampleGrinder::GetModuleData(
   return &(result.first->second);
 }
 
+bool SampleGrinder::FoldSampleData(const TraceSampleData* sample_data,
+                                   SampleGrinder::ModuleData* module_data) {
+  DCHECK(sample_data != NULL);
+  DCHECK(module_data != NULL);
+  DCHECK(streaming_);
+
+  // The heat map is built the first time the module is seen. If that fails
+  // then the samples of the module are dropped, without trying again.
+  if (!module_data->heat_map_built) {
+    module_data->heat_map_built = true;
+    if (!BuildEmptyHeatMap(*module_data, false, &string_table_,
+                           &module_data->heat_map)) {
+      LOG(ERROR) << "Unable to build empty heat map for module \""
+                 << module_data->module_path.value() << "\".";
+      module_data->heat_map.Clear();
+      return false;
+    }
+  }
+  if (module_data->heat_map.empty())
+    return false;
+
+  // Scale the samples of this record into temporary buckets, which are then
+  // poured into the heat map and released.
+  ModuleData record;
+  UpsampleModuleData(sample_data, &record);
+  if (!IncrementModuleData(clock_rate_, sample_data, &record))
+    return false;
+
+  double total = 0.0;
+  module_data->orphaned_heat += IncrementHeatMapFromModuleData(
+      record, &module_data->heat_map, &total);
+  module_data->total_heat += total;
+
+  return true;
+}
+
 void SampleGrinder::UpsampleModuleData(
     const TraceSampleData* sample_data,
     SampleGrinder::ModuleData* module_data) {
@@ -605,26 +811,7 @@ void SampleGrinder::UpsampleModuleData(
   if (module_data->bucket_size <= sample_data->bucket_size)
     return;
 
-  // Grow the buckets in place, and then fill in the scaled values tail first.
-  std::vector<double>& buckets = module_data->buckets;
-  size_t old_size = buckets.size();
-  size_t factor = module_data->bucket_size / sample_data->bucket_size;
-  size_t new_size = old_size * factor;
-  buckets.resize(new_size);
-  for (size_t i = old_size, j = new_size; i > 0; ) {
-    --i;
-    double new_value = buckets[i] / factor;
-
-    for (size_t k = 0; k < factor; ++k) {
-      --j;
-      buckets[j] = new_value;
-    }
-  }
-
-  // Update the bucket size.
-  module_data->bucket_size = sample_data->bucket_size;
-
-  return;
+  UpsampleBuckets(sample_data->bucket_size, module_data);
 }
 
 // Increments the module data with the given sample data. Returns false and
@@ -53,6 +53,7 @@ class SampleGrinder : public GrinderInterface {
   // @{
   virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
   virtual void SetParser(Parser* parser) OVERRIDE;
+  virtual bool Merge(GrinderInterface* partial) OVERRIDE;
   virtual bool Grind() OVERRIDE;
   virtual bool OutputData(FILE* file) OVERRIDE;
   // @}
@@ -74,6 +75,7 @@ class SampleGrinder : public GrinderInterface {
   // @{
   static const char kAggregationLevel[];
   static const char kImage[];
+  static const char kStreaming[];
   // @}
 
   // Forward declarations. These are public so that they are accessible by
@@ -106,6 +108,15 @@ class SampleGrinder : public GrinderInterface {
       const base::FilePath& module_path,
       const TraceSampleData* sample_data);
 
+  // Pours the samples of @p sample_data straight into the heat map of
+  // @p module_data, building that heat map first if need be. This is used in
+  // streaming mode, where no buckets are accumulated.
+  // @param sample_data The sample data to be folded.
+  // @param module_data The module data to be updated.
+  // @returns true on success, false otherwise.
+  bool FoldSampleData(const TraceSampleData* sample_data,
+                      SampleGrinder::ModuleData* module_data);
+
   // Upsamples the provided @p module_data so that it has at least as many
   // buckets as the @p sample_data. If the resolution is already sufficient
   // this does nothing.
@@ -157,6 +168,13 @@ class SampleGrinder : public GrinderInterface {
   // The aggregation level to be used in processing samples.
   AggregationLevel aggregation_level_;
 
+  // If true, the samples are folded into per-function heat as they are
+  // parsed, rather than being accumulated in per-module buckets until Grind
+  // is called. This bounds the memory use to the size of the symbols of the
+  // modules, rather than that of their code. Only supported at the function
+  // and compiland aggregation levels.
+  bool streaming_;
+
   // If image_path_ is not empty, then this data is used as a filter for
   // processing.
   base::FilePath image_path_;
@@ -202,12 +220,29 @@ struct SampleGrinder::ModuleKey {
 };
 
 struct SampleGrinder::ModuleData {
-  ModuleData::ModuleData() : bucket_size(0) {}
+  ModuleData::ModuleData()
+      : bucket_size(0),
+        heat_map_built(false),
+        total_heat(0.0),
+        orphaned_heat(0.0) {
+  }
 
   base::FilePath module_path;
   uint32 bucket_size;
   core::RelativeAddress bucket_start;
   std::vector<double> buckets;
+
+  // @name Streaming mode state. The buckets are left empty in streaming mode.
+  // @{
+  // Set to true once an attempt has been made to build heat_map.
+  bool heat_map_built;
+  // The heat of the code blocks of the module, with one range per block.
+  HeatMap heat_map;
+  // The total heat poured into heat_map, and the part of it that didn't
+  // land on any code block.
+  double total_heat;
+  double orphaned_heat;
+  // @}
 };
 
 }  // namespace grinders
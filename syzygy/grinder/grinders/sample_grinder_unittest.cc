@@ -44,13 +44,18 @@ class TestSampleGrinder : public SampleGrinder {
   using SampleGrinder::IncrementHeatMapFromModuleData;
   using SampleGrinder::RollUpByName;
 
+  // Types.
+  using SampleGrinder::ModuleDataMap;
+
   // Members.
   using SampleGrinder::aggregation_level_;
+  using SampleGrinder::streaming_;
   using SampleGrinder::image_path_;
   using SampleGrinder::parser_;
   using SampleGrinder::heat_map_;
   using SampleGrinder::name_heat_map_;
   using SampleGrinder::line_info_;
+  using SampleGrinder::module_data_;
 };
 
 class SampleGrinderTest : public testing::PELibUnitTest {
@@ -114,6 +119,15 @@ class SampleGrinderTest : public testing::PELibUnitTest {
 
     ASSERT_TRUE(g.Grind());
 
+    // In streaming mode no buckets are ever accumulated.
+    if (cmd_line_.HasSwitch(SampleGrinder::kStreaming)) {
+      ASSERT_FALSE(g.module_data_.empty());
+      TestSampleGrinder::ModuleDataMap::const_iterator mod_it =
+          g.module_data_.begin();
+      for (; mod_it != g.module_data_.end(); ++mod_it)
+        EXPECT_TRUE(mod_it->second.buckets.empty());
+    }
+
     // 1000 samples at a rate of 0.01 samples/sec = 10 seconds of heat.
     const double expected_heat = 10.0;
     double total_heat = 0;
@@ -290,6 +304,39 @@ TEST_F(SampleGrinderTest, UpsampleModuleData) {
   EXPECT_DOUBLE_EQ(2.0, BucketSum(module_data));
 }
 
+TEST_F(SampleGrinderTest, Merge) {
+  SampleGrinder::ModuleKey key = { 0x10000, 0x12345678, 0x87654321 };
+
+  TestSampleGrinder partial1;
+  SampleGrinder::ModuleData& module_data1 = partial1.module_data_[key];
+  module_data1.bucket_size = 8;
+  module_data1.bucket_start = core::RelativeAddress(0x1000);
+  module_data1.buckets.resize(4, 1.0);
+
+  TestSampleGrinder partial2;
+  SampleGrinder::ModuleData& module_data2 = partial2.module_data_[key];
+  module_data2.bucket_size = 4;
+  module_data2.bucket_start = core::RelativeAddress(0x1000);
+  module_data2.buckets.resize(8, 1.0);
+
+  // The first merge copies the module data.
+  TestSampleGrinder g;
+  ASSERT_TRUE(g.Merge(&partial1));
+  ASSERT_EQ(1u, g.module_data_.size());
+  const SampleGrinder::ModuleData& module_data = g.module_data_[key];
+  EXPECT_EQ(8u, module_data.bucket_size);
+  EXPECT_DOUBLE_EQ(4.0, BucketSum(module_data));
+
+  // The second one upsamples to the finest bucket size, and sums the heat.
+  ASSERT_TRUE(g.Merge(&partial2));
+  ASSERT_EQ(1u, g.module_data_.size());
+  EXPECT_EQ(4u, module_data.bucket_size);
+  ASSERT_EQ(8u, module_data.buckets.size());
+  EXPECT_DOUBLE_EQ(1.5, module_data.buckets[0]);
+  EXPECT_DOUBLE_EQ(1.5, module_data.buckets[7]);
+  EXPECT_DOUBLE_EQ(12.0, BucketSum(module_data));
+}
+
 TEST_F(SampleGrinderTest, IncrementModuleData) {
   ASSERT_NO_FATAL_FAILURE(PrepareDummySampleDataBuffer(5));
   ASSERT_TRUE(sample_data_ != NULL);
@@ -554,6 +601,25 @@ TEST_F(SampleGrinderTest, ParseCommandLineAggregationLevel) {
   }
 }
 
+TEST_F(SampleGrinderTest, ParseCommandLineStreaming) {
+  cmd_line_.AppendSwitch(SampleGrinder::kStreaming);
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "function");
+  {
+    TestSampleGrinder g;
+    EXPECT_TRUE(g.ParseCommandLine(&cmd_line_));
+    EXPECT_TRUE(g.streaming_);
+  }
+
+  // Streaming is not supported at the line level.
+  cmd_line_.Init(0, NULL);
+  cmd_line_.AppendSwitch(SampleGrinder::kStreaming);
+  cmd_line_.AppendSwitchASCII(SampleGrinder::kAggregationLevel, "line");
+  {
+    TestSampleGrinder g;
+    EXPECT_FALSE(g.ParseCommandLine(&cmd_line_));
+  }
+}
+
 TEST_F(SampleGrinderTest, SetParserSucceeds) {
   TestSampleGrinder g;
   EXPECT_TRUE(g.parser_ == NULL);
@@ -587,6 +653,16 @@ TEST_F(SampleGrinderTest, GrindCompilandNoImageSpecified) {
   ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kCompiland, false));
 }
 
+TEST_F(SampleGrinderTest, GrindFunctionStreaming) {
+  cmd_line_.AppendSwitch(SampleGrinder::kStreaming);
+  ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kFunction, false));
+}
+
+TEST_F(SampleGrinderTest, GrindCompilandStreaming) {
+  cmd_line_.AppendSwitch(SampleGrinder::kStreaming);
+  ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kCompiland, false));
+}
+
 TEST_F(SampleGrinderTest, GrindLine) {
   TestSampleGrinder g;
   ASSERT_NO_FATAL_FAILURE(GrindSucceeds(SampleGrinder::kLine, true));
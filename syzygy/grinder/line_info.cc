@@ -21,18 +21,31 @@
 #include "base/strings/utf_string_conversions.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
+#include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
 
 namespace grinder {
 
 namespace {
 
+namespace cci = Microsoft_Cci_Pdb;
+
 using base::win::ScopedBstr;
 using base::win::ScopedComPtr;
 
 typedef core::AddressRange<core::RelativeAddress, size_t> RelativeAddressRange;
 typedef std::map<DWORD, const std::string*> SourceFileMap;
+typedef std::vector<IMAGE_SECTION_HEADER> SectionHeaders;
+
+// Maps the offsets of the file checksum records of a module to the names of
+// the source files they describe.
+typedef std::map<size_t, const std::string*> FileChecksumMap;
 
 bool GetDiaSessionForPdb(const base::FilePath& pdb_path,
                          IDiaDataSource* source,
@@ -121,6 +134,222 @@ const std::string* GetSourceFileName(DWORD source_file_id,
   return source_file_name;
 }
 
+// Orders source lines by address.
+bool SourceLineAddressLess(const LineInfo::SourceLine& sl1,
+                           const LineInfo::SourceLine& sl2) {
+  return sl1.address < sl2.address;
+}
+
+// Reads the section headers the line information of a PDB refers to. If the
+// image has been transformed, these are the headers of the original image.
+bool ReadSectionHeaders(const pdb::DbiStream& dbi_stream,
+                        pdb::PdbFile* pdb_file,
+                        SectionHeaders* section_headers) {
+  DCHECK(pdb_file != NULL);
+  DCHECK(section_headers != NULL);
+
+  int16 stream_index = dbi_stream.dbg_header().section_header_origin;
+  if (stream_index == -1)
+    stream_index = dbi_stream.dbg_header().section_header;
+
+  if (stream_index < 0 ||
+      static_cast<size_t>(stream_index) >= pdb_file->StreamCount()) {
+    LOG(ERROR) << "No section header stream.";
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> stream = pdb_file->GetStream(stream_index);
+  if (stream.get() == NULL) {
+    LOG(ERROR) << "No section header stream.";
+    return false;
+  }
+
+  size_t count = stream->length() / sizeof(IMAGE_SECTION_HEADER);
+  if (!stream->Seek(0) || !stream->Read(section_headers, count)) {
+    LOG(ERROR) << "Unable to read the section headers.";
+    return false;
+  }
+
+  return true;
+}
+
+// Reads the file checksum subsection of a module's C13 line information. The
+// file names are interned in @p source_files.
+bool ReadFileChecksums(const pdb::OffsetStringMap& names,
+                       pdb::PdbStream* stream,
+                       size_t length,
+                       LineInfo::SourceFileSet* source_files,
+                       FileChecksumMap* file_checksums) {
+  DCHECK(stream != NULL);
+  DCHECK(source_files != NULL);
+  DCHECK(file_checksums != NULL);
+
+  size_t base = stream->pos();
+  size_t end = base + length;
+  while (stream->pos() < end) {
+    // The records are referred to by their offset in the subsection. They
+    // aren't read as a whole, as the structure is padded.
+    size_t offset = stream->pos() - base;
+    uint32 name = 0;
+    uint8 checksum_length = 0;
+    uint8 checksum_type = 0;
+    if (!stream->Read(&name, 1) || !stream->Read(&checksum_length, 1) ||
+        !stream->Read(&checksum_type, 1)) {
+      LOG(ERROR) << "Unable to read file checksum.";
+      return false;
+    }
+
+    pdb::OffsetStringMap::const_iterator name_it = names.find(name);
+    if (name_it == names.end()) {
+      LOG(ERROR) << "File checksum refers to an unknown file name.";
+      return false;
+    }
+    const std::string* source_file_name =
+        &(*source_files->insert(name_it->second).first);
+    file_checksums->insert(std::make_pair(offset, source_file_name));
+
+    // Skip the checksum and align.
+    if (!stream->Seek(common::AlignUp(stream->pos() + checksum_length, 4))) {
+      LOG(ERROR) << "Unable to seek past file checksum.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Reads a lines subsection of a module's C13 line information. This describes
+// a contiguous run of code, typically a function.
+bool ReadLinesSubsection(const SectionHeaders& section_headers,
+                         const FileChecksumMap& file_checksums,
+                         pdb::PdbStream* stream,
+                         size_t length,
+                         LineInfo::SourceLines* source_lines) {
+  DCHECK(stream != NULL);
+  DCHECK(source_lines != NULL);
+
+  size_t end = stream->pos() + length;
+  cci::CV_LineSection line_section = {};
+  if (!stream->Read(&line_section, 1)) {
+    LOG(ERROR) << "Unable to read line section.";
+    return false;
+  }
+
+  if (line_section.sec == 0 || line_section.sec > section_headers.size()) {
+    LOG(ERROR) << "Line section refers to an invalid section.";
+    return false;
+  }
+  core::RelativeAddress start(
+      section_headers[line_section.sec - 1].VirtualAddress + line_section.off);
+
+  // The lines of the run may be spread over several source files. They are
+  // gathered first, so that their sizes can be derived from the addresses of
+  // the lines that follow them.
+  LineInfo::SourceLines lines;
+  while (stream->pos() < end) {
+    cci::CV_SourceFile source_file = {};
+    if (!stream->Read(&source_file, 1)) {
+      LOG(ERROR) << "Unable to read source info.";
+      return false;
+    }
+
+    FileChecksumMap::const_iterator file_it =
+        file_checksums.find(source_file.index);
+    if (file_it == file_checksums.end()) {
+      LOG(ERROR) << "Line information refers to an unknown file.";
+      return false;
+    }
+
+    std::vector<cci::CV_Line> cv_lines;
+    if (source_file.count != 0 &&
+        !stream->Read(&cv_lines, source_file.count)) {
+      LOG(ERROR) << "Unable to read line records.";
+      return false;
+    }
+
+    // We've no use for the columns.
+    if ((line_section.flags & cci::CV_LINES_HAVE_COLUMNS) != 0 &&
+        !stream->Seek(stream->pos() +
+                      source_file.count * sizeof(cci::CV_Column))) {
+      LOG(ERROR) << "Unable to seek past column records.";
+      return false;
+    }
+
+    for (size_t i = 0; i < cv_lines.size(); ++i) {
+      lines.push_back(LineInfo::SourceLine(
+          file_it->second,
+          cv_lines[i].flags & cci::linenumStart,
+          start + cv_lines[i].offset,
+          0));
+    }
+  }
+
+  // Each line extends up to the next one, and the last one up to the end of
+  // the run. Lines sharing an address get a zero size here.
+  std::stable_sort(lines.begin(), lines.end(), SourceLineAddressLess);
+  core::RelativeAddress run_end = start + line_section.cod;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    core::RelativeAddress next =
+        i + 1 < lines.size() ? lines[i + 1].address : run_end;
+    if (next < lines[i].address) {
+      LOG(ERROR) << "Line lies past the end of its code run.";
+      return false;
+    }
+    lines[i].size = next - lines[i].address;
+  }
+
+  source_lines->insert(source_lines->end(), lines.begin(), lines.end());
+  return true;
+}
+
+// Reads the C13 line information of a module.
+bool ReadModuleLines(const pdb::DbiModuleInfo& module_info,
+                     const pdb::OffsetStringMap& names,
+                     const SectionHeaders& section_headers,
+                     pdb::PdbStream* stream,
+                     LineInfo::SourceFileSet* source_files,
+                     LineInfo::SourceLines* source_lines) {
+  DCHECK(stream != NULL);
+  DCHECK(source_files != NULL);
+  DCHECK(source_lines != NULL);
+
+  const pdb::DbiModuleInfoBase& info = module_info.module_info_base();
+  size_t start = info.symbol_bytes + info.old_lines_bytes;
+  size_t end = start + info.lines_bytes;
+
+  // The line information is a run of {type, length} prefixed subsections. The
+  // lines subsections refer to the file checksums subsection, which may come
+  // after them, so this takes two passes.
+  FileChecksumMap file_checksums;
+  for (size_t pass = 0; pass < 2; ++pass) {
+    size_t pos = start;
+    while (pos < end) {
+      uint32 type = 0;
+      uint32 length = 0;
+      if (!stream->Seek(pos) || !stream->Read(&type, 1) ||
+          !stream->Read(&length, 1)) {
+        LOG(ERROR) << "Unable to read line information subsection header.";
+        return false;
+      }
+      pos = common::AlignUp(stream->pos() + length, 4);
+
+      if (pass == 0 && type == cci::DEBUG_S_FILECHKSMS) {
+        if (!ReadFileChecksums(names, stream, length, source_files,
+                               &file_checksums)) {
+          return false;
+        }
+      } else if (pass == 1 && type == cci::DEBUG_S_LINES) {
+        if (!ReadLinesSubsection(section_headers, file_checksums, stream,
+                                 length, source_lines)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
 // Used for comparing the ranges covered by two source lines.
 struct SourceLineAddressComparator {
   bool operator()(const LineInfo::SourceLine& sl1,
@@ -132,6 +361,96 @@ struct SourceLineAddressComparator {
 }  // namespace
 
 bool LineInfo::Init(const base::FilePath& pdb_path) {
+  if (InitFromPdbStreams(pdb_path))
+    return true;
+
+  LOG(WARNING) << "Unable to read the line information from the streams of \""
+               << pdb_path.value() << "\", falling back to DIA.";
+  source_files_.clear();
+  source_lines_.clear();
+  return InitFromDia(pdb_path);
+}
+
+bool LineInfo::InitFromPdbStreams(const base::FilePath& pdb_path) {
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  pdb_reader.set_memory_mapped(true);
+  if (!pdb_reader.Read(pdb_path, &pdb_file)) {
+    LOG(ERROR) << "Failed to read PDB file: " << pdb_path.value();
+    return false;
+  }
+
+  // The source files are referred to by their offset in the name table.
+  pdb::PdbInfoHeader70 pdb_header = {};
+  pdb::NameStreamMap name_stream_map;
+  if (!pdb::ReadHeaderInfoStream(pdb_file, &pdb_header, &name_stream_map))
+    return false;
+  pdb::NameStreamMap::const_iterator names_it = name_stream_map.find("/names");
+  if (names_it == name_stream_map.end()) {
+    LOG(ERROR) << "No name table in PDB file: " << pdb_path.value();
+    return false;
+  }
+  scoped_refptr<pdb::PdbStream> names_stream =
+      pdb_file.GetStream(names_it->second);
+  pdb::OffsetStringMap names;
+  if (names_stream.get() == NULL ||
+      !pdb::ReadStringTable(names_stream.get(), "Name table", 0,
+                            names_stream->length(), &names)) {
+    LOG(ERROR) << "Unable to read the name table of PDB file: "
+               << pdb_path.value();
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> dbi_stream_data =
+      pdb_file.GetStream(pdb::kDbiStream);
+  pdb::DbiStream dbi_stream;
+  if (dbi_stream_data.get() == NULL ||
+      !dbi_stream.Read(dbi_stream_data.get())) {
+    LOG(ERROR) << "Unable to read the Dbi stream of PDB file: "
+               << pdb_path.value();
+    return false;
+  }
+
+  SectionHeaders section_headers;
+  if (!ReadSectionHeaders(dbi_stream, &pdb_file, &section_headers))
+    return false;
+
+  const pdb::DbiStream::DbiModuleVector& modules = dbi_stream.modules();
+  for (size_t i = 0; i < modules.size(); ++i) {
+    const pdb::DbiModuleInfoBase& info = modules[i].module_info_base();
+    if (info.stream == -1 || info.lines_bytes == 0)
+      continue;
+
+    scoped_refptr<pdb::PdbStream> module_stream =
+        pdb_file.GetStream(info.stream);
+    if (module_stream.get() == NULL) {
+      LOG(ERROR) << "Unable to read a module info stream.";
+      return false;
+    }
+
+    if (!ReadModuleLines(modules[i], names, section_headers,
+                         module_stream.get(), &source_files_,
+                         &source_lines_)) {
+      return false;
+    }
+  }
+
+  // The modules don't come in address order. Once sorted, zero-length lines
+  // are made the same length as the line following them at the same address,
+  // as is done when reading from DIA.
+  std::stable_sort(source_lines_.begin(), source_lines_.end(),
+                   SourceLineAddressLess);
+  for (size_t i = source_lines_.size(); i > 1; --i) {
+    SourceLine& line = source_lines_[i - 2];
+    const SourceLine& next_line = source_lines_[i - 1];
+    if (line.size == 0 && line.address == next_line.address)
+      line.size = next_line.size;
+  }
+
+  return true;
+}
+
+bool LineInfo::InitFromDia(const base::FilePath& pdb_path) {
   ScopedComPtr<IDiaDataSource> source;
   HRESULT hr = source.CreateInstance(CLSID_DiaSource);
   if (FAILED(hr)) {
@@ -44,6 +44,9 @@ class LineInfo {
   typedef std::vector<SourceLine> SourceLines;
 
   // Initializes this LineInfo object with data read from the provided PDB.
+  // The line information is read straight from the module streams of the PDB,
+  // which is much faster than enumerating it through DIA. DIA is only used if
+  // that fails.
   // @param pdb_path the PDB whose line information is to be read.
   // @returns true on success, false otherwise.
   bool Init(const base::FilePath& pdb_path);
@@ -62,6 +65,14 @@ class LineInfo {
   // @}
 
  protected:
+  // @name Initialization helpers. These expect an empty LineInfo object.
+  // @{
+  // Reads the C13 line information of the module streams of the PDB.
+  bool InitFromPdbStreams(const base::FilePath& pdb_path);
+  // Enumerates the line information of the PDB through DIA.
+  bool InitFromDia(const base::FilePath& pdb_path);
+  // @}
+
   // Used to store unique file names in a manner such that we can draw stable
   // pointers to them. The SourceLine objects will point to the strings in this
   // set.
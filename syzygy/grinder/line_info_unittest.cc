@@ -26,6 +26,8 @@ namespace {
 
 class TestLineInfo : public LineInfo {
  public:
+  using LineInfo::InitFromDia;
+  using LineInfo::InitFromPdbStreams;
   using LineInfo::source_files_;
   using LineInfo::source_lines_;
 
@@ -118,6 +120,26 @@ TEST_F(LineInfoTest, InitStaticPdb) {
   EXPECT_EQ(8379u, line_info.source_lines().size());
 }
 
+TEST_F(LineInfoTest, InitFromPdbStreamsMatchesDia) {
+  TestLineInfo stream_line_info;
+  ASSERT_TRUE(stream_line_info.InitFromPdbStreams(static_pdb_path_));
+  TestLineInfo dia_line_info;
+  ASSERT_TRUE(dia_line_info.InitFromDia(static_pdb_path_));
+
+  EXPECT_EQ(dia_line_info.source_files(), stream_line_info.source_files());
+
+  const LineInfo::SourceLines& stream_lines = stream_line_info.source_lines();
+  const LineInfo::SourceLines& dia_lines = dia_line_info.source_lines();
+  ASSERT_EQ(dia_lines.size(), stream_lines.size());
+  for (size_t i = 0; i < dia_lines.size(); ++i) {
+    EXPECT_EQ(dia_lines[i].address, stream_lines[i].address);
+    EXPECT_EQ(dia_lines[i].size, stream_lines[i].size);
+    EXPECT_EQ(dia_lines[i].line_number, stream_lines[i].line_number);
+    EXPECT_EQ(*dia_lines[i].source_file_name,
+              *stream_lines[i].source_file_name);
+  }
+}
+
 TEST_F(LineInfoTest, Visit) {
   TestLineInfo line_info;
 
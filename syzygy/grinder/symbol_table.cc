@@ -0,0 +1,426 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/symbol_table.h"
+
+#include <algorithm>
+
+#include "base/file_util.h"
+#include "base/strings/stringprintf.h"
+#include "base/win/scoped_bstr.h"
+#include "base/win/scoped_comptr.h"
+#include "syzygy/common/com_utils.h"
+
+namespace grinder {
+
+namespace {
+
+using base::win::ScopedBstr;
+using base::win::ScopedComPtr;
+
+// The version of the cache files. Bump this when the format changes.
+const uint32 kSymbolTableVersion = 1;
+
+// Orders functions and lines by address.
+struct AddressLess {
+  template <typename Entry>
+  bool operator()(const Entry& entry1, const Entry& entry2) const {
+    return entry1.address < entry2.address;
+  }
+};
+
+// Finds the last entry of @p entries starting at or before @p address.
+// @returns the entry, or NULL if there is none.
+template <typename Entry>
+const Entry* FindPrecedingEntry(const std::vector<Entry>& entries,
+                                core::RelativeAddress address) {
+  Entry key;
+  key.address = address;
+  typename std::vector<Entry>::const_iterator it =
+      std::upper_bound(entries.begin(), entries.end(), key, AddressLess());
+  if (it == entries.begin())
+    return NULL;
+  --it;
+  return &(*it);
+}
+
+// Reads the address, the size and the name of a function symbol.
+bool ReadFunction(IDiaSymbol* symbol, SymbolTable::Function* function) {
+  DCHECK(symbol != NULL);
+  DCHECK(function != NULL);
+
+  DWORD rva = 0;
+  ULONGLONG length = 0;
+  ScopedBstr name;
+  HRESULT hr = symbol->get_relativeVirtualAddress(&rva);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_relativeVirtualAddress: "
+               << common::LogHr(hr) << ".";
+    return false;
+  }
+  hr = symbol->get_length(&length);
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_length: " << common::LogHr(hr) << ".";
+    return false;
+  }
+  hr = symbol->get_name(name.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_name: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  function->address = core::RelativeAddress(rva);
+  function->size = static_cast<size_t>(length);
+  function->name = common::ToString(name);
+  return true;
+}
+
+// Saves a size as 32 bits, so that cache files don't depend on the bitness of
+// the grinder.
+bool SaveSize(size_t size, core::OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(static_cast<uint32>(size));
+}
+
+bool LoadSize(size_t* size, core::InArchive* in_archive) {
+  DCHECK(size != NULL);
+  DCHECK(in_archive != NULL);
+  uint32 value = 0;
+  if (!in_archive->Load(&value))
+    return false;
+  *size = value == static_cast<uint32>(-1) ? SymbolTable::kNoFile : value;
+  return true;
+}
+
+}  // namespace
+
+bool SymbolTable::Init(IDiaSession* session) {
+  DCHECK(session != NULL);
+
+  functions_.clear();
+  public_symbols_.clear();
+  lines_.clear();
+  file_names_.clear();
+
+  ScopedComPtr<IDiaSymbol> global;
+  HRESULT hr = session->get_globalScope(global.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in get_globalScope: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  if (!ReadFunctions(session, global.get()) ||
+      !ReadPublicSymbols(global.get())) {
+    return false;
+  }
+
+  std::sort(functions_.begin(), functions_.end(), AddressLess());
+  std::sort(public_symbols_.begin(), public_symbols_.end(), AddressLess());
+  std::stable_sort(lines_.begin(), lines_.end(), AddressLess());
+
+  return true;
+}
+
+const SymbolTable::Function* SymbolTable::FindFunction(
+    core::RelativeAddress address) const {
+  const Function* function = FindPrecedingEntry(functions_, address);
+  if (function != NULL && address < function->address + function->size)
+    return function;
+
+  return FindPrecedingEntry(public_symbols_, address);
+}
+
+const SymbolTable::Line* SymbolTable::FindLine(core::RelativeAddress address,
+                                               size_t size) const {
+  // Look for a line containing the start of the range.
+  const Line* line = FindPrecedingEntry(lines_, address);
+  if (line != NULL && address < line->address + line->size)
+    return line;
+
+  // Otherwise, look for the first line starting in the range.
+  Line key;
+  key.address = address;
+  Lines::const_iterator it =
+      std::lower_bound(lines_.begin(), lines_.end(), key, AddressLess());
+  if (it != lines_.end() && it->address < address + size)
+    return &(*it);
+
+  return NULL;
+}
+
+base::FilePath SymbolTable::GetCachePath(const base::FilePath& cache_dir,
+                                         const GUID& signature,
+                                         uint32 age) {
+  wchar_t signature_string[40] = {};
+  CHECK_LT(0, ::StringFromGUID2(signature,
+                                signature_string,
+                                arraysize(signature_string)));
+  return cache_dir.Append(
+      base::StringPrintf(L"%ls-%d.symbols", signature_string, age));
+}
+
+bool SymbolTable::SaveToFile(const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!Save(&out_archive) || !out_archive.Flush()) {
+    LOG(ERROR) << "Unable to write symbols to \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool SymbolTable::LoadFromFile(const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  if (!Load(&in_archive)) {
+    LOG(WARNING) << "Unable to read symbols from \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool SymbolTable::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(kSymbolTableVersion) &&
+      out_archive->Save(functions_) &&
+      out_archive->Save(public_symbols_) &&
+      out_archive->Save(lines_) &&
+      out_archive->Save(file_names_);
+}
+
+bool SymbolTable::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+
+  uint32 version = 0;
+  if (!in_archive->Load(&version))
+    return false;
+  if (version != kSymbolTableVersion) {
+    LOG(WARNING) << "Unsupported symbol table version " << version << ".";
+    return false;
+  }
+
+  SymbolTable table;
+  if (!in_archive->Load(&table.functions_) ||
+      !in_archive->Load(&table.public_symbols_) ||
+      !in_archive->Load(&table.lines_) ||
+      !in_archive->Load(&table.file_names_)) {
+    return false;
+  }
+
+  // Validate the file indices, so that lookups can trust them.
+  for (size_t i = 0; i < table.lines_.size(); ++i) {
+    size_t file_index = table.lines_[i].file_index;
+    if (file_index != kNoFile && file_index >= table.file_names_.size())
+      return false;
+  }
+
+  functions_.swap(table.functions_);
+  public_symbols_.swap(table.public_symbols_);
+  lines_.swap(table.lines_);
+  file_names_.swap(table.file_names_);
+  return true;
+}
+
+bool SymbolTable::ReadFunctions(IDiaSession* session, IDiaSymbol* global) {
+  DCHECK(session != NULL);
+  DCHECK(global != NULL);
+
+  // The source files already seen, mapped to their index in file_names_.
+  SourceFileIndexMap source_file_indices;
+
+  ScopedComPtr<IDiaEnumSymbols> compilands;
+  HRESULT hr = global->findChildren(SymTagCompiland, NULL, 0,
+                                    compilands.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in findChildren: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  while (true) {
+    ScopedComPtr<IDiaSymbol> compiland;
+    ULONG fetched = 0;
+    hr = compilands->Next(1, compiland.Receive(), &fetched);
+    if (hr != S_OK || fetched != 1)
+      break;
+
+    ScopedComPtr<IDiaEnumSymbols> functions;
+    hr = compiland->findChildren(SymTagFunction, NULL, 0,
+                                 functions.Receive());
+    if (FAILED(hr)) {
+      LOG(ERROR) << "Failure in findChildren: " << common::LogHr(hr) << ".";
+      return false;
+    }
+
+    while (true) {
+      ScopedComPtr<IDiaSymbol> symbol;
+      hr = functions->Next(1, symbol.Receive(), &fetched);
+      if (hr != S_OK || fetched != 1)
+        break;
+
+      Function function;
+      if (!ReadFunction(symbol.get(), &function))
+        return false;
+      functions_.push_back(function);
+
+      if (function.size != 0 &&
+          !ReadLines(session, function.address, function.size,
+                     &source_file_indices)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool SymbolTable::ReadPublicSymbols(IDiaSymbol* global) {
+  DCHECK(global != NULL);
+
+  ScopedComPtr<IDiaEnumSymbols> publics;
+  HRESULT hr = global->findChildren(SymTagPublicSymbol, NULL, 0,
+                                    publics.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in findChildren: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  while (true) {
+    ScopedComPtr<IDiaSymbol> symbol;
+    ULONG fetched = 0;
+    hr = publics->Next(1, symbol.Receive(), &fetched);
+    if (hr != S_OK || fetched != 1)
+      break;
+
+    Function function;
+    if (!ReadFunction(symbol.get(), &function))
+      return false;
+    public_symbols_.push_back(function);
+  }
+
+  return true;
+}
+
+bool SymbolTable::ReadLines(IDiaSession* session,
+                            core::RelativeAddress address,
+                            size_t size,
+                            SourceFileIndexMap* source_file_indices) {
+  DCHECK(session != NULL);
+  DCHECK(source_file_indices != NULL);
+
+  ScopedComPtr<IDiaEnumLineNumbers> enum_lines;
+  HRESULT hr = session->findLinesByRVA(address.value(), size,
+                                       enum_lines.Receive());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failure in findLinesByRVA: " << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  while (true) {
+    ScopedComPtr<IDiaLineNumber> line_number;
+    ULONG fetched = 0;
+    hr = enum_lines->Next(1, line_number.Receive(), &fetched);
+    if (hr != S_OK || fetched != 1)
+      break;
+
+    DWORD line = 0;
+    DWORD rva = 0;
+    DWORD length = 0;
+    if (FAILED(line_number->get_lineNumber(&line)) ||
+        FAILED(line_number->get_relativeVirtualAddress(&rva)) ||
+        FAILED(line_number->get_length(&length))) {
+      LOG(ERROR) << "Failed to get line number properties.";
+      return false;
+    }
+
+    // The same source file is referred to by many lines, so its name is
+    // retrieved only once.
+    Line source_line;
+    ScopedComPtr<IDiaSourceFile> source_file;
+    hr = line_number->get_sourceFile(source_file.Receive());
+    if (hr == S_OK) {
+      DWORD source_file_id = 0;
+      hr = source_file->get_uniqueId(&source_file_id);
+      if (FAILED(hr)) {
+        LOG(ERROR) << "Failure in get_uniqueId: " << common::LogHr(hr) << ".";
+        return false;
+      }
+
+      std::pair<SourceFileIndexMap::iterator, bool> result =
+          source_file_indices->insert(
+              std::make_pair(source_file_id, file_names_.size()));
+      if (result.second) {
+        ScopedBstr file_name;
+        hr = source_file->get_fileName(file_name.Receive());
+        if (FAILED(hr)) {
+          LOG(ERROR) << "Failure in get_fileName: " << common::LogHr(hr)
+                     << ".";
+          return false;
+        }
+        file_names_.push_back(common::ToString(file_name));
+      }
+      source_line.file_index = result.first->second;
+    }
+
+    source_line.address = core::RelativeAddress(rva);
+    source_line.size = length;
+    source_line.line_number = line;
+    lines_.push_back(source_line);
+  }
+
+  return true;
+}
+
+bool SymbolTable::Function::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(address) &&
+      SaveSize(size, out_archive) &&
+      out_archive->Save(name);
+}
+
+bool SymbolTable::Function::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&address) &&
+      LoadSize(&size, in_archive) &&
+      in_archive->Load(&name);
+}
+
+bool SymbolTable::Line::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(address) &&
+      SaveSize(size, out_archive) &&
+      SaveSize(line_number, out_archive) &&
+      SaveSize(file_index, out_archive);
+}
+
+bool SymbolTable::Line::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&address) &&
+      LoadSize(&size, in_archive) &&
+      LoadSize(&line_number, in_archive) &&
+      LoadSize(&file_index, in_archive);
+}
+
+}  // namespace grinder
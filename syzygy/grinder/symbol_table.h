@@ -0,0 +1,162 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a class for holding the function symbols of a module, as extracted
+// from its PDB.
+
+#ifndef SYZYGY_GRINDER_SYMBOL_TABLE_H_
+#define SYZYGY_GRINDER_SYMBOL_TABLE_H_
+
+#include <dia2.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/core/address.h"
+#include "syzygy/core/serialization.h"
+
+namespace grinder {
+
+// Holds the functions and the source lines of a module, extracted once from
+// its PDB and sorted by address for efficient lookup. Resolving an address
+// then doesn't involve DIA anymore.
+//
+// As extracting the symbols of a large module is costly, a symbol table can be
+// saved to and loaded from a cache file. Cache files are named after the
+// signature of the PDB, so that a rebuilt module never hits a stale cache.
+class SymbolTable {
+ public:
+  struct Function;  // Forward declaration.
+  struct Line;  // Forward declaration.
+  typedef std::vector<Function> Functions;
+  typedef std::vector<Line> Lines;
+  typedef std::vector<std::wstring> FileNames;
+
+  // The file index of lines without a source file.
+  static const size_t kNoFile = static_cast<size_t>(-1);
+
+  // Initializes this symbol table with the symbols of the PDB opened by
+  // @p session. The addresses are as translated by @p session.
+  // @param session the DIA session to read the symbols from.
+  // @returns true on success, false otherwise.
+  bool Init(IDiaSession* session);
+
+  // Finds the function containing @p address. As with DIA, this falls back to
+  // the closest preceding public symbol if no private function contains
+  // @p address.
+  // @param address the address to look up.
+  // @returns the function, or NULL if there is none.
+  const Function* FindFunction(core::RelativeAddress address) const;
+
+  // Finds the first line intersecting an address range.
+  // @param address the starting address of the range.
+  // @param size the size of the range.
+  // @returns the line, or NULL if there is none.
+  const Line* FindLine(core::RelativeAddress address, size_t size) const;
+
+  // @name Accessors.
+  // @{
+  const Functions& functions() const { return functions_; }
+  const Functions& public_symbols() const { return public_symbols_; }
+  const Lines& lines() const { return lines_; }
+  const FileNames& file_names() const { return file_names_; }
+  // @}
+
+  // Returns the path of the cache file of the symbols of a PDB.
+  // @param cache_dir the directory containing the cache files.
+  // @param signature the signature of the PDB.
+  // @param age the age of the PDB.
+  static base::FilePath GetCachePath(const base::FilePath& cache_dir,
+                                     const GUID& signature,
+                                     uint32 age);
+
+  // @name Cache files.
+  // @{
+  // Saves this symbol table to the file at @p path.
+  // @returns true on success, false otherwise.
+  bool SaveToFile(const base::FilePath& path) const;
+  // Loads this symbol table from the file at @p path.
+  // @returns true on success, false otherwise.
+  bool LoadFromFile(const base::FilePath& path);
+  // @}
+
+  // @name Serialization.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+
+ protected:
+  // Maps the unique ids of the source files to their index in file_names_.
+  typedef std::map<DWORD, size_t> SourceFileIndexMap;
+
+  // Reads the private functions of @p session, and their source lines.
+  bool ReadFunctions(IDiaSession* session, IDiaSymbol* global);
+  // Reads the public symbols of @p global.
+  bool ReadPublicSymbols(IDiaSymbol* global);
+  // Reads the source lines of the address range of a function.
+  bool ReadLines(IDiaSession* session,
+                 core::RelativeAddress address,
+                 size_t size,
+                 SourceFileIndexMap* source_file_indices);
+
+  // The private functions, sorted by address.
+  Functions functions_;
+  // The public symbols, sorted by address.
+  Functions public_symbols_;
+  // The source lines of the private functions, sorted by address.
+  Lines lines_;
+  // The unique source file names the lines refer to.
+  FileNames file_names_;
+};
+
+// Describes a function, or a public symbol.
+struct SymbolTable::Function {
+  Function() : size(0) {
+  }
+
+  core::RelativeAddress address;
+  // The size may be zero for a public symbol.
+  size_t size;
+  std::wstring name;
+
+  // @name Serialization.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+};
+
+// Describes the code of a single source line.
+struct SymbolTable::Line {
+  Line() : size(0), line_number(0), file_index(kNoFile) {
+  }
+
+  core::RelativeAddress address;
+  size_t size;
+  size_t line_number;
+  // The index of the source file in file_names().
+  size_t file_index;
+
+  // @name Serialization.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+};
+
+}  // namespace grinder
+
+#endif  // SYZYGY_GRINDER_SYMBOL_TABLE_H_
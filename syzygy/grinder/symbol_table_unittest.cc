@@ -0,0 +1,203 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/grinder/symbol_table.h"
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/win/scoped_com_initializer.h"
+#include "base/win/scoped_comptr.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/dia_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace grinder {
+
+namespace {
+
+using base::win::ScopedComPtr;
+
+class TestSymbolTable : public SymbolTable {
+ public:
+  using SymbolTable::functions_;
+  using SymbolTable::lines_;
+  using SymbolTable::public_symbols_;
+
+  void AddFunction(Functions* functions,
+                   uint32 address,
+                   size_t size,
+                   const wchar_t* name) {
+    DCHECK(functions != NULL);
+    Function function;
+    function.address = core::RelativeAddress(address);
+    function.size = size;
+    function.name = name;
+    functions->push_back(function);
+  }
+
+  void AddLine(uint32 address, size_t size, size_t line_number) {
+    Line line;
+    line.address = core::RelativeAddress(address);
+    line.size = size;
+    line.line_number = line_number;
+    lines_.push_back(line);
+  }
+};
+
+class SymbolTableTest : public testing::Test {
+ public:
+  // Initializes @p table with the symbols of the test DLL.
+  void InitTestDllSymbols(SymbolTable* table) {
+    ASSERT_TRUE(table != NULL);
+
+    ScopedComPtr<IDiaDataSource> dia_source;
+    ASSERT_TRUE(pe::CreateDiaSource(dia_source.Receive()));
+
+    ScopedComPtr<IDiaSession> dia_session;
+    ASSERT_TRUE(pe::CreateDiaSession(
+        testing::GetExeRelativePath(testing::kTestDllPdbName),
+        dia_source.get(),
+        dia_session.Receive()));
+
+    ASSERT_TRUE(table->Init(dia_session.get()));
+  }
+
+  // Ensures that COM is initialized for tests in this fixture.
+  base::win::ScopedCOMInitializer com_initializer_;
+};
+
+}  // namespace
+
+TEST_F(SymbolTableTest, FindFunction) {
+  TestSymbolTable table;
+  table.AddFunction(&table.functions_, 0x1000, 0x10, L"foo");
+  table.AddFunction(&table.functions_, 0x1020, 0x10, L"bar");
+  table.AddFunction(&table.public_symbols_, 0x1010, 0, L"_baz");
+
+  EXPECT_EQ(NULL, table.FindFunction(core::RelativeAddress(0x0FFF)));
+  EXPECT_EQ(&table.functions_[0],
+            table.FindFunction(core::RelativeAddress(0x1000)));
+  EXPECT_EQ(&table.functions_[0],
+            table.FindFunction(core::RelativeAddress(0x100F)));
+  EXPECT_EQ(&table.functions_[1],
+            table.FindFunction(core::RelativeAddress(0x1025)));
+
+  // Addresses outside of the private functions fall back to the closest
+  // preceding public symbol.
+  EXPECT_EQ(&table.public_symbols_[0],
+            table.FindFunction(core::RelativeAddress(0x1018)));
+  EXPECT_EQ(&table.public_symbols_[0],
+            table.FindFunction(core::RelativeAddress(0x1030)));
+}
+
+TEST_F(SymbolTableTest, FindLine) {
+  TestSymbolTable table;
+  table.AddLine(0x1000, 4, 10);
+  table.AddLine(0x1004, 4, 11);
+  table.AddLine(0x1010, 4, 20);
+
+  EXPECT_EQ(&table.lines_[0], table.FindLine(core::RelativeAddress(0x1000), 1));
+  EXPECT_EQ(&table.lines_[1], table.FindLine(core::RelativeAddress(0x1006), 1));
+
+  // A range starting in between lines finds the next line it intersects.
+  EXPECT_EQ(&table.lines_[2],
+            table.FindLine(core::RelativeAddress(0x1008), 0x10));
+  EXPECT_EQ(NULL, table.FindLine(core::RelativeAddress(0x1008), 4));
+  EXPECT_EQ(NULL, table.FindLine(core::RelativeAddress(0x1020), 4));
+}
+
+TEST_F(SymbolTableTest, InitFromPdb) {
+  SymbolTable table;
+  ASSERT_NO_FATAL_FAILURE(InitTestDllSymbols(&table));
+
+  ASSERT_FALSE(table.functions().empty());
+  EXPECT_FALSE(table.public_symbols().empty());
+  EXPECT_FALSE(table.lines().empty());
+  EXPECT_FALSE(table.file_names().empty());
+
+  // The functions are sorted, and each can be found by its address.
+  const SymbolTable::Functions& functions = table.functions();
+  bool found_dll_main = false;
+  for (size_t i = 0; i < functions.size(); ++i) {
+    if (i > 0)
+      EXPECT_LE(functions[i - 1].address, functions[i].address);
+    if (functions[i].name == L"DllMain")
+      found_dll_main = true;
+    if (functions[i].size == 0)
+      continue;
+
+    const SymbolTable::Function* function =
+        table.FindFunction(functions[i].address + functions[i].size - 1);
+    ASSERT_TRUE(function != NULL);
+    EXPECT_EQ(functions[i].address, function->address);
+  }
+  EXPECT_TRUE(found_dll_main);
+
+  // The lines refer to valid file names.
+  const SymbolTable::Lines& lines = table.lines();
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (lines[i].file_index != SymbolTable::kNoFile)
+      EXPECT_LT(lines[i].file_index, table.file_names().size());
+  }
+}
+
+TEST_F(SymbolTableTest, SaveAndLoad) {
+  SymbolTable table;
+  ASSERT_NO_FATAL_FAILURE(InitTestDllSymbols(&table));
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().Append(L"test_dll.symbols");
+  ASSERT_TRUE(table.SaveToFile(path));
+
+  SymbolTable loaded_table;
+  ASSERT_TRUE(loaded_table.LoadFromFile(path));
+
+  ASSERT_EQ(table.functions().size(), loaded_table.functions().size());
+  for (size_t i = 0; i < table.functions().size(); ++i) {
+    EXPECT_EQ(table.functions()[i].address,
+              loaded_table.functions()[i].address);
+    EXPECT_EQ(table.functions()[i].size, loaded_table.functions()[i].size);
+    EXPECT_EQ(table.functions()[i].name, loaded_table.functions()[i].name);
+  }
+  EXPECT_EQ(table.public_symbols().size(),
+            loaded_table.public_symbols().size());
+  EXPECT_EQ(table.lines().size(), loaded_table.lines().size());
+  EXPECT_EQ(table.file_names(), loaded_table.file_names());
+}
+
+TEST_F(SymbolTableTest, LoadMissingFileFails) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  SymbolTable table;
+  EXPECT_FALSE(table.LoadFromFile(temp_dir.path().Append(L"missing")));
+}
+
+TEST_F(SymbolTableTest, GetCachePath) {
+  const GUID kSignature = {
+      0x01234567, 0x89AB, 0xCDEF,
+      { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF } };
+  base::FilePath cache_dir(L"C:\\cache");
+
+  base::FilePath path = SymbolTable::GetCachePath(cache_dir, kSignature, 3);
+  EXPECT_EQ(cache_dir, path.DirName());
+  EXPECT_EQ(L"{01234567-89AB-CDEF-0123-456789ABCDEF}-3.symbols",
+            path.BaseName().value());
+
+  // Another age maps to another file.
+  EXPECT_NE(path, SymbolTable::GetCachePath(cache_dir, kSignature, 4));
+}
+
+}  // namespace grinder
@@ -23,6 +23,8 @@
       'sources': [
         'instrument_app.cc',
         'instrument_app.h',
+        'instrumentation_cache.cc',
+        'instrumentation_cache.h',
         'instrumenter.h',
         'instrumenters/archive_instrumenter.cc',
         'instrumenters/archive_instrumenter.h',
@@ -32,6 +34,8 @@
         'instrumenters/branch_instrumenter.h',
         'instrumenters/bbentry_instrumenter.cc',
         'instrumenters/bbentry_instrumenter.h',
+        'instrumenters/chained_instrumenter.cc',
+        'instrumenters/chained_instrumenter.h',
         'instrumenters/coverage_instrumenter.cc',
         'instrumenters/coverage_instrumenter.h',
         'instrumenters/entry_call_instrumenter.cc',
@@ -77,10 +81,12 @@
             'block_graph_transforms_lib',
         '<(src)/syzygy/ar/ar.gyp:ar_lib',
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/grinder/grinder.gyp:grinder_lib',
         '<(src)/syzygy/pe/orderers/pe_orderers.gyp:pe_orderers_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/transforms/pe_transforms.gyp:pe_transforms_lib',
         '<(src)/syzygy/relink/relink.gyp:relink_lib',
+        '<(src)/syzygy/version/version.gyp:version_lib',
       ],
     },
     {
@@ -108,10 +114,12 @@
       'type': 'executable',
       'sources': [
         'instrument_app_unittest.cc',
+        'instrumentation_cache_unittest.cc',
         'instrumenters/archive_instrumenter_unittest.cc',
         'instrumenters/asan_instrumenter_unittest.cc',
         'instrumenters/bbentry_instrumenter_unittest.cc',
         'instrumenters/branch_instrumenter_unittest.cc',
+        'instrumenters/chained_instrumenter_unittest.cc',
         'instrumenters/coverage_instrumenter_unittest.cc',
         'instrumenters/entry_call_instrumenter_unittest.cc',
         'instrumenters/entry_thunk_instrumenter_unittest.cc',
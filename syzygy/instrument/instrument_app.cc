@@ -19,16 +19,23 @@
 
 #include <algorithm>
 #include <iostream>
+#include <set>
 
+#include "base/file_util.h"
+#include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/core/file_util.h"
+#include "syzygy/instrument/instrumentation_cache.h"
 #include "syzygy/instrument/instrumenters/archive_instrumenter.h"
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 #include "syzygy/instrument/instrumenters/bbentry_instrumenter.h"
 #include "syzygy/instrument/instrumenters/branch_instrumenter.h"
+#include "syzygy/instrument/instrumenters/chained_instrumenter.h"
 #include "syzygy/instrument/instrumenters/coverage_instrumenter.h"
 #include "syzygy/instrument/instrumenters/entry_call_instrumenter.h"
 #include "syzygy/instrument/instrumenters/entry_thunk_instrumenter.h"
+#include "syzygy/pe/pe_relinker_util.h"
 
 namespace instrument {
 
@@ -43,6 +50,10 @@ static const char kUsageFormatStr[] =
     "                            be used. If this is not specified it is\n"
     "                            equivalent to specifying --mode=calltrace\n"
     "                            (this default behaviour is DEPRECATED).\n"
+    "                            A comma separated list of modes applies\n"
+    "                            them in order with a single relink. At most\n"
+    "                            one of bbentry, branch and coverage may be\n"
+    "                            listed, and --agent can't be used.\n"
     "    --output-image=<path>\n"
     "                            The instrumented output image.\n"
     "  DEPRECATED options:\n"
@@ -60,12 +71,20 @@ static const char kUsageFormatStr[] =
     "                            use when instrumenting the provided module.\n"
     "                            If not specified a default agent library\n"
     "                            will be used. This is ignored in Asan mode.\n"
+    "    --cache-dir=<path>      A directory in which the instrumented PE\n"
+    "                            images and their PDBs are cached, keyed on\n"
+    "                            the contents of the input files and on the\n"
+    "                            options. An image instrumented before with\n"
+    "                            the same options is copied from the cache.\n"
+    "                            The directory may be shared.\n"
     "    --debug-friendly        Generate more debugger friendly output by\n"
     "                            making the thunks resolve to the original\n"
     "                            function's name. This is at the cost of the\n"
     "                            uniqueness of address->name resolution.\n"
     "    --inline-fast-path      Inline a fast path into the instrumented\n"
-    "                            image.\n"
+    "                            image. In asan mode this inlines the shadow\n"
+    "                            memory checks, and requires the liveness\n"
+    "                            analysis.\n"
     "    --input-pdb=<path>      The PDB for the DLL to instrument. If not\n"
     "                            explicitly provided will be searched for.\n"
     "    --filter=<path>         The path of the filter to be used in\n"
@@ -89,10 +108,25 @@ static const char kUsageFormatStr[] =
     "                            these options see common/asan_parameters. If\n"
     "                            not specified then the defaults of the RTL\n"
     "                            will be used.\n"
+    "    --hot-instrumentation-rate=DOUBLE\n"
+    "                            Specifies the fraction of instructions to\n"
+    "                            be instrumented in the hot basic blocks.\n"
+    "                            Defaults to 0.1.\n"
+    "    --hotness-budget=DOUBLE The fraction of the profiled basic block\n"
+    "                            entries that the hot basic blocks account\n"
+    "                            for. Defaults to 0.9.\n"
+    "    --hotness-profile=<path>\n"
+    "                            Basic block entry counts in JSON format, as\n"
+    "                            produced by the grinder in bbentry mode. The\n"
+    "                            hottest basic blocks are instrumented at the\n"
+    "                            hot instrumentation rate. PE images only.\n"
     "    --instrumentation-rate=DOUBLE\n"
     "                            Specifies the fraction of instructions to\n"
     "                            be instrumented, as a value in the range\n"
     "                            0..1, inclusive. Defaults to 1.\n"
+    "    --jobs=N                When instrumenting an archive, the number of\n"
+    "                            object files to instrument in parallel.\n"
+    "                            Defaults to 1.\n"
     "    --no-interceptors       Disable the interception of the functions\n"
     "                            like memset, memcpy, stcpy, ReadFile... to\n"
     "                            check their parameters.\n"
@@ -100,11 +134,26 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "    --range-checks          Check the adjacent accesses of a basic block\n"
+    "                            and the loop invariant accesses of a loop\n"
+    "                            with a single check of the range they span.\n"
+    "    --threads=N             The number of worker threads the code blocks\n"
+    "                            of an image are instrumented on. The output\n"
+    "                            doesn't depend on it, except for the\n"
+    "                            sampling of partial instrumentation rates.\n"
+    "                            Defaults to 1.\n"
+    "  bbentry mode options:\n"
+    "    --buffering             Count the basic block entries in per-thread\n"
+    "                            arrays, merged when the threads exit.\n"
+    "    --counter-size=1|2|4    The size in bytes of the saturating\n"
+    "                            counters. Defaults to 4.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
     "                            local storage.\n"
     "  calltrace mode options:\n"
+    "    --direct-thunks         Have the thunks jump directly to a stub of\n"
+    "                            the hook rather than through its import.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "    --module-entry-only     If specified then the per-function entry\n"
     "                            hook will not be used and only module entry\n"
@@ -112,7 +161,12 @@ static const char kUsageFormatStr[] =
     "    --no-unsafe-refs        Perform no instrumentation of references\n"
     "                            between code blocks that contain anything\n"
     "                            but C/C++.\n"
+    "  coverage mode options:\n"
+    "    --self-patching         Patch each basic block probe into a jump\n"
+    "                            over itself once it has been executed.\n"
     "  profile mode options:\n"
+    "    --direct-thunks         Have the thunks jump directly to a stub of\n"
+    "                            the hook rather than through its import.\n"
     "    --instrument-imports    Also instrument calls to imports.\n"
     "\n";
 
@@ -123,6 +177,58 @@ InstrumenterInterface* AsanInstrumenterFactory() {
   return new instrumenters::AsanInstrumenter();
 }
 
+// Creates the PE instrumenter for the given mode.
+// @param mode the name of the instrumentation mode.
+// @returns the instrumenter, or NULL if the mode is unknown.
+instrumenters::InstrumenterWithAgent* CreateInstrumenter(
+    const std::string& mode) {
+  if (LowerCaseEqualsASCII(mode, "asan"))
+    return new instrumenters::AsanInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "bbentry"))
+    return new instrumenters::BasicBlockEntryInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "branch"))
+    return new instrumenters::BranchInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "calltrace")) {
+    return new instrumenters::EntryThunkInstrumenter(
+        instrumenters::EntryThunkInstrumenter::CALL_TRACE);
+  }
+  if (LowerCaseEqualsASCII(mode, "coverage"))
+    return new instrumenters::CoverageInstrumenter();
+  if (LowerCaseEqualsASCII(mode, "profile"))
+    return new instrumenters::EntryCallInstrumenter();
+  return NULL;
+}
+
+// @returns true if the instrumentation mode writes the basic block ranges
+//     stream to the PDB. At most one such mode may be chained.
+bool ModeWritesBasicBlockRanges(const std::string& mode) {
+  return LowerCaseEqualsASCII(mode, "bbentry") ||
+      LowerCaseEqualsASCII(mode, "branch") ||
+      LowerCaseEqualsASCII(mode, "coverage");
+}
+
+// The switches that don't go into the key of the instrumentation cache as
+// they are. The input files are hashed, and the outputs are where the cache
+// entry is copied to.
+const char* kUncachedSwitches[] = {
+    "cache-dir",
+    "input-dll",
+    "input-image",
+    "input-pdb",
+    "output-dll",
+    "output-image",
+    "output-pdb",
+    "overwrite",
+};
+
+bool IsUncachedSwitch(const std::string& name) {
+  for (size_t i = 0; i < arraysize(kUncachedSwitches); ++i) {
+    if (name == kUncachedSwitches[i])
+      return true;
+  }
+  return false;
+}
+
 }  // namespace
 
 void InstrumentApp::ParseDeprecatedMode(const CommandLine* cmd_line) {
@@ -165,37 +271,180 @@ bool InstrumentApp::ParseCommandLine(const CommandLine* cmd_line) {
     ParseDeprecatedMode(cmd_line);
   } else {
     std::string mode = cmd_line->GetSwitchValueASCII("mode");
+    std::vector<std::string> modes;
+    base::SplitString(mode, ',', &modes);
+    if (modes.size() > 1)
+      return ParseChainedModes(cmd_line, modes);
+
     if (LowerCaseEqualsASCII(mode, "asan")) {
       // We wrap the Asan instrumenter in an ArchiveInstrumenter adapter so
       // that it can transparently handle .lib files.
       instrumenter_.reset(new instrumenters::ArchiveInstrumenter(
           &AsanInstrumenterFactory));
-    } else if (LowerCaseEqualsASCII(mode, "bbentry")) {
-      instrumenter_.reset(new instrumenters::BasicBlockEntryInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "branch")) {
-      instrumenter_.reset(new instrumenters::BranchInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "calltrace")) {
-      instrumenter_.reset(new instrumenters::EntryThunkInstrumenter(
-          instrumenters::EntryThunkInstrumenter::CALL_TRACE));
-    } else if (LowerCaseEqualsASCII(mode, "coverage")) {
-      instrumenter_.reset(new instrumenters::CoverageInstrumenter());
-    } else if (LowerCaseEqualsASCII(mode, "profile")) {
-      instrumenter_.reset(new instrumenters::EntryCallInstrumenter());
     } else {
+      instrumenter_.reset(CreateInstrumenter(mode));
+      if (instrumenter_.get() == NULL) {
+        return Usage(cmd_line,
+                     base::StringPrintf("Unknown instrumentation mode: %s.",
+                                        mode.c_str()).c_str());
+      }
+    }
+  }
+  DCHECK(instrumenter_.get() != NULL);
+
+  if (!instrumenter_->ParseCommandLine(cmd_line))
+    return false;
+
+  if (cmd_line->HasSwitch("cache-dir"))
+    ParseCacheOptions(cmd_line);
+
+  return true;
+}
+
+bool InstrumentApp::ParseChainedModes(const CommandLine* cmd_line,
+                                      const std::vector<std::string>& modes) {
+  DCHECK(cmd_line != NULL);
+  DCHECK_LT(1U, modes.size());
+
+  scoped_ptr<instrumenters::ChainedInstrumenter> chained_instrumenter(
+      new instrumenters::ChainedInstrumenter());
+  std::set<std::string> seen_modes;
+  size_t basic_block_ranges_modes = 0;
+  for (size_t i = 0; i < modes.size(); ++i) {
+    std::string mode = StringToLowerASCII(modes[i]);
+    if (!seen_modes.insert(mode).second) {
+      return Usage(cmd_line,
+                   base::StringPrintf("Duplicate instrumentation mode: %s.",
+                                      mode.c_str()).c_str());
+    }
+
+    if (ModeWritesBasicBlockRanges(mode) && ++basic_block_ranges_modes > 1) {
+      return Usage(cmd_line,
+                   "Only one of the bbentry, branch and coverage modes may be "
+                   "used at once.");
+    }
+
+    instrumenters::InstrumenterWithAgent* instrumenter =
+        CreateInstrumenter(mode);
+    if (instrumenter == NULL) {
       return Usage(cmd_line,
                    base::StringPrintf("Unknown instrumentation mode: %s.",
                                       mode.c_str()).c_str());
     }
+    chained_instrumenter->AppendInstrumenter(instrumenter);
   }
-  DCHECK(instrumenter_.get() != NULL);
 
-  return instrumenter_->ParseCommandLine(cmd_line);
+  instrumenter_.reset(chained_instrumenter.release());
+  if (!instrumenter_->ParseCommandLine(cmd_line))
+    return false;
+
+  if (cmd_line->HasSwitch("cache-dir"))
+    ParseCacheOptions(cmd_line);
+
+  return true;
+}
+
+void InstrumentApp::ParseCacheOptions(const CommandLine* cmd_line) {
+  DCHECK(cmd_line != NULL);
+
+  cache_dir_ = AbsolutePath(cmd_line->GetSwitchValuePath("cache-dir"));
+  input_image_path_ = AbsolutePath(cmd_line->GetSwitchValuePath(
+      cmd_line->HasSwitch("input-dll") ? "input-dll" : "input-image"));
+  input_pdb_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("input-pdb"));
+  output_image_path_ = AbsolutePath(cmd_line->GetSwitchValuePath(
+      cmd_line->HasSwitch("output-dll") ? "output-dll" : "output-image"));
+  output_pdb_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("output-pdb"));
+  allow_overwrite_ = cmd_line->HasSwitch("overwrite");
+
+  // The switches are sorted by name. Those naming a file, such as a filter,
+  // contribute its contents rather than its path.
+  cache_options_.clear();
+  cache_input_paths_.clear();
+  const CommandLine::SwitchMap& switches = cmd_line->GetSwitches();
+  CommandLine::SwitchMap::const_iterator it = switches.begin();
+  for (; it != switches.end(); ++it) {
+    if (IsUncachedSwitch(it->first))
+      continue;
+
+    base::FilePath path(it->second);
+    cache_options_.append(it->first);
+    if (!it->second.empty() && base::PathExists(path) &&
+        !base::DirectoryExists(path)) {
+      cache_input_paths_.push_back(AbsolutePath(path));
+      cache_options_.append("=<file>");
+    } else if (!it->second.empty()) {
+      cache_options_.append("=");
+      cache_options_.append(path.AsUTF8Unsafe());
+    }
+    cache_options_.append("\n");
+  }
+}
+
+bool InstrumentApp::GetCacheKey(std::string* key) {
+  DCHECK(key != NULL);
+  DCHECK(!cache_dir_.empty());
+
+  key->clear();
+
+  // Only PE images are cached. Archives and object files have no PDB, and are
+  // quick enough to instrument.
+  core::FileType file_type = core::kUnknownFileType;
+  if (!core::GuessFileType(input_image_path_, &file_type) ||
+      file_type != core::kPeFileType) {
+    LOG(INFO) << "Not using the instrumentation cache for ""
+              << input_image_path_.value() << "".";
+    return true;
+  }
+
+  // This checks the paths the same way the relinker will.
+  if (!pe::ValidateAndInferPaths(input_image_path_, output_image_path_,
+                                 allow_overwrite_, &input_pdb_path_,
+                                 &output_pdb_path_)) {
+    return false;
+  }
+
+  std::vector<base::FilePath> input_paths;
+  input_paths.push_back(input_image_path_);
+  input_paths.push_back(input_pdb_path_);
+  input_paths.insert(input_paths.end(), cache_input_paths_.begin(),
+                     cache_input_paths_.end());
+
+  // The path of the output PDB is written to the image, so it's part of the
+  // key too.
+  std::string options(cache_options_);
+  options.append("output-pdb=");
+  options.append(output_pdb_path_.AsUTF8Unsafe());
+
+  return InstrumentationCache::ComputeKey(input_paths, options, key);
 }
 
 int InstrumentApp::Run() {
   DCHECK(instrumenter_.get() != NULL);
 
-  return instrumenter_->Instrument() ? 0 : 1;
+  // Reuse a previous instrumentation if there is one.
+  std::string cache_key;
+  if (!cache_dir_.empty()) {
+    if (!GetCacheKey(&cache_key))
+      return 1;
+    if (!cache_key.empty()) {
+      InstrumentationCache cache(cache_dir_);
+      if (cache.Fetch(cache_key, output_image_path_, output_pdb_path_))
+        return 0;
+    }
+  }
+
+  if (!instrumenter_->Instrument())
+    return 1;
+
+  // Failing to populate the cache isn't fatal, the image will simply be
+  // instrumented again the next time.
+  if (!cache_key.empty()) {
+    InstrumentationCache cache(cache_dir_);
+    if (!cache.Store(cache_key, output_image_path_, output_pdb_path_))
+      LOG(WARNING) << "Unable to cache the instrumented image.";
+  }
+
+  return 0;
 }
 
 bool InstrumentApp::Usage(const CommandLine* cmd_line,
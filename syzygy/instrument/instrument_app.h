@@ -18,6 +18,9 @@
 #ifndef SYZYGY_INSTRUMENT_INSTRUMENT_APP_H_
 #define SYZYGY_INSTRUMENT_INSTRUMENT_APP_H_
 
+#include <string>
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
@@ -34,7 +37,7 @@ namespace instrument {
 class InstrumentApp : public application::AppImplBase {
  public:
   InstrumentApp()
-      : application::AppImplBase("Instrumenter") {
+      : application::AppImplBase("Instrumenter"), allow_overwrite_(false) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -55,8 +58,41 @@ class InstrumentApp : public application::AppImplBase {
   //     been updated.
   void ParseDeprecatedMode(const CommandLine* command_line);
 
+  // Sets up a chained instrumenter applying the given instrumentation modes
+  // in a single relink.
+  // @param command_line the command-line to be parsed.
+  // @param modes the instrumentation modes, in order.
+  // @returns true on success, false otherwise.
+  bool ParseChainedModes(const CommandLine* command_line,
+                         const std::vector<std::string>& modes);
+
+  // Parses the options of the instrumentation cache.
+  // @param command_line the command-line to be parsed.
+  void ParseCacheOptions(const CommandLine* command_line);
+
+  // Computes the key of the instrumentation in the instrumentation cache.
+  // @param key receives the key. It is left empty if the instrumentation
+  //     can't be cached.
+  // @returns true on success, false otherwise.
+  bool GetCacheKey(std::string* key);
+
   // The instrumenter we delegate to.
   scoped_ptr<InstrumenterInterface> instrumenter_;
+
+  // @name Instrumentation cache parameters. The cache is only used if
+  //     cache_dir_ is not empty.
+  // @{
+  base::FilePath cache_dir_;
+  base::FilePath input_image_path_;
+  base::FilePath input_pdb_path_;
+  base::FilePath output_image_path_;
+  base::FilePath output_pdb_path_;
+  bool allow_overwrite_;
+  // The options that affect the output, one per line.
+  std::string cache_options_;
+  // The files named by those options, whose contents affect the output.
+  std::vector<base::FilePath> cache_input_paths_;
+  // @}
 };
 
 }  // namespace instrument
@@ -15,12 +15,14 @@
 #include "syzygy/instrument/instrument_app.h"
 
 #include "base/environment.h"
+#include "base/file_util.h"
 #include "base/strings/stringprintf.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/unittest_util.h"
 #include "syzygy/common/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/instrument/instrumenters/chained_instrumenter.h"
 #include "syzygy/instrument/instrumenters/entry_thunk_instrumenter.h"
 #include "syzygy/pe/pe_relinker.h"
 #include "syzygy/pe/pe_utils.h"
@@ -177,6 +179,40 @@ TEST_F(InstrumentAppTest, DeprecatedParseCallTraceClientProfiler) {
             entry_thunk_instrumenter->instrumentation_mode());
 }
 
+TEST_F(InstrumentAppTest, ParseChainedModes) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+  cmd_line_.AppendSwitchASCII("mode", "asan,coverage");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(dynamic_cast<instrumenters::ChainedInstrumenter*>(
+      test_impl_.instrumenter_.get()) != NULL);
+}
+
+TEST_F(InstrumentAppTest, ParseChainedModesWithDuplicateFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+  cmd_line_.AppendSwitchASCII("mode", "asan,ASAN");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, ParseChainedModesWithTwoRangesModesFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+  cmd_line_.AppendSwitchASCII("mode", "bbentry,coverage");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(InstrumentAppTest, ParseChainedModesWithUnknownModeFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+  cmd_line_.AppendSwitchASCII("mode", "asan,foo");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(InstrumentAppTest, Run) {
   cmd_line_.AppendSwitchPath("input-dll", input_dll_path_);
   cmd_line_.AppendSwitchPath("output-dll", output_dll_path_);
@@ -185,4 +221,30 @@ TEST_F(InstrumentAppTest, Run) {
   ASSERT_EQ(0, test_impl_.Run());
 }
 
+TEST_F(InstrumentAppTest, RunWithCache) {
+  base::FilePath cache_dir = temp_dir_.Append(L"cache");
+  cmd_line_.AppendSwitchASCII("mode", "calltrace");
+  cmd_line_.AppendSwitchPath("input-image", input_dll_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_dll_path_);
+  cmd_line_.AppendSwitchPath("cache-dir", cache_dir);
+
+  // The first run populates the cache.
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(0, test_impl_.Run());
+  ASSERT_TRUE(base::PathExists(output_dll_path_));
+  EXPECT_FALSE(base::IsDirectoryEmpty(cache_dir));
+
+  // The second one is served from it.
+  std::string image;
+  ASSERT_TRUE(base::ReadFileToString(output_dll_path_, &image));
+  ASSERT_TRUE(base::DeleteFile(output_dll_path_, false));
+  ASSERT_TRUE(base::DeleteFile(output_pdb_path_, false));
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(0, test_impl_.Run());
+  std::string cached_image;
+  ASSERT_TRUE(base::ReadFileToString(output_dll_path_, &cached_image));
+  EXPECT_EQ(image, cached_image);
+  EXPECT_TRUE(base::PathExists(output_pdb_path_));
+}
+
 }  // namespace instrument
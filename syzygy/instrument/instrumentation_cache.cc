@@ -0,0 +1,163 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/instrument/instrumentation_cache.h"
+
+#include "base/file_util.h"
+#include "base/logging.h"
+#include "base/md5.h"
+#include "base/strings/string_number_conversions.h"
+#include "syzygy/version/syzygy_version.h"
+
+namespace instrument {
+
+namespace {
+
+// Feeds the size and the contents of the file at @p path to @p context.
+bool Md5ConsumeFile(const base::FilePath& path, base::MD5Context* context) {
+  DCHECK(context != NULL);
+
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\".";
+    return false;
+  }
+
+  int64 file_size = 0;
+  if (!base::GetFileSize(path, &file_size)) {
+    LOG(ERROR) << "Unable to get the size of \"" << path.value() << "\".";
+    return false;
+  }
+  base::MD5Update(context, base::Int64ToString(file_size));
+
+  char buffer[4096] = { 0 };
+  int64 total_bytes_read = 0;
+  while (true) {
+    size_t bytes_read = ::fread(buffer, 1, sizeof(buffer), file.get());
+    if (bytes_read == 0)
+      break;
+    base::MD5Update(context, base::StringPiece(buffer, bytes_read));
+    total_bytes_read += bytes_read;
+  }
+
+  if (::ferror(file.get()) || total_bytes_read != file_size) {
+    LOG(ERROR) << "Error reading \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+const wchar_t InstrumentationCache::kImageFileName[] = L"image";
+const wchar_t InstrumentationCache::kPdbFileName[] = L"pdb";
+
+InstrumentationCache::InstrumentationCache(const base::FilePath& cache_dir)
+    : cache_dir_(cache_dir) {
+  DCHECK(!cache_dir.empty());
+}
+
+bool InstrumentationCache::ComputeKey(
+    const std::vector<base::FilePath>& input_paths,
+    const std::string& options,
+    std::string* key) {
+  DCHECK(key != NULL);
+
+  // The fields are separated so that no two sets of inputs feed the same
+  // bytes to the digest.
+  base::MD5Context context;
+  base::MD5Init(&context);
+  base::MD5Update(&context, version::kSyzygyVersion.GetVersionString());
+  base::MD5Update(&context, base::StringPiece("\0", 1));
+  base::MD5Update(&context, options);
+  for (size_t i = 0; i < input_paths.size(); ++i) {
+    base::MD5Update(&context, base::StringPiece("\0", 1));
+    if (!Md5ConsumeFile(input_paths[i], &context))
+      return false;
+  }
+
+  base::MD5Digest digest;
+  base::MD5Final(&digest, &context);
+  *key = base::MD5DigestToBase16(digest);
+
+  return true;
+}
+
+bool InstrumentationCache::Fetch(const std::string& key,
+                                 const base::FilePath& image_path,
+                                 const base::FilePath& pdb_path) const {
+  DCHECK(!key.empty());
+
+  base::FilePath entry_dir(cache_dir_.AppendASCII(key));
+  if (!base::DirectoryExists(entry_dir))
+    return false;
+
+  if (!base::CopyFile(entry_dir.Append(kImageFileName), image_path) ||
+      !base::CopyFile(entry_dir.Append(kPdbFileName), pdb_path)) {
+    LOG(WARNING) << "Unable to copy cache entry \"" << entry_dir.value()
+                 << "\".";
+    base::DeleteFile(image_path, false);
+    base::DeleteFile(pdb_path, false);
+    return false;
+  }
+
+  LOG(INFO) << "Using cached instrumentation \"" << entry_dir.value()
+            << "\".";
+  return true;
+}
+
+bool InstrumentationCache::Store(const std::string& key,
+                                 const base::FilePath& image_path,
+                                 const base::FilePath& pdb_path) const {
+  DCHECK(!key.empty());
+
+  base::FilePath entry_dir(cache_dir_.AppendASCII(key));
+  if (base::DirectoryExists(entry_dir))
+    return true;
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Unable to create cache directory \"" << cache_dir_.value()
+               << "\".";
+    return false;
+  }
+
+  // Populate the entry under a temporary name, then move it into place. If
+  // another instrumentation stored the same entry in the meantime, this one
+  // is simply discarded.
+  base::FilePath temp_dir;
+  if (!base::CreateTemporaryDirInDir(cache_dir_, L"tmp", &temp_dir)) {
+    LOG(ERROR) << "Unable to create a temporary directory in \""
+               << cache_dir_.value() << "\".";
+    return false;
+  }
+
+  bool stored = base::CopyFile(image_path, temp_dir.Append(kImageFileName)) &&
+      base::CopyFile(pdb_path, temp_dir.Append(kPdbFileName)) &&
+      base::Move(temp_dir, entry_dir);
+  if (!stored) {
+    base::DeleteFile(temp_dir, true);
+    if (base::DirectoryExists(entry_dir))
+      return true;
+    LOG(ERROR) << "Unable to store cache entry \"" << entry_dir.value()
+               << "\".";
+    return false;
+  }
+
+  LOG(INFO) << "Stored instrumentation in cache \"" << entry_dir.value()
+            << "\".";
+  return true;
+}
+
+}  // namespace instrument
@@ -0,0 +1,83 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the InstrumentationCache class, a content-keyed cache of
+// instrumented images and their PDBs. It lets repeated instrumentations of
+// the same image with the same options skip the decomposition and relinking
+// altogether.
+//
+// The key of an entry is a digest of the toolchain version, of the
+// instrumentation options and of the contents of all the input files. Each
+// entry is a directory named after its key, holding a copy of the image and of
+// the PDB. The cache directory may be shared by several machines: entries are
+// written under a temporary name and then moved into place, so that readers
+// never see partial entries.
+
+#ifndef SYZYGY_INSTRUMENT_INSTRUMENTATION_CACHE_H_
+#define SYZYGY_INSTRUMENT_INSTRUMENTATION_CACHE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+
+namespace instrument {
+
+class InstrumentationCache {
+ public:
+  // @param cache_dir the directory holding the cache entries. It is created
+  //     as needed.
+  explicit InstrumentationCache(const base::FilePath& cache_dir);
+
+  // Computes the key under which the output of an instrumentation is cached.
+  // @param input_paths the files read by the instrumentation. Their contents,
+  //     rather than their paths, go into the key.
+  // @param options the instrumentation options. These go into the key
+  //     verbatim.
+  // @param key receives the key.
+  // @returns true on success, false if an input file couldn't be read.
+  static bool ComputeKey(const std::vector<base::FilePath>& input_paths,
+                         const std::string& options,
+                         std::string* key);
+
+  // Copies the image and PDB cached under @p key to @p image_path and
+  // @p pdb_path, overwriting them if they exist.
+  // @returns true on a cache hit, false otherwise.
+  bool Fetch(const std::string& key,
+             const base::FilePath& image_path,
+             const base::FilePath& pdb_path) const;
+
+  // Stores copies of @p image_path and @p pdb_path under @p key. An existing
+  // entry for @p key is left untouched.
+  // @returns true on success, false otherwise.
+  bool Store(const std::string& key,
+             const base::FilePath& image_path,
+             const base::FilePath& pdb_path) const;
+
+  // Accessor.
+  const base::FilePath& cache_dir() const { return cache_dir_; }
+
+  // The names of the files of a cache entry.
+  static const wchar_t kImageFileName[];
+  static const wchar_t kPdbFileName[];
+
+ private:
+  base::FilePath cache_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstrumentationCache);
+};
+
+}  // namespace instrument
+
+#endif  // SYZYGY_INSTRUMENT_INSTRUMENTATION_CACHE_H_
@@ -0,0 +1,117 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/instrument/instrumentation_cache.h"
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+
+namespace instrument {
+
+namespace {
+
+class InstrumentationCacheTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    cache_dir_ = temp_dir_.path().Append(L"cache");
+    image_path_ = temp_dir_.path().Append(L"image.dll");
+    pdb_path_ = temp_dir_.path().Append(L"image.dll.pdb");
+    ASSERT_NO_FATAL_FAILURE(WriteFile(image_path_, "image"));
+    ASSERT_NO_FATAL_FAILURE(WriteFile(pdb_path_, "pdb"));
+  }
+
+  void WriteFile(const base::FilePath& path, const std::string& contents) {
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              base::WriteFile(path, contents.data(), contents.size()));
+  }
+
+  std::string ReadFile(const base::FilePath& path) {
+    std::string contents;
+    EXPECT_TRUE(base::ReadFileToString(path, &contents));
+    return contents;
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::FilePath cache_dir_;
+  base::FilePath image_path_;
+  base::FilePath pdb_path_;
+};
+
+}  // namespace
+
+TEST_F(InstrumentationCacheTest, ComputeKey) {
+  std::vector<base::FilePath> input_paths;
+  input_paths.push_back(image_path_);
+  input_paths.push_back(pdb_path_);
+
+  std::string key;
+  ASSERT_TRUE(InstrumentationCache::ComputeKey(input_paths, "asan", &key));
+  EXPECT_FALSE(key.empty());
+
+  // The key only depends on the contents of the inputs.
+  std::string same_key;
+  base::FilePath copy_path = temp_dir_.path().Append(L"copy.dll");
+  ASSERT_TRUE(base::CopyFile(image_path_, copy_path));
+  input_paths[0] = copy_path;
+  ASSERT_TRUE(InstrumentationCache::ComputeKey(input_paths, "asan",
+                                               &same_key));
+  EXPECT_EQ(key, same_key);
+
+  // Other options give another key.
+  std::string other_key;
+  ASSERT_TRUE(InstrumentationCache::ComputeKey(input_paths, "bbentry",
+                                               &other_key));
+  EXPECT_NE(key, other_key);
+
+  // So do other contents.
+  ASSERT_NO_FATAL_FAILURE(WriteFile(copy_path, "other image"));
+  ASSERT_TRUE(InstrumentationCache::ComputeKey(input_paths, "asan",
+                                               &other_key));
+  EXPECT_NE(key, other_key);
+
+  // Missing inputs are an error.
+  input_paths[0] = temp_dir_.path().Append(L"missing.dll");
+  EXPECT_FALSE(InstrumentationCache::ComputeKey(input_paths, "asan",
+                                                &other_key));
+}
+
+TEST_F(InstrumentationCacheTest, StoreAndFetch) {
+  InstrumentationCache cache(cache_dir_);
+  base::FilePath output_image_path = temp_dir_.path().Append(L"out.dll");
+  base::FilePath output_pdb_path = temp_dir_.path().Append(L"out.dll.pdb");
+
+  // Nothing is cached at first.
+  EXPECT_FALSE(cache.Fetch("key", output_image_path, output_pdb_path));
+  EXPECT_FALSE(base::PathExists(output_image_path));
+  EXPECT_FALSE(base::PathExists(output_pdb_path));
+
+  EXPECT_TRUE(cache.Store("key", image_path_, pdb_path_));
+  EXPECT_TRUE(cache.Fetch("key", output_image_path, output_pdb_path));
+  EXPECT_EQ("image", ReadFile(output_image_path));
+  EXPECT_EQ("pdb", ReadFile(output_pdb_path));
+
+  // An existing entry is kept as is.
+  ASSERT_NO_FATAL_FAILURE(WriteFile(image_path_, "new image"));
+  EXPECT_TRUE(cache.Store("key", image_path_, pdb_path_));
+  EXPECT_TRUE(cache.Fetch("key", output_image_path, output_pdb_path));
+  EXPECT_EQ("image", ReadFile(output_image_path));
+
+  // Other keys don't hit.
+  EXPECT_FALSE(cache.Fetch("other_key", output_image_path, output_pdb_path));
+}
+
+}  // namespace instrument
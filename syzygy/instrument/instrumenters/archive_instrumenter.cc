@@ -21,6 +21,7 @@
 
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "syzygy/application/application.h"
 #include "syzygy/ar/ar_transform.h"
 #include "syzygy/core/file_util.h"
 
@@ -35,11 +36,11 @@ const char kOutputImage[] = "output-image";
 }  // namespace
 
 ArchiveInstrumenter::ArchiveInstrumenter()
-    : factory_(NULL), overwrite_(false) {
+    : factory_(NULL), overwrite_(false), jobs_(1) {
 }
 
 ArchiveInstrumenter::ArchiveInstrumenter(InstrumenterFactoryFunction factory)
-    : factory_(factory), overwrite_(false) {
+    : factory_(factory), overwrite_(false), jobs_(1) {
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory);
 }
 
@@ -54,6 +55,9 @@ bool ArchiveInstrumenter::ParseCommandLine(const CommandLine* command_line) {
   output_image_ = command_line_->GetSwitchValuePath(kOutputImage);
   overwrite_ = command_line_->HasSwitch("overwrite");
 
+  if (!application::AppImplBase::ParseJobs(command_line_.get(), &jobs_))
+    return false;
+
   return true;
 }
 
@@ -112,6 +116,8 @@ bool ArchiveInstrumenter::InstrumentArchive() {
   }
 
   LOG(INFO) << "Instrumenting archive: " << input_image_.value();
+  if (jobs_ > 1)
+    LOG(INFO) << "Instrumenting up to " << jobs_ << " files at once.";
 
   // Configure and run an archive transform.
   ar::OnDiskArTransformAdapter::TransformFileOnDiskCallback callback =
@@ -121,6 +127,7 @@ bool ArchiveInstrumenter::InstrumentArchive() {
   ar_transform.set_callback(on_disk_adapter.outer_callback());
   ar_transform.set_input_archive(input_image_);
   ar_transform.set_output_archive(output_image_);
+  ar_transform.set_max_concurrency(jobs_);
   if (!ar_transform.Transform())
     return false;
 
@@ -131,6 +138,8 @@ bool ArchiveInstrumenter::InstrumentFile(const base::FilePath& input_path,
                                          const base::FilePath& output_path,
                                          ar::ParsedArFileHeader* header,
                                          bool* remove) {
+  // This may be invoked by several threads at once, so it only reads the
+  // shared state of this object.
   DCHECK_NE(reinterpret_cast<InstrumenterFactoryFunction>(NULL), factory_);
   DCHECK_NE(reinterpret_cast<ar::ParsedArFileHeader*>(NULL), header);
   DCHECK_NE(reinterpret_cast<bool*>(NULL), remove);
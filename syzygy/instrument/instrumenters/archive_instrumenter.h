@@ -18,7 +18,9 @@
 // an archive simply passes through the original instrumenter.
 //
 // This presumes that the underlying instrumenter uses --input-image and
-// --output-image for configuring which files are operated on.
+// --output-image for configuring which files are operated on. The files of an
+// archive are instrumented in parallel if --jobs is greater than one, in which
+// case the underlying instrumenter must not share state between instances.
 
 #ifndef SYZYGY_INSTRUMENT_INSTRUMENTERS_ARCHIVE_INSTRUMENTER_H_
 #define SYZYGY_INSTRUMENT_INSTRUMENTERS_ARCHIVE_INSTRUMENTER_H_
@@ -45,6 +47,9 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   // @returns the factory function being used by this instrumenter
   //     adapter.
   InstrumenterFactoryFunction factory() const { return factory_; }
+
+  // @returns the number of archive files that are instrumented at once.
+  size_t jobs() const { return jobs_; }
   // @}
 
   // @name Mutators.
@@ -84,6 +89,7 @@ class ArchiveInstrumenter : public InstrumenterInterface {
   base::FilePath input_image_;
   base::FilePath output_image_;
   bool overwrite_;
+  size_t jobs_;
 
   DISALLOW_COPY_AND_ASSIGN(ArchiveInstrumenter);
 };
@@ -16,6 +16,7 @@
 
 #include "base/file_util.h"
 #include "gtest/gtest.h"
+#include "syzygy/ar/ar_reader.h"
 #include "syzygy/ar/unittest_util.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
@@ -138,6 +139,24 @@ TEST_F(ArchiveInstrumenterTest, IteratesOverArchiveFiles) {
   EXPECT_TRUE(base::PathExists(output_image_));
 }
 
+TEST_F(ArchiveInstrumenterTest, ParseJobs) {
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_EQ(1u, inst.jobs());
+
+  command_line_->AppendSwitchASCII("jobs", "4");
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_EQ(4u, inst.jobs());
+}
+
+TEST_F(ArchiveInstrumenterTest, ParseJobsFailsInvalidValue) {
+  ArchiveInstrumenter inst(&IdentityInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchASCII("jobs", "0");
+  EXPECT_FALSE(inst.ParseCommandLine(command_line_.get()));
+}
+
 TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchive) {
   ArchiveInstrumenter inst(&AsanInstrumenterFactory);
   command_line_->AppendSwitchPath("input-image", zlib_lib_);
@@ -147,5 +166,19 @@ TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchive) {
   EXPECT_TRUE(base::PathExists(output_image_));
 }
 
+TEST_F(ArchiveInstrumenterTest, AsanInstrumentArchiveInParallel) {
+  ArchiveInstrumenter inst(&AsanInstrumenterFactory);
+  command_line_->AppendSwitchPath("input-image", zlib_lib_);
+  command_line_->AppendSwitchASCII("jobs", "4");
+
+  EXPECT_TRUE(inst.ParseCommandLine(command_line_.get()));
+  EXPECT_TRUE(inst.Instrument());
+  EXPECT_TRUE(base::PathExists(output_image_));
+
+  ar::ArReader reader;
+  ASSERT_TRUE(reader.Init(output_image_));
+  EXPECT_EQ(testing::kArchiveFileCount, reader.offsets().size());
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
@@ -15,11 +15,15 @@
 #include "syzygy/instrument/instrumenters/asan_instrumenter.h"
 
 #include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
 
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "syzygy/application/application.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
+#include "syzygy/pe/pe_file.h"
 
 namespace {
   using instrument::transforms::AllocationFilterTransform;
@@ -34,8 +38,13 @@ AsanInstrumenter::AsanInstrumenter()
     : use_interceptors_(true),
       remove_redundant_checks_(true),
       use_liveness_analysis_(true),
+      inline_fast_path_(false),
+      use_range_checks_(false),
       instrumentation_rate_(1.0),
-      asan_rtl_options_(false) {
+      hotness_budget_(0.9),
+      hot_instrumentation_rate_(0.1),
+      asan_rtl_options_(false),
+      num_threads_(1) {
   agent_dll_ = kAgentDllAsan;
 }
 
@@ -69,7 +78,40 @@ bool AsanInstrumenter::InstrumentImpl() {
   asan_transform_->set_use_interceptors(use_interceptors_);
   asan_transform_->set_use_liveness_analysis(use_liveness_analysis_);
   asan_transform_->set_remove_redundant_checks(remove_redundant_checks_);
+  asan_transform_->set_inline_fast_path(inline_fast_path_);
+  asan_transform_->set_use_range_checks(use_range_checks_);
   asan_transform_->set_instrumentation_rate(instrumentation_rate_);
+  asan_transform_->set_num_threads(num_threads_);
+
+  // Load the hotness profile if one was provided. It refers to the addresses
+  // of the basic blocks in the input image.
+  if (!hotness_profile_path_.empty()) {
+    if (image_format_ != BlockGraph::PE_IMAGE) {
+      LOG(ERROR) << "A hotness profile can only be used with PE images.";
+      return false;
+    }
+
+    pe::PEFile pe_file;
+    pe::PEFile::Signature signature;
+    if (!pe_file.Init(input_image_path_)) {
+      LOG(ERROR) << "Unable to read the input image: "
+                 << input_image_path_.value() << ".";
+      return false;
+    }
+    pe_file.GetSignature(&signature);
+
+    IndexedFrequencyMap frequencies;
+    if (!grinder::basic_block_util::LoadBranchStatisticsFromFile(
+            hotness_profile_path_, signature, &frequencies)) {
+      LOG(ERROR) << "Unable to load the hotness profile: "
+                 << hotness_profile_path_.value() << ".";
+      return false;
+    }
+
+    SelectHotBasicBlocks(frequencies, hotness_budget_, &hot_basic_blocks_);
+    asan_transform_->set_hot_basic_blocks(&hot_basic_blocks_);
+    asan_transform_->set_hot_instrumentation_rate(hot_instrumentation_rate_);
+  }
 
   // Set up the filter if one was provided.
   if (filter.get()) {
@@ -105,6 +147,8 @@ bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
   use_liveness_analysis_ = !command_line->HasSwitch("no-liveness-analysis");
   remove_redundant_checks_ = !command_line->HasSwitch("no-redundancy-analysis");
   use_interceptors_ = !command_line->HasSwitch("no-interceptors");
+  inline_fast_path_ = command_line->HasSwitch("inline-fast-path");
+  use_range_checks_ = command_line->HasSwitch("range-checks");
 
   // Parse the instrumentation rate if one has been provided.
   static const char kInstrumentationRate[] = "instrumentation-rate";
@@ -119,6 +163,42 @@ bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
     instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
   }
 
+  // Parse the number of worker threads. This is distinct from the --jobs of
+  // the archive instrumenter, which runs an instrumenter per object file.
+  static const char kThreads[] = "threads";
+  if (command_line->HasSwitch(kThreads)) {
+    std::string s = command_line->GetSwitchValueASCII(kThreads);
+    unsigned threads = 0;
+    if (!base::StringToUint(s, &threads) || threads == 0) {
+      LOG(ERROR) << "Invalid value for --" << kThreads << ": " << s;
+      return false;
+    }
+    num_threads_ = threads;
+  }
+
+  // Parse the hotness profile options.
+  hotness_profile_path_ = command_line->GetSwitchValuePath("hotness-profile");
+  static const char kHotnessBudget[] = "hotness-budget";
+  if (command_line->HasSwitch(kHotnessBudget)) {
+    std::string s = command_line->GetSwitchValueASCII(kHotnessBudget);
+    double d = 0;
+    if (!base::StringToDouble(s, &d)) {
+      LOG(ERROR) << "Failed to parse floating point value: " << s;
+      return false;
+    }
+    hotness_budget_ = std::max(0.0, std::min(1.0, d));
+  }
+  static const char kHotInstrumentationRate[] = "hot-instrumentation-rate";
+  if (command_line->HasSwitch(kHotInstrumentationRate)) {
+    std::string s = command_line->GetSwitchValueASCII(kHotInstrumentationRate);
+    double d = 0;
+    if (!base::StringToDouble(s, &d)) {
+      LOG(ERROR) << "Failed to parse floating point value: " << s;
+      return false;
+    }
+    hot_instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
+  }
+
   // Parse Asan RTL options if present.
   static const char kAsanRtlOptions[] = "asan-rtl-options";
   if (asan_rtl_options_ = command_line->HasSwitch(kAsanRtlOptions)) {
@@ -159,5 +239,37 @@ bool AsanInstrumenter::ParseAdditionalCommandLineArguments(
   return true;
 }
 
+void AsanInstrumenter::SelectHotBasicBlocks(
+    const IndexedFrequencyMap& frequencies,
+    double budget,
+    RelativeAddressSet* hot_basic_blocks) {
+  DCHECK_NE(reinterpret_cast<RelativeAddressSet*>(NULL), hot_basic_blocks);
+
+  hot_basic_blocks->clear();
+
+  // Only the first column holds the basic block entry counts.
+  typedef std::pair<grinder::basic_block_util::EntryCountType,
+                    core::RelativeAddress> CountAndAddress;
+  std::vector<CountAndAddress> counts;
+  double total_count = 0;
+  IndexedFrequencyMap::const_iterator it = frequencies.begin();
+  for (; it != frequencies.end(); ++it) {
+    if (it->first.second != 0 || it->second <= 0)
+      continue;
+    counts.push_back(std::make_pair(it->second, it->first.first));
+    total_count += it->second;
+  }
+
+  // Take the hottest basic blocks until they cover the budget.
+  std::sort(counts.begin(), counts.end(), std::greater<CountAndAddress>());
+  double covered_count = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (covered_count >= budget * total_count)
+      break;
+    covered_count += counts[i].first;
+    hot_basic_blocks->insert(counts[i].second);
+  }
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
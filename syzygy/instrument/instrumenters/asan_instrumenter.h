@@ -20,6 +20,7 @@
 
 #include "base/command_line.h"
 #include "syzygy/common/asan_parameters.h"
+#include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 #include "syzygy/instrument/transforms/asan_transform.h"
@@ -36,6 +37,10 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   ~AsanInstrumenter() { }
 
  protected:
+  typedef grinder::basic_block_util::IndexedFrequencyMap IndexedFrequencyMap;
+  typedef instrument::transforms::AsanBasicBlockTransform::RelativeAddressSet
+      RelativeAddressSet;
+
   // The name of the agent for this mode of instrumentation.
   static const char kAgentDllAsan[];
 
@@ -48,16 +53,34 @@ class AsanInstrumenter : public InstrumenterWithAgent {
       const CommandLine* command_line) OVERRIDE;
   // @}
 
+  // Selects the hottest basic blocks of a profile, which together account for
+  // a given fraction of the basic block entries.
+  // @param frequencies The basic block entry counts.
+  // @param budget The fraction of the basic block entries, in the range [0, 1].
+  // @param hot_basic_blocks Receives the addresses of the hot basic blocks.
+  static void SelectHotBasicBlocks(const IndexedFrequencyMap& frequencies,
+                                   double budget,
+                                   RelativeAddressSet* hot_basic_blocks);
+
   // @name Command-line parameters.
   // @{
   base::FilePath filter_path_;
   bool use_interceptors_;
   bool remove_redundant_checks_;
   bool use_liveness_analysis_;
+  bool inline_fast_path_;
+  bool use_range_checks_;
   double instrumentation_rate_;
+  base::FilePath hotness_profile_path_;
+  double hotness_budget_;
+  double hot_instrumentation_rate_;
   bool asan_rtl_options_;
+  size_t num_threads_;
   // @}
 
+  // The hot basic blocks, valid if hotness_profile_path_ is not empty.
+  RelativeAddressSet hot_basic_blocks_;
+
   // Valid if asan_rtl_options_ is true.
   common::InflatedAsanParameters asan_params_;
 
@@ -32,6 +32,7 @@ static wchar_t kGoodAllocationFilterFile[] =
 
 class TestAsanInstrumenter : public AsanInstrumenter {
  public:
+  using AsanInstrumenter::RelativeAddressSet;
   using AsanInstrumenter::af_transform_;
   using AsanInstrumenter::agent_dll_;
   using AsanInstrumenter::allocation_filter_config_file_path_;
@@ -40,19 +41,26 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::asan_rtl_options_;
   using AsanInstrumenter::debug_friendly_;
   using AsanInstrumenter::filter_path_;
+  using AsanInstrumenter::hot_instrumentation_rate_;
+  using AsanInstrumenter::hotness_budget_;
+  using AsanInstrumenter::hotness_profile_path_;
+  using AsanInstrumenter::inline_fast_path_;
   using AsanInstrumenter::input_image_path_;
   using AsanInstrumenter::input_pdb_path_;
   using AsanInstrumenter::instrumentation_rate_;
   using AsanInstrumenter::kAgentDllAsan;
   using AsanInstrumenter::no_augment_pdb_;
   using AsanInstrumenter::no_strip_strings_;
+  using AsanInstrumenter::num_threads_;
   using AsanInstrumenter::output_image_path_;
   using AsanInstrumenter::output_pdb_path_;
   using AsanInstrumenter::remove_redundant_checks_;
   using AsanInstrumenter::use_interceptors_;
   using AsanInstrumenter::use_liveness_analysis_;
+  using AsanInstrumenter::use_range_checks_;
   using InstrumenterWithAgent::CreateRelinker;
   using AsanInstrumenter::InstrumentImpl;
+  using AsanInstrumenter::SelectHotBasicBlocks;
 
   TestAsanInstrumenter() {
     // Call the GetPERelinker function to initialize it.
@@ -161,8 +169,14 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_TRUE(instrumenter_.use_interceptors_);
   EXPECT_TRUE(instrumenter_.use_liveness_analysis_);
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
+  EXPECT_FALSE(instrumenter_.inline_fast_path_);
+  EXPECT_FALSE(instrumenter_.use_range_checks_);
   EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
+  EXPECT_TRUE(instrumenter_.hotness_profile_path_.empty());
+  EXPECT_EQ(0.9, instrumenter_.hotness_budget_);
+  EXPECT_EQ(0.1, instrumenter_.hot_instrumentation_rate_);
   EXPECT_FALSE(instrumenter_.asan_rtl_options_);
+  EXPECT_EQ(1u, instrumenter_.num_threads_);
 }
 
 TEST_F(AsanInstrumenterTest, ParseFullAsan) {
@@ -170,6 +184,7 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitchPath("filter", test_dll_filter_path_);
   cmd_line_.AppendSwitchASCII("agent", "foo.dll");
   cmd_line_.AppendSwitch("debug-friendly");
+  cmd_line_.AppendSwitch("inline-fast-path");
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("no-interceptors");
@@ -178,7 +193,12 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("no-liveness-analysis");
   cmd_line_.AppendSwitch("no-redundancy-analysis");
+  cmd_line_.AppendSwitch("range-checks");
   cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
+  cmd_line_.AppendSwitchPath("hotness-profile", dummy_filter_path_);
+  cmd_line_.AppendSwitchASCII("hotness-budget", "0.75");
+  cmd_line_.AppendSwitchASCII("hot-instrumentation-rate", "0.25");
+  cmd_line_.AppendSwitchASCII("threads", "4");
   cmd_line_.AppendSwitchASCII("asan-rtl-options",
       "--quarantine_size=1024 --quarantine_block_size=512 --ignored");
 
@@ -197,8 +217,14 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_FALSE(instrumenter_.use_interceptors_);
   EXPECT_FALSE(instrumenter_.use_liveness_analysis_);
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
+  EXPECT_TRUE(instrumenter_.inline_fast_path_);
+  EXPECT_TRUE(instrumenter_.use_range_checks_);
   EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(dummy_filter_path_, instrumenter_.hotness_profile_path_);
+  EXPECT_EQ(0.75, instrumenter_.hotness_budget_);
+  EXPECT_EQ(0.25, instrumenter_.hot_instrumentation_rate_);
   EXPECT_TRUE(instrumenter_.asan_rtl_options_);
+  EXPECT_EQ(4u, instrumenter_.num_threads_);
 
   // We check that the requested RTL options were parsed, and that others are
   // left to their defaults. We don't check all the parameters as other
@@ -250,6 +276,64 @@ TEST_F(AsanInstrumenterTest, FailsWithInvalidInstrumentationRate) {
   EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(AsanInstrumenterTest, FailsWithInvalidThreads) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("threads", "0");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanInstrumenterTest, FailsWithInvalidHotnessBudget) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("hotness-budget", "most");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(AsanInstrumenterTest, FailsWithInvalidHotnessProfile) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchPath("hotness-profile", dummy_filter_path_);
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_FALSE(instrumenter_.InstrumentImpl());
+}
+
+TEST_F(AsanInstrumenterTest, SelectHotBasicBlocks) {
+  typedef core::RelativeAddress RelativeAddress;
+  grinder::basic_block_util::IndexedFrequencyMap frequencies;
+  frequencies[std::make_pair(RelativeAddress(0x1000), 0)] = 60;
+  frequencies[std::make_pair(RelativeAddress(0x1010), 0)] = 30;
+  frequencies[std::make_pair(RelativeAddress(0x1020), 0)] = 9;
+  frequencies[std::make_pair(RelativeAddress(0x1030), 0)] = 1;
+  frequencies[std::make_pair(RelativeAddress(0x1040), 0)] = 0;
+  // Only the entry counts are taken into account.
+  frequencies[std::make_pair(RelativeAddress(0x1040), 1)] = 1000;
+
+  TestAsanInstrumenter::RelativeAddressSet hot_basic_blocks;
+  TestAsanInstrumenter::SelectHotBasicBlocks(frequencies, 0.0,
+                                             &hot_basic_blocks);
+  EXPECT_TRUE(hot_basic_blocks.empty());
+
+  TestAsanInstrumenter::SelectHotBasicBlocks(frequencies, 0.9,
+                                             &hot_basic_blocks);
+  EXPECT_EQ(2u, hot_basic_blocks.size());
+  EXPECT_EQ(1u, hot_basic_blocks.count(RelativeAddress(0x1000)));
+  EXPECT_EQ(1u, hot_basic_blocks.count(RelativeAddress(0x1010)));
+
+  TestAsanInstrumenter::SelectHotBasicBlocks(frequencies, 0.95,
+                                             &hot_basic_blocks);
+  EXPECT_EQ(3u, hot_basic_blocks.size());
+  EXPECT_EQ(1u, hot_basic_blocks.count(RelativeAddress(0x1020)));
+
+  TestAsanInstrumenter::SelectHotBasicBlocks(frequencies, 1.0,
+                                             &hot_basic_blocks);
+  EXPECT_EQ(4u, hot_basic_blocks.size());
+  EXPECT_EQ(0u, hot_basic_blocks.count(RelativeAddress(0x1040)));
+}
+
 TEST_F(AsanInstrumenterTest, FailsWithInvalidAsanRtlOptions) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
@@ -16,6 +16,7 @@
 
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/application/application.h"
 #include "syzygy/pe/image_filter.h"
 
@@ -26,7 +27,9 @@ const char BasicBlockEntryInstrumenter::kAgentDllBasicBlockEntry[] =
     "basic_block_entry_client.dll";
 
 BasicBlockEntryInstrumenter::BasicBlockEntryInstrumenter()
-    : inline_fast_path_(false) {
+    : inline_fast_path_(false),
+      buffering_(false),
+      counter_size_(sizeof(uint32)) {
   agent_dll_ = kAgentDllBasicBlockEntry;
 }
 
@@ -35,6 +38,8 @@ bool BasicBlockEntryInstrumenter::InstrumentImpl() {
       new instrument::transforms::BasicBlockEntryHookTransform());
   bbentry_transform_->set_instrument_dll_name(agent_dll_);
   bbentry_transform_->set_inline_fast_path(inline_fast_path_);
+  bbentry_transform_->set_buffering(buffering_);
+  bbentry_transform_->set_frequency_size(static_cast<uint8>(counter_size_));
   bbentry_transform_->set_src_ranges_for_thunks(debug_friendly_);
   if (!relinker_->AppendTransform(bbentry_transform_.get()))
     return false;
@@ -53,6 +58,20 @@ bool BasicBlockEntryInstrumenter::ParseAdditionalCommandLineArguments(
     const CommandLine* command_line) {
   // Parse the additional command line arguments.
   inline_fast_path_ = command_line->HasSwitch("inline-fast-path");
+  buffering_ = command_line->HasSwitch("buffering");
+
+  if (command_line->HasSwitch("counter-size")) {
+    std::string counter_size_str =
+        command_line->GetSwitchValueASCII("counter-size");
+    if (!base::StringToUint(counter_size_str, &counter_size_)) {
+      LOG(ERROR) << "Unrecognized counter size: not a valid number.";
+      return false;
+    }
+    if (counter_size_ != 1 && counter_size_ != 2 && counter_size_ != 4) {
+      LOG(ERROR) << "counter-size must be 1, 2 or 4.";
+      return false;
+    }
+  }
 
   return true;
 }
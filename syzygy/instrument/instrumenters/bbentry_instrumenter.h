@@ -48,6 +48,8 @@ class BasicBlockEntryInstrumenter : public InstrumenterWithAgent {
   // @name Command-line parameters.
   // @{
   bool inline_fast_path_;
+  bool buffering_;
+  uint32 counter_size_;
   // @}
 
   // The transform for this agent.
@@ -0,0 +1,91 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/instrument/instrumenters/chained_instrumenter.h"
+
+#include "base/logging.h"
+
+namespace instrument {
+namespace instrumenters {
+
+void ChainedInstrumenter::AppendInstrumenter(
+    InstrumenterWithAgent* instrumenter) {
+  DCHECK(instrumenter != NULL);
+  instrumenters_.push_back(instrumenter);
+}
+
+bool ChainedInstrumenter::ParseCommandLine(const CommandLine* command_line) {
+  DCHECK(command_line != NULL);
+
+  if (instrumenters_.empty()) {
+    LOG(ERROR) << "No instrumenter has been chained.";
+    return false;
+  }
+
+  // Each instrumenter imports from its own agent.
+  if (command_line->HasSwitch("agent")) {
+    LOG(ERROR) << "A custom agent can't be used with chained instrumenters.";
+    return false;
+  }
+
+  for (size_t i = 0; i < instrumenters_.size(); ++i) {
+    if (!instrumenters_[i]->ParseCommandLine(command_line))
+      return false;
+  }
+
+  // The shared relinker is configured with the common parameters, which all
+  // the instrumenters parsed identically.
+  const InstrumenterWithAgent* first = instrumenters_.front();
+  input_image_path_ = first->input_image_path_;
+  input_pdb_path_ = first->input_pdb_path_;
+  output_image_path_ = first->output_image_path_;
+  output_pdb_path_ = first->output_pdb_path_;
+  allow_overwrite_ = first->allow_overwrite_;
+  debug_friendly_ = first->debug_friendly_;
+  no_augment_pdb_ = first->no_augment_pdb_;
+  no_strip_strings_ = first->no_strip_strings_;
+
+  return true;
+}
+
+bool ChainedInstrumenter::ImageFormatIsSupported(ImageFormat image_format) {
+  for (size_t i = 0; i < instrumenters_.size(); ++i) {
+    if (!instrumenters_[i]->ImageFormatIsSupported(image_format))
+      return false;
+  }
+  return true;
+}
+
+bool ChainedInstrumenter::InstrumentImpl() {
+  DCHECK(relinker_ != NULL);
+
+  for (size_t i = 0; i < instrumenters_.size(); ++i) {
+    InstrumenterWithAgent* instrumenter = instrumenters_[i];
+
+    // Have the instrumenter set up the shared relinker rather than its own.
+    instrumenter->image_format_ = image_format_;
+    instrumenter->relinker_ = relinker_;
+    if (!instrumenter->InstrumentImpl()) {
+      LOG(ERROR) << "Failed to set up the "
+                 << instrumenter->InstrumentationMode() << " instrumentation.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace instrumenters
+}  // namespace instrument
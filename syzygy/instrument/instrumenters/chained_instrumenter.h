@@ -0,0 +1,64 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the chained instrumenter. This applies the instrumentation of
+// several instrumenters with a single decomposition and relink of the input
+// image: each instrumenter appends its transforms and PDB mutators to a shared
+// relinker, in the order in which the instrumenters were chained.
+#ifndef SYZYGY_INSTRUMENT_INSTRUMENTERS_CHAINED_INSTRUMENTER_H_
+#define SYZYGY_INSTRUMENT_INSTRUMENTERS_CHAINED_INSTRUMENTER_H_
+
+#include "base/command_line.h"
+#include "base/memory/scoped_vector.h"
+#include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
+
+namespace instrument {
+namespace instrumenters {
+
+class ChainedInstrumenter : public InstrumenterWithAgent {
+ public:
+  ChainedInstrumenter() { }
+
+  ~ChainedInstrumenter() { }
+
+  // Appends an instrumenter to the chain. Its transforms are applied after
+  // those of the instrumenters already in the chain.
+  // @param instrumenter the instrumenter to append. Ownership is transferred
+  //     to the chain.
+  void AppendInstrumenter(InstrumenterWithAgent* instrumenter);
+
+  // @name InstrumenterInterface implementation.
+  // @{
+  virtual bool ParseCommandLine(const CommandLine* command_line) OVERRIDE;
+  // @}
+
+ protected:
+  // @name InstrumenterWithAgent overrides.
+  // @{
+  virtual bool ImageFormatIsSupported(ImageFormat image_format) OVERRIDE;
+  virtual bool InstrumentImpl() OVERRIDE;
+  virtual const char* InstrumentationMode() OVERRIDE { return "chained"; }
+  // @}
+
+  // The chained instrumenters, in order.
+  ScopedVector<InstrumenterWithAgent> instrumenters_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ChainedInstrumenter);
+};
+
+}  // namespace instrumenters
+}  // namespace instrument
+
+#endif  // SYZYGY_INSTRUMENT_INSTRUMENTERS_CHAINED_INSTRUMENTER_H_
@@ -0,0 +1,187 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/instrument/instrumenters/chained_instrumenter.h"
+
+#include "base/command_line.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace instrument {
+namespace instrumenters {
+
+namespace {
+
+using testing::StrictMock;
+using testing::Return;
+
+class MockPERelinker : public pe::PERelinker {
+ public:
+  MockPERelinker() : pe::PERelinker(&policy_) {
+  }
+
+  MOCK_METHOD0(Init, bool());
+  MOCK_METHOD0(Relink, bool());
+
+ private:
+  pe::PETransformPolicy policy_;
+};
+
+// An instrumenter to be chained, which exposes the relinker it's given.
+class TestInstrumenter : public InstrumenterWithAgent {
+ public:
+  using InstrumenterWithAgent::input_image_path_;
+  using InstrumenterWithAgent::relinker_;
+
+  explicit TestInstrumenter(const char* agent_dll) {
+    agent_dll_ = agent_dll;
+  }
+
+  MOCK_METHOD0(InstrumentImpl, bool());
+
+  virtual const char* InstrumentationMode() OVERRIDE { return "test"; }
+};
+
+class TestChainedInstrumenter : public ChainedInstrumenter {
+ public:
+  using ChainedInstrumenter::input_image_path_;
+  using ChainedInstrumenter::output_image_path_;
+  using ChainedInstrumenter::allow_overwrite_;
+
+  pe::PERelinker* GetPERelinker() OVERRIDE {
+    return &mock_pe_relinker_;
+  }
+
+  StrictMock<MockPERelinker> mock_pe_relinker_;
+};
+
+class ChainedInstrumenterTest : public testing::PELibUnitTest {
+ public:
+  typedef testing::PELibUnitTest Super;
+
+  ChainedInstrumenterTest()
+      : cmd_line_(base::FilePath(L"instrument.exe")),
+        first_(NULL),
+        second_(NULL) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+
+    // Several of the tests generate progress and (deliberate) error messages
+    // that would otherwise clutter the unittest output.
+    logging::SetMinLogLevel(logging::LOG_FATAL);
+
+    CreateTemporaryDir(&temp_dir_);
+
+    abs_input_image_path_ = testing::GetExeRelativePath(testing::kTestDllName);
+    input_image_path_ = testing::GetRelativePath(abs_input_image_path_);
+    output_image_path_ = temp_dir_.Append(input_image_path_.BaseName());
+
+    first_ = new StrictMock<TestInstrumenter>("first.dll");
+    second_ = new StrictMock<TestInstrumenter>("second.dll");
+    instrumenter_.AppendInstrumenter(first_);
+    instrumenter_.AppendInstrumenter(second_);
+  }
+
+  void SetUpValidCommandLine() {
+    cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+    cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+    cmd_line_.AppendSwitch("overwrite");
+  }
+
+ protected:
+  // Stashes the current log-level before each test instance and restores it
+  // after each test completes.
+  testing::ScopedLogLevelSaver log_level_saver;
+
+  base::FilePath temp_dir_;
+
+  // @name Command-line and parameters.
+  // @{
+  CommandLine cmd_line_;
+  base::FilePath input_image_path_;
+  base::FilePath output_image_path_;
+  base::FilePath abs_input_image_path_;
+  // @}
+
+  // The chained instrumenter, and the instrumenters it owns.
+  TestChainedInstrumenter instrumenter_;
+  StrictMock<TestInstrumenter>* first_;
+  StrictMock<TestInstrumenter>* second_;
+};
+
+}  // namespace
+
+TEST_F(ChainedInstrumenterTest, EmptyChainFails) {
+  SetUpValidCommandLine();
+
+  TestChainedInstrumenter instrumenter;
+  EXPECT_FALSE(instrumenter.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ChainedInstrumenterTest, CustomAgentFails) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitchASCII("agent", "foo.dll");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ChainedInstrumenterTest, ParseCommandLine) {
+  SetUpValidCommandLine();
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(abs_input_image_path_, instrumenter_.input_image_path_);
+  EXPECT_EQ(output_image_path_, instrumenter_.output_image_path_);
+  EXPECT_TRUE(instrumenter_.allow_overwrite_);
+  EXPECT_EQ(abs_input_image_path_, first_->input_image_path_);
+  EXPECT_EQ(abs_input_image_path_, second_->input_image_path_);
+  EXPECT_EQ(std::string("first.dll"), first_->agent_dll());
+  EXPECT_EQ(std::string("second.dll"), second_->agent_dll());
+}
+
+TEST_F(ChainedInstrumenterTest, InstrumentRelinksOnce) {
+  SetUpValidCommandLine();
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+
+  testing::InSequence in_sequence;
+  EXPECT_CALL(instrumenter_.mock_pe_relinker_, Init()).WillOnce(Return(true));
+  EXPECT_CALL(*first_, InstrumentImpl()).WillOnce(Return(true));
+  EXPECT_CALL(*second_, InstrumentImpl()).WillOnce(Return(true));
+  EXPECT_CALL(instrumenter_.mock_pe_relinker_, Relink()).WillOnce(
+      Return(true));
+
+  EXPECT_TRUE(instrumenter_.Instrument());
+
+  // Both instrumenters set up the relinker of the chain.
+  EXPECT_EQ(&instrumenter_.mock_pe_relinker_, first_->relinker_);
+  EXPECT_EQ(&instrumenter_.mock_pe_relinker_, second_->relinker_);
+}
+
+TEST_F(ChainedInstrumenterTest, InstrumentFailsWhenALinkFails) {
+  SetUpValidCommandLine();
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_CALL(instrumenter_.mock_pe_relinker_, Init()).WillOnce(Return(true));
+  EXPECT_CALL(*first_, InstrumentImpl()).WillOnce(Return(false));
+
+  EXPECT_FALSE(instrumenter_.Instrument());
+}
+
+}  // namespace instrumenters
+}  // namespace instrument
@@ -24,7 +24,7 @@ namespace instrumenters {
 
 const char CoverageInstrumenter::kAgentDllCoverage[] = "coverage_client.dll";
 
-CoverageInstrumenter::CoverageInstrumenter() {
+CoverageInstrumenter::CoverageInstrumenter() : self_patching_(false) {
   agent_dll_ = kAgentDllCoverage;
 }
 
@@ -33,6 +33,7 @@ bool CoverageInstrumenter::InstrumentImpl() {
       new instrument::transforms::CoverageInstrumentationTransform());
   coverage_transform_->set_instrument_dll_name(agent_dll_);
   coverage_transform_->set_src_ranges_for_thunks(debug_friendly_);
+  coverage_transform_->set_self_patching(self_patching_);
   if (!relinker_->AppendTransform(coverage_transform_.get()))
     return false;
 
@@ -46,5 +47,13 @@ bool CoverageInstrumenter::InstrumentImpl() {
   return true;
 }
 
+bool CoverageInstrumenter::ParseAdditionalCommandLineArguments(
+    const CommandLine* command_line) {
+  // Parse the additional command line arguments.
+  self_patching_ = command_line->HasSwitch("self-patching");
+
+  return true;
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
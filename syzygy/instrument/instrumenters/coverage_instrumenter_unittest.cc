@@ -35,6 +35,7 @@ class TestCoverageInstrumenter : public CoverageInstrumenter {
   using CoverageInstrumenter::no_augment_pdb_;
   using CoverageInstrumenter::no_strip_strings_;
   using CoverageInstrumenter::debug_friendly_;
+  using CoverageInstrumenter::self_patching_;
   using CoverageInstrumenter::kAgentDllCoverage;
   using CoverageInstrumenter::InstrumentImpl;
   using InstrumenterWithAgent::CreateRelinker;
@@ -126,6 +127,7 @@ TEST_F(CoverageInstrumenterTest, ParseMinimalCoverage) {
   EXPECT_FALSE(instrumenter_.no_augment_pdb_);
   EXPECT_FALSE(instrumenter_.no_strip_strings_);
   EXPECT_FALSE(instrumenter_.debug_friendly_);
+  EXPECT_FALSE(instrumenter_.self_patching_);
 }
 
 TEST_F(CoverageInstrumenterTest, ParseFullCoverage) {
@@ -137,6 +139,7 @@ TEST_F(CoverageInstrumenterTest, ParseFullCoverage) {
   cmd_line_.AppendSwitch("no-strip-strings");
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("self-patching");
 
   EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
 
@@ -149,6 +152,7 @@ TEST_F(CoverageInstrumenterTest, ParseFullCoverage) {
   EXPECT_TRUE(instrumenter_.no_augment_pdb_);
   EXPECT_TRUE(instrumenter_.no_strip_strings_);
   EXPECT_TRUE(instrumenter_.debug_friendly_);
+  EXPECT_TRUE(instrumenter_.self_patching_);
 }
 
 TEST_F(CoverageInstrumenterTest, InstrumentImpl) {
@@ -159,5 +163,14 @@ TEST_F(CoverageInstrumenterTest, InstrumentImpl) {
   EXPECT_TRUE(instrumenter_.InstrumentImpl());
 }
 
+TEST_F(CoverageInstrumenterTest, InstrumentImplSelfPatching) {
+  SetUpValidCommandLine();
+  cmd_line_.AppendSwitch("self-patching");
+
+  EXPECT_TRUE(instrumenter_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_.CreateRelinker());
+  EXPECT_TRUE(instrumenter_.InstrumentImpl());
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
@@ -29,7 +29,8 @@ EntryThunkInstrumenter::EntryThunkInstrumenter(Mode instrumentation_mode)
     : instrumentation_mode_(instrumentation_mode),
       instrument_unsafe_references_(false),
       module_entry_only_(false),
-      thunk_imports_(false) {
+      thunk_imports_(false),
+      direct_thunks_(false) {
   DCHECK(instrumentation_mode != INVALID_MODE);
   switch (instrumentation_mode) {
     case CALL_TRACE:
@@ -56,6 +57,7 @@ bool EntryThunkInstrumenter::InstrumentImpl() {
       instrument_unsafe_references_);
   entry_thunk_transform_->set_src_ranges_for_thunks(debug_friendly_);
   entry_thunk_transform_->set_only_instrument_module_entry(module_entry_only_);
+  entry_thunk_transform_->set_direct_thunks(direct_thunks_);
   if (!relinker_->AppendTransform(entry_thunk_transform_.get()))
     return false;
 
@@ -79,6 +81,7 @@ bool EntryThunkInstrumenter::ParseAdditionalCommandLineArguments(
     instrument_unsafe_references_ = !command_line->HasSwitch("no-unsafe-refs");
   }
   thunk_imports_ = command_line->HasSwitch("instrument-imports");
+  direct_thunks_ = command_line->HasSwitch("direct-thunks");
 
   return true;
 }
@@ -61,6 +61,7 @@ class EntryThunkInstrumenter : public InstrumenterWithAgent {
   bool instrument_unsafe_references_;
   bool module_entry_only_;
   bool thunk_imports_;
+  bool direct_thunks_;
   // @}
 
   // The instrumentation mode.
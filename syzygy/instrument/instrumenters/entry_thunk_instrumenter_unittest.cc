@@ -37,6 +37,7 @@ class TestEntryThunkInstrumenter : public EntryThunkInstrumenter {
   using EntryThunkInstrumenter::instrument_unsafe_references_;
   using EntryThunkInstrumenter::module_entry_only_;
   using EntryThunkInstrumenter::thunk_imports_;
+  using EntryThunkInstrumenter::direct_thunks_;
   using EntryThunkInstrumenter::debug_friendly_;
   using EntryThunkInstrumenter::instrumentation_mode_;
   using EntryThunkInstrumenter::kAgentDllProfile;
@@ -136,6 +137,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseMinimalCallTrace) {
   EXPECT_FALSE(instrumenter_->no_strip_strings_);
   EXPECT_FALSE(instrumenter_->debug_friendly_);
   EXPECT_FALSE(instrumenter_->thunk_imports_);
+  EXPECT_FALSE(instrumenter_->direct_thunks_);
   EXPECT_TRUE(instrumenter_->instrument_unsafe_references_);
   EXPECT_FALSE(instrumenter_->module_entry_only_);
 }
@@ -153,6 +155,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("instrument-imports");
+  cmd_line_.AppendSwitch("direct-thunks");
   cmd_line_.AppendSwitch("module-entry-only");
   cmd_line_.AppendSwitch("no-unsafe-refs");
 
@@ -170,6 +173,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullCallTrace) {
   EXPECT_TRUE(instrumenter_->no_strip_strings_);
   EXPECT_TRUE(instrumenter_->debug_friendly_);
   EXPECT_TRUE(instrumenter_->thunk_imports_);
+  EXPECT_TRUE(instrumenter_->direct_thunks_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_TRUE(instrumenter_->module_entry_only_);
 }
@@ -194,6 +198,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseMinimalProfile) {
   EXPECT_FALSE(instrumenter_->no_strip_strings_);
   EXPECT_FALSE(instrumenter_->debug_friendly_);
   EXPECT_FALSE(instrumenter_->thunk_imports_);
+  EXPECT_FALSE(instrumenter_->direct_thunks_);
   EXPECT_FALSE(instrumenter_->instrument_unsafe_references_);
   EXPECT_FALSE(instrumenter_->module_entry_only_);
 }
@@ -210,6 +215,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullProfile) {
   cmd_line_.AppendSwitchPath("output-pdb", output_pdb_path_);
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("instrument-imports");
+  cmd_line_.AppendSwitch("direct-thunks");
 
   EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
 
@@ -225,6 +231,7 @@ TEST_F(EntryThunkInstrumenterTest, ParseFullProfile) {
   EXPECT_TRUE(instrumenter_->no_strip_strings_);
   EXPECT_TRUE(instrumenter_->debug_friendly_);
   EXPECT_TRUE(instrumenter_->thunk_imports_);
+  EXPECT_TRUE(instrumenter_->direct_thunks_);
 }
 
 TEST_F(EntryThunkInstrumenterTest, InstrumentImplCallTrace) {
@@ -247,5 +254,16 @@ TEST_F(EntryThunkInstrumenterTest, InstrumentImplProfile) {
   EXPECT_TRUE(instrumenter_->InstrumentImpl());
 }
 
+TEST_F(EntryThunkInstrumenterTest, InstrumentImplProfileDirectThunks) {
+  SetUpValidCommandLine();
+  instrumenter_.reset(
+      new TestEntryThunkInstrumenter(EntryThunkInstrumenter::PROFILE));
+  cmd_line_.AppendSwitch("direct-thunks");
+
+  EXPECT_TRUE(instrumenter_->ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(instrumenter_->CreateRelinker());
+  EXPECT_TRUE(instrumenter_->InstrumentImpl());
+}
+
 }  // namespace instrumenters
 }  // namespace instrument
@@ -120,6 +120,10 @@ class InstrumenterWithAgent : public InstrumenterInterface {
   pe::RelinkerInterface* relinker_;
 
  private:
+  // The chained instrumenter drives the instrumenters it chains with its own
+  // relinker.
+  friend class ChainedInstrumenter;
+
   // They are used as containers for holding policy and relinker objects that
   // are allocated by our default Get* implementations above.
   scoped_ptr<block_graph::TransformPolicyInterface> policy_object_;
@@ -16,6 +16,8 @@
 
 #include <algorithm>
 #include <list>
+#include <map>
+#include <set>
 #include <vector>
 
 #include "base/logging.h"
@@ -29,6 +31,8 @@
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/block_graph/typed_block.h"
+#include "syzygy/block_graph/analysis/control_flow_analysis.h"
+#include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
 #include "syzygy/pe/pe_utils.h"
@@ -53,8 +57,10 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
+using block_graph::Successor;
 using block_graph::TransformPolicyInterface;
 using block_graph::TypedBlock;
+using block_graph::analysis::ControlFlowAnalysis;
 using block_graph::analysis::LivenessAnalysis;
 using block_graph::analysis::MemoryAccessAnalysis;
 using assm::Register32;
@@ -71,6 +77,7 @@ typedef AsanBasicBlockTransform::MemoryAccessMode AsanMemoryAccessMode;
 typedef AsanBasicBlockTransform::AsanHookMap HookMap;
 typedef std::vector<AsanBasicBlockTransform::AsanHookMapEntryKey>
     AccessHookParamVector;
+typedef ControlFlowAnalysis::StructuralNode StructuralNode;
 typedef TypedBlock<IMAGE_IMPORT_DESCRIPTOR> ImageImportDescriptor;
 typedef TypedBlock<StringStruct> String;
 
@@ -304,6 +311,228 @@ void InjectAsanHook(BasicBlockAssembler* bb_asm,
   }
 }
 
+// Finds two registers, other than ESP and EBP, that are dead given the
+// liveness @p state.
+// @param state The liveness state at the point where the registers are needed.
+// @param first Will receive the first free register.
+// @param second Will receive the second free register.
+// @returns true if two free registers were found, false otherwise.
+bool FindFreeRegisters(const LivenessAnalysis::State& state,
+                       const Register32** first,
+                       const Register32** second) {
+  DCHECK_NE(reinterpret_cast<const Register32**>(NULL), first);
+  DCHECK_NE(reinterpret_cast<const Register32**>(NULL), second);
+
+  const Register32* candidates[] = {
+      &assm::eax, &assm::ecx, &assm::edx, &assm::ebx, &assm::esi, &assm::edi };
+
+  *first = NULL;
+  *second = NULL;
+  for (size_t i = 0; i < arraysize(candidates); ++i) {
+    if (state.IsLive(*candidates[i]))
+      continue;
+    if (*first == NULL) {
+      *first = candidates[i];
+    } else {
+      *second = candidates[i];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Gets the child nodes of a node of a structural tree.
+// @param node The node whose children to get.
+// @param children Receives the child nodes.
+void GetChildNodes(const StructuralNode* node,
+                   std::vector<const StructuralNode*>* children) {
+  DCHECK_NE(reinterpret_cast<const StructuralNode*>(NULL), node);
+  DCHECK_NE(reinterpret_cast<std::vector<const StructuralNode*>*>(NULL),
+            children);
+
+  switch (node->kind()) {
+    case StructuralNode::kSequenceNode:
+      children->push_back(node->entry_node());
+      children->push_back(node->sequence_node());
+      break;
+    case StructuralNode::kIfThenNode:
+      children->push_back(node->entry_node());
+      children->push_back(node->then_node());
+      break;
+    case StructuralNode::kIfThenElseNode:
+      children->push_back(node->entry_node());
+      children->push_back(node->then_node());
+      children->push_back(node->else_node());
+      break;
+    case StructuralNode::kRepeatNode:
+    case StructuralNode::kLoopNode:
+      children->push_back(node->entry_node());
+      break;
+    case StructuralNode::kWhileNode:
+      children->push_back(node->entry_node());
+      children->push_back(node->body_node());
+      break;
+    default:
+      break;
+  }
+}
+
+// Gets the basic blocks of the region represented by a node of a structural
+// tree.
+// @param node The root of the region.
+// @param basic_blocks Receives the basic blocks of the region.
+void GetRegionBasicBlocks(const StructuralNode* node,
+                          std::set<const BasicBlock*>* basic_blocks) {
+  DCHECK_NE(reinterpret_cast<const StructuralNode*>(NULL), node);
+  DCHECK_NE(reinterpret_cast<std::set<const BasicBlock*>*>(NULL),
+            basic_blocks);
+
+  std::vector<const StructuralNode*> worklist(1, node);
+  while (!worklist.empty()) {
+    const StructuralNode* current = worklist.back();
+    worklist.pop_back();
+    if (current->kind() == StructuralNode::kBaseNode)
+      basic_blocks->insert(current->root());
+    else
+      GetChildNodes(current, &worklist);
+  }
+}
+
+// @returns true iff @p id is a register that is defined by @p defs.
+bool IsDefined(const LivenessAnalysis::State& defs, assm::RegisterId id) {
+  if (id == assm::kRegisterNone)
+    return false;
+  return defs.IsLive(assm::Register::Get(id));
+}
+
+// @returns true iff the range accessed through the memory operand @p operand
+//     can be expressed relative to its registers. Operands referring to a
+//     block can't be offset, and the stack pointer moves too often to be worth
+//     tracking.
+bool IsRangeCheckableOperand(const BasicBlockAssembler::Operand& operand) {
+  if (operand.displacement().reference().IsValid())
+    return false;
+  return operand.base() != assm::kRegisterEsp &&
+      operand.index() != assm::kRegisterEsp;
+}
+
+// Computes the range of memory accessed by an instrumentable access. The
+// operand of the access refers to its last byte.
+// @param operand The memory operand of the access.
+// @param info The memory access information.
+// @param start Receives the offset of the first accessed byte relative to the
+//     registers of @p operand.
+// @param end Receives the offset past the last accessed byte.
+void GetAccessRange(const BasicBlockAssembler::Operand& operand,
+                    const AsanBasicBlockTransform::MemoryAccessInfo& info,
+                    int32* start,
+                    int32* end) {
+  DCHECK_NE(reinterpret_cast<int32*>(NULL), start);
+  DCHECK_NE(reinterpret_cast<int32*>(NULL), end);
+  int32 last = static_cast<int32>(operand.displacement().value());
+  *start = last - info.size + 1;
+  *end = last + 1;
+}
+
+// @returns the size of the stack frame allocated by the prologue of
+//     @p subgraph, i.e. the immediate of the first SUB ESP, imm of its entry
+//     basic block, or 0 if there's none.
+size_t GetPrologueStackFrameSize(const BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  BasicBlockSubGraph::BBCollection::const_iterator bb_it =
+      subgraph->basic_blocks().begin();
+  for (; bb_it != subgraph->basic_blocks().end(); ++bb_it) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL || bb->offset() != 0)
+      continue;
+
+    BasicBlock::Instructions::const_iterator inst_it =
+        bb->instructions().begin();
+    for (; inst_it != bb->instructions().end(); ++inst_it) {
+      const _DInst& repr = inst_it->representation();
+      if (repr.opcode != I_SUB || repr.ops[0].type != O_REG ||
+          repr.ops[0].index != R_ESP || repr.ops[1].type != O_IMM) {
+        continue;
+      }
+      int32 size = repr.ops[1].size == 8 ? repr.imm.sbyte : repr.imm.sdword;
+      return size > 0 ? size : 0;
+    }
+  }
+  return 0;
+}
+
+// @returns true iff the access through @p operand is relative to ESP and
+//     falls within the @p stack_frame_size bytes above it. ESP always points
+//     to the stack, so such an access can't touch the heap.
+bool IsStackFrameAccess(const BasicBlockAssembler::Operand& operand,
+                        const AsanBasicBlockTransform::MemoryAccessInfo& info,
+                        size_t stack_frame_size) {
+  if (operand.base() != assm::kRegisterEsp ||
+      operand.index() != assm::kRegisterNone ||
+      operand.displacement().reference().IsValid()) {
+    return false;
+  }
+  int32 start = 0;
+  int32 end = 0;
+  GetAccessRange(operand, info, &start, &end);
+  return start >= 0 && end <= static_cast<int32>(stack_frame_size);
+}
+
+// Builds the operand referring to the byte at @p offset from the registers of
+// @p operand.
+BasicBlockAssembler::Operand OffsetOperand(
+    const BasicBlockAssembler::Operand& operand, int32 offset) {
+  return BasicBlockAssembler::Operand(operand.base(),
+                                      operand.index(),
+                                      operand.scale(),
+                                      Displacement(static_cast<uint32>(offset),
+                                                   assm::kSize32Bit));
+}
+
+// @returns the range check mode corresponding to a read/write access mode.
+AsanMemoryAccessMode GetRangeAccessMode(AsanMemoryAccessMode mode) {
+  DCHECK(mode == AsanBasicBlockTransform::kReadAccess ||
+         mode == AsanBasicBlockTransform::kWriteAccess);
+  if (mode == AsanBasicBlockTransform::kWriteAccess)
+    return AsanBasicBlockTransform::kRangeWriteAccess;
+  return AsanBasicBlockTransform::kRangeReadAccess;
+}
+
+// A group of adjacent accesses through the same registers, with no definition
+// of these registers in between.
+struct AccessGroup {
+  // The register operand shared by the accesses, and the accessed range
+  // relative to its registers.
+  BasicBlockAssembler::Operand operand;
+  int32 start;
+  int32 end;
+  // Either kRangeReadAccess or kRangeWriteAccess.
+  AsanMemoryAccessMode mode;
+  // The accesses, in instruction order.
+  std::vector<const Instruction*> accesses;
+};
+
+// @returns true iff an access through @p operand uses the same registers as
+//     the accesses in @p group.
+bool HasSameRegisters(const AccessGroup& group,
+                      const BasicBlockAssembler::Operand& operand) {
+  return group.operand.base() == operand.base() &&
+      group.operand.index() == operand.index() &&
+      group.operand.scale() == operand.scale();
+}
+
+void AddSuccessorBetween(Successor::Condition condition,
+                         BasicCodeBlock* from,
+                         BasicCodeBlock* to) {
+  from->successors().push_back(
+      Successor(condition,
+                BasicBlockReference(BlockGraph::RELATIVE_REF,
+                                    BlockGraph::Reference::kMaximumSize,
+                                    to),
+                0));
+}
+
 // Get the name of an asan check access function for an @p access_mode access.
 // @param info The memory access information, e.g. the size on a load/store,
 //     the instruction opcode and the kind of access.
@@ -311,6 +540,21 @@ std::string GetAsanCheckAccessFunctionName(
     AsanBasicBlockTransform::MemoryAccessInfo info,
     BlockGraph::ImageFormat image_format) {
   DCHECK(info.mode != AsanBasicBlockTransform::kNoAccess);
+
+  // For COFF images we use the decorated function name, which contains a
+  // leading underscore.
+  const char* decoration = image_format == BlockGraph::PE_IMAGE ? "" : "_";
+
+  // The range checks take their size as a parameter.
+  if (info.mode == AsanBasicBlockTransform::kRangeReadAccess ||
+      info.mode == AsanBasicBlockTransform::kRangeWriteAccess) {
+    return base::StringPrintf(
+        "%sasan_check_range_%s_access",
+        decoration,
+        info.mode == AsanBasicBlockTransform::kRangeReadAccess ?
+            "read" : "write");
+  }
+
   DCHECK_NE(0U, info.size);
   DCHECK(info.mode == AsanBasicBlockTransform::kReadAccess ||
          info.mode == AsanBasicBlockTransform::kWriteAccess ||
@@ -332,11 +576,9 @@ std::string GetAsanCheckAccessFunctionName(
   else
     access_mode_str = reinterpret_cast<char*>(GET_MNEMONIC_NAME(info.opcode));
 
-  // For COFF images we use the decorated function name, which contains a
-  // leading underscore.
   std::string function_name =
       base::StringPrintf("%sasan_check%s_%d_byte_%s_access%s",
-                         image_format == BlockGraph::PE_IMAGE ? "" : "_",
+                         decoration,
                          rep_str,
                          info.size,
                          access_mode_str,
@@ -466,9 +708,9 @@ bool AddAsanCheckAccessHooks(
   return true;
 }
 
-// Create a stub for the asan_check_access functions. For load/store, the stub
-// consists of a small block of code that restores the value of EDX and returns
-// to the caller. Otherwise, the stub do return.
+// Create a stub for the asan_check_access functions. For load/store and range
+// checks, the stub consists of a small block of code that restores the value
+// of EDX and returns to the caller. Otherwise, the stub do return.
 // @param block_graph The block-graph to populate with the stub.
 // @param stub_name The stub's name.
 // @param mode The kind of memory access.
@@ -512,6 +754,11 @@ bool CreateHooksStub(BlockGraph* block_graph,
     // return.
     assm.mov(assm::edx, Operand(assm::esp, Displacement(4)));
     assm.ret(4);
+  } else if (mode == AsanBasicBlockTransform::kRangeReadAccess ||
+             mode == AsanBasicBlockTransform::kRangeWriteAccess) {
+    // The range checks also receive the size of the range on the stack.
+    assm.mov(assm::edx, Operand(assm::esp, Displacement(4)));
+    assm.ret(8);
   } else {
     assm.ret();
   }
@@ -894,7 +1141,8 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     BlockGraph::ImageFormat image_format) {
   DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), basic_block);
 
-  if (instrumentation_rate_ == 0.0)
+  double instrumentation_rate = GetInstrumentationRate(basic_block);
+  if (instrumentation_rate == 0.0)
     return true;
 
   // Pre-compute liveness information for each instruction.
@@ -929,13 +1177,7 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   for (; iter_inst != basic_block->instructions().end(); ++iter_inst) {
     auto operand(Operand(assm::eax));
     const Instruction& instr = *iter_inst;
-    const _DInst& repr = instr.representation();
-
     MemoryAccessInfo info;
-    info.mode = kNoAccess;
-    info.size = 0;
-    info.opcode = 0;
-    info.save_flags = true;
 
     // Get current instruction liveness information.
     if (use_liveness_analysis_) {
@@ -943,6 +1185,24 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
       ++iter_state;
     }
 
+    // Inject the range check that replaces the checks of this access and of
+    // the ones it was coalesced with.
+    RangeCheckMap::const_iterator range_check = range_checks_.find(&instr);
+    if (range_check != range_checks_.end()) {
+      BasicBlockAssembler bb_asm(iter_inst, &basic_block->instructions());
+      if (debug_friendly_)
+        bb_asm.set_source_range(instr.source_range());
+      if (!InjectRangeCheck(&bb_asm, range_check->second, image_format))
+        return false;
+    }
+
+    // Accesses covered by a range check are not instrumented on their own.
+    if (covered_accesses_.find(&instr) != covered_accesses_.end()) {
+      if (remove_redundant_checks_)
+        memory_accesses_.PropagateForward(instr, &memory_state);
+      continue;
+    }
+
     // When activated, skip redundant memory access check.
     if (remove_redundant_checks_) {
       bool need_memory_access_check = false;
@@ -957,58 +1217,12 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
     }
 
     // Insert hook for a standard instruction.
-    if (!DecodeMemoryAccess(instr, &operand, &info))
-      continue;
-
-    // Bail if this is not a memory access.
-    if (info.mode == kNoAccess)
-      continue;
-
-    // A basic block reference means that can be either a computed jump,
-    // or a load from a case table. In either case it doesn't make sense
-    // to instrument the access.
-    if (operand.displacement().reference().referred_type() ==
-        BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
-      continue;
-    }
-
-    // A block reference means this instruction is reading or writing to
-    // a global variable or some such. It's viable to pad and align global
-    // variables and to red-zone the padding, but without that, there's nothing
-    // to gain by instrumenting these accesses.
-    if (operand.displacement().reference().referred_type() ==
-        BasicBlockReference::REFERRED_TYPE_BLOCK) {
-      continue;
-    }
-
-    // Is this an instruction we should be instrumenting.
-    if (!ShouldInstrumentOpcode(repr.opcode))
-      continue;
-
-    // If there are no unconventional manipulations of the stack frame, we can
-    // skip instrumenting stack-based memory access (based on ESP or EBP).
-    // Conventionally, accesses through ESP/EBP are always on stack.
-    if (stack_mode == kSafeStackAccess &&
-        (operand.base() == assm::kRegisterEsp ||
-         operand.base() == assm::kRegisterEbp)) {
-      continue;
-    }
-
-    // We do not instrument memory accesses through special segments.
-    // FS is used for thread local specifics and GS for CPU info.
-    uint8_t segment = SEGMENT_GET(repr.segment);
-    if (segment == R_FS || segment == R_GS)
-      continue;
-
-    // Don't instrument any filtered instructions.
-    if (IsFiltered(*iter_inst))
+    if (!IsInstrumentableAccess(instr, stack_mode, &operand, &info))
       continue;
 
     // Randomly sample to effect partial instrumentation.
-    if (instrumentation_rate_ < 1.0 &&
-        base::RandDouble() >= instrumentation_rate_) {
+    if (SkipCheck(instrumentation_rate))
       continue;
-    }
 
     // Create a BasicBlockAssembler to insert new instruction.
     BasicBlockAssembler bb_asm(iter_inst, &basic_block->instructions());
@@ -1039,6 +1253,19 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
         return false;
       }
 
+      // Defer the accesses that can be checked inline, as this requires
+      // splitting the basic block.
+      FastPathCheck check = { basic_block, iter_inst, operand, hook->second,
+                              NULL, NULL };
+      if (inline_fast_path_ && use_liveness_analysis_ && !info.save_flags &&
+          shadow_memory_reference_.referenced() != NULL &&
+          (info.mode == kReadAccess || info.mode == kWriteAccess) &&
+          FindFreeRegisters(state, &check.shadow_register,
+                            &check.address_register)) {
+        fast_path_checks_.push_back(check);
+        continue;
+      }
+
       // Instrument this instruction.
       InjectAsanHook(
           &bb_asm, info, operand, &hook->second, state, image_format);
@@ -1051,12 +1278,478 @@ bool AsanBasicBlockTransform::InstrumentBasicBlock(
   return true;
 }
 
+bool AsanBasicBlockTransform::IsInstrumentableAccess(
+    const Instruction& instr,
+    StackAccessMode stack_mode,
+    BasicBlockAssembler::Operand* operand,
+    MemoryAccessInfo* info) {
+  DCHECK_NE(reinterpret_cast<BasicBlockAssembler::Operand*>(NULL), operand);
+  DCHECK_NE(reinterpret_cast<MemoryAccessInfo*>(NULL), info);
+  const _DInst& repr = instr.representation();
+
+  info->mode = kNoAccess;
+  info->size = 0;
+  info->opcode = 0;
+  info->save_flags = true;
+
+  if (!DecodeMemoryAccess(instr, operand, info))
+    return false;
+
+  // Bail if this is not a memory access.
+  if (info->mode == kNoAccess)
+    return false;
+
+  // A basic block reference means that can be either a computed jump,
+  // or a load from a case table. In either case it doesn't make sense
+  // to instrument the access.
+  if (operand->displacement().reference().referred_type() ==
+      BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
+    return false;
+  }
+
+  // A block reference means this instruction is reading or writing to
+  // a global variable or some such. It's viable to pad and align global
+  // variables and to red-zone the padding, but without that, there's nothing
+  // to gain by instrumenting these accesses.
+  if (operand->displacement().reference().referred_type() ==
+      BasicBlockReference::REFERRED_TYPE_BLOCK) {
+    return false;
+  }
+
+  // Is this an instruction we should be instrumenting.
+  if (!ShouldInstrumentOpcode(repr.opcode))
+    return false;
+
+  // If there are no unconventional manipulations of the stack frame, we can
+  // skip instrumenting stack-based memory access (based on ESP or EBP).
+  // Conventionally, accesses through ESP/EBP are always on stack.
+  if (stack_mode == kSafeStackAccess &&
+      (operand->base() == assm::kRegisterEsp ||
+       operand->base() == assm::kRegisterEbp)) {
+    return false;
+  }
+
+  // Otherwise EBP can't be trusted, but the ESP-relative accesses within the
+  // frame allocated by the prologue are still known to hit the stack.
+  if (stack_mode == kUnsafeStackAccess &&
+      IsStackFrameAccess(*operand, *info, stack_frame_size_)) {
+    return false;
+  }
+
+  // We do not instrument memory accesses through special segments.
+  // FS is used for thread local specifics and GS for CPU info.
+  uint8_t segment = SEGMENT_GET(repr.segment);
+  if (segment == R_FS || segment == R_GS)
+    return false;
+
+  // Don't instrument any filtered instructions.
+  if (IsFiltered(instr))
+    return false;
+
+  return true;
+}
+
+void AsanBasicBlockTransform::PlanRangeChecks(BasicBlockSubGraph* subgraph,
+                                              StackAccessMode stack_mode) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  range_checks_.clear();
+  hoisted_range_checks_.clear();
+  covered_accesses_.clear();
+
+  // The hoisted accesses are left out of the coalesced ranges.
+  HoistLoopInvariantChecks(subgraph, stack_mode);
+
+  BasicBlockSubGraph::BBCollection::const_iterator it =
+      subgraph->basic_blocks().begin();
+  for (; it != subgraph->basic_blocks().end(); ++it) {
+    const BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+    if (bb != NULL)
+      CoalesceAccesses(bb, stack_mode);
+  }
+
+  if (!range_checks_.empty() || !hoisted_range_checks_.empty())
+    instrumentation_happened_ = true;
+}
+
+void AsanBasicBlockTransform::HoistLoopInvariantChecks(
+    BasicBlockSubGraph* subgraph,
+    StackAccessMode stack_mode) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  // Loops can only be found in a reducible control flow graph.
+  ControlFlowAnalysis::StructuralTree tree;
+  if (!ControlFlowAnalysis::BuildStructuralTree(subgraph, &tree))
+    return;
+
+  // Find the predecessors of each basic block.
+  typedef std::map<const BasicBlock*, std::vector<BasicCodeBlock*> >
+      PredecessorMap;
+  PredecessorMap predecessors;
+  BasicBlockSubGraph::BBCollection::iterator bb_it =
+      subgraph->basic_blocks().begin();
+  for (; bb_it != subgraph->basic_blocks().end(); ++bb_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+    if (bb == NULL)
+      continue;
+    BasicBlock::Successors::const_iterator succ = bb->successors().begin();
+    for (; succ != bb->successors().end(); ++succ) {
+      if (succ->reference().basic_block() != NULL)
+        predecessors[succ->reference().basic_block()].push_back(bb);
+    }
+  }
+
+  std::vector<const StructuralNode*> worklist(1, tree.get());
+  while (!worklist.empty()) {
+    const StructuralNode* node = worklist.back();
+    worklist.pop_back();
+    GetChildNodes(node, &worklist);
+
+    if (node->kind() != StructuralNode::kRepeatNode &&
+        node->kind() != StructuralNode::kWhileNode &&
+        node->kind() != StructuralNode::kLoopNode) {
+      continue;
+    }
+
+    // The loop header is executed on each iteration, and is only entered from
+    // outside of the loop through its preheader, which must flow straight
+    // into it.
+    const BasicCodeBlock* header = node->root();
+    std::set<const BasicBlock*> loop;
+    GetRegionBasicBlocks(node, &loop);
+    BasicCodeBlock* preheader = NULL;
+    const std::vector<BasicCodeBlock*>& header_predecessors =
+        predecessors[header];
+    bool unique_preheader = true;
+    for (size_t i = 0; i < header_predecessors.size(); ++i) {
+      if (loop.find(header_predecessors[i]) != loop.end())
+        continue;
+      if (preheader != NULL)
+        unique_preheader = false;
+      preheader = header_predecessors[i];
+    }
+    if (preheader == NULL || !unique_preheader ||
+        preheader->successors().size() != 1) {
+      continue;
+    }
+
+    // Find the registers defined in the loop. A call may free the memory, so
+    // loops containing calls are left alone.
+    std::set<assm::RegisterId> defined_registers;
+    bool hoistable = true;
+    std::set<const BasicBlock*>::const_iterator loop_it = loop.begin();
+    for (; hoistable && loop_it != loop.end(); ++loop_it) {
+      const BasicCodeBlock* bb = BasicCodeBlock::Cast(*loop_it);
+      DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), bb);
+      BasicBlock::Instructions::const_iterator instr =
+          bb->instructions().begin();
+      for (; instr != bb->instructions().end(); ++instr) {
+        LivenessAnalysis::State defs;
+        if (instr->IsCall() ||
+            !LivenessAnalysis::StateHelper::GetDefsOf(*instr, &defs)) {
+          hoistable = false;
+          break;
+        }
+        for (size_t i = 0; i < assm::kRegister32Count; ++i) {
+          if (defs.IsLive(assm::kRegisters32[i]))
+            defined_registers.insert(assm::kRegisters32[i].id());
+        }
+      }
+    }
+    if (!hoistable)
+      continue;
+
+    // Hoist the checks of the loop invariant accesses of the header.
+    BasicBlock::Instructions::const_iterator instr =
+        header->instructions().begin();
+    for (; instr != header->instructions().end(); ++instr) {
+      BasicBlockAssembler::Operand operand(assm::eax);
+      MemoryAccessInfo info;
+      if (!IsInstrumentableAccess(*instr, stack_mode, &operand, &info) ||
+          (info.mode != kReadAccess && info.mode != kWriteAccess) ||
+          !IsRangeCheckableOperand(operand) ||
+          defined_registers.count(operand.base()) != 0 ||
+          defined_registers.count(operand.index()) != 0) {
+        continue;
+      }
+
+      // Sample the hoisted checks like the checks they replace.
+      if (SkipCheck(GetInstrumentationRate(header)))
+        continue;
+
+      int32 start = 0;
+      int32 end = 0;
+      GetAccessRange(operand, info, &start, &end);
+      RangeCheck range_check = { OffsetOperand(operand, start),
+                                 static_cast<size_t>(end - start),
+                                 GetRangeAccessMode(info.mode) };
+      hoisted_range_checks_.push_back(std::make_pair(preheader, range_check));
+      covered_accesses_.insert(&*instr);
+    }
+  }
+}
+
+void AsanBasicBlockTransform::CoalesceAccesses(
+    const BasicCodeBlock* basic_block,
+    StackAccessMode stack_mode) {
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), basic_block);
+
+  std::vector<AccessGroup> groups;
+  std::vector<AccessGroup> closed_groups;
+  BasicBlock::Instructions::const_iterator instr =
+      basic_block->instructions().begin();
+  for (; instr != basic_block->instructions().end(); ++instr) {
+    BasicBlockAssembler::Operand operand(assm::eax);
+    MemoryAccessInfo info;
+    if (covered_accesses_.find(&*instr) == covered_accesses_.end() &&
+        IsInstrumentableAccess(*instr, stack_mode, &operand, &info) &&
+        (info.mode == kReadAccess || info.mode == kWriteAccess) &&
+        IsRangeCheckableOperand(operand)) {
+      int32 start = 0;
+      int32 end = 0;
+      GetAccessRange(operand, info, &start, &end);
+
+      // Extend the group of accesses through the same registers if this access
+      // overlaps or touches its range, otherwise start a new group.
+      std::vector<AccessGroup>::iterator group = groups.begin();
+      for (; group != groups.end(); ++group) {
+        if (HasSameRegisters(*group, operand))
+          break;
+      }
+      if (group != groups.end()) {
+        int32 new_start = std::min(start, group->start);
+        int32 new_end = std::max(end, group->end);
+        if (start <= group->end && end >= group->start &&
+            static_cast<size_t>(new_end - new_start) <=
+                kMaxCoalescedRangeSize) {
+          group->start = new_start;
+          group->end = new_end;
+          if (info.mode == kWriteAccess)
+            group->mode = kRangeWriteAccess;
+          group->accesses.push_back(&*instr);
+        } else {
+          closed_groups.push_back(*group);
+          groups.erase(group);
+          group = groups.end();
+        }
+      }
+      if (group == groups.end()) {
+        AccessGroup new_group = { operand, start, end,
+                                  GetRangeAccessMode(info.mode) };
+        new_group.accesses.push_back(&*instr);
+        groups.push_back(new_group);
+      }
+    }
+
+    // A call may free the memory, and an instruction with unknown effects may
+    // change any register, so they end all the groups. Otherwise only the
+    // groups whose registers are defined by this instruction end.
+    LivenessAnalysis::State defs;
+    if (instr->IsCall() ||
+        !LivenessAnalysis::StateHelper::GetDefsOf(*instr, &defs)) {
+      closed_groups.insert(closed_groups.end(), groups.begin(), groups.end());
+      groups.clear();
+      continue;
+    }
+    for (size_t i = 0; i < groups.size(); ) {
+      if (IsDefined(defs, groups[i].operand.base()) ||
+          IsDefined(defs, groups[i].operand.index())) {
+        closed_groups.push_back(groups[i]);
+        groups.erase(groups.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+  }
+  closed_groups.insert(closed_groups.end(), groups.begin(), groups.end());
+
+  // Replace the checks of the groups of several accesses by a range check
+  // before their first access.
+  for (size_t i = 0; i < closed_groups.size(); ++i) {
+    const AccessGroup& group = closed_groups[i];
+    if (group.accesses.size() < 2)
+      continue;
+
+    // Sample the range checks like the checks they replace.
+    if (SkipCheck(GetInstrumentationRate(basic_block)))
+      continue;
+
+    RangeCheck range_check = { OffsetOperand(group.operand, group.start),
+                               static_cast<size_t>(group.end - group.start),
+                               group.mode };
+    range_checks_.insert(std::make_pair(group.accesses.front(), range_check));
+    covered_accesses_.insert(group.accesses.begin(), group.accesses.end());
+  }
+}
+
+bool AsanBasicBlockTransform::InjectRangeCheck(
+    BasicBlockAssembler* bb_asm,
+    const RangeCheck& range_check,
+    BlockGraph::ImageFormat image_format) {
+  DCHECK_NE(reinterpret_cast<BasicBlockAssembler*>(NULL), bb_asm);
+  DCHECK(range_check.mode == kRangeReadAccess ||
+         range_check.mode == kRangeWriteAccess);
+
+  if (dry_run_)
+    return true;
+
+  MemoryAccessInfo info = { range_check.mode, 0, 0, true };
+  AsanHookMap::iterator hook = check_access_hooks_->find(info);
+  if (hook == check_access_hooks_->end()) {
+    LOG(ERROR) << "Invalid access : "
+               << GetAsanCheckAccessFunctionName(info, image_format);
+    return false;
+  }
+
+  // The range check hooks receive the size of the range and the original
+  // value of EDX on the stack, and the start of the range in EDX.
+  bb_asm->push(Immediate(range_check.size, assm::kSize32Bit));
+  bb_asm->push(assm::edx);
+  bb_asm->lea(assm::edx, range_check.operand);
+  if (image_format == BlockGraph::PE_IMAGE) {
+    bb_asm->call(Operand(Displacement(hook->second.referenced(),
+                                      hook->second.offset())));
+  } else {
+    DCHECK_EQ(BlockGraph::COFF_IMAGE, image_format);
+    bb_asm->call(Immediate(hook->second.referenced(), hook->second.offset()));
+  }
+
+  return true;
+}
+
+void AsanBasicBlockTransform::InjectFastPathChecks(
+    BasicBlockSubGraph* subgraph,
+    BlockGraph::ImageFormat image_format) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  BlockGraph::Block* shadow_block = shadow_memory_reference_.referenced();
+  BlockGraph::Offset shadow_offset = shadow_memory_reference_.offset();
+
+  // The checks are in instruction order, so the access of a check is in the
+  // basic block continuing the previous check of the same original block.
+  BasicCodeBlock* original_bb = NULL;
+  BasicCodeBlock* bb = NULL;
+  for (size_t i = 0; i < fast_path_checks_.size(); ++i) {
+    const FastPathCheck& check = fast_path_checks_[i];
+    if (check.basic_block != original_bb) {
+      original_bb = check.basic_block;
+      bb = original_bb;
+    }
+
+    // Find where the basic block is laid out.
+    BasicBlockSubGraph::BasicBlockOrdering* order = NULL;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator position;
+    BasicBlockSubGraph::BlockDescriptionList::iterator desc_it =
+        subgraph->block_descriptions().begin();
+    for (; desc_it != subgraph->block_descriptions().end(); ++desc_it) {
+      position = std::find(desc_it->basic_block_order.begin(),
+                           desc_it->basic_block_order.end(),
+                           bb);
+      if (position != desc_it->basic_block_order.end()) {
+        order = &desc_it->basic_block_order;
+        break;
+      }
+    }
+    DCHECK_NE(reinterpret_cast<BasicBlockSubGraph::BasicBlockOrdering*>(NULL),
+              order);
+
+    // The access and the rest of the basic block move to a continuation, which
+    // inherits the successors.
+    BasicCodeBlock* cont_bb = subgraph->AddBasicCodeBlock(bb->name());
+    cont_bb->instructions().splice(cont_bb->instructions().end(),
+                                   bb->instructions(),
+                                   check.instruction,
+                                   bb->instructions().end());
+    cont_bb->successors().swap(bb->successors());
+
+    // The slow path calls the hook, and is laid out at the end of the block so
+    // that the fast path falls through.
+    BasicCodeBlock* slow_bb = subgraph->AddBasicCodeBlock(
+        "asan_check_slow_path");
+    BasicBlockAssembler slow_asm(slow_bb->instructions().end(),
+                                 &slow_bb->instructions());
+    if (debug_friendly_)
+      slow_asm.set_source_range(check.instruction->source_range());
+    slow_asm.push(assm::edx);
+    slow_asm.lea(assm::edx, check.operand);
+    if (image_format == BlockGraph::PE_IMAGE) {
+      slow_asm.call(Operand(Displacement(check.hook.referenced(),
+                                         check.hook.offset())));
+    } else {
+      DCHECK_EQ(BlockGraph::COFF_IMAGE, image_format);
+      slow_asm.call(Immediate(check.hook.referenced(), check.hook.offset()));
+    }
+    AddSuccessorBetween(Successor::kConditionTrue, slow_bb, cont_bb);
+
+    // Load the address of the shadow memory.
+    const Register32& shadow = *check.shadow_register;
+    const Register32& address = *check.address_register;
+    BasicBlockAssembler load_asm(bb->instructions().end(),
+                                 &bb->instructions());
+    if (debug_friendly_)
+      load_asm.set_source_range(check.instruction->source_range());
+    load_asm.mov(shadow, Operand(Displacement(shadow_block, shadow_offset)));
+    load_asm.mov(shadow, Operand(shadow));
+
+    ++position;
+    BasicCodeBlock* check_bb = bb;
+    if (image_format == BlockGraph::PE_IMAGE) {
+      // The import of the shadow memory points to a null address until the
+      // RTL is bound, and the hooks are stubbed until then as well.
+      load_asm.test(shadow, shadow);
+      check_bb = subgraph->AddBasicCodeBlock("asan_check_fast_path");
+      AddSuccessorBetween(Successor::kConditionEqual, bb, slow_bb);
+      AddSuccessorBetween(Successor::kConditionNotEqual, bb, check_bb);
+      order->insert(position, check_bb);
+    }
+
+    // Test the shadow byte of the accessed address.
+    BasicBlockAssembler check_asm(check_bb->instructions().end(),
+                                  &check_bb->instructions());
+    if (debug_friendly_)
+      check_asm.set_source_range(check.instruction->source_range());
+    check_asm.lea(address, check.operand);
+    check_asm.shr(address, Immediate(3));
+    check_asm.movzx_b(address, Operand(shadow, address, assm::kTimes1));
+    check_asm.test(address, address);
+    AddSuccessorBetween(Successor::kConditionNotEqual, check_bb, slow_bb);
+    AddSuccessorBetween(Successor::kConditionEqual, check_bb, cont_bb);
+
+    order->insert(position, cont_bb);
+    order->push_back(slow_bb);
+
+    bb = cont_bb;
+  }
+
+  fast_path_checks_.clear();
+}
+
 void AsanBasicBlockTransform::set_instrumentation_rate(
     double instrumentation_rate) {
   // Set the instrumentation rate, capping it between 0 and 1.
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+void AsanBasicBlockTransform::set_hot_instrumentation_rate(
+    double hot_instrumentation_rate) {
+  // Set the hot instrumentation rate, capping it between 0 and 1.
+  hot_instrumentation_rate_ =
+      std::max(0.0, std::min(1.0, hot_instrumentation_rate));
+}
+
+double AsanBasicBlockTransform::GetInstrumentationRate(
+    const BasicBlock* basic_block) const {
+  if (hot_subgraph_basic_blocks_.find(basic_block) !=
+          hot_subgraph_basic_blocks_.end()) {
+    return hot_instrumentation_rate_;
+  }
+  return instrumentation_rate_;
+}
+
+bool AsanBasicBlockTransform::SkipCheck(double rate) {
+  return rate < 1.0 && base::RandDouble() >= rate;
+}
+
 bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1078,6 +1771,34 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
   StackAccessMode stack_mode = kUnsafeStackAccess;
   if (!block_graph::HasUnexpectedStackFrameManipulation(subgraph))
     stack_mode = kSafeStackAccess;
+  stack_frame_size_ = 0;
+  if (stack_mode == kUnsafeStackAccess)
+    stack_frame_size_ = GetPrologueStackFrameSize(subgraph);
+
+  // Find the hot basic blocks of this subgraph, using their original address.
+  hot_subgraph_basic_blocks_.clear();
+  if (hot_basic_blocks_ != NULL && subgraph->original_block() != NULL) {
+    core::RelativeAddress block_addr = subgraph->original_block()->addr();
+    BasicBlockSubGraph::BBCollection::const_iterator bb_it =
+        subgraph->basic_blocks().begin();
+    for (; bb_it != subgraph->basic_blocks().end(); ++bb_it) {
+      const BasicBlock* bb = *bb_it;
+      if (bb->offset() == BasicBlock::kNoOffset)
+        continue;
+      if (hot_basic_blocks_->find(block_addr + bb->offset()) !=
+              hot_basic_blocks_->end()) {
+        hot_subgraph_basic_blocks_.insert(bb);
+      }
+    }
+  }
+
+  // Find the accesses that can be checked by coalesced or hoisted range
+  // checks.
+  range_checks_.clear();
+  hoisted_range_checks_.clear();
+  covered_accesses_.clear();
+  if (use_range_checks_ && !dry_run_)
+    PlanRangeChecks(subgraph, stack_mode);
 
   // Iterates through each basic block and instruments it.
   BasicBlockSubGraph::BBCollection::iterator it =
@@ -1089,6 +1810,26 @@ bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
       return false;
     }
   }
+
+  // The hoisted checks go at the very end of the loop preheaders.
+  for (size_t i = 0; i < hoisted_range_checks_.size(); ++i) {
+    BasicCodeBlock* preheader = hoisted_range_checks_[i].first;
+    BasicBlockAssembler bb_asm(preheader->instructions().end(),
+                               &preheader->instructions());
+    if (!InjectRangeCheck(&bb_asm, hoisted_range_checks_[i].second,
+                          block_graph->image_format())) {
+      return false;
+    }
+  }
+  range_checks_.clear();
+  hoisted_range_checks_.clear();
+  covered_accesses_.clear();
+  hot_subgraph_basic_blocks_.clear();
+
+  // The basic blocks created by the fast path checks are not instrumented, so
+  // they are only injected once all the basic blocks have been visited.
+  InjectFastPathChecks(subgraph, block_graph->image_format());
+
   return true;
 }
 
@@ -1098,16 +1839,23 @@ const char AsanTransform::kAsanHookStubName[] = "asan_hook_stub";
 
 const char AsanTransform::kSyzyAsanDll[] = "syzyasan_rtl.dll";
 
+const char AsanTransform::kAsanShadowMemoryName[] = "asan_shadow_memory";
+
 AsanTransform::AsanTransform()
     : asan_dll_name_(kSyzyAsanDll),
       debug_friendly_(false),
       use_liveness_analysis_(false),
       remove_redundant_checks_(false),
       use_interceptors_(false),
+      inline_fast_path_(false),
+      use_range_checks_(false),
       instrumentation_rate_(1.0),
+      hot_basic_blocks_(NULL),
+      hot_instrumentation_rate_(1.0),
       asan_parameters_(NULL),
       check_access_hooks_ref_(),
-      asan_parameters_block_(NULL) {
+      asan_parameters_block_(NULL),
+      num_threads_(1) {
 }
 
 void AsanTransform::set_instrumentation_rate(double instrumentation_rate) {
@@ -1115,6 +1863,13 @@ void AsanTransform::set_instrumentation_rate(double instrumentation_rate) {
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+void AsanTransform::set_hot_instrumentation_rate(
+    double hot_instrumentation_rate) {
+  // Set the hot instrumentation rate, capping it between 0 and 1.
+  hot_instrumentation_rate_ =
+      std::max(0.0, std::min(1.0, hot_instrumentation_rate));
+}
+
 bool AsanTransform::PreBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1131,6 +1886,20 @@ bool AsanTransform::PreBlockGraphIteration(
     return false;
   }
 
+  if (filter() != NULL && filter_bitmap() == NULL) {
+    filter_index_.reset(new block_graph::RelativeAddressFilterBitmap(
+        *filter()));
+    set_filter_bitmap(filter_index_.get());
+  }
+
+  // Check all the blocks against the filter up front, as the same answer is
+  // needed for each of them.
+  if (filter() != NULL && filtered_blocks() == NULL) {
+    filtered_blocks_.reset(new block_graph::FilteredBlockSet(
+        *filter_bitmap(), *block_graph));
+    set_filtered_blocks(filtered_blocks_.get());
+  }
+
   AccessHookParamVector access_hook_param_vec;
   AsanBasicBlockTransform::AsanDefaultHookMap default_stub_map;
 
@@ -1153,12 +1922,22 @@ bool AsanTransform::PreBlockGraphIteration(
       return false;
     }
 
+    // Create the hook stub for the range checks.
+    BlockGraph::Reference range_hook;
+    if (!CreateHooksStub(block_graph, kAsanHookStubName,
+                         AsanBasicBlockTransform::kRangeReadAccess,
+                         &range_hook)) {
+      return false;
+    }
+
     // Map each memory access kind to an appropriate stub.
     default_stub_map[AsanBasicBlockTransform::kReadAccess] = read_write_hook;
     default_stub_map[AsanBasicBlockTransform::kWriteAccess] = read_write_hook;
     default_stub_map[AsanBasicBlockTransform::kInstrAccess] = instr_hook;
     default_stub_map[AsanBasicBlockTransform::kRepzAccess] = instr_hook;
     default_stub_map[AsanBasicBlockTransform::kRepnzAccess] = instr_hook;
+    default_stub_map[AsanBasicBlockTransform::kRangeReadAccess] = range_hook;
+    default_stub_map[AsanBasicBlockTransform::kRangeWriteAccess] = range_hook;
   }
 
   // Add an import entry for the Asan runtime.
@@ -1224,6 +2003,28 @@ bool AsanTransform::PreBlockGraphIteration(
     }
   }
 
+  // Import the hooks for the coalesced and hoisted range checks.
+  if (use_range_checks_) {
+    MemoryAccessInfo range_read_info =
+        { AsanBasicBlockTransform::kRangeReadAccess, 0, 0, true };
+    access_hook_param_vec.push_back(range_read_info);
+    MemoryAccessInfo range_write_info =
+        { AsanBasicBlockTransform::kRangeWriteAccess, 0, 0, true };
+    access_hook_param_vec.push_back(range_write_info);
+  }
+
+  // Import the address of the shadow memory for the inlined checks. This is
+  // a data import, so in COFF images we refer to its import pointer.
+  size_t shadow_memory_idx = 0;
+  bool import_shadow_memory = inline_fast_path_ && use_liveness_analysis_;
+  if (import_shadow_memory) {
+    std::string shadow_memory_name(kAsanShadowMemoryName);
+    if (block_graph->image_format() == BlockGraph::COFF_IMAGE)
+      shadow_memory_name.insert(0, "__imp__");
+    shadow_memory_idx = import_module.AddSymbol(shadow_memory_name,
+                                                ImportedModule::kAlwaysImport);
+  }
+
   if (!AddAsanCheckAccessHooks(access_hook_param_vec,
                                default_stub_map,
                                &import_module,
@@ -1233,9 +2034,109 @@ bool AsanTransform::PreBlockGraphIteration(
                                header_block)) {
     return false;
   }
+
+  if (import_shadow_memory) {
+    if (!import_module.GetSymbolReference(shadow_memory_idx,
+                                          &shadow_memory_ref_)) {
+      LOG(ERROR) << "Unable to get import reference for "
+                 << kAsanShadowMemoryName << ".";
+      return false;
+    }
+
+    // Like the hooks, the import is used before the RTL is bound in a Chrome
+    // sandboxed process. Until then it points to a null shadow memory address,
+    // which sends the inlined checks to the hook stubs.
+    if (block_graph->image_format() == BlockGraph::PE_IMAGE) {
+      BlockGraph::Section* rdata_section = block_graph->FindOrAddSection(
+          pe::kReadOnlyDataSectionName, pe::kReadOnlyDataCharacteristics);
+      if (rdata_section == NULL) {
+        LOG(ERROR) << "Unable to find or create .rdata section.";
+        return false;
+      }
+
+      BlockGraph::Block* stub = block_graph->AddBlock(
+          BlockGraph::DATA_BLOCK, sizeof(uint32), "asan_shadow_memory_stub");
+      DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), stub);
+      stub->AllocateData(sizeof(uint32));
+      stub->set_section(rdata_section->id());
+
+      shadow_memory_ref_.referenced()->SetReference(
+          shadow_memory_ref_.offset(),
+          BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, sizeof(uint32),
+                                stub, 0, 0));
+    }
+  }
+
   return true;
 }
 
+class AsanTransform::ParallelBasicBlockTransform
+    : public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
+          ParallelBasicBlockTransform> {
+ public:
+  explicit ParallelBasicBlockTransform(AsanTransform* asan_transform)
+      : asan_transform_(asan_transform) {
+    DCHECK_NE(reinterpret_cast<AsanTransform*>(NULL), asan_transform);
+  }
+
+  // @name BasicBlockSubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* subgraph) OVERRIDE {
+    DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+    DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL),
+              subgraph->original_block());
+
+    // The basic-block transform keeps per-subgraph state, so each subgraph
+    // gets its own. The hooks are only looked up, never inserted.
+    AsanBasicBlockTransform transform(
+        &asan_transform_->check_access_hooks_ref_);
+    asan_transform_->ConfigureBasicBlockTransform(subgraph->original_block(),
+                                                  &transform);
+    return transform.TransformBasicBlockSubGraph(policy, block_graph,
+                                                 subgraph);
+  }
+  // @}
+
+  // The transform name.
+  static const char kTransformName[];
+
+ private:
+  AsanTransform* asan_transform_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelBasicBlockTransform);
+};
+
+const char AsanTransform::ParallelBasicBlockTransform::kTransformName[] =
+    "ParallelAsanBasicBlockTransform";
+
+void AsanTransform::ConfigureBasicBlockTransform(
+    const BlockGraph::Block* block,
+    AsanBasicBlockTransform* transform) const {
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  DCHECK_NE(reinterpret_cast<AsanBasicBlockTransform*>(NULL), transform);
+
+  transform->set_debug_friendly(debug_friendly());
+  transform->set_use_liveness_analysis(use_liveness_analysis());
+  transform->set_remove_redundant_checks(remove_redundant_checks());
+  transform->set_inline_fast_path(inline_fast_path());
+  transform->set_shadow_memory_reference(shadow_memory_ref_);
+  transform->set_use_range_checks(use_range_checks());
+  transform->set_instrumentation_rate(instrumentation_rate_);
+  transform->set_hot_basic_blocks(hot_basic_blocks_);
+  transform->set_hot_instrumentation_rate(hot_instrumentation_rate_);
+
+  // Use the filter that was passed to us for our child transform. None of the
+  // instructions of a block that isn't filtered can be, so the filter is only
+  // needed for the filtered blocks.
+  if (IsFiltered(block)) {
+    transform->set_filter(filter());
+    transform->set_filter_bitmap(filter_bitmap());
+  }
+}
+
 bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
                             BlockGraph* block_graph,
                             BlockGraph::Block* block) {
@@ -1246,13 +2147,13 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   if (!policy->BlockIsSafeToBasicBlockDecompose(block))
     return true;
 
-  // Use the filter that was passed to us for our child transform.
+  if (num_threads_ > 1) {
+    blocks_to_instrument_.push_back(block);
+    return true;
+  }
+
   AsanBasicBlockTransform transform(&check_access_hooks_ref_);
-  transform.set_debug_friendly(debug_friendly());
-  transform.set_use_liveness_analysis(use_liveness_analysis());
-  transform.set_remove_redundant_checks(remove_redundant_checks());
-  transform.set_filter(filter());
-  transform.set_instrumentation_rate(instrumentation_rate_);
+  ConfigureBasicBlockTransform(block, &transform);
 
   if (!ApplyBasicBlockSubGraphTransform(
           &transform, policy, block_graph, block, NULL)) {
@@ -1270,6 +2171,17 @@ bool AsanTransform::PostBlockGraphIteration(
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
 
+  // Instrument the blocks gathered by OnBlock before anything else, just as
+  // they would have been had they been instrumented one at a time.
+  if (!blocks_to_instrument_.empty()) {
+    ParallelBasicBlockTransform transform(this);
+    bool instrumented = ApplyBasicBlockSubGraphTransformInParallel(
+        &transform, policy, block_graph, blocks_to_instrument_, num_threads_);
+    blocks_to_instrument_.clear();
+    if (!instrumented)
+      return false;
+  }
+
   if (block_graph->image_format() == BlockGraph::PE_IMAGE) {
     if (!PeInterceptFunctions(kAsanIntercepts, policy, block_graph,
                               header_block)) {
@@ -1399,7 +2311,7 @@ bool AsanTransform::PeInjectAsanParameters(
   params_block->CopyData(fparams.data().size(), fparams.data().data());
 
   // Wire up any references that are required.
-  COMPILE_ASSERT(8 == common::kAsanParametersVersion,
+  COMPILE_ASSERT(18 == common::kAsanParametersVersion,
                  pointers_in_the_params_must_be_linked_up_here);
   block_graph::TypedBlock<common::AsanParameters> params;
   CHECK(params.Init(0, params_block));
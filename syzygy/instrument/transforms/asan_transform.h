@@ -21,8 +21,11 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string_piece.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/iterate.h"
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
@@ -30,6 +33,7 @@
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 #include "syzygy/common/asan_parameters.h"
+#include "syzygy/core/address.h"
 #include "syzygy/instrument/transforms/asan_interceptor_filter.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
 
@@ -50,6 +54,9 @@ class AsanBasicBlockTransform
     kInstrAccess,
     kRepzAccess,
     kRepnzAccess,
+    // Checks of a range of memory, covering one or more read/write accesses.
+    kRangeReadAccess,
+    kRangeWriteAccess,
   };
 
   enum StackAccessMode {
@@ -73,19 +80,26 @@ class AsanBasicBlockTransform
   // Map of hooks to Asan check access functions.
   typedef std::map<AsanHookMapEntryKey, BlockGraph::Reference> AsanHookMap;
   typedef std::map<MemoryAccessMode, BlockGraph::Reference> AsanDefaultHookMap;
+  // The addresses of basic blocks in the original image.
+  typedef std::set<core::RelativeAddress> RelativeAddressSet;
 
   // Constructor.
   // @param check_access_hooks References to the various check access functions.
   //     The hooks are assumed to be direct references for COFF images, and
   //     indirect references for PE images.
   explicit AsanBasicBlockTransform(AsanHookMap* check_access_hooks) :
+      stack_frame_size_(0),
       check_access_hooks_(check_access_hooks),
       debug_friendly_(false),
       dry_run_(false),
+      hot_basic_blocks_(NULL),
+      hot_instrumentation_rate_(1.0),
+      inline_fast_path_(false),
       instrumentation_happened_(false),
       instrumentation_rate_(1.0),
       remove_redundant_checks_(false),
-      use_liveness_analysis_(false) {
+      use_liveness_analysis_(false),
+      use_range_checks_(false) {
     DCHECK(check_access_hooks != NULL);
   }
 
@@ -104,10 +118,50 @@ class AsanBasicBlockTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  // When the fast path is inlined, the read and write accesses for which the
+  // liveness analysis finds two free registers and dead flags are checked
+  // directly against the shadow memory, and the hook is only called when the
+  // shadow byte is non-zero. This requires a shadow memory reference.
+  bool inline_fast_path() const { return inline_fast_path_; }
+  void set_inline_fast_path(bool inline_fast_path) {
+    inline_fast_path_ = inline_fast_path;
+  }
+
+  // When range checks are used, the accesses of a basic block through the same
+  // registers are coalesced into a single check of the range they cover, and
+  // the checks of loop invariant accesses are hoisted out of the loops.
+  bool use_range_checks() const { return use_range_checks_; }
+  void set_use_range_checks(bool use_range_checks) {
+    use_range_checks_ = use_range_checks;
+  }
+
+  // The reference to the import of the shadow memory address. This is an
+  // indirect reference, for both PE and COFF images.
+  const BlockGraph::Reference& shadow_memory_reference() const {
+    return shadow_memory_reference_;
+  }
+  void set_shadow_memory_reference(const BlockGraph::Reference& reference) {
+    shadow_memory_reference_ = reference;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The hot basic blocks are instrumented at the hot instrumentation rate
+  // rather than at the instrumentation rate. They are identified by their
+  // address in the original image, so this only applies to PE images.
+  const RelativeAddressSet* hot_basic_blocks() const {
+    return hot_basic_blocks_;
+  }
+  void set_hot_basic_blocks(const RelativeAddressSet* hot_basic_blocks) {
+    hot_basic_blocks_ = hot_basic_blocks;
+  }
+
+  // The hot instrumentation rate must be in the range [0, 1], inclusive.
+  double hot_instrumentation_rate() const { return hot_instrumentation_rate_; }
+  void set_hot_instrumentation_rate(double hot_instrumentation_rate);
+
   // Instead of instrumenting the basic blocks, in dry run mode the instrumenter
   // only signals if any instrumentation would have happened on the block.
   // @returns true iff the instrumenter is in dry run mode.
@@ -127,6 +181,9 @@ class AsanBasicBlockTransform
   // The transform name.
   static const char kTransformName[];
 
+  // The largest range that adjacent accesses are coalesced into.
+  static const size_t kMaxCoalescedRangeSize = 64;
+
  protected:
   // @name BasicBlockSubGraphTransformInterface method.
   virtual bool TransformBasicBlockSubGraph(
@@ -148,6 +205,114 @@ class AsanBasicBlockTransform
                             StackAccessMode stack_mode,
                             BlockGraph::ImageFormat image_format);
 
+  // @returns the rate at which the accesses of @p basic_block are
+  //     instrumented.
+  double GetInstrumentationRate(
+      const block_graph::BasicBlock* basic_block) const;
+
+  // @returns true iff a check at the instrumentation rate @p rate should be
+  //     skipped, using random sampling.
+  static bool SkipCheck(double rate);
+
+  // The basic blocks of the current subgraph that are hot.
+  std::set<const block_graph::BasicBlock*> hot_subgraph_basic_blocks_;
+
+  // The size of the stack frame allocated by the prologue of the current
+  // subgraph, or 0 if it's unknown. The ESP-relative accesses that fall within
+  // it are not instrumented, even when EBP can't be trusted.
+  size_t stack_frame_size_;
+
+  // Decodes the memory access of an instruction, and determines whether it
+  // should be instrumented. This doesn't take the redundant checks or the
+  // instrumentation rate into account.
+  // @param instr The instruction to inspect.
+  // @param stack_mode The assumptions on the stack frame manipulations.
+  // @param operand Receives the checked memory operand.
+  // @param info Receives the memory access information.
+  // @returns true iff the access of @p instr should be instrumented.
+  bool IsInstrumentableAccess(
+      const block_graph::Instruction& instr,
+      StackAccessMode stack_mode,
+      block_graph::BasicBlockAssembler::Operand* operand,
+      MemoryAccessInfo* info);
+
+  // Describes a check of a memory range.
+  struct RangeCheck {
+    // The first byte of the range.
+    block_graph::BasicBlockAssembler::Operand operand;
+    // The size of the range, in bytes.
+    size_t size;
+    // Either kRangeReadAccess or kRangeWriteAccess.
+    MemoryAccessMode mode;
+  };
+
+  // Plans the range checks of a subgraph, which replace the checks of the
+  // accesses they cover.
+  // @param subgraph The subgraph to analyze.
+  // @param stack_mode The assumptions on the stack frame manipulations.
+  void PlanRangeChecks(BasicBlockSubGraph* subgraph,
+                       StackAccessMode stack_mode);
+
+  // Plans range checks in the preheaders of the loops of a subgraph for the
+  // loop invariant accesses of their headers.
+  // @param subgraph The subgraph to analyze.
+  // @param stack_mode The assumptions on the stack frame manipulations.
+  void HoistLoopInvariantChecks(BasicBlockSubGraph* subgraph,
+                                StackAccessMode stack_mode);
+
+  // Plans range checks for the adjacent accesses of a basic block.
+  // @param basic_block The basic block to analyze.
+  // @param stack_mode The assumptions on the stack frame manipulations.
+  void CoalesceAccesses(const block_graph::BasicCodeBlock* basic_block,
+                        StackAccessMode stack_mode);
+
+  // Injects a call to a range check hook.
+  // @param bb_asm The assembler to use.
+  // @param range_check The range to check.
+  // @param image_format The format of the image being instrumented.
+  // @returns true on success, false otherwise.
+  bool InjectRangeCheck(block_graph::BasicBlockAssembler* bb_asm,
+                        const RangeCheck& range_check,
+                        BlockGraph::ImageFormat image_format);
+
+  // The range checks to inject before an instruction.
+  typedef std::map<const block_graph::Instruction*, RangeCheck> RangeCheckMap;
+  RangeCheckMap range_checks_;
+
+  // The range checks to inject at the end of a loop preheader.
+  typedef std::vector<std::pair<block_graph::BasicCodeBlock*, RangeCheck> >
+      HoistedRangeChecks;
+  HoistedRangeChecks hoisted_range_checks_;
+
+  // The accesses whose checks are replaced by range checks.
+  std::set<const block_graph::Instruction*> covered_accesses_;
+
+  // Describes an access that should be checked by an inlined fast path.
+  struct FastPathCheck {
+    // The basic block containing the access.
+    block_graph::BasicCodeBlock* basic_block;
+    // The instrumented instruction, in @p basic_block.
+    block_graph::BasicBlock::Instructions::iterator instruction;
+    // The accessed memory operand.
+    block_graph::BasicBlockAssembler::Operand operand;
+    // The hook to call when the shadow byte is non-zero.
+    BlockGraph::Reference hook;
+    // Registers that are free at the instrumented instruction.
+    const assm::Register32* shadow_register;
+    const assm::Register32* address_register;
+  };
+
+  // Injects the fast path checks gathered by InstrumentBasicBlock. Each check
+  // splits the basic block containing the access, as the slow path needs a
+  // branch.
+  // @param subgraph The subgraph containing the instrumented basic blocks.
+  // @param image_format The format of the image being instrumented.
+  void InjectFastPathChecks(BasicBlockSubGraph* subgraph,
+                            BlockGraph::ImageFormat image_format);
+
+  // The fast path checks that remain to be injected.
+  std::vector<FastPathCheck> fast_path_checks_;
+
  private:
   // Liveness analysis and liveness information for this subgraph.
   block_graph::analysis::LivenessAnalysis liveness_;
@@ -165,6 +330,17 @@ class AsanBasicBlockTransform
   // signal whether there would be an instrumenation in the block.
   bool dry_run_;
 
+  // The hot basic blocks, if any, and the rate at which they are
+  // instrumented.
+  const RelativeAddressSet* hot_basic_blocks_;
+  double hot_instrumentation_rate_;
+
+  // Set iff the fast path of the access checks should be inlined.
+  bool inline_fast_path_;
+
+  // The reference to the shadow memory address import.
+  BlockGraph::Reference shadow_memory_reference_;
+
   // Controls the rate at which reads/writes are instrumented. This is
   // implemented using random sampling.
   double instrumentation_rate_;
@@ -180,6 +356,9 @@ class AsanBasicBlockTransform
   // Set iff we should use the liveness analysis to do smarter instrumentation.
   bool use_liveness_analysis_;
 
+  // Set iff accesses should be checked by coalesced and hoisted range checks.
+  bool use_range_checks_;
+
   DISALLOW_COPY_AND_ASSIGN(AsanBasicBlockTransform);
 };
 
@@ -235,10 +414,35 @@ class AsanTransform
     remove_redundant_checks_ = remove_redundant_checks;
   }
 
+  bool use_range_checks() const { return use_range_checks_; }
+  void set_use_range_checks(bool use_range_checks) {
+    use_range_checks_ = use_range_checks;
+  }
+
+  // The fast path is only inlined when the liveness analysis is used.
+  bool inline_fast_path() const { return inline_fast_path_; }
+  void set_inline_fast_path(bool inline_fast_path) {
+    inline_fast_path_ = inline_fast_path;
+  }
+
   // The instrumentation rate must be in the range [0, 1], inclusive.
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The hot basic blocks are instrumented at the hot instrumentation rate.
+  // @note @p hot_basic_blocks must outlive this transform.
+  const AsanBasicBlockTransform::RelativeAddressSet* hot_basic_blocks() const {
+    return hot_basic_blocks_;
+  }
+  void set_hot_basic_blocks(
+      const AsanBasicBlockTransform::RelativeAddressSet* hot_basic_blocks) {
+    hot_basic_blocks_ = hot_basic_blocks;
+  }
+
+  // The hot instrumentation rate must be in the range [0, 1], inclusive.
+  double hot_instrumentation_rate() const { return hot_instrumentation_rate_; }
+  void set_hot_instrumentation_rate(double hot_instrumentation_rate);
+
   // Asan RTL parameters.
   const common::InflatedAsanParameters* asan_parameters() const {
     return asan_parameters_;
@@ -247,6 +451,17 @@ class AsanTransform
       const common::InflatedAsanParameters* asan_parameters) {
     asan_parameters_ = asan_parameters;
   }
+
+  // The number of worker threads the code blocks are instrumented on. When
+  // this is more than one, OnBlock only gathers the blocks, which are then
+  // instrumented in parallel at the start of PostBlockGraphIteration. The
+  // result doesn't depend on the number of threads, except for the random
+  // sampling of a partial instrumentation rate.
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0U, num_threads);
+    num_threads_ = num_threads;
+  }
   // @}
 
   // The name of the DLL that is imported by default.
@@ -258,6 +473,9 @@ class AsanTransform
   // The hooks stub name.
   static const char kAsanHookStubName[];
 
+  // The name of the shadow memory address exported by the RTL.
+  static const char kAsanShadowMemoryName[];
+
  protected:
   // @name PE-specific methods.
   // @{
@@ -286,6 +504,10 @@ class AsanTransform
                               BlockGraph::Block* header_block);
   // @}
 
+  // Configures @p transform to instrument @p block.
+  void ConfigureBasicBlockTransform(const BlockGraph::Block* block,
+                                    AsanBasicBlockTransform* transform) const;
+
   // Name of the asan_rtl DLL we import. Defaults to "syzyasan_rtl.dll".
   std::string asan_dll_name_;
 
@@ -302,10 +524,21 @@ class AsanTransform
   // Set iff we should use the functions interceptors.
   bool use_interceptors_;
 
+  // Set iff the fast path of the access checks should be inlined.
+  bool inline_fast_path_;
+
+  // Set iff accesses should be checked by coalesced and hoisted range checks.
+  bool use_range_checks_;
+
   // Controls the rate at which reads/writes are instrumented. This is
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // The hot basic blocks, if any, and the rate at which they are
+  // instrumented.
+  const AsanBasicBlockTransform::RelativeAddressSet* hot_basic_blocks_;
+  double hot_instrumentation_rate_;
+
   // Asan RTL parameters that will be injected into the instrumented image.
   // These will be found by the RTL and used to control its behaviour. Allows
   // for setting parameters at instrumentation time that vary from the defaults.
@@ -317,11 +550,34 @@ class AsanTransform
   // successful PreBlockGraphIteration.
   AsanBasicBlockTransform::AsanHookMap check_access_hooks_ref_;
 
+  // Reference to the import of the shadow memory address. Valid after a
+  // successful PreBlockGraphIteration if the fast path is inlined.
+  BlockGraph::Reference shadow_memory_ref_;
+
+  // An index of the filter, built by PreBlockGraphIteration. The basic-block
+  // transforms check every instruction against the filter, so this makes
+  // each of those checks constant time.
+  scoped_ptr<block_graph::RelativeAddressFilterBitmap> filter_index_;
+
+  // The blocks matched by the filter, built by PreBlockGraphIteration unless
+  // one was provided.
+  scoped_ptr<block_graph::FilteredBlockSet> filtered_blocks_;
+
   // Block containing any injected runtime parameters. Valid in PE mode after
   // a successful PostBlockGraphIteration. This is a unittesting seam.
   block_graph::BlockGraph::Block* asan_parameters_block_;
 
+  // The number of worker threads, and the blocks gathered by OnBlock to be
+  // instrumented on them.
+  size_t num_threads_;
+  block_graph::BlockVector blocks_to_instrument_;
+
  private:
+  // Instruments each subgraph with its own AsanBasicBlockTransform, so that
+  // several subgraphs can be instrumented at once. Defined in the
+  // implementation file.
+  class ParallelBasicBlockTransform;
+
   DISALLOW_COPY_AND_ASSIGN(AsanTransform);
 };
 
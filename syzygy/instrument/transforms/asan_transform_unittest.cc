@@ -65,6 +65,8 @@ typedef AsanBasicBlockTransform::AsanHookMapEntryKey HookMapEntryKey;
 class TestAsanBasicBlockTransform : public AsanBasicBlockTransform {
  public:
   using AsanBasicBlockTransform::InstrumentBasicBlock;
+  using AsanBasicBlockTransform::TransformBasicBlockSubGraph;
+  using AsanBasicBlockTransform::stack_frame_size_;
 
   explicit TestAsanBasicBlockTransform(AsanHookMap* hooks_check_access)
       : AsanBasicBlockTransform(hooks_check_access) {
@@ -81,6 +83,7 @@ class TestAsanTransform : public AsanTransform {
   using AsanTransform::use_interceptors_;
   using AsanTransform::use_liveness_analysis_;
   using AsanTransform::asan_parameters_block_;
+  using AsanTransform::shadow_memory_ref_;
   using AsanTransform::CoffInterceptFunctions;
   using AsanTransform::PeInterceptFunctions;
   using AsanTransform::PeInjectAsanParameters;
@@ -196,6 +199,12 @@ class AsanTransformTest : public testing::TestDllTransformTest {
                    opcode, true);
       }
     }
+
+    // Initialize the range check hooks.
+    AddHookRef("asan_check_range_read_access",
+               AsanBasicBlockTransform::kRangeReadAccess, 0, 0, true);
+    AddHookRef("asan_check_range_write_access",
+               AsanBasicBlockTransform::kRangeWriteAccess, 0, 0, true);
   }
 
   bool AddInstructionFromBuffer(const uint8* data, size_t length) {
@@ -278,6 +287,25 @@ TEST_F(AsanTransformTest, SetInstrumentationRate) {
   EXPECT_EQ(0.5, bb_transform.instrumentation_rate());
 }
 
+TEST_F(AsanTransformTest, SetHotInstrumentationRate) {
+  EXPECT_EQ(1.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_hot_instrumentation_rate(1.2);
+  EXPECT_EQ(1.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_hot_instrumentation_rate(-0.2);
+  EXPECT_EQ(0.0, asan_transform_.hot_instrumentation_rate());
+  asan_transform_.set_hot_instrumentation_rate(0.5);
+  EXPECT_EQ(0.5, asan_transform_.hot_instrumentation_rate());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_EQ(1.0, bb_transform.hot_instrumentation_rate());
+  bb_transform.set_hot_instrumentation_rate(1.2);
+  EXPECT_EQ(1.0, bb_transform.hot_instrumentation_rate());
+  bb_transform.set_hot_instrumentation_rate(-0.2);
+  EXPECT_EQ(0.0, bb_transform.hot_instrumentation_rate());
+  bb_transform.set_hot_instrumentation_rate(0.5);
+  EXPECT_EQ(0.5, bb_transform.hot_instrumentation_rate());
+}
+
 TEST_F(AsanTransformTest, SetInstrumentDLLName) {
   asan_transform_.set_instrument_dll_name("foo");
   ASSERT_EQ(strcmp(asan_transform_.instrument_dll_name(), "foo"), 0);
@@ -321,6 +349,36 @@ TEST_F(AsanTransformTest, SetUseLivenessFlag) {
   EXPECT_FALSE(bb_transform.use_liveness_analysis());
 }
 
+TEST_F(AsanTransformTest, SetInlineFastPathFlag) {
+  EXPECT_FALSE(asan_transform_.inline_fast_path());
+  asan_transform_.set_inline_fast_path(true);
+  EXPECT_TRUE(asan_transform_.inline_fast_path());
+  asan_transform_.set_inline_fast_path(false);
+  EXPECT_FALSE(asan_transform_.inline_fast_path());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.inline_fast_path());
+  bb_transform.set_inline_fast_path(true);
+  EXPECT_TRUE(bb_transform.inline_fast_path());
+  bb_transform.set_inline_fast_path(false);
+  EXPECT_FALSE(bb_transform.inline_fast_path());
+}
+
+TEST_F(AsanTransformTest, SetUseRangeChecksFlag) {
+  EXPECT_FALSE(asan_transform_.use_range_checks());
+  asan_transform_.set_use_range_checks(true);
+  EXPECT_TRUE(asan_transform_.use_range_checks());
+  asan_transform_.set_use_range_checks(false);
+  EXPECT_FALSE(asan_transform_.use_range_checks());
+
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  EXPECT_FALSE(bb_transform.use_range_checks());
+  bb_transform.set_use_range_checks(true);
+  EXPECT_TRUE(bb_transform.use_range_checks());
+  bb_transform.set_use_range_checks(false);
+  EXPECT_FALSE(bb_transform.use_range_checks());
+}
+
 TEST_F(AsanTransformTest, ApplyAsanTransformPE) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -337,6 +395,79 @@ TEST_F(AsanTransformTest, ApplyAsanTransformCoff) {
       &asan_transform_, policy_, &block_graph_, header_block_));
 }
 
+TEST_F(AsanTransformTest, ApplyAsanTransformOnWorkerThreadsPE) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+
+  // Instrument another decomposition of the test DLL on worker threads.
+  BlockGraph parallel_block_graph;
+  pe::ImageLayout parallel_layout(&parallel_block_graph);
+  pe::Decomposer decomposer(pe_file_);
+  ASSERT_TRUE(decomposer.Decompose(&parallel_layout));
+  BlockGraph::Block* parallel_header_block =
+      parallel_layout.blocks.GetBlockByAddress(RelativeAddress(0));
+  ASSERT_TRUE(parallel_header_block != NULL);
+
+  TestAsanTransform parallel_transform;
+  parallel_transform.set_num_threads(4);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &parallel_transform, policy_, &parallel_block_graph,
+      parallel_header_block));
+
+  // Both block graphs should be the same, down to the block IDs.
+  ASSERT_EQ(block_graph_.blocks().size(),
+            parallel_block_graph.blocks().size());
+  BlockGraph::BlockMap::const_iterator serial_it =
+      block_graph_.blocks().begin();
+  BlockGraph::BlockMap::const_iterator parallel_it =
+      parallel_block_graph.blocks().begin();
+  for (; serial_it != block_graph_.blocks().end();
+       ++serial_it, ++parallel_it) {
+    const BlockGraph::Block& serial_block = serial_it->second;
+    const BlockGraph::Block& parallel_block = parallel_it->second;
+    EXPECT_EQ(serial_it->first, parallel_it->first);
+    EXPECT_EQ(serial_block.name(), parallel_block.name());
+    EXPECT_EQ(serial_block.size(), parallel_block.size());
+    EXPECT_EQ(serial_block.references().size(),
+              parallel_block.references().size());
+    ASSERT_EQ(serial_block.data_size(), parallel_block.data_size());
+    if (serial_block.data_size() != 0) {
+      EXPECT_EQ(0, ::memcmp(serial_block.data(), parallel_block.data(),
+                            serial_block.data_size()));
+    }
+  }
+}
+
+TEST_F(AsanTransformTest, ApplyAsanTransformWithInlineFastPathPE) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  asan_transform_.use_liveness_analysis_ = true;
+  asan_transform_.set_inline_fast_path(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+
+  // The shadow memory is imported, and stubbed until the RTL is bound.
+  BlockGraph::Reference stub_ref;
+  ASSERT_NE(reinterpret_cast<BlockGraph::Block*>(NULL),
+            asan_transform_.shadow_memory_ref_.referenced());
+  ASSERT_TRUE(asan_transform_.shadow_memory_ref_.referenced()->GetReference(
+      asan_transform_.shadow_memory_ref_.offset(), &stub_ref));
+  EXPECT_EQ(BlockGraph::DATA_BLOCK, stub_ref.referenced()->type());
+  EXPECT_EQ(sizeof(uint32), stub_ref.referenced()->size());
+}
+
+TEST_F(AsanTransformTest, ApplyAsanTransformWithInlineFastPathCoff) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDllObj());
+
+  asan_transform_.use_liveness_analysis_ = true;
+  asan_transform_.set_inline_fast_path(true);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &asan_transform_, policy_, &block_graph_, header_block_));
+  EXPECT_NE(reinterpret_cast<BlockGraph::Block*>(NULL),
+            asan_transform_.shadow_memory_ref_.referenced());
+}
+
 TEST_F(AsanTransformTest, InjectAsanHooksPe) {
   // Add a read access to the memory.
   bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
@@ -511,6 +642,185 @@ TEST_F(AsanTransformTest, InjectAsanHooksCoff) {
   ASSERT_TRUE(iter_inst == basic_block_->instructions().end());
 }
 
+TEST_F(AsanTransformTest, InjectFastPathChecksPe) {
+  // A read access for which EAX, ECX and the flags are free.
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
+  bb_asm_->mov(assm::ecx, block_graph::Immediate(1));
+  bb_asm_->cmp(assm::eax, assm::ebx);
+  bb_asm_->ret();
+
+  BasicBlockSubGraph::BlockDescription* desc =
+      subgraph_.AddBlockDescription("Foo()", "foo.obj",
+                                    BlockGraph::CODE_BLOCK, 1, 1, 0);
+  ASSERT_NE(static_cast<BasicBlockSubGraph::BlockDescription*>(NULL), desc);
+  desc->basic_block_order.push_back(basic_block_);
+
+  BlockGraph::Block* shadow_memory =
+      block_graph_.AddBlock(BlockGraph::DATA_BLOCK, 4, "shadow_memory");
+  block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_liveness_analysis(true);
+  bb_transform.set_inline_fast_path(true);
+  bb_transform.set_shadow_memory_reference(BlockGraph::Reference(
+      BlockGraph::ABSOLUTE_REF, 4, shadow_memory, 0, 0));
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The basic block is split into the shadow memory load, the shadow byte
+  // check, the continuation and the slow path.
+  ASSERT_EQ(4u, desc->basic_block_order.size());
+  BasicBlockSubGraph::BasicBlockOrdering::iterator bb_it =
+      desc->basic_block_order.begin();
+  BasicCodeBlock* load_bb = BasicCodeBlock::Cast(*(bb_it++));
+  BasicCodeBlock* check_bb = BasicCodeBlock::Cast(*(bb_it++));
+  BasicCodeBlock* cont_bb = BasicCodeBlock::Cast(*(bb_it++));
+  BasicCodeBlock* slow_bb = BasicCodeBlock::Cast(*(bb_it++));
+  ASSERT_EQ(basic_block_, load_bb);
+  ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), check_bb);
+  ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), cont_bb);
+  ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), slow_bb);
+
+  // The shadow memory address is loaded through its import, and tested for
+  // null.
+  BasicBlock::Instructions::const_iterator iter_inst =
+      load_bb->instructions().begin();
+  ASSERT_EQ(3u, load_bb->instructions().size());
+  ASSERT_EQ(1u, iter_inst->references().size());
+  EXPECT_EQ(shadow_memory, iter_inst->references().begin()->second.block());
+  EXPECT_EQ(I_MOV, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_MOV, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_TEST, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(2u, load_bb->successors().size());
+  EXPECT_EQ(slow_bb, load_bb->successors().front().reference().basic_block());
+  EXPECT_EQ(check_bb, load_bb->successors().back().reference().basic_block());
+
+  // The shadow byte of the access is tested.
+  iter_inst = check_bb->instructions().begin();
+  ASSERT_EQ(4u, check_bb->instructions().size());
+  EXPECT_EQ(I_LEA, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_SHR, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_MOVZX, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_TEST, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(2u, check_bb->successors().size());
+  EXPECT_EQ(slow_bb, check_bb->successors().front().reference().basic_block());
+  EXPECT_EQ(cont_bb, check_bb->successors().back().reference().basic_block());
+
+  // The original instructions end up in the continuation.
+  EXPECT_EQ(4u, cont_bb->instructions().size());
+  EXPECT_TRUE(cont_bb->successors().empty());
+
+  // The slow path calls the hook that doesn't save the flags.
+  iter_inst = slow_bb->instructions().begin();
+  ASSERT_EQ(3u, slow_bb->instructions().size());
+  EXPECT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_LEA, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  HookMapEntryKey check_4_byte_read_key =
+      { AsanBasicBlockTransform::kReadAccess, 4, 0, false };
+  EXPECT_EQ(hooks_check_access_[check_4_byte_read_key],
+            iter_inst->references().begin()->second.block());
+  EXPECT_EQ(I_CALL, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(1u, slow_bb->successors().size());
+  EXPECT_EQ(cont_bb, slow_bb->successors().front().reference().basic_block());
+}
+
+TEST_F(AsanTransformTest, CoalesceAdjacentAccesses) {
+  // Two adjacent reads through EBX, and a write through ESI which is
+  // left alone.
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
+  bb_asm_->mov(assm::ecx, block_graph::Operand(assm::ebx,
+                                                block_graph::Displacement(4)));
+  bb_asm_->mov(block_graph::Operand(assm::esi), assm::eax);
+  bb_asm_->ret();
+
+  BasicBlockSubGraph::BlockDescription* desc =
+      subgraph_.AddBlockDescription("Foo()", "foo.obj",
+                                    BlockGraph::CODE_BLOCK, 1, 1, 0);
+  ASSERT_NE(static_cast<BasicBlockSubGraph::BlockDescription*>(NULL), desc);
+  desc->basic_block_order.push_back(basic_block_);
+  block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_use_range_checks(true);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+
+  // The two reads are checked by a single range check, injected before the
+  // first of them.
+  BasicBlock::Instructions::const_iterator iter_inst =
+      basic_block_->instructions().begin();
+  ASSERT_EQ(11u, basic_block_->instructions().size());
+  EXPECT_EQ(I_PUSH, iter_inst->representation().opcode);
+  EXPECT_EQ(8u, (iter_inst++)->representation().imm.dword);
+  EXPECT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_LEA, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  HookMapEntryKey range_read_key =
+      { AsanBasicBlockTransform::kRangeReadAccess, 0, 0, true };
+  EXPECT_EQ(hooks_check_access_[range_read_key],
+            iter_inst->references().begin()->second.block());
+  EXPECT_EQ(I_CALL, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_MOV, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_MOV, (iter_inst++)->representation().opcode);
+
+  // The write is checked on its own.
+  EXPECT_EQ(I_PUSH, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_LEA, (iter_inst++)->representation().opcode);
+  ASSERT_EQ(1u, iter_inst->references().size());
+  HookMapEntryKey check_4_byte_write_key =
+      { AsanBasicBlockTransform::kWriteAccess, 4, 0, true };
+  EXPECT_EQ(hooks_check_access_[check_4_byte_write_key],
+            iter_inst->references().begin()->second.block());
+  EXPECT_EQ(I_CALL, (iter_inst++)->representation().opcode);
+  EXPECT_EQ(I_MOV, (iter_inst++)->representation().opcode);
+}
+
+TEST_F(AsanTransformTest, HotBasicBlocksUseHotInstrumentationRate) {
+  bb_asm_->mov(assm::eax, block_graph::Operand(assm::ebx));
+  bb_asm_->ret();
+
+  BasicBlockSubGraph::BlockDescription* desc =
+      subgraph_.AddBlockDescription("Foo()", "foo.obj",
+                                    BlockGraph::CODE_BLOCK, 1, 1, 0);
+  ASSERT_NE(static_cast<BasicBlockSubGraph::BlockDescription*>(NULL), desc);
+  desc->basic_block_order.push_back(basic_block_);
+  block_graph_.set_image_format(BlockGraph::PE_IMAGE);
+
+  // The basic block is at the start of a block at 0x1000 in the original
+  // image.
+  BlockGraph::Block* original_block =
+      block_graph_.AddBlock(BlockGraph::CODE_BLOCK, 16, "Foo()");
+  original_block->set_addr(core::RelativeAddress(0x1000));
+  subgraph_.set_original_block(original_block);
+  basic_block_->set_offset(0);
+
+  AsanBasicBlockTransform::RelativeAddressSet hot_basic_blocks;
+  hot_basic_blocks.insert(core::RelativeAddress(0x1000));
+
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.set_hot_basic_blocks(&hot_basic_blocks);
+  bb_transform.set_hot_instrumentation_rate(0.0);
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+
+  // The hot basic block isn't instrumented.
+  EXPECT_FALSE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(2u, basic_block_->instructions().size());
+
+  // Once it's cold, it's fully instrumented.
+  hot_basic_blocks.clear();
+  ASSERT_TRUE(bb_transform.TransformBasicBlockSubGraph(
+      &pe_policy_, &block_graph_, &subgraph_));
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(5u, basic_block_->instructions().size());
+}
+
 TEST_F(AsanTransformTest, InstrumentDifferentKindOfInstructions) {
   uint32 instrumentable_instructions = 0;
 
@@ -638,6 +948,55 @@ TEST_F(AsanTransformTest, InstrumentableStackBasedUnsafeInstructions) {
   EXPECT_LT(previous_basic_block_size, basic_block_->instructions().size());
 }
 
+TEST_F(AsanTransformTest, NonInstrumentableStackFrameUnsafeInstructions) {
+  // INC DWORD [ESP + 0x1c]
+  static const uint8 kInc1[4] = { 0xff, 0x44, 0x24, 0x1c };
+  // FISTP QWORD [ESP + 0x28]
+  static const uint8 kFistp1[4] = { 0xdf, 0x7c, 0x24, 0x28 };
+
+  ASSERT_TRUE(AddInstructionFromBuffer(kInc1, sizeof(kInc1)));
+  ASSERT_TRUE(AddInstructionFromBuffer(kFistp1, sizeof(kFistp1)));
+
+  // Keep track of the basic block size before Asan transform.
+  uint32 expected_basic_block_size = basic_block_->instructions().size();
+
+  // These accesses fall within the stack frame, so they don't need to be
+  // instrumented even if EBP can't be trusted.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.stack_frame_size_ = 0x30;
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+        basic_block_,
+        AsanBasicBlockTransform::kUnsafeStackAccess,
+        BlockGraph::PE_IMAGE));
+
+  EXPECT_FALSE(bb_transform.instrumentation_happened());
+  EXPECT_EQ(expected_basic_block_size, basic_block_->instructions().size());
+}
+
+TEST_F(AsanTransformTest, InstrumentableStackFrameUnsafeInstructions) {
+  // FISTP QWORD [ESP + 0x28]
+  static const uint8 kFistp1[4] = { 0xdf, 0x7c, 0x24, 0x28 };
+
+  ASSERT_TRUE(AddInstructionFromBuffer(kFistp1, sizeof(kFistp1)));
+
+  // Keep track of the basic block size before Asan transform.
+  uint32 previous_basic_block_size = basic_block_->instructions().size();
+
+  // This access overflows the stack frame by a byte, so it must be
+  // instrumented.
+  InitHooksRefs();
+  TestAsanBasicBlockTransform bb_transform(&hooks_check_access_ref_);
+  bb_transform.stack_frame_size_ = 0x2f;
+  ASSERT_TRUE(bb_transform.InstrumentBasicBlock(
+        basic_block_,
+        AsanBasicBlockTransform::kUnsafeStackAccess,
+        BlockGraph::PE_IMAGE));
+
+  EXPECT_TRUE(bb_transform.instrumentation_happened());
+  EXPECT_LT(previous_basic_block_size, basic_block_->instructions().size());
+}
+
 TEST_F(AsanTransformTest, NonInstrumentableSegmentBasedInstructions) {
   // add eax, fs:[eax]
   static const uint8 kAdd1[3] = { 0x64, 0x03, 0x00 };
@@ -55,6 +55,8 @@ typedef pe::transforms::ImportedModule ImportedModule;
 
 const char kDefaultModuleName[] = "basic_block_entry_client.dll";
 const char kBasicBlockEnter[] = "_increment_indexed_freq_data";
+const char kBasicBlockEnterBuffered[] =
+    "_increment_indexed_freq_data_buffered";
 
 // Compares two relative address ranges to see if they overlap. Assumes they
 // are already sorted. This is used to validate basic-block ranges.
@@ -75,14 +77,18 @@ bool SetupEntryHooks(const TransformPolicyInterface* policy,
                      BlockGraph* block_graph,
                      BlockGraph::Block* header_block,
                      const std::string& module_name,
+                     bool buffering,
                      BlockGraph::Reference* basic_block_enter) {
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
   DCHECK(basic_block_enter != NULL);
 
+  const char* basic_block_enter_name =
+      buffering ? kBasicBlockEnterBuffered : kBasicBlockEnter;
+
   // Setup the import module.
   ImportedModule module(module_name);
-  size_t bb_index = module.AddSymbol(kBasicBlockEnter,
+  size_t bb_index = module.AddSymbol(basic_block_enter_name,
                                      ImportedModule::kAlwaysImport);
 
   // Setup the add-imports transform.
@@ -98,7 +104,7 @@ bool SetupEntryHooks(const TransformPolicyInterface* policy,
 
   // Get a reference to the entry-hook function.
   if (!module.GetSymbolReference(bb_index, basic_block_enter)) {
-    LOG(ERROR) << "Unable to get " << kBasicBlockEnter << ".";
+    LOG(ERROR) << "Unable to get " << basic_block_enter_name << ".";
     return false;
   }
   DCHECK(basic_block_enter->IsValid());
@@ -131,7 +137,9 @@ BasicBlockEntryHookTransform::BasicBlockEntryHookTransform()
     thunk_section_(NULL),
     instrument_dll_name_(kDefaultModuleName),
     set_src_ranges_for_thunks_(false),
-    set_inline_fast_path_(false) {
+    set_inline_fast_path_(false),
+    buffering_(false),
+    frequency_size_(sizeof(uint32)) {
 }
 
 bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
@@ -148,6 +156,7 @@ bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
                        block_graph,
                        header_block,
                        instrument_dll_name_,
+                       buffering_,
                        &bb_entry_hook_ref_)) {
     return false;
   }
@@ -164,6 +173,18 @@ bool BasicBlockEntryHookTransform::PreBlockGraphIteration(
                                                  pe::kCodeCharacteristics);
   DCHECK(thunk_section_ != NULL);
 
+  // Precompile the entry hook instrumentation, with a placeholder for the
+  // basic_block_id. It's the same for every basic block but for that value.
+  BasicBlockAssembler* bb_asm = entry_hook_template_.assembler();
+  bb_asm->push(Immediate(0, assm::kSize32Bit));
+  bb_asm->push(Immediate(add_frequency_data_.frequency_data_block(), 0));
+  bb_asm->call(Operand(Displacement(bb_entry_hook_ref_.referenced(),
+                                    bb_entry_hook_ref_.offset())));
+  if (!entry_hook_template_.AddValueSlot(0, 0)) {
+    LOG(ERROR) << "Failed to precompile the basic-block entry hook.";
+    return false;
+  }
+
   return true;
 }
 
@@ -229,18 +250,11 @@ bool BasicBlockEntryHookTransform::TransformBasicBlockSubGraph(
     // We use the location/index in the bb_ranges vector of the current
     // basic-block range as the basic_block_id, and we pass a pointer to
     // the frequency data block as the module_data parameter. We then make
-    // a memory indirect call to the bb_entry_hook.
-    auto basic_block_id(Immediate(bb_ranges_.size(), assm::kSize32Bit));
-    auto module_data(Immediate(add_frequency_data_.frequency_data_block(), 0));
-    auto bb_entry_hook(Operand(Displacement(bb_entry_hook_ref_.referenced(),
-                                            bb_entry_hook_ref_.offset())));
-
-    // Assemble entry hook instrumentation into the instruction stream.
-    BasicBlockAssembler bb_asm(bb->instructions().begin(), &bb->instructions());
-
-    bb_asm.push(basic_block_id);
-    bb_asm.push(module_data);
-    bb_asm.call(bb_entry_hook);
+    // a memory indirect call to the bb_entry_hook. This is emitted from the
+    // template precompiled in PreBlockGraphIteration.
+    uint32 basic_block_id = bb_ranges_.size();
+    entry_hook_template_.Emit(bb->instructions().begin(), &bb->instructions(),
+                              &basic_block_id, 1, NULL, 0);
 
     bb_ranges_.push_back(source_range);
   }
@@ -264,7 +278,7 @@ bool BasicBlockEntryHookTransform::PostBlockGraphIteration(
 
   if (!add_frequency_data_.ConfigureFrequencyDataBuffer(num_basic_blocks,
                                                         1,
-                                                        sizeof(uint32))) {
+                                                        frequency_size_)) {
     LOG(ERROR) << "Failed to configure frequency data buffer.";
     return false;
   }
@@ -81,6 +81,23 @@ class BasicBlockEntryHookTransform
     set_inline_fast_path_ = value;
   }
 
+  // @name Accessors for the flag denoting whether or not the counters are
+  //     buffered in thread-local arrays by the agent.
+  // @{
+  bool buffering() const { return buffering_; }
+  void set_buffering(bool buffering) { buffering_ = buffering; }
+  // @}
+
+  // @name Accessors for the size in bytes of the basic-block counters. This
+  //     must be 1, 2 or 4. The counters saturate at their maximal value.
+  // @{
+  uint8 frequency_size() const { return frequency_size_; }
+  void set_frequency_size(uint8 frequency_size) {
+    DCHECK(frequency_size == 1 || frequency_size == 2 || frequency_size == 4);
+    frequency_size_ = frequency_size;
+  }
+  // @}
+
  protected:
   typedef std::map<BlockGraph::Offset, BlockGraph::Block*> ThunkBlockMap;
 
@@ -163,6 +180,9 @@ class BasicBlockEntryHookTransform
   // The entry hook to which basic-block entry events are directed.
   BlockGraph::Reference bb_entry_hook_ref_;
 
+  // The instrumentation inserted at the top of each basic block.
+  block_graph::InstructionTemplate entry_hook_template_;
+
   // The section where the entry-point thunks were placed. This will only be
   // non-NULL after a successful application of the transform. This value is
   // retained for unit-testing purposes.
@@ -179,6 +199,12 @@ class BasicBlockEntryHookTransform
   // falling back to the hook in the agent.
   bool set_inline_fast_path_;
 
+  // If true, the basic-block entries are directed to the buffered hook.
+  bool buffering_;
+
+  // The size in bytes of the basic-block counters.
+  uint8 frequency_size_;
+
   // The name of this transform.
   static const char kTransformName[];
 
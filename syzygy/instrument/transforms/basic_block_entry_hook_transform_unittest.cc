@@ -192,6 +192,22 @@ TEST_F(BasicBlockEntryHookTransformTest, SetInlinePathFlag) {
   EXPECT_FALSE(tx_.inline_fast_path());
 }
 
+TEST_F(BasicBlockEntryHookTransformTest, SetBufferingFlag) {
+  EXPECT_FALSE(tx_.buffering());
+  tx_.set_buffering(true);
+  EXPECT_TRUE(tx_.buffering());
+  tx_.set_buffering(false);
+  EXPECT_FALSE(tx_.buffering());
+}
+
+TEST_F(BasicBlockEntryHookTransformTest, SetFrequencySize) {
+  EXPECT_EQ(sizeof(uint32), tx_.frequency_size());
+  tx_.set_frequency_size(1);
+  EXPECT_EQ(1U, tx_.frequency_size());
+  tx_.set_frequency_size(2);
+  EXPECT_EQ(2U, tx_.frequency_size());
+}
+
 TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentation) {
   ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
 
@@ -225,5 +241,28 @@ TEST_F(BasicBlockEntryHookTransformTest, ApplyAgentInstrumentation) {
   CheckBasicBlockInstrumentation(kAgentInstrumentation);
 }
 
+TEST_F(BasicBlockEntryHookTransformTest, ApplyCompactBufferedInstrumentation) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  // Apply the transform.
+  tx_.set_buffering(true);
+  tx_.set_frequency_size(1);
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx_, policy_, &block_graph_, header_block_));
+  ASSERT_TRUE(tx_.frequency_data_block() != NULL);
+  ASSERT_TRUE(tx_.bb_entry_hook_ref_.IsValid());
+  ASSERT_LT(0u, tx_.bb_ranges().size());
+
+  // The counters must be a single byte wide.
+  block_graph::ConstTypedBlock<IndexedFrequencyData> frequency_data;
+  ASSERT_TRUE(frequency_data.Init(0, tx_.frequency_data_block()));
+  EXPECT_EQ(1U, frequency_data->frequency_size);
+  EXPECT_EQ(frequency_data->num_entries,
+            tx_.frequency_data_buffer_block()->size());
+
+  // Validate that all basic block have been instrumented.
+  CheckBasicBlockInstrumentation(kAgentInstrumentation);
+}
+
 }  // namespace transforms
 }  // namespace instrument
@@ -19,6 +19,7 @@
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/core/disassembler_util.h"
 #include "syzygy/pe/pe_utils.h"
+#include "syzygy/pe/transforms/pe_add_imports_transform.h"
 
 namespace instrument {
 namespace transforms {
@@ -39,9 +40,14 @@ using block_graph::Displacement;
 using block_graph::Immediate;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
+using pe::transforms::PEAddImportsTransform;
 
 typedef CoverageInstrumentationTransform::RelativeAddressRange
     RelativeAddressRange;
+typedef pe::transforms::ImportedModule ImportedModule;
+
+// The hook called by the self-patching probes.
+const char kCoverageHit[] = "_coverage_hit";
 
 const BlockGraph::Offset kFrequencyDataOffset =
     offsetof(IndexedFrequencyData, frequency_data);
@@ -70,7 +76,8 @@ CoverageInstrumentationTransform::CoverageInstrumentationTransform()
                            "Basic-Block Frequency Data",
                            common::kBasicBlockFrequencyDataVersion,
                            common::IndexedFrequencyData::COVERAGE,
-                           sizeof(common::IndexedFrequencyData)) {
+                           sizeof(common::IndexedFrequencyData)),
+      self_patching_(false) {
   // Initialize the EntryThunkTransform.
   entry_thunk_tx_.set_instrument_unsafe_references(false);
   entry_thunk_tx_.set_only_instrument_module_entry(true);
@@ -105,18 +112,31 @@ bool CoverageInstrumentationTransform::TransformBasicBlockSubGraph(
       return false;
     }
 
-    // We prepend each basic code block with the following instructions:
-    //   0. push eax
-    //   1. mov eax, dword ptr[data.frequency_data]
-    //   2. mov byte ptr[eax + basic_block_index], 1
-    //   3. pop eax
     BasicBlockAssembler assm(bb->instructions().begin(), &bb->instructions());
 
-    // Prepend the instrumentation instructions.
-    assm.push(eax);
-    assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
-    assm.mov_b(Operand(eax, Displacement(bb_ranges_.size())), Immediate(1));
-    assm.pop(eax);
+    if (self_patching_) {
+      // We prepend each basic code block with a probe that the agent patches
+      // into a short jump over itself once it has been executed. The agent
+      // relies on the exact size and layout of this sequence:
+      //   0. push basic_block_index
+      //   1. push data
+      //   2. call [coverage_hit]
+      DCHECK(coverage_hit_hook_ref_.IsValid());
+      assm.push(Immediate(bb_ranges_.size(), assm::kSize32Bit));
+      assm.push(Immediate(data_block, 0));
+      assm.call(Operand(Displacement(coverage_hit_hook_ref_.referenced(),
+                                     coverage_hit_hook_ref_.offset())));
+    } else {
+      // We prepend each basic code block with the following instructions:
+      //   0. push eax
+      //   1. mov eax, dword ptr[data.frequency_data]
+      //   2. mov byte ptr[eax + basic_block_index], 1
+      //   3. pop eax
+      assm.push(eax);
+      assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
+      assm.mov_b(Operand(eax, Displacement(bb_ranges_.size())), Immediate(1));
+      assm.pop(eax);
+    }
 
     bb_ranges_.push_back(source_range);
   }
@@ -139,6 +159,27 @@ bool CoverageInstrumentationTransform::PreBlockGraphIteration(
     return false;
   }
 
+  if (self_patching_) {
+    // Import the hook called by the self-patching probes.
+    ImportedModule module(entry_thunk_tx_.instrument_dll_name());
+    size_t hook_index = module.AddSymbol(kCoverageHit,
+                                         ImportedModule::kAlwaysImport);
+
+    PEAddImportsTransform add_imports;
+    add_imports.AddModule(&module);
+    if (!ApplyBlockGraphTransform(
+            &add_imports, policy, block_graph, header_block)) {
+      LOG(ERROR) << "Unable to add import for " << kCoverageHit << ".";
+      return false;
+    }
+
+    if (!module.GetSymbolReference(hook_index, &coverage_hit_hook_ref_)) {
+      LOG(ERROR) << "Unable to get " << kCoverageHit << ".";
+      return false;
+    }
+    DCHECK(coverage_hit_hook_ref_.IsValid());
+  }
+
   return true;
 }
 
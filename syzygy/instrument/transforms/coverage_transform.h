@@ -67,6 +67,12 @@ class CoverageInstrumentationTransform
   //      as its unique ID.
   const RelativeAddressRangeVector& bb_ranges() const { return bb_ranges_; }
 
+  // If true, the basic blocks are instrumented with probes that call into the
+  // agent, which records the visit and patches the probe into a jump over
+  // itself. Otherwise, an inline probe records each visit.
+  bool self_patching() const { return self_patching_; }
+  void set_self_patching(bool self_patching) { self_patching_ = self_patching; }
+
   // @}
 
   // @name Pass-throughs to EntryThunkTransform.
@@ -127,6 +133,13 @@ class CoverageInstrumentationTransform
   // Stores the RVAs in the original image for each instrumented basic block.
   RelativeAddressRangeVector bb_ranges_;
 
+  // Indicates whether the probes are self-patching.
+  bool self_patching_;
+
+  // The hook called by the self-patching probes, valid only when they are
+  // used.
+  BlockGraph::Reference coverage_hit_hook_ref_;
+
   DISALLOW_COPY_AND_ASSIGN(CoverageInstrumentationTransform);
 };
 
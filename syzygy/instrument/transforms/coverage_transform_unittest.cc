@@ -67,5 +67,25 @@ TEST_F(CoverageInstrumentationTransformTest, Apply) {
       coverage_data.OffsetOf(coverage_data->frequency_data)));
 }
 
+TEST_F(CoverageInstrumentationTransformTest, ApplySelfPatching) {
+  CoverageInstrumentationTransform tx;
+  tx.set_self_patching(true);
+  EXPECT_TRUE(tx.self_patching());
+  ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+      &tx, policy_, &block_graph_, header_block_));
+
+  block_graph::ConstTypedBlock<IndexedFrequencyData> coverage_data;
+  ASSERT_TRUE(coverage_data.Init(0, tx.frequency_data_block()));
+  EXPECT_FALSE(tx.bb_ranges().empty());
+  EXPECT_EQ(tx.bb_ranges().size(), coverage_data->num_entries);
+  EXPECT_EQ(coverage_data->num_entries,
+            tx.frequency_data_buffer_block()->size());
+
+  // Every probe pushes the frequency data, so the data block is referred to
+  // once per instrumented basic block.
+  EXPECT_LE(tx.bb_ranges().size(),
+            tx.frequency_data_block()->referrers().size());
+}
+
 }  // namespace transforms
 }  // namespace instrument
@@ -55,6 +55,7 @@ EntryThunkTransform::EntryThunkTransform()
       instrument_unsafe_references_(true),
       src_ranges_for_thunks_(false),
       only_instrument_module_entry_(false),
+      direct_thunks_(false),
       instrument_dll_name_(kDefaultInstrumentDll) {
 }
 
@@ -161,6 +162,21 @@ bool EntryThunkTransform::PreBlockGraphIteration(
                                                  pe::kCodeCharacteristics);
   DCHECK(thunk_section_ != NULL);
 
+  if (direct_thunks_) {
+    // Create a stub for each of the imported hooks. These are created before
+    // any thunk so that they're laid out at the start of the thunk section.
+    if ((hook_ref_.IsValid() &&
+         !CreateHookStub(block_graph, hook_ref_, &hook_stub_ref_)) ||
+        (hook_dllmain_ref_.IsValid() &&
+         !CreateHookStub(block_graph, hook_dllmain_ref_,
+                         &hook_dllmain_stub_ref_)) ||
+        (hook_exe_entry_ref_.IsValid() &&
+         !CreateHookStub(block_graph, hook_exe_entry_ref_,
+                         &hook_exe_entry_stub_ref_))) {
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -267,6 +283,15 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
     hook_ref = &hook_dllmain_ref_;
   else if (is_exe_entry)
     hook_ref = &hook_exe_entry_ref_;
+
+  // Direct thunks go through the stub of the hook instead.
+  if (direct_thunks_) {
+    hook_ref = &hook_stub_ref_;
+    if (is_dllmain_entry)
+      hook_ref = &hook_dllmain_stub_ref_;
+    else if (is_exe_entry)
+      hook_ref = &hook_exe_entry_stub_ref_;
+  }
   DCHECK(hook_ref->referenced() != NULL);
 
   // Determine which parameter to use, if any.
@@ -303,6 +328,50 @@ bool EntryThunkTransform::InstrumentCodeBlockReferrer(
   return true;
 }
 
+bool EntryThunkTransform::CreateHookStub(BlockGraph* block_graph,
+                                         const BlockGraph::Reference& hook,
+                                         BlockGraph::Reference* stub_ref) {
+  DCHECK(block_graph != NULL);
+  DCHECK(hook.IsValid());
+  DCHECK(stub_ref != NULL);
+
+  std::string name = base::StringPrintf("%s%s",
+                                        hook.referenced()->name().c_str(),
+                                        common::kThunkSuffix);
+
+  BasicBlockSubGraph bbsg;
+  BasicBlockSubGraph::BlockDescription* block_desc = bbsg.AddBlockDescription(
+      name,
+      NULL,
+      BlockGraph::CODE_BLOCK,
+      thunk_section_->id(),
+      kDirectThunkAlignment,
+      0);
+  BasicCodeBlock* bb = bbsg.AddBasicCodeBlock(name);
+  block_desc->basic_block_order.push_back(bb);
+  BasicBlockAssembler assm(bb->instructions().begin(),
+                           &bb->instructions());
+
+  // The stub is the single indirect branch shared by all the thunks of the
+  // hook:
+  // 1. jmp hook_addr
+  assm.jmp(Operand(Displacement(hook.referenced(), hook.offset())));
+
+  BlockBuilder block_builder(block_graph);
+  if (!block_builder.Merge(&bbsg)) {
+    LOG(ERROR) << "Failed to build hook stub block.";
+    return false;
+  }
+
+  DCHECK_EQ(1u, block_builder.new_blocks().size());
+  BlockGraph::Block* stub = block_builder.new_blocks().front();
+  *stub_ref = BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF,
+                                    sizeof(core::AbsoluteAddress),
+                                    stub, 0, 0);
+
+  return true;
+}
+
 BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
     BlockGraph* block_graph,
     const BlockGraph::Reference& destination,
@@ -331,7 +400,7 @@ BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
       NULL,
       BlockGraph::CODE_BLOCK,
       thunk_section_->id(),
-      1,
+      direct_thunks_ ? kDirectThunkAlignment : 1,
       0);
   BasicCodeBlock* bb = bbsg.AddBasicCodeBlock(name);
   block_desc->basic_block_order.push_back(bb);
@@ -341,11 +410,14 @@ BlockGraph::Block* EntryThunkTransform::CreateOneThunk(
   // Set up our thunk:
   // 1. push parameter
   // 2. push func_addr
-  // 3. jmp hook_addr
+  // 3. jmp hook_addr, or jmp hook_stub with direct thunks.
   if (parameter != NULL)
     assm.push(*parameter);
   assm.push(Immediate(destination.referenced(), destination.offset()));
-  assm.jmp(Operand(Displacement(hook.referenced(), hook.offset())));
+  if (direct_thunks_)
+    assm.jmp(Immediate(hook.referenced(), hook.offset()));
+  else
+    assm.jmp(Operand(Displacement(hook.referenced(), hook.offset())));
 
   // Condense the whole mess into a block.
   BlockBuilder block_builder(block_graph);
@@ -43,6 +43,18 @@
 //
 // Prior to executing the thunk the stack is set up as if the call was going to
 // be directly to the original function.
+//
+// With direct thunks, the indirect jump of each thunk is replaced by a direct
+// jump to a per-hook stub laid out in the thunk section:
+//
+//   0x68 0x44 0x33 0x22 0x11       push 0x11223344
+//   0xe9 0x88 0x77 0x66 0x55       jmp stub
+//
+//   stub:
+//   0xff 0x25 0x88 0x77 0x66 0x55  jmp [0x55667788]
+//
+// The thunks and stubs are aligned so that none of them straddles a cache
+// line. The stack seen by the hook is unchanged.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_ENTRY_THUNK_TRANSFORM_H_
@@ -93,6 +105,11 @@ class EntryThunkTransform
     return only_instrument_module_entry_;
   }
 
+  void set_direct_thunks(bool direct_thunks) {
+    direct_thunks_ = direct_thunks;
+  }
+  bool direct_thunks() const { return direct_thunks_; }
+
   void set_instrument_dll_name(const base::StringPiece& instrument_dll_name) {
     instrument_dll_name.CopyToString(&instrument_dll_name_);
   }
@@ -136,6 +153,10 @@ class EntryThunkTransform
   // The name of the DLL imported default.
   static const char kDefaultInstrumentDll[];
 
+  // The alignment of the thunks and stubs when using direct thunks. This
+  // divides the size of a cache line and is no smaller than any thunk.
+  static const size_t kDirectThunkAlignment = 16;
+
  protected:
   typedef std::map<BlockGraph::Offset, BlockGraph::Block*> ThunkBlockMap;
 
@@ -158,10 +179,20 @@ class EntryThunkTransform
                                    BlockGraph::Block* block,
                                    ThunkBlockMap* thunk_block_map);
 
+  // Creates the stub through which direct thunks jump to a hook.
+  // @param block_graph the block-graph being instrumented.
+  // @param hook a reference to the import of the hook.
+  // @param stub_ref receives a reference to the created stub.
+  // @returns true on success, false otherwise.
+  bool CreateHookStub(BlockGraph* block_graph,
+                      const BlockGraph::Reference& hook,
+                      BlockGraph::Reference* stub_ref);
+
   // Create a single thunk to destination.
   // @param block_graph the block-graph being instrumented.
   // @param destination the destination reference.
-  // @param hook a reference to the hook to use.
+  // @param hook a reference to the hook to use. This refers to the stub of
+  //     the hook when using direct thunks, and to its import otherwise.
   // @param parameter the parameter to be passed to the thunk. If this is NULL
   //     then an unparameterized thunk will be created.
   BlockGraph::Block* CreateOneThunk(BlockGraph* block_graph,
@@ -188,6 +219,12 @@ class EntryThunkTransform
   BlockGraph::Reference hook_dllmain_ref_;
   BlockGraph::Reference hook_exe_entry_ref_;
 
+  // References to the stubs of each of the hooks above. Valid after
+  // successful PreBlockGraphIteration when using direct thunks.
+  BlockGraph::Reference hook_stub_ref_;
+  BlockGraph::Reference hook_dllmain_stub_ref_;
+  BlockGraph::Reference hook_exe_entry_stub_ref_;
+
   // Iff true, instrument references with a non-zero offset into the
   // destination block.
   bool instrument_unsafe_references_;
@@ -200,6 +237,10 @@ class EntryThunkTransform
   // If true, only instrument DLL entry points.
   bool only_instrument_module_entry_;
 
+  // If true, thunks jump directly to a per-hook stub instead of jumping
+  // indirectly through the import of the hook.
+  bool direct_thunks_;
+
   // If has a size of 32 bits, then entry thunks will be set up with an extra
   // parameter on the stack prior to the address of the original function.
   ImmediateType entry_thunk_parameter_;
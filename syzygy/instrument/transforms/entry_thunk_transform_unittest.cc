@@ -56,6 +56,16 @@ struct ParamThunk {
   WORD indirect_jmp;
   DWORD hook_addr;  // The instrumentation hook that gets called indirectly.
 };
+struct DirectThunk {
+  BYTE push;
+  DWORD func_addr;  // The real function to invoke.
+  BYTE direct_jmp;
+  DWORD stub_addr;  // The stub that jumps indirectly to the hook.
+};
+struct HookStub {
+  WORD indirect_jmp;
+  DWORD hook_addr;  // The instrumentation hook that gets called indirectly.
+};
 #pragma pack(pop)
 
 class EntryThunkTransformTest : public testing::Test {
@@ -383,14 +393,17 @@ TEST_F(EntryThunkTransformTest, AccessorsAndMutators) {
   EXPECT_TRUE(tx.instrument_unsafe_references());
   EXPECT_FALSE(tx.src_ranges_for_thunks());
   EXPECT_FALSE(tx.only_instrument_module_entry());
+  EXPECT_FALSE(tx.direct_thunks());
 
   tx.set_instrument_unsafe_references(false);
   tx.set_src_ranges_for_thunks(true);
   tx.set_only_instrument_module_entry(true);
+  tx.set_direct_thunks(true);
 
   EXPECT_FALSE(tx.instrument_unsafe_references());
   EXPECT_TRUE(tx.src_ranges_for_thunks());
   EXPECT_TRUE(tx.only_instrument_module_entry());
+  EXPECT_TRUE(tx.direct_thunks());
 }
 
 TEST_F(EntryThunkTransformTest, ParameterizedThunks) {
@@ -463,6 +476,55 @@ TEST_F(EntryThunkTransformTest, InstrumentAllWithParam) {
   EXPECT_EQ(num_sections_pre_transform_ + 1, bg_.sections().size());
 }
 
+TEST_F(EntryThunkTransformTest, InstrumentAllDirect) {
+  EntryThunkTransform transform;
+  ASSERT_NO_FATAL_FAILURE(SetEmptyDllEntryPoint());
+  transform.set_direct_thunks(true);
+
+  ASSERT_TRUE(ApplyBlockGraphTransform(
+      &transform, &policy_, &bg_, dos_header_block_));
+
+  BlockGraph::Section* thunk_section =
+      bg_.FindSection(common::kThunkSectionName);
+  ASSERT_TRUE(thunk_section != NULL);
+
+  // Sort the blocks of the thunk section into thunks and stubs.
+  std::set<const BlockGraph::Block*> stubs;
+  std::set<const BlockGraph::Block*> stub_targets;
+  size_t thunks = 0;
+  BlockGraph::BlockMap::const_iterator it = bg_.blocks().begin();
+  for (; it != bg_.blocks().end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    if (block.section() != thunk_section->id())
+      continue;
+
+    EXPECT_EQ(BlockGraph::CODE_BLOCK, block.type());
+    EXPECT_EQ(EntryThunkTransform::kDirectThunkAlignment, block.alignment());
+
+    BlockGraph::Reference ref;
+    if (block.size() == sizeof(HookStub)) {
+      EXPECT_EQ(1, block.references().size());
+      EXPECT_TRUE(block.GetReference(offsetof(HookStub, hook_addr), &ref));
+      EXPECT_EQ(BlockGraph::ABSOLUTE_REF, ref.type());
+      stubs.insert(&block);
+    } else {
+      ASSERT_EQ(sizeof(DirectThunk), block.size());
+      EXPECT_EQ(2, block.references().size());
+      EXPECT_TRUE(block.GetReference(offsetof(DirectThunk, stub_addr), &ref));
+      EXPECT_EQ(BlockGraph::PC_RELATIVE_REF, ref.type());
+      stub_targets.insert(ref.referenced());
+      ++thunks;
+    }
+  }
+
+  // We should have three thunks - one each for the start of foo() and bar(),
+  // and one for the middle of foo() - all going through the single stub of
+  // the function entry hook.
+  EXPECT_EQ(3, thunks);
+  EXPECT_EQ(1, stubs.size());
+  EXPECT_EQ(stubs, stub_targets);
+}
+
 TEST_F(EntryThunkTransformTest, InstrumentModuleEntriesOnlyNone) {
   EntryThunkTransform transform;
   ASSERT_NO_FATAL_FAILURE(SetEmptyDllEntryPoint());
@@ -21,19 +21,22 @@
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/common/indexed_frequency_data.h"
 #include "syzygy/instrument/transforms/entry_thunk_transform.h"
 #include "syzygy/pe/pe_utils.h"
-#include "syzygy/pe/transforms/pe_add_imports_transform.h"
 
 namespace instrument {
 namespace transforms {
 
 namespace {
 
+using agent::basic_block_entry::BasicBlockEntry;
+using assm::eax;
+using assm::ecx;
 using block_graph::BasicBlock;
 using block_graph::BasicBlockSubGraph;
 using block_graph::BasicCodeBlock;
@@ -47,55 +50,15 @@ using block_graph::Immediate;
 using block_graph::Instruction;
 using block_graph::Operand;
 using block_graph::TransformPolicyInterface;
-using pe::transforms::PEAddImportsTransform;
-using pe::transforms::ImportedModule;
+
+typedef BasicBlockEntry::BasicBlockIndexedFrequencyData
+    BasicBlockIndexedFrequencyData;
 
 const char kDefaultModuleName[] = "basic_block_entry_client.dll";
-const char kJumpTableCaseCounter[] = "_increment_indexed_freq_data";
 const char kThunkSuffix[] = "_jump_table_thunk";
 
-// Sets up the jump table counter hook import.
-// @param policy The policy object restricting how the transform is applied.
-// @param block_graph The block-graph to populate.
-// @param header_block The header block from block_graph.
-// @param module_name The name of the module implementing the hooks.
-// @param jump_table_case_counter will refer to the imported hook function.
-// @returns true on success, false otherwise.
-bool SetupCounterHook(const TransformPolicyInterface* policy,
-                      BlockGraph* block_graph,
-                      BlockGraph::Block* header_block,
-                      const std::string& module_name,
-                      BlockGraph::Reference* jump_table_case_counter) {
-  DCHECK(block_graph != NULL);
-  DCHECK(header_block != NULL);
-  DCHECK(jump_table_case_counter != NULL);
-
-  // Setup the import module.
-  ImportedModule module(module_name);
-  size_t index_case_counter = module.AddSymbol(
-      kJumpTableCaseCounter,
-      ImportedModule::kAlwaysImport);
-
-  // Setup the add-imports transform.
-  PEAddImportsTransform add_imports;
-  add_imports.AddModule(&module);
-
-  // Add the imports to the block-graph.
-  if (!ApplyBlockGraphTransform(
-          &add_imports, policy, block_graph, header_block)) {
-    LOG(ERROR) << "Unable to add import entry for jump table hook functions.";
-    return false;
-  }
-
-  // Get a reference to the hook function.
-  if (!module.GetSymbolReference(index_case_counter, jump_table_case_counter)) {
-    LOG(ERROR) << "Unable to get jump table hooks.";
-    return false;
-  }
-  DCHECK(jump_table_case_counter->IsValid());
-
-  return true;
-}
+const BlockGraph::Offset kFrequencyDataOffset =
+    offsetof(common::IndexedFrequencyData, frequency_data);
 
 }  // namespace
 
@@ -103,11 +66,12 @@ const char JumpTableCaseCountTransform::kTransformName[] =
     "JumpTableCountTransform";
 
 JumpTableCaseCountTransform::JumpTableCaseCountTransform()
-    : add_frequency_data_(common::kJumpTableCountAgentId,
+    : thunk_section_(NULL),
+      add_frequency_data_(common::kJumpTableCountAgentId,
                           "Jump Table Frequency Data",
                           common::kJumpTableFrequencyDataVersion,
                           common::IndexedFrequencyData::JUMP_TABLE,
-                          sizeof(common::IndexedFrequencyData)),
+                          sizeof(BasicBlockIndexedFrequencyData)),
       instrument_dll_name_(kDefaultModuleName),
       jump_table_case_count_(0) {
 }
@@ -121,15 +85,6 @@ bool JumpTableCaseCountTransform::PreBlockGraphIteration(
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), header_block);
   DCHECK_EQ(BlockGraph::PE_IMAGE, block_graph->image_format());
 
-  // Setup the jump table counter entry hook.
-  if (!SetupCounterHook(policy,
-                        block_graph,
-                        header_block,
-                        instrument_dll_name_,
-                        &jump_table_case_counter_hook_ref_)) {
-    return false;
-  }
-
   // Add the static jump table count frequency data.
   if (!ApplyBlockGraphTransform(&add_frequency_data_,
                                 policy,
@@ -171,7 +126,9 @@ bool JumpTableCaseCountTransform::OnBlock(
       return false;
 
     jump_table_infos_.push_back(
-        std::make_pair(block->addr() + iter_label->first, table_size));
+        JumpTableInfo(block->addr() + iter_label->first,
+                      table_size,
+                      jump_table_case_count_));
 
     BlockGraph::Block::ReferenceMap::const_iterator iter_ref =
         block->references().find(iter_label->first);
@@ -218,6 +175,12 @@ bool JumpTableCaseCountTransform::PostBlockGraphIteration(
     return false;
   }
 
+  // Initialize the BasicBlockEntry agent specific fields.
+  block_graph::TypedBlock<BasicBlockIndexedFrequencyData> frequency_data;
+  CHECK(frequency_data.Init(0, add_frequency_data_.frequency_data_block()));
+  frequency_data->fs_slot = 0;
+  frequency_data->tls_index = TLS_OUT_OF_INDEXES;
+
   // Add the module entry thunks.
   EntryThunkTransform add_thunks;
   add_thunks.set_only_instrument_module_entry(true);
@@ -245,10 +208,6 @@ BlockGraph::Block* JumpTableCaseCountTransform::CreateOneThunk(
   // Construct the name for the new thunk.
   std::string thunk_name(destination.referenced()->name() + kThunkSuffix);
 
-  auto jump_table_case_counter_hook(
-      Operand(Displacement(jump_table_case_counter_hook_ref_.referenced(),
-                           jump_table_case_counter_hook_ref_.offset())));
-
   // Construct the thunk basic block.
   BasicBlockSubGraph bbsg;
   BasicBlockSubGraph::BlockDescription* block_desc = bbsg.AddBlockDescription(
@@ -261,10 +220,21 @@ BlockGraph::Block* JumpTableCaseCountTransform::CreateOneThunk(
   BasicCodeBlock* bb = bbsg.AddBasicCodeBlock(thunk_name);
   block_desc->basic_block_order.push_back(bb);
 
+  // Increment the counter of this case in place. This uses lea rather than
+  // add or inc so that the flags seen by the case body are preserved.
   BasicBlockAssembler assm(bb->instructions().begin(), &bb->instructions());
-  DCHECK_LT(jump_table_case_count_, std::numeric_limits<size_t>::max());
-  assm.push(Immediate(jump_table_case_count_++, assm::kSize32Bit));
-  assm.call(jump_table_case_counter_hook);
+  DCHECK_LT(jump_table_case_count_,
+            std::numeric_limits<size_t>::max() / sizeof(uint32));
+  BlockGraph::Block* data_block = add_frequency_data_.frequency_data_block();
+  Displacement counter(jump_table_case_count_++ * sizeof(uint32));
+  assm.push(eax);
+  assm.push(ecx);
+  assm.mov(eax, Operand(Displacement(data_block, kFrequencyDataOffset)));
+  assm.mov(ecx, Operand(eax, counter));
+  assm.lea(ecx, Operand(ecx, Displacement(1)));
+  assm.mov(Operand(eax, counter), ecx);
+  assm.pop(ecx);
+  assm.pop(eax);
   assm.jmp(Immediate(destination.referenced(), destination.offset()));
 
   // Condense into a block.
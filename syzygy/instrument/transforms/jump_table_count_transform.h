@@ -16,16 +16,26 @@
 //
 // The purpose of this instrumentation is to count the number of times each jump
 // table entry is dereferenced. To do this we redirect each reference in the
-// jump tables to the following hook:
-//     push unique_id_for_this_case
-//     call jump_table_count.dll!_jump_table_case_counter
+// jump tables to a thunk that increments the counter of this case in place,
+// without calling into the agent:
+//     push eax
+//     push ecx
+//     mov eax, dword ptr[data.frequency_data]
+//     mov ecx, dword ptr[eax + 4 * unique_id_for_this_case]
+//     lea ecx, [ecx + 1]
+//     mov dword ptr[eax + 4 * unique_id_for_this_case], ecx
+//     pop ecx
+//     pop eax
 //     jmp original_reference
+// The flags are left untouched. The cases of a given jump table get
+// consecutive ids, so the counters of each table form a contiguous histogram
+// in the frequency data buffer. The agent is only used to hook the module
+// entry point and to commit the buffer to the trace file.
 
 #ifndef SYZYGY_INSTRUMENT_TRANSFORMS_JUMP_TABLE_COUNT_TRANSFORM_H_
 #define SYZYGY_INSTRUMENT_TRANSFORMS_JUMP_TABLE_COUNT_TRANSFORM_H_
 
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "syzygy/block_graph/basic_block.h"
@@ -46,6 +56,28 @@ class JumpTableCaseCountTransform
   // module and function names.
   JumpTableCaseCountTransform();
 
+  typedef core::RelativeAddress RelativeAddress;
+  // Describes an instrumented jump table: its address, its number of cases and
+  // the index of the counter of its first case in the frequency data buffer.
+  struct JumpTableInfo {
+    JumpTableInfo(RelativeAddress address, size_t size, size_t first_case_id)
+        : address(address), size(size), first_case_id(first_case_id) {
+    }
+
+    RelativeAddress address;
+    size_t size;
+    size_t first_case_id;
+  };
+  typedef std::vector<JumpTableInfo> JumpTableVector;
+
+  // @returns the jump tables that have been instrumented, in increasing case
+  //     id order. This allows the per-case counters to be split into one
+  //     histogram per table.
+  const JumpTableVector& jump_table_infos() const { return jump_table_infos_; }
+
+  // @returns the total number of instrumented jump table cases.
+  size_t jump_table_case_count() const { return jump_table_case_count_; }
+
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
@@ -56,20 +88,12 @@ class JumpTableCaseCountTransform
   AddIndexedFrequencyDataTransform* add_frequency_data() {
     return &add_frequency_data_;
   }
-  BlockGraph::Reference* jump_table_case_counter_hook_ref() {
-    return &jump_table_case_counter_hook_ref_;
-  }
   // @}
 
  private:
   friend NamedBlockGraphTransformImpl<JumpTableCaseCountTransform>;
   friend IterativeTransformImpl<JumpTableCaseCountTransform>;
 
-  typedef core::RelativeAddress RelativeAddress;
-  // A pair containing the address of a jump-table and its size.
-  typedef std::pair<RelativeAddress, size_t> JumpTableInfo;
-  typedef std::vector<JumpTableInfo> JumpTableVector;
-
   // The name of this transform.
   static const char kTransformName[];
 
@@ -100,16 +124,14 @@ class JumpTableCaseCountTransform
   // instrumentation.
   AddIndexedFrequencyDataTransform add_frequency_data_;
 
-  // The entry hook to which jump table entry events are directed.
-  BlockGraph::Reference jump_table_case_counter_hook_ref_;
-
   // The instrumentation dll used by this transform.
   std::string instrument_dll_name_;
 
   // The counter used to get a unique ID for each case in a jump table.
   size_t jump_table_case_count_;
 
-  // The different jump tables encountered; we store their addresses and sizes.
+  // The different jump tables encountered; we store their addresses, sizes
+  // and the id of their first case.
   JumpTableVector jump_table_infos_;
 
   DISALLOW_COPY_AND_ASSIGN(JumpTableCaseCountTransform);
@@ -17,6 +17,7 @@
 #include "syzygy/instrument/transforms/jump_table_count_transform.h"
 
 #include "gtest/gtest.h"
+#include "syzygy/agent/basic_block_entry/basic_block_entry.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -41,10 +42,12 @@ using block_graph::BlockGraph;
 using block_graph::Instruction;
 using common::IndexedFrequencyData;
 
+typedef agent::basic_block_entry::BasicBlockEntry::
+    BasicBlockIndexedFrequencyData BasicBlockIndexedFrequencyData;
+
 class TestJumpTableCaseCountTransform : public JumpTableCaseCountTransform {
  public:
   using JumpTableCaseCountTransform::add_frequency_data;
-  using JumpTableCaseCountTransform::jump_table_case_counter_hook_ref;
   using JumpTableCaseCountTransform::thunk_section;
 
   BlockGraph::Block* frequency_data_block() {
@@ -71,16 +74,18 @@ void CheckBlockIsAThunk(BlockGraph::Block* block) {
   ASSERT_TRUE(bb != NULL);
   ASSERT_FALSE(bb->is_padding());
 
-  ASSERT_EQ(2U, bb->instructions().size());
+  // The thunk should increment the counter in place without calling the
+  // agent or altering the flags.
+  const uint16 kExpectedOpcodes[] = {
+      I_PUSH, I_PUSH, I_MOV, I_MOV, I_LEA, I_MOV, I_POP, I_POP };
+  ASSERT_EQ(arraysize(kExpectedOpcodes), bb->instructions().size());
   BasicBlock::Instructions::const_iterator inst_iter =
       bb->instructions().begin();
+  for (size_t i = 0; i < arraysize(kExpectedOpcodes); ++i, ++inst_iter)
+    EXPECT_EQ(kExpectedOpcodes[i], inst_iter->representation().opcode);
 
-  // Instruction 1 should push the case id.
-  EXPECT_EQ(I_PUSH, inst_iter->representation().opcode);
-
-  // Instruction 2 should call the jump table counter hook.
-  ++inst_iter;
-  EXPECT_EQ(I_CALL, inst_iter->representation().opcode);
+  // The thunk should then jump to the original case.
+  ASSERT_EQ(1U, bb->successors().size());
 
   EXPECT_EQ(BasicBlock::BASIC_END_BLOCK,
             (*subgraph.basic_blocks().rbegin())->type());
@@ -97,8 +102,6 @@ TEST_F(JumpTableCaseCountTransformTest, Apply) {
       &tx, policy_, &block_graph_, header_block_));
   ASSERT_TRUE(tx.frequency_data_block() != NULL);
   ASSERT_TRUE(tx.thunk_section() != NULL);
-  ASSERT_TRUE(tx.jump_table_case_counter_hook_ref() != NULL);
-  ASSERT_TRUE(tx.jump_table_case_counter_hook_ref()->IsValid());
 
   // Validate the jump table frequency data structure.
   block_graph::ConstTypedBlock<IndexedFrequencyData> frequency_data;
@@ -107,8 +110,9 @@ TEST_F(JumpTableCaseCountTransformTest, Apply) {
   EXPECT_EQ(common::kJumpTableCountAgentId, frequency_data->agent_id);
   EXPECT_EQ(common::kJumpTableFrequencyDataVersion, frequency_data->version);
   EXPECT_EQ(IndexedFrequencyData::JUMP_TABLE, frequency_data->data_type);
-  EXPECT_EQ(sizeof(IndexedFrequencyData), tx.frequency_data_block()->size());
-  EXPECT_EQ(sizeof(IndexedFrequencyData),
+  EXPECT_EQ(sizeof(BasicBlockIndexedFrequencyData),
+            tx.frequency_data_block()->size());
+  EXPECT_EQ(sizeof(BasicBlockIndexedFrequencyData),
             tx.frequency_data_block()->data_size());
   EXPECT_TRUE(frequency_data.HasReferenceAt(
       frequency_data.OffsetOf(frequency_data->frequency_data)));
@@ -164,7 +168,18 @@ TEST_F(JumpTableCaseCountTransformTest, Apply) {
       jump_table_entries += table_size;
     }
   }
-  DCHECK_EQ(frequency_data->num_entries, jump_table_entries);
+  EXPECT_EQ(frequency_data->num_entries, jump_table_entries);
+  EXPECT_EQ(jump_table_entries, tx.jump_table_case_count());
+
+  // The jump tables should map to contiguous ranges of counters covering the
+  // whole frequency data buffer.
+  size_t next_case_id = 0;
+  for (size_t i = 0; i < tx.jump_table_infos().size(); ++i) {
+    EXPECT_EQ(next_case_id, tx.jump_table_infos()[i].first_case_id);
+    EXPECT_LT(0U, tx.jump_table_infos()[i].size);
+    next_case_id += tx.jump_table_infos()[i].size;
+  }
+  EXPECT_EQ(jump_table_entries, next_case_id);
 }
 
 }  // namespace transforms
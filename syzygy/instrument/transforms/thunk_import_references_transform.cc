@@ -18,7 +18,9 @@
 // delayimp.h
 #undef FACILITY_VISUALCPP
 #include <delayimp.h>
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/strings/string_util.h"
@@ -55,6 +57,37 @@ typedef TypedBlock<ImgDelayDescr> ImageDelayImportDescriptor;
 const char kThunkSuffix[] = "_ImportThunk";
 const char kDelayThunkSuffix[] = "_DelayImportThunk";
 
+// The alignment of the first thunk, so that the most used ones share as few
+// cache lines as possible.
+const BlockGraph::Size kThunkAlignment = 64;
+
+// Identifies an IAT entry by its <iat block, offset>.
+typedef std::pair<const BlockGraph::Block*, BlockGraph::Offset> ThunkBlockKey;
+
+// An IAT entry to be thunked, along with all the <referrer, offset> sites
+// referring to it.
+struct ThunkedImport {
+  ThunkedImport() : name(NULL) {
+  }
+
+  ThunkBlockKey key;
+  BlockGraph::Reference destination;
+  const std::string* name;
+  std::vector<std::pair<BlockGraph::Block*, BlockGraph::Offset> > sites;
+};
+typedef std::vector<ThunkedImport> ThunkedImportVector;
+
+// Orders thunked imports by decreasing number of referring sites, and then by
+// their location in the IAT so that the resulting layout is deterministic.
+bool ThunkedImportIsMoreReferenced(const ThunkedImport& import1,
+                                   const ThunkedImport& import2) {
+  if (import1.sites.size() != import2.sites.size())
+    return import1.sites.size() > import2.sites.size();
+  if (import1.key.first->id() != import2.key.first->id())
+    return import1.key.first->id() < import2.key.first->id();
+  return import1.key.second < import2.key.second;
+}
+
 }  // namespace
 
 using pe::transforms::PEAddImportsTransform;
@@ -155,6 +188,11 @@ bool ThunkImportReferencesTransform::ModuleNameLess::operator()(
 // an indirect call or jump instruction, changing the address of the call
 // statement from an address into the IAT to an address into the thunk table
 // gets the thunk called properly.
+//
+// A single thunk is shared by all the references to a given IAT entry. The
+// thunks are created, and hence laid out, in decreasing order of the number of
+// sites referring to them, so that the most used thunks are packed together
+// at the start of a cache line.
 bool ThunkImportReferencesTransform::InstrumentImportReferences(
     BlockGraph* block_graph,
     const ImportAddressLocationNameMap& import_locations) {
@@ -173,29 +211,22 @@ bool ThunkImportReferencesTransform::InstrumentImportReferences(
     return false;
   }
 
-  // Typedef for the thunk block map. The key is the <iat block, offset> the
-  // (since all callers can use the same thunk) and the value is the offset into
-  // the thunk table that points to the thunk block for that IAT entry.
-  typedef std::pair<const BlockGraph::Block*, BlockGraph::Offset>
-      ThunkBlockKey;
-  typedef std::map<ThunkBlockKey, BlockGraph::Offset> ThunkBlockMap;
+  // The key is the <iat block, offset> of an import entry (since all callers
+  // can use the same thunk) and the value is the index of the corresponding
+  // entry in the list of thunked imports.
+  typedef std::map<ThunkBlockKey, size_t> ThunkBlockMap;
   ThunkBlockMap thunk_block_map;
+  ThunkedImportVector thunked_imports;
 
-  // Create the thunk table - we'll grow it as we go.
-  BlockGraph::Block* thunk_table_block =
-      block_graph->AddBlock(BlockGraph::DATA_BLOCK, 0, "ImportsThunkTable");
-  thunk_table_block->set_section(thunk_section_->id());
-  BlockGraph::Offset thunk_table_offset = 0;
-
-  // Now iterate through the import blocks and instrument the references.
+  // Iterate through the import blocks and gather the references to thunk,
+  // grouped by IAT entry.
   BlockSet::const_iterator it = import_blocks.begin();
   for (; it != import_blocks.end(); ++it) {
     BlockGraph::Block* iat_block = *it;
 
-    // Next, list all referrers to get all references into the IAT. For each
-    // eligible reference, create a thunk (in its own block) and add a pointer
-    // to it to the thunk table.
-    BlockGraph::Block::ReferrerSet iat_referrers(iat_block->referrers());
+    // List all referrers to get all references into the IAT.
+    const BlockGraph::Block::ReferrerSet& iat_referrers =
+        iat_block->referrers();
     BlockGraph::Block::ReferrerSet::const_iterator iat_referrer_iter(
         iat_referrers.begin());
     for (; iat_referrer_iter != iat_referrers.end(); ++iat_referrer_iter) {
@@ -248,48 +279,79 @@ bool ThunkImportReferencesTransform::InstrumentImportReferences(
         return false;
       }
 
-      // Look for the reference in the thunk block map, and only create a
-      // new one if it does not already exist.
-      BlockGraph::Block* thunk_block = NULL;
-      BlockGraph::Offset new_ref_offset = 0;
-
+      // Look for the IAT entry in the thunk block map, and only create a
+      // new entry if it does not already exist.
       ThunkBlockKey key(std::make_pair(iat_block, ref.offset()));
-      ThunkBlockMap::const_iterator thunk_it = thunk_block_map.find(key);
-      if (thunk_it == thunk_block_map.end()) {
-        // Create the thunk block for this offset into the IAT.
-        thunk_block = CreateOneThunk(block_graph, ref, it->second);
-        if (thunk_block == NULL) {
-          LOG(DFATAL) << "Unable to create thunk block.";
-          return false;
-        }
+      std::pair<ThunkBlockMap::iterator, bool> inserted =
+          thunk_block_map.insert(
+              std::make_pair(key, thunked_imports.size()));
+      if (inserted.second) {
+        thunked_imports.push_back(ThunkedImport());
+        thunked_imports.back().key = key;
+        thunked_imports.back().destination = ref;
+        thunked_imports.back().name = &it->second;
+      }
 
-        // Now add a reference to the thunk in the thunk table.
-        BlockGraph::Reference thunk_ref(BlockGraph::ABSOLUTE_REF,
-                                        sizeof(core::AbsoluteAddress),
-                                        thunk_block, 0, 0);
-        thunk_table_block->set_size(
-            thunk_table_offset + sizeof(core::AbsoluteAddress));
-        thunk_table_block->SetReference(thunk_table_offset, thunk_ref);
-
-        // Remember this thunk in case we need to use it again.
-        thunk_block_map[key] = thunk_table_offset;
-        new_ref_offset = thunk_table_offset;
-
-        // Move to the next empty entry in the thunk table.
-        thunk_table_offset += sizeof(core::AbsoluteAddress);
-        DCHECK_EQ(static_cast<BlockGraph::Size>(thunk_table_offset),
-                  thunk_table_block->size());
-      } else {
-        new_ref_offset = thunk_it->second;
+      ThunkedImport& thunked_import = thunked_imports[inserted.first->second];
+      thunked_import.sites.push_back(
+          std::make_pair(referrer, iat_referrer_iter->second));
+    }
+  }
+
+  if (thunked_imports.empty())
+    return true;
+
+  // Lay out the most referenced thunks first.
+  std::sort(thunked_imports.begin(), thunked_imports.end(),
+            &ThunkedImportIsMoreReferenced);
+
+  // Create the thunk table, which holds a pointer to each thunk.
+  BlockGraph::Block* thunk_table_block = block_graph->AddBlock(
+      BlockGraph::DATA_BLOCK,
+      thunked_imports.size() * sizeof(core::AbsoluteAddress),
+      "ImportsThunkTable");
+  thunk_table_block->set_section(thunk_section_->id());
+
+  // Now create the thunks and redirect their referrers.
+  for (size_t i = 0; i < thunked_imports.size(); ++i) {
+    const ThunkedImport& thunked_import = thunked_imports[i];
+
+    // Create the thunk block for this offset into the IAT.
+    BlockGraph::Block* thunk_block = CreateOneThunk(
+        block_graph, thunked_import.destination, *thunked_import.name);
+    if (thunk_block == NULL) {
+      LOG(DFATAL) << "Unable to create thunk block.";
+      return false;
+    }
+
+    // The thunks are packed back to back, starting on a cache line.
+    if (i == 0)
+      thunk_block->set_alignment(kThunkAlignment);
+
+    // Now add a reference to the thunk in the thunk table.
+    BlockGraph::Offset thunk_table_offset = i * sizeof(core::AbsoluteAddress);
+    BlockGraph::Reference thunk_ref(BlockGraph::ABSOLUTE_REF,
+                                    sizeof(core::AbsoluteAddress),
+                                    thunk_block, 0, 0);
+    thunk_table_block->SetReference(thunk_table_offset, thunk_ref);
+
+    // Update the referrers to point to the new location in the thunk table.
+    for (size_t j = 0; j < thunked_import.sites.size(); ++j) {
+      BlockGraph::Block* referrer = thunked_import.sites[j].first;
+      BlockGraph::Offset offset = thunked_import.sites[j].second;
+
+      BlockGraph::Reference ref;
+      if (!referrer->GetReference(offset, &ref)) {
+        LOG(ERROR) << "Unable to get reference from referrer.";
+        return false;
       }
 
-      // Update the referrer to point to the new location in the thunk table.
       BlockGraph::Reference new_ref(ref.type(),
                                     ref.size(),
                                     thunk_table_block,
-                                    new_ref_offset,
+                                    thunk_table_offset,
                                     0);
-      referrer->SetReference(iat_referrer_iter->second, new_ref);
+      referrer->SetReference(offset, new_ref);
     }
   }
 
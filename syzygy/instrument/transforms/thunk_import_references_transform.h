@@ -100,7 +100,9 @@ class ThunkImportReferencesTransform
   BlockGraph::Section* thunk_section() const { return thunk_section_; }
 
   // Instrument all references to @p iat_block that have an entry
-  // in @p import_locations, excluding references from @p iidt_block.
+  // in @p import_locations, excluding references from @p iidt_block. A single
+  // thunk is created per IAT entry, and the thunks are laid out by decreasing
+  // number of referring sites.
   // @param block_graph the block graph to operate on.
   // @param import_locations tags the entries to instrument.
   // @returns true on success, false on failure.
@@ -16,6 +16,9 @@
 
 #include "syzygy/instrument/transforms/thunk_import_references_transform.h"
 
+#include <limits>
+#include <map>
+#include <set>
 #include <vector>
 
 #include "base/files/scoped_temp_dir.h"
@@ -226,5 +229,63 @@ TEST_F(ThunkImportReferencesTransformTest, TestInstrumentation) {
   }
 }
 
+TEST_F(ThunkImportReferencesTransformTest, ThunkLayout) {
+  TestThunkImportReferencesTransform transform;
+  ASSERT_TRUE(ApplyBlockGraphTransform(
+      &transform, policy_, &block_graph_, header_block_));
+
+  BlockGraph::Section* thunks_section =
+      block_graph_.FindSection(common::kThunkSectionName);
+  ASSERT_TRUE(thunks_section != NULL);
+
+  // Find the thunk table.
+  BlockGraph::Block* thunk_table = NULL;
+  BlockGraph::BlockMap::iterator block_it =
+      block_graph_.blocks_mutable().begin();
+  for (; block_it != block_graph_.blocks_mutable().end(); ++block_it) {
+    if (block_it->second.section() == thunks_section->id() &&
+        block_it->second.type() == BlockGraph::DATA_BLOCK) {
+      ASSERT_TRUE(thunk_table == NULL);
+      thunk_table = &block_it->second;
+    }
+  }
+  ASSERT_TRUE(thunk_table != NULL);
+  ASSERT_FALSE(thunk_table->references().empty());
+
+  // Count the number of sites referring to each thunk table entry.
+  std::map<BlockGraph::Offset, size_t> site_counts;
+  const ReferrerSet& referrers = thunk_table->referrers();
+  ReferrerSet::const_iterator ref_it = referrers.begin();
+  for (; ref_it != referrers.end(); ++ref_it) {
+    BlockGraph::Reference ref;
+    ASSERT_TRUE(ref_it->first->GetReference(ref_it->second, &ref));
+    ++site_counts[ref.offset()];
+  }
+
+  // Each IAT entry has a single thunk, the thunks are ordered by decreasing
+  // number of referring sites, and the first one starts a cache line.
+  std::set<BlockGraph::Block*> thunks;
+  BlockGraph::Block* previous_thunk = NULL;
+  size_t previous_count = std::numeric_limits<size_t>::max();
+  BlockGraph::Block::ReferenceMap::const_iterator table_it =
+      thunk_table->references().begin();
+  for (; table_it != thunk_table->references().end(); ++table_it) {
+    BlockGraph::Block* thunk = table_it->second.referenced();
+    EXPECT_EQ(thunks_section->id(), thunk->section());
+    EXPECT_TRUE(thunks.insert(thunk).second);
+
+    size_t count = site_counts[table_it->first];
+    EXPECT_LT(0U, count);
+    EXPECT_GE(previous_count, count);
+    previous_count = count;
+
+    if (previous_thunk == NULL)
+      EXPECT_EQ(64U, thunk->alignment());
+    else
+      EXPECT_LT(previous_thunk->id(), thunk->id());
+    previous_thunk = thunk;
+  }
+}
+
 }  // namespace transforms
 }  // namespace instrument
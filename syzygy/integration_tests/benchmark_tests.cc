@@ -0,0 +1,101 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/integration_tests/benchmark_tests.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace testing {
+
+namespace {
+
+// The number of elements sorted by the computation kernel, and the number of
+// times it sorts them.
+const size_t kComputationArrayLength = 4096;
+const size_t kComputationRounds = 16;
+
+// The number of blocks allocated by each round of the allocation kernel, and
+// the number of rounds.
+const size_t kAllocationBlockCount = 1024;
+const size_t kAllocationRounds = 32;
+
+// A simple linear congruential generator, so that the kernels are
+// deterministic.
+unsigned int NextRandom(unsigned int* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+// A shell sort. It's implemented here rather than taken from the CRT so that
+// it gets instrumented.
+void ShellSort(unsigned int* values, size_t length) {
+  for (size_t gap = length / 2; gap > 0; gap /= 2) {
+    for (size_t i = gap; i < length; ++i) {
+      unsigned int value = values[i];
+      size_t j = i;
+      for (; j >= gap && values[j - gap] > value; j -= gap)
+        values[j] = values[j - gap];
+      values[j] = value;
+    }
+  }
+}
+
+}  // namespace
+
+unsigned int BenchmarkComputation() {
+  unsigned int values[kComputationArrayLength];
+  unsigned int seed = 42;
+  unsigned int checksum = 0;
+
+  for (size_t round = 0; round < kComputationRounds; ++round) {
+    for (size_t i = 0; i < kComputationArrayLength; ++i)
+      values[i] = NextRandom(&seed);
+    ShellSort(values, kComputationArrayLength);
+
+    for (size_t i = 0; i < kComputationArrayLength; ++i) {
+      if (values[i] & 1)
+        checksum += values[i];
+      else
+        checksum ^= values[i] << (i % 8);
+    }
+  }
+
+  return checksum;
+}
+
+unsigned int BenchmarkAllocation() {
+  char* blocks[kAllocationBlockCount] = {};
+  unsigned int seed = 42;
+  unsigned int checksum = 0;
+
+  for (size_t round = 0; round < kAllocationRounds; ++round) {
+    for (size_t i = 0; i < kAllocationBlockCount; ++i) {
+      size_t size = 1 + NextRandom(&seed) % 512;
+      blocks[i] = static_cast<char*>(::malloc(size));
+      ::memset(blocks[i], static_cast<int>(i), size);
+      checksum += blocks[i][size - 1];
+    }
+
+    // Free the blocks out of allocation order.
+    for (size_t i = 0; i < kAllocationBlockCount; i += 2)
+      ::free(blocks[i]);
+    for (size_t i = 1; i < kAllocationBlockCount; i += 2)
+      ::free(blocks[i]);
+  }
+
+  return checksum;
+}
+
+}  // namespace testing
@@ -0,0 +1,32 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the kernels used to measure the overhead of the instrumentation.
+// Each kernel does a fixed amount of work and returns a checksum of it, so
+// that the instrumented and original results can be compared.
+#ifndef SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
+#define SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
+
+namespace testing {
+
+// A CPU-bound kernel: branchy arithmetic and array accesses on the stack.
+unsigned int BenchmarkComputation();
+
+// An allocation-bound kernel: allocates, touches and frees heap blocks of
+// various sizes.
+unsigned int BenchmarkAllocation();
+
+}  // namespace testing
+
+#endif  // SYZYGY_INTEGRATION_TESTS_BENCHMARK_TESTS_H_
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <intrin.h>
+
 #include "base/environment.h"
 #include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
@@ -44,6 +46,7 @@
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_transform_policy.h"
 #include "syzygy/pe/unittest_util.h"
+#include "syzygy/testing/metrics.h"
 #include "syzygy/trace/agent_logger/agent_logger.h"
 #include "syzygy/trace/common/unittest_util.h"
 
@@ -86,6 +89,21 @@ const char kAsanHeapBufferOverflow[] = "SyzyASAN error: heap-buffer-overflow ";
 const char kAsanCorruptHeap[] = "SyzyASAN error: corrupt-heap ";
 const char kAsanHeapUseAfterFree[] = "SyzyASAN error: heap-use-after-free ";
 
+// The kernels run by the overhead benchmarks, and the names under which their
+// slowdowns are reported.
+struct BenchmarkKernel {
+  testing::EndToEndTestId test_id;
+  const char* name;
+};
+const BenchmarkKernel kBenchmarkKernels[] = {
+    { testing::kBenchmarkComputation, "Computation" },
+    { testing::kBenchmarkAllocation, "Allocation" },
+};
+
+// The number of times each benchmark kernel is run. The fastest run is kept,
+// to filter out the noise of the machine.
+const size_t kBenchmarkRepetitions = 5;
+
 // A convenience class for controlling an out of process agent_logger instance,
 // and getting the contents of its log file. Not thread safe.
 struct ScopedAgentLogger {
@@ -1099,6 +1117,54 @@ class InstrumentAppIntegrationTest : public testing::PELibUnitTest {
     env->UnSetVar(::common::kSyzyAsanOptionsEnvVar);
   }
 
+  // Runs a test function of the loaded test_dll several times.
+  // @param test The test function to run.
+  // @param result Receives the value returned by the test function.
+  // @returns the number of CPU cycles taken by the fastest run.
+  uint64 TimeTestDllFunction(testing::EndToEndTestId test,
+                             unsigned int* result) {
+    DCHECK(result != NULL);
+    uint64 min_cycles = kuint64max;
+    for (size_t i = 0; i < kBenchmarkRepetitions; ++i) {
+      uint64 start_cycles = ::__rdtsc();
+      *result = InvokeTestDllFunction(test);
+      min_cycles = std::min(min_cycles, ::__rdtsc() - start_cycles);
+    }
+    return min_cycles;
+  }
+
+  // Times the benchmark kernels in the original test_dll, then in test_dll
+  // instrumented in the given mode, and reports the slowdown of each kernel.
+  // The call trace service must be running for the modes that need it.
+  void BenchmarkTestDll(const std::string& mode) {
+    unsigned int results[arraysize(kBenchmarkKernels)] = {};
+    uint64 cycles[arraysize(kBenchmarkKernels)] = {};
+
+    ASSERT_NO_FATAL_FAILURE(LoadTestDll(input_dll_path_, &module_));
+    for (size_t i = 0; i < arraysize(kBenchmarkKernels); ++i) {
+      cycles[i] = TimeTestDllFunction(kBenchmarkKernels[i].test_id,
+                                      &results[i]);
+    }
+    ASSERT_NO_FATAL_FAILURE(UnloadDll());
+
+    ASSERT_NO_FATAL_FAILURE(EndToEndTest(mode));
+    for (size_t i = 0; i < arraysize(kBenchmarkKernels); ++i) {
+      unsigned int result = 0;
+      uint64 instrumented_cycles =
+          TimeTestDllFunction(kBenchmarkKernels[i].test_id, &result);
+
+      // The instrumentation mustn't change the behavior of the kernel.
+      EXPECT_EQ(results[i], result);
+
+      ASSERT_LT(0U, cycles[i]);
+      double slowdown = static_cast<double>(instrumented_cycles) / cycles[i];
+      testing::EmitMetric(
+          base::StringPrintf("Syzygy.InstrumentOverhead.%s.%s.Slowdown",
+                             mode.c_str(), kBenchmarkKernels[i].name),
+          slowdown);
+    }
+  }
+
   // Stashes the current log-level before each test instance and restores it
   // after each test completes.
   testing::ScopedLogLevelSaver log_level_saver;
@@ -1613,4 +1679,30 @@ TEST_F(InstrumentAppIntegrationTest, ProfileWithImportsEndToEnd) {
   ASSERT_NO_FATAL_FAILURE(ProfileCheckTestDll(true));
 }
 
+TEST_F(InstrumentAppIntegrationTest, AsanOverheadBenchmark) {
+  ASSERT_NO_FATAL_FAILURE(BenchmarkTestDll("asan"));
+}
+
+TEST_F(InstrumentAppIntegrationTest, BBEntryOverheadBenchmark) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(BenchmarkTestDll("bbentry"));
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_NO_FATAL_FAILURE(StopService());
+}
+
+TEST_F(InstrumentAppIntegrationTest, CoverageOverheadBenchmark) {
+  base::win::ScopedCOMInitializer scoped_com_initializer;
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(BenchmarkTestDll("coverage"));
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_NO_FATAL_FAILURE(StopService());
+}
+
+TEST_F(InstrumentAppIntegrationTest, ProfileOverheadBenchmark) {
+  ASSERT_NO_FATAL_FAILURE(StartService());
+  ASSERT_NO_FATAL_FAILURE(BenchmarkTestDll("profile"));
+  ASSERT_NO_FATAL_FAILURE(UnloadDll());
+  ASSERT_NO_FATAL_FAILURE(StopService());
+}
+
 }  // namespace integration_tests
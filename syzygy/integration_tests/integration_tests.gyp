@@ -68,6 +68,8 @@
         'bb_entry_tests.h',
         'behavior_tests.cc',
         'behavior_tests.h',
+        'benchmark_tests.cc',
+        'benchmark_tests.h',
         'coverage_tests.cc',
         'coverage_tests.h',
         'integration_tests_dll.cc',
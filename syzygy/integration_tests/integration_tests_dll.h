@@ -158,7 +158,9 @@ namespace testing {
          testing::AsanWritePageAllocationBodyAfterFree)  \
     decl(kAsanMemcmpAccessViolation, testing::AsanMemcmpAccessViolation)  \
     decl(kAsanCorruptBlockWithPageProtections,  \
-         testing::AsanCorruptBlockWithPageProtections)
+         testing::AsanCorruptBlockWithPageProtections)  \
+    decl(kBenchmarkComputation, testing::BenchmarkComputation)  \
+    decl(kBenchmarkAllocation, testing::BenchmarkAllocation)
 
 // This enumeration contains an unique id for each end to end test. It is used
 // to perform an indirect call through the DLL entry point 'EndToEndTest'.
@@ -18,6 +18,7 @@
 
 #include "base/logging.h"
 #include "syzygy/kasko/client.h"
+#include "syzygy/kasko/crash_keys_serialization.h"
 #include "syzygy/kasko/dll_lifetime.h"
 
 namespace kasko {
@@ -28,6 +29,13 @@ namespace {
 static_assert(sizeof(CrashKey) == 256u,
               "CrashKey struct size must match that of the "
               "google_breakpad::CustomInfoEntry struct.");
+static_assert(sizeof(CrashKey) == sizeof(CrashKeyTableEntry) &&
+                  CrashKey::kNameMaxLength ==
+                      CrashKeyTableEntry::kNameMaxLength &&
+                  CrashKey::kValueMaxLength ==
+                      CrashKeyTableEntry::kValueMaxLength,
+              "CrashKey struct layout must match that of the "
+              "CrashKeyTableEntry struct.");
 
 const DllLifetime* g_dll_lifetime;
 const Client* g_client = nullptr;
@@ -50,6 +58,20 @@ void InitializeClient(const base::char16* endpoint_name) {
   g_client = new Client(endpoint_name);
 }
 
+void InitializeClient(const base::char16* endpoint_name,
+                      const CrashKey* crash_keys,
+                      size_t crash_key_count) {
+  DCHECK(!g_dll_lifetime);
+  g_dll_lifetime = new DllLifetime;
+
+  DCHECK(!g_client);
+  DCHECK(endpoint_name);
+  DCHECK(crash_keys || !crash_key_count);
+  g_client = new Client(
+      endpoint_name, reinterpret_cast<const CrashKeyTableEntry*>(crash_keys),
+      crash_key_count);
+}
+
 void SendReport(const EXCEPTION_POINTERS* exception_pointers,
                 MinidumpType minidump_type,
                 const char* protobuf,
@@ -43,6 +43,18 @@ struct CrashKey {
 // @param endpoint_name The RPC endpoint name shared with the reporter process.
 KASKO_EXPORT void InitializeClient(const base::char16* endpoint_name);
 
+// Initializes a diagnostic reporting client in the current process, with a
+// crash key table maintained by the current process. The reporter process
+// reads the crash keys directly from the table when a report is sent, so they
+// don't have to be passed to SendReport.
+// @param endpoint_name The RPC endpoint name shared with the reporter process.
+// @param crash_keys The crash key table. Entries with empty names or values
+//     are ignored. The table must remain valid until ShutdownClient is called.
+// @param crash_key_count The number of entries in crash_keys.
+KASKO_EXPORT void InitializeClient(const base::char16* endpoint_name,
+                                   const CrashKey* crash_keys,
+                                   size_t crash_key_count);
+
 // Shuts down and frees resources associated with the previously initialized
 // client.
 KASKO_EXPORT void ShutdownClient();
@@ -53,7 +65,8 @@ KASKO_EXPORT void ShutdownClient();
 // @param protobuf An optional protobuf to be included in the report.
 // @param protobuf_length The length of the protobuf.
 // @param crash_keys An optional array of crash keys. Keys with empty names or
-//     values will be ignored.
+//     values will be ignored. These take precedence over the crash key table
+//     registered with InitializeClient.
 // @param crash_key_count The number of entries in crash_keys.
 KASKO_EXPORT void SendReport(const EXCEPTION_POINTERS* exception_pointers,
                              MinidumpType minidump_type,
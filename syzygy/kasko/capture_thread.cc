@@ -0,0 +1,167 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/kasko/capture_thread.h"
+
+#include <windows.h>
+
+#include "base/logging.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/com_utils.h"
+
+namespace kasko {
+
+namespace {
+
+// The signature of NtSuspendProcess and NtResumeProcess, which suspend and
+// resume all of the threads of a process at once.
+typedef LONG (NTAPI* NtProcessFunction)(HANDLE process);
+
+// Invokes NtSuspendProcess or NtResumeProcess.
+// @param function_name The name of the function.
+// @param process The process to suspend or resume.
+// @returns true if successful.
+bool InvokeNtProcessFunction(const char* function_name, HANDLE process) {
+  HMODULE ntdll = ::GetModuleHandle(L"ntdll.dll");
+  NtProcessFunction function = nullptr;
+  if (ntdll) {
+    function = reinterpret_cast<NtProcessFunction>(
+        ::GetProcAddress(ntdll, function_name));
+  }
+  if (!function) {
+    LOG(ERROR) << "Unable to find " << function_name << ".";
+    return false;
+  }
+  LONG status = function(process);
+  if (status < 0) {
+    LOG(ERROR) << function_name << " failed with status 0x" << std::hex
+               << status << std::dec << ".";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+CaptureRequest::CaptureRequest()
+    : process_id(0),
+      exception_info_address(0),
+      thread_id(0),
+      minidump_type(SMALL_DUMP_TYPE) {
+}
+
+CaptureRequest::~CaptureRequest() {
+}
+
+struct CaptureThread::PendingCapture {
+  CaptureRequest request;
+  // The target process, if it was suspended.
+  base::win::ScopedHandle suspended_process;
+};
+
+CaptureThread::CaptureThread(const Capturer& capturer)
+    : capturer_(capturer),
+      thread_(this, "capture_thread"),
+      condition_(&lock_),
+      stopping_(false) {
+}
+
+CaptureThread::~CaptureThread() {
+  if (thread_.HasBeenStarted() && !thread_.HasBeenJoined())
+    Stop();
+
+  // Requests queued on a thread that never ran are dropped, but their target
+  // processes must still be resumed.
+  while (!pending_captures_.empty()) {
+    ReleaseCapture(pending_captures_.front());
+    pending_captures_.pop_front();
+  }
+}
+
+void CaptureThread::Start() {
+  thread_.Start();
+}
+
+void CaptureThread::Capture(const CaptureRequest& request) {
+  PendingCapture* capture = new PendingCapture;
+  capture->request = request;
+
+  // Suspend the target process so that its state doesn't change while the
+  // request waits in the queue. The capture goes ahead unsuspended if this
+  // fails.
+  if (request.process_id != base::GetCurrentProcId()) {
+    base::win::ScopedHandle process(::OpenProcess(
+        PROCESS_SUSPEND_RESUME, FALSE, request.process_id));
+    if (!process.IsValid()) {
+      LOG(ERROR) << "Failed to open process " << request.process_id << ": "
+                 << ::common::LogWe();
+    } else if (InvokeNtProcessFunction("NtSuspendProcess", process.Get())) {
+      capture->suspended_process.Set(process.Take());
+    }
+  }
+
+  {
+    base::AutoLock auto_lock(lock_);
+    if (!stopping_) {
+      pending_captures_.push_back(capture);
+      condition_.Signal();
+      return;
+    }
+  }
+
+  LOG(ERROR) << "Dropping a capture request received while stopping.";
+  ReleaseCapture(capture);
+}
+
+void CaptureThread::Stop() {
+  {
+    base::AutoLock auto_lock(lock_);
+    stopping_ = true;
+    condition_.Signal();
+  }
+  thread_.Join();
+}
+
+void CaptureThread::Run() {
+  while (true) {
+    PendingCapture* capture = nullptr;
+    {
+      base::AutoLock auto_lock(lock_);
+      while (pending_captures_.empty() && !stopping_)
+        condition_.Wait();
+      // Drain the queue before stopping, so that no process is left
+      // suspended.
+      if (pending_captures_.empty())
+        return;
+      capture = pending_captures_.front();
+      pending_captures_.pop_front();
+    }
+
+    capturer_.Run(capture->request);
+    ReleaseCapture(capture);
+  }
+}
+
+// static
+void CaptureThread::ReleaseCapture(PendingCapture* capture) {
+  DCHECK(capture);
+  if (capture->suspended_process.IsValid()) {
+    InvokeNtProcessFunction("NtResumeProcess",
+                            capture->suspended_process.Get());
+  }
+  delete capture;
+}
+
+}  // namespace kasko
@@ -0,0 +1,116 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SYZYGY_KASKO_CAPTURE_THREAD_H_
+#define SYZYGY_KASKO_CAPTURE_THREAD_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "base/callback.h"
+#include "base/macros.h"
+#include "base/process/process_handle.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/kasko/minidump_type.h"
+
+namespace kasko {
+
+// A request for a diagnostic report of a process.
+struct CaptureRequest {
+  CaptureRequest();
+  ~CaptureRequest();
+
+  // The process to be reported on.
+  base::ProcessId process_id;
+  // An optional address (in the target process memory space) of an
+  // EXCEPTION_POINTERS structure.
+  uint64_t exception_info_address;
+  // The (optional) faulting thread in the target process.
+  base::PlatformThreadId thread_id;
+  // The type of minidump to be included in the report.
+  MinidumpType minidump_type;
+  // An optional protobuf to be included in the report.
+  std::string protobuf;
+  // Crash keys to be included in the report.
+  std::map<base::string16, base::string16> crash_keys;
+};
+
+// Captures diagnostic reports on a background thread, so that the threads
+// requesting them (RPC handlers, watchdogs) needn't wait for the minidump
+// generation, and so that a slow capture doesn't hold up other requests.
+//
+// The target process of a request is suspended when the request is queued, so
+// that its report reflects its state at the time of the request. It is resumed
+// once its report has been captured. The current process is never suspended.
+class CaptureThread : public base::DelegateSimpleThread::Delegate {
+ public:
+  // Captures the report of a request. This is invoked on the background thread,
+  // while the target process is suspended.
+  typedef base::Callback<void(const CaptureRequest&)> Capturer;
+
+  // @param capturer The callback that captures reports.
+  explicit CaptureThread(const Capturer& capturer);
+
+  // Stops the thread, if it was started. Requests that were never captured
+  // are dropped.
+  ~CaptureThread() override;
+
+  // Starts the background thread.
+  void Start();
+
+  // Queues a request. Returns once the target process is suspended.
+  // @param request The request to queue.
+  void Capture(const CaptureRequest& request);
+
+  // Captures the reports of the requests that are still queued, then stops the
+  // background thread. Blocks until the thread has terminated.
+  void Stop();
+
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override;
+
+ private:
+  // A queued request.
+  struct PendingCapture;
+
+  // Resumes the target process of a capture and deletes it.
+  // @param capture The capture to release.
+  static void ReleaseCapture(PendingCapture* capture);
+
+  Capturer capturer_;
+  base::DelegateSimpleThread thread_;
+
+  // Protects the members below.
+  base::Lock lock_;
+  // Signaled when a request is queued or the thread is asked to stop.
+  base::ConditionVariable condition_;
+  // The queued requests, in order of arrival.
+  std::deque<PendingCapture*> pending_captures_;  // Under lock_.
+  // Whether the thread is asked to stop.
+  bool stopping_;  // Under lock_.
+
+  DISALLOW_COPY_AND_ASSIGN(CaptureThread);
+};
+
+}  // namespace kasko
+
+#endif  // SYZYGY_KASKO_CAPTURE_THREAD_H_
@@ -0,0 +1,101 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/kasko/capture_thread.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/bind_helpers.h"
+#include "base/process/process_handle.h"
+#include "base/threading/platform_thread.h"
+#include "gtest/gtest.h"
+
+namespace kasko {
+
+namespace {
+
+// Records the requests received by a CaptureThread.
+class CaptureRecorder {
+ public:
+  CaptureRecorder() {}
+
+  void Capture(const CaptureRequest& request) {
+    // Captures only happen on the background thread.
+    EXPECT_NE(base::PlatformThread::CurrentId(), main_thread_id_);
+    requests_.push_back(request);
+  }
+
+  void set_main_thread_id(base::PlatformThreadId main_thread_id) {
+    main_thread_id_ = main_thread_id;
+  }
+
+  const std::vector<CaptureRequest>& requests() const { return requests_; }
+
+ private:
+  base::PlatformThreadId main_thread_id_;
+  std::vector<CaptureRequest> requests_;
+
+  DISALLOW_COPY_AND_ASSIGN(CaptureRecorder);
+};
+
+CaptureRequest CreateRequest(const base::string16& id) {
+  CaptureRequest request;
+  request.process_id = base::GetCurrentProcId();
+  request.minidump_type = SMALL_DUMP_TYPE;
+  request.protobuf = "protobuf";
+  request.crash_keys[L"id"] = id;
+  return request;
+}
+
+}  // namespace
+
+TEST(CaptureThreadTest, CapturesInOrder) {
+  CaptureRecorder recorder;
+  recorder.set_main_thread_id(base::PlatformThread::CurrentId());
+  CaptureThread capture_thread(
+      base::Bind(&CaptureRecorder::Capture, base::Unretained(&recorder)));
+
+  // Requests that arrive before the thread is started are kept.
+  capture_thread.Capture(CreateRequest(L"1"));
+  capture_thread.Start();
+  capture_thread.Capture(CreateRequest(L"2"));
+  capture_thread.Capture(CreateRequest(L"3"));
+
+  // Stopping drains the queue.
+  capture_thread.Stop();
+
+  ASSERT_EQ(3u, recorder.requests().size());
+  EXPECT_EQ(L"1", recorder.requests()[0].crash_keys.at(L"id"));
+  EXPECT_EQ(L"2", recorder.requests()[1].crash_keys.at(L"id"));
+  EXPECT_EQ(L"3", recorder.requests()[2].crash_keys.at(L"id"));
+  EXPECT_EQ("protobuf", recorder.requests()[0].protobuf);
+  EXPECT_EQ(base::GetCurrentProcId(), recorder.requests()[0].process_id);
+}
+
+TEST(CaptureThreadTest, DropsRequestsAfterStop) {
+  CaptureRecorder recorder;
+  recorder.set_main_thread_id(base::PlatformThread::CurrentId());
+  CaptureThread capture_thread(
+      base::Bind(&CaptureRecorder::Capture, base::Unretained(&recorder)));
+
+  capture_thread.Start();
+  capture_thread.Stop();
+  capture_thread.Capture(CreateRequest(L"1"));
+
+  EXPECT_TRUE(recorder.requests().empty());
+}
+
+}  // namespace kasko
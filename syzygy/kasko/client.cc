@@ -28,7 +28,17 @@
 
 namespace kasko {
 
-Client::Client(const base::string16& endpoint) : endpoint_(endpoint) {
+Client::Client(const base::string16& endpoint)
+    : endpoint_(endpoint), crash_key_table_(nullptr), crash_key_table_size_(0) {
+}
+
+Client::Client(const base::string16& endpoint,
+               const CrashKeyTableEntry* crash_key_table,
+               size_t crash_key_table_size)
+    : endpoint_(endpoint),
+      crash_key_table_(crash_key_table),
+      crash_key_table_size_(crash_key_table_size) {
+  DCHECK(crash_key_table || !crash_key_table_size);
 }
 
 Client::~Client(){
@@ -40,9 +50,11 @@ void Client::SendReport(const EXCEPTION_POINTERS* exception_pointers,
                         size_t protobuf_length,
                         const base::char16* const* keys,
                         const base::char16* const* values) const {
-  // Establish the RPC binding.
-  common::rpc::ScopedRpcBinding rpc_binding;
-  if (!rpc_binding.Open(L"ncalrpc", endpoint_)) {
+  // Get the RPC binding. It is pooled, so that it's only created for the first
+  // report sent to this endpoint.
+  handle_t rpc_binding = NULL;
+  if (!common::rpc::RpcBindingPool::Instance()->Get(L"ncalrpc", endpoint_,
+                                                    &rpc_binding)) {
     LOG(ERROR) << "Failed to open an RPC binding.";
     return;
   }
@@ -90,11 +102,13 @@ void Client::SendReport(const EXCEPTION_POINTERS* exception_pointers,
 
   // Invoke SendDiagnosticReport via RPC.
   common::rpc::RpcStatus status = common::rpc::InvokeRpc(
-      KaskoClient_SendDiagnosticReport, rpc_binding.Get(),
+      KaskoClient_SendDiagnosticReport, rpc_binding,
       reinterpret_cast<unsigned long>(exception_pointers),
       base::PlatformThread::CurrentId(), rpc_dump_type, protobuf_length,
       reinterpret_cast<const signed char*>(protobuf ? protobuf : ""),
-      utf8_crash_keys.size(), crash_keys.get());
+      utf8_crash_keys.size(), crash_keys.get(),
+      reinterpret_cast<unsigned long>(crash_key_table_),
+      crash_key_table_size_);
 
   if (!status.succeeded())
     LOG(ERROR) << "Failed to invoke the SendDiagnosticReport RPC.";
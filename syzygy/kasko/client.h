@@ -23,6 +23,8 @@
 
 namespace kasko {
 
+struct CrashKeyTableEntry;
+
 // Implements the client process lifetime. Holds configuration and provides an
 // API for triggering a diagnostic report of the current process..
 class Client {
@@ -32,6 +34,18 @@ class Client {
   //     process.
   explicit Client(const base::string16& endpoint);
 
+  // Instantiates a diagnostic reporting client with a crash key table. The
+  // table is read directly by the reporter process when a report is sent, so
+  // its crash keys don't have to be passed to SendReport.
+  // @param endpoint_name The RPC endpoint name shared with the reporter
+  //     process.
+  // @param crash_key_table The crash key table, which must remain valid for
+  //     the lifetime of the client.
+  // @param crash_key_table_size The number of entries of |crash_key_table|.
+  Client(const base::string16& endpoint,
+         const CrashKeyTableEntry* crash_key_table,
+         size_t crash_key_table_size);
+
   ~Client();
 
   // Sends a diagnostic report for the current process.
@@ -41,7 +55,8 @@ class Client {
   // @param protobuf_length The length of the protobuf.
   // @param keys An optional null-terminated array of crash key names
   // @param values An optional null-terminated array of crash key values. Must
-  //     be of equal length to |keys|.
+  //     be of equal length to |keys|. These take precedence over the crash
+  //     key table.
   void SendReport(const EXCEPTION_POINTERS* exception_pointers,
                   MinidumpType minidump_type,
                   const char* protobuf,
@@ -53,6 +68,10 @@ class Client {
   // The RPC endpoint name shared with the reporter process.
   const base::string16 endpoint_;
 
+  // The crash key table of the current process, if any.
+  const CrashKeyTableEntry* crash_key_table_;
+  size_t crash_key_table_size_;
+
   DISALLOW_COPY_AND_ASSIGN(Client);
 };
 
@@ -26,6 +26,7 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "gtest/gtest.h"
+#include "syzygy/kasko/crash_keys_serialization.h"
 #include "syzygy/kasko/service_bridge.h"
 #include "syzygy/kasko/testing/mock_service.h"
 
@@ -86,4 +87,41 @@ TEST(ClientTest, BasicTest) {
   ASSERT_EQ(LARGER_DUMP_TYPE, call_log[1].minidump_type);
 }
 
+TEST(ClientTest, CrashKeyTable) {
+  std::vector<testing::MockService::CallRecord> call_log;
+
+  base::string16 protocol = kValidRpcProtocol;
+  base::string16 endpoint = GetTestEndpoint();
+  ServiceBridge instance(
+      protocol, endpoint,
+      scoped_ptr<Service>(new testing::MockService(&call_log)));
+  ASSERT_TRUE(instance.Run());
+
+  base::ScopedClosureRunner stop_service_bridge(
+      base::Bind(&ServiceBridge::Stop, base::Unretained(&instance)));
+
+  CrashKeyTableEntry crash_key_table[3] = {};
+  ::wcscpy_s(crash_key_table[0].name, L"foo");
+  ::wcscpy_s(crash_key_table[0].value, L"table");
+  ::wcscpy_s(crash_key_table[2].name, L"hello");
+  ::wcscpy_s(crash_key_table[2].value, L"world");
+  Client client(endpoint, crash_key_table, arraysize(crash_key_table));
+
+  // The table is read when the report is sent, and the crash keys passed to
+  // SendReport take precedence.
+  ::wcscpy_s(crash_key_table[2].value, L"again");
+  base::char16* keys[] = {L"foo", nullptr};
+  base::char16* values[] = {L"bar", nullptr};
+  client.SendReport(nullptr, SMALL_DUMP_TYPE, nullptr, 0, keys, values);
+
+  ASSERT_EQ(1u, call_log.size());
+  ASSERT_EQ(2u, call_log[0].crash_keys.size());
+  auto entry = call_log[0].crash_keys.find(L"foo");
+  ASSERT_NE(call_log[0].crash_keys.end(), entry);
+  ASSERT_EQ(L"bar", entry->second);
+  entry = call_log[0].crash_keys.find(L"hello");
+  ASSERT_NE(call_log[0].crash_keys.end(), entry);
+  ASSERT_EQ(L"again", entry->second);
+}
+
 }  // namespace kasko
@@ -22,9 +22,64 @@
 #include "base/json/json_writer.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/utf_string_conversions.h"
+#include "syzygy/common/com_utils.h"
 
 namespace kasko {
 
+namespace {
+
+// Returns true if |buffer| is a null-terminated string whose length is greater
+// than 0 and less than |buffer_length|.
+bool IsValidNonEmptyString(const base::char16* buffer, size_t buffer_length) {
+  size_t string_length = ::wcsnlen(buffer, buffer_length);
+  return string_length > 0 && string_length < buffer_length;
+}
+
+}  // namespace
+
+bool ReadCrashKeysFromProcess(
+    HANDLE process,
+    uint64_t table_address,
+    size_t table_size,
+    std::map<base::string16, base::string16>* crash_keys) {
+  DCHECK(process);
+  DCHECK(crash_keys);
+  if (!table_address || !table_size)
+    return true;
+
+  if (table_size > kMaxCrashKeyTableSize) {
+    LOG(WARNING) << "Truncating a crash key table of " << table_size
+                 << " entries.";
+    table_size = kMaxCrashKeyTableSize;
+  }
+
+  // The whole table is read at once, so that the client has nothing to do
+  // but keep it up to date.
+  scoped_ptr<CrashKeyTableEntry[]> table(new CrashKeyTableEntry[table_size]);
+  SIZE_T bytes_read = 0;
+  if (!::ReadProcessMemory(process,
+                           reinterpret_cast<const void*>(
+                               static_cast<uintptr_t>(table_address)),
+                           table.get(), table_size * sizeof(table[0]),
+                           &bytes_read) ||
+      bytes_read != table_size * sizeof(table[0])) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to read the crash key table: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  for (size_t i = 0; i < table_size; ++i) {
+    const CrashKeyTableEntry& entry = table[i];
+    if (!IsValidNonEmptyString(entry.name, arraysize(entry.name)) ||
+        !IsValidNonEmptyString(entry.value, arraysize(entry.value))) {
+      continue;
+    }
+    crash_keys->insert(std::make_pair(entry.name, entry.value));
+  }
+  return true;
+}
+
 bool ReadCrashKeysFromFile(
     const base::FilePath& file_path,
     std::map<base::string16, base::string16>* crash_keys) {
@@ -15,6 +15,9 @@
 #ifndef SYZYGY_KASKO_CRASH_KEYS_SERIALIZATION_H_
 #define SYZYGY_KASKO_CRASH_KEYS_SERIALIZATION_H_
 
+#include <windows.h>
+#include <stdint.h>
+
 #include <map>
 #include "base/strings/string16.h"
 
@@ -24,6 +27,41 @@ class FilePath;
 
 namespace kasko {
 
+// An entry of a crash key table, an array of crash keys that a client process
+// maintains in its own memory. The table is registered once, and the service
+// reads it directly from the memory of the client when a report is requested.
+// This has the same layout as api::CrashKey.
+struct CrashKeyTableEntry {
+  // Maximum name length.
+  static const size_t kNameMaxLength = 64;
+  // Maximum value length.
+  static const size_t kValueMaxLength = 64;
+
+  // The name of the crash key. Entries with an empty name are ignored.
+  base::char16 name[kNameMaxLength];
+  // The value of the crash key. Entries with an empty value are ignored.
+  base::char16 value[kValueMaxLength];
+};
+
+// The maximum number of entries of a crash key table.
+const size_t kMaxCrashKeyTableSize = 1024;
+
+// Reads the crash keys of a crash key table from the memory of a process, in
+// a single read. Entries with an empty or unterminated name or value are
+// ignored, as are the names that are already in @p crash_keys.
+// @param process A handle to the process, with the PROCESS_VM_READ access
+//     right.
+// @param table_address The address of the crash key table in @p process.
+// @param table_size The number of entries of the table. At most
+//     kMaxCrashKeyTableSize entries are read.
+// @param crash_keys A map to store the crash keys in.
+// @returns true if the operation succeeds.
+bool ReadCrashKeysFromProcess(
+    HANDLE process,
+    uint64_t table_address,
+    size_t table_size,
+    std::map<base::string16, base::string16>* crash_keys);
+
 // Reads serialized crash keys.
 // @param file_path The file to read from.
 // @param crash_keys A map to store the deserialized crash keys in.
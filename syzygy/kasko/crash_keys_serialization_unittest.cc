@@ -28,6 +28,51 @@
 
 namespace kasko {
 
+TEST(CrashKeysSerializationTest, ReadCrashKeysFromProcess) {
+  CrashKeyTableEntry table[4] = {};
+  ::wcscpy_s(table[0].name, L"name");
+  ::wcscpy_s(table[0].value, L"value");
+  // Entries without a name or a value are ignored.
+  ::wcscpy_s(table[1].name, L"empty");
+  ::wcscpy_s(table[2].value, L"nameless");
+  // As are entries that aren't terminated.
+  ::wmemset(table[3].name, L'x', arraysize(table[3].name));
+  ::wcscpy_s(table[3].value, L"unterminated");
+
+  // The crash keys that are already known are kept.
+  std::map<base::string16, base::string16> crash_keys;
+  crash_keys[L"name"] = L"known";
+  crash_keys[L"other"] = L"other value";
+  ASSERT_TRUE(ReadCrashKeysFromProcess(::GetCurrentProcess(),
+                                       reinterpret_cast<uintptr_t>(table),
+                                       arraysize(table), &crash_keys));
+  std::map<base::string16, base::string16> expected_crash_keys;
+  expected_crash_keys[L"name"] = L"known";
+  expected_crash_keys[L"other"] = L"other value";
+  EXPECT_EQ(expected_crash_keys, crash_keys);
+
+  crash_keys.clear();
+  ASSERT_TRUE(ReadCrashKeysFromProcess(::GetCurrentProcess(),
+                                       reinterpret_cast<uintptr_t>(table),
+                                       arraysize(table), &crash_keys));
+  expected_crash_keys.clear();
+  expected_crash_keys[L"name"] = L"value";
+  EXPECT_EQ(expected_crash_keys, crash_keys);
+
+  // An empty table has no crash keys.
+  crash_keys.clear();
+  ASSERT_TRUE(ReadCrashKeysFromProcess(::GetCurrentProcess(), 0, 0,
+                                       &crash_keys));
+  EXPECT_TRUE(crash_keys.empty());
+}
+
+TEST(CrashKeysSerializationTest, ReadCrashKeysFromProcessInvalidAddress) {
+  // The first page of the address space is never mapped.
+  std::map<base::string16, base::string16> crash_keys;
+  EXPECT_FALSE(ReadCrashKeysFromProcess(::GetCurrentProcess(), 0x10, 1,
+                                        &crash_keys));
+}
+
 TEST(CrashKeysSerializationTest, BasicTest) {
   base::ScopedTempDir temp_dir;
   ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <string>
 
+#include "base/files/file_path.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
 
@@ -46,6 +47,25 @@ class HttpAgent {
                                         bool secure,
                                         const base::string16& extra_headers,
                                         const std::string& body) = 0;
+
+  // Issues an HTTP POST request whose body is read from a file, a chunk at a
+  // time, so that large bodies needn't be held in memory.
+  // @param host The target host.
+  // @param port The target port.
+  // @param path The resource path.
+  // @param secure Whether to use HTTPS.
+  // @param extra_headers Zero or more CRLF-delimited HTTP header lines to
+  //     include in the request.
+  // @param body_path The path to the file containing the request body.
+  // @returns NULL if the request fails for any reason. Otherwise, returns an
+  //     HttpResponse that may be used to access the HTTP response.
+  virtual scoped_ptr<HttpResponse> PostFile(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      const base::FilePath& body_path) = 0;
 };
 
 }  // namespace kasko
@@ -17,14 +17,21 @@
 #include <windows.h>
 #include <winhttp.h>
 
+#include <algorithm>
+#include <limits>
+#include <map>
 #include <string>
+#include <utility>
 
 #include "base/file_version_info.h"
 #include "base/logging.h"
 #include "base/macros.h"
 #include "base/sys_info.h"
+#include "base/files/file.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
 #include "base/win/scoped_handle.h"
 #include "base/win/windows_version.h"
 #include "syzygy/common/com_utils.h"
@@ -36,6 +43,11 @@ namespace kasko {
 
 namespace {
 
+// The option enabling HTTP/2, and its flag, which older SDKs don't define.
+// Versions of WinHTTP that don't support HTTP/2 reject the option.
+const DWORD kWinHttpOptionEnableHttpProtocol = 133;
+const DWORD kWinHttpProtocolFlagHttp2 = 0x1;
+
 class WinHttpHandleTraits {
  public:
   typedef HINTERNET Handle;
@@ -53,6 +65,43 @@ typedef base::win::GenericScopedHandle<WinHttpHandleTraits,
                                        base::win::DummyVerifierTraits>
     ScopedWinHttpHandle;
 
+// A WinHTTP handle shared between an HttpAgentImpl and the responses to its
+// requests. Each handle holds a reference to its parent, so that a session
+// outlives its connections and a connection outlives its requests.
+class SharedWinHttpHandle
+    : public base::RefCountedThreadSafe<SharedWinHttpHandle> {
+ public:
+  // @param handle The handle to take ownership of. Must be valid.
+  // @param parent The handle that |handle| was opened from, if any.
+  SharedWinHttpHandle(HINTERNET handle, SharedWinHttpHandle* parent)
+      : parent_(parent), handle_(handle) {
+    DCHECK(handle_.IsValid());
+  }
+
+  HINTERNET Get() const { return handle_.Get(); }
+  SharedWinHttpHandle* parent() const { return parent_.get(); }
+
+ private:
+  friend class base::RefCountedThreadSafe<SharedWinHttpHandle>;
+  ~SharedWinHttpHandle() {}
+
+  // Declared after |parent_| so that it is closed first.
+  scoped_refptr<SharedWinHttpHandle> parent_;
+  ScopedWinHttpHandle handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedWinHttpHandle);
+};
+
+// An open connection to a host and port, with the proxy auto-configuration
+// settings of its session.
+struct WinHttpConnection {
+  WinHttpConnection() : auto_detect_proxy(false) {}
+
+  scoped_refptr<SharedWinHttpHandle> connection;
+  bool auto_detect_proxy;
+  base::string16 auto_config_url;
+};
+
 // A helper class that retrieves and frees user proxy settings.
 class AutoWinHttpProxyConfig {
  public:
@@ -117,11 +166,13 @@ class AutoWinHttpProxyConfig {
 // A helper class that retrieves and frees URL-specific proxy settings.
 class AutoWinHttpUrlProxyConfig {
  public:
-  // Constructs an instance that will use the auto-configuration URL (if any)
-  // from |proxy_config| to retrieve URL-specific proxy settings.
-  explicit AutoWinHttpUrlProxyConfig(const AutoWinHttpProxyConfig& proxy_config)
-      : auto_detect_(proxy_config.auto_detect()),
-        auto_config_url_(proxy_config.auto_config_url()),
+  // Constructs an instance that will use auto-detection if |auto_detect| is
+  // true, and the auto-configuration URL |auto_config_url| if it is not empty,
+  // to retrieve URL-specific proxy settings.
+  AutoWinHttpUrlProxyConfig(bool auto_detect,
+                            const base::string16& auto_config_url)
+      : auto_detect_(auto_detect),
+        auto_config_url_(auto_config_url),
         is_valid_(false),
         url_proxy_config_() {}
 
@@ -204,21 +255,109 @@ class AutoWinHttpUrlProxyConfig {
   DISALLOW_COPY_AND_ASSIGN(AutoWinHttpUrlProxyConfig);
 };
 
+// Provides the body of a request, a chunk at a time.
+class RequestBody {
+ public:
+  virtual ~RequestBody() {}
+
+  // @returns the total size of the body.
+  virtual size_t size() const = 0;
+
+  // Reads the next chunk of the body.
+  // @param buffer The buffer that receives the chunk.
+  // @param count On input, the size of |buffer|. On output, the size of the
+  //     chunk, which is 0 at the end of the body.
+  // @returns true if successful.
+  virtual bool Read(char* buffer, size_t* count) = 0;
+};
+
+// A request body that is held in memory.
+class StringRequestBody : public RequestBody {
+ public:
+  explicit StringRequestBody(const std::string& body)
+      : body_(body), offset_(0) {}
+
+  // RequestBody implementation.
+  virtual size_t size() const override { return body_.size(); }
+  virtual bool Read(char* buffer, size_t* count) override {
+    DCHECK(buffer);
+    DCHECK(count);
+    *count = std::min(*count, body_.size() - offset_);
+    ::memcpy(buffer, body_.data() + offset_, *count);
+    offset_ += *count;
+    return true;
+  }
+
+ private:
+  const std::string& body_;
+  size_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringRequestBody);
+};
+
+// A request body that is read from a file.
+class FileRequestBody : public RequestBody {
+ public:
+  FileRequestBody() : size_(0) {}
+
+  // Opens the file containing the body.
+  // @param path The path to the file.
+  // @returns true if successful.
+  bool Open(const base::FilePath& path) {
+    file_.Initialize(path, base::File::FLAG_OPEN | base::File::FLAG_READ);
+    if (!file_.IsValid()) {
+      LOG(ERROR) << "Failed to open " << path.value();
+      return false;
+    }
+    int64_t length = file_.GetLength();
+    if (length < 0 ||
+        static_cast<uint64_t>(length) > std::numeric_limits<DWORD>::max()) {
+      LOG(ERROR) << "Invalid request body size for " << path.value();
+      return false;
+    }
+    size_ = static_cast<size_t>(length);
+    return true;
+  }
+
+  // RequestBody implementation.
+  virtual size_t size() const override { return size_; }
+  virtual bool Read(char* buffer, size_t* count) override {
+    DCHECK(buffer);
+    DCHECK(count);
+    int bytes_read = file_.ReadAtCurrentPos(
+        buffer, static_cast<int>(std::min<size_t>(
+                    *count, std::numeric_limits<int>::max())));
+    if (bytes_read < 0) {
+      LOG(ERROR) << "Failed to read the request body.";
+      return false;
+    }
+    *count = bytes_read;
+    return true;
+  }
+
+ private:
+  base::File file_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileRequestBody);
+};
+
 // Implements HttpResponse using the WinHTTP API.
 class HttpResponseImpl : public HttpResponse {
  public:
   virtual ~HttpResponseImpl() override;
 
-  // Issues the request defined by its parameters and, if successful, returns an
-  // HttpResponse that may be used to access the response. See HttpAgent::Post
-  // for a description of the parameters.
-  static scoped_ptr<HttpResponse> Create(const base::string16& user_agent,
+  // Issues the request defined by its parameters on |connection| and, if
+  // successful, returns an HttpResponse that may be used to access the
+  // response. See HttpAgent::Post for a description of the other parameters.
+  // The body is sent a chunk at a time.
+  static scoped_ptr<HttpResponse> Create(const WinHttpConnection& connection,
                                          const base::string16& host,
                                          uint16_t port,
                                          const base::string16& path,
                                          bool secure,
                                          const base::string16& extra_headers,
-                                         const std::string& body);
+                                         RequestBody* body);
 
   // HttpResponse implementation.
   virtual bool GetStatusCode(uint16_t* status_code) override;
@@ -241,10 +380,9 @@ class HttpResponseImpl : public HttpResponse {
                    void* buffer,
                    DWORD buffer_length);
 
-  // WinHttp handles used for the request.
-  ScopedWinHttpHandle session_;
-  ScopedWinHttpHandle connection_;
-  ScopedWinHttpHandle request_;
+  // The WinHttp handle of the request, which keeps its connection and session
+  // open.
+  scoped_refptr<SharedWinHttpHandle> request_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpResponseImpl);
 };
@@ -253,64 +391,47 @@ HttpResponseImpl::~HttpResponseImpl() {}
 
 // static
 scoped_ptr<HttpResponse> HttpResponseImpl::Create(
-    const base::string16& user_agent,
+    const WinHttpConnection& connection,
     const base::string16& host,
     uint16_t port,
     const base::string16& path,
     bool secure,
     const base::string16& extra_headers,
-    const std::string& body) {
-  // Retrieve the user's proxy configuration.
-  AutoWinHttpProxyConfig proxy_config;
-  if (!proxy_config.Load())
-    return scoped_ptr<HttpResponse>();
+    RequestBody* body) {
+  DCHECK(connection.connection.get());
+  DCHECK(body);
 
   // Tentatively create an instance. We will return it if we are able to
   // successfully initialize it.
   scoped_ptr<HttpResponseImpl> instance(new HttpResponseImpl);
 
-  // Open a WinHTTP session.
-  instance->session_.Set(
-      ::WinHttpOpen(user_agent.c_str(), proxy_config.access_type(),
-                    proxy_config.proxy(), proxy_config.proxy_bypass(), 0));
-  if (!instance->session_) {
-    LOG(ERROR) << "WinHttpOpen() failed: " << ::common::LogWe();
-    return scoped_ptr<HttpResponse>();
-  }
-
   // Look up URL-specific proxy settings.
-  AutoWinHttpUrlProxyConfig url_proxy_config(proxy_config);
-  if (!url_proxy_config.Load(instance->session_.Get(),
+  AutoWinHttpUrlProxyConfig url_proxy_config(connection.auto_detect_proxy,
+                                             connection.auto_config_url);
+  if (!url_proxy_config.Load(connection.connection->parent()->Get(),
                              ComposeUrl(host, port, path, secure))) {
     return scoped_ptr<HttpResponse>();
   }
 
-  // Connect to a host/port.
-  instance->connection_.Set(
-      ::WinHttpConnect(instance->session_.Get(), host.c_str(), port, 0));
-  if (!instance->connection_) {
-    LOG(ERROR) << "WinHttpConnect() failed with host " << host << " and port "
-               << port << ": " << ::common::LogWe();
-    return scoped_ptr<HttpResponse>();
-  }
-
   // Initiate a request. This doesn't actually send the request yet.
-  instance->request_.Set(
-      ::WinHttpOpenRequest(instance->connection_.Get(), L"POST", path.c_str(),
+  HINTERNET request =
+      ::WinHttpOpenRequest(connection.connection->Get(), L"POST", path.c_str(),
                            NULL,  // version
                            NULL,  // referer
                            NULL,  // accept types
-                           secure ? WINHTTP_FLAG_SECURE : 0));
-  if (!instance->connection_) {
-    LOG(ERROR) << "WinHttpConnect() failed with host " << host << " and port "
-               << port << ": " << ::common::LogWe();
+                           secure ? WINHTTP_FLAG_SECURE : 0);
+  if (!request) {
+    LOG(ERROR) << "WinHttpOpenRequest() failed with host " << host
+               << " and port " << port << ": " << ::common::LogWe();
     return scoped_ptr<HttpResponse>();
   }
+  instance->request_ =
+      new SharedWinHttpHandle(request, connection.connection.get());
 
   // Disable cookies and authentication. This request should be completely
   // stateless and untied to any identity of any sort.
   DWORD option_value = WINHTTP_DISABLE_COOKIES | WINHTTP_DISABLE_AUTHENTICATION;
-  if (!::WinHttpSetOption(instance->request_.Get(),
+  if (!::WinHttpSetOption(instance->request_->Get(),
                           WINHTTP_OPTION_DISABLE_FEATURE, &option_value,
                           sizeof(option_value))) {
     LOG(ERROR) << "WinHttpSetOption(WINHTTP_DISABLE_COOKIES | "
@@ -321,7 +442,7 @@ scoped_ptr<HttpResponse> HttpResponseImpl::Create(
 
   // If this URL is configured to use a proxy, set that up now.
   if (url_proxy_config.get()) {
-    if (!::WinHttpSetOption(instance->request_.Get(), WINHTTP_OPTION_PROXY,
+    if (!::WinHttpSetOption(instance->request_->Get(), WINHTTP_OPTION_PROXY,
                             url_proxy_config.get(),
                             sizeof(*url_proxy_config.get()))) {
       LOG(ERROR) << "WinHttpSetOption(WINHTTP_OPTION_PROXY) failed: "
@@ -330,20 +451,44 @@ scoped_ptr<HttpResponse> HttpResponseImpl::Create(
     }
   }
 
-  // Send the request.
-  if (!::WinHttpSendRequest(instance->request_.Get(), extra_headers.c_str(),
-                            static_cast<DWORD>(-1),
-                            const_cast<char*>(body.data()),
-                            static_cast<DWORD>(body.size()),
-                            static_cast<DWORD>(body.size()), NULL)) {
+  // Send the request headers.
+  if (!::WinHttpSendRequest(instance->request_->Get(), extra_headers.c_str(),
+                            static_cast<DWORD>(-1), WINHTTP_NO_REQUEST_DATA, 0,
+                            static_cast<DWORD>(body->size()), NULL)) {
     LOG(ERROR) << "Failed to send HTTP request to host " << host << " and port "
                << port << ": " << ::common::LogWe();
     return scoped_ptr<HttpResponse>();
   }
 
+  // Send the body, a chunk at a time.
+  static const size_t kChunkSize = 64 * 1024;
+  scoped_ptr<char[]> chunk(new char[kChunkSize]);
+  size_t total_written = 0;
+  while (true) {
+    size_t chunk_size = kChunkSize;
+    if (!body->Read(chunk.get(), &chunk_size))
+      return scoped_ptr<HttpResponse>();
+    if (chunk_size == 0)
+      break;
+    DWORD written = 0;
+    if (!::WinHttpWriteData(instance->request_->Get(), chunk.get(),
+                            static_cast<DWORD>(chunk_size), &written) ||
+        written != chunk_size) {
+      LOG(ERROR) << "Failed to send HTTP request body to host " << host
+                 << " and port " << port << ": " << ::common::LogWe();
+      return scoped_ptr<HttpResponse>();
+    }
+    total_written += chunk_size;
+  }
+  if (total_written != body->size()) {
+    LOG(ERROR) << "Request body size changed while sending it to host " << host
+               << " and port " << port << ".";
+    return scoped_ptr<HttpResponse>();
+  }
+
   // This seems to read at least all headers from the response. The remainder of
   // the body, if any, may be read during subsequent calls to WinHttpReadData().
-  if (!::WinHttpReceiveResponse(instance->request_.Get(), 0)) {
+  if (!::WinHttpReceiveResponse(instance->request_->Get(), 0)) {
     LOG(ERROR) << "Failed to complete HTTP request to host " << host
                << " and port " << port << ": " << ::common::LogWe();
     return scoped_ptr<HttpResponse>();
@@ -408,7 +553,7 @@ bool HttpResponseImpl::HasData(bool* has_data) {
   DCHECK(has_data);
 
   DWORD leftover_data = 0;
-  if (!::WinHttpQueryDataAvailable(request_.Get(), &leftover_data)) {
+  if (!::WinHttpQueryDataAvailable(request_->Get(), &leftover_data)) {
     LOG(ERROR) << "WinHttpQueryDataAvailable failed: " << ::common::LogWe();
     return false;
   }
@@ -424,7 +569,7 @@ bool HttpResponseImpl::ReadData(char* buffer, size_t* count) {
   DCHECK(count);
 
   DWORD size_read = 0;
-  if (!::WinHttpReadData(request_.Get(), buffer, *count, &size_read)) {
+  if (!::WinHttpReadData(request_->Get(), buffer, *count, &size_read)) {
     LOG(ERROR) << "Failed to read response body: " << ::common::LogWe();
     return false;
   }
@@ -438,7 +583,7 @@ bool HttpResponseImpl::QueryHeader(DWORD info_level,
                                    bool* header_present,
                                    void* buffer,
                                    DWORD buffer_length) {
-  if (::WinHttpQueryHeaders(request_.Get(), info_level,
+  if (::WinHttpQueryHeaders(request_->Get(), info_level,
                             WINHTTP_HEADER_NAME_BY_INDEX, buffer,
                             &buffer_length, 0)) {
     *header_present = true;
@@ -493,16 +638,129 @@ void GetOSAndCPU(UserAgent* user_agent) {
 
 }  // namespace
 
+class HttpAgentImpl::ConnectionPool {
+ public:
+  explicit ConnectionPool(const base::string16& user_agent)
+      : user_agent_(user_agent), auto_detect_proxy_(false) {}
+
+  // Retrieves the connection to |host| and |port|, opening it, and the session
+  // it belongs to, if need be.
+  // @param host The target host.
+  // @param port The target port.
+  // @param connection Receives the connection.
+  // @returns true if successful.
+  bool GetConnection(const base::string16& host,
+                     uint16_t port,
+                     WinHttpConnection* connection);
+
+  // Closes the session and its connections. Responses that are still in use
+  // keep theirs open until they are destroyed.
+  void Close();
+
+ private:
+  typedef std::map<std::pair<base::string16, uint16_t>,
+                   scoped_refptr<SharedWinHttpHandle>> ConnectionMap;
+
+  // Opens the session, with the user's current proxy configuration.
+  // @returns true if successful.
+  bool OpenSession();
+
+  base::string16 user_agent_;
+
+  // Protects the members below, as requests may be issued from several
+  // threads.
+  base::Lock lock_;
+  scoped_refptr<SharedWinHttpHandle> session_;
+  bool auto_detect_proxy_;
+  base::string16 auto_config_url_;
+  ConnectionMap connections_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConnectionPool);
+};
+
+bool HttpAgentImpl::ConnectionPool::GetConnection(
+    const base::string16& host,
+    uint16_t port,
+    WinHttpConnection* connection) {
+  DCHECK(connection);
+
+  base::AutoLock auto_lock(lock_);
+
+  if (!session_.get() && !OpenSession())
+    return false;
+
+  scoped_refptr<SharedWinHttpHandle>& host_connection =
+      connections_[std::make_pair(host, port)];
+  if (!host_connection.get()) {
+    HINTERNET handle =
+        ::WinHttpConnect(session_->Get(), host.c_str(), port, 0);
+    if (!handle) {
+      LOG(ERROR) << "WinHttpConnect() failed with host " << host
+                 << " and port " << port << ": " << ::common::LogWe();
+      connections_.erase(std::make_pair(host, port));
+      return false;
+    }
+    host_connection = new SharedWinHttpHandle(handle, session_.get());
+  }
+
+  connection->connection = host_connection;
+  connection->auto_detect_proxy = auto_detect_proxy_;
+  connection->auto_config_url = auto_config_url_;
+  return true;
+}
+
+void HttpAgentImpl::ConnectionPool::Close() {
+  base::AutoLock auto_lock(lock_);
+  connections_.clear();
+  session_ = nullptr;
+}
+
+bool HttpAgentImpl::ConnectionPool::OpenSession() {
+  lock_.AssertAcquired();
+  DCHECK(!session_.get());
+
+  // Retrieve the user's proxy configuration.
+  AutoWinHttpProxyConfig proxy_config;
+  if (!proxy_config.Load())
+    return false;
+
+  HINTERNET handle =
+      ::WinHttpOpen(user_agent_.c_str(), proxy_config.access_type(),
+                    proxy_config.proxy(), proxy_config.proxy_bypass(), 0);
+  if (!handle) {
+    LOG(ERROR) << "WinHttpOpen() failed: " << ::common::LogWe();
+    return false;
+  }
+  session_ = new SharedWinHttpHandle(handle, nullptr);
+
+  // Prefer HTTP/2 where the server and WinHTTP support it, so that concurrent
+  // uploads are multiplexed over a single connection.
+  DWORD protocols = kWinHttpProtocolFlagHttp2;
+  if (!::WinHttpSetOption(session_->Get(), kWinHttpOptionEnableHttpProtocol,
+                          &protocols, sizeof(protocols))) {
+    VLOG(1) << "HTTP/2 is not supported by WinHTTP: " << ::common::LogWe();
+  }
+
+  auto_detect_proxy_ = proxy_config.auto_detect();
+  auto_config_url_ = proxy_config.auto_config_url();
+  return true;
+}
+
 HttpAgentImpl::HttpAgentImpl(const base::string16& product_name,
                              const base::string16& product_version) {
   UserAgent user_agent(product_name, product_version);
   user_agent.set_winhttp_version(GetWinHttpVersion());
   GetOSAndCPU(&user_agent);
   user_agent_ = user_agent.AsString();
+  connection_pool_.reset(new ConnectionPool(user_agent_));
 }
 
 HttpAgentImpl::~HttpAgentImpl() {}
 
+void HttpAgentImpl::CloseConnections() {
+  connection_pool_->Close();
+}
+
 scoped_ptr<HttpResponse> HttpAgentImpl::Post(
     const base::string16& host,
     uint16_t port,
@@ -510,8 +768,29 @@ scoped_ptr<HttpResponse> HttpAgentImpl::Post(
     bool secure,
     const base::string16& extra_headers,
     const std::string& body) {
-  return HttpResponseImpl::Create(user_agent_, host, port, path, secure,
-                                  extra_headers, body);
+  WinHttpConnection connection;
+  if (!connection_pool_->GetConnection(host, port, &connection))
+    return scoped_ptr<HttpResponse>();
+  StringRequestBody request_body(body);
+  return HttpResponseImpl::Create(connection, host, port, path, secure,
+                                  extra_headers, &request_body);
+}
+
+scoped_ptr<HttpResponse> HttpAgentImpl::PostFile(
+    const base::string16& host,
+    uint16_t port,
+    const base::string16& path,
+    bool secure,
+    const base::string16& extra_headers,
+    const base::FilePath& body_path) {
+  FileRequestBody request_body;
+  if (!request_body.Open(body_path))
+    return scoped_ptr<HttpResponse>();
+  WinHttpConnection connection;
+  if (!connection_pool_->GetConnection(host, port, &connection))
+    return scoped_ptr<HttpResponse>();
+  return HttpResponseImpl::Create(connection, host, port, path, secure,
+                                  extra_headers, &request_body);
 }
 
 }  // namespace kasko
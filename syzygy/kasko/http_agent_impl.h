@@ -15,12 +15,17 @@
 #ifndef SYZYGY_KASKO_HTTP_AGENT_IMPL_H_
 #define SYZYGY_KASKO_HTTP_AGENT_IMPL_H_
 
+#include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
 #include "syzygy/kasko/http_agent.h"
 
 namespace kasko {
 
 // Implements HttpAgent using WinHttp. Respects the user proxy settings if any.
+// The WinHTTP session and the connections to each host are kept open between
+// requests, so that consecutive requests save the TCP and TLS handshakes, and
+// HTTP/2 is used where available. Requests may be issued from several threads
+// at once.
 class HttpAgentImpl : public HttpAgent {
  public:
   // Constructs an HttpAgentImpl.
@@ -31,6 +36,11 @@ class HttpAgentImpl : public HttpAgent {
                 const base::string16& product_version);
   ~HttpAgentImpl() override;
 
+  // Closes the session and connections kept open between requests. The next
+  // request opens a new session, with the current proxy settings. Responses
+  // that are still in use remain valid.
+  void CloseConnections();
+
   // HttpAgent implementation
   virtual scoped_ptr<HttpResponse> Post(const base::string16& host,
                                         uint16_t port,
@@ -38,9 +48,21 @@ class HttpAgentImpl : public HttpAgent {
                                         bool secure,
                                         const base::string16& extra_headers,
                                         const std::string& body) override;
+  virtual scoped_ptr<HttpResponse> PostFile(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      const base::FilePath& body_path) override;
 
  private:
+  // Keeps the WinHTTP session and connections open. Defined in the
+  // implementation file.
+  class ConnectionPool;
+
   base::string16 user_agent_;
+  scoped_ptr<ConnectionPool> connection_pool_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpAgentImpl);
 };
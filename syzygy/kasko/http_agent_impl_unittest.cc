@@ -41,4 +41,28 @@ TEST(HttpAgentImplTest, SimpleUpload) {
   EXPECT_EQ(200, response_code);
 }
 
+TEST(HttpAgentImplTest, ReusesConnections) {
+  testing::TestServer server;
+  ASSERT_TRUE(server.Start());
+
+  base::string16 url =
+      L"http://localhost:" + base::UintToString16(server.port()) + L"/path";
+  HttpAgentImpl agent_impl(L"test", L"0.0");
+
+  // The second upload reuses the connection of the first one, and the third
+  // one opens a new connection once they are closed.
+  for (size_t i = 0; i < 3; ++i) {
+    if (i == 2)
+      agent_impl.CloseConnections();
+
+    base::string16 response_body;
+    uint16_t response_code = 0;
+    ASSERT_TRUE(SendHttpUpload(
+        &agent_impl, url, std::map<base::string16, base::string16>(),
+        "file_contents", L"file_name", &response_body, &response_code));
+    EXPECT_EQ(L"file_name=file_contents\r\n", response_body);
+    EXPECT_EQ(200, response_code);
+  }
+}
+
 }  // namespace kasko
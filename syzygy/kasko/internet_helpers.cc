@@ -235,6 +235,15 @@ std::string GenerateMultipartHttpRequestBody(
     const std::string& upload_file,
     const base::string16& file_part_name,
     const base::string16& boundary) {
+  return GenerateMultipartHttpRequestBodyPrefix(parameters, file_part_name,
+                                                boundary) +
+         upload_file + GenerateMultipartHttpRequestBodySuffix(boundary);
+}
+
+std::string GenerateMultipartHttpRequestBodyPrefix(
+    const std::map<base::string16, base::string16>& parameters,
+    const base::string16& file_part_name,
+    const base::string16& boundary) {
   DCHECK(!boundary.empty());
   DCHECK(!file_part_name.empty());
   std::string boundary_utf8 = base::WideToUTF8(boundary);
@@ -258,11 +267,13 @@ std::string GenerateMultipartHttpRequestBody(
   request_body.append("Content-Type: application/octet-stream\r\n");
   request_body.append("\r\n");
 
-  request_body.append(upload_file);
-  request_body.append("\r\n");
-  request_body.append("--" + boundary_utf8 + "--\r\n");
-
   return request_body;
 }
 
+std::string GenerateMultipartHttpRequestBodySuffix(
+    const base::string16& boundary) {
+  DCHECK(!boundary.empty());
+  return "\r\n--" + base::WideToUTF8(boundary) + "--\r\n";
+}
+
 }  // namespace kasko
@@ -86,6 +86,26 @@ std::string GenerateMultipartHttpRequestBody(
     const base::string16& file_part_name,
     const base::string16& boundary);
 
+// Generates the part of a multipart HTTP message body that precedes the file
+// contents. This allows the file contents to be streamed rather than held in
+// memory. The message body is the concatenation of this prefix, the file
+// contents, and the suffix generated by GenerateMultipartHttpRequestBodySuffix.
+// @param parameters HTTP request parameters to be encoded in the body.
+// @param file_part_name The parameter name to be assigned to the file part.
+// @param boundary The MIME boundary to use.
+// @returns The prefix of a multipart HTTP message body.
+std::string GenerateMultipartHttpRequestBodyPrefix(
+    const std::map<base::string16, base::string16>& parameters,
+    const base::string16& file_part_name,
+    const base::string16& boundary);
+
+// Generates the part of a multipart HTTP message body that follows the file
+// contents.
+// @param boundary The MIME boundary to use.
+// @returns The suffix of a multipart HTTP message body.
+std::string GenerateMultipartHttpRequestBodySuffix(
+    const base::string16& boundary);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_INTERNET_HELPERS_H_
@@ -87,6 +87,8 @@
       'target_name': 'kasko_lib',
       'type': 'static_library',
       'sources': [
+        'capture_thread.cc',
+        'capture_thread.h',
         'client.cc',
         'client.h',
         'crash_keys_serialization.cc',
@@ -134,6 +136,7 @@
       'dependencies': [
         '<(src)/syzygy/common/common.gyp:common_lib',
         '<(src)/syzygy/common/rpc/rpc.gyp:common_rpc_lib',
+        '<(src)/third_party/zlib/zlib.gyp:zlib',
         'kasko_version',
         'kasko_rpc',
       ],
@@ -222,6 +225,7 @@
       'type': 'executable',
       'sources': [
         '<(src)/base/test/run_all_unittests.cc',
+        'capture_thread_unittest.cc',
         'client_unittest.cc',
         'crash_keys_serialization_unittest.cc',
         'http_agent_impl_unittest.cc',
@@ -17,8 +17,13 @@
 #include <Windows.h>  // NOLINT
 #include <DbgHelp.h>
 
+#include <algorithm>
+
 #include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/process/process_handle.h"
+#include "base/strings/string_util.h"
 #include "base/win/scoped_handle.h"
 
 #include "syzygy/common/com_utils.h"
@@ -45,6 +50,109 @@ const MINIDUMP_TYPE kFullDumpType = static_cast<MINIDUMP_TYPE>(
     MiniDumpWithHandleData |  // Get all handle information.
     MiniDumpWithUnloadedModules);  // Get unloaded modules when available.
 
+// The maximum number of return addresses of the faulting thread that go into
+// a crash signature.
+const size_t kCrashSignatureStackFrames = 4;
+
+// The maximum number of bytes of the faulting thread's stack that are scanned
+// for return addresses.
+const size_t kCrashSignatureStackScanSize = 4096;
+
+// Accumulates a 64-bit FNV-1a hash.
+class SignatureHasher {
+ public:
+  SignatureHasher() : hash_(14695981039346656037ULL) {}
+
+  void Update(const void* data, size_t length) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; ++i) {
+      hash_ ^= bytes[i];
+      hash_ *= 1099511628211ULL;
+    }
+  }
+
+  uint64_t hash() const { return hash_ ? hash_ : 1; }
+
+ private:
+  uint64_t hash_;
+
+  DISALLOW_COPY_AND_ASSIGN(SignatureHasher);
+};
+
+// Provides bounds-checked access to the streams of a mapped minidump.
+class MinidumpReader {
+ public:
+  explicit MinidumpReader(const base::MemoryMappedFile& file) : file_(file) {}
+
+  // @returns the stream of the given type, or null if there is none or if it
+  //     is smaller than |min_size|.
+  const void* GetStream(ULONG stream_type, size_t min_size) const {
+    MINIDUMP_DIRECTORY* directory = nullptr;
+    void* stream = nullptr;
+    ULONG stream_size = 0;
+    if (!::MiniDumpReadDumpStream(const_cast<uint8*>(file_.data()),
+                                  stream_type, &directory, &stream,
+                                  &stream_size) ||
+        stream_size < min_size ||
+        !Contains(stream, stream_size)) {
+      return nullptr;
+    }
+    return stream;
+  }
+
+  // @returns the data at |rva|, or null if it doesn't fit in the file.
+  const void* GetData(RVA rva, size_t size) const {
+    if (rva > file_.length() || size > file_.length() - rva)
+      return nullptr;
+    return file_.data() + rva;
+  }
+
+ private:
+  bool Contains(const void* data, size_t size) const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    return bytes >= file_.data() && bytes <= file_.data() + file_.length() &&
+           size <= static_cast<size_t>(file_.data() + file_.length() - bytes);
+  }
+
+  const base::MemoryMappedFile& file_;
+
+  DISALLOW_COPY_AND_ASSIGN(MinidumpReader);
+};
+
+// Hashes the module containing an address and the offset of the address in
+// it. The name of the module is hashed rather than its path, which depends on
+// the installation.
+// @returns true if the address is in a module of |modules|.
+bool HashModuleOffset(const MinidumpReader& reader,
+                      const MINIDUMP_MODULE_LIST& modules,
+                      size_t module_count,
+                      ULONG64 address,
+                      SignatureHasher* hasher) {
+  for (size_t i = 0; i < module_count; ++i) {
+    const MINIDUMP_MODULE& module = modules.Modules[i];
+    if (address < module.BaseOfImage ||
+        address - module.BaseOfImage >= module.SizeOfImage) {
+      continue;
+    }
+
+    const MINIDUMP_STRING* name = reinterpret_cast<const MINIDUMP_STRING*>(
+        reader.GetData(module.ModuleNameRva, sizeof(MINIDUMP_STRING)));
+    if (name && reader.GetData(module.ModuleNameRva + sizeof(ULONG32),
+                               name->Length)) {
+      base::FilePath path(
+          base::string16(name->Buffer, name->Length / sizeof(WCHAR)));
+      base::string16 base_name = base::StringToLowerASCII(
+          path.BaseName().value());
+      hasher->Update(base_name.data(), base_name.size() * sizeof(WCHAR));
+    }
+    hasher->Update(&module.TimeDateStamp, sizeof(module.TimeDateStamp));
+    ULONG64 offset = address - module.BaseOfImage;
+    hasher->Update(&offset, sizeof(offset));
+    return true;
+  }
+  return false;
+}
+
 }  // namespace
 
 bool GenerateMinidump(const base::FilePath& destination,
@@ -119,4 +227,79 @@ bool GenerateMinidump(const base::FilePath& destination,
   return true;
 }
 
+bool GetMinidumpCrashSignature(const base::FilePath& minidump_path,
+                               uint64_t* signature) {
+  DCHECK(signature);
+
+  base::MemoryMappedFile file;
+  if (!file.Initialize(minidump_path)) {
+    LOG(ERROR) << "Failed to map " << minidump_path.value();
+    return false;
+  }
+  MinidumpReader reader(file);
+
+  // Reports without an exception have no signature.
+  const MINIDUMP_EXCEPTION_STREAM* exception =
+      reinterpret_cast<const MINIDUMP_EXCEPTION_STREAM*>(reader.GetStream(
+          ExceptionStream, sizeof(MINIDUMP_EXCEPTION_STREAM)));
+  const MINIDUMP_MODULE_LIST* modules =
+      reinterpret_cast<const MINIDUMP_MODULE_LIST*>(reader.GetStream(
+          ModuleListStream, sizeof(ULONG32)));
+  if (!exception || !modules)
+    return false;
+  size_t module_count = modules->NumberOfModules;
+  if (!reader.GetData(
+          static_cast<RVA>(reinterpret_cast<const uint8*>(modules->Modules) -
+                           file.data()),
+          module_count * sizeof(MINIDUMP_MODULE))) {
+    return false;
+  }
+
+  SignatureHasher hasher;
+  hasher.Update(&exception->ExceptionRecord.ExceptionCode,
+                sizeof(exception->ExceptionRecord.ExceptionCode));
+  if (!HashModuleOffset(reader, *modules, module_count,
+                        exception->ExceptionRecord.ExceptionAddress,
+                        &hasher)) {
+    hasher.Update(&exception->ExceptionRecord.ExceptionAddress,
+                  sizeof(exception->ExceptionRecord.ExceptionAddress));
+  }
+
+  // Scan the top of the faulting thread's stack for return addresses. This
+  // may pick up stale values, but those are the same for the reports of a
+  // same crash.
+  const MINIDUMP_THREAD_LIST* threads =
+      reinterpret_cast<const MINIDUMP_THREAD_LIST*>(reader.GetStream(
+          ThreadListStream, sizeof(ULONG32)));
+  size_t thread_count = threads ? threads->NumberOfThreads : 0;
+  if (threads &&
+      !reader.GetData(
+          static_cast<RVA>(reinterpret_cast<const uint8*>(threads->Threads) -
+                           file.data()),
+          thread_count * sizeof(MINIDUMP_THREAD))) {
+    thread_count = 0;
+  }
+  for (size_t i = 0; i < thread_count; ++i) {
+    const MINIDUMP_THREAD& thread = threads->Threads[i];
+    if (thread.ThreadId != exception->ThreadId)
+      continue;
+    size_t stack_size = std::min<size_t>(thread.Stack.Memory.DataSize,
+                                         kCrashSignatureStackScanSize);
+    const uint32_t* stack = reinterpret_cast<const uint32_t*>(
+        reader.GetData(thread.Stack.Memory.Rva, stack_size));
+    if (!stack)
+      break;
+    size_t frames = 0;
+    for (size_t j = 0; j < stack_size / sizeof(*stack) &&
+                       frames < kCrashSignatureStackFrames; ++j) {
+      if (HashModuleOffset(reader, *modules, module_count, stack[j], &hasher))
+        ++frames;
+    }
+    break;
+  }
+
+  *signature = hasher.hash();
+  return true;
+}
+
 }  // namespace kasko
@@ -15,8 +15,10 @@
 #ifndef SYZYGY_KASKO_MINIDUMP_H_
 #define SYZYGY_KASKO_MINIDUMP_H_
 
+#include <stdint.h>
 #include <vector>
 
+#include "base/files/file_path.h"
 #include "base/process/process_handle.h"
 #include "base/threading/platform_thread.h"
 #include "syzygy/kasko/minidump_type.h"
@@ -51,6 +53,18 @@ bool GenerateMinidump(const base::FilePath& destination,
                       MinidumpType minidump_type,
                       const std::vector<CustomStream>& custom_streams);
 
+// Computes the crash signature of a minidump, which is shared by the reports
+// of a same crash. It covers the exception code, the module and offset of the
+// faulting instruction, and the first few return addresses found on the stack
+// of the faulting thread, all of them relative to their module so that they
+// don't depend on where the modules were loaded.
+// @param minidump_path The path to the minidump.
+// @param signature Receives the crash signature, which is never 0.
+// @returns true if the minidump has an exception and a signature could be
+//     computed.
+bool GetMinidumpCrashSignature(const base::FilePath& minidump_path,
+                               uint64_t* signature);
+
 }  // namespace kasko
 
 #endif  // SYZYGY_KASKO_MINIDUMP_H_
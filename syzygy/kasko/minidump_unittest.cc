@@ -158,4 +158,18 @@ TEST_F(MinidumpTest, NonexistantTargetDirectory) {
       ::GetCurrentProcessId(), 0, NULL, SMALL_DUMP_TYPE, custom_streams));
 }
 
+TEST_F(MinidumpTest, CrashSignatureWithoutException) {
+  base::FilePath dump_file_path = temp_dir().Append(L"test.dump");
+  std::vector<CustomStream> custom_streams;
+  ASSERT_TRUE(kasko::GenerateMinidump(dump_file_path, ::GetCurrentProcessId(),
+                                      0, NULL, SMALL_DUMP_TYPE,
+                                      custom_streams));
+
+  // A minidump without an exception has no signature.
+  uint64_t signature = 0;
+  EXPECT_FALSE(GetMinidumpCrashSignature(dump_file_path, &signature));
+  EXPECT_FALSE(GetMinidumpCrashSignature(temp_dir().Append(L"missing.dump"),
+                                         &signature));
+}
+
 }  // namespace kasko
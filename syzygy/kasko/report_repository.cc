@@ -41,6 +41,20 @@
 // upload, those in "Retry" and "Retry 2" are eligible when their last-modified
 // date is older than the configured retry interval.
 //
+// UploadPendingReports claims a batch of eligible reports and uploads them
+// concurrently. Reports in "Incoming" come first, followed by those in "Retry"
+// and "Retry 2", and within a directory the most recently touched reports come
+// first. The batch is bounded both in number of reports and in total minidump
+// size, which throttles the bandwidth used per upload interval.
+//
+// Reports may carry a crash signature, which identifies the reports of a same
+// crash. When a duplicate report limit is set, a record is kept for each
+// signature in <root>/Signatures, in the crash keys format. It counts the
+// reports stored in the current window and the duplicates that were dropped
+// but not yet reported. Dropped duplicates are counted in the crash keys of
+// the last stored report while it is pending, and otherwise carried over to
+// the next stored report. Records are deleted once they are stale.
+//
 // Orphaned report files (minidumps without crash keys and vice-versa) may be
 // detected during upload attempts. When receiving new minidumps, we first write
 // the crash keys to "Incoming" before moving the minidump file in. As a result,
@@ -51,9 +65,17 @@
 
 #include "syzygy/kasko/report_repository.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/files/file_enumerator.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
 
 namespace kasko {
@@ -71,6 +93,16 @@ const base::char16 kIncomingReportsSubdir[] = L"Incoming";
 const base::char16 kFailedOnceSubdir[] = L"Retry";
 // The subdirectory where reports that have failed twice are stored.
 const base::char16 kFailedTwiceSubdir[] = L"Retry 2";
+// The subdirectory where crash signature records are stored.
+const base::char16 kSignaturesSubdir[] = L"Signatures";
+// The extension of crash signature records.
+const base::char16 kSignatureRecordExtension[] = L".sig";
+
+// The keys of crash signature records.
+const base::char16 kWindowStartKey[] = L"window-start";
+const base::char16 kStoredReportsKey[] = L"stored-reports";
+const base::char16 kPendingDuplicatesKey[] = L"pending-duplicates";
+const base::char16 kLastReportKey[] = L"last-report";
 
 // Deletes a path non-recursively and logs an error in case of failure.
 // @param path The path to delete.
@@ -155,6 +187,30 @@ base::FilePath GetDumpFileForCrashKeysFile(
   return crash_keys_path.ReplaceExtension(kDumpFileExtension);
 }
 
+// Determines whether a minidump is eligible for upload. Minidumps with missing
+// crash keys are deleted.
+// @param candidate The path to the minidump.
+// @param file_info The file information of the minidump.
+// @param maximum_timestamp_for_retries The cutoff for the most most recent
+//     upload attempt of eligible minidumps. If null, there is no cutoff.
+// @returns true if the minidump is eligible for upload.
+bool IsPendingReport(const base::FilePath& candidate,
+                     const base::FileEnumerator::FileInfo& file_info,
+                     const base::Time& maximum_timestamp_for_retries) {
+  // Skip dumps with missing crash keys.
+  if (!base::PathExists(GetCrashKeysFileForDumpFile(candidate))) {
+    LOG(ERROR) << "Deleting a minidump file with missing crash keys: "
+               << candidate.value();
+    LoggedDeleteFile(candidate);
+    return false;
+  }
+  if (maximum_timestamp_for_retries.is_null())
+    return true;
+
+  // Check if this file is eligible for retry.
+  return file_info.GetLastModifiedTime() <= maximum_timestamp_for_retries;
+}
+
 // Returns a minidump that is eligible for upload from the given directory, if
 // any are.
 // @param directory The directory to scan.
@@ -170,22 +226,66 @@ base::FilePath GetPendingReportFromDirectory(
   // Visit all files in this directory until we find an eligible one.
   for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
        candidate = file_enumerator.Next()) {
-    // Skip dumps with missing crash keys.
-    if (!base::PathExists(GetCrashKeysFileForDumpFile(candidate))) {
-      LOG(ERROR) << "Deleting a minidump file with missing crash keys: "
-                 << candidate.value();
-      LoggedDeleteFile(candidate);
-      continue;
-    }
-    if (maximum_timestamp_for_retries.is_null())
+    if (IsPendingReport(candidate, file_enumerator.GetInfo(),
+                        maximum_timestamp_for_retries)) {
       return candidate;
+    }
+  }
+  return base::FilePath();
+}
 
-    // Check if this file is eligible for retry.
+// A minidump that is eligible for upload.
+struct PendingReport {
+  // The path to the minidump.
+  base::FilePath minidump_path;
+  // The directory where the report goes if its upload fails, or empty if the
+  // next failure is permanent.
+  base::FilePath failure_destination;
+  // The size of the minidump.
+  int64_t size;
+  // The time of the most recent upload attempt, or of the storage, of the
+  // report.
+  base::Time last_modified;
+};
+
+// Orders pending reports from the most recently to the least recently touched.
+bool IsMoreRecentReport(const PendingReport& report1,
+                        const PendingReport& report2) {
+  return report1.last_modified > report2.last_modified;
+}
+
+// Appends the minidumps that are eligible for upload from the given directory
+// to @p reports, from the most to the least recently touched.
+// @param directory The directory to scan.
+// @param maximum_timestamp_for_retries The cutoff for the most most recent
+//     upload attempt of eligible minidumps. If null, there is no cutoff.
+// @param failure_destination The directory where reports from @p directory go
+//     if their upload fails, or empty if the next failure is permanent.
+// @param reports The vector that receives the eligible minidumps.
+void GetPendingReportsFromDirectory(
+    const base::FilePath& directory,
+    const base::Time& maximum_timestamp_for_retries,
+    const base::FilePath& failure_destination,
+    std::vector<PendingReport>* reports) {
+  DCHECK(reports);
+  size_t first_report = reports->size();
+  base::FileEnumerator file_enumerator(
+      directory, false, base::FileEnumerator::FILES,
+      base::string16(L"*") + kDumpFileExtension);
+  for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
+       candidate = file_enumerator.Next()) {
     base::FileEnumerator::FileInfo file_info = file_enumerator.GetInfo();
-    if (file_info.GetLastModifiedTime() <= maximum_timestamp_for_retries)
-      return candidate;
+    if (!IsPendingReport(candidate, file_info, maximum_timestamp_for_retries))
+      continue;
+    PendingReport report;
+    report.minidump_path = candidate;
+    report.failure_destination = failure_destination;
+    report.size = file_info.GetSize();
+    report.last_modified = file_info.GetLastModifiedTime();
+    reports->push_back(report);
   }
-  return base::FilePath();
+  std::stable_sort(reports->begin() + first_report, reports->end(),
+                   &IsMoreRecentReport);
 }
 
 void CleanOrphanedCrashKeysFiles(
@@ -217,6 +317,23 @@ void CleanOrphanedCrashKeysFiles(
   }
 }
 
+// The directories of the repository, in the order in which their reports are
+// uploaded.
+struct RepositoryDirectory {
+  // The subdirectory.
+  const base::char16* subdir;
+  // The subdirectory where reports go if their upload fails, or null if the
+  // next failure is permanent.
+  const base::char16* failure_subdir;
+  // True if the reports of this subdirectory must wait for the retry interval
+  // since their last upload attempt.
+  bool is_retry;
+};
+const RepositoryDirectory kRepositoryDirectories[] = {
+    {kIncomingReportsSubdir, kFailedOnceSubdir, false},
+    {kFailedOnceSubdir, kFailedTwiceSubdir, true},
+    {kFailedTwiceSubdir, nullptr, true}};
+
 // Returns a minidump that is eligible for upload, if any are.
 // @param repository_path The directory where this repository stores reports.
 // @param now The current time.
@@ -228,29 +345,46 @@ std::pair<base::FilePath, base::FilePath> GetPendingReport(
     const base::FilePath& repository_path,
     const base::Time& now,
     const base::TimeDelta& retry_interval) {
-  struct {
-    const base::char16* subdir;
-    const base::char16* failure_subdir;
-    base::Time retry_cutoff;
-  } directories[] = {
-      {kIncomingReportsSubdir, kFailedOnceSubdir, base::Time()},
-      {kFailedOnceSubdir, kFailedTwiceSubdir, now - retry_interval},
-      {kFailedTwiceSubdir, nullptr, now - retry_interval}};
-
-  for (size_t i = 0; i < arraysize(directories); ++i) {
+  for (size_t i = 0; i < arraysize(kRepositoryDirectories); ++i) {
+    const RepositoryDirectory& directory = kRepositoryDirectories[i];
     base::FilePath result = GetPendingReportFromDirectory(
-        repository_path.Append(directories[i].subdir),
-        directories[i].retry_cutoff);
+        repository_path.Append(directory.subdir),
+        directory.is_retry ? now - retry_interval : base::Time());
     if (result.empty())
       continue;
-    if (!directories[i].failure_subdir)
+    if (!directory.failure_subdir)
       return std::make_pair(result, base::FilePath());
-    return std::make_pair(
-        result, repository_path.Append(directories[i].failure_subdir));
+    return std::make_pair(result,
+                          repository_path.Append(directory.failure_subdir));
   }
   return std::pair<base::FilePath, base::FilePath>();
 }
 
+// Returns all of the minidumps that are eligible for upload, in the order in
+// which they should be uploaded.
+// @param repository_path The directory where this repository stores reports.
+// @param now The current time.
+// @param retry_interval The minimum interval between upload attempts for a
+//     given report.
+// @param reports Receives the eligible minidumps.
+void GetPendingReports(const base::FilePath& repository_path,
+                       const base::Time& now,
+                       const base::TimeDelta& retry_interval,
+                       std::vector<PendingReport>* reports) {
+  DCHECK(reports);
+  reports->clear();
+  for (size_t i = 0; i < arraysize(kRepositoryDirectories); ++i) {
+    const RepositoryDirectory& directory = kRepositoryDirectories[i];
+    base::FilePath failure_destination;
+    if (directory.failure_subdir)
+      failure_destination = repository_path.Append(directory.failure_subdir);
+    GetPendingReportsFromDirectory(
+        repository_path.Append(directory.subdir),
+        directory.is_retry ? now - retry_interval : base::Time(),
+        failure_destination, reports);
+  }
+}
+
 // Handles a non-permanent failure by moving the report files to a new queue.
 // @param minidump_file The minidump file. This method calls Take() on success.
 // @param crash_keys_file The crash keys file. This method calls Take() on
@@ -295,35 +429,236 @@ void HandlePermanentFailure(const base::FilePath& minidump_path,
     LoggedDeleteFile(crash_keys_path);
 }
 
-}  // namespace
+// An upload attempt of a single report. The upload itself may run on a thread
+// of its own, while the preparation and the handling of the result happen on
+// the thread that owns the repository. The report files are deleted when the
+// instance is destroyed, unless they were moved to another queue.
+class ReportUpload : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param report The report to upload.
+  // @param uploader The uploader to use. Must outlive this instance.
+  ReportUpload(const PendingReport& report,
+               const ReportRepository::Uploader& uploader)
+      : minidump_file_(report.minidump_path),
+        crash_keys_file_(GetCrashKeysFileForDumpFile(report.minidump_path)),
+        failure_destination_(report.failure_destination),
+        uploader_(uploader),
+        prepared_(false),
+        crash_keys_read_(false),
+        succeeded_(false) {}
+
+  // Renews the file timestamps and reads the crash keys of the report. If the
+  // timestamps can't be renewed, no upload must be attempted, since that would
+  // potentially lead to a hot loop of upload attempts.
+  // @param now The current time.
+  // @returns true if the upload should be attempted.
+  bool Prepare(const base::Time& now) {
+    if (!minidump_file_.UpdateTimestamp(now))
+      return false;
+    if (!crash_keys_file_.UpdateTimestamp(now))
+      return false;
+    prepared_ = true;
+    crash_keys_read_ = ReadCrashKeysFromFile(crash_keys_file_.Get(),
+                                             &crash_keys_);
+    return true;
+  }
 
-ReportRepository::ReportRepository(
-    const base::FilePath& repository_path,
-    const base::TimeDelta& retry_interval,
-    const TimeSource& time_source,
-    const Uploader& uploader,
-    const PermanentFailureHandler& permanent_failure_handler)
-    : repository_path_(repository_path),
-      retry_interval_(retry_interval),
-      time_source_(time_source),
-      uploader_(uploader),
-      permanent_failure_handler_(permanent_failure_handler) {
+  // Performs the upload.
+  // base::DelegateSimpleThread::Delegate implementation.
+  void Run() override {
+    DCHECK(prepared_);
+    if (crash_keys_read_)
+      succeeded_ = uploader_.Run(minidump_file_.Get(), crash_keys_);
+  }
+
+  // Handles the result of the upload. This must be called after Run.
+  // @param permanent_failure_handler The handler for reports that have
+  //     exceeded the maximum retry attempts.
+  // @returns true if the upload succeeded.
+  bool Finish(const ReportRepository::PermanentFailureHandler&
+                  permanent_failure_handler) {
+    if (!prepared_)
+      return false;
+    if (succeeded_)
+      return true;
+
+    if (!failure_destination_.empty()) {
+      HandleNonpermanentFailure(&minidump_file_, &crash_keys_file_,
+                                failure_destination_);
+    } else {
+      HandlePermanentFailure(minidump_file_.Take(), crash_keys_file_.Take(),
+                             permanent_failure_handler);
+    }
+    return false;
+  }
+
+ private:
+  ScopedReportFile minidump_file_;
+  ScopedReportFile crash_keys_file_;
+  base::FilePath failure_destination_;
+  const ReportRepository::Uploader& uploader_;
+  std::map<base::string16, base::string16> crash_keys_;
+  bool prepared_;
+  bool crash_keys_read_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReportUpload);
+};
+
+// The state of a crash signature.
+struct SignatureRecord {
+  SignatureRecord() : stored_reports(0), pending_duplicates(0) {}
+
+  // The start of the current window.
+  base::Time window_start;
+  // The number of reports stored in the current window.
+  size_t stored_reports;
+  // The number of dropped duplicates that weren't counted in a stored report.
+  size_t pending_duplicates;
+  // The file name of the last stored minidump.
+  base::FilePath last_report;
+};
+
+// @returns the path of the record of a crash signature.
+base::FilePath GetSignatureRecordPath(const base::FilePath& repository_path,
+                                      uint64_t signature) {
+  return repository_path.Append(kSignaturesSubdir).Append(
+      base::StringPrintf(L"%016llX", signature) + kSignatureRecordExtension);
 }
 
-ReportRepository::~ReportRepository() {
+// Reads the record of a crash signature.
+// @param path The path to the record.
+// @param record Receives the record.
+// @returns true if the record exists and is valid.
+bool ReadSignatureRecord(const base::FilePath& path, SignatureRecord* record) {
+  DCHECK(record);
+  if (!base::PathExists(path))
+    return false;
+  std::map<base::string16, base::string16> values;
+  int64_t window_start = 0;
+  if (!ReadCrashKeysFromFile(path, &values) ||
+      !base::StringToInt64(values[kWindowStartKey], &window_start) ||
+      !base::StringToSizeT(values[kStoredReportsKey],
+                           &record->stored_reports) ||
+      !base::StringToSizeT(values[kPendingDuplicatesKey],
+                           &record->pending_duplicates)) {
+    LOG(ERROR) << "Invalid crash signature record: " << path.value();
+    return false;
+  }
+  record->window_start = base::Time::FromInternalValue(window_start);
+  record->last_report = base::FilePath(values[kLastReportKey]);
+  return true;
 }
 
-void ReportRepository::StoreReport(
+// Writes the record of a crash signature.
+// @param path The path to the record.
+// @param record The record.
+// @param now The current time, which becomes the timestamp of the record.
+void WriteSignatureRecord(const base::FilePath& path,
+                          const SignatureRecord& record,
+                          const base::Time& now) {
+  if (!base::CreateDirectory(path.DirName())) {
+    LOG(ERROR) << "Failed to create directory " << path.DirName().value();
+    return;
+  }
+  std::map<base::string16, base::string16> values;
+  values[kWindowStartKey] =
+      base::Int64ToString16(record.window_start.ToInternalValue());
+  values[kStoredReportsKey] = base::SizeTToString16(record.stored_reports);
+  values[kPendingDuplicatesKey] =
+      base::SizeTToString16(record.pending_duplicates);
+  values[kLastReportKey] = record.last_report.value();
+  if (WriteCrashKeysToFile(path, values))
+    base::TouchFile(path, now, now);
+}
+
+// Counts a dropped duplicate in the crash keys of a report, if it is still
+// pending.
+// @param repository_path The directory where this repository stores reports.
+// @param minidump_name The file name of the minidump of the report.
+// @returns true if the report was found and updated.
+bool AddDuplicateToPendingReport(const base::FilePath& repository_path,
+                                 const base::FilePath& minidump_name) {
+  if (minidump_name.empty())
+    return false;
+  const base::char16* subdirs[] = {
+      kIncomingReportsSubdir, kFailedOnceSubdir, kFailedTwiceSubdir};
+  for (size_t i = 0; i < arraysize(subdirs); ++i) {
+    base::FilePath crash_keys_path = GetCrashKeysFileForDumpFile(
+        repository_path.Append(subdirs[i]).Append(minidump_name));
+    if (!base::PathExists(crash_keys_path))
+      continue;
+
+    std::map<base::string16, base::string16> crash_keys;
+    if (!ReadCrashKeysFromFile(crash_keys_path, &crash_keys))
+      return false;
+    size_t duplicate_count = 0;
+    base::string16& value =
+        crash_keys[ReportRepository::kDuplicateCountCrashKey];
+    base::StringToSizeT(value, &duplicate_count);
+    value = base::SizeTToString16(duplicate_count + 1);
+
+    // Keep the timestamp of the report, which schedules its retries.
+    base::File::Info file_info;
+    if (!base::GetFileInfo(crash_keys_path, &file_info) ||
+        !WriteCrashKeysToFile(crash_keys_path, crash_keys)) {
+      return false;
+    }
+    base::TouchFile(crash_keys_path, file_info.last_accessed,
+                    file_info.last_modified);
+    return true;
+  }
+  return false;
+}
+
+// Deletes the crash signature records that no longer hold any state. Records
+// that still have pending duplicates are kept for a day.
+// @param repository_path The directory where this repository stores reports.
+// @param now The current time.
+// @param window The duplicate report window.
+void CleanStaleSignatureRecords(const base::FilePath& repository_path,
+                                const base::Time& now,
+                                const base::TimeDelta& window) {
+  base::Time one_day_ago(now - base::TimeDelta::FromDays(1));
+  base::FileEnumerator file_enumerator(
+      repository_path.Append(kSignaturesSubdir), false,
+      base::FileEnumerator::FILES,
+      base::string16(L"*") + kSignatureRecordExtension);
+  for (base::FilePath candidate = file_enumerator.Next(); !candidate.empty();
+       candidate = file_enumerator.Next()) {
+    base::Time last_modified = file_enumerator.GetInfo().GetLastModifiedTime();
+    if (last_modified >= now - window)
+      continue;
+    SignatureRecord record;
+    if (last_modified >= one_day_ago &&
+        ReadSignatureRecord(candidate, &record) &&
+        record.pending_duplicates != 0) {
+      continue;
+    }
+    LoggedDeleteFile(candidate);
+  }
+}
+
+// Stores a report in "Incoming".
+// @param repository_path The directory where this repository stores reports.
+// @param minidump_path The path to the minidump file, which is moved or
+//     deleted.
+// @param crash_keys The crash keys for the report.
+// @param now The current time.
+// @returns the path of the stored minidump, or an empty path on failure.
+base::FilePath StoreReportFiles(
+    const base::FilePath& repository_path,
     const base::FilePath& minidump_path,
-    const std::map<base::string16, base::string16>& crash_keys) {
+    const std::map<base::string16, base::string16>& crash_keys,
+    const base::Time& now) {
   ScopedReportFile minidump_file(minidump_path);
 
   base::FilePath destination_directory(
-      repository_path_.Append(kIncomingReportsSubdir));
+      repository_path.Append(kIncomingReportsSubdir));
   if (!base::CreateDirectory(destination_directory)) {
     LOG(ERROR) << "Failed to create target directory "
                << destination_directory.value();
-    return;
+    return base::FilePath();
   }
 
   // Choose the location and extension where the minidump will be stored.
@@ -333,64 +668,162 @@ void ReportRepository::StoreReport(
       GetCrashKeysFileForDumpFile(minidump_target_path);
 
   if (!WriteCrashKeysToFile(crash_keys_path, crash_keys))
-    return;
+    return base::FilePath();
   ScopedReportFile crash_keys_file(crash_keys_path);
 
   if (!minidump_file.Move(minidump_target_path))
-    return;
+    return base::FilePath();
 
-  base::Time now = time_source_.Run();
   if (!minidump_file.UpdateTimestamp(now))
-    return;
+    return base::FilePath();
   if (!crash_keys_file.UpdateTimestamp(now))
-    return;
+    return base::FilePath();
 
   // Prevent the files from being deleted.
-  minidump_file.Take();
   crash_keys_file.Take();
+  return minidump_file.Take();
+}
+
+}  // namespace
+
+const base::char16* const ReportRepository::kDuplicateCountCrashKey =
+    L"duplicate-count";
+
+ReportRepository::ReportRepository(
+    const base::FilePath& repository_path,
+    const base::TimeDelta& retry_interval,
+    const TimeSource& time_source,
+    const Uploader& uploader,
+    const PermanentFailureHandler& permanent_failure_handler)
+    : repository_path_(repository_path),
+      retry_interval_(retry_interval),
+      time_source_(time_source),
+      uploader_(uploader),
+      permanent_failure_handler_(permanent_failure_handler),
+      max_reports_per_signature_(0) {
+}
+
+ReportRepository::~ReportRepository() {
+}
+
+void ReportRepository::SetDuplicateReportLimit(
+    const base::TimeDelta& window,
+    size_t max_reports_per_signature) {
+  duplicate_window_ = window;
+  max_reports_per_signature_ = max_reports_per_signature;
+}
+
+void ReportRepository::StoreReport(
+    const base::FilePath& minidump_path,
+    const std::map<base::string16, base::string16>& crash_keys) {
+  StoreReport(minidump_path, crash_keys, 0);
+}
+
+void ReportRepository::StoreReport(
+    const base::FilePath& minidump_path,
+    const std::map<base::string16, base::string16>& crash_keys,
+    uint64_t signature) {
+  base::Time now = time_source_.Run();
+  if (signature == 0 || max_reports_per_signature_ == 0) {
+    StoreReportFiles(repository_path_, minidump_path, crash_keys, now);
+    return;
+  }
+
+  base::FilePath record_path =
+      GetSignatureRecordPath(repository_path_, signature);
+  SignatureRecord record;
+  if (!ReadSignatureRecord(record_path, &record) ||
+      now - record.window_start >= duplicate_window_) {
+    // Start a new window. Duplicates that weren't reported yet are carried
+    // over.
+    record.window_start = now;
+    record.stored_reports = 0;
+  }
+
+  if (record.stored_reports >= max_reports_per_signature_) {
+    if (!AddDuplicateToPendingReport(repository_path_, record.last_report))
+      ++record.pending_duplicates;
+    LoggedDeleteFile(minidump_path);
+    WriteSignatureRecord(record_path, record, now);
+    return;
+  }
+
+  std::map<base::string16, base::string16> report_crash_keys(crash_keys);
+  if (record.pending_duplicates != 0) {
+    report_crash_keys[kDuplicateCountCrashKey] =
+        base::SizeTToString16(record.pending_duplicates);
+  }
+  base::FilePath stored_path = StoreReportFiles(
+      repository_path_, minidump_path, report_crash_keys, now);
+  if (stored_path.empty())
+    return;
+
+  ++record.stored_reports;
+  record.pending_duplicates = 0;
+  record.last_report = stored_path.BaseName();
+  WriteSignatureRecord(record_path, record, now);
 }
 
 bool ReportRepository::UploadPendingReport() {
+  return UploadPendingReports(1, 0);
+}
+
+bool ReportRepository::UploadPendingReports(size_t max_uploads,
+                                            uint64_t max_bytes) {
+  DCHECK_LT(0u, max_uploads);
   base::Time now = time_source_.Run();
 
   // Do a bit of opportunistic cleanup.
   CleanOrphanedCrashKeysFiles(repository_path_, now);
+  CleanStaleSignatureRecords(repository_path_, now, duplicate_window_);
 
-  std::pair<base::FilePath, base::FilePath> entry =
-      GetPendingReport(repository_path_, now, retry_interval_);
-  ScopedReportFile minidump_file(entry.first);
-  base::FilePath failure_destination = entry.second;
-
-  if (minidump_file.Get().empty())
+  std::vector<PendingReport> pending_reports;
+  GetPendingReports(repository_path_, now, retry_interval_, &pending_reports);
+  if (pending_reports.empty())
     return true;  // Successful no-op.
 
-  ScopedReportFile crash_keys_file(
-      GetCrashKeysFileForDumpFile(minidump_file.Get()));
-
-  // Renew the file timestamps before attempting upload. If we are unable to do
-  // this, make no upload attempt (since that would potentially lead to a hot
-  // loop of upload attempts).
-  if (!minidump_file.UpdateTimestamp(now))
-    return false;
-  if (!crash_keys_file.UpdateTimestamp(now))
-    return false;
+  // Claim the reports of this batch, in priority order.
+  bool success = true;
+  uint64_t batch_bytes = 0;
+  ScopedVector<ReportUpload> uploads;
+  for (size_t i = 0; i < pending_reports.size() && i < max_uploads; ++i) {
+    const PendingReport& report = pending_reports[i];
+    uint64_t report_bytes = static_cast<uint64_t>(report.size);
+    if (max_bytes != 0 && !uploads.empty() &&
+        batch_bytes + report_bytes > max_bytes) {
+      break;
+    }
 
-  // Attempt the upload.
-  std::map<base::string16, base::string16> crash_keys;
-  if (ReadCrashKeysFromFile(crash_keys_file.Get(), &crash_keys)) {
-    if (uploader_.Run(minidump_file.Get(), crash_keys))
-      return true;
+    // A report whose timestamps can't be renewed still uses up a slot of the
+    // batch, and is deleted along with its upload.
+    scoped_ptr<ReportUpload> upload(new ReportUpload(report, uploader_));
+    if (!upload->Prepare(now)) {
+      success = false;
+      continue;
+    }
+    batch_bytes += report_bytes;
+    uploads.push_back(upload.release());
   }
 
-  // We failed.
-  if (!failure_destination.empty()) {
-    HandleNonpermanentFailure(&minidump_file, &crash_keys_file,
-                              failure_destination);
-  } else {
-    HandlePermanentFailure(minidump_file.Take(), crash_keys_file.Take(),
-                           permanent_failure_handler_);
+  // Run all but the first upload on threads of their own, and the first one on
+  // this thread.
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 1; i < uploads.size(); ++i) {
+    threads.push_back(
+        new base::DelegateSimpleThread(uploads[i], "ReportRepository upload"));
+    threads.back()->Start();
   }
-  return false;
+  if (!uploads.empty())
+    uploads[0]->Run();
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  // Handle the failures.
+  for (size_t i = 0; i < uploads.size(); ++i) {
+    if (!uploads[i]->Finish(permanent_failure_handler_))
+      success = false;
+  }
+  return success;
 }
 
 bool ReportRepository::HasPendingReports() {
@@ -15,6 +15,7 @@
 #ifndef SYZYGY_KASKO_REPORT_REPOSITORY_H_
 #define SYZYGY_KASKO_REPORT_REPOSITORY_H_
 
+#include <stdint.h>
 #include <map>
 #include "base/callback.h"
 #include "base/macros.h"
@@ -30,12 +31,13 @@ namespace kasko {
 //
 // Any number of ReportRepository instances may be used to store reports (via
 // StoreReport). Only a single instance should be used for uploading (via
-// UploadPendingReport). It's the client's responsibility to enforce this
-// requirement.
+// UploadPendingReport or UploadPendingReports). It's the client's
+// responsibility to enforce this requirement.
 class ReportRepository {
  public:
   // Attempts to upload the minidump at the specified file path with the given
-  // crash keys. Returns true if successful.
+  // crash keys. Returns true if successful. This may be invoked concurrently
+  // from several threads by UploadPendingReports.
   typedef base::Callback<bool(
       const base::FilePath&,
       const std::map<base::string16, base::string16>&)> Uploader;
@@ -66,6 +68,21 @@ class ReportRepository {
 
   ~ReportRepository();
 
+  // The crash key that counts the reports of the same crash signature that
+  // were dropped in favour of a stored report.
+  static const base::char16* const kDuplicateCountCrashKey;
+
+  // Limits the number of reports stored for each crash signature. Once the
+  // limit is reached within a window, further reports with that signature are
+  // dropped and only counted, in the kDuplicateCountCrashKey crash key of the
+  // last stored report if it is still pending, or of the next stored report
+  // otherwise.
+  // @param window The interval over which reports are counted.
+  // @param max_reports_per_signature The maximum number of reports stored
+  //     for each signature within @p window, or 0 for no limit (the default).
+  void SetDuplicateReportLimit(const base::TimeDelta& window,
+                               size_t max_reports_per_signature);
+
   // Stores the provided report in the repository. Does not attempt an upload at
   // this time. The provided file will be moved or deleted by this method.
   // @param minidump_path The path to the minidump file.
@@ -74,6 +91,18 @@ class ReportRepository {
       const base::FilePath& minidump_path,
       const std::map<base::string16, base::string16>& crash_keys);
 
+  // Stores the provided report in the repository, unless the limit of reports
+  // with the same crash signature was reached. The provided file will be moved
+  // or deleted by this method.
+  // @param minidump_path The path to the minidump file.
+  // @param crash_keys The crash keys for the report.
+  // @param signature The crash signature of the report, or 0 if it has none.
+  //     Reports without a signature are always stored.
+  void StoreReport(
+      const base::FilePath& minidump_path,
+      const std::map<base::string16, base::string16>& crash_keys,
+      uint64_t signature);
+
   // Attempts to upload a pending report, if any. A report is pending if it has
   // never been submitted to an upload attempt or if its most recent upload
   // attempt is older than the configured retry interval.
@@ -81,6 +110,19 @@ class ReportRepository {
   //     uploaded.
   bool UploadPendingReport();
 
+  // Attempts to upload a batch of pending reports concurrently. Reports in
+  // "Incoming" are preferred over those being retried, and more recent reports
+  // over older ones, so that a backlog doesn't delay fresh reports. Failures
+  // are handled on the calling thread once all of the uploads have completed.
+  // @param max_uploads The maximum number of reports to upload, which is also
+  //     the maximum number of concurrent uploads. Must be at least 1.
+  // @param max_bytes The maximum total size of the minidumps in the batch, or
+  //     0 for no limit. At least one report is always attempted, whatever its
+  //     size, so that large reports can't stall the repository.
+  // @returns true if there are no pending reports or all of the attempted
+  //     reports were successfully uploaded.
+  bool UploadPendingReports(size_t max_uploads, uint64_t max_bytes);
+
   // @returns true if UploadPendingReport would attempt to upload a report.
   bool HasPendingReports();
 
@@ -90,6 +132,8 @@ class ReportRepository {
   TimeSource time_source_;
   Uploader uploader_;
   PermanentFailureHandler permanent_failure_handler_;
+  base::TimeDelta duplicate_window_;
+  size_t max_reports_per_signature_;
 
   DISALLOW_COPY_AND_ASSIGN(ReportRepository);
 };
@@ -29,6 +29,7 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/kasko/crash_keys_serialization.h"
@@ -44,6 +45,8 @@ namespace {
 // handler is invoked inappropriately or not invoked when expected.
 // A mock TimeSource is used to simulate the passage of time for retry
 // intervals.
+// Uploads may run concurrently when UploadPendingReports is used, so the upload
+// handler is thread-safe.
 // Each test should call repository()->UploadPendingReport() enough times to
 // empty the repository. The harness expects it to be empty at the end of the
 // test.
@@ -187,6 +190,7 @@ class ReportRepositoryTest : public testing::Test {
   // Implements the UploadHandler.
   bool Upload(const base::FilePath& minidump_path,
               const std::map<base::string16, base::string16>& crash_keys) {
+    base::AutoLock auto_lock(lock_);
     Report report;
     bool success = base::ReadFileToString(minidump_path, &report.first);
     EXPECT_TRUE(success);
@@ -250,6 +254,9 @@ class ReportRepositoryTest : public testing::Test {
     }
   }
 
+  // Protects the expected reports from concurrent uploads.
+  base::Lock lock_;
+
   // If true, exactly one report should never have been sent (because we
   // corrupted it).
   bool remainder_expected_;
@@ -280,6 +287,92 @@ const uint16_t ReportRepositoryTest::kHalfRetryIntervalInSeconds = 10;
 const uint16_t ReportRepositoryTest::kRetryIntervalInSeconds =
     ReportRepositoryTest::kHalfRetryIntervalInSeconds * 2;
 
+// Stores reports with crash signatures in a repository that keeps a single
+// report per signature and per hour, and records the crash keys of the
+// uploaded reports.
+class ReportRepositoryDuplicatesTest : public testing::Test {
+ public:
+  typedef std::map<base::string16, base::string16> CrashKeys;
+
+  ReportRepositoryDuplicatesTest() : time_(base::Time::Now()) {}
+
+ protected:
+  // testing::Test implementation
+  void SetUp() override {
+    ASSERT_TRUE(repository_temp_dir_.CreateUniqueTempDir());
+    repository_.reset(new ReportRepository(
+        repository_temp_dir_.path(), base::TimeDelta::FromMinutes(1),
+        base::Bind(&ReportRepositoryDuplicatesTest::GetTime,
+                   base::Unretained(this)),
+        base::Bind(&ReportRepositoryDuplicatesTest::Upload,
+                   base::Unretained(this)),
+        base::Bind(&ReportRepositoryDuplicatesTest::HandlePermanentFailure,
+                   base::Unretained(this))));
+    repository_->SetDuplicateReportLimit(base::TimeDelta::FromHours(1), 1);
+  }
+
+  // Writes a report to disk and stores it in the repository.
+  // @param signature The crash signature of the report, which is also
+  //     recorded in its crash keys.
+  void StoreReport(uint64_t signature) {
+    base::FilePath minidump_file;
+    ASSERT_TRUE(base::CreateTemporaryFileInDir(repository_temp_dir_.path(),
+                                               &minidump_file));
+    ASSERT_TRUE(base::WriteFile(minidump_file, "dump", 4));
+    CrashKeys crash_keys;
+    crash_keys[L"signature"] = base::Uint64ToString16(signature);
+    repository_->StoreReport(minidump_file, crash_keys, signature);
+  }
+
+  // Uploads all of the pending reports.
+  // @returns the crash keys of the uploaded reports, by signature.
+  std::multimap<base::string16, CrashKeys> UploadAll() {
+    uploads_.clear();
+    EXPECT_TRUE(repository_->UploadPendingReports(100, 0));
+    std::multimap<base::string16, CrashKeys> uploads;
+    for (size_t i = 0; i < uploads_.size(); ++i)
+      uploads.insert(std::make_pair(uploads_[i][L"signature"], uploads_[i]));
+    return uploads;
+  }
+
+  // @returns true if the repository directory contains no file.
+  bool IsRepositoryEmpty() {
+    return base::FileEnumerator(repository_temp_dir_.path(), true,
+                                base::FileEnumerator::FILES).Next().empty();
+  }
+
+  // Increments the simulated clock.
+  void IncrementTime(const base::TimeDelta& time_delta) { time_ += time_delta; }
+
+ private:
+  // Implements the TimeSource.
+  base::Time GetTime() { return time_; }
+
+  // Implements the Uploader.
+  bool Upload(const base::FilePath& minidump_path,
+              const CrashKeys& crash_keys) {
+    base::AutoLock auto_lock(lock_);
+    uploads_.push_back(crash_keys);
+    return true;
+  }
+
+  // Implements the PermanentFailureHandler.
+  void HandlePermanentFailure(const base::FilePath& minidump_path,
+                              const base::FilePath& crash_keys_path) {
+    ADD_FAILURE() << "Unexpected permanent failure.";
+  }
+
+  // Protects |uploads_| from concurrent uploads.
+  base::Lock lock_;
+  std::vector<CrashKeys> uploads_;
+
+  base::ScopedTempDir repository_temp_dir_;
+  base::Time time_;
+  scoped_ptr<ReportRepository> repository_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReportRepositoryDuplicatesTest);
+};
+
 }  // namespace
 
 TEST_F(ReportRepositoryTest, BasicTest) {
@@ -477,6 +570,72 @@ TEST_F(ReportRepositoryTest, MultipleInterleavedReports) {
   EXPECT_FALSE(repository()->HasPendingReports());
 }
 
+TEST_F(ReportRepositoryTest, UploadPendingReportsTest) {
+  EXPECT_TRUE(repository()->UploadPendingReports(2, 0));  // No-op
+
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  EXPECT_TRUE(repository()->UploadPendingReports(2, 0));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReports(2, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST_F(ReportRepositoryTest, UploadPendingReportsWithFailures) {
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(1);
+  InjectForFailure();
+  EXPECT_FALSE(repository()->UploadPendingReports(3, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_FALSE(repository()->UploadPendingReports(3, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_FALSE(repository()->UploadPendingReports(3, 0));  // Permanent failure
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST_F(ReportRepositoryTest, UploadPendingReportsByteLimit) {
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+  InjectForSuccessAfterRetries(0);
+
+  // Each minidump is at least one byte long, so a single report fits in the
+  // batch.
+  EXPECT_TRUE(repository()->UploadPendingReports(3, 1));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReports(3, 1));
+  EXPECT_TRUE(repository()->HasPendingReports());
+  EXPECT_TRUE(repository()->UploadPendingReports(3, 1));
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
+TEST_F(ReportRepositoryTest, UploadPendingReportsPriority) {
+  // The newest incoming report is uploaded first.
+  InjectForSuccessAfterRetries(1);
+  IncrementTime(base::TimeDelta::FromSeconds(1));
+  InjectForSuccessAfterRetries(0);
+  EXPECT_TRUE(repository()->UploadPendingReports(1, 0));
+  EXPECT_FALSE(repository()->UploadPendingReports(1, 0));  // Failure
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  // Incoming reports are uploaded before retried ones.
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  InjectForFailure();
+  EXPECT_FALSE(repository()->UploadPendingReports(1, 0));  // Failure
+  EXPECT_TRUE(repository()->UploadPendingReports(1, 0));
+  EXPECT_FALSE(repository()->HasPendingReports());
+
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_FALSE(repository()->UploadPendingReports(1, 0));  // Failure
+  IncrementTime(base::TimeDelta::FromSeconds(kRetryIntervalInSeconds));
+  EXPECT_FALSE(repository()->UploadPendingReports(1, 0));  // Permanent failure
+  EXPECT_FALSE(repository()->HasPendingReports());
+}
+
 TEST_F(ReportRepositoryTest, CorruptionTest) {
   // In order to avoid hard-coding extensions/paths, and having a bunch of
   // permutations, let's run this test a bunch of times and probabilistically
@@ -508,4 +667,49 @@ TEST_F(ReportRepositoryTest, CorruptionTest) {
   }
 }
 
+TEST_F(ReportRepositoryDuplicatesTest, DuplicatesOfPendingReport) {
+  StoreReport(1);
+  StoreReport(1);
+  StoreReport(1);
+  StoreReport(2);
+
+  std::multimap<base::string16, CrashKeys> uploads = UploadAll();
+  ASSERT_EQ(2u, uploads.size());
+  ASSERT_EQ(1u, uploads.count(L"1"));
+  EXPECT_EQ(L"2", uploads.find(L"1")->second[
+      ReportRepository::kDuplicateCountCrashKey]);
+  ASSERT_EQ(1u, uploads.count(L"2"));
+  EXPECT_EQ(0u, uploads.find(L"2")->second.count(
+      ReportRepository::kDuplicateCountCrashKey));
+}
+
+TEST_F(ReportRepositoryDuplicatesTest, DuplicatesOfUploadedReport) {
+  StoreReport(1);
+  EXPECT_EQ(1u, UploadAll().size());
+
+  // The duplicates are carried over to the next window.
+  StoreReport(1);
+  StoreReport(1);
+  EXPECT_EQ(0u, UploadAll().size());
+  IncrementTime(base::TimeDelta::FromHours(1));
+  StoreReport(1);
+
+  std::multimap<base::string16, CrashKeys> uploads = UploadAll();
+  ASSERT_EQ(1u, uploads.size());
+  EXPECT_EQ(L"2", uploads.begin()->second[
+      ReportRepository::kDuplicateCountCrashKey]);
+
+  // The signature records are eventually deleted.
+  IncrementTime(base::TimeDelta::FromDays(2));
+  EXPECT_EQ(0u, UploadAll().size());
+  EXPECT_TRUE(IsRepositoryEmpty());
+}
+
+TEST_F(ReportRepositoryDuplicatesTest, ReportsWithoutSignature) {
+  StoreReport(0);
+  StoreReport(0);
+  EXPECT_EQ(2u, UploadAll().size());
+  EXPECT_TRUE(IsRepositoryEmpty());
+}
+
 }  // namespace kasko
@@ -28,6 +28,7 @@
 #include "base/strings/utf_string_conversions.h"
 #include "base/threading/platform_thread.h"
 #include "base/time/time.h"
+#include "syzygy/kasko/capture_thread.h"
 #include "syzygy/kasko/http_agent_impl.h"
 #include "syzygy/kasko/minidump.h"
 #include "syzygy/kasko/service.h"
@@ -47,26 +48,34 @@ const base::char16* const kRpcProtocol = L"ncalrpc";
 // The subdirectory where minidumps are generated.
 const base::char16* const kTemporarySubdir = L"Temporary";
 
+// The maximum number of reports uploaded concurrently at each upload interval.
+const size_t kMaxConcurrentUploads = 4;
+
+// The maximum total size of the minidumps uploaded at each upload interval.
+// This bounds the bandwidth used while draining a backlog of reports.
+const uint64_t kMaxUploadBytesPerInterval = 8 * 1024 * 1024;
+
+// The window over which reports with the same crash signature are counted.
+const int kDuplicateReportWindowInHours = 1;
+
+// The maximum number of reports stored for each crash signature per window.
+// Further reports are only counted in the crash keys of a stored report.
+const size_t kMaxReportsPerSignature = 1;
+
 // Uploads a crash report containing the minidump at |minidump_path| and
-// |crash_keys| to |upload_url|. Returns true if successful.
+// |crash_keys| to |upload_url| using |http_agent|. Returns true if successful.
 bool UploadCrashReport(
+    HttpAgent* http_agent,
     const base::string16& upload_url,
     const base::FilePath& minidump_path,
     const std::map<base::string16, base::string16>& crash_keys) {
-  std::string dump_contents;
-  if (!base::ReadFileToString(minidump_path, &dump_contents)) {
-    LOG(ERROR) << "Failed to read the minidump file at "
-               << minidump_path.value();
-    return false;
-  }
-
-  HttpAgentImpl http_agent(
-      L"Kasko", base::ASCIIToUTF16(KASKO_VERSION_STRING));
+  // The minidump is streamed from disk and compressed, as full memory dumps
+  // may be hundreds of megabytes.
   base::string16 remote_dump_id;
   uint16_t response_code = 0;
-  if (!SendHttpUpload(&http_agent, upload_url, crash_keys, dump_contents,
-                      Reporter::kMinidumpUploadFilePart, &remote_dump_id,
-                      &response_code)) {
+  if (!SendHttpFileUpload(http_agent, upload_url, crash_keys, minidump_path,
+                          Reporter::kMinidumpUploadFilePart, true,
+                          &remote_dump_id, &response_code)) {
     LOG(ERROR) << "Failed to upload the minidump file to " << upload_url;
     return false;
   } else {
@@ -79,6 +88,17 @@ bool UploadCrashReport(
   return true;
 }
 
+// Uploads the pending reports of |report_repository| with |http_agent|. This
+// is invoked by the UploadThread. The uploads of a batch share the connections
+// of |http_agent|, which are closed once the batch is done rather than being
+// held open until the next upload interval.
+void UploadPendingReports(ReportRepository* report_repository,
+                          HttpAgentImpl* http_agent) {
+  report_repository->UploadPendingReports(kMaxConcurrentUploads,
+                                          kMaxUploadBytesPerInterval);
+  http_agent->CloseConnections();
+}
+
 // Moves |minidump_path| and |crash_keys_path| to |permanent_failure_directory|.
 // The destination filenames have the filename from |minidump_path| and the
 // extensions Reporter::kPermanentFailureMinidumpExtension and
@@ -108,15 +128,11 @@ void HandlePermanentFailure(const base::FilePath& permanent_failure_directory,
   }
 }
 
+// Captures the report of |request| and stores it in |report_repository|. This
+// is invoked by the CaptureThread.
 void SendReportImpl(const base::FilePath& temporary_directory,
                     ReportRepository* report_repository,
-                    base::ProcessId client_process_id,
-                    uint64_t exception_info_address,
-                    base::PlatformThreadId thread_id,
-                    MinidumpType minidump_type,
-                    const char* protobuf,
-                    size_t protobuf_length,
-                    std::map<base::string16, base::string16> crash_keys) {
+                    const CaptureRequest& request) {
   if (!base::CreateDirectory(temporary_directory)) {
     LOG(ERROR) << "Failed to create dump destination directory: "
                << temporary_directory.value();
@@ -130,31 +146,34 @@ void SendReportImpl(const base::FilePath& temporary_directory,
   }
 
   std::vector<CustomStream> custom_streams;
-  if (protobuf && protobuf_length) {
-    CustomStream custom_stream = {
-        Reporter::kProtobufStreamType, protobuf, protobuf_length};
+  if (!request.protobuf.empty()) {
+    CustomStream custom_stream = {Reporter::kProtobufStreamType,
+                                  request.protobuf.data(),
+                                  request.protobuf.length()};
     custom_streams.push_back(custom_stream);
   }
 
-  if (!GenerateMinidump(dump_file, client_process_id, thread_id,
-                        exception_info_address, minidump_type,
+  if (!GenerateMinidump(dump_file, request.process_id, request.thread_id,
+                        request.exception_info_address, request.minidump_type,
                         custom_streams)) {
     LOG(ERROR) << "Minidump generation failed.";
     base::DeleteFile(dump_file, false);
     return;
   }
 
-  report_repository->StoreReport(dump_file, crash_keys);
+  // Reports without an exception, or whose signature can't be computed, are
+  // always stored.
+  uint64_t signature = 0;
+  if (!GetMinidumpCrashSignature(dump_file, &signature))
+    signature = 0;
+  report_repository->StoreReport(dump_file, request.crash_keys, signature);
 }
 
-// Implements kasko::Service to capture minidumps and store them in a
-// ReportRepository.
+// Implements kasko::Service to queue minidump captures on a CaptureThread.
 class ServiceImpl : public Service {
   public:
-   ServiceImpl(const base::FilePath& temporary_directory,
-               ReportRepository* report_repository)
-       : temporary_directory_(temporary_directory),
-         report_repository_(report_repository) {}
+   explicit ServiceImpl(CaptureThread* capture_thread)
+       : capture_thread_(capture_thread) {}
 
    ~ServiceImpl() override {}
 
@@ -167,14 +186,20 @@ class ServiceImpl : public Service {
        const char* protobuf,
        size_t protobuf_length,
        const std::map<base::string16, base::string16>& crash_keys) override {
-     SendReportImpl(temporary_directory_, report_repository_, client_process_id,
-                    exception_info_address, thread_id, minidump_type, protobuf,
-                    protobuf_length, crash_keys);
+     // The protobuf is copied, as it doesn't outlive this call.
+     CaptureRequest request;
+     request.process_id = client_process_id;
+     request.exception_info_address = exception_info_address;
+     request.thread_id = thread_id;
+     request.minidump_type = minidump_type;
+     if (protobuf && protobuf_length)
+       request.protobuf.assign(protobuf, protobuf_length);
+     request.crash_keys = crash_keys;
+     capture_thread_->Capture(request);
    }
 
   private:
-   base::FilePath temporary_directory_;
-   ReportRepository* report_repository_;
+   CaptureThread* capture_thread_;
 
    DISALLOW_COPY_AND_ASSIGN(ServiceImpl);
 };
@@ -209,19 +234,23 @@ scoped_ptr<Reporter> Reporter::Create(
     LOG(ERROR) << "Failed to create a timer for the upload process.";
     return scoped_ptr<Reporter>();
   }
-  // It's safe to pass an Unretained reference to |report_repository_| because
-  // |instance| will shut down |upload_thread_| before destroying
-  // |report_repository_|..
+  // It's safe to pass Unretained references to |report_repository_| and
+  // |http_agent_| because |instance| will shut down |upload_thread_| before
+  // destroying them.
   instance->upload_thread_ = UploadThread::Create(
       data_directory, waitable_timer.Pass(),
-      base::Bind(base::IgnoreResult(&ReportRepository::UploadPendingReport),
-                 base::Unretained(&instance->report_repository_)));
+      base::Bind(&UploadPendingReports,
+                 base::Unretained(&instance->report_repository_),
+                 base::Unretained(&instance->http_agent_)));
 
   if (!instance->upload_thread_) {
     LOG(ERROR) << "Failed to initialize background upload process.";
     return scoped_ptr<Reporter>();
   }
 
+  // The capture thread must be running before requests come in.
+  instance->capture_thread_.Start();
+
   if (!instance->service_bridge_.Run()) {
     LOG(ERROR) << "Failed to start the Kasko RPC service using protocol "
                << kRpcProtocol << " and endpoint name " << endpoint_name << ".";
@@ -239,15 +268,18 @@ void Reporter::SendReportForProcess(
     base::ProcessHandle process_handle,
     MinidumpType minidump_type,
     const std::map<base::string16, base::string16>& crash_keys) {
-  SendReportImpl(temporary_minidump_directory_, &report_repository_,
-                 base::GetProcId(process_handle), NULL, 0, minidump_type, NULL,
-                 0, crash_keys);
+  CaptureRequest request;
+  request.process_id = base::GetProcId(process_handle);
+  request.minidump_type = minidump_type;
+  request.crash_keys = crash_keys;
+  capture_thread_.Capture(request);
 }
 
 // static
 void Reporter::Shutdown(scoped_ptr<Reporter> instance) {
   instance->upload_thread_->Stop();  // Non-blocking.
   instance->service_bridge_.Stop();  // Blocking.
+  instance->capture_thread_.Stop();  // Blocking.
   instance->upload_thread_->Join();  // Blocking.
 }
 
@@ -256,19 +288,24 @@ Reporter::Reporter(const base::string16& endpoint_name,
                    const base::FilePath& data_directory,
                    const base::FilePath& permanent_failure_directory,
                    const base::TimeDelta& retry_interval)
-    : report_repository_(
+    : http_agent_(L"Kasko", base::ASCIIToUTF16(KASKO_VERSION_STRING)),
+      report_repository_(
           data_directory,
           retry_interval,
           base::Bind(&base::Time::Now),
-          base::Bind(&UploadCrashReport, url),
+          base::Bind(&UploadCrashReport, base::Unretained(&http_agent_), url),
           base::Bind(&HandlePermanentFailure, permanent_failure_directory)),
       temporary_minidump_directory_(
           base::FilePath(data_directory).Append(kTemporarySubdir)),
-      service_bridge_(
-          kRpcProtocol,
-          endpoint_name,
-          make_scoped_ptr(new ServiceImpl(temporary_minidump_directory_,
-                                          &report_repository_))) {
+      capture_thread_(base::Bind(&SendReportImpl,
+                                 temporary_minidump_directory_,
+                                 base::Unretained(&report_repository_))),
+      service_bridge_(kRpcProtocol,
+                      endpoint_name,
+                      make_scoped_ptr(new ServiceImpl(&capture_thread_))) {
+  report_repository_.SetDuplicateReportLimit(
+      base::TimeDelta::FromHours(kDuplicateReportWindowInHours),
+      kMaxReportsPerSignature);
 }
 
 }  // namespace kasko
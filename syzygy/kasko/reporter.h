@@ -20,6 +20,8 @@
 #include "base/memory/scoped_ptr.h"
 #include "base/process/process_handle.h"
 #include "base/strings/string16.h"
+#include "syzygy/kasko/capture_thread.h"
+#include "syzygy/kasko/http_agent_impl.h"
 #include "syzygy/kasko/minidump_type.h"
 #include "syzygy/kasko/report_repository.h"
 #include "syzygy/kasko/service_bridge.h"
@@ -77,7 +79,8 @@ class Reporter {
   ~Reporter();
 
   // Sends a diagnostic report for a specified process with the specified crash
-  // keys.
+  // keys. The process is suspended and the report is captured in the
+  // background, so this returns without waiting for the minidump generation.
   // @param process_handle A handle to the process to report on.
   // @param minidump_type The type of minidump to be included in the report.
   // @param crash_keys Crash keys to include in the report.
@@ -108,6 +111,10 @@ class Reporter {
            const base::FilePath& permanent_failure_directory,
            const base::TimeDelta& retry_interval);
 
+  // The agent that reports are uploaded with. It is shared by the concurrent
+  // uploads of a batch, so that they reuse its connections.
+  HttpAgentImpl http_agent_;
+
   // A repository for generated reports.
   ReportRepository report_repository_;
 
@@ -117,6 +124,10 @@ class Reporter {
   // The directory where minidumps will be initially created.
   base::FilePath temporary_minidump_directory_;
 
+  // A background minidump capturer, fed by the RPC service and by
+  // SendReportForProcess.
+  CaptureThread capture_thread_;
+
   // An RPC service endpoint.
   ServiceBridge service_bridge_;
 
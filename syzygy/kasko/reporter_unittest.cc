@@ -72,7 +72,7 @@ void DoInvokeService(const base::string16& endpoint,
   common::rpc::RpcStatus status = common::rpc::InvokeRpc(
       KaskoClient_SendDiagnosticReport, rpc_binding.Get(), NULL, 0, SMALL_DUMP,
       protobuf.length(), reinterpret_cast<const signed char*>(protobuf.c_str()),
-      arraysize(crash_keys), crash_keys);
+      arraysize(crash_keys), crash_keys, 0, 0);
   ASSERT_FALSE(status.exception_occurred);
   ASSERT_TRUE(status.succeeded());
 }
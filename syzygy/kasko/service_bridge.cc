@@ -17,8 +17,10 @@
 #include "base/logging.h"
 #include "base/process/process_handle.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/rpc/helpers.h"
+#include "syzygy/kasko/crash_keys_serialization.h"
 #include "syzygy/kasko/service.h"
 
 namespace kasko {
@@ -29,14 +31,17 @@ ServiceBridge* g_service_bridge = NULL;
 
 // RPC calls all come through this single free function. We use the singleton
 // g_service_bridge to forward the call to the running Service.
-boolean KaskoService_SendDiagnosticReport(handle_t IDL_handle,
-                                          unsigned long exception_info_address,
-                                          unsigned long thread_id,
-                                          DumpType minidump_type,
-                                          unsigned long protobuf_length,
-                                          const signed char* protobuf,
-                                          unsigned long crash_keys_size,
-                                          const CrashKey* crash_keys) {
+boolean KaskoService_SendDiagnosticReport(
+    handle_t IDL_handle,
+    unsigned long exception_info_address,
+    unsigned long thread_id,
+    DumpType minidump_type,
+    unsigned long protobuf_length,
+    const signed char* protobuf,
+    unsigned long crash_keys_size,
+    const CrashKey* crash_keys,
+    unsigned long crash_key_table_address,
+    unsigned long crash_key_table_size) {
   DCHECK(kasko::g_service_bridge);
 
   base::ProcessId client_process_id =
@@ -53,6 +58,22 @@ boolean KaskoService_SendDiagnosticReport(handle_t IDL_handle,
         base::UTF8ToUTF16(reinterpret_cast<const char*>(crash_keys[i].value));
   }
 
+  // Add the crash keys of the client's table. A report is still generated if
+  // they can't be read.
+  if (crash_key_table_address && crash_key_table_size) {
+    base::win::ScopedHandle client_process(
+        ::OpenProcess(PROCESS_VM_READ, FALSE, client_process_id));
+    if (!client_process.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to open the client process: "
+                 << ::common::LogWe(error) << ".";
+    } else {
+      kasko::ReadCrashKeysFromProcess(client_process.Get(),
+                                      crash_key_table_address,
+                                      crash_key_table_size, &crash_keys_map);
+    }
+  }
+
   kasko::MinidumpType internal_minidump_type = kasko::SMALL_DUMP_TYPE;
   switch (minidump_type) {
     case SMALL_DUMP:
@@ -69,7 +69,9 @@ class ServiceBridge {
       unsigned long protobuf_length,
       const signed char* protobuf,
       unsigned long crash_keys_size,
-      const CrashKey* crash_keys);
+      const CrashKey* crash_keys,
+      unsigned long crash_key_table_address,
+      unsigned long crash_key_table_size);
 
   scoped_ptr<common::rpc::ScopedRpcInterfaceRegistration>
       interface_registration_;
@@ -108,7 +108,7 @@ void DoInvokeService(const base::string16& protocol,
   common::rpc::RpcStatus status = common::rpc::InvokeRpc(
       KaskoClient_SendDiagnosticReport, rpc_binding.Get(), NULL, 0, SMALL_DUMP,
       protobuf.length(), reinterpret_cast<const signed char*>(protobuf.c_str()),
-      crash_keys_length, crash_keys);
+      crash_keys_length, crash_keys, 0, 0);
   ASSERT_FALSE(status.exception_occurred);
   ASSERT_TRUE(status.succeeded());
   *complete = true;
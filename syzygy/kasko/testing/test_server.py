@@ -14,6 +14,7 @@
 
 import BaseHTTPServer
 import cgi
+import cStringIO
 import msvcrt
 import optparse
 import os
@@ -22,6 +23,7 @@ import struct
 import sys
 import tempfile
 import uuid
+import zlib
 
 def serve_file_handler(file_path):
   class ServeFileHandler(BaseHTTPServer.BaseHTTPRequestHandler):
@@ -49,7 +51,17 @@ def multipart_form_handler(incoming_directory):
           self.headers.getheader('content-type'))
       if content_type != 'multipart/form-data':
         raise Exception('Unsupported Content-Type: ' + content_type)
-      post_multipart = cgi.parse_multipart(self.rfile, parameters)
+      body = self.rfile
+      content_encoding = self.headers.getheader('content-encoding')
+      if content_encoding == 'gzip':
+        length = int(self.headers.getheader('content-length'))
+        body = cStringIO.StringIO(
+            zlib.decompress(self.rfile.read(length), 16 + zlib.MAX_WBITS))
+      elif content_encoding:
+        self.send_response(415)
+        self.end_headers()
+        return
+      post_multipart = cgi.parse_multipart(body, parameters)
       if self.path == '/crash_failure':
         self.send_response(500)
         self.end_headers()
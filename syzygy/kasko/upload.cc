@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <vector>
+
 #include "base/logging.h"
+#include "base/files/file.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 
@@ -20,11 +24,224 @@
 #include "syzygy/kasko/http_agent.h"
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
+#include "third_party/zlib/zlib.h"
 
 namespace kasko {
 
 namespace {
 
+// The size of the chunks in which streamed request bodies are built.
+const size_t kRequestBodyChunkSize = 64 * 1024;
+
+// The HTTP status code of a server that doesn't accept the Content-Encoding of
+// a request.
+const uint16_t kHttpUnsupportedMediaType = 415;
+
+// The header sent with compressed request bodies.
+const base::char16 kGzipContentEncodingHeader[] = L"Content-Encoding: gzip";
+
+// Writes a request body to a file, optionally compressing it with gzip.
+class RequestBodyWriter {
+ public:
+  RequestBodyWriter()
+      : buffer_(kRequestBodyChunkSize),
+        compress_(false),
+        zstream_initialized_(false) {
+    ::memset(&zstream_, 0, sizeof(zstream_));
+  }
+
+  ~RequestBodyWriter() {
+    if (zstream_initialized_)
+      deflateEnd(&zstream_);
+  }
+
+  // Creates the file that receives the request body.
+  // @param path The path to the file.
+  // @param compress Whether to compress the request body.
+  // @returns true if successful.
+  bool Init(const base::FilePath& path, bool compress) {
+    file_.Initialize(path,
+                     base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+    if (!file_.IsValid()) {
+      LOG(ERROR) << "Failed to create " << path.value();
+      return false;
+    }
+
+    compress_ = compress;
+    if (!compress_)
+      return true;
+
+    // The window bits are offset by 16 in order to get a gzip header and
+    // trailer rather than zlib ones.
+    int ret = deflateInit2(&zstream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                           MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+      LOG(ERROR) << "deflateInit2 returned " << ret << ".";
+      return false;
+    }
+    zstream_initialized_ = true;
+    return true;
+  }
+
+  // Appends data to the request body.
+  // @param data The data to append.
+  // @param size The size of @p data.
+  // @returns true if successful.
+  bool Write(const char* data, size_t size) {
+    if (!compress_)
+      return WriteToFile(data, size);
+
+    zstream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zstream_.avail_in = static_cast<uInt>(size);
+    return Deflate(Z_NO_FLUSH);
+  }
+
+  // Completes the request body and closes the file.
+  // @returns true if successful.
+  bool Finish() {
+    if (compress_) {
+      zstream_.next_in = nullptr;
+      zstream_.avail_in = 0;
+      if (!Deflate(Z_FINISH))
+        return false;
+    }
+    file_.Close();
+    return true;
+  }
+
+ private:
+  // Compresses the pending input of the zlib stream and writes the output to
+  // the file.
+  // @param flush The zlib flush mode.
+  // @returns true if successful.
+  bool Deflate(int flush) {
+    DCHECK(zstream_initialized_);
+    do {
+      zstream_.next_out = reinterpret_cast<Bytef*>(buffer_.data());
+      zstream_.avail_out = static_cast<uInt>(buffer_.size());
+      int ret = deflate(&zstream_, flush);
+      if (ret == Z_STREAM_ERROR) {
+        LOG(ERROR) << "deflate returned " << ret << ".";
+        return false;
+      }
+      if (!WriteToFile(buffer_.data(), buffer_.size() - zstream_.avail_out))
+        return false;
+    } while (zstream_.avail_out == 0);
+    DCHECK_EQ(0u, zstream_.avail_in);
+    return true;
+  }
+
+  // Writes data to the file.
+  // @param data The data to write.
+  // @param size The size of @p data.
+  // @returns true if successful.
+  bool WriteToFile(const char* data, size_t size) {
+    while (size > 0) {
+      int written = file_.WriteAtCurrentPos(data, static_cast<int>(size));
+      if (written <= 0) {
+        LOG(ERROR) << "Failed to write the request body.";
+        return false;
+      }
+      data += written;
+      size -= written;
+    }
+    return true;
+  }
+
+  base::File file_;
+  std::vector<char> buffer_;
+  bool compress_;
+  z_stream zstream_;
+  bool zstream_initialized_;
+
+  DISALLOW_COPY_AND_ASSIGN(RequestBodyWriter);
+};
+
+// Builds a multipart HTTP message body in a file, reading the file part a chunk
+// at a time.
+// @param parameters HTTP request parameters to be encoded in the body.
+// @param upload_file_path The path to the file to be encoded in the body.
+// @param file_part_name The parameter name to be assigned to the file part.
+// @param boundary The MIME boundary to use.
+// @param compress Whether to compress the body with gzip.
+// @param body_path The path to the file that receives the body.
+// @returns true if successful.
+bool WriteMultipartHttpRequestBody(
+    const std::map<base::string16, base::string16>& parameters,
+    const base::FilePath& upload_file_path,
+    const base::string16& file_part_name,
+    const base::string16& boundary,
+    bool compress,
+    const base::FilePath& body_path) {
+  base::File upload_file(upload_file_path,
+                         base::File::FLAG_OPEN | base::File::FLAG_READ);
+  if (!upload_file.IsValid()) {
+    LOG(ERROR) << "Failed to open " << upload_file_path.value();
+    return false;
+  }
+
+  RequestBodyWriter writer;
+  if (!writer.Init(body_path, compress))
+    return false;
+
+  std::string prefix = GenerateMultipartHttpRequestBodyPrefix(
+      parameters, file_part_name, boundary);
+  if (!writer.Write(prefix.data(), prefix.size()))
+    return false;
+
+  std::vector<char> chunk(kRequestBodyChunkSize);
+  while (true) {
+    int bytes_read = upload_file.ReadAtCurrentPos(
+        chunk.data(), static_cast<int>(chunk.size()));
+    if (bytes_read < 0) {
+      LOG(ERROR) << "Failed to read " << upload_file_path.value();
+      return false;
+    }
+    if (bytes_read == 0)
+      break;
+    if (!writer.Write(chunk.data(), bytes_read))
+      return false;
+  }
+
+  std::string suffix = GenerateMultipartHttpRequestBodySuffix(boundary);
+  if (!writer.Write(suffix.data(), suffix.size()))
+    return false;
+  return writer.Finish();
+}
+
+// Decomposes an upload URL.
+// @param url The URL to decompose.
+// @param host Receives the host.
+// @param port Receives the port.
+// @param path Receives the path.
+// @param secure Receives whether the URL uses HTTPS.
+// @returns true if the URL is a valid HTTP or HTTPS URL.
+bool DecomposeUploadUrl(const base::string16& url,
+                        base::string16* host,
+                        uint16_t* port,
+                        base::string16* path,
+                        bool* secure) {
+  DCHECK(host);
+  DCHECK(port);
+  DCHECK(path);
+  DCHECK(secure);
+
+  base::string16 scheme;
+  if (!DecomposeUrl(url, &scheme, host, port, path)) {
+    LOG(ERROR) << "Failed to decompose URL: " << url;
+    return false;
+  }
+
+  *secure = false;
+  if (scheme == L"https") {
+    *secure = true;
+  } else if (scheme != L"http") {
+    LOG(ERROR) << "Invalid scheme in URL: " << url;
+    return false;
+  }
+  return true;
+}
+
 // Reads up to |count| bytes of raw response body into |buffer|. Returns true if
 // the entire response body is successfully read. Regardless of success or
 // failure, |*count| will be assigned the number of bytes read (between 0 and
@@ -151,6 +368,45 @@ bool ReadResponse(HttpResponse* response, base::string16 *response_body) {
   return true;
 }
 
+// Handles the response to an upload.
+// @param url The resource to which the upload was POSTed.
+// @param response The response to the upload.
+// @param response_body Receives the HTTP response body.
+// @param response_code Receives the HTTP response status code.
+// @returns true if the upload succeeded.
+bool HandleUploadResponse(const base::string16& url,
+                          HttpResponse* response,
+                          base::string16* response_body,
+                          uint16_t* response_code) {
+  DCHECK(response);
+  DCHECK(response_body);
+  DCHECK(response_code);
+
+  uint16_t status_code = 0;
+  if (!response->GetStatusCode(&status_code))
+    return false;
+
+  *response_code = status_code;
+
+  if (status_code != 200) {
+    LOG(ERROR) << "Request to " << url << " failed with HTTP status code "
+               << status_code;
+    return false;
+  }
+
+  if (!ReadResponse(response, response_body)) {
+    if (response_body->length()) {
+      LOG(ERROR) << "Failure while reading response body. Possibly truncated "
+                    "response body: " << *response_body;
+    } else {
+      LOG(ERROR) << "Failure while reading response body.";
+    }
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 bool SendHttpUpload(HttpAgent* agent,
@@ -163,20 +419,11 @@ bool SendHttpUpload(HttpAgent* agent,
   DCHECK(response_body);
   DCHECK(response_code);
 
-  base::string16 scheme, host, path;
+  base::string16 host, path;
   uint16_t port = 0;
-  if (!DecomposeUrl(url, &scheme, &host, &port, &path)) {
-    LOG(ERROR) << "Failed to decompose URL: " << url;
-    return false;
-  }
-
   bool secure = false;
-  if (scheme == L"https") {
-    secure = true;
-  } else if (scheme != L"http") {
-    LOG(ERROR) << "Invalid scheme in URL: " << url;
+  if (!DecomposeUploadUrl(url, &host, &port, &path, &secure))
     return false;
-  }
 
   base::string16 boundary = GenerateMultipartHttpRequestBoundary();
   base::string16 content_type_header =
@@ -192,29 +439,69 @@ bool SendHttpUpload(HttpAgent* agent,
     return false;
   }
 
-  uint16_t status_code = 0;
-  if (!response->GetStatusCode(&status_code))
-    return false;
+  return HandleUploadResponse(url, response.get(), response_body,
+                              response_code);
+}
 
-  *response_code = status_code;
+bool SendHttpFileUpload(
+    HttpAgent* agent,
+    const base::string16& url,
+    const std::map<base::string16, base::string16>& parameters,
+    const base::FilePath& upload_file_path,
+    const base::string16& file_part_name,
+    bool compress,
+    base::string16* response_body,
+    uint16_t* response_code) {
+  DCHECK(response_body);
+  DCHECK(response_code);
 
-  if (status_code != 200) {
-    LOG(ERROR) << "Request to " << url << " failed with HTTP status code "
-               << status_code;
+  base::string16 host, path;
+  uint16_t port = 0;
+  bool secure = false;
+  if (!DecomposeUploadUrl(url, &host, &port, &path, &secure))
     return false;
-  }
 
-  if (!ReadResponse(response.get(), response_body)) {
-    if (response_body->length()) {
-      LOG(ERROR) << "Failure while reading response body. Possibly truncated "
-                    "response body: " << *response_body;
-    } else {
-      LOG(ERROR) << "Failure while reading response body.";
-    }
+  base::ScopedTempDir temp_dir;
+  if (!temp_dir.CreateUniqueTempDir()) {
+    LOG(ERROR) << "Failed to create a temporary directory for the request.";
     return false;
   }
+  base::FilePath body_path = temp_dir.path().Append(L"request_body");
+
+  while (true) {
+    base::string16 boundary = GenerateMultipartHttpRequestBoundary();
+    base::string16 headers =
+        GenerateMultipartHttpRequestContentTypeHeader(boundary);
+    if (compress)
+      headers += base::string16(L"\r\n") + kGzipContentEncodingHeader;
+
+    if (!WriteMultipartHttpRequestBody(parameters, upload_file_path,
+                                       file_part_name, boundary, compress,
+                                       body_path)) {
+      return false;
+    }
 
-  return true;
+    scoped_ptr<HttpResponse> response =
+        agent->PostFile(host, port, path, secure, headers, body_path);
+    if (!response) {
+      LOG(ERROR) << "Request to " << url << " failed.";
+      return false;
+    }
+
+    // Fall back to an uncompressed request if the server doesn't accept
+    // compressed ones.
+    uint16_t status_code = 0;
+    if (compress && response->GetStatusCode(&status_code) &&
+        status_code == kHttpUnsupportedMediaType) {
+      LOG(WARNING) << "Request to " << url << " doesn't accept compressed "
+                   << "requests. Retrying uncompressed.";
+      compress = false;
+      continue;
+    }
+
+    return HandleUploadResponse(url, response.get(), response_body,
+                                response_code);
+  }
 }
 
 }  // namespace kasko
@@ -21,7 +21,10 @@
 #include <string>
 #include <vector>
 
+#include "base/file_util.h"
 #include "base/macros.h"
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_tokenizer.h"
@@ -32,11 +35,35 @@
 #include "syzygy/kasko/http_response.h"
 #include "syzygy/kasko/internet_helpers.h"
 #include "syzygy/kasko/internet_unittest_helpers.h"
+#include "third_party/zlib/zlib.h"
 
 namespace kasko {
 
 namespace {
 
+const base::char16 kContentEncodingHeaderPrefix[] = L"\r\nContent-Encoding: ";
+
+// Decompresses gzip data.
+bool Gunzip(const std::string& compressed, std::string* decompressed) {
+  z_stream zstream = {};
+  if (inflateInit2(&zstream, MAX_WBITS + 16) != Z_OK)
+    return false;
+  zstream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  zstream.avail_in = static_cast<uInt>(compressed.size());
+  decompressed->clear();
+  int ret = Z_OK;
+  while (ret == Z_OK) {
+    char buffer[1024];
+    zstream.next_out = reinterpret_cast<Bytef*>(buffer);
+    zstream.avail_out = sizeof(buffer);
+    ret = inflate(&zstream, Z_NO_FLUSH);
+    decompressed->append(buffer, sizeof(buffer) - zstream.avail_out);
+  }
+  inflateEnd(&zstream);
+  return ret == Z_STREAM_END;
+}
+
 // An implementation of HttpAgent that performs a sanity check on the request
 // parameters before returning a fixed HttpResponse.
 class MockHttpAgent : public HttpAgent {
@@ -50,6 +77,9 @@ class MockHttpAgent : public HttpAgent {
     std::map<base::string16, base::string16> parameters;
     std::string file;
     base::string16 file_name;
+    // The Content-Encoding expected for requests with a file body, or empty
+    // if they shouldn't be encoded.
+    base::string16 content_encoding;
   };
 
   MockHttpAgent();
@@ -68,8 +98,23 @@ class MockHttpAgent : public HttpAgent {
                                         bool secure,
                                         const base::string16& extra_headers,
                                         const std::string& body) override;
+  virtual scoped_ptr<HttpResponse> PostFile(
+      const base::string16& host,
+      uint16_t port,
+      const base::string16& path,
+      bool secure,
+      const base::string16& extra_headers,
+      const base::FilePath& body_path) override;
 
  private:
+  // Checks the parameters of a request.
+  void ExpectRequest(const base::string16& host,
+                     uint16_t port,
+                     const base::string16& path,
+                     bool secure,
+                     const base::string16& extra_headers,
+                     const std::string& body);
+
   Expectations expectations_;
   scoped_ptr<HttpResponse> response_;
   bool invoked_;
@@ -99,6 +144,48 @@ scoped_ptr<HttpResponse> MockHttpAgent::Post(
     bool secure,
     const base::string16& extra_headers,
     const std::string& body) {
+  ExpectRequest(host, port, path, secure, extra_headers, body);
+  return response_.Pass();
+}
+
+scoped_ptr<HttpResponse> MockHttpAgent::PostFile(
+    const base::string16& host,
+    uint16_t port,
+    const base::string16& path,
+    bool secure,
+    const base::string16& extra_headers,
+    const base::FilePath& body_path) {
+  std::string body;
+  EXPECT_TRUE(base::ReadFileToString(body_path, &body));
+
+  // Split the Content-Encoding header, which follows the Content-Type one, if
+  // any.
+  base::string16 content_type_header = extra_headers;
+  base::string16 content_encoding;
+  size_t content_encoding_start =
+      extra_headers.find(kContentEncodingHeaderPrefix);
+  if (content_encoding_start != base::string16::npos) {
+    content_type_header = extra_headers.substr(0, content_encoding_start);
+    content_encoding = extra_headers.substr(
+        content_encoding_start + arraysize(kContentEncodingHeaderPrefix) - 1);
+  }
+  EXPECT_EQ(expectations_.content_encoding, content_encoding);
+  if (content_encoding == L"gzip") {
+    std::string compressed_body;
+    compressed_body.swap(body);
+    EXPECT_TRUE(Gunzip(compressed_body, &body));
+  }
+
+  ExpectRequest(host, port, path, secure, content_type_header, body);
+  return response_.Pass();
+}
+
+void MockHttpAgent::ExpectRequest(const base::string16& host,
+                                  uint16_t port,
+                                  const base::string16& path,
+                                  bool secure,
+                                  const base::string16& extra_headers,
+                                  const std::string& body) {
   EXPECT_FALSE(invoked_);
   invoked_ = true;
   EXPECT_EQ(expectations_.host, host);
@@ -136,8 +223,6 @@ scoped_ptr<HttpResponse> MockHttpAgent::Post(
       base::WideToUTF8(expectations_.file_name), body);
 
   EXPECT_EQ(expectations_.host, host);
-
-  return response_.Pass();
 }
 
 // An implementation of HttpResponse that may be configured to fail at any point
@@ -300,6 +385,9 @@ class UploadTest : public testing::Test {
   MockHttpAgent& agent() { return agent_; }
 
   bool SendUpload(base::string16* response_body, uint16_t* response_code);
+  bool SendFileUpload(bool compress,
+                      base::string16* response_body,
+                      uint16_t* response_code);
 
  private:
   MockHttpAgent agent_;
@@ -314,6 +402,25 @@ bool UploadTest::SendUpload(base::string16* response_body,
       agent().expectations().file_name, response_body, response_code);
 }
 
+bool UploadTest::SendFileUpload(bool compress,
+                                base::string16* response_body,
+                                uint16_t* response_code) {
+  base::ScopedTempDir temp_dir;
+  EXPECT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath file_path = temp_dir.path().Append(L"file");
+  const std::string& file = agent().expectations().file;
+  EXPECT_EQ(static_cast<int>(file.size()),
+            base::WriteFile(file_path, file.data(), file.size()));
+  agent().expectations().content_encoding = compress ? L"gzip" : L"";
+
+  return SendHttpFileUpload(
+      &agent(), (agent().expectations().secure ? L"https://" : L"http://") +
+                    agent().expectations().host + agent().expectations().path,
+      agent().expectations().parameters, file_path,
+      agent().expectations().file_name, compress, response_body,
+      response_code);
+}
+
 TEST_F(UploadTest, PostFails) {
   base::string16 response_body;
   uint16_t response_code = 0;
@@ -621,4 +728,47 @@ TEST_F(UploadTest, WideResponse) {
   EXPECT_EQ(kResponse, response_body);
 }
 
+TEST_F(UploadTest, PostFileSucceeds) {
+  const std::string kResponse = "hello world";
+
+  scoped_ptr<MockHttpResponse> mock_response(new MockHttpResponse);
+  std::vector<std::string> data;
+  data.push_back(kResponse);
+  data.push_back(std::string());
+  mock_response->set_data(data);
+  agent().set_response(mock_response.Pass());
+
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_TRUE(SendFileUpload(false, &response_body, &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
+}
+
+TEST_F(UploadTest, PostFileSucceedsCompressed) {
+  const std::string kResponse = "hello world";
+
+  scoped_ptr<MockHttpResponse> mock_response(new MockHttpResponse);
+  std::vector<std::string> data;
+  data.push_back(kResponse);
+  data.push_back(std::string());
+  mock_response->set_data(data);
+  agent().set_response(mock_response.Pass());
+
+  // Use a file that spans several chunks.
+  agent().expectations().file = std::string(200 * 1024, 'x');
+
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_TRUE(SendFileUpload(true, &response_body, &response_code));
+  EXPECT_EQ(200, response_code);
+  EXPECT_EQ(base::UTF8ToWide(kResponse), response_body);
+}
+
+TEST_F(UploadTest, PostFileFails) {
+  base::string16 response_body;
+  uint16_t response_code = 0;
+  EXPECT_FALSE(SendFileUpload(true, &response_body, &response_code));
+}
+
 }  // namespace kasko
@@ -14,6 +14,9 @@
 
 #include "syzygy/optimize/application_profile.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <map>
 #include <queue>
 
@@ -94,7 +97,10 @@ bool GetAddressOfBlock(const BlockGraph::Block* block,
 }  // namespace
 
 ApplicationProfile::ApplicationProfile(const ImageLayout* image_layout)
-    : image_layout_(image_layout), global_temperature_(0.0) {
+    : total_weight_(0.0),
+      max_run_length_(0.0),
+      image_layout_(image_layout),
+      global_temperature_(0.0) {
   empty_profile_.reset(new BlockProfile());
 }
 
@@ -191,8 +197,55 @@ bool ApplicationProfile::ComputeGlobalProfile() {
 
 bool ApplicationProfile::ImportFrequencies(
     const IndexedFrequencyMap& frequencies) {
-  // TODO(etienneb): Support importing multiple sets.
-  frequencies_ = frequencies;
+  return ImportFrequencies(frequencies, 1.0);
+}
+
+bool ApplicationProfile::ImportFrequencies(
+    const IndexedFrequencyMap& frequencies, double weight) {
+  if (weight <= 0.0) {
+    LOG(ERROR) << "Invalid scenario weight: " << weight << ".";
+    return false;
+  }
+
+  // The run length of a scenario is the sum of its entry counts.
+  double run_length = 0.0;
+  IndexedFrequencyMap::const_iterator freq = frequencies.begin();
+  for (; freq != frequencies.end(); ++freq) {
+    if (freq->first.second == kEntryCountColumn)
+      run_length += freq->second;
+  }
+
+  if (run_length == 0.0) {
+    LOG(WARNING) << "Ignoring a scenario where no block was executed.";
+    return true;
+  }
+
+  // Accumulate the normalized frequencies of this scenario. All the columns of
+  // a scenario are scaled by the same factor so that they remain consistent
+  // with each other (e.g., a branch isn't taken more often than its basic block
+  // is entered).
+  double scale = weight / run_length;
+  for (freq = frequencies.begin(); freq != frequencies.end(); ++freq)
+    weighted_frequencies_[freq->first] += scale * freq->second;
+  total_weight_ += weight;
+  max_run_length_ = std::max(max_run_length_, run_length);
+
+  // Rebuild the merged frequencies. A block executed in any scenario must stay
+  // executed, so non-zero values are never rounded down to zero.
+  const double kMaxCount = std::numeric_limits<EntryCountType>::max();
+  double factor = max_run_length_ / total_weight_;
+  frequencies_.clear();
+  WeightedFrequencyMap::const_iterator weighted = weighted_frequencies_.begin();
+  for (; weighted != weighted_frequencies_.end(); ++weighted) {
+    double value = 0.0;
+    if (weighted->second > 0.0) {
+      value = std::floor(weighted->second * factor + 0.5);
+      value = std::min(std::max(value, 1.0), kMaxCount);
+    }
+    frequencies_.insert(frequencies_.end(),
+        std::make_pair(weighted->first, static_cast<EntryCountType>(value)));
+  }
+
   return true;
 }
 
@@ -87,17 +87,43 @@ class ApplicationProfile {
   // Import the frequency information of an application.
   // @param frequencies the branches frequencies.
   // @returns true on success, false otherwise.
-  // @note This function should only be called once.
-  // TODO(etienneb): Support multiple importation.
+  // @note This is equivalent to importing @p frequencies with a weight of 1.
   bool ImportFrequencies(const IndexedFrequencyMap& frequencies);
 
+  // Import the frequency information of one scenario of an application. This
+  // may be called once per scenario (e.g., startup, page load, idle) and the
+  // scenarios are merged into a single profile. Each scenario is first
+  // normalized by its run length (the sum of its entry counts) so that a long
+  // running scenario doesn't drown the others, and then contributes to the
+  // merged profile in proportion to @p weight. The merged counts are scaled
+  // back to the run length of the longest scenario.
+  // @param frequencies the branches frequencies of the scenario.
+  // @param weight the relative weight of the scenario. Must be positive.
+  // @returns true on success, false otherwise.
+  // @note This must be called before ComputeGlobalProfile.
+  bool ImportFrequencies(const IndexedFrequencyMap& frequencies,
+                         double weight);
+
  protected:
   // These are protected so that they can be accessed by unittests.
 
+  typedef std::map<grinder::basic_block_util::IndexedFrequencyOffset, double>
+      WeightedFrequencyMap;
+
   // Frequency information for the whole block graph (includes basic block
-  // information).
+  // information). When several scenarios are imported this holds their
+  // weighted merge.
   IndexedFrequencyMap frequencies_;
 
+  // The normalized and weighted sum of the imported scenarios.
+  WeightedFrequencyMap weighted_frequencies_;
+
+  // The sum of the weights of the imported scenarios.
+  double total_weight_;
+
+  // The longest run length of the imported scenarios.
+  double max_run_length_;
+
   // The image layout to which the profile data applies.
   const ImageLayout* image_layout_;
 
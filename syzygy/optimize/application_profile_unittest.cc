@@ -247,6 +247,65 @@ TEST_F(ApplicationProfileTest, BuildApplicationProfile) {
   EXPECT_EQ(1.0, app.empty_profile_->percentile());
 }
 
+TEST_F(ApplicationProfileTest, ImportFrequenciesWithInvalidWeight) {
+  TestAplicationProfile app(&layout_);
+  IndexedFrequencyMap frequencies;
+  ASSERT_NO_FATAL_FAILURE(PopulateFrequencies(&frequencies));
+  EXPECT_FALSE(app.ImportFrequencies(frequencies, 0.0));
+  EXPECT_FALSE(app.ImportFrequencies(frequencies, -1.0));
+  EXPECT_TRUE(app.frequencies_.empty());
+}
+
+TEST_F(ApplicationProfileTest, ImportEmptyScenario) {
+  TestAplicationProfile app(&layout_);
+  IndexedFrequencyMap frequencies;
+  ASSERT_NO_FATAL_FAILURE(PopulateFrequencies(&frequencies));
+  ASSERT_TRUE(app.ImportFrequencies(frequencies));
+
+  // A scenario where nothing was executed doesn't change the profile.
+  IndexedFrequencyMap empty;
+  ASSERT_TRUE(app.ImportFrequencies(empty, 10.0));
+  EXPECT_THAT(frequencies, ContainerEq(app.frequencies_));
+}
+
+TEST_F(ApplicationProfileTest, MergeWeightedScenarios) {
+  TestAplicationProfile app(&layout_);
+  ASSERT_NO_FATAL_FAILURE(PopulateLayout());
+
+  const RelativeAddress kBlock1Address(0x1000);
+  const RelativeAddress kBlock2Address(0x2000);
+  IndexedFrequencyOffset block1_key =
+      std::make_pair(kBlock1Address, kEntryCountColumn);
+  IndexedFrequencyOffset block2_key =
+      std::make_pair(kBlock2Address, kEntryCountColumn);
+
+  // A short scenario (run length of 100) only executing block1.
+  IndexedFrequencyMap startup;
+  startup[block1_key] = 100;
+
+  // A longer scenario (run length of 40), three times more important.
+  IndexedFrequencyMap page_load;
+  page_load[block1_key] = 10;
+  page_load[block2_key] = 30;
+
+  ASSERT_TRUE(app.ImportFrequencies(startup, 1.0));
+  ASSERT_TRUE(app.ImportFrequencies(page_load, 3.0));
+
+  // Each scenario is normalized by its run length, weighted, and the result is
+  // scaled back to the longest run length:
+  //   block1: (1 * 100 / 100 + 3 * 10 / 40) / 4 * 100 = 43.75
+  //   block2: (3 * 30 / 40) / 4 * 100 = 56.25
+  ASSERT_EQ(2U, app.frequencies_.size());
+  EXPECT_EQ(44, app.frequencies_[block1_key]);
+  EXPECT_EQ(56, app.frequencies_[block2_key]);
+
+  ASSERT_TRUE(app.ComputeGlobalProfile());
+  EXPECT_EQ(44, app.GetBlockProfile(block1_)->count());
+  EXPECT_EQ(56, app.GetBlockProfile(block2_)->count());
+  EXPECT_LT(app.GetBlockProfile(block2_)->percentile(),
+            app.GetBlockProfile(block1_)->percentile());
+}
+
 TEST_F(ApplicationProfileTest, ComputeSubGraphProfile) {
   // Build global profile.
   TestAplicationProfile app(&layout_);
@@ -31,6 +31,8 @@
         'transforms/block_alignment_transform.h',
         'transforms/chained_subgraph_transforms.cc',
         'transforms/chained_subgraph_transforms.h',
+        'transforms/hot_cold_splitting_transform.cc',
+        'transforms/hot_cold_splitting_transform.h',
         'transforms/inlining_transform.cc',
         'transforms/inlining_transform.h',
         'transforms/peephole_transform.cc',
@@ -68,6 +70,7 @@
         'transforms/basic_block_reordering_transform_unittest.cc',
         'transforms/block_alignment_transform_unittest.cc',
         'transforms/chained_subgraph_transforms_unittest.cc',
+        'transforms/hot_cold_splitting_transform_unittest.cc',
         'transforms/inlining_transform_unittest.cc',
         'transforms/peephole_transform_unittest.cc',
         'transforms/unreachable_block_transform_unittest.cc',
@@ -14,6 +14,8 @@
 
 #include "syzygy/optimize/optimize_app.h"
 
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
@@ -23,6 +25,7 @@
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 #include "syzygy/optimize/transforms/chained_subgraph_transforms.h"
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
 #include "syzygy/optimize/transforms/inlining_transform.h"
 #include "syzygy/optimize/transforms/peephole_transform.h"
 #include "syzygy/optimize/transforms/unreachable_block_transform.h"
@@ -40,6 +43,7 @@ using grinder::basic_block_util::LoadBranchStatisticsFromFile;
 using optimize::transforms::BasicBlockReorderingTransform;
 using optimize::transforms::BlockAlignmentTransform;
 using optimize::transforms::ChainedSubgraphTransforms;
+using optimize::transforms::HotColdSplittingTransform;
 using optimize::transforms::InliningTransform;
 using optimize::transforms::PeepholeTransform;
 using optimize::transforms::UnreachableBlockTransform;
@@ -51,7 +55,13 @@ const char kUsageFormatStr[] =
     "    --output-image=<path> Output path for the rewritten image file.\n"
     "\n"
     "  Options:\n"
-    "    --branch-file=<path>  Branch statistics in JSON format.\n"
+    "    --branch-file=<path>[;<path>...]\n"
+    "                          Branch statistics in JSON format. Profiles of\n"
+    "                          several scenarios are merged after being\n"
+    "                          normalized by their run length.\n"
+    "    --branch-weights=<weight>[,<weight>...]\n"
+    "                          The relative weight of each branch file.\n"
+    "                          Default is 1 for each file.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
     "    --output-pdb=<path>   Output path for the rewritten PDB file.\n"
@@ -64,7 +74,10 @@ const char kUsageFormatStr[] =
     "                          Enable the decomposition of inline assembly\n"
     "                          blocks.\n"
     "    --basic-block-reorder Enable basic block reodering.\n"
-    "    --block-alignment     Enable block realignment.\n"
+    "    --block-alignment     Enable the alignment of hot functions and hot\n"
+    "                          loop headers.\n"
+    "    --hot-cold-split      Enable moving the cold basic blocks of hot\n"
+    "                          functions to a separate section.\n"
     "    --inlining            Enable function inlining.\n"
     "    --peephole            Enable peephole optimization.\n"
     "    --unreachable-block   Enable unreachable block optimization.\n"
@@ -88,11 +101,43 @@ bool OptimizeApp::ParseCommandLine(const CommandLine* cmd_line) {
   output_image_path_ = cmd_line->GetSwitchValuePath("output-image");
   input_pdb_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("input-pdb"));
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
-  branch_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("branch-file"));
+
+  // Parse the branch files of each scenario and their weights.
+  branch_file_paths_.clear();
+  branch_file_weights_.clear();
+  std::vector<std::wstring> branch_files;
+  base::SplitString(cmd_line->GetSwitchValueNative("branch-file"), L';',
+                    &branch_files);
+  for (size_t i = 0; i < branch_files.size(); ++i) {
+    if (branch_files[i].empty())
+      continue;
+    branch_file_paths_.push_back(
+        AbsolutePath(base::FilePath(branch_files[i])));
+  }
+
+  std::string weights_str = cmd_line->GetSwitchValueASCII("branch-weights");
+  if (!weights_str.empty()) {
+    std::vector<std::string> weights;
+    base::SplitString(weights_str, ',', &weights);
+    for (size_t i = 0; i < weights.size(); ++i) {
+      double weight = 0.0;
+      if (!base::StringToDouble(weights[i], &weight) || weight <= 0.0) {
+        return Usage(cmd_line, "Branch weights must be positive numbers.");
+      }
+      branch_file_weights_.push_back(weight);
+    }
+    if (branch_file_weights_.size() != branch_file_paths_.size()) {
+      return Usage(cmd_line,
+                   "There must be one branch weight per branch file.");
+    }
+  } else {
+    branch_file_weights_.resize(branch_file_paths_.size(), 1.0);
+  }
 
   basic_block_reorder_ = cmd_line->HasSwitch("basic-block-reorder");
   block_alignment_ = cmd_line->HasSwitch("block-alignment");
   fuzz_ = cmd_line->HasSwitch("fuzz");
+  hot_cold_split_ = cmd_line->HasSwitch("hot-cold-split");
   inlining_ = cmd_line->HasSwitch("inlining");
   allow_inline_assembly_ = cmd_line->HasSwitch("allow-inline-assembly");
   peephole_ = cmd_line->HasSwitch("peephole");
@@ -103,6 +148,7 @@ bool OptimizeApp::ParseCommandLine(const CommandLine* cmd_line) {
   if (cmd_line->HasSwitch("all")) {
     basic_block_reorder_ = true;
     block_alignment_ = true;
+    hot_cold_split_ = true;
     inlining_ = true;
     peephole_ = true;
     unreachable_block_ = true;
@@ -150,20 +196,37 @@ int OptimizeApp::Run() {
   const pe::ImageLayout& image_layout = relinker.input_image_layout();
 
   // Load profile information from file.
+  // When merging several scenarios, a profile that can't be used (e.g., one
+  // taken on a different version of the module) is skipped rather than
+  // invalidating the others.
+  DCHECK_EQ(branch_file_paths_.size(), branch_file_weights_.size());
   ApplicationProfile profile(&image_layout);
-  if (!branch_file_path_.empty()) {
+  size_t imported_profiles = 0;
+  for (size_t i = 0; i < branch_file_paths_.size(); ++i) {
+    const base::FilePath& branch_file_path = branch_file_paths_[i];
     IndexedFrequencyMap frequencies;
-    if (!LoadBranchStatisticsFromFile(branch_file_path_,
+    if (!LoadBranchStatisticsFromFile(branch_file_path,
                                       signature,
                                       &frequencies)) {
-      LOG(ERROR) << "Unable to load profile information.";
-      return 1;
+      if (branch_file_paths_.size() == 1) {
+        LOG(ERROR) << "Unable to load profile information.";
+        return 1;
+      }
+      LOG(WARNING) << "Ignoring profile information from '"
+                   << branch_file_path.value() << "'.";
+      continue;
     }
-    if (!profile.ImportFrequencies(frequencies)) {
+    if (!profile.ImportFrequencies(frequencies, branch_file_weights_[i])) {
       LOG(ERROR) << "Could not import metrics for '"
-                 << branch_file_path_.value() << "'.";
-      return false;
+                 << branch_file_path.value() << "'.";
+      return 1;
     }
+    ++imported_profiles;
+  }
+
+  if (!branch_file_paths_.empty() && imported_profiles == 0) {
+    LOG(ERROR) << "Unable to load profile information.";
+    return 1;
   }
 
   // Compute global profile information for the current block graph.
@@ -179,6 +242,7 @@ int OptimizeApp::Run() {
   scoped_ptr<BasicBlockReorderingTransform> basic_block_reordering_transform;
   scoped_ptr<BlockAlignmentTransform> block_alignment_transform;
   scoped_ptr<FuzzingTransform> fuzzing_transform;
+  scoped_ptr<HotColdSplittingTransform> hot_cold_splitting_transform;
   scoped_ptr<InliningTransform> inlining_transform;
   scoped_ptr<PeepholeTransform> peephole_transform;
   scoped_ptr<UnreachableBlockTransform> unreachable_block_transform;
@@ -201,6 +265,13 @@ int OptimizeApp::Run() {
     chains.AppendTransform(basic_block_reordering_transform.get());
   }
 
+  // If hot/cold splitting is enabled, add it to the chain. This must come
+  // after the basic block reordering, which works on a single block.
+  if (hot_cold_split_) {
+    hot_cold_splitting_transform.reset(new HotColdSplittingTransform());
+    chains.AppendTransform(hot_cold_splitting_transform.get());
+  }
+
   // If block alignment is enabled, add it to the chain.
   if (block_alignment_) {
     block_alignment_transform.reset(new BlockAlignmentTransform());
@@ -231,6 +302,17 @@ int OptimizeApp::Run() {
     return 1;
   }
 
+  // Report the size cost of the alignments performed.
+  if (block_alignment_transform.get() != NULL) {
+    LOG(INFO) << "Aligned " << block_alignment_transform->aligned_functions()
+              << " function(s) and "
+              << block_alignment_transform->aligned_loop_headers()
+              << " loop header(s) using at most "
+              << block_alignment_transform->padding_used()
+              << " bytes of padding (budget of "
+              << block_alignment_transform->padding_budget() << " bytes).";
+  }
+
   return 0;
 }
 
@@ -18,6 +18,8 @@
 #ifndef SYZYGY_OPTIMIZE_OPTIMIZE_APP_H_
 #define SYZYGY_OPTIMIZE_OPTIMIZE_APP_H_
 
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
@@ -34,6 +36,7 @@ class OptimizeApp : public application::AppImplBase {
         basic_block_reorder_(false),
         block_alignment_(false),
         fuzz_(false),
+        hot_cold_split_(false),
         inlining_(false),
         allow_inline_assembly_(false),
         overwrite_(false),
@@ -61,11 +64,13 @@ class OptimizeApp : public application::AppImplBase {
   base::FilePath input_pdb_path_;
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
-  base::FilePath branch_file_path_;
+  std::vector<base::FilePath> branch_file_paths_;
+  std::vector<double> branch_file_weights_;
   base::FilePath unreachable_graph_path_;
   bool block_alignment_;
   bool basic_block_reorder_;
   bool fuzz_;
+  bool hot_cold_split_;
   bool inlining_;
   bool allow_inline_assembly_;
   bool peephole_;
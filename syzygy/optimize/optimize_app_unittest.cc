@@ -35,11 +35,13 @@ class TestOptimizeApp : public OptimizeApp {
   using OptimizeApp::input_pdb_path_;
   using OptimizeApp::output_image_path_;
   using OptimizeApp::output_pdb_path_;
-  using OptimizeApp::branch_file_path_;
+  using OptimizeApp::branch_file_paths_;
+  using OptimizeApp::branch_file_weights_;
   using OptimizeApp::unreachable_graph_path_;
   using OptimizeApp::basic_block_reorder_;
   using OptimizeApp::block_alignment_;
   using OptimizeApp::fuzz_;
+  using OptimizeApp::hot_cold_split_;
   using OptimizeApp::inlining_;
   using OptimizeApp::allow_inline_assembly_;
   using OptimizeApp::peephole_;
@@ -162,6 +164,7 @@ TEST_F(OptimizeAppTest, ParseMinimalCommandLineWithBranchFile) {
   EXPECT_FALSE(test_impl_.basic_block_reorder_);
   EXPECT_FALSE(test_impl_.peephole_);
   EXPECT_FALSE(test_impl_.fuzz_);
+  EXPECT_FALSE(test_impl_.hot_cold_split_);
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_TRUE(test_impl_.SetUp());
@@ -179,12 +182,51 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithBranchFile) {
   EXPECT_TRUE(test_impl_.input_pdb_path_.empty());
   EXPECT_EQ(output_image_path_, test_impl_.output_image_path_);
   EXPECT_EQ(output_pdb_path_, test_impl_.output_pdb_path_);
-  EXPECT_EQ(branch_file_path_, test_impl_.branch_file_path_);
+  ASSERT_EQ(1U, test_impl_.branch_file_paths_.size());
+  EXPECT_EQ(branch_file_path_, test_impl_.branch_file_paths_[0]);
+  ASSERT_EQ(1U, test_impl_.branch_file_weights_.size());
+  EXPECT_EQ(1.0, test_impl_.branch_file_weights_[0]);
   EXPECT_TRUE(test_impl_.overwrite_);
 
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(OptimizeAppTest, ParseCommandLineWithWeightedBranchFiles) {
+  base::FilePath other_branch_file_path = temp_dir_.Append(L"other.json");
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchNative(
+      "branch-file",
+      branch_file_path_.value() + L";" + other_branch_file_path.value());
+  cmd_line_.AppendSwitchASCII("branch-weights", "3,0.5");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  ASSERT_EQ(2U, test_impl_.branch_file_paths_.size());
+  EXPECT_EQ(branch_file_path_, test_impl_.branch_file_paths_[0]);
+  EXPECT_EQ(other_branch_file_path, test_impl_.branch_file_paths_[1]);
+  ASSERT_EQ(2U, test_impl_.branch_file_weights_.size());
+  EXPECT_EQ(3.0, test_impl_.branch_file_weights_[0]);
+  EXPECT_EQ(0.5, test_impl_.branch_file_weights_[1]);
+}
+
+TEST_F(OptimizeAppTest, ParseCommandLineWithMismatchedBranchWeightsFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchPath("branch-file", branch_file_path_);
+  cmd_line_.AppendSwitchASCII("branch-weights", "1,2");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(OptimizeAppTest, ParseCommandLineWithInvalidBranchWeightFails) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchPath("branch-file", branch_file_path_);
+  cmd_line_.AppendSwitchASCII("branch-weights", "-1");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("input-pdb", input_pdb_path_);
@@ -197,6 +239,7 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   cmd_line_.AppendSwitch("basic-block-reorder");
   cmd_line_.AppendSwitch("peephole");
   cmd_line_.AppendSwitch("fuzz");
+  cmd_line_.AppendSwitch("hot-cold-split");
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_EQ(abs_input_image_path_, test_impl_.input_image_path_);
@@ -210,6 +253,7 @@ TEST_F(OptimizeAppTest, ParseFullCommandLineWithInputAndOutputPdb) {
   EXPECT_TRUE(test_impl_.basic_block_reorder_);
   EXPECT_TRUE(test_impl_.peephole_);
   EXPECT_TRUE(test_impl_.fuzz_);
+  EXPECT_TRUE(test_impl_.hot_cold_split_);
 
   EXPECT_TRUE(test_impl_.SetUp());
 }
@@ -233,6 +277,7 @@ TEST_F(OptimizeAppTest, ParseAllCommandLineWithInputAndOutputPdb) {
   EXPECT_TRUE(test_impl_.basic_block_reorder_);
   EXPECT_TRUE(test_impl_.block_alignment_);
   EXPECT_TRUE(test_impl_.peephole_);
+  EXPECT_TRUE(test_impl_.hot_cold_split_);
   EXPECT_FALSE(test_impl_.fuzz_);
 
   EXPECT_TRUE(test_impl_.SetUp());
@@ -14,6 +14,8 @@
 
 #include "syzygy/optimize/transforms/basic_block_reordering_transform.h"
 
+#include <set>
+
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/optimize/application_profile.h"
 
@@ -49,6 +51,65 @@ const BasicCodeBlock* GetSuccessorBB(const Successor& successor) {
   return code_bb;
 }
 
+// Returns the number of times the control flow went from the basic blocks of
+// @p order, starting at @p first, to @p target.
+EntryCountType GetEdgeCount(const SubGraphProfile* profile,
+                            const BasicBlockOrdering& order,
+                            size_t first,
+                            const BasicCodeBlock* target) {
+  DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), profile);
+  DCHECK_NE(reinterpret_cast<const BasicCodeBlock*>(NULL), target);
+
+  EntryCountType count = 0;
+  for (size_t i = first; i < order.size(); ++i)
+    count += profile->GetBasicBlockProfile(order[i])->GetSuccessorCount(target);
+  return count;
+}
+
+// Returns the number of times the control flow left the basic blocks of
+// @p order, starting at @p first, to a basic block other than @p excluded.
+EntryCountType GetExitCount(const SubGraphProfile* profile,
+                            const BasicBlockOrdering& order,
+                            size_t first,
+                            const BasicCodeBlock* excluded) {
+  DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), profile);
+
+  std::set<const BasicCodeBlock*> region(order.begin() + first, order.end());
+  EntryCountType count = 0;
+  for (size_t i = first; i < order.size(); ++i) {
+    const BasicBlockProfile* bb_profile =
+        profile->GetBasicBlockProfile(order[i]);
+    const BasicCodeBlock::Successors& successors = order[i]->successors();
+    BasicCodeBlock::Successors::const_iterator succ = successors.begin();
+    for (; succ != successors.end(); ++succ) {
+      const BasicCodeBlock* succ_bb = GetSuccessorBB(*succ);
+      if (succ_bb == NULL || succ_bb == excluded || region.count(succ_bb) != 0)
+        continue;
+      count += bb_profile->GetSuccessorCount(succ_bb);
+    }
+  }
+  return count;
+}
+
+void FlattenStructuralTreeRecursive(const StructuralNode* tree,
+                                    const SubGraphProfile* profile,
+                                    BasicBlockOrdering* order,
+                                    BasicBlockOrdering* cold);
+
+// Flattens @p tree out of the line: its basic blocks are appended to the cold
+// basic blocks.
+void FlattenStructuralTreeOutOfLine(const StructuralNode* tree,
+                                    const SubGraphProfile* profile,
+                                    BasicBlockOrdering* cold) {
+  DCHECK_NE(reinterpret_cast<BasicBlockOrdering*>(NULL), cold);
+
+  // The subtree is flattened on its own, so that its cold parts don't end up
+  // in the middle of it.
+  BasicBlockOrdering out_of_line;
+  FlattenStructuralTreeRecursive(tree, profile, &out_of_line, cold);
+  cold->insert(cold->end(), out_of_line.begin(), out_of_line.end());
+}
+
 void FlattenStructuralTreeRecursive(const StructuralNode* tree,
                                     const SubGraphProfile* profile,
                                     BasicBlockOrdering* order,
@@ -58,7 +119,6 @@ void FlattenStructuralTreeRecursive(const StructuralNode* tree,
   DCHECK_NE(reinterpret_cast<BasicBlockOrdering*>(NULL), order);
   DCHECK_NE(reinterpret_cast<BasicBlockOrdering*>(NULL), cold);
 
-  // TODO(etienneb): Implement rules based on profile.
   switch (tree->kind()) {
     case StructuralNode::kBaseNode: {
       order->push_back(tree->root());
@@ -73,14 +133,47 @@ void FlattenStructuralTreeRecursive(const StructuralNode* tree,
       break;
     }
     case StructuralNode::kIfThenNode: {
+      size_t entry_start = order->size();
       FlattenStructuralTreeRecursive(tree->entry_node(), profile, order, cold);
-      FlattenStructuralTreeRecursive(tree->then_node(), profile, order, cold);
+
+      // Placed in line, the 'then' part costs a taken branch each time it's
+      // skipped. Placed out of line, it costs a taken branch to enter it and
+      // another one to come back. Move it out of line when it's entered less
+      // than half as often as it's skipped.
+      const StructuralNode* then_node = tree->then_node();
+      EntryCountType then_count =
+          GetEdgeCount(profile, *order, entry_start, then_node->root());
+      EntryCountType skip_count =
+          GetExitCount(profile, *order, entry_start, then_node->root());
+      if (2 * then_count < skip_count)
+        FlattenStructuralTreeOutOfLine(then_node, profile, cold);
+      else
+        FlattenStructuralTreeRecursive(then_node, profile, order, cold);
       break;
     }
     case StructuralNode::kIfThenElseNode: {
+      size_t entry_start = order->size();
       FlattenStructuralTreeRecursive(tree->entry_node(), profile, order, cold);
-      FlattenStructuralTreeRecursive(tree->then_node(), profile, order, cold);
-      FlattenStructuralTreeRecursive(tree->else_node(), profile, order, cold);
+
+      // The most likely branch falls through from the entry and into the
+      // follower, the other one is moved out of line. On a tie, both branches
+      // are kept in line, in their original order.
+      const StructuralNode* then_node = tree->then_node();
+      const StructuralNode* else_node = tree->else_node();
+      EntryCountType then_count =
+          GetEdgeCount(profile, *order, entry_start, then_node->root());
+      EntryCountType else_count =
+          GetEdgeCount(profile, *order, entry_start, else_node->root());
+      if (then_count == else_count) {
+        FlattenStructuralTreeRecursive(then_node, profile, order, cold);
+        FlattenStructuralTreeRecursive(else_node, profile, order, cold);
+      } else if (then_count > else_count) {
+        FlattenStructuralTreeRecursive(then_node, profile, order, cold);
+        FlattenStructuralTreeOutOfLine(else_node, profile, cold);
+      } else {
+        FlattenStructuralTreeRecursive(else_node, profile, order, cold);
+        FlattenStructuralTreeOutOfLine(then_node, profile, cold);
+      }
       break;
     }
     case StructuralNode::kRepeatNode: {
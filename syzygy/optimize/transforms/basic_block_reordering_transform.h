@@ -15,7 +15,11 @@
 // This class implements the basic block reordering transformation.
 //
 // The transformation reorders basic blocks to decrease the amount of taken and
-// mispredicted jumps.
+// mispredicted jumps. The structural tree of a subgraph is flattened following
+// the edge counts of the branch profile: the most likely successor of a branch
+// falls through, and the unlikely paths are moved after the hot basic blocks.
+// The conditions of the branches are inverted as needed when the block is
+// rebuilt.
 //
 // see: K.Pettis, R.C.Hansen, Profile Guided Code Positioning,
 //     Proceedings of the ACM SIGPLAN 1990 Conference on Programming Language
@@ -390,6 +390,41 @@ TEST_F(BasicBlockReorderingTransformTest, FlattenStructuralTreeToAnOrder) {
       TestBasicBlockReorderingTransform::FlattenStructuralTreeToAnOrder(
           &subgraph_, &subgraph_profile_, &order));
 
+  // The most likely branch, b3, falls through and b2 is moved out of line.
+  EXPECT_EQ(5U, order.size());
+  EXPECT_THAT(order, ElementsAre(b1_, b3_, b4_, b5_, b2_));
+}
+
+TEST_F(BasicBlockReorderingTransformTest,
+       FlattenStructuralTreeFollowsLikelyBranch) {
+  // Make b2 the most likely branch.
+  TestBasicBlockProfile profile_b1(10, 0, 4);
+  profile_b1.successors_[b2_] = 6;
+  profile_b1.successors_[b3_] = 4;
+  subgraph_profile_.basic_blocks_[b1_] = profile_b1;
+
+  BasicBlockOrdering order;
+  ASSERT_TRUE(
+      TestBasicBlockReorderingTransform::FlattenStructuralTreeToAnOrder(
+          &subgraph_, &subgraph_profile_, &order));
+
+  EXPECT_EQ(5U, order.size());
+  EXPECT_THAT(order, ElementsAre(b1_, b2_, b4_, b5_, b3_));
+}
+
+TEST_F(BasicBlockReorderingTransformTest,
+       FlattenStructuralTreeWithBalancedBranches) {
+  TestBasicBlockProfile profile_b1(10, 0, 5);
+  profile_b1.successors_[b2_] = 5;
+  profile_b1.successors_[b3_] = 5;
+  subgraph_profile_.basic_blocks_[b1_] = profile_b1;
+
+  BasicBlockOrdering order;
+  ASSERT_TRUE(
+      TestBasicBlockReorderingTransform::FlattenStructuralTreeToAnOrder(
+          &subgraph_, &subgraph_profile_, &order));
+
+  // Both branches are kept in line.
   EXPECT_EQ(5U, order.size());
   EXPECT_THAT(order, ElementsAre(b1_, b2_, b3_, b4_, b5_));
 }
@@ -447,5 +482,29 @@ TEST_F(BasicBlockReorderingTransformTest, ApplyTransformWithProfileAndGain) {
   EXPECT_THAT(kCodeJump, ElementsAreArray(block->data(), block->size()));
 }
 
+TEST_F(BasicBlockReorderingTransformTest, ApplyTransformMovesUnlikelyThen) {
+  BlockGraph::Block* block =
+      block_graph_.AddBlock(BlockGraph::CODE_BLOCK, sizeof(kCodeJump), "jump");
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+  block->SetData(kCodeJump, sizeof(kCodeJump));
+
+  // Insert the block profile into the profile map.
+  ApplicationProfile::BlockProfile block_profile(kRunMoreThanOnce, kHot);
+  profile_.profiles_.insert(std::make_pair(block->id(), block_profile));
+
+  // The 'xor' is never executed.
+  TestBasicBlockProfile bb_profiles[] = {
+    TestBasicBlockProfile(kRunMoreThanOnce, 0, kRunMoreThanOnce),
+    TestBasicBlockProfile(0, 0, 0),
+    TestBasicBlockProfile(kRunMoreThanOnce, 0, 0)
+  };
+
+  ASSERT_NO_FATAL_FAILURE(
+      ApplyTransform(&block, bb_profiles, arraysize(bb_profiles)));
+
+  // The 'xor' must be moved out of line, and the branch inverted.
+  EXPECT_THAT(kCodeJumpInv, ElementsAreArray(block->data(), block->size()));
+}
+
 }  // namespace transforms
 }  // namespace optimize
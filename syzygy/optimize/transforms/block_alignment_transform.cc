@@ -14,16 +14,36 @@
 
 #include "syzygy/optimize/transforms/block_alignment_transform.h"
 
+#include <map>
+#include <set>
+
 #include "syzygy/block_graph/block_graph.h"
 
 namespace optimize {
 namespace transforms {
 
 namespace {
+
 using block_graph::BasicBlock;
 using block_graph::BasicCodeBlock;
+typedef BasicBlockSubGraph::BasicBlockOrdering BasicBlockOrdering;
+typedef BasicBlockSubGraph::BlockDescription BlockDescription;
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
+
+// A function is hot when it belongs to the blocks accounting for this fraction
+// of the application temperature.
+const double kHotBlockPercentile = 0.8;
+
+// A loop header is hot when it runs at least this many times per function
+// entry.
+const EntryCountType kHotLoopHeaderRatio = 2;
+
 }  // namespace
 
+const size_t BlockAlignmentTransform::kFunctionAlignment = 32;
+const size_t BlockAlignmentTransform::kLoopHeaderAlignment = 16;
+const size_t BlockAlignmentTransform::kDefaultPaddingBudget = 64 * 1024;
+
 bool BlockAlignmentTransform::TransformBasicBlockSubGraph(
       const TransformPolicyInterface* policy,
       BlockGraph* block_graph,
@@ -36,27 +56,93 @@ bool BlockAlignmentTransform::TransformBasicBlockSubGraph(
   DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
   DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
 
-  // Iterates through each basic block.
-  BasicBlockSubGraph::BBCollection::iterator bb_iter =
-      subgraph->basic_blocks().begin();
-  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
-    BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
-    if (bb == NULL)
-      continue;
-    // TODO(etienneb): Basic block alignment based on frequencies (PGO).
-  }
+  // Cold functions are left with their current alignment.
+  const BlockGraph::Block* block = subgraph->original_block();
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  const ApplicationProfile::BlockProfile* block_profile =
+      profile->GetBlockProfile(block);
+  EntryCountType entry_count = block_profile->count();
+  if (entry_count == 0 || block_profile->percentile() >= kHotBlockPercentile)
+    return true;
+
+  BasicBlockSubGraph::BlockDescriptionList& descriptions =
+      subgraph->block_descriptions();
+  BasicBlockSubGraph::BlockDescriptionList::iterator description =
+      descriptions.begin();
+  for (; description != descriptions.end(); ++description) {
+    // Apply function alignment to the main part of the function, unless it
+    // already has an explicit alignment.
+    if (description == descriptions.begin() && description->alignment <= 1 &&
+        SpendPadding(description->alignment, kFunctionAlignment)) {
+      description->alignment = kFunctionAlignment;
+      ++aligned_functions_;
+    }
+
+    // Find the loop headers, i.e. the targets of the backward branches of
+    // this block description.
+    std::map<const BasicBlock*, size_t> positions;
+    BasicBlockOrdering& order = description->basic_block_order;
+    BasicBlockOrdering::iterator bb_iter = order.begin();
+    for (size_t i = 0; bb_iter != order.end(); ++bb_iter, ++i)
+      positions[*bb_iter] = i;
 
-  // Apply function alignment.
-  if (!subgraph->block_descriptions().empty()) {
-    BasicBlockSubGraph::BlockDescription& description =
-        subgraph->block_descriptions().front();
-    // TODO(etienneb): Function alignment based on frequencies (PGO).
-    if (description.alignment <= 1)
-      description.alignment = 32;
+    std::set<BasicCodeBlock*> loop_headers;
+    bb_iter = order.begin();
+    for (; bb_iter != order.end(); ++bb_iter) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+      if (bb == NULL)
+        continue;
+
+      BasicBlock::Successors::iterator succ = bb->successors().begin();
+      for (; succ != bb->successors().end(); ++succ) {
+        BasicCodeBlock* target =
+            BasicCodeBlock::Cast(succ->reference().basic_block());
+        if (target == NULL || positions.count(target) == 0)
+          continue;
+        if (positions[target] <= positions[bb])
+          loop_headers.insert(target);
+      }
+    }
+
+    // Align the hot loop headers. The entry of the function is already
+    // aligned with the function.
+    bb_iter = order.begin();
+    for (; bb_iter != order.end(); ++bb_iter) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_iter);
+      if (bb == NULL || bb_iter == order.begin() ||
+          loop_headers.count(bb) == 0) {
+        continue;
+      }
+
+      EntryCountType count =
+          subgraph_profile->GetBasicBlockProfile(bb)->count();
+      if (count < kHotLoopHeaderRatio * entry_count)
+        continue;
+
+      if (SpendPadding(bb->alignment(), kLoopHeaderAlignment)) {
+        bb->set_alignment(kLoopHeaderAlignment);
+        ++aligned_loop_headers_;
+      }
+    }
   }
 
   return true;
 }
 
+bool BlockAlignmentTransform::SpendPadding(size_t old_alignment,
+                                           size_t alignment) {
+  if (old_alignment >= alignment)
+    return false;
+
+  // Aligning code to |alignment| introduces at most |alignment - 1| bytes of
+  // padding, of which |old_alignment - 1| were already accounted for.
+  size_t padding = alignment - old_alignment;
+  if (padding_used_ + padding > padding_budget_)
+    return false;
+
+  padding_used_ += padding;
+  return true;
+}
+
 }  // namespace transforms
 }  // namespace optimize
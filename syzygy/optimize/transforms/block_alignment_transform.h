@@ -13,6 +13,10 @@
 // limitations under the License.
 //
 // This class implements the functions alignment transformation.
+//
+// Aligning code is only worth its padding when the aligned code is executed
+// often. Thus, only the entries of hot functions and the headers of hot loops
+// are aligned, and the worst case padding introduced is bounded by a budget.
 
 #ifndef SYZYGY_OPTIMIZE_TRANSFORMS_BLOCK_ALIGNMENT_TRANSFORM_H_
 #define SYZYGY_OPTIMIZE_TRANSFORMS_BLOCK_ALIGNMENT_TRANSFORM_H_
@@ -31,8 +35,38 @@ class BlockAlignmentTransform : public SubGraphTransformInterface {
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
+  // The alignment given to the entry of a hot function.
+  static const size_t kFunctionAlignment;
+
+  // The alignment given to the header of a hot loop.
+  static const size_t kLoopHeaderAlignment;
+
+  // The default budget, in bytes, of padding that may be introduced.
+  static const size_t kDefaultPaddingBudget;
+
   // Constructor.
-  BlockAlignmentTransform() { }
+  BlockAlignmentTransform()
+      : padding_budget_(kDefaultPaddingBudget),
+        padding_used_(0),
+        aligned_functions_(0),
+        aligned_loop_headers_(0) {
+  }
+
+  // @name Accessors.
+  // @{
+  size_t padding_budget() const { return padding_budget_; }
+  void set_padding_budget(size_t padding_budget) {
+    padding_budget_ = padding_budget;
+  }
+  // @}
+
+  // @name Statistics on the alignments performed so far.
+  // @{
+  // @returns the worst case padding introduced, in bytes.
+  size_t padding_used() const { return padding_used_; }
+  size_t aligned_functions() const { return aligned_functions_; }
+  size_t aligned_loop_headers() const { return aligned_loop_headers_; }
+  // @}
 
   // @name SubGraphTransformInterface implementation.
   // @{
@@ -45,6 +79,20 @@ class BlockAlignmentTransform : public SubGraphTransformInterface {
   // @}
 
  private:
+  // Aligns to @p alignment if the padding budget allows it.
+  // @param old_alignment the current alignment.
+  // @param alignment the requested alignment.
+  // @returns true if the alignment must be applied, false otherwise.
+  bool SpendPadding(size_t old_alignment, size_t alignment);
+
+  // The worst case padding, in bytes, that may be introduced.
+  size_t padding_budget_;
+
+  // Statistics.
+  size_t padding_used_;
+  size_t aligned_functions_;
+  size_t aligned_loop_headers_;
+
   DISALLOW_COPY_AND_ASSIGN(BlockAlignmentTransform);
 };
 
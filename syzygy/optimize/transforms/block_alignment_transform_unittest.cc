@@ -27,6 +27,7 @@ namespace transforms {
 namespace {
 
 using block_graph::BasicBlockDecomposer;
+using block_graph::BasicCodeBlock;
 using block_graph::BlockBuilder;
 using block_graph::BlockGraph;
 using block_graph::BasicBlockSubGraph;
@@ -34,10 +35,46 @@ using optimize::ApplicationProfile;
 using optimize::SubGraphProfile;
 using pe::ImageLayout;
 
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
+
 // Dummy code body.
 const uint8 kCodeBody1[] = { 0x74, 0x02, 0x33, 0xC0, 0xC3 };
 const uint8 kCodeBody2[] = { 0x0B, 0xC0, 0x75, 0xFC, 0xC3 };
 
+// _asm xor eax, eax
+// loop:
+// _asm inc eax
+// _asm cmp eax, 10
+// _asm jne loop
+// _asm ret
+const uint8 kCodeLoop[] = {
+    0x33, 0xC0, 0x40, 0x83, 0xF8, 0x0A, 0x75, 0xFA, 0xC3 };
+
+const EntryCountType kRunMoreThanOnce = 100;
+const EntryCountType kRunInLoop = 1000;
+const EntryCountType kHot = 100;
+
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
 class BlockAlignmentTransformTest : public testing::Test {
  public:
   BlockAlignmentTransformTest()
@@ -58,7 +95,17 @@ class BlockAlignmentTransformTest : public testing::Test {
     code2_->SetData(kCodeBody2, code2_->size());
   }
 
-  void ApplyTransform(BlockGraph::Block** block);
+  // Marks @p block as executed.
+  void SetBlockIsHot(const BlockGraph::Block* block) {
+    ApplicationProfile::BlockProfile block_profile(kRunMoreThanOnce, kHot);
+    profile_.profiles_.insert(std::make_pair(block->id(), block_profile));
+  }
+
+  // Decomposes @p block, assigns the entry counts @p counts to its basic code
+  // blocks (in their original order), applies the transform and rebuilds it.
+  void ApplyTransform(BlockGraph::Block** block,
+                      const EntryCountType* counts,
+                      size_t counts_length);
 
  protected:
   pe::PETransformPolicy policy_;
@@ -67,16 +114,29 @@ class BlockAlignmentTransformTest : public testing::Test {
   BlockGraph::Block* code2_;
   BlockAlignmentTransform tx_;
   ImageLayout image_;
-  ApplicationProfile profile_;
-  SubGraphProfile subgraph_profile_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
 };
 
-void BlockAlignmentTransformTest::ApplyTransform(BlockGraph::Block** block) {
+void BlockAlignmentTransformTest::ApplyTransform(BlockGraph::Block** block,
+                                                 const EntryCountType* counts,
+                                                 size_t counts_length) {
   // Decompose to subgraph.
   BasicBlockSubGraph subgraph;
   BasicBlockDecomposer decomposer(*block, &subgraph);
   ASSERT_TRUE(decomposer.Decompose());
 
+  // Assign the basic block entry counts.
+  ASSERT_EQ(1U, subgraph.block_descriptions().size());
+  BasicBlockSubGraph::BasicBlockOrdering& order =
+      subgraph.block_descriptions().front().basic_block_order;
+  BasicBlockSubGraph::BasicBlockOrdering::iterator bb = order.begin();
+  for (size_t i = 0; i < counts_length && bb != order.end(); ++i, ++bb) {
+    BasicCodeBlock* code = BasicCodeBlock::Cast(*bb);
+    ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), code);
+    subgraph_profile_.basic_blocks_[code] = TestBasicBlockProfile(counts[i]);
+  }
+
   // Apply block alignment transform.
   ASSERT_TRUE(
       tx_.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
@@ -91,16 +151,89 @@ void BlockAlignmentTransformTest::ApplyTransform(BlockGraph::Block** block) {
 
 }  // namespace
 
+TEST_F(BlockAlignmentTransformTest, DontAlignColdFunction) {
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(&code1_, NULL, 0));
+  EXPECT_EQ(1U, code1_->alignment());
+  EXPECT_EQ(0U, tx_.aligned_functions());
+  EXPECT_EQ(0U, tx_.padding_used());
+}
+
 TEST_F(BlockAlignmentTransformTest, AlignmentTest) {
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code1_);
   DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), code2_);
 
-  ApplyTransform(&code1_);
+  SetBlockIsHot(code1_);
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(&code1_, NULL, 0));
   EXPECT_EQ(32U, code1_->alignment());
 
+  // An explicit alignment is preserved.
   code2_->set_alignment(2);
-  ApplyTransform(&code2_);
+  SetBlockIsHot(code2_);
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(&code2_, NULL, 0));
   EXPECT_EQ(2U, code2_->alignment());
+
+  EXPECT_EQ(1U, tx_.aligned_functions());
+  EXPECT_EQ(31U, tx_.padding_used());
+}
+
+TEST_F(BlockAlignmentTransformTest, AlignHotLoopHeader) {
+  BlockGraph::Block* loop = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                  sizeof(kCodeLoop),
+                                                  "loop");
+  ASSERT_NE(reinterpret_cast<BlockGraph::Block*>(NULL), loop);
+  loop->SetData(kCodeLoop, loop->size());
+  SetBlockIsHot(loop);
+
+  const EntryCountType kCounts[] = {
+      kRunMoreThanOnce, kRunInLoop, kRunMoreThanOnce };
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(&loop, kCounts, arraysize(kCounts)));
+
+  // The loop header 'inc eax' must be aligned.
+  EXPECT_EQ(32U, loop->alignment());
+  ASSERT_LT(16U, loop->size());
+  EXPECT_EQ(0x40, loop->data()[16]);
+
+  EXPECT_EQ(1U, tx_.aligned_functions());
+  EXPECT_EQ(1U, tx_.aligned_loop_headers());
+  EXPECT_EQ(31U + 15U, tx_.padding_used());
+}
+
+TEST_F(BlockAlignmentTransformTest, DontAlignColdLoopHeader) {
+  BlockGraph::Block* loop = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                  sizeof(kCodeLoop),
+                                                  "loop");
+  ASSERT_NE(reinterpret_cast<BlockGraph::Block*>(NULL), loop);
+  loop->SetData(kCodeLoop, loop->size());
+  SetBlockIsHot(loop);
+
+  // The loop body runs once per call.
+  const EntryCountType kCounts[] = {
+      kRunMoreThanOnce, kRunMoreThanOnce, kRunMoreThanOnce };
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(&loop, kCounts, arraysize(kCounts)));
+
+  EXPECT_EQ(sizeof(kCodeLoop), loop->size());
+  EXPECT_EQ(0U, tx_.aligned_loop_headers());
+}
+
+TEST_F(BlockAlignmentTransformTest, PaddingBudget) {
+  BlockGraph::Block* loop = block_graph_.AddBlock(BlockGraph::CODE_BLOCK,
+                                                  sizeof(kCodeLoop),
+                                                  "loop");
+  ASSERT_NE(reinterpret_cast<BlockGraph::Block*>(NULL), loop);
+  loop->SetData(kCodeLoop, loop->size());
+  SetBlockIsHot(loop);
+
+  // Only the function alignment fits in the budget.
+  tx_.set_padding_budget(31);
+  const EntryCountType kCounts[] = {
+      kRunMoreThanOnce, kRunInLoop, kRunMoreThanOnce };
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(&loop, kCounts, arraysize(kCounts)));
+
+  EXPECT_EQ(32U, loop->alignment());
+  EXPECT_EQ(sizeof(kCodeLoop), loop->size());
+  EXPECT_EQ(1U, tx_.aligned_functions());
+  EXPECT_EQ(0U, tx_.aligned_loop_headers());
+  EXPECT_EQ(31U, tx_.padding_used());
 }
 
 }  // namespace transforms
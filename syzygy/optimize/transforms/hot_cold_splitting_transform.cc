@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
+
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/pe_utils.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicCodeBlock;
+typedef BasicBlockSubGraph::BasicBlockOrdering BasicBlockOrdering;
+typedef BasicBlockSubGraph::BlockDescription BlockDescription;
+typedef SubGraphProfile::BasicBlockProfile BasicBlockProfile;
+
+}  // namespace
+
+const char HotColdSplittingTransform::kColdSectionName[] = ".cold";
+const char HotColdSplittingTransform::kColdBlockSuffix[] = "_cold";
+const size_t HotColdSplittingTransform::kMinimumColdCodeSize = 16;
+
+bool HotColdSplittingTransform::TransformBasicBlockSubGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BasicBlockSubGraph* subgraph,
+    ApplicationProfile* profile,
+    SubGraphProfile* subgraph_profile) {
+  DCHECK_NE(reinterpret_cast<TransformPolicyInterface*>(NULL), policy);
+  DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
+  DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
+
+  // Functions that never ran are left alone, there is nothing to split.
+  const BlockGraph::Block* block = subgraph->original_block();
+  DCHECK_NE(reinterpret_cast<const BlockGraph::Block*>(NULL), block);
+  const ApplicationProfile::BlockProfile* block_profile =
+      profile->GetBlockProfile(block);
+  if (block_profile->count() == 0)
+    return true;
+
+  // Avoid splitting a block with a jump table or data block.
+  BasicBlockSubGraph::BBCollection::iterator bb_iter =
+      subgraph->basic_blocks().begin();
+  for (; bb_iter != subgraph->basic_blocks().end(); ++bb_iter) {
+    if ((*bb_iter)->type() == BlockGraph::DATA_BLOCK)
+      return true;
+  }
+
+  // Retrieve the block description.
+  BasicBlockSubGraph::BlockDescriptionList& descriptions =
+      subgraph->block_descriptions();
+  if (descriptions.size() != 1)
+    return true;
+  BlockDescription& hot_description = descriptions.front();
+
+  // Partition the basic blocks. The entry basic block, the end block and the
+  // basic blocks referred to from outside of the function always stay in the
+  // hot part.
+  BasicBlockOrdering hot_order;
+  BasicBlockOrdering cold_order;
+  size_t cold_code_size = 0;
+  BasicBlockOrdering::iterator order_it =
+      hot_description.basic_block_order.begin();
+  for (; order_it != hot_description.basic_block_order.end(); ++order_it) {
+    BasicCodeBlock* bb = BasicCodeBlock::Cast(*order_it);
+    if (bb == NULL || order_it == hot_description.basic_block_order.begin() ||
+        !bb->referrers().empty() ||
+        subgraph_profile->GetBasicBlockProfile(bb)->count() != 0) {
+      hot_order.push_back(*order_it);
+      continue;
+    }
+
+    cold_order.push_back(bb);
+    cold_code_size += bb->GetInstructionSize();
+  }
+
+  if (cold_order.empty() || cold_code_size < kMinimumColdCodeSize)
+    return true;
+
+  // Find or create the section receiving the cold code.
+  BlockGraph::Section* cold_section = block_graph->FindOrAddSection(
+      kColdSectionName, pe::kCodeCharacteristics);
+  DCHECK_NE(reinterpret_cast<BlockGraph::Section*>(NULL), cold_section);
+
+  // Move the cold basic blocks to their own block. The block builder takes
+  // care of the control flow between the two parts.
+  BlockDescription* cold_description = subgraph->AddBlockDescription(
+      hot_description.name + kColdBlockSuffix,
+      hot_description.compiland_name,
+      BlockGraph::CODE_BLOCK,
+      cold_section->id(),
+      1,
+      hot_description.attributes);
+  DCHECK_NE(reinterpret_cast<BlockDescription*>(NULL), cold_description);
+  cold_description->basic_block_order.swap(cold_order);
+  hot_description.basic_block_order.swap(hot_order);
+
+  return true;
+}
+
+}  // namespace transforms
+}  // namespace optimize
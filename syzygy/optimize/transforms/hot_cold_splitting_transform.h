@@ -0,0 +1,78 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This class implements the hot/cold splitting transformation.
+//
+// The basic blocks of an executed function that were never executed are moved
+// to a separate block living in a dedicated cold code section. The hot part of
+// the function keeps its identity (and its referrers), and the control flow
+// between the two parts is maintained by the block builder, which synthesizes
+// the jumps needed. This shrinks the hot text working set without changing the
+// semantics of the function.
+//
+// Basic blocks that are referred to from outside of the function (exception
+// handlers, jump table targets, ...) are never moved, so that the references,
+// exception data and OMAP information are preserved by the usual block builder
+// machinery.
+
+#ifndef SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
+#define SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
+
+#include "syzygy/block_graph/transform_policy.h"
+#include "syzygy/optimize/application_profile.h"
+#include "syzygy/optimize/transforms/subgraph_transform.h"
+
+namespace optimize {
+namespace transforms {
+
+// This transformation moves the cold basic blocks of hot functions to a
+// separate section.
+class HotColdSplittingTransform : public SubGraphTransformInterface {
+ public:
+  typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
+  typedef block_graph::BlockGraph BlockGraph;
+  typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+
+  // The name of the section receiving the cold code. PE section names are
+  // limited to 8 characters.
+  static const char kColdSectionName[];
+
+  // The suffix appended to the name of a block to name its cold part.
+  static const char kColdBlockSuffix[];
+
+  // The minimal size of the cold code of a function, in bytes, for it to be
+  // worth splitting.
+  static const size_t kMinimumColdCodeSize;
+
+  // Constructor.
+  HotColdSplittingTransform() { }
+
+  // @name SubGraphTransformInterface implementation.
+  // @{
+  virtual bool TransformBasicBlockSubGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BasicBlockSubGraph* subgraph,
+      ApplicationProfile* profile,
+      SubGraphProfile* subgraph_profile) OVERRIDE;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(HotColdSplittingTransform);
+};
+
+}  // namespace transforms
+}  // namespace optimize
+
+#endif  // SYZYGY_OPTIMIZE_TRANSFORMS_HOT_COLD_SPLITTING_TRANSFORM_H_
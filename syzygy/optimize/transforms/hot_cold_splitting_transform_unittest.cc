@@ -0,0 +1,204 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/optimize/transforms/hot_cold_splitting_transform.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/pe_transform_policy.h"
+
+namespace optimize {
+namespace transforms {
+
+namespace {
+
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::BlockBuilder;
+using block_graph::BlockGraph;
+using block_graph::BlockVector;
+using pe::ImageLayout;
+using testing::ElementsAreArray;
+
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
+
+// _asm je  here
+// _asm xor eax, eax
+// here:
+// _asm ret
+const uint8 kCodeJump[] = { 0x74, 0x02, 0x33, 0xC0, 0xC3 };
+
+// _asm test eax, eax
+// _asm jne cold
+// _asm ret
+// cold:
+// _asm xor eax, eax  (x8)
+// _asm ret
+const uint8 kCodeWithColdPath[] = {
+    0x85, 0xC0, 0x75, 0x01, 0xC3,
+    0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0,
+    0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0, 0x33, 0xC0,
+    0xC3 };
+
+const EntryCountType kRunMoreThanOnce = 100;
+const EntryCountType kHot = 100;
+
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
+class HotColdSplittingTransformTest : public testing::Test {
+ public:
+  HotColdSplittingTransformTest()
+      : image_(&block_graph_),
+        profile_(&image_) {
+  }
+
+  // Adds a code block containing @p data to the block graph.
+  BlockGraph::Block* AddCodeBlock(const uint8* data, size_t size) {
+    BlockGraph::Block* block =
+        block_graph_.AddBlock(BlockGraph::CODE_BLOCK, size, "code");
+    DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+    block->SetData(data, size);
+    return block;
+  }
+
+  // Marks @p block as executed.
+  void SetBlockIsHot(const BlockGraph::Block* block) {
+    ApplicationProfile::BlockProfile block_profile(kRunMoreThanOnce, kHot);
+    profile_.profiles_.insert(std::make_pair(block->id(), block_profile));
+  }
+
+  // Decomposes @p block, assigns the entry counts @p counts to its basic code
+  // blocks (in their original order), applies the transform and rebuilds the
+  // block(s).
+  void ApplyTransform(BlockGraph::Block* block,
+                      const EntryCountType* counts,
+                      size_t counts_length) {
+    BasicBlockSubGraph subgraph;
+    BasicBlockDecomposer decomposer(block, &subgraph);
+    ASSERT_TRUE(decomposer.Decompose());
+
+    ASSERT_EQ(1U, subgraph.block_descriptions().size());
+    BasicBlockSubGraph::BasicBlockOrdering& order =
+        subgraph.block_descriptions().front().basic_block_order;
+    BasicBlockSubGraph::BasicBlockOrdering::iterator bb = order.begin();
+    for (size_t i = 0; i < counts_length && bb != order.end(); ++i, ++bb) {
+      BasicCodeBlock* code = BasicCodeBlock::Cast(*bb);
+      ASSERT_NE(reinterpret_cast<BasicCodeBlock*>(NULL), code);
+      subgraph_profile_.basic_blocks_[code] = TestBasicBlockProfile(counts[i]);
+    }
+
+    ASSERT_TRUE(
+        tx_.TransformBasicBlockSubGraph(&policy_, &block_graph_, &subgraph,
+                                        &profile_, &subgraph_profile_));
+
+    BlockBuilder builder(&block_graph_);
+    ASSERT_TRUE(builder.Merge(&subgraph));
+    new_blocks_ = builder.new_blocks();
+  }
+
+ protected:
+  pe::PETransformPolicy policy_;
+  BlockGraph block_graph_;
+  ImageLayout image_;
+  HotColdSplittingTransform tx_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
+  BlockVector new_blocks_;
+};
+
+}  // namespace
+
+TEST_F(HotColdSplittingTransformTest, DoNotSplitWithoutProfile) {
+  BlockGraph::Block* block =
+      AddCodeBlock(kCodeWithColdPath, sizeof(kCodeWithColdPath));
+
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(block, NULL, 0));
+
+  // This block was never run, it must be left unchanged.
+  ASSERT_EQ(1U, new_blocks_.size());
+  EXPECT_THAT(kCodeWithColdPath,
+              ElementsAreArray(new_blocks_[0]->data(),
+                               new_blocks_[0]->size()));
+  EXPECT_EQ(reinterpret_cast<BlockGraph::Section*>(NULL),
+            block_graph_.FindSection(
+                HotColdSplittingTransform::kColdSectionName));
+}
+
+TEST_F(HotColdSplittingTransformTest, DoNotSplitSmallColdCode) {
+  BlockGraph::Block* block = AddCodeBlock(kCodeJump, sizeof(kCodeJump));
+  SetBlockIsHot(block);
+
+  // The 'xor eax, eax' basic block is cold but too small to be worth moving.
+  const EntryCountType kCounts[] = { kRunMoreThanOnce, 0, kRunMoreThanOnce };
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(block, kCounts, arraysize(kCounts)));
+
+  ASSERT_EQ(1U, new_blocks_.size());
+  EXPECT_THAT(kCodeJump,
+              ElementsAreArray(new_blocks_[0]->data(), new_blocks_[0]->size()));
+}
+
+TEST_F(HotColdSplittingTransformTest, SplitColdCode) {
+  BlockGraph::Block* block =
+      AddCodeBlock(kCodeWithColdPath, sizeof(kCodeWithColdPath));
+  SetBlockIsHot(block);
+
+  const EntryCountType kCounts[] = { kRunMoreThanOnce, kRunMoreThanOnce, 0 };
+  ASSERT_NO_FATAL_FAILURE(ApplyTransform(block, kCounts, arraysize(kCounts)));
+
+  // The cold path should have been moved to its own block in the cold section.
+  const BlockGraph::Section* cold_section =
+      block_graph_.FindSection(HotColdSplittingTransform::kColdSectionName);
+  ASSERT_NE(reinterpret_cast<const BlockGraph::Section*>(NULL), cold_section);
+
+  ASSERT_EQ(2U, new_blocks_.size());
+  BlockGraph::Block* hot = new_blocks_[0];
+  BlockGraph::Block* cold = new_blocks_[1];
+  if (hot->section() == cold_section->id())
+    std::swap(hot, cold);
+  EXPECT_NE(cold_section->id(), hot->section());
+  EXPECT_EQ(cold_section->id(), cold->section());
+
+  // The cold block holds the 8 'xor eax, eax' and the 'ret'.
+  EXPECT_EQ(17U, cold->size());
+
+  // The hot block must jump to the cold block.
+  ASSERT_EQ(1U, hot->references().size());
+  EXPECT_EQ(cold, hot->references().begin()->second.referenced());
+}
+
+}  // namespace transforms
+}  // namespace optimize
@@ -35,9 +35,16 @@
 //   Example:
 //     - xor eax, eax
 //       ret
+//
+// Inlining a callee no bigger than its call-site is always done. A bigger
+// callee is inlined only at a call-site executed in a hot caller, and each
+// caller is given a growth budget spent on its most frequent call-sites first.
 
 #include "syzygy/optimize/transforms/inlining_transform.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
@@ -74,6 +81,7 @@ typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef BasicBlock::Instructions Instructions;
 typedef BlockGraph::Offset Offset;
 typedef scoped_ptr<BasicBlockSubGraph> ScopedSubgraph;
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
 
 enum MatchKind {
   kInvalidMatch,
@@ -83,6 +91,24 @@ enum MatchKind {
   kIndirectTrampolineMatch,
 };
 
+// A call-site in a hot basic block whose inlining grows the caller.
+struct HotCallSite {
+  BasicCodeBlock* bb;
+  Instructions::iterator call_iter;
+  BlockGraph::Block* callee;
+  EntryCountType count;
+  size_t growth;
+};
+
+// Sorts the call-sites by decreasing frequency, and then by increasing growth.
+struct HotCallSiteSort {
+  bool operator()(const HotCallSite& site1, const HotCallSite& site2) const {
+    if (site1.count != site2.count)
+      return site1.count > site2.count;
+    return site1.growth < site2.growth;
+  }
+};
+
 // Threshold in bytes to consider a block as a candidate for inlining. This size
 // must be big enough to don't miss good candidates, but small to avoid the
 // overhead of decomposition and simplification of huge block.
@@ -94,6 +120,15 @@ const size_t kHotCodeSizeThreshold = 15;
 // Threshold in bytes to inline a callee in a cold block.
 const size_t kColdCodeSizeThreshold = 1;
 
+// A caller is hot when it belongs to the blocks accounting for this fraction
+// of the application temperature.
+const double kHotBlockPercentile = 0.8;
+
+// The code growth budget of a caller is kBaseGrowthBudget bytes plus
+// kGrowthBudgetPercent percent of its size.
+const size_t kBaseGrowthBudget = 32;
+const size_t kGrowthBudgetPercent = 25;
+
 // A size huge enough to never be an inlining candidate.
 const size_t kHugeBlockSize = 0xFFFFFFFF;
 
@@ -520,6 +555,45 @@ size_t EstimateSubgraphSize(BasicBlockSubGraph* subgraph) {
   return size;
 }
 
+// Inline the body of @p callee at the call-site @p call_iter.
+// @param callee The block being called.
+// @param subgraph The caller subgraph.
+// @param callee_subgraph The decomposed callee, if available. Otherwise the
+//     callee is decomposed on demand.
+// @param call_iter The call-site to replace.
+// @param instructions The caller instructions containing @p call_iter.
+// @returns true if the call-site was replaced, false otherwise.
+bool InlineCallSite(BlockGraph::Block* callee,
+                    BasicBlockSubGraph* subgraph,
+                    ScopedSubgraph* callee_subgraph,
+                    Instructions::iterator call_iter,
+                    Instructions* instructions) {
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), callee);
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<ScopedSubgraph*>(NULL), callee_subgraph);
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+
+  // If not already decomposed (cached), decompose it.
+  if (callee_subgraph->get() == NULL) {
+    CHECK(DecomposeCalleeBlock(callee, callee_subgraph));
+  }
+
+  size_t return_constant = 0;
+  BasicCodeBlock* body = NULL;
+  BasicBlockReference target;
+  MatchKind match_kind = kInvalidMatch;
+  if (!MatchTrivialBody(**callee_subgraph, &match_kind, &return_constant,
+                        &target, &body) ||
+      !InlineTrivialBody(match_kind, subgraph, return_constant, target, body,
+                         call_iter, instructions)) {
+    return false;
+  }
+
+  // Inlining successful, remove call-site.
+  instructions->erase(call_iter);
+  return true;
+}
+
 }  // namespace
 
 bool InliningTransform::TransformBasicBlockSubGraph(
@@ -545,6 +619,18 @@ bool InliningTransform::TransformBasicBlockSubGraph(
   // dangling pointers, the block is removed from the decomposed cache.
   subgraph_cache_.erase(caller->id());
 
+  // Only a hot caller may grow, and by a bounded amount of code.
+  const BlockProfile* caller_profile = profile->GetBlockProfile(caller);
+  DCHECK_NE(reinterpret_cast<const BlockProfile*>(NULL), caller_profile);
+  bool caller_is_hot = caller_profile->count() != 0 &&
+      caller_profile->percentile() < kHotBlockPercentile;
+  size_t growth_budget = kBaseGrowthBudget +
+      caller->size() * kGrowthBudgetPercent / 100;
+
+  // The call-sites that would grow the caller, considered once the size
+  // neutral ones are done.
+  std::vector<HotCallSite> hot_call_sites;
+
   // Iterates through each basic block.
   BasicBlockSubGraph::BBCollection::iterator bb_iter =
       subgraph->basic_blocks().begin();
@@ -553,6 +639,11 @@ bool InliningTransform::TransformBasicBlockSubGraph(
     if (bb == NULL)
       continue;
 
+    // Call-sites in a basic block never executed are cold.
+    EntryCountType bb_count = 0;
+    if (caller_is_hot)
+      bb_count = subgraph_profile->GetBasicBlockProfile(bb)->count();
+
     // Iterates through each instruction.
     BasicBlock::Instructions::iterator inst_iter = bb->instructions().begin();
     while (inst_iter != bb->instructions().end()) {
@@ -589,10 +680,6 @@ bool InliningTransform::TransformBasicBlockSubGraph(
 
       size_t subgraph_size = 0;
       ScopedSubgraph callee_subgraph;
-      size_t return_constant = 0;
-      BasicCodeBlock* body = NULL;
-      BasicBlockReference target;
-      MatchKind match_kind = kInvalidMatch;
 
       // Look in the subgraph cache for an already decomposed subgraph size for
       // an optimized version of the callee block.
@@ -613,36 +700,51 @@ bool InliningTransform::TransformBasicBlockSubGraph(
         subgraph_cache_[callee->id()] = subgraph_size;
       }
 
-      // Heuristic to determine whether to inline or not the callee subgraph.
-      bool candidate_for_inlining = false;
-
       // For a small callee, try to replace callee instructions in-place.
       // This kind of inlining is always a win.
       size_t callsite_size = instr.size();
-      if (subgraph_size <= callsite_size + kColdCodeSizeThreshold)
-        candidate_for_inlining = true;
-
-      // TODO(etienneb): Add more rules based on profile data.
-
-      if (!candidate_for_inlining)
+      if (subgraph_size <= callsite_size + kColdCodeSizeThreshold) {
+        if (!InlineCallSite(callee, subgraph, &callee_subgraph, call_iter,
+                            &bb->instructions())) {
+          // Inlining was unsuccessful, avoid any further inlining of this
+          // block.
+          subgraph_cache_[callee->id()] = kHugeBlockSize;
+        }
         continue;
-
-      // If not already decomposed (cached), decompose it.
-      if (callee_subgraph.get() == NULL) {
-        CHECK(DecomposeCalleeBlock(callee, &callee_subgraph));
       }
 
-      if (MatchTrivialBody(*callee_subgraph, &match_kind, &return_constant,
-                           &target, &body) &&
-          InlineTrivialBody(match_kind, subgraph, return_constant, target, body,
-                            call_iter, &bb->instructions())) {
-        // Inlining successful, remove call-site.
-        bb->instructions().erase(call_iter);
-      } else {
-        // Inlining was unsuccessful, avoid any further inlining of this block.
-        subgraph_cache_[callee->id()] = kHugeBlockSize;
+      // A bigger callee is only worth inlining at a hot call-site.
+      if (bb_count == 0 ||
+          subgraph_size > callsite_size + kHotCodeSizeThreshold) {
+        continue;
       }
+
+      HotCallSite site = { bb, call_iter, callee, bb_count,
+                           subgraph_size - callsite_size };
+      hot_call_sites.push_back(site);
+    }
+  }
+
+  // Spend the growth budget on the most frequent call-sites first.
+  std::stable_sort(hot_call_sites.begin(), hot_call_sites.end(),
+                   HotCallSiteSort());
+  size_t growth = 0;
+  for (size_t i = 0; i < hot_call_sites.size(); ++i) {
+    const HotCallSite& site = hot_call_sites[i];
+    if (growth + site.growth > growth_budget)
+      continue;
+
+    // Skip the callees that already failed to be inlined.
+    if (subgraph_cache_[site.callee->id()] == kHugeBlockSize)
+      continue;
+
+    ScopedSubgraph callee_subgraph;
+    if (!InlineCallSite(site.callee, subgraph, &callee_subgraph,
+                        site.call_iter, &site.bb->instructions())) {
+      subgraph_cache_[site.callee->id()] = kHugeBlockSize;
+      continue;
     }
+    growth += site.growth;
   }
 
   return true;
@@ -47,6 +47,7 @@ using testing::ElementsAreArray;
 
 typedef BasicBlockSubGraph::BasicCodeBlock BasicCodeBlock;
 typedef BlockGraph::Offset Offset;
+typedef grinder::basic_block_util::EntryCountType EntryCountType;
 
 // This enum is used to drive the contents of the callee.
 enum CalleeKind {
@@ -135,17 +136,42 @@ const uint8 kCodeIndirectCall[] = { 0xFF, 0x55, 0xF8, 0xC3 };
 // _asm ret
 const uint8 kStackCst[] = { 0x6A, 0x02, 0x58, 0xC3 };
 
+const EntryCountType kRunMoreThanOnce = 100;
+const EntryCountType kHot = 100;
+
 class TestInliningTransform : public InliningTransform {
  public:
   using InliningTransform::subgraph_cache_;
 };
 
+class TestApplicationProfile : public ApplicationProfile {
+ public:
+  explicit TestApplicationProfile(const ImageLayout* image_layout)
+      : ApplicationProfile(image_layout) {
+  }
+
+  using ApplicationProfile::profiles_;
+};
+
+class TestSubGraphProfile : public SubGraphProfile {
+ public:
+  using SubGraphProfile::basic_blocks_;
+};
+
+class TestBasicBlockProfile : public SubGraphProfile::BasicBlockProfile {
+ public:
+  explicit TestBasicBlockProfile(EntryCountType count) {
+    count_ = count;
+  }
+};
+
 class InliningTransformTest : public testing::Test {
  public:
   InliningTransformTest()
       : data_(NULL),
         caller_(NULL),
         callee_(NULL),
+        caller_is_hot_(false),
         image_(&block_graph_),
         profile_(&image_) {
   }
@@ -178,11 +204,12 @@ class InliningTransformTest : public testing::Test {
   BlockGraph::Block* data_;
   BlockGraph::Block* caller_;
   BlockGraph::Block* callee_;
+  bool caller_is_hot_;
   std::vector<uint8> original_;
   BasicBlockSubGraph callee_subgraph_;
   ImageLayout image_;
-  ApplicationProfile profile_;
-  SubGraphProfile subgraph_profile_;
+  TestApplicationProfile profile_;
+  TestSubGraphProfile subgraph_profile_;
 };
 
 void InliningTransformTest::AddBlockFromBuffer(const uint8* data,
@@ -303,6 +330,23 @@ void InliningTransformTest::ApplyTransformOnCaller() {
   BasicBlockDecomposer decomposer(caller_, &subgraph);
   ASSERT_TRUE(decomposer.Decompose());
 
+  // Mark the caller and all its basic blocks as executed.
+  subgraph_profile_.basic_blocks_.clear();
+  if (caller_is_hot_) {
+    ApplicationProfile::BlockProfile block_profile(kRunMoreThanOnce, kHot);
+    profile_.profiles_[caller_->id()] = block_profile;
+
+    BasicBlockSubGraph::BBCollection::iterator it =
+        subgraph.basic_blocks().begin();
+    for (; it != subgraph.basic_blocks().end(); ++it) {
+      BasicCodeBlock* code = BasicCodeBlock::Cast(*it);
+      if (code != NULL) {
+        subgraph_profile_.basic_blocks_[code] =
+            TestBasicBlockProfile(kRunMoreThanOnce);
+      }
+    }
+  }
+
   // Apply inlining transform.
   InliningTransform tx;
   ASSERT_TRUE(
@@ -501,6 +545,43 @@ TEST_F(InliningTransformTest, DontInlineBigBlock) {
   EXPECT_THAT(original_, ElementsAreArray(caller_->data(), caller_->size()));
 }
 
+TEST_F(InliningTransformTest, DontInlineColdCallSite) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  // The callee is bigger than the call-site, and the caller never ran.
+  EXPECT_THAT(original_, ElementsAreArray(caller_->data(), caller_->size()));
+}
+
+TEST_F(InliningTransformTest, InlineHotCallSite) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  caller_is_hot_ = true;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  EXPECT_THAT(kCodeRetBoth,
+              ElementsAreArray(caller_->data(), caller_->size()));
+}
+
+TEST_F(InliningTransformTest, InlineHotCallSiteWithinGrowthBudget) {
+  ASSERT_NO_FATAL_FAILURE(
+      AddBlockFromBuffer(kCodeRetBoth, sizeof(kCodeRetBoth), &callee_));
+  const size_t kCallSites = 20;
+  for (size_t i = 0; i < kCallSites; ++i)
+    ASSERT_NO_FATAL_FAILURE(CreateCallSiteToBlock(callee_));
+  caller_is_hot_ = true;
+  ASSERT_NO_FATAL_FAILURE(ApplyTransformOnCaller());
+
+  // Each inlining grows the caller by an estimated 3 bytes, and the caller is
+  // given a budget of 32 + 101 / 4 = 57 bytes. Only 19 call-sites fit: the
+  // last call and the 'ret' are left, with 19 copies of 'xor; mov'.
+  const size_t kInlinedBodySize = sizeof(kCodeRetBoth) - 1;
+  EXPECT_EQ(19 * kInlinedBodySize + 5 + 1, caller_->size());
+}
+
 TEST_F(InliningTransformTest, DontInlineCallerPolicy) {
   ASSERT_NO_FATAL_FAILURE(
       AddBlockFromBuffer(kCodeRet0, sizeof(kCodeRet0), &callee_));
@@ -14,9 +14,11 @@
 
 #include "syzygy/optimize/transforms/peephole_transform.h"
 
+#include <vector>
+
 #include "syzygy/block_graph/block_graph.h"
-#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/analysis/liveness_analysis_internal.h"
+#include "syzygy/core/disassembler_util.h"
 
 namespace optimize {
 namespace transforms {
@@ -32,6 +34,11 @@ using block_graph::analysis::LivenessAnalysis;
 typedef BasicBlockSubGraph::BBCollection BBCollection;
 typedef BasicBlock::Instructions Instructions;
 
+// A pattern simplifying the instructions at |where|. On success, |where| is
+// updated to point to the first instruction following the rewritten ones.
+typedef bool (*SimplifyPattern)(Instructions* instructions,
+                                Instructions::iterator* where);
+
 // Match a sequence of three instructions and return them into |instr1|,
 // |instr2| and |instr3|.
 bool MatchThreeInstructions(const Instructions& instructions,
@@ -153,6 +160,164 @@ bool SimplifyIdentityMov(Instructions* instructions,
   return false;
 }
 
+// Remove a register saved and immediately restored: push eax, pop eax.
+bool SimplifyPushPopSameRegister(Instructions* instructions,
+                                 Instructions::iterator* where) {
+  DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
+  DCHECK_NE(reinterpret_cast<Instructions::iterator*>(NULL), where);
+
+  const Instruction& instr1 = **where;
+  Instructions::iterator next = *where;
+  ++next;
+  if (next == instructions->end())
+    return false;
+  const Instruction& instr2 = *next;
+
+  const _DInst& repr1 = instr1.representation();
+  if (repr1.opcode != I_PUSH || repr1.ops[0].type != O_REG)
+    return false;
+
+  _RegisterType reg = static_cast<_RegisterType>(repr1.ops[0].index);
+  if (!MatchInstructionReg(instr2, I_POP, reg))
+    return false;
+
+  // Remove the two matched instructions.
+  for (int i = 0; i < 2; ++i)
+    *where = instructions->erase(*where);
+  return true;
+}
+
+// The patterns applied by SimplifyBasicBlock, in order.
+const SimplifyPattern kSimplifyPatterns[] = {
+    &SimplifyEmptyPrologEpilog,
+    &SimplifyIdentityMov,
+    &SimplifyPushPopSameRegister,
+};
+
+// Determine whether an instruction may be moved across a save/restore pair:
+// it must not alter the control flow, nor touch the stack.
+// @param instr the instruction to check.
+// @param defs receives the registers and flags defined by @p instr.
+// @returns true if @p instr is transparent for the stack, false otherwise.
+bool IsStackNeutral(const Instruction& instr, LivenessAnalysis::State* defs) {
+  DCHECK_NE(reinterpret_cast<LivenessAnalysis::State*>(NULL), defs);
+
+  if (instr.IsCall() || instr.IsReturn() || instr.IsControlFlow())
+    return false;
+
+  LivenessAnalysis::State uses;
+  if (!LivenessAnalysis::StateHelper::GetDefsOf(instr, defs) ||
+      !LivenessAnalysis::StateHelper::GetUsesOf(instr, &uses)) {
+    return false;
+  }
+
+  if (defs->IsLive(assm::esp) || uses.IsLive(assm::esp) ||
+      defs->IsLive(assm::ebp) || uses.IsLive(assm::ebp)) {
+    return false;
+  }
+
+  return true;
+}
+
+// Remove the redundant save/restore pairs of a basic block. A 'push reg' and
+// its matching 'pop reg' are redundant when the instructions between them
+// don't touch the stack, and either preserve the register or the register is
+// dead after the restore. The same applies to the flags saved by 'pushfd'.
+bool RemoveRedundantSaveRestore(BasicCodeBlock* bb,
+                                const LivenessAnalysis& liveness) {
+  DCHECK_NE(reinterpret_cast<BasicCodeBlock*>(NULL), bb);
+
+  Instructions& instructions = bb->instructions();
+  std::vector<Instructions::iterator> insts;
+  Instructions::iterator it = instructions.begin();
+  for (; it != instructions.end(); ++it)
+    insts.push_back(it);
+
+  // Compute the liveness information after each instruction.
+  std::vector<LivenessAnalysis::State> live_after(insts.size());
+  LivenessAnalysis::State state;
+  liveness.GetStateAtExitOf(bb, &state);
+  for (size_t i = insts.size(); i > 0; --i) {
+    live_after[i - 1] = state;
+    liveness.PropagateBackward(*insts[i - 1], &state);
+  }
+
+  std::vector<bool> removed(insts.size(), false);
+  bool changed = false;
+  for (size_t i = 0; i < insts.size(); ++i) {
+    if (removed[i])
+      continue;
+
+    // Match a register or a flags save.
+    const _DInst& save = insts[i]->representation();
+    bool is_flags = false;
+    _RegisterType reg = _RegisterType();
+    if (save.opcode == I_PUSHF) {
+      is_flags = true;
+    } else if (save.opcode == I_PUSH &&
+               save.ops[0].type == O_REG &&
+               save.ops[0].index >= R_EAX &&
+               save.ops[0].index <= R_EDI &&
+               save.ops[0].index != R_ESP &&
+               save.ops[0].index != R_EBP) {
+      reg = static_cast<_RegisterType>(save.ops[0].index);
+    } else {
+      continue;
+    }
+
+    // Find the matching restore.
+    bool clobbered = false;
+    bool direction_changed = false;
+    size_t j = i + 1;
+    for (; j < insts.size(); ++j) {
+      const Instruction& instr = *insts[j];
+      if (removed[j])
+        break;
+      if (is_flags && instr.representation().opcode == I_POPF)
+        break;
+      if (!is_flags && MatchInstructionReg(instr, I_POP, reg))
+        break;
+
+      LivenessAnalysis::State defs;
+      if (!IsStackNeutral(instr, &defs)) {
+        j = insts.size();
+        break;
+      }
+
+      if (is_flags) {
+        clobbered |= defs.AreArithmeticFlagsLive();
+        direction_changed |=
+            (instr.representation().modifiedFlagsMask & D_DF) != 0;
+      } else {
+        clobbered |= defs.IsLive(core::GetRegister(reg));
+      }
+    }
+    if (j >= insts.size() || removed[j])
+      continue;
+
+    // The restore is only needed to undo a clobber that is observed later.
+    if (clobbered) {
+      if (is_flags) {
+        if (direction_changed || live_after[j].AreArithmeticFlagsLive())
+          continue;
+      } else if (live_after[j].IsLive(core::GetRegister(reg))) {
+        continue;
+      }
+    }
+
+    removed[i] = true;
+    removed[j] = true;
+    changed = true;
+  }
+
+  for (size_t i = 0; i < insts.size(); ++i) {
+    if (removed[i])
+      instructions.erase(insts[i]);
+  }
+
+  return changed;
+}
+
 // Simplify a given basic block.
 bool SimplifyBasicBlock(BasicBlock* basic_block) {
   DCHECK_NE(reinterpret_cast<BasicBlock*>(NULL), basic_block);
@@ -166,8 +331,14 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
   // Match and rewrite based on patterns.
   BasicBlock::Instructions::iterator inst_iter = bb->instructions().begin();
   while (inst_iter != bb->instructions().end()) {
-    if (SimplifyEmptyPrologEpilog(&bb->instructions(), &inst_iter) ||
-        SimplifyIdentityMov(&bb->instructions(), &inst_iter)) {
+    bool simplified = false;
+    for (size_t i = 0; i < arraysize(kSimplifyPatterns); ++i) {
+      if (kSimplifyPatterns[i](&bb->instructions(), &inst_iter)) {
+        simplified = true;
+        break;
+      }
+    }
+    if (simplified) {
       changed = true;
       continue;
     }
@@ -183,14 +354,23 @@ bool SimplifyBasicBlock(BasicBlock* basic_block) {
 
 // Simplify a given subgraph.
 bool PeepholeTransform::SimplifySubgraph(BasicBlockSubGraph* subgraph) {
+  BasicBlockSet changed_blocks;
+  return SimplifySubgraph(subgraph, &changed_blocks);
+}
+
+bool PeepholeTransform::SimplifySubgraph(BasicBlockSubGraph* subgraph,
+                                         BasicBlockSet* changed_blocks) {
   DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<BasicBlockSet*>(NULL), changed_blocks);
 
   bool changed = false;
   BBCollection& basic_blocks = subgraph->basic_blocks();
   BBCollection::iterator it = basic_blocks.begin();
   for (; it != basic_blocks.end(); ++it) {
-    if (SimplifyBasicBlock(*it))
+    if (SimplifyBasicBlock(*it)) {
+      changed_blocks->insert(*it);
       changed = true;
+    }
   }
 
   return changed;
@@ -199,14 +379,25 @@ bool PeepholeTransform::SimplifySubgraph(BasicBlockSubGraph* subgraph) {
 bool PeepholeTransform::RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph) {
   DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
 
-  bool changed = false;
-  BBCollection& basic_blocks = subgraph->basic_blocks();
-  BBCollection::iterator it = basic_blocks.begin();
-
   // Perform a global liveness analysis.
   LivenessAnalysis liveness;
   liveness.Analyze(subgraph);
 
+  BasicBlockSet changed_blocks;
+  return RemoveDeadCodeSubgraph(subgraph, liveness, &changed_blocks);
+}
+
+bool PeepholeTransform::RemoveDeadCodeSubgraph(
+    BasicBlockSubGraph* subgraph,
+    const LivenessAnalysis& liveness,
+    BasicBlockSet* changed_blocks) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<BasicBlockSet*>(NULL), changed_blocks);
+
+  bool changed = false;
+  BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::iterator it = basic_blocks.begin();
+
   // For each basic block, remove dead instructions.
   for (; it != basic_blocks.end(); ++it) {
     BasicCodeBlock* basic_block = BasicCodeBlock::Cast(*it);
@@ -300,6 +491,7 @@ bool PeepholeTransform::RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph) {
         Instructions::const_iterator it = rev_iter_inst.base();
         rev_iter_inst = Instructions::reverse_iterator(
             basic_block->instructions().erase(it));
+        changed_blocks->insert(basic_block);
         changed = true;
 
         // Do not propagate liveness backward.
@@ -314,6 +506,43 @@ bool PeepholeTransform::RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph) {
   return changed;
 }
 
+bool PeepholeTransform::RemoveRedundantSaveRestoreSubgraph(
+    BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+
+  // Perform a global liveness analysis.
+  LivenessAnalysis liveness;
+  liveness.Analyze(subgraph);
+
+  BasicBlockSet changed_blocks;
+  return RemoveRedundantSaveRestoreSubgraph(subgraph, liveness,
+                                            &changed_blocks);
+}
+
+bool PeepholeTransform::RemoveRedundantSaveRestoreSubgraph(
+    BasicBlockSubGraph* subgraph,
+    const LivenessAnalysis& liveness,
+    BasicBlockSet* changed_blocks) {
+  DCHECK_NE(reinterpret_cast<BasicBlockSubGraph*>(NULL), subgraph);
+  DCHECK_NE(reinterpret_cast<BasicBlockSet*>(NULL), changed_blocks);
+
+  bool changed = false;
+  BBCollection& basic_blocks = subgraph->basic_blocks();
+  BBCollection::iterator it = basic_blocks.begin();
+  for (; it != basic_blocks.end(); ++it) {
+    BasicCodeBlock* basic_block = BasicCodeBlock::Cast(*it);
+    if (basic_block == NULL)
+      continue;
+
+    if (RemoveRedundantSaveRestore(basic_block, liveness)) {
+      changed_blocks->insert(basic_block);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
 bool PeepholeTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -326,14 +555,33 @@ bool PeepholeTransform::TransformBasicBlockSubGraph(
   DCHECK_NE(reinterpret_cast<ApplicationProfile*>(NULL), profile);
   DCHECK_NE(reinterpret_cast<SubGraphProfile*>(NULL), subgraph_profile);
 
+  // The global liveness analysis is computed once, then only updated for the
+  // basic blocks modified by each iteration.
+  LivenessAnalysis liveness;
+  liveness.Analyze(subgraph);
+
   bool changed = false;
   do {
     changed = false;
 
-    if (SimplifySubgraph(subgraph))
+    BasicBlockSet changed_blocks;
+    if (SimplifySubgraph(subgraph, &changed_blocks)) {
+      liveness.Reanalyze(subgraph, changed_blocks);
       changed = true;
-    if (RemoveDeadCodeSubgraph(subgraph))
+    }
+
+    changed_blocks.clear();
+    if (RemoveRedundantSaveRestoreSubgraph(subgraph, liveness,
+                                           &changed_blocks)) {
+      liveness.Reanalyze(subgraph, changed_blocks);
+      changed = true;
+    }
+
+    changed_blocks.clear();
+    if (RemoveDeadCodeSubgraph(subgraph, liveness, &changed_blocks)) {
+      liveness.Reanalyze(subgraph, changed_blocks);
       changed = true;
+    }
   } while (changed);
 
   return true;
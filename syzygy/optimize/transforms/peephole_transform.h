@@ -21,6 +21,7 @@
 #define SYZYGY_OPTIMIZE_TRANSFORMS_PEEPHOLE_TRANSFORM_H_
 
 #include "syzygy/block_graph/filterable.h"
+#include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/transform_policy.h"
 #include "syzygy/optimize/application_profile.h"
 #include "syzygy/optimize/transforms/subgraph_transform.h"
@@ -35,6 +36,8 @@ class PeepholeTransform : public SubGraphTransformInterface {
   typedef block_graph::BasicBlockSubGraph BasicBlockSubGraph;
   typedef block_graph::BlockGraph BlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
+  typedef block_graph::analysis::LivenessAnalysis LivenessAnalysis;
+  typedef LivenessAnalysis::BasicBlockSet BasicBlockSet;
 
   // Constructor.
   PeepholeTransform() { }
@@ -63,6 +66,30 @@ class PeepholeTransform : public SubGraphTransformInterface {
   // @returns true if the subgraph has been simplified, false otherwise.
   static bool RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph);
 
+  // Remove the redundant register and flags save/restore pairs (push/pop,
+  // pushfd/popfd) in the contents of a subgraph, like the ones left around
+  // instrumentation hooks. The elimination is applied once.
+  // @param subgraph the subgraph to simplify.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  static bool RemoveRedundantSaveRestoreSubgraph(BasicBlockSubGraph* subgraph);
+
+  // @name Incremental versions of the above, used to reach the fixed point.
+  // @param subgraph the subgraph to simplify.
+  // @param liveness an up to date global liveness analysis of @p subgraph.
+  // @param changed_blocks receives the basic blocks that have been modified.
+  // @returns true if the subgraph has been simplified, false otherwise.
+  // @{
+  static bool SimplifySubgraph(BasicBlockSubGraph* subgraph,
+                               BasicBlockSet* changed_blocks);
+  static bool RemoveDeadCodeSubgraph(BasicBlockSubGraph* subgraph,
+                                     const LivenessAnalysis& liveness,
+                                     BasicBlockSet* changed_blocks);
+  static bool RemoveRedundantSaveRestoreSubgraph(
+      BasicBlockSubGraph* subgraph,
+      const LivenessAnalysis& liveness,
+      BasicBlockSet* changed_blocks);
+  // @}
+
  private:
   DISALLOW_COPY_AND_ASSIGN(PeepholeTransform);
 };
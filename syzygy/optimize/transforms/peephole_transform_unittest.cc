@@ -203,5 +203,94 @@ TEST_F(PeepholeTransformTest, RemoveDeadCodeSubgraphWith8BitRegister) {
   EXPECT_THAT(kSource, ElementsAreArray(block_->data(), block_->size()));
 }
 
+TEST_F(PeepholeTransformTest, SimplifyPushPopSameRegister) {
+  // _asm push eax
+  // _asm pop eax
+  // _asm ret
+  const uint8 kSource[] = { 0x50, 0x58, 0xC3 };
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformSubgraph, kSource, sizeof(kSource)));
+  EXPECT_THAT(kRet, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, RemoveRedundantSaveRestore) {
+  // _asm push ecx
+  // _asm mov eax, edx
+  // _asm pop ecx
+  // _asm ret
+  const uint8 kSource[] = { 0x51, 0x8B, 0xC2, 0x59, 0xC3 };
+
+  // _asm mov eax, edx
+  // _asm ret
+  const uint8 kResult[] = { 0x8B, 0xC2, 0xC3 };
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, RemoveSaveRestoreOfDeadRegister) {
+  // _asm push ecx
+  // _asm mov ecx, edx
+  // _asm pop ecx
+  // _asm mov ecx, 1
+  // _asm ret
+  const uint8 kSource[] = {
+      0x51, 0x8B, 0xCA, 0x59, 0xB9, 0x01, 0x00, 0x00, 0x00, 0xC3 };
+
+  // _asm mov ecx, 1
+  // _asm ret
+  const uint8 kResult[] = { 0xB9, 0x01, 0x00, 0x00, 0x00, 0xC3 };
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, KeepSaveRestoreOfLiveRegister) {
+  // _asm push ecx
+  // _asm mov ecx, edx
+  // _asm pop ecx
+  // _asm ret
+  const uint8 kSource[] = { 0x51, 0x8B, 0xCA, 0x59, 0xC3 };
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+
+  // The value of ecx restored is used by the caller.
+  EXPECT_THAT(kSource, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, KeepSaveRestoreWithStackAccess) {
+  // _asm push ecx
+  // _asm mov eax, [esp]
+  // _asm pop ecx
+  // _asm ret
+  const uint8 kSource[] = { 0x51, 0x8B, 0x04, 0x24, 0x59, 0xC3 };
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+
+  // The saved value is read from the stack.
+  EXPECT_THAT(kSource, ElementsAreArray(block_->data(), block_->size()));
+}
+
+TEST_F(PeepholeTransformTest, RemoveRedundantFlagsSaveRestore) {
+  // _asm pushfd
+  // _asm mov eax, edx
+  // _asm popfd
+  // _asm ret
+  const uint8 kSource[] = { 0x9C, 0x8B, 0xC2, 0x9D, 0xC3 };
+
+  // _asm mov eax, edx
+  // _asm ret
+  const uint8 kResult[] = { 0x8B, 0xC2, 0xC3 };
+
+  ASSERT_NO_FATAL_FAILURE(
+      TransformBlock(ktransformBlock, kSource, sizeof(kSource)));
+  EXPECT_THAT(kResult, ElementsAreArray(block_->data(), block_->size()));
+}
+
 }  // namespace transforms
 }  // namespace optimize
@@ -16,7 +16,7 @@
 
 #include "syzygy/optimize/transforms/unreachable_block_transform.h"
 
-#include <stack>
+#include "syzygy/block_graph/block_util.h"
 
 namespace optimize {
 namespace transforms {
@@ -27,9 +27,11 @@ namespace {
 struct SubTreeInformation;
 
 using block_graph::BlockGraph;
+using block_graph::ConstBlockVector;
+using block_graph::IsReachableBlock;
 typedef BlockGraph::Block::ReferenceMap ReferenceMap;
 typedef std::set<const BlockGraph::Block*> ReachableSet;
-typedef std::stack<const BlockGraph::Block*> ReachableStack;
+typedef std::vector<bool> ReachableBits;
 typedef std::map<const BlockGraph::Block*, SubTreeInformation> RecursiveSizeMap;
 
 struct SubTreeInformation {
@@ -41,7 +43,7 @@ struct SubTreeInformation {
 // from the given root |block|.
 void ComputeSubTreeInformation(const BlockGraph::Block* block,
                                const BlockGraph::BlockMap& blocks,
-                               const ReachableSet& reachable,
+                               const ReachableBits& reachable,
                                SubTreeInformation* subtree,
                                ReachableSet* visited) {
   DCHECK_NE(reinterpret_cast<SubTreeInformation*>(NULL), subtree);
@@ -62,7 +64,7 @@ void ComputeSubTreeInformation(const BlockGraph::Block* block,
   ReferenceMap::const_iterator reference = references.begin();
   for (; reference != references.end(); ++reference) {
     const BlockGraph::Block* reference_block = reference->second.referenced();
-    if (reachable.find(reference_block) != reachable.end())
+    if (IsReachableBlock(reachable, reference_block))
       continue;
     ComputeSubTreeInformation(
         reference_block, blocks, reachable, subtree, visited);
@@ -71,7 +73,7 @@ void ComputeSubTreeInformation(const BlockGraph::Block* block,
 
 bool DumpUnreachableCallgraph(const base::FilePath& path,
                               const BlockGraph::BlockMap& blocks,
-                              const ReachableSet& reachable) {
+                              const ReachableBits& reachable) {
 
   // A cache of computed sizes.
   RecursiveSizeMap subtrees;
@@ -88,7 +90,7 @@ bool DumpUnreachableCallgraph(const base::FilePath& path,
   BlockGraph::BlockMap::const_iterator block_iter = blocks.begin();
   for (block_iter = blocks.begin(); block_iter != blocks.end(); ++block_iter) {
     const BlockGraph::Block* block = &block_iter->second;
-    if (reachable.find(block) != reachable.end())
+    if (IsReachableBlock(reachable, block))
       continue;
 
     ::fprintf(file.get(), "ob=%s\n", block->compiland_name().c_str());
@@ -102,7 +104,7 @@ bool DumpUnreachableCallgraph(const base::FilePath& path,
     ReferenceMap::const_iterator reference = references.begin();
     for (; reference != references.end(); ++reference) {
       const BlockGraph::Block* reference_block = reference->second.referenced();
-      if (reachable.find(reference_block) != reachable.end())
+      if (IsReachableBlock(reachable, reference_block))
         continue;
       if (subtree_visited.find(reference_block) != subtree_visited.end())
         continue;
@@ -146,12 +148,10 @@ bool UnreachableBlockTransform::TransformBlockGraph(
     BlockGraph* block_graph,
     BlockGraph::Block* header_block) {
 
-  ReachableSet reachable;
-  ReachableStack working;
-
-  // Mark roots as reachable.
-  reachable.insert(header_block);
-  working.push(header_block);
+  // The roots are the header block and the blocks parsed from the PE
+  // structures.
+  ConstBlockVector roots;
+  roots.push_back(header_block);
 
   BlockGraph::BlockMap& blocks = block_graph->blocks_mutable();
   BlockGraph::BlockMap::iterator block_iter = blocks.begin();
@@ -159,23 +159,12 @@ bool UnreachableBlockTransform::TransformBlockGraph(
     BlockGraph::Block* block = &block_iter->second;
     if ((block->attributes() & BlockGraph::PE_PARSED) == 0)
       continue;
-    reachable.insert(block);
-    working.push(block);
+    roots.push_back(block);
   }
 
   // Follow the reachable graph.
-  while (!working.empty()) {
-    const BlockGraph::Block* block = working.top();
-    working.pop();
-
-    const ReferenceMap& references = block->references();
-    ReferenceMap::const_iterator reference = references.begin();
-    for (; reference != references.end(); ++reference) {
-      const BlockGraph::Block* reference_block = reference->second.referenced();
-      if (reachable.insert(reference_block).second)
-        working.push(reference_block);
-    }
-  }
+  ReachableBits reachable;
+  block_graph::MarkReachableBlocks(*block_graph, roots, &reachable);
 
   // Dump a cachegrind graph of unreachable blocks.
   if (!unreachable_graph_path_.empty())
@@ -187,7 +176,7 @@ bool UnreachableBlockTransform::TransformBlockGraph(
   std::vector<BlockGraph::BlockId> to_remove;
   for (block_iter = blocks.begin(); block_iter != blocks.end(); ++block_iter) {
     BlockGraph::Block* block = &block_iter->second;
-    if (reachable.find(block) == reachable.end()) {
+    if (!IsReachableBlock(reachable, block)) {
       block->RemoveAllReferences();
       to_remove.push_back(block->id());
     }
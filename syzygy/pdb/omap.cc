@@ -57,6 +57,37 @@ core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
       (address - core::RelativeAddress(it->rva));
 }
 
+void TranslateAddressesViaOmap(const std::vector<OMAP>& omaps,
+                               std::vector<core::RelativeAddress>* addresses) {
+  DCHECK(addresses != NULL);
+
+  // Sort the addresses, remembering their positions.
+  typedef std::pair<core::RelativeAddress, size_t> AddressAndIndex;
+  std::vector<AddressAndIndex> sorted_addresses(addresses->size());
+  for (size_t i = 0; i < addresses->size(); ++i)
+    sorted_addresses[i] = std::make_pair((*addresses)[i], i);
+  std::sort(sorted_addresses.begin(), sorted_addresses.end());
+
+  // Sweep the addresses and the OMAP entries together. |it| is kept at the
+  // first entry that is > than the current address, as in
+  // TranslateAddressViaOmap.
+  std::vector<OMAP>::const_iterator it = omaps.begin();
+  for (size_t i = 0; i < sorted_addresses.size(); ++i) {
+    core::RelativeAddress address = sorted_addresses[i].first;
+    while (it != omaps.end() && it->rva <= address.value())
+      ++it;
+
+    // Addresses before any OMAPped address are left as is.
+    if (it == omaps.begin())
+      continue;
+
+    const OMAP& omap = *(it - 1);
+    (*addresses)[sorted_addresses[i].second] =
+        core::RelativeAddress(omap.rvaTo) +
+        (address - core::RelativeAddress(omap.rva));
+  }
+}
+
 bool ReadOmapsFromPdbFile(const PdbFile& pdb_file,
                           std::vector<OMAP>* omap_to,
                           std::vector<OMAP>* omap_from) {
@@ -97,6 +128,7 @@ bool ReadOmapsFromPdbFile(const base::FilePath& pdb_path,
                           std::vector<OMAP>* omap_to,
                           std::vector<OMAP>* omap_from) {
   PdbReader pdb_reader;
+  pdb_reader.set_memory_mapped(true);
   PdbFile pdb_file;
   if (!pdb_reader.Read(pdb_path, &pdb_file))
     return false;
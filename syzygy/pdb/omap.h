@@ -53,6 +53,18 @@ bool OmapVectorIsValid(const std::vector<OMAP>& omaps);
 core::RelativeAddress TranslateAddressViaOmap(const std::vector<OMAP>& omaps,
                                               core::RelativeAddress address);
 
+// Maps a batch of addresses through the given OMAP information. The addresses
+// are visited in increasing order, so that the OMAP vector is swept once
+// rather than searched for each address. This is preferable to repeated calls
+// to TranslateAddressViaOmap when there are many addresses to map.
+//
+// @param omaps the vector of OMAPs to apply.
+// @param addresses the addresses to map. They are replaced in place by the
+//     mapped addresses, and need not be sorted.
+// @pre OmapIsValid(omaps) is true.
+void TranslateAddressesViaOmap(const std::vector<OMAP>& omaps,
+                               std::vector<core::RelativeAddress>* addresses);
+
 // Reads OMAP tables from a PdbFile. The destination vectors may be NULL if
 // they are not required to be read. Even if neither stream is read they will be
 // checked for existence.
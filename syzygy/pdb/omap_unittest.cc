@@ -15,6 +15,7 @@
 #include "syzygy/pdb/omap.h"
 
 #include "base/path_service.h"
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pdb/unittest_util.h"
@@ -82,6 +83,39 @@ TEST(OmapTest, Translate) {
             TranslateAddressViaOmap(omaps, RelativeAddress(3500)));
 }
 
+TEST(OmapTest, TranslateBatch) {
+  std::vector<OMAP> omaps;
+  omaps.push_back(CreateOmap(1000, 2000));
+  omaps.push_back(CreateOmap(2000, 1000));
+  omaps.push_back(CreateOmap(3000, 3000));
+  ASSERT_TRUE(OmapVectorIsValid(omaps));
+
+  // Unsorted addresses, with duplicates and region boundaries.
+  std::vector<RelativeAddress> addresses;
+  addresses.push_back(RelativeAddress(3500));
+  addresses.push_back(RelativeAddress(1500));
+  addresses.push_back(RelativeAddress(500));
+  addresses.push_back(RelativeAddress(2000));
+  addresses.push_back(RelativeAddress(1500));
+  addresses.push_back(RelativeAddress(999));
+  addresses.push_back(RelativeAddress(1000));
+  addresses.push_back(RelativeAddress(2999));
+
+  // The result should be the same as translating one address at a time.
+  std::vector<RelativeAddress> expected_addresses;
+  for (size_t i = 0; i < addresses.size(); ++i)
+    expected_addresses.push_back(TranslateAddressViaOmap(omaps, addresses[i]));
+
+  TranslateAddressesViaOmap(omaps, &addresses);
+  EXPECT_THAT(addresses, testing::ContainerEq(expected_addresses));
+
+  // An empty OMAP vector leaves the addresses unchanged.
+  std::vector<OMAP> no_omaps;
+  std::vector<RelativeAddress> unchanged_addresses(expected_addresses);
+  TranslateAddressesViaOmap(no_omaps, &unchanged_addresses);
+  EXPECT_THAT(unchanged_addresses, testing::ContainerEq(expected_addresses));
+}
+
 TEST(OmapTest, ReadOmapsFromPdbFile) {
   std::vector<OMAP> omap_to, omap_from;
 
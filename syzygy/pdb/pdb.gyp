@@ -38,6 +38,8 @@
         'pdb_file.h',
         'pdb_file_stream.cc',
         'pdb_file_stream.h',
+        'pdb_mapped_file_stream.cc',
+        'pdb_mapped_file_stream.h',
         'pdb_mutator.cc',
         'pdb_mutator.h',
         'pdb_reader.cc',
@@ -81,6 +83,7 @@
         'pdb_dbi_stream_unittest.cc',
         'pdb_file_stream_unittest.cc',
         'pdb_file_unittest.cc',
+        'pdb_mapped_file_stream_unittest.cc',
         'pdb_mutator_unittest.cc',
         'pdb_reader_unittest.cc',
         'pdb_stream_unittest.cc',
@@ -91,8 +91,14 @@ const uint32 kSyzygyHistoryStreamVersion = 0;
 extern const char kSyzygyBlockGraphStreamName[];
 
 // The version of the Syzygy BlockGraph data stream. This needs to be
-// incremented whenever the format of the stream has changed.
-const uint32 kSyzygyBlockGraphStreamVersion = 1;
+// incremented whenever the format of the stream has changed. Version 2
+// compresses the stream with core::ParallelZOutStream rather than with a
+// single zlib stream.
+const uint32 kSyzygyBlockGraphStreamVersion = 2;
+
+// The previous version of the Syzygy BlockGraph data stream, which is still
+// supported for reading.
+const uint32 kSyzygyBlockGraphStreamVersion1 = 1;
 
 }  // namespace pdb
 
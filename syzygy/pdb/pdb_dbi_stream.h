@@ -125,6 +125,9 @@ class DbiStream {
   const DbiDbgHeader& dbg_header() const { return dbg_header_; }
   const DbiHeader& header() const { return header_; }
   const DbiModuleVector& modules() const { return modules_; }
+  const DbiSectionContribVector& section_contribs() const {
+    return section_contribs_;
+  }
   // @}
 
   // Reads the Dbi stream of a PDB.
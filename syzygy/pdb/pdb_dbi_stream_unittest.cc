@@ -29,6 +29,8 @@ TEST(PdbDbiStreamTest, ReadValidDbiStream) {
       testing::GetStreamFromFile(valid_dbi_path);
   DbiStream dbi_stream;
   EXPECT_TRUE(dbi_stream.Read(valid_dbi_stream.get()));
+  EXPECT_FALSE(dbi_stream.modules().empty());
+  EXPECT_FALSE(dbi_stream.section_contribs().empty());
 }
 
 TEST(PdbDbiStreamTest, ReadInvalidDbiStream) {
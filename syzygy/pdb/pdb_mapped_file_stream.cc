@@ -0,0 +1,166 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/pdb/pdb_mapped_file_stream.h"
+
+#include <windows.h>
+#include <algorithm>
+
+#include "base/logging.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/com_utils.h"
+
+namespace pdb {
+
+bool RefCountedMappedFile::Init(const base::FilePath& path) {
+  DCHECK(data_ == NULL);
+
+  base::win::ScopedHandle file(
+      ::CreateFile(path.value().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                   NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Unable to open '" << path.value() << "'.";
+    return false;
+  }
+
+  LARGE_INTEGER file_size = {};
+  if (!::GetFileSizeEx(file.Get(), &file_size) ||
+      file_size.HighPart != 0 || file_size.LowPart == 0) {
+    LOG(ERROR) << "Unable to map file of unsupported size: '"
+               << path.value() << "'.";
+    return false;
+  }
+
+  // The view keeps the mapping alive once the handles are closed.
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(file.Get(), NULL, PAGE_READONLY, 0, 0, NULL));
+  if (!mapping.IsValid()) {
+    LOG(ERROR) << "Failed to create file mapping for '" << path.value()
+               << "': " << common::LogWe() << ".";
+    return false;
+  }
+
+  data_ = reinterpret_cast<const uint8*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_READ, 0, 0, 0));
+  if (data_ == NULL) {
+    LOG(ERROR) << "Failed to map view of '" << path.value() << "': "
+               << common::LogWe() << ".";
+    return false;
+  }
+  size_ = file_size.LowPart;
+
+  return true;
+}
+
+RefCountedMappedFile::~RefCountedMappedFile() {
+  if (data_ != NULL)
+    ::UnmapViewOfFile(data_);
+}
+
+PdbMappedFileStream::PdbMappedFileStream(RefCountedMappedFile* file,
+                                         size_t length,
+                                         const uint32* pages,
+                                         size_t page_size)
+    : PdbStream(length),
+      file_(file),
+      page_size_(page_size) {
+  DCHECK(file != NULL);
+  size_t num_pages = (length + page_size - 1) / page_size;
+  pages_.assign(pages, pages + num_pages);
+}
+
+PdbMappedFileStream::~PdbMappedFileStream() {
+}
+
+bool PdbMappedFileStream::ReadBytes(void* dest,
+                                    size_t count,
+                                    size_t* bytes_read) {
+  DCHECK(dest != NULL);
+  DCHECK(bytes_read != NULL);
+
+  // Return 0 once we've reached the end of the stream.
+  if (pos() == length()) {
+    *bytes_read = 0;
+    return true;
+  }
+
+  // Don't read beyond the end of the known stream length.
+  count = std::min(count, length() - pos());
+  *bytes_read = count;
+
+  // Read the stream, straight from the pages of the mapping.
+  while (count > 0) {
+    size_t page_index = pos() / page_size_;
+    size_t offset = pos() % page_size_;
+    size_t chunk_size = std::min(count, page_size_ - offset);
+    const uint8* page = GetPage(pages_[page_index]);
+    if (page == NULL ||
+        page + offset + chunk_size > file_->data() + file_->size()) {
+      LOG(ERROR) << "Page read failed";
+      return false;
+    }
+
+    ::memcpy(dest, page + offset, chunk_size);
+
+    count -= chunk_size;
+    Seek(pos() + chunk_size);
+    dest = reinterpret_cast<uint8*>(dest) + chunk_size;
+  }
+
+  return true;
+}
+
+bool PdbMappedFileStream::GetContiguousData(size_t offset,
+                                            const uint8** data,
+                                            size_t* length) const {
+  DCHECK(data != NULL);
+  DCHECK(length != NULL);
+
+  if (offset >= this->length())
+    return false;
+
+  size_t page_index = offset / page_size_;
+  const uint8* page = GetPage(pages_[page_index]);
+  if (page == NULL)
+    return false;
+
+  // Extend the run for as long as the following pages are adjacent in the
+  // file.
+  size_t run_end = page_index + 1;
+  while (run_end < pages_.size() &&
+         pages_[run_end] == pages_[run_end - 1] + 1) {
+    ++run_end;
+  }
+
+  // The run can't extend beyond the end of the stream nor of the file.
+  const uint8* file_end = file_->data() + file_->size();
+  if (page + offset % page_size_ >= file_end)
+    return false;
+  *data = page + offset % page_size_;
+  size_t file_left = file_end - *data;
+  *length = std::min(run_end * page_size_, this->length()) - offset;
+  *length = std::min(*length, file_left);
+
+  return true;
+}
+
+const uint8* PdbMappedFileStream::GetPage(uint32 page) const {
+  size_t page_offset = page_size_ * page;
+  if (page_offset / page_size_ != page || page_offset >= file_->size())
+    return NULL;
+  return file_->data() + page_offset;
+}
+
+}  // namespace pdb
@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Declares PdbMappedFileStream, a PDB stream read from a memory mapping of
+// the PDB file.
+
+#ifndef SYZYGY_PDB_PDB_MAPPED_FILE_STREAM_H_
+#define SYZYGY_PDB_PDB_MAPPED_FILE_STREAM_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/pdb/pdb_stream.h"
+
+namespace pdb {
+
+// A reference counted read-only view of a whole file.
+class RefCountedMappedFile : public base::RefCounted<RefCountedMappedFile> {
+ public:
+  RefCountedMappedFile() : data_(NULL), size_(0) { }
+
+  // Maps the file at @p path into memory.
+  // @param path the path of the file to map.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& path);
+
+  // @returns the mapped contents of the file, or NULL if it's not mapped.
+  const uint8* data() const { return data_; }
+
+  // @returns the size of the file, in bytes.
+  size_t size() const { return size_; }
+
+ private:
+  friend base::RefCounted<RefCountedMappedFile>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~RefCountedMappedFile();
+
+  const uint8* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefCountedMappedFile);
+};
+
+// This class represents a PDB stream in a memory mapped PDB file. Reading
+// copies directly from the pages of the mapping, and runs of consecutive pages
+// can be accessed in place.
+class PdbMappedFileStream : public PdbStream {
+ public:
+  // Constructor.
+  // @param file the mapped file housing this stream.
+  // @param length the length of this stream.
+  // @param pages the indices of the pages that make up this stream in the file.
+  //     A copy is made of the data so the pointer need not remain valid
+  //     beyond the constructor. The length of this array is implicit in the
+  //     stream length and the page size.
+  // @param page_size the size of the pages, in bytes.
+  PdbMappedFileStream(RefCountedMappedFile* file,
+                      size_t length,
+                      const uint32* pages,
+                      size_t page_size);
+
+  // PdbStream implementation.
+  bool ReadBytes(void* dest, size_t count, size_t* bytes_read);
+
+  // Gets the data at @p offset in the stream without copying it. The data
+  // extends up to the end of the run of consecutive pages that holds
+  // @p offset, or the end of the stream.
+  // @param offset the offset of the data in the stream.
+  // @param data receives a pointer to the data in the mapping. It remains
+  //     valid for the lifetime of the stream.
+  // @param length receives the length of the data, in bytes.
+  // @returns true on success, false if @p offset is out of bounds or lies
+  //     beyond the end of the file.
+  bool GetContiguousData(size_t offset,
+                         const uint8** data,
+                         size_t* length) const;
+
+ protected:
+  // Protected to enforce reference counted pointers at compile time.
+  virtual ~PdbMappedFileStream();
+
+  // @returns a pointer to @p page in the mapping, or NULL if it starts beyond
+  //     the end of the file.
+  const uint8* GetPage(uint32 page) const;
+
+ private:
+  // The mapped PDB file. This is reference counted so that streams can
+  // outlive the PdbReader that created them.
+  scoped_refptr<RefCountedMappedFile> file_;
+
+  // The list of pages in the PDB that make up this stream.
+  std::vector<uint32> pages_;
+
+  // The size of pages within the stream.
+  size_t page_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbMappedFileStream);
+};
+
+}  // namespace pdb
+
+#endif  // SYZYGY_PDB_PDB_MAPPED_FILE_STREAM_H_
@@ -0,0 +1,124 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "syzygy/pdb/pdb_mapped_file_stream.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_data.h"
+#include "syzygy/pdb/unittest_util.h"
+
+namespace pdb {
+
+namespace {
+
+class PdbMappedFileStreamTest : public testing::Test {
+ public:
+  virtual void SetUp() {
+    file_ = new RefCountedMappedFile();
+    ASSERT_TRUE(file_->Init(testing::GetSrcRelativePath(
+        testing::kTestPdbFilePath)));
+    ASSERT_TRUE(file_->data() != NULL);
+  }
+
+ protected:
+  scoped_refptr<RefCountedMappedFile> file_;
+};
+
+}  // namespace
+
+TEST_F(PdbMappedFileStreamTest, InitFailsOnNonexistentFile) {
+  scoped_refptr<RefCountedMappedFile> file(new RefCountedMappedFile());
+  EXPECT_FALSE(file->Init(testing::GetSrcRelativePath(
+      L"syzygy\\pdb\\test_data\\nonexistent.pdb")));
+  EXPECT_TRUE(file->data() == NULL);
+  EXPECT_EQ(0u, file->size());
+}
+
+TEST_F(PdbMappedFileStreamTest, Constructor) {
+  uint32 pages[] = {1, 2, 3};
+  scoped_refptr<PdbMappedFileStream> stream(
+      new PdbMappedFileStream(file_, 10, pages, 8));
+  EXPECT_EQ(10, stream->length());
+}
+
+TEST_F(PdbMappedFileStreamTest, ReadBytes) {
+  // Different sections of the pdb header magic string.
+  char* test_cases[] = {
+    "Mic",
+    "roso",
+    "ft",
+    " C/C+",
+    "+ MS",
+    "F 7.00"
+  };
+
+  // Test that we can read varying sizes of bytes from the header of the
+  // file with varying page sizes.
+  char buffer[8] = {0};
+  for (size_t page_size = 4; page_size <= 32; page_size *= 2) {
+    uint32 pages[] = {0, 1, 2, 3, 4, 5, 6, 7};
+    scoped_refptr<PdbMappedFileStream> stream(new PdbMappedFileStream(
+        file_.get(), sizeof(PdbHeader), pages, page_size));
+
+    for (uint32 j = 0; j < arraysize(test_cases); ++j) {
+      char* test_case = test_cases[j];
+      size_t len = strlen(test_case);
+      size_t bytes_read = 0;
+      EXPECT_TRUE(stream->ReadBytes(&buffer, len, &bytes_read));
+      EXPECT_EQ(0, memcmp(buffer, test_case, len));
+      EXPECT_EQ(len, bytes_read);
+    }
+  }
+}
+
+TEST_F(PdbMappedFileStreamTest, ReadBytesAcrossNonContiguousPages) {
+  // Read the magic string from pages out of order.
+  uint32 pages[] = {1, 0, 2};
+  scoped_refptr<PdbMappedFileStream> stream(new PdbMappedFileStream(
+      file_.get(), 12, pages, 4));
+
+  char buffer[12] = {0};
+  size_t bytes_read = 0;
+  EXPECT_TRUE(stream->ReadBytes(buffer, sizeof(buffer), &bytes_read));
+  EXPECT_EQ(sizeof(buffer), bytes_read);
+  EXPECT_EQ(0, memcmp(buffer, "osofMicrt C/", 12));
+}
+
+TEST_F(PdbMappedFileStreamTest, GetContiguousData) {
+  // Pages 2, 3 and 4 form a run, as do pages 7 and 8.
+  uint32 pages[] = {2, 3, 4, 7, 8};
+  scoped_refptr<PdbMappedFileStream> stream(new PdbMappedFileStream(
+      file_.get(), 18, pages, 4));
+
+  const uint8* data = NULL;
+  size_t length = 0;
+  EXPECT_TRUE(stream->GetContiguousData(0, &data, &length));
+  EXPECT_EQ(file_->data() + 8, data);
+  EXPECT_EQ(12u, length);
+
+  EXPECT_TRUE(stream->GetContiguousData(5, &data, &length));
+  EXPECT_EQ(file_->data() + 13, data);
+  EXPECT_EQ(7u, length);
+
+  // The last run is cut short by the end of the stream.
+  EXPECT_TRUE(stream->GetContiguousData(12, &data, &length));
+  EXPECT_EQ(file_->data() + 28, data);
+  EXPECT_EQ(6u, length);
+
+  EXPECT_FALSE(stream->GetContiguousData(18, &data, &length));
+}
+
+}  // namespace pdb
@@ -17,6 +17,7 @@
 #include "base/logging.h"
 #include "base/strings/string_util.h"
 #include "syzygy/pdb/pdb_file_stream.h"
+#include "syzygy/pdb/pdb_mapped_file_stream.h"
 
 namespace pdb {
 
@@ -46,25 +47,58 @@ uint32 GetNumPages(const PdbHeader& header, uint32 num_bytes) {
   return (num_bytes + header.page_size - 1) / header.page_size;
 }
 
+// Creates a stream over the mapped file if there is one, over the FILE
+// otherwise.
+PdbStream* CreateStream(RefCountedMappedFile* mapped_file,
+                        RefCountedFILE* file,
+                        size_t length,
+                        const uint32* pages,
+                        size_t page_size) {
+  if (mapped_file != NULL)
+    return new PdbMappedFileStream(mapped_file, length, pages, page_size);
+  return new PdbFileStream(file, length, pages, page_size);
+}
+
 }  // namespace
 
 bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
+  return Read(pdb_path, pdb_file, NULL);
+}
+
+bool PdbReader::Read(const base::FilePath& pdb_path,
+                     PdbFile* pdb_file,
+                     PdbStreamLayout* layout) {
   DCHECK(pdb_file != NULL);
 
   pdb_file->Clear();
 
-  scoped_refptr<RefCountedFILE> file(new RefCountedFILE(
-      base::OpenFile(pdb_path, "rb")));
-  if (!file->file()) {
-    LOG(ERROR) << "Unable to open '" << pdb_path.value() << "'.";
-    return false;
+  scoped_refptr<RefCountedMappedFile> mapped_file;
+  if (memory_mapped_) {
+    mapped_file = new RefCountedMappedFile();
+    if (!mapped_file->Init(pdb_path)) {
+      LOG(WARNING) << "Unable to map '" << pdb_path.value() << "', reading "
+                   << "it instead.";
+      mapped_file = NULL;
+    }
   }
 
-  // Get the file size.
+  scoped_refptr<RefCountedFILE> file;
   uint32 file_size = 0;
-  if (!GetFileSize(file->file(), &file_size)) {
-    LOG(ERROR) << "Unable to determine size of '" << pdb_path.value() << "'.";
-    return false;
+  if (mapped_file.get() != NULL) {
+    file_size = mapped_file->size();
+  } else {
+    file = new RefCountedFILE(base::OpenFile(pdb_path, "rb"));
+    if (!file->file()) {
+      LOG(ERROR) << "Unable to open '" << pdb_path.value() << "'.";
+      return false;
+    }
+
+    // Get the file size.
+    if (!GetFileSize(file->file(), &file_size)) {
+      LOG(ERROR) << "Unable to determine size of '" << pdb_path.value()
+                 << "'.";
+      return false;
+    }
   }
 
   PdbHeader header = { 0 };
@@ -73,8 +107,9 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   // is irrelevant as after reading the header we get the actual page size in
   // use by the PDB and from then on use that.
   uint32 header_page = 0;
-  scoped_refptr<PdbFileStream> header_stream(new PdbFileStream(
-      file, sizeof(header), &header_page, kPdbPageSize));
+  scoped_refptr<PdbStream> header_stream(CreateStream(
+      mapped_file.get(), file.get(), sizeof(header), &header_page,
+      kPdbPageSize));
   if (!header_stream->Read(&header, 1)) {
     LOG(ERROR) << "Failed to read PDB file header.";
     return false;
@@ -98,8 +133,8 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   // containing that many page pointers from the root pages array.
   int num_dir_pages = static_cast<int>(GetNumPages(header,
                                                    header.directory_size));
-  scoped_refptr<PdbFileStream> dir_page_stream(new PdbFileStream(
-      file, num_dir_pages * sizeof(uint32),
+  scoped_refptr<PdbStream> dir_page_stream(CreateStream(
+      mapped_file.get(), file.get(), num_dir_pages * sizeof(uint32),
       header.root_pages, header.page_size));
   scoped_ptr<uint32[]> dir_pages(new uint32[num_dir_pages]);
   if (dir_pages.get() == NULL) {
@@ -113,8 +148,9 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
 
   // Load the actual directory.
   int dir_size = static_cast<int>(header.directory_size / sizeof(uint32));
-  scoped_refptr<PdbFileStream> dir_stream(new PdbFileStream(
-      file, header.directory_size, dir_pages.get(), header.page_size));
+  scoped_refptr<PdbStream> dir_stream(CreateStream(
+      mapped_file.get(), file.get(), header.directory_size, dir_pages.get(),
+      header.page_size));
   std::vector<uint32> directory(dir_size);
   if (!dir_stream->Read(&directory[0], dir_size)) {
     LOG(ERROR) << "Failed to read directory stream.";
@@ -126,13 +162,25 @@ bool PdbReader::Read(const base::FilePath& pdb_path, PdbFile* pdb_file) {
   const uint32* stream_lengths = &(directory[1]);
   const uint32* stream_pages = &(directory[1 + num_streams]);
 
+  if (layout != NULL) {
+    layout->page_size = header.page_size;
+    layout->stream_pages.clear();
+    layout->stream_pages.resize(num_streams);
+  }
+
   uint32 page_index = 0;
   for (uint32 stream_index = 0; stream_index < num_streams; ++stream_index) {
-    pdb_file->AppendStream(new PdbFileStream(file,
-                                             stream_lengths[stream_index],
-                                             stream_pages + page_index,
-                                             header.page_size));
-    page_index += GetNumPages(header, stream_lengths[stream_index]);
+    pdb_file->AppendStream(CreateStream(mapped_file.get(),
+                                        file.get(),
+                                        stream_lengths[stream_index],
+                                        stream_pages + page_index,
+                                        header.page_size));
+    uint32 num_pages = GetNumPages(header, stream_lengths[stream_index]);
+    if (layout != NULL) {
+      layout->stream_pages[stream_index].assign(
+          stream_pages + page_index, stream_pages + page_index + num_pages);
+    }
+    page_index += num_pages;
   }
 
   return true;
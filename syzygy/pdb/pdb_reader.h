@@ -23,15 +23,40 @@
 #include "syzygy/pdb/pdb_data.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_file_stream.h"
+#include "syzygy/pdb/pdb_mapped_file_stream.h"
 #include "syzygy/pdb/pdb_stream.h"
 
 namespace pdb {
 
+// Describes where the streams of a PDB file live within the file itself. This
+// allows the streams to be patched in place.
+struct PdbStreamLayout {
+  PdbStreamLayout() : page_size(0) { }
+
+  // The size of the pages of the PDB file, in bytes.
+  size_t page_size;
+
+  // For each stream, the indices of the pages that house it, in order.
+  std::vector<std::vector<uint32> > stream_pages;
+};
+
 // This class is used to read a PDB file from disk, populating a PdbFile
 // object with its streams.
 class PdbReader {
  public:
-  PdbReader() { }
+  PdbReader() : memory_mapped_(false) { }
+
+  // Sets whether the PDB file is mapped into memory, rather than read through
+  // a FILE. The streams of a mapped PDB file are PdbMappedFileStreams, whose
+  // reads are copies from the mapping. If mapping fails, Read falls back to
+  // reading through a FILE. Defaults to false.
+  // @param memory_mapped true to map the file into memory.
+  void set_memory_mapped(bool memory_mapped) {
+    memory_mapped_ = memory_mapped;
+  }
+
+  // @returns true iff the PDB file is mapped into memory by Read.
+  bool memory_mapped() const { return memory_mapped_; }
 
   // Reads a PDB, populating the given PdbFile object with the streams.
   //
@@ -43,7 +68,20 @@ class PdbReader {
   // @returns true on success, false otherwise.
   bool Read(const base::FilePath& pdb_path, PdbFile* pdb_file);
 
+  // Reads a PDB, populating the given PdbFile object with the streams and
+  // reporting the pages that house each of them.
+  // @param pdb_path the PDB file to read.
+  // @param pdb_file the empty PdbFile object to be filled in.
+  // @param layout will receive the page layout of the streams. May be NULL.
+  // @returns true on success, false otherwise.
+  bool Read(const base::FilePath& pdb_path,
+            PdbFile* pdb_file,
+            PdbStreamLayout* layout);
+
  private:
+  // Indicates whether the PDB file is mapped into memory.
+  bool memory_mapped_;
+
   DISALLOW_COPY_AND_ASSIGN(PdbReader);
 };
 
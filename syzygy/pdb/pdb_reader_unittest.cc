@@ -14,6 +14,9 @@
 
 #include "syzygy/pdb/pdb_reader.h"
 
+#include <algorithm>
+
+#include "base/file_util.h"
 #include "base/path_service.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -32,4 +35,75 @@ TEST(PdbReaderTest, Read) {
   EXPECT_EQ(pdb_file.StreamCount(), 168u);
 }
 
+TEST(PdbReaderTest, ReadMemoryMapped) {
+  base::FilePath test_dll_pdb =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  PdbReader reader;
+  EXPECT_FALSE(reader.memory_mapped());
+  reader.set_memory_mapped(true);
+  EXPECT_TRUE(reader.memory_mapped());
+
+  PdbFile mapped_pdb_file;
+  EXPECT_TRUE(reader.Read(test_dll_pdb, &mapped_pdb_file));
+
+  PdbReader file_reader;
+  PdbFile pdb_file;
+  EXPECT_TRUE(file_reader.Read(test_dll_pdb, &pdb_file));
+
+  // The streams should be identical to those read through a FILE.
+  ASSERT_EQ(pdb_file.StreamCount(), mapped_pdb_file.StreamCount());
+  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
+    PdbStream* stream = pdb_file.GetStream(i);
+    PdbStream* mapped_stream = mapped_pdb_file.GetStream(i);
+    ASSERT_TRUE(stream != NULL);
+    ASSERT_TRUE(mapped_stream != NULL);
+    ASSERT_EQ(stream->length(), mapped_stream->length());
+
+    std::vector<uint8> data;
+    std::vector<uint8> mapped_data;
+    ASSERT_TRUE(stream->Read(&data, stream->length()));
+    ASSERT_TRUE(mapped_stream->Read(&mapped_data, mapped_stream->length()));
+    EXPECT_TRUE(data == mapped_data);
+  }
+}
+
+TEST(PdbReaderTest, ReadLayout) {
+  base::FilePath test_dll_pdb =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  PdbReader reader;
+  PdbFile pdb_file;
+  PdbStreamLayout layout;
+  EXPECT_TRUE(reader.Read(test_dll_pdb, &pdb_file, &layout));
+  EXPECT_LT(0u, layout.page_size);
+  ASSERT_EQ(pdb_file.StreamCount(), layout.stream_pages.size());
+
+  base::ScopedFILE file(base::OpenFile(test_dll_pdb, "rb"));
+  ASSERT_TRUE(file.get() != NULL);
+
+  // Reading the pages named by the layout should yield the stream contents.
+  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
+    PdbStream* stream = pdb_file.GetStream(i);
+    ASSERT_TRUE(stream != NULL);
+    size_t length = stream->length();
+    ASSERT_EQ((length + layout.page_size - 1) / layout.page_size,
+              layout.stream_pages[i].size());
+
+    std::vector<uint8> data;
+    ASSERT_TRUE(stream->Read(&data, length));
+
+    std::vector<uint8> page_data(length);
+    for (size_t j = 0; j < layout.stream_pages[i].size(); ++j) {
+      size_t offset = j * layout.page_size;
+      size_t count = std::min(layout.page_size, length - offset);
+      ASSERT_EQ(0, ::fseek(file.get(),
+                           layout.stream_pages[i][j] * layout.page_size,
+                           SEEK_SET));
+      ASSERT_EQ(count, ::fread(&page_data[offset], 1, count, file.get()));
+    }
+    EXPECT_TRUE(data == page_data);
+  }
+}
+
 }  // namespace pdb
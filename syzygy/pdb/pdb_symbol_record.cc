@@ -14,10 +14,16 @@
 
 #include "syzygy/pdb/pdb_symbol_record.h"
 
+#include <algorithm>
 #include <string>
 
+#include "base/atomicops.h"
+#include "base/bind.h"
 #include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/common/align.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "third_party/cci/Files/CvInfo.h"
@@ -26,6 +32,92 @@ namespace cci = Microsoft_Cci_Pdb;
 
 namespace pdb {
 
+namespace {
+
+// The size of the length and type fields that precede the data of a record.
+const size_t kSymbolRecordHeaderSize = 2 * sizeof(uint16);
+
+bool SymbolRecordStartsBefore(const SymbolRecord& record, size_t position) {
+  return record.start_position < position;
+}
+
+// Visits the symbol streams in parallel. Each worker thread takes the next
+// stream that hasn't been visited yet, until they're all done.
+class SymbolStreamVisitor : public base::DelegateSimpleThread::Delegate {
+ public:
+  SymbolStreamVisitor(const VisitStreamSymbolsCallback& callback,
+                      const SymbolStreamVector& streams)
+      : callback_(callback), streams_(streams), next_stream_(0), failed_(0) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    while (base::subtle::NoBarrier_Load(&failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_stream_, 1));
+      if (index > streams_.size())
+        return;
+
+      if (!VisitStream(index - 1))
+        base::subtle::NoBarrier_Store(&failed_, 1);
+    }
+  }
+  // @}
+
+  // @returns true iff all the streams were visited successfully.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+ private:
+  bool VisitStream(size_t index) {
+    const SymbolStream& symbol_stream = streams_[index];
+    DCHECK(symbol_stream.stream != NULL);
+
+    if (symbol_stream.symbol_table_size > symbol_stream.stream->length()) {
+      LOG(ERROR) << "Symbol table size provided exceeds stream length.";
+      return false;
+    }
+
+    // Only the reads from the underlying stream are serialized.
+    std::vector<uint8> data(symbol_stream.symbol_table_size);
+    {
+      base::AutoLock auto_lock(lock_);
+      if (!symbol_stream.stream->Seek(0) ||
+          (!data.empty() && !symbol_stream.stream->Read(&data[0],
+                                                        data.size()))) {
+        LOG(ERROR) << "Unable to read symbol stream " << index << ".";
+        return false;
+      }
+    }
+
+    scoped_refptr<PdbByteStream> symbols(new PdbByteStream());
+    if (!data.empty() && !symbols->Init(&data[0], data.size()))
+      return false;
+
+    VisitSymbolsCallback callback = base::Bind(callback_, index);
+    return VisitSymbols(callback, symbols->length(), symbol_stream.has_header,
+                        symbols.get());
+  }
+
+  const VisitStreamSymbolsCallback& callback_;
+  const SymbolStreamVector& streams_;
+
+  // Serializes the reads from the streams.
+  base::Lock lock_;
+
+  // One past the index of the next entry of streams_ to visit.
+  base::subtle::Atomic32 next_stream_;
+
+  // Set to 1 as soon as a stream fails to be visited.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolStreamVisitor);
+};
+
+}  // namespace
+
 bool ReadSymbolRecord(PdbStream* stream,
                       size_t symbol_table_size,
                       SymbolRecordVector* symbol_vector) {
@@ -67,6 +159,17 @@ bool ReadSymbolRecord(PdbStream* stream,
   return true;
 }
 
+const SymbolRecord* FindSymbolRecord(const SymbolRecordVector& symbol_vector,
+                                     size_t offset) {
+  size_t start_position = offset + kSymbolRecordHeaderSize;
+  SymbolRecordVector::const_iterator it = std::lower_bound(
+      symbol_vector.begin(), symbol_vector.end(), start_position,
+      SymbolRecordStartsBefore);
+  if (it == symbol_vector.end() || it->start_position != start_position)
+    return NULL;
+  return &(*it);
+}
+
 // Reads symbols from the given symbol stream until the end of the stream.
 bool VisitSymbols(VisitSymbolsCallback callback,
                   size_t symbol_table_size,
@@ -144,4 +247,23 @@ bool VisitSymbols(VisitSymbolsCallback callback,
   return true;
 }
 
+bool VisitSymbolStreams(const VisitStreamSymbolsCallback& callback,
+                        const SymbolStreamVector& streams,
+                        size_t num_threads) {
+  DCHECK_LT(0u, num_threads);
+
+  SymbolStreamVisitor visitor(callback, streams);
+  num_threads = std::min(num_threads, streams.size());
+  if (num_threads <= 1) {
+    visitor.Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("VisitSymbolStreams", num_threads);
+    pool.Start();
+    pool.AddWork(&visitor, num_threads);
+    pool.JoinAll();
+  }
+
+  return visitor.succeeded();
+}
+
 }  // namespace pdb
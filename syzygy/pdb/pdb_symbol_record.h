@@ -38,6 +38,16 @@ bool ReadSymbolRecord(PdbStream* stream,
                       size_t symbol_table_size,
                       SymbolRecordVector* symbol_vector);
 
+// Finds a record of a symbol record table from its offset in the stream. The
+// records read by ReadSymbolRecord are sorted by position, so they serve as an
+// offset table and the stream needn't be rescanned for each lookup.
+// @param symbol_vector The symbol records, as read by ReadSymbolRecord.
+// @param offset The offset of the record in the stream, which is that of its
+//     length field. This is how the symbol hash tables refer to records.
+// @returns the record at @p offset, or NULL if no record starts there.
+const SymbolRecord* FindSymbolRecord(const SymbolRecordVector& symbol_vector,
+                                     size_t offset);
+
 // Defines a symbol visitor callback. This needs to return true on success
 // (indicating that the symbol visitor should continue), and false on failure
 // (indicating that it should terminate). The stream is positioned at the
@@ -63,6 +73,42 @@ bool VisitSymbols(VisitSymbolsCallback callback,
                   bool has_header,
                   PdbStream* symbols);
 
+// Describes a symbol stream to be visited by VisitSymbolStreams.
+struct SymbolStream {
+  // The stream containing the symbols, which start at its beginning.
+  PdbStream* stream;
+  // The size of the symbol record table.
+  size_t symbol_table_size;
+  // Whether the symbols are preceded by a symbol stream header.
+  bool has_header;
+};
+typedef std::vector<SymbolStream> SymbolStreamVector;
+
+// Defines the callback of VisitSymbolStreams. This is a VisitSymbolsCallback
+// that also receives the index of the stream being visited.
+typedef base::Callback<bool(size_t /* stream_index */,
+                            uint16 /* symbol_length */,
+                            uint16 /* symbol_type */,
+                            PdbStream* /* symbol_stream */)>
+    VisitStreamSymbolsCallback;
+
+// Visits the symbols of several symbol streams, such as the module streams of
+// a PDB, on up to @p num_threads worker threads. Each stream is visited by a
+// single thread, in order, but the streams are visited concurrently so the
+// callback must be thread safe. Keeping the results of each stream apart makes
+// them independent of the scheduling of the threads. The symbol tables are
+// read into memory one at a time, as the streams of a PDB file share the same
+// file handle, and the symbols are visited in those copies.
+// @param callback The callback to be invoked for each symbol.
+// @param streams The streams to visit.
+// @param num_threads The maximum number of worker threads to use. The streams
+//     are visited on the calling thread if this is 1.
+// @returns true on success, false if any stream couldn't be visited or if the
+//     callback returned false.
+bool VisitSymbolStreams(const VisitStreamSymbolsCallback& callback,
+                        const SymbolStreamVector& streams,
+                        size_t num_threads);
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_SYMBOL_RECORD_H_
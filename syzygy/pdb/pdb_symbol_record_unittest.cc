@@ -16,6 +16,7 @@
 
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/synchronization/lock.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -49,6 +50,35 @@ class MockVisitorImpl {
 };
 typedef testing::StrictMock<MockVisitorImpl> MockVisitor;
 
+// Counts the symbols of each stream, from any thread.
+class SymbolCounter {
+ public:
+  explicit SymbolCounter(size_t stream_count) : counts_(stream_count, 0) {
+  }
+
+  bool OnSymbol(size_t stream_index,
+                uint16 symbol_length,
+                uint16 symbol_type,
+                PdbStream* stream) {
+    base::AutoLock auto_lock(lock_);
+    ++counts_[stream_index];
+    return true;
+  }
+
+  const std::vector<size_t>& counts() const { return counts_; }
+
+ private:
+  base::Lock lock_;
+  std::vector<size_t> counts_;
+};
+
+bool FailOnSymbol(size_t stream_index,
+                  uint16 symbol_length,
+                  uint16 symbol_type,
+                  PdbStream* stream) {
+  return false;
+}
+
 }  // namespace
 
 TEST(PdbReadSymbolRecordTest, ReadValidSymRecordStream) {
@@ -211,4 +241,85 @@ TEST_F(PdbVisitSymbolsTest, AllSymbolsVisitedNoHeader) {
   EXPECT_TRUE(VisitSymbols(callback, reader->length(), false, reader));
 }
 
+TEST(PdbFindSymbolRecordTest, FindsRecordsByOffset) {
+  base::FilePath valid_sym_record_path = testing::GetSrcRelativePath(
+      testing::kValidPdbSymbolRecordStreamPath);
+
+  scoped_refptr<pdb::PdbFileStream> stream =
+      testing::GetStreamFromFile(valid_sym_record_path);
+  SymbolRecordVector symbol_vector;
+  ASSERT_TRUE(ReadSymbolRecord(stream.get(), stream->length(),
+                               &symbol_vector));
+  ASSERT_FALSE(symbol_vector.empty());
+
+  // Each record is preceded by its length and type.
+  for (size_t i = 0; i < symbol_vector.size(); ++i) {
+    size_t offset = symbol_vector[i].start_position - 2 * sizeof(uint16);
+    EXPECT_EQ(&symbol_vector[i], FindSymbolRecord(symbol_vector, offset));
+  }
+
+  // Offsets that aren't those of a record aren't found.
+  EXPECT_TRUE(FindSymbolRecord(symbol_vector, 1) == NULL);
+  EXPECT_TRUE(FindSymbolRecord(symbol_vector, stream->length()) == NULL);
+  EXPECT_TRUE(FindSymbolRecord(SymbolRecordVector(), 0) == NULL);
+}
+
+TEST(PdbVisitSymbolStreamsTest, VisitsAllStreams) {
+  base::FilePath valid_sym_record_path = testing::GetSrcRelativePath(
+      testing::kValidPdbSymbolRecordStreamPath);
+
+  // Visit the sample symbol stream several times over, along with an empty
+  // stream.
+  scoped_refptr<PdbStream> stream =
+      testing::GetStreamFromFile(valid_sym_record_path);
+  scoped_refptr<PdbStream> empty_stream(new PdbByteStream());
+  SymbolStreamVector streams;
+  for (size_t i = 0; i < 8; ++i) {
+    SymbolStream symbol_stream = { stream.get(), stream->length(), false };
+    streams.push_back(symbol_stream);
+  }
+  SymbolStream empty_symbol_stream = { empty_stream.get(), 0, false };
+  streams.push_back(empty_symbol_stream);
+
+  const size_t kNumThreads[] = { 1, 4 };
+  for (size_t i = 0; i < arraysize(kNumThreads); ++i) {
+    SymbolCounter counter(streams.size());
+    VisitStreamSymbolsCallback callback = base::Bind(
+        &SymbolCounter::OnSymbol, base::Unretained(&counter));
+    EXPECT_TRUE(VisitSymbolStreams(callback, streams, kNumThreads[i]));
+
+    // There are 697 symbols in the sample symbol stream in test_data.
+    for (size_t j = 0; j + 1 < streams.size(); ++j)
+      EXPECT_EQ(697u, counter.counts()[j]);
+    EXPECT_EQ(0u, counter.counts().back());
+  }
+}
+
+TEST(PdbVisitSymbolStreamsTest, Fails) {
+  base::FilePath valid_sym_record_path = testing::GetSrcRelativePath(
+      testing::kValidPdbSymbolRecordStreamPath);
+
+  scoped_refptr<PdbStream> stream =
+      testing::GetStreamFromFile(valid_sym_record_path);
+  SymbolStreamVector streams;
+  SymbolStream symbol_stream = { stream.get(), stream->length(), false };
+  streams.push_back(symbol_stream);
+  streams.push_back(symbol_stream);
+
+  // The callback fails.
+  EXPECT_FALSE(VisitSymbolStreams(base::Bind(&FailOnSymbol), streams, 2));
+
+  // The symbol table of a stream is larger than the stream.
+  SymbolCounter counter(streams.size());
+  VisitStreamSymbolsCallback callback = base::Bind(
+      &SymbolCounter::OnSymbol, base::Unretained(&counter));
+  streams[1].symbol_table_size = stream->length() + 1;
+  EXPECT_FALSE(VisitSymbolStreams(callback, streams, 2));
+
+  // The stream doesn't have the expected header.
+  streams[1].symbol_table_size = stream->length();
+  streams[1].has_header = true;
+  EXPECT_FALSE(VisitSymbolStreams(callback, streams, 2));
+}
+
 }  // namespace pdb
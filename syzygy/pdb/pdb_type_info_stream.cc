@@ -28,32 +28,60 @@ bool ReadTypeInfoStream(PdbStream* stream,
   DCHECK(type_info_header != NULL);
   DCHECK(type_info_record_map != NULL);
 
+  TypeInfoIndex index;
+  if (!index.Init(stream))
+    return false;
+
+  *type_info_header = index.header();
+
+  // The records are in increasing type ID order, so each insertion is at the
+  // end of the map.
+  uint32 type_id = type_info_header->type_min;
+  TypeInfoRecord type_record = {};
+  while (index.Find(type_id, &type_record)) {
+    type_info_record_map->insert(type_info_record_map->end(),
+                                 std::make_pair(type_id, type_record));
+    ++type_id;
+  }
+
+  return true;
+}
+
+TypeInfoIndex::TypeInfoIndex() {
+  ::memset(&header_, 0, sizeof(header_));
+}
+
+bool TypeInfoIndex::Init(PdbStream* stream) {
+  DCHECK(stream != NULL);
+
+  records_.clear();
+
   // Reads the header of the stream.
-  if (!stream->Seek(0) || !stream->Read(type_info_header, 1)) {
+  if (!stream->Seek(0) || !stream->Read(&header_, 1)) {
     LOG(ERROR) << "Unable to read the type info stream header.";
     return false;
   }
 
-  if (stream->pos() != type_info_header->len) {
+  if (stream->pos() != header_.len) {
     LOG(ERROR) << "Unexpected length for the type info stream header (expected "
-               << type_info_header->len << ", read " << stream->pos() << ").";
+               << header_.len << ", read " << stream->pos() << ").";
     return false;
   }
 
-  size_t type_info_data_end =
-      type_info_header->len + type_info_header->type_info_data_size;
+  size_t type_info_data_end = header_.len + header_.type_info_data_size;
 
   if (type_info_data_end != stream->length()) {
     LOG(ERROR) << "The type info stream is not valid.";
     return false;
   }
 
+  if (header_.type_max > header_.type_min)
+    records_.reserve(header_.type_max - header_.type_min);
+
   // The type ID of each entry is not present in the stream, instead of that we
   // know the first and the last type ID and we know that the type records are
-  // ordered in increasing order in the stream.
-  uint32 current_type_id = type_info_header->type_min;
-  // Process each type record present in the stream. For now we only save their
-  // starting positions, their lengths and their types to be able to dump them.
+  // ordered in increasing order in the stream. For now we only save their
+  // starting positions, their lengths and their types.
   while (stream->pos() < type_info_data_end) {
     uint16 len = 0;
     uint16 record_type = 0;
@@ -71,22 +99,34 @@ bool ReadTypeInfoStream(PdbStream* stream,
     type_record.start_position = stream->pos();
     type_record.len = len - sizeof(record_type);
 
-    type_info_record_map->insert(std::make_pair(current_type_id, type_record));
+    records_.push_back(type_record);
     if (!stream->Seek(symbol_start + len)) {
       LOG(ERROR) << "Unable to seek to the end of the type info record.";
       return false;
     }
-    current_type_id++;
   }
 
-  if (current_type_id != type_info_header->type_max) {
+  uint32 current_type_id = header_.type_min + records_.size();
+  if (current_type_id != header_.type_max) {
     LOG(ERROR) << "Unexpected number of type info records in the type info "
-               << "stream (expected " << type_info_header->type_max
-               - type_info_header->type_min << ", read " << current_type_id
-               - type_info_header->type_min << ").";
+               << "stream (expected " << header_.type_max - header_.type_min
+               << ", read " << records_.size() << ").";
   }
 
   return true;
 }
 
+bool TypeInfoIndex::Find(uint32 type_id, TypeInfoRecord* type_record) const {
+  DCHECK(type_record != NULL);
+
+  if (type_id < header_.type_min)
+    return false;
+  size_t index = type_id - header_.type_min;
+  if (index >= records_.size())
+    return false;
+
+  *type_record = records_[index];
+  return true;
+}
+
 }  // namespace pdb
@@ -33,6 +33,42 @@ bool ReadTypeInfoStream(PdbStream* stream,
                         TypeInfoHeader* type_info_header,
                         TypeInfoRecordMap* type_info_record_map);
 
+// An index of the records of a type info stream, for constant time lookup of
+// a type record by type ID. As type IDs are consecutive, the records are
+// simply stored in type ID order.
+class TypeInfoIndex {
+ public:
+  TypeInfoIndex();
+
+  // Builds the index of the records of @p stream. This walks the stream once,
+  // reading only the header of each record.
+  // @param stream the type info stream to index.
+  // @returns true on success, false otherwise.
+  bool Init(PdbStream* stream);
+
+  // Finds the record of a type.
+  // @param type_id the ID of the type to find.
+  // @param type_record receives the record of the type.
+  // @returns true if the type is in the stream, false otherwise.
+  bool Find(uint32 type_id, TypeInfoRecord* type_record) const;
+
+  // @returns the header of the indexed stream.
+  const TypeInfoHeader& header() const { return header_; }
+
+  // @returns the number of records in the index.
+  size_t size() const { return records_.size(); }
+
+ private:
+  // The header of the indexed stream.
+  TypeInfoHeader header_;
+
+  // The records of the stream. The record of type ID header_.type_min + i is
+  // at position i.
+  std::vector<TypeInfoRecord> records_;
+
+  DISALLOW_COPY_AND_ASSIGN(TypeInfoIndex);
+};
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_TYPE_INFO_STREAM_H_
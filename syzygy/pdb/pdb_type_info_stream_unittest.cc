@@ -34,6 +34,39 @@ TEST(PdbTypeInfoStreamTest, ReadValidTypeInfoStream) {
                                  &types_map));
 }
 
+TEST(PdbTypeInfoStreamTest, TypeInfoIndex) {
+  base::FilePath valid_type_info_path = testing::GetSrcRelativePath(
+      testing::kValidPdbTypeInfoStreamPath);
+
+  scoped_refptr<pdb::PdbFileStream> valid_type_info_stream =
+      testing::GetStreamFromFile(valid_type_info_path);
+  TypeInfoHeader header;
+  TypeInfoRecordMap types_map;
+  ASSERT_TRUE(ReadTypeInfoStream(valid_type_info_stream.get(),
+                                 &header,
+                                 &types_map));
+
+  TypeInfoIndex index;
+  ASSERT_TRUE(index.Init(valid_type_info_stream.get()));
+  EXPECT_EQ(0, ::memcmp(&header, &index.header(), sizeof(header)));
+  EXPECT_EQ(types_map.size(), index.size());
+  EXPECT_EQ(header.type_max - header.type_min, index.size());
+
+  // Every record should be found, with the same contents as in the map.
+  TypeInfoRecordMap::const_iterator it = types_map.begin();
+  for (; it != types_map.end(); ++it) {
+    TypeInfoRecord type_record = {};
+    ASSERT_TRUE(index.Find(it->first, &type_record));
+    EXPECT_EQ(it->second.start_position, type_record.start_position);
+    EXPECT_EQ(it->second.len, type_record.len);
+    EXPECT_EQ(it->second.type, type_record.type);
+  }
+
+  TypeInfoRecord type_record = {};
+  EXPECT_FALSE(index.Find(header.type_min - 1, &type_record));
+  EXPECT_FALSE(index.Find(header.type_max, &type_record));
+}
+
 TEST(PdbTypeInfoStreamTest, ReadInvalidDataTypeInfoStream) {
   base::FilePath invalid_type_info_path = testing::GetSrcRelativePath(
       testing::kInvalidDataPdbTypeInfoStreamPath);
@@ -412,6 +412,7 @@ bool ReadPdbHeader(const base::FilePath& pdb_path,
   DCHECK(pdb_header != NULL);
 
   PdbReader pdb_reader;
+  pdb_reader.set_memory_mapped(true);
   PdbFile pdb_file;
   if (!pdb_reader.Read(pdb_path, &pdb_file)) {
     LOG(ERROR) << "Unable to process PDB file: " << pdb_path.value();
@@ -14,7 +14,10 @@
 
 #include "syzygy/pdb/pdb_writer.h"
 
+#include <algorithm>
+
 #include "base/logging.h"
+#include "base/md5.h"
 #include "syzygy/pdb/pdb_constants.h"
 #include "syzygy/pdb/pdb_data.h"
 
@@ -211,70 +214,179 @@ bool WriteFreePageBitMap(const FreePageBitMap& free, FILE* file) {
 
 }  // namespace
 
-PdbWriter::PdbWriter() {
+PdbWriter::PdbWriter()
+    : page_count_(0),
+      stream_open_(false),
+      stream_length_(0),
+      deduplicate_pages_(false),
+      deduplicating_(false),
+      deduplicated_page_count_(0) {
 }
 
 PdbWriter::~PdbWriter() {
 }
 
 bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
+  if (!Start(pdb_path))
+    return false;
+
+  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
+    if (!WriteStream(pdb_file.GetStream(i)))
+      return false;
+  }
+
+  return Finish();
+}
+
+bool PdbWriter::Start(const base::FilePath& pdb_path) {
+  stream_lengths_.clear();
+  stream_pages_.clear();
+  stream_open_ = false;
+  stream_length_ = 0;
+  stream_buffer_.clear();
+  deduplicating_ = false;
+  page_digests_.clear();
+  deduplicated_page_count_ = 0;
+
   file_.reset(base::OpenFile(pdb_path, "wb"));
   if (!file_.get()) {
     LOG(ERROR) << "Failed to create '" << pdb_path.value() << "'.";
     return false;
   }
 
-  // Initialize the directory with stream count and lengths.
-  std::vector<uint32> directory;
-  directory.push_back(pdb_file.StreamCount());
-  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
-    // Null streams have an implicit zero length.
-    PdbStream* stream = pdb_file.GetStream(i);
-    if (stream == NULL)
-      directory.push_back(0);
-    else
-      directory.push_back(stream->length());
-  }
-
   // Reserve space for the header page, the two free page map pages, and a
   // fourth empty page. The fourth empty page doesn't appear to be strictly
   // necessary but MSF/PDB files produced by MS tools always contain it.
-  uint32 page_count = 4;
-  for (uint32 i = 0; i < page_count; ++i) {
+  page_count_ = 4;
+  for (uint32 i = 0; i < page_count_; ++i) {
     if (::fwrite(kZeroBuffer, 1, kPdbPageSize, file_.get()) != kPdbPageSize) {
       LOG(ERROR) << "Failed to allocate preamble page.";
       return false;
     }
   }
 
-  // Append all the streams after the preamble and build the directory while
-  // we're at it. We keep track of which pages host stream 0 for some free page
-  // map bookkeeping later on.
-  size_t stream0_start = directory.size();
-  size_t stream0_end = 0;
-  for (size_t i = 0; i < pdb_file.StreamCount(); ++i) {
-    if (i == 1)
-      stream0_end = directory.size();
+  return true;
+}
+
+bool PdbWriter::WriteStream(PdbStream* stream) {
+  DCHECK(file_.get() != NULL);
+  DCHECK(!stream_open_);
+
+  // Null streams are treated as empty streams.
+  if (stream == NULL) {
+    stream_lengths_.push_back(0);
+    return true;
+  }
+
+  // Write the stream, updating the directory and page index. This routine
+  // takes care of making room for the free page map pages. Stream 0 ends up
+  // in free pages, so its pages can't be shared.
+  deduplicating_ = deduplicate_pages_ && !stream_lengths_.empty();
+  bool appended = AppendStream(stream, &stream_pages_, &page_count_);
+  deduplicating_ = false;
+  if (!appended) {
+    LOG(ERROR) << "Failed to write stream " << stream_lengths_.size() << ".";
+    return false;
+  }
+  stream_lengths_.push_back(stream->length());
 
-    // Null streams are treated as empty streams.
-    PdbStream* stream = pdb_file.GetStream(i);
-    if (stream == NULL || stream->length() == 0)
+  return true;
+}
+
+bool PdbWriter::BeginStream() {
+  DCHECK(file_.get() != NULL);
+  DCHECK(!stream_open_);
+
+  stream_open_ = true;
+  deduplicating_ = deduplicate_pages_ && !stream_lengths_.empty();
+  stream_length_ = 0;
+  stream_buffer_.clear();
+  stream_buffer_.reserve(kPdbPageSize);
+
+  return true;
+}
+
+bool PdbWriter::WriteStreamData(const void* data, size_t length) {
+  DCHECK(data != NULL || length == 0);
+  DCHECK(stream_open_);
+
+  const uint8* bytes = reinterpret_cast<const uint8*>(data);
+  stream_length_ += length;
+  while (length > 0) {
+    // Complete pages are written straight from the caller's buffer.
+    if (stream_buffer_.empty() && length >= kPdbPageSize) {
+      if (!AppendStreamPage(bytes, &stream_pages_, &page_count_))
+        return false;
+      bytes += kPdbPageSize;
+      length -= kPdbPageSize;
       continue;
+    }
+
+    size_t bytes_to_copy = std::min(
+        static_cast<size_t>(kPdbPageSize) - stream_buffer_.size(), length);
+    stream_buffer_.insert(stream_buffer_.end(), bytes, bytes + bytes_to_copy);
+    bytes += bytes_to_copy;
+    length -= bytes_to_copy;
+
+    if (stream_buffer_.size() == kPdbPageSize) {
+      if (!AppendStreamPage(stream_buffer_.data(), &stream_pages_,
+                            &page_count_)) {
+        return false;
+      }
+      stream_buffer_.clear();
+    }
+  }
+
+  return true;
+}
 
-    // Write the stream, updating the directory and page index. This routine
-    // takes care of making room for the free page map pages.
-    if (!AppendStream(stream, &directory, &page_count)) {
-      LOG(ERROR) << "Failed to write stream " << i << ".";
+bool PdbWriter::EndStream() {
+  DCHECK(stream_open_);
+
+  // Pad and flush the trailing partial page.
+  if (!stream_buffer_.empty()) {
+    stream_buffer_.resize(kPdbPageSize, 0);
+    if (!AppendStreamPage(stream_buffer_.data(), &stream_pages_,
+                          &page_count_)) {
       return false;
     }
+    stream_buffer_.clear();
   }
-  DCHECK_LE(stream0_start, stream0_end);
+
+  stream_lengths_.push_back(stream_length_);
+  stream_open_ = false;
+  deduplicating_ = false;
+
+  return true;
+}
+
+bool PdbWriter::Finish() {
+  DCHECK(file_.get() != NULL);
+  DCHECK(!stream_open_);
+
+  // Build the directory from the stream count, lengths and pages.
+  std::vector<uint32> directory;
+  directory.reserve(1 + stream_lengths_.size() + stream_pages_.size());
+  directory.push_back(stream_lengths_.size());
+  directory.insert(directory.end(), stream_lengths_.begin(),
+                   stream_lengths_.end());
+  directory.insert(directory.end(), stream_pages_.begin(),
+                   stream_pages_.end());
+
+  // The pages of stream 0 come first. We keep track of them for some free
+  // page map bookkeeping later on.
+  size_t stream0_start = 1 + stream_lengths_.size();
+  size_t stream0_end = stream0_start;
+  if (!stream_lengths_.empty()) {
+    stream0_end += (stream_lengths_[0] + kPdbPageSize - 1) / kPdbPageSize;
+  }
+  DCHECK_LE(stream0_end, directory.size());
 
   // Write the directory, and keep track of the pages it is written to.
   std::vector<uint32> directory_pages;
   scoped_refptr<PdbStream> directory_stream(new ReadOnlyPdbStream(
       directory.data(), sizeof(directory[0]) * directory.size()));
-  if (!AppendStream(directory_stream.get(), &directory_pages, &page_count)) {
+  if (!AppendStream(directory_stream.get(), &directory_pages, &page_count_)) {
     LOG(ERROR) << "Failed to write directory.";
     return false;
   }
@@ -286,7 +398,7 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
       directory_pages.data(),
       sizeof(directory_pages[0]) * directory_pages.size()));
   if (!AppendStream(root_directory_stream.get(), &root_directory_pages,
-                    &page_count)) {
+                    &page_count_)) {
     LOG(ERROR) << "Failed to write root directory.";
     return false;
   }
@@ -294,7 +406,7 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
   // Write the header.
   if (!WriteHeader(root_directory_pages,
                    sizeof(directory[0]) * directory.size(),
-                   page_count)) {
+                   page_count_)) {
     LOG(ERROR) << "Failed to write PDB header.";
     return false;
   }
@@ -303,7 +415,7 @@ bool PdbWriter::Write(const base::FilePath& pdb_path, const PdbFile& pdb_file) {
   // always marked as free, as well as page 3 which we allocated in the
   // preamble.
   FreePageBitMap free;
-  free.SetPageCount(page_count);
+  free.SetPageCount(page_count_);
   free.SetFree(3);
   for (size_t i = stream0_start; i < stream0_end; ++i)
     free.SetFree(directory[i]);
@@ -356,7 +468,7 @@ bool PdbWriter::AppendStream(PdbStream* stream,
       return false;
     }
 
-    if (!AppendPage(buffer, pages_written, page_count, file_.get()))
+    if (!AppendStreamPage(buffer, pages_written, page_count))
       return false;
 
     bytes_left -= bytes_read;
@@ -375,6 +487,33 @@ bool PdbWriter::AppendStream(PdbStream* stream,
   return true;
 }
 
+bool PdbWriter::AppendStreamPage(const void* data,
+                                 std::vector<uint32>* pages_written,
+                                 uint32* page_count) {
+  DCHECK(data != NULL);
+  DCHECK(pages_written != NULL);
+
+  if (!deduplicating_)
+    return AppendPage(data, pages_written, page_count, file_.get());
+
+  base::MD5Digest digest = {};
+  base::MD5Sum(data, kPdbPageSize, &digest);
+  std::string key(reinterpret_cast<const char*>(digest.a), sizeof(digest.a));
+
+  std::map<std::string, uint32>::const_iterator it = page_digests_.find(key);
+  if (it != page_digests_.end()) {
+    pages_written->push_back(it->second);
+    ++deduplicated_page_count_;
+    return true;
+  }
+
+  if (!AppendPage(data, pages_written, page_count, file_.get()))
+    return false;
+  page_digests_.insert(std::make_pair(key, pages_written->back()));
+
+  return true;
+}
+
 bool PdbWriter::WriteHeader(const std::vector<uint32>& root_directory_pages,
                             size_t directory_size,
                             uint32 page_count) {
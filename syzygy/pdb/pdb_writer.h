@@ -15,6 +15,8 @@
 #ifndef SYZYGY_PDB_PDB_WRITER_H_
 #define SYZYGY_PDB_PDB_WRITER_H_
 
+#include <map>
+#include <string>
 #include <vector>
 
 #include "base/file_util.h"
@@ -27,17 +29,83 @@ namespace pdb {
 // This class is used to write a pdb file to disk given a list of PdbStreams.
 // It will create a header and directory inside the pdb file that describe
 // the page layout of the streams in the file.
+//
+// A PDB file can also be written one stream at a time, in which case the
+// contents of a stream can be produced on the fly rather than materialized in
+// memory. Each stream is paged out to the output file as it is written, and
+// only the directory is kept in memory until the file is finished:
+//
+//   PdbWriter writer;
+//   writer.Start(pdb_path);
+//   writer.WriteStream(stream0);  // Streams are written in index order.
+//   writer.BeginStream();
+//   writer.WriteStreamData(data, length);  // As many times as needed.
+//   writer.EndStream();
+//   ...
+//   writer.Finish();
 class PdbWriter {
  public:
   PdbWriter();
   ~PdbWriter();
 
+  // Sets whether identical pages are written only once. The pages of streams
+  // with the same contents are then shared in the directory, which shrinks
+  // PDBs with duplicate streams or data. Pages are identified by their MD5
+  // digest. The pages of stream 0, which are marked as free, are never
+  // shared. Defaults to false.
+  // @param deduplicate_pages true to share identical pages.
+  void set_deduplicate_pages(bool deduplicate_pages) {
+    deduplicate_pages_ = deduplicate_pages;
+  }
+
+  // @returns true iff identical pages are written only once.
+  bool deduplicate_pages() const { return deduplicate_pages_; }
+
+  // @returns the number of pages that were shared rather than written by the
+  //     last write.
+  size_t deduplicated_page_count() const { return deduplicated_page_count_; }
+
   // Writes the given PdbFile to disk with the given file name.
   // @param pdb_path the path of the PDB file to write.
   // @param pdb_file the PDB file to be written.
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& pdb_path, const PdbFile& pdb_file);
 
+  // @name Incremental writing.
+  // @{
+  // Creates the PDB file and reserves its preamble.
+  // @param pdb_path the path of the PDB file to write.
+  // @returns true on success, false otherwise.
+  bool Start(const base::FilePath& pdb_path);
+
+  // Writes the next stream of the PDB file.
+  // @param stream the stream to write. May be NULL, in which case an empty
+  //     stream is written.
+  // @returns true on success, false otherwise.
+  bool WriteStream(PdbStream* stream);
+
+  // Begins the next stream of the PDB file, whose contents are then provided
+  // by calls to WriteStreamData.
+  // @returns true on success, false otherwise.
+  bool BeginStream();
+
+  // Appends data to the stream started by BeginStream. Full pages are written
+  // to the file right away, only the trailing partial page is buffered.
+  // @param data the data to append.
+  // @param length the length of @p data, in bytes.
+  // @returns true on success, false otherwise.
+  bool WriteStreamData(const void* data, size_t length);
+
+  // Ends the stream started by BeginStream.
+  // @returns true on success, false otherwise.
+  bool EndStream();
+
+  // Writes the directory, the header and the free page map, then closes the
+  // file.
+  // @returns true on success, false otherwise.
+  bool Finish();
+  // @}
+
  protected:
   // Append the contents of the stream onto the file handle at the offset. The
   // contents of the file are padded to reach the next page boundary in the
@@ -48,6 +116,13 @@ class PdbWriter {
                     std::vector<uint32>* pages_written,
                     uint32* page_count);
 
+  // Appends a page of a stream, as AppendPage does. If pages are being
+  // deduplicated and an identical page has already been written, its index is
+  // appended to @p pages_written instead.
+  bool AppendStreamPage(const void* data,
+                        std::vector<uint32>* pages_written,
+                        uint32* page_count);
+
   // Writes the MSF header after the directory has been written.
   bool WriteHeader(const std::vector<uint32>& root_directory_pages,
                    size_t directory_size,
@@ -56,6 +131,32 @@ class PdbWriter {
   // The current file handle open for writing.
   base::ScopedFILE file_;
 
+  // @name Incremental writing state.
+  // @{
+  // The lengths of the streams written so far.
+  std::vector<uint32> stream_lengths_;
+  // The pages of the streams written so far, in stream order.
+  std::vector<uint32> stream_pages_;
+  // The number of pages in the file.
+  uint32 page_count_;
+  // True between BeginStream and EndStream.
+  bool stream_open_;
+  // The length of the open stream.
+  size_t stream_length_;
+  // The trailing partial page of the open stream.
+  std::vector<uint8> stream_buffer_;
+  // @}
+
+  // @name Page deduplication state.
+  // @{
+  bool deduplicate_pages_;
+  // True while writing a stream whose pages may be shared.
+  bool deduplicating_;
+  // The index of the page written for each MD5 digest, as a string.
+  std::map<std::string, uint32> page_digests_;
+  size_t deduplicated_page_count_;
+  // @}
+
  private:
   DISALLOW_COPY_AND_ASSIGN(PdbWriter);
 };
@@ -230,6 +230,83 @@ TEST(PdbWriterTest, WritePdbFile) {
       EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
 }
 
+TEST(PdbWriterTest, WritePdbFileIncrementally) {
+  PdbFile pdb_file;
+  for (uint32 i = 0; i < 4; ++i)
+    pdb_file.AppendStream(new TestPdbStream(1 << (8 + i), (i << 24)));
+  pdb_file.AppendStream(new TestPdbStream(5 * kPdbPageSize + 12, 0xAB000000));
+
+  testing::ScopedTempFile file;
+  {
+    PdbWriter writer;
+    ASSERT_TRUE(writer.Start(file.path()));
+    EXPECT_TRUE(writer.WriteStream(pdb_file.GetStream(0)));
+
+    // Produce the other streams in chunks that straddle page boundaries.
+    for (size_t i = 1; i < pdb_file.StreamCount(); ++i) {
+      TestPdbStream* stream =
+          static_cast<TestPdbStream*>(pdb_file.GetStream(i));
+      const std::vector<uint8>& data = stream->data();
+      ASSERT_TRUE(writer.BeginStream());
+      size_t offset = 0;
+      size_t chunk = 1;
+      while (offset < data.size()) {
+        size_t length = std::min(chunk, data.size() - offset);
+        EXPECT_TRUE(writer.WriteStreamData(data.data() + offset, length));
+        offset += length;
+        chunk = chunk * 3 + 1;
+      }
+      EXPECT_TRUE(writer.EndStream());
+    }
+
+    EXPECT_TRUE(writer.Finish());
+  }
+
+  PdbFile pdb_file_read;
+  PdbReader reader;
+  EXPECT_TRUE(reader.Read(file.path(), &pdb_file_read));
+
+  ASSERT_NO_FATAL_FAILURE(
+      EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
+}
+
+TEST(PdbWriterTest, WritePdbFileWithDeduplicatedPages) {
+  PdbFile pdb_file;
+  scoped_refptr<PdbStream> stream(new TestPdbStream(3 * kPdbPageSize, 0));
+  pdb_file.AppendStream(stream.get());
+  pdb_file.AppendStream(new TestPdbStream(2 * kPdbPageSize + 100, 1 << 24));
+  pdb_file.AppendStream(stream.get());
+  pdb_file.AppendStream(stream.get());
+  pdb_file.AppendStream(new TestPdbStream(2 * kPdbPageSize + 100, 1 << 24));
+
+  testing::ScopedTempFile file;
+  testing::ScopedTempFile deduplicated_file;
+  PdbWriter writer;
+  EXPECT_FALSE(writer.deduplicate_pages());
+  ASSERT_TRUE(writer.Write(file.path(), pdb_file));
+  EXPECT_EQ(0u, writer.deduplicated_page_count());
+
+  writer.set_deduplicate_pages(true);
+  EXPECT_TRUE(writer.deduplicate_pages());
+  ASSERT_TRUE(writer.Write(deduplicated_file.path(), pdb_file));
+
+  // The pages of stream 0 are never shared, so stream 2 is written in full.
+  // Stream 3 shares the pages of stream 2, and stream 4 those of stream 1.
+  EXPECT_EQ(3u + 3u, writer.deduplicated_page_count());
+
+  int64 size = 0;
+  int64 deduplicated_size = 0;
+  ASSERT_TRUE(base::GetFileSize(file.path(), &size));
+  ASSERT_TRUE(base::GetFileSize(deduplicated_file.path(), &deduplicated_size));
+  EXPECT_GT(size, deduplicated_size);
+
+  PdbFile pdb_file_read;
+  PdbReader reader;
+  EXPECT_TRUE(reader.Read(deduplicated_file.path(), &pdb_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      EnsurePdbContentsAreIdentical(pdb_file, pdb_file_read));
+}
+
 TEST(PdbWriterTest, PdbStrCompatible) {
   base::FilePath test_dll_pdb =
       testing::GetSrcRelativePath(testing::kTestPdbFilePath);
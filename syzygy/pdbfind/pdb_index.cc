@@ -0,0 +1,249 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/pdbfind/pdb_index.h"
+
+#include <algorithm>
+
+#include "base/file_util.h"
+#include "base/files/file_enumerator.h"
+#include "base/time/time.h"
+#include "syzygy/pdb/pdb_util.h"
+
+namespace pdbfind {
+
+namespace {
+
+// Bump this whenever the layout of the index files changes.
+const uint32 kPdbIndexVersion = 1;
+
+bool SaveGuid(const GUID& guid, core::OutArchive* out_archive) {
+  DCHECK(out_archive != NULL);
+  if (!out_archive->Save(static_cast<uint32>(guid.Data1)) ||
+      !out_archive->Save(static_cast<uint16>(guid.Data2)) ||
+      !out_archive->Save(static_cast<uint16>(guid.Data3))) {
+    return false;
+  }
+  for (size_t i = 0; i < arraysize(guid.Data4); ++i) {
+    if (!out_archive->Save(static_cast<uint8>(guid.Data4[i])))
+      return false;
+  }
+  return true;
+}
+
+bool LoadGuid(GUID* guid, core::InArchive* in_archive) {
+  DCHECK(guid != NULL);
+  DCHECK(in_archive != NULL);
+  uint32 data1 = 0;
+  uint16 data2 = 0;
+  uint16 data3 = 0;
+  if (!in_archive->Load(&data1) ||
+      !in_archive->Load(&data2) ||
+      !in_archive->Load(&data3)) {
+    return false;
+  }
+  guid->Data1 = data1;
+  guid->Data2 = data2;
+  guid->Data3 = data3;
+  for (size_t i = 0; i < arraysize(guid->Data4); ++i) {
+    uint8 data4 = 0;
+    if (!in_archive->Load(&data4))
+      return false;
+    guid->Data4[i] = data4;
+  }
+  return true;
+}
+
+}  // namespace
+
+void PdbIndex::AddDirectory(const base::FilePath& directory) {
+  DCHECK(!directory.empty());
+
+  base::FilePath abs_directory = base::MakeAbsoluteFilePath(directory);
+  if (abs_directory.empty())
+    abs_directory = directory;
+
+  const std::wstring& value = abs_directory.value();
+  if (std::find(directories_.begin(), directories_.end(), value) ==
+          directories_.end()) {
+    directories_.push_back(value);
+  }
+}
+
+bool PdbIndex::Update() {
+  headers_read_ = 0;
+
+  Entries old_entries;
+  old_entries.swap(entries_);
+
+  bool success = true;
+  for (size_t i = 0; i < directories_.size(); ++i) {
+    base::FilePath directory(directories_[i]);
+    if (!base::DirectoryExists(directory)) {
+      LOG(ERROR) << "Indexed directory \"" << directory.value()
+                 << "\" does not exist.";
+      success = false;
+      continue;
+    }
+    UpdateDirectory(directory, old_entries);
+  }
+
+  return success;
+}
+
+bool PdbIndex::Find(const pe::PdbInfo& pdb_info,
+                    base::FilePath* pdb_path) const {
+  DCHECK(pdb_path != NULL);
+
+  const Entries::value_type* best = NULL;
+  Entries::const_iterator it = entries_.begin();
+  for (; it != entries_.end(); ++it) {
+    const Entry& entry = it->second;
+    if (entry.signature != pdb_info.signature() ||
+        entry.pdb_age < pdb_info.pdb_age()) {
+      continue;
+    }
+    if (best != NULL && best->second.pdb_age <= entry.pdb_age)
+      continue;
+
+    // Skip files that have disappeared since the index was updated. This only
+    // costs a lookup of the file attributes.
+    base::FilePath path(it->first);
+    if (!base::PathExists(path))
+      continue;
+    best = &(*it);
+  }
+
+  if (best == NULL)
+    return false;
+
+  *pdb_path = base::FilePath(best->first);
+  return true;
+}
+
+bool PdbIndex::SaveToFile(const base::FilePath& path) const {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!Save(&out_archive) || !out_archive.Flush()) {
+    LOG(ERROR) << "Unable to write PDB index to \"" << path.value() << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool PdbIndex::LoadFromFile(const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  if (!Load(&in_archive)) {
+    LOG(WARNING) << "Unable to read PDB index from \"" << path.value()
+                 << "\".";
+    return false;
+  }
+
+  return true;
+}
+
+bool PdbIndex::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(kPdbIndexVersion) &&
+      out_archive->Save(directories_) &&
+      out_archive->Save(entries_);
+}
+
+bool PdbIndex::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+
+  uint32 version = 0;
+  if (!in_archive->Load(&version))
+    return false;
+  if (version != kPdbIndexVersion) {
+    LOG(WARNING) << "Unsupported PDB index version " << version << ".";
+    return false;
+  }
+
+  Directories directories;
+  Entries entries;
+  if (!in_archive->Load(&directories) || !in_archive->Load(&entries))
+    return false;
+
+  directories_.swap(directories);
+  entries_.swap(entries);
+  return true;
+}
+
+void PdbIndex::UpdateDirectory(const base::FilePath& directory,
+                               const Entries& old_entries) {
+  base::FileEnumerator enumerator(directory,
+                                  true,
+                                  base::FileEnumerator::FILES,
+                                  L"*.pdb");
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    base::FileEnumerator::FileInfo info = enumerator.GetInfo();
+    Entry entry;
+    entry.size = info.GetSize();
+    entry.last_modified = info.GetLastModifiedTime().ToInternalValue();
+
+    // Carry over the entries of the files that haven't changed.
+    Entries::const_iterator old_it = old_entries.find(path.value());
+    if (old_it != old_entries.end() &&
+        old_it->second.size == entry.size &&
+        old_it->second.last_modified == entry.last_modified) {
+      entries_.insert(*old_it);
+      continue;
+    }
+
+    ++headers_read_;
+    pdb::PdbInfoHeader70 header = {};
+    if (!pdb::ReadPdbHeader(path, &header)) {
+      LOG(WARNING) << "Not indexing unreadable PDB \"" << path.value()
+                   << "\".";
+      continue;
+    }
+
+    entry.signature = header.signature;
+    entry.pdb_age = header.pdb_age;
+    entries_[path.value()] = entry;
+  }
+}
+
+bool PdbIndex::Entry::Save(core::OutArchive* out_archive) const {
+  DCHECK(out_archive != NULL);
+  return out_archive->Save(size) &&
+      out_archive->Save(last_modified) &&
+      SaveGuid(signature, out_archive) &&
+      out_archive->Save(pdb_age);
+}
+
+bool PdbIndex::Entry::Load(core::InArchive* in_archive) {
+  DCHECK(in_archive != NULL);
+  return in_archive->Load(&size) &&
+      in_archive->Load(&last_modified) &&
+      LoadGuid(&signature, in_archive) &&
+      in_archive->Load(&pdb_age);
+}
+
+}  // namespace pdbfind
@@ -0,0 +1,132 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Declares a persistent index of the PDB files found under a set of
+// directories, keyed by their signature.
+
+#ifndef SYZYGY_PDBFIND_PDB_INDEX_H_
+#define SYZYGY_PDBFIND_PDB_INDEX_H_
+
+#include <windows.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/pe/pdb_info.h"
+
+namespace pdbfind {
+
+// Holds the signature (GUID and age) of every PDB file under a set of
+// directories, so that the PDB matching an image can be found without opening
+// any PDB file.
+//
+// The index is meant to be saved to and loaded from a file between runs. Each
+// entry remembers the size and the modification time of its PDB file, so that
+// bringing the index up to date only reads the headers of the PDB files that
+// are new or that have changed since.
+class PdbIndex {
+ public:
+  struct Entry;  // Forward declaration.
+  // The entries, keyed by the path of their PDB file.
+  typedef std::map<std::wstring, Entry> Entries;
+  typedef std::vector<std::wstring> Directories;
+
+  PdbIndex() : headers_read_(0) {
+  }
+
+  // Adds a directory to the index. The directories are searched recursively.
+  // Adding a directory that is already indexed has no effect.
+  // @param directory the directory to add.
+  void AddDirectory(const base::FilePath& directory);
+
+  // Brings the index up to date with the PDB files in the indexed directories.
+  // Entries whose file disappeared are dropped, and only the headers of the
+  // new or modified files are read.
+  // @returns true on success, false otherwise.
+  bool Update();
+
+  // Finds a PDB file matching an image. As with pe::PdbInfo::IsConsistent, a
+  // PDB file matches if it has the same GUID and an age no lower than that of
+  // the image. If several PDB files match, the one with the lowest age wins.
+  // @param pdb_info the PDB information of the image.
+  // @param pdb_path receives the path to the matching PDB file.
+  // @returns true if a matching PDB file was found, false otherwise.
+  bool Find(const pe::PdbInfo& pdb_info, base::FilePath* pdb_path) const;
+
+  // @name Accessors.
+  // @{
+  const Directories& directories() const { return directories_; }
+  const Entries& entries() const { return entries_; }
+  // Returns the number of PDB headers read by the last call to Update.
+  size_t headers_read() const { return headers_read_; }
+  // @}
+
+  // @name Index files.
+  // @{
+  // Saves this index to the file at @p path.
+  // @returns true on success, false otherwise.
+  bool SaveToFile(const base::FilePath& path) const;
+  // Loads this index from the file at @p path.
+  // @returns true on success, false otherwise.
+  bool LoadFromFile(const base::FilePath& path);
+  // @}
+
+  // @name Serialization.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+
+ protected:
+  // Indexes the PDB files under @p directory, carrying over the up to date
+  // entries of @p old_entries.
+  void UpdateDirectory(const base::FilePath& directory,
+                       const Entries& old_entries);
+
+  // The indexed directories.
+  Directories directories_;
+  // The indexed PDB files.
+  Entries entries_;
+  // The number of PDB headers read by the last update.
+  size_t headers_read_;
+};
+
+// Describes an indexed PDB file.
+struct PdbIndex::Entry {
+  Entry() : size(0), last_modified(0), pdb_age(0) {
+    ::memset(&signature, 0, sizeof(signature));
+  }
+
+  // The size and modification time of the file when it was indexed. The
+  // time is a base::Time internal value.
+  int64 size;
+  int64 last_modified;
+
+  // The signature of the PDB file.
+  GUID signature;
+  uint32 pdb_age;
+
+  // @name Serialization.
+  // @{
+  bool Save(core::OutArchive* out_archive) const;
+  bool Load(core::InArchive* in_archive);
+  // @}
+};
+
+}  // namespace pdbfind
+
+#endif  // SYZYGY_PDBFIND_PDB_INDEX_H_
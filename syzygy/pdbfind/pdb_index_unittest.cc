@@ -0,0 +1,157 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/pdbfind/pdb_index.h"
+
+#include "base/file_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/pe_data.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pdbfind {
+
+namespace {
+
+class PdbIndexTest : public testing::PELibUnitTest {
+ public:
+  typedef testing::PELibUnitTest Super;
+
+  virtual void SetUp() OVERRIDE {
+    Super::SetUp();
+
+    CreateTemporaryDir(&temp_dir_);
+    index_dir_ = temp_dir_.Append(L"symbols");
+    ASSERT_TRUE(base::CreateDirectory(index_dir_.Append(L"sub")));
+
+    // Index a copy of the test_dll PDB, in a sub-directory.
+    pdb_path_ = index_dir_.Append(L"sub").Append(testing::kTestDllPdbName);
+    ASSERT_TRUE(base::CopyFile(
+        testing::GetExeRelativePath(testing::kTestDllPdbName), pdb_path_));
+
+    ASSERT_TRUE(pdb_info_.Init(
+        testing::GetExeRelativePath(testing::kTestDllName)));
+  }
+
+  base::FilePath temp_dir_;
+  base::FilePath index_dir_;
+  base::FilePath pdb_path_;
+  pe::PdbInfo pdb_info_;
+};
+
+}  // namespace
+
+TEST_F(PdbIndexTest, AddDirectoryIgnoresDuplicates) {
+  PdbIndex index;
+  index.AddDirectory(index_dir_);
+  index.AddDirectory(index_dir_);
+  EXPECT_EQ(1U, index.directories().size());
+}
+
+TEST_F(PdbIndexTest, UpdateFailsForMissingDirectory) {
+  PdbIndex index;
+  index.AddDirectory(temp_dir_.Append(L"does_not_exist"));
+  EXPECT_FALSE(index.Update());
+  EXPECT_TRUE(index.entries().empty());
+}
+
+TEST_F(PdbIndexTest, FindsIndexedPdb) {
+  PdbIndex index;
+  index.AddDirectory(index_dir_);
+  ASSERT_TRUE(index.Update());
+  EXPECT_EQ(1U, index.entries().size());
+  EXPECT_EQ(1U, index.headers_read());
+
+  base::FilePath pdb_path;
+  ASSERT_TRUE(index.Find(pdb_info_, &pdb_path));
+  EXPECT_SAME_FILE(pdb_path_, pdb_path);
+
+  // A deleted PDB is no longer found, even before the index is updated.
+  ASSERT_TRUE(base::DeleteFile(pdb_path_, false));
+  EXPECT_FALSE(index.Find(pdb_info_, &pdb_path));
+  ASSERT_TRUE(index.Update());
+  EXPECT_TRUE(index.entries().empty());
+}
+
+TEST_F(PdbIndexTest, DoesNotFindOlderPdb) {
+  PdbIndex index;
+  index.AddDirectory(index_dir_);
+  ASSERT_TRUE(index.Update());
+
+  // Forge the signature of an image with a younger PDB.
+  pe::CvInfoPdb70 cv_info = {};
+  cv_info.cv_signature = pe::kPdb70Signature;
+  cv_info.signature = pdb_info_.signature();
+  cv_info.pdb_age = index.entries().begin()->second.pdb_age + 1;
+  pe::PdbInfo pdb_info;
+  ASSERT_TRUE(pdb_info.Init(cv_info));
+
+  base::FilePath pdb_path;
+  EXPECT_FALSE(index.Find(pdb_info, &pdb_path));
+}
+
+TEST_F(PdbIndexTest, UpdateOnlyReadsModifiedPdbs) {
+  PdbIndex index;
+  index.AddDirectory(index_dir_);
+  ASSERT_TRUE(index.Update());
+  EXPECT_EQ(1U, index.headers_read());
+
+  ASSERT_TRUE(index.Update());
+  EXPECT_EQ(1U, index.entries().size());
+  EXPECT_EQ(0U, index.headers_read());
+
+  // A new PDB gets read.
+  ASSERT_TRUE(base::CopyFile(pdb_path_, index_dir_.Append(L"copy.pdb")));
+  ASSERT_TRUE(index.Update());
+  EXPECT_EQ(2U, index.entries().size());
+  EXPECT_EQ(1U, index.headers_read());
+}
+
+TEST_F(PdbIndexTest, SaveAndLoad) {
+  PdbIndex index;
+  index.AddDirectory(index_dir_);
+  ASSERT_TRUE(index.Update());
+
+  base::FilePath index_path = temp_dir_.Append(L"pdb.index");
+  ASSERT_TRUE(index.SaveToFile(index_path));
+
+  PdbIndex loaded_index;
+  ASSERT_TRUE(loaded_index.LoadFromFile(index_path));
+  EXPECT_EQ(index.directories(), loaded_index.directories());
+  ASSERT_EQ(index.entries().size(), loaded_index.entries().size());
+
+  const PdbIndex::Entry& entry = index.entries().begin()->second;
+  const PdbIndex::Entry& loaded_entry = loaded_index.entries().begin()->second;
+  EXPECT_EQ(index.entries().begin()->first,
+            loaded_index.entries().begin()->first);
+  EXPECT_EQ(entry.size, loaded_entry.size);
+  EXPECT_EQ(entry.last_modified, loaded_entry.last_modified);
+  EXPECT_EQ(entry.signature, loaded_entry.signature);
+  EXPECT_EQ(entry.pdb_age, loaded_entry.pdb_age);
+
+  // The loaded index is up to date.
+  ASSERT_TRUE(loaded_index.Update());
+  EXPECT_EQ(0U, loaded_index.headers_read());
+
+  base::FilePath pdb_path;
+  EXPECT_TRUE(loaded_index.Find(pdb_info_, &pdb_path));
+}
+
+TEST_F(PdbIndexTest, LoadFailsForMissingFile) {
+  PdbIndex index;
+  EXPECT_FALSE(index.LoadFromFile(temp_dir_.Append(L"missing.index")));
+}
+
+}  // namespace pdbfind
@@ -21,12 +21,16 @@
       'target_name': 'pdbfind_lib',
       'type': 'static_library',
       'sources': [
+        'pdb_index.cc',
+        'pdb_index.h',
         'pdbfind_app.cc',
         'pdbfind_app.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/application/application.gyp:application_lib',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+        '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
       ],
     },
@@ -51,6 +55,7 @@
       'target_name': 'pdbfind_unittests',
       'type': 'executable',
       'sources': [
+        'pdb_index_unittest.cc',
         'pdbfind_app_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
@@ -15,6 +15,7 @@
 #include "syzygy/pdbfind/pdbfind_app.h"
 
 #include "base/file_util.h"
+#include "base/strings/string_split.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/pe_file.h"
@@ -30,7 +31,7 @@ const int kUnableToFindPdb = 2;
 const int kMissingOrMalformedCodeViewRecord = 3;
 
 const char kUsageFormatStr[] =
-    "Usage: %ls <input-image-path>\n"
+    "Usage: %ls [options] <input-image-path>\n"
     "\n"
     "  Searches for the PDB file matching the provided image. If successfully\n"
     "  found prints the absolute path to stdout and exit with a return code\n"
@@ -45,6 +46,20 @@ const char kUsageFormatStr[] =
     "\n"
     "  If the image does not contain a CodeView record or it is malformed\n"
     "  exits with a return code of 3.\n"
+    "\n"
+    "Options:\n"
+    "  --index=<path>        Looks the PDB up in the PDB index stored at\n"
+    "                        <path>, creating it as needed. PDB files that\n"
+    "                        are indexed are found without being opened.\n"
+    "                        Images whose PDB isn't indexed fall back to the\n"
+    "                        regular search.\n"
+    "  --index-dirs=<dirs>   A semi-colon separated list of directories to\n"
+    "                        add to the index. They are searched recursively\n"
+    "                        for PDB files. Requires --index.\n"
+    "  --update-index        Brings the index up to date with the indexed\n"
+    "                        directories. Only new or modified PDB files are\n"
+    "                        read. The input image may be omitted, in which\n"
+    "                        case only the index is updated.\n"
     "\n";
 
 }  // namespace
@@ -55,9 +70,27 @@ bool PdbFindApp::ParseCommandLine(const CommandLine* cmd_line) {
   if (cmd_line->HasSwitch("help"))
     return Usage(cmd_line, "");
 
+  index_path_ = cmd_line->GetSwitchValuePath("index");
+  update_index_ = cmd_line->HasSwitch("update-index");
+
+  std::vector<std::wstring> index_dirs;
+  base::SplitString(cmd_line->GetSwitchValueNative("index-dirs"), L';',
+                    &index_dirs);
+  for (size_t i = 0; i < index_dirs.size(); ++i) {
+    if (!index_dirs[i].empty())
+      index_dirs_.push_back(base::FilePath(index_dirs[i]));
+  }
+
+  if (index_path_.empty() && (update_index_ || !index_dirs_.empty()))
+    return Usage(cmd_line, "Must specify --index to maintain an index.");
+
   CommandLine::StringVector args = cmd_line->GetArgs();
-  if (args.size() == 0)
+  if (args.size() == 0) {
+    // Updating the index is the only thing that can be done without an image.
+    if (update_index_)
+      return true;
     return Usage(cmd_line, "Must specify input-image-path.");
+  }
 
   if (args.size() > 1)
     return Usage(cmd_line, "Can specify only one input-image-path.");
@@ -68,12 +101,22 @@ bool PdbFindApp::ParseCommandLine(const CommandLine* cmd_line) {
 }
 
 int PdbFindApp::Run() {
+  PdbIndex pdb_index;
+  if (!index_path_.empty() && !LoadIndex(&pdb_index))
+    return kError;
+
+  if (input_image_path_.empty()) {
+    DCHECK(update_index_);
+    return kSuccess;
+  }
+
   if (!base::PathExists(input_image_path_)) {
     LOG(ERROR) << "File not found: " << input_image_path_.value();
     return kError;
   }
 
   pe::PEFile pe_file;
+  pe_file.set_memory_mapped(true);
   if (!pe_file.Init(input_image_path_)) {
     LOG(ERROR) << "Failed to parse PE file: " << input_image_path_.value();
     return kError;
@@ -84,8 +127,12 @@ int PdbFindApp::Run() {
   if (!pdb_info.Init(pe_file))
     return kMissingOrMalformedCodeViewRecord;
 
-  // Look for the matching PDB.
+  // Look for the matching PDB, in the index first.
   base::FilePath pdb_path;
+  if (pdb_index.Find(pdb_info, &pdb_path)) {
+    fprintf(out(), "%ls\n", pdb_path.value().c_str());
+    return kSuccess;
+  }
   if (!pe::FindPdbForModule(input_image_path_, &pdb_path)) {
     LOG(ERROR) << "Error searching for PDB file.";
     return kError;
@@ -102,6 +149,35 @@ int PdbFindApp::Run() {
   return kSuccess;
 }
 
+bool PdbFindApp::LoadIndex(PdbIndex* pdb_index) const {
+  DCHECK(pdb_index != NULL);
+  DCHECK(!index_path_.empty());
+
+  // A missing or unreadable index is simply rebuilt.
+  bool update = update_index_;
+  if (!base::PathExists(index_path_) ||
+      !pdb_index->LoadFromFile(index_path_)) {
+    update = true;
+  }
+
+  size_t dir_count = pdb_index->directories().size();
+  for (size_t i = 0; i < index_dirs_.size(); ++i)
+    pdb_index->AddDirectory(index_dirs_[i]);
+  if (pdb_index->directories().size() != dir_count)
+    update = true;
+
+  if (!update)
+    return true;
+
+  // Failing to find one of the directories isn't fatal, the index is still
+  // good for the others.
+  pdb_index->Update();
+  LOG(INFO) << "Indexed " << pdb_index->entries().size() << " PDB files, "
+            << "read " << pdb_index->headers_read() << " of them.";
+
+  return pdb_index->SaveToFile(index_path_);
+}
+
 bool PdbFindApp::Usage(const CommandLine* cmd_line,
                        const base::StringPiece& message) const {
   if (!message.empty()) {
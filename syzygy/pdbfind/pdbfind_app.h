@@ -20,9 +20,12 @@
 #ifndef SYZYGY_PDBFIND_PDBFIND_APP_H_
 #define SYZYGY_PDBFIND_PDBFIND_APP_H_
 
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "syzygy/application/application.h"
+#include "syzygy/pdbfind/pdb_index.h"
 
 namespace pdbfind {
 
@@ -33,7 +36,8 @@ namespace pdbfind {
 class PdbFindApp : public application::AppImplBase {
  public:
   PdbFindApp()
-      : application::AppImplBase("PdbFind") {
+      : application::AppImplBase("PdbFind"),
+        update_index_(false) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -47,11 +51,19 @@ class PdbFindApp : public application::AppImplBase {
   // @{
   bool Usage(const CommandLine* command_line,
              const base::StringPiece& message) const;
+
+  // Loads the PDB index, and brings it up to date if need be.
+  // @param pdb_index the index to load.
+  // @returns true on success, false otherwise.
+  bool LoadIndex(PdbIndex* pdb_index) const;
   // @}
 
   // @name Command-line parameters.
   // @{
   base::FilePath input_image_path_;
+  base::FilePath index_path_;
+  std::vector<base::FilePath> index_dirs_;
+  bool update_index_;
   // @}
 };
 
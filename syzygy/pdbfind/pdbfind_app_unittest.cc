@@ -30,6 +30,9 @@ namespace {
 class TestPdbFindApp : public PdbFindApp {
  public:
   using PdbFindApp::input_image_path_;
+  using PdbFindApp::index_path_;
+  using PdbFindApp::index_dirs_;
+  using PdbFindApp::update_index_;
 };
 
 typedef application::Application<TestPdbFindApp> TestApp;
@@ -108,6 +111,67 @@ TEST_F(PdbFindAppTest, ParseWithOneArgumentPasses) {
   EXPECT_EQ(app_impl_.input_image_path_, base::FilePath(L"foo.dll"));
 }
 
+TEST_F(PdbFindAppTest, ParseIndexOptions) {
+  cmd_line_.AppendSwitchPath("index", base::FilePath(L"pdb.index"));
+  cmd_line_.AppendSwitchNative("index-dirs", L"C:\\foo;;C:\\bar");
+  cmd_line_.AppendSwitch("update-index");
+  cmd_line_.AppendArg("foo.dll");
+  ASSERT_TRUE(app_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(base::FilePath(L"pdb.index"), app_impl_.index_path_);
+  ASSERT_EQ(2U, app_impl_.index_dirs_.size());
+  EXPECT_EQ(base::FilePath(L"C:\\foo"), app_impl_.index_dirs_[0]);
+  EXPECT_EQ(base::FilePath(L"C:\\bar"), app_impl_.index_dirs_[1]);
+  EXPECT_TRUE(app_impl_.update_index_);
+}
+
+TEST_F(PdbFindAppTest, IndexOptionsRequireIndex) {
+  cmd_line_.AppendSwitch("update-index");
+  cmd_line_.AppendArg("foo.dll");
+  ASSERT_FALSE(app_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(PdbFindAppTest, UpdateIndexWithoutImage) {
+  base::FilePath index_dir = temp_dir_.Append(L"symbols");
+  ASSERT_TRUE(base::CreateDirectory(index_dir));
+  ASSERT_TRUE(base::CopyFile(
+      testing::GetExeRelativePath(testing::kTestDllPdbName),
+      index_dir.Append(testing::kTestDllPdbName)));
+
+  base::FilePath index_path = temp_dir_.Append(L"pdb.index");
+  cmd_line_.AppendSwitchPath("index", index_path);
+  cmd_line_.AppendSwitchPath("index-dirs", index_dir);
+  cmd_line_.AppendSwitch("update-index");
+  ASSERT_EQ(0, app_.Run());
+
+  PdbIndex index;
+  ASSERT_TRUE(index.LoadFromFile(index_path));
+  EXPECT_EQ(1U, index.directories().size());
+  EXPECT_EQ(1U, index.entries().size());
+}
+
+TEST_F(PdbFindAppTest, SucceedsWithIndex) {
+  // Index a copy of the PDB, so that it can only be found through the index.
+  base::FilePath index_dir = temp_dir_.Append(L"symbols");
+  ASSERT_TRUE(base::CreateDirectory(index_dir));
+  base::FilePath pdb_path = index_dir.Append(testing::kTestDllPdbName);
+  ASSERT_TRUE(base::CopyFile(
+      testing::GetExeRelativePath(testing::kTestDllPdbName), pdb_path));
+
+  base::FilePath index_path = temp_dir_.Append(L"pdb.index");
+  cmd_line_.AppendSwitchPath("index", index_path);
+  cmd_line_.AppendSwitchPath("index-dirs", index_dir);
+  cmd_line_.AppendArgPath(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_EQ(0, app_.Run());
+  EXPECT_TRUE(base::PathExists(index_path));
+
+  TearDownStreams();
+  std::string actual_stdout;
+  ASSERT_TRUE(base::ReadFileToString(stdout_path_, &actual_stdout));
+  base::TrimWhitespaceASCII(actual_stdout, base::TRIM_TRAILING,
+                            &actual_stdout);
+  EXPECT_SAME_FILE(pdb_path, base::FilePath(base::ASCIIToWide(actual_stdout)));
+}
+
 TEST_F(PdbFindAppTest, ModuleNotFound) {
   base::FilePath module = testing::GetExeRelativePath(L"made_up_module.dll");
   cmd_line_.AppendArgPath(module);
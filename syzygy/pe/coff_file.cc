@@ -36,6 +36,8 @@ CoffFile::~CoffFile() {
 
 bool CoffFile::Init(const base::FilePath& path) {
   PECoffFile::Init(path);
+  if (!MapFile())
+    return false;
 
   base::ScopedFILE file(base::OpenFile(path, "rb"));
   if (file.get() == NULL) {
@@ -72,6 +72,23 @@ TEST_F(CoffFileTest, Init) {
   EXPECT_EQ(0u, image_file_.file_header()->SizeOfOptionalHeader);
 }
 
+TEST_F(CoffFileTest, InitMemoryMapped) {
+  ASSERT_TRUE(image_file_.Init(test_dll_obj_path_));
+
+  CoffFile mapped_file;
+  mapped_file.set_memory_mapped(true);
+  ASSERT_TRUE(mapped_file.Init(test_dll_obj_path_));
+
+  ASSERT_EQ(image_file_.file_header()->NumberOfSymbols,
+            mapped_file.file_header()->NumberOfSymbols);
+  EXPECT_EQ(0, memcmp(image_file_.symbols(), mapped_file.symbols(),
+                      image_file_.file_header()->NumberOfSymbols *
+                          sizeof(IMAGE_SYMBOL)));
+  ASSERT_EQ(image_file_.strings_size(), mapped_file.strings_size());
+  EXPECT_EQ(0, memcmp(image_file_.strings(), mapped_file.strings(),
+                      image_file_.strings_size()));
+}
+
 TEST_F(CoffFileTest, TranslateSectionOffsets) {
   ASSERT_TRUE(image_file_.Init(test_dll_obj_path_));
 
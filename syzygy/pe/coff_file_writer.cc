@@ -39,10 +39,32 @@ bool CoffFileWriter::WriteImage(const base::FilePath& path) {
     return false;
   }
 
-  // Write every range in order. In a COFF file, block graph relative
-  // addresses match file offsets, so writing out the file can simply be
-  // done in address order, with appropriate padding.
-  std::vector<uint8> padding;
+  // Serialize the image and write it out with a single call, rather than a
+  // call per block.
+  std::vector<uint8> buffer;
+  if (!SerializeImage(&buffer))
+    return false;
+  if (buffer.empty())
+    return true;
+  if (std::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(),
+                  file.get()) != buffer.size()) {
+    LOG(ERROR) << "Unable to write image (" << buffer.size()
+               << " bytes) to file.";
+    return false;
+  }
+
+  return true;
+}
+
+bool CoffFileWriter::SerializeImage(std::vector<uint8>* buffer) {
+  DCHECK(image_layout_ != NULL);
+  DCHECK(buffer != NULL);
+
+  buffer->clear();
+
+  // Copy every range in order. In a COFF file, block graph relative
+  // addresses match file offsets, so the file can simply be assembled in
+  // address order, with appropriate padding.
   RelativeAddress cursor(0);
   BlockGraph::AddressSpace::RangeMapConstIter it =
       image_layout_->blocks.begin();
@@ -51,14 +73,7 @@ bool CoffFileWriter::WriteImage(const base::FilePath& path) {
     DCHECK_LE(cursor, it->first.start());
     size_t pad_size = it->first.start() - cursor;
     if (pad_size > 0) {
-      if (pad_size > padding.size())
-        padding.resize(pad_size, 0);
-      if (std::fwrite(&padding[0], sizeof(padding[0]), pad_size,
-                      file.get()) != pad_size) {
-        LOG(ERROR) << "Unable to write padding (" << pad_size
-                   << " bytes) to file.";
-        return false;
-      }
+      buffer->resize(buffer->size() + pad_size, 0);
       cursor += pad_size;
     }
 
@@ -68,15 +83,16 @@ bool CoffFileWriter::WriteImage(const base::FilePath& path) {
     if ((block->attributes() & BlockGraph::COFF_BSS) != 0)
       continue;
 
-    // Write the contents of the block.
+    // Copy the contents of the block.
     DCHECK(block != NULL);
     const uint8* data = block->data();
     size_t data_size = block->data_size();
-    if (std::fwrite(data, sizeof(*data), data_size, file.get()) != data_size) {
-      LOG(ERROR) << "Unable to write contents of block \""
-                 << block->name() << "\" ("
-                 << data_size << " bytes) to file.";
-      return false;
+    if (data_size > 0) {
+      if (data == NULL) {
+        LOG(ERROR) << "Block \"" << block->name() << "\" has no data.";
+        return false;
+      }
+      buffer->insert(buffer->end(), data, data + data_size);
     }
 
     // Advance cursor.
@@ -19,6 +19,8 @@
 #ifndef SYZYGY_PE_COFF_FILE_WRITER_H_
 #define SYZYGY_PE_COFF_FILE_WRITER_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/pe/image_layout.h"
 
@@ -43,6 +45,15 @@ class CoffFileWriter {
   // @returns true on success, false on failure.
   bool WriteImage(const base::FilePath& path);
 
+  // Serialize the image to memory, exactly as it would be written to disk.
+  // The buffer is cleared first, but its storage is reused, so serializing a
+  // series of images into the same buffer only reallocates when an image is
+  // larger than all of those before it.
+  //
+  // @param buffer the buffer that receives the image.
+  // @returns true on success, false on failure.
+  bool SerializeImage(std::vector<uint8>* buffer);
+
  private:
   // The image layout to write to disk.
   const ImageLayout* image_layout_;
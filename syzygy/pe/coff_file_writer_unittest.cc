@@ -84,4 +84,34 @@ TEST_F(CoffFileWriterTest, RedecomposeAfterWrite) {
                           sizeof(file_header_0[0])) == 0);
 }
 
+TEST_F(CoffFileWriterTest, SerializeMatchesWrite) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+
+  base::FilePath image_path_0(
+      testing::GetExeTestDataRelativePath(testing::kTestDllCoffObjName));
+  base::FilePath image_path_1(temp_dir.Append(testing::kTestDllName));
+
+  CoffFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path_0));
+
+  CoffDecomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  CoffFileWriter writer(&image_layout);
+  ASSERT_TRUE(writer.WriteImage(image_path_1));
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(image_path_1, &contents));
+
+  // Serialize twice into the same buffer, to make sure that it is reset.
+  std::vector<uint8> buffer;
+  ASSERT_TRUE(writer.SerializeImage(&buffer));
+  ASSERT_TRUE(writer.SerializeImage(&buffer));
+  ASSERT_EQ(contents.size(), buffer.size());
+  EXPECT_EQ(0, std::memcmp(contents.data(), &buffer[0], buffer.size()));
+}
+
 }  // namespace pe
@@ -0,0 +1,210 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/pe/coff_relink_pipeline.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/message_loop/message_loop.h"
+#include "base/threading/simple_thread.h"
+#include "base/threading/thread.h"
+
+namespace pe {
+
+// Relinks the objects in parallel. Each worker thread takes the next object
+// that hasn't been relinked yet, and hands it over to the writer thread once
+// it is serialized, until they're all done or one of them fails.
+class CoffRelinkPipeline::Worker
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  Worker(CoffRelinkPipeline* pipeline, base::MessageLoop* writer_loop)
+      : pipeline_(pipeline),
+        writer_loop_(writer_loop),
+        next_object_(0),
+        failed_(0) {
+    DCHECK(pipeline != NULL);
+    DCHECK(writer_loop != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    while (base::subtle::NoBarrier_Load(&failed_) == 0 &&
+           base::subtle::NoBarrier_Load(&pipeline_->write_failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_object_, 1));
+      if (index > pipeline_->objects_.size())
+        return;
+
+      const Object& object = pipeline_->objects_[index - 1];
+      std::vector<uint8>* buffer = pipeline_->AcquireBuffer();
+      if (!pipeline_->RelinkObject(object, buffer)) {
+        pipeline_->ReleaseBuffer(buffer);
+        base::subtle::NoBarrier_Store(&failed_, 1);
+        return;
+      }
+
+      // The writer thread takes ownership of the buffer until it's written.
+      writer_loop_->PostTask(
+          FROM_HERE,
+          base::Bind(&CoffRelinkPipeline::WriteObject,
+                     base::Unretained(pipeline_),
+                     object.output_path,
+                     base::Unretained(buffer)));
+    }
+  }
+  // @}
+
+  // @returns true iff all the objects were relinked successfully.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+ private:
+  CoffRelinkPipeline* pipeline_;
+  base::MessageLoop* writer_loop_;
+
+  // One past the index of the next object to relink.
+  base::subtle::Atomic32 next_object_;
+
+  // Set to 1 as soon as an object fails to be relinked.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+CoffRelinkPipeline::CoffRelinkPipeline(
+    const CoffTransformPolicy* transform_policy)
+    : transform_policy_(transform_policy),
+      jobs_(1),
+      allow_overwrite_(false),
+      buffer_available_(&buffer_lock_),
+      max_buffers_(0),
+      write_failed_(0) {
+  DCHECK(transform_policy != NULL);
+}
+
+void CoffRelinkPipeline::AddObject(const base::FilePath& input_path,
+                                   const base::FilePath& output_path) {
+  Object object;
+  object.input_path = input_path;
+  object.output_path = output_path;
+  objects_.push_back(object);
+}
+
+bool CoffRelinkPipeline::Relink() {
+  if (objects_.empty())
+    return true;
+
+  size_t num_threads = std::min(jobs_, objects_.size());
+  max_buffers_ = num_threads * kPendingWritesPerJob;
+  base::subtle::NoBarrier_Store(&write_failed_, 0);
+
+  base::Thread writer_thread("CoffRelinkPipelineWriter");
+  if (!writer_thread.Start()) {
+    LOG(ERROR) << "Unable to start the writer thread.";
+    return false;
+  }
+
+  Worker worker(this, writer_thread.message_loop());
+  base::DelegateSimpleThreadPool pool("CoffRelinkPipeline", num_threads);
+  pool.Start();
+  pool.AddWork(&worker, num_threads);
+  pool.JoinAll();
+
+  // Stopping the writer thread lets it finish the writes that are pending.
+  writer_thread.Stop();
+
+  if (!worker.succeeded())
+    return false;
+  if (base::subtle::NoBarrier_Load(&write_failed_) != 0)
+    return false;
+
+  return true;
+}
+
+bool CoffRelinkPipeline::RelinkObject(const Object& object,
+                                      std::vector<uint8>* buffer) {
+  DCHECK(buffer != NULL);
+
+  CoffRelinker relinker(transform_policy_);
+  relinker.set_input_path(object.input_path);
+  relinker.set_output_path(object.output_path);
+  relinker.set_allow_overwrite(allow_overwrite_);
+  if (!relinker.Init())
+    return false;
+
+  // This holds any transform that the callback allocates. It must outlive the
+  // relinking below.
+  ScopedVector<Transform> transforms;
+  if (!configure_callback_.is_null() &&
+      !configure_callback_.Run(&relinker, &transforms)) {
+    LOG(ERROR) << "Unable to configure the relinker for: "
+               << object.input_path.value() << ".";
+    return false;
+  }
+
+  if (!relinker.RelinkToBuffer(buffer))
+    return false;
+
+  return true;
+}
+
+void CoffRelinkPipeline::WriteObject(const base::FilePath& path,
+                                     std::vector<uint8>* buffer) {
+  DCHECK(buffer != NULL);
+
+  // There is no point in writing anything once a write has failed, as the
+  // workers are winding down.
+  if (base::subtle::NoBarrier_Load(&write_failed_) == 0) {
+    const char* data = buffer->empty() ?
+        "" : reinterpret_cast<const char*>(&buffer->at(0));
+    int size = static_cast<int>(buffer->size());
+    if (base::WriteFile(path, data, size) != size) {
+      LOG(ERROR) << "Failed to write image: " << path.value() << ".";
+      base::subtle::NoBarrier_Store(&write_failed_, 1);
+    } else {
+      LOG(INFO) << "Wrote image to file: " << path.value() << ".";
+    }
+  }
+
+  ReleaseBuffer(buffer);
+}
+
+std::vector<uint8>* CoffRelinkPipeline::AcquireBuffer() {
+  base::AutoLock auto_lock(buffer_lock_);
+  while (free_buffers_.empty() && buffers_.size() >= max_buffers_)
+    buffer_available_.Wait();
+
+  if (free_buffers_.empty()) {
+    buffers_.push_back(new std::vector<uint8>());
+    return buffers_.back();
+  }
+
+  std::vector<uint8>* buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+void CoffRelinkPipeline::ReleaseBuffer(std::vector<uint8>* buffer) {
+  DCHECK(buffer != NULL);
+  base::AutoLock auto_lock(buffer_lock_);
+  free_buffers_.push_back(buffer);
+  buffer_available_.Signal();
+}
+
+}  // namespace pe
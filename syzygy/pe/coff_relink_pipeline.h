@@ -0,0 +1,163 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//
+// Declares CoffRelinkPipeline, which relinks a collection of COFF object files
+// with a pool of worker threads. Each worker decomposes, transforms and lays
+// out one object at a time, and serializes it to memory. The serialized
+// objects are written to disk by a dedicated writer thread, so that the
+// workers never wait on I/O. The serialization buffers are recycled between
+// objects, and their number is bounded so that the workers can't get too far
+// ahead of the writer.
+//
+// It is intended to be used as follows:
+//
+//   CoffRelinkPipeline pipeline(&policy);
+//   pipeline.set_jobs(4);
+//   pipeline.set_configure_callback(base::Bind(&AddMyTransforms));
+//   pipeline.AddObject(input_path_1, output_path_1);
+//   pipeline.AddObject(input_path_2, output_path_2);
+//   ...
+//   pipeline.Relink();  // Check the return value!
+
+#ifndef SYZYGY_PE_COFF_RELINK_PIPELINE_H_
+#define SYZYGY_PE_COFF_RELINK_PIPELINE_H_
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/files/file_path.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/pe/coff_relinker.h"
+#include "syzygy/pe/coff_transform_policy.h"
+
+namespace pe {
+
+class CoffRelinkPipeline {
+ public:
+  typedef block_graph::BlockGraphTransformInterface Transform;
+
+  // The callback used to configure the relinker of each object. It is invoked
+  // after the object has been decomposed, and may append transforms and
+  // orderers to the relinker. Any transform it allocates should be given to
+  // @p transforms, which outlives the relinking of the object. This is
+  // invoked concurrently from the worker threads when jobs() > 1.
+  typedef base::Callback<bool(CoffRelinker* relinker,
+                              ScopedVector<Transform>* transforms)>
+      ConfigureCallback;
+
+  // The default number of serialized objects that may be waiting to be
+  // written, per worker.
+  static const size_t kPendingWritesPerJob = 2;
+
+  // Constructor.
+  // @param transform_policy The policy that dictates how to apply transforms.
+  //     This is shared by all of the workers.
+  explicit CoffRelinkPipeline(const CoffTransformPolicy* transform_policy);
+
+  // Adds an object to be relinked.
+  // @param input_path the path of the object to read.
+  // @param output_path the path of the object to write.
+  void AddObject(const base::FilePath& input_path,
+                 const base::FilePath& output_path);
+
+  // Relinks all of the objects that have been added.
+  // @returns true on success, false if any of the objects failed to be
+  //     relinked or written.
+  bool Relink();
+
+  // @name Accessors.
+  // @{
+  size_t jobs() const { return jobs_; }
+  bool allow_overwrite() const { return allow_overwrite_; }
+  size_t object_count() const { return objects_.size(); }
+  // @}
+
+  // @name Mutators.
+  // @{
+  void set_jobs(size_t jobs) {
+    DCHECK_LT(0u, jobs);
+    jobs_ = jobs;
+  }
+  void set_allow_overwrite(bool allow_overwrite) {
+    allow_overwrite_ = allow_overwrite;
+  }
+  void set_configure_callback(const ConfigureCallback& callback) {
+    configure_callback_ = callback;
+  }
+  // @}
+
+ protected:
+  // An object to be relinked.
+  struct Object {
+    base::FilePath input_path;
+    base::FilePath output_path;
+  };
+
+  class Worker;
+
+  // Relinks a single object into @p buffer. This is invoked from the worker
+  // threads.
+  // @param object the object to relink.
+  // @param buffer the buffer that receives the object.
+  // @returns true on success, false otherwise.
+  bool RelinkObject(const Object& object, std::vector<uint8>* buffer);
+
+  // Writes a serialized object to disk, and recycles its buffer. This is
+  // invoked on the writer thread.
+  // @param path the path to write to.
+  // @param buffer the serialized object.
+  void WriteObject(const base::FilePath& path, std::vector<uint8>* buffer);
+
+  // @name Buffer recycling. AcquireBuffer blocks while the maximum number of
+  //     buffers are in use.
+  // @{
+  std::vector<uint8>* AcquireBuffer();
+  void ReleaseBuffer(std::vector<uint8>* buffer);
+  // @}
+
+  // The transform policy used for all of the objects.
+  const CoffTransformPolicy* transform_policy_;
+
+  // The objects to relink.
+  std::vector<Object> objects_;
+
+  // The configuration of the relinkers.
+  ConfigureCallback configure_callback_;
+  size_t jobs_;
+  bool allow_overwrite_;
+
+  // The serialization buffers. |buffers_| owns all of them, and
+  // |free_buffers_| holds those that are not currently in use. Both are
+  // protected by |buffer_lock_|.
+  base::Lock buffer_lock_;
+  base::ConditionVariable buffer_available_;
+  ScopedVector<std::vector<uint8> > buffers_;
+  std::vector<std::vector<uint8>*> free_buffers_;
+  size_t max_buffers_;
+
+  // Set to 1 as soon as an object fails to be written.
+  base::subtle::Atomic32 write_failed_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CoffRelinkPipeline);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_COFF_RELINK_PIPELINE_H_
@@ -0,0 +1,162 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "syzygy/pe/coff_relink_pipeline.h"
+
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraph;
+using block_graph::TransformPolicyInterface;
+
+// A transform that counts the number of times it is applied.
+class CountingTransform : public block_graph::BlockGraphTransformInterface {
+ public:
+  explicit CountingTransform(base::subtle::Atomic32* count) : count_(count) {
+  }
+
+  virtual const char* name() const OVERRIDE { return "CountingTransform"; }
+
+  virtual bool TransformBlockGraph(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BlockGraph::Block* header_block) OVERRIDE {
+    base::subtle::NoBarrier_AtomicIncrement(count_, 1);
+    return true;
+  }
+
+ private:
+  base::subtle::Atomic32* count_;
+};
+
+class CoffRelinkPipelineTest : public testing::PELibUnitTest {
+ public:
+  CoffRelinkPipelineTest() : configure_count_(0), transform_count_(0) {
+  }
+
+  virtual void SetUp() OVERRIDE {
+    testing::PELibUnitTest::SetUp();
+
+    test_dll_obj_path_ =
+        testing::GetExeTestDataRelativePath(testing::kTestDllCoffObjName);
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_path_));
+  }
+
+  // A configure callback that adds a counting transform.
+  bool Configure(CoffRelinker* relinker,
+                 ScopedVector<CoffRelinkPipeline::Transform>* transforms) {
+    base::subtle::NoBarrier_AtomicIncrement(&configure_count_, 1);
+    transforms->push_back(new CountingTransform(&transform_count_));
+    return relinker->AppendTransform(transforms->back());
+  }
+
+  // A configure callback that fails.
+  bool FailToConfigure(
+      CoffRelinker* relinker,
+      ScopedVector<CoffRelinkPipeline::Transform>* transforms) {
+    return false;
+  }
+
+  base::FilePath OutputPath(size_t index) {
+    return temp_dir_path_.Append(
+        base::StringPrintf(L"test_dll_%d.obj", static_cast<int>(index)));
+  }
+
+  CoffTransformPolicy policy_;
+  base::FilePath test_dll_obj_path_;
+  base::FilePath temp_dir_path_;
+  base::subtle::Atomic32 configure_count_;
+  base::subtle::Atomic32 transform_count_;
+};
+
+}  // namespace
+
+TEST_F(CoffRelinkPipelineTest, EmptyPipelineSucceeds) {
+  CoffRelinkPipeline pipeline(&policy_);
+  EXPECT_EQ(1u, pipeline.jobs());
+  EXPECT_EQ(0u, pipeline.object_count());
+  EXPECT_TRUE(pipeline.Relink());
+}
+
+TEST_F(CoffRelinkPipelineTest, RelinkMatchesCoffRelinker) {
+  // Relink the object once the usual way, for reference.
+  base::FilePath reference_path = temp_dir_path_.Append(L"reference.obj");
+  CoffRelinker relinker(&policy_);
+  relinker.set_input_path(test_dll_obj_path_);
+  relinker.set_output_path(reference_path);
+  ASSERT_TRUE(relinker.Init());
+  ASSERT_TRUE(relinker.Relink());
+  std::string reference;
+  ASSERT_TRUE(base::ReadFileToString(reference_path, &reference));
+
+  // Relink a few copies of it with the pipeline.
+  const size_t kObjectCount = 6;
+  CoffRelinkPipeline pipeline(&policy_);
+  pipeline.set_jobs(3);
+  pipeline.set_configure_callback(
+      base::Bind(&CoffRelinkPipelineTest::Configure, base::Unretained(this)));
+  for (size_t i = 0; i < kObjectCount; ++i)
+    pipeline.AddObject(test_dll_obj_path_, OutputPath(i));
+  EXPECT_EQ(kObjectCount, pipeline.object_count());
+  ASSERT_TRUE(pipeline.Relink());
+
+  EXPECT_EQ(kObjectCount, static_cast<size_t>(configure_count_));
+  EXPECT_EQ(kObjectCount, static_cast<size_t>(transform_count_));
+  for (size_t i = 0; i < kObjectCount; ++i) {
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(OutputPath(i), &contents));
+    EXPECT_EQ(reference, contents);
+  }
+}
+
+TEST_F(CoffRelinkPipelineTest, RelinkFailsOnNonexistentInput) {
+  CoffRelinkPipeline pipeline(&policy_);
+  pipeline.set_jobs(2);
+  pipeline.AddObject(test_dll_obj_path_, OutputPath(0));
+  pipeline.AddObject(temp_dir_path_.Append(L"nonexistent.obj"),
+                     OutputPath(1));
+  EXPECT_FALSE(pipeline.Relink());
+}
+
+TEST_F(CoffRelinkPipelineTest, RelinkFailsOnDisallowedOverwrite) {
+  ASSERT_TRUE(base::CopyFile(test_dll_obj_path_, OutputPath(0)));
+
+  CoffRelinkPipeline pipeline(&policy_);
+  pipeline.AddObject(test_dll_obj_path_, OutputPath(0));
+  EXPECT_FALSE(pipeline.Relink());
+
+  pipeline.set_allow_overwrite(true);
+  EXPECT_TRUE(pipeline.Relink());
+}
+
+TEST_F(CoffRelinkPipelineTest, RelinkFailsWhenConfigureFails) {
+  CoffRelinkPipeline pipeline(&policy_);
+  pipeline.set_configure_callback(
+      base::Bind(&CoffRelinkPipelineTest::FailToConfigure,
+                 base::Unretained(this)));
+  pipeline.AddObject(test_dll_obj_path_, OutputPath(0));
+  EXPECT_FALSE(pipeline.Relink());
+  EXPECT_FALSE(base::PathExists(OutputPath(0)));
+}
+
+}  // namespace pe
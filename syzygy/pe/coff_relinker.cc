@@ -141,6 +141,44 @@ bool CoffRelinker::Init() {
 }
 
 bool CoffRelinker::Relink() {
+  ImageLayout output_image_layout(&block_graph_);
+  if (!TransformAndLayOut(&output_image_layout))
+    return false;
+
+  // Write the image.
+  if (!WriteImage(output_image_layout, output_path_))
+    return false;
+
+  if (!WriteStatistics())
+    return false;
+
+  return true;
+}
+
+bool CoffRelinker::RelinkToBuffer(std::vector<uint8>* buffer) {
+  DCHECK(buffer != NULL);
+
+  ImageLayout output_image_layout(&block_graph_);
+  if (!TransformAndLayOut(&output_image_layout))
+    return false;
+
+  // Serialize the image.
+  CoffFileWriter writer(&output_image_layout);
+  if (!writer.SerializeImage(buffer)) {
+    LOG(ERROR) << "Failed to serialize image for: "
+               << output_path_.value() << ".";
+    return false;
+  }
+
+  if (!WriteStatistics())
+    return false;
+
+  return true;
+}
+
+bool CoffRelinker::TransformAndLayOut(ImageLayout* output_image_layout) {
+  DCHECK(output_image_layout != NULL);
+
   if (!inited_) {
     LOG(ERROR) << "Init() has not been successfully called.";
     return false;
@@ -170,14 +208,7 @@ bool CoffRelinker::Relink() {
     return false;
 
   // Lay it out.
-  ImageLayout output_image_layout(&block_graph_);
-  if (!BuildImageLayout(ordered_graph, headers_block_,
-                        &output_image_layout)) {
-    return false;
-  }
-
-  // Write the image.
-  if (!WriteImage(output_image_layout, output_path_))
+  if (!BuildImageLayout(ordered_graph, headers_block_, output_image_layout))
     return false;
 
   return true;
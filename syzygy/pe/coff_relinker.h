@@ -39,6 +39,8 @@
 #ifndef SYZYGY_PE_COFF_RELINKER_H_
 #define SYZYGY_PE_COFF_RELINKER_H_
 
+#include <vector>
+
 #include "syzygy/pe/coff_file.h"
 #include "syzygy/pe/coff_transform_policy.h"
 #include "syzygy/pe/pe_coff_relinker.h"
@@ -87,6 +89,16 @@ class CoffRelinker : public PECoffRelinker {
   // @returns true on success, false otherwise.
   virtual bool Relink() OVERRIDE;
 
+  // Same as Relink(), but the resulting COFF file is serialized to @p buffer
+  // rather than written to the main output path. This lets the caller write
+  // it out at its own pace, as CoffRelinkPipeline does. The output path must
+  // still be set, as it is validated by Init().
+  //
+  // @param buffer the buffer that receives the COFF file. Its storage is
+  //     reused.
+  // @returns true on success, false otherwise.
+  bool RelinkToBuffer(std::vector<uint8>* buffer);
+
   // After a successful call to Init(), retrieve the original unmodified
   // COFF file reader.
   //
@@ -99,6 +111,13 @@ class CoffRelinker : public PECoffRelinker {
   // @returns true on success, or false on failure.
   bool CheckPaths();
 
+  // Applies the transforms and orderers, and lays out the result.
+  //
+  // @param output_image_layout the layout to fill in. This must refer to
+  //     block_graph_.
+  // @returns true on success, or false on failure.
+  bool TransformAndLayOut(ImageLayout* output_image_layout);
+
   // The original COFF file reader.
   CoffFile input_image_file_;
 
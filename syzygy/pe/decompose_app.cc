@@ -20,6 +20,7 @@
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/strings/string_util.h"
 #include "base/time/time.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -49,6 +50,10 @@ const char kUsageFormatStr[] =
     "  --benchmark-load\n"
     "    Causes the output to be deserialized after serialization,\n"
     "    for benchmarking.\n"
+    "  --dia-cache-dir=<directory>\n"
+    "    Caches the results of the DIA queries in this directory, keyed by\n"
+    "    the GUID and age of the PDB. Decomposing the same image again then\n"
+    "    reuses them.\n"
     "  --graph-only\n"
     "    Causes the serialized output to only contain the block-graph, with\n"
     "    all data inlined. The PE file (and pe_lib) will not be needed to\n"
@@ -95,6 +100,7 @@ bool DecomposeApp::ParseCommandLine(const CommandLine* cmd_line) {
   }
 
   benchmark_load_ = cmd_line->HasSwitch("benchmark-load");
+  dia_cache_dir_ = cmd_line->GetSwitchValuePath("dia-cache-dir");
   graph_only_ = cmd_line->HasSwitch("graph-only");
   strip_strings_ = cmd_line->HasSwitch("strip-strings");
 
@@ -116,6 +122,7 @@ int DecomposeApp::Run() {
   BlockGraph block_graph;
   pe::ImageLayout image_layout(&block_graph);
   pe::Decomposer decomposer(pe_file);
+  decomposer.set_dia_cache_dir(dia_cache_dir_);
   {
     ScopedTimeLogger scoped_time_logger("Decomposing image");
     if (!decomposer.Decompose(&image_layout))
@@ -173,15 +180,23 @@ bool DecomposeApp::SaveDecomposedImage(
 }
 
 bool DecomposeApp::LoadDecomposedImage(const base::FilePath& file_path) const {
+  // The mapping is declared first so that it outlives the block-graph, whose
+  // blocks may refer to data in it.
+  base::MemoryMappedFile in_file;
+  if (!in_file.Initialize(file_path)) {
+    LOG(ERROR) << "Unable to map \"" << file_path.value() << "\".";
+    return false;
+  }
+
   pe::PEFile pe_file;
   BlockGraph block_graph;
 
-  base::ScopedFILE in_file(base::OpenFile(file_path, "rb"));
-  core::FileInStream in_stream(in_file.get());
+  core::MemoryInStream in_stream(in_file.data(), in_file.length());
   core::NativeBinaryInArchive in_archive(&in_stream);
 
   if (graph_only_) {
     BlockGraphSerializer bgs;
+    bgs.set_load_data_in_place(true);
     if (!bgs.Load(&block_graph, &in_archive)) {
       LOG(ERROR) << "Unable to load block-graph.";
       return false;
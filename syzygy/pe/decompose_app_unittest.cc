@@ -36,6 +36,7 @@ class TestDecomposeApp : public DecomposeApp {
   // Member variables.
   using DecomposeApp::image_path_;
   using DecomposeApp::output_path_;
+  using DecomposeApp::dia_cache_dir_;
   using DecomposeApp::benchmark_load_;
   using DecomposeApp::strip_strings_;
 };
@@ -119,6 +120,7 @@ TEST_F(DecomposeAppTest, ParseCommandLineMinimal) {
   ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
   ASSERT_EQ(image_path_, impl_.image_path_);
   ASSERT_EQ(image_path_.value() + L".bg", impl_.output_path_.value());
+  ASSERT_TRUE(impl_.dia_cache_dir_.empty());
   ASSERT_FALSE(impl_.benchmark_load_);
   ASSERT_FALSE(impl_.strip_strings_);
 }
@@ -130,12 +132,14 @@ TEST_F(DecomposeAppTest, ParseCommandLineFull) {
 
   cmd_line_.AppendSwitchPath("image", image_path_);
   cmd_line_.AppendSwitchPath("output", output_path_);
+  cmd_line_.AppendSwitchPath("dia-cache-dir", temp_dir_);
   cmd_line_.AppendSwitch("benchmark-load");
   cmd_line_.AppendSwitch("strip-strings");
 
   ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
   ASSERT_EQ(image_path_, impl_.image_path_);
   ASSERT_EQ(output_path_, impl_.output_path_);
+  ASSERT_EQ(temp_dir_, impl_.dia_cache_dir_);
   ASSERT_TRUE(impl_.benchmark_load_);
   ASSERT_TRUE(impl_.strip_strings_);
 }
@@ -19,6 +19,7 @@
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
 #include "syzygy/core/zstream.h"
@@ -83,6 +84,7 @@ typedef Decomposer::IntermediateReferences IntermediateReferences;
 typedef pcrecpp::RE RE;
 typedef std::vector<OMAP> OMAPs;
 typedef std::vector<pdb::PdbFixup> PdbFixups;
+typedef std::map<std::string, bool> CompilandSupportMap;
 
 const char kJumpTable[] = "<jump-table>";
 const char kCaseTable[] = "<case-table>";
@@ -222,6 +224,61 @@ bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
   return false;
 }
 
+// Determines for each compiland whether it was built by a supported compiler.
+// The compilands are keyed by name. When several compilands share a name they
+// are only considered supported if they all are.
+bool GetCompilandSupport(IDiaSession* session,
+                         CompilandSupportMap* compiland_support) {
+  DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
+  DCHECK_NE(reinterpret_cast<CompilandSupportMap*>(NULL), compiland_support);
+
+  ScopedComPtr<IDiaSymbol> global;
+  HRESULT hr = session->get_globalScope(global.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Failed to get the DIA global scope: "
+               << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  ScopedComPtr<IDiaEnumSymbols> compilands;
+  hr = global->findChildren(SymTagCompiland, NULL, 0, compilands.Receive());
+  if (hr != S_OK) {
+    LOG(ERROR) << "Finding compilands failed on the global symbol: "
+               << common::LogHr(hr) << ".";
+    return false;
+  }
+
+  while (true) {
+    ULONG fetched = 0;
+    ScopedComPtr<IDiaSymbol> compiland;
+    hr = compilands->Next(1, compiland.Receive(), &fetched);
+    if (hr != S_OK || fetched != 1)
+      break;
+
+    ScopedBstr bstr_compiland_name;
+    if ((hr = compiland->get_name(bstr_compiland_name.Receive())) != S_OK) {
+      LOG(ERROR) << "Failed to get compiland name: "
+                 << common::LogHr(hr) << ".";
+      return false;
+    }
+
+    std::string compiland_name;
+    if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
+                          &compiland_name)) {
+      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+      return false;
+    }
+
+    bool supported = IsBuiltBySupportedCompiler(compiland.get());
+    std::pair<CompilandSupportMap::iterator, bool> result =
+        compiland_support->insert(std::make_pair(compiland_name, supported));
+    if (!result.second)
+      result.first->second = result.first->second && supported;
+  }
+
+  return true;
+}
+
 // Adds an intermediate reference to the provided vector. The vector is
 // specified as the first parameter (in slight violation of our coding
 // standards) because this function is intended to be used by Bind.
@@ -325,6 +382,92 @@ bool LoadDebugStreams(IDiaSession* dia_session,
   return true;
 }
 
+// Reads the section contributions through DIA.
+bool GetDiaSectionContribs(IDiaSession* session,
+                           std::vector<DiaSectionContrib>* section_contribs) {
+  DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
+  DCHECK_NE(reinterpret_cast<std::vector<DiaSectionContrib>*>(NULL),
+            section_contribs);
+
+  ScopedComPtr<IDiaEnumSectionContribs> dia_section_contribs;
+  SearchResult search_result = FindDiaTable(session,
+                                            dia_section_contribs.Receive());
+  if (search_result != kSearchSucceeded) {
+    if (search_result == kSearchFailed)
+      LOG(ERROR) << "No section contribution table found.";
+    return false;
+  }
+
+  LONG count = 0;
+  if (dia_section_contribs->get_Count(&count) != S_OK) {
+    LOG(ERROR) << "Failed to get section contributions enumeration length.";
+    return false;
+  }
+
+  section_contribs->clear();
+  section_contribs->reserve(count);
+  for (LONG visited = 0; visited < count; ++visited) {
+    ScopedComPtr<IDiaSectionContrib> section_contrib;
+    ULONG fetched = 0;
+    HRESULT hr = dia_section_contribs->Next(
+        1, section_contrib.Receive(), &fetched);
+    // The standard way to end an enumeration (according to the docs) is by
+    // returning S_FALSE and setting fetched to 0. We don't actually see this,
+    // but it wouldn't be an error if we did.
+    if (hr == S_FALSE && fetched == 0)
+      break;
+    if (hr != S_OK) {
+      LOG(ERROR) << "Failed to get DIA section contribution: "
+                 << common::LogHr(hr) << ".";
+      return false;
+    }
+    // We actually end up seeing S_OK and fetched == 0 when the enumeration
+    // terminates, which goes against the publishes documentations.
+    if (fetched == 0)
+      break;
+
+    DWORD rva = 0;
+    DWORD length = 0;
+    DWORD section_id = 0;
+    BOOL code = FALSE;
+    ScopedComPtr<IDiaSymbol> compiland;
+    ScopedBstr bstr_compiland_name;
+    if ((hr = section_contrib->get_relativeVirtualAddress(&rva)) != S_OK ||
+        (hr = section_contrib->get_length(&length)) != S_OK ||
+        (hr = section_contrib->get_addressSection(&section_id)) != S_OK ||
+        (hr = section_contrib->get_code(&code)) != S_OK ||
+        (hr = section_contrib->get_compiland(compiland.Receive())) != S_OK ||
+        (hr = compiland->get_name(bstr_compiland_name.Receive())) != S_OK) {
+      LOG(ERROR) << "Failed to get section contribution properties: "
+                 << common::LogHr(hr) << ".";
+      return false;
+    }
+
+    DiaSectionContrib dia_section_contrib;
+    dia_section_contrib.rva = rva;
+    dia_section_contrib.length = length;
+    dia_section_contrib.code = code != FALSE;
+
+    // Determine if this function was built by a supported compiler.
+    dia_section_contrib.is_built_by_supported_compiler =
+        IsBuiltBySupportedCompiler(compiland.get());
+
+    // DIA numbers sections from 1 to n, while we do 0 to n - 1.
+    DCHECK_LT(0u, section_id);
+    dia_section_contrib.section_id = section_id - 1;
+
+    if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
+                          &dia_section_contrib.compiland_name)) {
+      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+      return false;
+    }
+
+    section_contribs->push_back(dia_section_contrib);
+  }
+
+  return true;
+}
+
 bool GetFixupDestinationAndType(const PEFile& image_file,
                                 const pdb::PdbFixup& fixup,
                                 RelativeAddress* dst_addr,
@@ -411,6 +554,20 @@ bool CreateReferencesFromFixupsImpl(
     rsrc_end = rsrc_start + rsrc_header->Misc.VirtualSize;
   }
 
+  // Get the original addresses, and map them through OMAP information.
+  // Normally DIA takes care of this for us, but there is no API for getting
+  // DIA to give us FIXUP information, so we have to do it manually. The
+  // location and base of fixup i are at positions 2 * i and 2 * i + 1. They
+  // are all mapped in a single sweep of the OMAP vector.
+  std::vector<RelativeAddress> fixup_addresses;
+  fixup_addresses.reserve(2 * pdb_fixups.size());
+  for (size_t i = 0; i < pdb_fixups.size(); ++i) {
+    fixup_addresses.push_back(RelativeAddress(pdb_fixups[i].rva_location));
+    fixup_addresses.push_back(RelativeAddress(pdb_fixups[i].rva_base));
+  }
+  if (have_omap)
+    pdb::TranslateAddressesViaOmap(omap_from, &fixup_addresses);
+
   // Ensure the fixups are all valid.
   for (size_t i = 0; i < pdb_fixups.size(); ++i) {
     if (!pdb_fixups[i].ValidHeader()) {
@@ -427,15 +584,8 @@ bool CreateReferencesFromFixupsImpl(
     // All fixups we handle should be full size pointers.
     DCHECK_EQ(Reference::kMaximumSize, pdb_fixups[i].size());
 
-    // Get the original addresses, and map them through OMAP information.
-    // Normally DIA takes care of this for us, but there is no API for
-    // getting DIA to give us FIXUP information, so we have to do it manually.
-    RelativeAddress src_addr(pdb_fixups[i].rva_location);
-    RelativeAddress base_addr(pdb_fixups[i].rva_base);
-    if (have_omap) {
-      src_addr = pdb::TranslateAddressViaOmap(omap_from, src_addr);
-      base_addr = pdb::TranslateAddressViaOmap(omap_from, base_addr);
-    }
+    RelativeAddress src_addr(fixup_addresses[2 * i]);
+    RelativeAddress base_addr(fixup_addresses[2 * i + 1]);
 
     // If the reference originates beyond the .rsrc section then we can't
     // trust it.
@@ -808,11 +958,120 @@ struct Decomposer::VisitLinkerSymbolContext {
   DISALLOW_COPY_AND_ASSIGN(VisitLinkerSymbolContext);
 };
 
+// Reads the DBI, FIXUP and OMAP_FROM streams of a PDB file on a worker
+// thread. It uses its own PdbFile, as the streams of a PdbFile share a file
+// handle and can't be read concurrently.
+class Decomposer::PdbStreamLoader
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit PdbStreamLoader(const base::FilePath& pdb_path)
+      : pdb_path_(pdb_path), succeeded_(false) {
+  }
+
+  // Waits for the worker thread, if it was started.
+  ~PdbStreamLoader() {
+    Join();
+  }
+
+  // Starts loading the streams on the worker thread.
+  void Start() {
+    DCHECK(thread_.get() == NULL);
+    thread_.reset(new base::DelegateSimpleThread(this, "PdbStreamLoader"));
+    thread_->Start();
+  }
+
+  // Waits for the streams to be loaded.
+  // @returns true iff they were loaded successfully.
+  bool Join() {
+    if (thread_.get() != NULL) {
+      thread_->Join();
+      thread_.reset();
+    }
+    return succeeded_;
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    succeeded_ = Load();
+  }
+  // @}
+
+  // @name Accessors. Only valid once Join has returned true.
+  // @{
+  const pdb::DbiStream& dbi() const { return dbi_; }
+  const PdbFixups& fixups() const { return fixups_; }
+  const OMAPs& omap_from() const { return omap_from_; }
+  // @}
+
+ private:
+  bool Load();
+
+  base::FilePath pdb_path_;
+  scoped_ptr<base::DelegateSimpleThread> thread_;
+  bool succeeded_;
+
+  pdb::DbiStream dbi_;
+  PdbFixups fixups_;
+  OMAPs omap_from_;
+
+  DISALLOW_COPY_AND_ASSIGN(PdbStreamLoader);
+};
+
+bool Decomposer::PdbStreamLoader::Load() {
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  pdb_reader.set_memory_mapped(true);
+  if (!pdb_reader.Read(pdb_path_, &pdb_file)) {
+    LOG(ERROR) << "Failed to read PDB file: " << pdb_path_.value() << ".";
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> stream = pdb_file.GetStream(pdb::kDbiStream);
+  if (stream.get() == NULL) {
+    LOG(ERROR) << "PDB does not contain a DBI stream.";
+    return false;
+  }
+
+  // Read the entire DBI stream into memory before parsing it.
+  scoped_refptr<pdb::PdbByteStream> dbi_stream(new pdb::PdbByteStream());
+  if (!dbi_stream->Init(stream) || !dbi_.Read(dbi_stream.get())) {
+    LOG(ERROR) << "Unable to parse DBI stream.";
+    return false;
+  }
+
+  // The fixups must exist.
+  const pdb::DbiDbgHeader& dbg_header = dbi_.dbg_header();
+  stream = dbg_header.fixup < 0 ? NULL : pdb_file.GetStream(dbg_header.fixup);
+  if (stream.get() == NULL) {
+    LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
+                  "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
+    return false;
+  }
+  if (!stream->Read(&fixups_)) {
+    LOG(ERROR) << "Failed to read the FIXUP stream.";
+    return false;
+  }
+
+  // The OMAP_FROM stream is optional, but has to be readable if present.
+  if (dbg_header.omap_from_src >= 0 &&
+      !pdb::ReadOmapsFromPdbFile(pdb_file, NULL, &omap_from_)) {
+    LOG(ERROR) << "Failed to read the OMAP_FROM stream.";
+    return false;
+  }
+
+  return true;
+}
+
 Decomposer::Decomposer(const PEFile& image_file)
-    : image_file_(image_file), image_layout_(NULL), image_(NULL),
+    : image_file_(image_file), use_pdb_streams_(false),
+      dia_results_cached_(false), image_layout_(NULL), image_(NULL),
       current_block_(NULL), current_scope_count_(0) {
 }
 
+Decomposer::~Decomposer() {
+}
+
 bool Decomposer::Decompose(ImageLayout* image_layout) {
   DCHECK_NE(reinterpret_cast<ImageLayout*>(NULL), image_layout);
 
@@ -822,6 +1081,7 @@ bool Decomposer::Decompose(ImageLayout* image_layout) {
 
   // Set the image format.
   image_layout->blocks.graph()->set_image_format(BlockGraph::PE_IMAGE);
+  dia_results_cached_ = false;
 
   // We start by finding the PDB path.
   if (!FindAndValidatePdbPath())
@@ -846,6 +1106,8 @@ bool Decomposer::Decompose(ImageLayout* image_layout) {
   bool success = DecomposeImpl();
   image_layout_ = NULL;
   image_ = NULL;
+  pdb_stream_loader_.reset();
+  dia_results_ = DiaQueryResults();
 
   return success;
 }
@@ -890,9 +1152,8 @@ bool Decomposer::LoadBlockGraphFromPdbStream(
     return false;
   DCHECK_NE(reinterpret_cast<pdb::PdbByteStream*>(NULL), byte_stream.get());
 
-  core::ScopedInStreamPtr pdb_in_stream;
-  pdb_in_stream.reset(core::CreateByteInStream(
-      byte_stream->data(), byte_stream->data() + byte_stream->length()));
+  core::ScopedInStreamPtr pdb_in_stream(new core::MemoryInStream(
+      byte_stream->data(), byte_stream->length()));
 
   // Read the header.
   uint32 stream_version = 0;
@@ -905,8 +1166,10 @@ bool Decomposer::LoadBlockGraphFromPdbStream(
     return false;
   }
 
-  // Check the stream version.
-  if (stream_version != pdb::kSyzygyBlockGraphStreamVersion) {
+  // Check the stream version. Version 1 streams differ only in their
+  // compression.
+  if (stream_version != pdb::kSyzygyBlockGraphStreamVersion &&
+      stream_version != pdb::kSyzygyBlockGraphStreamVersion1) {
     LOG(ERROR) << "PDB contains an unsupported Syzygy block-graph stream"
                << " version (got " << stream_version << ", expected "
                << pdb::kSyzygyBlockGraphStreamVersion << ").";
@@ -916,13 +1179,23 @@ bool Decomposer::LoadBlockGraphFromPdbStream(
   // If the stream is compressed insert the decompression filter.
   core::InStream* in_stream = pdb_in_stream.get();
   scoped_ptr<core::ZInStream> zip_in_stream;
+  scoped_ptr<core::ParallelZInStream> parallel_zip_in_stream;
   if (compressed != 0) {
-    zip_in_stream.reset(new core::ZInStream(in_stream));
-    if (!zip_in_stream->Init()) {
-      LOG(ERROR) << "Unable to initialize ZInStream.";
-      return false;
+    if (stream_version == pdb::kSyzygyBlockGraphStreamVersion1) {
+      zip_in_stream.reset(new core::ZInStream(in_stream));
+      if (!zip_in_stream->Init()) {
+        LOG(ERROR) << "Unable to initialize ZInStream.";
+        return false;
+      }
+      in_stream = zip_in_stream.get();
+    } else {
+      parallel_zip_in_stream.reset(new core::ParallelZInStream(in_stream));
+      if (!parallel_zip_in_stream->Init()) {
+        LOG(ERROR) << "Unable to initialize ParallelZInStream.";
+        return false;
+      }
+      in_stream = parallel_zip_in_stream.get();
     }
-    in_stream = zip_in_stream.get();
   }
 
   // Deserialize the image-layout.
@@ -946,6 +1219,7 @@ bool Decomposer::LoadBlockGraphFromPdb(const base::FilePath& pdb_path,
 
   pdb::PdbFile pdb_file;
   pdb::PdbReader pdb_reader;
+  pdb_reader.set_memory_mapped(true);
   if (!pdb_reader.Read(pdb_path, &pdb_file)) {
     LOG(ERROR) << "Unable to read the PDB named \"" << pdb_path.value()
                << "\".";
@@ -979,6 +1253,13 @@ bool Decomposer::LoadBlockGraphFromPdb(const base::FilePath& pdb_path,
 }
 
 bool Decomposer::DecomposeImpl() {
+  // Start reading the PDB streams, if requested. This proceeds in parallel
+  // with the DIA initialization and the parsing of the PE structures.
+  if (use_pdb_streams_) {
+    pdb_stream_loader_.reset(new PdbStreamLoader(pdb_path_));
+    pdb_stream_loader_->Start();
+  }
+
   // Instantiate and initialize our Debug Interface Access session. This logs
   // verbosely for us.
   ScopedComPtr<IDiaDataSource> dia_source;
@@ -989,6 +1270,23 @@ bool Decomposer::DecomposeImpl() {
     return false;
   }
 
+  // Reuse the results of the DIA queries made by a previous decomposition of
+  // the same PDB, if they were cached.
+  pdb::PdbInfoHeader70 pdb_header = {};
+  bool use_dia_cache = !dia_cache_dir_.empty() && !use_pdb_streams_;
+  if (use_dia_cache) {
+    if (!pdb::ReadPdbHeader(pdb_path_, &pdb_header)) {
+      LOG(ERROR) << "Unable to read PDB header: " << pdb_path_.value();
+      return false;
+    }
+    DiaCache dia_cache(dia_cache_dir_);
+    dia_results_cached_ = dia_cache.Load(pdb_header.signature,
+                                         pdb_header.pdb_age,
+                                         &dia_results_);
+    if (dia_results_cached_)
+      VLOG(1) << "Using cached DIA query results.";
+  }
+
   // Copy the image headers to the layout.
   CopySectionHeadersToImageLayout(
       image_file_.nt_headers()->FileHeader.NumberOfSections,
@@ -1020,8 +1318,15 @@ bool Decomposer::DecomposeImpl() {
     // existing PE parsed blocks, but when they do we expect them to be exact
     // collisions.
     VLOG(1) << "Parsing section contributions.";
-    if (!CreateBlocksFromSectionContribs(dia_session.get()))
-      return false;
+    if (pdb_stream_loader_.get() != NULL) {
+      if (!pdb_stream_loader_->Join())
+        return false;
+      if (!CreateBlocksFromDbiSectionContribs(dia_session.get()))
+        return false;
+    } else {
+      if (!CreateBlocksFromSectionContribs(dia_session.get()))
+        return false;
+    }
 
     VLOG(1) << "Finding cold blocks.";
     if (!FindColdBlocksFromCompilands(dia_session.get()))
@@ -1043,6 +1348,16 @@ bool Decomposer::DecomposeImpl() {
   if (!CreateReferencesFromFixups(dia_session.get()))
     return false;
 
+  // A failure to cache the DIA query results only costs the next
+  // decomposition some time.
+  if (use_dia_cache && !dia_results_cached_) {
+    DiaCache dia_cache(dia_cache_dir_);
+    if (!dia_cache.Store(pdb_header.signature, pdb_header.pdb_age,
+                         dia_results_)) {
+      LOG(WARNING) << "Unable to cache the DIA query results.";
+    }
+  }
+
   // Annotate the block-graph with symbol information.
   VLOG(1) << "Parsing symbols.";
   if (!ProcessSymbols(global.get()))
@@ -1088,6 +1403,7 @@ bool Decomposer::CreatePEImageBlocksAndReferences(
 bool Decomposer::CreateBlocksFromCoffGroups() {
   pdb::PdbFile pdb_file;
   pdb::PdbReader pdb_reader;
+  pdb_reader.set_memory_mapped(true);
   if (!pdb_reader.Read(pdb_path_, &pdb_file)) {
     LOG(ERROR) << "Failed to load PDB: " << pdb_path_.value();
     return false;
@@ -1116,119 +1432,143 @@ bool Decomposer::CreateBlocksFromCoffGroups() {
 }
 
 bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
-  ScopedComPtr<IDiaEnumSectionContribs> section_contribs;
-  SearchResult search_result = FindDiaTable(session,
-                                            section_contribs.Receive());
-  if (search_result != kSearchSucceeded) {
-    if (search_result == kSearchFailed)
-      LOG(ERROR) << "No section contribution table found.";
+  if (!dia_results_cached_ &&
+      !GetDiaSectionContribs(session, &dia_results_.section_contribs)) {
     return false;
   }
 
   size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
 
-  LONG count = 0;
-  if (section_contribs->get_Count(&count) != S_OK) {
-    LOG(ERROR) << "Failed to get section contributions enumeration length.";
-    return false;
-  }
+  for (size_t i = 0; i < dia_results_.section_contribs.size(); ++i) {
+    const DiaSectionContrib& section_contrib =
+        dia_results_.section_contribs[i];
 
-  for (LONG visited = 0; visited < count; ++visited) {
-    ScopedComPtr<IDiaSectionContrib> section_contrib;
-    ULONG fetched = 0;
-    HRESULT hr = section_contribs->Next(1, section_contrib.Receive(), &fetched);
-    // The standard way to end an enumeration (according to the docs) is by
-    // returning S_FALSE and setting fetched to 0. We don't actually see this,
-    // but it wouldn't be an error if we did.
-    if (hr == S_FALSE && fetched == 0)
-      break;
-    if (hr != S_OK) {
-      LOG(ERROR) << "Failed to get DIA section contribution: "
-                 << common::LogHr(hr) << ".";
-      return false;
-    }
-    // We actually end up seeing S_OK and fetched == 0 when the enumeration
-    // terminates, which goes against the publishes documentations.
-    if (fetched == 0)
-      break;
+    // We don't parse the resource section, as it is parsed by the PEFileParser.
+    if (section_contrib.section_id == rsrc_id)
+      continue;
 
-    DWORD rva = 0;
-    DWORD length = 0;
-    DWORD section_id = 0;
-    BOOL code = FALSE;
-    ScopedComPtr<IDiaSymbol> compiland;
-    ScopedBstr bstr_compiland_name;
-    if ((hr = section_contrib->get_relativeVirtualAddress(&rva)) != S_OK ||
-        (hr = section_contrib->get_length(&length)) != S_OK ||
-        (hr = section_contrib->get_addressSection(&section_id)) != S_OK ||
-        (hr = section_contrib->get_code(&code)) != S_OK ||
-        (hr = section_contrib->get_compiland(compiland.Receive())) != S_OK ||
-        (hr = compiland->get_name(bstr_compiland_name.Receive())) != S_OK) {
-      LOG(ERROR) << "Failed to get section contribution properties: "
-                 << common::LogHr(hr) << ".";
+    if (!CreateSectionContribBlock(
+            RelativeAddress(section_contrib.rva), section_contrib.length,
+            section_contrib.code, section_contrib.compiland_name,
+            section_contrib.is_built_by_supported_compiler)) {
       return false;
     }
+  }
 
-    // Determine if this function was built by a supported compiler.
-    bool is_built_by_supported_compiler =
-        IsBuiltBySupportedCompiler(compiland.get());
+  return true;
+}
 
-    // DIA numbers sections from 1 to n, while we do 0 to n - 1.
-    DCHECK_LT(0u, section_id);
-    --section_id;
+bool Decomposer::CreateBlocksFromDbiSectionContribs(IDiaSession* session) {
+  DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
+  DCHECK_NE(reinterpret_cast<PdbStreamLoader*>(NULL),
+            pdb_stream_loader_.get());
+
+  // The section contributions are expressed relative to the sections of the
+  // original image, which DIA maps through OMAP for us. Leave that to DIA.
+  if (!pdb_stream_loader_->omap_from().empty())
+    return CreateBlocksFromSectionContribs(session);
+
+  // The compiler of each compiland is only available through DIA. There are
+  // far fewer compilands than section contributions though.
+  CompilandSupportMap compiland_support;
+  if (!GetCompilandSupport(session, &compiland_support))
+    return false;
+
+  const pdb::DbiStream& dbi = pdb_stream_loader_->dbi();
+  size_t num_sections = image_file_.nt_headers()->FileHeader.NumberOfSections;
+  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
+
+  for (size_t i = 0; i < dbi.section_contribs().size(); ++i) {
+    const pdb::DbiSectionContrib& section_contrib = dbi.section_contribs()[i];
+
+    // The PDB numbers sections from 1 to n, while we do 0 to n - 1.
+    if (section_contrib.section <= 0 ||
+        static_cast<size_t>(section_contrib.section) > num_sections) {
+      LOG(ERROR) << "Section contribution refers to invalid section "
+                 << section_contrib.section << ".";
+      return false;
+    }
+    size_t section_id = section_contrib.section - 1;
 
     // We don't parse the resource section, as it is parsed by the PEFileParser.
     if (section_id == rsrc_id)
       continue;
 
-    std::string compiland_name;
-    if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
-                          &compiland_name)) {
-      LOG(ERROR) << "Failed to convert compiland name to UTF8.";
+    if (section_contrib.module < 0 ||
+        static_cast<size_t>(section_contrib.module) >= dbi.modules().size()) {
+      LOG(ERROR) << "Section contribution refers to invalid module "
+                 << section_contrib.module << ".";
       return false;
     }
+    const std::string& compiland_name =
+        dbi.modules()[section_contrib.module].module_name();
 
-    // Give a name to the block based on the basename of the object file. This
-    // will eventually be replaced by the full symbol name, if one exists for
-    // the block.
-    size_t last_component = compiland_name.find_last_of('\\');
-    size_t extension = compiland_name.find_last_of('.');
-    if (last_component == std::string::npos) {
-      last_component = 0;
-    } else {
-      // We don't want to include the last slash.
-      ++last_component;
-    }
-    if (extension < last_component)
-      extension = compiland_name.size();
-    std::string name = compiland_name.substr(last_component,
-                                             extension - last_component);
-
-    // TODO(chrisha): We see special section contributions with the name
-    //     "* CIL *". These are concatenations of data symbols and can very
-    //     likely be chunked using symbols directly. A cursory visual inspection
-    //     of symbol names hints that these might be related to WPO.
-
-    // Create the block.
-    BlockType block_type =
-        code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
-    Block* block = CreateBlockOrFindCoveringPeBlock(
-        block_type, RelativeAddress(rva), length, name);
-    if (block == NULL) {
-      LOG(ERROR) << "Unable to create block for compiland \""
-                 << compiland_name << "\".";
+    // Compilands without details aren't seen by DIA as supported either.
+    CompilandSupportMap::const_iterator support_it =
+        compiland_support.find(compiland_name);
+    bool is_built_by_supported_compiler =
+        support_it != compiland_support.end() && support_it->second;
+
+    RelativeAddress rva(
+        image_file_.section_header(section_id)->VirtualAddress +
+        section_contrib.offset);
+    bool code = (section_contrib.flags & IMAGE_SCN_CNT_CODE) != 0;
+    if (!CreateSectionContribBlock(rva, section_contrib.size, code,
+                                   compiland_name,
+                                   is_built_by_supported_compiler)) {
       return false;
     }
+  }
 
-    // Set the block compiland name.
-    block->set_compiland_name(compiland_name);
+  return true;
+}
 
-    // Set the block attributes.
-    block->set_attribute(BlockGraph::SECTION_CONTRIB);
-    if (!is_built_by_supported_compiler)
-      block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+bool Decomposer::CreateSectionContribBlock(
+    RelativeAddress address,
+    BlockGraph::Size size,
+    bool code,
+    const std::string& compiland_name,
+    bool is_built_by_supported_compiler) {
+  // Give a name to the block based on the basename of the object file. This
+  // will eventually be replaced by the full symbol name, if one exists for
+  // the block.
+  size_t last_component = compiland_name.find_last_of('\\');
+  size_t extension = compiland_name.find_last_of('.');
+  if (last_component == std::string::npos) {
+    last_component = 0;
+  } else {
+    // We don't want to include the last slash.
+    ++last_component;
+  }
+  if (extension < last_component)
+    extension = compiland_name.size();
+  std::string name = compiland_name.substr(last_component,
+                                           extension - last_component);
+
+  // TODO(chrisha): We see special section contributions with the name
+  //     "* CIL *". These are concatenations of data symbols and can very
+  //     likely be chunked using symbols directly. A cursory visual inspection
+  //     of symbol names hints that these might be related to WPO.
+
+  // Create the block.
+  BlockType block_type =
+      code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
+  Block* block = CreateBlockOrFindCoveringPeBlock(
+      block_type, address, size, name);
+  if (block == NULL) {
+    LOG(ERROR) << "Unable to create block for compiland \""
+               << compiland_name << "\".";
+    return false;
   }
 
+  // Set the block compiland name.
+  block->set_compiland_name(compiland_name);
+
+  // Set the block attributes.
+  block->set_attribute(BlockGraph::SECTION_CONTRIB);
+  if (!is_built_by_supported_compiler)
+    block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+
   return true;
 }
 
@@ -1411,15 +1751,23 @@ bool Decomposer::CreateReferencesFromFixups(IDiaSession* session) {
   if (!image_file_.DecodeRelocs(&reloc_set))
     return false;
 
-  OMAPs omap_from;
-  PdbFixups fixups;
-  if (!LoadDebugStreams(session, &fixups, &omap_from))
+  // Use the streams that were read directly from the PDB if there are any,
+  // otherwise get them through DIA unless they were cached.
+  const OMAPs* omap_from = &dia_results_.omap_from;
+  const PdbFixups* fixups = &dia_results_.fixups;
+  if (pdb_stream_loader_.get() != NULL) {
+    omap_from = &pdb_stream_loader_->omap_from();
+    fixups = &pdb_stream_loader_->fixups();
+  } else if (!dia_results_cached_ &&
+             !LoadDebugStreams(session, &dia_results_.fixups,
+                               &dia_results_.omap_from)) {
     return false;
+  }
 
   // While creating references from the fixups this removes the
   // corresponding reference data from the relocs. We use this as a kind of
   // double-entry bookkeeping to ensure all is well and right in the world.
-  if (!CreateReferencesFromFixupsImpl(image_file_, fixups, omap_from,
+  if (!CreateReferencesFromFixupsImpl(image_file_, *fixups, *omap_from,
                                       &reloc_set, image_)) {
     return false;
   }
@@ -20,11 +20,14 @@
 
 #include <windows.h>  // NOLINT
 #include <dia2.h>
+#include <string>
 #include <vector>
 
+#include "base/memory/scoped_ptr.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_stream.h"
 #include "syzygy/pe/dia_browser.h"
+#include "syzygy/pe/dia_cache.h"
 #include "syzygy/pe/image_layout.h"
 #include "syzygy/pe/pe_file.h"
 
@@ -48,6 +51,8 @@ class Decomposer {
   //     instance of the decomposer.
   explicit Decomposer(const PEFile& image_file);
 
+  ~Decomposer();
+
   // Decomposes the image file into a BlockGraph and an ImageLayout, which
   // have the breakdown of code and data blocks with typed references and
   // information on where the blocks resided in the original image,
@@ -63,6 +68,24 @@ class Decomposer {
   // @param pdb_path the path to the PDB file to be used in decomposing the
   //     image.
   void set_pdb_path(const base::FilePath& pdb_path) { pdb_path_ = pdb_path; }
+  // Enables reading the section contributions, fixups and OMAP information
+  // directly from the PDB streams. These are loaded on a worker thread while
+  // the PE structures are being parsed, rather than through DIA. DIA is still
+  // used for the compiland details and the symbols, and for the section
+  // contributions of images that carry OMAP information. Defaults to false.
+  // @param use_pdb_streams true to read the PDB streams directly.
+  void set_use_pdb_streams(bool use_pdb_streams) {
+    use_pdb_streams_ = use_pdb_streams;
+  }
+  // Enables caching the section contributions, fixups and OMAP information
+  // that are queried through DIA in @p dia_cache_dir. They are then loaded
+  // from the cache when a PDB with the same GUID and age is decomposed again.
+  // This is not used when the PDB streams are read directly. Defaults to an
+  // empty path, which disables the cache.
+  // @param dia_cache_dir the directory holding the cache files.
+  void set_dia_cache_dir(const base::FilePath& dia_cache_dir) {
+    dia_cache_dir_ = dia_cache_dir;
+  }
   // @}
 
   // @name Accessors
@@ -72,12 +95,22 @@ class Decomposer {
   // decomposition.
   // @returns the PDB path.
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  // @returns true iff the PDB streams are read directly.
+  bool use_pdb_streams() const { return use_pdb_streams_; }
+  // @returns the DIA cache directory, or an empty path if there is none.
+  const base::FilePath& dia_cache_dir() const { return dia_cache_dir_; }
+  // @returns true iff the last decomposition used cached DIA query results.
+  bool used_dia_cache() const { return dia_results_cached_; }
   // @}
 
  protected:
   typedef block_graph::BlockGraph BlockGraph;
   typedef core::RelativeAddress RelativeAddress;
 
+  // Loads the PDB streams on a worker thread. Defined in the implementation
+  // file.
+  class PdbStreamLoader;
+
   // Searches for (if necessary) the PDB file to be used in the decomposition,
   // and validates that the file exists and matches the module.
   bool FindAndValidatePdbPath();
@@ -103,8 +136,12 @@ class Decomposer {
   // Creates blocks from the COFF group symbols in the linker symbol stream.
   bool CreateBlocksFromCoffGroups();
   // Processes the SectionContribution table, creating code/data blocks from it.
+  // The table is read from dia_results_ if they were cached.
   bool CreateBlocksFromSectionContribs(IDiaSession* session);
- // Processes the Compiland table and finds cold blocks.
+  // Same as above, but uses the section contributions of the DBI stream
+  // loaded by pdb_stream_loader_. DIA is only used for the compiland details.
+  bool CreateBlocksFromDbiSectionContribs(IDiaSession* session);
+  // Processes the Compiland table and finds cold blocks.
   bool FindColdBlocksFromCompilands(IDiaSession* session);
   // Creates gap blocks to flesh out the image. After this has been run all
   // references should be resolvable.
@@ -169,6 +206,13 @@ class Decomposer {
 
   // @name Block creation members.
   // @{
+  // Creates or finds the block for a section contribution, and sets its
+  // compiland name and attributes.
+  bool CreateSectionContribBlock(RelativeAddress address,
+                                 BlockGraph::Size size,
+                                 bool code,
+                                 const std::string& compiland_name,
+                                 bool is_built_by_supported_compiler);
   // Creates a new block with the given properties, and attaches the
   // data to it. This assumes that no conflicting block exists.
   BlockGraph::Block* CreateBlock(BlockGraph::BlockType type,
@@ -197,6 +241,12 @@ class Decomposer {
   const PEFile& image_file_;
   // The path to corresponding PDB file.
   base::FilePath pdb_path_;
+  // Whether the PDB streams are read directly rather than through DIA.
+  bool use_pdb_streams_;
+  // The directory holding the cached DIA query results, if any.
+  base::FilePath dia_cache_dir_;
+  // Whether dia_results_ were loaded from the cache.
+  bool dia_results_cached_;
 
   // @name Temporaries that are only valid while inside DecomposeImpl.
   //     Prevents us from having to pass these around everywhere.
@@ -205,6 +255,11 @@ class Decomposer {
   ImageLayout* image_layout_;
   // The image address space we're decomposing to.
   BlockGraph::AddressSpace* image_;
+  // The loader of the PDB streams, if they are read directly.
+  scoped_ptr<PdbStreamLoader> pdb_stream_loader_;
+  // The results of the DIA queries, either loaded from the cache or gathered
+  // as the decomposition proceeds.
+  DiaQueryResults dia_results_;
   // @}
 
   // Data structures holding the relation between functions and their cold
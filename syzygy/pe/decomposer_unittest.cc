@@ -84,6 +84,14 @@ TEST_F(DecomposerTest, MutatorsAndAccessors) {
 
   decomposer.set_pdb_path(pdb_path);
   EXPECT_EQ(pdb_path, decomposer.pdb_path());
+
+  EXPECT_FALSE(decomposer.use_pdb_streams());
+  decomposer.set_use_pdb_streams(true);
+  EXPECT_TRUE(decomposer.use_pdb_streams());
+
+  EXPECT_TRUE(decomposer.dia_cache_dir().empty());
+  decomposer.set_dia_cache_dir(temp_dir_);
+  EXPECT_EQ(temp_dir_, decomposer.dia_cache_dir());
 }
 
 TEST_F(DecomposerTest, Decompose) {
@@ -314,6 +322,80 @@ TEST_F(DecomposerTest, Decompose) {
   EXPECT_EQ(8u, coff_group_blocks);
 }
 
+TEST_F(DecomposerTest, DecomposeWithPdbStreamsMatchesDia) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  BlockGraph dia_block_graph;
+  ImageLayout dia_image_layout(&dia_block_graph);
+  Decomposer dia_decomposer(image_file);
+  ASSERT_TRUE(dia_decomposer.Decompose(&dia_image_layout));
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  Decomposer decomposer(image_file);
+  decomposer.set_use_pdb_streams(true);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  // Both decompositions should chunk the image identically.
+  ASSERT_EQ(dia_image_layout.blocks.size(), image_layout.blocks.size());
+  BlockGraph::AddressSpace::RangeMapConstIter dia_it =
+      dia_image_layout.blocks.begin();
+  BlockGraph::AddressSpace::RangeMapConstIter it =
+      image_layout.blocks.begin();
+  for (; it != image_layout.blocks.end(); ++it, ++dia_it) {
+    EXPECT_EQ(dia_it->first.start(), it->first.start());
+    EXPECT_EQ(dia_it->first.size(), it->first.size());
+    const BlockGraph::Block* dia_block = dia_it->second;
+    const BlockGraph::Block* block = it->second;
+    EXPECT_EQ(dia_block->type(), block->type());
+    EXPECT_EQ(dia_block->name(), block->name());
+    EXPECT_EQ(dia_block->compiland_name(), block->compiland_name());
+    EXPECT_EQ(dia_block->attributes(), block->attributes());
+    EXPECT_EQ(dia_block->references().size(), block->references().size());
+  }
+}
+
+TEST_F(DecomposerTest, DecomposeWithDiaCacheMatchesDia) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  // The first decomposition populates the cache, the second uses it.
+  BlockGraph dia_block_graph;
+  ImageLayout dia_image_layout(&dia_block_graph);
+  Decomposer dia_decomposer(image_file);
+  dia_decomposer.set_dia_cache_dir(temp_dir_);
+  ASSERT_TRUE(dia_decomposer.Decompose(&dia_image_layout));
+  EXPECT_FALSE(dia_decomposer.used_dia_cache());
+
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  Decomposer decomposer(image_file);
+  decomposer.set_dia_cache_dir(temp_dir_);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+  EXPECT_TRUE(decomposer.used_dia_cache());
+
+  // Both decompositions should chunk the image identically.
+  ASSERT_EQ(dia_image_layout.blocks.size(), image_layout.blocks.size());
+  BlockGraph::AddressSpace::RangeMapConstIter dia_it =
+      dia_image_layout.blocks.begin();
+  BlockGraph::AddressSpace::RangeMapConstIter it =
+      image_layout.blocks.begin();
+  for (; it != image_layout.blocks.end(); ++it, ++dia_it) {
+    EXPECT_EQ(dia_it->first.start(), it->first.start());
+    EXPECT_EQ(dia_it->first.size(), it->first.size());
+    const BlockGraph::Block* dia_block = dia_it->second;
+    const BlockGraph::Block* block = it->second;
+    EXPECT_EQ(dia_block->type(), block->type());
+    EXPECT_EQ(dia_block->name(), block->name());
+    EXPECT_EQ(dia_block->compiland_name(), block->compiland_name());
+    EXPECT_EQ(dia_block->attributes(), block->attributes());
+    EXPECT_EQ(dia_block->references().size(), block->references().size());
+  }
+}
+
 TEST_F(DecomposerTest, DecomposeFailsWithNonexistentPdb) {
   base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
   PEFile image_file;
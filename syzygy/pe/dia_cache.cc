@@ -0,0 +1,250 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/dia_cache.h"
+
+#include <map>
+
+#include "base/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/strings/stringprintf.h"
+
+namespace pe {
+
+namespace {
+
+// The layout of a cache file is a header, followed by the section
+// contributions, the fixups, the OMAP entries and finally the compiland names
+// that the section contributions refer to.
+const uint32 kCacheMagic = 0x43414944;  // 'DIAC'.
+const uint32 kCacheVersion = 1;
+
+struct CacheHeader {
+  uint32 magic;
+  uint32 version;
+  GUID signature;
+  uint32 age;
+  uint32 section_contrib_count;
+  uint32 fixup_count;
+  uint32 omap_count;
+  uint32 names_size;
+};
+
+enum CacheSectionContribFlags {
+  kCode = 1 << 0,
+  kBuiltBySupportedCompiler = 1 << 1,
+};
+
+struct CacheSectionContrib {
+  uint32 rva;
+  uint32 length;
+  uint32 section_id;
+  uint32 flags;
+  // The compiland name, in the names at the end of the file.
+  uint32 name_offset;
+  uint32 name_length;
+};
+
+// Appends the contents of @p vector to @p file.
+template <typename T>
+bool WriteVector(const std::vector<T>& vector, FILE* file) {
+  if (vector.empty())
+    return true;
+  return ::fwrite(&vector[0], sizeof(T), vector.size(), file) ==
+      vector.size();
+}
+
+// Reads @p count elements of type T at @p offset in @p data, advancing
+// @p offset past them.
+template <typename T>
+bool ReadVector(const uint8* data,
+                size_t data_size,
+                size_t count,
+                size_t* offset,
+                std::vector<T>* vector) {
+  DCHECK(offset != NULL);
+  DCHECK(vector != NULL);
+
+  if (count > (data_size - *offset) / sizeof(T))
+    return false;
+  const T* begin = reinterpret_cast<const T*>(data + *offset);
+  vector->assign(begin, begin + count);
+  *offset += count * sizeof(T);
+  return true;
+}
+
+}  // namespace
+
+const wchar_t DiaCache::kCacheFileExtension[] = L".dia_cache";
+
+DiaCache::DiaCache(const base::FilePath& cache_dir) : cache_dir_(cache_dir) {
+}
+
+base::FilePath DiaCache::GetCacheFilePath(const GUID& signature,
+                                          uint32 age) const {
+  // This follows the naming of the symbol server.
+  std::wstring name = base::StringPrintf(
+      L"%08X%04X%04X%02X%02X%02X%02X%02X%02X%02X%02X%X",
+      signature.Data1, signature.Data2, signature.Data3,
+      signature.Data4[0], signature.Data4[1], signature.Data4[2],
+      signature.Data4[3], signature.Data4[4], signature.Data4[5],
+      signature.Data4[6], signature.Data4[7], age);
+  return cache_dir_.Append(name + kCacheFileExtension);
+}
+
+bool DiaCache::Load(const GUID& signature,
+                    uint32 age,
+                    DiaQueryResults* results) const {
+  DCHECK(results != NULL);
+
+  base::FilePath path = GetCacheFilePath(signature, age);
+  if (!base::PathExists(path))
+    return false;
+
+  base::MemoryMappedFile mapped_file;
+  if (!mapped_file.Initialize(path)) {
+    LOG(WARNING) << "Unable to map DIA cache file \"" << path.value()
+                 << "\".";
+    return false;
+  }
+  const uint8* data = mapped_file.data();
+  size_t data_size = mapped_file.length();
+
+  if (data_size < sizeof(CacheHeader))
+    return false;
+  const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+  if (header->magic != kCacheMagic || header->version != kCacheVersion ||
+      header->signature != signature || header->age != age) {
+    VLOG(1) << "Ignoring stale DIA cache file \"" << path.value() << "\".";
+    return false;
+  }
+
+  size_t offset = sizeof(CacheHeader);
+  std::vector<CacheSectionContrib> section_contribs;
+  DiaQueryResults loaded;
+  if (!ReadVector(data, data_size, header->section_contrib_count, &offset,
+                  &section_contribs) ||
+      !ReadVector(data, data_size, header->fixup_count, &offset,
+                  &loaded.fixups) ||
+      !ReadVector(data, data_size, header->omap_count, &offset,
+                  &loaded.omap_from) ||
+      header->names_size != data_size - offset) {
+    LOG(WARNING) << "Ignoring corrupt DIA cache file \"" << path.value()
+                 << "\".";
+    return false;
+  }
+
+  const char* names = reinterpret_cast<const char*>(data + offset);
+  loaded.section_contribs.resize(section_contribs.size());
+  for (size_t i = 0; i < section_contribs.size(); ++i) {
+    const CacheSectionContrib& cached = section_contribs[i];
+    if (cached.name_offset > header->names_size ||
+        cached.name_length > header->names_size - cached.name_offset) {
+      LOG(WARNING) << "Ignoring corrupt DIA cache file \"" << path.value()
+                   << "\".";
+      return false;
+    }
+
+    DiaSectionContrib& section_contrib = loaded.section_contribs[i];
+    section_contrib.rva = cached.rva;
+    section_contrib.length = cached.length;
+    section_contrib.section_id = cached.section_id;
+    section_contrib.code = (cached.flags & kCode) != 0;
+    section_contrib.is_built_by_supported_compiler =
+        (cached.flags & kBuiltBySupportedCompiler) != 0;
+    section_contrib.compiland_name.assign(names + cached.name_offset,
+                                          cached.name_length);
+  }
+
+  results->section_contribs.swap(loaded.section_contribs);
+  results->fixups.swap(loaded.fixups);
+  results->omap_from.swap(loaded.omap_from);
+  return true;
+}
+
+bool DiaCache::Store(const GUID& signature,
+                     uint32 age,
+                     const DiaQueryResults& results) const {
+  // Section contributions of the same compiland share its name.
+  std::vector<CacheSectionContrib> section_contribs(
+      results.section_contribs.size());
+  std::map<std::string, uint32> name_offsets;
+  std::string names;
+  for (size_t i = 0; i < results.section_contribs.size(); ++i) {
+    const DiaSectionContrib& section_contrib = results.section_contribs[i];
+    std::pair<std::map<std::string, uint32>::iterator, bool> inserted =
+        name_offsets.insert(std::make_pair(section_contrib.compiland_name,
+                                           names.size()));
+    if (inserted.second)
+      names.append(section_contrib.compiland_name);
+
+    CacheSectionContrib& cached = section_contribs[i];
+    cached.rva = section_contrib.rva;
+    cached.length = section_contrib.length;
+    cached.section_id = section_contrib.section_id;
+    cached.flags = 0;
+    if (section_contrib.code)
+      cached.flags |= kCode;
+    if (section_contrib.is_built_by_supported_compiler)
+      cached.flags |= kBuiltBySupportedCompiler;
+    cached.name_offset = inserted.first->second;
+    cached.name_length = section_contrib.compiland_name.size();
+  }
+
+  CacheHeader header = {};
+  header.magic = kCacheMagic;
+  header.version = kCacheVersion;
+  header.signature = signature;
+  header.age = age;
+  header.section_contrib_count = section_contribs.size();
+  header.fixup_count = results.fixups.size();
+  header.omap_count = results.omap_from.size();
+  header.names_size = names.size();
+
+  if (!base::CreateDirectory(cache_dir_)) {
+    LOG(ERROR) << "Unable to create DIA cache directory \""
+               << cache_dir_.value() << "\".";
+    return false;
+  }
+
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(cache_dir_, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in \""
+               << cache_dir_.value() << "\".";
+    return false;
+  }
+
+  bool written = false;
+  {
+    base::ScopedFILE file(base::OpenFile(temp_path, "wb"));
+    written = file.get() != NULL &&
+        ::fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+        WriteVector(section_contribs, file.get()) &&
+        WriteVector(results.fixups, file.get()) &&
+        WriteVector(results.omap_from, file.get()) &&
+        (names.empty() ||
+         ::fwrite(names.data(), names.size(), 1, file.get()) == 1);
+  }
+
+  base::FilePath path = GetCacheFilePath(signature, age);
+  if (!written || !base::Move(temp_path, path)) {
+    LOG(ERROR) << "Unable to write DIA cache file \"" << path.value() << "\".";
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace pe
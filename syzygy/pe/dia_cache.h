@@ -0,0 +1,98 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares an on-disk cache of the results of DIA queries. Extracting the
+// section contributions of a large PDB through DIA's COM interfaces is slow,
+// and the same PDBs tend to be decomposed over and over again. The results
+// are stored in a flat file named after the GUID and age of the PDB, which is
+// memory mapped when it is loaded back.
+
+#ifndef SYZYGY_PE_DIA_CACHE_H_
+#define SYZYGY_PE_DIA_CACHE_H_
+
+#include <windows.h>  // NOLINT
+#include <dbghelp.h>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "syzygy/pdb/pdb_data.h"
+
+namespace pe {
+
+// A section contribution, as extracted from DIA.
+struct DiaSectionContrib {
+  DiaSectionContrib()
+      : rva(0), length(0), section_id(0), code(false),
+        is_built_by_supported_compiler(false) {
+  }
+
+  uint32 rva;
+  uint32 length;
+  // The index of the section, numbered from 0.
+  uint32 section_id;
+  bool code;
+  bool is_built_by_supported_compiler;
+  std::string compiland_name;
+};
+
+// The results of the DIA queries made when decomposing an image.
+struct DiaQueryResults {
+  std::vector<DiaSectionContrib> section_contribs;
+  std::vector<pdb::PdbFixup> fixups;
+  std::vector<OMAP> omap_from;
+};
+
+// Stores and loads DIA query results in a cache directory.
+class DiaCache {
+ public:
+  // The extension of the cache files.
+  static const wchar_t kCacheFileExtension[];
+
+  // @param cache_dir the directory holding the cache files. It is created
+  //     when results are first stored.
+  explicit DiaCache(const base::FilePath& cache_dir);
+
+  // @returns the path of the cache file of the PDB with the given signature
+  //     and age.
+  base::FilePath GetCacheFilePath(const GUID& signature, uint32 age) const;
+
+  // Loads the results of the PDB with the given signature and age. A cache
+  // file that is missing, of another version or corrupt is a miss.
+  // @param signature the GUID of the PDB.
+  // @param age the age of the PDB.
+  // @param results receives the results.
+  // @returns true if the results were found in the cache, false otherwise.
+  bool Load(const GUID& signature, uint32 age, DiaQueryResults* results) const;
+
+  // Stores the results of the PDB with the given signature and age, replacing
+  // any that are already cached. The file is written under a temporary name
+  // and moved in place, so concurrent readers never see a partial file.
+  // @param signature the GUID of the PDB.
+  // @param age the age of the PDB.
+  // @param results the results to store.
+  // @returns true on success, false otherwise.
+  bool Store(const GUID& signature,
+             uint32 age,
+             const DiaQueryResults& results) const;
+
+ private:
+  base::FilePath cache_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(DiaCache);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_DIA_CACHE_H_
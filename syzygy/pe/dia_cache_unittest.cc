@@ -0,0 +1,142 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/dia_cache.h"
+
+#include "base/file_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+const GUID kSignature = {
+    0x12345678, 0x1234, 0x5678,
+    { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF } };
+const uint32 kAge = 3;
+
+class DiaCacheTest : public testing::ApplicationTestBase {
+ public:
+  virtual void SetUp() OVERRIDE {
+    testing::ApplicationTestBase::SetUp();
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+    cache_dir_ = temp_dir_.Append(L"cache");
+
+    DiaSectionContrib section_contrib;
+    section_contrib.rva = 0x1000;
+    section_contrib.length = 0x20;
+    section_contrib.section_id = 0;
+    section_contrib.code = true;
+    section_contrib.is_built_by_supported_compiler = true;
+    section_contrib.compiland_name = "foo.obj";
+    results_.section_contribs.push_back(section_contrib);
+
+    section_contrib.rva = 0x1020;
+    section_contrib.length = 0x10;
+    results_.section_contribs.push_back(section_contrib);
+
+    section_contrib.rva = 0x2000;
+    section_contrib.length = 0x8;
+    section_contrib.section_id = 1;
+    section_contrib.code = false;
+    section_contrib.is_built_by_supported_compiler = false;
+    section_contrib.compiland_name = "bar.lib";
+    results_.section_contribs.push_back(section_contrib);
+
+    pdb::PdbFixup fixup = {};
+    fixup.type = pdb::PdbFixup::TYPE_ABSOLUTE;
+    fixup.rva_location = 0x1004;
+    fixup.rva_base = 0x2000;
+    results_.fixups.push_back(fixup);
+
+    OMAP omap = { 0x1000, 0x3000 };
+    results_.omap_from.push_back(omap);
+  }
+
+ protected:
+  base::FilePath temp_dir_;
+  base::FilePath cache_dir_;
+  DiaQueryResults results_;
+};
+
+}  // namespace
+
+TEST_F(DiaCacheTest, GetCacheFilePath) {
+  DiaCache cache(cache_dir_);
+  EXPECT_EQ(cache_dir_.Append(L"12345678123456780123456789ABCDEF3.dia_cache"),
+            cache.GetCacheFilePath(kSignature, kAge));
+}
+
+TEST_F(DiaCacheTest, LoadMissesEmptyCache) {
+  DiaCache cache(cache_dir_);
+  DiaQueryResults results;
+  EXPECT_FALSE(cache.Load(kSignature, kAge, &results));
+}
+
+TEST_F(DiaCacheTest, StoreAndLoad) {
+  DiaCache cache(cache_dir_);
+  ASSERT_TRUE(cache.Store(kSignature, kAge, results_));
+  EXPECT_TRUE(base::PathExists(cache.GetCacheFilePath(kSignature, kAge)));
+
+  DiaQueryResults results;
+  ASSERT_TRUE(cache.Load(kSignature, kAge, &results));
+
+  ASSERT_EQ(results_.section_contribs.size(), results.section_contribs.size());
+  for (size_t i = 0; i < results.section_contribs.size(); ++i) {
+    const DiaSectionContrib& expected = results_.section_contribs[i];
+    const DiaSectionContrib& actual = results.section_contribs[i];
+    EXPECT_EQ(expected.rva, actual.rva);
+    EXPECT_EQ(expected.length, actual.length);
+    EXPECT_EQ(expected.section_id, actual.section_id);
+    EXPECT_EQ(expected.code, actual.code);
+    EXPECT_EQ(expected.is_built_by_supported_compiler,
+              actual.is_built_by_supported_compiler);
+    EXPECT_EQ(expected.compiland_name, actual.compiland_name);
+  }
+
+  ASSERT_EQ(1u, results.fixups.size());
+  EXPECT_EQ(0, ::memcmp(&results_.fixups[0], &results.fixups[0],
+                        sizeof(pdb::PdbFixup)));
+  ASSERT_EQ(1u, results.omap_from.size());
+  EXPECT_EQ(results_.omap_from[0].rva, results.omap_from[0].rva);
+  EXPECT_EQ(results_.omap_from[0].rvaTo, results.omap_from[0].rvaTo);
+
+  // Another age of the same PDB isn't in the cache.
+  EXPECT_FALSE(cache.Load(kSignature, kAge + 1, &results));
+}
+
+TEST_F(DiaCacheTest, LoadMissesCorruptFile) {
+  DiaCache cache(cache_dir_);
+  ASSERT_TRUE(cache.Store(kSignature, kAge, results_));
+
+  // Truncate the cache file.
+  base::FilePath path = cache.GetCacheFilePath(kSignature, kAge);
+  int64 file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(path, &file_size));
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  contents.resize(static_cast<size_t>(file_size) - 4);
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            base::WriteFile(path, contents.data(), contents.size()));
+
+  DiaQueryResults results;
+  EXPECT_FALSE(cache.Load(kSignature, kAge, &results));
+
+  // Storing the results again replaces the corrupt file.
+  ASSERT_TRUE(cache.Store(kSignature, kAge, results_));
+  EXPECT_TRUE(cache.Load(kSignature, kAge, &results));
+}
+
+}  // namespace pe
@@ -85,7 +85,9 @@ BOOL CALLBACK FindPeFileCallback(PCTSTR path, PVOID context) {
   base::FilePath pe_path(path);
   const PEFile::Signature* pe_info = static_cast<PEFile::Signature*>(context);
 
+  // Only the signature is needed, so map the candidate rather than reading it.
   PEFile pe_file;
+  pe_file.set_memory_mapped(true);
   if (!pe_file.Init(pe_path))
     return TRUE;
   PEFile::Signature pe_sig;
@@ -112,9 +114,11 @@ bool FindFile(const base::FilePath& file_path,
 
   found_file->clear();
 
-  HANDLE handle = ::GetCurrentProcess();
-
-  if (!common::SymInitialize(handle, NULL, false))
+  // Reuse the process-wide symbol session rather than initializing and
+  // cleaning up a session for every search.
+  common::ScopedSharedSymbolSession symbol_session;
+  HANDLE handle = symbol_session.session();
+  if (handle == NULL)
     return false;
 
   base::FilePath dir = file_path.DirName();
@@ -142,11 +146,6 @@ bool FindFile(const base::FilePath& file_path,
                                      &buffer[0],
                                      callback,
                                      callback_context);
-  if (::SymCleanup(handle) == FALSE) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "SymCleanup failed: " << common::LogWe(error);
-    return false;
-  }
   if (!result) {
     // If there is a zero error code, this simply means that the search failed
     // to find anything, which is not an error.
@@ -0,0 +1,173 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/frozen_image_maps.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraph;
+using core::RelativeAddress;
+
+// Finds the last of a sorted array of range starts that is not greater than
+// @p value. The search range is halved on every step whatever the outcome of
+// the comparison, which the compiler turns into a conditional move, so that
+// there are no branches to mispredict.
+// @param starts the sorted range starts.
+// @param value the value to look up.
+// @returns the index of the range start, or -1 if all of them are greater
+//     than @p value.
+int FindLastNotGreater(const std::vector<uint32>& starts, uint32 value) {
+  if (starts.empty())
+    return -1;
+
+  const uint32* base = &starts[0];
+  size_t count = starts.size();
+  while (count > 1) {
+    size_t half = count / 2;
+    base = (base[half] <= value) ? base + half : base;
+    count -= half;
+  }
+
+  if (*base > value)
+    return -1;
+  return static_cast<int>(base - &starts[0]);
+}
+
+// Finds the range containing [@p value, @p value + @p size).
+// @returns the index of the range, or -1 if there's none.
+int FindContainingRange(const std::vector<uint32>& starts,
+                        const std::vector<uint32>& sizes,
+                        uint32 value,
+                        uint32 size) {
+  DCHECK_EQ(starts.size(), sizes.size());
+  int index = FindLastNotGreater(starts, value);
+  if (index < 0)
+    return -1;
+  uint32 offset = value - starts[index];
+  if (offset >= sizes[index] || size > sizes[index] - offset)
+    return -1;
+  return index;
+}
+
+}  // namespace
+
+FrozenImageSourceMap::FrozenImageSourceMap() {
+}
+
+void FrozenImageSourceMap::Init(const ImageSourceMap& source_map) {
+  starts_.clear();
+  sizes_.clear();
+  destination_starts_.clear();
+  destination_sizes_.clear();
+
+  starts_.reserve(source_map.size());
+  sizes_.reserve(source_map.size());
+  destination_starts_.reserve(source_map.size());
+  destination_sizes_.reserve(source_map.size());
+
+  // The range pairs are sorted and don't overlap.
+  ImageSourceMap::RangePairs::const_iterator pair_it =
+      source_map.range_pairs().begin();
+  for (; pair_it != source_map.range_pairs().end(); ++pair_it) {
+    starts_.push_back(pair_it->first.start().value());
+    sizes_.push_back(pair_it->first.size());
+    destination_starts_.push_back(pair_it->second.start().value());
+    destination_sizes_.push_back(pair_it->second.size());
+  }
+}
+
+bool FrozenImageSourceMap::Translate(RelativeAddress address,
+                                     RelativeAddress* translated) const {
+  DCHECK(translated != NULL);
+
+  int index = FindContainingRange(starts_, sizes_, address.value(), 1);
+  if (index < 0 || destination_sizes_[index] == 0)
+    return false;
+
+  uint32 offset = address.value() - starts_[index];
+  if (offset >= destination_sizes_[index])
+    offset %= destination_sizes_[index];
+  *translated = RelativeAddress(destination_starts_[index] + offset);
+  return true;
+}
+
+size_t FrozenImageSourceMap::TranslateAddresses(
+    const std::vector<RelativeAddress>& addresses,
+    std::vector<RelativeAddress>* translated) const {
+  DCHECK(translated != NULL);
+
+  translated->resize(addresses.size());
+  size_t mapped = 0;
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    if (Translate(addresses[i], &(*translated)[i]))
+      ++mapped;
+    else
+      (*translated)[i] = RelativeAddress::kInvalidAddress;
+  }
+  return mapped;
+}
+
+FrozenImageLayout::FrozenImageLayout() {
+}
+
+void FrozenImageLayout::Init(const ImageLayout& image_layout) {
+  starts_.clear();
+  sizes_.clear();
+  blocks_.clear();
+
+  starts_.reserve(image_layout.blocks.size());
+  sizes_.reserve(image_layout.blocks.size());
+  blocks_.reserve(image_layout.blocks.size());
+
+  // The blocks are sorted by address and don't overlap.
+  BlockGraph::AddressSpace::RangeMapConstIter block_it =
+      image_layout.blocks.begin();
+  for (; block_it != image_layout.blocks.end(); ++block_it) {
+    DCHECK(block_it->second != NULL);
+    starts_.push_back(block_it->first.start().value());
+    sizes_.push_back(block_it->first.size());
+    blocks_.push_back(block_it->second);
+  }
+}
+
+const FrozenImageLayout::Block* FrozenImageLayout::GetContainingBlock(
+    RelativeAddress address, size_t size) const {
+  if (size == 0)
+    return NULL;
+
+  int index = FindContainingRange(starts_, sizes_, address.value(), size);
+  if (index < 0)
+    return NULL;
+  return blocks_[index];
+}
+
+size_t FrozenImageLayout::GetContainingBlocks(
+    const std::vector<RelativeAddress>& addresses,
+    std::vector<const Block*>* blocks) const {
+  DCHECK(blocks != NULL);
+
+  blocks->resize(addresses.size());
+  size_t found = 0;
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    const Block* block = GetContainingBlock(addresses[i], 1);
+    (*blocks)[i] = block;
+    if (block != NULL)
+      ++found;
+  }
+  return found;
+}
+
+}  // namespace pe
@@ -0,0 +1,120 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares read-only versions of an ImageSourceMap and of the blocks of an
+// ImageLayout, for tools that look up many addresses once the layout is
+// final. The ranges are copied into sorted arrays of plain integers, which
+// are searched without data-dependent branches, and batches of addresses can
+// be looked up in a single call.
+
+#ifndef SYZYGY_PE_FROZEN_IMAGE_MAPS_H_
+#define SYZYGY_PE_FROZEN_IMAGE_MAPS_H_
+
+#include <vector>
+
+#include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/image_source_map.h"
+
+namespace pe {
+
+// A frozen copy of an ImageSourceMap, translating addresses from the
+// source ranges of the map to its destination ranges.
+class FrozenImageSourceMap {
+ public:
+  FrozenImageSourceMap();
+
+  // Initializes this map with a copy of @p source_map. Any previous content
+  // is discarded. Later changes to @p source_map are not reflected.
+  // @param source_map the map to copy.
+  void Init(const ImageSourceMap& source_map);
+
+  // Translates an address through the map. An address in a source range
+  // longer than its destination range wraps around the destination range,
+  // as it does in the OMAP built by BuildOmapVectorFromImageSourceMap.
+  // @param address the address to translate.
+  // @param translated receives the translated address.
+  // @returns true if @p address is mapped, false otherwise.
+  bool Translate(core::RelativeAddress address,
+                 core::RelativeAddress* translated) const;
+
+  // Translates a batch of addresses through the map.
+  // @param addresses the addresses to translate.
+  // @param translated receives the translated addresses, in the same order.
+  //     Unmapped addresses are translated to
+  //     core::RelativeAddress::kInvalidAddress.
+  // @returns the number of addresses that are mapped.
+  size_t TranslateAddresses(
+      const std::vector<core::RelativeAddress>& addresses,
+      std::vector<core::RelativeAddress>* translated) const;
+
+  // @returns the number of range pairs in the map.
+  size_t size() const { return starts_.size(); }
+
+ private:
+  // The source and destination ranges of the map, by increasing source
+  // address.
+  std::vector<uint32> starts_;
+  std::vector<uint32> sizes_;
+  std::vector<uint32> destination_starts_;
+  std::vector<uint32> destination_sizes_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrozenImageSourceMap);
+};
+
+// A frozen copy of the address space of an ImageLayout, finding the blocks
+// containing addresses in the image.
+class FrozenImageLayout {
+ public:
+  typedef block_graph::BlockGraph::Block Block;
+
+  FrozenImageLayout();
+
+  // Initializes this layout with a copy of the blocks of @p image_layout.
+  // Any previous content is discarded. Later changes to @p image_layout are
+  // not reflected.
+  // @param image_layout the layout to copy.
+  void Init(const ImageLayout& image_layout);
+
+  // Finds the block containing a range of addresses.
+  // @param address the start of the range.
+  // @param size the size of the range.
+  // @returns the block containing the whole range, or NULL if there's none
+  //     or if @p size is zero.
+  const Block* GetContainingBlock(core::RelativeAddress address,
+                                  size_t size) const;
+
+  // Finds the blocks containing a batch of addresses.
+  // @param addresses the addresses to look up.
+  // @param blocks receives the blocks containing the addresses, in the same
+  //     order. Addresses outside of any block get NULL.
+  // @returns the number of addresses that are in a block.
+  size_t GetContainingBlocks(
+      const std::vector<core::RelativeAddress>& addresses,
+      std::vector<const Block*>* blocks) const;
+
+  // @returns the number of blocks in the layout.
+  size_t size() const { return starts_.size(); }
+
+ private:
+  // The address ranges of the blocks, by increasing address.
+  std::vector<uint32> starts_;
+  std::vector<uint32> sizes_;
+  std::vector<const Block*> blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrozenImageLayout);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_FROZEN_IMAGE_MAPS_H_
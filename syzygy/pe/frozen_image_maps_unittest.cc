@@ -0,0 +1,129 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/frozen_image_maps.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/pe/decomposer.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+using block_graph::BlockGraph;
+using core::RelativeAddress;
+
+class FrozenImageMapsTest : public testing::PELibUnitTest {
+};
+
+}  // namespace
+
+TEST_F(FrozenImageMapsTest, EmptySourceMap) {
+  ImageSourceMap source_map;
+  FrozenImageSourceMap frozen_map;
+  frozen_map.Init(source_map);
+  EXPECT_EQ(0U, frozen_map.size());
+
+  RelativeAddress translated;
+  EXPECT_FALSE(frozen_map.Translate(RelativeAddress(0), &translated));
+}
+
+TEST_F(FrozenImageMapsTest, TranslateSourceMap) {
+  ImageSourceMap source_map;
+  ASSERT_TRUE(source_map.Push(RelativeAddressRange(RelativeAddress(0), 512),
+                              RelativeAddressRange(RelativeAddress(0), 512)));
+  ASSERT_TRUE(source_map.Push(
+      RelativeAddressRange(RelativeAddress(1024), 128),
+      RelativeAddressRange(RelativeAddress(1536), 128)));
+  // A source range longer than its destination range.
+  ASSERT_TRUE(source_map.Push(
+      RelativeAddressRange(RelativeAddress(1152), 10),
+      RelativeAddressRange(RelativeAddress(1024), 8)));
+
+  FrozenImageSourceMap frozen_map;
+  frozen_map.Init(source_map);
+  EXPECT_EQ(3U, frozen_map.size());
+
+  RelativeAddress translated;
+  EXPECT_TRUE(frozen_map.Translate(RelativeAddress(0), &translated));
+  EXPECT_EQ(RelativeAddress(0), translated);
+  EXPECT_TRUE(frozen_map.Translate(RelativeAddress(511), &translated));
+  EXPECT_EQ(RelativeAddress(511), translated);
+  EXPECT_TRUE(frozen_map.Translate(RelativeAddress(1030), &translated));
+  EXPECT_EQ(RelativeAddress(1542), translated);
+  EXPECT_TRUE(frozen_map.Translate(RelativeAddress(1161), &translated));
+  EXPECT_EQ(RelativeAddress(1025), translated);
+
+  EXPECT_FALSE(frozen_map.Translate(RelativeAddress(512), &translated));
+  EXPECT_FALSE(frozen_map.Translate(RelativeAddress(1162), &translated));
+
+  std::vector<RelativeAddress> addresses;
+  addresses.push_back(RelativeAddress(1161));
+  addresses.push_back(RelativeAddress(600));
+  addresses.push_back(RelativeAddress(1024));
+  std::vector<RelativeAddress> translated_addresses;
+  EXPECT_EQ(2U, frozen_map.TranslateAddresses(addresses,
+                                              &translated_addresses));
+  ASSERT_EQ(addresses.size(), translated_addresses.size());
+  EXPECT_EQ(RelativeAddress(1025), translated_addresses[0]);
+  EXPECT_EQ(RelativeAddress::kInvalidAddress, translated_addresses[1]);
+  EXPECT_EQ(RelativeAddress(1536), translated_addresses[2]);
+}
+
+TEST_F(FrozenImageMapsTest, MatchesImageLayout) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  FrozenImageLayout frozen_layout;
+  frozen_layout.Init(image_layout);
+  EXPECT_EQ(image_layout.blocks.size(), frozen_layout.size());
+
+  // Look up the first, middle and last byte of each block, and the bytes
+  // around it.
+  std::vector<RelativeAddress> addresses;
+  BlockGraph::AddressSpace::RangeMapConstIter block_it =
+      image_layout.blocks.begin();
+  for (; block_it != image_layout.blocks.end(); ++block_it) {
+    RelativeAddress start = block_it->first.start();
+    size_t size = block_it->first.size();
+    if (start.value() > 0)
+      addresses.push_back(start - 1);
+    addresses.push_back(start);
+    addresses.push_back(start + size / 2);
+    addresses.push_back(start + size - 1);
+    addresses.push_back(start + size);
+
+    EXPECT_EQ(block_it->second,
+              frozen_layout.GetContainingBlock(start, size));
+    EXPECT_TRUE(frozen_layout.GetContainingBlock(start, size + 1) == NULL);
+    EXPECT_TRUE(frozen_layout.GetContainingBlock(start, 0) == NULL);
+  }
+
+  std::vector<const BlockGraph::Block*> blocks;
+  frozen_layout.GetContainingBlocks(addresses, &blocks);
+  ASSERT_EQ(addresses.size(), blocks.size());
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    EXPECT_EQ(image_layout.blocks.GetContainingBlock(addresses[i], 1),
+              blocks[i]);
+  }
+}
+
+}  // namespace pe
@@ -17,8 +17,7 @@
 #include <errno.h>
 
 #include "base/file_util.h"
-#include "base/json/json_reader.h"
-#include "base/strings/stringprintf.h"
+#include "syzygy/core/json_file_reader.h"
 
 namespace pe {
 
@@ -27,6 +26,7 @@ namespace {
 using base::DictionaryValue;
 using base::ListValue;
 using base::Value;
+using core::JSONFileReader;
 
 // Keys used by the JSON serialization.
 const char kBaseAddress[] = "base_address";
@@ -42,14 +42,7 @@ const char kTimeDateStamp[] = "time_date_stamp";
 bool OutputHexUint32(uint32 value, core::JSONFileWriter* json) {
   DCHECK(json != NULL);
 
-  std::string s;
-  if (json->pretty_print()) {
-    s = base::StringPrintf("0x%08X", value);
-  } else {
-    s = base::StringPrintf("%X", value);
-  }
-
-  if (!json->OutputString(s))
+  if (!json->OutputHexString(value, json->pretty_print()))
     return false;
 
   return true;
@@ -164,6 +157,15 @@ bool LoadRangeFromJSON(const ListValue& range, ImageFilter* filter) {
   return true;
 }
 
+// Initializes the address filter in |filter| to an empty one covering the
+// module. This assumes that the signature has already been loaded.
+void InitFilter(ImageFilter* filter) {
+  DCHECK(filter != NULL);
+  filter->filter = ImageFilter::RelativeAddressFilter(
+      ImageFilter::Range(ImageFilter::RelativeAddress(0),
+                         filter->signature.module_size));
+}
+
 // Loads a relative address filter from the given |list|, populating the
 // address filter in |filter|. Expects that the signature member of |filter|
 // has already been appropriately initialized. Returns true on success, false
@@ -171,11 +173,7 @@ bool LoadRangeFromJSON(const ListValue& range, ImageFilter* filter) {
 bool LoadFilterFromJSON(const ListValue& list, ImageFilter* filter) {
   DCHECK(filter != NULL);
 
-  // Initialize the filter. This assumes that the signature has already been
-  // loaded.
-  filter->filter = ImageFilter::RelativeAddressFilter(
-      ImageFilter::Range(ImageFilter::RelativeAddress(0),
-                         filter->signature.module_size));
+  InitFilter(filter);
 
   ListValue::const_iterator it = list.begin();
   for (; it != list.end(); ++it) {
@@ -195,6 +193,37 @@ bool LoadFilterFromJSON(const ListValue& list, ImageFilter* filter) {
   return true;
 }
 
+// As above, but streams the list from |reader|, which must be positioned on
+// its opening. Only one range is materialized at a time.
+bool LoadFilterFromJSON(JSONFileReader* reader, ImageFilter* filter) {
+  DCHECK(reader != NULL);
+  DCHECK(filter != NULL);
+
+  if (reader->token() != JSONFileReader::kOpenList) {
+    LOG(ERROR) << "Dictionary does not contain a list under key \""
+               << kFilter << "\".";
+    return false;
+  }
+
+  InitFilter(filter);
+
+  while (true) {
+    if (!reader->Next())
+      return false;
+    if (reader->token() == JSONFileReader::kCloseList)
+      return true;
+
+    scoped_ptr<Value> value;
+    ListValue* range = NULL;
+    if (!reader->ReadValue(&value) ||
+        !value->GetAsList(&range) ||
+        !LoadRangeFromJSON(*range, filter)) {
+      LOG(ERROR) << "Encountered invalid range in filter list.";
+      return false;
+    }
+  }
+}
+
 }  // namespace
 
 void ImageFilter::Init(const PEFile::Signature& pe_signature) {
@@ -345,42 +374,68 @@ bool ImageFilter::LoadFromJSON(const DictionaryValue& dict) {
 bool ImageFilter::LoadFromJSON(FILE* file) {
   DCHECK(file != NULL);
 
-  // Read the file into one big array.
-  char buffer[4096] = {};
-  std::vector<char> json;
-  while (!::feof(file)) {
-    size_t bytes = ::fread(buffer, sizeof(buffer[0]), arraysize(buffer), file);
-    if (::ferror(file)) {
-      LOG(ERROR) << "Error reading from file.";
-      return false;
-    }
-    DCHECK_LT(0u, bytes);
-    size_t offset = json.size();
-    json.resize(offset + bytes);
-    ::memcpy(json.data() + offset, buffer, bytes);
+  // The file is read as a stream, so that large filters are never entirely
+  // materialized as base::Values. This requires the signature to precede the
+  // filter, as it's needed to initialize it. JSONFileWriter output is always
+  // laid out this way.
+  JSONFileReader reader(file);
+  if (!reader.Next()) {
+    LOG(ERROR) << "Failed to parse JSON from file.";
+    return false;
   }
-
-  if (json.empty()) {
-    LOG(ERROR) << "File is empty.";
+  if (reader.token() != JSONFileReader::kOpenDict) {
+    LOG(ERROR) << "JSON does not contain dictionary at top level.";
     return false;
   }
 
-  base::JSONReader json_reader;
-  scoped_ptr<base::Value> value(
-      json_reader.Read(base::StringPiece(json.data(), json.size())));
-  if (value.get() == NULL) {
-    LOG(ERROR) << "Failed to parse JSON from file.";
-    return false;
+  bool have_signature = false;
+  bool have_filter = false;
+  while (true) {
+    if (!reader.Next())
+      return false;
+    if (reader.token() == JSONFileReader::kCloseDict)
+      break;
+    DCHECK_EQ(JSONFileReader::kKey, reader.token());
+
+    std::string key(reader.string_value());
+    if (!reader.Next())
+      return false;
+
+    if (key == kSignature) {
+      scoped_ptr<Value> value;
+      const DictionaryValue* dict = NULL;
+      if (!reader.ReadValue(&value) || !value->GetAsDictionary(&dict)) {
+        LOG(ERROR) << "Dictionary does not contain a dictionary under key \""
+                   << kSignature << "\".";
+        return false;
+      }
+      if (!LoadSignatureFromJSON(*dict, this))
+        return false;
+      have_signature = true;
+    } else if (key == kFilter) {
+      if (!have_signature) {
+        LOG(ERROR) << "The \"" << kFilter << "\" list must follow the \""
+                   << kSignature << "\" dictionary.";
+        return false;
+      }
+      if (!LoadFilterFromJSON(&reader, this))
+        return false;
+      have_filter = true;
+    } else if (!reader.SkipValue()) {
+      return false;
+    }
   }
 
-  base::DictionaryValue* dict;
-  if (!value->GetAsDictionary(&dict) || dict == NULL) {
-    LOG(ERROR) << "JSON does not contain dictionary at top level.";
+  if (!have_signature || !have_filter) {
+    LOG(ERROR) << "Dictionary must contain \"" << kSignature << "\" and \""
+               << kFilter << "\".";
     return false;
   }
 
-  if (!LoadFromJSON(*dict))
+  // Make sure that there's nothing following the dictionary.
+  if (!reader.Next())
     return false;
+  DCHECK_EQ(JSONFileReader::kEndOfInput, reader.token());
 
   return true;
 }
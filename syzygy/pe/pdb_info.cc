@@ -88,7 +88,10 @@ bool PdbInfo::Init(const PEFile& pe_file) {
 bool PdbInfo::Init(const base::FilePath& pe_path) {
   DCHECK(!pe_path.empty());
 
+  // Only the headers and the debug directory are looked at, so map the image
+  // rather than reading all of it.
   PEFile pe_file;
+  pe_file.set_memory_mapped(true);
   if (!pe_file.Init(pe_path)) {
     LOG(ERROR) << "Unable to process PE file: " << pe_path.value();
     return false;
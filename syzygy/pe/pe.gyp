@@ -65,6 +65,8 @@
         'coff_file_writer.h',
         'coff_image_layout_builder.cc',
         'coff_image_layout_builder.h',
+        'coff_relink_pipeline.cc',
+        'coff_relink_pipeline.h',
         'coff_relinker.cc',
         'coff_relinker.h',
         'coff_transform_policy.cc',
@@ -74,6 +76,8 @@
         'cvinfo_ext.h',
         'dia_browser.cc',
         'dia_browser.h',
+        'dia_cache.cc',
+        'dia_cache.h',
         'dia_util.cc',
         'dia_util.h',
         'dia_util_internal.h',
@@ -84,6 +88,8 @@
         'dos_stub.h',
         'find.cc',
         'find.h',
+        'frozen_image_maps.cc',
+        'frozen_image_maps.h',
         'image_filter.cc',
         'image_filter.h',
         'image_layout.cc',
@@ -146,6 +152,7 @@
             # library dependency here.
             'AdditionalDependencies': [
               'imagehlp.lib',
+              'psapi.lib',
             ],
           },
         },
@@ -205,6 +212,7 @@
         'coff_file_unittest.cc',
         'coff_file_writer_unittest.cc',
         'coff_image_layout_builder_unittest.cc',
+        'coff_relink_pipeline_unittest.cc',
         'coff_relinker_unittest.cc',
         'coff_transform_policy_unittest.cc',
         'coff_utils_unittest.cc',
@@ -212,8 +220,10 @@
         'decompose_image_to_text_unittest.cc',
         'decomposer_unittest.cc',
         'dia_browser_unittest.cc',
+        'dia_cache_unittest.cc',
         'dia_util_unittest.cc',
         'find_unittest.cc',
+        'frozen_image_maps_unittest.cc',
         'image_filter_unittest.cc',
         'image_layout_unittest.cc',
         'image_source_map_unittest.cc',
@@ -25,6 +25,8 @@
 #include <vector>
 
 #include "base/files/file_path.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/com_utils.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/core/serialization.h"
@@ -103,6 +105,21 @@ class PECoffFile {
   // @returns the path of the input file read, if any.
   const base::FilePath& path() const { return path_; }
 
+  // Sets whether Init maps the whole file into memory, rather than reading
+  // the headers and sections into buffers. The mapping is copy-on-write, so
+  // the data can still be modified through GetImageData without affecting the
+  // file. It lives as long as this object, and prevents the file from being
+  // written to in the meantime. Must be called before Init.
+  //
+  // @param memory_mapped true to map the file into memory.
+  void set_memory_mapped(bool memory_mapped) {
+    DCHECK(image_data_.empty());
+    memory_mapped_ = memory_mapped;
+  }
+
+  // @returns true iff the file is mapped into memory by Init.
+  bool memory_mapped() const { return memory_mapped_; }
+
   // Copy mapped data to buffer. The specified range to read must be
   // contained within the image, and cannot cross data ranges from the
   // original file; in particular, sections with no gaps between them
@@ -216,10 +233,27 @@ class PECoffFile {
   typedef std::vector<uint8> SectionBuffer;
 
   struct SectionInfo {
-    SectionInfo() : id(kInvalidSection) {
+    SectionInfo() : id(kInvalidSection), mapped_data(NULL), mapped_size(0) {
+    }
+
+    // @returns the data of the range, either mapped or read into the buffer.
+    uint8* data() {
+      if (mapped_data != NULL)
+        return mapped_data;
+      return buffer.empty() ? NULL : &buffer[0];
+    }
+
+    // @returns the number of bytes of data available for the range.
+    size_t data_size() const {
+      return mapped_data != NULL ? mapped_size : buffer.size();
     }
+
     size_t id;
+    // The data read from the file, when it isn't memory mapped.
     SectionBuffer buffer;
+    // The view of the data in the file mapping, when it's memory mapped.
+    uint8* mapped_data;
+    size_t mapped_size;
   };
 
   typedef core::AddressSpace<AddressType, SizeType, SectionInfo>
@@ -228,17 +262,26 @@ class PECoffFile {
   // Protected constructor, for derived classes only.
   PECoffFile()
       : file_header_(NULL),
-        section_headers_(NULL) {
+        section_headers_(NULL),
+        memory_mapped_(false),
+        mapped_view_(NULL),
+        mapped_size_(0) {
   }
 
-  ~PECoffFile() {
-  }
+  ~PECoffFile();
 
   // Set the file path.
   //
   // @param path the path to the input file.
   void Init(const base::FilePath& path);
 
+  // Maps the whole file at path() into memory, if memory mapping is enabled.
+  // Ranges are then inserted as views of the mapping, rather than read.
+  //
+  // @returns true on success or if memory mapping is disabled, false on
+  //     error.
+  bool MapFile();
+
   // Read headers common to both PE and COFF. Insert a range covering
   // all headers, including unread headers; the range spans from the
   // beginning of the file to the end of the known fixed headers (the
@@ -257,7 +300,7 @@ class PECoffFile {
   bool ReadSections(FILE* file);
 
   // Insert a range into the address map, populated by data read from
-  // @p file.
+  // @p file, or referring to the file mapping if there is one.
   //
   // @param file the input file stream.
   // @param start the file offset to start reading at.
@@ -279,6 +322,13 @@ class PECoffFile {
   const IMAGE_FILE_HEADER* file_header_;
   const IMAGE_SECTION_HEADER* section_headers_;
 
+  // Whether Init maps the whole file into memory.
+  bool memory_mapped_;
+
+  // The copy-on-write view of the whole file, if it is mapped.
+  uint8* mapped_view_;
+  size_t mapped_size_;
+
   // Contains all data in the image. The address space has a range defined
   // for the header and each section in the image, with its associated
   // SectionBuffer as the data.
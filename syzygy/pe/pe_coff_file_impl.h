@@ -20,11 +20,61 @@
 
 namespace pe {
 
+template <typename AddressSpaceTraits>
+PECoffFile<AddressSpaceTraits>::~PECoffFile() {
+  if (mapped_view_ != NULL)
+    CHECK(::UnmapViewOfFile(mapped_view_));
+}
+
 template <typename AddressSpaceTraits>
 void PECoffFile<AddressSpaceTraits>::Init(const base::FilePath& path) {
   path_ = path;
 }
 
+template <typename AddressSpaceTraits>
+bool PECoffFile<AddressSpaceTraits>::MapFile() {
+  DCHECK(mapped_view_ == NULL);
+  if (!memory_mapped_)
+    return true;
+
+  base::win::ScopedHandle file(
+      ::CreateFile(path_.value().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                   NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Failed to open file " << path_.value() << ".";
+    return false;
+  }
+
+  LARGE_INTEGER file_size = {};
+  if (!::GetFileSizeEx(file.Get(), &file_size) ||
+      file_size.HighPart != 0 || file_size.LowPart == 0) {
+    LOG(ERROR) << "Unable to map file of unsupported size: "
+               << path_.value() << ".";
+    return false;
+  }
+
+  // A copy-on-write mapping gives us private pages as soon as they're
+  // written to. The view keeps the mapping alive once the handles are closed.
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(file.Get(), NULL, PAGE_WRITECOPY, 0, 0, NULL));
+  if (!mapping.IsValid()) {
+    LOG(ERROR) << "Failed to create file mapping for " << path_.value()
+               << ": " << common::LogWe() << ".";
+    return false;
+  }
+
+  mapped_view_ = reinterpret_cast<uint8*>(
+      ::MapViewOfFile(mapping.Get(), FILE_MAP_COPY, 0, 0, 0));
+  if (mapped_view_ == NULL) {
+    LOG(ERROR) << "Failed to map view of " << path_.value() << ": "
+               << common::LogWe() << ".";
+    return false;
+  }
+  mapped_size_ = file_size.LowPart;
+
+  return true;
+}
+
 template <typename AddressSpaceTraits>
 bool PECoffFile<AddressSpaceTraits>::Contains(AddressType addr,
                                               SizeType len) const {
@@ -167,10 +217,22 @@ bool PECoffFile<AddressSpaceTraits>::ReadSections(FILE* file) {
     }
 
     it->second.id = i;
-    SectionBuffer& buf = it->second.buffer;
     if (hdr->SizeOfRawData == 0)
       continue;
 
+    if (mapped_view_ != NULL) {
+      if (hdr->PointerToRawData > mapped_size_ ||
+          hdr->SizeOfRawData > mapped_size_ - hdr->PointerToRawData) {
+        LOG(ERROR) << "Data for section " << hdr->Name << " lies beyond the "
+                   << "end of the file.";
+        return false;
+      }
+      it->second.mapped_data = mapped_view_ + hdr->PointerToRawData;
+      it->second.mapped_size = hdr->SizeOfRawData;
+      continue;
+    }
+
+    SectionBuffer& buf = it->second.buffer;
     buf.resize(hdr->SizeOfRawData);
     if (!ReadAt(file, hdr->PointerToRawData, &buf.at(0), hdr->SizeOfRawData)) {
       LOG(ERROR) << "Unable to read data for section " << hdr->Name << ".";
@@ -192,6 +254,16 @@ bool PECoffFile<AddressSpaceTraits>::InsertRangeReadAt(
     return false;
   }
 
+  if (mapped_view_ != NULL) {
+    if (start.value() > mapped_size_ || size > mapped_size_ - start.value()) {
+      LOG(ERROR) << "Range lies beyond the end of the file.";
+      return false;
+    }
+    it->second.mapped_data = mapped_view_ + start.value();
+    it->second.mapped_size = size;
+    return true;
+  }
+
   SectionBuffer& buffer = it->second.buffer;
   buffer.resize(size);
   if (!ReadAt(file, start.value(), &buffer[0], size)) {
@@ -226,9 +298,10 @@ const uint8* PECoffFile<AddressSpaceTraits>::GetImageData(AddressType addr,
     ptrdiff_t offs = addr - it->first.start();
     DCHECK_GE(offs, 0);
 
-    const SectionBuffer& buf = it->second.buffer;
-    if (offs + len <= buf.size())
-      return &buf.at(offs);
+    // The data is only mutated through the non-const overload.
+    SectionInfo& info = const_cast<SectionInfo&>(it->second);
+    if (offs + len <= info.data_size())
+      return info.data() + offs;
   }
 
   return NULL;
@@ -289,19 +362,23 @@ bool PECoffFile<AddressSpaceTraits>::ReadImageString(AddressType addr,
   if (it != image_data_.ranges().end()) {
     ptrdiff_t offs = addr - it->first.start();
     DCHECK_GE(offs, 0);
-    // Stash the start position.
-    const SectionBuffer& buf = it->second.buffer;
-    const char* begin = reinterpret_cast<const char*>(&buf.at(offs));
-    // And loop through until we find a zero-terminating byte,
-    // or run off the end.
-    for (; static_cast<size_t>(offs) < buf.size() && buf.at(offs); ++offs) {
+    SectionInfo& info = const_cast<SectionInfo&>(it->second);
+    const char* data = reinterpret_cast<const char*>(info.data());
+    size_t size = info.data_size();
+    if (static_cast<size_t>(offs) >= size)
+      return false;
+
+    // Stash the start position, and loop through until we find a
+    // zero-terminating byte, or run off the end.
+    const char* begin = data + offs;
+    for (; static_cast<size_t>(offs) < size && data[offs]; ++offs) {
       // Intentionally empty.
     }
 
-    if (static_cast<size_t>(offs) == buf.size())
+    if (static_cast<size_t>(offs) == size)
       return false;
 
-    str->assign(begin);
+    str->assign(begin, data + offs);
     return true;
   }
 
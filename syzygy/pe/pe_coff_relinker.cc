@@ -14,7 +14,17 @@
 
 #include "syzygy/pe/pe_coff_relinker.h"
 
+#include <windows.h>  // NOLINT
+#include <psapi.h>
+
+#include <iterator>
+#include <map>
+#include <utility>
+
+#include "base/file_util.h"
+#include "base/time/time.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
+#include "syzygy/core/json_file_writer.h"
 
 namespace pe {
 namespace {
@@ -28,6 +38,137 @@ using block_graph::OrderedBlockGraph;
 using block_graph::TransformPolicyInterface;
 using core::RelativeAddress;
 
+// A summary of a block, used to find the blocks changed by a transform.
+struct BlockSummary {
+  bool operator!=(const BlockSummary& other) const {
+    return size != other.size || data_size != other.data_size ||
+        reference_count != other.reference_count ||
+        referrer_count != other.referrer_count ||
+        attributes != other.attributes || section != other.section;
+  }
+
+  BlockGraph::Size size;
+  size_t data_size;
+  size_t reference_count;
+  size_t referrer_count;
+  BlockGraph::BlockAttributes attributes;
+  BlockGraph::SectionId section;
+};
+typedef std::map<BlockGraph::BlockId, BlockSummary> BlockSummaryMap;
+
+// The position of a block in an ordered block graph, as the index of its
+// section and its index in that section.
+typedef std::pair<size_t, size_t> BlockPosition;
+typedef std::map<BlockGraph::BlockId, BlockPosition> BlockPositionMap;
+
+void SummarizeBlocks(const BlockGraph& block_graph,
+                     BlockSummaryMap* summaries) {
+  DCHECK(summaries != NULL);
+  BlockGraph::BlockMap::const_iterator it = block_graph.blocks().begin();
+  for (; it != block_graph.blocks().end(); ++it) {
+    const BlockGraph::Block& block = it->second;
+    BlockSummary& summary = (*summaries)[it->first];
+    summary.size = block.size();
+    summary.data_size = block.data_size();
+    summary.reference_count = block.references().size();
+    summary.referrer_count = block.referrers().size();
+    summary.attributes = block.attributes();
+    summary.section = block.section();
+  }
+}
+
+void GetBlockPositions(const OrderedBlockGraph& ordered_graph,
+                       BlockPositionMap* positions) {
+  DCHECK(positions != NULL);
+  const OrderedBlockGraph::SectionList& sections =
+      ordered_graph.ordered_sections();
+  OrderedBlockGraph::SectionList::const_iterator section_it = sections.begin();
+  for (size_t i = 0; section_it != sections.end(); ++section_it, ++i) {
+    const OrderedBlockGraph::BlockList& blocks =
+        (*section_it)->ordered_blocks();
+    OrderedBlockGraph::BlockList::const_iterator block_it = blocks.begin();
+    for (size_t j = 0; block_it != blocks.end(); ++block_it, ++j)
+      (*positions)[(*block_it)->id()] = BlockPosition(i, j);
+  }
+}
+
+// Counts the entries that were added, removed or modified between two maps.
+template <typename MapType>
+size_t CountChangedEntries(const MapType& before, const MapType& after) {
+  size_t changed = 0;
+  typename MapType::const_iterator before_it = before.begin();
+  typename MapType::const_iterator after_it = after.begin();
+  while (before_it != before.end() && after_it != after.end()) {
+    if (before_it->first < after_it->first) {
+      ++changed;
+      ++before_it;
+    } else if (after_it->first < before_it->first) {
+      ++changed;
+      ++after_it;
+    } else {
+      if (before_it->second != after_it->second)
+        ++changed;
+      ++before_it;
+      ++after_it;
+    }
+  }
+  changed += std::distance(before_it, before.end());
+  changed += std::distance(after_it, after.end());
+  return changed;
+}
+
+// @returns the private memory usage of the process, in bytes.
+int64 GetPrivateUsage() {
+  PROCESS_MEMORY_COUNTERS_EX counters = {};
+  if (!::GetProcessMemoryInfo(
+          ::GetCurrentProcess(),
+          reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters),
+          sizeof(counters))) {
+    return 0;
+  }
+  return counters.PrivateUsage;
+}
+
+bool WritePassStatistics(
+    const base::FilePath& input_path,
+    const std::vector<PECoffRelinker::PassStatistics>& pass_statistics,
+    core::JSONFileWriter* json_file) {
+  DCHECK(json_file != NULL);
+
+  if (!json_file->OpenDict() ||
+      !json_file->OutputKey("input_path") ||
+      !json_file->OutputString(input_path.value()) ||
+      !json_file->OutputKey("passes") ||
+      !json_file->OpenList()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < pass_statistics.size(); ++i) {
+    const PECoffRelinker::PassStatistics& stats = pass_statistics[i];
+    if (!json_file->OpenDict() ||
+        !json_file->OutputKey("name") ||
+        !json_file->OutputString(stats.name) ||
+        !json_file->OutputKey("type") ||
+        !json_file->OutputString(stats.type) ||
+        !json_file->OutputKey("seconds") ||
+        !json_file->OutputDouble(stats.seconds) ||
+        !json_file->OutputKey("blocks_visited") ||
+        !json_file->OutputInteger(static_cast<int>(stats.blocks_visited)) ||
+        !json_file->OutputKey("blocks_changed") ||
+        !json_file->OutputInteger(static_cast<int>(stats.blocks_changed)) ||
+        !json_file->OutputKey("memory_delta") ||
+        !json_file->OutputInteger(static_cast<int>(stats.memory_delta)) ||
+        !json_file->CloseDict()) {
+      return false;
+    }
+  }
+
+  if (!json_file->CloseList() || !json_file->CloseDict())
+    return false;
+
+  return true;
+}
+
 }  // namespace
 
 PECoffRelinker::PECoffRelinker(const TransformPolicyInterface* transform_policy)
@@ -64,31 +205,110 @@ bool PECoffRelinker::AppendOrderers(const std::vector<Orderer*>& orderers) {
 
 bool PECoffRelinker::ApplyUserTransforms() {
   LOG(INFO) << "Transforming block graph.";
-  if (!block_graph::ApplyBlockGraphTransforms(
-           transforms_, transform_policy_, &block_graph_, headers_block_)) {
-    return false;
+  if (statistics_path_.empty()) {
+    if (!block_graph::ApplyBlockGraphTransforms(
+             transforms_, transform_policy_, &block_graph_, headers_block_)) {
+      return false;
+    }
+    return true;
   }
+
+  // Apply the transforms one at a time, so that they can be measured.
+  for (size_t i = 0; i < transforms_.size(); ++i) {
+    BlockSummaryMap summaries_before;
+    SummarizeBlocks(block_graph_, &summaries_before);
+
+    PassStatistics stats = {};
+    stats.name = transforms_[i]->name();
+    stats.type = "transform";
+    stats.blocks_visited = summaries_before.size();
+    int64 memory_before = GetPrivateUsage();
+    base::Time start = base::Time::NowFromSystemTime();
+    if (!block_graph::ApplyBlockGraphTransform(
+             transforms_[i], transform_policy_, &block_graph_,
+             headers_block_)) {
+      return false;
+    }
+    stats.seconds = (base::Time::NowFromSystemTime() - start).InSecondsF();
+    stats.memory_delta = GetPrivateUsage() - memory_before;
+
+    BlockSummaryMap summaries_after;
+    SummarizeBlocks(block_graph_, &summaries_after);
+    stats.blocks_changed =
+        CountChangedEntries(summaries_before, summaries_after);
+    pass_statistics_.push_back(stats);
+  }
+
   return true;
 }
 
 bool PECoffRelinker::ApplyUserOrderers(OrderedBlockGraph* ordered_graph) {
   LOG(INFO) << "Ordering block graph.";
 
-  if (orderers_.empty()) {
+  std::vector<Orderer*> orderers(orderers_);
+  block_graph::orderers::OriginalOrderer default_orderer;
+  if (orderers.empty()) {
     // Default orderer.
     LOG(INFO) << "No orderers specified, applying default orderer.";
-    block_graph::orderers::OriginalOrderer default_orderer;
-    if (!default_orderer.OrderBlockGraph(ordered_graph, headers_block_)) {
-      LOG(ERROR) << "Orderer failed: " << default_orderer.name() << ".";
+    orderers.push_back(&default_orderer);
+  }
+
+  if (statistics_path_.empty()) {
+    if (!block_graph::ApplyBlockGraphOrderers(
+             orderers, ordered_graph, headers_block_)) {
       return false;
     }
-  } else {
-    // Supplied orderers.
+    return true;
+  }
+
+  // Apply the orderers one at a time, so that they can be measured.
+  for (size_t i = 0; i < orderers.size(); ++i) {
+    BlockPositionMap positions_before;
+    GetBlockPositions(*ordered_graph, &positions_before);
+
+    PassStatistics stats = {};
+    stats.name = orderers[i]->name();
+    stats.type = "orderer";
+    stats.blocks_visited = positions_before.size();
+    int64 memory_before = GetPrivateUsage();
+    base::Time start = base::Time::NowFromSystemTime();
     if (!block_graph::ApplyBlockGraphOrderers(
-             orderers_, ordered_graph, headers_block_)) {
+             std::vector<Orderer*>(1, orderers[i]), ordered_graph,
+             headers_block_)) {
       return false;
     }
+    stats.seconds = (base::Time::NowFromSystemTime() - start).InSecondsF();
+    stats.memory_delta = GetPrivateUsage() - memory_before;
+
+    BlockPositionMap positions_after;
+    GetBlockPositions(*ordered_graph, &positions_after);
+    stats.blocks_changed =
+        CountChangedEntries(positions_before, positions_after);
+    pass_statistics_.push_back(stats);
+  }
+
+  return true;
+}
+
+bool PECoffRelinker::WriteStatistics() const {
+  if (statistics_path_.empty())
+    return true;
+
+  LOG(INFO) << "Writing pass statistics to \""
+            << statistics_path_.value() << "\".";
+  base::ScopedFILE file(base::OpenFile(statistics_path_, "wb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open \"" << statistics_path_.value()
+               << "\" for writing.";
+    return false;
+  }
+
+  core::JSONFileWriter json_file(file.get(), true);
+  if (!WritePassStatistics(input_path_, pass_statistics_, &json_file)) {
+    LOG(ERROR) << "Failed to write \"" << statistics_path_.value() << "\".";
+    return false;
   }
+  DCHECK(json_file.Finished());
 
   return true;
 }
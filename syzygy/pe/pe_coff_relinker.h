@@ -18,6 +18,7 @@
 #ifndef SYZYGY_PE_PE_COFF_RELINKER_H_
 #define SYZYGY_PE_PE_COFF_RELINKER_H_
 
+#include <string>
 #include <vector>
 
 #include "base/files/file_path.h"
@@ -38,6 +39,23 @@ class PECoffRelinker : public RelinkerInterface {
   typedef block_graph::OrderedBlockGraph OrderedBlockGraph;
   typedef block_graph::TransformPolicyInterface TransformPolicyInterface;
 
+  // Statistics gathered while applying a user-supplied transform or orderer.
+  struct PassStatistics {
+    // The name of the transform or orderer.
+    std::string name;
+    // Either "transform" or "orderer".
+    std::string type;
+    // The wall time taken by the pass, in seconds.
+    double seconds;
+    // The number of blocks in the block graph handed to the pass.
+    size_t blocks_visited;
+    // The number of blocks added, removed or modified by a transform, or
+    // moved by an orderer.
+    size_t blocks_changed;
+    // The change in the private memory usage of the process, in bytes.
+    int64 memory_delta;
+  };
+
   // Change the path to the main input file. By default, it is empty.
   //
   // @param input_path the new input path.
@@ -61,6 +79,15 @@ class PECoffRelinker : public RelinkerInterface {
     allow_overwrite_ = allow_overwrite;
   }
 
+  // Change the path to which statistics about each user-supplied transform
+  // and orderer are written as JSON. By default, it is empty and no
+  // statistics are gathered.
+  //
+  // @param statistics_path the new statistics path.
+  void set_statistics_path(const base::FilePath& statistics_path) {
+    statistics_path_ = statistics_path;
+  }
+
   // @returns the path to the main input file.
   const base::FilePath& input_path() const { return input_path_; }
 
@@ -70,6 +97,15 @@ class PECoffRelinker : public RelinkerInterface {
   // @returns whether output files may be overwritten.
   bool allow_overwrite() const { return allow_overwrite_; }
 
+  // @returns the path to which statistics are written.
+  const base::FilePath& statistics_path() const { return statistics_path_; }
+
+  // @returns the statistics gathered about the passes applied so far. This is
+  //     only populated if a statistics path has been set.
+  const std::vector<PassStatistics>& pass_statistics() const {
+    return pass_statistics_;
+  }
+
   // @see RelinkerInterface::AppendTransform()
   virtual bool AppendTransform(Transform* transform) OVERRIDE;
 
@@ -130,6 +166,11 @@ class PECoffRelinker : public RelinkerInterface {
   // @returns true on success, or false on failure.
   bool ApplyUserOrderers(OrderedBlockGraph* ordered_graph);
 
+  // Writes the gathered pass statistics to the statistics path, if one has
+  // been set.
+  // @returns true on success, or false on failure.
+  bool WriteStatistics() const;
+
   // The policy that dictates how to apply transforms.
   const TransformPolicyInterface* transform_policy_;
 
@@ -142,6 +183,12 @@ class PECoffRelinker : public RelinkerInterface {
   // Whether we may overwrite output files.
   bool allow_overwrite_;
 
+  // The path to which pass statistics are written, if any.
+  base::FilePath statistics_path_;
+
+  // The statistics gathered about each pass, in the order they were applied.
+  std::vector<PassStatistics> pass_statistics_;
+
   // Transforms to be applied, in order.
   std::vector<Transform*> transforms_;
 
@@ -15,6 +15,10 @@
 #include "syzygy/pe/pe_coff_relinker.h"
 
 #include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/unittest_util.h"
@@ -30,6 +34,7 @@ using block_graph::BlockGraphOrdererInterface;
 using block_graph::BlockGraphTransformInterface;
 using block_graph::OrderedBlockGraph;
 using block_graph::TransformPolicyInterface;
+using testing::_;
 
 class TestPECoffRelinker : public PECoffRelinker {
  public:
@@ -37,6 +42,11 @@ class TestPECoffRelinker : public PECoffRelinker {
       : PECoffRelinker(transform_policy) {
   }
 
+  using PECoffRelinker::ApplyUserOrderers;
+  using PECoffRelinker::ApplyUserTransforms;
+  using PECoffRelinker::WriteStatistics;
+  using PECoffRelinker::block_graph_;
+  using PECoffRelinker::headers_block_;
   using PECoffRelinker::transforms_;
   using PECoffRelinker::orderers_;
 
@@ -63,6 +73,14 @@ class MockOrderer : public BlockGraphOrdererInterface {
   MOCK_METHOD2(OrderBlockGraph, bool(OrderedBlockGraph*, BlockGraph::Block*));
 };
 
+// Adds a block to a block graph, as a transform would.
+bool AddCodeBlock(const TransformPolicyInterface* /* policy */,
+                  BlockGraph* block_graph,
+                  BlockGraph::Block* /* headers_block */) {
+  block_graph->AddBlock(BlockGraph::CODE_BLOCK, 4, "new_block");
+  return true;
+}
+
 }  // namespace
 
 TEST(PECoffRelinkerTest, Properties) {
@@ -83,6 +101,10 @@ TEST(PECoffRelinkerTest, Properties) {
   EXPECT_TRUE(relinker.allow_overwrite());
   relinker.set_allow_overwrite(false);
   EXPECT_FALSE(relinker.allow_overwrite());
+
+  EXPECT_EQ(base::FilePath(), relinker.statistics_path());
+  relinker.set_statistics_path(dummy_path);
+  EXPECT_EQ(dummy_path, relinker.statistics_path());
 }
 
 TEST(PECoffRelinkerTest, AppendTransforms) {
@@ -121,4 +143,53 @@ TEST(PECoffRelinkerTest, AppendOrderers) {
   EXPECT_EQ(expected, relinker.orderers_);
 }
 
+TEST(PECoffRelinkerTest, PassStatistics) {
+  testing::DummyTransformPolicy policy;
+  TestPECoffRelinker relinker(&policy);
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath statistics_path = temp_dir.path().Append(L"stats.json");
+  relinker.set_statistics_path(statistics_path);
+  relinker.headers_block_ = relinker.block_graph_.AddBlock(
+      BlockGraph::DATA_BLOCK, 16, "headers");
+
+  MockTransform transform;
+  EXPECT_CALL(transform, TransformBlockGraph(_, _, _))
+      .WillOnce(testing::Invoke(&AddCodeBlock));
+  relinker.AppendTransform(&transform);
+  ASSERT_TRUE(relinker.ApplyUserTransforms());
+
+  MockOrderer orderer;
+  EXPECT_CALL(orderer, OrderBlockGraph(_, _))
+      .WillOnce(testing::Return(true));
+  relinker.AppendOrderer(&orderer);
+  OrderedBlockGraph ordered_graph(&relinker.block_graph_);
+  ASSERT_TRUE(relinker.ApplyUserOrderers(&ordered_graph));
+
+  ASSERT_EQ(2u, relinker.pass_statistics().size());
+  const TestPECoffRelinker::PassStatistics& transform_stats =
+      relinker.pass_statistics()[0];
+  EXPECT_EQ("MockTransform", transform_stats.name);
+  EXPECT_EQ("transform", transform_stats.type);
+  EXPECT_EQ(1u, transform_stats.blocks_visited);
+  EXPECT_EQ(1u, transform_stats.blocks_changed);
+  const TestPECoffRelinker::PassStatistics& orderer_stats =
+      relinker.pass_statistics()[1];
+  EXPECT_EQ("MockOrderer", orderer_stats.name);
+  EXPECT_EQ("orderer", orderer_stats.type);
+  EXPECT_EQ(2u, orderer_stats.blocks_visited);
+  EXPECT_EQ(0u, orderer_stats.blocks_changed);
+
+  ASSERT_TRUE(relinker.WriteStatistics());
+  std::string json;
+  ASSERT_TRUE(base::ReadFileToString(statistics_path, &json));
+  scoped_ptr<base::Value> value(base::JSONReader::Read(json));
+  ASSERT_TRUE(value.get() != NULL);
+  base::DictionaryValue* dict = NULL;
+  ASSERT_TRUE(value->GetAsDictionary(&dict));
+  base::ListValue* passes = NULL;
+  ASSERT_TRUE(dict->GetList("passes", &passes));
+  EXPECT_EQ(2u, passes->GetSize());
+}
+
 }  // namespace pe
@@ -21,6 +21,8 @@ template <class ImageNtHeaders, DWORD MagicValidation>
 bool PEFileBase<ImageNtHeaders, MagicValidation>::Init(
     const base::FilePath& path) {
   PECoffFile::Init(path);
+  if (!MapFile())
+    return false;
 
   FILE* file = base::OpenFile(path, "rb");
   if (file == NULL) {
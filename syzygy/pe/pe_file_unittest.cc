@@ -126,6 +126,50 @@ TEST_F(PEFileTest, Init) {
   EXPECT_TRUE(image_file_.section_headers() != NULL);
 }
 
+TEST_F(PEFileTest, InitMemoryMapped) {
+  PEFile image_file;
+  EXPECT_FALSE(image_file.memory_mapped());
+  image_file.set_memory_mapped(true);
+  EXPECT_TRUE(image_file.memory_mapped());
+  ASSERT_TRUE(image_file.Init(image_file_.path()));
+
+  // The headers and every section should be identical to those that were
+  // read into buffers.
+  const IMAGE_NT_HEADERS* nt_headers = image_file.nt_headers();
+  ASSERT_TRUE(nt_headers != NULL);
+  size_t headers_size = nt_headers->OptionalHeader.SizeOfHeaders;
+  ASSERT_EQ(0, memcmp(image_file_.GetImageData(RelativeAddress(0),
+                                               headers_size),
+                      image_file.GetImageData(RelativeAddress(0),
+                                              headers_size),
+                      headers_size));
+
+  ASSERT_EQ(image_file_.nt_headers()->FileHeader.NumberOfSections,
+            nt_headers->FileHeader.NumberOfSections);
+  for (size_t i = 0; i < nt_headers->FileHeader.NumberOfSections; ++i) {
+    const IMAGE_SECTION_HEADER* header = image_file.section_header(i);
+    if (header->SizeOfRawData == 0)
+      continue;
+    RelativeAddress addr(header->VirtualAddress);
+    const uint8* data = image_file.GetImageData(addr, header->SizeOfRawData);
+    ASSERT_TRUE(data != NULL);
+    EXPECT_EQ(0, memcmp(image_file_.GetImageData(addr, header->SizeOfRawData),
+                        data, header->SizeOfRawData));
+  }
+
+  // The mapping is copy-on-write, the data can be modified.
+  uint8* data = image_file.GetImageData(RelativeAddress(0), 1);
+  ASSERT_TRUE(data != NULL);
+  data[0] = ~data[0];
+  EXPECT_NE(*image_file_.GetImageData(RelativeAddress(0), 1), data[0]);
+
+  PEFile::Signature signature;
+  PEFile::Signature mapped_signature;
+  image_file_.GetSignature(&signature);
+  image_file.GetSignature(&mapped_signature);
+  EXPECT_TRUE(signature.IsConsistent(mapped_signature));
+}
+
 TEST_F(PEFileTest, GetImageData) {
   const IMAGE_NT_HEADERS* nt_headers = image_file_.nt_headers();
   ASSERT_TRUE(nt_headers != NULL);
@@ -20,6 +20,8 @@
 
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/atomicops.h"
+#include "base/threading/simple_thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/common/buffer_parser.h"
 #include "syzygy/common/com_utils.h"
@@ -37,8 +39,8 @@ using pe::ImageLayout;
 namespace {
 
 template <class Type>
-bool UpdateReference(size_t start, Type new_value, std::vector<uint8>* data) {
-  BinaryBufferParser parser(&data->at(0), data->size());
+bool UpdateReference(size_t start, Type new_value, uint8* data, size_t size) {
+  BinaryBufferParser parser(data, size);
 
   Type* ref_ptr = NULL;
   if (!parser.GetAt(start, const_cast<const Type**>(&ref_ptr))) {
@@ -108,18 +110,65 @@ size_t GetSectionOffset(const ImageLayout& image_layout,
 
 }  // namespace
 
+// Writes the sections of the image in parallel. Each worker thread takes the
+// next section that hasn't been written yet, until they're all done.
+class PEFileWriter::SectionWriter
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  SectionWriter(PEFileWriter* writer,
+                const std::vector<BlockVector>& section_blocks,
+                uint8* image_data,
+                size_t image_size)
+      : writer_(writer), section_blocks_(section_blocks),
+        image_data_(image_data), image_size_(image_size), next_section_(0),
+        failed_(0) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    while (base::subtle::NoBarrier_Load(&failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_section_, 1));
+      if (index > section_blocks_.size())
+        return;
+
+      // The first entry holds the header blocks, which aren't in a section.
+      size_t section_index = index == 1 ? BlockGraph::kInvalidSectionId :
+                                          index - 2;
+      if (!writer_->WriteSection(section_index, section_blocks_[index - 1],
+                                 image_data_, image_size_)) {
+        base::subtle::NoBarrier_Store(&failed_, 1);
+      }
+    }
+  }
+  // @}
+
+  // @returns true iff all the sections were written successfully.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+ private:
+  PEFileWriter* writer_;
+  const std::vector<BlockVector>& section_blocks_;
+  uint8* image_data_;
+  size_t image_size_;
+
+  // One past the index of the next entry of section_blocks_ to write.
+  base::subtle::Atomic32 next_section_;
+
+  // Set to 1 as soon as a section fails to be written.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(SectionWriter);
+};
+
 PEFileWriter::PEFileWriter(const ImageLayout& image_layout)
     : image_layout_(image_layout), nt_headers_(NULL) {
 }
 
 bool PEFileWriter::WriteImage(const base::FilePath& path) {
-  // Start by attempting to open the destination file.
-  base::ScopedFILE file(base::OpenFile(path, "wb"));
-  if (file.get() == NULL) {
-    LOG(ERROR) << "Unable to open " << path.value();
-    return false;
-  }
-
   if (!ValidateHeaders())
     return false;
 
@@ -127,16 +176,10 @@ bool PEFileWriter::WriteImage(const base::FilePath& path) {
 
   bool success = CalculateSectionRanges();
   if (success)
-    success = WriteBlocks(file.get());
+    success = WriteBlocks(path);
 
   nt_headers_ = NULL;
 
-  // Close the file.
-  file.reset();
-
-  if (success)
-    success = UpdateFileChecksum(path);
-
   return success;
 }
 
@@ -176,26 +219,32 @@ bool PEFileWriter::UpdateFileChecksum(const base::FilePath& path) {
     return false;
   }
 
+  bool success = UpdateChecksum(reinterpret_cast<uint8*>(image_ptr),
+                                file_size);
+  CHECK(::UnmapViewOfFile(image_ptr));
+
+  return success;
+}
+
+bool PEFileWriter::UpdateChecksum(uint8* image_data, size_t image_size) {
+  DCHECK(image_data != NULL);
+
   // Calculate the image checksum.
   DWORD original_checksum = 0;
   DWORD new_checksum = 0;
-  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_ptr,
-                                                      file_size,
+  IMAGE_NT_HEADERS* nt_headers = ::CheckSumMappedFile(image_data,
+                                                      image_size,
                                                       &original_checksum,
                                                       &new_checksum);
-
   if (nt_headers == NULL) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "CheckSumMappedFile failed: " << common::LogWe(error);
+    return false;
   }
 
-  // On success, we write the checksum back to the file header.
-  if (nt_headers != NULL) {
-    nt_headers->OptionalHeader.CheckSum = new_checksum;
-  }
-  CHECK(::UnmapViewOfFile(image_ptr));
-
-  return nt_headers != NULL;
+  // Write the checksum back to the file header.
+  nt_headers->OptionalHeader.CheckSum = new_checksum;
+  return true;
 }
 
 bool PEFileWriter::ValidateHeaders() {
@@ -324,89 +373,123 @@ bool PEFileWriter::CalculateSectionRanges() {
   return true;
 }
 
-bool PEFileWriter::WriteBlocks(FILE* file) {
-  DCHECK(file != NULL);
-
-  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
-
-  // Create the output buffer, reserving enough room for the whole file.
+bool PEFileWriter::WriteBlocks(const base::FilePath& path) {
+  // Bucket the blocks by section. Note that the section index is not the same
+  // thing as the section_id stored in the block; the section IDs are relative
+  // to the section data stored in the block-graph, not the ordered section
+  // infos stored in the image layout. The first bucket holds the header
+  // blocks, which precede all sections.
   DCHECK(!image_layout_.sections.empty());
-  size_t last_section_index = image_layout_.sections.size() - 1;
-  size_t image_size = section_file_range_map_[last_section_index].end().value();
-  std::vector<uint8> buffer;
-  buffer.reserve(image_size);
-
-  // Iterate through all blocks in the address space writing them as we go.
-  BlockGraph::AddressSpace::RangeMap::const_iterator block_it(
-      image_layout_.blocks.address_space_impl().ranges().begin());
-  BlockGraph::AddressSpace::RangeMap::const_iterator block_end(
-      image_layout_.blocks.address_space_impl().ranges().end());
-
-  // Write all of the blocks. We take care of writing the padding at the
-  // end of each section. Note that the section index is not the same thing as
-  // the section_id stored in the block; the section IDs are relative to the
-  // section data stored in the block-graph, not the ordered section infos
-  // stored in the image layout.
+  std::vector<BlockVector> section_blocks(image_layout_.sections.size() + 1);
+  BlockGraph::AddressSpace::RangeMapConstIter block_it(
+      image_layout_.blocks.begin());
   BlockGraph::SectionId section_id = BlockGraph::kInvalidSectionId;
-  size_t section_index = BlockGraph::kInvalidSectionId;
-  for (; block_it != block_end; ++block_it) {
-    BlockGraph::Block* block = const_cast<BlockGraph::Block*>(block_it->second);
-
-    // If we're jumping to a new section output the necessary padding.
+  size_t bucket = 0;
+  for (; block_it != image_layout_.blocks.end(); ++block_it) {
+    const BlockGraph::Block* block = block_it->second;
     if (block->section() != section_id) {
-      FlushSection(section_index, &buffer);
       section_id = block->section();
-      section_index++;
-      DCHECK_GT(image_layout_.sections.size(), section_index);
-    }
-
-    if (!WriteOneBlock(image_base, section_index, block, &buffer)) {
-      LOG(ERROR) << "Failed to write block \"" << block->name() << "\".";
-      return false;
+      ++bucket;
+      DCHECK_GT(section_blocks.size(), bucket);
     }
+    section_blocks[bucket].push_back(block);
   }
 
-  FlushSection(last_section_index, &buffer);
-  DCHECK_EQ(image_size, buffer.size());
-
-  // Write the whole image to disk in one go.
-  if (::fwrite(&buffer[0], sizeof(buffer[0]), buffer.size(), file) !=
-          buffer.size()) {
-    LOG(ERROR) << "Failed to write image to file.";
+  // Create the output file at its final size, and map all of it.
+  size_t last_section_index = image_layout_.sections.size() - 1;
+  size_t image_size =
+      GetSectionFileRange(last_section_index).end().value();
+  base::win::ScopedHandle file(
+      ::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Unable to open " << path.value();
+    return false;
+  }
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(file.Get(), NULL, PAGE_READWRITE, 0, image_size,
+                          NULL));
+  uint8* image_data = NULL;
+  if (mapping.IsValid()) {
+    image_data = reinterpret_cast<uint8*>(
+        ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, image_size));
+  }
+  if (image_data == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map " << path.value() << ": "
+               << common::LogWe(error) << ".";
     return false;
   }
 
-  return true;
+  // Write the sections, which lie in disjoint parts of the file, in parallel.
+  SYSTEM_INFO system_info = {};
+  ::GetSystemInfo(&system_info);
+  size_t num_threads = std::min<size_t>(system_info.dwNumberOfProcessors,
+                                        section_blocks.size());
+  SectionWriter section_writer(this, section_blocks, image_data, image_size);
+  if (num_threads <= 1) {
+    section_writer.Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("PEFileWriter", num_threads);
+    pool.Start();
+    pool.AddWork(&section_writer, num_threads);
+    pool.JoinAll();
+  }
+  bool success = section_writer.succeeded();
+
+  // Finish with the checksum, while the whole image is still in memory.
+  if (success)
+    success = UpdateChecksum(image_data, image_size);
+
+  CHECK(::UnmapViewOfFile(image_data));
+
+  return success;
 }
 
-void PEFileWriter::FlushSection(size_t section_index,
-                                std::vector<uint8>* buffer) {
-  DCHECK(buffer != NULL);
+const PEFileWriter::FileRange& PEFileWriter::GetSectionFileRange(
+    size_t section_index) const {
+  SectionIndexFileRangeMap::const_iterator it =
+      section_file_range_map_.find(section_index);
+  DCHECK(it != section_file_range_map_.end());
+  return it->second;
+}
 
-  size_t section_file_end =
-      section_file_range_map_[section_index].end().value();
+bool PEFileWriter::WriteSection(size_t section_index,
+                                const BlockVector& blocks,
+                                uint8* image_data,
+                                size_t image_size) {
+  DCHECK(image_data != NULL);
 
-  // We've already sanity checked this in CalculateSectionFileRanges, so this
-  // should be true.
-  DCHECK_GE(section_file_end, buffer->size());
-  if (section_file_end == buffer->size())
-    return;
+  AbsoluteAddress image_base(nt_headers_->OptionalHeader.ImageBase);
 
+  // Start by padding the whole section, the blocks are then written over it.
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
+  DCHECK_LE(section_file_range.end().value(), image_size);
   uint8 padding_byte = GetSectionPaddingByte(image_layout_, section_index);
-  buffer->resize(section_file_end, padding_byte);
+  ::memset(image_data + section_file_range.start().value(), padding_byte,
+           section_file_range.size());
 
-  return;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (!WriteOneBlock(image_base, section_index, blocks[i], image_data,
+                       image_size)) {
+      LOG(ERROR) << "Failed to write block \"" << blocks[i]->name() << "\".";
+      return false;
+    }
+  }
+
+  return true;
 }
 
 bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
                                  size_t section_index,
                                  const BlockGraph::Block* block,
-                                 std::vector<uint8>* buffer) {
+                                 uint8* image_data,
+                                 size_t image_size) {
   // This function walks through the data referred by the input block, and
   // patches it to reflect the addresses and offsets of the blocks
   // referenced before writing the block's data to the file.
   DCHECK(block != NULL);
-  DCHECK(buffer != NULL);
+  DCHECK(image_data != NULL);
 
   RelativeAddress addr;
   if (!image_layout_.blocks.GetAddressOf(block, &addr)) {
@@ -414,11 +497,9 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Get the start address of the section containing this block as well as the
-  // padding byte we need to use.
+  // Get the start address of the section containing this block.
   RelativeAddress section_start(0);
   RelativeAddress section_end(image_layout_.sections[0].addr);
-  uint8 padding_byte = GetSectionPaddingByte(image_layout_, section_index);
   if (section_index != BlockGraph::kInvalidSectionId) {
     const ImageLayout::SectionInfo& section_info =
         image_layout_.sections[section_index];
@@ -426,7 +507,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     section_end = section_start + section_info.size;
   }
 
-  const FileRange& section_file_range = section_file_range_map_[section_index];
+  const FileRange& section_file_range = GetSectionFileRange(section_index);
 
   // The block should lie entirely within the section.
   if (addr < section_start || addr + block->size() > section_end) {
@@ -439,11 +520,6 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
   BlockGraph::Offset section_offs = addr - section_start;
   FileOffsetAddress file_offs = section_file_range.start() + section_offs;
 
-  // We shouldn't have written anything to the spot where the block belongs.
-  // This is only a DCHECK because the address space of the image layout and
-  // the consistency of the sections guarantees this for us.
-  DCHECK_LE(buffer->size(), file_offs.value());
-
   size_t inited_data_size = GetBlockInitializedDataSize(block);
 
   // If this block is entirely in the virtual portion of the section, skip it.
@@ -465,14 +541,11 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     return false;
   }
 
-  // Add any necessary padding to get us to the block offset.
-  if (buffer->size() < file_offs.value())
-    buffer->resize(file_offs.value(), padding_byte);
-
-  // Copy the block data into the buffer.
-  buffer->insert(buffer->end(),
-                 block->data(),
-                 block->data() + block->data_size());
+  // Copy the block data into the image. The padding before it has already
+  // been written by WriteSection.
+  uint8* block_data = image_data + file_offs.value();
+  if (block->data_size() != 0)
+    ::memcpy(block_data, block->data(), block->data_size());
 
   // We now want to append zeros for the implicit portion of the block data.
   size_t trailing_zeros = block->size() - block->data_size();
@@ -491,7 +564,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     }
 
     // Write the implicit trailing zeros.
-    buffer->insert(buffer->end(), trailing_zeros, 0);
+    ::memset(block_data + block->data_size(), 0, trailing_zeros);
   }
 
   // Patch up all the references.
@@ -538,8 +611,7 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
         // Get the offset of the block in its section, as well as the range of
         // the section on disk. Validate that the referred location is
         // actually directly represented on disk (not in implicit virtual data).
-        const FileRange& file_range =
-            section_file_range_map_[dst_section_index];
+        const FileRange& file_range = GetSectionFileRange(dst_section_index);
         size_t section_offset = GetSectionOffset(image_layout_,
                                                  dst_addr,
                                                  dst_section_index);
@@ -563,17 +635,20 @@ bool PEFileWriter::WriteOneBlock(AbsoluteAddress image_base,
     BlockGraph::Offset ref_offset = file_offs.value() + start;
     switch (ref.size()) {
       case sizeof(uint8):
-        if (!UpdateReference(ref_offset, static_cast<uint8>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint8>(value),
+                             image_data, image_size))
           return false;
         break;
 
       case sizeof(uint16):
-        if (!UpdateReference(ref_offset, static_cast<uint16>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint16>(value),
+                             image_data, image_size))
           return false;
         break;
 
       case sizeof(uint32):
-        if (!UpdateReference(ref_offset, static_cast<uint32>(value), buffer))
+        if (!UpdateReference(ref_offset, static_cast<uint32>(value),
+                             image_data, image_size))
           return false;
         break;
 
@@ -15,6 +15,8 @@
 #ifndef SYZYGY_PE_PE_FILE_WRITER_H_
 #define SYZYGY_PE_PE_FILE_WRITER_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_space.h"
@@ -36,12 +38,21 @@ class PEFileWriter {
   // @param image_layout the image layout to write.
   explicit PEFileWriter(const ImageLayout& image_layout);
 
-  // Writes the image to path.
+  // Writes the image to path. The file is created at its final size and
+  // mapped into memory, the sections are written in parallel and the checksum
+  // is computed before the file is closed.
   bool WriteImage(const base::FilePath& path);
 
   // Updates the checksum for the image @p path.
   static bool UpdateFileChecksum(const base::FilePath& path);
 
+  // Updates the checksum of an image that is already in memory, such as a
+  // writable view of the image file.
+  // @param image_data the image file contents.
+  // @param image_size the size of the image file.
+  // @returns true on success, false otherwise.
+  static bool UpdateChecksum(uint8* image_data, size_t image_size);
+
  protected:
   // Validates the DOS header and the NT headers in the image.
   // On success, sets the nt_headers_ pointer.
@@ -51,27 +62,45 @@ class PEFileWriter {
   // section_file_range_map_ and section_index_space_.
   bool CalculateSectionRanges();
 
-  // Writes the entire image to the given file. Delegates to FlushSection and
-  // WriteOneBlock.
-  bool WriteBlocks(FILE* file);
-
-  // Closes off the writing of a section by adding any necessary padding to the
-  // output buffer.
-  void FlushSection(size_t section_index,
-                    std::vector<uint8>* buffer);
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+  typedef core::AddressRange<core::FileOffsetAddress, size_t> FileRange;
 
-  // Writes a single block to the buffer, first writing any necessary padding
-  // (the content of which depends on the section type), followed by the
-  // block data (containing finalized references).
+  // Writes the sections of the image on a pool of worker threads. Defined in
+  // the implementation file.
+  class SectionWriter;
+
+  // Writes the entire image to the given file, and updates its checksum.
+  // Delegates to WriteSection.
+  bool WriteBlocks(const base::FilePath& path);
+
+  // @returns the file range of the given section, which must exist.
+  const FileRange& GetSectionFileRange(size_t section_index) const;
+
+  // Writes a section of the image, filling it with the padding byte of the
+  // section before writing each of its blocks. This only reads the image
+  // layout, so distinct sections may be written concurrently.
+  // @param section_index the index of the section, or kInvalidSectionId for
+  //     the headers.
+  // @param blocks the blocks in the section, in address order.
+  // @param image_data the data of the whole image file.
+  // @param image_size the size of the whole image file.
+  // @returns true on success, false otherwise.
+  bool WriteSection(size_t section_index,
+                    const BlockVector& blocks,
+                    uint8* image_data,
+                    size_t image_size);
+
+  // Writes a single block to the image at its file offset, followed by its
+  // implicit trailing zeros, and finalizes its references.
   bool WriteOneBlock(AbsoluteAddress image_base,
                      size_t section_index,
                      const BlockGraph::Block* block,
-                     std::vector<uint8>* buffer);
+                     uint8* image_data,
+                     size_t image_size);
 
   // The file ranges of each section. This is populated by
   // CalculateSectionRanges and is a map from section index (as ordered in
   // the image layout) to section ranges on disk.
-  typedef core::AddressRange<core::FileOffsetAddress, size_t> FileRange;
   typedef std::map<size_t, FileRange> SectionIndexFileRangeMap;
   SectionIndexFileRangeMap section_file_range_map_;
 
@@ -14,6 +14,8 @@
 
 #include "syzygy/pe/pe_file_writer.h"
 
+#include <imagehlp.h>  // NOLINT
+
 #include "base/file_util.h"
 #include "base/path_service.h"
 #include "gmock/gmock.h"
@@ -66,6 +68,38 @@ TEST_F(PEFileWriterTest, RewriteAndLoadImage) {
   ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file));
 }
 
+TEST_F(PEFileWriterTest, RewrittenImageHasValidChecksum) {
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath temp_file = temp_dir.Append(testing::kTestDllName);
+
+  PEFile image_file;
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  block_graph::BlockGraph block_graph;
+  pe::ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  // Write the image twice over the same path, the second write must replace
+  // the first one entirely.
+  PEFileWriter writer(image_layout);
+  ASSERT_TRUE(writer.WriteImage(temp_file));
+  ASSERT_TRUE(writer.WriteImage(temp_file));
+
+  // The checksum is computed as part of the write.
+  DWORD header_checksum = 0;
+  DWORD checksum = 0;
+  ASSERT_EQ(CHECKSUM_SUCCESS,
+            ::MapFileAndCheckSum(temp_file.value().c_str(), &header_checksum,
+                                 &checksum));
+  EXPECT_EQ(checksum, header_checksum);
+  EXPECT_NE(0u, checksum);
+
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(temp_file));
+}
+
 TEST_F(PEFileWriterTest, UpdateFileChecksum) {
   base::FilePath temp_dir;
   ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
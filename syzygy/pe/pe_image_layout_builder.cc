@@ -30,6 +30,7 @@ using block_graph::TypedBlock;
 using core::RelativeAddress;
 
 typedef std::vector<uint8> ByteVector;
+typedef std::vector<RelativeAddress> RelativeAddressVector;
 
 // A utility class to help with formatting the relocations section.
 class RelocWriter {
@@ -55,6 +56,29 @@ class RelocWriter {
     Append(&type_offset, sizeof(type_offset));
   }
 
+  // Writes a batch of relocations. The buffer is sized once for the whole
+  // batch, instead of growing with each relocation.
+  // @param addrs The addresses to relocate, in increasing order.
+  void WriteRelocs(const RelativeAddressVector& addrs) {
+    size_t page_count = 0;
+    DWORD page = curr_page_;
+    bool page_open = buf_.size() != 0;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      DCHECK(i == 0 || addrs[i - 1] < addrs[i]);
+      if (!page_open || PageFromAddr(addrs[i]) != page) {
+        page = PageFromAddr(addrs[i]);
+        page_open = true;
+        ++page_count;
+      }
+    }
+
+    // Each page has a header, and may need a filler entry.
+    buf_.reserve(buf_.size() + addrs.size() * sizeof(WORD) +
+        page_count * (sizeof(IMAGE_BASE_RELOCATION) + sizeof(WORD)));
+    for (size_t i = 0; i < addrs.size(); ++i)
+      WriteReloc(addrs[i]);
+  }
+
   void Close(ByteVector* relocs_out) {
     DCHECK(relocs_out != NULL);
 
@@ -379,16 +403,19 @@ bool PEImageLayoutBuilder::CreateRelocsSection() {
   CHECK_EQ(0, reloc_data.offset());
 
   // Iterate over all blocks in the address space, in the order of increasing
-  // addresses.
+  // addresses. The address of each block is that of its range, which saves a
+  // lookup per block.
   BlockGraph::AddressSpace::RangeMap::const_iterator it(
       image_layout_->blocks.address_space_impl().ranges().begin());
   BlockGraph::AddressSpace::RangeMap::const_iterator end(
       image_layout_->blocks.address_space_impl().ranges().end());
 
+  RelativeAddressVector reloc_addrs;
   for (; it != end; ++it) {
     const BlockGraph::Block* block = it->second;
-    RelativeAddress block_addr;
-    CHECK(image_layout_->blocks.GetAddressOf(block, &block_addr));
+    if (block->references().empty())
+      continue;
+    RelativeAddress block_addr = it->first.start();
 
     // Iterate over all outgoing references in this block in
     // order of increasing offset.
@@ -398,14 +425,14 @@ bool PEImageLayoutBuilder::CreateRelocsSection() {
         block->references().end());
     for (; ref_it != ref_end; ++ref_it) {
       // Add each absolute reference to the relocs.
-      if (ref_it->second.type() == BlockGraph::ABSOLUTE_REF) {
-        writer.WriteReloc(block_addr + ref_it->first);
-      }
+      if (ref_it->second.type() == BlockGraph::ABSOLUTE_REF)
+        reloc_addrs.push_back(block_addr + ref_it->first);
     }
   }
 
   // Get the relocations data from the writer.
   ByteVector relocs;
+  writer.WriteRelocs(reloc_addrs);
   writer.Close(&relocs);
 
   // Update the block and the data directory.
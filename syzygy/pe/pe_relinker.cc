@@ -15,11 +15,11 @@
 #include "syzygy/pe/pe_relinker.h"
 
 #include "base/file_util.h"
+#include "syzygy/core/serialization.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
-#include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/metadata.h"
 #include "syzygy/pe/pdb_info.h"
@@ -46,27 +46,108 @@ using pdb::PdbMutatorInterface;
 using pdb::PdbStream;
 using pdb::WritablePdbStream;
 
-// Decomposes the module enclosed by the given PE file.
+// Loads the decomposition of @p pe_file from @p cache_path into the empty
+// @p image_layout.
+// @param loaded is set to true if the decomposition was loaded. It is left
+//     false if the cache doesn't exist or holds the decomposition of another
+//     image, in which case @p image_layout is left untouched.
+// @returns false if the cache matches @p pe_file but couldn't be loaded.
+bool LoadCachedDecomposition(const PEFile& pe_file,
+                             const base::FilePath& cache_path,
+                             ImageLayout* image_layout,
+                             bool* loaded) {
+  DCHECK(image_layout != NULL);
+  DCHECK(loaded != NULL);
+  DCHECK(image_layout->blocks.graph()->blocks().empty());
+
+  *loaded = false;
+  if (cache_path.empty() || !base::PathExists(cache_path))
+    return true;
+
+  base::ScopedFILE file(base::OpenFile(cache_path, "rb"));
+  if (file.get() == NULL) {
+    LOG(WARNING) << "Unable to open decomposition cache: "
+                 << cache_path.value();
+    return true;
+  }
+
+  LOG(INFO) << "Loading cached decomposition: " << cache_path.value();
+  core::FileInStream in_stream(file.get());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+  if (LoadBlockGraphAndImageLayout(pe_file, NULL, image_layout, &in_archive)) {
+    *loaded = true;
+    return true;
+  }
+
+  // A stale cache is rejected on its version or signature before anything is
+  // loaded, and is simply replaced.
+  if (image_layout->blocks.graph()->blocks().empty()) {
+    LOG(INFO) << "Ignoring stale decomposition cache.";
+    return true;
+  }
+
+  LOG(ERROR) << "Corrupt decomposition cache: " << cache_path.value();
+  return false;
+}
+
+// Saves the decomposition of @p pe_file to @p cache_path. Failing to do so
+// isn't fatal, the image will simply be decomposed the next time.
+void SaveCachedDecomposition(const PEFile& pe_file,
+                             const ImageLayout& image_layout,
+                             const base::FilePath& cache_path) {
+  LOG(INFO) << "Saving decomposition cache: " << cache_path.value();
+  base::ScopedFILE file(base::OpenFile(cache_path, "wb"));
+  if (file.get() == NULL) {
+    LOG(WARNING) << "Unable to create decomposition cache: "
+                 << cache_path.value();
+    return;
+  }
+
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+  if (!SaveBlockGraphAndImageLayout(pe_file, 0, image_layout, &out_archive) ||
+      !out_archive.Flush()) {
+    LOG(WARNING) << "Failed to save decomposition cache: "
+                 << cache_path.value();
+    file.reset();
+    base::DeleteFile(cache_path, false);
+  }
+}
+
+// Decomposes the module enclosed by the given PE file, or loads its
+// decomposition from @p cache_path if possible.
 bool Decompose(const PEFile& pe_file,
                const base::FilePath& pdb_path,
+               const base::FilePath& cache_path,
                ImageLayout* image_layout,
                BlockGraph::Block** dos_header_block) {
   DCHECK(image_layout != NULL);
   DCHECK(dos_header_block != NULL);
 
-  LOG(INFO) << "Decomposing module: " << pe_file.path().value();
-
   BlockGraph* block_graph = image_layout->blocks.graph();
   ImageLayout orig_image_layout(block_graph);
 
-  // Decompose the input image.
-  Decomposer decomposer(pe_file);
-  decomposer.set_pdb_path(pdb_path);
-  if (!decomposer.Decompose(&orig_image_layout)) {
-    LOG(ERROR) << "Unable to decompose module: " << pe_file.path().value();
+  bool loaded = false;
+  if (!LoadCachedDecomposition(pe_file, cache_path, &orig_image_layout,
+                               &loaded)) {
     return false;
   }
 
+  if (!loaded) {
+    LOG(INFO) << "Decomposing module: " << pe_file.path().value();
+
+    // Decompose the input image.
+    Decomposer decomposer(pe_file);
+    decomposer.set_pdb_path(pdb_path);
+    if (!decomposer.Decompose(&orig_image_layout)) {
+      LOG(ERROR) << "Unable to decompose module: " << pe_file.path().value();
+      return false;
+    }
+
+    if (!cache_path.empty())
+      SaveCachedDecomposition(pe_file, orig_image_layout, cache_path);
+  }
+
   // Make a copy of the image layout without padding. We don't want to carry
   // the padding through the toolchain.
   LOG(INFO) << "Removing padding blocks.";
@@ -153,8 +234,8 @@ bool PERelinker::Init() {
   }
 
   // Decompose the image.
-  if (!Decompose(input_pe_file_, input_pdb_path_, &input_image_layout_,
-                 &headers_block_)) {
+  if (!Decompose(input_pe_file_, input_pdb_path_, decomposition_cache_path_,
+                 &input_image_layout_, &headers_block_)) {
     return false;
   }
 
@@ -219,21 +300,27 @@ bool PERelinker::Relink() {
   // Finalize the PDB file.
   RelativeAddressRange input_range;
   GetOmapRange(input_image_layout_.sections, &input_range);
+  // The block-graph stream is serialized while writing the PDB, so that it
+  // doesn't need to be built in memory.
   if (!FinalizePdbFile(input_path_, output_path_, input_range,
-                       output_image_layout, output_guid_, augment_pdb_,
+                       output_image_layout, output_guid_, false,
                        strip_strings_, compress_pdb_, &pdb_file)) {
     return false;
   }
 
   // Write the PDB file.
   LOG(INFO) << "Writing the PDB.";
-  pdb::PdbWriter pdb_writer;
-  if (!pdb_writer.Write(output_pdb_path_, pdb_file)) {
+  if (!WritePdbFile(output_path_, output_image_layout, augment_pdb_,
+                    strip_strings_, compress_pdb_, output_pdb_path_,
+                    &pdb_file)) {
     LOG(ERROR) << "Failed to write PDB file \"" << output_pdb_path_.value()
                << "\".";
     return false;
   }
 
+  if (!WriteStatistics())
+    return false;
+
   LOG(INFO) << "PE relinker finished.";
 
   return true;
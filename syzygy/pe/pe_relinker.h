@@ -30,6 +30,8 @@
 //   relinker.set_output_path(...);  // Required.
 //   relinker.set_input_pdb_path(...);  // Optional.
 //   relinker.set_output_pdb_path(...);  // Optional.
+//   relinker.set_decomposition_cache_path(...);  // Optional.
+//   relinker.set_statistics_path(...);  // Optional.
 //   relinker.Init();  // Check the return value!
 //
 //   // At this point, the following accessors are valid:
@@ -115,6 +117,9 @@ class PERelinker : public PECoffRelinker {
   // @{
   const base::FilePath& input_pdb_path() const { return input_pdb_path_; }
   const base::FilePath& output_pdb_path() const { return output_pdb_path_; }
+  const base::FilePath& decomposition_cache_path() const {
+    return decomposition_cache_path_;
+  }
   bool add_metadata() const { return add_metadata_; }
   bool augment_pdb() const { return augment_pdb_; }
   bool compress_pdb() const { return compress_pdb_; }
@@ -131,6 +136,15 @@ class PERelinker : public PECoffRelinker {
   void set_output_pdb_path(const base::FilePath& output_pdb_path) {
     output_pdb_path_ = output_pdb_path;
   }
+  // Sets the path of a file caching the decomposition of the input image.
+  // If it holds the decomposition of the current input image, Init loads it
+  // rather than decomposing the image. Otherwise Init decomposes the image
+  // and saves its decomposition there, for subsequent relinks of the same
+  // image. By default there is no cache.
+  void set_decomposition_cache_path(
+      const base::FilePath& decomposition_cache_path) {
+    decomposition_cache_path_ = decomposition_cache_path;
+  }
   void set_add_metadata(bool add_metadata) {
     add_metadata_ = add_metadata;
   }
@@ -197,14 +211,15 @@ class PERelinker : public PECoffRelinker {
 
   base::FilePath input_pdb_path_;
   base::FilePath output_pdb_path_;
+  base::FilePath decomposition_cache_path_;
 
   // If true, metadata will be added to the output image. Defaults to true.
   bool add_metadata_;
   // If true, the PDB will be augmented with a serialized block-graph and
   // image layout. Defaults to true.
   bool augment_pdb_;
-  // If true, then the augmented PDB stream will be compressed as it is written.
-  // Defaults to false.
+  // If true, then the augmented PDB stream will be compressed as it is written,
+  // and identical PDB pages will only be written once. Defaults to false.
   bool compress_pdb_;
   // If true, strings associated with a block-graph will not be serialized into
   // the PDB. Defaults to false.
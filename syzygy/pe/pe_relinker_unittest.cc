@@ -121,6 +121,10 @@ TEST_F(PERelinkerTest, Properties) {
   relinker.set_output_pdb_path(dummy_path);
   EXPECT_EQ(dummy_path, relinker.output_pdb_path());
 
+  EXPECT_EQ(base::FilePath(), relinker.decomposition_cache_path());
+  relinker.set_decomposition_cache_path(dummy_path);
+  EXPECT_EQ(dummy_path, relinker.decomposition_cache_path());
+
   EXPECT_TRUE(relinker.add_metadata());
   relinker.set_add_metadata(false);
   EXPECT_FALSE(relinker.add_metadata());
@@ -329,6 +333,33 @@ TEST_F(PERelinkerTest, IdentityRelink) {
   EXPECT_EQ(pdb_path, relinker.output_pdb_path());
 }
 
+TEST_F(PERelinkerTest, RelinkUsesDecompositionCache) {
+  base::FilePath cache_path(temp_dir_.Append(L"decomposition.cache"));
+
+  // The first relink decomposes the image and populates the cache.
+  {
+    TestPERelinker relinker(&policy_);
+    relinker.set_input_path(input_dll_);
+    relinker.set_output_path(temp_dll_);
+    relinker.set_decomposition_cache_path(cache_path);
+    EXPECT_TRUE(relinker.Init());
+    EXPECT_TRUE(relinker.Relink());
+  }
+  EXPECT_TRUE(base::PathExists(cache_path));
+
+  // The second relink loads the decomposition from the cache, and must
+  // produce an equally valid image.
+  TestPERelinker relinker(&policy_);
+  relinker.set_input_path(input_dll_);
+  relinker.set_output_path(temp_dll_);
+  relinker.set_allow_overwrite(true);
+  relinker.set_decomposition_cache_path(cache_path);
+  EXPECT_TRUE(relinker.Init());
+  EXPECT_TRUE(relinker.Relink());
+
+  ASSERT_NO_FATAL_FAILURE(CheckTestDll(relinker.output_path()));
+}
+
 TEST_F(PERelinkerTest, BlockGraphStreamIsCreated) {
   TestPERelinker relinker(&policy_);
 
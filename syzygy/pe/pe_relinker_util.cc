@@ -15,11 +15,13 @@
 #include "syzygy/pe/pe_relinker_util.h"
 
 #include "base/file_util.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/block_graph/transform.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_util.h"
+#include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/metadata.h"
 #include "syzygy/pe/pe_image_layout_builder.h"
@@ -69,6 +71,28 @@ class PdbOutStream : public core::OutStream {
   scoped_refptr<WritablePdbStream> pdb_stream_;
 };
 
+// Builds an OMAP vector from an image source map on a thread of its own.
+class OmapVectorBuilder : public base::DelegateSimpleThread::Delegate {
+ public:
+  OmapVectorBuilder(const RelativeAddressRange& range,
+                    const ImageSourceMap& source_map,
+                    std::vector<OMAP>* omaps)
+      : range_(range), source_map_(source_map), omaps_(omaps) {
+    DCHECK(omaps != NULL);
+  }
+
+  virtual void Run() OVERRIDE {
+    BuildOmapVectorFromImageSourceMap(range_, source_map_, omaps_);
+  }
+
+ private:
+  RelativeAddressRange range_;
+  const ImageSourceMap& source_map_;
+  std::vector<OMAP>* omaps_;
+
+  DISALLOW_COPY_AND_ASSIGN(OmapVectorBuilder);
+};
+
 void BuildOmapVectors(const RelativeAddressRange& input_range,
                       const ImageLayout& output_image_layout,
                       std::vector<OMAP>* omap_to,
@@ -86,14 +110,20 @@ void BuildOmapVectors(const RelativeAddressRange& input_range,
   ImageSourceMap reverse_map;
   BuildImageSourceMap(output_image_layout, &reverse_map);
 
+  // OMAPTO only depends on the reverse map, so it is built on another thread
+  // while the forward map and OMAPFROM are computed. Both only read the
+  // reverse map.
+  OmapVectorBuilder omap_to_builder(output_range, reverse_map, omap_to);
+  base::DelegateSimpleThread omap_to_thread(&omap_to_builder, "OmapTo");
+  omap_to_thread.Start();
+
   ImageSourceMap forward_map;
   if (reverse_map.ComputeInverse(&forward_map) != 0) {
     LOG(WARNING) << "OMAPFROM not unique (there exist repeated source ranges).";
   }
-
-  // Build the two OMAP vectors.
-  BuildOmapVectorFromImageSourceMap(output_range, reverse_map, omap_to);
   BuildOmapVectorFromImageSourceMap(input_range, forward_map, omap_from);
+
+  omap_to_thread.Join();
 }
 
 // Get a specific named stream if it already exists, otherwise create one.
@@ -234,51 +264,58 @@ bool WriteSyzygyHistoryStream(const base::FilePath& input_path,
   return true;
 }
 
-// This writes the serialized block-graph and the image layout in a PDB stream
-// named /Syzygy/BlockGraph. If the format is changed, be sure to update this
-// documentation and pdb::kSyzygyBlockGraphStreamVersion (in pdb_constants.h).
-// The block graph stream will not include the data from the blocks of the
-// block-graph. If the strip-strings flag is set to true the strings contained
-// in the block-graph won't be saved.
-bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
-                                 const ImageLayout& image_layout,
-                                 bool strip_strings,
-                                 bool compress,
-                                 NameStreamMap* name_stream_map,
-                                 PdbFile* pdb_file) {
-  // Get the redecomposition data stream.
-  scoped_refptr<PdbStream> block_graph_reader =
-      GetOrCreatePdbStreamByName(pdb::kSyzygyBlockGraphStreamName,
-                                 true,
-                                 name_stream_map,
-                                 pdb_file);
+// A utility class for wrapping a serialization OutStream around the stream
+// being written by a PdbWriter.
+class PdbWriterOutStream : public core::OutStream {
+ public:
+  explicit PdbWriterOutStream(pdb::PdbWriter* pdb_writer)
+      : pdb_writer_(pdb_writer) {
+    DCHECK(pdb_writer != NULL);
+  }
 
-  if (block_graph_reader == NULL) {
-    LOG(ERROR) << "Failed to get the block-graph stream.";
-    return false;
+  virtual ~PdbWriterOutStream() { }
+
+  virtual bool Write(size_t length, const core::Byte* bytes) OVERRIDE {
+    return pdb_writer_->WriteStreamData(bytes, length);
   }
-  DCHECK_EQ(0u, block_graph_reader->length());
 
-  scoped_refptr<WritablePdbStream> block_graph_writer =
-      block_graph_reader->GetWritablePdbStream();
-  DCHECK(block_graph_writer.get() != NULL);
+ private:
+  pdb::PdbWriter* pdb_writer_;
+};
+
+// This serializes the block-graph and the image layout to @p pdb_out_stream,
+// in the format of the PDB stream named /Syzygy/BlockGraph. If the format is
+// changed, be sure to update this documentation and
+// pdb::kSyzygyBlockGraphStreamVersion (in pdb_constants.h).
+// The block graph stream will not include the data from the blocks of the
+// block-graph. If the strip-strings flag is set to true the strings contained
+// in the block-graph won't be saved.
+bool SerializeSyzygyBlockGraphStream(const PEFile& pe_file,
+                                     const ImageLayout& image_layout,
+                                     bool strip_strings,
+                                     bool compress,
+                                     core::OutStream* pdb_out_stream) {
+  DCHECK(pdb_out_stream != NULL);
 
   // Write the version of the BlockGraph stream, and whether or not its
   // contents are compressed.
-  if (!block_graph_writer->Write(pdb::kSyzygyBlockGraphStreamVersion) ||
-      !block_graph_writer->Write(static_cast<unsigned char>(compress))) {
+  uint32 version = pdb::kSyzygyBlockGraphStreamVersion;
+  unsigned char compressed = static_cast<unsigned char>(compress);
+  if (!pdb_out_stream->Write(sizeof(version),
+                             reinterpret_cast<const core::Byte*>(&version)) ||
+      !pdb_out_stream->Write(sizeof(compressed), &compressed)) {
     LOG(ERROR) << "Failed to write Syzygy BlockGraph stream header.";
     return false;
   }
 
   // Set up the output stream.
-  PdbOutStream pdb_out_stream(block_graph_writer.get());
-  core::OutStream* out_stream = &pdb_out_stream;
+  core::OutStream* out_stream = pdb_out_stream;
 
-  // If requested, compress the output.
-  scoped_ptr<core::ZOutStream> zip_stream;
+  // If requested, compress the output. The chunks are compressed in
+  // parallel, as this dominates the time spent writing the stream.
+  scoped_ptr<core::ParallelZOutStream> zip_stream;
   if (compress) {
-    zip_stream.reset(new core::ZOutStream(&pdb_out_stream));
+    zip_stream.reset(new core::ParallelZOutStream(pdb_out_stream));
     out_stream = zip_stream.get();
     if (!zip_stream->Init(core::ZOutStream::kZBestCompression)) {
       LOG(ERROR) << "Failed to initialize zlib compressor.";
@@ -306,6 +343,36 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
   return true;
 }
 
+// This writes the serialized block-graph and the image layout in a PDB stream
+// named /Syzygy/BlockGraph. See SerializeSyzygyBlockGraphStream for details.
+bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
+                                 const ImageLayout& image_layout,
+                                 bool strip_strings,
+                                 bool compress,
+                                 NameStreamMap* name_stream_map,
+                                 PdbFile* pdb_file) {
+  // Get the redecomposition data stream.
+  scoped_refptr<PdbStream> block_graph_reader =
+      GetOrCreatePdbStreamByName(pdb::kSyzygyBlockGraphStreamName,
+                                 true,
+                                 name_stream_map,
+                                 pdb_file);
+
+  if (block_graph_reader == NULL) {
+    LOG(ERROR) << "Failed to get the block-graph stream.";
+    return false;
+  }
+  DCHECK_EQ(0u, block_graph_reader->length());
+
+  scoped_refptr<WritablePdbStream> block_graph_writer =
+      block_graph_reader->GetWritablePdbStream();
+  DCHECK(block_graph_writer.get() != NULL);
+
+  PdbOutStream pdb_out_stream(block_graph_writer.get());
+  return SerializeSyzygyBlockGraphStream(pe_file, image_layout, strip_strings,
+                                         compress, &pdb_out_stream);
+}
+
 }  // namespace
 
 bool ValidateAndInferPaths(
@@ -574,4 +641,79 @@ bool FinalizePdbFile(const base::FilePath input_module,
   return true;
 }
 
+bool WritePdbFile(const base::FilePath output_module,
+                  const ImageLayout& image_layout,
+                  bool augment_pdb,
+                  bool strip_strings,
+                  bool compress_pdb,
+                  const base::FilePath& output_pdb,
+                  pdb::PdbFile* pdb_file) {
+  DCHECK(pdb_file != NULL);
+
+  // Reserve the block-graph stream. Its contents are serialized straight to
+  // the output file when its turn comes, rather than being built in memory.
+  PEFile new_pe_file;
+  size_t block_graph_stream = 0;
+  if (augment_pdb) {
+    if (!new_pe_file.Init(output_module)) {
+      LOG(ERROR) << "Failed to read newly written PE file.";
+      return false;
+    }
+
+    pdb::PdbInfoHeader70 header = {};
+    pdb::NameStreamMap name_stream_map;
+    if (!pdb::ReadHeaderInfoStream(*pdb_file, &header, &name_stream_map))
+      return false;
+
+    NameStreamMap::const_iterator name_it =
+        name_stream_map.find(pdb::kSyzygyBlockGraphStreamName);
+    if (name_it != name_stream_map.end()) {
+      block_graph_stream = name_it->second;
+      pdb_file->ReplaceStream(block_graph_stream, NULL);
+    } else {
+      block_graph_stream = pdb_file->AppendStream(NULL);
+      name_stream_map[pdb::kSyzygyBlockGraphStreamName] = block_graph_stream;
+      if (!pdb::WriteHeaderInfoStream(header, name_stream_map, pdb_file))
+        return false;
+    }
+    DCHECK_NE(0u, block_graph_stream);
+  }
+
+  pdb::PdbWriter pdb_writer;
+  pdb_writer.set_deduplicate_pages(compress_pdb);
+  if (!pdb_writer.Start(output_pdb))
+    return false;
+
+  for (size_t i = 0; i < pdb_file->StreamCount(); ++i) {
+    if (!augment_pdb || i != block_graph_stream) {
+      if (!pdb_writer.WriteStream(pdb_file->GetStream(i)))
+        return false;
+      continue;
+    }
+
+    VLOG(1) << "Writing serialized block-graph stream to PDB.";
+    PdbWriterOutStream out_stream(&pdb_writer);
+    if (!pdb_writer.BeginStream() ||
+        !SerializeSyzygyBlockGraphStream(new_pe_file,
+                                         image_layout,
+                                         strip_strings,
+                                         compress_pdb,
+                                         &out_stream) ||
+        !pdb_writer.EndStream()) {
+      LOG(ERROR) << "Failed to write the block-graph stream.";
+      return false;
+    }
+  }
+
+  if (!pdb_writer.Finish())
+    return false;
+
+  if (compress_pdb) {
+    VLOG(1) << "Shared " << pdb_writer.deduplicated_page_count()
+            << " duplicate PDB pages.";
+  }
+
+  return true;
+}
+
 }  // namespace pe
@@ -139,6 +139,32 @@ bool FinalizePdbFile(const base::FilePath input_module,
                      bool compress_pdb,
                      pdb::PdbFile* pdb_file);
 
+// Writes a finalized PDB file to disk one stream at a time. Streams read from
+// the original PDB are paged through to the output, and the serialized
+// block-graph is written directly to the output file as it is produced, so
+// that it never needs to be held in memory.
+// @param output_module The path to the transformed output module.
+// @param image_layout The transformed image layout.
+// @param augment_pdb If true then the serialized block-graph will be emitted to
+//     the PDB. This replaces any existing block-graph stream.
+// @param strip_strings If true then all strings will be stripped from the
+//     serialized block-graph, to save on space. Has no effect unless
+//     @p augment_pdb is true.
+// @param compress_pdb If true then the serialized block-graph will be
+//     compressed, and identical pages will be written only once.
+// @param output_pdb The path of the PDB file to write.
+// @param pdb_file The PDB file finalized by FinalizePdbFile, with
+//     @p augment_pdb false. Its header stream is updated to name the
+//     block-graph stream if required.
+// @returns true on success, false otherwise.
+bool WritePdbFile(const base::FilePath output_module,
+                  const ImageLayout& image_layout,
+                  bool augment_pdb,
+                  bool strip_strings,
+                  bool compress_pdb,
+                  const base::FilePath& output_pdb,
+                  pdb::PdbFile* pdb_file);
+
 }  // namespace pe
 
 #endif  // SYZYGY_PE_PE_RELINKER_UTIL_H_
@@ -20,6 +20,7 @@
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_constants.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/decomposer.h"
@@ -321,4 +322,54 @@ TEST_F(PERelinkerUtilTest, GetOmapRangeAndFinalizePdb) {
   EXPECT_EQ(guid, pdb_header.signature);
 }
 
+TEST_F(PERelinkerUtilTest, WritePdbFile) {
+  ASSERT_NO_FATAL_FAILURE(DecomposeTestDll());
+
+  RelativeAddressRange omap_range;
+  GetOmapRange(image_layout_.sections, &omap_range);
+
+  ASSERT_TRUE(base::CopyFile(input_dll_, temp_dll_));
+
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  ASSERT_TRUE(pdb_reader.Read(input_pdb_, &pdb_file));
+
+  GUID guid = {};
+  ASSERT_TRUE(FinalizePdbFile(input_dll_,
+                              temp_dll_,
+                              omap_range,
+                              image_layout_,
+                              guid,
+                              false,  // augment_pdb.
+                              false,  // strip_strings.
+                              false,  // compress_pdb.
+                              &pdb_file));
+  EXPECT_TRUE(WritePdbFile(temp_dll_,
+                           image_layout_,
+                           true,   // augment_pdb.
+                           false,  // strip_strings.
+                           false,  // compress_pdb.
+                           temp_pdb_,
+                           &pdb_file));
+
+  // The written PDB should contain the block-graph stream.
+  pdb::PdbFile pdb_file_read;
+  ASSERT_TRUE(pdb_reader.Read(temp_pdb_, &pdb_file_read));
+  pdb::PdbInfoHeader70 pdb_header;
+  pdb::NameStreamMap pdb_name_stream_map;
+  ASSERT_TRUE(pdb::ReadHeaderInfoStream(
+      pdb_file_read, &pdb_header, &pdb_name_stream_map));
+  EXPECT_EQ(guid, pdb_header.signature);
+
+  pdb::NameStreamMap::const_iterator name_it =
+      pdb_name_stream_map.find(pdb::kSyzygyBlockGraphStreamName);
+  ASSERT_TRUE(name_it != pdb_name_stream_map.end());
+  pdb::PdbStream* stream = pdb_file_read.GetStream(name_it->second);
+  ASSERT_TRUE(stream != NULL);
+
+  uint32 version = 0;
+  ASSERT_TRUE(stream->Read(&version, 1));
+  EXPECT_EQ(pdb::kSyzygyBlockGraphStreamVersion, version);
+}
+
 }  // namespace pe
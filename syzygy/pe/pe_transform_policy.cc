@@ -153,15 +153,18 @@ bool PETransformPolicy::BlockIsSafeToBasicBlockDecompose(
     return false;
 
   // Look for a cached result. This prevents repeated (expensive) calculations
-  // and inspections over the block.
-  BlockResultCache::const_iterator it = block_result_cache_->find(
-      block->id());
-  if (it != block_result_cache_->end())
-    return it->second;
-
-  bool result = CodeBlockIsSafeToBasicBlockDecompose(block);
-  block_result_cache_->insert(std::make_pair(block->id(), result));
-  return result;
+  // and inspections over the block, as long as it hasn't been modified since.
+  BlockResultCache::iterator it = block_result_cache_->find(block->id());
+  if (it != block_result_cache_->end() &&
+      BlockResultIsCurrent(block, it->second)) {
+    return it->second.is_safe;
+  }
+
+  BlockResult result = {};
+  result.is_safe = CodeBlockIsSafeToBasicBlockDecompose(block);
+  GetBlockFingerprint(block, &result);
+  (*block_result_cache_)[block->id()] = result;
+  return result.is_safe;
 }
 
 bool PETransformPolicy::ReferenceIsSafeToRedirect(
@@ -195,6 +198,25 @@ bool PETransformPolicy::CodeBlockIsSafeToBasicBlockDecompose(
   return true;
 }
 
+void PETransformPolicy::GetBlockFingerprint(const BlockGraph::Block* block,
+                                            BlockResult* result) {
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+  DCHECK_NE(reinterpret_cast<BlockResult*>(NULL), result);
+  result->size = block->size();
+  result->label_count = block->labels().size();
+  result->reference_count = block->references().size();
+  result->referrer_count = block->referrers().size();
+}
+
+bool PETransformPolicy::BlockResultIsCurrent(const BlockGraph::Block* block,
+                                             const BlockResult& result) {
+  DCHECK_NE(reinterpret_cast<BlockGraph::Block*>(NULL), block);
+  return result.size == block->size() &&
+      result.label_count == block->labels().size() &&
+      result.reference_count == block->references().size() &&
+      result.referrer_count == block->referrers().size();
+}
+
 bool PETransformPolicy::CodeBlockHasPrivateSymbols(
     const BlockGraph::Block* code_block) {
   BlockGraph::Block::LabelMap::const_iterator it = code_block->labels().begin();
@@ -72,9 +72,32 @@ class PETransformPolicy : public block_graph::TransformPolicyInterface {
       const BlockGraph::Block* code_block);
 
  protected:
+  // A cached analysis result, along with a fingerprint of the parts of the
+  // block it was derived from. Transforms may mutate a block in place after
+  // it has been analyzed, in which case the fingerprint no longer matches and
+  // the block is analyzed anew.
+  struct BlockResult {
+    bool is_safe;
+    BlockGraph::Size size;
+    size_t label_count;
+    size_t reference_count;
+    size_t referrer_count;
+  };
+
+  // Computes the fingerprint of a block, leaving @p result->is_safe untouched.
+  // @param block The block to fingerprint.
+  // @param result Receives the fingerprint.
+  static void GetBlockFingerprint(const BlockGraph::Block* block,
+                                  BlockResult* result);
+
+  // @returns true iff @p result was derived from the current state of
+  //     @p block.
+  static bool BlockResultIsCurrent(const BlockGraph::Block* block,
+                                   const BlockResult& result);
+
   // Block IDs are stable, unique and can't be reused. That makes them perfect
   // for a cache ID.
-  typedef std::map<const BlockGraph::BlockId, bool> BlockResultCache;
+  typedef std::map<const BlockGraph::BlockId, BlockResult> BlockResultCache;
   scoped_ptr<BlockResultCache> block_result_cache_;
 
   // Determines whether or not we will allow decomposition of blocks with
@@ -544,15 +544,22 @@ TEST_F(PETransformPolicyTest, CodeBlockIsSafeToBasicBlockDecomposeCache) {
       policy.block_result_cache_->find(code->id());
   ASSERT_NE(policy.block_result_cache_->end(), it);
   EXPECT_EQ(code->id(), it->first);
-  EXPECT_TRUE(it->second);
+  EXPECT_TRUE(it->second.is_safe);
 
-  // Add an unreferenced data label. This should make the analysis fail.
-  // However, it should be looked up in the cache and return true.
+  // Repeated queries are served from the cache.
+  ASSERT_TRUE(policy.BlockIsSafeToBasicBlockDecompose(code));
+  EXPECT_EQ(1u, policy.block_result_cache_->size());
+
+  // Add an unreferenced data label. This should make the analysis fail, and
+  // the modification of the block should invalidate the cached result.
   ASSERT_TRUE(code->SetLabel(1, BlockGraph::Label(
       "data", BlockGraph::DATA_LABEL)));
   ASSERT_FALSE(policy.CodeBlockIsSafeToBasicBlockDecompose(code));
-  ASSERT_TRUE(policy.BlockIsSafeToBasicBlockDecompose(code));
+  ASSERT_FALSE(policy.BlockIsSafeToBasicBlockDecompose(code));
   EXPECT_EQ(1u, policy.block_result_cache_->size());
+  it = policy.block_result_cache_->find(code->id());
+  ASSERT_NE(policy.block_result_cache_->end(), it);
+  EXPECT_FALSE(it->second.is_safe);
 }
 
 TEST_F(PETransformPolicyTest,
@@ -569,7 +576,7 @@ TEST_F(PETransformPolicyTest,
       policy.block_result_cache_->find(code->id());
   ASSERT_NE(policy.block_result_cache_->end(), it);
   EXPECT_EQ(code->id(), it->first);
-  EXPECT_TRUE(it->second);
+  EXPECT_TRUE(it->second.is_safe);
 
   // Set an attribute that disqualifies decomposition. This should return false
   // from both functions, ignoring the cached result.
@@ -94,9 +94,9 @@ bool ExplodeBasicBlockSubGraphTransform::TransformBasicBlockSubGraph(
       continue;
 
     if (type == BlockGraph::CODE_BLOCK) {
-      ++output_code_blocks_;
+      base::subtle::NoBarrier_AtomicIncrement(&output_code_blocks_, 1);
     } else {
-      ++output_data_blocks_;
+      base::subtle::NoBarrier_AtomicIncrement(&output_data_blocks_, 1);
     }
 
     BasicBlockSubGraph::BlockDescription* desc = subgraph->AddBlockDescription(
@@ -116,6 +116,7 @@ const char ExplodeBasicBlocksTransform::kTransformName[] =
 
 ExplodeBasicBlocksTransform::ExplodeBasicBlocksTransform()
     : exclude_padding_(false),
+      num_threads_(1),
       non_decomposable_code_blocks_(0),
       skipped_code_blocks_(0),
       input_code_blocks_(0),
@@ -152,6 +153,11 @@ bool ExplodeBasicBlocksTransform::OnBlock(
     return true;
   }
 
+  if (num_threads_ > 1) {
+    blocks_to_explode_.push_back(block);
+    return true;
+  }
+
   ExplodeBasicBlockSubGraphTransform transform(exclude_padding_);
 
   if (!ApplyBasicBlockSubGraphTransform(
@@ -167,9 +173,23 @@ bool ExplodeBasicBlocksTransform::OnBlock(
 }
 
 bool ExplodeBasicBlocksTransform::PostBlockGraphIteration(
-    const TransformPolicyInterface* unused_policy,
-    BlockGraph* unused_block_graph,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
     BlockGraph::Block* unused_header_block) {
+  if (!blocks_to_explode_.empty()) {
+    ExplodeBasicBlockSubGraphTransform transform(exclude_padding_);
+    if (!ApplyBasicBlockSubGraphTransformInParallel(
+            &transform, policy, block_graph, blocks_to_explode_,
+            num_threads_)) {
+      return false;
+    }
+
+    input_code_blocks_ += blocks_to_explode_.size();
+    output_code_blocks_ += transform.output_code_blocks();
+    output_data_blocks_ += transform.output_data_blocks();
+    blocks_to_explode_.clear();
+  }
+
   LOG(INFO) << "Exploded " << input_code_blocks_ << " input code blocks to";
   LOG(INFO) << "  Code blocks: " << output_code_blocks_;
   LOG(INFO) << "  Data blocks: " << output_data_blocks_;
@@ -21,6 +21,9 @@
 #ifndef SYZYGY_PE_TRANSFORMS_EXPLODE_BASIC_BLOCKS_TRANSFORM_H_
 #define SYZYGY_PE_TRANSFORMS_EXPLODE_BASIC_BLOCKS_TRANSFORM_H_
 
+#include <vector>
+
+#include "base/atomicops.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
 #include "syzygy/block_graph/transforms/named_transform.h"
 
@@ -28,7 +31,8 @@ namespace pe {
 namespace transforms {
 
 // A BasicBlockSubBlockGraph transform that explodes all basic-blocks in a
-// basic_block subgraph into individual code or data blocks.
+// basic_block subgraph into individual code or data blocks. It may be applied
+// to several subgraphs concurrently.
 class ExplodeBasicBlockSubGraphTransform
     : public block_graph::transforms::NamedBasicBlockSubGraphTransformImpl<
           ExplodeBasicBlockSubGraphTransform> {
@@ -53,16 +57,20 @@ class ExplodeBasicBlockSubGraphTransform
 
   // @name Accessors.
   // @{
-  size_t output_code_blocks() const { return output_code_blocks_; }
-  size_t output_data_blocks() const { return output_data_blocks_; }
+  size_t output_code_blocks() const {
+    return static_cast<size_t>(output_code_blocks_);
+  }
+  size_t output_data_blocks() const {
+    return static_cast<size_t>(output_data_blocks_);
+  }
   // @}
 
  protected:
   // A flag for whether padding (and dead code) basic-blocks should be excluded
   // when reconstituting the exploded blocks.
   bool exclude_padding_;
-  size_t output_code_blocks_;
-  size_t output_data_blocks_;
+  base::subtle::Atomic32 output_code_blocks_;
+  base::subtle::Atomic32 output_data_blocks_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ExplodeBasicBlockSubGraphTransform);
@@ -91,7 +99,8 @@ class ExplodeBasicBlocksTransform
                BlockGraph* block_graph,
                BlockGraph::Block* block);
 
-  // Logs metrics about the performed transform.
+  // Explodes the blocks gathered by OnBlock if this is done on worker threads,
+  // then logs metrics about the performed transform.
   // @param policy The policy object restricting how the transform is applied.
   // @param block_graph The block graph being modified.
   // @param header_block The header block associated with the image.
@@ -103,6 +112,11 @@ class ExplodeBasicBlocksTransform
   // @{
   bool exclude_padding() const { return exclude_padding_; }
   void set_exclude_padding(bool value) { exclude_padding_ = value; }
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0U, num_threads);
+    num_threads_ = num_threads;
+  }
   // @}
 
   // The transform name.
@@ -116,6 +130,15 @@ class ExplodeBasicBlocksTransform
   // when reconstituting the exploded blocks.
   bool exclude_padding_;
 
+  // The number of threads the blocks are exploded on. When this is more than
+  // one, OnBlock only gathers the blocks to explode and they are exploded by
+  // PostBlockGraphIteration. The result is the same either way, down to the
+  // IDs of the new blocks. Defaults to one.
+  size_t num_threads_;
+
+  // The blocks gathered by OnBlock, when exploding on worker threads.
+  std::vector<BlockGraph::Block*> blocks_to_explode_;
+
   // Statistics on blocks encountered and generated.
   size_t non_decomposable_code_blocks_;
   size_t skipped_code_blocks_;
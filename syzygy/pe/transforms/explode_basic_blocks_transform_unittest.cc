@@ -16,6 +16,7 @@
 
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/orderers/random_orderer.h"
+#include "syzygy/block_graph/transform.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_relinker.h"
@@ -64,6 +65,25 @@ class ExplodeBasicBlocksTransformTest : public testing::PELibUnitTest {
     ASSERT_NO_FATAL_FAILURE(CheckTestDll(output_path_));
   }
 
+  // Decomposes the test DLL into @p block_graph and explodes it on
+  // @p num_threads threads.
+  void ExplodeTestDll(size_t num_threads, BlockGraph* block_graph) {
+    pe::PEFile pe_file;
+    ASSERT_TRUE(pe_file.Init(input_path_));
+    ImageLayout image_layout(block_graph);
+    Decomposer decomposer(pe_file);
+    ASSERT_TRUE(decomposer.Decompose(&image_layout));
+    BlockGraph::Block* dos_header_block =
+        image_layout.blocks.GetBlockByAddress(core::RelativeAddress(0));
+    ASSERT_TRUE(dos_header_block != NULL);
+
+    pe::PETransformPolicy policy;
+    ExplodeBasicBlocksTransform transform;
+    transform.set_num_threads(num_threads);
+    ASSERT_TRUE(block_graph::ApplyBlockGraphTransform(
+        &transform, &policy, block_graph, dos_header_block));
+  }
+
   BlockGraph block_graph_;
   ImageLayout image_layout_;
   BlockGraph::Block* dos_header_block_;
@@ -97,5 +117,50 @@ TEST_F(ExplodeBasicBlocksTransformTest, RandomizeAllBasicBlocksNoPadding) {
   PerformRandomizationTest(&transform);
 }
 
+TEST_F(ExplodeBasicBlocksTransformTest, ExplodeOnWorkerThreads) {
+  BlockGraph serial_block_graph;
+  ASSERT_NO_FATAL_FAILURE(ExplodeTestDll(1, &serial_block_graph));
+  BlockGraph parallel_block_graph;
+  ASSERT_NO_FATAL_FAILURE(ExplodeTestDll(4, &parallel_block_graph));
+
+  // Both block graphs should be the same, down to the block IDs.
+  ASSERT_EQ(serial_block_graph.blocks().size(),
+            parallel_block_graph.blocks().size());
+  BlockGraph::BlockMap::const_iterator serial_it =
+      serial_block_graph.blocks().begin();
+  BlockGraph::BlockMap::const_iterator parallel_it =
+      parallel_block_graph.blocks().begin();
+  for (; serial_it != serial_block_graph.blocks().end();
+       ++serial_it, ++parallel_it) {
+    const BlockGraph::Block& serial_block = serial_it->second;
+    const BlockGraph::Block& parallel_block = parallel_it->second;
+    EXPECT_EQ(serial_it->first, parallel_it->first);
+    EXPECT_EQ(serial_block.type(), parallel_block.type());
+    EXPECT_EQ(serial_block.name(), parallel_block.name());
+    EXPECT_EQ(serial_block.size(), parallel_block.size());
+    EXPECT_EQ(serial_block.attributes(), parallel_block.attributes());
+    ASSERT_EQ(serial_block.data_size(), parallel_block.data_size());
+    if (serial_block.data_size() != 0) {
+      EXPECT_EQ(0, ::memcmp(serial_block.data(), parallel_block.data(),
+                            serial_block.data_size()));
+    }
+
+    ASSERT_EQ(serial_block.references().size(),
+              parallel_block.references().size());
+    BlockGraph::Block::ReferenceMap::const_iterator serial_ref_it =
+        serial_block.references().begin();
+    BlockGraph::Block::ReferenceMap::const_iterator parallel_ref_it =
+        parallel_block.references().begin();
+    for (; serial_ref_it != serial_block.references().end();
+         ++serial_ref_it, ++parallel_ref_it) {
+      EXPECT_EQ(serial_ref_it->first, parallel_ref_it->first);
+      EXPECT_EQ(serial_ref_it->second.referenced()->id(),
+                parallel_ref_it->second.referenced()->id());
+      EXPECT_EQ(serial_ref_it->second.offset(),
+                parallel_ref_it->second.offset());
+    }
+  }
+}
+
 }  // namespace transforms
 }  // namespace pe
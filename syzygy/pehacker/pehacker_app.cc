@@ -17,11 +17,17 @@
 
 #include "syzygy/pehacker/pehacker_app.h"
 
+#include <algorithm>
+
+#include "base/atomicops.h"
 #include "base/file_util.h"
 #include "base/json/json_reader.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/simple_thread.h"
+#include "base/win/scoped_com_initializer.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_writer.h"
@@ -47,6 +53,8 @@ static const char kUsageFormatStr[] = "Usage: %ls [options]\n"
     "                          Variable names defined on the command-line\n"
     "                          will be normalized to all lowercase. Values\n"
     "                          will be parsed as JSON.\n"
+    "    --jobs=<count>        The number of modules to process in\n"
+    "                          parallel. Defaults to 1.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --verbose             Log verbosely.\n"
     "\n";
@@ -83,6 +91,38 @@ bool GetFilePath(bool optional,
   return true;
 }
 
+// Creates the implementation of an operation. Sets |operation_impl| to NULL
+// for the 'none' operation, which does nothing. Returns true on success, false
+// otherwise.
+bool CreateOperation(const base::DictionaryValue& operation,
+                     scoped_ptr<OperationInterface>* operation_impl) {
+  DCHECK_NE(reinterpret_cast<scoped_ptr<OperationInterface>*>(NULL),
+            operation_impl);
+
+  std::string type;
+  if (!operation.GetString("type", &type)) {
+    LOG(ERROR) << "Each operation must specify a \"type\".";
+    return false;
+  }
+
+  // Dispatch to the appropriate operation implementation.
+  operation_impl->reset();
+  if (type == "none") {
+    // The 'none' operation is always defined, and does nothing. This is
+    // mainly there for simple unittesting of configuration files.
+    return true;
+  } else if (type == "add_imports") {
+    operation_impl->reset(new operations::AddImportsOperation());
+  } else if (type == "redirect_imports") {
+    operation_impl->reset(new operations::RedirectImportsOperation());
+  } else {
+    LOG(ERROR) << "Unrecognized operation type \"" << type << "\".";
+    return false;
+  }
+
+  return true;
+}
+
 void RemovePaddingBlocks(BlockGraph* block_graph) {
   DCHECK_NE(reinterpret_cast<BlockGraph*>(NULL), block_graph);
   BlockGraph::BlockMap::iterator it = block_graph->blocks_mutable().begin();
@@ -100,6 +140,51 @@ void RemovePaddingBlocks(BlockGraph* block_graph) {
 
 }  // namespace
 
+// Processes the images on a worker thread. Each worker thread takes the next
+// image that hasn't been processed yet, until they're all done.
+class PEHackerApp::ImageProcessor
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  explicit ImageProcessor(PEHackerApp* app)
+      : app_(app), next_image_(0), failed_(0) {
+    DCHECK_NE(reinterpret_cast<PEHackerApp*>(NULL), app);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    // The decomposer uses DIA.
+    base::win::ScopedCOMInitializer com_initializer;
+
+    while (base::subtle::NoBarrier_Load(&failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_image_, 1));
+      if (index > app_->image_infos_.size())
+        return;
+
+      if (!app_->ProcessImage(app_->image_infos_[index - 1]))
+        base::subtle::NoBarrier_Store(&failed_, 1);
+    }
+  }
+  // @}
+
+  // @returns true iff all the images were processed successfully.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+ private:
+  PEHackerApp* app_;
+
+  // One past the index of the next entry of image_infos_ to process.
+  base::subtle::Atomic32 next_image_;
+
+  // Set to 1 as soon as an image fails to be processed.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImageProcessor);
+};
+
 bool PEHackerApp::ImageId::operator<(const ImageId& rhs) const {
   if (input_module.value() < rhs.input_module.value())
     return true;
@@ -131,6 +216,10 @@ bool PEHackerApp::ParseCommandLine(const CommandLine* cmd_line) {
     VLOG(1) << "Parsed --overwrite switch.";
   }
 
+  if (!ParseJobs(cmd_line, &jobs_))
+    return false;
+  VLOG(1) << "Running up to " << jobs_ << " jobs.";
+
   // Set built-in variables.
   if (!SetBuiltInVariables())
     return false;
@@ -156,10 +245,7 @@ int PEHackerApp::Run() {
   if (!LoadAndValidateConfigurationFile())
     return 1;
 
-  if (!ProcessConfigurationFile(false))
-    return 1;
-
-  if (!WriteImages())
+  if (!ProcessImages())
     return 1;
 
   return 0;
@@ -207,9 +293,9 @@ bool PEHackerApp::LoadAndValidateConfigurationFile() {
     }
   }
 
-  // Process the configuration in dry-run mode. This doesn't do any work, but
-  // validates that the configuration makes sense and can be run.
-  if (!ProcessConfigurationFile(true))
+  // Process the configuration. This doesn't do any work, but validates that
+  // the configuration makes sense and can be run.
+  if (!ProcessConfigurationFile())
     return false;
 
   return true;
@@ -272,10 +358,10 @@ bool PEHackerApp::UpdateVariablesFromConfig() {
   return true;
 }
 
-bool PEHackerApp::ProcessConfigurationFile(bool dry_run) {
-  if (dry_run) {
-    VLOG(1) << "Validating configuration file.";
-  }
+bool PEHackerApp::ProcessConfigurationFile() {
+  VLOG(1) << "Validating configuration file.";
+  image_info_map_.clear();
+  image_infos_.clear();
 
   base::ListValue* targets = NULL;
   if (!config_->GetList("targets", &targets)) {
@@ -283,13 +369,13 @@ bool PEHackerApp::ProcessConfigurationFile(bool dry_run) {
     return false;
   }
 
-  if (!ProcessTargets(dry_run, targets))
+  if (!ProcessTargets(targets))
     return false;
 
   return true;
 }
 
-bool PEHackerApp::ProcessTargets(bool dry_run, base::ListValue* targets) {
+bool PEHackerApp::ProcessTargets(base::ListValue* targets) {
   DCHECK_NE(reinterpret_cast<base::ListValue*>(NULL), targets);
 
   if (targets->GetSize() == 0) {
@@ -305,14 +391,14 @@ bool PEHackerApp::ProcessTargets(bool dry_run, base::ListValue* targets) {
       return false;
     }
 
-    if (!ProcessTarget(dry_run, target))
+    if (!ProcessTarget(target))
       return false;
   }
 
   return true;
 }
 
-bool PEHackerApp::ProcessTarget(bool dry_run, base::DictionaryValue* target) {
+bool PEHackerApp::ProcessTarget(base::DictionaryValue* target) {
   DCHECK_NE(reinterpret_cast<base::DictionaryValue*>(NULL), target);
 
   base::FilePath input_module;
@@ -342,29 +428,24 @@ bool PEHackerApp::ProcessTarget(bool dry_run, base::DictionaryValue* target) {
     return false;
   }
 
-  ImageInfo* image_info = NULL;
-  if (!dry_run) {
-    // Get the decomposed image.
-    image_info = GetImageInfo(
-        input_module, output_module, input_pdb, output_pdb);
-    if (image_info == NULL)
-      return false;
-  }
+  // Several targets may refer to the same image. Their operations are all
+  // gathered so that the image is only decomposed and written once.
+  ImageInfo* image_info = GetImageInfo(
+      input_module, output_module, input_pdb, output_pdb);
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
 
   VLOG(1) << "Processing operations for module \"" << input_module.value()
           << "\".";
-  if (!ProcessOperations(dry_run, operations, image_info))
+  if (!ProcessOperations(operations, image_info))
     return false;
 
   return true;
 }
 
-bool PEHackerApp::ProcessOperations(bool dry_run,
-                                    base::ListValue* operations,
+bool PEHackerApp::ProcessOperations(base::ListValue* operations,
                                     ImageInfo* image_info) {
   DCHECK_NE(reinterpret_cast<base::ListValue*>(NULL), operations);
-  if (!dry_run)
-    DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
 
   for (size_t i = 0; i < operations->GetSize(); ++i) {
     base::DictionaryValue* operation = NULL;
@@ -373,59 +454,61 @@ bool PEHackerApp::ProcessOperations(bool dry_run,
       return false;
     }
 
-    if (!ProcessOperation(dry_run, operation, image_info))
+    if (!ProcessOperation(operation, image_info))
       return false;
   }
 
   return true;
 }
 
-bool PEHackerApp::ProcessOperation(bool dry_run,
-                                   base::DictionaryValue* operation,
+bool PEHackerApp::ProcessOperation(base::DictionaryValue* operation,
                                    ImageInfo* image_info) {
   DCHECK_NE(reinterpret_cast<base::DictionaryValue*>(NULL), operation);
-  if (!dry_run)
-    DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
 
-  std::string type;
-  if (!operation->GetString("type", &type)) {
-    LOG(ERROR) << "Each operation must specify a \"type\".";
-    return false;
-  }
-
-  // Dispatch to the appropriate operation implementation.
   scoped_ptr<OperationInterface> operation_impl;
-  if (type == "none") {
-    // The 'none' operation is always defined, and does nothing. This is
-    // mainly there for simple unittesting of configuration files.
+  if (!CreateOperation(*operation, &operation_impl))
+    return false;
+  if (operation_impl.get() == NULL)
     return true;
-  } else if (type == "add_imports") {
-    operation_impl.reset(new operations::AddImportsOperation());
-  } else if (type == "redirect_imports") {
-    operation_impl.reset(new operations::RedirectImportsOperation());
-  } else {
-    LOG(ERROR) << "Unrecognized operation type \"" << type << "\".";
+
+  // Initialize the operation, to validate its configuration.
+  if (!operation_impl->Init(&policy_, operation)) {
+    LOG(ERROR) << "Failed to initialize \"" << operation_impl->name()
+               << "\".";
     return false;
   }
 
-  // Initialize the operation.
+  // Defer the operation to when the image gets processed.
+  image_info->operations.push_back(operation);
+
+  return true;
+}
+
+bool PEHackerApp::ApplyOperation(base::DictionaryValue* operation,
+                                 ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<base::DictionaryValue*>(NULL), operation);
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+
+  // The operation was validated by ProcessOperation, but operations may only
+  // be initialized and applied once so a new one is created.
+  scoped_ptr<OperationInterface> operation_impl;
+  if (!CreateOperation(*operation, &operation_impl))
+    return false;
   DCHECK_NE(reinterpret_cast<OperationInterface*>(NULL), operation_impl.get());
-  if (!operation_impl->Init(&policy_, operation)) {
+  if (!operation_impl->Init(&image_info->policy, operation)) {
     LOG(ERROR) << "Failed to initialize \"" << operation_impl->name()
                << "\".";
     return false;
   }
 
-  // If not in a dry-run then apply the operation.
-  if (!dry_run) {
-    LOG(INFO) << "Applying operation \"" << type << "\" to \""
-              << image_info->input_module.value() << "\".";
-    if (!operation_impl->Apply(&policy_,
-                               &image_info->block_graph,
-                               image_info->header_block)) {
-      LOG(ERROR) << "Failed to apply \"" << operation_impl->name() << "\".";
-      return false;
-    }
+  LOG(INFO) << "Applying operation \"" << operation_impl->name() << "\" to \""
+            << image_info->input_module.value() << "\".";
+  if (!operation_impl->Apply(&image_info->policy,
+                             &image_info->block_graph,
+                             image_info->header_block)) {
+    LOG(ERROR) << "Failed to apply \"" << operation_impl->name() << "\".";
+    return false;
   }
 
   return true;
@@ -453,17 +536,63 @@ PEHackerApp::ImageInfo* PEHackerApp::GetImageInfo(
   image_info->output_module = output_module;
   image_info->input_pdb = input_pdb;
   image_info->output_pdb = output_pdb;
+
+  // Add it to the map, transfer the image info to the scoped array and return
+  // it.
+  it = image_info_map_.insert(std::make_pair(image_id, image_info.get())).first;
+  image_infos_.push_back(image_info.release());
+  return it->second;
+}
+
+bool PEHackerApp::ProcessImages() {
+  ImageProcessor image_processor(this);
+  size_t num_threads = std::min(jobs_, image_infos_.size());
+  if (num_threads <= 1) {
+    image_processor.Run();
+  } else {
+    LOG(INFO) << "Processing " << image_infos_.size() << " images using "
+              << num_threads << " threads.";
+    base::DelegateSimpleThreadPool pool("PEHackerApp", num_threads);
+    pool.Start();
+    pool.AddWork(&image_processor, num_threads);
+    pool.JoinAll();
+  }
+  return image_processor.succeeded();
+}
+
+bool PEHackerApp::ProcessImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+
+  if (!DecomposeImage(image_info))
+    return false;
+
+  for (size_t i = 0; i < image_info->operations.size(); ++i) {
+    if (!ApplyOperation(image_info->operations[i], image_info))
+      return false;
+  }
+
+  if (!WriteImage(image_info))
+    return false;
+
+  return true;
+}
+
+bool PEHackerApp::DecomposeImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
+
+  const base::FilePath& input_module = image_info->input_module;
   if (!image_info->pe_file.Init(input_module)) {
     LOG(ERROR) << "Failed to read image: " << input_module.value();
-    return NULL;
+    return false;
   }
 
   // Decompose the image.
+  LOG(INFO) << "Decomposing image \"" << input_module.value() << "\".";
   pe::ImageLayout image_layout(&image_info->block_graph);
   pe::Decomposer decomposer(image_info->pe_file);
   if (!decomposer.Decompose(&image_layout)) {
     LOG(ERROR) << "Failed to decompose image: " << input_module.value();
-    return NULL;
+    return false;
   }
 
   // Lookup the header block.
@@ -480,102 +609,95 @@ PEHackerApp::ImageInfo* PEHackerApp::GetImageInfo(
   // when finalizing the PDB.
   pe::GetOmapRange(image_layout.sections, &image_info->input_omap_range);
 
-  // Decomposition was successful. Add it to the map, transfer the image info to
-  // the scoped array and return it.
-  it = image_info_map_.insert(std::make_pair(image_id, image_info.get())).first;
-  image_infos_.push_back(image_info.release());
-  return it->second;
+  return true;
 }
 
-bool PEHackerApp::WriteImages() {
-  ImageInfoMap::iterator it = image_info_map_.begin();
-  for (; it != image_info_map_.end(); ++it) {
-    ImageInfo* image_info = it->second;
+bool PEHackerApp::WriteImage(ImageInfo* image_info) {
+  DCHECK_NE(reinterpret_cast<ImageInfo*>(NULL), image_info);
 
-    LOG(INFO) << "Finalizing and writing image \""
-              << image_info->output_module.value() << "\".";
+  LOG(INFO) << "Finalizing and writing image \""
+            << image_info->output_module.value() << "\".";
 
-    // Create a GUID for the output PDB.
-    GUID pdb_guid = {};
-    if (FAILED(::CoCreateGuid(&pdb_guid))) {
-      LOG(ERROR) << "Failed to create new GUID for output PDB.";
-      return false;
-    }
-
-    // Finalize the block-graph.
-    VLOG(1) << "Finalizing the block-graph.";
-    if (!pe::FinalizeBlockGraph(image_info->input_module,
-                                image_info->output_pdb,
-                                pdb_guid,
-                                true,
-                                &policy_,
-                                &image_info->block_graph,
-                                image_info->header_block)) {
-      return false;
-    }
+  // Create a GUID for the output PDB.
+  GUID pdb_guid = {};
+  if (FAILED(::CoCreateGuid(&pdb_guid))) {
+    LOG(ERROR) << "Failed to create new GUID for output PDB.";
+    return false;
+  }
 
-    // Build the ordered block-graph.
-    block_graph::OrderedBlockGraph ordered_block_graph(
-        &image_info->block_graph);
-    block_graph::orderers::OriginalOrderer orderer;
-    VLOG(1) << "Ordering the block-graph.";
-    if (!orderer.OrderBlockGraph(&ordered_block_graph,
-                                 image_info->header_block)) {
-      return false;
-    }
+  // Finalize the block-graph.
+  VLOG(1) << "Finalizing the block-graph.";
+  if (!pe::FinalizeBlockGraph(image_info->input_module,
+                              image_info->output_pdb,
+                              pdb_guid,
+                              true,
+                              &image_info->policy,
+                              &image_info->block_graph,
+                              image_info->header_block)) {
+    return false;
+  }
 
-    // Finalize the ordered block-graph.
-    VLOG(1) << "Finalizing the ordered block-graph.";
-    if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph,
-                                       image_info->header_block)) {
-      return false;
-    }
+  // Build the ordered block-graph.
+  block_graph::OrderedBlockGraph ordered_block_graph(
+      &image_info->block_graph);
+  block_graph::orderers::OriginalOrderer orderer;
+  VLOG(1) << "Ordering the block-graph.";
+  if (!orderer.OrderBlockGraph(&ordered_block_graph,
+                               image_info->header_block)) {
+    return false;
+  }
 
-    // Build the image layout.
-    pe::ImageLayout image_layout(&image_info->block_graph);
-    VLOG(1) << "Building the image layout.";
-    if (!pe::BuildImageLayout(0, 1, ordered_block_graph,
-                              image_info->header_block, &image_layout)) {
-      return false;
-    }
+  // Finalize the ordered block-graph.
+  VLOG(1) << "Finalizing the ordered block-graph.";
+  if (!pe::FinalizeOrderedBlockGraph(&ordered_block_graph,
+                                     image_info->header_block)) {
+    return false;
+  }
 
-    // Write the image.
-    pe::PEFileWriter pe_writer(image_layout);
-    VLOG(1) << "Writing image to disk.";
-    if (!pe_writer.WriteImage(image_info->output_module))
-      return false;
+  // Build the image layout.
+  pe::ImageLayout image_layout(&image_info->block_graph);
+  VLOG(1) << "Building the image layout.";
+  if (!pe::BuildImageLayout(0, 1, ordered_block_graph,
+                            image_info->header_block, &image_layout)) {
+    return false;
+  }
 
-    LOG(INFO) << "Finalizing and writing PDB file \""
-              << image_info->output_pdb.value() << "\".";
+  // Write the image.
+  pe::PEFileWriter pe_writer(image_layout);
+  VLOG(1) << "Writing image to disk.";
+  if (!pe_writer.WriteImage(image_info->output_module))
+    return false;
 
-    // Parse the original PDB.
-    pdb::PdbFile pdb_file;
-    pdb::PdbReader pdb_reader;
-    VLOG(1) << "Reading original PDB.";
-    if (!pdb_reader.Read(image_info->input_pdb, &pdb_file))
-      return false;
+  LOG(INFO) << "Finalizing and writing PDB file \""
+            << image_info->output_pdb.value() << "\".";
 
-    // Finalize the PDB to reflect the transformed image.
-    VLOG(1) << "Finalizing PDB.";
-    if (!pe::FinalizePdbFile(image_info->input_module,
-                             image_info->output_module,
-                             image_info->input_omap_range,
-                             image_layout,
-                             pdb_guid,
-                             false,
-                             false,
-                             false,
-                             &pdb_file)) {
-      return false;
-    }
+  // Parse the original PDB.
+  pdb::PdbFile pdb_file;
+  pdb::PdbReader pdb_reader;
+  VLOG(1) << "Reading original PDB.";
+  if (!pdb_reader.Read(image_info->input_pdb, &pdb_file))
+    return false;
 
-    // Write the PDB.
-    pdb::PdbWriter pdb_writer;
-    VLOG(1) << "Writing transformed PDB.";
-    if (!pdb_writer.Write(image_info->output_pdb, pdb_file))
-      return false;
+  // Finalize the PDB to reflect the transformed image.
+  VLOG(1) << "Finalizing PDB.";
+  if (!pe::FinalizePdbFile(image_info->input_module,
+                           image_info->output_module,
+                           image_info->input_omap_range,
+                           image_layout,
+                           pdb_guid,
+                           false,
+                           false,
+                           false,
+                           &pdb_file)) {
+    return false;
   }
 
+  // Write the PDB.
+  pdb::PdbWriter pdb_writer;
+  VLOG(1) << "Writing transformed PDB.";
+  if (!pdb_writer.Write(image_info->output_pdb, pdb_file))
+    return false;
+
   return true;
 }
 
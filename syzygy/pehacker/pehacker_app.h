@@ -18,6 +18,8 @@
 #ifndef SYZYGY_PEHACKER_PEHACKER_APP_H_
 #define SYZYGY_PEHACKER_PEHACKER_APP_H_
 
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/values.h"
 #include "base/files/file_path.h"
@@ -39,7 +41,7 @@ namespace pehacker {
 class PEHackerApp : public application::AppImplBase {
  public:
   PEHackerApp()
-      : application::AppImplBase("PEHacker"), overwrite_(false) {
+      : application::AppImplBase("PEHacker"), overwrite_(false), jobs_(1) {
   }
 
   // @name Implementation of the AppImplBase interface.
@@ -72,8 +74,18 @@ class PEHackerApp : public application::AppImplBase {
     BlockGraph block_graph;
     BlockGraph::Block* header_block;
     pe::RelativeAddressRange input_omap_range;
+    // The operations to apply to the module, in order. These are gathered
+    // from all the targets referring to the module while validating the
+    // configuration, and are owned by config_.
+    std::vector<base::DictionaryValue*> operations;
+    // The policy used by the transforms applied to the module. Each module
+    // has its own, as modules are processed in parallel.
+    pe::PETransformPolicy policy;
   };
 
+  // Processes the modules in parallel. Defined in the .cc file.
+  class ImageProcessor;
+
   typedef std::map<ImageId, ImageInfo*> ImageInfoMap;
 
   // @name Utility members.
@@ -101,47 +113,68 @@ class PEHackerApp : public application::AppImplBase {
   // @returns true on success, false otherwise.
   bool UpdateVariablesFromConfig();
 
-  // @name For processing the configuration file.
+  // @name For processing the configuration file. This doesn't do any actual
+  //     work, but validates the configuration and gathers the operations to
+  //     apply to each image.
   // @{
-  // @param dry_run If this is true then no actual work is done, but the
-  //     configuration file is validated.
   // @param targets A list of targets to process.
   // @param target A target to process.
   // @param operations A list of operations to process.
   // @param operation An operation to process.
   // @param image_info Information about the image being transformed.
   // @returns true on success, false otherwise.
-  bool ProcessConfigurationFile(bool dry_run);
-  bool ProcessTargets(bool dry_run, base::ListValue* targets);
-  bool ProcessTarget(bool dry_run, base::DictionaryValue* target);
-  bool ProcessOperations(bool dry_run,
-                         base::ListValue* operations,
-                         ImageInfo* image_info);
-  bool ProcessOperation(bool dry_run,
-                        base::DictionaryValue* operation,
+  bool ProcessConfigurationFile();
+  bool ProcessTargets(base::ListValue* targets);
+  bool ProcessTarget(base::DictionaryValue* target);
+  bool ProcessOperations(base::ListValue* operations, ImageInfo* image_info);
+  bool ProcessOperation(base::DictionaryValue* operation,
                         ImageInfo* image_info);
   // @}
 
-  // Looks up the already decomposed image, or loads and decomposes it for the
-  // first time.
+  // Applies an operation gathered by ProcessOperation to its image.
+  // @param operation The operation to apply.
+  // @param image_info The decomposed image to transform.
+  // @returns true on success, false otherwise.
+  bool ApplyOperation(base::DictionaryValue* operation, ImageInfo* image_info);
+
+  // Looks up the image, or creates it for the first time. The image is only
+  // decomposed by ProcessImages.
   // @param input_module The path to the input module.
   // @param output_module The path to the output module.
   // @param input_pdb The path to the input PDB.
   // @param output_pdb The path to the output PDB.
-  // @returns a pointer to the ImageInfo for the requested image. Returns NULL
-  //     on failure.
+  // @returns a pointer to the ImageInfo for the requested image.
   ImageInfo* GetImageInfo(const base::FilePath& input_module,
                           const base::FilePath& output_module,
                           const base::FilePath& input_pdb,
                           const base::FilePath& output_pdb);
 
-  // Writes any transformed images back to disk.
+  // Processes all the images gathered from the configuration file, using up
+  // to jobs_ threads. Each image is decomposed once, has all of its operations
+  // applied, and is written back to disk.
+  // @returns true on success, false otherwise.
+  bool ProcessImages();
+
+  // Decomposes, transforms and writes a single image. This only touches
+  // @p image_info, so distinct images may be processed concurrently.
+  // @param image_info The image to process.
+  // @returns true on success, false otherwise.
+  bool ProcessImage(ImageInfo* image_info);
+
+  // Decomposes an image.
+  // @param image_info The image to decompose.
+  // @returns true on success, false otherwise.
+  bool DecomposeImage(ImageInfo* image_info);
+
+  // Writes a transformed image back to disk.
+  // @param image_info The image to write.
   // @returns true on success, false otherwise.
-  bool WriteImages();
+  bool WriteImage(ImageInfo* image_info);
 
   // @name Command-line parameters.
   base::FilePath config_file_;
   bool overwrite_;
+  size_t jobs_;
   // @}
 
   // Dictionary of variables. We use a JSON dictionary so that it can easily
@@ -155,7 +188,8 @@ class PEHackerApp : public application::AppImplBase {
   ScopedVector<ImageInfo> image_infos_;
   ImageInfoMap image_info_map_;
 
-  // The policy object used by the various transforms.
+  // The policy object used to validate the operations. The operations are
+  // applied with the policy of their image.
   pe::PETransformPolicy policy_;
 };
 
@@ -46,6 +46,8 @@ static wchar_t kConfigGoodNestedVariables[] =
     L"syzygy/pehacker/test_data/config-good-nested-variables.txt";
 static wchar_t kConfigGoodNop[] =
     L"syzygy/pehacker/test_data/config-good-nop.txt";
+static wchar_t kConfigGoodMultipleTargets[] =
+    L"syzygy/pehacker/test_data/config-good-multiple-targets.txt";
 
 class TestPEHackerApp : public PEHackerApp {
  public:
@@ -53,8 +55,10 @@ class TestPEHackerApp : public PEHackerApp {
 
   using PEHackerApp::config_file_;
   using PEHackerApp::overwrite_;
+  using PEHackerApp::jobs_;
   using PEHackerApp::variables_;
   using PEHackerApp::config_;
+  using PEHackerApp::image_infos_;
 };
 
 typedef application::Application<TestPEHackerApp> TestApp;
@@ -166,6 +170,12 @@ TEST_F(PEHackerAppTest, ParseCommandLineFailsDouble) {
   ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(PEHackerAppTest, ParseCommandLineFailsInvalidJobs) {
+  cmd_line_.AppendSwitchPath("config-file", config_file_);
+  cmd_line_.AppendSwitchASCII("jobs", "0");
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(PEHackerAppTest, ParseFullCommandLineSucceeds) {
   cmd_line_.AppendSwitchPath("config-file", config_file_);
   cmd_line_.AppendSwitch("overwrite");
@@ -174,9 +184,11 @@ TEST_F(PEHackerAppTest, ParseFullCommandLineSucceeds) {
   cmd_line_.AppendSwitchASCII("Dvar3", "\"string\"");
   cmd_line_.AppendSwitchASCII("Dvar4", "false");
   cmd_line_.AppendSwitchASCII("Dvar5", "");
+  cmd_line_.AppendSwitchASCII("jobs", "4");
   ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_EQ(config_file_, test_impl_.config_file_);
   EXPECT_TRUE(test_impl_.overwrite_);
+  EXPECT_EQ(4U, test_impl_.jobs_);
 
   std::string s;
   int i = 0;
@@ -315,4 +327,29 @@ TEST_F(PEHackerAppTest, RunNop) {
   EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module));
 }
 
+TEST_F(PEHackerAppTest, RunMultipleTargets) {
+  base::FilePath input_module = testing::GetOutputRelativePath(
+      testing::kTestDllName);
+  base::FilePath output_module1 = temp_dir_.Append(L"test_dll1.dll");
+  base::FilePath output_module2 = temp_dir_.Append(L"test_dll2.dll");
+
+  config_file_ = testing::GetSrcRelativePath(kConfigGoodMultipleTargets);
+  cmd_line_.AppendSwitchPath("config-file", config_file_);
+  cmd_line_.AppendSwitchPath("Dinput_module", input_module);
+  cmd_line_.AppendSwitchPath("Doutput_module1", output_module1);
+  cmd_line_.AppendSwitchPath("Doutput_module2", output_module2);
+  cmd_line_.AppendSwitchASCII("jobs", "2");
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  // The targets sharing an output module are processed as a single image.
+  ASSERT_TRUE(test_impl_.LoadAndValidateConfigurationFile());
+  EXPECT_EQ(2U, test_impl_.image_infos_.size());
+
+  EXPECT_EQ(0, test_impl_.Run());
+  EXPECT_TRUE(base::PathExists(output_module1));
+  EXPECT_TRUE(base::PathExists(output_module2));
+  EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module1));
+  EXPECT_NO_FATAL_FAILURE(CheckTestDll(output_module2));
+}
+
 }  // namespace pehacker
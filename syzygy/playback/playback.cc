@@ -14,6 +14,8 @@
 
 #include "syzygy/playback/playback.h"
 
+#include <algorithm>
+
 #include "syzygy/core/address.h"
 #include "syzygy/pdb/omap.h"
 #include "syzygy/pe/find.h"
@@ -24,6 +26,18 @@ namespace playback {
 
 using trace::parser::Parser;
 
+namespace {
+
+typedef Playback::BlockIndexEntry BlockIndexEntry;
+
+// Orders block index entries by start address.
+bool BlockIndexEntryStartLess(const BlockIndexEntry& entry1,
+                              const BlockIndexEntry& entry2) {
+  return entry1.start < entry2.start;
+}
+
+}  // namespace
+
 Playback::Playback(const base::FilePath& module_path,
                    const base::FilePath& instrumented_path,
                    const TraceFileList& trace_files)
@@ -66,6 +80,8 @@ bool Playback::Init(PEFile* pe_file, ImageLayout* image, Parser* parser) {
   if (!DecomposeImage())
     return false;
 
+  BuildBlockIndex();
+
   return true;
 }
 
@@ -173,6 +189,72 @@ bool Playback::DecomposeImage() {
   return true;
 }
 
+void Playback::BuildBlockIndex() {
+  DCHECK(image_ != NULL);
+
+  // The OMAP information splits the instrumented module into ranges, each
+  // mapped to a contiguous range of the original module. Addresses before the
+  // first range map to themselves. Intersecting each of these ranges with the
+  // blocks of the original module yields the index in address order.
+  std::vector<OMAP> ranges;
+  if (omap_to_.empty() || omap_to_.front().rva != 0) {
+    OMAP identity = { 0, 0 };
+    ranges.push_back(identity);
+  }
+  ranges.insert(ranges.end(), omap_to_.begin(), omap_to_.end());
+
+  block_index_.clear();
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    const OMAP& omap = ranges[i];
+    uint64 range_end =
+        i + 1 < ranges.size() ? ranges[i + 1].rva : kuint32max;
+    DCHECK_LE(omap.rva, range_end);
+    uint64 size =
+        std::min<uint64>(range_end - omap.rva, kuint32max - omap.rvaTo);
+    if (size == 0)
+      continue;
+
+    BlockGraph::AddressSpace::RangeMapConstIterPair blocks =
+        image_->blocks.GetIntersectingBlocks(
+            core::RelativeAddress(omap.rvaTo), static_cast<uint32>(size));
+    for (; blocks.first != blocks.second; ++blocks.first) {
+      // Clip the block to the range, and move it to the instrumented module.
+      uint32 block_start = blocks.first->first.start().value();
+      uint32 block_end = block_start + blocks.first->first.size();
+      uint32 start = std::max<uint32>(block_start, omap.rvaTo);
+      uint32 end = static_cast<uint32>(
+          std::min<uint64>(block_end, omap.rvaTo + size));
+
+      BlockIndexEntry entry = {};
+      entry.start = omap.rva + (start - omap.rvaTo);
+      entry.size = end - start;
+      entry.block = blocks.first->second;
+      block_index_.push_back(entry);
+    }
+  }
+
+  LOG(INFO) << "Built a block index of " << block_index_.size()
+            << " entries.";
+}
+
+const Playback::BlockGraph::Block* Playback::FindBlockByInstrumentedAddress(
+    core::RelativeAddress rva) const {
+  BlockIndexEntry key = {};
+  key.start = rva.value();
+
+  // Find the last entry starting at or before rva.
+  BlockIndex::const_iterator it = std::upper_bound(
+      block_index_.begin(), block_index_.end(), key,
+      BlockIndexEntryStartLess);
+  if (it == block_index_.begin())
+    return NULL;
+  --it;
+
+  if (rva.value() - it->start >= it->size)
+    return NULL;
+  return it->block;
+}
+
 bool Playback::ValidateInstrumentedModuleAndParseSignature(
   pe::PEFile::Signature* orig_signature) {
   DCHECK(orig_signature != NULL);
@@ -255,12 +337,8 @@ const Playback::BlockGraph::Block* Playback::FindFunctionBlock(
   core::RelativeAddress rva(
       static_cast<uint32>(abs_address - module_info->base_address.value()));
 
-  // Convert the address from one in the instrumented module to one in the
-  // original module using the OMAP data.
-  rva = pdb::TranslateAddressViaOmap(omap_to(), rva);
-
-  // Get the block that this function call refers to.
-  const BlockGraph::Block* block = image_->blocks.GetBlockByAddress(rva);
+  // Get the block of the original module that this function call refers to.
+  const BlockGraph::Block* block = FindBlockByInstrumentedAddress(rva);
   if (block == NULL) {
     LOG(ERROR) << "Unable to map " << rva << " to a block.";
     *error = true;
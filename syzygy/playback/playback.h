@@ -28,6 +28,8 @@
 
 #include <windows.h>
 
+#include <vector>
+
 #include "base/win/event_trace_consumer.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/pdb/omap.h"
@@ -46,6 +48,17 @@ class Playback {
   typedef trace::parser::ModuleInformation ModuleInformation;
   typedef trace::parser::Parser Parser;
 
+  // An entry of the index mapping addresses in the instrumented module to the
+  // blocks of the original module. The entry covers the range
+  // [start, start + size) of the instrumented module.
+  struct BlockIndexEntry {
+    uint32 start;
+    uint32 size;
+    const BlockGraph::Block* block;
+  };
+  // The block index, sorted by address, without overlapping entries.
+  typedef std::vector<BlockIndexEntry> BlockIndex;
+
   // Construct a new Playback instance.
   // @param module_path The path of the module dll.
   // @param instrumented_path The path of the instrumented dll.
@@ -82,6 +95,14 @@ class Playback {
                                              FuncAddr function,
                                              bool* error);
 
+  // Looks up the block of the original module that contains an address of the
+  // instrumented module. This uses the block index, so it doesn't need to go
+  // through the OMAP information and the image layout.
+  // @param rva The relative address in the instrumented module.
+  // @returns the block that @p rva maps to, or NULL if there is none.
+  const BlockGraph::Block* FindBlockByInstrumentedAddress(
+      core::RelativeAddress rva) const;
+
   // @name Accessors
   // @{
   const PEFile* pe_file() const { return pe_file_; }
@@ -90,6 +111,7 @@ class Playback {
   const std::vector<OMAP>& omap_to() const { return omap_to_; }
   const std::vector<OMAP>& omap_from() const { return omap_from_; }
   const PEFile::Signature& instr_signature() const { return instr_signature_; }
+  const BlockIndex& block_index() const { return block_index_; }
   // @}
 
  protected:
@@ -106,6 +128,9 @@ class Playback {
   bool LoadInstrumentedOmap();
   // Decomposes the original image.
   bool DecomposeImage();
+  // Builds the block index from the OMAP information and the decomposed
+  // image.
+  void BuildBlockIndex();
 
   // Parses the instrumented DLL headers, validating that it was produced
   // by a compatible version of the toolchain, and extracting signature
@@ -140,6 +165,11 @@ class Playback {
 
   // Signature of the instrumented DLL. Used for filtering call-trace events.
   PEFile::Signature instr_signature_;
+
+  // Maps addresses in the instrumented DLL straight to the blocks of the
+  // decomposed image, with the OMAP information already applied. This is built
+  // once by Init, so that each event only costs a binary search.
+  BlockIndex block_index_;
 };
 
 }  // namespace playback
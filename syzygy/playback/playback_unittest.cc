@@ -210,4 +210,32 @@ TEST_F(PlaybackTest, FindFunctionBlock) {
   EXPECT_FALSE(error);
 }
 
+TEST_F(PlaybackTest, BlockIndexMatchesOmap) {
+  EXPECT_TRUE(Init());
+  EXPECT_TRUE(playback_->Init(&input_dll_, &image_layout_, parser_.get()));
+  EXPECT_FALSE(playback_->block_index().empty());
+
+  // The index entries are sorted and don't overlap.
+  const Playback::BlockIndex& block_index = playback_->block_index();
+  for (size_t i = 1; i < block_index.size(); ++i) {
+    EXPECT_LE(block_index[i - 1].start + block_index[i - 1].size,
+              block_index[i].start);
+  }
+
+  // Looking up addresses through the index must give the same blocks as going
+  // through the OMAP information and the image layout.
+  pe::PEFile instrumented_dll;
+  ASSERT_TRUE(instrumented_dll.Init(instrumented_path_));
+  const IMAGE_SECTION_HEADER* text = instrumented_dll.GetSectionHeader(".text");
+  ASSERT_TRUE(text != NULL);
+
+  for (uint32 offset = 0; offset < text->Misc.VirtualSize; offset += 7) {
+    core::RelativeAddress rva(text->VirtualAddress + offset);
+    const block_graph::BlockGraph::Block* expected_block =
+        image_layout_.blocks.GetBlockByAddress(
+            pdb::TranslateAddressViaOmap(playback_->omap_to(), rva));
+    EXPECT_EQ(expected_block, playback_->FindBlockByInstrumentedAddress(rva));
+  }
+}
+
 }  // namespace playback
@@ -14,6 +14,8 @@
 
 #include "syzygy/relink/relink_app.h"
 
+#include <algorithm>
+
 #include "base/strings/string_number_conversions.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/block_graph/orderers/random_orderer.h"
@@ -38,13 +40,20 @@ const char kUsageFormatStr[] =
     "    --code-alignment=<integer>\n"
     "                          Force a minimal alignment for code blocks.\n"
     "                          Default value is 1.\n"
-    "    --compress-pdb        If --no-augment-pdb is specified, causes the\n"
-    "                          augmented PDB stream to be compressed.\n"
+    "    --compress-pdb        Causes the augmented PDB stream to be\n"
+    "                          compressed, and identical PDB pages to be\n"
+    "                          stored only once.\n"
+    "    --decomposition-cache=<path>\n"
+    "                          Caches the decomposition of the input image\n"
+    "                          in the given file, and reuses it when\n"
+    "                          relinking the same image again.\n"
     "    --exclude-bb-padding  When randomly reordering basic blocks, exclude\n"
     "                          padding and unreachable code from the relinked\n"
     "                          output binary.\n"
     "    --input-pdb=<path>    The PDB file associated with the input DLL.\n"
     "                          Default is inferred from input-image.\n"
+    "    --jobs=<integer>      The number of threads used to decompose basic\n"
+    "                          blocks. Default is the number of processors.\n"
     "    --no-augment-pdb      Indicates that the relinker should not augment\n"
     "                          the PDB with roundtrip decomposition info.\n"
     "    --no-metadata         Prevents the relinker from adding metadata\n"
@@ -52,11 +61,16 @@ const char kUsageFormatStr[] =
     "    --no-strip-strings    Causes strings to be output in the augmented\n"
     "                          PDB stream. The default is to omit these to\n"
     "                          make smaller PDBs.\n"
-    "    --order-file=<path>   Reorder based on a JSON ordering file.\n"
+    "    --order-file=<path>   Reorder based on a JSON or binary ordering\n"
+    "                          file.\n"
     "    --output-pdb=<path>   Output path for the rewritten PDB file.\n"
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --padding=<integer>   Add bytes of padding between blocks.\n"
+    "    --statistics-file=<path>\n"
+    "                          Writes the time, the blocks changed and the\n"
+    "                          memory used by each transform and orderer\n"
+    "                          to the given JSON file.\n"
     "    --verbose             Log verbosely.\n"
     "\n"
     "  Testing Options:\n"
@@ -70,8 +84,8 @@ const char kUsageFormatStr[] =
     "  Notes:\n"
     "    * The --seed and --order-file options are mutually exclusive\n"
     "    * If --order-file is specified, --input-image is optional.\n"
-    "    * The --compress-pdb and --no-strip-strings options are only\n"
-    "      effective if --no-augment-pdb is not specified.\n"
+    "    * The --no-strip-strings option is only effective if\n"
+    "      --no-augment-pdb is not specified.\n"
     "    * The --exclude-bb-padding option is only effective if\n"
     "      --basic-blocks is specified.\n";
 
@@ -122,6 +136,10 @@ bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
 
   output_pdb_path_ = cmd_line->GetSwitchValuePath("output-pdb");
   order_file_path_ = AbsolutePath(cmd_line->GetSwitchValuePath("order-file"));
+  decomposition_cache_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("decomposition-cache"));
+  statistics_path_ =
+      AbsolutePath(cmd_line->GetSwitchValuePath("statistics-file"));
   no_augment_pdb_ = cmd_line->HasSwitch("no-augment-pdb");
   compress_pdb_ = cmd_line->HasSwitch("compress-pdb");
   no_strip_strings_ = cmd_line->HasSwitch("no-strip-strings");
@@ -156,6 +174,9 @@ bool RelinkApp::ParseCommandLine(const CommandLine* cmd_line) {
       return Usage(cmd_line, "Invalid seed value.");
   }
 
+  if (!ParseJobs(cmd_line, &jobs_))
+    return Usage(cmd_line, "Invalid jobs value.");
+
   // Parse the padding argument.
   if (cmd_line->HasSwitch("padding")) {
     std::wstring padding_str(cmd_line->GetSwitchValueNative("padding"));
@@ -209,6 +230,8 @@ int RelinkApp::Run() {
   relinker.set_augment_pdb(!no_augment_pdb_);
   relinker.set_compress_pdb(compress_pdb_);
   relinker.set_strip_strings(!no_strip_strings_);
+  relinker.set_decomposition_cache_path(decomposition_cache_path_);
+  relinker.set_statistics_path(statistics_path_);
 
   // Initialize the relinker. This does the decomposition, etc.
   if (!relinker.Init()) {
@@ -234,9 +257,9 @@ int RelinkApp::Run() {
 
   // If an order file is provided we are performing an explicit ordering.
   if (!order_file_path_.empty()) {
-    if (!order.LoadFromJSON(relinker.input_pe_file(),
-                            relinker.input_image_layout(),
-                            order_file_path_)) {
+    if (!order.Load(relinker.input_pe_file(),
+                    relinker.input_image_layout(),
+                    order_file_path_)) {
       LOG(ERROR) << "Failed to load order file: " << order_file_path_.value();
       return 1;
     }
@@ -265,6 +288,8 @@ int RelinkApp::Run() {
     if (basic_blocks_) {
       bb_explode.reset(new pe::transforms::ExplodeBasicBlocksTransform());
       bb_explode->set_exclude_padding(exclude_bb_padding_);
+      // The output doesn't depend on the number of threads.
+      bb_explode->set_num_threads(jobs_);
       CHECK(relinker.AppendTransform(bb_explode.get()));
     }
 
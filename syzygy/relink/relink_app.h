@@ -33,6 +33,7 @@ class RelinkApp : public application::AppImplBase {
         seed_(0),
         padding_(0),
         code_alignment_(1),
+        jobs_(GetProcessorCount()),
         no_augment_pdb_(false),
         compress_pdb_(false),
         no_strip_strings_(false),
@@ -64,9 +65,12 @@ class RelinkApp : public application::AppImplBase {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath decomposition_cache_path_;
+  base::FilePath statistics_path_;
   uint32 seed_;
   size_t padding_;
   size_t code_alignment_;
+  size_t jobs_;
   bool no_augment_pdb_;
   bool compress_pdb_;
   bool no_strip_strings_;
@@ -42,10 +42,13 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::input_pdb_path_;
   using RelinkApp::output_image_path_;
   using RelinkApp::output_pdb_path_;
+  using RelinkApp::decomposition_cache_path_;
+  using RelinkApp::statistics_path_;
   using RelinkApp::order_file_path_;
   using RelinkApp::seed_;
   using RelinkApp::padding_;
   using RelinkApp::code_alignment_;
+  using RelinkApp::jobs_;
   using RelinkApp::no_augment_pdb_;
   using RelinkApp::compress_pdb_;
   using RelinkApp::no_strip_strings_;
@@ -97,6 +100,8 @@ class RelinkAppTest : public testing::PELibUnitTest {
     output_image_path_ = temp_dir_.Append(input_image_path_.BaseName());
     output_pdb_path_ = temp_dir_.Append(input_pdb_path_.BaseName());
     order_file_path_ = temp_dir_.Append(L"order.json");
+    decomposition_cache_path_ = temp_dir_.Append(L"decomposition.cache");
+    statistics_path_ = temp_dir_.Append(L"statistics.json");
 
     // Point the application at the test's command-line and IO streams.
     test_app_.set_command_line(&cmd_line_);
@@ -146,6 +151,8 @@ class RelinkAppTest : public testing::PELibUnitTest {
   base::FilePath output_image_path_;
   base::FilePath output_pdb_path_;
   base::FilePath order_file_path_;
+  base::FilePath decomposition_cache_path_;
+  base::FilePath statistics_path_;
   uint32 seed_;
   size_t padding_;
   size_t code_alignment_;
@@ -216,6 +223,13 @@ TEST_F(RelinkAppTest, ParseWithInvalidPaddingFails) {
   ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(RelinkAppTest, ParseWithInvalidJobsFails) {
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("jobs", "0");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(RelinkAppTest, ParseMinimalCommandLineWithInputDll) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
@@ -235,12 +249,15 @@ TEST_F(RelinkAppTest, ParseMinimalCommandLineWithOrderFile) {
   EXPECT_EQ(0, test_impl_.seed_);
   EXPECT_EQ(0, test_impl_.padding_);
   EXPECT_EQ(1, test_impl_.code_alignment_);
+  EXPECT_EQ(application::AppImplBase::GetProcessorCount(), test_impl_.jobs_);
   EXPECT_FALSE(test_impl_.no_augment_pdb_);
   EXPECT_FALSE(test_impl_.compress_pdb_);
   EXPECT_FALSE(test_impl_.no_strip_strings_);
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_FALSE(test_impl_.overwrite_);
   EXPECT_FALSE(test_impl_.fuzz_);
+  EXPECT_TRUE(test_impl_.decomposition_cache_path_.empty());
+  EXPECT_TRUE(test_impl_.statistics_path_.empty());
 
   EXPECT_FALSE(test_impl_.SetUp());
 }
@@ -258,6 +275,8 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   cmd_line_.AppendSwitch("no-metadata");
   cmd_line_.AppendSwitch("overwrite");
   cmd_line_.AppendSwitch("fuzz");
+  cmd_line_.AppendSwitchPath("decomposition-cache", decomposition_cache_path_);
+  cmd_line_.AppendSwitchPath("statistics-file", statistics_path_);
 
   EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
   EXPECT_TRUE(test_impl_.input_image_path_.empty());
@@ -274,6 +293,8 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   EXPECT_FALSE(test_impl_.output_metadata_);
   EXPECT_TRUE(test_impl_.overwrite_);
   EXPECT_TRUE(test_impl_.fuzz_);
+  EXPECT_EQ(decomposition_cache_path_, test_impl_.decomposition_cache_path_);
+  EXPECT_EQ(statistics_path_, test_impl_.statistics_path_);
 
   // The order file doesn't actually exist, so setup should fail to infer the
   // input dll.
@@ -291,6 +312,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   cmd_line_.AppendSwitchASCII("padding", base::StringPrintf("%d", padding_));
   cmd_line_.AppendSwitchASCII("code-alignment",
                               base::StringPrintf("%d", code_alignment_));
+  cmd_line_.AppendSwitchASCII("jobs", "3");
   cmd_line_.AppendSwitch("no-augment-pdb");
   cmd_line_.AppendSwitch("compress-pdb");
   cmd_line_.AppendSwitch("no-strip-strings");
@@ -306,6 +328,7 @@ TEST_F(RelinkAppTest, ParseFullCommandLineWithInputSeedAndMetadata) {
   EXPECT_EQ(seed_, test_impl_.seed_);
   EXPECT_EQ(padding_, test_impl_.padding_);
   EXPECT_EQ(code_alignment_, test_impl_.code_alignment_);
+  EXPECT_EQ(3U, test_impl_.jobs_);
   EXPECT_TRUE(test_impl_.no_augment_pdb_);
   EXPECT_TRUE(test_impl_.compress_pdb_);
   EXPECT_TRUE(test_impl_.no_strip_strings_);
@@ -14,10 +14,15 @@
 
 #include "syzygy/reorder/basic_block_optimizer.h"
 
+#include <windows.h>
+
 #include <algorithm>
 #include <deque>
 #include <set>
 
+#include "base/atomicops.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/application/application.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
@@ -574,8 +579,87 @@ void BasicBlockOptimizer::BasicBlockOrderer::AddRecursiveDataReferences(
   }
 }
 
+// Optimizes the blocks of a section in parallel. Each worker thread takes the
+// next block that hasn't been optimized yet, until they're all done. The block
+// specs produced for each block are kept apart, so that the result doesn't
+// depend on the order in which the blocks were processed.
+class BasicBlockOptimizer::SectionOptimizer
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  SectionOptimizer(const ImageLayout& image_layout,
+                   const IndexedFrequencyInformation& entry_counts,
+                   const ConstBlockVector& blocks)
+      : image_layout_(image_layout), entry_counts_(entry_counts),
+        blocks_(blocks), warm_block_specs_(blocks.size()),
+        cold_block_specs_(blocks.size()), next_block_(0), failed_(0) {
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  virtual void Run() OVERRIDE {
+    // The transform policy caches its results, so each thread needs its own.
+    pe::PETransformPolicy policy;
+
+    while (base::subtle::NoBarrier_Load(&failed_) == 0) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(&next_block_, 1));
+      if (index > blocks_.size())
+        return;
+
+      if (!OptimizeBlock(policy,
+                         blocks_[index - 1],
+                         image_layout_,
+                         entry_counts_,
+                         &warm_block_specs_[index - 1],
+                         &cold_block_specs_[index - 1])) {
+        base::subtle::NoBarrier_Store(&failed_, 1);
+      }
+    }
+  }
+  // @}
+
+  // @returns true iff all the blocks were optimized successfully.
+  bool succeeded() const {
+    return base::subtle::NoBarrier_Load(&failed_) == 0;
+  }
+
+  // Appends the warm and cold block specs of all the blocks, in block order.
+  void AppendBlockSpecs(Order::BlockSpecVector* warm_block_specs,
+                        Order::BlockSpecVector* cold_block_specs) const {
+    DCHECK(warm_block_specs != NULL);
+    DCHECK(cold_block_specs != NULL);
+
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+      warm_block_specs->insert(warm_block_specs->end(),
+                               warm_block_specs_[i].begin(),
+                               warm_block_specs_[i].end());
+      cold_block_specs->insert(cold_block_specs->end(),
+                               cold_block_specs_[i].begin(),
+                               cold_block_specs_[i].end());
+    }
+  }
+
+ private:
+  const ImageLayout& image_layout_;
+  const IndexedFrequencyInformation& entry_counts_;
+  const ConstBlockVector& blocks_;
+
+  // The block specs produced for each entry of blocks_.
+  std::vector<Order::BlockSpecVector> warm_block_specs_;
+  std::vector<Order::BlockSpecVector> cold_block_specs_;
+
+  // One past the index of the next entry of blocks_ to optimize.
+  base::subtle::Atomic32 next_block_;
+
+  // Set to 1 as soon as a block fails to be optimized.
+  base::subtle::Atomic32 failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(SectionOptimizer);
+};
+
 BasicBlockOptimizer::BasicBlockOptimizer()
-    : cold_section_name_(kDefaultColdSectionName) {
+    : cold_section_name_(kDefaultColdSectionName),
+      num_threads_(application::AppImplBase::GetProcessorCount()) {
 }
 
 bool BasicBlockOptimizer::Optimize(
@@ -611,8 +695,6 @@ bool BasicBlockOptimizer::Optimize(
   cold_section_spec->id = Order::SectionSpec::kNewSectionId;
   cold_section_spec->characteristics = pe::kCodeCharacteristics;
 
-  pe::PETransformPolicy policy;
-
   // Iterate over the sections in the original order and update their basic-
   // block orderings.
   for (size_t i = 0; i < num_sections; ++i) {
@@ -621,10 +703,10 @@ bool BasicBlockOptimizer::Optimize(
     Order::BlockSpecVector cold_block_specs;
 
     // Get the collection of warm and cold block spec for this section.
-    if (!OptimizeSection(policy,
-                         image_layout,
+    if (!OptimizeSection(image_layout,
                          entry_counts,
                          explicit_blocks,
+                         num_threads_,
                          section_spec,
                          &warm_block_specs,
                          &cold_block_specs)) {
@@ -736,10 +818,10 @@ bool BasicBlockOptimizer::OptimizeBlock(
 }
 
 bool BasicBlockOptimizer::OptimizeSection(
-    const pe::PETransformPolicy& policy,
     const ImageLayout& image_layout,
     const IndexedFrequencyInformation& entry_counts,
     const ConstBlockVector& explicit_blocks,
+    size_t num_threads,
     Order::SectionSpec* orig_section_spec,
     Order::BlockSpecVector* warm_block_specs,
     Order::BlockSpecVector* cold_block_specs) {
@@ -747,21 +829,14 @@ bool BasicBlockOptimizer::OptimizeSection(
   DCHECK(warm_block_specs != NULL);
   DCHECK(cold_block_specs != NULL);
 
-  // Place all of the explicitly ordered blocks.
+  // Gather the blocks to optimize, starting with the explicitly ordered ones.
+  ConstBlockVector blocks;
   for (size_t i = 0; i < orig_section_spec->blocks.size(); ++i) {
     Order::BlockSpec* block_spec = &orig_section_spec->blocks[i];
     DCHECK(block_spec->block != NULL);
     DCHECK(block_spec->basic_block_offsets.empty());
     DCHECK(IsExplicitBlock(explicit_blocks, block_spec->block));
-
-    if (!OptimizeBlock(policy,
-                       block_spec->block,
-                       image_layout,
-                       entry_counts,
-                       warm_block_specs,
-                       cold_block_specs)) {
-      return false;
-    }
+    blocks.push_back(block_spec->block);
   }
 
   // If we are updating a preexisting section, then account for the rest of
@@ -785,17 +860,27 @@ bool BasicBlockOptimizer::OptimizeSection(
         continue;
 
       // We apply the same optimization as for explicitly placed blocks.
-      if (!OptimizeBlock(policy,
-                         it->second,
-                         image_layout,
-                         entry_counts,
-                         warm_block_specs,
-                         cold_block_specs)) {
-        return false;
-      }
+      blocks.push_back(it->second);
     }
   }
 
+  // The blocks are independent of each other, so they can be decomposed and
+  // ordered in parallel.
+  SectionOptimizer section_optimizer(image_layout, entry_counts, blocks);
+  DCHECK_LT(0U, num_threads);
+  num_threads = std::min(num_threads, blocks.size());
+  if (num_threads <= 1) {
+    section_optimizer.Run();
+  } else {
+    base::DelegateSimpleThreadPool pool("BasicBlockOptimizer", num_threads);
+    pool.Start();
+    pool.AddWork(&section_optimizer, num_threads);
+    pool.JoinAll();
+  }
+  if (!section_optimizer.succeeded())
+    return false;
+
+  section_optimizer.AppendBlockSpecs(warm_block_specs, cold_block_specs);
   return true;
 }
 
@@ -16,6 +16,7 @@
 #define SYZYGY_REORDER_BASIC_BLOCK_OPTIMIZER_H_
 
 #include <string>
+#include <vector>
 
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
@@ -54,6 +55,16 @@ class BasicBlockOptimizer {
     value.CopyToString(&cold_section_name_);
   }
 
+  // @returns the maximum number of threads used to optimize a section.
+  size_t num_threads() const { return num_threads_; }
+
+  // Set the maximum number of threads used to optimize a section. This
+  // defaults to the number of processors. The order doesn't depend on it.
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0U, num_threads);
+    num_threads_ = num_threads;
+  }
+
   // Basic-block optimize the given @p order.
   bool Optimize(const ImageLayout& image_layout,
                 const IndexedFrequencyInformation& entry_counts,
@@ -72,19 +83,28 @@ class BasicBlockOptimizer {
                             Order::BlockSpecVector* cold_block_specs);
 
   // Optimize the layout of all basic-blocks in a section, as defined by the
-  // given @p section_spec and the original @p image_layout.
-  static bool OptimizeSection(const pe::PETransformPolicy& policy,
-                              const ImageLayout& image_layout,
+  // given @p section_spec and the original @p image_layout. The blocks are
+  // optimized in parallel, but the resulting block specs are in the same
+  // order as if they had been optimized one after the other, on up to
+  // @p num_threads threads.
+  static bool OptimizeSection(const ImageLayout& image_layout,
                               const IndexedFrequencyInformation& entry_counts,
                               const ConstBlockVector& explicit_blocks,
+                              size_t num_threads,
                               Order::SectionSpec* orig_section_spec,
                               Order::BlockSpecVector* warm_block_specs,
                               Order::BlockSpecVector* cold_block_specs);
 
+  // Optimizes the blocks of a section on a pool of worker threads.
+  class SectionOptimizer;
+
   // The name of the (new) section in which to place cold blocks and
   // basic-blocks.
   std::string cold_section_name_;
 
+  // The maximum number of threads used to optimize a section.
+  size_t num_threads_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BasicBlockOptimizer);
 };
@@ -401,6 +401,41 @@ TEST_F(BasicBlockOptimizerTest, EmptyOrderingAllCold) {
   }
 }
 
+TEST_F(BasicBlockOptimizerTest, AllWarmKeepsBlockOrder) {
+  // Mark every code block as entered once.
+  IndexedFrequencyInformation entry_counts;
+  entry_counts.num_entries = 0;
+  entry_counts.num_columns = 1;
+  entry_counts.data_type = ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY;
+  entry_counts.frequency_size = 4;
+  BlockGraph::AddressSpace::RangeMapConstIter it =
+      image_layout_.blocks.begin();
+  for (; it != image_layout_.blocks.end(); ++it) {
+    if (it->second->type() == BlockGraph::CODE_BLOCK)
+      entry_counts.frequency_map[std::make_pair(it->first.start(), 0)] = 1;
+  }
+
+  // The blocks are optimized in parallel, but the result must not depend on
+  // the order in which they're processed.
+  Order order;
+  ASSERT_TRUE(optimizer_.Optimize(image_layout_, entry_counts, &order));
+  Order other_order;
+  ASSERT_TRUE(optimizer_.Optimize(image_layout_, entry_counts, &other_order));
+  EXPECT_TRUE(testing::OrdersAreEqual(order, other_order));
+
+  // Every block stays in its section, in its original relative order.
+  ASSERT_EQ(image_layout_.sections.size() + 1, order.sections.size());
+  for (size_t i = 0; i < image_layout_.sections.size(); ++i) {
+    BlockSpecVector original_block_specs;
+    GetBlockListForSection(input_dll_.section_header(i),
+                           &original_block_specs);
+    const BlockSpecVector& block_specs = order.sections[i].blocks;
+    ASSERT_EQ(original_block_specs.size(), block_specs.size());
+    for (size_t k = 0; k < block_specs.size(); ++k)
+      EXPECT_EQ(original_block_specs[k].block, block_specs[k].block);
+  }
+}
+
 TEST_F(BasicBlockOptimizerTest, HotCold) {
   // This test does a simple manipulation of the entry counts for DllMain and
   // validates that some minimum number of its blocks get moved into the cold
@@ -0,0 +1,296 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include <algorithm>
+#include <set>
+
+#include "syzygy/pe/pe_utils.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+
+// A cluster of blocks that are laid out contiguously.
+struct Cluster {
+  Cluster() : size(0), weight(0), first_seen(0) {}
+
+  std::vector<const BlockGraph::Block*> blocks;
+  size_t size;
+  uint64 weight;
+  size_t first_seen;
+};
+
+// A node of the call graph, used to visit the blocks by decreasing weight.
+struct WeightedBlock {
+  const BlockGraph::Block* block;
+  uint64 weight;
+  size_t first_seen;
+};
+
+// Sorts by decreasing weight, and then by increasing first seen rank.
+struct WeightedBlockSort {
+  bool operator()(const WeightedBlock& wb1, const WeightedBlock& wb2) const {
+    if (wb1.weight != wb2.weight)
+      return wb1.weight > wb2.weight;
+    return wb1.first_seen < wb2.first_seen;
+  }
+};
+
+// Sorts clusters by decreasing density, and then by increasing first seen
+// rank. Comparing weight1 / size1 to weight2 / size2 is done by
+// cross-multiplying to avoid the precision issues of floating point.
+struct ClusterDensitySort {
+  bool operator()(const Cluster* c1, const Cluster* c2) const {
+    DCHECK_LT(0U, c1->size);
+    DCHECK_LT(0U, c2->size);
+    uint64 density1 = c1->weight * c2->size;
+    uint64 density2 = c2->weight * c1->size;
+    if (density1 != density2)
+      return density1 > density2;
+    return c1->first_seen < c2->first_seen;
+  }
+};
+
+}  // namespace
+
+const size_t CallGraphOrderGenerator::kDefaultMaxClusterSize = 4096;
+
+CallGraphOrderGenerator::CallGraphOrderGenerator()
+    : Reorderer::OrderGenerator("Call Graph Order Generator"),
+      max_cluster_size_(kDefaultMaxClusterSize) {
+}
+
+CallGraphOrderGenerator::~CallGraphOrderGenerator() {
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                               RelativeAddress address,
+                                               uint32 process_id,
+                                               uint32 thread_id,
+                                               const UniqueTime& time) {
+  DCHECK(block != NULL);
+  ++GetNode(block)->weight;
+  return true;
+}
+
+bool CallGraphOrderGenerator::OnCodeBlockInvocation(
+    const BlockGraph::Block* caller,
+    const BlockGraph::Block* callee,
+    uint32 process_id,
+    uint32 thread_id,
+    size_t num_calls) {
+  DCHECK(caller != NULL);
+  DCHECK(callee != NULL);
+
+  // Make sure the caller is part of the graph, even if it's never called.
+  GetNode(caller);
+  GetNode(callee)->weight += num_calls;
+
+  // Recursive calls don't tell us anything about the layout.
+  if (caller != callee)
+    edges_[std::make_pair(caller, callee)] += num_calls;
+
+  return true;
+}
+
+bool CallGraphOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+
+  LOG(INFO) << "Clustering " << nodes_.size() << " blocks using "
+            << edges_.size() << " call graph edges.";
+
+  BlockVector ordered_blocks;
+  BuildClusters(&ordered_blocks);
+
+  // Initialize the section list and ordering meta data.
+  order->comment = "Call graph clustering ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    order->sections[i].id = i;
+    order->sections[i].name = image.sections[i].name;
+    order->sections[i].characteristics = image.sections[i].characteristics;
+  }
+
+  // Create the ordering from the clusters.
+  std::set<const BlockGraph::Block*> inserted_blocks;
+  for (size_t i = 0; i < ordered_blocks.size(); ++i) {
+    const BlockGraph::Block* code_block = ordered_blocks[i];
+
+    if (reorder_code) {
+      order->sections[code_block->section()].blocks.push_back(
+          Order::BlockSpec(code_block));
+      inserted_blocks.insert(code_block);
+    }
+
+    if (!reorder_data)
+      continue;
+
+    // Lay out the data directly referred to by this code block along with it.
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        code_block->references().begin();
+    for (; ref_it != code_block->references().end(); ++ref_it) {
+      const BlockGraph::Block* ref = ref_it->second.referenced();
+      DCHECK(ref != NULL);
+      if (ref->type() != BlockGraph::DATA_BLOCK ||
+          ref->section() == pe::kInvalidSection) {
+        continue;
+      }
+      if (!inserted_blocks.insert(ref).second)
+        continue;
+      order->sections[ref->section()].blocks.push_back(Order::BlockSpec(ref));
+    }
+  }
+
+  // Add the remaining blocks in each section to the order.
+  for (size_t section_index = 0; ; ++section_index) {
+    const IMAGE_SECTION_HEADER* section =
+        pe_file.section_header(section_index);
+    if (section == NULL)
+      break;
+
+    RelativeAddress section_start = RelativeAddress(section->VirtualAddress);
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(
+            section_start, section->Misc.VirtualSize);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      BlockGraph::Block* block = section_it->second;
+      if (inserted_blocks.count(block) > 0)
+        continue;
+      order->sections[section_index].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+CallGraphOrderGenerator::NodeInfo* CallGraphOrderGenerator::GetNode(
+    const BlockGraph::Block* block) {
+  DCHECK(block != NULL);
+  // All code blocks should belong to a defined section.
+  DCHECK_NE(pe::kInvalidSection, block->section());
+
+  std::pair<NodeMap::iterator, bool> result =
+      nodes_.insert(std::make_pair(block, NodeInfo()));
+  if (result.second)
+    result.first->second.first_seen = nodes_.size() - 1;
+  return &result.first->second;
+}
+
+void CallGraphOrderGenerator::BuildClusters(BlockVector* ordered_blocks) const {
+  DCHECK(ordered_blocks != NULL);
+  ordered_blocks->clear();
+
+  // Find the heaviest caller of each block. Ties are broken in favor of the
+  // caller that was seen first.
+  typedef std::map<const BlockGraph::Block*, Edge> HeaviestCallerMap;
+  HeaviestCallerMap heaviest_callers;
+  std::map<const BlockGraph::Block*, uint64> heaviest_weights;
+  EdgeMap::const_iterator edge_it = edges_.begin();
+  for (; edge_it != edges_.end(); ++edge_it) {
+    const BlockGraph::Block* caller = edge_it->first.first;
+    const BlockGraph::Block* callee = edge_it->first.second;
+    uint64& best_weight = heaviest_weights[callee];
+    HeaviestCallerMap::iterator best_it = heaviest_callers.find(callee);
+    if (best_it == heaviest_callers.end() || edge_it->second > best_weight ||
+        (edge_it->second == best_weight &&
+         nodes_.find(caller)->second.first_seen <
+             nodes_.find(best_it->second.first)->second.first_seen)) {
+      heaviest_callers[callee] = edge_it->first;
+      best_weight = edge_it->second;
+    }
+  }
+
+  // Create one cluster per block, and sort the blocks by decreasing weight.
+  std::vector<Cluster> clusters(nodes_.size());
+  std::map<const BlockGraph::Block*, Cluster*> block_clusters;
+  std::vector<WeightedBlock> weighted_blocks;
+  weighted_blocks.reserve(nodes_.size());
+  NodeMap::const_iterator node_it = nodes_.begin();
+  for (size_t i = 0; node_it != nodes_.end(); ++node_it, ++i) {
+    Cluster& cluster = clusters[i];
+    cluster.blocks.push_back(node_it->first);
+    cluster.size = std::max<size_t>(node_it->first->size(), 1);
+    cluster.weight = node_it->second.weight;
+    cluster.first_seen = node_it->second.first_seen;
+    block_clusters[node_it->first] = &cluster;
+
+    WeightedBlock weighted_block = { node_it->first,
+                                     node_it->second.weight,
+                                     node_it->second.first_seen };
+    weighted_blocks.push_back(weighted_block);
+  }
+  std::sort(weighted_blocks.begin(), weighted_blocks.end(),
+            WeightedBlockSort());
+
+  // Visit the blocks from the hottest to the coldest, and append the cluster
+  // of each block to the cluster of its heaviest caller.
+  for (size_t i = 0; i < weighted_blocks.size(); ++i) {
+    const BlockGraph::Block* callee = weighted_blocks[i].block;
+    HeaviestCallerMap::const_iterator caller_it = heaviest_callers.find(callee);
+    if (caller_it == heaviest_callers.end())
+      continue;
+    const BlockGraph::Block* caller = caller_it->second.first;
+    if (caller->section() != callee->section())
+      continue;
+
+    Cluster* caller_cluster = block_clusters[caller];
+    Cluster* callee_cluster = block_clusters[callee];
+    if (caller_cluster == callee_cluster)
+      continue;
+    if (caller_cluster->size + callee_cluster->size > max_cluster_size_)
+      continue;
+
+    // Merge the callee cluster into the caller cluster.
+    for (size_t j = 0; j < callee_cluster->blocks.size(); ++j)
+      block_clusters[callee_cluster->blocks[j]] = caller_cluster;
+    caller_cluster->blocks.insert(caller_cluster->blocks.end(),
+                                  callee_cluster->blocks.begin(),
+                                  callee_cluster->blocks.end());
+    caller_cluster->size += callee_cluster->size;
+    caller_cluster->weight += callee_cluster->weight;
+    caller_cluster->first_seen = std::min(caller_cluster->first_seen,
+                                          callee_cluster->first_seen);
+    callee_cluster->blocks.clear();
+  }
+
+  // Sort the surviving clusters by decreasing density.
+  std::vector<const Cluster*> sorted_clusters;
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    if (!clusters[i].blocks.empty())
+      sorted_clusters.push_back(&clusters[i]);
+  }
+  std::sort(sorted_clusters.begin(), sorted_clusters.end(),
+            ClusterDensitySort());
+
+  ordered_blocks->reserve(nodes_.size());
+  for (size_t i = 0; i < sorted_clusters.size(); ++i) {
+    ordered_blocks->insert(ordered_blocks->end(),
+                           sorted_clusters[i]->blocks.begin(),
+                           sorted_clusters[i]->blocks.end());
+  }
+  DCHECK_EQ(nodes_.size(), ordered_blocks->size());
+}
+
+}  // namespace reorder
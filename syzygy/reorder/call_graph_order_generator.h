@@ -0,0 +1,121 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer that clusters code blocks using the
+// caller/callee affinity seen in the traces, in the spirit of the Pettis-Hansen
+// and C3 (call-chain clustering) function ordering heuristics.
+//
+// A weighted call graph is built from the invocation batches produced by the
+// profiler: each caller/callee pair is an edge weighted by its call count, and
+// each block is weighted by the number of times it was called or entered.
+// Blocks that are only seen through entry events (as produced by the call-trace
+// client) are nodes without edges.
+//
+// Each block starts in its own cluster. The blocks are then visited in
+// decreasing weight order and the cluster of each block is appended to the
+// cluster of its heaviest caller, as long as the merged cluster fits in
+// max_cluster_size bytes (a page by default) and the two blocks live in the
+// same section. The resulting clusters are laid out in decreasing order of
+// density (weight per byte), so that the hottest call chains end up packed
+// together on as few pages as possible. The blocks that weren't seen are left
+// in their original order after the clustered ones.
+//
+// If data ordering is enabled, the data blocks directly referred to by a
+// clustered code block are laid out in the same order as the code.
+
+#ifndef SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A call-graph clustering order generator. See comment at top of this header
+// file for more details.
+class CallGraphOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // The default maximum size of a cluster, in bytes. This is the size of a
+  // page.
+  static const size_t kDefaultMaxClusterSize;
+
+  CallGraphOrderGenerator();
+  virtual ~CallGraphOrderGenerator();
+
+  // @name Accessors and mutators.
+  // @{
+  size_t max_cluster_size() const { return max_cluster_size_; }
+  void set_max_cluster_size(size_t max_cluster_size) {
+    max_cluster_size_ = max_cluster_size;
+  }
+  // @}
+
+  // OrderGenerator implementation.
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32 process_id,
+                                uint32 thread_id,
+                                const UniqueTime& time) OVERRIDE;
+  virtual bool OnCodeBlockInvocation(const BlockGraph::Block* caller,
+                                     const BlockGraph::Block* callee,
+                                     uint32 process_id,
+                                     uint32 thread_id,
+                                     size_t num_calls) OVERRIDE;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) OVERRIDE;
+
+ protected:
+  // Information about a node of the call graph.
+  struct NodeInfo {
+    NodeInfo() : weight(0), first_seen(0) {}
+
+    // The number of times this block was called or entered.
+    uint64 weight;
+    // The rank of the first event concerning this block. Used to break ties
+    // deterministically.
+    size_t first_seen;
+  };
+
+  typedef std::map<const BlockGraph::Block*, NodeInfo> NodeMap;
+  typedef std::pair<const BlockGraph::Block*, const BlockGraph::Block*> Edge;
+  typedef std::map<Edge, uint64> EdgeMap;
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+
+  // Returns the node associated with @p block, creating it if necessary.
+  NodeInfo* GetNode(const BlockGraph::Block* block);
+
+  // Clusters the blocks of the call graph.
+  // @param ordered_blocks receives the code blocks, in cluster order.
+  void BuildClusters(BlockVector* ordered_blocks) const;
+
+  // The maximum size of a cluster, in bytes.
+  size_t max_cluster_size_;
+
+  // The nodes of the call graph.
+  NodeMap nodes_;
+
+  // The edges of the call graph, keyed by (caller, callee), weighted by their
+  // call count.
+  EdgeMap edges_;
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_CALL_GRAPH_ORDER_GENERATOR_H_
@@ -0,0 +1,160 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/call_graph_order_generator.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+
+class CallGraphOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    testing::OrderGeneratorTest::SetUp();
+
+    // Get the first few non-empty code blocks of the .text section.
+    text_index_ = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(text_index_);
+    ASSERT_TRUE(section != NULL);
+
+    BlockGraph::AddressSpace::RangeMapConstIterPair section_blocks =
+        image_layout_.blocks.GetIntersectingBlocks(
+            core::RelativeAddress(section->VirtualAddress),
+            section->Misc.VirtualSize);
+    BlockGraph::AddressSpace::RangeMapConstIter it = section_blocks.first;
+    for (; it != section_blocks.second && blocks_.size() < 4; ++it) {
+      const BlockGraph::Block* block = it->second;
+      if (block->type() == BlockGraph::CODE_BLOCK && block->size() > 0)
+        blocks_.push_back(block);
+    }
+    ASSERT_EQ(4U, blocks_.size());
+  }
+
+  // Simulates the following call graph:
+  //   block0 -> block1 (100 calls)
+  //   block0 -> block2 (10 calls)
+  //   block2 -> block3 (50 calls)
+  void SimulateCallGraph() {
+    ASSERT_TRUE(order_generator_.OnCodeBlockInvocation(
+        blocks_[0], blocks_[1], 1, 1, 100));
+    ASSERT_TRUE(order_generator_.OnCodeBlockInvocation(
+        blocks_[0], blocks_[2], 1, 1, 10));
+    ASSERT_TRUE(order_generator_.OnCodeBlockInvocation(
+        blocks_[2], blocks_[3], 1, 1, 50));
+  }
+
+  // Returns the position of @p block in the .text ordering.
+  size_t PositionOf(const BlockGraph::Block* block) {
+    const BlockSpecVector& specs = order_.sections[text_index_].blocks;
+    for (size_t i = 0; i < specs.size(); ++i) {
+      if (specs[i].block == block)
+        return i;
+    }
+    return specs.size();
+  }
+
+  size_t text_index_;
+  std::vector<const BlockGraph::Block*> blocks_;
+  CallGraphOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(CallGraphOrderGeneratorTest, DoNotReorder) {
+  ASSERT_NO_FATAL_FAILURE(SimulateCallGraph());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, ClustersCallChains) {
+  // Allow all the blocks to fit in a single cluster.
+  order_generator_.set_max_cluster_size(
+      blocks_[0]->size() + blocks_[1]->size() + blocks_[2]->size() +
+      blocks_[3]->size());
+  ASSERT_NO_FATAL_FAILURE(SimulateCallGraph());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // Each callee is appended to the cluster of its heaviest caller, so we
+  // expect block0, block1, block2, block3 at the front of the section.
+  for (size_t i = 0; i < blocks_.size(); ++i)
+    EXPECT_EQ(i, PositionOf(blocks_[i]));
+
+  // The other sections should be untouched.
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    if (i == text_index_)
+      continue;
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(CallGraphOrderGeneratorTest, RespectsMaxClusterSize) {
+  // Only block0 and block1 fit together in a cluster.
+  order_generator_.set_max_cluster_size(
+      blocks_[0]->size() + blocks_[1]->size());
+  ASSERT_NO_FATAL_FAILURE(SimulateCallGraph());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // block1 is the heaviest callee, it should immediately follow its caller.
+  EXPECT_EQ(PositionOf(blocks_[0]) + 1, PositionOf(blocks_[1]));
+
+  // All the blocks of the call graph come before the blocks that weren't seen.
+  for (size_t i = 0; i < blocks_.size(); ++i)
+    EXPECT_GT(blocks_.size(), PositionOf(blocks_[i]));
+}
+
+TEST_F(CallGraphOrderGeneratorTest, EntryOnlyBlocks) {
+  // Blocks only seen through entry events are ordered by decreasing density.
+  ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+      blocks_[2], blocks_[2]->addr(), 1, 1, GetSystemTime()));
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+  EXPECT_EQ(0U, PositionOf(blocks_[2]));
+}
+
+}  // namespace reorder
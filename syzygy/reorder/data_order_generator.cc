@@ -0,0 +1,325 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/data_order_generator.h"
+
+#include <algorithm>
+#include <set>
+
+#include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+#include "syzygy/pe/pe_transform_policy.h"
+#include "syzygy/pe/pe_utils.h"
+
+#include "mnemonics.h"  // NOLINT
+
+namespace reorder {
+
+namespace {
+
+using block_graph::BasicBlock;
+using block_graph::BasicBlockDecomposer;
+using block_graph::BasicBlockSubGraph;
+using block_graph::BasicCodeBlock;
+using block_graph::Instruction;
+
+typedef block_graph::BlockGraph BlockGraph;
+
+// Determines whether @p instr writes to its first operand, and that operand is
+// in memory.
+bool IsMemoryWrite(const Instruction& instr) {
+  const _DInst& repr = instr.representation();
+  if (repr.ops[0].type != O_DISP &&
+      repr.ops[0].type != O_SMEM &&
+      repr.ops[0].type != O_MEM) {
+    return false;
+  }
+
+  switch (repr.opcode) {
+    case I_ADC:
+    case I_ADD:
+    case I_AND:
+    case I_CMPXCHG:
+    case I_DEC:
+    case I_FIST:
+    case I_FISTP:
+    case I_FST:
+    case I_FSTP:
+    case I_INC:
+    case I_MOV:
+    case I_MOVAPS:
+    case I_MOVD:
+    case I_MOVDQA:
+    case I_MOVDQU:
+    case I_MOVQ:
+    case I_MOVSD:
+    case I_MOVSS:
+    case I_MOVUPS:
+    case I_NEG:
+    case I_NOT:
+    case I_OR:
+    case I_POP:
+    case I_SAR:
+    case I_SBB:
+    case I_SHL:
+    case I_SHR:
+    case I_SUB:
+    case I_XADD:
+    case I_XCHG:
+    case I_XOR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Marks the data blocks referred to by @p code_block as touched.
+void TouchReferencedData(const BlockGraph::Block* code_block,
+                         bool is_written,
+                         std::map<const BlockGraph::Block*, bool>* touched) {
+  DCHECK(code_block != NULL);
+  DCHECK(touched != NULL);
+
+  BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+      code_block->references().begin();
+  for (; ref_it != code_block->references().end(); ++ref_it) {
+    const BlockGraph::Block* ref = ref_it->second.referenced();
+    DCHECK(ref != NULL);
+    if (ref->type() != BlockGraph::DATA_BLOCK ||
+        ref->section() == pe::kInvalidSection) {
+      continue;
+    }
+    (*touched)[ref] |= is_written;
+  }
+}
+
+// Sorts touched data blocks: written ones first, then by decreasing heat, and
+// then by increasing first seen rank.
+struct DataBlockSort {
+  template <typename DataBlockInfo>
+  bool operator()(const DataBlockInfo* info1,
+                  const DataBlockInfo* info2) const {
+    if (info1->is_written != info2->is_written)
+      return info1->is_written;
+    if (info1->heat != info2->heat)
+      return info1->heat > info2->heat;
+    return info1->first_seen < info2->first_seen;
+  }
+};
+
+// Sorts executed code blocks by increasing first seen rank.
+struct CodeBlockSort {
+  template <typename CodeBlockPair>
+  bool operator()(const CodeBlockPair* pair1,
+                  const CodeBlockPair* pair2) const {
+    return pair1->second.first_seen < pair2->second.first_seen;
+  }
+};
+
+}  // namespace
+
+DataOrderGenerator::DataOrderGenerator()
+    : Reorderer::OrderGenerator("Data Order Generator") {
+}
+
+DataOrderGenerator::~DataOrderGenerator() {
+}
+
+bool DataOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                          RelativeAddress address,
+                                          uint32 process_id,
+                                          uint32 thread_id,
+                                          const UniqueTime& time) {
+  DCHECK(block != NULL);
+  RecordEntries(block, 1);
+  return true;
+}
+
+bool DataOrderGenerator::OnCodeBlockInvocation(
+    const BlockGraph::Block* caller,
+    const BlockGraph::Block* callee,
+    uint32 process_id,
+    uint32 thread_id,
+    size_t num_calls) {
+  DCHECK(caller != NULL);
+  DCHECK(callee != NULL);
+  RecordEntries(callee, num_calls);
+  return true;
+}
+
+bool DataOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                             const ImageLayout& image,
+                                             bool reorder_code,
+                                             bool reorder_data,
+                                             Order* order) {
+  DCHECK(order != NULL);
+
+  // Sort the executed code blocks by first execution.
+  typedef CodeBlockMap::value_type CodeBlockPair;
+  std::vector<const CodeBlockPair*> code_blocks;
+  code_blocks.reserve(code_blocks_.size());
+  CodeBlockMap::const_iterator code_it = code_blocks_.begin();
+  for (; code_it != code_blocks_.end(); ++code_it)
+    code_blocks.push_back(&*code_it);
+  std::sort(code_blocks.begin(), code_blocks.end(), CodeBlockSort());
+
+  // Accumulate the data accesses of the executed code.
+  DataBlockMap data_blocks;
+  if (reorder_data) {
+    for (size_t i = 0; i < code_blocks.size(); ++i) {
+      AnalyzeCodeBlock(code_blocks[i]->first, code_blocks[i]->second,
+                       &data_blocks);
+    }
+  }
+
+  std::vector<const DataBlockInfo*> sorted_data_blocks;
+  sorted_data_blocks.reserve(data_blocks.size());
+  size_t written_blocks = 0;
+  DataBlockMap::const_iterator data_it = data_blocks.begin();
+  for (; data_it != data_blocks.end(); ++data_it) {
+    sorted_data_blocks.push_back(&data_it->second);
+    if (data_it->second.is_written)
+      ++written_blocks;
+  }
+  std::sort(sorted_data_blocks.begin(), sorted_data_blocks.end(),
+            DataBlockSort());
+
+  LOG(INFO) << "Laying out " << sorted_data_blocks.size() << " touched data "
+            << "blocks (" << written_blocks << " written) referred to by "
+            << code_blocks.size() << " executed code blocks.";
+
+  // Initialize the section list and ordering meta data.
+  order->comment = "Data layout ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    order->sections[i].id = i;
+    order->sections[i].name = image.sections[i].name;
+    order->sections[i].characteristics = image.sections[i].characteristics;
+  }
+
+  std::set<const BlockGraph::Block*> inserted_blocks;
+  if (reorder_code) {
+    for (size_t i = 0; i < code_blocks.size(); ++i) {
+      const BlockGraph::Block* code_block = code_blocks[i]->first;
+      order->sections[code_block->section()].blocks.push_back(
+          Order::BlockSpec(code_block));
+      inserted_blocks.insert(code_block);
+    }
+  }
+
+  for (size_t i = 0; i < sorted_data_blocks.size(); ++i) {
+    const BlockGraph::Block* data_block = sorted_data_blocks[i]->block;
+    order->sections[data_block->section()].blocks.push_back(
+        Order::BlockSpec(data_block));
+    inserted_blocks.insert(data_block);
+  }
+
+  // Add the remaining blocks in each section to the order.
+  for (size_t section_index = 0; ; ++section_index) {
+    const IMAGE_SECTION_HEADER* section =
+        pe_file.section_header(section_index);
+    if (section == NULL)
+      break;
+
+    RelativeAddress section_start = RelativeAddress(section->VirtualAddress);
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(
+            section_start, section->Misc.VirtualSize);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      BlockGraph::Block* block = section_it->second;
+      if (inserted_blocks.count(block) > 0)
+        continue;
+      order->sections[section_index].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+void DataOrderGenerator::RecordEntries(const BlockGraph::Block* block,
+                                       uint64 count) {
+  DCHECK(block != NULL);
+  // All code blocks should belong to a defined section.
+  DCHECK_NE(pe::kInvalidSection, block->section());
+
+  std::pair<CodeBlockMap::iterator, bool> result =
+      code_blocks_.insert(std::make_pair(block, CodeBlockInfo()));
+  if (result.second)
+    result.first->second.first_seen = code_blocks_.size() - 1;
+  result.first->second.entry_count += count;
+}
+
+void DataOrderGenerator::AnalyzeCodeBlock(const BlockGraph::Block* code_block,
+                                          const CodeBlockInfo& info,
+                                          DataBlockMap* data_blocks) {
+  DCHECK(code_block != NULL);
+  DCHECK(data_blocks != NULL);
+
+  // Find the data blocks touched by this code block, and whether they're
+  // written to. If the block can't be disassembled, assume the worst.
+  std::map<const BlockGraph::Block*, bool> touched;
+  pe::PETransformPolicy policy;
+  BasicBlockSubGraph subgraph;
+  BasicBlockDecomposer decomposer(code_block, &subgraph);
+  if (!policy.BlockIsSafeToBasicBlockDecompose(code_block) ||
+      !decomposer.Decompose()) {
+    TouchReferencedData(code_block, true, &touched);
+  } else {
+    BasicBlockSubGraph::BBCollection::const_iterator bb_it =
+        subgraph.basic_blocks().begin();
+    for (; bb_it != subgraph.basic_blocks().end(); ++bb_it) {
+      const BasicCodeBlock* bb = BasicCodeBlock::Cast(*bb_it);
+      if (bb == NULL)
+        continue;
+
+      BasicBlock::Instructions::const_iterator inst_it =
+          bb->instructions().begin();
+      for (; inst_it != bb->instructions().end(); ++inst_it) {
+        bool is_written = IsMemoryWrite(*inst_it);
+        Instruction::BasicBlockReferenceMap::const_iterator ref_it =
+            inst_it->references().begin();
+        for (; ref_it != inst_it->references().end(); ++ref_it) {
+          const BlockGraph::Block* ref = ref_it->second.block();
+          if (ref == NULL || ref->type() != BlockGraph::DATA_BLOCK ||
+              ref->section() == pe::kInvalidSection) {
+            continue;
+          }
+          touched[ref] |= is_written;
+        }
+      }
+    }
+  }
+
+  // Accumulate the accesses.
+  std::map<const BlockGraph::Block*, bool>::const_iterator touched_it =
+      touched.begin();
+  for (; touched_it != touched.end(); ++touched_it) {
+    std::pair<DataBlockMap::iterator, bool> result =
+        data_blocks->insert(std::make_pair(touched_it->first,
+                                           DataBlockInfo()));
+    DataBlockInfo& data_info = result.first->second;
+    if (result.second) {
+      data_info.block = touched_it->first;
+      data_info.first_seen = info.first_seen;
+    }
+    data_info.heat += info.entry_count;
+    data_info.is_written |= touched_it->second;
+  }
+}
+
+}  // namespace reorder
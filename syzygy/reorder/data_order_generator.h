@@ -0,0 +1,118 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer that focuses on the layout of the data
+// sections. The data blocks touched during the traces are packed together at
+// the front of their section, so that the startup working set of the data
+// sections spans as few pages as possible.
+//
+// The data accesses are derived from the code execution profile: each data
+// block referred to by an executed code block is assumed to be touched every
+// time that code block runs, and its heat is the sum of the entry counts of
+// the code blocks referring to it. The instructions of the executed code blocks
+// are disassembled to tell whether a data block is written to or only read.
+// A data block referred to by code that can't be safely decomposed is assumed
+// to be written.
+//
+// In each data section, the touched blocks that are written are laid out
+// first, followed by the touched blocks that are only read, each group sorted
+// by decreasing heat. Keeping read-mostly data away from written data avoids
+// false sharing of cache lines between threads, and keeps the read-mostly pages
+// clean. The blocks that weren't touched are left in their original order.
+//
+// If code ordering is enabled, the executed code blocks are laid out in the
+// order they were first seen, as with the LinearOrderGenerator.
+
+#ifndef SYZYGY_REORDER_DATA_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_DATA_ORDER_GENERATOR_H_
+
+#include <map>
+#include <vector>
+
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A data layout order generator. See comment at top of this header file for
+// more details.
+class DataOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  DataOrderGenerator();
+  virtual ~DataOrderGenerator();
+
+  // OrderGenerator implementation.
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32 process_id,
+                                uint32 thread_id,
+                                const UniqueTime& time) OVERRIDE;
+  virtual bool OnCodeBlockInvocation(const BlockGraph::Block* caller,
+                                     const BlockGraph::Block* callee,
+                                     uint32 process_id,
+                                     uint32 thread_id,
+                                     size_t num_calls) OVERRIDE;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) OVERRIDE;
+
+ protected:
+  // Information about an executed code block.
+  struct CodeBlockInfo {
+    CodeBlockInfo() : entry_count(0), first_seen(0) {}
+
+    // The number of times this block was entered.
+    uint64 entry_count;
+    // The rank of the first entry in this block.
+    size_t first_seen;
+  };
+
+  // Information about a touched data block.
+  struct DataBlockInfo {
+    DataBlockInfo() : block(NULL), heat(0), first_seen(0), is_written(false) {}
+
+    const BlockGraph::Block* block;
+    // The sum of the entry counts of the code blocks referring to this block.
+    uint64 heat;
+    // The rank of the first code block seen referring to this block.
+    size_t first_seen;
+    // True if this block may be written to.
+    bool is_written;
+  };
+
+  typedef std::map<const BlockGraph::Block*, CodeBlockInfo> CodeBlockMap;
+  typedef std::map<const BlockGraph::Block*, DataBlockInfo> DataBlockMap;
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+
+  // Records the entries of @p block.
+  void RecordEntries(const BlockGraph::Block* block, uint64 count);
+
+  // Accumulates the data accesses performed by @p code_block.
+  // @param code_block the executed code block to analyze.
+  // @param info the execution information of @p code_block.
+  // @param data_blocks receives the data blocks touched by @p code_block.
+  static void AnalyzeCodeBlock(const BlockGraph::Block* code_block,
+                               const CodeBlockInfo& info,
+                               DataBlockMap* data_blocks);
+
+  // The executed code blocks.
+  CodeBlockMap code_blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(DataOrderGenerator);
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_DATA_ORDER_GENERATOR_H_
@@ -0,0 +1,157 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/data_order_generator.h"
+
+#include <set>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/pe/pe_utils.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef std::set<const BlockGraph::Block*> BlockSet;
+
+class DataOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    testing::OrderGeneratorTest::SetUp();
+
+    // Get the first few code blocks of the .text section referring to data.
+    size_t text_index = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(text_index);
+    ASSERT_TRUE(section != NULL);
+
+    BlockGraph::AddressSpace::RangeMapConstIterPair section_blocks =
+        image_layout_.blocks.GetIntersectingBlocks(
+            core::RelativeAddress(section->VirtualAddress),
+            section->Misc.VirtualSize);
+    BlockGraph::AddressSpace::RangeMapConstIter it = section_blocks.first;
+    for (; it != section_blocks.second && code_blocks_.size() < 4; ++it) {
+      const BlockGraph::Block* block = it->second;
+      if (block->type() != BlockGraph::CODE_BLOCK)
+        continue;
+
+      BlockSet data_blocks;
+      GetReferencedData(block, &data_blocks);
+      if (data_blocks.empty())
+        continue;
+
+      code_blocks_.push_back(block);
+      touched_data_blocks_.insert(data_blocks.begin(), data_blocks.end());
+    }
+    ASSERT_EQ(4U, code_blocks_.size());
+  }
+
+  // Gets the data blocks directly referred to by @p block.
+  static void GetReferencedData(const BlockGraph::Block* block,
+                                BlockSet* data_blocks) {
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        block->references().begin();
+    for (; ref_it != block->references().end(); ++ref_it) {
+      const BlockGraph::Block* ref = ref_it->second.referenced();
+      if (ref->type() == BlockGraph::DATA_BLOCK &&
+          ref->section() != pe::kInvalidSection) {
+        data_blocks->insert(ref);
+      }
+    }
+  }
+
+  void SimulateEntries() {
+    for (size_t i = 0; i < code_blocks_.size(); ++i) {
+      ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+          code_blocks_[i], code_blocks_[i]->addr(), 1, 1, GetSystemTime()));
+    }
+  }
+
+  std::vector<const BlockGraph::Block*> code_blocks_;
+  BlockSet touched_data_blocks_;
+  DataOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(DataOrderGeneratorTest, DoNotReorder) {
+  ASSERT_NO_FATAL_FAILURE(SimulateEntries());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(DataOrderGeneratorTest, TouchedDataFirst) {
+  ASSERT_NO_FATAL_FAILURE(SimulateEntries());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   true,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // In each section, the touched data blocks come before all the other blocks.
+  size_t touched_blocks = 0;
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const BlockSpecVector& specs = order_.sections[i].blocks;
+    bool seen_untouched = false;
+    for (size_t j = 0; j < specs.size(); ++j) {
+      if (touched_data_blocks_.count(specs[j].block) == 0) {
+        seen_untouched = true;
+        continue;
+      }
+      EXPECT_FALSE(seen_untouched);
+      ++touched_blocks;
+    }
+  }
+  EXPECT_EQ(touched_data_blocks_.size(), touched_blocks);
+
+  // The code is left untouched.
+  size_t text_index = input_dll_.GetSectionIndex(".text");
+  ExpectSameOrder(input_dll_.section_header(text_index),
+                  order_.sections[text_index].blocks);
+}
+
+TEST_F(DataOrderGeneratorTest, ReorderCode) {
+  ASSERT_NO_FATAL_FAILURE(SimulateEntries());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The executed code blocks come first, in execution order.
+  size_t text_index = input_dll_.GetSectionIndex(".text");
+  const BlockSpecVector& specs = order_.sections[text_index].blocks;
+  ASSERT_LE(code_blocks_.size(), specs.size());
+  for (size_t i = 0; i < code_blocks_.size(); ++i)
+    EXPECT_EQ(code_blocks_[i], specs[i].block);
+}
+
+}  // namespace reorder
@@ -0,0 +1,276 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/page_fault_order_generator.h"
+
+#include <algorithm>
+
+#include "syzygy/pe/pe_utils.h"
+#include "syzygy/simulate/page_fault_simulation.h"
+
+namespace reorder {
+
+namespace {
+
+using simulate::PageFaultSimulation;
+
+typedef block_graph::BlockGraph BlockGraph;
+typedef core::RelativeAddress RelativeAddress;
+
+// Computes the address of each block of @p layout when laid out contiguously
+// from @p section_start, honoring the block alignments.
+void ComputeAddresses(RelativeAddress section_start,
+                      const std::vector<const BlockGraph::Block*>& layout,
+                      std::vector<RelativeAddress>* addresses) {
+  DCHECK(addresses != NULL);
+
+  addresses->resize(layout.size());
+  RelativeAddress address = section_start;
+  for (size_t i = 0; i < layout.size(); ++i) {
+    address = address.AlignUp(layout[i]->alignment());
+    (*addresses)[i] = address;
+    address += layout[i]->size();
+  }
+}
+
+}  // namespace
+
+PageFaultOrderGenerator::PageFaultOrderGenerator()
+    : Reorderer::OrderGenerator("Page Fault Order Generator"),
+      page_size_(PageFaultSimulation::kDefaultPageSize),
+      pages_per_code_fault_(PageFaultSimulation::kDefaultPagesPerCodeFault),
+      max_passes_(kDefaultMaxPasses),
+      initial_fault_count_(0),
+      final_fault_count_(0) {
+}
+
+PageFaultOrderGenerator::~PageFaultOrderGenerator() {
+}
+
+bool PageFaultOrderGenerator::OnProcessStarted(uint32 process_id,
+                                               const UniqueTime& time) {
+  current_runs_[process_id] = runs_.size();
+  runs_.push_back(ProcessRun());
+  runs_.back().start_time = time.time();
+  runs_.back().start_time_is_known = true;
+  return true;
+}
+
+bool PageFaultOrderGenerator::OnProcessEnded(uint32 process_id,
+                                             const UniqueTime& time) {
+  current_runs_.erase(process_id);
+  return true;
+}
+
+bool PageFaultOrderGenerator::OnCodeBlockEntry(const BlockGraph::Block* block,
+                                               RelativeAddress address,
+                                               uint32 process_id,
+                                               uint32 thread_id,
+                                               const UniqueTime& time) {
+  DCHECK(block != NULL);
+
+  ProcessRun* run = GetProcessRun(process_id);
+  DCHECK(run != NULL);
+  if (!run->start_time_is_known) {
+    run->start_time = time.time();
+    run->start_time_is_known = true;
+  }
+
+  // Ignore the blocks touched after the startup window.
+  if (startup_window_ > base::TimeDelta() &&
+      time.time() - run->start_time > startup_window_) {
+    return true;
+  }
+
+  if (!run->touched.insert(block).second)
+    return true;
+  run->first_touches.push_back(block);
+
+  if (startup_block_set_.insert(block).second)
+    startup_blocks_.push_back(block);
+
+  return true;
+}
+
+bool PageFaultOrderGenerator::CalculateReordering(const PEFile& pe_file,
+                                                  const ImageLayout& image,
+                                                  bool reorder_code,
+                                                  bool reorder_data,
+                                                  Order* order) {
+  DCHECK(order != NULL);
+
+  initial_fault_count_ = 0;
+  final_fault_count_ = 0;
+
+  // Initialize the section list and ordering meta data.
+  order->comment = "Page fault simulation ordering";
+  order->sections.clear();
+  order->sections.resize(image.sections.size());
+  for (size_t i = 0; i < image.sections.size(); ++i) {
+    order->sections[i].id = i;
+    order->sections[i].name = image.sections[i].name;
+    order->sections[i].characteristics = image.sections[i].characteristics;
+  }
+
+  // Group the startup blocks by section, in first touch order.
+  BlockSet inserted_blocks;
+  if (reorder_code) {
+    std::vector<BlockVector> section_layouts(image.sections.size());
+    for (size_t i = 0; i < startup_blocks_.size(); ++i) {
+      const BlockGraph::Block* block = startup_blocks_[i];
+      DCHECK_NE(pe::kInvalidSection, block->section());
+      DCHECK_LT(block->section(), section_layouts.size());
+      section_layouts[block->section()].push_back(block);
+    }
+
+    for (size_t i = 0; i < section_layouts.size(); ++i) {
+      BlockVector& layout = section_layouts[i];
+      if (layout.empty())
+        continue;
+
+      initial_fault_count_ += OptimizeSection(image.sections[i].addr, &layout);
+      for (size_t j = 0; j < layout.size(); ++j) {
+        order->sections[i].blocks.push_back(Order::BlockSpec(layout[j]));
+        inserted_blocks.insert(layout[j]);
+      }
+    }
+
+    LOG(INFO) << "Laid out " << startup_blocks_.size() << " startup block(s) "
+              << "seen in " << runs_.size() << " run(s); simulated page "
+              << "faults went from " << initial_fault_count_ << " to "
+              << final_fault_count_ << ".";
+  }
+
+  // Add the remaining blocks in each section to the order.
+  for (size_t section_index = 0; ; ++section_index) {
+    const IMAGE_SECTION_HEADER* section =
+        pe_file.section_header(section_index);
+    if (section == NULL)
+      break;
+
+    RelativeAddress section_start = RelativeAddress(section->VirtualAddress);
+    AddressSpace::RangeMapConstIterPair section_blocks =
+        image.blocks.GetIntersectingBlocks(
+            section_start, section->Misc.VirtualSize);
+    AddressSpace::RangeMapConstIter& section_it = section_blocks.first;
+    const AddressSpace::RangeMapConstIter& section_end = section_blocks.second;
+    for (; section_it != section_end; ++section_it) {
+      BlockGraph::Block* block = section_it->second;
+      if (inserted_blocks.count(block) > 0)
+        continue;
+      order->sections[section_index].blocks.push_back(Order::BlockSpec(block));
+    }
+  }
+
+  return true;
+}
+
+PageFaultOrderGenerator::ProcessRun* PageFaultOrderGenerator::GetProcessRun(
+    uint32 process_id) {
+  std::pair<ProcessRunMap::iterator, bool> result =
+      current_runs_.insert(std::make_pair(process_id, runs_.size()));
+  if (result.second)
+    runs_.push_back(ProcessRun());
+  DCHECK_LT(result.first->second, runs_.size());
+  return &runs_[result.first->second];
+}
+
+size_t PageFaultOrderGenerator::SimulatePageFaults(
+    RelativeAddress section_start,
+    const BlockVector& layout,
+    const std::vector<BlockVector>& touches) const {
+  std::vector<RelativeAddress> addresses;
+  ComputeAddresses(section_start, layout, &addresses);
+
+  std::map<const BlockGraph::Block*, RelativeAddress> address_map;
+  for (size_t i = 0; i < layout.size(); ++i)
+    address_map[layout[i]] = addresses[i];
+
+  // Each startup is simulated independently, as each starts with none of the
+  // pages of the module in memory.
+  size_t fault_count = 0;
+  for (size_t i = 0; i < touches.size(); ++i) {
+    PageFaultSimulation simulation;
+    simulation.set_page_size(page_size_);
+    simulation.set_pages_per_code_fault(pages_per_code_fault_);
+
+    const BlockVector& run_touches = touches[i];
+    for (size_t j = 0; j < run_touches.size(); ++j) {
+      const BlockGraph::Block* block = run_touches[j];
+      DCHECK(address_map.find(block) != address_map.end());
+      simulation.OnRangeAccessed(address_map[block].value(), block->size());
+    }
+    fault_count += simulation.fault_count();
+  }
+
+  return fault_count;
+}
+
+size_t PageFaultOrderGenerator::OptimizeSection(RelativeAddress section_start,
+                                                BlockVector* layout) {
+  DCHECK(layout != NULL);
+
+  // Restrict the first touches of each run to the blocks of this section.
+  BlockSet section_blocks(layout->begin(), layout->end());
+  std::vector<BlockVector> touches;
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    BlockVector run_touches;
+    const BlockVector& first_touches = runs_[i].first_touches;
+    for (size_t j = 0; j < first_touches.size(); ++j) {
+      if (section_blocks.count(first_touches[j]) > 0)
+        run_touches.push_back(first_touches[j]);
+    }
+    if (!run_touches.empty())
+      touches.push_back(run_touches);
+  }
+
+  const size_t initial_fault_count =
+      SimulatePageFaults(section_start, *layout, touches);
+  size_t best_fault_count = initial_fault_count;
+
+  std::vector<RelativeAddress> addresses;
+  for (size_t pass = 0; pass < max_passes_ && best_fault_count > 0; ++pass) {
+    bool improved = false;
+    ComputeAddresses(section_start, *layout, &addresses);
+
+    for (size_t i = 0; i + 1 < layout->size(); ++i) {
+      // Only swap pairs of blocks straddling a page boundary.
+      const BlockGraph::Block* next = (*layout)[i + 1];
+      size_t first_page = addresses[i].value() / page_size_;
+      size_t last_page =
+          (addresses[i + 1].value() + std::max<size_t>(next->size(), 1) - 1) /
+          page_size_;
+      if (first_page == last_page)
+        continue;
+
+      std::swap((*layout)[i], (*layout)[i + 1]);
+      size_t fault_count = SimulatePageFaults(section_start, *layout, touches);
+      if (fault_count < best_fault_count) {
+        best_fault_count = fault_count;
+        improved = true;
+        ComputeAddresses(section_start, *layout, &addresses);
+      } else {
+        std::swap((*layout)[i], (*layout)[i + 1]);
+      }
+    }
+
+    if (!improved)
+      break;
+  }
+
+  final_fault_count_ += best_fault_count;
+  return initial_fault_count;
+}
+
+}  // namespace reorder
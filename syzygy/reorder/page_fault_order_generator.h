@@ -0,0 +1,172 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// An implementation of a Reorderer that optimizes the code layout for cold
+// startup. It uses the PageFaultSimulation as its objective: the number of
+// page faults simulated while replaying the traced startups on a candidate
+// layout is what it tries to minimize.
+//
+// For each traced process, the code blocks are recorded in the order they were
+// first touched. Only the blocks first touched within the startup window (a
+// duration measured from the start of each process) are considered, as the
+// later ones don't contribute to the cold startup cost.
+//
+// The initial layout of each code section places the startup blocks in the
+// order they were first touched (as the LinearOrderGenerator does). This
+// layout is then improved by a local search: adjacent blocks straddling a page
+// boundary are swapped whenever this reduces the number of simulated page
+// faults. Swapping blocks that lie within a single page can't change the set
+// of touched pages, so only the page boundaries are explored. The search stops
+// when a pass brings no improvement, or after a maximum number of passes.
+//
+// The blocks that weren't touched during the startup window are laid out after
+// the startup blocks, in their original order. Data sections are left in their
+// original order.
+
+#ifndef SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
+#define SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/time/time.h"
+#include "syzygy/reorder/reorderer.h"
+
+namespace reorder {
+
+// A startup-focused order generator. See comment at top of this header file
+// for more details.
+class PageFaultOrderGenerator : public Reorderer::OrderGenerator {
+ public:
+  // The default maximum number of local search passes.
+  static const size_t kDefaultMaxPasses = 8;
+
+  PageFaultOrderGenerator();
+  virtual ~PageFaultOrderGenerator();
+
+  // @name Accessors.
+  // @{
+  const base::TimeDelta& startup_window() const { return startup_window_; }
+  size_t page_size() const { return page_size_; }
+  size_t pages_per_code_fault() const { return pages_per_code_fault_; }
+  size_t max_passes() const { return max_passes_; }
+  size_t initial_fault_count() const { return initial_fault_count_; }
+  size_t final_fault_count() const { return final_fault_count_; }
+  // @}
+
+  // @name Mutators.
+  // @{
+  // Sets the duration of the startup window. A zero duration means the whole
+  // traces are considered.
+  void set_startup_window(const base::TimeDelta& startup_window) {
+    startup_window_ = startup_window;
+  }
+  void set_page_size(size_t page_size) {
+    DCHECK_LT(0U, page_size);
+    page_size_ = page_size;
+  }
+  void set_pages_per_code_fault(size_t pages_per_code_fault) {
+    DCHECK_LT(0U, pages_per_code_fault);
+    pages_per_code_fault_ = pages_per_code_fault;
+  }
+  void set_max_passes(size_t max_passes) { max_passes_ = max_passes; }
+  // @}
+
+  // OrderGenerator implementation.
+  virtual bool OnProcessStarted(uint32 process_id,
+                                const UniqueTime& time) OVERRIDE;
+  virtual bool OnProcessEnded(uint32 process_id,
+                              const UniqueTime& time) OVERRIDE;
+  virtual bool OnCodeBlockEntry(const BlockGraph::Block* block,
+                                RelativeAddress address,
+                                uint32 process_id,
+                                uint32 thread_id,
+                                const UniqueTime& time) OVERRIDE;
+  virtual bool CalculateReordering(const PEFile& pe_file,
+                                   const ImageLayout& image,
+                                   bool reorder_code,
+                                   bool reorder_data,
+                                   Order* order) OVERRIDE;
+
+ protected:
+  typedef std::vector<const BlockGraph::Block*> BlockVector;
+  typedef std::set<const BlockGraph::Block*> BlockSet;
+
+  // The startup of a traced process.
+  struct ProcessRun {
+    ProcessRun() : start_time_is_known(false) {}
+
+    // The time the process started, or the time of its first event.
+    base::Time start_time;
+    bool start_time_is_known;
+    // The code blocks touched in the startup window, in first touch order.
+    BlockVector first_touches;
+    BlockSet touched;
+  };
+
+  typedef std::vector<ProcessRun> ProcessRuns;
+  typedef std::map<uint32, size_t> ProcessRunMap;
+
+  // Returns the run of @p process_id, creating it if needed.
+  ProcessRun* GetProcessRun(uint32 process_id);
+
+  // Simulates the page faults caused by the startups on a section layout.
+  // @param section_start the address of the section.
+  // @param layout the startup blocks of the section, in layout order.
+  // @param touches the first touches of each startup, restricted to the
+  //     blocks of @p layout.
+  // @returns the total number of simulated page faults.
+  size_t SimulatePageFaults(RelativeAddress section_start,
+                            const BlockVector& layout,
+                            const std::vector<BlockVector>& touches) const;
+
+  // Improves the layout of the startup blocks of a section.
+  // @param section_start the address of the section.
+  // @param layout the startup blocks of the section. On input this is the
+  //     initial layout, on output the improved layout.
+  // @returns the number of simulated page faults of the initial layout.
+  size_t OptimizeSection(RelativeAddress section_start, BlockVector* layout);
+
+  // @name Parameters.
+  // @{
+  base::TimeDelta startup_window_;
+  size_t page_size_;
+  size_t pages_per_code_fault_;
+  size_t max_passes_;
+  // @}
+
+  // The traced process runs. A process id may be reused across traces, so
+  // each process start creates a new run.
+  ProcessRuns runs_;
+  // Maps the running processes to their run.
+  ProcessRunMap current_runs_;
+
+  // The startup blocks, in first touch order across all the runs.
+  BlockVector startup_blocks_;
+  BlockSet startup_block_set_;
+
+  // @name Statistics about the last reordering.
+  // @{
+  size_t initial_fault_count_;
+  size_t final_fault_count_;
+  // @}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PageFaultOrderGenerator);
+};
+
+}  // namespace reorder
+
+#endif  // SYZYGY_REORDER_PAGE_FAULT_ORDER_GENERATOR_H_
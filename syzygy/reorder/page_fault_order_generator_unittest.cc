@@ -0,0 +1,167 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/reorder/page_fault_order_generator.h"
+
+#include <set>
+
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/reorder/order_generator_test.h"
+
+namespace reorder {
+
+namespace {
+
+typedef block_graph::BlockGraph BlockGraph;
+
+class TestPageFaultOrderGenerator : public PageFaultOrderGenerator {
+ public:
+  using PageFaultOrderGenerator::BlockVector;
+  using PageFaultOrderGenerator::OptimizeSection;
+  using PageFaultOrderGenerator::runs_;
+  using PageFaultOrderGenerator::startup_blocks_;
+};
+
+class PageFaultOrderGeneratorTest : public testing::OrderGeneratorTest {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    testing::OrderGeneratorTest::SetUp();
+
+    // Get the first few code blocks of the .text section.
+    size_t text_index = input_dll_.GetSectionIndex(".text");
+    const IMAGE_SECTION_HEADER* section =
+        input_dll_.section_header(text_index);
+    ASSERT_TRUE(section != NULL);
+
+    BlockGraph::AddressSpace::RangeMapConstIterPair section_blocks =
+        image_layout_.blocks.GetIntersectingBlocks(
+            core::RelativeAddress(section->VirtualAddress),
+            section->Misc.VirtualSize);
+    BlockGraph::AddressSpace::RangeMapConstIter it = section_blocks.first;
+    for (; it != section_blocks.second && code_blocks_.size() < 8; ++it) {
+      if (it->second->type() == BlockGraph::CODE_BLOCK)
+        code_blocks_.push_back(it->second);
+    }
+    ASSERT_EQ(8U, code_blocks_.size());
+  }
+
+  // Simulates the entry of the code blocks, in reverse address order.
+  void SimulateEntries() {
+    for (size_t i = code_blocks_.size(); i > 0; --i) {
+      const BlockGraph::Block* block = code_blocks_[i - 1];
+      ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+          block, block->addr(), 1, 1, GetSystemTime()));
+    }
+  }
+
+  std::vector<const BlockGraph::Block*> code_blocks_;
+  TestPageFaultOrderGenerator order_generator_;
+};
+
+}  // namespace
+
+TEST_F(PageFaultOrderGeneratorTest, DoNotReorder) {
+  ASSERT_NO_FATAL_FAILURE(SimulateEntries());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   false,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  for (size_t i = 0; i != order_.sections.size(); ++i) {
+    const IMAGE_SECTION_HEADER* section = input_dll_.section_header(i);
+    ExpectSameOrder(section, order_.sections[i].blocks);
+  }
+}
+
+TEST_F(PageFaultOrderGeneratorTest, StartupBlocksFirst) {
+  ASSERT_NO_FATAL_FAILURE(SimulateEntries());
+  EXPECT_TRUE(order_generator_.CalculateReordering(input_dll_,
+                                                   image_layout_,
+                                                   true,
+                                                   false,
+                                                   &order_));
+
+  ExpectNoDuplicateBlocks();
+
+  // The startup blocks come first.
+  size_t text_index = input_dll_.GetSectionIndex(".text");
+  const BlockSpecVector& specs = order_.sections[text_index].blocks;
+  ASSERT_LE(code_blocks_.size(), specs.size());
+  std::set<const BlockGraph::Block*> startup_blocks(code_blocks_.begin(),
+                                                    code_blocks_.end());
+  for (size_t i = 0; i < code_blocks_.size(); ++i)
+    EXPECT_EQ(1U, startup_blocks.count(specs[i].block));
+
+  // The search never makes things worse.
+  EXPECT_LE(order_generator_.final_fault_count(),
+            order_generator_.initial_fault_count());
+}
+
+TEST_F(PageFaultOrderGeneratorTest, StartupWindow) {
+  order_generator_.set_startup_window(base::TimeDelta::FromSeconds(1));
+
+  Reorderer::UniqueTime start(base::Time::Now());
+  Reorderer::UniqueTime late(start.time() + base::TimeDelta::FromSeconds(2));
+  ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+      code_blocks_[0], code_blocks_[0]->addr(), 1, 1, start));
+  ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+      code_blocks_[1], code_blocks_[1]->addr(), 1, 1, late));
+
+  // Only the block touched within the startup window is kept.
+  ASSERT_EQ(1U, order_generator_.startup_blocks_.size());
+  EXPECT_EQ(code_blocks_[0], order_generator_.startup_blocks_[0]);
+}
+
+TEST_F(PageFaultOrderGeneratorTest, OptimizeSection) {
+  // With 16-byte pages, the layout [a, b, c] puts a and c on different pages.
+  // Swapping a and b puts them on the same page.
+  BlockGraph block_graph;
+  BlockGraph::Block* a = block_graph.AddBlock(BlockGraph::CODE_BLOCK, 8, "a");
+  BlockGraph::Block* b = block_graph.AddBlock(BlockGraph::CODE_BLOCK, 16, "b");
+  BlockGraph::Block* c = block_graph.AddBlock(BlockGraph::CODE_BLOCK, 8, "c");
+
+  order_generator_.set_page_size(16);
+  order_generator_.set_pages_per_code_fault(1);
+
+  // A first startup touches a then c, a second one only touches b.
+  ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+      a, core::RelativeAddress(0), 1, 1, GetSystemTime()));
+  ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+      c, core::RelativeAddress(0), 1, 1, GetSystemTime()));
+  ASSERT_TRUE(order_generator_.OnCodeBlockEntry(
+      b, core::RelativeAddress(0), 2, 1, GetSystemTime()));
+  ASSERT_EQ(2U, order_generator_.runs_.size());
+
+  TestPageFaultOrderGenerator::BlockVector layout;
+  layout.push_back(a);
+  layout.push_back(b);
+  layout.push_back(c);
+
+  // Initially, each startup faults in 2 pages. Once optimized, each faults in
+  // a single page.
+  EXPECT_EQ(4U, order_generator_.OptimizeSection(core::RelativeAddress(0),
+                                                 &layout));
+  EXPECT_EQ(2U, order_generator_.final_fault_count());
+
+  ASSERT_EQ(3U, layout.size());
+  EXPECT_EQ(b, layout[0]);
+  EXPECT_EQ(a, layout[1]);
+  EXPECT_EQ(c, layout[2]);
+}
+
+}  // namespace reorder
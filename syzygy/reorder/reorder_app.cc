@@ -26,8 +26,11 @@
 #include "syzygy/grinder/indexed_frequency_data_serializer.h"
 #include "syzygy/pe/find.h"
 #include "syzygy/reorder/basic_block_optimizer.h"
+#include "syzygy/reorder/call_graph_order_generator.h"
+#include "syzygy/reorder/data_order_generator.h"
 #include "syzygy/reorder/dead_code_finder.h"
 #include "syzygy/reorder/linear_order_generator.h"
+#include "syzygy/reorder/page_fault_order_generator.h"
 #include "syzygy/reorder/random_order_generator.h"
 
 namespace reorder {
@@ -54,10 +57,25 @@ static const char kUsageFormatStr[] =
     "    --basic-block-entry-counts=PATH the path to the JSON file containing\n"
     "        the summary basic-block entry counts for the image. If this is\n"
     "        given then the input image is also required.\n"
+    "    --jobs=INT the number of threads used to optimize the basic-block\n"
+    "        layout. Default is the number of processors.\n"
     "    --seed=INT generates a random ordering; don't specify ETW log files.\n"
     "    --list-dead-code instead of an ordering, output the set of functions\n"
     "        not visited during the trace.\n"
+    "    --call-graph clusters the functions using the caller/callee affinity\n"
+    "        seen in the (profiler) traces rather than ordering them by first\n"
+    "        touch.\n"
+    "    --data-layout packs the data blocks referred to by the executed code\n"
+    "        together, keeping the written ones apart from the read-only\n"
+    "        ones.\n"
+    "    --page-fault-layout searches for the code layout minimizing the page\n"
+    "        faults simulated while replaying the traced startups.\n"
+    "    --startup-window=MS only considers the code first touched within MS\n"
+    "        milliseconds of the start of each process. Only accepted with\n"
+    "        --page-fault-layout. Default is the whole trace.\n"
     "    --pretty-print enables pretty printing of the JSON output file.\n"
+    "    --binary-output outputs a compact binary order file rather than a\n"
+    "        JSON one. It is faster to load, but isn't human-readable.\n"
     "    --reorderer-flags=<comma separated reorderer flags>\n"
     "  Reorderer Flags:\n"
     "    no-code: Do not reorder code sections.\n"
@@ -107,7 +125,12 @@ const char ReorderApp::kInputImage[] = "input-image";
 const char ReorderApp::kBasicBlockEntryCounts[] = "basic-block-entry-counts";
 const char ReorderApp::kSeed[] = "seed";
 const char ReorderApp::kListDeadCode[] = "list-dead-code";
+const char ReorderApp::kCallGraph[] = "call-graph";
+const char ReorderApp::kDataLayout[] = "data-layout";
+const char ReorderApp::kPageFaultLayout[] = "page-fault-layout";
+const char ReorderApp::kStartupWindow[] = "startup-window";
 const char ReorderApp::kPrettyPrint[] = "pretty-print";
+const char ReorderApp::kBinaryOutput[] = "binary-output";
 const char ReorderApp::kReordererFlags[] = "reorderer-flags";
 const char ReorderApp::kInstrumentedDll[] = "instrumented-dll";
 const char ReorderApp::kInputDll[] = "input-dll";
@@ -116,7 +139,10 @@ ReorderApp::ReorderApp()
     : AppImplBase("Reorder"),
       mode_(kInvalidMode),
       seed_(0),
+      startup_window_ms_(0),
+      jobs_(GetProcessorCount()),
       pretty_print_(false),
+      binary_output_(false),
       flags_(0) {
 }
 
@@ -158,9 +184,20 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
     return Usage(command_line, "Invalid reorderer flags");
   }
 
+  // Parse the number of jobs.
+  if (!ParseJobs(command_line, &jobs_))
+    return Usage(command_line, "Invalid number of jobs.");
+
   // Parse the pretty-print switch.
   pretty_print_ = command_line->HasSwitch(kPrettyPrint);
 
+  // Parse the binary-output switch.
+  binary_output_ = command_line->HasSwitch(kBinaryOutput);
+  if (pretty_print_ && binary_output_) {
+    return Usage(command_line,
+                 "Can't pretty-print a binary output file.");
+  }
+
   // Make all of the input paths absolute.
   input_image_path_ = AbsolutePath(input_image_path_);
   instrumented_image_path_ = AbsolutePath(instrumented_image_path_);
@@ -201,6 +238,52 @@ bool ReorderApp::ParseCommandLine(const CommandLine* command_line) {
     mode_ = kDeadCodeFinderMode;
   }
 
+  // Parse the call-graph switch.
+  if (command_line->HasSwitch(kCallGraph)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kCallGraph << " is mutually exclusive with --"
+                 << kSeed << "=N and --" << kListDeadCode << ".";
+      return false;
+    }
+    mode_ = kCallGraphOrderMode;
+  }
+
+  // Parse the data-layout switch.
+  if (command_line->HasSwitch(kDataLayout)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kDataLayout << " is mutually exclusive with --"
+                 << kSeed << "=N, --" << kListDeadCode << " and --"
+                 << kCallGraph << ".";
+      return false;
+    }
+    mode_ = kDataOrderMode;
+  }
+
+  // Parse the page-fault-layout switch.
+  if (command_line->HasSwitch(kPageFaultLayout)) {
+    if (mode_ != kInvalidMode) {
+      LOG(ERROR) << "--" << kPageFaultLayout << " is mutually exclusive with "
+                 << "--" << kSeed << "=N, --" << kListDeadCode << ", --"
+                 << kCallGraph << " and --" << kDataLayout << ".";
+      return false;
+    }
+    mode_ = kPageFaultOrderMode;
+  }
+
+  // Parse the startup-window switch.
+  if (command_line->HasSwitch(kStartupWindow)) {
+    if (mode_ != kPageFaultOrderMode) {
+      return Usage(command_line,
+                   "A startup window is only accepted in page fault layout "
+                   "mode.");
+    }
+    std::string window_str(command_line->GetSwitchValueASCII(kStartupWindow));
+    unsigned tmp_window = 0;
+    if (!base::StringToUint(window_str, &tmp_window))
+      return Usage(command_line, "Invalid startup window.");
+    startup_window_ms_ = tmp_window;
+  }
+
   // If we haven't found anything to over-ride the default mode (linear order),
   // then the default it is.
   if (mode_ == kInvalidMode)
@@ -244,6 +327,22 @@ bool ReorderApp::SetUp() {
     case kDeadCodeFinderMode:
       order_generator_.reset(new DeadCodeFinder());
       return true;
+
+    case kCallGraphOrderMode:
+      order_generator_.reset(new CallGraphOrderGenerator());
+      return true;
+
+    case kDataOrderMode:
+      order_generator_.reset(new DataOrderGenerator());
+      return true;
+
+    case kPageFaultOrderMode: {
+      PageFaultOrderGenerator* generator = new PageFaultOrderGenerator();
+      generator->set_startup_window(
+          base::TimeDelta::FromMilliseconds(startup_window_ms_));
+      order_generator_.reset(generator);
+      return true;
+    }
   }
 
   NOTREACHED();
@@ -279,8 +378,11 @@ int ReorderApp::Run() {
     }
   }
 
-  // Serialize the order to JSON.
-  if (!order.SerializeToJSON(input_image, output_file_path_, pretty_print_)) {
+  // Serialize the order.
+  bool serialized = binary_output_ ?
+      order.SerializeToBinary(input_image, output_file_path_) :
+      order.SerializeToJSON(input_image, output_file_path_, pretty_print_);
+  if (!serialized) {
     LOG(ERROR) << "Unable to output order.";
     return 1;
   }
@@ -330,6 +432,7 @@ bool ReorderApp::OptimizeBasicBlocks(const pe::PEFile::Signature& signature,
 
   // Optimize the ordering at the basic-block level.
   BasicBlockOptimizer optimizer;
+  optimizer.set_num_threads(jobs_);
   if (!optimizer.Optimize(image_layout, *entry_counts, order)) {
     LOG(ERROR) << "Failed to optimize basic-block ordering.";
     return false;
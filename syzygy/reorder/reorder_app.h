@@ -46,7 +46,10 @@ class ReorderApp : public application::AppImplBase {
     kInvalidMode,
     kLinearOrderMode,
     kRandomOrderMode,
-    kDeadCodeFinderMode
+    kDeadCodeFinderMode,
+    kCallGraphOrderMode,
+    kDataOrderMode,
+    kPageFaultOrderMode
   };
   // @name Utility members.
   // @{
@@ -68,7 +71,10 @@ class ReorderApp : public application::AppImplBase {
   base::FilePath bb_entry_count_file_path_;
   FilePathVector trace_file_paths_;
   uint32 seed_;
+  uint32 startup_window_ms_;
+  size_t jobs_;
   bool pretty_print_;
+  bool binary_output_;
   Reorderer::Flags flags_;
   // @}
 
@@ -80,7 +86,12 @@ class ReorderApp : public application::AppImplBase {
   static const char kBasicBlockEntryCounts[];
   static const char kSeed[];
   static const char kListDeadCode[];
+  static const char kCallGraph[];
+  static const char kDataLayout[];
+  static const char kPageFaultLayout[];
+  static const char kStartupWindow[];
   static const char kPrettyPrint[];
+  static const char kBinaryOutput[];
   static const char kReordererFlags[];
   static const char kInstrumentedDll[];
   static const char kInputDll[];
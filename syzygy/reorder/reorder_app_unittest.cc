@@ -44,6 +44,9 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kLinearOrderMode;
   using ReorderApp::kRandomOrderMode;
   using ReorderApp::kDeadCodeFinderMode;
+  using ReorderApp::kCallGraphOrderMode;
+  using ReorderApp::kDataOrderMode;
+  using ReorderApp::kPageFaultOrderMode;
   using ReorderApp::mode_;
   using ReorderApp::instrumented_image_path_;
   using ReorderApp::input_image_path_;
@@ -51,7 +54,10 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::bb_entry_count_file_path_;
   using ReorderApp::trace_file_paths_;
   using ReorderApp::seed_;
+  using ReorderApp::startup_window_ms_;
+  using ReorderApp::jobs_;
   using ReorderApp::pretty_print_;
+  using ReorderApp::binary_output_;
   using ReorderApp::flags_;
   using ReorderApp::kInstrumentedImage;
   using ReorderApp::kOutputFile;
@@ -59,7 +65,12 @@ class TestReorderApp : public ReorderApp {
   using ReorderApp::kBasicBlockEntryCounts;
   using ReorderApp::kSeed;
   using ReorderApp::kListDeadCode;
+  using ReorderApp::kCallGraph;
+  using ReorderApp::kDataLayout;
+  using ReorderApp::kPageFaultLayout;
+  using ReorderApp::kStartupWindow;
   using ReorderApp::kPrettyPrint;
+  using ReorderApp::kBinaryOutput;
   using ReorderApp::kReordererFlags;
   using ReorderApp::kInstrumentedDll;
   using ReorderApp::kInputDll;
@@ -187,6 +198,122 @@ TEST_F(ReorderAppTest, ParseWithSeedAndListDeadCodeFails) {
   ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(ReorderAppTest, ParseWithSeedAndCallGraphFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII(
+      TestReorderApp::kSeed, base::StringPrintf("%d", seed_));
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseCallGraphCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kCallGraphOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, ParseWithCallGraphAndDataLayoutFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kCallGraph);
+  cmd_line_.AppendSwitch(TestReorderApp::kDataLayout);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseDataLayoutCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kDataLayout);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kDataOrderMode, test_impl_.mode_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
+TEST_F(ReorderAppTest, ParseWithDataLayoutAndPageFaultLayoutFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kDataLayout);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaultLayout);
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithStartupWindowAndNoPageFaultLayoutFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kStartupWindow, "500");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseWithInvalidStartupWindowFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaultLayout);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kStartupWindow, "soon");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParseJobs) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII("jobs", "2");
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(2U, test_impl_.jobs_);
+}
+
+TEST_F(ReorderAppTest, ParseWithInvalidJobsFails) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitchASCII("jobs", "none");
+
+  ASSERT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ReorderAppTest, ParsePageFaultLayoutCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kPageFaultLayout);
+  cmd_line_.AppendSwitchASCII(TestReorderApp::kStartupWindow, "500");
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(TestReorderApp::kPageFaultOrderMode, test_impl_.mode_);
+  EXPECT_EQ(500U, test_impl_.startup_window_ms_);
+  EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
+
+  EXPECT_TRUE(test_impl_.SetUp());
+}
+
 TEST_F(ReorderAppTest, ParseWithEmptySeedFails) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -237,12 +364,29 @@ TEST_F(ReorderAppTest, ParseMinimalLinearOrderCommandLine) {
   EXPECT_EQ(abs_trace_file_path_, test_impl_.trace_file_paths_.front());
   EXPECT_EQ(0U, test_impl_.seed_);
   EXPECT_FALSE(test_impl_.pretty_print_);
+  EXPECT_FALSE(test_impl_.binary_output_);
   EXPECT_EQ(Reorderer::kFlagReorderCode | Reorderer::kFlagReorderData,
             test_impl_.flags_);
 
   EXPECT_TRUE(test_impl_.SetUp());
 }
 
+TEST_F(ReorderAppTest, ParseBinaryOutputCommandLine) {
+  cmd_line_.AppendSwitchPath(
+      TestReorderApp::kInstrumentedImage, instrumented_image_path_);
+  cmd_line_.AppendSwitchPath(TestReorderApp::kOutputFile, output_file_path_);
+  cmd_line_.AppendSwitch(TestReorderApp::kBinaryOutput);
+  cmd_line_.AppendArgPath(trace_file_path_);
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(test_impl_.binary_output_);
+  EXPECT_FALSE(test_impl_.pretty_print_);
+
+  // Binary output can't be pretty-printed.
+  cmd_line_.AppendSwitch(TestReorderApp::kPrettyPrint);
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(ReorderAppTest, ParseFullLinearOrderCommandLine) {
   cmd_line_.AppendSwitchPath(
       TestReorderApp::kInstrumentedImage, instrumented_image_path_);
@@ -16,12 +16,13 @@
 
 #include "base/file_util.h"
 #include "base/values.h"
-#include "base/json/json_reader.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/json/string_escape.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/common/defs.h"
+#include "syzygy/core/json_file_reader.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/core/serialization.h"
 #include "syzygy/pdb/omap.h"
@@ -34,6 +35,7 @@
 namespace reorder {
 
 using block_graph::BlockGraph;
+using core::JSONFileReader;
 using trace::parser::Parser;
 using base::ListValue;
 using base::DictionaryValue;
@@ -49,6 +51,10 @@ const char kSectionNameKey[] = "name";
 const char kSectionCharacteristicsKey[] = "characteristics";
 const char kBlocksKey[] = "blocks";
 
+// The magic value ("SORD") and version at the start of binary order files.
+const uint32 kBinaryOrderMagic = 0x44524F53;
+const uint32 kBinaryOrderVersion = 1;
+
 bool OutputTrailingBlockComment(const BlockGraph::Block* block,
                                 core::JSONFileWriter* json_file) {
   DCHECK(block != NULL);
@@ -172,6 +178,53 @@ bool OutputSectionSpec(const Reorderer::Order::SectionSpec& section_spec,
   return true;
 }
 
+// Resolves the block at @p address in @p image, and validates the
+// basic-block offsets already stored in @p block_spec against it.
+bool ResolveBlockSpec(const pe::ImageLayout& image,
+                      uint32 address,
+                      Reorderer::Order::BlockSpec* block_spec) {
+  DCHECK(block_spec != NULL);
+
+  block_spec->block = NULL;
+
+  // Resolve the referenced block.
+  core::RelativeAddress rva(address);
+  const BlockGraph::Block* block = image.blocks.GetBlockByAddress(rva);
+  if (block == NULL) {
+    LOG(ERROR) << "Block address not found in decomposed image: "
+                << address;
+    return false;
+  }
+
+  // Validate the basic_block offsets.
+  bool seen_end_block = false;
+  const Reorderer::Order::OffsetVector& offsets =
+      block_spec->basic_block_offsets;
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    BlockGraph::Offset offset = offsets[i];
+    if (offset < 0 ||
+        static_cast<BlockGraph::Size>(offset) > block->size()) {
+      LOG(ERROR) << "Offset " << offset << " falls outside block range [0-"
+                 << block->size() << "] for " << block->name();
+      return false;
+    }
+
+    // The basic-end block must be last in the block specification. The
+    // block builder will catch this error but we can meaningfully catch this
+    // earlier and avoid a lot of computation for nothing.
+    if (static_cast<BlockGraph::Size>(offset) == block->size()) {
+      seen_end_block = true;
+    } else if (seen_end_block) {
+      LOG(ERROR) << "Encountered basic-end block that is not last in the "
+                 << "specified ordering.";
+      return false;
+    }
+  }
+
+  block_spec->block = block;
+  return true;
+}
+
 bool LoadBlockSpec(const pe::ImageLayout& image,
                    const Value* block_value,
                    Reorderer::Order::BlockSpec* block_spec) {
@@ -197,56 +250,83 @@ bool LoadBlockSpec(const pe::ImageLayout& image,
     }
   }
 
-  // Resolve the referenced block.
-  core::RelativeAddress rva(address);
-  const BlockGraph::Block* block = image.blocks.GetBlockByAddress(rva);
-  if (block == NULL) {
-    LOG(ERROR) << "Block address not found in decomposed image: "
-                << address;
-    return false;
-  }
-
   // Read in the basic_block offsets.
-  bool seen_end_block = false;
   if (rva_list != NULL && !rva_list->empty()) {
     block_spec->basic_block_offsets.reserve(rva_list->GetSize());
     for (size_t i = 0; i < rva_list->GetSize(); ++i) {
       int offset = 0;
       if (!rva_list->GetInteger(i, &offset)) {
         LOG(ERROR) << "Unexpected value for basic-block offset #" << i
-                   << " of " << address << " [" << block->name() << "].";
+                   << " of block at " << address << ".";
         block_spec->basic_block_offsets.clear();
         return false;
       }
-      if (offset < 0 ||
-          static_cast<BlockGraph::Size>(offset) > block->size()) {
-        LOG(ERROR) << "Offset " << offset << " falls outside block range [0-"
-                   << block->size() << "] for " << block->name();
-        return false;
-      }
-
-      // The basic-end block must be last in the block specification. The
-      // block builder will catch this error but we can meaningfully catch this
-      // earlier and avoid a lot of computation for nothing.
-      if (static_cast<BlockGraph::Size>(offset) == block->size()) {
-        seen_end_block = true;
-      } else if (seen_end_block) {
-        LOG(ERROR) << "Encountered basic-end block that is not last in the "
-                   << "specified ordering.";
-        return false;
-      }
       block_spec->basic_block_offsets.push_back(offset);
     }
   }
 
-  block_spec->block = block;
+  return ResolveBlockSpec(image, address, block_spec);
+}
+
+// Reads and validates the header of a binary order file.
+bool LoadBinaryHeader(core::InArchive* in_archive, pe::Metadata* metadata) {
+  DCHECK(in_archive != NULL);
+  DCHECK(metadata != NULL);
+
+  uint32 magic = 0;
+  uint32 version = 0;
+  if (!in_archive->Load(&magic) || magic != kBinaryOrderMagic) {
+    LOG(ERROR) << "Not a binary order file.";
+    return false;
+  }
+  if (!in_archive->Load(&version) || version != kBinaryOrderVersion) {
+    LOG(ERROR) << "Unsupported binary order file version: " << version << ".";
+    return false;
+  }
+  if (!metadata->Load(in_archive)) {
+    LOG(ERROR) << "Unable to load " << kMetadataKey << " from order file.";
+    return false;
+  }
+
   return true;
 }
 
-bool LoadSectionSpec(const pe::ImageLayout& image,
-                     const DictionaryValue* section_value,
-                     Reorderer::Order::SectionSpec* section_spec,
-                     std::set<size_t>* seen_section_ids) {
+// Loads the block specifications of a section from |reader|, which must be
+// positioned on the opening of the list. The block specifications are read
+// one at a time.
+bool LoadBlockSpecs(const pe::ImageLayout& image,
+                    JSONFileReader* reader,
+                    Reorderer::Order::BlockSpecVector* blocks) {
+  DCHECK(reader != NULL);
+  DCHECK(blocks != NULL);
+
+  if (reader->token() != JSONFileReader::kOpenList) {
+    LOG(ERROR) << "Invalid or missing value for " << kBlocksKey << ".";
+    return false;
+  }
+
+  blocks->clear();
+  while (true) {
+    if (!reader->Next())
+      return false;
+    if (reader->token() == JSONFileReader::kCloseList)
+      return true;
+
+    scoped_ptr<Value> block_value;
+    if (!reader->ReadValue(&block_value))
+      return false;
+    blocks->push_back(Reorderer::Order::BlockSpec());
+    if (!LoadBlockSpec(image, block_value.get(), &blocks->back()))
+      return false;
+  }
+}
+
+// Loads the metadata of a section from |section_value|, which contains the
+// section dictionary without its list of blocks.
+bool LoadSectionMetadata(const pe::ImageLayout& image,
+                         const DictionaryValue* section_value,
+                         Reorderer::Order::SectionSpec* section_spec,
+                         std::set<size_t>* seen_section_ids) {
   DCHECK(section_value != NULL);
   DCHECK(section_spec != NULL);
   DCHECK(seen_section_ids != NULL);
@@ -255,7 +335,6 @@ bool LoadSectionSpec(const pe::ImageLayout& image,
   const std::string section_id_key(kSectionIdKey);
   const std::string section_name_key(kSectionNameKey);
   const std::string section_characteristics_key(kSectionCharacteristicsKey);
-  const std::string blocks_key(kBlocksKey);
 
   // Get the section id, if given.
   int tmp_section_id = Reorderer::Order::SectionSpec::kNewSectionId;
@@ -320,29 +399,54 @@ bool LoadSectionSpec(const pe::ImageLayout& image,
     section_spec->characteristics = tmp_characteristics;
   }
 
-  // Get the list of block specifications.
-  const ListValue* blocks = NULL;
-  if (!section_value->GetList(blocks_key, &blocks)) {
-    LOG(ERROR) << "Invalid or missing value for " << blocks_key << ".";
-    return false;
-  }
+  return true;
+}
 
-  if (!blocks->empty()) {
-    // Populate the block spec vector.
-    section_spec->blocks.resize(blocks->GetSize());
-    for (size_t block_idx = 0; block_idx != blocks->GetSize(); ++block_idx) {
-      const Value* block_value = NULL;
-      if (!blocks->Get(block_idx, &block_value)) {
-        LOG(ERROR) << "Failed to access item " << block_idx << ".";
-        return false;
-      }
+// Loads a section specification from |reader|, which must be positioned on
+// the opening of the section dictionary. The metadata values are small, and
+// are materialized, but the list of blocks is streamed.
+bool LoadSectionSpec(const pe::ImageLayout& image,
+                     JSONFileReader* reader,
+                     Reorderer::Order::SectionSpec* section_spec,
+                     std::set<size_t>* seen_section_ids) {
+  DCHECK(reader != NULL);
+  DCHECK(section_spec != NULL);
+  DCHECK(seen_section_ids != NULL);
+  DCHECK_EQ(JSONFileReader::kOpenDict, reader->token());
+
+  DictionaryValue section_value;
+  bool seen_blocks = false;
+  while (true) {
+    if (!reader->Next())
+      return false;
+    if (reader->token() == JSONFileReader::kCloseDict)
+      break;
+    DCHECK_EQ(JSONFileReader::kKey, reader->token());
 
-      if (!LoadBlockSpec(image, block_value, &section_spec->blocks[block_idx]))
+    std::string key(reader->string_value());
+    if (!reader->Next())
+      return false;
+
+    if (key == kBlocksKey) {
+      if (!LoadBlockSpecs(image, reader, &section_spec->blocks))
         return false;
+      seen_blocks = true;
+      continue;
     }
+
+    scoped_ptr<Value> value;
+    if (!reader->ReadValue(&value))
+      return false;
+    section_value.SetWithoutPathExpansion(key, value.release());
   }
 
-  return true;
+  if (!seen_blocks) {
+    LOG(ERROR) << "Invalid or missing value for " << kBlocksKey << ".";
+    return false;
+  }
+
+  return LoadSectionMetadata(image, &section_value, section_spec,
+                             seen_section_ids);
 }
 
 }  // namespace
@@ -356,6 +460,7 @@ Reorderer::Reorderer(const base::FilePath& module_path,
     : playback_(module_path, instrumented_path, trace_files),
       flags_(flags),
       code_block_entry_events_(0),
+      code_block_invocation_events_(0),
       order_generator_(NULL) {
 }
 
@@ -398,7 +503,7 @@ bool Reorderer::ReorderImpl(Order* order,
     if (!parser_.Consume())
       return false;
 
-    if (code_block_entry_events_ == 0) {
+    if (code_block_entry_events_ == 0 && code_block_invocation_events_ == 0) {
       LOG(ERROR) << "No events originated from the given instrumented DLL.";
       return false;
     }
@@ -498,6 +603,52 @@ void Reorderer::OnBatchFunctionEntry(base::Time time,
   }
 }
 
+void Reorderer::OnInvocationBatch(base::Time time,
+                                  DWORD process_id,
+                                  DWORD thread_id,
+                                  size_t num_invocations,
+                                  const TraceBatchInvocationInfo* data) {
+  DCHECK(data != NULL);
+
+  for (size_t i = 0; i < num_invocations; ++i) {
+    const InvocationInfo& info = data->invocations[i];
+
+    // Dynamic symbols can't be mapped back to blocks of the module.
+    if ((info.flags & (kCallerIsSymbol | kFunctionIsSymbol)) != 0)
+      continue;
+
+    bool error = false;
+    const BlockGraph::Block* callee = playback_.FindFunctionBlock(
+        process_id, info.function, &error);
+    if (error) {
+      LOG(ERROR) << "Playback::FindFunctionBlock failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+    if (callee == NULL)
+      continue;
+
+    // The caller is a return address, which may lie in a module that isn't
+    // known to the parser. This isn't an error, the edge is simply ignored.
+    const BlockGraph::Block* caller = playback_.FindFunctionBlock(
+        process_id, info.caller, &error);
+    if (error || caller == NULL)
+      continue;
+
+    ++code_block_invocation_events_;
+    if (!order_generator_->OnCodeBlockInvocation(caller,
+                                                 callee,
+                                                 process_id,
+                                                 thread_id,
+                                                 info.num_calls)) {
+      LOG(ERROR) << order_generator_->name()
+                 << "::OnCodeBlockInvocation failed.";
+      parser_.set_error_occurred(true);
+      return;
+    }
+  }
+}
+
 bool Reorderer::Order::SerializeToJSON(const PEFile& pe,
                                        const base::FilePath &path,
                                        bool pretty_print) const {
@@ -563,102 +714,344 @@ bool Reorderer::Order::SerializeToJSON(const PEFile& pe,
 bool Reorderer::Order::LoadFromJSON(const PEFile& pe,
                                     const ImageLayout& image,
                                     const base::FilePath& path) {
-  std::string file_string;
-  if (!base::ReadFileToString(path, &file_string)) {
-    LOG(ERROR) << "Unable to read order file to string";
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open order file.";
     return false;
   }
 
-  // Read in the JSON file. It should be a dictionary.
-  const DictionaryValue* outer_dict = NULL;
-  scoped_ptr<Value> value(base::JSONReader::Read(file_string));
-  if (value.get() == NULL || !value->GetAsDictionary(&outer_dict)) {
+  // The order file is streamed, so that the block specifications are never
+  // all materialized as base::Values. It should be a dictionary.
+  JSONFileReader reader(file.get());
+  if (!reader.Next() || reader.token() != JSONFileReader::kOpenDict) {
     LOG(ERROR) << "Order file does not contain a valid JSON dictionary.";
     return false;
   }
 
-  // Load the metadata from the order file, and ensure it is consistent with
-  // the signature of the module the ordering is being applied to.
-  pe::Metadata metadata;
   PEFile::Signature pe_sig;
   pe.GetSignature(&pe_sig);
-  const DictionaryValue* metadata_dict = NULL;
-  if (!outer_dict->GetDictionary(kMetadataKey, &metadata_dict) ||
-      !metadata.LoadFromJSON(*metadata_dict) ||
-      !metadata.IsConsistent(pe_sig)) {
+  bool seen_metadata = false;
+  bool seen_sections = false;
+  std::set<size_t> seen_section_ids;
+  sections.clear();
+
+  while (true) {
+    if (!reader.Next())
+      return false;
+    if (reader.token() == JSONFileReader::kCloseDict)
+      break;
+    DCHECK_EQ(JSONFileReader::kKey, reader.token());
+
+    std::string key(reader.string_value());
+    if (!reader.Next())
+      return false;
+
+    if (key == kMetadataKey) {
+      // Load the metadata from the order file, and ensure it is consistent
+      // with the signature of the module the ordering is being applied to.
+      scoped_ptr<Value> value;
+      const DictionaryValue* metadata_dict = NULL;
+      pe::Metadata metadata;
+      if (!reader.ReadValue(&value) ||
+          !value->GetAsDictionary(&metadata_dict) ||
+          !metadata.LoadFromJSON(*metadata_dict) ||
+          !metadata.IsConsistent(pe_sig)) {
+        LOG(ERROR) << "Missing, invalid, or inconsistent " << kMetadataKey
+                   << ".";
+        return false;
+      }
+      seen_metadata = true;
+    } else if (key == kCommentKey) {
+      // Load the comments field.
+      if (reader.token() != JSONFileReader::kString) {
+        LOG(ERROR) << "Invalid " << kCommentKey << " value. Must be a string.";
+        return false;
+      }
+      comment = reader.string_value();
+    } else if (key == kSectionsKey) {
+      if (reader.token() != JSONFileReader::kOpenList) {
+        LOG(ERROR) << "Missing or invalid " << kSectionsKey << ".";
+        return false;
+      }
+
+      // Iterate through the elements of the list. They should each be
+      // dictionaries representing a single section. We'll also track the
+      // sections descriptions we have already seen.
+      while (true) {
+        if (!reader.Next())
+          return false;
+        if (reader.token() == JSONFileReader::kCloseList)
+          break;
+        if (reader.token() != JSONFileReader::kOpenDict) {
+          LOG(ERROR) << "Item " << sections.size() << "of " << kSectionsKey
+                     << " list is not a dictionary.";
+          return false;
+        }
+
+        sections.push_back(SectionSpec());
+        if (!LoadSectionSpec(image, &reader, &sections.back(),
+                             &seen_section_ids)) {
+          return false;
+        }
+      }
+      seen_sections = true;
+    } else if (!reader.SkipValue()) {
+      return false;
+    }
+  }
+
+  if (!seen_metadata) {
     LOG(ERROR) << "Missing, invalid, or inconsistent " << kMetadataKey << ".";
     return false;
   }
+  if (!seen_sections) {
+    LOG(ERROR) << "Missing or invalid " << kSectionsKey << ".";
+    return false;
+  }
+
+  // Make sure that there's nothing following the dictionary.
+  if (!reader.Next())
+    return false;
+
+  return true;
+}
+
+bool Reorderer::Order::GetOriginalModulePath(const base::FilePath& path,
+                                             base::FilePath* module) {
+  if (IsBinaryOrderFile(path)) {
+    base::MemoryMappedFile mapped_file;
+    if (!mapped_file.Initialize(path)) {
+      LOG(ERROR) << "Unable to map order file.";
+      return false;
+    }
+
+    core::MemoryInStream in_stream(mapped_file.data(), mapped_file.length());
+    core::NativeBinaryInArchive in_archive(&in_stream);
+    pe::Metadata metadata;
+    if (!LoadBinaryHeader(&in_archive, &metadata))
+      return false;
+
+    *module = base::FilePath(metadata.module_signature().path);
+    return true;
+  }
 
-  // Load the comments field.
-  if (outer_dict->HasKey(kCommentKey) &&
-      !outer_dict->GetString(kCommentKey, &comment)) {
-    LOG(ERROR) << "Invalid " << kCommentKey << " value. Must be a string.";
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL) {
+    LOG(ERROR) << "Unable to open order file.";
     return false;
   }
 
-  // Grab the sections list.
-  const ListValue* order = NULL;
-  if (!outer_dict->GetList(kSectionsKey, &order)) {
-    LOG(ERROR) << "Missing or invalid " << kSectionsKey << ".";
+  // Only the metadata is needed, so the file is only read up to it.
+  JSONFileReader reader(file.get());
+  if (!reader.Next() || reader.token() != JSONFileReader::kOpenDict) {
+    LOG(ERROR) << "Order file does not contain a valid JSON dictionary.";
     return false;
   }
 
-  // Allocate the expected number of sections.
-  sections.clear();
+  while (true) {
+    if (!reader.Next())
+      return false;
+    if (reader.token() == JSONFileReader::kCloseDict)
+      break;
+    DCHECK_EQ(JSONFileReader::kKey, reader.token());
 
-  // Iterate through the elements of the list. They should each be dictionaries
-  // representing a single section. We'll also track the sections descriptions
-  // we have already seen.
-  std::set<size_t> seen_section_ids;
-  sections.resize(order->GetSize());
-  for (size_t index = 0; index < order->GetSize(); ++index) {
-    const DictionaryValue* section = NULL;
-    if (!order->GetDictionary(index, &section)) {
-      LOG(ERROR) << "Item " << index << "of " << kSectionsKey
-                 << " list is not a dictionary.";
+    std::string key(reader.string_value());
+    if (!reader.Next())
+      return false;
+    if (key != kMetadataKey) {
+      if (!reader.SkipValue())
+        return false;
+      continue;
+    }
+
+    scoped_ptr<Value> value;
+    const DictionaryValue* metadata_dict = NULL;
+    if (!reader.ReadValue(&value) || !value->GetAsDictionary(&metadata_dict)) {
+      LOG(ERROR) << "Order dictionary must contain 'metadata'.";
       return false;
     }
 
-    if (!LoadSectionSpec(image, section, &sections[index], &seen_section_ids))
+    pe::Metadata metadata;
+    if (!metadata.LoadFromJSON(*metadata_dict))
       return false;
+
+    *module = base::FilePath(metadata.module_signature().path);
+    return true;
   }
 
-  return true;
+  LOG(ERROR) << "Order dictionary must contain 'metadata'.";
+  return false;
 }
 
-bool Reorderer::Order::GetOriginalModulePath(const base::FilePath& path,
-                                             base::FilePath* module) {
-  std::string file_string;
-  if (!base::ReadFileToString(path, &file_string)) {
-    LOG(ERROR) << "Unable to read order file to string.";
+bool Reorderer::Order::SerializeToBinary(const PEFile& pe,
+                                         const base::FilePath& path) const {
+  PEFile::Signature orig_sig;
+  pe.GetSignature(&orig_sig);
+  pe::Metadata metadata;
+  if (!metadata.Init(orig_sig))
+    return false;
+
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  if (file.get() == NULL)
     return false;
+  core::FileOutStream out_stream(file.get());
+  core::NativeBinaryOutArchive out_archive(&out_stream);
+
+  // Like SerializeToJSON, empty sections are not output.
+  uint32 section_count = 0;
+  SectionSpecVector::const_iterator section_it = sections.begin();
+  for (; section_it != sections.end(); ++section_it) {
+    if (!section_it->blocks.empty())
+      ++section_count;
   }
 
-  scoped_ptr<Value> value(base::JSONReader::Read(file_string));
-  if (value.get() == NULL || value->GetType() != Value::TYPE_DICTIONARY) {
-    LOG(ERROR) << "Order file does not contain a valid JSON dictionary.";
+  if (!out_archive.Save(kBinaryOrderMagic) ||
+      !out_archive.Save(kBinaryOrderVersion) ||
+      !metadata.Save(&out_archive) ||
+      !out_archive.Save(comment) ||
+      !out_archive.Save(section_count)) {
     return false;
   }
-  const DictionaryValue* outer_dict =
-      reinterpret_cast<const DictionaryValue*>(value.get());
 
-  std::string metadata_key("metadata");
-  const DictionaryValue* metadata_dict = NULL;
-  if (!outer_dict->GetDictionary(metadata_key, &metadata_dict)) {
-    LOG(ERROR) << "Order dictionary must contain 'metadata'.";
+  // Each block is stored as its address followed by its basic-block offsets,
+  // which the archive writes in bulk.
+  for (section_it = sections.begin(); section_it != sections.end();
+       ++section_it) {
+    const SectionSpec& section_spec = *section_it;
+    if (section_spec.blocks.empty())
+      continue;
+
+    uint32 block_count = section_spec.blocks.size();
+    if (!out_archive.Save(section_spec.id) ||
+        !out_archive.Save(section_spec.name) ||
+        !out_archive.Save(section_spec.characteristics) ||
+        !out_archive.Save(block_count)) {
+      return false;
+    }
+
+    BlockSpecVector::const_iterator block_it = section_spec.blocks.begin();
+    for (; block_it != section_spec.blocks.end(); ++block_it) {
+      DCHECK(block_it->block != NULL);
+      uint32 address = block_it->block->addr().value();
+      if (!out_archive.Save(address) ||
+          !out_archive.Save(block_it->basic_block_offsets)) {
+        return false;
+      }
+    }
+  }
+
+  return out_archive.Flush();
+}
+
+bool Reorderer::Order::LoadFromBinary(const PEFile& pe,
+                                      const ImageLayout& image,
+                                      const base::FilePath& path) {
+  base::MemoryMappedFile mapped_file;
+  if (!mapped_file.Initialize(path)) {
+    LOG(ERROR) << "Unable to map order file.";
     return false;
   }
 
+  core::MemoryInStream in_stream(mapped_file.data(), mapped_file.length());
+  core::NativeBinaryInArchive in_archive(&in_stream);
+
   pe::Metadata metadata;
-  if (!metadata.LoadFromJSON(*metadata_dict))
+  if (!LoadBinaryHeader(&in_archive, &metadata))
     return false;
+  PEFile::Signature pe_sig;
+  pe.GetSignature(&pe_sig);
+  if (!metadata.IsConsistent(pe_sig)) {
+    LOG(ERROR) << "Inconsistent " << kMetadataKey << " in order file.";
+    return false;
+  }
+
+  uint32 section_count = 0;
+  if (!in_archive.Load(&comment) || !in_archive.Load(&section_count)) {
+    LOG(ERROR) << "Truncated order file.";
+    return false;
+  }
+
+  sections.clear();
+  std::set<size_t> seen_section_ids;
+  for (uint32 i = 0; i < section_count; ++i) {
+    sections.push_back(SectionSpec());
+    SectionSpec& section_spec = sections.back();
+
+    uint32 block_count = 0;
+    if (!in_archive.Load(&section_spec.id) ||
+        !in_archive.Load(&section_spec.name) ||
+        !in_archive.Load(&section_spec.characteristics) ||
+        !in_archive.Load(&block_count)) {
+      LOG(ERROR) << "Truncated order file.";
+      return false;
+    }
+
+    // The name and characteristics are always stored, so existing sections
+    // only need their id validated.
+    if (section_spec.id != SectionSpec::kNewSectionId) {
+      if (section_spec.id >= image.sections.size()) {
+        LOG(ERROR) << "Invalid section id: " << section_spec.id << ".";
+        return false;
+      }
+      if (!seen_section_ids.insert(section_spec.id).second) {
+        LOG(ERROR) << "Section ID " << section_spec.id << " redefined.";
+        return false;
+      }
+    }
+    if (section_spec.name.empty()) {
+      LOG(ERROR) << "Missing a value for the section name.";
+      return false;
+    }
 
-  *module = base::FilePath(metadata.module_signature().path);
+    // Every block takes several bytes, so this rejects corrupt counts before
+    // allocating for them.
+    if (block_count > in_stream.remaining()) {
+      LOG(ERROR) << "Truncated order file.";
+      return false;
+    }
+
+    section_spec.blocks.resize(block_count);
+    for (uint32 j = 0; j < block_count; ++j) {
+      BlockSpec& block_spec = section_spec.blocks[j];
+      uint32 address = 0;
+      if (!in_archive.Load(&address) ||
+          !in_archive.Load(&block_spec.basic_block_offsets)) {
+        LOG(ERROR) << "Truncated order file.";
+        return false;
+      }
+      if (!ResolveBlockSpec(image, address, &block_spec))
+        return false;
+    }
+  }
+
+  if (in_stream.remaining() != 0) {
+    LOG(ERROR) << "Unexpected data at the end of the order file.";
+    return false;
+  }
 
   return true;
 }
 
+bool Reorderer::Order::Load(const PEFile& pe,
+                            const ImageLayout& image,
+                            const base::FilePath& path) {
+  if (IsBinaryOrderFile(path))
+    return LoadFromBinary(pe, image, path);
+  return LoadFromJSON(pe, image, path);
+}
+
+bool Reorderer::Order::IsBinaryOrderFile(const base::FilePath& path) {
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  if (file.get() == NULL)
+    return false;
+
+  uint32 magic = 0;
+  if (::fread(&magic, sizeof(magic), 1, file.get()) != 1)
+    return false;
+
+  return magic == kBinaryOrderMagic;
+}
+
 Reorderer::UniqueTime::UniqueTime()
     : time_(),
       id_(0) {
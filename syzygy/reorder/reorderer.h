@@ -127,6 +127,11 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
                                     DWORD process_id,
                                     DWORD thread_id,
                                     const TraceBatchEnterData* data) OVERRIDE;
+  virtual void OnInvocationBatch(base::Time time,
+                                 DWORD process_id,
+                                 DWORD thread_id,
+                                 size_t num_invocations,
+                                 const TraceBatchInvocationInfo* data) OVERRIDE;
   // @}
 
   // A playback, which will decompose the image for us.
@@ -138,6 +143,9 @@ class Reorderer : public trace::parser::ParseEventHandlerImpl {
   // Number of CodeBlockEntry events processed.
   size_t code_block_entry_events_;
 
+  // Number of CodeBlockInvocation events processed.
+  size_t code_block_invocation_events_;
+
   // The following three variables are only valid while Reorder is executing.
   // A pointer to our order generator delegate.
   OrderGenerator* order_generator_;
@@ -282,6 +290,29 @@ struct Reorderer::Order {
                     const ImageLayout& image,
                     const base::FilePath& path);
 
+  // Serializes the order to a compact binary file. It holds the metadata
+  // of @p pe followed by the address and basic-block offsets of each block,
+  // and can be loaded without any parsing. Returns true on success, false
+  // otherwise.
+  bool SerializeToBinary(const PEFile& pe, const base::FilePath& path) const;
+
+  // Loads an ordering from a binary file written by SerializeToBinary. The
+  // file is memory-mapped and read in a single pass.
+  // @note @p pe and @p image must already be populated prior to calling this.
+  bool LoadFromBinary(const PEFile& pe,
+                      const ImageLayout& image,
+                      const base::FilePath& path);
+
+  // Loads an ordering from either a binary or a JSON file, depending on the
+  // contents of the file.
+  // @note @p pe and @p image must already be populated prior to calling this.
+  bool Load(const PEFile& pe,
+            const ImageLayout& image,
+            const base::FilePath& path);
+
+  // @returns true if @p path is a binary order file.
+  static bool IsBinaryOrderFile(const base::FilePath& path);
+
   // Extracts the name of the original module from an order file. This is
   // used to guess the value of --input-image.
   static bool GetOriginalModulePath(const base::FilePath& path,
@@ -332,6 +363,18 @@ class Reorderer::OrderGenerator {
                                 uint32 thread_id,
                                 const UniqueTime& time) = 0;
 
+  // The derived class may implement this callback, which receives the
+  // caller/callee pairs aggregated in TRACE_BATCH_INVOCATION events (as
+  // produced by the profiler) for the module that is being reordered. Only
+  // pairs where both the caller and the callee belong to the module are
+  // reported. Returns true on success, false on error. If this returns false,
+  // no further callbacks will be processed.
+  virtual bool OnCodeBlockInvocation(const BlockGraph::Block* caller,
+                                     const BlockGraph::Block* callee,
+                                     uint32 process_id,
+                                     uint32 thread_id,
+                                     size_t num_calls) { return true; }
+
   // The derived class shall implement this function, which actually produces
   // the reordering. When this is called, the callee can be assured that the
   // ImageLayout is populated and all traces have been parsed. This must
@@ -544,6 +544,24 @@ TEST(OrderTest, SerializeToJsonRoundTrip) {
 
   // Expect them to be the same.
   EXPECT_TRUE(OrdersAreEqual(order, order2));
+  EXPECT_FALSE(Reorderer::Order::IsBinaryOrderFile(temp_file));
+
+  // Do the same with the binary format.
+  EXPECT_TRUE(order.SerializeToBinary(pe_file, temp_file));
+  EXPECT_TRUE(Reorderer::Order::IsBinaryOrderFile(temp_file));
+  orig_module.clear();
+  EXPECT_TRUE(Reorderer::Order::GetOriginalModulePath(temp_file, &orig_module));
+  EXPECT_EQ(module, orig_module);
+
+  Reorderer::Order order3;
+  EXPECT_FALSE(OrdersAreEqual(order, order3));
+  EXPECT_TRUE(order3.LoadFromBinary(pe_file, layout, temp_file));
+  EXPECT_TRUE(OrdersAreEqual(order, order3));
+
+  // Load dispatches on the format of the file.
+  Reorderer::Order order4;
+  EXPECT_TRUE(order4.Load(pe_file, layout, temp_file));
+  EXPECT_TRUE(OrdersAreEqual(order, order4));
 
   EXPECT_TRUE(base::DeleteFile(temp_file, false));
 }
@@ -169,6 +169,35 @@ void SampledModuleCache::RemoveDeadModules() {
   }
 }
 
+size_t SampledModuleCache::RebucketHotModules(uint64 hot_sample_count,
+                                             size_t log2_bucket_size) {
+  DCHECK_LE(2u, log2_bucket_size);
+  DCHECK_GT(log2_bucket_size_, log2_bucket_size);
+
+  size_t rebucketed = 0;
+  ProcessMap::iterator proc_it = processes_.begin();
+  for (; proc_it != processes_.end(); ++proc_it) {
+    Process::ModuleMap& modules = proc_it->second->modules();
+    Process::ModuleMap::iterator mod_it = modules.begin();
+    for (; mod_it != modules.end(); ++mod_it) {
+      Module* module = mod_it->second;
+      DCHECK(module != NULL);
+
+      // Skip modules that are already fine enough, or that aren't hot.
+      if (module->log2_bucket_size() <= log2_bucket_size)
+        continue;
+      if (module->GetSampleCount() < hot_sample_count)
+        continue;
+
+      if (!module->Rebucket(log2_bucket_size, dead_module_callback_))
+        continue;
+      ++rebucketed;
+    }
+  }
+
+  return rebucketed;
+}
+
 SampledModuleCache::Process::Process(HANDLE process, DWORD pid)
     : process_(process), pid_(pid), alive_(true) {
   DCHECK(process != INVALID_HANDLE_VALUE);
@@ -247,8 +276,10 @@ void SampledModuleCache::Process::RemoveDeadModules(
     ++mod_it_next;
 
     if (!mod_it->second->alive()) {
-      // Stop profiling.
-      mod_it->second->Stop();
+      // Stop profiling. The profiler of a module that failed to restart after
+      // being re-bucketed is already stopped.
+      if (mod_it->second->profiler().is_started())
+        mod_it->second->Stop();
 
       // Return the results to the callback if one has been provided.
       if (!callback.is_null())
@@ -277,6 +308,7 @@ SampledModuleCache::Module::Module(Process* process,
       log2_bucket_size_(log2_bucket_size),
       profiling_start_time_(0),
       profiling_stop_time_(0),
+      profiler_(new SamplingProfiler()),
       alive_(true) {
   DCHECK(process != NULL);
   DCHECK(module_ != INVALID_HANDLE_VALUE);
@@ -380,7 +412,7 @@ bool SampledModuleCache::Module::Init() {
       reinterpret_cast<const char*>(module_) + text_end);
 
   // Initialize the profiler.
-  if (!profiler_.Initialize(process_->process(),
+  if (!profiler_->Initialize(process_->process(),
                             const_cast<void*>(buckets_begin_),
                             text_end - text_begin,
                             log2_bucket_size_)) {
@@ -391,23 +423,63 @@ bool SampledModuleCache::Module::Init() {
                << " of process " << process_->pid() << ".";
     return false;
   }
-  DCHECK_EQ(bucket_count, profiler_.buckets().size());
+  DCHECK_EQ(bucket_count, profiler_->buckets().size());
 
   return true;
 }
 
+uint64 SampledModuleCache::Module::GetSampleCount() const {
+  uint64 sample_count = 0;
+  const std::vector<ULONG>& buckets = profiler_->buckets();
+  for (size_t i = 0; i < buckets.size(); ++i)
+    sample_count += buckets[i];
+  return sample_count;
+}
+
 bool SampledModuleCache::Module::Start() {
-  if (!profiler_.Start())
+  if (!profiler_->Start())
     return false;
   profiling_start_time_ = trace::common::GetTsc();
   return true;
 }
 
 bool SampledModuleCache::Module::Stop() {
-  if (!profiler_.Stop())
+  if (!profiler_->Stop())
     return false;
   profiling_stop_time_ = trace::common::GetTsc();
   return true;
 }
 
+bool SampledModuleCache::Module::Rebucket(size_t log2_bucket_size,
+                                          const DeadModuleCallback& callback) {
+  DCHECK_LE(2u, log2_bucket_size);
+  DCHECK_GT(log2_bucket_size_, log2_bucket_size);
+  DCHECK(profiler_->is_started());
+
+  // The bucket range is aligned to the current bucket size, and thus to the
+  // finer one as well. Keeping it unchanged means that all of the sample data
+  // of this module has the same bucket start, as the grinder expects.
+  scoped_ptr<SamplingProfiler> profiler(new SamplingProfiler());
+  if (!profiler->Initialize(process_->process(),
+                            const_cast<void*>(buckets_begin_),
+                            reinterpret_cast<const char*>(buckets_end_) -
+                                reinterpret_cast<const char*>(buckets_begin_),
+                            log2_bucket_size)) {
+    LOG(ERROR) << "Failed to initialize fine profiler for module \""
+               << module_path_.value() << "\" of process " << process_->pid()
+               << ".";
+    return false;
+  }
+
+  // Hand off the coarse samples.
+  if (!Stop())
+    return false;
+  if (!callback.is_null())
+    callback.Run(this);
+
+  profiler_.swap(profiler);
+  log2_bucket_size_ = log2_bucket_size;
+  return Start();
+}
+
 }  // namespace sampler
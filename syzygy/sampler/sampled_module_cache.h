@@ -45,6 +45,11 @@
 //   // Clean up any modules that haven't been added (or re-added and marked as
 //   // alive). This invokes our callback with the gathered profile data.
 //   cache.RemoveDeadModules();
+//
+//   // Optionally, switch the modules that turned out to be hot to a finer
+//   // bucket size. This also invokes our callback with the coarse profile
+//   // data gathered so far.
+//   cache.RebucketHotModules(hot_sample_count, log2_fine_bucket_size);
 // }
 
 #ifndef SYZYGY_SAMPLER_SAMPLED_MODULE_CACHE_H_
@@ -55,6 +60,7 @@
 #include "base/basictypes.h"
 #include "base/callback.h"
 #include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/application/application.h"
 #include "syzygy/sampler/sampling_profiler.h"
@@ -78,7 +84,8 @@ class SampledModuleCache {
 
   // This is the callback that is used to indicate that a module has been
   // unloaded and/or we have stopped profiling it (from our point of view, it is
-  // dead). It is up to the callback to deal with the sample data.
+  // dead). It is up to the callback to deal with the sample data. This is also
+  // invoked with the coarse sample data of a module that is being re-bucketed.
   typedef base::Callback<void(const Module* module)> DeadModuleCallback;
 
   // Constructor.
@@ -133,6 +140,20 @@ class SampledModuleCache {
   // module the dead module callback will be invoked, if set.
   void RemoveDeadModules();
 
+  // Switches the modules that have gathered enough samples to a finer bucket
+  // size. This allows profiling hot modules at a fine granularity, without
+  // paying the memory cost of fine buckets for every module. The samples
+  // gathered so far by a re-bucketed module are handed to the dead module
+  // callback, if set, and the module is then profiled afresh. Modules for
+  // which a finer profiler can't be created simply keep being profiled at
+  // their current bucket size.
+  // @param hot_sample_count The number of samples from which a module is
+  //     considered hot.
+  // @param log2_bucket_size The number of bits in the finer bucket size. This
+  //     must be smaller than the bucket size of the cache.
+  // @returns the number of modules that were re-bucketed.
+  size_t RebucketHotModules(uint64 hot_sample_count, size_t log2_bucket_size);
+
   // @returns the total number of modules currently being profiled across all
   // processes.
   size_t module_count() const { return module_count_; }
@@ -274,10 +295,13 @@ class SampledModuleCache::Module {
   size_t log2_bucket_size() const { return log2_bucket_size_; }
   uint64 profiling_start_time() const { return profiling_start_time_; }
   uint64 profiling_stop_time() const { return profiling_stop_time_; }
-  SamplingProfiler& profiler() { return profiler_; }
-  const SamplingProfiler& profiler() const { return profiler_; }
+  SamplingProfiler& profiler() { return *profiler_; }
+  const SamplingProfiler& profiler() const { return *profiler_; }
   // @}
 
+  // @returns the number of samples gathered so far by the profiler.
+  uint64 GetSampleCount() const;
+
  protected:
   friend class SampledModuleCache;
 
@@ -302,6 +326,15 @@ class SampledModuleCache::Module {
   // @returns true on success, false otherwise.
   bool Stop();
 
+  // Restarts profiling this module with a finer bucket size. The new profiler
+  // is created before the current one is stopped, so that a failure leaves
+  // the module being profiled as before.
+  // @param log2_bucket_size The number of bits in the finer bucket size.
+  // @param callback The callback to be invoked with the samples gathered at
+  //     the current bucket size, once they're final. May be empty.
+  // @returns true on success, false otherwise.
+  bool Rebucket(size_t log2_bucket_size, const DeadModuleCallback& callback);
+
  private:
   friend class SampledModuleCacheTest;  // Testing seam.
 
@@ -334,8 +367,9 @@ class SampledModuleCache::Module {
   uint64 profiling_start_time_;
   uint64 profiling_stop_time_;
 
-  // The sampling profiler instance that is profiling this module.
-  SamplingProfiler profiler_;
+  // The sampling profiler instance that is profiling this module. This is
+  // replaced when the module is re-bucketed.
+  scoped_ptr<SamplingProfiler> profiler_;
 
   // This is used for cleaning up no longer loaded modules using a mark and
   // sweep technique.
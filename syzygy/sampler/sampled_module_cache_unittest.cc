@@ -141,4 +141,51 @@ TEST_F(SampledModuleCacheTest, EndToEnd) {
   EXPECT_EQ(0u, cache.module_count());
 }
 
+TEST_F(SampledModuleCacheTest, RebucketHotModules) {
+  SampledModuleCache cache(12);
+  cache.set_dead_module_callback(dead_module_callback);
+
+  static const DWORD kAccess =
+      PROCESS_DUP_HANDLE | PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  base::win::ScopedHandle proc(
+      ::OpenProcess(kAccess, FALSE, ::GetCurrentProcessId()));
+  ASSERT_TRUE(proc.IsValid());
+
+  SampledModuleCache::ProfilingStatus status =
+      SampledModuleCache::kProfilingStarted;
+  const SampledModuleCache::Module* module = NULL;
+  EXPECT_TRUE(cache.AddModule(proc.Get(), ::GetModuleHandle(NULL), &status,
+                              &module));
+  ASSERT_TRUE(module != NULL);
+  EXPECT_EQ(12u, module->log2_bucket_size());
+  const void* buckets_begin = module->buckets_begin();
+  const void* buckets_end = module->buckets_end();
+
+  // No module is this hot, so nothing happens.
+  EXPECT_EQ(0u, cache.RebucketHotModules(kuint64max, 2));
+  EXPECT_EQ(12u, module->log2_bucket_size());
+
+  // With no threshold the module is re-bucketed, and its coarse samples are
+  // handed to the callback. The bucket range is unchanged.
+  EXPECT_CALL(mock, OnDeadModule(module)).Times(1);
+  EXPECT_EQ(1u, cache.RebucketHotModules(0, 2));
+  EXPECT_EQ(2u, module->log2_bucket_size());
+  EXPECT_EQ(buckets_begin, module->buckets_begin());
+  EXPECT_EQ(buckets_end, module->buckets_end());
+  EXPECT_TRUE(module->profiler().is_started());
+  EXPECT_EQ(
+      (reinterpret_cast<const char*>(buckets_end) -
+           reinterpret_cast<const char*>(buckets_begin)) / 4,
+      module->profiler().buckets().size());
+  EXPECT_EQ(1u, cache.module_count());
+
+  // The module is already fine enough.
+  EXPECT_EQ(0u, cache.RebucketHotModules(0, 2));
+
+  EXPECT_CALL(mock, OnDeadModule(module)).Times(1);
+  cache.MarkAllModulesDead();
+  cache.RemoveDeadModules();
+  EXPECT_EQ(0u, cache.module_count());
+}
+
 }  // namespace sampler
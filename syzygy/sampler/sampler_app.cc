@@ -51,6 +51,17 @@ const char kUsageFormatStr[] =
     "                        the list is a whitelist.\n"
     "  --bucket-size=POSINT  Specifies the bucket size. This must be a power\n"
     "                        of two, and must be >= 4. Defaults to 4.\n"
+    "  --fine-bucket-size=POSINT\n"
+    "                        Enables adaptive bucket sizes. Modules are\n"
+    "                        first profiled with --bucket-size, and those\n"
+    "                        that gather --hot-sample-count samples are\n"
+    "                        then profiled with this finer bucket size. This\n"
+    "                        must be a power of two, >= 4 and smaller than\n"
+    "                        --bucket-size.\n"
+    "  --hot-sample-count=POSINT\n"
+    "                        The number of samples from which a module is\n"
+    "                        considered hot, with --fine-bucket-size.\n"
+    "                        Defaults to 1000.\n"
     "  --output-dir=DIR      The path to write trace-files. Will be created\n"
     "                        if it doesn't exist. Defaults to the current\n"
     "                        working directory.\n"
@@ -70,27 +81,30 @@ const char kUsageFormatStr[] =
     "                        files will be written.\n"
     "\n";
 
-// Parses the bucket size. Leaves the value unchanged if it is not specified.
+// Parses the bucket size given by the switch @p name. Leaves the value
+// unchanged if it is not specified.
 bool ParseBucketSize(const CommandLine* command_line,
+                     const char* name,
                      size_t* log2_bucket_size) {
   DCHECK(command_line != NULL);
+  DCHECK(name != NULL);
   DCHECK(log2_bucket_size != NULL);
 
-  if (!command_line->HasSwitch(SamplerApp::kBucketSize))
+  if (!command_line->HasSwitch(name))
     return true;
 
-  std::string s = command_line->GetSwitchValueASCII(SamplerApp::kBucketSize);
+  std::string s = command_line->GetSwitchValueASCII(name);
   size_t bucket_size = 0;
   if (!base::StringToSizeT(s, &bucket_size)) {
-    LOG(ERROR) << "--" << SamplerApp::kBucketSize << " must be an integer.";
+    LOG(ERROR) << "--" << name << " must be an integer.";
     return false;
   }
   if (!common::IsPowerOfTwo(bucket_size)) {
-    LOG(ERROR) << "--" << SamplerApp::kBucketSize << " must be a power of 2.";
+    LOG(ERROR) << "--" << name << " must be a power of 2.";
     return false;
   }
   if (bucket_size < 4) {
-    LOG(ERROR) << "--" << SamplerApp::kBucketSize << " must be >= 4.";
+    LOG(ERROR) << "--" << name << " must be >= 4.";
     return false;
   }
 
@@ -104,6 +118,27 @@ bool ParseBucketSize(const CommandLine* command_line,
   return true;
 }
 
+// Parses the hot sample count. Leaves the value unchanged if it is not
+// specified.
+bool ParseHotSampleCount(const CommandLine* command_line,
+                         uint64* hot_sample_count) {
+  DCHECK(command_line != NULL);
+  DCHECK(hot_sample_count != NULL);
+
+  if (!command_line->HasSwitch(SamplerApp::kHotSampleCount))
+    return true;
+
+  std::string s = command_line->GetSwitchValueASCII(
+      SamplerApp::kHotSampleCount);
+  if (!base::StringToUint64(s, hot_sample_count) || *hot_sample_count == 0) {
+    LOG(ERROR) << "--" << SamplerApp::kHotSampleCount
+               << " must be a positive integer.";
+    return false;
+  }
+
+  return true;
+}
+
 // Parses the sampling interval. Leaves the value unchanged if it is not
 // specified.
 bool ParseSamplingInterval(const CommandLine* command_line,
@@ -572,11 +607,14 @@ bool WriteTraceSampleDataRecord(uint64 sampling_interval_in_cycles,
 
 const char SamplerApp::kBlacklistPids[] = "blacklist-pids";
 const char SamplerApp::kBucketSize[] = "bucket-size";
+const char SamplerApp::kFineBucketSize[] = "fine-bucket-size";
+const char SamplerApp::kHotSampleCount[] = "hot-sample-count";
 const char SamplerApp::kPids[] = "pids";
 const char SamplerApp::kSamplingInterval[] = "sampling-interval";
 const char SamplerApp::kOutputDir[] = "output-dir";
 
 const size_t SamplerApp::kDefaultLog2BucketSize = 2;
+const uint64 SamplerApp::kDefaultHotSampleCount = 1000;
 
 base::Lock SamplerApp::console_ctrl_lock_;
 SamplerApp* SamplerApp::console_ctrl_owner_ = NULL;
@@ -585,6 +623,8 @@ SamplerApp::SamplerApp()
     : application::AppImplBase("Sampler"),
       blacklist_pids_(true),
       log2_bucket_size_(kDefaultLog2BucketSize),
+      log2_fine_bucket_size_(0),
+      hot_sample_count_(kDefaultHotSampleCount),
       sampling_interval_(),
       running_(true),
       sampling_interval_in_cycles_(0) {
@@ -600,10 +640,18 @@ bool SamplerApp::ParseCommandLine(const CommandLine* command_line) {
     return PrintUsage(command_line->GetProgram(), "");
 
   // Parse the profiler parameters.
-  if (!ParseBucketSize(command_line, &log2_bucket_size_) ||
+  if (!ParseBucketSize(command_line, kBucketSize, &log2_bucket_size_) ||
+      !ParseBucketSize(command_line, kFineBucketSize,
+                       &log2_fine_bucket_size_) ||
+      !ParseHotSampleCount(command_line, &hot_sample_count_) ||
       !ParseSamplingInterval(command_line, &sampling_interval_)) {
     return PrintUsage(command_line->GetProgram(), "");
   }
+  if (log2_fine_bucket_size_ != 0 &&
+      log2_fine_bucket_size_ >= log2_bucket_size_) {
+    return PrintUsage(command_line->GetProgram(),
+                      "--fine-bucket-size must be smaller than --bucket-size.");
+  }
 
   // By default we set up an empty PID blacklist. This means that all PIDs
   // will be profiled.
@@ -760,6 +808,18 @@ int SamplerApp::RunImpl() {
     // and causes the profile information to be written to a trace file.
     cache.RemoveDeadModules();
 
+    // Profile the modules that have turned out to be hot at a finer
+    // granularity. Their coarse samples are written to a trace file.
+    if (log2_fine_bucket_size_ != 0) {
+      size_t rebucketed = cache.RebucketHotModules(hot_sample_count_,
+                                                   log2_fine_bucket_size_);
+      if (rebucketed != 0) {
+        LOG(INFO) << "Switched " << rebucketed << " hot module"
+                  << (rebucketed != 1 ? "s" : "") << " to a bucket size of "
+                  << (1 << log2_fine_bucket_size_) << ".";
+      }
+    }
+
     // Count the number of actively profiled modules and processes.
     size_t new_process_count = cache.processes().size();
     size_t new_module_count = cache.module_count();
@@ -844,6 +904,14 @@ void SamplerApp::OnDeadModule(const SampledModuleCache::Module* module) {
           process->process_info());
   base::FilePath trace_file_path = output_dir_.Append(basename);
 
+  // The names only have a resolution of a second, and the samples of a
+  // re-bucketed module are written in several times. Don't overwrite a trace
+  // file written earlier.
+  for (size_t i = 1; base::PathExists(trace_file_path); ++i) {
+    trace_file_path = output_dir_.Append(basename.InsertBeforeExtensionASCII(
+        base::StringPrintf("-%d", i)));
+  }
+
   LOG(INFO) << "Writing module samples to \"" << trace_file_path.value()
             << "\".";
 
@@ -45,6 +45,8 @@ class SamplerApp : public application::AppImplBase {
   // @{
   static const char kBlacklistPids[];
   static const char kBucketSize[];
+  static const char kFineBucketSize[];
+  static const char kHotSampleCount[];
   static const char kPids[];
   static const char kSamplingInterval[];
   static const char kOutputDir[];
@@ -53,6 +55,7 @@ class SamplerApp : public application::AppImplBase {
   // @name Default command-line values.
   // @{
   static const size_t kDefaultLog2BucketSize;
+  static const uint64 kDefaultHotSampleCount;
   // @}
 
   // These are exposed for use by anonymous helper functions.
@@ -116,6 +119,11 @@ class SamplerApp : public application::AppImplBase {
 
   // Sampling profiler parameters.
   size_t log2_bucket_size_;
+
+  // Adaptive bucket size parameters. Modules that gather hot_sample_count_
+  // samples are re-bucketed to log2_fine_bucket_size_, if it is not zero.
+  size_t log2_fine_bucket_size_;
+  uint64 hot_sample_count_;
   base::TimeDelta sampling_interval_;
 
   // The output directory where trace files will be written.
@@ -59,6 +59,8 @@ class TestSamplerApp : public SamplerApp {
   using SamplerApp::output_dir_;
   using SamplerApp::module_sigs_;
   using SamplerApp::log2_bucket_size_;
+  using SamplerApp::log2_fine_bucket_size_;
+  using SamplerApp::hot_sample_count_;
   using SamplerApp::sampling_interval_;
   using SamplerApp::running_;
 
@@ -305,6 +307,33 @@ TEST_F(SamplerAppTest, ParseValidBucketSizeMinimal) {
   EXPECT_TRUE(impl_.output_dir_.empty());
 }
 
+TEST_F(SamplerAppTest, ParseFineBucketSize) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kBucketSize, "4096");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFineBucketSize, "8");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kHotSampleCount, "50");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_TRUE(impl_.ParseCommandLine(&cmd_line_));
+
+  EXPECT_EQ(12u, impl_.log2_bucket_size_);
+  EXPECT_EQ(3u, impl_.log2_fine_bucket_size_);
+  EXPECT_EQ(50u, impl_.hot_sample_count_);
+}
+
+TEST_F(SamplerAppTest, ParseCoarseFineBucketSizeFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kBucketSize, "8");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFineBucketSize, "8");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(SamplerAppTest, ParseInvalidHotSampleCountFails) {
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kBucketSize, "4096");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kFineBucketSize, "8");
+  cmd_line_.AppendSwitchASCII(TestSamplerApp::kHotSampleCount, "0");
+  cmd_line_.AppendArgPath(test_dll_path);
+  ASSERT_FALSE(impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(SamplerAppTest, ParseTooSmallSamplingIntervalFails) {
   cmd_line_.AppendSwitchASCII(TestSamplerApp::kSamplingInterval, "1e-7");
   cmd_line_.AppendArgPath(test_dll_path);
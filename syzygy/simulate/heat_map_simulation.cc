@@ -15,15 +15,55 @@
 #include "syzygy/simulate/heat_map_simulation.h"
 
 #include <functional>
+#include <set>
+
+#include "base/file_util.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
 
 namespace simulate {
 
+namespace {
+
+const char kSummaryKey[] = "summary";
+const char kBaselineSummaryKey[] = "baseline_summary";
+const char kTimeSliceUsecsKey[] = "time_slice_usecs";
+const char kMemorySliceBytesKey[] = "memory_slice_bytes";
+const char kTimeSliceCountKey[] = "time_slice_count";
+const char kMemorySliceCountKey[] = "memory_slice_count";
+const char kMemorySlicesPerTimeSliceKey[] = "memory_slices_per_time_slice";
+
+bool OutputSummary(const char* key,
+                   const HeatMapSimulation::Summary& summary,
+                   core::JSONFileWriter* json_file) {
+  DCHECK(key != NULL);
+  DCHECK(json_file != NULL);
+
+  return json_file->OutputKey(key) &&
+      json_file->OpenDict() &&
+      json_file->OutputKey(kTimeSliceUsecsKey) &&
+      json_file->OutputInteger(summary.time_slice_usecs) &&
+      json_file->OutputKey(kMemorySliceBytesKey) &&
+      json_file->OutputInteger(summary.memory_slice_bytes) &&
+      json_file->OutputKey(kTimeSliceCountKey) &&
+      json_file->OutputInteger(summary.time_slice_count) &&
+      json_file->OutputKey(kMemorySliceCountKey) &&
+      json_file->OutputInteger(summary.memory_slice_count) &&
+      json_file->OutputKey(kMemorySlicesPerTimeSliceKey) &&
+      json_file->OutputDouble(summary.memory_slices_per_time_slice) &&
+      json_file->CloseDict();
+}
+
+}  // namespace
+
 HeatMapSimulation::HeatMapSimulation()
     : time_slice_usecs_(kDefaultTimeSliceSize),
       memory_slice_bytes_(kDefaultMemorySliceSize),
       max_time_slice_usecs_(0),
       max_memory_slice_bytes_(0),
-      output_individual_functions_(false) {
+      output_individual_functions_(false),
+      has_baseline_summary_(false) {
 }
 
 bool HeatMapSimulation::TimeSlice::PrintJSONFunctions(
@@ -69,12 +109,24 @@ bool HeatMapSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
 
   core::JSONFileWriter json_file(output, pretty_print);
 
+  Summary summary;
+  ComputeSummary(&summary);
+
   if (!json_file.OpenDict() ||
-      !json_file.OutputKey("time_slice_usecs") ||
+      !json_file.OutputKey(kTimeSliceUsecsKey) ||
       !json_file.OutputInteger(time_slice_usecs_) ||
-      !json_file.OutputKey("memory_slice_bytes") ||
+      !json_file.OutputKey(kMemorySliceBytesKey) ||
       !json_file.OutputInteger(memory_slice_bytes_) ||
-      !json_file.OutputKey("max_time_slice_usecs") ||
+      !OutputSummary(kSummaryKey, summary, &json_file)) {
+    return false;
+  }
+
+  if (has_baseline_summary_ &&
+      !OutputSummary(kBaselineSummaryKey, baseline_summary_, &json_file)) {
+    return false;
+  }
+
+  if (!json_file.OutputKey("max_time_slice_usecs") ||
       !json_file.OutputInteger(max_time_slice_usecs_) ||
       !json_file.OutputKey("max_memory_slice_bytes") ||
       !json_file.OutputInteger(max_memory_slice_bytes_) ||
@@ -140,52 +192,154 @@ void HeatMapSimulation::OnProcessStarted(base::Time time,
 
 void HeatMapSimulation::OnFunctionEntry(base::Time time,
                                         const Block* block) {
-  // Get the time when this function was called since the process start.
+  DCHECK(block != NULL);
+  AddCodeRange(GetTimeSlice(time), block->addr().value(), block->size(),
+               block->name(), 1);
+}
+
+void HeatMapSimulation::OnBasicBlockEntry(base::Time time,
+                                          const Block* block,
+                                          uint32 offset,
+                                          uint32 size,
+                                          uint32 count) {
+  DCHECK(block != NULL);
+  DCHECK_LE(offset + size, block->size());
+  if (size == 0 || count == 0)
+    return;
+  AddCodeRange(GetTimeSlice(time), block->addr().value() + offset, size,
+               block->name(), count);
+}
+
+HeatMapSimulation::TimeSliceId HeatMapSimulation::GetTimeSlice(
+    base::Time time) const {
+  // Get the time when this code was executed since the process start.
   time_t relative_time = (time - process_start_time_).InMicroseconds();
+  return relative_time / time_slice_usecs_;
+}
+
+void HeatMapSimulation::AddCodeRange(TimeSliceId time_slice,
+                                     uint32 start,
+                                     uint32 size,
+                                     const std::string& name,
+                                     uint32 count) {
+  DCHECK(memory_slice_bytes_ != 0);
 
   // Since we will insert to a map many TimeSlices with the same entry time,
-  // we can pass RegisterFunction a reference to the TimeSlice in the map.
-  // This way, RegisterFunction doesn't have to search for that position
-  // every time it gets called and the time complexity gets reduced
-  // in a logarithmic scale.
-  TimeSliceId time_slice = relative_time / time_slice_usecs_;
+  // we can keep a reference to the TimeSlice in the map. This way, we don't
+  // have to search for that position for every memory slice.
   TimeSlice& slice = time_memory_map_[time_slice];
 
   max_time_slice_usecs_ = std::max(max_time_slice_usecs_, time_slice);
 
-  DCHECK(block != NULL);
-  DCHECK(memory_slice_bytes_ != 0);
-  const uint32 block_start = block->addr().value();
-  const uint32 size = block->size();
-  const std::string& name = block->name();
-
-  const uint32 first_slice = block_start / memory_slice_bytes_;
-  const uint32 last_slice = (block_start + size - 1) / memory_slice_bytes_;
+  const uint32 first_slice = start / memory_slice_bytes_;
+  const uint32 last_slice = (start + size - 1) / memory_slice_bytes_;
   if (first_slice == last_slice) {
-    // This function fits in a single memory slice. Add it to our time slice.
-    slice.AddSlice(first_slice, name, size);
+    // This code fits in a single memory slice. Add it to our time slice.
+    AddToSlice(first_slice, name, size * count, &slice);
   } else {
-    // This function takes several memory slices. Add the first and last
-    // slices to our time slice only with the part of the slice they use,
-    // and then loop through the rest and add the whole slices.
+    // This code takes several memory slices. Add the first and last slices to
+    // our time slice only with the part of the slice they use, and then loop
+    // through the rest and add the whole slices.
     const uint32 leading_bytes =
-        memory_slice_bytes_ - block_start % memory_slice_bytes_;
+        memory_slice_bytes_ - start % memory_slice_bytes_;
 
     const uint32 trailing_bytes =
-        ((block_start + size - 1 + memory_slice_bytes_) %
+        ((start + size - 1 + memory_slice_bytes_) %
             memory_slice_bytes_) + 1;
 
-    slice.AddSlice(first_slice, name, leading_bytes);
-    slice.AddSlice(last_slice, name, trailing_bytes);
-
-    const uint32 kStartIndex = block_start / memory_slice_bytes_ + 1;
-    const uint32 kEndIndex = (block_start + size - 1) / memory_slice_bytes_;
+    AddToSlice(first_slice, name, leading_bytes * count, &slice);
+    AddToSlice(last_slice, name, trailing_bytes * count, &slice);
 
-    for (uint32 i = kStartIndex; i < kEndIndex; i++)
-      slice.AddSlice(i, name, memory_slice_bytes_);
+    for (uint32 i = first_slice + 1; i < last_slice; i++)
+      AddToSlice(i, name, memory_slice_bytes_ * count, &slice);
   }
 
   max_memory_slice_bytes_ = std::max(max_memory_slice_bytes_, last_slice);
 }
 
+void HeatMapSimulation::AddToSlice(MemorySliceId memory_slice,
+                                   const std::string& name,
+                                   uint32 num_bytes,
+                                   TimeSlice* slice) const {
+  DCHECK(slice != NULL);
+  if (output_individual_functions_)
+    slice->AddSlice(memory_slice, name, num_bytes);
+  else
+    slice->AddSlice(memory_slice, num_bytes);
+}
+
+void HeatMapSimulation::ComputeSummary(Summary* summary) const {
+  DCHECK(summary != NULL);
+
+  std::set<MemorySliceId> memory_slices;
+  size_t memory_slices_per_time_slice = 0;
+  TimeMemoryMap::const_iterator time_memory_iter = time_memory_map_.begin();
+  for (; time_memory_iter != time_memory_map_.end(); ++time_memory_iter) {
+    const TimeSlice::MemorySliceMap& slices = time_memory_iter->second.slices();
+    memory_slices_per_time_slice += slices.size();
+    TimeSlice::MemorySliceMap::const_iterator slices_iter = slices.begin();
+    for (; slices_iter != slices.end(); ++slices_iter)
+      memory_slices.insert(slices_iter->first);
+  }
+
+  summary->time_slice_usecs = time_slice_usecs_;
+  summary->memory_slice_bytes = memory_slice_bytes_;
+  summary->time_slice_count = time_memory_map_.size();
+  summary->memory_slice_count = memory_slices.size();
+  summary->memory_slices_per_time_slice = 0.0;
+  if (!time_memory_map_.empty()) {
+    summary->memory_slices_per_time_slice =
+        static_cast<double>(memory_slices_per_time_slice) /
+            time_memory_map_.size();
+  }
+}
+
+bool HeatMapSimulation::LoadSummaryFromJSON(const base::FilePath& path,
+                                            Summary* summary) {
+  DCHECK(summary != NULL);
+
+  std::string json_string;
+  if (!base::ReadFileToString(path, &json_string)) {
+    LOG(ERROR) << "Failed to read '" << path.value() << "'.";
+    return false;
+  }
+
+  base::JSONReader json_reader;
+  std::string error_msg;
+  scoped_ptr<base::Value> json_value(
+      json_reader.ReadAndReturnError(
+          json_string, base::JSON_ALLOW_TRAILING_COMMAS, NULL, &error_msg));
+  if (json_value.get() == NULL) {
+    LOG(ERROR) << "Failed to parse '" << path.value() << "' as JSON ("
+               << error_msg << ").";
+    return false;
+  }
+
+  const base::DictionaryValue* root = NULL;
+  const base::DictionaryValue* summary_dict = NULL;
+  int time_slice_usecs = 0;
+  int memory_slice_bytes = 0;
+  int time_slice_count = 0;
+  int memory_slice_count = 0;
+  double memory_slices_per_time_slice = 0.0;
+  if (!json_value->GetAsDictionary(&root) ||
+      !root->GetDictionary(kSummaryKey, &summary_dict) ||
+      !summary_dict->GetInteger(kTimeSliceUsecsKey, &time_slice_usecs) ||
+      !summary_dict->GetInteger(kMemorySliceBytesKey, &memory_slice_bytes) ||
+      !summary_dict->GetInteger(kTimeSliceCountKey, &time_slice_count) ||
+      !summary_dict->GetInteger(kMemorySliceCountKey, &memory_slice_count) ||
+      !summary_dict->GetDouble(kMemorySlicesPerTimeSliceKey,
+                               &memory_slices_per_time_slice)) {
+    LOG(ERROR) << "'" << path.value() << "' has no heat map summary.";
+    return false;
+  }
+
+  summary->time_slice_usecs = time_slice_usecs;
+  summary->memory_slice_bytes = memory_slice_bytes;
+  summary->time_slice_count = time_slice_count;
+  summary->memory_slice_count = memory_slice_count;
+  summary->memory_slices_per_time_slice = memory_slices_per_time_slice;
+  return true;
+}
+
 }  // namespace simulate
@@ -20,6 +20,7 @@
 
 #include <map>
 
+#include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/simulate/simulation_event_handler.h"
@@ -43,7 +44,15 @@ namespace simulate {
 // simulation.SerializeToJSON(file, pretty_print);
 //
 // If the time slice size or the memory slice size are not set, the default
-// values of 1 and 0x8000, respectively, are used.
+// values of 1 and 0x8000, respectively, are used. Cache-line sized memory
+// slices show the I-cache locality of the code rather than its page locality.
+//
+// Basic-block entry counts are added at the time they're reported, weighted
+// by the number of times each basic block was entered.
+//
+// The output includes a summary of the locality of the code, which can be
+// compared to the summary of another layout, given with
+// set_baseline_summary.
 class HeatMapSimulation : public SimulationEventHandler {
  public:
   class TimeSlice;
@@ -53,6 +62,27 @@ class HeatMapSimulation : public SimulationEventHandler {
   typedef std::map<TimeSliceId, TimeSlice> TimeMemoryMap;
   typedef uint32 MemorySliceId;
 
+  // A summary of the locality of the simulated code.
+  struct Summary {
+    Summary()
+        : time_slice_usecs(0),
+          memory_slice_bytes(0),
+          time_slice_count(0),
+          memory_slice_count(0),
+          memory_slices_per_time_slice(0.0) {
+    }
+
+    // The slice sizes the summary was computed with.
+    uint32 time_slice_usecs;
+    uint32 memory_slice_bytes;
+    // The number of time slices in which code was executed.
+    uint32 time_slice_count;
+    // The number of distinct memory slices executed over the whole run.
+    uint32 memory_slice_count;
+    // The mean number of distinct memory slices executed per time slice.
+    double memory_slices_per_time_slice;
+  };
+
   // The default time and memory slice sizes.
   static const uint32 kDefaultTimeSliceSize = 1;
   static const uint32 kDefaultMemorySliceSize = 0x8000;
@@ -92,8 +122,26 @@ class HeatMapSimulation : public SimulationEventHandler {
   void set_output_individual_functions(bool output_individual_functions) {
     output_individual_functions_ = output_individual_functions;
   }
+  // Set the summary of another layout, which SerializeToJSON outputs next to
+  // the summary of this one.
+  // @param baseline_summary The summary of the other layout.
+  void set_baseline_summary(const Summary& baseline_summary) {
+    baseline_summary_ = baseline_summary;
+    has_baseline_summary_ = true;
+  }
   // @}
 
+  // Computes the summary of the locality of the simulated code.
+  // @param summary Receives the summary.
+  void ComputeSummary(Summary* summary) const;
+
+  // Loads the summary from the output of a previous simulation.
+  // @param path The JSON file written by SerializeToJSON.
+  // @param summary Receives the summary.
+  // @returns true on success, false on failure.
+  static bool LoadSummaryFromJSON(const base::FilePath& path,
+                                  Summary* summary);
+
   // @name SimulationEventHandler implementation
   // @{
   // Sets the entry time of the trace file.
@@ -107,6 +155,18 @@ class HeatMapSimulation : public SimulationEventHandler {
   // @param size The size of the function.
   void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
 
+  // Adds a basic block to time_memory_map_, weighted by its entry count.
+  // @param time The time the entry count was reported.
+  // @param block The function block containing the basic block.
+  // @param offset The offset of the basic block in @p block.
+  // @param size The size of the basic block.
+  // @param count The number of times the basic block was entered.
+  void OnBasicBlockEntry(base::Time time,
+                         const Block* block,
+                         uint32 offset,
+                         uint32 size,
+                         uint32 count) OVERRIDE;
+
   // Serializes the data to JSON.
   // The serialization consists of a list containing a dictionary of each
   // timestamp, and the total number of memory slices used, during that
@@ -114,10 +174,26 @@ class HeatMapSimulation : public SimulationEventHandler {
   // separate memory slice, the number of times it was used, and a list
   // of all the used functions and the number of times they were used in that
   // memory slice in descending order. If output_individual_functions is true,
-  // then the list of function for each memory slice isn't printed. Example:
+  // then the list of function for each memory slice isn't printed. The
+  // summary of the simulation, and the baseline summary if any, are output
+  // first. Example:
   // {
   //   "time_slice_usecs": 1,
   //   "memory_slice_bytes": 32768,
+  //   "summary": {
+  //     "time_slice_usecs": 1,
+  //     "memory_slice_bytes": 32768,
+  //     "time_slice_count": 2,
+  //     "memory_slice_count": 3,
+  //     "memory_slices_per_time_slice": 1.5
+  //   },
+  //   "baseline_summary": {
+  //     "time_slice_usecs": 1,
+  //     "memory_slice_bytes": 32768,
+  //     "time_slice_count": 2,
+  //     "memory_slice_count": 4,
+  //     "memory_slices_per_time_slice": 2.5
+  //   },
   //   "time_slice_list": [
   //     {
   //       "timestamp": 31,
@@ -178,6 +254,24 @@ class HeatMapSimulation : public SimulationEventHandler {
   // @}
 
  protected:
+  // Adds @p size bytes of code at @p start to the memory slices of
+  // @p time_slice, weighted by @p count.
+  void AddCodeRange(TimeSliceId time_slice,
+                    uint32 start,
+                    uint32 size,
+                    const std::string& name,
+                    uint32 count);
+
+  // Adds @p num_bytes to @p memory_slice of @p slice, and to @p name if
+  // individual functions are output.
+  void AddToSlice(MemorySliceId memory_slice,
+                  const std::string& name,
+                  uint32 num_bytes,
+                  TimeSlice* slice) const;
+
+  // @returns the time slice of @p time, relative to the process start.
+  TimeSliceId GetTimeSlice(base::Time time) const;
+
   // The size of each time block on the heat map, in microseconds.
   uint32 time_slice_usecs_;
 
@@ -199,8 +293,14 @@ class HeatMapSimulation : public SimulationEventHandler {
 
   // If set to true, SerializeToJSON outputs information about each function
   // in each time/memory block. This gives more information and is useful
-  // for analysis, but may make the output files excessively big.
+  // for analysis, but may make the output files excessively big. Otherwise
+  // only the totals of the memory slices are kept, which keeps the memory
+  // usage down with small memory slices.
   bool output_individual_functions_;
+
+  // The summary of another layout, if any.
+  Summary baseline_summary_;
+  bool has_baseline_summary_;
 };
 
 // Stores the respective memory slices of a particular time slice in a map.
@@ -232,6 +332,15 @@ class HeatMapSimulation::TimeSlice {
     total_ += num_bytes;
   }
 
+  // Add a quantity of bytes to a memory slice to the counter, without
+  // keeping track of the function which uses it.
+  // @param slice The relative code block number.
+  // @param num_bytes The value to be added, in bytes.
+  void AddSlice(MemorySliceId slice, uint32 num_bytes) {
+    slices_[slice].total += num_bytes;
+    total_ += num_bytes;
+  }
+
   // @name Accessors.
   // @{
   const MemorySliceMap& slices() const { return slices_; }
@@ -17,6 +17,7 @@
 #include <map>
 #include <vector>
 
+#include "base/file_util.h"
 #include "syzygy/core/random_number_generator.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pdb/omap.h"
@@ -470,4 +471,92 @@ TEST_F(HeatMapSimulationTest, RandomInput) {
   }
 }
 
+TEST_F(HeatMapSimulationTest, BasicBlockEntryIsWeighted) {
+  simulation_->set_memory_slice_bytes(4);
+  simulation_->set_output_individual_functions(true);
+  simulation_->OnProcessStarted(time, 1);
+
+  // Bytes 3 to 6 of the image, entered 3 times.
+  simulation_->OnBasicBlockEntry(Time::FromTimeT(40), blocks_[8].block,
+                                 1, 4, 3);
+
+  ASSERT_EQ(1U, simulation_->time_memory_map().size());
+  HeatMapSimulation::TimeMemoryMap::const_iterator current_slice =
+      simulation_->time_memory_map().find(30000000);
+  ASSERT_NE(current_slice, simulation_->time_memory_map().end());
+  EXPECT_EQ(12U, current_slice->second.total());
+
+  TimeSlice::MemorySliceMap expected_slices;
+  expected_slices[0].total = 3;
+  expected_slices[0].functions["B"] = 3;
+  expected_slices[1].total = 9;
+  expected_slices[1].functions["B"] = 9;
+  ASSERT_EQ(expected_slices.size(), current_slice->second.slices().size());
+  EXPECT_TRUE(std::equal(current_slice->second.slices().begin(),
+                         current_slice->second.slices().end(),
+                         expected_slices.begin(),
+                         CompareMemorySlices<true>()));
+
+  EXPECT_EQ(30000000, simulation_->max_time_slice_usecs());
+  EXPECT_EQ(1, simulation_->max_memory_slice_bytes());
+}
+
+TEST_F(HeatMapSimulationTest, ComputeSummary) {
+  simulation_->set_memory_slice_bytes(4);
+  simulation_->OnProcessStarted(time, 1);
+  for (uint32 i = 0; i < arraysize(blocks_); i++) {
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                 blocks_[i].block);
+  }
+
+  HeatMapSimulation::Summary summary;
+  simulation_->ComputeSummary(&summary);
+  EXPECT_EQ(1U, summary.time_slice_usecs);
+  EXPECT_EQ(4U, summary.memory_slice_bytes);
+  EXPECT_EQ(2U, summary.time_slice_count);
+  EXPECT_EQ(4U, summary.memory_slice_count);
+  EXPECT_DOUBLE_EQ(3.0, summary.memory_slices_per_time_slice);
+}
+
+TEST_F(HeatMapSimulationTest, LoadSummaryFromJSON) {
+  simulation_->set_memory_slice_bytes(4);
+  simulation_->OnProcessStarted(time, 1);
+  for (uint32 i = 0; i < arraysize(blocks_); i++) {
+    simulation_->OnFunctionEntry(Time::FromTimeT(blocks_[i].time),
+                                 blocks_[i].block);
+  }
+
+  HeatMapSimulation::Summary baseline_summary;
+  baseline_summary.time_slice_usecs = 1;
+  baseline_summary.memory_slice_bytes = 4;
+  baseline_summary.time_slice_count = 2;
+  baseline_summary.memory_slice_count = 5;
+  baseline_summary.memory_slices_per_time_slice = 3.5;
+  simulation_->set_baseline_summary(baseline_summary);
+
+  base::FilePath temp_dir;
+  ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir));
+  base::FilePath path;
+  base::ScopedFILE temp_file(
+      base::CreateAndOpenTemporaryFileInDir(temp_dir, &path));
+  ASSERT_TRUE(temp_file.get() != NULL);
+  ASSERT_TRUE(simulation_->SerializeToJSON(temp_file.get(), true));
+  temp_file.reset();
+
+  // The summary of this simulation is read back, not the baseline one.
+  HeatMapSimulation::Summary expected_summary;
+  simulation_->ComputeSummary(&expected_summary);
+  HeatMapSimulation::Summary summary;
+  ASSERT_TRUE(HeatMapSimulation::LoadSummaryFromJSON(path, &summary));
+  EXPECT_EQ(expected_summary.time_slice_usecs, summary.time_slice_usecs);
+  EXPECT_EQ(expected_summary.memory_slice_bytes, summary.memory_slice_bytes);
+  EXPECT_EQ(expected_summary.time_slice_count, summary.time_slice_count);
+  EXPECT_EQ(expected_summary.memory_slice_count, summary.memory_slice_count);
+  EXPECT_DOUBLE_EQ(expected_summary.memory_slices_per_time_slice,
+                   summary.memory_slices_per_time_slice);
+
+  EXPECT_FALSE(HeatMapSimulation::LoadSummaryFromJSON(
+      temp_dir.Append(L"missing.json"), &summary));
+}
+
 }  // namespace simulate
@@ -0,0 +1,170 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/multi_simulation.h"
+
+#include <algorithm>
+
+#include "base/atomicops.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+
+namespace simulate {
+
+namespace {
+
+// Replays a batch of events into the simulations. Each worker repeatedly
+// grabs the next simulation that hasn't been fed the batch yet, so that the
+// simulations are spread evenly across the workers.
+class ReplayWorker : public base::DelegateSimpleThread::Delegate {
+ public:
+  ReplayWorker(const MultiSimulation::Events& events,
+               const MultiSimulation::Simulations& simulations,
+               base::subtle::Atomic32* next_simulation)
+      : events_(events),
+        simulations_(simulations),
+        next_simulation_(next_simulation) {
+    DCHECK(next_simulation != NULL);
+  }
+
+  virtual void Run() OVERRIDE {
+    while (true) {
+      size_t index = static_cast<size_t>(
+          base::subtle::NoBarrier_AtomicIncrement(next_simulation_, 1) - 1);
+      if (index >= simulations_.size())
+        return;
+      MultiSimulation::ReplayEvents(events_, simulations_[index]);
+    }
+  }
+
+ private:
+  const MultiSimulation::Events& events_;
+  const MultiSimulation::Simulations& simulations_;
+  base::subtle::Atomic32* next_simulation_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayWorker);
+};
+
+}  // namespace
+
+MultiSimulation::MultiSimulation(size_t num_threads)
+    : num_threads_(num_threads),
+      batch_size_(kDefaultBatchSize) {
+  DCHECK_LT(0U, num_threads);
+}
+
+void MultiSimulation::AddSimulation(SimulationEventHandler* simulation) {
+  DCHECK(simulation != NULL);
+  DCHECK(events_.empty());
+  simulations_.push_back(simulation);
+}
+
+void MultiSimulation::Flush() {
+  if (events_.empty())
+    return;
+
+  size_t num_threads = std::min(num_threads_, simulations_.size());
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < simulations_.size(); ++i)
+      ReplayEvents(events_, simulations_[i]);
+  } else {
+    base::subtle::Atomic32 next_simulation = 0;
+    ScopedVector<ReplayWorker> workers;
+    base::DelegateSimpleThreadPool pool("MultiSimulation", num_threads);
+    pool.Start();
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers.push_back(
+          new ReplayWorker(events_, simulations_, &next_simulation));
+      pool.AddWork(workers.back(), 1);
+    }
+    pool.JoinAll();
+  }
+
+  events_.clear();
+}
+
+void MultiSimulation::OnProcessStarted(base::Time time,
+                                       size_t default_page_size) {
+  Event event = { Event::kProcessStarted, time, default_page_size, NULL, 0, 0,
+                  0 };
+  events_.push_back(event);
+  if (events_.size() >= batch_size_)
+    Flush();
+}
+
+void MultiSimulation::OnFunctionEntry(base::Time time, const Block* block) {
+  DCHECK(block != NULL);
+  Event event = { Event::kFunctionEntry, time, 0, block, 0, 0, 0 };
+  events_.push_back(event);
+  if (events_.size() >= batch_size_)
+    Flush();
+}
+
+void MultiSimulation::OnBasicBlockEntry(base::Time time,
+                                        const Block* block,
+                                        uint32 offset,
+                                        uint32 size,
+                                        uint32 count) {
+  DCHECK(block != NULL);
+  Event event = { Event::kBasicBlockEntry, time, 0, block, offset, size,
+                  count };
+  events_.push_back(event);
+  if (events_.size() >= batch_size_)
+    Flush();
+}
+
+bool MultiSimulation::SerializeToJSON(FILE* output, bool pretty_print) {
+  DCHECK(output != NULL);
+
+  Flush();
+
+  if (::fputs(pretty_print ? "[\n" : "[", output) < 0)
+    return false;
+  for (size_t i = 0; i < simulations_.size(); ++i) {
+    if (i > 0 && ::fputs(pretty_print ? ",\n" : ",", output) < 0)
+      return false;
+    if (!simulations_[i]->SerializeToJSON(output, pretty_print))
+      return false;
+  }
+  if (::fputs(pretty_print ? "\n]\n" : "]", output) < 0)
+    return false;
+
+  return true;
+}
+
+void MultiSimulation::ReplayEvents(const Events& events,
+                                   SimulationEventHandler* simulation) {
+  DCHECK(simulation != NULL);
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    const Event& event = events[i];
+    switch (event.type) {
+      case Event::kProcessStarted:
+        simulation->OnProcessStarted(event.time, event.default_page_size);
+        break;
+      case Event::kFunctionEntry:
+        simulation->OnFunctionEntry(event.time, event.block);
+        break;
+      case Event::kBasicBlockEntry:
+        simulation->OnBasicBlockEntry(event.time, event.block, event.offset,
+                                      event.size, event.count);
+        break;
+      default:
+        NOTREACHED();
+        break;
+    }
+  }
+}
+
+}  // namespace simulate
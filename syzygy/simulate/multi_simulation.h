@@ -0,0 +1,147 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares MultiSimulation, a simulation that feeds the events of a single
+// trace pass to many simulations. This allows evaluating many candidate
+// layouts, or many simulation parameters, without parsing the traces once
+// per candidate.
+//
+// The events are buffered as they are decoded by the Simulator. Whenever the
+// buffer is full, and when the simulation is flushed, the buffered events are
+// replayed into each of the simulations, in parallel on worker threads. Each
+// simulation sees all of the events in order, on a single thread at a time, so
+// the simulations don't need to be thread-safe, but they must be independent
+// of each other.
+//
+// MultiSimulation multi_simulation(num_threads);
+// multi_simulation.AddSimulation(&simulation1);
+// multi_simulation.AddSimulation(&simulation2);
+// Simulator simulator(..., &multi_simulation);
+// simulator.ParseTraceFiles();
+// multi_simulation.Flush();
+// ... inspect simulation1 and simulation2 ...
+
+#ifndef SYZYGY_SIMULATE_MULTI_SIMULATION_H_
+#define SYZYGY_SIMULATE_MULTI_SIMULATION_H_
+
+#include <vector>
+
+#include "syzygy/simulate/simulation_event_handler.h"
+
+namespace simulate {
+
+class MultiSimulation : public SimulationEventHandler {
+ public:
+  typedef block_graph::BlockGraph::Block Block;
+
+  // A decoded event, as buffered until it is replayed.
+  struct Event;  // Forward declaration.
+  typedef std::vector<Event> Events;
+  typedef std::vector<SimulationEventHandler*> Simulations;
+
+  // The default number of events buffered before they are replayed.
+  static const size_t kDefaultBatchSize = 1 << 16;
+
+  // Constructs a new MultiSimulation instance.
+  // @param num_threads The number of worker threads replaying events. If this
+  //     is 1 then the events are replayed on the calling thread.
+  explicit MultiSimulation(size_t num_threads);
+
+  // Adds a simulation to be fed the events. This must be called before any
+  // event is received.
+  // @param simulation The simulation to be added. Ownership is not
+  //     transferred, and it must outlive this object.
+  void AddSimulation(SimulationEventHandler* simulation);
+
+  // Replays the buffered events into the simulations. This must be called
+  // once the trace files have been parsed, before inspecting the
+  // simulations. The blocks the events refer to must still be alive.
+  void Flush();
+
+  // @name Accessors.
+  // @{
+  const Simulations& simulations() const { return simulations_; }
+  size_t num_threads() const { return num_threads_; }
+  size_t batch_size() const { return batch_size_; }
+  // @}
+
+  // @name Mutators.
+  // @{
+  void set_batch_size(size_t batch_size) {
+    DCHECK_LT(0U, batch_size);
+    batch_size_ = batch_size;
+  }
+  // @}
+
+  // @name SimulationEventHandler implementation
+  // @{
+  virtual void OnProcessStarted(base::Time time,
+                                size_t default_page_size) OVERRIDE;
+  virtual void OnFunctionEntry(base::Time time, const Block* block) OVERRIDE;
+  virtual void OnBasicBlockEntry(base::Time time,
+                                 const Block* block,
+                                 uint32 offset,
+                                 uint32 size,
+                                 uint32 count) OVERRIDE;
+
+  // Flushes the buffered events, then serializes the simulations to a JSON
+  // list, in the order they were added.
+  virtual bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
+  // @}
+
+  // Replays @p events into @p simulation.
+  // @param events The events to be replayed.
+  // @param simulation The simulation to be fed.
+  static void ReplayEvents(const Events& events,
+                           SimulationEventHandler* simulation);
+
+ protected:
+  // The simulations being fed the events. These are not owned.
+  Simulations simulations_;
+
+  // The buffered events, not yet replayed.
+  Events events_;
+
+  // The number of worker threads replaying events.
+  size_t num_threads_;
+
+  // The number of events buffered before they are replayed.
+  size_t batch_size_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MultiSimulation);
+};
+
+struct MultiSimulation::Event {
+  enum Type {
+    kProcessStarted,
+    kFunctionEntry,
+    kBasicBlockEntry,
+  };
+
+  Type type;
+  base::Time time;
+  // Only valid for kProcessStarted events.
+  size_t default_page_size;
+  // Only valid for kFunctionEntry and kBasicBlockEntry events.
+  const Block* block;
+  // Only valid for kBasicBlockEntry events.
+  uint32 offset;
+  uint32 size;
+  uint32 count;
+};
+
+}  // namespace simulate
+
+#endif  // SYZYGY_SIMULATE_MULTI_SIMULATION_H_
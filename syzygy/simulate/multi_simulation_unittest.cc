@@ -0,0 +1,217 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/simulate/multi_simulation.h"
+
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_reader.h"
+#include "base/memory/scoped_vector.h"
+#include "base/values.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/simulate/page_fault_simulation.h"
+
+namespace simulate {
+
+namespace {
+
+using block_graph::BlockGraph;
+using testing::_;
+using testing::InSequence;
+
+class MockSimulationEventHandler : public SimulationEventHandler {
+ public:
+  MOCK_METHOD2(OnProcessStarted, void(base::Time time,
+                                      size_t default_page_size));
+
+  MOCK_METHOD2(
+      OnFunctionEntry,
+      void(base::Time time, const block_graph::BlockGraph::Block* block));
+
+  MOCK_METHOD5(OnBasicBlockEntry,
+               void(base::Time time,
+                    const block_graph::BlockGraph::Block* block,
+                    uint32 offset,
+                    uint32 size,
+                    uint32 count));
+
+  MOCK_METHOD2(SerializeToJSON, bool (FILE* output, bool pretty_print));
+};
+
+const size_t kNumSimulations = 5;
+const size_t kNumBlocks = 100;
+
+class MultiSimulationTest : public testing::Test {
+ public:
+  void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      BlockGraph::Block* block = block_graph_.AddBlock(
+          BlockGraph::CODE_BLOCK, 0x80, "block");
+      block->set_addr(core::RelativeAddress(i * 0x1234));
+      blocks_.push_back(block);
+    }
+
+    // Each simulation gets its own candidate layout of the blocks.
+    layouts_.resize(kNumSimulations);
+    for (size_t i = 0; i < kNumSimulations; ++i) {
+      for (size_t j = 0; j < kNumBlocks; ++j) {
+        size_t position = (j * (i + 1) * 7) % kNumBlocks;
+        layouts_[i][blocks_[j]] = position * 0x80;
+      }
+    }
+  }
+
+  // Feeds a fixed sequence of events to @p handler.
+  void FeedEvents(SimulationEventHandler* handler) {
+    DCHECK(handler != NULL);
+    handler->OnProcessStarted(time_, 0x1000);
+    for (size_t i = 0; i < 1000; ++i)
+      handler->OnFunctionEntry(time_, blocks_[(i * 13) % kNumBlocks]);
+  }
+
+  // Creates a page fault simulation for each layout.
+  void CreateSimulations(ScopedVector<PageFaultSimulation>* simulations) {
+    DCHECK(simulations != NULL);
+    for (size_t i = 0; i < kNumSimulations; ++i) {
+      simulations->push_back(new PageFaultSimulation());
+      simulations->back()->set_pages_per_code_fault(1);
+      simulations->back()->set_layout(&layouts_[i]);
+    }
+  }
+
+  // Checks that the simulations fed through a MultiSimulation with
+  // @p num_threads threads and batches of @p batch_size events get the same
+  // results as simulations that are fed directly.
+  void CheckSimulations(size_t num_threads, size_t batch_size) {
+    ScopedVector<PageFaultSimulation> expected;
+    CreateSimulations(&expected);
+    for (size_t i = 0; i < expected.size(); ++i)
+      FeedEvents(expected[i]);
+
+    ScopedVector<PageFaultSimulation> simulations;
+    CreateSimulations(&simulations);
+    MultiSimulation multi_simulation(num_threads);
+    multi_simulation.set_batch_size(batch_size);
+    for (size_t i = 0; i < simulations.size(); ++i)
+      multi_simulation.AddSimulation(simulations[i]);
+    FeedEvents(&multi_simulation);
+    multi_simulation.Flush();
+
+    for (size_t i = 0; i < simulations.size(); ++i) {
+      EXPECT_EQ(expected[i]->page_size(), simulations[i]->page_size());
+      EXPECT_EQ(expected[i]->fault_count(), simulations[i]->fault_count());
+      EXPECT_EQ(expected[i]->pages(), simulations[i]->pages());
+    }
+  }
+
+ protected:
+  base::ScopedTempDir temp_dir_;
+  base::Time time_;
+  BlockGraph block_graph_;
+  std::vector<const BlockGraph::Block*> blocks_;
+  std::vector<PageFaultSimulation::BlockAddressMap> layouts_;
+};
+
+}  // namespace
+
+TEST_F(MultiSimulationTest, EventsAreBufferedUntilFlush) {
+  testing::StrictMock<MockSimulationEventHandler> simulation;
+  MultiSimulation multi_simulation(1);
+  multi_simulation.AddSimulation(&simulation);
+
+  multi_simulation.OnProcessStarted(time_, 0x1000);
+  multi_simulation.OnFunctionEntry(time_, blocks_[0]);
+  multi_simulation.OnFunctionEntry(time_, blocks_[1]);
+  multi_simulation.OnBasicBlockEntry(time_, blocks_[1], 0x10, 0x8, 3);
+  testing::Mock::VerifyAndClearExpectations(&simulation);
+
+  {
+    InSequence in_sequence;
+    EXPECT_CALL(simulation, OnProcessStarted(_, 0x1000));
+    EXPECT_CALL(simulation, OnFunctionEntry(_, blocks_[0]));
+    EXPECT_CALL(simulation, OnFunctionEntry(_, blocks_[1]));
+    EXPECT_CALL(simulation, OnBasicBlockEntry(_, blocks_[1], 0x10, 0x8, 3));
+  }
+  multi_simulation.Flush();
+  testing::Mock::VerifyAndClearExpectations(&simulation);
+
+  // Nothing is left to be replayed.
+  multi_simulation.Flush();
+}
+
+TEST_F(MultiSimulationTest, FullBatchIsReplayed) {
+  testing::StrictMock<MockSimulationEventHandler> simulation;
+  MultiSimulation multi_simulation(1);
+  multi_simulation.set_batch_size(2);
+  multi_simulation.AddSimulation(&simulation);
+
+  multi_simulation.OnProcessStarted(time_, 0x1000);
+  testing::Mock::VerifyAndClearExpectations(&simulation);
+
+  EXPECT_CALL(simulation, OnProcessStarted(_, 0x1000));
+  EXPECT_CALL(simulation, OnFunctionEntry(_, blocks_[0]));
+  multi_simulation.OnFunctionEntry(time_, blocks_[0]);
+}
+
+TEST_F(MultiSimulationTest, SingleThread) {
+  ASSERT_NO_FATAL_FAILURE(CheckSimulations(1, 64));
+}
+
+TEST_F(MultiSimulationTest, MultipleThreads) {
+  ASSERT_NO_FATAL_FAILURE(CheckSimulations(3, 64));
+}
+
+TEST_F(MultiSimulationTest, MoreThreadsThanSimulations) {
+  ASSERT_NO_FATAL_FAILURE(
+      CheckSimulations(2 * kNumSimulations,
+                       MultiSimulation::kDefaultBatchSize));
+}
+
+TEST_F(MultiSimulationTest, SerializeToJSON) {
+  ScopedVector<PageFaultSimulation> simulations;
+  CreateSimulations(&simulations);
+  MultiSimulation multi_simulation(2);
+  for (size_t i = 0; i < simulations.size(); ++i)
+    multi_simulation.AddSimulation(simulations[i]);
+  FeedEvents(&multi_simulation);
+
+  base::FilePath path = temp_dir_.path().AppendASCII("test.json");
+  {
+    base::ScopedFILE file(base::OpenFile(path, "w"));
+    ASSERT_TRUE(file.get() != NULL);
+    ASSERT_TRUE(multi_simulation.SerializeToJSON(file.get(), true));
+  }
+
+  std::string json;
+  ASSERT_TRUE(base::ReadFileToString(path, &json));
+  scoped_ptr<base::Value> value(base::JSONReader::Read(json));
+  ASSERT_TRUE(value.get() != NULL);
+  base::ListValue* list = NULL;
+  ASSERT_TRUE(value->GetAsList(&list));
+  ASSERT_EQ(kNumSimulations, list->GetSize());
+
+  for (size_t i = 0; i < kNumSimulations; ++i) {
+    base::DictionaryValue* dict = NULL;
+    ASSERT_TRUE(list->GetDictionary(i, &dict));
+    int fault_count = 0;
+    ASSERT_TRUE(dict->GetInteger("fault_count", &fault_count));
+    EXPECT_EQ(simulations[i]->fault_count(), static_cast<size_t>(fault_count));
+  }
+}
+
+}  // namespace simulate
@@ -20,8 +20,21 @@ namespace simulate {
 
 PageFaultSimulation::PageFaultSimulation()
     : fault_count_(0),
+      hard_fault_count_(0),
+      soft_fault_count_(0),
       page_size_(0),
-      pages_per_code_fault_(kDefaultPagesPerCodeFault) {
+      pages_per_code_fault_(kDefaultPagesPerCodeFault),
+      layout_(NULL),
+      working_set_size_(0),
+      standby_list_size_(0),
+      eviction_policy_(kLruEviction),
+      clock_hand_(resident_list_.end()) {
+}
+
+size_t PageFaultSimulation::resident_page_count() const {
+  if (working_set_size_ == 0)
+    return pages_.size();
+  return resident_pages_.size();
 }
 
 void PageFaultSimulation::OnProcessStarted(base::Time /*time*/,
@@ -51,6 +64,12 @@ bool PageFaultSimulation::SerializeToJSON(FILE* output,
       !json_file.OutputInteger(pages_per_code_fault_) ||
       !json_file.OutputKey("fault_count") ||
       !json_file.OutputInteger(fault_count_) ||
+      !json_file.OutputKey("hard_fault_count") ||
+      !json_file.OutputInteger(hard_fault_count_) ||
+      !json_file.OutputKey("soft_fault_count") ||
+      !json_file.OutputInteger(soft_fault_count_) ||
+      !json_file.OutputKey("working_set_size") ||
+      !json_file.OutputInteger(working_set_size_) ||
       !json_file.OutputKey("loaded_pages") ||
       !json_file.OpenList()) {
     return false;
@@ -75,24 +94,139 @@ bool PageFaultSimulation::SerializeToJSON(FILE* output,
 void PageFaultSimulation::OnFunctionEntry(base::Time /*time*/,
                                           const Block* block) {
   DCHECK(block != NULL);
+
+  uint32 address = block->addr().value();
+  if (layout_ != NULL) {
+    BlockAddressMap::const_iterator it = layout_->find(block);
+    if (it != layout_->end())
+      address = it->second;
+  }
+
+  OnRangeAccessed(address, block->size());
+}
+
+void PageFaultSimulation::OnRangeAccessed(uint32 address, size_t size) {
   DCHECK(page_size_ != 0);
 
-  const uint32 block_start = block->addr().value();
-  const uint32 block_size = block->size();
-  const size_t kStartIndex = block_start / page_size_;
-  const size_t kEndIndex = (block_start + block_size +
-      page_size_ - 1) / page_size_;
+  const size_t kStartIndex = address / page_size_;
+  const size_t kEndIndex = (address + size + page_size_ - 1) / page_size_;
 
-  // Loop through all the pages in the block, and if it isn't already in memory
-  // then simulate a code fault and load all the faulting pages in memory.
-  for (size_t i = kStartIndex; i < kEndIndex; i++) {
-    if (pages_.find(i) == pages_.end()) {
+  // Loop through all the pages in the range, and simulate touching them.
+  for (size_t i = kStartIndex; i < kEndIndex; i++)
+    AccessPage(i);
+}
+
+void PageFaultSimulation::AccessPage(uint32 page) {
+  // If pages are never evicted, then only the first touch of a page faults.
+  if (working_set_size_ == 0) {
+    if (pages_.find(page) == pages_.end()) {
       fault_count_++;
+      hard_fault_count_++;
       for (size_t j = 0; j < pages_per_code_fault_; j++) {
-        pages_.insert(i + j);
+        pages_.insert(page + j);
       }
     }
+    return;
+  }
+
+  ResidentPageMap::iterator it = resident_pages_.find(page);
+  if (it != resident_pages_.end()) {
+    // Touching a resident page doesn't fault, but updates its recency.
+    if (eviction_policy_ == kLruEviction) {
+      resident_list_.splice(resident_list_.begin(), resident_list_,
+                            it->second.position);
+    }
+    it->second.referenced = true;
+    return;
+  }
+
+  fault_count_++;
+
+  // A page that is still on the standby list is simply moved back to the
+  // working set.
+  if (RemoveFromStandbyList(page)) {
+    soft_fault_count_++;
+    LoadPage(page);
+    return;
+  }
+
+  // Otherwise the whole cluster is read in. The faulting page is loaded last
+  // so that it is the last to be evicted.
+  hard_fault_count_++;
+  for (size_t j = pages_per_code_fault_; j > 0; j--) {
+    uint32 cluster_page = page + j - 1;
+    if (resident_pages_.find(cluster_page) != resident_pages_.end())
+      continue;
+    RemoveFromStandbyList(cluster_page);
+    LoadPage(cluster_page);
+  }
+}
+
+void PageFaultSimulation::LoadPage(uint32 page) {
+  DCHECK_LT(0U, working_set_size_);
+  DCHECK(resident_pages_.find(page) == resident_pages_.end());
+
+  if (resident_pages_.size() >= working_set_size_)
+    EvictPage();
+
+  pages_.insert(page);
+
+  // With the clock policy new pages are inserted right behind the hand, so
+  // that they are the last to be swept.
+  PageList::iterator position = clock_hand_;
+  if (eviction_policy_ == kLruEviction)
+    position = resident_list_.begin();
+
+  ResidentPage resident_page;
+  resident_page.position = resident_list_.insert(position, page);
+  resident_page.referenced = true;
+  resident_pages_.insert(std::make_pair(page, resident_page));
+}
+
+void PageFaultSimulation::EvictPage() {
+  DCHECK(!resident_list_.empty());
+
+  PageList::iterator victim = resident_list_.end();
+  if (eviction_policy_ == kLruEviction) {
+    --victim;
+  } else {
+    // Sweep the hand until it finds a page that wasn't referenced since the
+    // last sweep. This terminates after at most one full revolution.
+    while (true) {
+      if (clock_hand_ == resident_list_.end())
+        clock_hand_ = resident_list_.begin();
+      ResidentPage& resident_page = resident_pages_[*clock_hand_];
+      if (!resident_page.referenced)
+        break;
+      resident_page.referenced = false;
+      ++clock_hand_;
+    }
+    victim = clock_hand_;
+    ++clock_hand_;
   }
+
+  uint32 page = *victim;
+  resident_pages_.erase(page);
+  resident_list_.erase(victim);
+
+  if (standby_list_size_ == 0)
+    return;
+
+  standby_pages_[page] = standby_list_.insert(standby_list_.end(), page);
+  if (standby_list_.size() > standby_list_size_) {
+    standby_pages_.erase(standby_list_.front());
+    standby_list_.pop_front();
+  }
+}
+
+bool PageFaultSimulation::RemoveFromStandbyList(uint32 page) {
+  StandbyPageMap::iterator it = standby_pages_.find(page);
+  if (it == standby_pages_.end())
+    return false;
+
+  standby_list_.erase(it->second);
+  standby_pages_.erase(it);
+  return true;
 }
 
 }  // namespace simulate
@@ -17,6 +17,10 @@
 #ifndef SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_H_
 #define SYZYGY_SIMULATE_PAGE_FAULT_SIMULATION_H_
 
+#include <list>
+#include <map>
+#include <set>
+
 #include "syzygy/simulate/simulation_event_handler.h"
 #include "syzygy/trace/parse/parser.h"
 
@@ -40,11 +44,31 @@ namespace simulate {
 //
 // If the page size is not set, then it's deduced from the trace file data
 // or, if that's not possible, it's set to the default value of 0x1000 (4 KB).
+//
+// By default pages stay resident once they are loaded, so only the first
+// touch of each page can fault. If a working set size is set, then at most that
+// many pages are resident, and loading a page past that evicts a resident page
+// according to the eviction policy. Evicted pages go to a standby list of
+// bounded size, as with the Windows memory manager: touching a page that is
+// still on the standby list is a soft fault, which brings back that single
+// page, while touching any other page is a hard fault, which reads in a
+// cluster of pages_per_code_fault pages.
 class PageFaultSimulation : public SimulationEventHandler {
  public:
   typedef block_graph::BlockGraph::Block Block;
   typedef std::set<uint32> PageSet;
 
+  // The policies used to pick the resident page to be evicted.
+  enum EvictionPolicy {
+    // Evicts the least recently used page.
+    kLruEviction,
+    // Evicts the first page found without its referenced bit set by a clock
+    // hand sweeping the resident pages, clearing the bits along the way.
+    kClockEviction,
+  };
+  // Maps blocks to the address they have in a candidate layout.
+  typedef std::map<const Block*, uint32> BlockAddressMap;
+
   // The default page size, in case neither the user nor the system
   // provide one.
   static const size_t kDefaultPageSize = 0x1000;
@@ -59,8 +83,15 @@ class PageFaultSimulation : public SimulationEventHandler {
   // @{
   const PageSet& pages() const { return pages_; }
   size_t fault_count() const { return fault_count_; }
+  size_t hard_fault_count() const { return hard_fault_count_; }
+  size_t soft_fault_count() const { return soft_fault_count_; }
   size_t page_size() const { return page_size_; }
   size_t pages_per_code_fault() const { return pages_per_code_fault_; }
+  const BlockAddressMap* layout() const { return layout_; }
+  size_t working_set_size() const { return working_set_size_; }
+  size_t standby_list_size() const { return standby_list_size_; }
+  EvictionPolicy eviction_policy() const { return eviction_policy_; }
+  size_t resident_page_count() const;
   // @}
 
   // @name Mutators
@@ -73,6 +104,24 @@ class PageFaultSimulation : public SimulationEventHandler {
     DCHECK(pages_per_code_fault > 0);
     pages_per_code_fault_ = pages_per_code_fault;
   }
+  // Sets a candidate layout to be simulated instead of the addresses of the
+  // blocks. Blocks missing from @p layout keep their own address. The layout
+  // is not owned, and may be NULL.
+  void set_layout(const BlockAddressMap* layout) { layout_ = layout; }
+  // Sets the maximum number of resident pages, or 0 for no maximum. This must
+  // be set before any page is accessed.
+  void set_working_set_size(size_t working_set_size) {
+    DCHECK(pages_.empty());
+    working_set_size_ = working_set_size;
+  }
+  // Sets the maximum number of evicted pages that can be soft-faulted back.
+  void set_standby_list_size(size_t standby_list_size) {
+    standby_list_size_ = standby_list_size;
+  }
+  void set_eviction_policy(EvictionPolicy eviction_policy) {
+    DCHECK(pages_.empty());
+    eviction_policy_ = eviction_policy;
+  }
   // @}
 
   // @name SimulationEventHandler implementation
@@ -88,13 +137,49 @@ class PageFaultSimulation : public SimulationEventHandler {
   bool SerializeToJSON(FILE* output, bool pretty_print) OVERRIDE;
   // @}
 
+  // Registers the page faults caused by touching the range of memory
+  // [address, address + size). This allows simulating layouts that haven't
+  // been applied to a block graph yet.
+  // @param address the start address of the touched range.
+  // @param size the size of the touched range.
+  void OnRangeAccessed(uint32 address, size_t size);
+
  protected:
+  typedef std::list<uint32> PageList;
+
+  // The state of a resident page, when the working set size is bounded.
+  struct ResidentPage {
+    // The position of the page in resident_list_.
+    PageList::iterator position;
+    // Set whenever the page is touched. Used by the clock policy.
+    bool referenced;
+  };
+  typedef std::map<uint32, ResidentPage> ResidentPageMap;
+  typedef std::map<uint32, PageList::iterator> StandbyPageMap;
+
+  // Simulates touching the page @p page.
+  void AccessPage(uint32 page);
+
+  // Makes @p page resident, evicting another page if the working set is full.
+  void LoadPage(uint32 page);
+
+  // Evicts a resident page, as picked by the eviction policy, and moves it to
+  // the standby list.
+  void EvictPage();
+
+  // @returns true iff @p page is on the standby list, in which case it is
+  //     removed from it.
+  bool RemoveFromStandbyList(uint32 page);
+
   // A set which contains the block number of the pages that
   // were faulted in the trace files.
   PageSet pages_;
 
-  // The total number of page-faults detected.
+  // The total number of page-faults detected, and how they split between hard
+  // and soft faults.
   size_t fault_count_;
+  size_t hard_fault_count_;
+  size_t soft_fault_count_;
 
   // The size of each page, in bytes. If not set, PageFaultSimulator will
   // try to load the system value, or uses kDefaultPageSize
@@ -104,6 +189,34 @@ class PageFaultSimulation : public SimulationEventHandler {
   // The number of pages each code-fault loads. If not set,
   // PageFaultSimulator uses kDefaultPagesPerFault.
   size_t pages_per_code_fault_;
+
+  // The candidate layout being simulated, if any. This is not owned.
+  const BlockAddressMap* layout_;
+
+  // The maximum number of resident pages, or 0 if pages are never evicted.
+  size_t working_set_size_;
+
+  // The maximum number of pages on the standby list.
+  size_t standby_list_size_;
+
+  // The policy used to evict pages.
+  EvictionPolicy eviction_policy_;
+
+  // @name Resident pages, only used when the working set size is bounded.
+  // @{
+  // The resident pages. With the LRU policy the most recently used page is at
+  // the front. With the clock policy this is the circular list swept by
+  // clock_hand_.
+  PageList resident_list_;
+  ResidentPageMap resident_pages_;
+  PageList::iterator clock_hand_;
+  // @}
+
+  // @name The standby list, with the most recently evicted page at the back.
+  // @{
+  PageList standby_list_;
+  StandbyPageMap standby_pages_;
+  // @}
 };
 
 }  // namespace simulate
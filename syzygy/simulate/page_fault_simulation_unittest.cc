@@ -329,6 +329,122 @@ TEST_F(PageFaultSimulatorTest, ExactPageFaults) {
       arraysize(expected_pages)));
 }
 
+TEST_F(PageFaultSimulatorTest, ExactPageFaultsForRanges) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(4);
+
+  simulation_->OnRangeAccessed(0, 3);
+  simulation_->OnRangeAccessed(2, 2);
+  simulation_->OnRangeAccessed(5, 5);
+
+  PageSet::key_type expected_pages[] = {0, 1, 2, 3, 5, 6, 7, 8, 9, 10, 11, 12};
+  EXPECT_EQ(simulation_->fault_count(), 3);
+  EXPECT_EQ(simulation_->pages(), PageSet(expected_pages, expected_pages +
+      arraysize(expected_pages)));
+}
+
+TEST_F(PageFaultSimulatorTest, ExactPageFaultsWithLayout) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(4);
+
+  MockBlockInfo blocks[] = {
+      MockBlockInfo(0, 3, &block_graph_),
+      MockBlockInfo(2, 2, &block_graph_),
+      MockBlockInfo(5, 5, &block_graph_)
+  };
+
+  // Move the last block right after the first one. The second block keeps its
+  // own address.
+  PageFaultSimulation::BlockAddressMap layout;
+  layout[blocks[0].block] = 0;
+  layout[blocks[2].block] = 3;
+  simulation_->set_layout(&layout);
+
+  for (uint32 i = 0; i < arraysize(blocks); i++) {
+    simulation_->OnFunctionEntry(time_, blocks[i].block);
+  }
+
+  PageSet::key_type expected_pages[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  EXPECT_EQ(simulation_->fault_count(), 2);
+  EXPECT_EQ(simulation_->pages(), PageSet(expected_pages, expected_pages +
+      arraysize(expected_pages)));
+}
+
+TEST_F(PageFaultSimulatorTest, LruEviction) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(1);
+  simulation_->set_working_set_size(2);
+
+  static const uint32 kAccesses[] = {0, 1, 0, 2, 1};
+  for (size_t i = 0; i < arraysize(kAccesses); ++i)
+    simulation_->OnRangeAccessed(kAccesses[i], 1);
+
+  // Touching page 2 evicts page 1, which was the least recently used.
+  EXPECT_EQ(4U, simulation_->fault_count());
+  EXPECT_EQ(4U, simulation_->hard_fault_count());
+  EXPECT_EQ(0U, simulation_->soft_fault_count());
+  EXPECT_EQ(2U, simulation_->resident_page_count());
+}
+
+TEST_F(PageFaultSimulatorTest, ClockEviction) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(1);
+  simulation_->set_working_set_size(2);
+  simulation_->set_eviction_policy(PageFaultSimulation::kClockEviction);
+
+  static const uint32 kAccesses[] = {0, 1, 0, 2, 1};
+  for (size_t i = 0; i < arraysize(kAccesses); ++i)
+    simulation_->OnRangeAccessed(kAccesses[i], 1);
+
+  // Both pages are referenced when page 2 is touched, so the hand clears
+  // their bits and comes back to page 0, which is evicted.
+  EXPECT_EQ(3U, simulation_->fault_count());
+  EXPECT_EQ(3U, simulation_->hard_fault_count());
+  EXPECT_EQ(0U, simulation_->soft_fault_count());
+  EXPECT_EQ(2U, simulation_->resident_page_count());
+}
+
+TEST_F(PageFaultSimulatorTest, SoftFaults) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(1);
+  simulation_->set_working_set_size(1);
+  simulation_->set_standby_list_size(1);
+
+  static const uint32 kAccesses[] = {0, 1, 0, 2, 1};
+  for (size_t i = 0; i < arraysize(kAccesses); ++i)
+    simulation_->OnRangeAccessed(kAccesses[i], 1);
+
+  // Page 0 is still on the standby list when it is touched again, but page 1
+  // has been pushed out of it by then.
+  EXPECT_EQ(5U, simulation_->fault_count());
+  EXPECT_EQ(4U, simulation_->hard_fault_count());
+  EXPECT_EQ(1U, simulation_->soft_fault_count());
+  EXPECT_EQ(1U, simulation_->resident_page_count());
+}
+
+TEST_F(PageFaultSimulatorTest, ClusterEviction) {
+  simulation_->OnProcessStarted(time_, 1);
+  simulation_->set_page_size(1);
+  simulation_->set_pages_per_code_fault(4);
+  simulation_->set_working_set_size(4);
+
+  // Reading in the second cluster evicts the whole first cluster.
+  simulation_->OnRangeAccessed(0, 1);
+  simulation_->OnRangeAccessed(10, 1);
+  simulation_->OnRangeAccessed(0, 1);
+
+  PageSet::key_type expected_pages[] = {0, 1, 2, 3, 10, 11, 12, 13};
+  EXPECT_EQ(3U, simulation_->fault_count());
+  EXPECT_EQ(4U, simulation_->resident_page_count());
+  EXPECT_EQ(simulation_->pages(), PageSet(expected_pages, expected_pages +
+      arraysize(expected_pages)));
+}
+
 TEST_F(PageFaultSimulatorTest, CorrectPageFaults) {
   simulation_->OnProcessStarted(time_, 1);
 
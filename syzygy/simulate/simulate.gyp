@@ -23,6 +23,8 @@
       'sources': [
         'heat_map_simulation.cc',
         'heat_map_simulation.h',
+        'multi_simulation.cc',
+        'multi_simulation.h',
         'page_fault_simulation.cc',
         'page_fault_simulation.h',
         'simulation_event_handler.h',
@@ -31,6 +33,7 @@
       ],
       'dependencies': [
         '<(src)/syzygy/common/common.gyp:common_lib',
+        '<(src)/syzygy/grinder/grinder.gyp:grinder_lib',
         '<(src)/syzygy/pdb/pdb.gyp:pdb_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/playback/playback.gyp:playback_lib',
@@ -46,6 +49,7 @@
       'dependencies': [
         'simulate_lib',
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/application/application.gyp:application_lib',
       ],
     },
     {
@@ -53,6 +57,7 @@
       'type': 'executable',
       'sources': [
         'heat_map_simulation_unittest.cc',
+        'multi_simulation_unittest.cc',
         'page_fault_simulation_unittest.cc',
         'simulator_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
@@ -21,14 +21,19 @@
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
+#include "base/memory/scoped_vector.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "syzygy/application/application.h"
 #include "syzygy/simulate/heat_map_simulation.h"
+#include "syzygy/simulate/multi_simulation.h"
 #include "syzygy/simulate/page_fault_simulation.h"
 #include "syzygy/simulate/simulator.h"
 
 namespace {
 
 using simulate::HeatMapSimulation;
+using simulate::MultiSimulation;
 using simulate::PageFaultSimulation;
 using simulate::SimulationEventHandler;
 using simulate::Simulator;
@@ -43,23 +48,65 @@ const char kUsage[] =
     "    --pretty-print enables pretty printing of the JSON output file.\n"
     "    --input-dll=<path> the input DLL from where the trace files belong.\n"
     "    --output-file=<path> the output file.\n"
+    "    --jobs=INT the number of threads running the simulations when\n"
+    "        more than one is simulated (default 1).\n"
     "    For page fault method:\n"
-    "      --pages-per-code-fault=INT The number of pages loaded by each\n"
-    "          page-fault (default 8)\n"
-    "      --page-size=INT the size of each page, in bytes (default 4KB).\n"
+    "      --pages-per-code-fault=INT[,INT...] The number of pages loaded by\n"
+    "          each page-fault (default 8)\n"
+    "      --page-size=INT[,INT...] the size of each page, in bytes\n"
+    "          (default 4KB).\n"
+    "      --working-set-size=INT the maximum number of resident pages, past\n"
+    "          which pages are evicted (default 0, for no maximum).\n"
+    "      --eviction-policy=lru|clock the policy used to evict pages\n"
+    "          (default lru).\n"
+    "      --standby-list-size=INT the number of evicted pages that can be\n"
+    "          soft-faulted back (default 0).\n"
+    "      When several values are given, a simulation is run for each\n"
+    "      combination of them in a single pass over the trace files, and the\n"
+    "      output is a list of the results of each simulation.\n"
     "    For heat map method:\n"
     "      --time-slice-usecs=INT the size of each time slice in the heatmap,\n"
     "          in microseconds (default 1).\n"
     "      --memory-slice-bytes=INT the size of each memory slice,\n"
-    "          in bytes (default 32KB).\n"
+    "          in bytes (default 32KB). Use the cache line size (e.g. 64)\n"
+    "          to see the instruction cache locality of the code.\n"
     "      --output-individual-functions Output information about each\n"
-    "          function in each time/memory block\n";
+    "          function in each time/memory block\n"
+    "      --compare-to=<path> the output of a previous heat map simulation,\n"
+    "          with the same slice sizes, whose summary is output next to\n"
+    "          the summary of this one.\n";
 
 int Usage(const char* message) {
   std::cerr << message << std::endl << kUsage;
   return 1;
 }
 
+// Parses a comma-separated list of positive integers. An empty string yields
+// a list holding only @p default_value.
+// @returns true on success, false otherwise.
+bool ParseIntList(const CommandLine::StringType& str,
+                  int default_value,
+                  std::vector<int>* values) {
+  DCHECK(values != NULL);
+  values->clear();
+
+  if (str.empty()) {
+    values->push_back(default_value);
+    return true;
+  }
+
+  std::vector<CommandLine::StringType> tokens;
+  base::SplitString(str, L',', &tokens);
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    int value = 0;
+    if (!base::StringToInt(tokens[i], &value) || value <= 0)
+      return false;
+    values->push_back(value);
+  }
+
+  return true;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -97,29 +144,78 @@ int main(int argc, char** argv) {
 
   scoped_ptr<SimulationEventHandler> simulation;
 
+  // The simulations fed through the MultiSimulation, if any.
+  ScopedVector<SimulationEventHandler> simulations;
+
   if (simulate_method == "pagefault") {
-    PageFaultSimulation* page_fault_simulation = new PageFaultSimulation();
-    DCHECK(page_fault_simulation != NULL);
-    simulation.reset(page_fault_simulation);
-
-    int page_size = 0;
-    int pages_per_code_fault = 0;
-    StringType page_size_str = cmd_line->GetSwitchValueNative("page-size");
-    StringType pages_per_code_fault_str =
-        cmd_line->GetSwitchValueNative("pages-per-code-fault");
-
-    if (!page_size_str.empty()) {
-      if (!base::StringToInt(page_size_str, &page_size))
-        return Usage("Invalid page-size value.");
-      else
-        page_fault_simulation->set_page_size(page_size);
+    // A page size of 0 lets the simulation use the system page size.
+    std::vector<int> page_sizes;
+    std::vector<int> pages_per_code_faults;
+    if (!ParseIntList(cmd_line->GetSwitchValueNative("page-size"), 0,
+                      &page_sizes)) {
+      return Usage("Invalid page-size value.");
+    }
+    if (!ParseIntList(cmd_line->GetSwitchValueNative("pages-per-code-fault"),
+                      PageFaultSimulation::kDefaultPagesPerCodeFault,
+                      &pages_per_code_faults)) {
+      return Usage("Invalid pages-per-code-fault value.");
     }
 
-    if (!pages_per_code_fault_str.empty()) {
-      if (!base::StringToInt(pages_per_code_fault_str, &pages_per_code_fault))
-        return Usage("Invalid pages-per-code-fault value.");
-      else
-        page_fault_simulation->set_pages_per_code_fault(pages_per_code_fault);
+    int working_set_size = 0;
+    int standby_list_size = 0;
+    StringType working_set_size_str =
+        cmd_line->GetSwitchValueNative("working-set-size");
+    StringType standby_list_size_str =
+        cmd_line->GetSwitchValueNative("standby-list-size");
+    std::string eviction_policy_str =
+        cmd_line->GetSwitchValueASCII("eviction-policy");
+
+    if (!working_set_size_str.empty() &&
+        (!base::StringToInt(working_set_size_str, &working_set_size) ||
+         working_set_size < 0)) {
+      return Usage("Invalid working-set-size value.");
+    }
+    if (!standby_list_size_str.empty() &&
+        (!base::StringToInt(standby_list_size_str, &standby_list_size) ||
+         standby_list_size < 0)) {
+      return Usage("Invalid standby-list-size value.");
+    }
+
+    PageFaultSimulation::EvictionPolicy eviction_policy =
+        PageFaultSimulation::kLruEviction;
+    if (eviction_policy_str == "clock")
+      eviction_policy = PageFaultSimulation::kClockEviction;
+    else if (!eviction_policy_str.empty() && eviction_policy_str != "lru")
+      return Usage("Invalid eviction-policy value.");
+
+    for (size_t i = 0; i < page_sizes.size(); ++i) {
+      for (size_t j = 0; j < pages_per_code_faults.size(); ++j) {
+        PageFaultSimulation* page_fault_simulation = new PageFaultSimulation();
+        DCHECK(page_fault_simulation != NULL);
+        simulations.push_back(page_fault_simulation);
+
+        if (page_sizes[i] != 0)
+          page_fault_simulation->set_page_size(page_sizes[i]);
+        page_fault_simulation->set_pages_per_code_fault(
+            pages_per_code_faults[j]);
+        page_fault_simulation->set_working_set_size(working_set_size);
+        page_fault_simulation->set_standby_list_size(standby_list_size);
+        page_fault_simulation->set_eviction_policy(eviction_policy);
+      }
+    }
+
+    if (simulations.size() == 1) {
+      simulation.reset(simulations[0]);
+      simulations.weak_clear();
+    } else {
+      size_t jobs = 1;
+      if (!application::AppImplBase::ParseJobs(cmd_line, &jobs))
+        return Usage("Invalid jobs value.");
+
+      MultiSimulation* multi_simulation = new MultiSimulation(jobs);
+      simulation.reset(multi_simulation);
+      for (size_t i = 0; i < simulations.size(); ++i)
+        multi_simulation->AddSimulation(simulations[i]);
     }
   } else if (simulate_method == "heatmap") {
     HeatMapSimulation* heat_map_simulation = new HeatMapSimulation();
@@ -149,6 +245,22 @@ int main(int argc, char** argv) {
 
     heat_map_simulation->set_output_individual_functions(
         cmd_line->HasSwitch("output-individual-functions"));
+
+    base::FilePath compare_to_path = cmd_line->GetSwitchValuePath("compare-to");
+    if (!compare_to_path.empty()) {
+      HeatMapSimulation::Summary baseline_summary;
+      if (!HeatMapSimulation::LoadSummaryFromJSON(compare_to_path,
+                                                  &baseline_summary)) {
+        return Usage("Invalid compare-to file.");
+      }
+      if (baseline_summary.time_slice_usecs !=
+              heat_map_simulation->time_slice_usecs() ||
+          baseline_summary.memory_slice_bytes !=
+              heat_map_simulation->memory_slice_bytes()) {
+        return Usage("The compare-to file has different slice sizes.");
+      }
+      heat_map_simulation->set_baseline_summary(baseline_summary);
+    }
   } else {
     return Usage("Invalid simulate-method value.");
   }
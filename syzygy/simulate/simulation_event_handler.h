@@ -44,6 +44,22 @@ class SimulationEventHandler {
       base::Time time,
       const block_graph::BlockGraph::Block* block) = 0;
 
+  // Issued for the basic blocks of the basic-block entry count traces. These
+  // are only reported when the process ends, with the number of times each
+  // basic block was entered. Simulations that only model function entries
+  // ignore these events.
+  // @param time The time the entry counts were reported.
+  // @param block The function block containing the basic block.
+  // @param offset The offset of the basic block in @p block.
+  // @param size The size of the basic block.
+  // @param count The number of times the basic block was entered.
+  virtual void OnBasicBlockEntry(base::Time time,
+                                 const block_graph::BlockGraph::Block* block,
+                                 uint32 offset,
+                                 uint32 size,
+                                 uint32 count) {
+  }
+
   // Serializes the data to JSON.
   // @param output The output FILE.
   // @param pretty_print Pretty printing on the JSON file.
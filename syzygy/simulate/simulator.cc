@@ -14,6 +14,9 @@
 
 #include "syzygy/simulate/simulator.h"
 
+#include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/pe/find.h"
+
 namespace simulate {
 
 Simulator::Simulator(const base::FilePath& module_path,
@@ -111,4 +114,78 @@ void Simulator::OnBatchFunctionEntry(base::Time time,
   }
 }
 
+void Simulator::OnIndexedFrequency(base::Time time,
+                                   DWORD process_id,
+                                   DWORD thread_id,
+                                   const TraceIndexedFrequencyData* data) {
+  DCHECK(playback_ != NULL);
+  DCHECK(data != NULL);
+
+  // Only the basic-block entry counts can be simulated.
+  if (data->data_type != ::common::IndexedFrequencyData::BASIC_BLOCK_ENTRY ||
+      data->num_entries == 0) {
+    return;
+  }
+
+  // Skip the data of the other instrumented modules.
+  const pe::ModuleInformation* module_info = parser_->GetModuleInformation(
+      process_id, trace::parser::AbsoluteAddress64(data->module_base_addr));
+  if (module_info == NULL ||
+      !playback_->MatchesInstrumentedModuleSignature(*module_info)) {
+    return;
+  }
+
+  if (!grinder::basic_block_util::IsValidFrequencySize(data->frequency_size) ||
+      !LoadBasicBlockRanges()) {
+    parser_->set_error_occurred(true);
+    return;
+  }
+  if (data->num_entries != bb_ranges_.size()) {
+    LOG(ERROR) << "Unexpected number of basic blocks in frequency data.";
+    parser_->set_error_occurred(true);
+    return;
+  }
+
+  DCHECK(simulation_ != NULL);
+  for (size_t i = 0; i < bb_ranges_.size(); ++i) {
+    uint32 count = grinder::basic_block_util::GetFrequency(data, i, 0);
+    if (count == 0)
+      continue;
+
+    // Basic blocks outside the decomposed blocks can't be simulated.
+    const grinder::basic_block_util::RelativeAddressRange& range =
+        bb_ranges_[i];
+    const BlockGraph::Block* block =
+        image_layout_.blocks.GetContainingBlock(range.start(), range.size());
+    if (block == NULL)
+      continue;
+
+    simulation_->OnBasicBlockEntry(time, block, range.start() - block->addr(),
+                                   range.size(), count);
+  }
+}
+
+bool Simulator::LoadBasicBlockRanges() {
+  if (!bb_ranges_.empty())
+    return true;
+
+  base::FilePath pdb_path;
+  if (!pe::FindPdbForModule(instrumented_path_, &pdb_path) ||
+      pdb_path.empty()) {
+    LOG(ERROR) << "Unable to find PDB for \"" << instrumented_path_.value()
+               << "\".";
+    return false;
+  }
+
+  if (!grinder::basic_block_util::LoadBasicBlockRanges(pdb_path,
+                                                       &bb_ranges_)) {
+    LOG(ERROR) << "Unable to load basic block ranges from \""
+               << pdb_path.value() << "\".";
+    bb_ranges_.clear();
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace simulate
@@ -19,6 +19,7 @@
 #ifndef SYZYGY_SIMULATE_SIMULATOR_H_
 #define SYZYGY_SIMULATE_SIMULATOR_H_
 
+#include "syzygy/grinder/basic_block_util.h"
 #include "syzygy/playback/playback.h"
 #include "syzygy/simulate/simulation_event_handler.h"
 #include "syzygy/trace/parse/parser.h"
@@ -64,8 +65,16 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
   virtual void OnBatchFunctionEntry(
       base::Time time, DWORD process_id, DWORD thread_id,
       const TraceBatchEnterData* data) OVERRIDE;
+  virtual void OnIndexedFrequency(
+      base::Time time, DWORD process_id, DWORD thread_id,
+      const TraceIndexedFrequencyData* data) OVERRIDE;
   // @}
 
+  // Loads the basic block ranges of the original module from the PDB of the
+  // instrumented module, if they haven't been loaded yet.
+  // @returns true on success, false otherwise.
+  bool LoadBasicBlockRanges();
+
   // The input files.
   base::FilePath module_path_;
   base::FilePath instrumented_path_;
@@ -86,6 +95,10 @@ class Simulator : public trace::parser::ParseEventHandlerImpl {
 
   // A pointer to a simulation, that is to be used.
   SimulationEventHandler* simulation_;
+
+  // The basic block ranges of the original module, by basic block ID. These
+  // are only loaded for basic-block entry traces.
+  grinder::basic_block_util::RelativeAddressRangeVector bb_ranges_;
 };
 
 }  // namespace simulate
@@ -17,9 +17,13 @@
 
 #include "syzygy/swapimport/swapimport_app.h"
 
+#include <algorithm>
+
 #include "base/file_util.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/win/scoped_handle.h"
+#include "syzygy/common/com_utils.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/pe_file_writer.h"
@@ -41,6 +45,55 @@ static const char kUsageFormatStr[] = "Usage: %ls [options] IMPORT\n"
     "    --verbose             Log verbosely.\n"
     "\n";
 
+// Writes @p imports over the import descriptor table at @p import_offset in
+// the image file @p path, and updates the image checksum. The file is mapped
+// read/write, so only the pages touched are written back.
+bool PatchImports(const base::FilePath& path,
+                  pe::PEFile::FileOffsetAddress import_offset,
+                  const std::vector<IMAGE_IMPORT_DESCRIPTOR>& imports) {
+  base::win::ScopedHandle file(
+      ::CreateFile(path.value().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                   NULL, OPEN_EXISTING, 0, NULL));
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Failed to open \"" << path.value() << "\" for writing.";
+    return false;
+  }
+
+  size_t file_size = ::GetFileSize(file.Get(), NULL);
+  size_t table_size = imports.size() * sizeof(imports[0]);
+  if (import_offset.value() > file_size ||
+      file_size - import_offset.value() < table_size) {
+    LOG(ERROR) << "Import descriptors lie outside of \"" << path.value()
+               << "\".";
+    return false;
+  }
+
+  base::win::ScopedHandle mapping(
+      ::CreateFileMapping(file.Get(), NULL, PAGE_READWRITE, 0, 0, NULL));
+  void* view = NULL;
+  if (mapping.IsValid())
+    view = ::MapViewOfFile(mapping.Get(), FILE_MAP_WRITE, 0, 0, file_size);
+  if (view == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map \"" << path.value() << "\": "
+               << common::LogWe(error);
+    return false;
+  }
+
+  uint8* image_data = reinterpret_cast<uint8*>(view);
+  if (table_size != 0)
+    ::memcpy(image_data + import_offset.value(), &imports[0], table_size);
+
+  // Finalize the image by updating the checksum.
+  LOG(INFO) << "Updating output image checksum.";
+  bool success = pe::PEFileWriter::UpdateChecksum(image_data, file_size);
+  if (!success)
+    LOG(ERROR) << "Failed to update image checksum.";
+
+  CHECK(::UnmapViewOfFile(view));
+  return success;
+}
+
 }  // namespace
 
 bool SwapImportApp::ParseCommandLine(const CommandLine* cmd_line) {
@@ -88,124 +141,123 @@ bool SwapImportApp::ParseCommandLine(const CommandLine* cmd_line) {
 
 template <typename PEFileType>
 int SwapImportApp::SwapImports() {
-  // Parse the input file as a PE image.
-  PEFileType pe_file;
-  if (!pe_file.Init(input_image_)) {
-    LOG(ERROR) << "Failed to parse image as a PE file: "
-               << input_image_.value();
+  // The import descriptors, in their final order, and their location in the
+  // image file.
+  std::vector<IMAGE_IMPORT_DESCRIPTOR> imports;
+  pe::PEFile::FileOffsetAddress import_offset;
+
+  // Only the headers and the import directory are needed, so the input is
+  // mapped rather than read in its entirety. The mapping is released before
+  // the output is written, as both may refer to the same file.
+  {
+    PEFileType pe_file;
+    pe_file.set_memory_mapped(true);
+    if (!pe_file.Init(input_image_)) {
+      LOG(ERROR) << "Failed to parse image as a PE file: "
+                 << input_image_.value();
+      return 1;
+    }
+
+    if (!ReadAndSwapImports(pe_file, &import_offset, &imports))
       return 1;
   }
 
-  // Read the entire input into memory.
-  VLOG(1) << "Reading \"" << input_image_.value() << "\" into memory.";
-  int64 image_size = 0;
-  if (!base::GetFileSize(input_image_, &image_size)) {
-    LOG(ERROR) << "Failed to get image size: " << input_image_.value();
-    return 1;
+  // Copy the input to the output, unless they are one and the same.
+  if (core::CompareFilePaths(input_image_, output_image_) !=
+          core::kEquivalentFilePaths) {
+    VLOG(1) << "Copying \"" << input_image_.value() << "\" to \""
+            << output_image_.value() << "\".";
+    if (!base::CopyFile(input_image_, output_image_)) {
+      LOG(ERROR) << "Failed to copy \"" << input_image_.value() << "\" to \""
+                 << output_image_.value() << "\".";
+      return 1;
+    }
   }
-  std::vector<unsigned char> image(image_size, 0);
-  if (!base::ReadFile(input_image_,
-                           reinterpret_cast<char*>(image.data()),
-                           image_size)) {
-    LOG(ERROR) << "Failed to read image to memory: " << input_image_.value();
+
+  // Patch the descriptor table and the checksum in place.
+  LOG(INFO) << "Writing output to \"" << output_image_.value() << "\".";
+  if (!PatchImports(output_image_, import_offset, imports))
     return 1;
-  }
 
-  // Keeps track of matched imports, and how many have been swapped.
-  size_t imports_swapped = 0;
-  size_t imports_matched = 0;
+  return 0;
+}
+
+template <typename PEFileType>
+bool SwapImportApp::ReadAndSwapImports(
+    const PEFileType& pe_file,
+    pe::PEFile::FileOffsetAddress* import_offset,
+    std::vector<IMAGE_IMPORT_DESCRIPTOR>* imports) {
+  DCHECK_NE(reinterpret_cast<pe::PEFile::FileOffsetAddress*>(NULL),
+            import_offset);
+  DCHECK_NE(reinterpret_cast<std::vector<IMAGE_IMPORT_DESCRIPTOR>*>(NULL),
+            imports);
 
   // Look up the import directory.
   LOG(INFO) << "Processing NT headers.";
   const IMAGE_DATA_DIRECTORY* data_dir =
       pe_file.nt_headers()->OptionalHeader.DataDirectory +
           IMAGE_DIRECTORY_ENTRY_IMPORT;
-  if (data_dir->Size != 0) {
-    LOG(INFO) << "Processing imports.";
-
-    pe::PEFile::FileOffsetAddress import_offset;
-    if (!pe_file.Translate(
-            pe::PEFile::RelativeAddress(data_dir->VirtualAddress),
-            &import_offset)) {
-      LOG(ERROR) << "Failed to translate import directory address.";
-      return 1;
+  if (data_dir->Size == 0) {
+    LOG(ERROR) << "Image has no imports.";
+    return false;
+  }
+
+  LOG(INFO) << "Processing imports.";
+  pe::PEFile::RelativeAddress import_addr(data_dir->VirtualAddress);
+  if (!pe_file.Translate(import_addr, import_offset)) {
+    LOG(ERROR) << "Failed to translate import directory address.";
+    return false;
+  }
+
+  // Read the descriptors up to the terminating null entry.
+  size_t max_imports = data_dir->Size / sizeof(IMAGE_IMPORT_DESCRIPTOR);
+  imports->clear();
+  for (size_t i = 0; i < max_imports; ++i) {
+    IMAGE_IMPORT_DESCRIPTOR iid = {};
+    if (!pe_file.ReadImage(import_addr + i * sizeof(iid), &iid,
+                           sizeof(iid))) {
+      LOG(ERROR) << "Failed to read import descriptor " << i << ".";
+      return false;
     }
+    if (iid.Characteristics == 0)
+      break;
+    imports->push_back(iid);
+  }
 
-    // Walk over the imports.
-    IMAGE_IMPORT_DESCRIPTOR* imports_begin =
-        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
-            image.data() + import_offset.value());
-    IMAGE_IMPORT_DESCRIPTOR* imports_end =
-        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
-            image.data() + import_offset.value() + data_dir->Size);
-    IMAGE_IMPORT_DESCRIPTOR* imports = imports_begin;
-    size_t import_index = 0;
-    while (imports < imports_end && imports->Characteristics != 0) {
-      // Look up the import name.
-      pe::PEFile::FileOffsetAddress name_offset;
-      if (!pe_file.Translate(
-              pe::PEFile::RelativeAddress(imports->Name),
-              &name_offset)) {
-        LOG(ERROR) << "Failed to translate import name.";
-        return 1;
-      }
-
-      // Compare the import name.
-      const char* name = reinterpret_cast<const char*>(
-          image.data() + name_offset.value());
-      VLOG(1) << "Processing import " << import_index << " \""
-              << name << "\".";
-      if (base::strcasecmp(import_name_.c_str(), name) == 0) {
-        VLOG(1) << "Import " << import_index << " matches import name.";
-        ++imports_matched;
-
-        if (import_index > imports_swapped) {
-          // Do the actual swapping of the imports.
-          LOG(INFO) << "Swapping imports " << imports_swapped << " and "
-                    << import_index;
-
-          IMAGE_IMPORT_DESCRIPTOR temp_iid = *imports;
-          *imports = imports_begin[imports_swapped];
-          imports_begin[imports_swapped] = temp_iid;
-
-          ++imports_swapped;
-        }
-      }
-
-      ++imports;
-      ++import_index;
+  // Keeps track of matched imports, which are moved to the front of the table
+  // in the order in which they are encountered.
+  size_t imports_matched = 0;
+  for (size_t import_index = 0; import_index < imports->size();
+       ++import_index) {
+    IMAGE_IMPORT_DESCRIPTOR& iid = (*imports)[import_index];
+
+    // Look up and compare the import name.
+    std::string name;
+    if (!pe_file.ReadImageString(pe::PEFile::RelativeAddress(iid.Name),
+                                 &name)) {
+      LOG(ERROR) << "Failed to read import name.";
+      return false;
     }
+    VLOG(1) << "Processing import " << import_index << " \"" << name << "\".";
+    if (base::strcasecmp(import_name_.c_str(), name.c_str()) != 0)
+      continue;
+
+    VLOG(1) << "Import " << import_index << " matches import name.";
+    if (import_index > imports_matched) {
+      LOG(INFO) << "Swapping imports " << imports_matched << " and "
+                << import_index;
+      std::swap(iid, (*imports)[imports_matched]);
+    }
+    ++imports_matched;
   }
 
   // We expect to have matched the specified import at least once.
   if (imports_matched == 0) {
     LOG(ERROR) << "Did not find an import matching \"" << import_name_ << "\".";
-    return 1;
-  }
-
-  // Write the actual output.
-  LOG(INFO) << "Writing output to \"" << output_image_.value() << "\".";
-  base::ScopedFILE output(base::OpenFile(output_image_, "wb"));
-  if (output.get() == NULL) {
-    LOG(ERROR) << "Failed to open \"" << output_image_.value() << "\" for "
-               << "writing.";
-    return 1;
-  }
-  if (::fwrite(image.data(), sizeof(image[0]), image.size(), output.get()) !=
-          image.size()) {
-    LOG(ERROR) << "Failed to write output: " << output_image_.value();
-    return 1;
-  }
-  output.reset();
-
-  // Finalize the image by updating the checksum.
-  LOG(INFO) << "Updating output image checksum.";
-  if (!pe::PEFileWriter::UpdateFileChecksum(output_image_)) {
-    LOG(ERROR) << "Failed to update image checksum.";
-    return 1;
+    return false;
   }
 
-  return 0;
+  return true;
 }
 
 int SwapImportApp::Run() {
@@ -18,9 +18,14 @@
 #ifndef SYZYGY_SWAPIMPORT_SWAPIMPORT_APP_H_
 #define SYZYGY_SWAPIMPORT_SWAPIMPORT_APP_H_
 
+#include <windows.h>
+#include <string>
+#include <vector>
+
 #include "base/command_line.h"
 #include "base/files/file_path.h"
 #include "syzygy/application/application.h"
+#include "syzygy/pe/pe_file.h"
 
 namespace swapimport {
 
@@ -51,6 +56,17 @@ class SwapImportApp : public application::AppImplBase {
   // @name Implementation of import swapping.
   // @{
   template <typename PEFileType> int SwapImports();
+
+  // Reads the import descriptors of @p pe_file and moves those that match
+  // import_name_ to the front of the table, preserving their relative order.
+  // @param pe_file the input image.
+  // @param import_offset receives the file offset of the descriptor table.
+  // @param imports receives the reordered descriptors.
+  // @returns true on success, false otherwise.
+  template <typename PEFileType>
+  bool ReadAndSwapImports(const PEFileType& pe_file,
+                          pe::PEFile::FileOffsetAddress* import_offset,
+                          std::vector<IMAGE_IMPORT_DESCRIPTOR>* imports);
   // @}
 
   std::string import_name_;
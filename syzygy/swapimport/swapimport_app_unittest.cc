@@ -226,6 +226,19 @@ TEST_F(SwapImportAppTest, RunSucceedsOverwrite) {
   ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
 }
 
+TEST_F(SwapImportAppTest, RunSucceedsInPlace) {
+  ASSERT_TRUE(base::CopyFile(input_image_, output_image_));
+
+  cmd_line_.AppendSwitchPath("input-image", output_image_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_);
+  cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendArg("kernel32.dll");
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  ASSERT_NO_FATAL_FAILURE(ValidateImportsSwapped());
+}
+
 TEST_F(SwapImportAppTest, RunSucceeds64) {
   cmd_line_.AppendSwitch("x64");
   cmd_line_.AppendSwitchPath("input-image", input_image_64_);
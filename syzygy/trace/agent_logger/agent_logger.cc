@@ -21,6 +21,9 @@
 #include <dbghelp.h>
 #include <psapi.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "base/bind.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
@@ -28,7 +31,7 @@
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/dbghelp_util.h"
 #include "syzygy/common/rpc/helpers.h"
-#include "syzygy/pe/find.h"
+#include "syzygy/trace/common/minidump_memory_ranges.h"
 
 namespace trace {
 namespace agent_logger {
@@ -36,68 +39,117 @@ namespace agent_logger {
 namespace {
 
 using ::common::rpc::GetInstanceString;
+using trace::common::MiniDumpMemoryRange;
+using trace::common::MiniDumpMemoryRanges;
+
+// Reads a value from the memory of another process.
+// @param process The process to read from.
+// @param address The address of the value in the memory of @p process.
+// @param value Receives the value.
+// @returns true on success, false otherwise.
+template <typename T>
+bool ReadRemoteValue(HANDLE process, ULONG_PTR address, T* value) {
+  DCHECK(value != NULL);
+  SIZE_T bytes_read = 0;
+  if (!::ReadProcessMemory(process, reinterpret_cast<const void*>(address),
+                           value, sizeof(*value), &bytes_read) ||
+      bytes_read != sizeof(*value)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to read the memory of the dumped process: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  return true;
+}
 
-// A helper class to manage a SYMBOL_INFO structure.
-template <size_t max_name_len>
-class SymbolInfo {
- public:
-  SymbolInfo() {
-    COMPILE_ASSERT(max_name_len > 0, error_maximum_name_length_is_zero);
-    COMPILE_ASSERT(
-        sizeof(buf_) - sizeof(info_) >= max_name_len * sizeof(wchar_t),
-        error_not_enough_buffer_space_for_max_name_len_wchars);
-
-    ::memset(buf_, 0, sizeof(buf_));
-    info_.SizeOfStruct = sizeof(info_);
-    info_.MaxNameLen = max_name_len;
+// Reads the memory ranges of a targeted minidump from the dumped process.
+// @param process The dumped process.
+// @param exc_ptr The address of the EXCEPTION_POINTERS of the minidump, in the
+//     memory of @p process. The last parameter of the exception record is the
+//     address of a MiniDumpMemoryRanges record.
+// @param ranges Receives the memory ranges.
+// @returns true on success, false otherwise.
+bool ReadMiniDumpMemoryRanges(HANDLE process,
+                              DWORD exc_ptr,
+                              std::vector<MiniDumpMemoryRange>* ranges) {
+  DCHECK(ranges != NULL);
+
+  EXCEPTION_POINTERS pointers = {};
+  EXCEPTION_RECORD record = {};
+  if (!ReadRemoteValue(process, exc_ptr, &pointers) ||
+      !ReadRemoteValue(process,
+                       reinterpret_cast<ULONG_PTR>(pointers.ExceptionRecord),
+                       &record)) {
+    return false;
+  }
+  if (record.NumberParameters == 0 ||
+      record.NumberParameters > EXCEPTION_MAXIMUM_PARAMETERS) {
+    LOG(ERROR) << "The exception record has no memory ranges.";
+    return false;
   }
 
-  PSYMBOL_INFO Get() { return &info_; }
+  MiniDumpMemoryRanges header = {};
+  if (!ReadRemoteValue(
+          process, record.ExceptionInformation[record.NumberParameters - 1],
+          &header)) {
+    return false;
+  }
 
-  PSYMBOL_INFO operator->() { return &info_; }
+  ranges->resize(
+      std::min(header.count, trace::common::kMaxMiniDumpMemoryRanges));
+  if (ranges->empty())
+    return true;
+  SIZE_T size = ranges->size() * sizeof(MiniDumpMemoryRange);
+  SIZE_T bytes_read = 0;
+  if (!::ReadProcessMemory(process, reinterpret_cast<const void*>(
+                                        header.ranges),
+                           &ranges->at(0), size, &bytes_read) ||
+      bytes_read != size) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to read the memory ranges of the minidump: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+  return true;
+}
 
- private:
-  // SYMBOL_INFO is a variable length structure ending with a string (the
-  // name of the symbol). The SYMBOL_INFO struct itself only declares the
-  // first byte of the Name array, the rest we reserve by holding it in
-  // union with a properly sized underlying buffer.
-  union {
-    SYMBOL_INFO info_;
-    char buf_[sizeof(SYMBOL_INFO) + max_name_len * sizeof(wchar_t)];
-  };
+// The state of the MiniDumpWriteDump callback of a targeted minidump.
+struct TargetedMiniDumpState {
+  // The memory ranges to include in the minidump.
+  const std::vector<MiniDumpMemoryRange>* ranges;
+  // The index of the next range to hand to MiniDumpWriteDump.
+  size_t next_range;
 };
 
-void GetSymbolInfo(HANDLE process,
-                   DWORD frame_ptr,
-                   std::string* name,
-                   DWORD64* offset) {
-  DCHECK(frame_ptr != NULL);
-  DCHECK(name != NULL);
-  DCHECK(offset != NULL);
-
-  // Constants we'll need later.
-  static const size_t kMaxNameLength = 256;
-  SymbolInfo<kMaxNameLength> symbol;
-
-  // Lookup the symbol by address.
-  if (::SymFromAddr(process, frame_ptr, offset, symbol.Get())) {
-    base::SStringPrintf(name, "%s+%ld", symbol->Name, *offset);
-  } else {
-    base::SStringPrintf(name, "(unknown)+%ld", *offset);
-  }
-}
+// The MiniDumpWriteDump callback of a targeted minidump. This adds the memory
+// ranges of the minidump, one per MemoryCallback.
+BOOL CALLBACK TargetedMiniDumpCallback(PVOID param,
+                                       const PMINIDUMP_CALLBACK_INPUT input,
+                                       PMINIDUMP_CALLBACK_OUTPUT output) {
+  TargetedMiniDumpState* state = reinterpret_cast<TargetedMiniDumpState*>(
+      param);
+  DCHECK(state != NULL);
+
+  switch (input->CallbackType) {
+    case MemoryCallback: {
+      // This is invoked until it returns FALSE.
+      if (state->next_range == state->ranges->size())
+        return FALSE;
+      const MiniDumpMemoryRange& range = state->ranges->at(state->next_range);
+      ++state->next_range;
+      output->MemoryBase = range.address;
+      output->MemorySize = range.size;
+      return TRUE;
+    }
 
-void GetLineInfo(HANDLE process, DWORD_PTR frame, std::string* line_info) {
-  DCHECK(frame != NULL);
-  DCHECK(line_info != NULL);
+    case ReadMemoryFailureCallback:
+      // Some of the ranges may be protected, as is the case of quarantined
+      // blocks. Skip them rather than failing the whole minidump.
+      output->Status = S_OK;
+      return TRUE;
 
-  DWORD line_displacement = 0;
-  IMAGEHLP_LINE64 line = {};
-  line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
-  if (::SymGetLineFromAddr64(process, frame, &line_displacement, &line)) {
-    base::SStringPrintf(line_info, "%s:%d", line.FileName, line.LineNumber);
-  } else {
-    line_info->clear();
+    default:
+      return TRUE;
   }
 }
 
@@ -191,69 +243,24 @@ bool AgentLogger::AppendTrace(HANDLE process,
     return true;
   }
 
-  // TODO(rogerm): Add an RPC session to the logger and its interface. This
-  //     would serialize calls per process and provide a convenient mechanism
-  //     for ensuring SymInitialize/Cleanup are called exactly once per client
-  //     process.
-
-  base::AutoLock auto_lock(symbol_lock_);
+  ::common::AutoRecursiveLock auto_lock(*::common::GetDbgHelpLock());
 
-  // Initializes the symbols for the process:
-  //     - Defer symbol load until they're needed
-  //     - Use undecorated names
-  //     - Get line numbers
-  ::SymSetOptions(SYMOPT_DEFERRED_LOADS | SYMOPT_UNDNAME | SYMOPT_LOAD_LINES);
-  if (!::common::SymInitialize(process, NULL, true))
+  std::vector<Symbolizer::FrameSymbol> symbols;
+  if (!symbolizer_.Symbolize(process, trace_data, trace_length, &symbols))
     return false;
 
-  // Try to find the PDB of the running process, if it's found its path will be
-  // appended to the current symbol search path. It is necessary because the
-  // default search path doesn't include the directory of the caller by default.
-  // TODO(sebmarchand): Also append the path of the PDBs of the modules loaded
-  //     by the running process.
-  WCHAR temp_path[MAX_PATH];
-  if (::GetModuleFileNameEx(process, NULL, temp_path, MAX_PATH) != 0) {
-    base::FilePath module_path(temp_path);
-    base::FilePath temp_pdb_path;
-    if (pe::FindPdbForModule(module_path, &temp_pdb_path)) {
-      char current_search_path[1024];
-      if (!::SymGetSearchPath(process, current_search_path,
-          arraysize(current_search_path))) {
-        LOG(ERROR) << "Unable to get the current symbol search path.";
-        return false;
-      }
-      std::string new_pdb_search_path = std::string(current_search_path) + ";" +
-          temp_pdb_path.DirName().AsUTF8Unsafe();
-      if (!::SymSetSearchPath(process, new_pdb_search_path.c_str())) {
-        LOG(ERROR) << "Unable to set the symbol search path.";
-        return false;
-      }
-    }
-  }
-
   // Append each line of the trace to the message string.
   for (size_t i = 0; i < trace_length; ++i) {
     DWORD frame_ptr = trace_data[i];
-    DWORD64 offset = 0;
-    std::string symbol_name;
-    std::string line_info;
-
-    GetSymbolInfo(process, frame_ptr, &symbol_name, &offset);
-    GetLineInfo(process, frame_ptr, &line_info);
-
+    const Symbolizer::FrameSymbol& symbol = symbols[i];
     base::StringAppendF(message,
-                        "    #%d 0x%012llx in %s%s%s\n",
+                        "    #%d 0x%012llx in %s+%lld%s%s\n",
                         i,
-                        frame_ptr + offset,
-                        symbol_name.c_str(),
-                        line_info.empty() ? "" : " ",
-                        line_info.c_str());
-  }
-
-  if (!::SymCleanup(process)) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "SymCleanup failed: " << ::common::LogWe(error) << ".";
-    return false;
+                        frame_ptr + symbol.displacement,
+                        symbol.name.c_str(),
+                        symbol.displacement,
+                        symbol.line_info.empty() ? "" : " ",
+                        symbol.line_info.c_str());
   }
 
   return true;
@@ -279,14 +286,16 @@ bool AgentLogger::CaptureRemoteTrace(HANDLE process,
     return true;
   }
 
-  base::AutoLock auto_lock(symbol_lock_);
+  ::common::AutoRecursiveLock auto_lock(*::common::GetDbgHelpLock());
 
   // Initializes the symbols for the process:
   //     - Defer symbol load until they're needed
   //     - Use undecorated names
   //     - Get line numbers
+  // The process isn't invaded; instead the modules are loaded on demand by
+  // the module base callback, so only those on the stack are loaded.
   ::SymSetOptions(SYMOPT_DEFERRED_LOADS | SYMOPT_UNDNAME | SYMOPT_LOAD_LINES);
-  if (!::common::SymInitialize(process, NULL, true))
+  if (!::common::SymInitialize(process, NULL, false))
     return false;
 
   // Initialize a stack frame structure.
@@ -315,7 +324,7 @@ bool AgentLogger::CaptureRemoteTrace(HANDLE process,
                        context,
                        &ReadProcessMemoryProc64,
                        &::SymFunctionTableAccess64,
-                       &::SymGetModuleBase64,
+                       &::common::GetModuleBaseLoadingModules,
                        NULL)) {
     trace_data->push_back(stack_frame.AddrPC.Offset);
   }
@@ -387,15 +396,28 @@ bool AgentLogger::SaveMiniDump(HANDLE process,
       return false;
     }
 
+    // A targeted minidump adds the memory ranges requested by the process to
+    // the normal minidump. If they can't be read then a normal minidump is
+    // generated.
+    std::vector<MiniDumpMemoryRange> ranges;
+    TargetedMiniDumpState targeted_state = { &ranges, 0 };
+    MINIDUMP_CALLBACK_INFORMATION targeted_callback = {
+        &TargetedMiniDumpCallback, &targeted_state };
+    MINIDUMP_CALLBACK_INFORMATION* callback = NULL;
+    if ((flags & trace::common::kSaveMiniDumpTargetedMemory) != 0) {
+      if (ReadMiniDumpMemoryRanges(process, exc_ptr, &ranges))
+        callback = &targeted_callback;
+    }
+
     // Access to ::MiniDumpWriteDump (and all DbgHelp functions) must be
     // serialized.
-    base::AutoLock auto_lock(symbol_lock_);
+    ::common::AutoRecursiveLock auto_lock(*::common::GetDbgHelpLock());
 
     // Generate the minidump.
     MINIDUMP_EXCEPTION_INFORMATION exc_info = {
         tid, reinterpret_cast<EXCEPTION_POINTERS*>(exc_ptr), true };
     if (!::MiniDumpWriteDump(process, pid, temp_file, ::MiniDumpNormal,
-                             &exc_info, NULL, NULL)) {
+                             &exc_info, NULL, callback)) {
       // Note that the error set by ::MiniDumpWriteDump is an HRESULT, not a
       // Windows error. even though it is returned via ::GetLastError().
       // http://msdn.microsoft.com/en-us/library/windows/desktop/ms680360.aspx
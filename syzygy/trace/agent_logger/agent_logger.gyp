@@ -27,6 +27,8 @@
         'agent_logger_app.h',
         'agent_logger_rpc_impl.cc',
         'agent_logger_rpc_impl.h',
+        'symbolizer.cc',
+        'symbolizer.h',
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
@@ -44,6 +46,7 @@
       'sources': [
         'agent_logger_app_unittest.cc',
         'agent_logger_unittest.cc',
+        'symbolizer_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
       'dependencies': [
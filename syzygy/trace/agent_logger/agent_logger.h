@@ -24,6 +24,7 @@
 #include "base/process/process.h"
 #include "base/strings/string_piece.h"
 #include "base/threading/platform_thread.h"
+#include "syzygy/trace/agent_logger/symbolizer.h"
 #include "syzygy/trace/common/service.h"
 #include "syzygy/trace/rpc/logger_rpc.h"
 
@@ -65,7 +66,7 @@ class AgentLogger : public trace::common::Service {
   // Note that the DWORD elements of @p trace_data are really void* values
   // pointing to the frame pointers of a call stack in @p process.
   //
-  // Calls to this method are serialized under symbol_lock_.
+  // Calls to this method are serialized under the dbghelp lock.
   bool AppendTrace(HANDLE process,
                    const DWORD* trace_data,
                    size_t trace_length,
@@ -92,7 +93,7 @@ class AgentLogger : public trace::common::Service {
   // @param exc_ptr The pointer value (in the memory address space of the
   //     process to dump) of the exception record for which the dump is being
   //     generated.
-  // @param flags Reserved.
+  // @param flags A combination of trace::common::SaveMiniDumpFlags.
   // @returns true on success, false otherwise.
   bool SaveMiniDump(HANDLE process,
                     base::ProcessId pid,
@@ -135,13 +136,12 @@ class AgentLogger : public trace::common::Service {
   // The lock used to serializes writes to destination_;
   base::Lock write_lock_;
 
-  // The lock used to serialize access to the debug help library used to
-  // symbolize traces.
-  base::Lock symbol_lock_;
-
   // Indicates if we should symbolize the stack traces. Defaults to true.
   bool symbolize_stack_traces_;
 
+  // Symbolizes and caches the stack traces. Accessed under the dbghelp lock.
+  Symbolizer symbolizer_;
+
   // Signaled once the agent has successfully initialized.
   base::win::ScopedHandle started_event_;
 
@@ -0,0 +1,343 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/agent_logger/symbolizer.h"
+
+#include <dbghelp.h>
+#include <psapi.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/files/file_path.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/common/align.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/common/dbghelp_util.h"
+#include "syzygy/pe/find.h"
+#include "syzygy/pe/pe_data.h"
+
+namespace trace {
+namespace agent_logger {
+
+namespace {
+
+// The name of the functions that can't be found.
+const char kUnknownSymbolName[] = "(unknown)";
+
+// The address of the first module in the dbghelp session, and the alignment
+// of the modules in the session.
+const DWORD64 kFirstSessionBase = 0x10000000;
+const size_t kSessionModuleAlignment = 64 * 1024;
+
+// The maximum number of debug directory entries of a module that are
+// inspected when looking for its CodeView record.
+const size_t kMaxDebugDirectoryEntries = 16;
+
+// A helper class to manage a SYMBOL_INFO structure.
+template <size_t max_name_len>
+class SymbolInfo {
+ public:
+  SymbolInfo() {
+    COMPILE_ASSERT(max_name_len > 0, error_maximum_name_length_is_zero);
+    COMPILE_ASSERT(
+        sizeof(buf_) - sizeof(info_) >= max_name_len * sizeof(wchar_t),
+        error_not_enough_buffer_space_for_max_name_len_wchars);
+
+    ::memset(buf_, 0, sizeof(buf_));
+    info_.SizeOfStruct = sizeof(info_);
+    info_.MaxNameLen = max_name_len;
+  }
+
+  PSYMBOL_INFO Get() { return &info_; }
+
+  PSYMBOL_INFO operator->() { return &info_; }
+
+ private:
+  // SYMBOL_INFO is a variable length structure ending with a string (the
+  // name of the symbol). The SYMBOL_INFO struct itself only declares the
+  // first byte of the Name array, the rest we reserve by holding it in
+  // union with a properly sized underlying buffer.
+  union {
+    SYMBOL_INFO info_;
+    char buf_[sizeof(SYMBOL_INFO) + max_name_len * sizeof(wchar_t)];
+  };
+};
+
+// Reads a value from the memory of a process.
+// @param process The process to read from.
+// @param address The address of the value in the memory of @p process.
+// @param value Receives the value.
+// @returns true on success, false otherwise.
+template <typename T>
+bool ReadRemoteValue(HANDLE process, DWORD address, T* value) {
+  DCHECK(value != NULL);
+  SIZE_T bytes_read = 0;
+  return ::ReadProcessMemory(process, reinterpret_cast<const void*>(address),
+                             value, sizeof(*value), &bytes_read) &&
+      bytes_read == sizeof(*value);
+}
+
+// Appends a directory to the symbol search path of a dbghelp session, unless
+// it's already there.
+// @param session The dbghelp session.
+// @param dir The directory to append.
+void AppendToSearchPath(HANDLE session, const base::FilePath& dir) {
+  char current_search_path[1024];
+  if (!::SymGetSearchPath(session, current_search_path,
+                          arraysize(current_search_path))) {
+    LOG(ERROR) << "Unable to get the current symbol search path.";
+    return;
+  }
+
+  std::string new_dir = dir.AsUTF8Unsafe();
+  std::string search_path(current_search_path);
+  if (search_path.find(new_dir) != std::string::npos)
+    return;
+  search_path += ";" + new_dir;
+  if (!::SymSetSearchPath(session, search_path.c_str()))
+    LOG(ERROR) << "Unable to set the symbol search path.";
+}
+
+}  // namespace
+
+bool Symbolizer::ModuleKey::operator<(const ModuleKey& other) const {
+  int signature = ::memcmp(&pdb_signature, &other.pdb_signature,
+                           sizeof(pdb_signature));
+  if (signature != 0)
+    return signature < 0;
+  if (pdb_age != other.pdb_age)
+    return pdb_age < other.pdb_age;
+  if (time_date_stamp != other.time_date_stamp)
+    return time_date_stamp < other.time_date_stamp;
+  return image_size < other.image_size;
+}
+
+Symbolizer::Symbolizer()
+    : session_(reinterpret_cast<HANDLE>(this)),
+      session_initialized_(false),
+      next_session_base_(kFirstSessionBase) {
+}
+
+Symbolizer::~Symbolizer() {
+  if (session_initialized_ && !::SymCleanup(session_)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "SymCleanup failed: " << ::common::LogWe(error) << ".";
+  }
+}
+
+bool Symbolizer::Symbolize(HANDLE process,
+                           const DWORD* frames,
+                           size_t frame_count,
+                           std::vector<FrameSymbol>* symbols) {
+  DCHECK(frames != NULL || frame_count == 0);
+  DCHECK(symbols != NULL);
+
+  symbols->clear();
+  symbols->resize(frame_count);
+  if (!InitSession())
+    return false;
+
+  // Recursive functions and common callers make frames repeat within a trace,
+  // so each distinct frame is only symbolized once.
+  typedef std::map<DWORD, size_t> FirstOccurrenceMap;
+  FirstOccurrenceMap first_occurrences;
+  for (size_t i = 0; i < frame_count; ++i) {
+    FrameSymbol& symbol = symbols->at(i);
+    std::pair<FirstOccurrenceMap::iterator, bool> first_occurrence =
+        first_occurrences.insert(std::make_pair(frames[i], i));
+    if (!first_occurrence.second) {
+      symbol = symbols->at(first_occurrence.first->second);
+      continue;
+    }
+
+    DWORD module_base = 0;
+    Module* module = FindModule(process, frames[i], &module_base);
+    if (module == NULL || module->session_base == 0) {
+      symbol.name = kUnknownSymbolName;
+      continue;
+    }
+
+    uint32 offset = frames[i] - module_base;
+    std::pair<std::map<uint32, FrameSymbol>::iterator, bool> cached =
+        module->frames.insert(std::make_pair(offset, FrameSymbol()));
+    if (cached.second)
+      LookupSymbol(module->session_base + offset, &cached.first->second);
+    symbol = cached.first->second;
+  }
+
+  return true;
+}
+
+Symbolizer::Module* Symbolizer::FindModule(HANDLE process,
+                                           DWORD address,
+                                           DWORD* module_base) {
+  DCHECK(module_base != NULL);
+
+  // The allocation containing the code of a module is the image of the
+  // module, which starts with its headers.
+  MEMORY_BASIC_INFORMATION memory_info = {};
+  if (::VirtualQueryEx(process, reinterpret_cast<const void*>(address),
+                       &memory_info, sizeof(memory_info)) !=
+          sizeof(memory_info) ||
+      memory_info.Type != MEM_IMAGE) {
+    return NULL;
+  }
+  DWORD base = reinterpret_cast<DWORD>(memory_info.AllocationBase);
+
+  ModuleKey key = {};
+  if (!ReadModuleKey(process, base, &key))
+    return NULL;
+
+  std::pair<ModuleMap::iterator, bool> result =
+      modules_.insert(std::make_pair(key, Module()));
+  Module* module = &result.first->second;
+  if (result.second)
+    module->session_base = LoadModule(process, base, key.image_size);
+
+  *module_base = base;
+  return module;
+}
+
+bool Symbolizer::ReadModuleKey(HANDLE process,
+                               DWORD module_base,
+                               ModuleKey* key) {
+  DCHECK(key != NULL);
+
+  IMAGE_DOS_HEADER dos_header = {};
+  if (!ReadRemoteValue(process, module_base, &dos_header) ||
+      dos_header.e_magic != IMAGE_DOS_SIGNATURE) {
+    return false;
+  }
+  IMAGE_NT_HEADERS32 nt_headers = {};
+  if (!ReadRemoteValue(process, module_base + dos_header.e_lfanew,
+                       &nt_headers) ||
+      nt_headers.Signature != IMAGE_NT_SIGNATURE) {
+    return false;
+  }
+
+  ::memset(key, 0, sizeof(*key));
+  key->time_date_stamp = nt_headers.FileHeader.TimeDateStamp;
+  key->image_size = nt_headers.OptionalHeader.SizeOfImage;
+
+  // Look for the CodeView record of the module, which identifies its PDB.
+  const IMAGE_DATA_DIRECTORY& debug_directory =
+      nt_headers.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG];
+  size_t entry_count = std::min(
+      debug_directory.Size / sizeof(IMAGE_DEBUG_DIRECTORY),
+      kMaxDebugDirectoryEntries);
+  for (size_t i = 0; i < entry_count; ++i) {
+    IMAGE_DEBUG_DIRECTORY entry = {};
+    if (!ReadRemoteValue(process,
+                         module_base + debug_directory.VirtualAddress +
+                             i * sizeof(entry),
+                         &entry)) {
+      break;
+    }
+    if (entry.Type != IMAGE_DEBUG_TYPE_CODEVIEW ||
+        entry.AddressOfRawData == 0 ||
+        entry.SizeOfData < offsetof(pe::CvInfoPdb70, pdb_file_name)) {
+      continue;
+    }
+
+    pe::CvInfoPdb70 cv_info = {};
+    if (ReadRemoteValue(process, module_base + entry.AddressOfRawData,
+                        &cv_info) &&
+        cv_info.cv_signature == pe::kPdb70Signature) {
+      key->pdb_signature = cv_info.signature;
+      key->pdb_age = cv_info.pdb_age;
+    }
+    break;
+  }
+
+  return true;
+}
+
+DWORD64 Symbolizer::LoadModule(HANDLE process,
+                               DWORD module_base,
+                               uint32 image_size) {
+  wchar_t module_path[MAX_PATH];
+  if (::GetModuleFileNameEx(process, reinterpret_cast<HMODULE>(module_base),
+                            module_path, arraysize(module_path)) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to get the path of the module at 0x"
+               << std::hex << module_base << std::dec << ": "
+               << ::common::LogWe(error) << ".";
+    return 0;
+  }
+
+  // The default search path doesn't include the directory of the PDB of the
+  // module when it isn't next to the module, so it's appended to it.
+  base::FilePath pdb_path;
+  if (pe::FindPdbForModule(base::FilePath(module_path), &pdb_path) &&
+      !pdb_path.empty()) {
+    AppendToSearchPath(session_, pdb_path.DirName());
+  }
+
+  DWORD64 session_base = next_session_base_;
+  if (::SymLoadModuleExW(session_, NULL, module_path, NULL, session_base,
+                         image_size, NULL, 0) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Unable to load the symbols of " << module_path << ": "
+               << ::common::LogWe(error) << ".";
+    return 0;
+  }
+  next_session_base_ += ::common::AlignUp(image_size, kSessionModuleAlignment);
+
+  return session_base;
+}
+
+void Symbolizer::LookupSymbol(DWORD64 address, FrameSymbol* symbol) {
+  DCHECK(symbol != NULL);
+
+  static const size_t kMaxNameLength = 256;
+  SymbolInfo<kMaxNameLength> symbol_info;
+  symbol->displacement = 0;
+  if (::SymFromAddr(session_, address, &symbol->displacement,
+                    symbol_info.Get())) {
+    symbol->name = symbol_info->Name;
+  } else {
+    symbol->name = kUnknownSymbolName;
+  }
+
+  DWORD line_displacement = 0;
+  IMAGEHLP_LINE64 line = {};
+  line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+  if (::SymGetLineFromAddr64(session_, address, &line_displacement, &line)) {
+    base::SStringPrintf(&symbol->line_info, "%s:%d", line.FileName,
+                        line.LineNumber);
+  } else {
+    symbol->line_info.clear();
+  }
+}
+
+bool Symbolizer::InitSession() {
+  if (session_initialized_)
+    return true;
+
+  // Initializes the symbols of the session:
+  //     - Defer symbol load until they're needed
+  //     - Use undecorated names
+  //     - Get line numbers
+  ::SymSetOptions(SYMOPT_DEFERRED_LOADS | SYMOPT_UNDNAME | SYMOPT_LOAD_LINES);
+  if (!::common::SymInitialize(session_, NULL, false))
+    return false;
+
+  session_initialized_ = true;
+  return true;
+}
+
+}  // namespace agent_logger
+}  // namespace trace
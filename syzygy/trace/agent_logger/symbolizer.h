@@ -0,0 +1,153 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// This file declares the trace::agent_logger::Symbolizer class, which
+// symbolizes the stack traces sent to the logger.
+
+#ifndef SYZYGY_TRACE_AGENT_LOGGER_SYMBOLIZER_H_
+#define SYZYGY_TRACE_AGENT_LOGGER_SYMBOLIZER_H_
+
+#include <windows.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace trace {
+namespace agent_logger {
+
+// Symbolizes the stack traces of the processes that use the logger.
+//
+// The modules of the processes are identified by the signature of their PDB,
+// and their symbols are loaded once, in a dbghelp session that belongs to the
+// symbolizer rather than to any process. The symbols of the frames are cached
+// by module and by offset in the module, so the frames that were already seen
+// in any process running the same modules are symbolized without calling into
+// dbghelp. In particular, repeated stack traces are entirely served from the
+// cache.
+//
+// This uses dbghelp, so calls to Symbolize must be serialized with the other
+// uses of dbghelp.
+class Symbolizer {
+ public:
+  // The symbol of a frame.
+  struct FrameSymbol {
+    // The name of the function containing the frame, or "(unknown)".
+    std::string name;
+    // The offset of the frame in the function.
+    uint64 displacement;
+    // The source file and line of the frame, formatted as "file:line", or
+    // empty if they are unknown.
+    std::string line_info;
+  };
+
+  Symbolizer();
+  ~Symbolizer();
+
+  // Symbolizes the frames of a stack trace. Each frame is only looked up
+  // once, no matter how many times it appears in the trace.
+  // @param process An open handle to the process, with at least the
+  //     PROCESS_QUERY_INFORMATION and PROCESS_VM_READ access rights.
+  // @param frames The return addresses of the stack trace, in the memory of
+  //     @p process.
+  // @param frame_count The number of frames in @p frames.
+  // @param symbols Receives the symbol of each frame.
+  // @returns true on success, false if the symbols can't be loaded at all.
+  //     Frames that can't be symbolized are still described as unknown.
+  bool Symbolize(HANDLE process,
+                 const DWORD* frames,
+                 size_t frame_count,
+                 std::vector<FrameSymbol>* symbols);
+
+ protected:
+  // Identifies a module independently of the process that loaded it and of
+  // its address.
+  struct ModuleKey {
+    // The signature and age of the PDB of the module, or zero if the module
+    // has no CodeView record.
+    GUID pdb_signature;
+    uint32 pdb_age;
+    // The time stamp and image size of the module, which tell apart modules
+    // without a PDB.
+    uint32 time_date_stamp;
+    uint32 image_size;
+
+    bool operator<(const ModuleKey& other) const;
+  };
+
+  // A module whose symbols were looked up.
+  struct Module {
+    // The address of the module in the dbghelp session of the symbolizer, or
+    // zero if the symbols of the module failed to load.
+    DWORD64 session_base;
+    // The symbols of the frames that were seen, by offset in the module.
+    std::map<uint32, FrameSymbol> frames;
+  };
+  typedef std::map<ModuleKey, Module> ModuleMap;
+
+  // Finds the module containing an address of a process, loading its symbols
+  // if it wasn't seen before.
+  // @param process The process.
+  // @param address The address, in the memory of @p process.
+  // @param module_base Receives the address of the module in @p process.
+  // @returns the module, or NULL if @p address isn't in a module.
+  Module* FindModule(HANDLE process, DWORD address, DWORD* module_base);
+
+  // Reads the key of a module of a process.
+  // @param process The process.
+  // @param module_base The address of the module in @p process.
+  // @param key Receives the key of the module.
+  // @returns true on success, false otherwise.
+  static bool ReadModuleKey(HANDLE process, DWORD module_base, ModuleKey* key);
+
+  // Loads the symbols of a module into the dbghelp session.
+  // @param process The process that loaded the module.
+  // @param module_base The address of the module in @p process.
+  // @param image_size The size of the module.
+  // @returns the address of the module in the session, or zero on failure.
+  DWORD64 LoadModule(HANDLE process, DWORD module_base, uint32 image_size);
+
+  // Looks up the symbol of a frame in the dbghelp session.
+  // @param address The address of the frame in the session.
+  // @param symbol Receives the symbol of the frame.
+  void LookupSymbol(DWORD64 address, FrameSymbol* symbol);
+
+  // Initializes the dbghelp session on first use.
+  // @returns true on success, false otherwise.
+  bool InitSession();
+
+  // The handle identifying the dbghelp session of the symbolizer. This isn't
+  // a real process handle, which dbghelp allows when it doesn't have to
+  // enumerate the modules of the process itself.
+  HANDLE session_;
+  bool session_initialized_;
+
+  // The address at which the next module is loaded in the session. Modules
+  // are laid out one after the other, so that the modules of different
+  // processes never overlap.
+  DWORD64 next_session_base_;
+
+  // The modules that were seen.
+  ModuleMap modules_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Symbolizer);
+};
+
+}  // namespace agent_logger
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_AGENT_LOGGER_SYMBOLIZER_H_
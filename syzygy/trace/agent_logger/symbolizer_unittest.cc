@@ -0,0 +1,74 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/agent_logger/symbolizer.h"
+
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace agent_logger {
+
+namespace {
+
+class TestSymbolizer : public Symbolizer {
+ public:
+  using Symbolizer::modules_;
+};
+
+int __declspec(noinline) KnownFunction(int value) {
+  return value * 3 + 1;
+}
+
+DWORD KnownFunctionAddress() {
+  return reinterpret_cast<DWORD>(&KnownFunction);
+}
+
+}  // namespace
+
+TEST(SymbolizerTest, Symbolize) {
+  TestSymbolizer symbolizer;
+  EXPECT_EQ(7, KnownFunction(2));
+
+  // The same frame appears twice, along with a frame that isn't in a module.
+  const DWORD kFrames[] = {
+      KnownFunctionAddress() + 1, 0, KnownFunctionAddress() + 1 };
+  std::vector<Symbolizer::FrameSymbol> symbols;
+  ASSERT_TRUE(symbolizer.Symbolize(::GetCurrentProcess(), kFrames,
+                                   arraysize(kFrames), &symbols));
+  ASSERT_EQ(arraysize(kFrames), symbols.size());
+
+  EXPECT_NE(std::string::npos, symbols[0].name.find("KnownFunction"));
+  EXPECT_EQ(1u, symbols[0].displacement);
+  EXPECT_NE(std::string::npos,
+            symbols[0].line_info.find("symbolizer_unittest.cc"));
+  EXPECT_EQ("(unknown)", symbols[1].name);
+  EXPECT_EQ(symbols[0].name, symbols[2].name);
+  EXPECT_EQ(symbols[0].line_info, symbols[2].line_info);
+
+  // The frame is cached in the module of the test.
+  ASSERT_EQ(1u, symbolizer.modules_.size());
+  EXPECT_NE(0u, symbolizer.modules_.begin()->second.session_base);
+  EXPECT_EQ(1u, symbolizer.modules_.begin()->second.frames.size());
+
+  // Symbolizing again is served by the cache.
+  ASSERT_TRUE(symbolizer.Symbolize(::GetCurrentProcess(), kFrames, 1,
+                                   &symbols));
+  ASSERT_EQ(1u, symbols.size());
+  EXPECT_NE(std::string::npos, symbols[0].name.find("KnownFunction"));
+  EXPECT_EQ(1u, symbolizer.modules_.size());
+  EXPECT_EQ(1u, symbolizer.modules_.begin()->second.frames.size());
+}
+
+}  // namespace agent_logger
+}  // namespace trace
@@ -353,11 +353,71 @@ bool IsRpcSessionMandatoryForThisModule() {
   return false;
 }
 
+size_t GetNumSpareBuffers(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyRpcSpareBuffersEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return 0;
+  }
+
+  if (value <= 0)
+    return 0;
+
+  return value;
+}
+
+size_t GetNumSpareBuffersForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  return GetNumSpareBuffers(module_path);
+}
+
+bool IsBufferRingEnabled(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygyRpcBufferRingEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return false;
+  }
+
+  // Anything non-zero is treated as 'true'.
+  return value != 0;
+}
+
+bool IsBufferRingEnabledForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  return IsBufferRingEnabled(module_path);
+}
+
+bool IsSharedFrequencyDataEnabled(const base::FilePath& module_path) {
+  int value = 0;
+  if (!GetModuleValueFromEnvVar(kSyzygySharedFrequencyDataEnvVar, module_path,
+                                value, ToInt(), &value)) {
+    return false;
+  }
+
+  // Anything non-zero is treated as 'true'.
+  return value != 0;
+}
+
+bool IsSharedFrequencyDataEnabledForThisModule() {
+  base::FilePath module_path;
+  CHECK(GetModulePath(&__ImageBase, &module_path));
+
+  return IsSharedFrequencyDataEnabled(module_path);
+}
+
 bool InitializeRpcSession(RpcSession* rpc_session, TraceFileSegment* segment) {
   DCHECK(rpc_session != NULL);
 
   std::string id = trace::client::GetInstanceIdForThisModule();
   rpc_session->set_instance_id(base::UTF8ToWide(id));
+  rpc_session->set_num_spare_buffers(
+      trace::client::GetNumSpareBuffersForThisModule());
+  rpc_session->set_use_buffer_ring(
+      trace::client::IsBufferRingEnabledForThisModule());
   if (rpc_session->CreateSession(segment))
     return true;
 
@@ -184,6 +184,54 @@ bool IsRpcSessionMandatory(const base::FilePath& module_path);
 //     function is found.
 bool IsRpcSessionMandatoryForThisModule();
 
+// Given the path to a module, determines how many spare buffers its RPC
+// session should keep on hand. This works by looking at the
+// SYZYGY_RPC_SPARE_BUFFERS environment variable, which has the same format as
+// SYZYGY_RPC_SESSION_MANDATORY. See RpcSession::set_num_spare_buffers.
+//
+// @param module_path the path to the module for which we wish to determine the
+//     number of spare buffers.
+// @returns the number of spare buffers, zero if none are to be used.
+size_t GetNumSpareBuffers(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// GetNumSpareBuffers.
+// @returns the number of spare buffers for the module in which this function
+//     is found.
+size_t GetNumSpareBuffersForThisModule();
+
+// Given the path to a module, determines whether its RPC session should
+// exchange buffers through a shared-memory buffer ring. This works by looking
+// at the SYZYGY_RPC_BUFFER_RING environment variable, which has the same
+// format as SYZYGY_RPC_SESSION_MANDATORY. See RpcSession::set_use_buffer_ring.
+//
+// @param module_path the path to the module for which we wish to determine if
+//     the buffer ring is to be used.
+// @returns true if the buffer ring is to be used, false otherwise.
+bool IsBufferRingEnabled(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsBufferRingEnabled.
+// @returns true if the buffer ring is to be used for the module in which this
+//     function is found.
+bool IsBufferRingEnabledForThisModule();
+
+// Given the path to a module, determines whether the processes of the modules
+// it instruments should merge their frequency data in shared memory. This
+// works by looking at the SYZYGY_SHARED_FREQUENCY_DATA environment variable,
+// which has the same format as SYZYGY_RPC_SESSION_MANDATORY.
+//
+// @param module_path the path to the module for which we wish to determine if
+//     the frequency data is to be shared.
+// @returns true if the frequency data is to be shared, false otherwise.
+bool IsSharedFrequencyDataEnabled(const base::FilePath& module_path);
+
+// Encapsulates calls to GetModuleBaseAddress, GetModulePath and
+// IsSharedFrequencyDataEnabled.
+// @returns true if the frequency data is to be shared for the module in which
+//     this function is found.
+bool IsSharedFrequencyDataEnabledForThisModule();
+
 // Initializes an RPC session, automatically getting the instance ID and
 // determining if the session is mandatory. If the session is mandatory and it
 // is unable to be connected this will raise an exception and cause the process
@@ -73,6 +73,75 @@ class IsRpcSessionMandatoryTest : public testing::Test {
   scoped_ptr<base::Environment> env_;
 };
 
+class IsBufferRingEnabledTest : public testing::Test {
+ public:
+  IsBufferRingEnabledTest() : path_(L"C:\\path\\foo.exe") { }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    env_.reset(base::Environment::Create());
+  }
+
+  virtual void TearDown() OVERRIDE {
+    env_->UnSetVar(::kSyzygyRpcBufferRingEnvVar);
+    testing::Test::TearDown();
+  }
+
+  void SetEnvVar(const base::StringPiece& string) {
+    ASSERT_TRUE(env_->SetVar(::kSyzygyRpcBufferRingEnvVar,
+                             string.as_string()));
+  }
+
+  base::FilePath path_;
+  scoped_ptr<base::Environment> env_;
+};
+
+class IsSharedFrequencyDataEnabledTest : public testing::Test {
+ public:
+  IsSharedFrequencyDataEnabledTest() : path_(L"C:\\path\\foo.exe") { }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    env_.reset(base::Environment::Create());
+  }
+
+  virtual void TearDown() OVERRIDE {
+    env_->UnSetVar(::kSyzygySharedFrequencyDataEnvVar);
+    testing::Test::TearDown();
+  }
+
+  void SetEnvVar(const base::StringPiece& string) {
+    ASSERT_TRUE(env_->SetVar(::kSyzygySharedFrequencyDataEnvVar,
+                             string.as_string()));
+  }
+
+  base::FilePath path_;
+  scoped_ptr<base::Environment> env_;
+};
+
+class GetNumSpareBuffersTest : public testing::Test {
+ public:
+  GetNumSpareBuffersTest() : path_(L"C:\\path\\foo.exe") { }
+
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    env_.reset(base::Environment::Create());
+  }
+
+  virtual void TearDown() OVERRIDE {
+    env_->UnSetVar(::kSyzygyRpcSpareBuffersEnvVar);
+    testing::Test::TearDown();
+  }
+
+  void SetEnvVar(const base::StringPiece& string) {
+    ASSERT_TRUE(env_->SetVar(::kSyzygyRpcSpareBuffersEnvVar,
+                             string.as_string()));
+  }
+
+  base::FilePath path_;
+  scoped_ptr<base::Environment> env_;
+};
+
 }  // namespace
 
 TEST(GetModuleBaseAddressTest, WorksOnSelf) {
@@ -173,6 +242,66 @@ TEST_F(IsRpcSessionMandatoryTest, NonNumericIgnored) {
   EXPECT_FALSE(IsRpcSessionMandatory(path_));
 }
 
+TEST_F(GetNumSpareBuffersTest, ReturnsZeroForNoEnvVar) {
+  env_->UnSetVar(::kSyzygyRpcSpareBuffersEnvVar);
+  EXPECT_EQ(0u, GetNumSpareBuffers(path_));
+}
+
+TEST_F(GetNumSpareBuffersTest, ReturnsZeroForNoMatch) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("bar.exe,2;baz.exe,3"));
+  EXPECT_EQ(0u, GetNumSpareBuffers(path_));
+}
+
+TEST_F(GetNumSpareBuffersTest, ReturnsZeroForNegativeValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("-2"));
+  EXPECT_EQ(0u, GetNumSpareBuffers(path_));
+}
+
+TEST_F(GetNumSpareBuffersTest, ReturnsExactPathValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1;foo.exe,2;C:\\path\\foo.exe, 3 "));
+  EXPECT_EQ(3u, GetNumSpareBuffers(path_));
+}
+
+TEST_F(IsBufferRingEnabledTest, ReturnsFalseForNoEnvVar) {
+  env_->UnSetVar(::kSyzygyRpcBufferRingEnvVar);
+  EXPECT_FALSE(IsBufferRingEnabled(path_));
+}
+
+TEST_F(IsBufferRingEnabledTest, ReturnsFalseForNoMatch) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("bar.exe,1;baz.exe,1"));
+  EXPECT_FALSE(IsBufferRingEnabled(path_));
+}
+
+TEST_F(IsBufferRingEnabledTest, ReturnsTrueForDefaultValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1;bar.exe,0"));
+  EXPECT_TRUE(IsBufferRingEnabled(path_));
+}
+
+TEST_F(IsBufferRingEnabledTest, ReturnsExactPathValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1;foo.exe,1;C:\\path\\foo.exe,0"));
+  EXPECT_FALSE(IsBufferRingEnabled(path_));
+}
+
+TEST_F(IsSharedFrequencyDataEnabledTest, ReturnsFalseForNoEnvVar) {
+  env_->UnSetVar(::kSyzygySharedFrequencyDataEnvVar);
+  EXPECT_FALSE(IsSharedFrequencyDataEnabled(path_));
+}
+
+TEST_F(IsSharedFrequencyDataEnabledTest, ReturnsFalseForNoMatch) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("bar.exe,1;baz.exe,1"));
+  EXPECT_FALSE(IsSharedFrequencyDataEnabled(path_));
+}
+
+TEST_F(IsSharedFrequencyDataEnabledTest, ReturnsTrueForDefaultValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1;bar.exe,0"));
+  EXPECT_TRUE(IsSharedFrequencyDataEnabled(path_));
+}
+
+TEST_F(IsSharedFrequencyDataEnabledTest, ReturnsExactPathValue) {
+  ASSERT_NO_FATAL_FAILURE(SetEnvVar("1;foo.exe,1;C:\\path\\foo.exe,0"));
+  EXPECT_FALSE(IsSharedFrequencyDataEnabled(path_));
+}
+
 TEST(IsRpcSessionMandatoryThisModuleTest, WorksAsExpected) {
   base::FilePath self_path =
       ::testing::GetExeRelativePath(L"rpc_client_lib_unittests.exe");
@@ -27,14 +27,47 @@ extern "C" IMAGE_DOS_HEADER __ImageBase;
 namespace trace {
 namespace client {
 
+namespace {
+
+// How long to wait for the buffer exchange worker when closing the session.
+const DWORD kWorkerFlushTimeoutMs = 10000;
+
+BufferRingDescriptor ToBufferRingDescriptor(const CallTraceBuffer& buffer) {
+  BufferRingDescriptor descriptor = {};
+  descriptor.shared_memory_handle = buffer.shared_memory_handle;
+  descriptor.mapping_size = buffer.mapping_size;
+  descriptor.buffer_offset = buffer.buffer_offset;
+  descriptor.buffer_size = buffer.buffer_size;
+  return descriptor;
+}
+
+CallTraceBuffer ToCallTraceBuffer(const BufferRingDescriptor& descriptor) {
+  CallTraceBuffer buffer = {};
+  buffer.shared_memory_handle = descriptor.shared_memory_handle;
+  buffer.mapping_size = descriptor.mapping_size;
+  buffer.buffer_offset = descriptor.buffer_offset;
+  buffer.buffer_size = descriptor.buffer_size;
+  return buffer;
+}
+
+}  // namespace
+
 RpcSession::RpcSession()
     : rpc_binding_(NULL),
       session_handle_(NULL),
       flags_(0),
-      is_disabled_(false) {
+      is_disabled_(false),
+      num_spare_buffers_(0),
+      worker_scheduled_(false),
+      use_buffer_ring_(false),
+      rings_(NULL) {
+  ::memset(&statistics_, 0, sizeof(statistics_));
+  statistics_.source = TraceSessionStatistics::kClientSource;
+  statistics_.num_sessions = 1;
 }
 
 RpcSession::~RpcSession() {
+  CloseBufferRing();
   FreeSharedMemory();
 }
 
@@ -118,8 +151,9 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
   }
 
   if ((flags_ & TRACE_FLAG_BATCH_ENTER) != 0) {
-    // Batch mode is mutually exclusive of all other flags.
-    flags_ = TRACE_FLAG_BATCH_ENTER;
+    // Batch mode is mutually exclusive of all other flags, save for session
+    // statistics which don't affect the events captured.
+    flags_ &= TRACE_FLAG_BATCH_ENTER | TRACE_FLAG_SESSION_STATISTICS;
   }
 
   if (!MapSegmentBuffer(segment)) {
@@ -127,6 +161,25 @@ bool RpcSession::CreateSession(TraceFileSegment* segment) {
     return false;
   }
 
+  // The buffer ring supersedes the spare buffers. If the service doesn't
+  // support it we carry on with RPC calls.
+  if (use_buffer_ring_ && OpenBufferRing())
+    num_spare_buffers_ = 0;
+
+  if (num_spare_buffers_ != 0) {
+    worker_idle_event_.Set(::CreateEvent(NULL, TRUE, TRUE, NULL));
+    if (!worker_idle_event_.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(WARNING) << "Failed to create event, exchanging buffers "
+                   << "synchronously: " << ::common::LogWe(error) << ".";
+      num_spare_buffers_ = 0;
+    } else {
+      // Get the spare buffers ready ahead of the first exchange.
+      base::AutoLock lock(spare_buffers_lock_);
+      ScheduleWorkerUnlocked();
+    }
+  }
+
   return true;
 }
 
@@ -134,9 +187,11 @@ bool RpcSession::AllocateBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  base::TimeTicks start = base::TimeTicks::Now();
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_AllocateBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
+  RecordWaitTime(start);
 
   return succeeded ? MapSegmentBuffer(segment) : false;
 }
@@ -151,10 +206,12 @@ bool RpcSession::AllocateBuffer(size_t min_size, TraceFileSegment* segment) {
   const size_t kHeaderSize = sizeof(RecordPrefix) +
       sizeof(TraceFileSegmentHeader);
 
+  base::TimeTicks start = base::TimeTicks::Now();
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_AllocateLargeBuffer,
                                session_handle_, min_size + kHeaderSize,
                                &segment->buffer_info).succeeded();
+  RecordWaitTime(start);
   if (!succeeded)
     return false;
 
@@ -171,9 +228,55 @@ bool RpcSession::ExchangeBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  RecordCommit(*segment);
+
+  if (IsUsingBufferRing()) {
+    // If the commit ring is full the service has fallen behind, and the
+    // buffer is exchanged through an RPC call instead.
+    if (PushBufferRing(ToBufferRingDescriptor(segment->buffer_info),
+                       &rings_->commit_ring)) {
+      ::SetEvent(commit_event_.Get());
+
+      BufferRingDescriptor descriptor = {};
+      if (!PopBufferRing(&rings_->free_ring, &descriptor))
+        return AllocateBuffer(segment);
+
+      segment->buffer_info = ToCallTraceBuffer(descriptor);
+      return MapSegmentBuffer(segment);
+    }
+  }
+
+  if (IsExchangingAsynchronously()) {
+    CallTraceBuffer spare = {};
+    bool have_spare = false;
+    {
+      base::AutoLock lock(spare_buffers_lock_);
+      pending_commits_.push_back(segment->buffer_info);
+      if (!spare_buffers_.empty()) {
+        spare = spare_buffers_.back();
+        spare_buffers_.pop_back();
+        have_spare = true;
+      }
+      ScheduleWorkerUnlocked();
+    }
+
+    // If the worker hasn't caught up, allocate a buffer synchronously. The
+    // full buffer still goes through the worker, so that it can't overtake
+    // the ones this thread handed in before it.
+    if (!have_spare)
+      return AllocateBuffer(segment);
+
+    // Remapping the spare is cheap, as its view is already mapped, and
+    // rewrites its segment header for this thread.
+    segment->buffer_info = spare;
+    return MapSegmentBuffer(segment);
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
   bool succeeded =
       ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer, session_handle_,
                                &segment->buffer_info).succeeded();
+  RecordWaitTime(start);
 
   return succeeded ? MapSegmentBuffer(segment) : false;
 }
@@ -182,6 +285,22 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
   DCHECK(IsTracing());
   DCHECK(segment != NULL);
 
+  RecordCommit(*segment);
+
+  if (IsUsingBufferRing() &&
+      PushBufferRing(ToBufferRingDescriptor(segment->buffer_info),
+                     &rings_->commit_ring)) {
+    ::SetEvent(commit_event_.Get());
+    ::memset(&segment->buffer_info, 0, sizeof(segment->buffer_info));
+    return true;
+  }
+
+  if (IsExchangingAsynchronously()) {
+    QueueCommit(segment->buffer_info);
+    ::memset(&segment->buffer_info, 0, sizeof(segment->buffer_info));
+    return true;
+  }
+
   return ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer, session_handle_,
                                   &segment->buffer_info).succeeded();
 }
@@ -189,8 +308,16 @@ bool RpcSession::ReturnBuffer(TraceFileSegment* segment) {
 bool RpcSession::CloseSession() {
   DCHECK(IsTracing());
 
+  FlushSpareBuffers();
+
+  if (IsEnabled(TRACE_FLAG_SESSION_STATISTICS) && !WriteStatistics())
+    LOG(ERROR) << "Failed to write the session statistics.";
+
+  // The service commits whatever is left in the buffer ring as the session
+  // closes.
   bool succeeded = ::common::rpc::InvokeRpc(CallTraceClient_CloseSession,
                                             &session_handle_).succeeded();
+  CloseBufferRing();
 
   ignore_result(::RpcBindingFree(&rpc_binding_));
   rpc_binding_ = NULL;
@@ -198,6 +325,236 @@ bool RpcSession::CloseSession() {
   return succeeded;
 }
 
+bool RpcSession::OpenBufferRing() {
+  DCHECK(IsTracing());
+  DCHECK(rings_ == NULL);
+
+  unsigned long ring_handle = 0;
+  unsigned long ring_size = 0;
+  unsigned long commit_event = 0;
+  bool succeeded =
+      ::common::rpc::InvokeRpc(CallTraceClient_OpenBufferRing, session_handle_,
+                               &ring_handle, &ring_size,
+                               &commit_event).succeeded();
+  if (!succeeded) {
+    LOG(WARNING) << "Failed to open buffer ring, exchanging buffers through "
+                 << "RPC calls.";
+    return false;
+  }
+
+  ring_handle_.Set(reinterpret_cast<HANDLE>(ring_handle));
+  commit_event_.Set(reinterpret_cast<HANDLE>(commit_event));
+  if (ring_size != sizeof(BufferRings)) {
+    LOG(ERROR) << "Buffer ring has an unexpected size, exchanging buffers "
+               << "through RPC calls.";
+    ring_handle_.Close();
+    commit_event_.Close();
+    return false;
+  }
+
+  rings_ = reinterpret_cast<BufferRings*>(
+      ::MapViewOfFile(ring_handle_.Get(), FILE_MAP_WRITE, 0, 0, ring_size));
+  if (rings_ == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer ring: " << ::common::LogWe(error)
+               << ".";
+    ring_handle_.Close();
+    commit_event_.Close();
+    return false;
+  }
+
+  return true;
+}
+
+void RpcSession::CloseBufferRing() {
+  if (rings_ == NULL)
+    return;
+
+  if (::UnmapViewOfFile(rings_) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to unmap buffer ring: " << ::common::LogWe(error)
+                 << ".";
+  }
+  rings_ = NULL;
+  ring_handle_.Close();
+  commit_event_.Close();
+}
+
+void RpcSession::QueueCommit(const CallTraceBuffer& buffer) {
+  base::AutoLock lock(spare_buffers_lock_);
+  pending_commits_.push_back(buffer);
+  ScheduleWorkerUnlocked();
+}
+
+void RpcSession::ScheduleWorkerUnlocked() {
+  spare_buffers_lock_.AssertAcquired();
+  DCHECK(worker_idle_event_.IsValid());
+
+  if (worker_scheduled_)
+    return;
+
+  worker_scheduled_ = true;
+  ::ResetEvent(worker_idle_event_.Get());
+  if (!::QueueUserWorkItem(&WorkerCallback, this, WT_EXECUTEDEFAULT)) {
+    // Anything left in the queue gets committed when the session closes.
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to queue buffer exchange worker: "
+               << ::common::LogWe(error) << ".";
+    worker_scheduled_ = false;
+    ::SetEvent(worker_idle_event_.Get());
+  }
+}
+
+// static
+DWORD WINAPI RpcSession::WorkerCallback(void* param) {
+  DCHECK(param != NULL);
+  static_cast<RpcSession*>(param)->RunWorker();
+  return 0;
+}
+
+void RpcSession::RunWorker() {
+  while (true) {
+    CallTraceBuffer buffer = {};
+    bool commit = false;
+    bool need_spare = false;
+    {
+      base::AutoLock lock(spare_buffers_lock_);
+      if (!pending_commits_.empty()) {
+        buffer = pending_commits_.front();
+        pending_commits_.pop_front();
+        commit = true;
+      }
+      need_spare = spare_buffers_.size() < num_spare_buffers_;
+
+      if (!commit && !need_spare) {
+        worker_scheduled_ = false;
+        ::SetEvent(worker_idle_event_.Get());
+        return;
+      }
+    }
+
+    // Committing a buffer through an exchange gets us a spare for the price
+    // of a single round-trip.
+    bool succeeded = false;
+    if (commit && need_spare) {
+      succeeded = ::common::rpc::InvokeRpc(CallTraceClient_ExchangeBuffer,
+                                           session_handle_,
+                                           &buffer).succeeded();
+    } else if (commit) {
+      succeeded = ::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer,
+                                           session_handle_,
+                                           &buffer).succeeded();
+    } else {
+      succeeded = ::common::rpc::InvokeRpc(CallTraceClient_AllocateBuffer,
+                                           session_handle_,
+                                           &buffer).succeeded();
+    }
+
+    if (!succeeded) {
+      LOG(ERROR) << "Buffer exchange worker failed to "
+                 << (commit ? "commit" : "allocate") << " a buffer.";
+      if (commit)
+        continue;
+
+      // Don't spin on a failing allocation, exchanges fall back to
+      // allocating synchronously.
+      base::AutoLock lock(spare_buffers_lock_);
+      if (pending_commits_.empty()) {
+        worker_scheduled_ = false;
+        ::SetEvent(worker_idle_event_.Get());
+        return;
+      }
+      continue;
+    }
+
+    if (!need_spare)
+      continue;
+
+    // Map the spare right away, so that handing it out is cheap. This also
+    // gives it a valid segment header, in case it gets committed unused.
+    TraceFileSegment spare;
+    spare.buffer_info = buffer;
+    if (!MapSegmentBuffer(&spare))
+      continue;
+
+    base::AutoLock lock(spare_buffers_lock_);
+    spare_buffers_.push_back(spare.buffer_info);
+  }
+}
+
+void RpcSession::FlushSpareBuffers() {
+  if (!worker_idle_event_.IsValid())
+    return;
+
+  if (::WaitForSingleObject(worker_idle_event_.Get(),
+                            kWorkerFlushTimeoutMs) != WAIT_OBJECT_0) {
+    LOG(WARNING) << "Timed out waiting for the buffer exchange worker.";
+  }
+
+  // Stop the worker from replenishing the spares, and take over whatever it
+  // left behind.
+  std::deque<CallTraceBuffer> pending_commits;
+  std::vector<CallTraceBuffer> spare_buffers;
+  {
+    base::AutoLock lock(spare_buffers_lock_);
+    num_spare_buffers_ = 0;
+    pending_commits.swap(pending_commits_);
+    spare_buffers.swap(spare_buffers_);
+  }
+
+  // Commit in order, followed by the unused spares.
+  pending_commits.insert(pending_commits.end(),
+                         spare_buffers.begin(),
+                         spare_buffers.end());
+  for (size_t i = 0; i < pending_commits.size(); ++i) {
+    if (!::common::rpc::InvokeRpc(CallTraceClient_ReturnBuffer,
+                                  session_handle_,
+                                  &pending_commits[i]).succeeded()) {
+      LOG(ERROR) << "Failed to commit buffer.";
+    }
+  }
+}
+
+void RpcSession::GetStatistics(TraceSessionStatistics* statistics) const {
+  DCHECK(statistics != NULL);
+  *statistics = statistics_;
+}
+
+void RpcSession::RecordCommit(const TraceFileSegment& segment) {
+  ::InterlockedIncrement(
+      reinterpret_cast<volatile LONG*>(&statistics_.num_buffers_committed));
+  if (segment.header != NULL) {
+    ::InterlockedExchangeAdd64(
+        reinterpret_cast<volatile LONGLONG*>(&statistics_.num_bytes_committed),
+        segment.header->segment_length);
+  }
+}
+
+void RpcSession::RecordWaitTime(base::TimeTicks start) {
+  base::TimeDelta wait_time = base::TimeTicks::Now() - start;
+  size_t bucket = GetTraceLatencyBucket(wait_time.InMicroseconds());
+  ::InterlockedIncrement(
+      reinterpret_cast<volatile LONG*>(&statistics_.wait_time.counts[bucket]));
+}
+
+bool RpcSession::WriteStatistics() {
+  DCHECK(IsTracing());
+
+  TraceFileSegment segment;
+  if (!AllocateBuffer(&segment))
+    return false;
+
+  TraceSessionStatistics* record =
+      segment.AllocateTraceRecord<TraceSessionStatistics>();
+  GetStatistics(record);
+
+  VLOG(1) << "Committed " << record->num_buffers_committed << " buffers ("
+          << record->num_bytes_committed << " bytes) to the call trace "
+          << "service.";
+
+  return ReturnBuffer(&segment);
+}
+
 void RpcSession::FreeSharedMemory() {
   base::AutoLock scoped_lock_(shared_memory_lock_);
 
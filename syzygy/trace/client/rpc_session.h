@@ -17,11 +17,16 @@
 #ifndef SYZYGY_TRACE_CLIENT_RPC_SESSION_H_
 #define SYZYGY_TRACE_CLIENT_RPC_SESSION_H_
 
+#include <deque>
 #include <map>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/protocol/buffer_ring.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -41,6 +46,34 @@ class RpcSession {
   // @returns the instance ID for this session.
   const std::wstring instance_id() const { return instance_id_; }
 
+  // Sets the number of spare buffers the session keeps on hand. When this is
+  // non-zero ExchangeBuffer hands out a spare buffer and commits the full one
+  // from a worker thread, which also replenishes the spares. ReturnBuffer
+  // commits through the same worker, so that each thread's buffers reach the
+  // service in order. Zero, the default, makes every exchange a synchronous
+  // round-trip to the service.
+  void set_num_spare_buffers(size_t num_spare_buffers) {
+    DCHECK(!IsTracing());
+    num_spare_buffers_ = num_spare_buffers;
+  }
+
+  // @returns the number of spare buffers this session keeps on hand.
+  size_t num_spare_buffers() const { return num_spare_buffers_; }
+
+  // Sets whether the session exchanges buffers through a shared-memory buffer
+  // ring rather than RPC calls. This only takes effect if the service
+  // supports it, in which case it takes precedence over spare buffers. Full
+  // buffers are pushed to the ring for the service to commit, and fresh ones
+  // are taken from it. RPC calls are only made when the ring is full or
+  // empty. Defaults to false.
+  void set_use_buffer_ring(bool use_buffer_ring) {
+    DCHECK(!IsTracing());
+    use_buffer_ring_ = use_buffer_ring;
+  }
+
+  // @returns true if this session tries to use a buffer ring.
+  bool use_buffer_ring() const { return use_buffer_ring_; }
+
   // @name Wrapper and helper functions for the RPC and shared memory calls made
   // by the call-trace client. These are virtual for ease of unittesting.
   // @{
@@ -71,10 +104,56 @@ class RpcSession {
 
   unsigned long flags() const { return flags_; }
 
+  // Gets the buffer exchange statistics of this session. These are updated
+  // concurrently by the tracing threads, so they're only approximate while
+  // tracing is in progress.
+  // @param statistics receives the statistics.
+  void GetStatistics(TraceSessionStatistics* statistics) const;
+
  protected:
   // Map a tracefile segment buffer into local memory.
   bool MapSegmentBuffer(TraceFileSegment* segment);
 
+  // @name Buffer ring exchange.
+  // @{
+  // @returns true iff buffers are exchanged through the buffer ring.
+  bool IsUsingBufferRing() const { return rings_ != NULL; }
+  // Asks the service for a buffer ring, and maps it.
+  // @returns true on success, false otherwise.
+  bool OpenBufferRing();
+  // Unmaps the buffer ring, if any.
+  void CloseBufferRing();
+  // @}
+
+  // @name Asynchronous buffer exchange.
+  // @{
+  // @returns true iff buffers are exchanged through the worker.
+  bool IsExchangingAsynchronously() const {
+    return num_spare_buffers_ != 0 && worker_idle_event_.IsValid();
+  }
+  // Queues @p buffer to be committed by the worker, and schedules the worker.
+  void QueueCommit(const CallTraceBuffer& buffer);
+  // Schedules the worker if it's not already running.
+  void ScheduleWorkerUnlocked();
+  // The worker commits the queued buffers and replenishes the spares.
+  static DWORD WINAPI WorkerCallback(void* param);
+  void RunWorker();
+  // Waits for the worker to go idle, then synchronously commits anything it
+  // left behind and returns the spare buffers to the service.
+  void FlushSpareBuffers();
+  // @}
+
+  // @name Statistics.
+  // @{
+  // Counts the commit of @p segment's buffer.
+  void RecordCommit(const TraceFileSegment& segment);
+  // Records the time the calling thread spent blocked since @p start.
+  void RecordWaitTime(base::TimeTicks start);
+  // Writes the statistics to a trace record of their own.
+  // @returns true on success, false otherwise.
+  bool WriteStatistics();
+  // @}
+
   // The call trace RPC binding.
   handle_t rpc_binding_;
 
@@ -103,6 +182,34 @@ class RpcSession {
   // The (optional) unique id used to differentiate concurrent instances of the
   // RPC call-trace logging service.
   std::wstring instance_id_;
+
+  // The number of spare buffers to keep on hand, zero when buffers are
+  // exchanged synchronously.
+  size_t num_spare_buffers_;
+
+  // The spare buffers, mapped and ready to be handed out, and the buffers
+  // that are waiting to be committed, in the order they were handed in.
+  base::Lock spare_buffers_lock_;
+  std::vector<CallTraceBuffer> spare_buffers_;  // Under spare_buffers_lock_.
+  std::deque<CallTraceBuffer> pending_commits_;  // Under spare_buffers_lock_.
+  bool worker_scheduled_;  // Under spare_buffers_lock_.
+
+  // Signaled whenever the worker isn't scheduled.
+  base::win::ScopedHandle worker_idle_event_;
+
+  // Whether to ask the service for a buffer ring.
+  bool use_buffer_ring_;
+
+  // The shared memory holding the buffer rings, its view and the event to
+  // signal after pushing to the commit ring. These are only set while the
+  // buffer ring is in use.
+  base::win::ScopedHandle ring_handle_;
+  BufferRings* rings_;
+  base::win::ScopedHandle commit_event_;
+
+  // The buffer exchange statistics of this session. These are updated with
+  // interlocked operations, once per buffer.
+  TraceSessionStatistics statistics_;
 };
 
 }  // namespace client
@@ -15,6 +15,7 @@
 #include "syzygy/trace/common/clock.h"
 
 #include <WinBase.h>
+#include <algorithm>
 #include <type_traits>
 
 #include "base/logging.h"
@@ -34,8 +35,52 @@ union LargeInteger {
 
 typedef ULONGLONG (*GetTickCount64Ptr)();
 
+// The states of a lazily queried CPUID feature.
+enum CpuFeatureState {
+  kCpuFeatureUnknown,
+  kCpuFeatureAbsent,
+  kCpuFeaturePresent,
+};
+
+// Queries a CPUID feature bit, caching the result in @p state. This is racy
+// but safe, as all threads compute and store the same value.
+bool HasCpuFeature(int function, size_t reg, int bit, CpuFeatureState* state) {
+  DCHECK(state != NULL);
+  DCHECK_GT(4u, reg);
+
+  if (*state == kCpuFeatureUnknown) {
+    int info[4] = {};
+    ::__cpuid(info, function);
+    *state = (info[reg] & (1 << bit)) != 0 ? kCpuFeaturePresent :
+        kCpuFeatureAbsent;
+  }
+
+  return *state == kCpuFeaturePresent;
+}
+
+uint64 FileTimeToUint64(const FILETIME& file_time) {
+  return (static_cast<uint64>(file_time.dwHighDateTime) << 32) |
+      file_time.dwLowDateTime;
+}
+
+void Uint64ToFileTime(uint64 value, FILETIME* file_time) {
+  DCHECK(file_time != NULL);
+  file_time->dwLowDateTime = value & 0xFFFFFFFF;
+  file_time->dwHighDateTime = value >> 32;
+}
+
 }  // namespace
 
+bool HasInvariantTsc() {
+  static CpuFeatureState state = kCpuFeatureUnknown;
+  return HasCpuFeature(0x80000007, 3, 8, &state);
+}
+
+bool HasRdtscp() {
+  static CpuFeatureState state = kCpuFeatureUnknown;
+  return HasCpuFeature(0x80000001, 3, 27, &state);
+}
+
 void GetTickTimerInfo(TimerInfo* timer_info) {
   DCHECK(timer_info != NULL);
 
@@ -53,11 +98,8 @@ void GetTscTimerInfo(TimerInfo* timer_info) {
   ::memset(timer_info, 0, sizeof(TimerInfo));
 
   // Check the TscInvariant flag to see if we can rely on TSC as a constant
-  // rate timer that is synchronous across all cores. This is in
-  // CPUID.80000007.EDX[8].
-  int info[4];
-  ::__cpuid(info, 0x80000007);
-  if ((info[3] & (1 << 8)) == 0)
+  // rate timer that is synchronous across all cores.
+  if (!HasInvariantTsc())
     return;
 
   // Get the CPU frequency. If all is well, this is the frequency of the TSC
@@ -171,5 +213,68 @@ bool TscToFileTime(const ClockInfo& clock_info,
                          file_time);
 }
 
+TimerToFileTimeConverter::TimerToFileTimeConverter()
+    : timer_ref_(0),
+      multiplier_(0),
+      max_delta_(0),
+      has_base_(false),
+      base_timer_value_(0),
+      base_file_time_(0) {
+  ::memset(&file_time_ref_, 0, sizeof(file_time_ref_));
+  ::memset(&timer_info_, 0, sizeof(timer_info_));
+}
+
+bool TimerToFileTimeConverter::Init(const FILETIME& file_time_ref,
+                                    const TimerInfo& timer_info,
+                                    uint64 timer_ref) {
+  has_base_ = false;
+  multiplier_ = 0;
+
+  // This only works if we have valid timer information.
+  if (timer_info.frequency == 0 || timer_info.resolution == 0)
+    return false;
+
+  file_time_ref_ = file_time_ref;
+  timer_info_ = timer_info;
+  timer_ref_ = timer_ref;
+
+  // The filetime is expressed in 100ns intervals.
+  multiplier_ = (10000000ULL << kFractionBits) / timer_info.frequency;
+  max_delta_ = kuint32max;
+  if (multiplier_ != 0)
+    max_delta_ = std::min(max_delta_, kuint64max / multiplier_);
+
+  return true;
+}
+
+bool TimerToFileTimeConverter::SetBase(uint64 timer_value) {
+  FILETIME file_time = {};
+  if (!TimerToFileTime(file_time_ref_, timer_info_, timer_ref_, timer_value,
+                       &file_time)) {
+    return false;
+  }
+
+  has_base_ = true;
+  base_timer_value_ = timer_value;
+  base_file_time_ = FileTimeToUint64(file_time);
+  return true;
+}
+
+bool TimerToFileTimeConverter::Convert(uint64 timer_value,
+                                       FILETIME* file_time) {
+  DCHECK(file_time != NULL);
+
+  if (!has_base_ || timer_value < base_timer_value_ ||
+      timer_value - base_timer_value_ > max_delta_) {
+    if (!SetBase(timer_value))
+      return false;
+  }
+
+  uint64 delta = timer_value - base_timer_value_;
+  Uint64ToFileTime(base_file_time_ + ((delta * multiplier_) >> kFractionBits),
+                   file_time);
+  return true;
+}
+
 }  // namespace common
 }  // namespace trace
@@ -50,6 +50,23 @@ uint64 GetTicks();
 // @returns the current value of the TSC register using RDTSC.
 inline uint64 GetTsc() { return ::__rdtsc(); }
 
+// @returns true if the TSC runs at a constant rate that is synchronized across
+//     processors. This is CPUID.80000007.EDX[8], which is only queried once.
+bool HasInvariantTsc();
+
+// @returns true if the processor supports RDTSCP. This is
+//     CPUID.80000001.EDX[27], which is only queried once.
+bool HasRdtscp();
+
+// @returns the current value of the TSC register using RDTSCP.
+// @param processor Receives the contents of IA32_TSC_AUX, which the operating
+//     system sets per processor. RDTSCP reads both atomically, so this
+//     identifies the processor whose TSC was read.
+// @note This may only be used if HasRdtscp() is true.
+inline uint64 GetTscAndProcessor(uint32* processor) {
+  return ::__rdtscp(processor);
+}
+
 // Given a file time, a reference time and TimerInfo, convert the given
 // timer value to the corresponding file time. This can fail if the timer
 // info is invalid (frequency is 0, ie: unknown).
@@ -65,6 +82,58 @@ bool TimerToFileTime(const FILETIME& file_time_ref,
                      const uint64& timer_value,
                      FILETIME* file_time);
 
+// Converts the values of a timer to file times with integer arithmetic. This
+// suits converting many values that span a short interval, such as the
+// timestamps of a trace segment: a base value is converted once with
+// TimerToFileTime, and each value is then converted from its 32-bit delta to
+// the base with a fixed point multiplication.
+class TimerToFileTimeConverter {
+ public:
+  TimerToFileTimeConverter();
+
+  // Initializes the converter for a timer.
+  // @param file_time_ref A reference file time.
+  // @param timer_info Information regarding the timer frequency.
+  // @param timer_ref The corresponding reference timer value.
+  // @returns true on success, false if @p timer_info is invalid.
+  bool Init(const FILETIME& file_time_ref,
+            const TimerInfo& timer_info,
+            uint64 timer_ref);
+
+  // Sets the base value that the following values are converted relative to.
+  // @param timer_value The base value.
+  // @returns true on success, false if @p timer_value can't be converted.
+  bool SetBase(uint64 timer_value);
+
+  // Converts a timer value to a file time. A value that precedes the base, or
+  // that is too far past it, becomes the new base.
+  // @param timer_value The timer value to be converted.
+  // @param file_time The file time to be populated.
+  // @returns true on success, false otherwise.
+  bool Convert(uint64 timer_value, FILETIME* file_time);
+
+ private:
+  // The number of fractional bits of multiplier_.
+  static const size_t kFractionBits = 32;
+
+  // The timer, as given to Init.
+  FILETIME file_time_ref_;
+  TimerInfo timer_info_;
+  uint64 timer_ref_;
+
+  // The number of 100ns intervals per timer count, in fixed point.
+  uint64 multiplier_;
+  // The largest delta to the base whose conversion doesn't overflow.
+  uint64 max_delta_;
+
+  // The base value and its file time, in 100ns intervals.
+  bool has_base_;
+  uint64 base_timer_value_;
+  uint64 base_file_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerToFileTimeConverter);
+};
+
 // Information about the system clock and various timers.
 // NOTE: This is meant to be POD so that it can be written directly as is to and
 //     from disk.
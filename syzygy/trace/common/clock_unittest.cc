@@ -71,6 +71,27 @@ TEST(GetTscTest, WorksAsExpected) {
     t2 = GetTsc();
 }
 
+TEST(HasInvariantTscTest, MatchesTscTimerInfo) {
+  TimerInfo ti = {};
+  GetTscTimerInfo(&ti);
+  if (!HasInvariantTsc())
+    EXPECT_EQ(0u, ti.frequency);
+}
+
+TEST(GetTscAndProcessorTest, WorksAsExpected) {
+  if (!HasRdtscp())
+    return;
+
+  // This will busy loop until the counter advances, or until we perform
+  // 2^32 iterations. The counter should definitely have advanced by then.
+  uint32 processor = 0;
+  uint64 t1 = GetTscAndProcessor(&processor);
+  uint64 t2 = t1;
+  uint32 count = 0;
+  while (t2 == t1 && ++count != 0)
+    t2 = GetTscAndProcessor(&processor);
+}
+
 TEST(TimerToFileTimeTest, FailsForInvalidTimerInfo) {
   FILETIME ft1 = {};
   TimerInfo ti = {};
@@ -174,5 +195,59 @@ TEST(TscToFileTimeTest, WorksAsExpected) {
   EXPECT_EQ(0, ft.dwHighDateTime);
 }
 
+TEST(TimerToFileTimeConverterTest, FailsForInvalidTimerInfo) {
+  FILETIME ft1 = {};
+  TimerInfo ti = {};
+  TimerToFileTimeConverter converter;
+  EXPECT_FALSE(converter.Init(ft1, ti, 0));
+}
+
+TEST(TimerToFileTimeConverterTest, MatchesTimerToFileTime) {
+  FILETIME ft1 = { 0x10000, 0xCAFE };
+  TimerInfo ti = {};
+
+  // This corresponds to 100ns ticks, which is the same precision as the
+  // underlying filetime.
+  ti.frequency = 10000000;
+  ti.resolution = 1;
+
+  TimerToFileTimeConverter converter;
+  ASSERT_TRUE(converter.Init(ft1, ti, 200));
+  ASSERT_TRUE(converter.SetBase(1000));
+
+  // Values past the base, before it and too far past it for a 32-bit delta.
+  const uint64 kValues[] = { 1000, 1100, 300, 100, 1000 + (1ULL << 33) };
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    FILETIME expected = {};
+    FILETIME ft2 = {};
+    ASSERT_TRUE(TimerToFileTime(ft1, ti, 200, kValues[i], &expected));
+    ASSERT_TRUE(converter.Convert(kValues[i], &ft2));
+    EXPECT_EQ(expected.dwLowDateTime, ft2.dwLowDateTime);
+    EXPECT_EQ(expected.dwHighDateTime, ft2.dwHighDateTime);
+  }
+}
+
+TEST(TimerToFileTimeConverterTest, ConvertsTscDeltas) {
+  ClockInfo ci = {};
+  ci.tsc_info.frequency = 3000000000ULL;
+  ci.tsc_info.resolution = 1;
+  ci.tsc_reference = 1000000;
+
+  TimerToFileTimeConverter converter;
+  ASSERT_TRUE(converter.Init(ci.file_time, ci.tsc_info, ci.tsc_reference));
+  ASSERT_TRUE(converter.SetBase(ci.tsc_reference));
+
+  // 3e9 counts are 1s, or 1e7 100ns intervals. The fixed point conversion
+  // may be off by one interval.
+  FILETIME ft = {};
+  ASSERT_TRUE(converter.Convert(ci.tsc_reference + 3000000000ULL, &ft));
+  EXPECT_EQ(0u, ft.dwHighDateTime);
+  EXPECT_LE(10000000u - 1, ft.dwLowDateTime);
+  EXPECT_GE(10000000u, ft.dwLowDateTime);
+
+  // This fails as the value precedes the reference file time of 0.
+  EXPECT_FALSE(converter.Convert(0, &ft));
+}
+
 }  // namespace common
 }  // namespace trace
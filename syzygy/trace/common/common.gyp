@@ -35,6 +35,7 @@
       'sources': [
         'clock.cc',
         'clock.h',
+        'minidump_memory_ranges.h',
         'service.cc',
         'service.h',
         'service_util.cc',
@@ -0,0 +1,63 @@
+// Copyright 2013 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Declares the protocol used by instrumented processes to restrict the memory
+// captured by the SaveMiniDump logger RPC to the ranges that are relevant to
+// a crash. This keeps the minidumps small while still including the memory
+// that is needed to diagnose the crash.
+
+#ifndef SYZYGY_TRACE_COMMON_MINIDUMP_MEMORY_RANGES_H_
+#define SYZYGY_TRACE_COMMON_MINIDUMP_MEMORY_RANGES_H_
+
+#include "base/basictypes.h"
+
+namespace trace {
+namespace common {
+
+// The flags of the SaveMiniDump logger RPC.
+enum SaveMiniDumpFlags {
+  // Restricts the minidump to the threads, stacks and modules of the process,
+  // plus the memory ranges described by a MiniDumpMemoryRanges record. The
+  // address of the record, in the memory of the dumped process, is the last
+  // parameter of the exception record of the minidump.
+  kSaveMiniDumpTargetedMemory = 1 << 0,
+};
+
+// A range of memory to include in a targeted minidump.
+struct MiniDumpMemoryRange {
+  // The address of the range, in the memory of the dumped process.
+  uint32 address;
+  // The size of the range.
+  uint32 size;
+};
+
+// Describes the memory to include in a targeted minidump. This lives in the
+// memory of the dumped process.
+struct MiniDumpMemoryRanges {
+  // The number of ranges.
+  uint32 count;
+  // The address of an array of |count| MiniDumpMemoryRange, in the memory of
+  // the dumped process.
+  uint32 ranges;
+};
+
+// The maximum number of memory ranges of a targeted minidump. Any further
+// ranges are ignored.
+const uint32 kMaxMiniDumpMemoryRanges = 4096;
+
+}  // namespace common
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_COMMON_MINIDUMP_MEMORY_RANGES_H_
@@ -32,6 +32,7 @@
 
 namespace {
 
+using trace::parser::AbsoluteAddress64;
 using trace::parser::Parser;
 using trace::parser::ParseEventHandler;
 using trace::parser::ModuleInformation;
@@ -492,7 +493,85 @@ class TraceFileDumper : public ParseEventHandler {
               data->comment);
   }
 
+  virtual void OnSessionStatistics(
+      base::Time time,
+      DWORD process_id,
+      const TraceSessionStatistics* data) {
+    DCHECK_NE(static_cast<TraceSessionStatistics*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnSessionStatistics: process-id=%d;\n"
+              "    source=%s\n"
+              "    num-sessions=%d\n"
+              "    num-buffers-committed=%d\n"
+              "    num-bytes-committed=%lld\n"
+              "    num-recycle-stalls=%d\n",
+              time.ToInternalValue(),
+              process_id,
+              data->source == TraceSessionStatistics::kClientSource ?
+                  "client" : "service",
+              data->num_sessions,
+              data->num_buffers_committed,
+              data->num_bytes_committed,
+              data->num_recycle_stalls);
+    PrintLatencyHistogram("wait-time", data->wait_time);
+    PrintLatencyHistogram("write-latency", data->write_latency);
+  }
+
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerCalibration* data) {
+    DCHECK_NE(static_cast<TraceProfilerCalibration*>(nullptr), data);
+    ::fprintf(file_,
+              "[%012lld] OnProfilerCalibration: process-id=%d; "
+              "thread-id=%d;\n"
+              "    processor-number=%d\n"
+              "    invocation-overhead-cycles=%lld\n"
+              "    call-overhead-cycles=%lld\n",
+              time.ToInternalValue(),
+              process_id,
+              thread_id,
+              data->processor_number,
+              data->invocation_overhead_cycles,
+              data->call_overhead_cycles);
+  }
+
+  virtual void OnPageFault(base::Time time,
+                           DWORD process_id,
+                           DWORD thread_id,
+                           AbsoluteAddress64 address,
+                           bool is_hard_fault) {
+    ::fprintf(file_,
+              "[%012lld] OnPageFault: process-id=%d; thread-id=%d;\n"
+              "    address=0x%08llX\n"
+              "    type=%s\n",
+              time.ToInternalValue(),
+              process_id,
+              thread_id,
+              address,
+              is_hard_fault ? "hard" : "soft");
+  }
+
  private:
+  // Prints the non-empty buckets of a histogram.
+  void PrintLatencyHistogram(const char* name,
+                             const TraceLatencyHistogram& histogram) {
+    ::fprintf(file_, "    %s:\n", name);
+    for (size_t i = 0; i < TraceLatencyHistogram::kNumBuckets; ++i) {
+      if (histogram.counts[i] == 0)
+        continue;
+      uint64 lower_bound = i == 0 ? 0 : (1ULL << (i - 1));
+      if (i + 1 == TraceLatencyHistogram::kNumBuckets) {
+        ::fprintf(file_, "      >= %lldus: %d\n", lower_bound,
+                  histogram.counts[i]);
+      } else {
+        ::fprintf(file_, "      < %lldus: %d\n", 1ULL << i,
+                  histogram.counts[i]);
+      }
+    }
+  }
+
   FILE* file_;
   const char* indentation_;
 
@@ -23,6 +23,8 @@
       'sources': [
         'parse_engine.cc',
         'parse_engine.h',
+        'parse_engine_kernel.cc',
+        'parse_engine_kernel.h',
         'parse_engine_rpc.cc',
         'parse_engine_rpc.h',
         'parse_utils.cc',
@@ -31,6 +33,7 @@
         'parser.cc',
       ],
       'dependencies': [
+        '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
@@ -67,6 +70,7 @@
       'target_name': 'parse_unittests',
       'type': 'executable',
       'sources': [
+        'parse_engine_kernel_unittest.cc',
         'parse_engine_rpc_unittest.cc',
         'parse_engine_unittest.cc',
         'parse_utils_unittest.cc',
@@ -18,6 +18,8 @@
 #include <windows.h>  // NOLINT
 #include <wmistr.h>  // NOLINT
 #include <evntrace.h>
+#include <algorithm>
+#include <vector>
 
 #include "base/logging.h"
 #include "syzygy/common/buffer_parser.h"
@@ -28,6 +30,25 @@ namespace trace {
 namespace parser {
 
 using ::common::BinaryBufferReader;
+using ::common::BufferView;
+
+namespace {
+
+// Reads a varint encoded by WriteTraceVarint from @p reader.
+bool ReadVarint(BinaryBufferReader* reader, uint64* value) {
+  DCHECK_NE(static_cast<BinaryBufferReader*>(nullptr), reader);
+  DCHECK_NE(static_cast<uint64*>(nullptr), value);
+
+  size_t remaining = reader->RemainingBytes();
+  const void* data = NULL;
+  if (remaining == 0 || !reader->Peek(remaining, &data))
+    return false;
+  size_t size = ReadTraceVarint(reinterpret_cast<const uint8*>(data),
+                                remaining, value);
+  return size != 0 && reader->Consume(size);
+}
+
+}  // namespace
 
 ParseEngine::ParseEngine(const char* name, bool fail_on_module_conflict)
     : event_handler_(NULL),
@@ -262,10 +283,22 @@ bool ParseEngine::DispatchEvent(EVENT_TRACE* event) {
       success = DispatchDetailedFunctionCall(event);
       break;
 
+    case TRACE_COMPACT_FUNCTION_CALLS:
+      success = DispatchCompactFunctionCalls(event);
+      break;
+
     case TRACE_COMMENT:
       success = DispatchComment(event);
       break;
 
+    case TRACE_SESSION_STATISTICS:
+      success = DispatchSessionStatistics(event);
+      break;
+
+    case TRACE_PROFILER_CALIBRATION:
+      success = DispatchProfilerCalibration(event);
+      break;
+
     default:
       LOG(ERROR) << "Unknown event type encountered.";
       break;
@@ -555,17 +588,16 @@ bool ParseEngine::DispatchStackTrace(EVENT_TRACE* event) {
 
   BinaryBufferReader reader(event->MofData, event->MofLength);
   const TraceStackTrace* data = NULL;
-  if (!reader.Read(&data)) {
+  if (!reader.Read(FIELD_OFFSET(TraceStackTrace, frames), &data)) {
     LOG(ERROR) << "Short or empty TraceStackTrace event.";
     return false;
   }
   DCHECK(data != NULL);
 
-  // Calculate the expected size of the payload and ensure there's
-  // enough data.
-  size_t expected_length = FIELD_OFFSET(TraceStackTrace, frames) +
-      data->num_frames * sizeof(void*);
-  if (event->MofLength < expected_length) {
+  // Ensure the frames are all in the payload. They're handed to the event
+  // handler in place.
+  BufferView<void*> frames;
+  if (!reader.ReadView(data->num_frames, &frames)) {
     LOG(ERROR) << "Payload smaller than size implied by "
                << "TraceStackTrace header.";
     return false;
@@ -612,6 +644,149 @@ bool ParseEngine::DispatchDetailedFunctionCall(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchCompactFunctionCalls(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceCompactFunctionCalls* data = NULL;
+  if (!reader.Read(FIELD_OFFSET(TraceCompactFunctionCalls, data), &data)) {
+    LOG(ERROR) << "Short or empty TraceCompactFunctionCalls event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  if (reader.RemainingBytes() < data->data_size) {
+    LOG(ERROR) << "Payload smaller than size implied by "
+               << "TraceCompactFunctionCalls header.";
+    return false;
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+
+  // The state the calls are encoded relative to. This is scoped to the batch.
+  uint64 timestamp = data->base_timestamp;
+  std::vector<uint32> stack_trace_ids;
+  uint32 last_arguments[TraceCompactFunctionCalls::kMaxDeltaArguments] = {};
+
+  // Each call is decoded to a TraceDetailedFunctionCall, in |buffer|. The
+  // arguments are gathered as views into the event or into |last_arguments|,
+  // so that they're copied only once, into |buffer|.
+  std::vector<uint32> argument_sizes;
+  std::vector<BufferView<uint8>> arguments;
+  std::vector<uint8> buffer;
+
+  BinaryBufferReader calls(data->data, data->data_size);
+  for (size_t i = 0; i < data->call_count; ++i) {
+    uint64 timestamp_delta = 0;
+    uint64 function_id = 0;
+    uint64 stack_trace_index = 0;
+    uint64 argument_count = 0;
+    if (!ReadVarint(&calls, &timestamp_delta) ||
+        !ReadVarint(&calls, &function_id) ||
+        !ReadVarint(&calls, &stack_trace_index) ||
+        stack_trace_index > stack_trace_ids.size()) {
+      LOG(ERROR) << "Malformed call in TraceCompactFunctionCalls event.";
+      return false;
+    }
+    timestamp += timestamp_delta;
+
+    uint32 stack_trace_id = 0;
+    if (stack_trace_index < stack_trace_ids.size()) {
+      stack_trace_id = stack_trace_ids[static_cast<size_t>(stack_trace_index)];
+    } else {
+      const void* id = NULL;
+      if (!calls.Read(sizeof(stack_trace_id), &id)) {
+        LOG(ERROR) << "Malformed call in TraceCompactFunctionCalls event.";
+        return false;
+      }
+      ::memcpy(&stack_trace_id, id, sizeof(stack_trace_id));
+      if (stack_trace_ids.size() < TraceCompactFunctionCalls::kMaxStackTraceIds)
+        stack_trace_ids.push_back(stack_trace_id);
+    }
+
+    if (!ReadVarint(&calls, &argument_count)) {
+      LOG(ERROR) << "Malformed call in TraceCompactFunctionCalls event.";
+      return false;
+    }
+    argument_sizes.clear();
+    arguments.clear();
+    size_t total_argument_size = 0;
+    for (size_t j = 0; j < argument_count; ++j) {
+      uint64 argument_size = 0;
+      if (!ReadVarint(&calls, &argument_size) || argument_size == 0 ||
+          argument_size > calls.RemainingBytes()) {
+        LOG(ERROR) << "Malformed argument in TraceCompactFunctionCalls event.";
+        return false;
+      }
+
+      BufferView<uint8> argument;
+      if (argument_size == sizeof(uint32) &&
+          j < TraceCompactFunctionCalls::kMaxDeltaArguments) {
+        uint64 delta = 0;
+        if (!ReadVarint(&calls, &delta) || delta > 0xFFFFFFFF) {
+          LOG(ERROR) << "Malformed argument in TraceCompactFunctionCalls "
+                     << "event.";
+          return false;
+        }
+        last_arguments[j] += ZigZagDecodeTraceDelta(static_cast<uint32>(delta));
+        argument = BufferView<uint8>(
+            reinterpret_cast<const uint8*>(&last_arguments[j]),
+            sizeof(last_arguments[j]));
+      } else {
+        bool read = calls.ReadView(static_cast<size_t>(argument_size),
+                                   &argument);
+        DCHECK(read);
+      }
+      argument_sizes.push_back(static_cast<uint32>(argument_size));
+      arguments.push_back(argument);
+      total_argument_size += argument.size();
+    }
+
+    // Lay out the call as a TraceDetailedFunctionCall would.
+    size_t argument_data_size = 0;
+    if (!argument_sizes.empty()) {
+      argument_data_size = (argument_sizes.size() + 1) * sizeof(uint32) +
+          total_argument_size;
+    }
+    buffer.assign(std::max(sizeof(TraceDetailedFunctionCall),
+                           FIELD_OFFSET(TraceDetailedFunctionCall,
+                                        argument_data) + argument_data_size),
+                  0);
+    TraceDetailedFunctionCall* call =
+        reinterpret_cast<TraceDetailedFunctionCall*>(&buffer[0]);
+    call->timestamp = timestamp;
+    call->function_id = static_cast<uint32>(function_id);
+    call->stack_trace_id = stack_trace_id;
+    call->argument_data_size = argument_data_size;
+    if (argument_data_size != 0) {
+      uint32* sizes = reinterpret_cast<uint32*>(call->argument_data);
+      *(sizes++) = argument_sizes.size();
+      ::memcpy(sizes, &argument_sizes[0],
+               argument_sizes.size() * sizeof(uint32));
+      uint8* argument_data =
+          reinterpret_cast<uint8*>(sizes + argument_sizes.size());
+      for (size_t j = 0; j < arguments.size(); ++j) {
+        ::memcpy(argument_data, arguments[j].data(), arguments[j].size());
+        argument_data += arguments[j].size();
+      }
+    }
+
+    event_handler_->OnDetailedFunctionCall(time, process_id, thread_id, call);
+  }
+
+  if (calls.RemainingBytes() != 0) {
+    LOG(ERROR) << "Trailing data in TraceCompactFunctionCalls event.";
+    return false;
+  }
+
+  return true;
+}
+
 bool ParseEngine::DispatchComment(EVENT_TRACE* event) {
   DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
   DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
@@ -645,6 +820,49 @@ bool ParseEngine::DispatchComment(EVENT_TRACE* event) {
   return true;
 }
 
+bool ParseEngine::DispatchSessionStatistics(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceSessionStatistics* data = NULL;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceSessionStatistics event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  event_handler_->OnSessionStatistics(time, process_id, data);
+
+  return true;
+}
+
+bool ParseEngine::DispatchProfilerCalibration(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const TraceProfilerCalibration* data = NULL;
+  if (!reader.Read(&data)) {
+    LOG(ERROR) << "Short or empty TraceProfilerCalibration event.";
+    return false;
+  }
+  DCHECK(data != NULL);
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  event_handler_->OnProfilerCalibration(time, process_id, thread_id, data);
+
+  return true;
+}
+
 namespace {
 
 void ModuleTraceDataToModuleInformation(
@@ -233,12 +233,31 @@ class ParseEngine {
   //     Does not explicitly set error occurred.
   bool DispatchDetailedFunctionCall(EVENT_TRACE* event);
 
+  // Parses a batch of compact function calls, and dispatches each of them as
+  // a detailed function call.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchCompactFunctionCalls(EVENT_TRACE* event);
+
   // Parses and dispatches a call-trace comment.
   // @param event the event to dispatch.
   // @returns true if the event was successfully dispatched, false otherwise.
   //     Does not explicitly set error occurred.
   bool DispatchComment(EVENT_TRACE* event);
 
+  // Parses and dispatches a session statistics record.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchSessionStatistics(EVENT_TRACE* event);
+
+  // Parses and dispatches a profiler calibration record.
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  //     Does not explicitly set error occurred.
+  bool DispatchProfilerCalibration(EVENT_TRACE* event);
+
   // The name by which this parse engine is known.
   std::string name_;
 
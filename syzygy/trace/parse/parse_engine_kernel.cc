@@ -0,0 +1,363 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Implementation of kernel ETW log parsing.
+
+#include "syzygy/trace/parse/parse_engine_kernel.h"
+
+#include <stddef.h>
+
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+#include "syzygy/common/buffer_parser.h"
+#include "syzygy/common/com_utils.h"
+
+namespace trace {
+namespace parser {
+
+using ::common::BinaryBufferReader;
+
+namespace {
+
+// The classes of the kernel events we're interested in. These are the
+// documented MOF classes of the NT kernel logger.
+// {68FDD900-4A3E-11D1-84F4-0000F80464E3}
+const GUID kEventTraceEventClass = {
+    0x68fdd900, 0x4a3e, 0x11d1,
+    { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+// {2CB15D1D-5FC1-11D2-ABE1-00A0C911F518}
+const GUID kImageEventClass = {
+    0x2cb15d1d, 0x5fc1, 0x11d2,
+    { 0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18 } };
+// {3D6FA8D1-FE05-11D0-9DDA-00C04FD7BA7C}
+const GUID kThreadEventClass = {
+    0x3d6fa8d1, 0xfe05, 0x11d0,
+    { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+// {3D6FA8D3-FE05-11D0-9DDA-00C04FD7BA7C}
+const GUID kPageFaultEventClass = {
+    0x3d6fa8d3, 0xfe05, 0x11d0,
+    { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+
+// The event types of the image events.
+enum ImageEventType {
+  kImageUnloadEvent = 2,
+  kImageDCStartEvent = 3,
+  kImageDCEndEvent = 4,
+  kImageLoadEvent = 10,
+};
+
+// The event types of the thread events.
+enum ThreadEventType {
+  kThreadStartEvent = 1,
+  kThreadDCStartEvent = 3,
+};
+
+// The event types of the page fault events. The hard faults reported in
+// PageFault_TypeGroup1 events are ignored, as they're also reported, with
+// the thread that caused them, by the PageFault_HardFault events.
+enum PageFaultEventType {
+  kTransitionFaultEvent = 10,
+  kDemandZeroFaultEvent = 11,
+  kCopyOnWriteFaultEvent = 12,
+  kHardFaultEvent = 32,
+};
+
+// The first version of the Image_Load events carrying the checksum and the
+// time stamp of the modules.
+const UCHAR kMinImageEventVersion = 2;
+
+// Reads a pointer of @p pointer_size bytes from @p reader.
+bool ReadPointer(size_t pointer_size,
+                 BinaryBufferReader* reader,
+                 uint64* value) {
+  DCHECK_NE(static_cast<BinaryBufferReader*>(nullptr), reader);
+  DCHECK_NE(static_cast<uint64*>(nullptr), value);
+
+  if (pointer_size == sizeof(uint32)) {
+    const uint32* value32 = NULL;
+    if (!reader->Read(&value32))
+      return false;
+    *value = *value32;
+    return true;
+  }
+
+  DCHECK_EQ(sizeof(uint64), pointer_size);
+  const uint64* value64 = NULL;
+  if (!reader->Read(&value64))
+    return false;
+  *value = *value64;
+  return true;
+}
+
+}  // namespace
+
+ParseEngineKernel* ParseEngineKernel::consuming_engine_ = NULL;
+
+ParseEngineKernel::ParseEngineKernel()
+    : ParseEngine("Kernel", false), pointer_size_(0) {
+}
+
+ParseEngineKernel::~ParseEngineKernel() {
+}
+
+bool ParseEngineKernel::IsRecognizedTraceFile(
+    const base::FilePath& trace_file_path) {
+  return LowerCaseEqualsASCII(trace_file_path.Extension(), ".etl");
+}
+
+bool ParseEngineKernel::OpenTraceFile(const base::FilePath& trace_file_path) {
+  HRESULT hr = OpenFileSession(trace_file_path.value().c_str());
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to open '" << trace_file_path.value() << "': "
+               << ::common::LogHr(hr) << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool ParseEngineKernel::ConsumeAllEvents() {
+  DCHECK(consuming_engine_ == NULL);
+
+  consuming_engine_ = this;
+  HRESULT hr = Consume();
+  consuming_engine_ = NULL;
+
+  // Consumption is cancelled on the first error, which was already logged.
+  if (error_occurred())
+    return false;
+
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to consume the kernel events: "
+               << ::common::LogHr(hr) << ".";
+    return false;
+  }
+
+  return true;
+}
+
+bool ParseEngineKernel::CloseAllTraceFiles() {
+  HRESULT hr = Close();
+  if (FAILED(hr)) {
+    LOG(ERROR) << "Failed to close the trace files: " << ::common::LogHr(hr)
+               << ".";
+    return false;
+  }
+
+  return true;
+}
+
+void ParseEngineKernel::ProcessEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEngineKernel*>(nullptr), consuming_engine_);
+
+  if (consuming_engine_->error_occurred())
+    return;
+  consuming_engine_->DispatchKernelEvent(event);
+}
+
+bool ParseEngineKernel::ProcessBuffer(EVENT_TRACE_LOGFILE* buffer) {
+  DCHECK_NE(static_cast<ParseEngineKernel*>(nullptr), consuming_engine_);
+
+  // Stop consuming on the first error.
+  return !consuming_engine_->error_occurred();
+}
+
+bool ParseEngineKernel::DispatchKernelEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+  DCHECK_NE(static_cast<ParseEventHandler*>(nullptr), event_handler_);
+  DCHECK(!error_occurred_);
+
+  bool success = false;
+  if (kEventTraceEventClass == event->Header.Guid) {
+    success = DispatchLogFileHeaderEvent(event);
+  } else if (kImageEventClass == event->Header.Guid) {
+    success = DispatchImageEvent(event);
+  } else if (kThreadEventClass == event->Header.Guid) {
+    success = DispatchThreadEvent(event);
+  } else if (kPageFaultEventClass == event->Header.Guid) {
+    success = DispatchPageFaultEvent(event);
+  } else {
+    return false;
+  }
+
+  if (!success)
+    error_occurred_ = true;
+
+  return true;
+}
+
+bool ParseEngineKernel::DispatchLogFileHeaderEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+
+  if (event->Header.Class.Type != EVENT_TRACE_TYPE_INFO)
+    return true;
+
+  // The pointers in the header itself are of the size of those of the logger,
+  // but the pointer size precedes them.
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const ULONG* pointer_size = NULL;
+  if (!reader.Consume(offsetof(TRACE_LOGFILE_HEADER, PointerSize)) ||
+      !reader.Read(&pointer_size)) {
+    LOG(ERROR) << "Short log file header event.";
+    return false;
+  }
+
+  if (*pointer_size != sizeof(uint32) && *pointer_size != sizeof(uint64)) {
+    LOG(ERROR) << "Unexpected pointer size in log file header: "
+               << *pointer_size << ".";
+    return false;
+  }
+  pointer_size_ = *pointer_size;
+
+  return true;
+}
+
+bool ParseEngineKernel::DispatchImageEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+
+  UCHAR type = event->Header.Class.Type;
+  if (type != kImageLoadEvent && type != kImageDCStartEvent &&
+      type != kImageUnloadEvent) {
+    return true;
+  }
+
+  // Older systems don't report enough to identify the modules.
+  if (event->Header.Class.Version < kMinImageEventVersion)
+    return true;
+
+  if (pointer_size_ == 0) {
+    LOG(ERROR) << "Image event before the log file header.";
+    return false;
+  }
+
+  // Image_Load: ImageBase, ImageSize, ProcessId, ImageCheckSum,
+  // TimeDateStamp, Reserved0, DefaultBase, Reserved1-4, FileName.
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  uint64 image_base = 0;
+  uint64 image_size = 0;
+  const uint32* process_id = NULL;
+  const uint32* checksum = NULL;
+  const uint32* time_date_stamp = NULL;
+  uint64 default_base = 0;
+  const wchar_t* file_name = NULL;
+  size_t file_name_length = 0;
+  if (!ReadPointer(pointer_size_, &reader, &image_base) ||
+      !ReadPointer(pointer_size_, &reader, &image_size) ||
+      !reader.Read(&process_id) ||
+      !reader.Read(&checksum) ||
+      !reader.Read(&time_date_stamp) ||
+      !reader.Consume(sizeof(uint32)) ||
+      !ReadPointer(pointer_size_, &reader, &default_base) ||
+      !reader.Consume(4 * sizeof(uint32)) ||
+      !reader.ReadString(&file_name, &file_name_length)) {
+    LOG(ERROR) << "Short or malformed image event.";
+    return false;
+  }
+
+  // Only 32-bit modules are of interest, and their addresses can't be
+  // represented otherwise.
+  if (image_base + image_size > 0xFFFFFFFF)
+    return true;
+
+  ModuleInformation module_info;
+  module_info.path.assign(file_name, file_name_length);
+  module_info.base_address.set_value(static_cast<uint32>(image_base));
+  module_info.module_size = static_cast<size_t>(image_size);
+  module_info.module_checksum = *checksum;
+  module_info.module_time_date_stamp = *time_date_stamp;
+
+  if (type == kImageUnloadEvent)
+    return RemoveModuleInformation(*process_id, module_info);
+  return AddModuleInformation(*process_id, module_info);
+}
+
+bool ParseEngineKernel::DispatchThreadEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+
+  UCHAR type = event->Header.Class.Type;
+  if (type != kThreadStartEvent && type != kThreadDCStartEvent)
+    return true;
+
+  // The first version of these events has the thread id first, the others
+  // have the process id first.
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  const uint32* ids = NULL;
+  if (!reader.Read(2 * sizeof(uint32), &ids)) {
+    LOG(ERROR) << "Short thread event.";
+    return false;
+  }
+
+  if (event->Header.Class.Version == 0)
+    thread_processes_[ids[0]] = ids[1];
+  else
+    thread_processes_[ids[1]] = ids[0];
+
+  return true;
+}
+
+bool ParseEngineKernel::DispatchPageFaultEvent(EVENT_TRACE* event) {
+  DCHECK_NE(static_cast<EVENT_TRACE*>(nullptr), event);
+
+  UCHAR type = event->Header.Class.Type;
+  if (type != kTransitionFaultEvent && type != kDemandZeroFaultEvent &&
+      type != kCopyOnWriteFaultEvent && type != kHardFaultEvent) {
+    return true;
+  }
+
+  if (pointer_size_ == 0) {
+    LOG(ERROR) << "Page fault event before the log file header.";
+    return false;
+  }
+
+  BinaryBufferReader reader(event->MofData, event->MofLength);
+  uint64 address = 0;
+  DWORD process_id = event->Header.ProcessId;
+  DWORD thread_id = event->Header.ThreadId;
+  bool is_hard_fault = type == kHardFaultEvent;
+
+  if (is_hard_fault) {
+    // PageFault_HardFault: InitialTime, ReadOffset, VirtualAddress,
+    // FileObject, TThreadId, ByteCount.
+    const uint32* faulting_thread_id = NULL;
+    if (!reader.Consume(2 * sizeof(uint64)) ||
+        !ReadPointer(pointer_size_, &reader, &address) ||
+        !reader.Consume(pointer_size_) ||
+        !reader.Read(&faulting_thread_id)) {
+      LOG(ERROR) << "Short hard fault event.";
+      return false;
+    }
+
+    thread_id = *faulting_thread_id;
+    ThreadProcessMap::const_iterator it = thread_processes_.find(thread_id);
+    if (it != thread_processes_.end())
+      process_id = it->second;
+  } else {
+    // PageFault_TypeGroup1: VirtualAddress, ProgramCounter.
+    if (!ReadPointer(pointer_size_, &reader, &address)) {
+      LOG(ERROR) << "Short page fault event.";
+      return false;
+    }
+  }
+
+  base::Time time(base::Time::FromFileTime(
+      reinterpret_cast<FILETIME&>(event->Header.TimeStamp)));
+  event_handler_->OnPageFault(time, process_id, thread_id, address,
+                              is_hard_fault);
+
+  return true;
+}
+
+}  // namespace parser
+}  // namespace trace
@@ -0,0 +1,102 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Kernel ETW event parsing classes. These consume the kernel log files
+// written by call_trace_control, and dispatch their image load and page fault
+// events.
+
+#ifndef SYZYGY_TRACE_PARSE_PARSE_ENGINE_KERNEL_H_
+#define SYZYGY_TRACE_PARSE_PARSE_ENGINE_KERNEL_H_
+
+#include <windows.h>  // NOLINT
+#include <wmistr.h>  // NOLINT
+#include <evntrace.h>
+
+#include <map>
+
+#include "base/files/file_path.h"
+#include "base/win/event_trace_consumer.h"
+#include "syzygy/trace/parse/parse_engine.h"
+
+namespace trace {
+namespace parser {
+
+// A parse engine for the kernel logger's ETW log files. Image loads and
+// unloads are used to track the modules of each process, so that the
+// addresses of the page faults can be attributed to modules by the event
+// handler. All other kernel events are ignored.
+class ParseEngineKernel
+    : public ParseEngine,
+      public base::win::EtwTraceConsumerBase<ParseEngineKernel> {
+ public:
+  ParseEngineKernel();
+  virtual ~ParseEngineKernel();
+
+  // @name ParseEngine implementation
+  // @{
+  virtual bool IsRecognizedTraceFile(
+      const base::FilePath& trace_file_path) OVERRIDE;
+  virtual bool OpenTraceFile(
+      const base::FilePath& trace_file_path) OVERRIDE;
+  virtual bool ConsumeAllEvents() OVERRIDE;
+  virtual bool CloseAllTraceFiles() OVERRIDE;
+  // @}
+
+  // @name EtwTraceConsumerBase callbacks.
+  // @{
+  static void ProcessEvent(EVENT_TRACE* event);
+  static bool ProcessBuffer(EVENT_TRACE_LOGFILE* buffer);
+  // @}
+
+ protected:
+  // Dispatches a kernel event to the appropriate handler.
+  // @param event The event to dispatch.
+  // @returns true if the event was recognized and handled in some way; false
+  //     if the event must be handled elsewhere. If an error occurs during
+  //     the handling of the event, the error_occurred_ flag will be set to
+  //     true.
+  bool DispatchKernelEvent(EVENT_TRACE* event);
+
+  // @name Kernel event handlers. Called from DispatchKernelEvent().
+  // @param event the event to dispatch.
+  // @returns true if the event was successfully dispatched, false otherwise.
+  // @{
+  bool DispatchLogFileHeaderEvent(EVENT_TRACE* event);
+  bool DispatchImageEvent(EVENT_TRACE* event);
+  bool DispatchThreadEvent(EVENT_TRACE* event);
+  bool DispatchPageFaultEvent(EVENT_TRACE* event);
+  // @}
+
+  // The size of the pointers in the events of the log file being consumed.
+  // This is only known once the log file header has been seen.
+  size_t pointer_size_;
+
+  // The process owning each of the threads seen so far. Hard faults are
+  // reported in the context of the thread completing the I/O, so they are
+  // attributed to the process of the faulting thread instead.
+  typedef std::map<DWORD, DWORD> ThreadProcessMap;
+  ThreadProcessMap thread_processes_;
+
+ private:
+  // The engine whose events are being consumed. The consumer callbacks are
+  // static, so they need this to get back to the engine.
+  static ParseEngineKernel* consuming_engine_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParseEngineKernel);
+};
+
+}  // namespace parser
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_PARSE_PARSE_ENGINE_KERNEL_H_
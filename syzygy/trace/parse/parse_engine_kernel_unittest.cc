@@ -0,0 +1,237 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/parse_engine_kernel.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/trace/parse/unittest_util.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+using testing::_;
+
+const GUID kEventTraceEventClass = {
+    0x68fdd900, 0x4a3e, 0x11d1,
+    { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+const GUID kImageEventClass = {
+    0x2cb15d1d, 0x5fc1, 0x11d2,
+    { 0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18 } };
+const GUID kThreadEventClass = {
+    0x3d6fa8d1, 0xfe05, 0x11d0,
+    { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+const GUID kPageFaultEventClass = {
+    0x3d6fa8d3, 0xfe05, 0x11d0,
+    { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+
+const DWORD kProcessId = 0x1234;
+const DWORD kThreadId = 0x5678;
+const DWORD kOtherProcessId = 0x4321;
+const DWORD kOtherThreadId = 0x8765;
+const uint32 kImageBase = 0x10000000;
+const uint32 kImageSize = 0x00100000;
+const uint32 kImageChecksum = 0xC0FFEE;
+const uint32 kImageTimeDateStamp = 0x12345678;
+const wchar_t kImagePath[] = L"\\Device\\HarddiskVolume1\\foo.dll";
+
+// Builds the payload of a kernel event.
+class Payload {
+ public:
+  template <typename T>
+  Payload& Append(const T& value) {
+    const uint8* data = reinterpret_cast<const uint8*>(&value);
+    data_.insert(data_.end(), data, data + sizeof(value));
+    return *this;
+  }
+
+  Payload& AppendString(const wchar_t* str) {
+    const uint8* data = reinterpret_cast<const uint8*>(str);
+    data_.insert(data_.end(), data, data + (::wcslen(str) + 1) * sizeof(*str));
+    return *this;
+  }
+
+  std::vector<uint8>& data() { return data_; }
+
+ private:
+  std::vector<uint8> data_;
+};
+
+class TestParseEngineKernel : public ParseEngineKernel {
+ public:
+  using ParseEngineKernel::DispatchKernelEvent;
+  using ParseEngineKernel::pointer_size_;
+};
+
+class ParseEngineKernelTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    engine_.set_event_handler(&handler_);
+  }
+
+  void DispatchKernelEvent(const GUID& guid,
+                           UCHAR type,
+                           UCHAR version,
+                           Payload* payload) {
+    EVENT_TRACE event = {};
+    event.Header.ProcessId = kProcessId;
+    event.Header.ThreadId = kThreadId;
+    event.Header.Guid = guid;
+    event.Header.Class.Type = type;
+    event.Header.Class.Version = version;
+    event.MofData = &payload->data()[0];
+    event.MofLength = payload->data().size();
+
+    ASSERT_TRUE(engine_.DispatchKernelEvent(&event));
+  }
+
+  void DispatchLogFileHeader() {
+    TRACE_LOGFILE_HEADER header = {};
+    header.PointerSize = sizeof(uint32);
+    Payload payload;
+    payload.Append(header);
+    ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+        kEventTraceEventClass, EVENT_TRACE_TYPE_INFO, 2, &payload));
+  }
+
+  void DispatchImageEvent(UCHAR type) {
+    Payload payload;
+    payload.Append(kImageBase).Append(kImageSize).Append(kProcessId)
+        .Append(kImageChecksum).Append(kImageTimeDateStamp)
+        .Append(static_cast<uint32>(0)).Append(kImageBase)
+        .Append(static_cast<uint32>(0)).Append(static_cast<uint32>(0))
+        .Append(static_cast<uint32>(0)).Append(static_cast<uint32>(0))
+        .AppendString(kImagePath);
+    ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+        kImageEventClass, type, 2, &payload));
+  }
+
+ protected:
+  TestParseEngineKernel engine_;
+  testing::StrictMockParseEventHandler handler_;
+};
+
+}  // namespace
+
+TEST_F(ParseEngineKernelTest, IsRecognizedTraceFile) {
+  EXPECT_TRUE(engine_.IsRecognizedTraceFile(base::FilePath(L"kernel.etl")));
+  EXPECT_TRUE(engine_.IsRecognizedTraceFile(base::FilePath(L"KERNEL.ETL")));
+  EXPECT_FALSE(engine_.IsRecognizedTraceFile(base::FilePath(L"trace.bin")));
+}
+
+TEST_F(ParseEngineKernelTest, UnhandledEvent) {
+  Payload payload;
+  payload.Append(static_cast<uint32>(0));
+  EVENT_TRACE event = {};
+  event.MofData = &payload.data()[0];
+  event.MofLength = payload.data().size();
+  EXPECT_FALSE(engine_.DispatchKernelEvent(&event));
+  EXPECT_FALSE(engine_.error_occurred());
+}
+
+TEST_F(ParseEngineKernelTest, LogFileHeader) {
+  ASSERT_NO_FATAL_FAILURE(DispatchLogFileHeader());
+  EXPECT_FALSE(engine_.error_occurred());
+  EXPECT_EQ(sizeof(uint32), engine_.pointer_size_);
+
+  // An unexpected pointer size is an error.
+  TRACE_LOGFILE_HEADER header = {};
+  header.PointerSize = 3;
+  Payload payload;
+  payload.Append(header);
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kEventTraceEventClass, EVENT_TRACE_TYPE_INFO, 2, &payload));
+  EXPECT_TRUE(engine_.error_occurred());
+}
+
+TEST_F(ParseEngineKernelTest, ImageEvents) {
+  // Images can't be decoded before the header.
+  ASSERT_NO_FATAL_FAILURE(DispatchImageEvent(10));
+  EXPECT_TRUE(engine_.error_occurred());
+  engine_.set_error_occurred(false);
+
+  ASSERT_NO_FATAL_FAILURE(DispatchLogFileHeader());
+  ASSERT_NO_FATAL_FAILURE(DispatchImageEvent(10));
+  EXPECT_FALSE(engine_.error_occurred());
+
+  const ModuleInformation* module_info =
+      engine_.GetModuleInformation(kProcessId, kImageBase + 0x1000);
+  ASSERT_TRUE(module_info != NULL);
+  EXPECT_EQ(std::wstring(kImagePath), module_info->path);
+  EXPECT_EQ(kImageBase, module_info->base_address.value());
+  EXPECT_EQ(kImageSize, module_info->module_size);
+  EXPECT_EQ(kImageChecksum, module_info->module_checksum);
+  EXPECT_EQ(kImageTimeDateStamp, module_info->module_time_date_stamp);
+  EXPECT_TRUE(engine_.GetModuleInformation(kOtherProcessId,
+                                           kImageBase) == NULL);
+
+  // A truncated event is an error.
+  Payload payload;
+  payload.Append(kImageBase).Append(kImageSize);
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kImageEventClass, 10, 2, &payload));
+  EXPECT_TRUE(engine_.error_occurred());
+}
+
+TEST_F(ParseEngineKernelTest, SoftPageFault) {
+  ASSERT_NO_FATAL_FAILURE(DispatchLogFileHeader());
+
+  EXPECT_CALL(handler_, OnPageFault(_, kProcessId, kThreadId,
+                                    kImageBase + 0x1234, false));
+  Payload payload;
+  payload.Append(kImageBase + 0x1234).Append(kImageBase);
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kPageFaultEventClass, 10, 2, &payload));
+  EXPECT_FALSE(engine_.error_occurred());
+
+  // Guard page faults are not reported.
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kPageFaultEventClass, 13, 2, &payload));
+  EXPECT_FALSE(engine_.error_occurred());
+}
+
+TEST_F(ParseEngineKernelTest, HardPageFault) {
+  ASSERT_NO_FATAL_FAILURE(DispatchLogFileHeader());
+
+  // Record the process of the faulting thread.
+  Payload thread_payload;
+  thread_payload.Append(kOtherProcessId).Append(kOtherThreadId);
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kThreadEventClass, 3, 2, &thread_payload));
+
+  // The fault is attributed to the faulting thread, rather than to the
+  // thread in the event header.
+  EXPECT_CALL(handler_, OnPageFault(_, kOtherProcessId, kOtherThreadId,
+                                    kImageBase + 0x2000, true));
+  Payload payload;
+  payload.Append(static_cast<uint64>(0)).Append(static_cast<uint64>(0))
+      .Append(kImageBase + 0x2000).Append(static_cast<uint32>(0))
+      .Append(kOtherThreadId).Append(static_cast<uint32>(0x1000));
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kPageFaultEventClass, 32, 2, &payload));
+  EXPECT_FALSE(engine_.error_occurred());
+
+  // A truncated event is an error.
+  payload.data().resize(2 * sizeof(uint64));
+  ASSERT_NO_FATAL_FAILURE(DispatchKernelEvent(
+      kPageFaultEventClass, 32, 2, &payload));
+  EXPECT_TRUE(engine_.error_occurred());
+}
+
+}  // namespace parser
+}  // namespace trace
@@ -16,18 +16,188 @@
 
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
+#include <algorithm>
+
 #include "base/file_util.h"
 #include "base/logging.h"
+#include "base/win/scoped_handle.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/trace/parse/parse_utils.h"
 
-using common::AlignUp;
 using common::AlignUp64;
 
 namespace trace {
 namespace parser {
 
+namespace {
+
+// Provides read access to arbitrary ranges of a trace file by mapping a
+// sliding view of it into memory. This avoids copying each segment out of the
+// file, while keeping the address space used bounded for large trace files.
+class TraceFileView {
+ public:
+  TraceFileView() : file_size_(0), view_(NULL), view_offset_(0),
+                    view_size_(0), allocation_granularity_(0) {
+  }
+
+  ~TraceFileView() {
+    Unmap();
+  }
+
+  // Opens the given trace file for reading.
+  // @param path The path of the file to open.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path) {
+    DCHECK(!file_.IsValid());
+
+    SYSTEM_INFO system_info = {};
+    ::GetSystemInfo(&system_info);
+    allocation_granularity_ = system_info.dwAllocationGranularity;
+
+    file_.Set(::CreateFile(path.value().c_str(), GENERIC_READ,
+                           FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                           NULL));
+    if (!file_.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to open '" << path.value() << "': "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+
+    LARGE_INTEGER file_size = {};
+    if (!::GetFileSizeEx(file_.Get(), &file_size)) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to get the size of '" << path.value() << "': "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+    file_size_ = file_size.QuadPart;
+
+    // An empty file can't be mapped, but there's nothing to read from it
+    // either.
+    if (file_size_ == 0)
+      return true;
+
+    mapping_.Set(::CreateFileMapping(file_.Get(), NULL, PAGE_READONLY, 0, 0,
+                                     NULL));
+    if (!mapping_.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to map '" << path.value() << "': "
+                 << ::common::LogWe(error) << ".";
+      return false;
+    }
+
+    return true;
+  }
+
+  // Gets a pointer to a range of the file. This remains valid until the next
+  // call to GetRange.
+  // @param offset The offset of the range in the file.
+  // @param length The length of the range.
+  // @returns a pointer to the data, or NULL if the range extends beyond the
+  //     end of the file or could not be mapped.
+  const uint8* GetRange(uint64 offset, size_t length) {
+    if (offset > file_size_ || length > file_size_ - offset)
+      return NULL;
+
+    // Reuse the current view if it covers the range.
+    if (view_ != NULL && offset >= view_offset_ &&
+        offset + length <= view_offset_ + view_size_) {
+      return view_ + (offset - view_offset_);
+    }
+
+    Unmap();
+
+    // Views must start on an allocation granularity boundary.
+    uint64 view_offset = offset - offset % allocation_granularity_;
+    uint64 view_size = std::max<uint64>(kViewSize,
+                                        offset + length - view_offset);
+    view_size = std::min(view_size, file_size_ - view_offset);
+
+    view_ = reinterpret_cast<const uint8*>(::MapViewOfFile(
+        mapping_.Get(), FILE_MAP_READ, static_cast<DWORD>(view_offset >> 32),
+        static_cast<DWORD>(view_offset), static_cast<size_t>(view_size)));
+    if (view_ == NULL) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Unable to map a view of the trace file: "
+                 << ::common::LogWe(error) << ".";
+      return NULL;
+    }
+    view_offset_ = view_offset;
+    view_size_ = static_cast<size_t>(view_size);
+
+    return view_ + (offset - view_offset_);
+  }
+
+  // @returns the size of the file.
+  uint64 file_size() const { return file_size_; }
+
+ private:
+  // The preferred size of the views of the file.
+  static const size_t kViewSize = 64 * 1024 * 1024;
+
+  void Unmap() {
+    if (view_ == NULL)
+      return;
+    if (!::UnmapViewOfFile(view_)) {
+      DWORD error = ::GetLastError();
+      LOG(WARNING) << "Unable to unmap a view of the trace file: "
+                   << ::common::LogWe(error) << ".";
+    }
+    view_ = NULL;
+  }
+
+  base::win::ScopedHandle file_;
+  base::win::ScopedHandle mapping_;
+  uint64 file_size_;
+
+  // The currently mapped view, and the range of the file that it covers.
+  const uint8* view_;
+  uint64 view_offset_;
+  size_t view_size_;
+
+  size_t allocation_granularity_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileView);
+};
+
+// Decompresses the data of a compressed segment.
+// @param data The compressed segment data.
+// @param length The length of the compressed data.
+// @param uncompressed_length The expected length of the decompressed data.
+// @param buffer Will receive the decompressed data.
+// @returns true on success, false otherwise.
+bool DecompressSegment(const uint8* data,
+                       size_t length,
+                       size_t uncompressed_length,
+                       std::vector<uint8>* buffer) {
+  DCHECK(data != NULL);
+  DCHECK(buffer != NULL);
+
+  if (uncompressed_length == 0) {
+    LOG(ERROR) << "Encountered empty compressed segment.";
+    return false;
+  }
+
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(data, data + length));
+  core::ZInStream unzip_stream(in_stream.get());
+  buffer->resize(uncompressed_length);
+  if (!unzip_stream.Init() ||
+      !unzip_stream.Read(uncompressed_length, &(*buffer)[0])) {
+    LOG(ERROR) << "Failed to decompress segment.";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
 ParseEngineRpc::ParseEngineRpc() : ParseEngine("RPC", true) {
 }
 
@@ -173,70 +343,104 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
   event_handler_->OnProcessStarted(start_time, file_header->process_id,
                                    &system_info);
 
+  // The record timestamps are TSC values. If the TSC isn't usable as a clock
+  // they can't be converted, and the events carry no time.
+  bool has_clock = clock_converter_.Init(file_header->clock_info.file_time,
+                                         file_header->clock_info.tsc_info,
+                                         file_header->clock_info.tsc_reference);
+
+  // The body of the trace file is read through a mapped view, so that the
+  // events are dispatched straight from the file data.
+  trace_file.reset();
+  TraceFileView trace_file_view;
+  if (!trace_file_view.Open(trace_file_path))
+    return false;
+
   // Consume the body of the trace file.
   uint64 next_segment = AlignUp64(file_header->header_size,
                                   file_header->block_size);
-  scoped_ptr<uint8> buffer;
-  size_t buffer_size = 0;
+  std::vector<uint8> decompressed_segment;
   while (true) {
-    if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
-      LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
-      return false;
+    // A partial segment prefix at the end of the file marks its end.
+    if (next_segment >= trace_file_view.file_size() ||
+        trace_file_view.file_size() - next_segment < sizeof(RecordPrefix)) {
+      break;
     }
 
-    RecordPrefix segment_prefix;
-    if (::fread(&segment_prefix,
-                sizeof(segment_prefix),
-                1,
-                trace_file.get()) != 1) {
-      if (::feof(trace_file.get()))
-        break;
-
+    const uint8* prefix_data =
+        trace_file_view.GetRange(next_segment, sizeof(RecordPrefix));
+    if (prefix_data == NULL) {
       LOG(ERROR) << "Failed to read segment header prefix.";
       return false;
     }
 
-    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
-        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
+    // Segments may have been compressed by the writer, in which case they
+    // have a different header.
+    const RecordPrefix segment_prefix =
+        *reinterpret_cast<const RecordPrefix*>(prefix_data);
+    bool is_compressed =
+        segment_prefix.type == TraceFileCompressedSegmentHeader::kTypeId;
+    size_t header_size = is_compressed ?
+        sizeof(TraceFileCompressedSegmentHeader) :
+        sizeof(TraceFileSegmentHeader);
+    if ((segment_prefix.type != TraceFileSegmentHeader::kTypeId &&
+            !is_compressed) ||
+        segment_prefix.size != header_size ||
         segment_prefix.version.hi != TRACE_VERSION_HI ||
         segment_prefix.version.lo != TRACE_VERSION_LO) {
       LOG(ERROR) << "Unrecognized record prefix for segment header.";
       return false;
     }
 
-    TraceFileSegmentHeader segment_header;
-    if (::fread(&segment_header,
-                sizeof(segment_header),
-                1,
-                trace_file.get()) != 1) {
+    const uint8* header_data = trace_file_view.GetRange(
+        next_segment + sizeof(segment_prefix), header_size);
+    if (header_data == NULL) {
       LOG(ERROR) << "Failed to read segment header.";
       return false;
     }
 
-    size_t aligned_size = AlignUp(segment_header.segment_length,
-                                  file_header->block_size);
-
-    if (aligned_size > buffer_size) {
-      buffer.reset(reinterpret_cast<uint8*>(::malloc(aligned_size)));
-      buffer_size = aligned_size;
+    // The length of the segment data as stored in the file.
+    TraceFileSegmentHeader segment_header = {};
+    size_t stored_length = 0;
+    if (is_compressed) {
+      const TraceFileCompressedSegmentHeader* compressed_header =
+          reinterpret_cast<const TraceFileCompressedSegmentHeader*>(
+              header_data);
+      segment_header.thread_id = compressed_header->thread_id;
+      segment_header.segment_length = compressed_header->uncompressed_length;
+      stored_length = compressed_header->segment_length;
+    } else {
+      segment_header =
+          *reinterpret_cast<const TraceFileSegmentHeader*>(header_data);
+      stored_length = segment_header.segment_length;
     }
 
-    if (::fread(buffer.get(), segment_header.segment_length, 1,
-                trace_file.get()) != 1) {
+    const uint8* buffer = trace_file_view.GetRange(
+        next_segment + sizeof(segment_prefix) + header_size, stored_length);
+    if (buffer == NULL) {
       LOG(ERROR) << "Failed to read segment.";
       return false;
     }
 
+    if (is_compressed) {
+      if (!DecompressSegment(buffer, stored_length,
+                             segment_header.segment_length,
+                             &decompressed_segment)) {
+        return false;
+      }
+      buffer = &decompressed_segment[0];
+    }
+
     if (!ConsumeSegmentEvents(*file_header,
                               segment_header,
-                              buffer.get(),
+                              has_clock,
+                              buffer,
                               segment_header.segment_length)) {
       return false;
     }
 
     next_segment = AlignUp64(
-        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
-            segment_header.segment_length,
+        next_segment + sizeof(segment_prefix) + header_size + stored_length,
         file_header->block_size);
   }
 
@@ -246,22 +450,31 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
 bool ParseEngineRpc::ConsumeSegmentEvents(
     const TraceFileHeader& file_header,
     const TraceFileSegmentHeader& segment_header,
-    uint8* buffer,
+    bool has_clock,
+    const uint8* buffer,
     size_t buffer_length) {
   DCHECK(buffer != NULL);
   DCHECK(event_handler_ != NULL);
 
+  // A segment is filled by a single thread over a short interval, so its
+  // first timestamp is converted once, and the others as deltas to it.
+  if (has_clock && buffer_length >= sizeof(RecordPrefix)) {
+    clock_converter_.SetBase(
+        reinterpret_cast<const RecordPrefix*>(buffer)->timestamp);
+  }
+
   EVENT_TRACE event_record = {};
 
   event_record.Header.ProcessId = file_header.process_id;
   event_record.Header.ThreadId = segment_header.thread_id;
   event_record.Header.Guid = kCallTraceEventClass;
 
-  uint8* read_ptr = buffer;
-  uint8* end_ptr = read_ptr + buffer_length;
+  const uint8* read_ptr = buffer;
+  const uint8* end_ptr = read_ptr + buffer_length;
 
   while (read_ptr < end_ptr) {
-    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(read_ptr);
+    const RecordPrefix* prefix =
+        reinterpret_cast<const RecordPrefix*>(read_ptr);
     read_ptr += sizeof(RecordPrefix) + prefix->size;
     if (read_ptr > end_ptr) {
       // For batch-oriented records (where the record size is updated after
@@ -277,12 +490,15 @@ bool ParseEngineRpc::ConsumeSegmentEvents(
 
     // The TimeStamp is interpreted as a FILETIME, so we convert the timer
     // value to that.
-    trace::common::TscToFileTime(
-        file_header.clock_info,
-        prefix->timestamp,
-        reinterpret_cast<FILETIME*>(&event_record.Header.TimeStamp));
+    if (has_clock) {
+      clock_converter_.Convert(
+          prefix->timestamp,
+          reinterpret_cast<FILETIME*>(&event_record.Header.TimeStamp));
+    }
 
-    event_record.MofData = prefix + 1;
+    // The event handlers only read the event data, which may be a read-only
+    // view of the trace file.
+    event_record.MofData = const_cast<RecordPrefix*>(prefix + 1);
     event_record.MofLength = prefix->size;
     if (!DispatchEvent(&event_record)) {
       LOG(ERROR) << "Failed to process event of type " << prefix->type << ".";
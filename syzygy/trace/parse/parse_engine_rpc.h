@@ -19,6 +19,7 @@
 
 #include "base/files/file_path.h"
 #include "base/time/time.h"
+#include "syzygy/trace/common/clock.h"
 #include "syzygy/trace/parse/parse_engine.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
@@ -58,17 +59,23 @@ class ParseEngineRpc : public ParseEngine {
   //
   // @param file_header the header information describing the trace file.
   // @param segment_header the header information describing the segment.
+  // @param has_clock true if clock_converter_ is initialized for the trace
+  //     file, false if the events can't be timed.
   // @param buffer the full segment data buffer.
   // @param buffer_length the length of the segment data buffer (in bytes).
   // @return true on success.
   bool ConsumeSegmentEvents(const TraceFileHeader& file_header,
                             const TraceFileSegmentHeader& segment_header,
-                            uint8* buffer,
+                            bool has_clock,
+                            const uint8* buffer,
                             size_t buffer_length);
 
   // The set of trace files to consume when ConsumeAllEvents() is called.
   TraceFileSet trace_file_set_;
 
+  // Converts the record timestamps of the trace file being consumed.
+  trace::common::TimerToFileTimeConverter clock_converter_;
+
   DISALLOW_COPY_AND_ASSIGN(ParseEngineRpc);
 };
 
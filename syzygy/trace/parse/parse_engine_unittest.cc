@@ -30,6 +30,8 @@
 namespace {
 
 using testing::_;
+using testing::Invoke;
+using testing::WithArg;
 using trace::parser::Parser;
 using trace::parser::ParseEngine;
 using trace::parser::ParseEventHandler;
@@ -213,6 +215,21 @@ class ParseEngineUnitTest
                void(base::Time time,
                     DWORD process_id,
                     const TraceComment* data));
+  MOCK_METHOD3(OnSessionStatistics,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceSessionStatistics* data));
+  MOCK_METHOD4(OnProfilerCalibration,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceProfilerCalibration* data));
+  MOCK_METHOD5(OnPageFault,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    trace::parser::AbsoluteAddress64 address,
+                    bool is_hard_fault));
 
   static const DWORD kProcessId;
   static const DWORD kThreadId;
@@ -735,6 +752,111 @@ TEST_F(ParseEngineUnitTest, DetailedFunctionCall) {
   ASSERT_TRUE(error_occurred());
 }
 
+// Appends a varint to an encoded batch of compact function calls.
+void AppendVarint(uint64 value, std::vector<uint8>* data) {
+  uint8 buffer[kMaxTraceVarintSize] = {};
+  size_t size = WriteTraceVarint(value, buffer);
+  data->insert(data->end(), buffer, buffer + size);
+}
+
+// Keeps a copy of the detailed function calls it is invoked with.
+class DetailedFunctionCallRecorder {
+ public:
+  void Record(const TraceDetailedFunctionCall* data) {
+    const uint8* begin = reinterpret_cast<const uint8*>(data);
+    calls.push_back(std::vector<uint8>(
+        begin,
+        begin + FIELD_OFFSET(TraceDetailedFunctionCall, argument_data) +
+            data->argument_data_size));
+  }
+
+  const TraceDetailedFunctionCall* call(size_t index) const {
+    return reinterpret_cast<const TraceDetailedFunctionCall*>(
+        &calls[index][0]);
+  }
+
+  std::vector<std::vector<uint8>> calls;
+};
+
+TEST_F(ParseEngineUnitTest, CompactFunctionCalls) {
+  const uint32 kStackTraceId = 0x11223344;
+
+  // The first call has a new stack trace ID and two arguments.
+  std::vector<uint8> calls;
+  AppendVarint(5, &calls);  // Timestamp delta.
+  AppendVarint(3, &calls);  // Function ID.
+  AppendVarint(0, &calls);  // New stack trace ID.
+  const uint8* stack_trace_id = reinterpret_cast<const uint8*>(&kStackTraceId);
+  calls.insert(calls.end(), stack_trace_id,
+               stack_trace_id + sizeof(kStackTraceId));
+  AppendVarint(2, &calls);  // 2 arguments.
+  AppendVarint(4, &calls);  // Argument 0 length 4.
+  AppendVarint(ZigZagEncodeTraceDelta(0x1000), &calls);
+  AppendVarint(1, &calls);  // Argument 1 length 1.
+  calls.push_back('A');
+
+  // The second call reuses the stack trace ID, and its argument is relative
+  // to the first argument of the previous call.
+  AppendVarint(7, &calls);  // Timestamp delta.
+  AppendVarint(4, &calls);  // Function ID.
+  AppendVarint(0, &calls);  // Stack trace ID 0 in the dictionary.
+  AppendVarint(1, &calls);  // 1 argument.
+  AppendVarint(4, &calls);  // Argument 0 length 4.
+  AppendVarint(ZigZagEncodeTraceDelta(static_cast<uint32>(-16)), &calls);
+
+  std::vector<uint8> buffer(
+      FIELD_OFFSET(TraceCompactFunctionCalls, data) + calls.size());
+  TraceCompactFunctionCalls* data =
+      reinterpret_cast<TraceCompactFunctionCalls*>(&buffer[0]);
+  data->base_timestamp = 100;
+  data->call_count = 2;
+  data->data_size = calls.size();
+  ::memcpy(data->data, &calls[0], calls.size());
+
+  DetailedFunctionCallRecorder recorder;
+  EXPECT_CALL(*this, OnDetailedFunctionCall(_, kProcessId, kThreadId, _))
+      .Times(2)
+      .WillRepeatedly(WithArg<3>(
+          Invoke(&recorder, &DetailedFunctionCallRecorder::Record)));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_FUNCTION_CALLS, data, buffer.size()));
+  ASSERT_FALSE(error_occurred());
+  ASSERT_EQ(2u, recorder.calls.size());
+
+  const uint8 kArguments0[] = {
+      0x02, 0x00, 0x00, 0x00,  // 2 arguments.
+      0x04, 0x00, 0x00, 0x00,  // Argument 0 length 4.
+      0x01, 0x00, 0x00, 0x00,  // Argument 1 length 1.
+      0x00, 0x10, 0x00, 0x00,  // Argument 0: 0x1000.
+      'A'                      // Argument 1: 'A'
+      };
+  const TraceDetailedFunctionCall* call = recorder.call(0);
+  EXPECT_EQ(105u, call->timestamp);
+  EXPECT_EQ(3u, call->function_id);
+  EXPECT_EQ(kStackTraceId, call->stack_trace_id);
+  ASSERT_EQ(arraysize(kArguments0), call->argument_data_size);
+  EXPECT_EQ(0, ::memcmp(kArguments0, call->argument_data,
+                        arraysize(kArguments0)));
+
+  const uint8 kArguments1[] = {
+      0x01, 0x00, 0x00, 0x00,  // 1 argument.
+      0x04, 0x00, 0x00, 0x00,  // Argument 0 length 4.
+      0xF0, 0x0F, 0x00, 0x00,  // Argument 0: 0xFF0.
+      };
+  call = recorder.call(1);
+  EXPECT_EQ(112u, call->timestamp);
+  EXPECT_EQ(4u, call->function_id);
+  EXPECT_EQ(kStackTraceId, call->stack_trace_id);
+  ASSERT_EQ(arraysize(kArguments1), call->argument_data_size);
+  EXPECT_EQ(0, ::memcmp(kArguments1, call->argument_data,
+                        arraysize(kArguments1)));
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_COMPACT_FUNCTION_CALLS, data, buffer.size() - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 TEST_F(ParseEngineUnitTest, Comment) {
   const char kDummyComment[] = "This is a comment!";
   char buffer[FIELD_OFFSET(TraceComment, comment) +
@@ -756,4 +878,38 @@ TEST_F(ParseEngineUnitTest, Comment) {
   ASSERT_TRUE(error_occurred());
 }
 
+TEST_F(ParseEngineUnitTest, SessionStatistics) {
+  TraceSessionStatistics data = {};
+  data.source = TraceSessionStatistics::kServiceSource;
+  data.num_sessions = 1;
+  data.num_buffers_committed = 42;
+
+  EXPECT_CALL(*this, OnSessionStatistics(_, kProcessId, &data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_SESSION_STATISTICS, &data, sizeof(data)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_SESSION_STATISTICS, &data, sizeof(data) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
+TEST_F(ParseEngineUnitTest, ProfilerCalibration) {
+  TraceProfilerCalibration data = {};
+  data.processor_number = 1;
+  data.invocation_overhead_cycles = 40;
+  data.call_overhead_cycles = 100;
+
+  EXPECT_CALL(*this, OnProfilerCalibration(_, kProcessId, kThreadId, &data));
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_PROFILER_CALIBRATION, &data, sizeof(data)));
+  ASSERT_FALSE(error_occurred());
+
+  // Dispatch a malformed record and make sure the parser errors.
+  ASSERT_NO_FATAL_FAILURE(DispatchEventData(
+      TRACE_PROFILER_CALIBRATION, &data, sizeof(data) - 1));
+  ASSERT_TRUE(error_occurred());
+}
+
 }  // namespace
@@ -18,6 +18,7 @@
 
 #include "base/logging.h"
 #include "syzygy/common/buffer_parser.h"
+#include "syzygy/trace/parse/parse_engine_kernel.h"
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
 namespace trace {
@@ -58,6 +59,15 @@ bool Parser::Init(ParseEventHandler* event_handler) {
   }
   parse_engine_set_.push_back(engine);
 
+  // Create the kernel ETW parse engine.
+  LOG(INFO) << "Initializing kernel ETW parse engine.";
+  engine = new ParseEngineKernel;
+  if (engine == NULL) {
+    LOG(ERROR) << "Failed to initialize kernel ETW parse engine.";
+    return false;
+  }
+  parse_engine_set_.push_back(engine);
+
   // Setup the event handler for all of the engines.
   ParseEngineIter it = parse_engine_set_.begin();
   for (; it != parse_engine_set_.end(); ++it) {
@@ -244,5 +254,26 @@ void ParseEventHandlerImpl::OnComment(
     const TraceComment* data) {
 }
 
+void ParseEventHandlerImpl::OnSessionStatistics(
+    base::Time time,
+    DWORD process_id,
+    const TraceSessionStatistics* data) {
+}
+
+void ParseEventHandlerImpl::OnProfilerCalibration(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    const TraceProfilerCalibration* data) {
+}
+
+void ParseEventHandlerImpl::OnPageFault(
+    base::Time time,
+    DWORD process_id,
+    DWORD thread_id,
+    AbsoluteAddress64 address,
+    bool is_hard_fault) {
+}
+
 }  // namespace parser
 }  // namespace trace
@@ -120,6 +120,9 @@ class Parser {
 };
 
 // Implemented by clients of Parser to receive trace event notifications.
+// The records passed to the callbacks point directly into the trace buffers
+// whenever possible, and are only valid for the duration of the callback.
+// Clients that need a record afterwards must copy what they need from it.
 class ParseEventHandler {
  public:
   // Issued for the first call-trace event occurring in an instrumented module.
@@ -230,6 +233,29 @@ class ParseEventHandler {
       base::Time time,
       DWORD process_id,
       const TraceComment* data) = 0;
+
+  // Issued for session statistics records.
+  virtual void OnSessionStatistics(
+      base::Time time,
+      DWORD process_id,
+      const TraceSessionStatistics* data) = 0;
+
+  // Issued for profiler calibration records.
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerCalibration* data) = 0;
+
+  // Issued for page faults recorded by the kernel logger. @p address is the
+  // faulting address in the memory space of @p process_id. Soft faults are
+  // resolved from memory, while hard faults required reading from disk.
+  virtual void OnPageFault(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      AbsoluteAddress64 address,
+      bool is_hard_fault) = 0;
 };
 
 // A default implementation of the ParseEventHandler interface. Provides
@@ -308,6 +334,21 @@ class ParseEventHandlerImpl : public ParseEventHandler {
       base::Time time,
       DWORD process_id,
       const TraceComment* data) OVERRIDE;
+  virtual void OnSessionStatistics(
+      base::Time time,
+      DWORD process_id,
+      const TraceSessionStatistics* data) OVERRIDE;
+  virtual void OnProfilerCalibration(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      const TraceProfilerCalibration* data) OVERRIDE;
+  virtual void OnPageFault(
+      base::Time time,
+      DWORD process_id,
+      DWORD thread_id,
+      AbsoluteAddress64 address,
+      bool is_hard_fault) OVERRIDE;
   // @}
 };
 
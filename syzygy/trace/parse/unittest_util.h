@@ -95,6 +95,21 @@ class MockParseEventHandler : public trace::parser::ParseEventHandler {
                void(base::Time time,
                     DWORD process_id,
                     const TraceComment* data));
+  MOCK_METHOD3(OnSessionStatistics,
+               void(base::Time time,
+                    DWORD process_id,
+                    const TraceSessionStatistics* data));
+  MOCK_METHOD4(OnProfilerCalibration,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    const TraceProfilerCalibration* data));
+  MOCK_METHOD5(OnPageFault,
+               void(base::Time time,
+                    DWORD process_id,
+                    DWORD thread_id,
+                    trace::parser::AbsoluteAddress64 address,
+                    bool is_hard_fault));
 };
 
 typedef testing::StrictMock<MockParseEventHandler> StrictMockParseEventHandler;
@@ -0,0 +1,117 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/buffer_ring.h"
+
+#include "base/logging.h"
+
+namespace {
+
+COMPILE_ASSERT((BufferRing::kNumEntries & (BufferRing::kNumEntries - 1)) == 0,
+               buffer_ring_size_must_be_a_power_of_two);
+
+const ULONG kIndexMask = BufferRing::kNumEntries - 1;
+
+// Positions and sequence numbers wrap around, so they are compared through
+// their difference.
+LONG Difference(LONG a, LONG b) {
+  return static_cast<LONG>(static_cast<ULONG>(a) - static_cast<ULONG>(b));
+}
+
+LONG Advance(LONG position, ULONG distance) {
+  return static_cast<LONG>(static_cast<ULONG>(position) + distance);
+}
+
+}  // namespace
+
+void InitializeBufferRing(BufferRing* ring) {
+  DCHECK(ring != NULL);
+
+  ::memset(ring, 0, sizeof(*ring));
+  for (LONG i = 0; i < BufferRing::kNumEntries; ++i)
+    ring->entries[i].sequence = i;
+}
+
+bool PushBufferRing(const BufferRingDescriptor& descriptor, BufferRing* ring) {
+  DCHECK(ring != NULL);
+
+  BufferRingEntry* entry = NULL;
+  LONG position = ring->enqueue_position;
+  while (true) {
+    entry = &ring->entries[static_cast<ULONG>(position) & kIndexMask];
+    LONG difference = Difference(entry->sequence, position);
+    if (difference == 0) {
+      // The entry is free, try to claim it.
+      LONG previous = ::InterlockedCompareExchange(
+          &ring->enqueue_position, Advance(position, 1), position);
+      if (previous == position)
+        break;
+      position = previous;
+    } else if (difference < 0) {
+      // The entry still holds a descriptor from the previous lap.
+      return false;
+    } else {
+      // Another producer claimed the entry, catch up.
+      position = ring->enqueue_position;
+    }
+  }
+
+  // Publish the descriptor. The interlocked operation is a full barrier.
+  entry->descriptor = descriptor;
+  ::InterlockedExchange(&entry->sequence, Advance(position, 1));
+  return true;
+}
+
+bool PopBufferRing(BufferRing* ring, BufferRingDescriptor* descriptor) {
+  DCHECK(ring != NULL);
+  DCHECK(descriptor != NULL);
+
+  BufferRingEntry* entry = NULL;
+  LONG position = ring->dequeue_position;
+  while (true) {
+    entry = &ring->entries[static_cast<ULONG>(position) & kIndexMask];
+    LONG difference = Difference(entry->sequence, Advance(position, 1));
+    if (difference == 0) {
+      // The entry holds a descriptor, try to claim it.
+      LONG previous = ::InterlockedCompareExchange(
+          &ring->dequeue_position, Advance(position, 1), position);
+      if (previous == position)
+        break;
+      position = previous;
+    } else if (difference < 0) {
+      // The entry hasn't been published yet.
+      return false;
+    } else {
+      // Another consumer claimed the entry, catch up.
+      position = ring->dequeue_position;
+    }
+  }
+
+  // Hand the entry back to the producers, for their next lap.
+  *descriptor = entry->descriptor;
+  ::InterlockedExchange(&entry->sequence,
+                        Advance(position, BufferRing::kNumEntries));
+  return true;
+}
+
+size_t GetBufferRingSize(const BufferRing& ring) {
+  // Read the dequeue position first. Positions only move forward, so this
+  // can't observe more pops than pushes.
+  LONG dequeue_position = ring.dequeue_position;
+  LONG enqueue_position = ring.enqueue_position;
+  LONG size = Difference(enqueue_position, dequeue_position);
+  DCHECK_LE(0, size);
+  DCHECK_GE(BufferRing::kNumEntries, size);
+  return size;
+}
@@ -0,0 +1,98 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the rings of buffer descriptors that a call trace client and the
+// call trace service share in memory. They let a client commit full buffers
+// and pick up fresh ones without an RPC round-trip per buffer. The client
+// pushes full buffers to the commit ring and signals the service's event. The
+// service commits them and keeps the free ring stocked with fresh buffers.
+//
+// Each ring is a bounded multi-producer multi-consumer queue, built on a
+// sequence number per entry as described at
+// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue.
+
+#ifndef SYZYGY_TRACE_PROTOCOL_BUFFER_RING_H_
+#define SYZYGY_TRACE_PROTOCOL_BUFFER_RING_H_
+
+#include <windows.h>
+
+#include "base/basictypes.h"
+#include "syzygy/common/assertions.h"
+
+// Describes a call trace buffer. This mirrors the fields of the RPC
+// CallTraceBuffer structure.
+struct BufferRingDescriptor {
+  uint32 shared_memory_handle;
+  uint32 mapping_size;
+  uint32 buffer_offset;
+  uint32 buffer_size;
+};
+COMPILE_ASSERT_IS_POD(BufferRingDescriptor);
+
+struct BufferRingEntry {
+  // The position this entry is ready to be written at, or that plus one once
+  // it's ready to be read.
+  volatile LONG sequence;
+  BufferRingDescriptor descriptor;
+};
+COMPILE_ASSERT_IS_POD(BufferRingEntry);
+
+struct BufferRing {
+  // Must be a power of two.
+  enum { kNumEntries = 64 };
+
+  // The producers and consumers each get their own cache line.
+  volatile LONG enqueue_position;
+  uint8 reserved1[60];
+  volatile LONG dequeue_position;
+  uint8 reserved2[60];
+
+  BufferRingEntry entries[kNumEntries];
+};
+COMPILE_ASSERT_IS_POD(BufferRing);
+
+// The layout of the shared memory a session's rings live in.
+struct BufferRings {
+  // Full buffers, pushed by the client and popped by the service.
+  BufferRing commit_ring;
+  // Fresh buffers, pushed by the service and popped by the client.
+  BufferRing free_ring;
+};
+COMPILE_ASSERT_IS_POD(BufferRings);
+
+// Initializes an empty ring.
+// @param ring the ring to initialize.
+void InitializeBufferRing(BufferRing* ring);
+
+// Pushes a descriptor onto a ring. This is safe to call concurrently with
+// other pushes and pops, from any process sharing the ring.
+// @param descriptor the descriptor to push.
+// @param ring the ring to push to.
+// @returns true on success, false if the ring is full.
+bool PushBufferRing(const BufferRingDescriptor& descriptor, BufferRing* ring);
+
+// Pops a descriptor from a ring. This is safe to call concurrently with other
+// pushes and pops, from any process sharing the ring.
+// @param ring the ring to pop from.
+// @param descriptor receives the popped descriptor.
+// @returns true on success, false if the ring is empty.
+bool PopBufferRing(BufferRing* ring, BufferRingDescriptor* descriptor);
+
+// Gets the number of descriptors in a ring. This is only a snapshot when the
+// ring is being used concurrently.
+// @param ring the ring to inspect.
+// @returns the number of descriptors pushed and not yet popped.
+size_t GetBufferRingSize(const BufferRing& ring);
+
+#endif  // SYZYGY_TRACE_PROTOCOL_BUFFER_RING_H_
@@ -0,0 +1,185 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/protocol/buffer_ring.h"
+
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+BufferRingDescriptor MakeDescriptor(uint32 id) {
+  BufferRingDescriptor descriptor = {};
+  descriptor.shared_memory_handle = id;
+  descriptor.mapping_size = id + 1;
+  descriptor.buffer_offset = id + 2;
+  descriptor.buffer_size = id + 3;
+  return descriptor;
+}
+
+class BufferRingTest : public testing::Test {
+ public:
+  virtual void SetUp() OVERRIDE {
+    testing::Test::SetUp();
+    InitializeBufferRing(&ring_);
+  }
+
+  // Pushes the descriptors [first, first + count) from a single producer.
+  class Producer : public base::DelegateSimpleThread::Delegate {
+   public:
+    Producer(BufferRing* ring, uint32 first, uint32 count)
+        : ring_(ring), first_(first), count_(count) {
+    }
+
+    virtual void Run() OVERRIDE {
+      for (uint32 i = 0; i < count_; ++i) {
+        while (!PushBufferRing(MakeDescriptor(first_ + i), ring_))
+          ::Sleep(0);
+      }
+    }
+
+   private:
+    BufferRing* ring_;
+    uint32 first_;
+    uint32 count_;
+  };
+
+  BufferRing ring_;
+};
+
+}  // namespace
+
+TEST_F(BufferRingTest, InitiallyEmpty) {
+  EXPECT_EQ(0u, GetBufferRingSize(ring_));
+
+  BufferRingDescriptor descriptor = {};
+  EXPECT_FALSE(PopBufferRing(&ring_, &descriptor));
+}
+
+TEST_F(BufferRingTest, PushAndPopInOrder) {
+  EXPECT_TRUE(PushBufferRing(MakeDescriptor(10), &ring_));
+  EXPECT_TRUE(PushBufferRing(MakeDescriptor(20), &ring_));
+  EXPECT_EQ(2u, GetBufferRingSize(ring_));
+
+  BufferRingDescriptor descriptor = {};
+  ASSERT_TRUE(PopBufferRing(&ring_, &descriptor));
+  EXPECT_EQ(10u, descriptor.shared_memory_handle);
+  EXPECT_EQ(11u, descriptor.mapping_size);
+  EXPECT_EQ(12u, descriptor.buffer_offset);
+  EXPECT_EQ(13u, descriptor.buffer_size);
+
+  ASSERT_TRUE(PopBufferRing(&ring_, &descriptor));
+  EXPECT_EQ(20u, descriptor.shared_memory_handle);
+
+  EXPECT_EQ(0u, GetBufferRingSize(ring_));
+  EXPECT_FALSE(PopBufferRing(&ring_, &descriptor));
+}
+
+TEST_F(BufferRingTest, PushFailsWhenFull) {
+  for (uint32 i = 0; i < BufferRing::kNumEntries; ++i)
+    EXPECT_TRUE(PushBufferRing(MakeDescriptor(i), &ring_));
+  EXPECT_EQ(static_cast<size_t>(BufferRing::kNumEntries),
+            GetBufferRingSize(ring_));
+  EXPECT_FALSE(PushBufferRing(MakeDescriptor(0), &ring_));
+
+  // Popping makes room for one more.
+  BufferRingDescriptor descriptor = {};
+  EXPECT_TRUE(PopBufferRing(&ring_, &descriptor));
+  EXPECT_EQ(0u, descriptor.shared_memory_handle);
+  EXPECT_TRUE(PushBufferRing(MakeDescriptor(0), &ring_));
+  EXPECT_FALSE(PushBufferRing(MakeDescriptor(0), &ring_));
+}
+
+TEST_F(BufferRingTest, WrapsAround) {
+  // Go around the ring a few times, keeping a few descriptors in it.
+  uint32 next_push = 0;
+  uint32 next_pop = 0;
+  for (; next_push < 3; ++next_push)
+    ASSERT_TRUE(PushBufferRing(MakeDescriptor(next_push), &ring_));
+
+  for (; next_push < 5 * BufferRing::kNumEntries; ++next_push) {
+    ASSERT_TRUE(PushBufferRing(MakeDescriptor(next_push), &ring_));
+    BufferRingDescriptor descriptor = {};
+    ASSERT_TRUE(PopBufferRing(&ring_, &descriptor));
+    EXPECT_EQ(next_pop++, descriptor.shared_memory_handle);
+  }
+  EXPECT_EQ(3u, GetBufferRingSize(ring_));
+}
+
+TEST_F(BufferRingTest, WorksWithPositionsThatOverflow) {
+  // Start the positions just shy of the wrap-around of their type.
+  const LONG kStart = static_cast<LONG>(0xFFFFFFF0U);
+  ring_.enqueue_position = kStart;
+  ring_.dequeue_position = kStart;
+  for (ULONG i = 0; i < BufferRing::kNumEntries; ++i) {
+    ULONG position = static_cast<ULONG>(kStart) + i;
+    ring_.entries[position & (BufferRing::kNumEntries - 1)].sequence =
+        static_cast<LONG>(position);
+  }
+
+  for (uint32 i = 0; i < 2 * BufferRing::kNumEntries; ++i) {
+    ASSERT_TRUE(PushBufferRing(MakeDescriptor(i), &ring_));
+    EXPECT_EQ(1u, GetBufferRingSize(ring_));
+    BufferRingDescriptor descriptor = {};
+    ASSERT_TRUE(PopBufferRing(&ring_, &descriptor));
+    EXPECT_EQ(i, descriptor.shared_memory_handle);
+    EXPECT_EQ(0u, GetBufferRingSize(ring_));
+  }
+}
+
+TEST_F(BufferRingTest, ConcurrentProducers) {
+  const uint32 kNumProducers = 4;
+  const uint32 kNumPushesPerProducer = 1000;
+
+  ScopedVector<Producer> producers;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (uint32 i = 0; i < kNumProducers; ++i) {
+    producers.push_back(new Producer(&ring_, i * kNumPushesPerProducer,
+                                     kNumPushesPerProducer));
+    threads.push_back(
+        new base::DelegateSimpleThread(producers.back(), "BufferRingTest"));
+    threads.back()->Start();
+  }
+
+  // Each producer's descriptors must come out in the order it pushed them,
+  // and none may be lost or duplicated.
+  std::vector<uint32> next_id(kNumProducers);
+  for (uint32 i = 0; i < kNumProducers; ++i)
+    next_id[i] = i * kNumPushesPerProducer;
+
+  uint32 num_popped = 0;
+  while (num_popped < kNumProducers * kNumPushesPerProducer) {
+    BufferRingDescriptor descriptor = {};
+    if (!PopBufferRing(&ring_, &descriptor)) {
+      ::Sleep(0);
+      continue;
+    }
+
+    uint32 producer = descriptor.shared_memory_handle / kNumPushesPerProducer;
+    ASSERT_GT(kNumProducers, producer);
+    EXPECT_EQ(next_id[producer], descriptor.shared_memory_handle);
+    EXPECT_EQ(descriptor.shared_memory_handle + 3, descriptor.buffer_size);
+    ++next_id[producer];
+    ++num_popped;
+  }
+
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+
+  BufferRingDescriptor descriptor = {};
+  EXPECT_FALSE(PopBufferRing(&ring_, &descriptor));
+}
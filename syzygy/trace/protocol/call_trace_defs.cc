@@ -53,6 +53,16 @@ const char kSyzygyRpcInstanceIdEnvVar[] = "SYZYGY_RPC_INSTANCE_ID";
 // Environment variable used to indicate that an RPC session is mandatory.
 const char kSyzygyRpcSessionMandatoryEnvVar[] =
     "SYZYGY_RPC_SESSION_MANDATORY";
+// Environment variable used to set the number of spare buffers an RPC session
+// keeps on hand.
+const char kSyzygyRpcSpareBuffersEnvVar[] = "SYZYGY_RPC_SPARE_BUFFERS";
+// Environment variable used to indicate that an RPC session should exchange
+// buffers through a shared-memory buffer ring.
+const char kSyzygyRpcBufferRingEnvVar[] = "SYZYGY_RPC_BUFFER_RING";
+// Environment variable used to indicate that the processes of an instrumented
+// module should merge their frequency data in shared memory.
+const char kSyzygySharedFrequencyDataEnvVar[] =
+    "SYZYGY_SHARED_FREQUENCY_DATA";
 
 namespace {
 
@@ -99,3 +109,26 @@ void GetSyzygyCallTraceRpcEventName(const base::StringPiece16& id,
                                     std::wstring* event_name) {
   MakeInstanceString(kCallTraceRpcEvent, id, event_name);
 }
+
+size_t GetTraceLatencyBucket(uint64 microseconds) {
+  size_t bucket = 0;
+  while (microseconds != 0 && bucket + 1 < TraceLatencyHistogram::kNumBuckets) {
+    microseconds >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+void AddTraceSessionStatistics(const TraceSessionStatistics& statistics,
+                               TraceSessionStatistics* total) {
+  DCHECK(total != NULL);
+
+  total->num_sessions += statistics.num_sessions;
+  total->num_buffers_committed += statistics.num_buffers_committed;
+  total->num_bytes_committed += statistics.num_bytes_committed;
+  total->num_recycle_stalls += statistics.num_recycle_stalls;
+  for (size_t i = 0; i < TraceLatencyHistogram::kNumBuckets; ++i) {
+    total->wait_time.counts[i] += statistics.wait_time.counts[i];
+    total->write_latency.counts[i] += statistics.write_latency.counts[i];
+  }
+}
@@ -63,10 +63,22 @@ void GetSyzygyCallTraceRpcEventName(const base::StringPiece16& id,
 // Environment variable used to indicate that an RPC session is mandatory.
 extern const char kSyzygyRpcSessionMandatoryEnvVar[];
 
+// Environment variable used to set the number of spare buffers an RPC session
+// keeps on hand.
+extern const char kSyzygyRpcSpareBuffersEnvVar[];
+
+// Environment variable used to indicate that an RPC session should exchange
+// buffers through a shared-memory buffer ring.
+extern const char kSyzygyRpcBufferRingEnvVar[];
+
+// Environment variable used to indicate that the processes of an instrumented
+// module should merge their frequency data in shared memory.
+extern const char kSyzygySharedFrequencyDataEnvVar[];
+
 // This must be bumped anytime the file format is changed.
 enum {
   TRACE_VERSION_HI = 1,
-  TRACE_VERSION_LO = 4,
+  TRACE_VERSION_LO = 5,
 };
 
 enum TraceEventType {
@@ -92,6 +104,11 @@ enum TraceEventType {
   TRACE_STACK_TRACE,
   TRACE_DETAILED_FUNCTION_CALL,
   TRACE_COMMENT,
+  // Header prefix for a compressed "page" of call trace events.
+  TRACE_COMPRESSED_PAGE_HEADER,
+  TRACE_SESSION_STATISTICS,
+  TRACE_COMPACT_FUNCTION_CALLS,
+  TRACE_PROFILER_CALIBRATION,
 };
 
 // All traces are emitted at this trace level.
@@ -110,6 +127,9 @@ enum TraceEventFlags {
   TRACE_FLAG_THREAD_EVENTS  = 0x0010,
   // Batch entry traces.
   TRACE_FLAG_BATCH_ENTER    = 0x0020,
+  // Record buffer exchange statistics in the trace file. Unlike the other
+  // flags this may be combined with TRACE_FLAG_BATCH_ENTER.
+  TRACE_FLAG_SESSION_STATISTICS = 0x0040,
 };
 
 // Max depth of stack trace captured on entry/exit.
@@ -250,6 +270,28 @@ struct TraceFileSegmentHeader {
 };
 COMPILE_ASSERT_IS_POD(TraceFileSegmentHeader);
 
+// Written at the beginning of a compressed call trace file segment, in place
+// of a TraceFileSegmentHeader. The segment data that follows is a zlib stream
+// which decompresses to the records of an ordinary segment. As with ordinary
+// segments, the on-disk length is rounded up to the block_size.
+struct TraceFileCompressedSegmentHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_COMPRESSED_PAGE_HEADER };
+
+  // The identity of the thread that is reporting in this segment
+  // of the trace file.
+  uint32 thread_id;
+
+  // The number of compressed data bytes in this segment of the trace file.
+  // This value does not include the size of the record prefix nor the size
+  // of the segment header.
+  uint32 segment_length;
+
+  // The number of bytes of segment data once decompressed.
+  uint32 uncompressed_length;
+};
+COMPILE_ASSERT_IS_POD(TraceFileCompressedSegmentHeader);
+
 // The structure traced on function entry or exit.
 template<int TypeId>
 struct TraceEnterExitEventDataTempl {
@@ -351,6 +393,25 @@ struct TraceBatchInvocationInfo {
 };
 COMPILE_ASSERT_IS_POD(TraceBatchInvocationInfo);
 
+// Records the overhead of the profiler's hooks that its own accounting can't
+// see, as calibrated on a processor. Each thread writes one of these when it
+// starts tracing, so that the invocations it records can be compensated.
+struct TraceProfilerCalibration {
+  enum { kTypeId = TRACE_PROFILER_CALIBRATION };
+
+  // The processor the hooks were calibrated on.
+  uint32 processor_number;
+
+  // The number of cycles of hook overhead that each invocation reports as its
+  // own. This is the tail of the entry hook and the head of the exit hook.
+  uint64 invocation_overhead_cycles;
+
+  // The number of cycles of hook overhead that each invocation adds to the
+  // cycles of its caller. This includes invocation_overhead_cycles.
+  uint64 call_overhead_cycles;
+};
+COMPILE_ASSERT_IS_POD(TraceProfilerCalibration);
+
 struct TraceThreadNameInfo {
   enum { kTypeId = TRACE_THREAD_NAME };
   // In fact as many as our enclosing record's size allows for,
@@ -498,6 +559,103 @@ struct TraceDetailedFunctionCall {
 };
 COMPILE_ASSERT_IS_POD(TraceDetailedFunctionCall);
 
+// Records a batch of detailed function calls made by a single thread. This
+// carries the same information as a series of TraceDetailedFunctionCall
+// records, but each call is encoded relative to the previous calls of the
+// batch. The |data| blob holds |call_count| calls, each laid out as follows:
+// varint timestamp_delta
+// varint function_id
+// varint stack_trace_index
+// uint32 stack_trace_id (only present if stack_trace_index is new, see below)
+// varint argument_count
+// varint argument_length_0
+// argument_0
+// varint argument_length_1
+// argument_1
+// ...
+// Varints are encoded by WriteTraceVarint. The timestamp delta of the first
+// call is relative to |base_timestamp|, and that of the others to the
+// timestamp of the previous call. The stack trace IDs of the batch form a
+// dictionary, in order of first appearance. An index equal to the size of
+// the dictionary is followed by a new ID, which is added to the dictionary
+// unless it already holds kMaxStackTraceIds IDs. Among the first
+// kMaxDeltaArguments arguments, those of 4 bytes are encoded as the zigzag
+// varint of their difference with the argument at the same position in the
+// previous call that had one, or with 0. All other arguments are stored as
+// is.
+struct TraceCompactFunctionCalls {
+  enum { kTypeId = TRACE_COMPACT_FUNCTION_CALLS };
+
+  // The maximum size of the stack trace ID dictionary of a batch.
+  enum { kMaxStackTraceIds = 64 };
+
+  // The number of leading arguments that are delta encoded.
+  enum { kMaxDeltaArguments = 8 };
+
+  // The timestamp the first call of the batch is relative to.
+  uint64 base_timestamp;
+
+  // The number of calls in the batch.
+  uint32 call_count;
+
+  // The size of the encoded calls.
+  uint32 data_size;
+
+  // The encoded calls. This is actually of size |data_size|.
+  uint8 data[1];
+};
+COMPILE_ASSERT_IS_POD(TraceCompactFunctionCalls);
+
+// The maximum size of a varint encoded by WriteTraceVarint.
+const size_t kMaxTraceVarintSize = 10;
+
+// Encodes a varint, as 7-bit groups starting with the least significant one,
+// with the high bit of each byte set if more bytes follow.
+// @param value the value to encode.
+// @param buffer the buffer to write to. This must have room for
+//     kMaxTraceVarintSize bytes.
+// @returns the number of bytes written.
+inline size_t WriteTraceVarint(uint64 value, uint8* buffer) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<uint8>(value) | 0x80;
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<uint8>(value);
+  return size;
+}
+
+// Decodes a varint encoded by WriteTraceVarint.
+// @param buffer the buffer to read from.
+// @param buffer_size the number of bytes that can be read from @p buffer.
+// @param value receives the decoded value.
+// @returns the number of bytes read, or 0 if the buffer doesn't hold a valid
+//     varint.
+inline size_t ReadTraceVarint(const uint8* buffer,
+                              size_t buffer_size,
+                              uint64* value) {
+  uint64 result = 0;
+  for (size_t i = 0; i < buffer_size && i < kMaxTraceVarintSize; ++i) {
+    result |= static_cast<uint64>(buffer[i] & 0x7F) << (7 * i);
+    if ((buffer[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// Maps a signed 32-bit difference to an unsigned value such that differences
+// of small magnitude, be they positive or negative, have small encodings.
+inline uint32 ZigZagEncodeTraceDelta(uint32 delta) {
+  return (delta << 1) ^ static_cast<uint32>(static_cast<int32>(delta) >> 31);
+}
+
+// Inverts ZigZagEncodeTraceDelta.
+inline uint32 ZigZagDecodeTraceDelta(uint32 value) {
+  return (value >> 1) ^ (0 - (value & 1));
+}
+
 // Records a comment in a trace file. These are output via the call-trace
 // service and act as delimiters in a call-trace log.
 struct TraceComment {
@@ -510,4 +668,65 @@ struct TraceComment {
   char comment[1];
 };
 
+// A histogram of durations, with buckets of exponentially increasing width.
+// Bucket 0 counts durations below 1us and bucket i counts durations in
+// [2^(i-1), 2^i) us. The last bucket also counts anything longer.
+struct TraceLatencyHistogram {
+  enum { kNumBuckets = 24 };
+
+  uint32 counts[kNumBuckets];
+};
+COMPILE_ASSERT_IS_POD(TraceLatencyHistogram);
+
+// Gets the bucket of a TraceLatencyHistogram that counts a duration.
+// @param microseconds the duration.
+// @returns the index of the bucket.
+size_t GetTraceLatencyBucket(uint64 microseconds);
+
+// Records statistics about the buffers exchanged over a call trace session,
+// to help size buffer pools and diagnose throughput issues. These are written
+// by the service alongside the process ended event, and by clients when they
+// close their session, if the TRACE_FLAG_SESSION_STATISTICS flag is set. The
+// service also aggregates them across sessions.
+struct TraceSessionStatistics {
+  enum { kTypeId = TRACE_SESSION_STATISTICS };
+
+  // The side of the session that recorded the statistics.
+  enum Source {
+    kClientSource,
+    kServiceSource,
+  };
+
+  // The Source of these statistics.
+  uint32 source;
+
+  // The number of sessions these statistics cover.
+  uint32 num_sessions;
+
+  // The number of buffers committed, and the number of bytes of trace data
+  // they held. The service only counts the bytes once a buffer is written.
+  uint32 num_buffers_committed;
+  uint64 num_bytes_committed;
+
+  // The number of times a request for a buffer was held back by the service,
+  // waiting for a buffer to be written and recycled. This is always zero for
+  // the client.
+  uint32 num_recycle_stalls;
+
+  // For the client, how long threads were blocked getting fresh buffers from
+  // the service. For the service, how long recycle stalls lasted.
+  TraceLatencyHistogram wait_time;
+
+  // How long committed buffers took to be written to disk. This is only
+  // recorded by the service.
+  TraceLatencyHistogram write_latency;
+};
+COMPILE_ASSERT_IS_POD(TraceSessionStatistics);
+
+// Adds the counts of a set of statistics to another.
+// @param statistics the statistics to add.
+// @param total the statistics to add to.
+void AddTraceSessionStatistics(const TraceSessionStatistics& statistics,
+                               TraceSessionStatistics* total);
+
 #endif  // SYZYGY_TRACE_PROTOCOL_CALL_TRACE_DEFS_H_
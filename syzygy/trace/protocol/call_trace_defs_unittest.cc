@@ -46,4 +46,72 @@ TEST(CallTraceDefsTest, GetSyzygyCallTraceRpcMutexName) {
   EXPECT_EQ(base_mutex_name + L"-bar", new_mutex_name);
 }
 
+TEST(CallTraceDefsTest, GetTraceLatencyBucket) {
+  EXPECT_EQ(0u, GetTraceLatencyBucket(0));
+  EXPECT_EQ(1u, GetTraceLatencyBucket(1));
+  EXPECT_EQ(2u, GetTraceLatencyBucket(2));
+  EXPECT_EQ(2u, GetTraceLatencyBucket(3));
+  EXPECT_EQ(3u, GetTraceLatencyBucket(4));
+  EXPECT_EQ(10u, GetTraceLatencyBucket(1000));
+
+  const size_t kLastBucket = TraceLatencyHistogram::kNumBuckets - 1;
+  EXPECT_EQ(kLastBucket, GetTraceLatencyBucket(1ULL << (kLastBucket - 1)));
+  EXPECT_EQ(kLastBucket, GetTraceLatencyBucket(1ULL << 40));
+  EXPECT_EQ(kLastBucket, GetTraceLatencyBucket(~0ULL));
+}
+
+TEST(CallTraceDefsTest, AddTraceSessionStatistics) {
+  TraceSessionStatistics statistics = {};
+  statistics.source = TraceSessionStatistics::kServiceSource;
+  statistics.num_sessions = 1;
+  statistics.num_buffers_committed = 2;
+  statistics.num_bytes_committed = 3;
+  statistics.num_recycle_stalls = 4;
+  statistics.wait_time.counts[1] = 5;
+  statistics.write_latency.counts[2] = 6;
+
+  TraceSessionStatistics total = {};
+  AddTraceSessionStatistics(statistics, &total);
+  AddTraceSessionStatistics(statistics, &total);
+  EXPECT_EQ(2u, total.num_sessions);
+  EXPECT_EQ(4u, total.num_buffers_committed);
+  EXPECT_EQ(6u, total.num_bytes_committed);
+  EXPECT_EQ(8u, total.num_recycle_stalls);
+  EXPECT_EQ(10u, total.wait_time.counts[1]);
+  EXPECT_EQ(12u, total.write_latency.counts[2]);
+  EXPECT_EQ(0u, total.write_latency.counts[1]);
+}
+
+TEST(CallTraceDefsTest, TraceVarintRoundTrip) {
+  const uint64 kValues[] = { 0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0xFFFFFFFF,
+                             ~0ULL };
+  const size_t kSizes[] = { 1, 1, 1, 2, 2, 3, 5, kMaxTraceVarintSize };
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    uint8 buffer[kMaxTraceVarintSize] = {};
+    size_t size = WriteTraceVarint(kValues[i], buffer);
+    EXPECT_EQ(kSizes[i], size);
+
+    uint64 value = 0;
+    EXPECT_EQ(size, ReadTraceVarint(buffer, size, &value));
+    EXPECT_EQ(kValues[i], value);
+
+    // Truncated varints are rejected.
+    EXPECT_EQ(0u, ReadTraceVarint(buffer, size - 1, &value));
+  }
+}
+
+TEST(CallTraceDefsTest, ZigZagTraceDelta) {
+  EXPECT_EQ(0u, ZigZagEncodeTraceDelta(0));
+  EXPECT_EQ(1u, ZigZagEncodeTraceDelta(static_cast<uint32>(-1)));
+  EXPECT_EQ(2u, ZigZagEncodeTraceDelta(1));
+  EXPECT_EQ(3u, ZigZagEncodeTraceDelta(static_cast<uint32>(-2)));
+  EXPECT_EQ(0xFFFFFFFFu, ZigZagEncodeTraceDelta(0x80000000));
+
+  const uint32 kDeltas[] = { 0, 1, 0x10, 0x7FFFFFFF, 0x80000000, 0xFFFFFFF0 };
+  for (size_t i = 0; i < arraysize(kDeltas); ++i) {
+    EXPECT_EQ(kDeltas[i],
+              ZigZagDecodeTraceDelta(ZigZagEncodeTraceDelta(kDeltas[i])));
+  }
+}
+
 }  // namespace trace
@@ -21,6 +21,8 @@
       'target_name': 'protocol_lib',
       'type': 'static_library',
       'sources': [
+        'buffer_ring.cc',
+        'buffer_ring.h',
         'call_trace_defs.cc',
         'call_trace_defs.h',
       ],
@@ -32,6 +34,7 @@
       'target_name': 'protocol_unittests',
       'type': 'executable',
       'sources': [
+        'buffer_ring_unittest.cc',
         'call_trace_defs_unittest.cc',
         '<(src)/base/test/run_all_unittests.cc',
       ],
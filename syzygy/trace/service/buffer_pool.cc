@@ -24,7 +24,11 @@
 namespace trace {
 namespace service {
 
-BufferPool::BufferPool() {
+BufferPool::BufferPool()
+    : client_handle_(0),
+      buffer_size_(0),
+      num_busy_buffers_(0),
+      is_discarded_(false) {
 }
 
 BufferPool::~BufferPool() {
@@ -56,6 +60,7 @@ bool BufferPool::Init(Session* session,
   handle_.Set(new_handle.Take());
 
   // Create records for each buffer in the pool.
+  buffer_size_ = buffer_size;
   buffers_.resize(num_buffers);
   for (size_t i = 0; i < num_buffers; ++i) {
     Buffer& cb = buffers_[i];
@@ -67,21 +72,90 @@ bool BufferPool::Init(Session* session,
     cb.session = session;
     cb.pool = this;
     cb.state = Buffer::kAvailable;
+    cb.num_bytes_written = 0;
   }
+  idle_since_ = base::TimeTicks::Now();
 
   return true;
 }
 
 void BufferPool::SetClientHandle(HANDLE client_handle) {
   DCHECK(client_handle != NULL);
+  DCHECK_EQ(0u, client_handle_);
+
+  client_handle_ = reinterpret_cast<unsigned long>(client_handle);
 
   for (size_t i = 0; i < buffers_.size(); ++i) {
     Buffer& cb = buffers_[i];
     DCHECK_EQ(Buffer::kAvailable, cb.state);
     DCHECK(cb.shared_memory_handle == NULL);
-    cb.shared_memory_handle = reinterpret_cast<unsigned long>(client_handle);
+    cb.shared_memory_handle = client_handle_;
   }
 }
 
+Buffer* BufferPool::FindBuffer(unsigned long buffer_offset) {
+  DCHECK_NE(0u, buffer_size_);
+
+  if (buffer_offset % buffer_size_ != 0)
+    return NULL;
+  size_t index = buffer_offset / buffer_size_;
+  if (index >= buffers_.size())
+    return NULL;
+
+  Buffer* buffer = &buffers_[index];
+  DCHECK_EQ(buffer_offset, buffer->buffer_offset);
+  return buffer;
+}
+
+void BufferPool::OnBufferAcquired() {
+  DCHECK_GT(buffers_.size(), num_busy_buffers_);
+  ++num_busy_buffers_;
+  is_discarded_ = false;
+}
+
+void BufferPool::OnBufferReleased(base::TimeTicks now) {
+  DCHECK_LT(0u, num_busy_buffers_);
+  if (--num_busy_buffers_ == 0)
+    idle_since_ = now;
+}
+
+bool BufferPool::DiscardContents(size_t header_size) {
+  DCHECK(is_idle());
+  DCHECK_GE(buffer_size_, header_size);
+  DCHECK(handle_.IsValid());
+
+  size_t mapping_size = buffers_.size() * buffer_size_;
+  uint8* data = reinterpret_cast<uint8*>(
+      ::MapViewOfFile(handle_.Get(), FILE_MAP_WRITE, 0, 0, mapping_size));
+  if (data == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed mapping buffer pool: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
+  bool result = true;
+  if (::VirtualAlloc(data, mapping_size, MEM_RESET, PAGE_READWRITE) == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed discarding buffer pool: " << ::common::LogWe(error)
+               << ".";
+    result = false;
+  }
+
+  // The contents of reset pages are undefined, so clear the buffer headers.
+  // This only touches the first page of each buffer.
+  for (size_t i = 0; i < buffers_.size(); ++i)
+    ::memset(data + i * buffer_size_, 0, header_size);
+
+  if (::UnmapViewOfFile(data) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to unmap buffer pool: " << ::common::LogWe(error)
+                 << ".";
+  }
+
+  is_discarded_ = result;
+  return result;
+}
+
 }  // namespace service
 }  // namespace trace
@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/rpc/call_trace_rpc.h"
 
@@ -60,6 +61,12 @@ struct Buffer : public ::CallTraceBuffer {
   Session* session;
   BufferPool* pool;
   BufferState state;
+
+  // When the buffer was last committed, and how many bytes of trace data it
+  // then held. The latter is filled in by the consumer before recycling the
+  // buffer. These feed the session statistics.
+  base::TimeTicks commit_time;
+  size_t num_bytes_written;
 };
 
 // A BufferPool manages a collection of buffers that all belong to the same
@@ -82,15 +89,73 @@ class BufferPool {
   Buffer* begin() { return &buffers_[0]; }
   Buffer* end() { return begin() + buffers_.size(); }
 
+  // Locates the buffer at the given offset in the pool's shared memory
+  // segment. As the buffers are laid out contiguously this is a constant time
+  // operation.
+  // @param buffer_offset The offset of the buffer, as reported to the client.
+  // @returns the buffer, or NULL if @p buffer_offset does not correspond to a
+  //     buffer in this pool.
+  Buffer* FindBuffer(unsigned long buffer_offset);
+
+  // @returns the number of buffers in this pool.
+  size_t num_buffers() const { return buffers_.size(); }
+
+  // Returns the handle to the shared memory segment, as valid in the client
+  // process. This is NULL until SetClientHandle has been called.
+  unsigned long client_handle() const { return client_handle_; }
+
   // Returns this pools shared memory segment handle.
   HANDLE handle() const { return handle_.Get(); }
 
+  // @name Idle tracking. A pool is idle when none of its buffers are in use
+  //     by the client or pending write.
+  // @{
+  // Records that one of the pool's buffers has been handed out.
+  void OnBufferAcquired();
+
+  // Records that one of the pool's buffers has been returned to the pool.
+  // @param now The current time.
+  void OnBufferReleased(base::TimeTicks now);
+
+  // @returns true if none of the pool's buffers are in use.
+  bool is_idle() const { return num_busy_buffers_ == 0; }
+
+  // @returns the time at which the pool last became idle.
+  base::TimeTicks idle_since() const { return idle_since_; }
+
+  // @returns true if the contents of the pool have been discarded since it
+  //     last became idle.
+  bool is_discarded() const { return is_discarded_; }
+  // @}
+
+  // Tells the system that the contents of this idle pool are no longer
+  // needed, allowing the memory to be reclaimed without first being written
+  // to the page file. The pool must be idle. The headers of the buffers are
+  // cleared, so that they remain safe to write should a client return them
+  // untouched.
+  // @param header_size The number of bytes to clear at the start of each
+  //     buffer.
+  // @returns true on success, false otherwise.
+  bool DiscardContents(size_t header_size);
+
  private:
   typedef std::vector<Buffer> BufferCollection;
   // Sadly ScopedHandle is not const correct.
   mutable base::win::ScopedHandle handle_;
+  unsigned long client_handle_;
+  size_t buffer_size_;
   BufferCollection buffers_;
 
+  // The number of buffers handed out and not yet returned to the pool.
+  size_t num_busy_buffers_;
+
+  // The time at which the pool last became idle.
+  base::TimeTicks idle_since_;
+
+  // Indicates if the contents of the pool have been discarded since it last
+  // became idle.
+  bool is_discarded_;
+
   DISALLOW_COPY_AND_ASSIGN(BufferPool);
 };
 
@@ -0,0 +1,100 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/service/buffer_pool.h"
+
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace service {
+
+namespace {
+
+const size_t kBufferSize = 4096;
+const size_t kNumBuffers = 4;
+
+}  // namespace
+
+TEST(BufferPoolTest, FindBuffer) {
+  BufferPool pool;
+  ASSERT_TRUE(pool.Init(NULL, kNumBuffers, kBufferSize));
+  EXPECT_EQ(kNumBuffers, pool.num_buffers());
+
+  EXPECT_EQ(0u, pool.client_handle());
+  pool.SetClientHandle(pool.handle());
+  EXPECT_EQ(reinterpret_cast<unsigned long>(pool.handle()),
+            pool.client_handle());
+
+  for (size_t i = 0; i < kNumBuffers; ++i) {
+    Buffer* buffer = pool.FindBuffer(i * kBufferSize);
+    EXPECT_EQ(pool.begin() + i, buffer);
+    EXPECT_EQ(pool.client_handle(), buffer->shared_memory_handle);
+  }
+
+  // Offsets that don't correspond to the start of a buffer in the pool can't
+  // be found.
+  EXPECT_TRUE(pool.FindBuffer(1) == NULL);
+  EXPECT_TRUE(pool.FindBuffer(kBufferSize + kBufferSize / 2) == NULL);
+  EXPECT_TRUE(pool.FindBuffer(kNumBuffers * kBufferSize) == NULL);
+}
+
+TEST(BufferPoolTest, IdleTracking) {
+  BufferPool pool;
+  ASSERT_TRUE(pool.Init(NULL, kNumBuffers, kBufferSize));
+  EXPECT_TRUE(pool.is_idle());
+  EXPECT_FALSE(pool.is_discarded());
+
+  pool.OnBufferAcquired();
+  pool.OnBufferAcquired();
+  EXPECT_FALSE(pool.is_idle());
+
+  base::TimeTicks now = base::TimeTicks::Now();
+  pool.OnBufferReleased(now);
+  EXPECT_FALSE(pool.is_idle());
+  pool.OnBufferReleased(now);
+  EXPECT_TRUE(pool.is_idle());
+  EXPECT_EQ(now, pool.idle_since());
+}
+
+TEST(BufferPoolTest, DiscardContents) {
+  BufferPool pool;
+  ASSERT_TRUE(pool.Init(NULL, kNumBuffers, kBufferSize));
+
+  // Dirty the whole pool.
+  size_t mapping_size = kNumBuffers * kBufferSize;
+  uint8* data = reinterpret_cast<uint8*>(
+      ::MapViewOfFile(pool.handle(), FILE_MAP_WRITE, 0, 0, mapping_size));
+  ASSERT_TRUE(data != NULL);
+  ::memset(data, 0xAB, mapping_size);
+
+  const size_t kHeaderSize = 16;
+  EXPECT_TRUE(pool.DiscardContents(kHeaderSize));
+  EXPECT_TRUE(pool.is_discarded());
+
+  // The headers of the buffers have been cleared.
+  for (size_t i = 0; i < kNumBuffers; ++i) {
+    uint8* header = data + i * kBufferSize;
+    for (size_t j = 0; j < kHeaderSize; ++j)
+      EXPECT_EQ(0u, header[j]);
+  }
+  EXPECT_NE(0, ::UnmapViewOfFile(data));
+
+  // Handing out a buffer means the contents are in use again.
+  pool.OnBufferAcquired();
+  EXPECT_FALSE(pool.is_discarded());
+  pool.OnBufferReleased(base::TimeTicks::Now());
+}
+
+}  // namespace service
+}  // namespace trace
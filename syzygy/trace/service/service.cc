@@ -46,9 +46,19 @@ const size_t Service::kDefaultNumIncrementalBuffers = 16;
 // represents about 26 MB, so 1.3 seconds of disk bandwidth.
 const size_t Service::kDefaultMaxBuffersPendingWrite = 13;
 
+// A session that keeps exhausting its buffers will grow its buffer pool by
+// up to 4 times the usual increment at once.
+const size_t Service::kDefaultMaxIncrementalBuffers =
+    4 * Service::kDefaultNumIncrementalBuffers;
+
+const int Service::kDefaultIdleBufferPoolTimeoutInSeconds = 30;
+
 Service::Service(BufferConsumerFactory* factory)
     : num_active_sessions_(0),
       num_incremental_buffers_(kDefaultNumIncrementalBuffers),
+      max_incremental_buffers_(kDefaultMaxIncrementalBuffers),
+      idle_buffer_pool_timeout_(base::TimeDelta::FromSeconds(
+          kDefaultIdleBufferPoolTimeoutInSeconds)),
       buffer_size_in_bytes_(kDefaultBufferSize),
       max_buffers_pending_write_(kDefaultMaxBuffersPendingWrite),
       owner_thread_(base::PlatformThread::CurrentId()),
@@ -59,6 +69,9 @@ Service::Service(BufferConsumerFactory* factory)
       rpc_is_non_blocking_(false),
       flags_(TRACE_FLAG_BATCH_ENTER) {
   DCHECK(factory != NULL);
+  ::memset(&closed_session_statistics_, 0,
+           sizeof(closed_session_statistics_));
+  closed_session_statistics_.source = TraceSessionStatistics::kServiceSource;
 }
 
 Service::~Service() {
@@ -582,6 +595,76 @@ bool Service::CloseSession(SessionHandle* session_handle) {
   return true;
 }
 
+// RPC entry point.
+bool Service::QueryStatistics(unsigned long statistics_size,
+                              byte* statistics) {
+  if (statistics == NULL) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  if (statistics_size != sizeof(TraceSessionStatistics)) {
+    LOG(ERROR) << "Statistics requested with an unexpected size.";
+    return false;
+  }
+
+  GetStatistics(reinterpret_cast<TraceSessionStatistics*>(statistics));
+
+  return true;
+}
+
+void Service::GetStatistics(TraceSessionStatistics* statistics) {
+  DCHECK(statistics != NULL);
+
+  base::AutoLock auto_lock(lock_);
+
+  *statistics = closed_session_statistics_;
+  SessionMap::iterator iter = sessions_.begin();
+  for (; iter != sessions_.end(); ++iter) {
+    TraceSessionStatistics session_statistics = {};
+    iter->second->GetStatistics(&session_statistics);
+    AddTraceSessionStatistics(session_statistics, statistics);
+  }
+}
+
+void Service::AddClosedSessionStatistics(
+    const TraceSessionStatistics& statistics) {
+  base::AutoLock auto_lock(lock_);
+
+  AddTraceSessionStatistics(statistics, &closed_session_statistics_);
+}
+
+// RPC entry point.
+bool Service::OpenBufferRing(SessionHandle session_handle,
+                             unsigned long* ring_handle,
+                             unsigned long* ring_size,
+                             unsigned long* commit_event) {
+  if (session_handle == NULL || ring_handle == NULL || ring_size == NULL ||
+      commit_event == NULL) {
+    LOG(WARNING) << "Invalid RPC parameters.";
+    return false;
+  }
+
+  scoped_refptr<Session> session;
+  if (!GetExistingSession(session_handle, &session))
+    return false;
+  DCHECK(session.get() != NULL);
+
+  HANDLE client_ring_handle = NULL;
+  HANDLE client_commit_event = NULL;
+  size_t client_ring_size = 0;
+  if (!session->OpenBufferRing(&client_ring_handle, &client_ring_size,
+                               &client_commit_event)) {
+    return false;
+  }
+
+  *ring_handle = reinterpret_cast<unsigned long>(client_ring_handle);
+  *ring_size = client_ring_size;
+  *commit_event = reinterpret_cast<unsigned long>(client_commit_event);
+
+  return true;
+}
+
 bool Service::GetNewSession(ProcessId client_process_id,
                             scoped_refptr<Session>* session) {
   DCHECK(session != NULL);
@@ -43,7 +43,9 @@
       ],
       'dependencies': [
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/protocol/protocol.gyp:protocol_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
       ],
     },
@@ -51,6 +53,7 @@
       'target_name': 'rpc_service_unittests',
       'type': 'executable',
       'sources': [
+        'buffer_pool_unittest.cc',
         'mapped_buffer_unittest.cc',
         'process_info_unittest.cc',
         'service_unittest.cc',
@@ -28,6 +28,8 @@
 #include "base/synchronization/condition_variable.h"
 #include "base/threading/platform_thread.h"
 #include "base/threading/thread.h"
+#include "base/time/time.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/rpc/call_trace_rpc.h"
 
 namespace trace {
@@ -83,6 +85,14 @@ class Service {
   // allow before beginning to force writes.
   static const size_t kDefaultMaxBuffersPendingWrite;
 
+  // The default maximum number of buffers by which a session may grow its
+  // buffer pool in a single allocation.
+  static const size_t kDefaultMaxIncrementalBuffers;
+
+  // The default time after which the contents of a session's idle buffer pool
+  // are discarded.
+  static const int kDefaultIdleBufferPoolTimeoutInSeconds;
+
   // Set the id for this instance.
   void set_instance_id(const base::StringPiece16& id) {
     DCHECK(!is_running());
@@ -105,6 +115,19 @@ class Service {
     num_incremental_buffers_ = n;
   }
 
+  // Set the maximum number of buffers by which to grow a sessions buffer pool.
+  // While a session keeps running out of buffers the size of its successive
+  // allocations doubles, from num_incremental_buffers up to this cap.
+  void set_max_incremental_buffers(size_t n) {
+    max_incremental_buffers_ = n;
+  }
+
+  // Set the time after which the contents of a sessions idle buffer pools are
+  // discarded.
+  void set_idle_buffer_pool_timeout(base::TimeDelta timeout) {
+    idle_buffer_pool_timeout_ = timeout;
+  }
+
   // Set the number of bytes comprising each buffer in a
   // sessions buffer pool.
   void set_buffer_size_in_bytes(size_t n) {
@@ -119,9 +142,21 @@ class Service {
     max_buffers_pending_write_ = n;
   }
 
+  // @returns the trace flags that get communicated to clients.
+  uint32 flags() const { return flags_; }
+
   // @returns the number of new buffers to be created per allocation.
   size_t num_incremental_buffers() const { return num_incremental_buffers_; }
 
+  // @returns the maximum number of new buffers to be created per allocation.
+  size_t max_incremental_buffers() const { return max_incremental_buffers_; }
+
+  // @returns the time after which the contents of idle buffer pools are
+  //     discarded.
+  base::TimeDelta idle_buffer_pool_timeout() const {
+    return idle_buffer_pool_timeout_;
+  }
+
   // @returns the size (in bytes) of new buffers to be allocated.
   size_t buffer_size_in_bytes() const { return buffer_size_in_bytes_; }
 
@@ -200,6 +235,28 @@ class Service {
   // See call_trace_rpc.idl for further info.
   bool CloseSession(SessionHandle* session_handle);
 
+  // RPC implementation of CallTraceControl::QueryStatistics().
+  // See call_trace_rpc.idl for further info.
+  bool QueryStatistics(unsigned long statistics_size, byte* statistics);
+
+  // Gets the statistics of all the sessions handled so far, added up. The
+  // sessions that are closing but still have buffers being written aren't
+  // counted.
+  // @param statistics receives the statistics.
+  void GetStatistics(TraceSessionStatistics* statistics);
+
+  // Adds the final statistics of a session to those reported by
+  // GetStatistics. This is called as the session is destroyed.
+  // @param statistics the session's statistics.
+  void AddClosedSessionStatistics(const TraceSessionStatistics& statistics);
+
+  // RPC implementation of CallTraceService::OpenBufferRing().
+  // See call_trace_rpc.idl for further info.
+  bool OpenBufferRing(SessionHandle session_handle,
+                      unsigned long* ring_handle,
+                      unsigned long* ring_size,
+                      unsigned long* commit_event);
+
   // Decrement the active session count.
   // @see num_active_sessions_
   void RemoveOneActiveSession();
@@ -265,12 +322,21 @@ class Service {
   // finished flushing their buffers.
   size_t num_active_sessions_;  // Under lock_.
 
+  // The statistics of the sessions that have been destroyed.
+  TraceSessionStatistics closed_session_statistics_;  // Under lock_.
+
   // The instance id to use when running this service instance.
   std::wstring instance_id_;
 
   // The number of buffers to allocate with each increment.
   size_t num_incremental_buffers_;
 
+  // The maximum number of buffers to allocate with each increment.
+  size_t max_incremental_buffers_;
+
+  // The time after which the contents of idle buffer pools are discarded.
+  base::TimeDelta idle_buffer_pool_timeout_;
+
   // The number of bytes in each buffer.
   size_t buffer_size_in_bytes_;
 
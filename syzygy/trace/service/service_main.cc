@@ -21,6 +21,7 @@
 #include "base/files/file_path.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/path_service.h"
 #include "base/process/kill.h"
 #include "base/process/launch.h"
@@ -50,6 +51,9 @@ const int kMinBufferSize = 1024 * 1024;
 // Minimum number of buffers to allocate.
 const int kMinBuffers = 16;
 
+// Maximum number of trace file writer threads to run.
+const int kMaxWriterThreads = 64;
+
 // A static location to which the current instance id can be saved. We
 // persist it here so that OnConsoleCtrl can have access to the instance
 // id when it is invoked on the signal handler thread.
@@ -80,6 +84,8 @@ const char kUsage[] =
     "                     for it to be ready, and returns. The call trace\n"
     "                     service continues running in the background.\n"
     "  stop               Stop the call trace service.\n"
+    "  query              Print the buffer exchange statistics of a running\n"
+    "                     call trace service.\n"
     "\n"
     "Options:\n"
     "  --help             Show this help message.\n"
@@ -90,6 +96,16 @@ const char kUsage[] =
     "                     pool each time the client exhausts its available\n"
     "                     buffer space.\n"
     "  --enable-exits     Enable exit tracing (off by default).\n"
+    "  --num-writer-threads=NUM\n"
+    "                     The number of threads among which the writing of\n"
+    "                     trace files is distributed. Defaults to 1.\n"
+    "  --overlapped-io    Write trace buffers to disk using overlapped I/O,\n"
+    "                     allowing several writes to be in flight at once.\n"
+    "  --compress-segments\n"
+    "                     Compress the segments of the trace files.\n"
+    "  --record-statistics\n"
+    "                     Record buffer exchange statistics in the trace\n"
+    "                     files.\n"
     "  --verbose          Increase the logging verbosity to also include\n"
     "                     debug-level information.\n"
     "  --instance-id=ID   A unique identifier to use for the RPC endpoint.\n"
@@ -165,6 +181,9 @@ bool RunService(const CommandLine* cmd_line,
     return 1;
   }
 
+  // Any additional writer threads. These must outlive the service.
+  ScopedVector<base::Thread> extra_writer_threads;
+
   base::MessageLoop* message_loop = writer_thread.message_loop();
   SessionTraceFileWriterFactory session_trace_file_writer_factory(message_loop);
   Service call_trace_service(&session_trace_file_writer_factory);
@@ -202,6 +221,40 @@ bool RunService(const CommandLine* cmd_line,
     call_trace_service.set_flags(TRACE_FLAG_ENTER | TRACE_FLAG_EXIT);
   }
 
+  if (cmd_line->HasSwitch("record-statistics")) {
+    call_trace_service.set_flags(
+        call_trace_service.flags() | TRACE_FLAG_SESSION_STATISTICS);
+  }
+
+  if (cmd_line->HasSwitch("overlapped-io"))
+    session_trace_file_writer_factory.set_overlapped_io(true);
+
+  if (cmd_line->HasSwitch("compress-segments"))
+    session_trace_file_writer_factory.set_compress_segments(true);
+
+  // Setup the pool of writer threads.
+  std::wstring writer_threads_str(
+      cmd_line->GetSwitchValueNative("num-writer-threads"));
+  if (!writer_threads_str.empty()) {
+    int num = 0;
+    if (!base::StringToInt(writer_threads_str, &num) || num < 1 ||
+        num > kMaxWriterThreads) {
+      LOG(ERROR) << "Number of writer threads must be between 1 and "
+                 << kMaxWriterThreads << ".";
+      return false;
+    }
+    for (int i = 1; i < num; ++i) {
+      base::Thread* thread = new base::Thread("trace-file-writer");
+      extra_writer_threads.push_back(thread);
+      if (!thread->StartWithOptions(
+              base::Thread::Options(base::MessageLoop::TYPE_IO, 0))) {
+        LOG(ERROR) << "Failed to start call trace service writer thread.";
+        return false;
+      }
+      session_trace_file_writer_factory.AddMessageLoop(thread->message_loop());
+    }
+  }
+
   // Setup the number of incremental buffers
   std::wstring buffers_str(
       cmd_line->GetSwitchValueNative("num-incremental-buffers"));
@@ -336,6 +389,53 @@ bool StopService(const base::StringPiece16& instance_id) {
   return true;
 }
 
+void PrintLatencyHistogram(const char* name,
+                           const TraceLatencyHistogram& histogram) {
+  std::cout << name << ":\n";
+  for (size_t i = 0; i < TraceLatencyHistogram::kNumBuckets; ++i) {
+    if (histogram.counts[i] == 0)
+      continue;
+    if (i + 1 == TraceLatencyHistogram::kNumBuckets) {
+      std::cout << "  >= " << (1ULL << (i - 1)) << "us: ";
+    } else {
+      std::cout << "  < " << (1ULL << i) << "us: ";
+    }
+    std::cout << histogram.counts[i] << "\n";
+  }
+}
+
+bool QueryService(const base::StringPiece16& instance_id) {
+  std::wstring protocol;
+  std::wstring endpoint;
+
+  ::GetSyzygyCallTraceRpcProtocol(&protocol);
+  ::GetSyzygyCallTraceRpcEndpoint(instance_id, &endpoint);
+
+  handle_t binding = NULL;
+  if (!CreateRpcBinding(protocol, endpoint, &binding)) {
+    LOG(ERROR) << "Failed to connect to call trace logging service.";
+    return false;
+  }
+
+  TraceSessionStatistics statistics = {};
+  if (!InvokeRpc(CallTraceClient_QueryStatistics, binding,
+                 sizeof(statistics),
+                 reinterpret_cast<byte*>(&statistics)).succeeded()) {
+    LOG(ERROR) << "Failed to query call trace logging service.";
+    return false;
+  }
+
+  std::cout << "Sessions: " << statistics.num_sessions << "\n"
+            << "Buffers committed: " << statistics.num_buffers_committed
+            << "\n"
+            << "Bytes committed: " << statistics.num_bytes_committed << "\n"
+            << "Recycle stalls: " << statistics.num_recycle_stalls << "\n";
+  PrintLatencyHistogram("Recycle stall time", statistics.wait_time);
+  PrintLatencyHistogram("Write latency", statistics.write_latency);
+
+  return true;
+}
+
 extern "C" int main(int argc, char** argv) {
   base::AtExitManager at_exit_manager;
   CommandLine::Init(argc, argv);
@@ -379,6 +479,11 @@ extern "C" int main(int argc, char** argv) {
     return (GetInstanceId(cmd_line, &id) && StopService(id)) ? 0 : 1;
   }
 
+  if (LowerCaseEqualsASCII(cmd_line->GetArgs()[0], "query")) {
+    std::wstring id;
+    return (GetInstanceId(cmd_line, &id) && QueryService(id)) ? 0 : 1;
+  }
+
   if (LowerCaseEqualsASCII(cmd_line->GetArgs()[0], "start")) {
     return RunService(cmd_line, &app_command_line) ? 0 : 1;
   }
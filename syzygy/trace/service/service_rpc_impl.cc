@@ -84,12 +84,32 @@ boolean CallTraceService_CloseSession(
   return true;
 }
 
+// RPC entrypoint for CallTraceService::OpenBufferRing().
+boolean CallTraceService_OpenBufferRing(
+    /* [in] */ SessionHandle session_handle,
+    /* [out] */ unsigned long* ring_handle,
+    /* [out] */ unsigned long* ring_size,
+    /* [out] */ unsigned long* commit_event) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->OpenBufferRing(session_handle, ring_handle, ring_size,
+                                  commit_event);
+}
+
 // RPC entrypoint for CallTraceControl::Stop().
 boolean CallTraceService_Stop(/* [in] */ handle_t /* binding */) {
   Service* instance = RpcServiceInstanceManager::GetInstance();
   return instance->RequestShutdown();
 }
 
+// RPC entrypoint for CallTraceControl::QueryStatistics().
+boolean CallTraceService_QueryStatistics(
+    /* [in] */ handle_t /* binding */,
+    /* [in] */ unsigned long statistics_size,
+    /* [out] */ byte* statistics) {
+  Service* instance = RpcServiceInstanceManager::GetInstance();
+  return instance->QueryStatistics(statistics_size, statistics);
+}
+
 // This callback is invoked if the RPC mechanism detects that a client
 // has ceased to exist, but the service still has resources allocated
 // on the client's behalf.
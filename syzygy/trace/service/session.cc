@@ -24,6 +24,8 @@
 
 #include <time.h>
 
+#include <algorithm>
+
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/memory/scoped_ptr.h"
@@ -50,35 +52,65 @@ std::ostream& operator << (std::ostream& stream, const Buffer::ID& buffer_id) {
                 << ", buffer_offset=0x" << std::hex << buffer_id.second;
 }
 
+// The number of fresh buffers the service tries to keep in the free ring.
+const size_t kNumFreeRingBuffers = 4;
+
+BufferRingDescriptor ToBufferRingDescriptor(const CallTraceBuffer& buffer) {
+  BufferRingDescriptor descriptor = {};
+  descriptor.shared_memory_handle = buffer.shared_memory_handle;
+  descriptor.mapping_size = buffer.mapping_size;
+  descriptor.buffer_offset = buffer.buffer_offset;
+  descriptor.buffer_size = buffer.buffer_size;
+  return descriptor;
+}
+
+CallTraceBuffer ToCallTraceBuffer(const BufferRingDescriptor& descriptor) {
+  CallTraceBuffer buffer = {};
+  buffer.shared_memory_handle = descriptor.shared_memory_handle;
+  buffer.mapping_size = descriptor.mapping_size;
+  buffer.buffer_offset = descriptor.buffer_offset;
+  buffer.buffer_size = descriptor.buffer_size;
+  return buffer;
+}
+
 }  // namespace
 
 Session::Session(Service* call_trace_service)
     : call_trace_service_(call_trace_service),
+      num_buffers_(0),
+      num_buffers_to_allocate_(0),
       is_closing_(false),
       buffer_consumer_(NULL),
       buffer_requests_waiting_for_recycle_(0),
       buffer_is_available_(&lock_),
       buffer_id_(0),
+      rings_(NULL),
+      commit_wait_(NULL),
       input_error_already_logged_(false) {
   DCHECK(call_trace_service != NULL);
   ::memset(buffer_state_counts_, 0, sizeof(buffer_state_counts_));
+  ::memset(&statistics_, 0, sizeof(statistics_));
+  statistics_.source = TraceSessionStatistics::kServiceSource;
+  statistics_.num_sessions = 1;
 
   call_trace_service->AddOneActiveSession();
 }
 
 Session::~Session() {
+  CloseBufferRing();
+
   // We expect all of the buffers to be available, and none of them to be
   // outstanding.
   DCHECK(call_trace_service_ != NULL);
   DCHECK_EQ(buffers_available_.size(),
             buffer_state_counts_[Buffer::kAvailable]);
-  DCHECK_EQ(buffers_.size(), buffer_state_counts_[Buffer::kAvailable]);
+  DCHECK_EQ(num_buffers_, buffer_state_counts_[Buffer::kAvailable]);
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kInUse]);
   DCHECK_EQ(0u, buffer_state_counts_[Buffer::kPendingWrite]);
 
   // Not strictly necessary, but let's make sure nothing refers to the
   // client buffers before we delete the underlying memory.
-  buffers_.clear();
+  buffer_pools_.clear();
   buffers_available_.clear();
 
   // The session owns all of its shared memory buffers using raw pointers
@@ -99,6 +131,7 @@ Session::~Session() {
     buffer_consumer_ = static_cast<BufferConsumer*>(NULL);
   }
 
+  call_trace_service_->AddClosedSessionStatistics(statistics_);
   call_trace_service_->RemoveOneActiveSession();
 }
 
@@ -110,6 +143,10 @@ bool Session::Init(ProcessId client_process_id) {
 }
 
 bool Session::Close() {
+  // Commit what's left in the buffer ring first, so that its buffers reach
+  // the consumer in the order the client committed them.
+  CloseBufferRing();
+
   std::vector<Buffer*> buffers;
   base::AutoLock lock(lock_);
 
@@ -126,12 +163,16 @@ bool Session::Close() {
   buffers.reserve(buffer_state_counts_[Buffer::kInUse] + 1);
 
   // Schedule any outstanding buffers for flushing.
-  for (BufferMap::iterator it = buffers_.begin(); it != buffers_.end(); ++it) {
-    Buffer* buffer = it->second;
-    DCHECK(buffer != NULL);
-    if (buffer->state == Buffer::kInUse) {
-      ChangeBufferState(Buffer::kPendingWrite, buffer);
-      buffer_consumer_->ConsumeBuffer(buffer);
+  SharedMemoryBufferCollection::iterator it = shared_memory_buffers_.begin();
+  for (; it != shared_memory_buffers_.end(); ++it) {
+    BufferPool* pool = *it;
+    DCHECK(pool != NULL);
+    for (Buffer* buffer = pool->begin(); buffer != pool->end(); ++buffer) {
+      if (buffer->state == Buffer::kInUse) {
+        ChangeBufferState(Buffer::kPendingWrite, buffer);
+        buffer->commit_time = base::TimeTicks::Now();
+        buffer_consumer_->ConsumeBuffer(buffer);
+      }
     }
   }
 
@@ -147,6 +188,96 @@ bool Session::Close() {
   return true;
 }
 
+bool Session::OpenBufferRing(HANDLE* client_ring_handle,
+                             size_t* ring_size,
+                             HANDLE* client_commit_event) {
+  DCHECK(client_ring_handle != NULL);
+  DCHECK(ring_size != NULL);
+  DCHECK(client_commit_event != NULL);
+
+  base::AutoLock ring_lock(ring_lock_);
+
+  if (rings_ != NULL) {
+    LOG(ERROR) << "Buffer ring is already open for this session.";
+    return false;
+  }
+
+  {
+    base::AutoLock lock(lock_);
+    if (is_closing_) {
+      LOG(ERROR) << "Session is closing but someone is trying to open a "
+                 << "buffer ring.";
+      return false;
+    }
+  }
+
+  base::win::ScopedHandle ring_handle(
+      ::CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                          sizeof(BufferRings), NULL));
+  if (!ring_handle.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to allocate buffer ring: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
+  base::win::ScopedHandle commit_event(::CreateEvent(NULL, FALSE, FALSE, NULL));
+  if (!commit_event.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to create buffer ring event: "
+               << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  HANDLE client_ring = NULL;
+  HANDLE client_event = NULL;
+  if (!CopyBufferHandleToClient(client_.process_handle.Get(),
+                                ring_handle.Get(),
+                                &client_ring) ||
+      !CopyBufferHandleToClient(client_.process_handle.Get(),
+                                commit_event.Get(),
+                                &client_event)) {
+    return false;
+  }
+
+  BufferRings* rings = reinterpret_cast<BufferRings*>(
+      ::MapViewOfFile(ring_handle.Get(), FILE_MAP_WRITE, 0, 0,
+                      sizeof(BufferRings)));
+  if (rings == NULL) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to map buffer ring: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+  InitializeBufferRing(&rings->commit_ring);
+  InitializeBufferRing(&rings->free_ring);
+
+  // The callback can't get at the rings before we release ring_lock_.
+  if (!::RegisterWaitForSingleObject(&commit_wait_, commit_event.Get(),
+                                     &OnBufferRingCommit, this, INFINITE,
+                                     WT_EXECUTEDEFAULT)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to wait on buffer ring event: "
+               << ::common::LogWe(error) << ".";
+    commit_wait_ = NULL;
+    ignore_result(::UnmapViewOfFile(rings));
+    return false;
+  }
+
+  ring_handle_.Set(ring_handle.Take());
+  commit_event_.Set(commit_event.Take());
+  rings_ = rings;
+
+  // Stock the free ring ahead of the first exchange.
+  RefillBufferRingUnlocked();
+
+  *client_ring_handle = client_ring;
+  *ring_size = sizeof(BufferRings);
+  *client_commit_event = client_event;
+
+  return true;
+}
+
 bool Session::FindBuffer(CallTraceBuffer* call_trace_buffer,
                          Buffer** client_buffer) {
   DCHECK(call_trace_buffer != NULL);
@@ -156,8 +287,11 @@ bool Session::FindBuffer(CallTraceBuffer* call_trace_buffer,
 
   Buffer::ID buffer_id = Buffer::GetID(*call_trace_buffer);
 
-  BufferMap::iterator iter = buffers_.find(buffer_id);
-  if (iter == buffers_.end()) {
+  Buffer* buffer = NULL;
+  BufferPoolMap::iterator iter = buffer_pools_.find(buffer_id.first);
+  if (iter != buffer_pools_.end())
+    buffer = iter->second->FindBuffer(buffer_id.second);
+  if (buffer == NULL) {
     if (!input_error_already_logged_) {
       LOG(ERROR) << "Received call trace buffer not in use for this session "
                  << "[pid=" << client_.process_id << ", " << buffer_id << "].";
@@ -169,13 +303,13 @@ bool Session::FindBuffer(CallTraceBuffer* call_trace_buffer,
 #ifndef NDEBUG
   // Make sure fields that are not part of the ID also match. The client
   // shouldn't be playing with any of the call_trace_buffer fields.
-  if (call_trace_buffer->mapping_size != iter->second->mapping_size ||
-      call_trace_buffer->buffer_size != iter->second->buffer_size) {
+  if (call_trace_buffer->mapping_size != buffer->mapping_size ||
+      call_trace_buffer->buffer_size != buffer->buffer_size) {
     LOG(WARNING) << "Received call trace buffer with mismatched attributes.";
   }
 #endif
 
-  *client_buffer = iter->second;
+  *client_buffer = buffer;
   return true;
 }
 
@@ -221,6 +355,8 @@ bool Session::ReturnBuffer(Buffer* buffer) {
       return true;
 
     ChangeBufferState(Buffer::kPendingWrite, buffer);
+    buffer->commit_time = base::TimeTicks::Now();
+    ++statistics_.num_buffers_committed;
   }
 
   // Hand the buffer over to the consumer.
@@ -244,6 +380,10 @@ bool Session::RecycleBuffer(Buffer* buffer) {
   if (buffer->buffer_offset == 0 &&
       buffer->mapping_size == buffer->buffer_size &&
       buffer->buffer_size > normal_buffer_size) {
+    {
+      base::AutoLock lock(lock_);
+      RecordBufferWrittenUnlocked(buffer);
+    }
     if (!DestroySingletonBuffer(buffer))
       return false;
     return true;
@@ -251,10 +391,15 @@ bool Session::RecycleBuffer(Buffer* buffer) {
 
   base::AutoLock lock(lock_);
 
+  RecordBufferWrittenUnlocked(buffer);
   ChangeBufferState(Buffer::kAvailable, buffer);
   buffers_available_.push_front(buffer);
   buffer_is_available_.Signal();
 
+  // Buffers are handed out most recently recycled first, so a pool that is no
+  // longer needed stays idle.
+  DiscardIdleBufferPools(base::TimeTicks::Now());
+
   // If the session is closing and all outstanding buffers have been recycled
   // then it's safe to destroy this session.
   if (is_closing_ && buffer_state_counts_[Buffer::kInUse] == 0 &&
@@ -262,7 +407,7 @@ bool Session::RecycleBuffer(Buffer* buffer) {
     // If all buffers have been recycled, then all the buffers we own must be
     // available. When we start closing we refuse to hand out further buffers
     // so this must eventually happen, unless the write queue hangs.
-    DCHECK_EQ(buffers_.size(), buffer_state_counts_[Buffer::kAvailable]);
+    DCHECK_EQ(num_buffers_, buffer_state_counts_[Buffer::kAvailable]);
     DCHECK_EQ(buffers_available_.size(),
               buffer_state_counts_[Buffer::kAvailable]);
   }
@@ -270,6 +415,28 @@ bool Session::RecycleBuffer(Buffer* buffer) {
   return true;
 }
 
+void Session::GetStatistics(TraceSessionStatistics* statistics) {
+  DCHECK(statistics != NULL);
+
+  base::AutoLock lock(lock_);
+  *statistics = statistics_;
+}
+
+void Session::RecordBufferWrittenUnlocked(Buffer* buffer) {
+  DCHECK(buffer != NULL);
+  lock_.AssertAcquired();
+
+  statistics_.num_bytes_committed += buffer->num_bytes_written;
+  buffer->num_bytes_written = 0;
+
+  if (buffer->commit_time.is_null())
+    return;
+  uint64 write_latency =
+      (base::TimeTicks::Now() - buffer->commit_time).InMicroseconds();
+  ++statistics_.write_latency.counts[GetTraceLatencyBucket(write_latency)];
+  buffer->commit_time = base::TimeTicks();
+}
+
 void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
@@ -285,6 +452,13 @@ void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
   buffer->state = new_state;
   buffer_state_counts_[old_state]--;
   buffer_state_counts_[new_state]++;
+
+  // Keep track of the idleness of the buffer's pool.
+  DCHECK(buffer->pool != NULL);
+  if (old_state == Buffer::kAvailable)
+    buffer->pool->OnBufferAcquired();
+  else if (new_state == Buffer::kAvailable)
+    buffer->pool->OnBufferReleased(base::TimeTicks::Now());
 }
 
 bool Session::InitializeProcessInfo(ProcessId process_id,
@@ -371,12 +545,23 @@ bool Session::AllocateBufferPool(
   pool->SetClientHandle(client_handle);
 
   // Save the shared memory block so that it's managed by the session.
-  shared_memory_buffers_.push_back(pool.get());
+  AddBufferPool(pool.get());
   *out_pool = pool.release();
 
   return true;
 }
 
+void Session::AddBufferPool(BufferPool* pool) {
+  DCHECK(pool != NULL);
+  DCHECK_NE(0u, pool->client_handle());
+  lock_.AssertAcquired();
+
+  shared_memory_buffers_.push_back(pool);
+  CHECK(buffer_pools_.insert(
+      std::make_pair(pool->client_handle(), pool)).second);
+  num_buffers_ += pool->num_buffers();
+}
+
 bool Session::AllocateBuffers(size_t num_buffers, size_t buffer_size) {
   DCHECK_GT(num_buffers, 0u);
   DCHECK_GT(buffer_size, 0u);
@@ -391,11 +576,7 @@ bool Session::AllocateBuffers(size_t num_buffers, size_t buffer_size) {
   // Put the client buffers into the list of available buffers and update
   // the buffer state information.
   for (Buffer* buf = pool_ptr->begin(); buf != pool_ptr->end(); ++buf) {
-    Buffer::ID buffer_id = Buffer::GetID(*buf);
-
     buf->state = Buffer::kAvailable;
-    CHECK(buffers_.insert(std::make_pair(buffer_id, buf)).second);
-
     buffer_state_counts_[Buffer::kAvailable]++;
     buffers_available_.push_back(buf);
     buffer_is_available_.Signal();
@@ -421,11 +602,10 @@ bool Session::AllocateBufferForImmediateUse(size_t minimum_size,
   // Get the buffer.
   DCHECK_EQ(pool_ptr->begin() + 1, pool_ptr->end());
   Buffer* buffer = pool_ptr->begin();
-  Buffer::ID buffer_id = Buffer::GetID(*buffer);
 
   // Update the bookkeeping.
   buffer->state = Buffer::kInUse;
-  CHECK(buffers_.insert(std::make_pair(buffer_id, buffer)).second);
+  pool_ptr->OnBufferAcquired();
   buffer_state_counts_[Buffer::kInUse]++;
 
   DCHECK(BufferBookkeepingIsConsistent());
@@ -476,15 +656,31 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
     // satisfied by an allocation.
     if (buffer_requests_waiting_for_recycle_ < buffers_force_recyclable) {
       ++buffer_requests_waiting_for_recycle_;
+      ++statistics_.num_recycle_stalls;
+      base::TimeTicks stall_start = base::TimeTicks::Now();
       OnWaitingForBufferToBeRecycled();  // Unittest hook.
       buffer_is_available_.Wait();
       --buffer_requests_waiting_for_recycle_;
+      uint64 stall_time =
+          (base::TimeTicks::Now() - stall_start).InMicroseconds();
+      ++statistics_.wait_time.counts[GetTraceLatencyBucket(stall_time)];
     } else {
-      // Otherwise, force an allocation.
-      if (!AllocateBuffers(call_trace_service_->num_incremental_buffers(),
+      // Otherwise, force an allocation. Each successive allocation is twice
+      // the size of the previous one, up to the service's limit, so that
+      // a session that is short of buffers doesn't need to keep allocating
+      // small pools.
+      size_t num_incremental_buffers =
+          call_trace_service_->num_incremental_buffers();
+      if (num_buffers_to_allocate_ < num_incremental_buffers)
+        num_buffers_to_allocate_ = num_incremental_buffers;
+      if (!AllocateBuffers(num_buffers_to_allocate_,
                            call_trace_service_->buffer_size_in_bytes())) {
         return false;
       }
+      num_buffers_to_allocate_ = std::max(
+          num_incremental_buffers,
+          std::min(2 * num_buffers_to_allocate_,
+                   call_trace_service_->max_incremental_buffers()));
     }
   }
   DCHECK(!buffers_available_.empty());
@@ -532,8 +728,9 @@ bool Session::DestroySingletonBuffer(Buffer* buffer) {
   // Remove the pool from our collection of pools.
   shared_memory_buffers_.erase(it);
 
-  // Remove the buffer from the buffer map.
-  CHECK_EQ(1u, buffers_.erase(Buffer::GetID(*buffer)));
+  // Remove the pool from the pool index.
+  CHECK_EQ(1u, buffer_pools_.erase(pool->client_handle()));
+  --num_buffers_;
 
   // Remove the buffer from our buffer statistics.
   buffer_state_counts_[Buffer::kPendingWrite]--;
@@ -559,15 +756,22 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   //     (with type TraceFileSegmentHeader::kTypeId).
   // TraceFileSegmentHeader: the segment header for the segment represented
   //     by this buffer.
+  // RecordPrefix, TraceSessionStatistics: the session statistics, if the
+  //     service records them.
   // RecordPrefix: the prefix for the event itself (with type
   //     TRACE_PROCESS_ENDED). This prefix will have a data size of zero
   //     indicating that no structure follows.
-  const size_t kBufferSize = sizeof(RecordPrefix) +
-      sizeof(TraceFileSegmentHeader) + sizeof(RecordPrefix);
+  bool record_statistics =
+      (call_trace_service_->flags() & TRACE_FLAG_SESSION_STATISTICS) != 0;
+  size_t statistics_size = 0;
+  if (record_statistics)
+    statistics_size = sizeof(RecordPrefix) + sizeof(TraceSessionStatistics);
+  size_t required_size = sizeof(RecordPrefix) +
+      sizeof(TraceFileSegmentHeader) + statistics_size + sizeof(RecordPrefix);
 
   // Ensure that a free buffer exists.
   if (buffers_available_.empty()) {
-    if (!AllocateBuffers(1, kBufferSize)) {
+    if (!AllocateBuffers(1, required_size)) {
       LOG(ERROR) << "Unable to allocate buffer for process ended event.";
       return false;
     }
@@ -583,7 +787,7 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
 
   // This should pretty much never happen as we always allocate really big
   // buffers, but it is possible.
-  if ((*buffer)->buffer_size < kBufferSize) {
+  if ((*buffer)->buffer_size < required_size) {
     LOG(ERROR) << "Buffer too small for process ended event.";
     return false;
   }
@@ -606,10 +810,25 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   TraceFileSegmentHeader* segment_header =
       reinterpret_cast<TraceFileSegmentHeader*>(segment_prefix + 1);
   segment_header->thread_id = 0;
-  segment_header->segment_length = sizeof(RecordPrefix);
+  segment_header->segment_length = statistics_size + sizeof(RecordPrefix);
 
   RecordPrefix* event_prefix =
       reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  if (record_statistics) {
+    RecordPrefix* statistics_prefix = event_prefix;
+    statistics_prefix->timestamp = timestamp;
+    statistics_prefix->size = sizeof(TraceSessionStatistics);
+    statistics_prefix->type = TraceSessionStatistics::kTypeId;
+    statistics_prefix->version.hi = TRACE_VERSION_HI;
+    statistics_prefix->version.lo = TRACE_VERSION_LO;
+
+    TraceSessionStatistics* statistics =
+        reinterpret_cast<TraceSessionStatistics*>(statistics_prefix + 1);
+    *statistics = statistics_;
+
+    event_prefix = reinterpret_cast<RecordPrefix*>(statistics + 1);
+  }
+
   event_prefix->timestamp = timestamp;
   event_prefix->size = 0;
   event_prefix->type = TRACE_PROCESS_ENDED;
@@ -619,13 +838,142 @@ bool Session::CreateProcessEndedEvent(Buffer** buffer) {
   return true;
 }
 
+void Session::DiscardIdleBufferPools(base::TimeTicks now) {
+  lock_.AssertAcquired();
+
+  // There's no point in discarding buffers that are about to be freed.
+  if (is_closing_)
+    return;
+
+  base::TimeDelta timeout = call_trace_service_->idle_buffer_pool_timeout();
+  const size_t kHeaderSize =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+
+  SharedMemoryBufferCollection::iterator it = shared_memory_buffers_.begin();
+  for (; it != shared_memory_buffers_.end(); ++it) {
+    BufferPool* pool = *it;
+    if (!pool->is_idle() || pool->is_discarded() ||
+        now - pool->idle_since() < timeout) {
+      continue;
+    }
+
+    if (pool->DiscardContents(kHeaderSize)) {
+      VLOG(1) << "Discarded idle buffer pool for session [pid="
+              << client_.process_id << "].";
+    }
+
+    // The session is clearly not short of buffers.
+    num_buffers_to_allocate_ = 0;
+  }
+}
+
+void Session::CloseBufferRing() {
+  HANDLE commit_wait = NULL;
+  {
+    base::AutoLock ring_lock(ring_lock_);
+    std::swap(commit_wait, commit_wait_);
+  }
+
+  // Wait for any running callback to complete. It acquires ring_lock_, so
+  // this can't happen under it.
+  if (commit_wait != NULL &&
+      !::UnregisterWaitEx(commit_wait, INVALID_HANDLE_VALUE)) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "Failed to stop waiting on buffer ring event: "
+               << ::common::LogWe(error) << ".";
+  }
+
+  base::AutoLock ring_lock(ring_lock_);
+  if (rings_ == NULL)
+    return;
+
+  CommitBufferRingUnlocked();
+
+  // The client never claimed the buffers left in the free ring. They're in
+  // use but still hold whatever was last written to them, so clear their
+  // headers to have them commit as empty segments.
+  const size_t kHeaderSize =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  BufferRingDescriptor descriptor = {};
+  while (PopBufferRing(&rings_->free_ring, &descriptor)) {
+    CallTraceBuffer call_trace_buffer = ToCallTraceBuffer(descriptor);
+    Buffer* buffer = NULL;
+    if (!FindBuffer(&call_trace_buffer, &buffer))
+      continue;
+
+    DCHECK_LE(kHeaderSize, buffer->buffer_size);
+    MappedBuffer mapped_buffer(buffer);
+    if (mapped_buffer.Map())
+      ::memset(mapped_buffer.data(), 0, kHeaderSize);
+  }
+
+  if (::UnmapViewOfFile(rings_) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(WARNING) << "Failed to unmap buffer ring: " << ::common::LogWe(error)
+                 << ".";
+  }
+  rings_ = NULL;
+  ring_handle_.Close();
+  commit_event_.Close();
+}
+
+// static
+void CALLBACK Session::OnBufferRingCommit(void* param, BOOLEAN timed_out) {
+  DCHECK(param != NULL);
+  DCHECK(!timed_out);
+
+  Session* session = static_cast<Session*>(param);
+  base::AutoLock ring_lock(session->ring_lock_);
+  if (session->rings_ == NULL)
+    return;
+
+  session->CommitBufferRingUnlocked();
+  session->RefillBufferRingUnlocked();
+}
+
+void Session::CommitBufferRingUnlocked() {
+  DCHECK(rings_ != NULL);
+  ring_lock_.AssertAcquired();
+
+  BufferRingDescriptor descriptor = {};
+  while (PopBufferRing(&rings_->commit_ring, &descriptor)) {
+    CallTraceBuffer call_trace_buffer = ToCallTraceBuffer(descriptor);
+    Buffer* buffer = NULL;
+    if (!FindBuffer(&call_trace_buffer, &buffer))
+      continue;
+
+    if (!ReturnBuffer(buffer))
+      LOG(ERROR) << "Unable to return buffer from buffer ring.";
+  }
+}
+
+void Session::RefillBufferRingUnlocked() {
+  DCHECK(rings_ != NULL);
+  ring_lock_.AssertAcquired();
+
+  // The service is the only producer for the free ring, so it can't fill up
+  // under our feet.
+  while (GetBufferRingSize(rings_->free_ring) < kNumFreeRingBuffers) {
+    Buffer* buffer = NULL;
+    if (!GetNextBuffer(&buffer))
+      return;
+
+    DCHECK(buffer != NULL);
+    if (!PushBufferRing(ToBufferRingDescriptor(*buffer), &rings_->free_ring)) {
+      // The buffer stays in use, and is committed when the session closes.
+      LOG(ERROR) << "Unable to push buffer to buffer ring.";
+      return;
+    }
+  }
+}
+
 bool Session::BufferBookkeepingIsConsistent() const {
   lock_.AssertAcquired();
 
   size_t buffer_states_ = buffer_state_counts_[Buffer::kAvailable] +
       buffer_state_counts_[Buffer::kInUse] +
       buffer_state_counts_[Buffer::kPendingWrite];
-  if (buffer_states_ != buffers_.size())
+  if (buffer_states_ != num_buffers_)
     return false;
 
   if (buffers_available_.size() != buffer_state_counts_[Buffer::kAvailable])
@@ -28,7 +28,9 @@
 #include "base/process/process.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
+#include "syzygy/trace/protocol/buffer_ring.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/process_info.h"
@@ -98,6 +100,24 @@ class Session : public base::RefCountedThreadSafe<Session> {
   bool FindBuffer(::CallTraceBuffer* call_trace_buffer,
                   Buffer** client_buffer);
 
+  // Opens a shared-memory buffer ring through which the client can commit
+  // and exchange buffers without making RPC calls. The service commits the
+  // buffers pushed to the commit ring whenever the client signals the commit
+  // event, and keeps the free ring stocked with fresh buffers.
+  // @param client_ring_handle on success, receives the handle of the shared
+  //     memory holding the rings, valid in the client process.
+  // @param ring_size on success, receives the size of the shared memory.
+  // @param client_commit_event on success, receives the handle of the commit
+  //     event, valid in the client process.
+  // @returns true on success, false otherwise.
+  bool OpenBufferRing(HANDLE* client_ring_handle,
+                      size_t* ring_size,
+                      HANDLE* client_commit_event);
+
+  // Gets the statistics of this session so far.
+  // @param statistics receives the statistics.
+  void GetStatistics(TraceSessionStatistics* statistics);
+
   // Returns the process id of the client process.
   ProcessId client_process_id() const { return client_.process_id; }
 
@@ -203,14 +223,51 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // @pre Under lock_.
   void ChangeBufferState(BufferState new_state, Buffer* buffer);
 
+  // Accounts for a buffer having been written and recycled.
+  // @param buffer the buffer.
+  // @pre Under lock_.
+  void RecordBufferWrittenUnlocked(Buffer* buffer);
+
   // Gets (creating if needed) a buffer and populates it with a
-  // TRACE_PROCESS_ENDED event. This is called by Close(), which is called
+  // TRACE_PROCESS_ENDED event, preceded by the session statistics if the
+  // service records them. This is called by Close(), which is called
   // when the process owning this session disconnects (at its death).
   // @param buffer receives a pointer to the buffer that is used.
   // @returns true on success, false otherwise.
   // @pre Under lock_.
   bool CreateProcessEndedEvent(Buffer** buffer);
 
+  // Takes ownership of a newly allocated buffer pool, making its buffers
+  // available to FindBuffer.
+  // @param pool The pool to be added.
+  // @pre Under lock_.
+  void AddBufferPool(BufferPool* pool);
+
+  // Discards the contents of any buffer pools that have been idle for longer
+  // than the service's idle timeout. When this happens the allocation size
+  // returns to its initial value, as the session is no longer running short
+  // of buffers.
+  // @param now The current time.
+  // @pre Under lock_.
+  void DiscardIdleBufferPools(base::TimeTicks now);
+
+  // Stops servicing the buffer ring, if any, after committing the buffers
+  // left in its commit ring. The buffers left in its free ring are cleared so
+  // that they commit as empty segments when the session closes. This must not
+  // be called under lock_.
+  void CloseBufferRing();
+
+  // Invoked on a thread pool thread when the client signals the commit event.
+  static void CALLBACK OnBufferRingCommit(void* param, BOOLEAN timed_out);
+
+  // Commits the buffers the client pushed to the commit ring.
+  // @pre Under ring_lock_.
+  void CommitBufferRingUnlocked();
+
+  // Tops up the free ring with fresh buffers.
+  // @pre Under ring_lock_.
+  void RefillBufferRingUnlocked();
+
   // Returns true if the buffer book-keeping is self-consistent.
   // @pre Under lock_.
   bool BufferBookkeepingIsConsistent() const;
@@ -225,9 +282,18 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // All shared memory buffers allocated for this session.
   SharedMemoryBufferCollection shared_memory_buffers_;  // Under lock_.
 
-  // This is the set of buffers that we currently own.
-  typedef std::map<Buffer::ID, Buffer*> BufferMap;
-  BufferMap buffers_;  // Under lock_.
+  // The shared memory buffers, indexed by the value of their handle in the
+  // client process. A buffer is located by finding its pool here and then
+  // indexing into the pool by offset.
+  typedef std::map<unsigned long, BufferPool*> BufferPoolMap;
+  BufferPoolMap buffer_pools_;  // Under lock_.
+
+  // The total number of buffers that we currently own.
+  size_t num_buffers_;  // Under lock_.
+
+  // The number of buffers to allocate the next time the session runs out of
+  // buffers. This is zero until the first such allocation.
+  size_t num_buffers_to_allocate_;  // Under lock_.
 
   // State summary.
   size_t buffer_state_counts_[Buffer::kBufferStateMax];  // Under lock_.
@@ -260,6 +326,21 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // state.
   base::Lock lock_;
 
+  // The shared memory holding the buffer rings, its view and the event the
+  // client signals after pushing to the commit ring. These are only set while
+  // the buffer ring is open.
+  base::win::ScopedHandle ring_handle_;  // Under ring_lock_.
+  BufferRings* rings_;  // Under ring_lock_.
+  base::win::ScopedHandle commit_event_;  // Under ring_lock_.
+  HANDLE commit_wait_;  // Under ring_lock_.
+
+  // This lock serializes the servicing of the buffer ring. It's acquired
+  // before lock_ when both are needed.
+  base::Lock ring_lock_;
+
+  // The statistics of this session.
+  TraceSessionStatistics statistics_;  // Under lock_.
+
   // Tracks whether or not invalid input errors have already been logged.
   // When an error of this type occurs, there will typically be numerous
   // follow-on occurrences that we don't want to log.
@@ -19,8 +19,12 @@
 
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/file_util.h"
+#include "base/memory/scoped_ptr.h"
+#include "syzygy/common/com_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/mapped_buffer.h"
@@ -29,10 +33,32 @@
 namespace trace {
 namespace service {
 
+// The IOContext is the first base of this structure, so the context passed
+// to OnIOCompleted can be converted back to the pending write.
+struct SessionTraceFileWriter::PendingWrite
+    : public base::MessageLoopForIO::IOContext {
+  PendingWrite(Session* session, Buffer* buffer)
+      : session(session), buffer(buffer), mapped_buffer(buffer) {
+  }
+
+  // Keeps the session, and through it this writer, alive until the write
+  // completes.
+  scoped_refptr<Session> session;
+  Buffer* buffer;
+
+  // The view that the buffer is written from. This stays mapped for the
+  // duration of the write.
+  MappedBuffer mapped_buffer;
+};
+
 SessionTraceFileWriter::SessionTraceFileWriter(
     base::MessageLoop* message_loop, const base::FilePath& trace_directory)
     : message_loop_(message_loop),
-      trace_file_path_(trace_directory) {
+      trace_file_path_(trace_directory),
+      overlapped_io_(false),
+      compress_segments_(false),
+      queue_depth_(0),
+      max_queue_depth_(0) {
   DCHECK(message_loop != NULL);
   DCHECK(!trace_directory.empty());
 }
@@ -53,15 +79,26 @@ bool SessionTraceFileWriter::Open(Session* session) {
   trace_file_path_ = trace_file_path_.Append(basename);
 
   // Open the trace file and write the header.
-  if (!writer_.Open(trace_file_path_) ||
-      !writer_.WriteHeader(session->client_info())) {
+  bool opened = overlapped_io_ ?
+      writer_.OpenForOverlappedIO(trace_file_path_) :
+      writer_.Open(trace_file_path_);
+  if (!opened || !writer_.WriteHeader(session->client_info()))
     return false;
+
+  // Have the completions of the overlapped writes delivered to the message
+  // loop.
+  if (overlapped_io_) {
+    DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop_->type());
+    static_cast<base::MessageLoopForIO*>(message_loop_)->RegisterIOHandler(
+        writer_.handle(), this);
   }
 
   return true;
 }
 
 bool SessionTraceFileWriter::Close(Session* /* session */) {
+  VLOG(1) << "Trace file '" << trace_file_path_.value() << "' had at most "
+          << max_queue_depth() << " buffers queued for writing.";
   return true;
 }
 
@@ -70,6 +107,12 @@ bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
   DCHECK(buffer->session != NULL);
   DCHECK(message_loop_ != NULL);
 
+  {
+    base::AutoLock auto_lock(queue_depth_lock_);
+    ++queue_depth_;
+    max_queue_depth_ = std::max(max_queue_depth_, queue_depth_);
+  }
+
   message_loop_->PostTask(FROM_HERE,
                           base::Bind(&SessionTraceFileWriter::WriteBuffer,
                                      this,
@@ -83,6 +126,16 @@ size_t SessionTraceFileWriter::block_size() const {
   return writer_.block_size();
 }
 
+size_t SessionTraceFileWriter::queue_depth() const {
+  base::AutoLock auto_lock(queue_depth_lock_);
+  return queue_depth_;
+}
+
+size_t SessionTraceFileWriter::max_queue_depth() const {
+  base::AutoLock auto_lock(queue_depth_lock_);
+  return max_queue_depth_;
+}
+
 void SessionTraceFileWriter::WriteBuffer(Session* session, Buffer* buffer) {
   DCHECK(session != NULL);
   DCHECK(buffer != NULL);
@@ -90,23 +143,101 @@ void SessionTraceFileWriter::WriteBuffer(Session* session, Buffer* buffer) {
   DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
   DCHECK_EQ(base::MessageLoop::current(), message_loop_);
 
+  {
+    base::AutoLock auto_lock(queue_depth_lock_);
+    DCHECK_LT(0u, queue_depth_);
+    --queue_depth_;
+  }
+
+  // Compressed records are written from a scratch buffer, so they always take
+  // the synchronous path.
+  if (overlapped_io_ && !compress_segments_) {
+    BeginWriteBuffer(session, buffer);
+    return;
+  }
+
   MappedBuffer mapped_buffer(buffer);
   if (!mapped_buffer.Map())
     return;
 
   // We deliberately ignore the return status. However, this will log if
   // anything goes wrong.
-  writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
+  if (compress_segments_)
+    writer_.WriteCompressedRecord(mapped_buffer.data(), buffer->buffer_size);
+  else
+    writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
+
+  RecycleWrittenBuffer(session, buffer, &mapped_buffer);
+}
+
+void SessionTraceFileWriter::BeginWriteBuffer(Session* session,
+                                              Buffer* buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK(overlapped_io_);
+  DCHECK(!compress_segments_);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  scoped_ptr<PendingWrite> write(new PendingWrite(session, buffer));
+  if (!write->mapped_buffer.Map())
+    return;
+
+  // We deliberately ignore the return status. However, this will log if
+  // anything goes wrong.
+  bool pending = false;
+  writer_.BeginWriteRecord(write->mapped_buffer.data(),
+                           buffer->buffer_size,
+                           &write->overlapped,
+                           &pending);
+
+  // If there's no write in progress then the buffer can be recycled right
+  // away, otherwise this is done once the write completes.
+  if (!pending) {
+    RecycleWrittenBuffer(session, buffer, &write->mapped_buffer);
+    return;
+  }
+  ignore_result(write.release());
+}
+
+void SessionTraceFileWriter::OnIOCompleted(
+    base::MessageLoopForIO::IOContext* context,
+    DWORD bytes_transfered,
+    DWORD error) {
+  DCHECK(context != NULL);
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  scoped_ptr<PendingWrite> write(static_cast<PendingWrite*>(context));
+  if (error != ERROR_SUCCESS) {
+    LOG(ERROR) << "Failed writing to '" << trace_file_path_.value()
+               << "': " << ::common::LogWe(error) << ".";
+  }
+
+  RecycleWrittenBuffer(write->session.get(), write->buffer,
+                       &write->mapped_buffer);
+}
+
+void SessionTraceFileWriter::RecycleWrittenBuffer(
+    Session* session, Buffer* buffer, MappedBuffer* mapped_buffer) {
+  DCHECK(session != NULL);
+  DCHECK(buffer != NULL);
+  DCHECK(mapped_buffer != NULL);
+  DCHECK(mapped_buffer->IsMapped());
+
+  // Note how much trace data the buffer held, for the session statistics.
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(
+          mapped_buffer->data() + sizeof(RecordPrefix));
+  buffer->num_bytes_written = header->segment_length;
 
   // It's entirely possible for this buffer to be handed out to another client
   // and for the service to be forcibly shutdown before the client has had a
   // chance to even touch the buffer. In that case, we'll end up writing the
   // buffer again. We clear the RecordPrefix and the TraceFileSegmentHeader so
   // that we'll at least see the buffer as empty and write nothing.
-  ::memset(mapped_buffer.data(), 0,
+  ::memset(mapped_buffer->data(), 0,
            sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
 
-  mapped_buffer.Unmap();
+  mapped_buffer->Unmap();
   session->RecycleBuffer(buffer);
 }
 
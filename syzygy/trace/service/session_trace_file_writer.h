@@ -20,6 +20,8 @@
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 
 #include "base/files/file_path.h"
+#include "base/message_loop/message_loop.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/thread.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
@@ -29,12 +31,19 @@ namespace trace {
 namespace service {
 
 // Forward Declaration.
+class MappedBuffer;
 class Session;
 class SessionTraceFileWriterFactory;
 
 // This class implements the interface the buffer consumer thread uses to
 // process incoming buffers.
-class SessionTraceFileWriter : public BufferConsumer {
+//
+// By default each buffer is written to disk synchronously on the message loop.
+// If overlapped I/O is enabled the writes for several buffers may instead be
+// in flight at once, each being written directly from its mapped view. A
+// buffer is only recycled once its write has completed.
+class SessionTraceFileWriter : public BufferConsumer,
+                               public base::MessageLoopForIO::IOHandler {
  public:
   // Construct a SessionTraceFileWriter instance.
   // @param message_loop The message loop on which this writer instance will
@@ -54,10 +63,61 @@ class SessionTraceFileWriter : public BufferConsumer {
   virtual size_t block_size() const OVERRIDE;
   // @}
 
+  // @name base::MessageLoopForIO::IOHandler implementation.
+  // @{
+  virtual void OnIOCompleted(base::MessageLoopForIO::IOContext* context,
+                             DWORD bytes_transfered,
+                             DWORD error) OVERRIDE;
+  // @}
+
+  // Enables or disables overlapped I/O. This must be called prior to Open.
+  // @param overlapped_io True if buffers are to be written using overlapped
+  //     I/O.
+  void set_overlapped_io(bool overlapped_io) {
+    overlapped_io_ = overlapped_io;
+  }
+
+  // @returns true if buffers are written using overlapped I/O.
+  bool overlapped_io() const { return overlapped_io_; }
+
+  // Enables or disables the compression of the segments written to the trace
+  // file. Compressed segments are written synchronously, even when overlapped
+  // I/O is enabled.
+  // @param compress_segments True if segments are to be compressed.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns true if segments are compressed.
+  bool compress_segments() const { return compress_segments_; }
+
+  // @returns the number of buffers that have been handed to this writer but
+  //     that have not yet been written.
+  size_t queue_depth() const;
+
+  // @returns the largest number of buffers that have been queued for writing
+  //     at once.
+  size_t max_queue_depth() const;
+
  protected:
+  // The state of a buffer whose overlapped write is in progress.
+  struct PendingWrite;
+
   // Commit a trace buffer to disk. This will be called on message_loop_.
   void WriteBuffer(Session* session, Buffer* buffer);
 
+  // Starts an overlapped write of a trace buffer to disk. This will be called
+  // on message_loop_.
+  void BeginWriteBuffer(Session* session, Buffer* buffer);
+
+  // Returns a buffer that has been written to disk to its session.
+  // @param session The session that owns the buffer.
+  // @param buffer The buffer that has been written.
+  // @param mapped_buffer The view of the buffer that was written.
+  void RecycleWrittenBuffer(Session* session,
+                            Buffer* buffer,
+                            MappedBuffer* mapped_buffer);
+
   // The message loop on which this trace file writer will do IO.
   base::MessageLoop* const message_loop_;
 
@@ -69,6 +129,21 @@ class SessionTraceFileWriter : public BufferConsumer {
   // This is used for committing actual buffers to disk.
   TraceFileWriter writer_;
 
+  // Indicates if buffers are written using overlapped I/O.
+  bool overlapped_io_;
+
+  // Indicates if segments are compressed before being written.
+  bool compress_segments_;
+
+  // The number of buffers queued on message_loop_, and the largest such
+  // number seen. Protected by queue_depth_lock_.
+  size_t queue_depth_;
+  size_t max_queue_depth_;
+
+  // Protects the queue depth statistics, which are updated both by the
+  // threads returning buffers and by message_loop_.
+  mutable base::Lock queue_depth_lock_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriter);
 };
@@ -23,9 +23,22 @@ namespace service {
 
 SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
     base::MessageLoop* message_loop)
-    : message_loop_(message_loop), trace_file_directory_(L".") {
+    : message_loop_(message_loop), trace_file_directory_(L"."),
+      overlapped_io_(false),
+      compress_segments_(false),
+      next_message_loop_(0) {
   DCHECK(message_loop != NULL);
   DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
+  message_loops_.push_back(message_loop);
+}
+
+void SessionTraceFileWriterFactory::AddMessageLoop(
+    base::MessageLoop* message_loop) {
+  DCHECK(message_loop != NULL);
+  DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
+
+  base::AutoLock auto_lock(lock_);
+  message_loops_.push_back(message_loop);
 }
 
 bool SessionTraceFileWriterFactory::SetTraceFileDirectory(
@@ -47,9 +60,21 @@ bool SessionTraceFileWriterFactory::CreateConsumer(
   DCHECK(message_loop_ != NULL);
 
   // Allocate a new trace file writer.
-  *consumer = new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  SessionTraceFileWriter* writer =
+      new SessionTraceFileWriter(GetNextMessageLoop(), trace_file_directory_);
+  writer->set_overlapped_io(overlapped_io_);
+  writer->set_compress_segments(compress_segments_);
+  *consumer = writer;
   return true;
 }
 
+base::MessageLoop* SessionTraceFileWriterFactory::GetNextMessageLoop() {
+  base::AutoLock auto_lock(lock_);
+  DCHECK(!message_loops_.empty());
+  base::MessageLoop* message_loop = message_loops_[next_message_loop_];
+  next_message_loop_ = (next_message_loop_ + 1) % message_loops_.size();
+  return message_loop;
+}
+
 }  // namespace service
 }  // namespace trace
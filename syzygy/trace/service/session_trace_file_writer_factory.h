@@ -19,6 +19,7 @@
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_FACTORY_H_
 
 #include <set>
+#include <vector>
 
 #include "base/files/file_path.h"
 #include "base/synchronization/lock.h"
@@ -44,6 +45,15 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   //     must outlive the factory instance.
   explicit SessionTraceFileWriterFactory(base::MessageLoop* message_loop);
 
+  // Adds a message loop to the pool of loops on which trace file writers
+  // consume buffers. Each new trace file writer is assigned to the next loop
+  // in the pool in turn, so that the writes of concurrent sessions are
+  // spread over several threads.
+  // @param message_loop The message loop to add. This must be of type
+  //     TYPE_IO. The factory instance does NOT take ownership of the
+  //     message_loop. The message_loop must outlive the factory instance.
+  void AddMessageLoop(base::MessageLoop* message_loop);
+
   // @name BufferConsumerFactory implementation.
   // @{
   virtual bool CreateConsumer(scoped_refptr<BufferConsumer>* consumer) OVERRIDE;
@@ -53,16 +63,58 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // file writers will output trace files.
   bool SetTraceFileDirectory(const base::FilePath& path);
 
-  // Get the message loop the trace file writers should use for IO.
+  // Enables or disables overlapped I/O for all subsequently created trace
+  // file writers.
+  // @param overlapped_io True if buffers are to be written using overlapped
+  //     I/O.
+  void set_overlapped_io(bool overlapped_io) {
+    overlapped_io_ = overlapped_io;
+  }
+
+  // @returns true if the trace file writers use overlapped I/O.
+  bool overlapped_io() const { return overlapped_io_; }
+
+  // Enables or disables segment compression for all subsequently created
+  // trace file writers.
+  // @param compress_segments True if segments are to be compressed.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns true if the trace file writers compress segments.
+  bool compress_segments() const { return compress_segments_; }
+
+  // Get the message loop the trace file writers should use for IO. If the
+  // pool contains several loops, this is the one provided on construction.
   base::MessageLoop* message_loop() { return message_loop_; }
 
+  // @returns the number of message loops in the pool.
+  size_t num_message_loops() const { return message_loops_.size(); }
+
  protected:
+  // @returns the message loop to be used by the next trace file writer.
+  base::MessageLoop* GetNextMessageLoop();
+
   // The message loop the trace file writers should use for IO.
   base::MessageLoop* const message_loop_;
 
+  // The pool of message loops, including message_loop_, among which the trace
+  // file writers are distributed. Protected by lock_.
+  std::vector<base::MessageLoop*> message_loops_;
+
+  // The index of the loop to be used by the next trace file writer.
+  // Protected by lock_.
+  size_t next_message_loop_;
+
   // The directory into which trace file writers will write.
   base::FilePath trace_file_directory_;
 
+  // Indicates if the trace file writers should use overlapped I/O.
+  bool overlapped_io_;
+
+  // Indicates if the trace file writers should compress segments.
+  bool compress_segments_;
+
   // The set of currently active buffer consumer objects. Protected by lock_.
   std::set<scoped_refptr<BufferConsumer>> active_consumers_;
 
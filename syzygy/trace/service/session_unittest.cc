@@ -122,6 +122,8 @@ volatile base::subtle::Atomic32 TestSessionTraceFileWriter::num_instances_ = 0;
 
 class TestSessionTraceFileWriterFactory : public SessionTraceFileWriterFactory {
  public:
+  using SessionTraceFileWriterFactory::GetNextMessageLoop;
+
   explicit TestSessionTraceFileWriterFactory(base::MessageLoop* message_loop)
       : SessionTraceFileWriterFactory(message_loop) {
   }
@@ -192,6 +194,11 @@ class TestSession : public Session {
     waiting_for_buffer_to_be_recycled_state_ = false;
   }
 
+  Buffer::BufferState GetBufferState(Buffer* buffer) {
+    base::AutoLock lock(lock_);
+    return buffer->state;
+  }
+
   size_t buffer_requests_waiting_for_recycle() {
     base::AutoLock lock(lock_);
     return buffer_requests_waiting_for_recycle_;
@@ -463,6 +470,53 @@ TEST_F(SessionTest, BackPressureWorks) {
   session->AllowBuffersToBeRecycled(9999);
 }
 
+TEST_F(SessionTest, StatisticsCountCommitsAndStalls) {
+  call_trace_service_.set_max_buffers_pending_write(1);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  TraceSessionStatistics statistics = {};
+  session->GetStatistics(&statistics);
+  EXPECT_EQ(TraceSessionStatistics::kServiceSource, statistics.source);
+  EXPECT_EQ(1u, statistics.num_sessions);
+  EXPECT_EQ(0u, statistics.num_buffers_committed);
+  EXPECT_EQ(0u, statistics.num_recycle_stalls);
+
+  Buffer* buffer1 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer1));
+  Buffer* buffer2 = NULL;
+  ASSERT_TRUE(session->GetNextBuffer(&buffer2));
+  ASSERT_TRUE(session->ReturnBuffer(buffer1));
+  ASSERT_TRUE(session->ReturnBuffer(buffer2));
+  session->ClearWaitingForBufferToBeRecycledState();
+
+  session->GetStatistics(&statistics);
+  EXPECT_EQ(2u, statistics.num_buffers_committed);
+
+  // Getting another buffer stalls until one is recycled.
+  bool result3 = false;
+  Buffer* buffer3 = NULL;
+  base::Closure buffer_getter3 = base::Bind(
+      &GetNextBuffer, session, &buffer3, &result3);
+  worker1_.message_loop()->PostTask(FROM_HERE, buffer_getter3);
+  session->PauseUntilWaitingForBufferToBeRecycled();
+  session->AllowBuffersToBeRecycled(1);
+  worker1_.Stop();
+  ASSERT_TRUE(result3);
+
+  session->GetStatistics(&statistics);
+  EXPECT_EQ(1u, statistics.num_recycle_stalls);
+  size_t num_waits = 0;
+  for (size_t i = 0; i < TraceLatencyHistogram::kNumBuckets; ++i)
+    num_waits += statistics.wait_time.counts[i];
+  EXPECT_EQ(1u, num_waits);
+
+  ASSERT_TRUE(session->ReturnBuffer(buffer3));
+  session->AllowBuffersToBeRecycled(9999);
+}
+
 TEST_F(SessionTest, BackPressureIsLimited) {
   // Configure things so that back-pressure will be easily forced.
   call_trace_service_.set_max_buffers_pending_write(1);
@@ -577,5 +631,86 @@ TEST_F(SessionTest, LargeBufferRequestAvoidsBackPressure) {
   ASSERT_EQ(buffer3, session->last_singleton_buffer_destroyed_);
 }
 
+TEST_F(SessionTest, BufferRingCommitsAndRefills) {
+  ASSERT_TRUE(call_trace_service_.Start(true));
+
+  TestSessionPtr session = call_trace_service_.CreateTestSession();
+  ASSERT_TRUE(session != NULL);
+
+  HANDLE ring_handle = NULL;
+  size_t ring_size = 0;
+  HANDLE commit_event = NULL;
+  ASSERT_TRUE(session->OpenBufferRing(&ring_handle, &ring_size,
+                                      &commit_event));
+  ASSERT_EQ(sizeof(BufferRings), ring_size);
+
+  // A session only has one buffer ring.
+  HANDLE other_ring_handle = NULL;
+  size_t other_ring_size = 0;
+  HANDLE other_commit_event = NULL;
+  EXPECT_FALSE(session->OpenBufferRing(&other_ring_handle, &other_ring_size,
+                                       &other_commit_event));
+
+  // The test session hands out its own handles, so we can play the client.
+  BufferRings* rings = reinterpret_cast<BufferRings*>(
+      ::MapViewOfFile(ring_handle, FILE_MAP_WRITE, 0, 0, ring_size));
+  ASSERT_TRUE(rings != NULL);
+  size_t num_free_buffers = GetBufferRingSize(rings->free_ring);
+  EXPECT_LT(0u, num_free_buffers);
+
+  BufferRingDescriptor descriptor = {};
+  ASSERT_TRUE(PopBufferRing(&rings->free_ring, &descriptor));
+  CallTraceBuffer call_trace_buffer = {};
+  call_trace_buffer.shared_memory_handle = descriptor.shared_memory_handle;
+  call_trace_buffer.mapping_size = descriptor.mapping_size;
+  call_trace_buffer.buffer_offset = descriptor.buffer_offset;
+  call_trace_buffer.buffer_size = descriptor.buffer_size;
+  Buffer* buffer = NULL;
+  ASSERT_TRUE(session->FindBuffer(&call_trace_buffer, &buffer));
+  EXPECT_EQ(Buffer::kInUse, session->GetBufferState(buffer));
+
+  // Committing the buffer through the ring gets it written, and the free ring
+  // topped back up.
+  ASSERT_TRUE(PushBufferRing(descriptor, &rings->commit_ring));
+  ASSERT_TRUE(::SetEvent(commit_event));
+  while (session->GetBufferState(buffer) != Buffer::kPendingWrite)
+    ::Sleep(1);
+  while (GetBufferRingSize(rings->free_ring) < num_free_buffers)
+    ::Sleep(1);
+
+  // Closing the session takes back the unclaimed buffers.
+  ASSERT_TRUE(session->Close());
+  EXPECT_EQ(0u, GetBufferRingSize(rings->free_ring));
+  EXPECT_EQ(0u, GetBufferRingSize(rings->commit_ring));
+  EXPECT_TRUE(::UnmapViewOfFile(rings));
+
+  session->AllowBuffersToBeRecycled(9999);
+}
+
+TEST(SessionTraceFileWriterFactoryTest, DistributesWritersAmongMessageLoops) {
+  base::Thread thread1("writer-thread-1");
+  base::Thread thread2("writer-thread-2");
+  ASSERT_TRUE(thread1.StartWithOptions(
+      base::Thread::Options(base::MessageLoop::TYPE_IO, 0)));
+  ASSERT_TRUE(thread2.StartWithOptions(
+      base::Thread::Options(base::MessageLoop::TYPE_IO, 0)));
+
+  TestSessionTraceFileWriterFactory factory(thread1.message_loop());
+  EXPECT_EQ(1u, factory.num_message_loops());
+  EXPECT_EQ(thread1.message_loop(), factory.GetNextMessageLoop());
+  EXPECT_EQ(thread1.message_loop(), factory.GetNextMessageLoop());
+
+  factory.AddMessageLoop(thread2.message_loop());
+  EXPECT_EQ(2u, factory.num_message_loops());
+  EXPECT_EQ(thread1.message_loop(), factory.message_loop());
+
+  // The writers are assigned to the loops in turn.
+  base::MessageLoop* first = factory.GetNextMessageLoop();
+  base::MessageLoop* second = factory.GetNextMessageLoop();
+  EXPECT_NE(first, second);
+  EXPECT_EQ(first, factory.GetNextMessageLoop());
+  EXPECT_EQ(second, factory.GetNextMessageLoop());
+}
+
 }  // namespace service
 }  // namespace trace
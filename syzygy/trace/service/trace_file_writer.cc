@@ -16,11 +16,15 @@
 
 #include <time.h>
 
+#include <iterator>
+
 #include "base/strings/stringprintf.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/buffer_writer.h"
 #include "syzygy/common/com_utils.h"
 #include "syzygy/common/path_util.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 
 namespace trace {
@@ -29,10 +33,15 @@ namespace service {
 namespace {
 
 bool OpenTraceFile(const base::FilePath& file_path,
+                   bool overlapped,
                    base::win::ScopedHandle* file_handle) {
   DCHECK(!file_path.empty());
   DCHECK(file_handle != NULL);
 
+  DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING;
+  if (overlapped)
+    flags |= FILE_FLAG_OVERLAPPED;
+
   // Create a new trace file.
   base::win::ScopedHandle new_file_handle(
       ::CreateFile(file_path.value().c_str(),
@@ -40,7 +49,7 @@ bool OpenTraceFile(const base::FilePath& file_path,
                    FILE_SHARE_DELETE | FILE_SHARE_READ,
                    NULL, /* lpSecurityAttributes */
                    CREATE_ALWAYS,
-                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                   flags,
                    NULL /* hTemplateFile */));
   if (!new_file_handle.IsValid()) {
     DWORD error = ::GetLastError();
@@ -83,7 +92,8 @@ bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
 
 }  // namespace
 
-TraceFileWriter::TraceFileWriter() : block_size_(0) {
+TraceFileWriter::TraceFileWriter()
+    : block_size_(0), overlapped_(false), next_offset_(0) {
 }
 
 TraceFileWriter::~TraceFileWriter() {
@@ -112,9 +122,17 @@ base::FilePath TraceFileWriter::GenerateTraceFileBaseName(
 }
 
 bool TraceFileWriter::Open(const base::FilePath& path) {
+  return OpenImpl(path, false);
+}
+
+bool TraceFileWriter::OpenForOverlappedIO(const base::FilePath& path) {
+  return OpenImpl(path, true);
+}
+
+bool TraceFileWriter::OpenImpl(const base::FilePath& path, bool overlapped) {
   // Open the trace file.
   base::win::ScopedHandle temp_handle;
-  if (!OpenTraceFile(path, &temp_handle)) {
+  if (!OpenTraceFile(path, overlapped, &temp_handle)) {
     LOG(ERROR) << "Failed to open trace file: '"
                << path_.value() << "'.";
     return false;
@@ -130,6 +148,8 @@ bool TraceFileWriter::Open(const base::FilePath& path) {
   path_ = path;
   handle_.Set(temp_handle.Take());
   block_size_ = block_size;
+  overlapped_ = overlapped;
+  next_offset_ = 0;
 
   return true;
 }
@@ -181,12 +201,8 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   writer.Align(block_size_);
 
   // Commit the header page to disk.
-  DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(), &buffer[0], buffer.size(), &bytes_written,
-                   NULL) || bytes_written != buffer.size() ) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "Failed writing trace file header: " << ::common::LogWe(error)
-               << ".";
+  if (!WriteBlocking(&buffer[0], buffer.size())) {
+    LOG(ERROR) << "Failed writing trace file header.";
     return false;
   }
 
@@ -196,6 +212,135 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
 bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   DCHECK(data != NULL);
 
+  size_t bytes_to_write = 0;
+  if (!GetRecordWriteSize(data, length, &bytes_to_write))
+    return false;
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    return true;
+  }
+
+  // Commit the buffer to disk.
+  return WriteBlocking(data, bytes_to_write);
+}
+
+bool TraceFileWriter::WriteCompressedRecord(const void* data, size_t length) {
+  DCHECK(data != NULL);
+
+  size_t bytes_to_write = 0;
+  if (!GetRecordWriteSize(data, length, &bytes_to_write))
+    return false;
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    return true;
+  }
+
+  const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
+  const TraceFileSegmentHeader* header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
+  const uint8* segment = reinterpret_cast<const uint8*>(header + 1);
+  size_t segment_length = header->segment_length;
+
+  // Compress the segment data, leaving room for the headers.
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader);
+  compression_buffer_.resize(kHeaderLength);
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(compression_buffer_)));
+  core::ZOutStream zip_stream(out_stream.get());
+  if (!zip_stream.Init(core::ZOutStream::kZBestSpeed) ||
+      !zip_stream.Write(segment_length, segment) ||
+      !zip_stream.Flush()) {
+    LOG(ERROR) << "Failed to compress buffer.";
+    return false;
+  }
+
+  // If compression doesn't help, write the record as is.
+  size_t compressed_length = compression_buffer_.size() - kHeaderLength;
+  size_t compressed_size = ::common::AlignUp(compression_buffer_.size(),
+                                             block_size_);
+  if (compressed_size >= bytes_to_write)
+    return WriteBlocking(data, bytes_to_write);
+
+  RecordPrefix* compressed_record =
+      reinterpret_cast<RecordPrefix*>(&compression_buffer_[0]);
+  *compressed_record = *record;
+  compressed_record->type = TraceFileCompressedSegmentHeader::kTypeId;
+  compressed_record->size = sizeof(TraceFileCompressedSegmentHeader);
+
+  TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<TraceFileCompressedSegmentHeader*>(
+          compressed_record + 1);
+  compressed_header->thread_id = header->thread_id;
+  compressed_header->segment_length = compressed_length;
+  compressed_header->uncompressed_length = segment_length;
+
+  // Pad the record out to the block size.
+  compression_buffer_.resize(compressed_size, 0);
+
+  return WriteBlocking(&compression_buffer_[0], compression_buffer_.size());
+}
+
+bool TraceFileWriter::BeginWriteRecord(const void* data,
+                                       size_t length,
+                                       OVERLAPPED* overlapped,
+                                       bool* pending) {
+  DCHECK(data != NULL);
+  DCHECK(overlapped != NULL);
+  DCHECK(pending != NULL);
+  DCHECK(overlapped_);
+
+  *pending = false;
+
+  size_t bytes_to_write = 0;
+  if (!GetRecordWriteSize(data, length, &bytes_to_write))
+    return false;
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    return true;
+  }
+
+  // Reserve the space for this record in the trace file.
+  ::memset(overlapped, 0, sizeof(*overlapped));
+  overlapped->Offset = static_cast<DWORD>(next_offset_);
+  overlapped->OffsetHigh = static_cast<DWORD>(next_offset_ >> 32);
+  next_offset_ += bytes_to_write;
+
+  // A write that completes immediately still posts a completion packet, so
+  // both cases are handled identically by the caller.
+  if (!::WriteFile(handle_.Get(), data, bytes_to_write, NULL, overlapped)) {
+    DWORD error = ::GetLastError();
+    if (error != ERROR_IO_PENDING) {
+      LOG(ERROR) << "Failed writing to '" << path_.value()
+                 << "': " << ::common::LogWe(error) << ".";
+      // Nothing else has been written since the space was reserved, so it
+      // can be given back.
+      next_offset_ -= bytes_to_write;
+      return false;
+    }
+  }
+
+  *pending = true;
+  return true;
+}
+
+bool TraceFileWriter::Close() {
+  if (::CloseHandle(handle_.Take()) == 0) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CloseHandle failed: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+  return true;
+}
+
+bool TraceFileWriter::GetRecordWriteSize(const void* data,
+                                         size_t length,
+                                         size_t* bytes_to_write) {
+  DCHECK(data != NULL);
+  DCHECK(bytes_to_write != NULL);
+
+  *bytes_to_write = 0;
+
   const size_t kHeaderLength =
       sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
 
@@ -220,47 +365,73 @@ bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
   const TraceFileSegmentHeader* header =
       reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
   size_t segment_length = header->segment_length;
-  if (segment_length == 0) {
-    LOG(INFO) << "Not writing empty buffer.";
+  if (segment_length == 0)
     return true;
-  }
 
   // Figure out the total size that we'll write to disk.
-  size_t bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
-                                            block_size_);
+  size_t size = ::common::AlignUp(kHeaderLength + segment_length, block_size_);
 
   // Ensure that the total number of bytes to write does not exceed the
   // maximum record length.
-  if (bytes_to_write > length) {
+  if (size > length) {
     LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
     return false;
   }
 
-  // Commit the buffer to disk.
-  // TODO(rogerm): Use overlapped I/O.
-  DCHECK_LT(0u, bytes_to_write);
+  *bytes_to_write = size;
+  return true;
+}
+
+bool TraceFileWriter::WriteBlocking(const void* data, size_t length) {
+  DCHECK(data != NULL);
+  DCHECK_LT(0u, length);
+  DCHECK_EQ(0u, length % block_size_);
+
   DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(),
-                   record,
-                   bytes_to_write,
-                   &bytes_written,
-                   NULL) ||
-      bytes_written != bytes_to_write) {
+  if (!overlapped_) {
+    if (!::WriteFile(handle_.Get(), data, length, &bytes_written, NULL) ||
+        bytes_written != length) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed writing to '" << path_.value()
+                 << "': " << ::common::LogWe(error) << ".";
+      return false;
+    }
+    next_offset_ += length;
+    return true;
+  }
+
+  // Overlapped handles have no file pointer, so the offset is explicit. The
+  // low bit of the event handle prevents a completion packet from being
+  // posted to any completion port associated with the file.
+  base::win::ScopedHandle event(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  if (!event.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CreateEvent failed: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = static_cast<DWORD>(next_offset_);
+  overlapped.OffsetHigh = static_cast<DWORD>(next_offset_ >> 32);
+  overlapped.hEvent = reinterpret_cast<HANDLE>(
+      reinterpret_cast<uintptr_t>(event.Get()) | 1);
+
+  if (!::WriteFile(handle_.Get(), data, length, NULL, &overlapped) &&
+      ::GetLastError() != ERROR_IO_PENDING) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed writing to '" << path_.value()
                << "': " << ::common::LogWe(error) << ".";
     return false;
   }
-
-  return true;
-}
-
-bool TraceFileWriter::Close() {
-  if (::CloseHandle(handle_.Take()) == 0) {
+  if (!::GetOverlappedResult(handle_.Get(), &overlapped, &bytes_written,
+                             TRUE) ||
+      bytes_written != length) {
     DWORD error = ::GetLastError();
-    LOG(ERROR) << "CloseHandle failed: " << ::common::LogWe(error) << ".";
+    LOG(ERROR) << "Failed writing to '" << path_.value()
+               << "': " << ::common::LogWe(error) << ".";
     return false;
   }
+
+  next_offset_ += length;
   return true;
 }
 
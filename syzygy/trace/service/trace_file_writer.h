@@ -35,10 +35,17 @@
 //
 //   if (!w.Close())
 //     ...
+//
+// A trace file may also be opened for overlapped I/O using
+// OpenForOverlappedIO, in which case records can be written asynchronously
+// using BeginWriteRecord. The data being written is then left in place until
+// the write completes, avoiding any copies.
 
 #ifndef SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/process_info.h"
@@ -69,6 +76,13 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool Open(const base::FilePath& path);
 
+  // Opens a trace file at the given path for overlapped I/O. WriteHeader and
+  // WriteRecord may still be used, and will block until their writes
+  // complete.
+  // @param path The path of the trace file to write.
+  // @returns true on success, false otherwise.
+  bool OpenForOverlappedIO(const base::FilePath& path);
+
   // Writes the header to the trace file. A trace file is associated with a
   // single running process, so we require a populated process-info struct.
   // @param process_info Information about the process to which this trace file
@@ -86,6 +100,37 @@ class TraceFileWriter {
   // @returns true on success, false otherwise.
   bool WriteRecord(const void* data, size_t length);
 
+  // Writes a record to disk, compressing its segment data. The record is
+  // written as a segment with a TraceFileCompressedSegmentHeader, unless
+  // compression doesn't make it smaller, in which case it is written as is.
+  // Like WriteRecord, this blocks until the write is complete.
+  // @param data The record to be written, as for WriteRecord.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record, as for WriteRecord.
+  // @returns true on success, false otherwise.
+  bool WriteCompressedRecord(const void* data, size_t length);
+
+  // Starts an overlapped write of a record to disk. This may only be used if
+  // the trace file was opened with OpenForOverlappedIO. Records are laid out
+  // in the trace file in the order in which their writes are started.
+  // @param data The record to be written, as for WriteRecord. This must
+  //     remain valid and unmodified until the write completes.
+  // @param length The maximum length of continuous data that may be
+  //     contained in the record, as for WriteRecord.
+  // @param overlapped The structure used to track the write. This must
+  //     remain valid until the write completes. If the file handle is
+  //     associated with an I/O completion port then completion will be
+  //     signaled there, even if the write completes immediately.
+  // @param pending Will be set to true if a write was started, and to false if
+  //     there was nothing to write.
+  // @returns true on success, false otherwise.
+  // @note If a write that was started fails, the space reserved for it in
+  //     the trace file is left as a hole.
+  bool BeginWriteRecord(const void* data,
+                        size_t length,
+                        OVERLAPPED* overlapped,
+                        bool* pending);
+
   // Closes the trace file.
   // @returns true on success, false otherwise.
   // @note If this is not called manually the trace-file will close itself when
@@ -100,7 +145,38 @@ class TraceFileWriter {
   // @note This is only valid after Open has returned successfully.
   size_t block_size() const { return block_size_; }
 
+  // @returns the handle to the trace file.
+  // @note This is only valid after Open has returned successfully.
+  HANDLE handle() const { return handle_.Get(); }
+
+  // @returns true if the trace file was opened for overlapped I/O.
+  bool overlapped() const { return overlapped_; }
+
  protected:
+  // Opens the trace file, optionally for overlapped I/O.
+  // @param path The path of the trace file to write.
+  // @param overlapped If true then the file is opened for overlapped I/O.
+  // @returns true on success, false otherwise.
+  bool OpenImpl(const base::FilePath& path, bool overlapped);
+
+  // Validates a record and determines how much of it has to be written.
+  // @param data The record to be validated.
+  // @param length The maximum length of the record.
+  // @param bytes_to_write Will be set to the number of bytes to write. This is
+  //     zero if the record is valid but empty.
+  // @returns true if the record is valid, false otherwise.
+  bool GetRecordWriteSize(const void* data,
+                          size_t length,
+                          size_t* bytes_to_write);
+
+  // Writes data at the end of the trace file, blocking until the write is
+  // complete.
+  // @param data The data to be written.
+  // @param length The length of the data. This must be a multiple of the
+  //     block size.
+  // @returns true on success, false otherwise.
+  bool WriteBlocking(const void* data, size_t length);
+
   // The path to the trace file being written.
   base::FilePath path_;
 
@@ -110,6 +186,16 @@ class TraceFileWriter {
   // The block size being used by the trace file writer.
   size_t block_size_;
 
+  // Indicates if the trace file was opened for overlapped I/O.
+  bool overlapped_;
+
+  // The offset at which the next record will be written.
+  uint64 next_offset_;
+
+  // A scratch buffer to which compressed records are written. This is kept
+  // around to avoid reallocating it for each record.
+  std::vector<uint8> compression_buffer_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(TraceFileWriter);
 };
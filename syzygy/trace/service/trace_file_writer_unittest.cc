@@ -15,8 +15,11 @@
 #include "syzygy/trace/service/trace_file_writer.h"
 
 #include "base/file_util.h"
+#include "base/rand_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/process_info.h"
@@ -43,6 +46,39 @@ class TraceFileWriterTest : public testing::PELibUnitTest {
   base::FilePath trace_path;
 };
 
+// Builds a segment containing @p segment_length bytes of data in a buffer
+// that is padded to @p block_size.
+void BuildSegment(size_t segment_length,
+                  size_t block_size,
+                  std::vector<uint8>* data) {
+  data->resize(::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + segment_length,
+      block_size));
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(&data->at(0));
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type = TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->thread_id = 42;
+  header->segment_length = segment_length;
+}
+
+// Reads the record following the header of the trace file at @p path.
+void ReadFirstRecord(const base::FilePath& path,
+                     std::string* contents,
+                     const RecordPrefix** record) {
+  ASSERT_TRUE(base::ReadFileToString(path, contents));
+  ASSERT_LE(sizeof(TraceFileHeader), contents->size());
+  const TraceFileHeader* file_header =
+      reinterpret_cast<const TraceFileHeader*>(contents->data());
+  size_t offset = ::common::AlignUp(file_header->header_size,
+                                    file_header->block_size);
+  ASSERT_LT(offset + sizeof(RecordPrefix), contents->size());
+  *record = reinterpret_cast<const RecordPrefix*>(contents->data() + offset);
+}
+
 }  // namespace
 
 TEST_F(TraceFileWriterTest, GenerateTraceFileBaseName) {
@@ -141,7 +177,7 @@ TEST_F(TraceFileWriterTest, WriteRecordFailsOverwritten) {
   TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
       record + 1);
   record->size = sizeof(TraceFileSegmentHeader);
-  record->type= TraceFileSegmentHeader::kTypeId;
+  record->type = TraceFileSegmentHeader::kTypeId;
   record->version.hi = TRACE_VERSION_HI;
   record->version.lo = TRACE_VERSION_LO;
   header->segment_length = 1;
@@ -163,7 +199,7 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
       record + 1);
   record->size = sizeof(TraceFileSegmentHeader);
-  record->type= TraceFileSegmentHeader::kTypeId;
+  record->type = TraceFileSegmentHeader::kTypeId;
   record->version.hi = TRACE_VERSION_HI;
   record->version.lo = TRACE_VERSION_LO;
   header->segment_length = 1;
@@ -180,5 +216,116 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, BeginWriteRecordSucceeds) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.OpenForOverlappedIO(trace_path));
+  EXPECT_TRUE(w.overlapped());
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  std::vector<uint8> data;
+  data.resize(sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + 1);
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type = TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+  header->segment_length = 1;
+
+  data.resize(::common::AlignUp(data.size(), w.block_size()));
+  OVERLAPPED overlapped = {};
+  bool pending = false;
+  EXPECT_TRUE(w.BeginWriteRecord(data.data(), data.size(), &overlapped,
+                                 &pending));
+  EXPECT_TRUE(pending);
+
+  DWORD bytes_written = 0;
+  EXPECT_TRUE(::GetOverlappedResult(w.handle(), &overlapped, &bytes_written,
+                                    TRUE));
+  EXPECT_EQ(data.size(), bytes_written);
+
+  ASSERT_TRUE(w.Close());
+  EXPECT_TRUE(base::PathExists(trace_path));
+
+  int64 trace_file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &trace_file_size));
+  EXPECT_LT(0, trace_file_size);
+  EXPECT_EQ(0, trace_file_size % w.block_size());
+}
+
+TEST_F(TraceFileWriterTest, WriteCompressedRecordSucceeds) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  // Fill the segment with highly compressible data.
+  const size_t kSegmentLength = 16 * w.block_size();
+  std::vector<uint8> data;
+  BuildSegment(kSegmentLength, w.block_size(), &data);
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  for (size_t i = 0; i < kSegmentLength; ++i)
+    data[kHeaderLength + i] = static_cast<uint8>(i % 7);
+  EXPECT_TRUE(w.WriteCompressedRecord(&data[0], data.size()));
+  ASSERT_TRUE(w.Close());
+
+  std::string contents;
+  const RecordPrefix* record = NULL;
+  ASSERT_NO_FATAL_FAILURE(ReadFirstRecord(trace_path, &contents, &record));
+  EXPECT_EQ(0, contents.size() % w.block_size());
+
+  // The record should have been written as a smaller, compressed segment.
+  ASSERT_EQ(TraceFileCompressedSegmentHeader::kTypeId, record->type);
+  ASSERT_EQ(sizeof(TraceFileCompressedSegmentHeader), record->size);
+  const TraceFileCompressedSegmentHeader* header =
+      reinterpret_cast<const TraceFileCompressedSegmentHeader*>(record + 1);
+  EXPECT_EQ(42u, header->thread_id);
+  EXPECT_EQ(kSegmentLength, header->uncompressed_length);
+  EXPECT_GT(kSegmentLength, header->segment_length);
+
+  // Decompressing it should give back the original data.
+  const uint8* compressed = reinterpret_cast<const uint8*>(header + 1);
+  core::ScopedInStreamPtr in_stream(core::CreateByteInStream(
+      compressed, compressed + header->segment_length));
+  core::ZInStream unzip_stream(in_stream.get());
+  ASSERT_TRUE(unzip_stream.Init());
+  std::vector<uint8> decompressed(kSegmentLength);
+  ASSERT_TRUE(unzip_stream.Read(decompressed.size(), &decompressed[0]));
+  EXPECT_EQ(0, ::memcmp(&data[kHeaderLength], &decompressed[0],
+                        kSegmentLength));
+}
+
+TEST_F(TraceFileWriterTest, WriteCompressedRecordFallsBackWhenIncompressible) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  // Random data doesn't compress.
+  const size_t kSegmentLength = 4 * w.block_size();
+  std::vector<uint8> data;
+  BuildSegment(kSegmentLength, w.block_size(), &data);
+  const size_t kHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  base::RandBytes(&data[kHeaderLength], kSegmentLength);
+  EXPECT_TRUE(w.WriteCompressedRecord(&data[0], data.size()));
+  ASSERT_TRUE(w.Close());
+
+  std::string contents;
+  const RecordPrefix* record = NULL;
+  ASSERT_NO_FATAL_FAILURE(ReadFirstRecord(trace_path, &contents, &record));
+  EXPECT_EQ(TraceFileSegmentHeader::kTypeId, record->type);
+  EXPECT_EQ(0, ::memcmp(&data[0], record, data.size()));
+}
+
 }  // namespace service
 }  // namespace trace
@@ -71,14 +71,16 @@ class ProcessWorkingSet {
   // @returns per module tallies.
   const ModuleStatsVector& module_stats() const { return module_stats_; }
 
- protected:
-  // These are protected members to allow unittesting them.
+  // @name Capture helpers. These are also used by WorkingSetSampler.
+  // @{
   typedef scoped_ptr<PSAPI_WORKING_SET_INFORMATION> ScopedWsPtr;
   static bool CaptureWorkingSet(HANDLE process, ScopedWsPtr* working_set);
 
   typedef core::AddressSpace<size_t, size_t, std::wstring> ModuleAddressSpace;
   static bool CaptureModules(DWORD process_id, ModuleAddressSpace* modules);
+  // @}
 
+ protected:
   // Storage for stats.
   Stats total_stats_;
   Stats non_module_stats_;
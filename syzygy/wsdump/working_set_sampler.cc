@@ -0,0 +1,273 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <psapi.h>
+#include <algorithm>
+#include <iterator>
+
+#include "syzygy/common/com_utils.h"
+#include "syzygy/core/address_space.h"
+#include "syzygy/wsdump/process_working_set.h"
+
+namespace wsdump {
+
+namespace {
+
+typedef WorkingSetSampler::Module Module;
+
+bool ModuleBaseLess(const Module& module1, const Module& module2) {
+  return module1.base < module2.base;
+}
+
+// Reads @p size bytes at @p address in @p process.
+bool ReadMemory(HANDLE process, size_t address, size_t size, void* buffer) {
+  DCHECK(buffer != NULL);
+
+  SIZE_T bytes_read = 0;
+  if (!::ReadProcessMemory(process, reinterpret_cast<const void*>(address),
+                           buffer, size, &bytes_read) ||
+      bytes_read != size) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+WorkingSetSampler::WorkingSetSampler()
+    : process_id_(0), modules_changed_(false) {
+}
+
+bool WorkingSetSampler::Initialize(DWORD process_id) {
+  DCHECK(!process_.IsValid());
+
+  const DWORD kProcessPermissions = PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
+  process_.Set(::OpenProcess(kProcessPermissions, FALSE, process_id));
+  if (!process_.IsValid()) {
+    DWORD err = ::GetLastError();
+    LOG(ERROR) << "OpenProcess failed: " << common::LogWe(err);
+    return false;
+  }
+
+  process_id_ = process_id;
+  start_time_ = base::TimeTicks::Now();
+  return RefreshModules();
+}
+
+bool WorkingSetSampler::TakeSample(Sample* sample) {
+  DCHECK(sample != NULL);
+  DCHECK(process_.IsValid());
+
+  DWORD exit_code = 0;
+  if (!::GetExitCodeProcess(process_.Get(), &exit_code) ||
+      exit_code != STILL_ACTIVE) {
+    LOG(INFO) << "Process " << process_id_ << " has exited.";
+    return false;
+  }
+
+  if (!RefreshModules())
+    return false;
+
+  ProcessWorkingSet::ScopedWsPtr working_set;
+  if (!ProcessWorkingSet::CaptureWorkingSet(process_.Get(), &working_set))
+    return false;
+
+  std::vector<size_t> pages(working_set->NumberOfEntries);
+  for (size_t i = 0; i < pages.size(); ++i)
+    pages[i] = working_set->WorkingSetInfo[i].VirtualPage;
+  std::sort(pages.begin(), pages.end());
+
+  // Diff the working set against the previous sample.
+  std::vector<size_t> added_pages;
+  std::set_difference(pages.begin(), pages.end(),
+                      pages_.begin(), pages_.end(),
+                      std::back_inserter(added_pages));
+  sample->removed_pages.clear();
+  std::set_difference(pages_.begin(), pages_.end(),
+                      pages.begin(), pages.end(),
+                      std::back_inserter(sample->removed_pages));
+
+  // Only the attributes of the added pages are queried, which keeps the
+  // overhead of each sample proportional to the working set churn.
+  sample->added_pages.resize(added_pages.size());
+  for (size_t i = 0; i < added_pages.size(); ++i)
+    sample->added_pages[i].page = added_pages[i];
+  if (!QueryPageAttributes(&sample->added_pages))
+    return false;
+
+  sample->time = base::TimeTicks::Now() - start_time_;
+  sample->pages = pages.size();
+  pages_.swap(pages);
+  return true;
+}
+
+void WorkingSetSampler::FindPage(size_t page,
+                                 size_t* module_index,
+                                 size_t* section_index) const {
+  DCHECK(module_index != NULL);
+  DCHECK(section_index != NULL);
+
+  *module_index = kInvalidIndex;
+  *section_index = kInvalidIndex;
+
+  // Find the last module starting at or before the page.
+  size_t address = page * kPageSize;
+  Module key;
+  key.base = address;
+  Modules::const_iterator it = std::upper_bound(
+      modules_.begin(), modules_.end(), key, ModuleBaseLess);
+  if (it == modules_.begin())
+    return;
+  --it;
+  if (address - it->base >= it->size)
+    return;
+
+  *module_index = it - modules_.begin();
+  size_t rva = address - it->base;
+  for (size_t i = 0; i < it->sections.size(); ++i) {
+    const Section& section = it->sections[i];
+    if (rva >= section.rva && rva - section.rva < section.size) {
+      *section_index = i;
+      return;
+    }
+  }
+}
+
+bool WorkingSetSampler::RefreshModules() {
+  modules_changed_ = false;
+
+  // Enumerating the module handles is much cheaper than capturing the
+  // modules, so the latter is only done when the former changes.
+  std::vector<HMODULE> module_handles(module_handles_.size() + 64);
+  while (true) {
+    DWORD needed = 0;
+    DWORD size = static_cast<DWORD>(module_handles.size() * sizeof(HMODULE));
+    if (!::EnumProcessModules(process_.Get(), &module_handles[0], size,
+                              &needed)) {
+      DWORD err = ::GetLastError();
+      LOG(ERROR) << "EnumProcessModules failed: " << common::LogWe(err);
+      return false;
+    }
+    if (needed <= size) {
+      module_handles.resize(needed / sizeof(HMODULE));
+      break;
+    }
+    module_handles.resize(needed / sizeof(HMODULE));
+  }
+  std::sort(module_handles.begin(), module_handles.end());
+
+  if (module_handles == module_handles_ && !modules_.empty())
+    return true;
+
+  ProcessWorkingSet::ModuleAddressSpace module_space;
+  if (!ProcessWorkingSet::CaptureModules(process_id_, &module_space))
+    return false;
+
+  Modules modules;
+  ProcessWorkingSet::ModuleAddressSpace::RangeMap::const_iterator it =
+      module_space.ranges().begin();
+  for (; it != module_space.ranges().end(); ++it) {
+    modules.push_back(Module());
+    Module& module = modules.back();
+    module.path = it->second;
+    module.base = it->first.start();
+    module.size = it->first.size();
+    ReadSections(&module);
+  }
+
+  modules_.swap(modules);
+  module_handles_.swap(module_handles);
+  modules_changed_ = true;
+  return true;
+}
+
+void WorkingSetSampler::ReadSections(Module* module) {
+  DCHECK(module != NULL);
+
+  IMAGE_DOS_HEADER dos_header = {};
+  if (!ReadMemory(process_.Get(), module->base, sizeof(dos_header),
+                  &dos_header) ||
+      dos_header.e_magic != IMAGE_DOS_SIGNATURE) {
+    LOG(WARNING) << "Unable to read the DOS header of " << module->path << ".";
+    return;
+  }
+
+  // Only the signature and the file header are needed, which are the same
+  // for 32 and 64-bit images.
+  size_t nt_headers = module->base + dos_header.e_lfanew;
+  DWORD signature = 0;
+  IMAGE_FILE_HEADER file_header = {};
+  if (!ReadMemory(process_.Get(), nt_headers, sizeof(signature), &signature) ||
+      signature != IMAGE_NT_SIGNATURE ||
+      !ReadMemory(process_.Get(), nt_headers + sizeof(signature),
+                  sizeof(file_header), &file_header)) {
+    LOG(WARNING) << "Unable to read the NT headers of " << module->path << ".";
+    return;
+  }
+
+  std::vector<IMAGE_SECTION_HEADER> headers(file_header.NumberOfSections);
+  size_t section_headers = nt_headers + sizeof(signature) +
+      sizeof(file_header) + file_header.SizeOfOptionalHeader;
+  if (headers.empty() ||
+      !ReadMemory(process_.Get(), section_headers,
+                  headers.size() * sizeof(headers[0]), &headers[0])) {
+    LOG(WARNING) << "Unable to read the sections of " << module->path << ".";
+    return;
+  }
+
+  module->sections.resize(headers.size());
+  for (size_t i = 0; i < headers.size(); ++i) {
+    const char* name = reinterpret_cast<const char*>(headers[i].Name);
+    Section& section = module->sections[i];
+    section.name.assign(name,
+                        std::find(name, name + IMAGE_SIZEOF_SHORT_NAME, '\0'));
+    section.rva = headers[i].VirtualAddress;
+    section.size = headers[i].Misc.VirtualSize;
+  }
+}
+
+bool WorkingSetSampler::QueryPageAttributes(std::vector<AddedPage>* pages) {
+  DCHECK(pages != NULL);
+
+  if (pages->empty())
+    return true;
+
+  std::vector<PSAPI_WORKING_SET_EX_INFORMATION> info(pages->size());
+  for (size_t i = 0; i < info.size(); ++i) {
+    info[i].VirtualAddress =
+        reinterpret_cast<void*>((*pages)[i].page * kPageSize);
+  }
+
+  DWORD size = static_cast<DWORD>(info.size() * sizeof(info[0]));
+  if (!::QueryWorkingSetEx(process_.Get(), &info[0], size)) {
+    DWORD err = ::GetLastError();
+    LOG(ERROR) << "QueryWorkingSetEx failed: " << common::LogWe(err);
+    return false;
+  }
+
+  for (size_t i = 0; i < info.size(); ++i) {
+    const PSAPI_WORKING_SET_EX_BLOCK& attributes = info[i].VirtualAttributes;
+    AddedPage& page = (*pages)[i];
+    page.valid = attributes.Valid != 0;
+    page.shared = page.valid && attributes.Shared != 0;
+    page.share_count = page.valid ? attributes.ShareCount : 0;
+    page.protection = page.valid ? attributes.Win32Protection : 0;
+  }
+
+  return true;
+}
+
+}  // namespace wsdump
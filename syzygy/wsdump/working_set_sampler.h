@@ -0,0 +1,162 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Samples the working set of a process over time. Each sample is diffed
+// against the previous one, so that only the pages that entered or left the
+// working set are reported, and the attributes of the pages that entered it
+// are queried with QueryWorkingSetEx. Pages are mapped to the sections of the
+// modules of the process, so that working set growth can be correlated with
+// the layout of these modules.
+//
+// WorkingSetSampler sampler;
+// sampler.Initialize(process_id);
+// while (...) {
+//   WorkingSetSampler::Sample sample;
+//   sampler.TakeSample(&sample);
+//   ... inspect sample ...
+// }
+
+#ifndef SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+#define SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#include "base/time/time.h"
+#include "base/win/scoped_handle.h"
+
+namespace wsdump {
+
+class WorkingSetSampler {
+ public:
+  // The size of the pages reported by the sampler.
+  static const size_t kPageSize = 4096;
+
+  // Used for pages that don't belong to any module or section.
+  static const size_t kInvalidIndex = static_cast<size_t>(-1);
+
+  // A section of a module.
+  struct Section {
+    std::string name;
+    // The range of the section, relative to the base of its module.
+    size_t rva;
+    size_t size;
+  };
+
+  // A module of the process.
+  struct Module {
+    Module() : base(0), size(0) {
+    }
+
+    std::wstring path;
+    size_t base;
+    size_t size;
+    std::vector<Section> sections;
+  };
+  typedef std::vector<Module> Modules;
+
+  // A page that entered the working set since the previous sample.
+  struct AddedPage {
+    // The virtual page number.
+    size_t page;
+    // The attributes of the page, as reported by QueryWorkingSetEx. The
+    // attributes are zero if the page had already left the working set when
+    // they were queried.
+    bool valid;
+    bool shared;
+    size_t share_count;
+    uint32 protection;
+  };
+
+  // The difference between two consecutive samples. The pages are sorted.
+  struct Sample {
+    Sample() : pages(0) {
+    }
+
+    // The time of the sample, relative to the call to Initialize.
+    base::TimeDelta time;
+    // The total number of pages in the working set.
+    size_t pages;
+    std::vector<AddedPage> added_pages;
+    // The virtual page numbers of the pages that left the working set.
+    std::vector<size_t> removed_pages;
+  };
+
+  WorkingSetSampler();
+
+  // Initializes the sampler for the given process. The first sample reports
+  // the whole working set as added pages.
+  // @param process_id The ID of the process to be sampled.
+  // @returns true on success, false on failure.
+  bool Initialize(DWORD process_id);
+
+  // Captures the working set of the process and diffs it against the previous
+  // sample. The list of modules is refreshed if modules were loaded or
+  // unloaded since the previous sample.
+  // @param sample Receives the difference with the previous sample.
+  // @returns true on success, false on failure. This fails once the process
+  //     has exited.
+  bool TakeSample(Sample* sample);
+
+  // Locates the module and section a page belongs to.
+  // @param page A virtual page number.
+  // @param module_index Receives the index of the module in modules(), or
+  //     kInvalidIndex.
+  // @param section_index Receives the index of the section in the module, or
+  //     kInvalidIndex.
+  void FindPage(size_t page,
+                size_t* module_index,
+                size_t* section_index) const;
+
+  // @returns the modules of the process, sorted by base address.
+  const Modules& modules() const { return modules_; }
+
+  // @returns true if the list of modules changed during the last call to
+  //     TakeSample.
+  bool modules_changed() const { return modules_changed_; }
+
+ protected:
+  // Refreshes modules_ if the set of modules of the process changed.
+  // @returns true on success, false on failure.
+  bool RefreshModules();
+
+  // Reads the section headers of @p module from the process memory. Failing to
+  // read them isn't an error, the pages of the module simply aren't mapped to
+  // sections.
+  void ReadSections(Module* module);
+
+  // Queries the attributes of @p pages.
+  bool QueryPageAttributes(std::vector<AddedPage>* pages);
+
+  DWORD process_id_;
+  base::win::ScopedHandle process_;
+  base::TimeTicks start_time_;
+
+  // The modules of the process, sorted by base address, and their base
+  // addresses as last seen, used for detecting changes cheaply.
+  Modules modules_;
+  std::vector<HMODULE> module_handles_;
+  bool modules_changed_;
+
+  // The sorted virtual page numbers of the previous sample.
+  std::vector<size_t> pages_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WorkingSetSampler);
+};
+
+}  // namespace wsdump
+
+#endif  // SYZYGY_WSDUMP_WORKING_SET_SAMPLER_H_
@@ -0,0 +1,112 @@
+// Copyright 2014 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/wsdump/working_set_sampler.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+namespace wsdump {
+
+namespace {
+
+const size_t kNumPages = 16;
+const size_t kPageSize = WorkingSetSampler::kPageSize;
+const size_t kInvalidIndex = WorkingSetSampler::kInvalidIndex;
+
+// This function gives us an address in our module.
+void dummy() {
+}
+
+bool ContainsAddedPage(const WorkingSetSampler::Sample& sample, size_t page) {
+  for (size_t i = 0; i < sample.added_pages.size(); ++i) {
+    if (sample.added_pages[i].page == page)
+      return true;
+  }
+  return false;
+}
+
+bool ContainsRemovedPage(const WorkingSetSampler::Sample& sample,
+                         size_t page) {
+  return std::binary_search(sample.removed_pages.begin(),
+                            sample.removed_pages.end(),
+                            page);
+}
+
+}  // namespace
+
+TEST(WorkingSetSamplerTest, SamplesAreDiffed) {
+  WorkingSetSampler sampler;
+  ASSERT_TRUE(sampler.Initialize(::GetCurrentProcessId()));
+
+  // The first sample reports the whole working set.
+  WorkingSetSampler::Sample sample;
+  ASSERT_TRUE(sampler.TakeSample(&sample));
+  EXPECT_TRUE(sampler.modules_changed());
+  EXPECT_LT(0U, sample.pages);
+  EXPECT_EQ(sample.pages, sample.added_pages.size());
+  EXPECT_TRUE(sample.removed_pages.empty());
+
+  // Touch some new pages.
+  uint8* buffer = reinterpret_cast<uint8*>(
+      ::VirtualAlloc(NULL, kNumPages * kPageSize, MEM_COMMIT | MEM_RESERVE,
+                     PAGE_READWRITE));
+  ASSERT_TRUE(buffer != NULL);
+  for (size_t i = 0; i < kNumPages; ++i)
+    buffer[i * kPageSize] = 1;
+
+  size_t first_page = reinterpret_cast<size_t>(buffer) / kPageSize;
+  ASSERT_TRUE(sampler.TakeSample(&sample));
+  for (size_t i = 0; i < kNumPages; ++i)
+    EXPECT_TRUE(ContainsAddedPage(sample, first_page + i));
+  for (size_t i = 0; i < sample.added_pages.size(); ++i) {
+    if (sample.added_pages[i].page == first_page) {
+      EXPECT_TRUE(sample.added_pages[i].valid);
+      EXPECT_EQ(static_cast<uint32>(PAGE_READWRITE),
+                sample.added_pages[i].protection);
+    }
+  }
+
+  // And free them.
+  ASSERT_TRUE(::VirtualFree(buffer, 0, MEM_RELEASE));
+  ASSERT_TRUE(sampler.TakeSample(&sample));
+  for (size_t i = 0; i < kNumPages; ++i)
+    EXPECT_TRUE(ContainsRemovedPage(sample, first_page + i));
+}
+
+TEST(WorkingSetSamplerTest, FindPage) {
+  WorkingSetSampler sampler;
+  ASSERT_TRUE(sampler.Initialize(::GetCurrentProcessId()));
+  ASSERT_LT(0U, sampler.modules().size());
+
+  // Our code is in the text section of our module.
+  size_t page = reinterpret_cast<size_t>(&dummy) / kPageSize;
+  size_t module_index = kInvalidIndex;
+  size_t section_index = kInvalidIndex;
+  sampler.FindPage(page, &module_index, &section_index);
+  ASSERT_NE(kInvalidIndex, module_index);
+  ASSERT_NE(kInvalidIndex, section_index);
+
+  const WorkingSetSampler::Module& module = sampler.modules()[module_index];
+  EXPECT_EQ(reinterpret_cast<size_t>(::GetModuleHandle(NULL)), module.base);
+  EXPECT_EQ(".text", module.sections[section_index].name);
+
+  // The first page is never mapped.
+  sampler.FindPage(0, &module_index, &section_index);
+  EXPECT_EQ(kInvalidIndex, module_index);
+  EXPECT_EQ(kInvalidIndex, section_index);
+}
+
+}  // namespace wsdump
@@ -14,18 +14,23 @@
 
 #include <iostream>
 #include <list>
+#include <map>
 
 #include "base/at_exit.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/logging.h"
 #include "base/process/process_iterator.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/platform_thread.h"
 #include "pcrecpp.h"  // NOLINT
 #include "syzygy/core/json_file_writer.h"
 #include "syzygy/wsdump/process_working_set.h"
+#include "syzygy/wsdump/working_set_sampler.h"
 
 using wsdump::ProcessWorkingSet;
+using wsdump::WorkingSetSampler;
 
 namespace {
 
@@ -68,6 +73,7 @@ bool RegexpProcessFilter::Includes(const base::ProcessEntry& entry) const {
 
 const char kUsage[] =
 "Usage: wsdump [--process-name=<process_re>]\n"
+"              [--sample-interval-ms=<ms> [--sample-count=<count>]]\n"
 "\n"
 "    Captures and outputs working set statistics for all processes,\n"
 "    or only for processess whose executable name matches <process_re>.\n"
@@ -106,7 +112,24 @@ const char kUsage[] =
 "        \"executable_pages\": 8959\n"
 "      },\n"
 "      {\n"
-" ... \n";
+" ... \n"
+"\n"
+"    If --sample-interval-ms is given, the working sets of the processes\n"
+"    are instead sampled every <ms> milliseconds, <count> times or until\n"
+"    the processes exit if --sample-count is missing. The output is then a\n"
+"    stream of JSON dictionaries, one per line, of two kinds:\n"
+"      * A modules record, emitted whenever the modules of a process change,\n"
+"        with the pid and a list of modules. Each module has a path, a base\n"
+"        address and a list of sections, with their name, rva and size.\n"
+"      * A sample record, with the pid, the time in milliseconds since\n"
+"        sampling started, the total number of pages in the working set,\n"
+"        the number of pages that entered and left it since the previous\n"
+"        sample, and a list of regions. Each region is a section of a\n"
+"        module, given by the index of the module in the last modules\n"
+"        record and the name of the section, with the offsets of the pages\n"
+"        that entered and left the working set, in pages from the base of\n"
+"        the module, and the number of the added pages that are shared.\n"
+"        The first sample reports the whole working set as added pages.\n";
 
 int Usage() {
   std::cout << kUsage;
@@ -173,6 +196,190 @@ void OutputProcessInfo(const ProcessInfo& info,
   json->CloseDict();
 }
 
+
+// The pages of a section of a module that entered or left the working set.
+struct Region {
+  Region() : shared_pages(0) {
+  }
+
+  std::vector<size_t> added_pages;
+  std::vector<size_t> removed_pages;
+  size_t shared_pages;
+};
+// Regions are keyed by module index and section index.
+typedef std::map<std::pair<size_t, size_t>, Region> RegionMap;
+
+void OutputModules(base::ProcessId pid,
+                   const WorkingSetSampler& sampler,
+                   core::JSONFileWriter* json) {
+  DCHECK(json != NULL);
+
+  json->OpenDict();
+  json->OutputKey("pid");
+  json->OutputInteger(pid);
+  json->OutputKey("modules");
+  json->OpenList();
+  for (size_t i = 0; i < sampler.modules().size(); ++i) {
+    const WorkingSetSampler::Module& module = sampler.modules()[i];
+    json->OpenDict();
+    json->OutputKey("path");
+    json->OutputString(module.path);
+    json->OutputKey("base");
+    json->OutputInteger(module.base);
+    json->OutputKey("sections");
+    json->OpenList();
+    for (size_t j = 0; j < module.sections.size(); ++j) {
+      json->OpenDict();
+      json->OutputKey("name");
+      json->OutputString(module.sections[j].name);
+      json->OutputKey("rva");
+      json->OutputInteger(module.sections[j].rva);
+      json->OutputKey("size");
+      json->OutputInteger(module.sections[j].size);
+      json->CloseDict();
+    }
+    json->CloseList();
+    json->CloseDict();
+  }
+  json->CloseList();
+  json->CloseDict();
+}
+
+void OutputPageList(const std::vector<size_t>& pages,
+                    core::JSONFileWriter* json) {
+  DCHECK(json != NULL);
+
+  json->OpenList();
+  for (size_t i = 0; i < pages.size(); ++i)
+    json->OutputInteger(pages[i]);
+  json->CloseList();
+}
+
+void OutputSample(base::ProcessId pid,
+                  const WorkingSetSampler& sampler,
+                  const WorkingSetSampler::Sample& sample,
+                  core::JSONFileWriter* json) {
+  DCHECK(json != NULL);
+
+  // Group the pages by module section. Pages outside of any module are only
+  // counted.
+  RegionMap regions;
+  size_t module_index = 0;
+  size_t section_index = 0;
+  for (size_t i = 0; i < sample.added_pages.size(); ++i) {
+    const WorkingSetSampler::AddedPage& page = sample.added_pages[i];
+    sampler.FindPage(page.page, &module_index, &section_index);
+    if (module_index == WorkingSetSampler::kInvalidIndex)
+      continue;
+    Region& region = regions[std::make_pair(module_index, section_index)];
+    size_t module_page =
+        sampler.modules()[module_index].base / WorkingSetSampler::kPageSize;
+    region.added_pages.push_back(page.page - module_page);
+    if (page.shared)
+      ++region.shared_pages;
+  }
+  for (size_t i = 0; i < sample.removed_pages.size(); ++i) {
+    size_t page = sample.removed_pages[i];
+    sampler.FindPage(page, &module_index, &section_index);
+    if (module_index == WorkingSetSampler::kInvalidIndex)
+      continue;
+    Region& region = regions[std::make_pair(module_index, section_index)];
+    size_t module_page =
+        sampler.modules()[module_index].base / WorkingSetSampler::kPageSize;
+    region.removed_pages.push_back(page - module_page);
+  }
+
+  json->OpenDict();
+  json->OutputKey("pid");
+  json->OutputInteger(pid);
+  json->OutputKey("time_ms");
+  json->OutputInteger(static_cast<int>(sample.time.InMilliseconds()));
+  json->OutputKey("pages");
+  json->OutputInteger(sample.pages);
+  json->OutputKey("added");
+  json->OutputInteger(sample.added_pages.size());
+  json->OutputKey("removed");
+  json->OutputInteger(sample.removed_pages.size());
+  json->OutputKey("regions");
+  json->OpenList();
+  RegionMap::const_iterator it = regions.begin();
+  for (; it != regions.end(); ++it) {
+    const WorkingSetSampler::Module& module =
+        sampler.modules()[it->first.first];
+    json->OpenDict();
+    json->OutputKey("module");
+    json->OutputInteger(it->first.first);
+    json->OutputKey("section");
+    if (it->first.second == WorkingSetSampler::kInvalidIndex)
+      json->OutputString("");
+    else
+      json->OutputString(module.sections[it->first.second].name);
+    json->OutputKey("added");
+    OutputPageList(it->second.added_pages, json);
+    json->OutputKey("removed");
+    OutputPageList(it->second.removed_pages, json);
+    json->OutputKey("shared");
+    json->OutputInteger(it->second.shared_pages);
+    json->CloseDict();
+  }
+  json->CloseList();
+  json->CloseDict();
+}
+
+// Samples the working sets of the processes in @p pids every @p interval,
+// @p count times or until they all exit if @p count is zero.
+// @returns 0 on success, 1 on failure.
+int SampleWorkingSets(const std::vector<base::ProcessId>& pids,
+                      base::TimeDelta interval,
+                      size_t count) {
+  typedef std::map<base::ProcessId, WorkingSetSampler*> SamplerMap;
+  SamplerMap samplers;
+  for (size_t i = 0; i < pids.size(); ++i) {
+    scoped_ptr<WorkingSetSampler> sampler(new WorkingSetSampler());
+    if (!sampler->Initialize(pids[i])) {
+      LOG(ERROR) << "Unable to sample the working set of pid: " << pids[i];
+      continue;
+    }
+    samplers[pids[i]] = sampler.release();
+  }
+
+  for (size_t i = 0; !samplers.empty() && (count == 0 || i < count); ++i) {
+    if (i > 0)
+      base::PlatformThread::Sleep(interval);
+
+    SamplerMap::iterator it = samplers.begin();
+    while (it != samplers.end()) {
+      WorkingSetSampler::Sample sample;
+      if (!it->second->TakeSample(&sample)) {
+        // The process most likely exited.
+        delete it->second;
+        samplers.erase(it++);
+        continue;
+      }
+
+      // Each record is compact and on its own line.
+      if (it->second->modules_changed()) {
+        core::JSONFileWriter json(stdout, false);
+        OutputModules(it->first, *it->second, &json);
+        json.Flush();
+        ::fputc('\n', stdout);
+      }
+      core::JSONFileWriter json(stdout, false);
+      OutputSample(it->first, *it->second, sample, &json);
+      json.Flush();
+      ::fputc('\n', stdout);
+      ::fflush(stdout);
+      ++it;
+    }
+  }
+
+  SamplerMap::iterator it = samplers.begin();
+  for (; it != samplers.end(); ++it)
+    delete it->second;
+
+  return 0;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -201,6 +408,33 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (cmd_line->HasSwitch("sample-interval-ms")) {
+    int interval_ms = 0;
+    int count = 0;
+    if (!base::StringToInt(
+            cmd_line->GetSwitchValueASCII("sample-interval-ms"),
+            &interval_ms) || interval_ms <= 0) {
+      LOG(ERROR) << "Invalid sample interval.";
+      return Usage();
+    }
+    if (cmd_line->HasSwitch("sample-count") &&
+        (!base::StringToInt(cmd_line->GetSwitchValueASCII("sample-count"),
+                            &count) || count <= 0)) {
+      LOG(ERROR) << "Invalid sample count.";
+      return Usage();
+    }
+
+    std::vector<base::ProcessId> pids;
+    const base::ProcessEntry* entry = NULL;
+    base::ProcessIterator process_iterator(&filter);
+    while (entry = process_iterator.NextProcessEntry())
+      pids.push_back(entry->pid());
+
+    return SampleWorkingSets(pids,
+                             base::TimeDelta::FromMilliseconds(interval_ms),
+                             count);
+  }
+
   typedef std::list<ProcessInfo> WorkingSets;
   WorkingSets working_sets;
 
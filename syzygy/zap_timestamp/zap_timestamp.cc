@@ -12,34 +12,38 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 //
-// ZapTimestamps uses PEFile/ImageLayout/BlockGraph to represent a PE file in
-// memory, and TypedBlock to navigate through the PE structures of the file.
-// We don't use a full decomposition of the image, but rather only decompose
-// the PE headers and structures. As such, ZapTimetamps can be seen as a
-// lightweight decomposer. It would be better do this directly using the
-// internal intermediate representation formats of PEFileParser, but this
-// functionality would require some refactoring.
+// ZapTimestamps uses PEFile to represent a PE file in memory. We don't
+// decompose the image at all: the fields to be changed are all found by
+// reading the NT headers and the few data directories that carry a timestamp
+// (export, resource and debug), which is much cheaper than parsing out all of
+// the PE structures.
 //
 // Changes that are required to be made to the PE file are represented by an
 // address space, mapping replacement data to file offsets. This address-space
 // can then be simply 'stamped' on to the PE file to be modified.
 //
-// The matching PDB file is completely rewritten to guarantee that it is
-// canonical (as long as the underlying PdbWriter doesn't change). We load all
-// of the streams into memory, reach in and make local modifications, and
-// rewrite the entire file to disk.
+// By default the matching PDB file is completely rewritten to guarantee that
+// it is canonical (as long as the underlying PdbWriter doesn't change). We
+// load all of the streams into memory, reach in and make local modifications,
+// and rewrite the entire file to disk. Alternatively, the modified bytes of
+// the streams can be mapped back to the pages of the PDB file that house them
+// and stamped on to it, exactly like the PE file. This is much cheaper, but
+// leaves the page layout of the PDB file as the linker wrote it.
 
 #include "syzygy/zap_timestamp/zap_timestamp.h"
 
+#include <algorithm>
+#include <map>
+
 #include "base/at_exit.h"
-#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/file_util.h"
+#include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/md5.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/strings/stringprintf.h"
-#include "syzygy/block_graph/typed_block.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/core/file_util.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_constants.h"
@@ -49,15 +53,12 @@
 #include "syzygy/pe/find.h"
 #include "syzygy/pe/pdb_info.h"
 #include "syzygy/pe/pe_data.h"
-#include "syzygy/pe/pe_file_parser.h"
 #include "syzygy/pe/pe_file_writer.h"
 
 namespace zap_timestamp {
 
 namespace {
 
-using block_graph::BlockGraph;
-using block_graph::ConstTypedBlock;
 using core::FileOffsetAddress;
 using core::RelativeAddress;
 using pdb::PdbByteStream;
@@ -66,118 +67,18 @@ using pdb::PdbReader;
 using pdb::PdbStream;
 using pdb::PdbWriter;
 using pdb::WritablePdbStream;
-using pe::ImageLayout;
 using pe::PEFile;
-using pe::PEFileParser;
 
-typedef ConstTypedBlock<IMAGE_DEBUG_DIRECTORY> ImageDebugDirectory;
-typedef ConstTypedBlock<IMAGE_DOS_HEADER> DosHeader;
-typedef ConstTypedBlock<IMAGE_NT_HEADERS> NtHeaders;
-typedef ConstTypedBlock<pe::CvInfoPdb70> CvInfoPdb;
 typedef ZapTimestamp::PatchAddressSpace PatchAddressSpace;
 typedef ZapTimestamp::PatchData PatchData;
 
-// An intermediate reference type used to track references generated by
-// PEFileParser.
-struct IntermediateReference {
-  BlockGraph::ReferenceType type;
-  BlockGraph::Size size;
-  RelativeAddress address;
-};
-
-// A map of intermediate references. This tracks references created by the
-// PEFileParser.
-typedef std::map<RelativeAddress, IntermediateReference>
-    IntermediateReferenceMap;
-
-// Adds a reference to the given intermediate reference map. Used as a callback
-// to PEFileParser.
-bool AddReference(IntermediateReferenceMap* references,
-                  RelativeAddress source,
-                  BlockGraph::ReferenceType type,
-                  BlockGraph::Size size,
-                  RelativeAddress destination) {
-  DCHECK(references != NULL);
-
-  IntermediateReference ref = { type, size, destination };
-  return references->insert(std::make_pair(source, ref)).second;
-}
-
-// Returns the block and offset into the block associated with the given
-// address and size. Sets block pointer to NULL and offset to 0 if no block
-// was found for the address and size. Returns true if a block is found, false
-// otherwise.
-bool LookupBlockOffset(const ImageLayout& image_layout,
-                       RelativeAddress address,
-                       size_t size,
-                       BlockGraph::Block** block,
-                       BlockGraph::Offset* offset) {
-  DCHECK(block != NULL);
-  DCHECK(offset != NULL);
-
-  *block = image_layout.blocks.GetContainingBlock(address, size);
-  if (*block == NULL) {
-    *offset = 0;
-    return false;
-  }
-
-  *offset = address - (*block)->addr();
-  return true;
-}
-
-// Performs a decomposition of the given PE file, only parsing out the PE
-// data blocks and references between them.
-bool MiniDecompose(const PEFile& pe_file,
-                   ImageLayout* image_layout,
-                   BlockGraph::Block** dos_header_block) {
-  DCHECK(image_layout != NULL);
-  DCHECK(dos_header_block != NULL);
-
-  IntermediateReferenceMap references;
-
-  PEFileParser::AddReferenceCallback add_reference = base::Bind(
-      &AddReference, base::Unretained(&references));
-  PEFileParser pe_file_parser(pe_file, &image_layout->blocks, add_reference);
-
-  PEFileParser::PEHeader pe_header;
-  if (!pe_file_parser.ParseImage(&pe_header)) {
-    LOG(ERROR) << "Failed to parse PE file: " << pe_file.path().value();
-    return false;
-  }
-
-  if (!pe::CopyHeaderToImageLayout(pe_header.nt_headers, image_layout)) {
-    LOG(ERROR) << "Failed to copy NT headers to image layout.";
-    return false;
-  }
-
-  // Finalize the intermediate references. We only finalize those that are
-  // within the closed set of blocks.
-  IntermediateReferenceMap::const_iterator ref_it = references.begin();
-  for (; ref_it != references.end(); ++ref_it) {
-    BlockGraph::Block* src_block = NULL;
-    BlockGraph::Offset src_offset = 0;
-    if (!LookupBlockOffset(*image_layout, ref_it->first, ref_it->second.size,
-                           &src_block, &src_offset)) {
-      continue;
-    }
-
-    BlockGraph::Block* dst_block = NULL;
-    BlockGraph::Offset dst_offset = 0;
-    if (!LookupBlockOffset(*image_layout, ref_it->second.address, 1,
-                           &dst_block, &dst_offset)) {
-      continue;
-    }
-
-    // Make the final reference.
-    BlockGraph::Reference ref(ref_it->second.type, ref_it->second.size,
-                              dst_block, dst_offset, dst_offset);
-    CHECK(src_block->SetReference(src_offset, ref));
-  }
-
-  *dos_header_block = pe_header.dos_header;
+// A map of the modified streams of a PDB file, by stream index.
+typedef std::map<size_t, scoped_refptr<PdbByteStream> > PdbByteStreamMap;
 
-  return true;
-}
+// DbgHelp, which is used to search for the PDB files, is single threaded.
+// This serializes the searches of the ZapTimestamp instances that are
+// running concurrently.
+base::LazyInstance<base::Lock>::Leaky find_pdb_lock = LAZY_INSTANCE_INITIALIZER;
 
 // Marks the range of data at @p rel_addr and of size @p size as needing to be
 // changed. It will be replaced with the data in @p data, and marked with the
@@ -215,48 +116,38 @@ bool MarkData(const PEFile& pe_file,
 // PatchAddressSpace @p file_addr_space.
 template<typename T>
 bool MarkDataDirectoryTimestamps(const PEFile& pe_file,
-                                 NtHeaders& nt_headers,
                                  size_t data_dir_index,
                                  const char* data_dir_name,
                                  const uint8* timestamp_data,
                                  PatchAddressSpace* file_addr_space) {
+  const IMAGE_NT_HEADERS* nt_headers = pe_file.nt_headers();
+  DCHECK(nt_headers != NULL);
   DCHECK_GT(arraysize(nt_headers->OptionalHeader.DataDirectory),
             data_dir_index);
   DCHECK(timestamp_data != NULL);
   DCHECK(file_addr_space != NULL);
 
-  // It is not an error if the debug directory doesn't exist.
+  // It is not an error if the data directory doesn't exist.
   const IMAGE_DATA_DIRECTORY& data_dir_info =
       nt_headers->OptionalHeader.DataDirectory[data_dir_index];
-  if (!nt_headers.HasReference(data_dir_info.VirtualAddress)) {
-    DCHECK_EQ(0u, data_dir_info.VirtualAddress);
+  if (data_dir_info.VirtualAddress == 0) {
     LOG(INFO) << "PE file contains no data directory " << data_dir_index << ".";
     return true;
   }
 
-  ConstTypedBlock<T> data_dir;
-  if (!nt_headers.Dereference(data_dir_info.VirtualAddress, &data_dir)) {
-    LOG(ERROR) << "Failed to dereference data directory " << data_dir_index
-               << ".";
-    return false;
-  }
-
-  FileOffsetAddress data_dir_addr;
-  if (!pe_file.Translate(data_dir.block()->addr(), &data_dir_addr)) {
-    LOG(ERROR) << "Failed to locate data directory " << data_dir_index << ".";
+  RelativeAddress data_dir_addr(data_dir_info.VirtualAddress);
+  T data_dir = { 0 };
+  if (!pe_file.ReadImage(data_dir_addr, &data_dir, sizeof(data_dir))) {
+    LOG(ERROR) << "Failed to read data directory " << data_dir_index << ".";
     return false;
   }
 
-  if (data_dir->TimeDateStamp == 0)
+  if (data_dir.TimeDateStamp == 0)
     return true;
 
-  FileOffsetAddress timestamp_addr = data_dir_addr +
-      data_dir.OffsetOf(data_dir->TimeDateStamp);
-
   std::string name = base::StringPrintf("%s Timestamp", data_dir_name);
-  if (!file_addr_space->Insert(PatchAddressSpace::Range(timestamp_addr,
-                                                        sizeof(DWORD)),
-                               PatchData(timestamp_data, name))) {
+  if (!MarkData(pe_file, data_dir_addr + offsetof(T, TimeDateStamp),
+                sizeof(DWORD), timestamp_data, name, file_addr_space)) {
     LOG(ERROR) << "Failed to mark timestamp of data directory "
                << data_dir_index << ".";
     return false;
@@ -329,26 +220,84 @@ bool UpdateFileInPlace(const base::FilePath& path,
   return true;
 }
 
-// Ensures that the stream with the given ID is writable, returning a scoped
-// pointer to it.
-scoped_refptr<PdbStream> GetWritablePdbStream(size_t index,
+// Replaces the stream with the given ID by an in-memory copy, which is
+// writable in place, returning a pointer to it. Returns NULL if there is no
+// such stream.
+scoped_refptr<PdbByteStream> GetPdbByteStream(size_t index,
                                               PdbFile* pdb_file) {
   DCHECK(pdb_file != NULL);
-  DCHECK_GT(pdb_file->StreamCount(), index);
 
-  scoped_refptr<PdbStream> reader = pdb_file->GetStream(index);
+  if (index >= pdb_file->StreamCount() || pdb_file->GetStream(index) == NULL)
+    return NULL;
+
+  scoped_refptr<PdbByteStream> byte_stream(new PdbByteStream());
+  if (!byte_stream->Init(pdb_file->GetStream(index)))
+    return NULL;
+  pdb_file->ReplaceStream(index, byte_stream);
+
+  return byte_stream;
+}
+
+// Compares the modified copy @p modified of the stream at @p stream_index of
+// a PDB file to its @p original contents, and marks each run of changed bytes
+// for patching. The changes are recorded in @p file_addr_space in terms of
+// offsets in the PDB file, as described by @p layout. The patch data points
+// into @p modified, which must outlive @p file_addr_space.
+bool MarkPdbStreamChanges(const pdb::PdbStreamLayout& layout,
+                          size_t stream_index,
+                          PdbStream* original,
+                          PdbByteStream* modified,
+                          PatchAddressSpace* file_addr_space) {
+  DCHECK_GT(layout.stream_pages.size(), stream_index);
+  DCHECK(original != NULL);
+  DCHECK(modified != NULL);
+  DCHECK(file_addr_space != NULL);
 
-  // Try and get the writer. If it's not available, then replace the stream
-  // with a byte stream, which is in-place writable.
-  scoped_refptr<WritablePdbStream> writer = reader->GetWritablePdbStream();
-  if (writer.get() == NULL) {
-    scoped_refptr<PdbByteStream> byte_stream(new PdbByteStream());
-    byte_stream->Init(reader);
-    pdb_file->ReplaceStream(index, byte_stream);
-    reader = byte_stream;
+  if (original->length() != modified->length()) {
+    LOG(ERROR) << "PDB stream " << stream_index << " changed length.";
+    return false;
+  }
+
+  const std::vector<uint32>& pages = layout.stream_pages[stream_index];
+  std::string name = base::StringPrintf("PDB Stream %d", stream_index);
+  std::vector<uint8> page_data;
+  if (!original->Seek(0))
+    return false;
+
+  // The pages of a stream needn't be contiguous in the file, so the runs of
+  // changed bytes are broken at page boundaries.
+  for (size_t page = 0; page < pages.size(); ++page) {
+    size_t offset = page * layout.page_size;
+    size_t count = std::min(layout.page_size, original->length() - offset);
+    if (!original->Read(&page_data, count)) {
+      LOG(ERROR) << "Failed to read PDB stream " << stream_index << ".";
+      return false;
+    }
+
+    const uint8* data = modified->data() + offset;
+    size_t i = 0;
+    while (i < count) {
+      if (page_data[i] == data[i]) {
+        ++i;
+        continue;
+      }
+
+      size_t start = i;
+      while (i < count && page_data[i] != data[i])
+        ++i;
+
+      FileOffsetAddress file_addr(pages[page] * layout.page_size + start);
+      if (!file_addr_space->Insert(
+              PatchAddressSpace::Range(file_addr, i - start),
+              PatchData(data + start, name))) {
+        LOG(ERROR) << "Failed to insert file range at " << file_addr
+                   << " of length " << i - start << ".";
+        return false;
+      }
+    }
   }
 
-  return reader;
+  return true;
 }
 
 void OutputSummaryStats(base::FilePath& path) {
@@ -488,11 +437,10 @@ bool NormalizeSymbolRecordStream(PdbByteStream* stream) {
 }  // namespace
 
 ZapTimestamp::ZapTimestamp()
-    : image_layout_(&block_graph_),
-      dos_header_block_(NULL),
-      write_image_(true),
+    : write_image_(true),
       write_pdb_(true),
-      overwrite_(false) {
+      overwrite_(false),
+      patch_pdb_in_place_(false) {
   // The timestamp can't just be set to zero as that represents a special
   // value in the PE file. We set it to some arbitrary fixed date in the past.
   // This is Jan 1, 2010, 0:00:00 GMT. This date shouldn't be too much in
@@ -512,9 +460,6 @@ bool ZapTimestamp::Init() {
   if (!ValidateOutputPaths())
     return false;
 
-  if (!DecomposePeFile())
-    return false;
-
   if (!MarkPeFileRanges())
     return false;
 
@@ -537,8 +482,13 @@ bool ZapTimestamp::Zap() {
   }
 
   if (!input_pdb_.empty() && write_pdb_) {
-    if (!WritePdbFile())
-      return false;
+    if (patch_pdb_in_place_) {
+      if (!PatchPdbFile())
+        return false;
+    } else {
+      if (!WritePdbFile())
+        return false;
+    }
     OutputSummaryStats(input_pdb_);
   }
 
@@ -567,6 +517,7 @@ bool ZapTimestamp::ValidatePeAndPdbFiles() {
       return true;
 
     // Find the matching PDB file.
+    base::AutoLock auto_lock(find_pdb_lock.Get());
     if (!pe::FindPdbForModule(input_image_, &input_pdb_)) {
       LOG(ERROR) << "Error while searching for PDB file.";
       return false;
@@ -636,36 +587,16 @@ bool ZapTimestamp::ValidateOutputPaths() {
   return true;
 }
 
-bool ZapTimestamp::DecomposePeFile() {
-  // Decompose the image. This is a very high level decomposition only
-  // chunking out the PE structures and references from/to PE blocks.
-  BlockGraph::Block* dos_header_block = NULL;
-  if (!MiniDecompose(pe_file_, &image_layout_, &dos_header_block_))
-    return false;
-
-  return true;
-}
-
 bool ZapTimestamp::MarkPeFileRanges() {
-  DCHECK(dos_header_block_ != NULL);
   LOG(INFO) << "Finding PE fields that need updating.";
 
-  DosHeader dos_header;
-  if (!dos_header.Init(0, dos_header_block_)) {
-    LOG(ERROR) << "Failed to cast IMAGE_DOS_HEADER.";
-    return false;
-  }
-
-  NtHeaders nt_headers;
-  if (!dos_header.Dereference(dos_header->e_lfanew, &nt_headers)) {
-    LOG(ERROR) << "Failed to dereference IMAGE_NT_HEADERS.";
-    return false;
-  }
+  const IMAGE_NT_HEADERS* nt_headers = pe_file_.nt_headers();
+  DCHECK(nt_headers != NULL);
+  RelativeAddress nt_headers_addr(pe_file_.dos_header()->e_lfanew);
 
   // Mark the export data directory timestamp.
   if (!MarkDataDirectoryTimestamps<IMAGE_EXPORT_DIRECTORY>(
-          pe_file_, nt_headers, IMAGE_DIRECTORY_ENTRY_EXPORT,
-          "Export Directory",
+          pe_file_, IMAGE_DIRECTORY_ENTRY_EXPORT, "Export Directory",
           reinterpret_cast<const uint8*>(&timestamp_data_),
           &pe_file_addr_space_)) {
     // This logs verbosely on failure.
@@ -674,62 +605,69 @@ bool ZapTimestamp::MarkPeFileRanges() {
 
   // Mark the resource data directory timestamp.
   if (!MarkDataDirectoryTimestamps<IMAGE_RESOURCE_DIRECTORY>(
-          pe_file_, nt_headers, IMAGE_DIRECTORY_ENTRY_RESOURCE,
-          "Resource Directory",
+          pe_file_, IMAGE_DIRECTORY_ENTRY_RESOURCE, "Resource Directory",
           reinterpret_cast<const uint8*>(&timestamp_data_),
           &pe_file_addr_space_)) {
     // This logs verbosely on failure.
     return false;
   }
 
-  // Find the debug directory.
-  ImageDebugDirectory debug_dir;
+  // Run over the debug directory, finding the codeview debug entry. We also
+  // update every other debug timestamp.
   const IMAGE_DATA_DIRECTORY& debug_dir_info =
       nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG];
-  if (nt_headers.HasReference(debug_dir_info.VirtualAddress))
-    nt_headers.Dereference(debug_dir_info.VirtualAddress, &debug_dir);
+  RelativeAddress debug_dir_addr(debug_dir_info.VirtualAddress);
+  size_t debug_dir_count = 0;
+  if (debug_dir_info.VirtualAddress != 0)
+    debug_dir_count = debug_dir_info.Size / sizeof(IMAGE_DEBUG_DIRECTORY);
 
-  // Within that, find the codeview debug entry. We also update every other
-  // debug timestamp.
-  CvInfoPdb cv_info_pdb;
+  RelativeAddress cv_info_pdb_addr;
+  bool found_cv_info_pdb = false;
   RelativeAddress rel_addr;
-  if (debug_dir.block()) {
-    for (size_t i = 0; i < debug_dir.ElementCount(); ++i) {
-      rel_addr = debug_dir.block()->addr() +
-          debug_dir.OffsetOf(debug_dir[i].TimeDateStamp);
-      std::string name = base::StringPrintf("Debug Directory %d Timestamp", i);
-      if (!MarkData(pe_file_, rel_addr, sizeof(timestamp_data_),
-                    reinterpret_cast<const uint8*>(&timestamp_data_), name,
-                    &pe_file_addr_space_)) {
-        LOG(ERROR) << "Failed to mark TimeDateStamp of debug directory " << i
-                   << ".";
+  for (size_t i = 0; i < debug_dir_count; ++i) {
+    RelativeAddress debug_entry_addr =
+        debug_dir_addr + i * sizeof(IMAGE_DEBUG_DIRECTORY);
+    IMAGE_DEBUG_DIRECTORY debug_dir = { 0 };
+    if (!pe_file_.ReadImage(debug_entry_addr, &debug_dir, sizeof(debug_dir))) {
+      LOG(ERROR) << "Failed to read debug directory " << i << ".";
+      return false;
+    }
+
+    rel_addr = debug_entry_addr +
+        offsetof(IMAGE_DEBUG_DIRECTORY, TimeDateStamp);
+    std::string name = base::StringPrintf("Debug Directory %d Timestamp", i);
+    if (!MarkData(pe_file_, rel_addr, sizeof(timestamp_data_),
+                  reinterpret_cast<const uint8*>(&timestamp_data_), name,
+                  &pe_file_addr_space_)) {
+      LOG(ERROR) << "Failed to mark TimeDateStamp of debug directory " << i
+                 << ".";
+      return false;
+    }
+
+    if (debug_dir.Type == IMAGE_DEBUG_TYPE_CODEVIEW) {
+      if (found_cv_info_pdb) {
+        LOG(ERROR) << "Found multiple CodeView debug directories.";
         return false;
       }
-
-      if (debug_dir[i].Type == IMAGE_DEBUG_TYPE_CODEVIEW) {
-        if (cv_info_pdb.block() != NULL) {
-          LOG(ERROR) << "Found multiple CodeView debug directories.";
-          return false;
-        }
-        if (!debug_dir.Dereference(debug_dir[i].PointerToRawData,
-                                   &cv_info_pdb)) {
-          LOG(ERROR) << "Failed to dereference CodeView debug directory.";
-          return false;
-        }
+      // The debug directory refers to its data by file offset.
+      if (!pe_file_.Translate(FileOffsetAddress(debug_dir.PointerToRawData),
+                              &cv_info_pdb_addr)) {
+        LOG(ERROR) << "Failed to locate CodeView debug directory.";
+        return false;
       }
+      found_cv_info_pdb = true;
     }
   }
 
   // We should have found a code view debug directory pointing to the PDB file.
   if (!input_pdb_.empty()) {
-    if (cv_info_pdb.block() == NULL) {
+    if (!found_cv_info_pdb) {
       LOG(ERROR) << "Failed to find CodeView debug directory.";
       return false;
     }
 
     // Get the file offset of the PDB age and mark it.
-    rel_addr = cv_info_pdb.block()->addr() +
-        cv_info_pdb.OffsetOf(cv_info_pdb->pdb_age);
+    rel_addr = cv_info_pdb_addr + offsetof(pe::CvInfoPdb70, pdb_age);
     if (!MarkData(pe_file_, rel_addr, sizeof(pdb_age_data_),
                   reinterpret_cast<const uint8*>(&pdb_age_data_),
                   "PDB Age", &pe_file_addr_space_)) {
@@ -738,8 +676,7 @@ bool ZapTimestamp::MarkPeFileRanges() {
     }
 
     // Get the file offset of the PDB guid and mark it.
-    rel_addr = cv_info_pdb.block()->addr() +
-        cv_info_pdb.OffsetOf(cv_info_pdb->signature);
+    rel_addr = cv_info_pdb_addr + offsetof(pe::CvInfoPdb70, signature);
     if (!MarkData(pe_file_, rel_addr, sizeof(pdb_guid_data_),
                   reinterpret_cast<const uint8*>(&pdb_guid_data_),
                   "PDB GUID", &pe_file_addr_space_)) {
@@ -749,8 +686,8 @@ bool ZapTimestamp::MarkPeFileRanges() {
   }
 
   // Get the file offset of the PE checksum and mark it.
-  rel_addr = nt_headers.block()->addr() +
-      nt_headers.OffsetOf(nt_headers->OptionalHeader.CheckSum);
+  rel_addr = nt_headers_addr +
+      offsetof(IMAGE_NT_HEADERS, OptionalHeader.CheckSum);
   if (!MarkData(pe_file_, rel_addr, sizeof(DWORD), NULL,
                 "PE Checksum", &pe_file_addr_space_)) {
     LOG(ERROR) << "Failed to mark PE checksum.";
@@ -758,8 +695,8 @@ bool ZapTimestamp::MarkPeFileRanges() {
   }
 
   // Get the file offset of the PE timestamp and mark it.
-  rel_addr = nt_headers.block()->addr() +
-      nt_headers.OffsetOf(nt_headers->FileHeader.TimeDateStamp);
+  rel_addr = nt_headers_addr +
+      offsetof(IMAGE_NT_HEADERS, FileHeader.TimeDateStamp);
   if (!MarkData(pe_file_, rel_addr, sizeof(timestamp_data_),
                 reinterpret_cast<uint8*>(&timestamp_data_), "PE Timestamp",
                 &pe_file_addr_space_)) {
@@ -843,25 +780,36 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
 
   pdb_file_.reset(new PdbFile());
   PdbReader pdb_reader;
-  if (!pdb_reader.Read(input_pdb_, pdb_file_.get())) {
+  pdb::PdbStreamLayout pdb_layout;
+  if (!pdb_reader.Read(input_pdb_, pdb_file_.get(), &pdb_layout)) {
     LOG(ERROR) << "Failed to read PDB file: " << input_pdb_.value();
     return false;
   }
 
+  // Keep a hold of the original streams. When patching in place the modified
+  // streams are compared to them to find the bytes that changed.
+  std::vector<scoped_refptr<PdbStream> > original_streams;
+  for (size_t i = 0; i < pdb_file_->StreamCount(); ++i)
+    original_streams.push_back(pdb_file_->GetStream(i));
+
   // We turf the old directory stream as a fresh PDB does not have one. It's
   // also meaningless after we rewrite a PDB as the old blocks it refers to
-  // will no longer exist.
-  pdb_file_->ReplaceStream(pdb::kPdbOldDirectoryStream, NULL);
-
-  scoped_refptr<PdbStream> header_reader =
-      GetWritablePdbStream(pdb::kPdbHeaderInfoStream, pdb_file_.get());
-  if (header_reader.get() == NULL) {
+  // will no longer exist. When patching in place the blocks stay put, and so
+  // does the stream.
+  if (!patch_pdb_in_place_)
+    pdb_file_->ReplaceStream(pdb::kPdbOldDirectoryStream, NULL);
+
+  PdbByteStreamMap modified_streams;
+  scoped_refptr<PdbByteStream> header_stream =
+      GetPdbByteStream(pdb::kPdbHeaderInfoStream, pdb_file_.get());
+  if (header_stream.get() == NULL) {
     LOG(ERROR) << "No header info stream in PDB file: " << input_pdb_.value();
     return false;
   }
+  modified_streams[pdb::kPdbHeaderInfoStream] = header_stream;
 
   scoped_refptr<WritablePdbStream> header_writer =
-      header_reader->GetWritablePdbStream();
+      header_stream->GetWritablePdbStream();
   DCHECK(header_writer.get() != NULL);
 
   // Update the timestamp, the age and the signature.
@@ -872,9 +820,10 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   header_writer->Write(pdb_guid_data_);
 
   // Normalize the DBI stream in place.
-  scoped_refptr<PdbByteStream> dbi_stream(new PdbByteStream());
-  CHECK(dbi_stream->Init(pdb_file_->GetStream(pdb::kDbiStream)));
-  pdb_file_->ReplaceStream(pdb::kDbiStream, dbi_stream);
+  scoped_refptr<PdbByteStream> dbi_stream =
+      GetPdbByteStream(pdb::kDbiStream, pdb_file_.get());
+  CHECK(dbi_stream.get() != NULL);
+  modified_streams[pdb::kDbiStream] = dbi_stream;
   if (!NormalizeDbiStream(pdb_age_data_, dbi_stream)) {
     LOG(ERROR) << "Failed to normalize DBI stream.";
     return false;
@@ -884,10 +833,10 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
   pdb::DbiHeader* dbi_header = reinterpret_cast<pdb::DbiHeader*>(dbi_data);
 
   // Normalize the symbol record stream in place.
-  scoped_refptr<PdbByteStream> symrec_stream(new PdbByteStream());
-  CHECK(symrec_stream->Init(pdb_file_->GetStream(
-      dbi_header->symbol_record_stream)));
-  pdb_file_->ReplaceStream(dbi_header->symbol_record_stream, symrec_stream);
+  scoped_refptr<PdbByteStream> symrec_stream = GetPdbByteStream(
+      dbi_header->symbol_record_stream, pdb_file_.get());
+  CHECK(symrec_stream.get() != NULL);
+  modified_streams[dbi_header->symbol_record_stream] = symrec_stream;
   if (!NormalizeSymbolRecordStream(symrec_stream)) {
     LOG(ERROR) << "Failed to normalize symbol record stream.";
     return false;
@@ -895,14 +844,32 @@ bool ZapTimestamp::LoadAndUpdatePdbFile() {
 
   // Normalize the public symbol info stream. There's a DWORD of padding at
   // offset 24 that we want to zero.
-  scoped_refptr<PdbStream> pubsym_reader = GetWritablePdbStream(
+  scoped_refptr<PdbByteStream> pubsym_stream = GetPdbByteStream(
       dbi_header->public_symbol_info_stream, pdb_file_.get());
+  CHECK(pubsym_stream.get() != NULL);
+  modified_streams[dbi_header->public_symbol_info_stream] = pubsym_stream;
   scoped_refptr<WritablePdbStream> pubsym_writer =
-      pubsym_reader->GetWritablePdbStream();
+      pubsym_stream->GetWritablePdbStream();
   DCHECK(pubsym_writer.get() != NULL);
   pubsym_writer->set_pos(24);
   pubsym_writer->Write(static_cast<uint32>(0));
 
+  if (!patch_pdb_in_place_)
+    return true;
+
+  // Find the bytes of the PDB file that need to be patched.
+  LOG(INFO) << "Finding PDB pages that need updating.";
+  PdbByteStreamMap::const_iterator stream_it = modified_streams.begin();
+  for (; stream_it != modified_streams.end(); ++stream_it) {
+    if (!MarkPdbStreamChanges(pdb_layout,
+                              stream_it->first,
+                              original_streams[stream_it->first],
+                              stream_it->second,
+                              &pdb_file_addr_space_)) {
+      return false;  // This logs verbosely for us.
+    }
+  }
+
   return true;
 }
 
@@ -974,4 +941,29 @@ bool ZapTimestamp::WritePdbFile() {
   return true;
 }
 
+bool ZapTimestamp::PatchPdbFile() {
+  DCHECK(!input_pdb_.empty());
+  DCHECK(pdb_file_.get() != NULL);
+
+  if (core::CompareFilePaths(input_pdb_, output_pdb_) !=
+          core::kEquivalentFilePaths) {
+    if (::CopyFileW(input_pdb_.value().c_str(),
+                    output_pdb_.value().c_str(),
+                    FALSE) == FALSE) {
+      LOG(ERROR) << "Failed to write output PDB: " << output_pdb_.value();
+      return false;
+    }
+  }
+
+  if (!UpdateFileInPlace(output_pdb_, pdb_file_addr_space_))
+    return false;
+
+  // The patches refer to the streams of the PDB file, so it can only be freed
+  // up now.
+  pdb_file_addr_space_.Clear();
+  pdb_file_.reset(NULL);
+
+  return true;
+}
+
 }  // namespace zap_timestamp
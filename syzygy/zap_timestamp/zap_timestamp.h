@@ -20,10 +20,8 @@
 
 #include "base/files/file_path.h"
 #include "base/strings/string_piece.h"
-#include "syzygy/block_graph/block_graph.h"
 #include "syzygy/core/address_space.h"
 #include "syzygy/pdb/pdb_file.h"
-#include "syzygy/pe/image_layout.h"
 #include "syzygy/pe/pe_file.h"
 
 namespace zap_timestamp {
@@ -60,6 +58,9 @@ class ZapTimestamp {
   void set_timestamp_value(size_t timestamp_value) {
     timestamp_data_ = static_cast<size_t>(timestamp_value);
   }
+  void set_patch_pdb_in_place(bool patch_pdb_in_place) {
+    patch_pdb_in_place_ = patch_pdb_in_place;
+  }
   // @}
 
   // @name Accessors.
@@ -74,6 +75,7 @@ class ZapTimestamp {
   size_t timestamp_value() const {
     return static_cast<size_t>(timestamp_data_);
   }
+  bool patch_pdb_in_place() const { return patch_pdb_in_place_; }
   // @}
 
   // Prepares for modifying the given PE file. Tracks down all of the bytes
@@ -105,37 +107,41 @@ class ZapTimestamp {
   // |output_pdb_| are configured.
   bool ValidateOutputPaths();
 
-  // Decomposes the PE file. After this is complete block_graph_, image_layout_
-  // and pe_file_ and dos_header_block_ have been initialized.
-  bool DecomposePeFile();
-
-  // Paints the regions of the PE file that need to be modified.
+  // Paints the regions of the PE file that need to be modified. This only
+  // looks at the headers and the few data directories carrying a timestamp,
+  // rather than decomposing the image.
   bool MarkPeFileRanges();
 
   // Calculates a PDB GUID using the non-changing parts of the PE file.
   bool CalculatePdbGuid();
 
-  // Loads the PDB file and updates its in-memory representation.
+  // Loads the PDB file and updates its in-memory representation. When
+  // patching the PDB in place this also paints the regions of the PDB file
+  // that need to be modified.
   bool LoadAndUpdatePdbFile();
 
   // @{
-  // These do the actual writing of the individual files.
+  // These do the actual writing of the individual files. WritePdbFile
+  // rewrites the whole PDB, while PatchPdbFile only modifies the bytes that
+  // changed.
   bool WritePeFile();
   bool WritePdbFile();
+  bool PatchPdbFile();
   // @}
 
-  // Initialized by DecomposePeFile.
-  block_graph::BlockGraph block_graph_;
-  pe::ImageLayout image_layout_;
+  // Initialized by ValidatePeAndPdbFiles.
   pe::PEFile pe_file_;
-  block_graph::BlockGraph::Block* dos_header_block_;
 
   // Populated by MarkPeFileRanges.
   PatchAddressSpace pe_file_addr_space_;
 
-  // Populated by LoadPdbFile and modified by UpdatePdbFile.
+  // Populated by LoadAndUpdatePdbFile.
   scoped_ptr<pdb::PdbFile> pdb_file_;
 
+  // Populated by LoadAndUpdatePdbFile when patching the PDB in place. The
+  // patch data refers to the streams of pdb_file_.
+  PatchAddressSpace pdb_file_addr_space_;
+
   // These house the new values to be written when the image is zapped.
   DWORD timestamp_data_;
   DWORD pdb_age_data_;
@@ -149,6 +155,7 @@ class ZapTimestamp {
   bool write_image_;
   bool write_pdb_;
   bool overwrite_;
+  bool patch_pdb_in_place_;
 
   DISALLOW_COPY_AND_ASSIGN(ZapTimestamp);
 };
@@ -14,6 +14,7 @@
 
 #include "syzygy/zap_timestamp/zap_timestamp_app.h"
 
+#include "base/bind.h"
 #include "base/strings/string_number_conversions.h"
 
 namespace zap_timestamp {
@@ -22,15 +23,23 @@ namespace {
 
 const char kUsageFormatStr[] =
     "Usage: %ls --input-image=<PE file>\n"
+    "       %ls --overwrite [options] <PE file> [<PE file> ...]\n"
     "\n"
     "  A tool that normalizes the GUID and timestamps associated with a\n"
     "  given PE/PDB file pair. The PDB files matching each given PE file can\n"
     "  be tracked down automatically.\n"
     "\n"
+    "  In the second form the PE files and their matching PDB files are\n"
+    "  all normalized in place, several at a time. The --input-pdb,\n"
+    "  --output-image and --output-pdb options can't be used in this mode.\n"
+    "\n"
     "Options:\n"
     "  --input-pdb=<PDB path>\n"
     "    If specified then this PDB will be used as the matching PDB. Will\n"
     "    fail if the PDB and the PE file are not paired.\n"
+    "  --jobs=<count>\n"
+    "    The number of PE files to normalize concurrently in batch mode.\n"
+    "    Defaults to 1.\n"
     "  --no-write-image\n"
     "    If this is specified then the PE file will not be written.\n"
     "  --no-write-pdb\n"
@@ -43,10 +52,15 @@ const char kUsageFormatStr[] =
     "    Specifies the output PDB path. If this is not specified but\n"
     "    --output-image is, then will place the PDB alongside the output\n"
     "    image with the same basename. If this is specified then\n"
-    "    --output-image must also be specified."
+    "    --output-image must also be specified.\n"
     "  --overwrite\n"
     "    If specified will allow overwriting of existing output files. Must\n"
     "    be specified for in place processing.\n"
+    "  --patch-pdb-in-place\n"
+    "    If specified then only the bytes of the PDB file that need to be\n"
+    "    normalized are updated, instead of rewriting the whole file. This is\n"
+    "    much faster, but the layout of the PDB file is left as is, so it is\n"
+    "    only reproducible if that layout already is.\n"
     "  --timestamp-value=<seconds since Jan 1, 1970>\n"
     "    The timestamp value to use in the binaries, if not specified an\n"
     "    arbitrary date in the past will be used (default to Jan 1, 2010).\n";
@@ -59,7 +73,30 @@ void PrintUsage(FILE* out,
     ::fprintf(out, "\n\n");
   }
 
-  ::fprintf(out, kUsageFormatStr, program.BaseName().value().c_str());
+  base::FilePath program_name = program.BaseName();
+  ::fprintf(out, kUsageFormatStr, program_name.value().c_str(),
+            program_name.value().c_str());
+}
+
+// Zaps an image in place, with a transform configured like @p config.
+// @returns true on success, false otherwise.
+bool ZapImage(const ZapTimestamp* config, const base::FilePath& image) {
+  DCHECK(config != NULL);
+
+  ZapTimestamp zap;
+  zap.set_input_image(image);
+  zap.set_write_image(config->write_image());
+  zap.set_write_pdb(config->write_pdb());
+  zap.set_overwrite(config->overwrite());
+  zap.set_timestamp_value(config->timestamp_value());
+  zap.set_patch_pdb_in_place(config->patch_pdb_in_place());
+
+  if (!zap.Init() || !zap.Zap()) {
+    LOG(ERROR) << "Failed to zap image: " << image.value();
+    return false;
+  }
+
+  return true;
 }
 
 }  // namespace
@@ -73,11 +110,27 @@ bool ZapTimestampApp::ParseCommandLine(const CommandLine* command_line) {
   }
 
   base::FilePath path = command_line->GetSwitchValuePath("input-image");
-  if (path.empty()) {
+  const CommandLine::StringVector& args = command_line->GetArgs();
+  if (path.empty() && args.empty()) {
     PrintUsage(out(), command_line->GetProgram(),
                "You must specify --input-image.");
     return false;
   }
+
+  // Any images given as arguments put us in batch mode.
+  if (!args.empty()) {
+    if (!path.empty())
+      batch_images_.push_back(path);
+    for (size_t i = 0; i < args.size(); ++i)
+      batch_images_.push_back(base::FilePath(args[i]));
+    if (command_line->HasSwitch("input-pdb") ||
+        command_line->HasSwitch("output-image") ||
+        command_line->HasSwitch("output-pdb")) {
+      PrintUsage(out(), command_line->GetProgram(),
+                 "Batch mode only supports zapping images in place.");
+      return false;
+    }
+  }
   zap_.set_input_image(path);
 
   zap_.set_input_pdb(command_line->GetSwitchValuePath("input-pdb"));
@@ -86,6 +139,13 @@ bool ZapTimestampApp::ParseCommandLine(const CommandLine* command_line) {
   zap_.set_write_image(!command_line->HasSwitch("no-write-image"));
   zap_.set_write_pdb(!command_line->HasSwitch("no-write-pdb"));
   zap_.set_overwrite(command_line->HasSwitch("overwrite"));
+  zap_.set_patch_pdb_in_place(command_line->HasSwitch("patch-pdb-in-place"));
+
+  if (!ParseJobs(command_line, &num_jobs_)) {
+    PrintUsage(out(), command_line->GetProgram(),
+               "Invalid number of jobs.");
+    return false;
+  }
 
   if (command_line->HasSwitch("timestamp-value")) {
     size_t timestamp_value = 0;
@@ -102,6 +162,9 @@ bool ZapTimestampApp::ParseCommandLine(const CommandLine* command_line) {
 }
 
 int ZapTimestampApp::Run() {
+  if (!batch_images_.empty())
+    return ZapBatch() ? 0 : 1;
+
   if (!zap_.Init())
     return 1;
 
@@ -111,4 +174,15 @@ int ZapTimestampApp::Run() {
   return 0;
 }
 
+bool ZapTimestampApp::ZapBatch() {
+  DCHECK(!batch_images_.empty());
+
+  // Keep going on failure, so that a single bad image doesn't prevent the
+  // others from being zapped.
+  application::JobPool pool("ZapTimestampApp", num_jobs_);
+  for (size_t i = 0; i < batch_images_.size(); ++i)
+    pool.AddJob(base::Bind(&ZapImage, &zap_, batch_images_[i]));
+  return pool.Run();
+}
+
 }  // namespace zap_timestamp
@@ -15,6 +15,9 @@
 #ifndef SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_APP_H_
 #define SYZYGY_ZAP_TIMESTAMP_ZAP_TIMESTAMP_APP_H_
 
+#include <vector>
+
+#include "base/files/file_path.h"
 #include "syzygy/application/application.h"
 #include "syzygy/zap_timestamp/zap_timestamp.h"
 
@@ -23,7 +26,7 @@ namespace zap_timestamp {
 // The application class that actually runs ZapTimestamp.
 class ZapTimestampApp : public application::AppImplBase {
  public:
-  ZapTimestampApp() : AppImplBase("Zap Timestamp") { }
+  ZapTimestampApp() : AppImplBase("Zap Timestamp"), num_jobs_(1) { }
 
   // @name Implementation of the AppImplbase interface.
   // @{
@@ -32,9 +35,21 @@ class ZapTimestampApp : public application::AppImplBase {
   // @}
 
  protected:
+  // Zaps each of the batch images in place, running up to num_jobs_ of them
+  // concurrently. Each image gets its own transform, configured like zap_.
+  // @returns true if all of the images were successfully zapped.
+  bool ZapBatch();
+
   // The actual transform. Configuration is performed directly on it.
   ZapTimestamp zap_;
 
+  // The images to be zapped in batch mode. This is empty when zapping a
+  // single image.
+  std::vector<base::FilePath> batch_images_;
+
+  // The maximum number of images to zap concurrently in batch mode.
+  size_t num_jobs_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(ZapTimestampApp);
 };
@@ -14,6 +14,8 @@
 
 #include "syzygy/zap_timestamp/zap_timestamp_app.h"
 
+#include "base/file_util.h"
+#include "base/strings/stringprintf.h"
 #include "gtest/gtest.h"
 #include "syzygy/pe/unittest_util.h"
 
@@ -23,6 +25,8 @@ namespace {
 
 class TestZapTimestampApp : public ZapTimestampApp {
  public:
+  using ZapTimestampApp::batch_images_;
+  using ZapTimestampApp::num_jobs_;
   using ZapTimestampApp::zap_;
 };
 
@@ -122,6 +126,63 @@ TEST_F(ZapTimestampAppTest, ParseMaximalCommandLine) {
   EXPECT_FALSE(test_impl_.zap_.write_pdb());
   EXPECT_TRUE(test_impl_.zap_.overwrite());
   EXPECT_EQ(42, test_impl_.zap_.timestamp_value());
+  EXPECT_TRUE(test_impl_.batch_images_.empty());
+}
+
+TEST_F(ZapTimestampAppTest, ParseBatchCommandLine) {
+  cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitch("patch-pdb-in-place");
+  cmd_line_.AppendSwitchASCII("jobs", "4");
+  cmd_line_.AppendArgPath(base::FilePath(L"foo.dll"));
+  cmd_line_.AppendArgPath(base::FilePath(L"bar.dll"));
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+
+  ASSERT_EQ(2u, test_impl_.batch_images_.size());
+  EXPECT_EQ(base::FilePath(L"foo.dll"), test_impl_.batch_images_[0]);
+  EXPECT_EQ(base::FilePath(L"bar.dll"), test_impl_.batch_images_[1]);
+  EXPECT_EQ(4u, test_impl_.num_jobs_);
+  EXPECT_TRUE(test_impl_.zap_.overwrite());
+  EXPECT_TRUE(test_impl_.zap_.patch_pdb_in_place());
+}
+
+TEST_F(ZapTimestampAppTest, ParseBatchCommandLineFailsWithOutputImage) {
+  cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitchPath("output-image", base::FilePath(L"baz.dll"));
+  cmd_line_.AppendArgPath(base::FilePath(L"foo.dll"));
+  cmd_line_.AppendArgPath(base::FilePath(L"bar.dll"));
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ZapTimestampAppTest, ParseInvalidJobs) {
+  cmd_line_.AppendSwitchPath("input-image", base::FilePath(L"foo.dll"));
+  cmd_line_.AppendSwitchASCII("jobs", "0");
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
+TEST_F(ZapTimestampAppTest, RunBatch) {
+  // Make two copies of the test DLL and its PDB.
+  base::FilePath images[2];
+  for (size_t i = 0; i < arraysize(images); ++i) {
+    base::FilePath dir = temp_dir_.Append(base::StringPrintf(L"copy%d", i));
+    ASSERT_TRUE(base::CreateDirectory(dir));
+    images[i] = dir.Append(testing::kTestDllName);
+    ASSERT_TRUE(base::CopyFile(
+        testing::GetExeRelativePath(testing::kTestDllName), images[i]));
+    ASSERT_TRUE(base::CopyFile(
+        testing::GetExeRelativePath(testing::kTestDllPdbName),
+        dir.Append(testing::kTestDllPdbName)));
+    cmd_line_.AppendArgPath(images[i]);
+  }
+  cmd_line_.AppendSwitch("overwrite");
+  cmd_line_.AppendSwitchASCII("jobs", "2");
+
+  ASSERT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_EQ(0, test_impl_.Run());
+
+  // Both copies were zapped the same way.
+  EXPECT_TRUE(base::ContentsEqual(images[0], images[1]));
+  EXPECT_FALSE(base::ContentsEqual(
+      testing::GetExeRelativePath(testing::kTestDllName), images[0]));
 }
 
 }  // namespace zap_timestamp
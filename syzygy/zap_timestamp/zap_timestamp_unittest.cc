@@ -18,6 +18,7 @@
 #include "base/files/scoped_temp_dir.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/find.h"
 #include "syzygy/pe/unittest_util.h"
 
 namespace zap_timestamp {
@@ -308,6 +309,69 @@ TEST_F(ZapTimestampTest, Succeeds) {
   EXPECT_TRUE(base::ContentsEqual(temp_pdb_path_, pdb_path_1));
 }
 
+TEST_F(ZapTimestampTest, IsIdempotentPatchPdbInPlace) {
+  // Zap the first set of the PE and PDB files, patching the PDB in place.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap0;
+  zap0.set_input_image(temp_pe_path_);
+  zap0.set_overwrite(true);
+  zap0.set_patch_pdb_in_place(true);
+  EXPECT_TRUE(zap0.Init());
+  EXPECT_TRUE(zap0.Zap());
+
+  // The PDB should keep its size, and still match the image.
+  int64 pdb_size = 0;
+  int64 zapped_pdb_size = 0;
+  ASSERT_TRUE(base::GetFileSize(test_paths_[0].pdb_path, &pdb_size));
+  ASSERT_TRUE(base::GetFileSize(temp_pdb_path_, &zapped_pdb_size));
+  EXPECT_EQ(pdb_size, zapped_pdb_size);
+  EXPECT_FALSE(base::ContentsEqual(test_paths_[0].pdb_path, temp_pdb_path_));
+  EXPECT_TRUE(pe::PeAndPdbAreMatched(temp_pe_path_, temp_pdb_path_));
+
+  // Make a copy of the singly zapped files.
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  base::FilePath pdb_path_0 = temp_dir_.path().Append(L"test_dll_0.pdb");
+  ASSERT_TRUE(base::CopyFile(temp_pe_path_, pe_path_0));
+  ASSERT_TRUE(base::CopyFile(temp_pdb_path_, pdb_path_0));
+
+  // Zap them again.
+  ZapTimestamp zap1;
+  zap1.set_input_image(temp_pe_path_);
+  zap1.set_overwrite(true);
+  zap1.set_patch_pdb_in_place(true);
+  EXPECT_TRUE(zap1.Init());
+  EXPECT_TRUE(zap1.Zap());
+
+  // The singly and doubly zapped files should be the same.
+  EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path_0));
+  EXPECT_TRUE(base::ContentsEqual(temp_pdb_path_, pdb_path_0));
+}
+
+TEST_F(ZapTimestampTest, PatchPdbInPlaceMatchesRewrittenImage) {
+  // Zap the image while rewriting the PDB.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap0;
+  zap0.set_input_image(temp_pe_path_);
+  zap0.set_overwrite(true);
+  EXPECT_TRUE(zap0.Init());
+  EXPECT_TRUE(zap0.Zap());
+
+  base::FilePath pe_path_0 = temp_dir_.path().Append(L"test_dll_0.dll");
+  ASSERT_TRUE(base::Move(temp_pe_path_, pe_path_0));
+
+  // Zap it again while patching the PDB in place. The images should be the
+  // same either way.
+  ASSERT_NO_FATAL_FAILURE(CopyTestData(0));
+  ZapTimestamp zap1;
+  zap1.set_input_image(temp_pe_path_);
+  zap1.set_overwrite(true);
+  zap1.set_patch_pdb_in_place(true);
+  EXPECT_TRUE(zap1.Init());
+  EXPECT_TRUE(zap1.Zap());
+
+  EXPECT_TRUE(base::ContentsEqual(temp_pe_path_, pe_path_0));
+}
+
 TEST_F(ZapTimestampTest, IsIdempotentNoPdb) {
   // Zap the iage.
   ASSERT_NO_FATAL_FAILURE(CopyNoPdbTestData());